@@ -0,0 +1,228 @@
+/*
+ * bench.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ *
+ * BloodHornBench.efi: times the boot-path crypto primitives on real
+ * firmware, once with the portable code and once with every hardware
+ * backend the CPU offers, and prints cycles per byte from the libb
+ * performance counter (one tick per cycle on TSC-based TimerLibs).
+ */
+
+#include <Uefi.h>
+#include "../compat.h"
+#include <Library/UefiLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/TimerLib.h>
+#include "../boot/libb/include/bloodhorn/bloodhorn.h"
+#include "../security/crypto.h"
+#include "bench_rsa.h"
+
+#define BENCH_MAX_SIZE      (64 * 1024 * 1024)
+#define BENCH_MIN_BYTES     (16 * 1024 * 1024)  // repeat small inputs up to this much
+#define BENCH_SIZE_COUNT    3
+
+STATIC CONST UINT32 mBenchSizes[BENCH_SIZE_COUNT] = { 4 * 1024, 1024 * 1024, BENCH_MAX_SIZE };
+STATIC CONST UINT32 mBenchIterations[BENCH_SIZE_COUNT] = { 1000, 10000, 100000 };
+
+STATIC UINT64 mCounterStart = 0;
+STATIC UINT64 mCounterEnd = 0;
+STATIC UINT64 mCounterFrequency = 0;
+
+STATIC bh_uint64_t BenchCounterFrequency(void) {
+    if (mCounterFrequency == 0) {
+        mCounterFrequency = GetPerformanceCounterProperties(&mCounterStart, &mCounterEnd);
+    }
+    return mCounterFrequency;
+}
+
+STATIC bh_uint64_t BenchCounter(void) {
+    UINT64 Ticks;
+
+    BenchCounterFrequency();
+    Ticks = GetPerformanceCounter();
+    // Some timers count down; present a monotonically increasing value
+    return mCounterStart > mCounterEnd ? mCounterStart - Ticks : Ticks;
+}
+
+STATIC bh_system_table_t mBenchSystemTable = {
+    .alloc = (void* (*)(bh_size_t))AllocatePool,
+    .free = (void (*)(void*))FreePool,
+    .alloc_pages = (void* (*)(bh_size_t))AllocatePages,
+    .free_pages = (void (*)(void*, bh_size_t))FreePages,
+    .get_performance_counter = BenchCounter,
+    .get_performance_frequency = BenchCounterFrequency
+};
+
+typedef struct {
+    UINT8               *Data;
+    UINT8               *Out;
+    crypto_aes_ctx_t    Aes;
+    UINT32              SizeIndex;
+} BENCH_STATE;
+
+// One run of a primitive over `Length` bytes; FALSE if it did not succeed
+typedef BOOLEAN (*BENCH_FN)(BENCH_STATE *State, UINT32 Length);
+
+STATIC BOOLEAN BenchSha256(BENCH_STATE *State, UINT32 Length) {
+    UINT8 Hash[CRYPTO_SHA256_DIGEST_LENGTH];
+    sha256_hash(State->Data, Length, Hash);
+    return TRUE;
+}
+
+STATIC BOOLEAN BenchSha512(BENCH_STATE *State, UINT32 Length) {
+    UINT8 Hash[CRYPTO_SHA512_DIGEST_LENGTH];
+    sha512_hash(State->Data, Length, Hash);
+    return TRUE;
+}
+
+STATIC BOOLEAN BenchBlake3(BENCH_STATE *State, UINT32 Length) {
+    UINT8 Hash[CRYPTO_BLAKE3_DIGEST_LENGTH];
+    blake3_hash(State->Data, Length, Hash);
+    return TRUE;
+}
+
+STATIC BOOLEAN BenchAesGcm(BENCH_STATE *State, UINT32 Length) {
+    STATIC CONST UINT8 Iv[12] = { 0 };
+    UINT8 Tag[16];
+    return crypto_aes_gcm_encrypt(&State->Aes, Iv, sizeof(Iv), NULL, 0, State->Data, Length,
+                                  State->Out, Tag) == CRYPTO_SUCCESS;
+}
+
+STATIC BOOLEAN BenchVerify(BENCH_STATE *State, UINT32 Length) {
+    return verify_signature(State->Data, Length, mBenchRsaSig[State->SizeIndex], mBenchRsaKey) == CRYPTO_SUCCESS;
+}
+
+typedef struct {
+    CONST CHAR8 *Name;
+    BENCH_FN    Run;
+} BENCH_PRIMITIVE;
+
+STATIC CONST BENCH_PRIMITIVE mBenchPrimitives[] = {
+    { "sha256_hash",            BenchSha256 },
+    { "sha512_hash",            BenchSha512 },
+    { "blake3_hash",            BenchBlake3 },
+    { "crypto_aes_gcm_encrypt", BenchAesGcm },
+    { "verify_signature",       BenchVerify },
+};
+
+// Hundredths, for printing without floating point
+STATIC VOID PrintFixed2(UINT64 Hundredths) {
+    Print(L"%5lu.%02lu", Hundredths / 100, Hundredths % 100);
+}
+
+STATIC VOID PrintRate(UINT64 Bytes, UINT64 Ticks) {
+    UINT64 Hz = bh_get_performance_frequency();
+
+    PrintFixed2(Bytes ? Ticks * 100 / Bytes : 0);
+    Print(L" cycles/byte");
+    if (Hz != 0 && Ticks != 0) {
+        // MiB/s = Bytes * Hz / Ticks / 2^20, split to keep it in 64 bits
+        Print(L"  %6lu MiB/s", (Bytes >> 10) * (Hz >> 10) / Ticks);
+    }
+    Print(L"\n");
+}
+
+STATIC VOID BenchRunBackend(BENCH_STATE *State) {
+    for (UINTN p = 0; p < ARRAY_SIZE(mBenchPrimitives); p++) {
+        for (UINT32 s = 0; s < BENCH_SIZE_COUNT; s++) {
+            UINT32 Length = mBenchSizes[s];
+            UINT32 Repeats = Length < BENCH_MIN_BYTES ? BENCH_MIN_BYTES / Length : 1;
+            BOOLEAN Ok = TRUE;
+
+            State->SizeIndex = s;
+            mBenchPrimitives[p].Run(State, Length);     // warm caches and backends
+            UINT64 Start = bh_get_performance_counter();
+            for (UINT32 r = 0; r < Repeats; r++) {
+                Ok &= mBenchPrimitives[p].Run(State, Length);
+            }
+            UINT64 Ticks = bh_get_performance_counter() - Start;
+
+            Print(L"  %-24a %6u KiB  ", mBenchPrimitives[p].Name, Length / 1024);
+            if (!Ok) {
+                Print(L"FAILED\n");
+                continue;
+            }
+            PrintRate((UINT64)Length * Repeats, Ticks);
+        }
+    }
+
+    // PBKDF2 cost is per iteration, not per byte of input
+    for (UINT32 s = 0; s < BENCH_SIZE_COUNT; s++) {
+        UINT8 Key[32];
+        UINT64 Start = bh_get_performance_counter();
+        crypto_pbkdf2_sha256((CONST UINT8 *)"bloodhorn", 9, (CONST UINT8 *)"benchsalt", 9,
+                             mBenchIterations[s], Key, sizeof(Key));
+        UINT64 Ticks = bh_get_performance_counter() - Start;
+        UINT64 Hz = bh_get_performance_frequency();
+
+        Print(L"  %-24a %6u it   ", "crypto_pbkdf2_sha256", mBenchIterations[s]);
+        PrintFixed2(Ticks * 100 / mBenchIterations[s]);
+        Print(L" cycles/iter");
+        if (Hz != 0) {
+            Print(L"  %6lu ms", Ticks * 1000 / Hz);
+        }
+        Print(L"\n");
+    }
+}
+
+EFI_STATUS
+EFIAPI
+BenchMain(
+    IN EFI_HANDLE        ImageHandle,
+    IN EFI_SYSTEM_TABLE  *SystemTable
+) {
+    STATIC CONST UINT8 AesKey[32] = {
+        0x60, 0x3d, 0xeb, 0x10, 0x15, 0xca, 0x71, 0xbe, 0x2b, 0x73, 0xae, 0xf0, 0x85, 0x7d, 0x77, 0x81,
+        0x1f, 0x35, 0x2c, 0x07, 0x3b, 0x61, 0x08, 0xd7, 0x2d, 0x98, 0x10, 0xa3, 0x09, 0x14, 0xdf, 0xf4
+    };
+    STATIC CONST struct {
+        CONST CHAR16            *Name;
+        crypto_hw_support_t     Mask;
+    } Backends[] = {
+        { L"software", CRYPTO_HW_NONE },
+        { L"hardware", (crypto_hw_support_t)~0u },
+    };
+    BENCH_STATE State;
+
+    bh_initialize(&mBenchSystemTable);
+    if (bh_get_performance_frequency() == 0) {
+        Print(L"No performance counter\n");
+        return EFI_UNSUPPORTED;
+    }
+
+    ZeroMem(&State, sizeof(State));
+    State.Data = AllocatePages(EFI_SIZE_TO_PAGES(BENCH_MAX_SIZE));
+    State.Out = AllocatePages(EFI_SIZE_TO_PAGES(BENCH_MAX_SIZE));
+    if (State.Data == NULL || State.Out == NULL) {
+        Print(L"Out of memory for %u MiB buffers\n", BENCH_MAX_SIZE >> 20);
+        if (State.Data) FreePages(State.Data, EFI_SIZE_TO_PAGES(BENCH_MAX_SIZE));
+        if (State.Out) FreePages(State.Out, EFI_SIZE_TO_PAGES(BENCH_MAX_SIZE));
+        return EFI_OUT_OF_RESOURCES;
+    }
+    // The pattern the embedded signatures were made over
+    for (UINT32 i = 0; i < BENCH_MAX_SIZE; i++) {
+        State.Data[i] = (UINT8)(i * 167 + 13);
+    }
+
+    Print(L"BloodHorn crypto benchmark, counter at %lu Hz, hardware support 0x%x\n",
+          bh_get_performance_frequency(), crypto_detect_hardware_support());
+
+    for (UINTN b = 0; b < ARRAY_SIZE(Backends); b++) {
+        crypto_init_hardware_acceleration(Backends[b].Mask);
+        crypto_aes_init(&State.Aes, AesKey, 256);
+        Print(L"\n%s: sha256 %a, sha512 %a, blake3 %a, aes %a\n", Backends[b].Name,
+              crypto_sha256_backend_name(), crypto_sha512_backend_name(), crypto_blake3_backend_name(),
+              crypto_aes_backend_name());
+        BenchRunBackend(&State);
+    }
+
+    crypto_zeroize_context(&State.Aes, sizeof(State.Aes));
+    crypto_cleanup_hardware();
+    FreePages(State.Data, EFI_SIZE_TO_PAGES(BENCH_MAX_SIZE));
+    FreePages(State.Out, EFI_SIZE_TO_PAGES(BENCH_MAX_SIZE));
+    return EFI_SUCCESS;
+}
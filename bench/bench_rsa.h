@@ -0,0 +1,112 @@
+/*
+ * bench_rsa.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ *
+ * Throwaway RSA-2048 key and signatures shared by BloodHornBench.efi and
+ * the host benchmarks. The signatures are over the bench pattern,
+ * byte i = (i * 167 + 13) & 0xFF, truncated to 4 KiB, 1 MiB and 64 MiB.
+ */
+
+#ifndef BLOODHORN_BENCH_RSA_H
+#define BLOODHORN_BENCH_RSA_H
+
+#include <stdint.h>
+
+// [key_bits][e][n] for verify_signature: a throwaway RSA-2048 key
+static const uint8_t mBenchRsaKey[4 + 2 * 256] = {
+    0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x01, 0x00, 0x01, 0x8b, 0x8c, 0xee, 0xda, 0xba, 0x5d, 0x2b, 0x35, 0xb5, 0xf8, 0x24, 0x22,
+    0x7b, 0xb6, 0x77, 0x14, 0x33, 0x8e, 0x50, 0xa2, 0x5c, 0xe2, 0xb7, 0xc1, 0xd5, 0xf5, 0xc4, 0x25,
+    0xf0, 0x49, 0x7d, 0x9a, 0xe1, 0x90, 0xb1, 0xaa, 0x02, 0xc3, 0x71, 0x22, 0xfe, 0xf0, 0x42, 0xab,
+    0x36, 0xf6, 0xdd, 0xf4, 0x09, 0xb9, 0xe6, 0xe2, 0x1f, 0x2d, 0x28, 0x4a, 0xbf, 0xc7, 0x96, 0x89,
+    0xb1, 0x86, 0x8d, 0x41, 0x92, 0xd5, 0x17, 0x70, 0x4d, 0xd1, 0x3b, 0x82, 0x33, 0xb6, 0x8b, 0x88,
+    0x08, 0xe9, 0x52, 0xdf, 0xa9, 0xbb, 0xb7, 0xde, 0x7c, 0xcb, 0xaf, 0x70, 0xf1, 0xea, 0x7b, 0x3d,
+    0xd1, 0x77, 0xb9, 0xbf, 0x4b, 0xa8, 0xee, 0xd7, 0xa3, 0x39, 0x12, 0xb6, 0x0f, 0x62, 0x9f, 0x5c,
+    0x4c, 0x01, 0xbf, 0xf7, 0xa9, 0x06, 0xff, 0xf7, 0xc8, 0xa3, 0x70, 0x1e, 0xf0, 0x76, 0x7f, 0x8d,
+    0xb5, 0x42, 0x59, 0xde, 0x4c, 0x0a, 0xd6, 0x27, 0x23, 0x8f, 0x55, 0x22, 0x17, 0x1e, 0x5d, 0xdf,
+    0xcf, 0x09, 0xa5, 0x4d, 0x9a, 0x43, 0xd4, 0x01, 0x46, 0x7d, 0x6a, 0x1f, 0x90, 0xf0, 0xa8, 0x0c,
+    0x11, 0xbe, 0xda, 0x7b, 0x28, 0xdc, 0xdb, 0xf9, 0x99, 0x52, 0x85, 0xce, 0xa4, 0xe4, 0xcf, 0x61,
+    0x97, 0x6d, 0xdd, 0xd0, 0xbe, 0x0d, 0xbc, 0x0b, 0x0b, 0x02, 0x2e, 0x31, 0x96, 0xe7, 0x78, 0x56,
+    0x5a, 0x1f, 0xe2, 0x51, 0x6e, 0xaa, 0x4c, 0x53, 0x65, 0x5b, 0x4c, 0xbf, 0xae, 0xd1, 0xdc, 0x5b,
+    0x3f, 0x7f, 0x9b, 0x40, 0xa1, 0x6f, 0xf6, 0xa7, 0xf7, 0x59, 0x5d, 0x4c, 0x71, 0xd8, 0xeb, 0x7a,
+    0xc3, 0x98, 0x3a, 0x1c, 0x64, 0x6a, 0xa6, 0x70, 0xbe, 0x3c, 0x2c, 0xd4, 0x79, 0x47, 0x7b, 0x2f,
+    0x00, 0x6b, 0x1e, 0x5a, 0xc8, 0x75, 0xf2, 0x18, 0x3a, 0xe2, 0x11, 0x9e, 0x8d, 0x0c, 0x12, 0x68,
+    0x7d, 0x59, 0x95, 0x53
+};
+
+// PKCS#1 v1.5 SHA-256 signatures over the bench pattern, one per size
+static const uint8_t mBenchRsaSig[3][256] = {
+    {
+        0x70, 0xf8, 0x7f, 0x1a, 0x01, 0xeb, 0x8a, 0xd6, 0xb3, 0xd7, 0x83, 0x78, 0x8d, 0x28, 0x84, 0x45,
+        0xcb, 0x3d, 0x1c, 0x82, 0x61, 0xb9, 0xbb, 0x31, 0x40, 0xbf, 0x5a, 0xb8, 0x4a, 0xfe, 0x14, 0xff,
+        0x47, 0x7e, 0x30, 0xd3, 0xa1, 0xe4, 0x90, 0xb8, 0xfb, 0xd8, 0x22, 0x89, 0x45, 0x59, 0x4e, 0x53,
+        0x8b, 0x17, 0x1e, 0x20, 0x41, 0xaf, 0xb2, 0x34, 0xd2, 0xc5, 0x28, 0xcd, 0x9f, 0x74, 0xd9, 0xbf,
+        0x3f, 0xcd, 0x5b, 0x7f, 0x16, 0xc7, 0x11, 0xe3, 0xdf, 0xcb, 0x79, 0xbf, 0x62, 0x26, 0x5a, 0x7a,
+        0x44, 0xac, 0x7a, 0xda, 0x54, 0x5f, 0x74, 0xc1, 0xcc, 0xf0, 0x8d, 0x2d, 0xd6, 0xf8, 0x70, 0x97,
+        0x12, 0x20, 0x7f, 0x47, 0xc8, 0x49, 0x8a, 0x92, 0xc7, 0x92, 0x70, 0x68, 0x57, 0x1e, 0x5f, 0x06,
+        0x15, 0x01, 0xfd, 0x0d, 0x41, 0xdf, 0x7c, 0x4b, 0xe0, 0x19, 0x59, 0xde, 0x5c, 0xd2, 0xa7, 0x54,
+        0x7f, 0x6c, 0xf0, 0x22, 0x4e, 0x0d, 0xbf, 0x90, 0x8a, 0xb4, 0xfa, 0x15, 0x69, 0x20, 0xed, 0xa6,
+        0x69, 0x8b, 0x38, 0x03, 0x77, 0xa6, 0x57, 0x3d, 0x25, 0x09, 0xf4, 0xf2, 0x19, 0x87, 0xdd, 0x1c,
+        0xb8, 0xc9, 0x65, 0x0f, 0x1b, 0xe3, 0x3f, 0x6d, 0x5e, 0xef, 0x69, 0x86, 0x11, 0xb8, 0x26, 0xe2,
+        0xca, 0x84, 0x6e, 0x33, 0x3a, 0x53, 0xef, 0x4c, 0xa7, 0x00, 0x71, 0x2c, 0xea, 0xa1, 0x87, 0x2d,
+        0xee, 0xec, 0x74, 0x19, 0xce, 0x3b, 0xb0, 0xe3, 0xed, 0xd7, 0x6d, 0xdf, 0x70, 0x04, 0x48, 0x98,
+        0xe2, 0x8b, 0xd1, 0x31, 0x5f, 0x20, 0xb1, 0x5f, 0xb1, 0xae, 0x6a, 0x1b, 0x5c, 0xbb, 0xa8, 0x1a,
+        0x26, 0xc3, 0x2d, 0x33, 0x44, 0xa7, 0xed, 0xe2, 0xb2, 0x79, 0x98, 0xa2, 0x15, 0xd3, 0x65, 0x57,
+        0xc5, 0xb9, 0x24, 0xd4, 0xf6, 0x8a, 0xe9, 0xee, 0x43, 0x8f, 0x30, 0xbd, 0x64, 0x26, 0xcd, 0x76
+    },
+    {
+        0x4b, 0xf7, 0xbb, 0xab, 0xf1, 0xa2, 0xe4, 0xa4, 0x54, 0x6f, 0x41, 0x27, 0x30, 0x65, 0xc7, 0x6c,
+        0x76, 0x4c, 0xed, 0xf7, 0xfa, 0x74, 0x58, 0x97, 0x38, 0xce, 0x17, 0x77, 0xa0, 0x36, 0xf8, 0xd1,
+        0x92, 0x9c, 0xf4, 0xa2, 0xb6, 0x93, 0xbf, 0x14, 0x83, 0x3b, 0xf8, 0x07, 0x4b, 0x67, 0x96, 0xe9,
+        0xeb, 0x69, 0xa6, 0xd8, 0x51, 0x63, 0x7c, 0xf0, 0xbf, 0xda, 0x79, 0xce, 0x24, 0x5f, 0x6a, 0xb5,
+        0x57, 0x23, 0x25, 0xb3, 0x4f, 0xf7, 0x34, 0x10, 0x2a, 0x1e, 0xa6, 0x46, 0xf1, 0x4b, 0x6f, 0x2a,
+        0x1e, 0x39, 0xff, 0xbd, 0xe3, 0x4a, 0x52, 0x5b, 0x93, 0x1c, 0xa9, 0x17, 0x83, 0x46, 0xb3, 0xc5,
+        0x21, 0xf9, 0xa7, 0x88, 0xb1, 0x7d, 0xef, 0xef, 0x00, 0x24, 0xe8, 0x79, 0x16, 0x2e, 0x9d, 0xef,
+        0x89, 0xb1, 0xa1, 0xdf, 0x99, 0xee, 0x81, 0x9c, 0x44, 0x4c, 0x9a, 0x5d, 0x1b, 0x64, 0xf2, 0x2c,
+        0xaf, 0xa8, 0x0e, 0x63, 0xbe, 0x9b, 0xdf, 0xd5, 0xaa, 0x19, 0x04, 0x02, 0x24, 0x88, 0x2b, 0x91,
+        0x75, 0x10, 0x3d, 0x62, 0xcf, 0x3c, 0x69, 0x76, 0xa1, 0x51, 0xbc, 0xc1, 0xf6, 0x03, 0x4c, 0x1b,
+        0x0e, 0x79, 0xd1, 0xfa, 0xa3, 0x45, 0xbf, 0x68, 0xf1, 0x6e, 0x5b, 0x94, 0x3c, 0x5e, 0xdf, 0x2d,
+        0x12, 0x2a, 0x1d, 0x43, 0xe7, 0xab, 0x53, 0xc2, 0x78, 0xdd, 0x0b, 0xac, 0x90, 0x6b, 0x25, 0xc9,
+        0xff, 0xc1, 0x16, 0xeb, 0xb0, 0xe7, 0x7b, 0x1f, 0x29, 0xa6, 0x54, 0xef, 0x27, 0xac, 0xdd, 0x04,
+        0x08, 0x08, 0xfa, 0xad, 0x07, 0x47, 0xa7, 0xd7, 0x62, 0xeb, 0xe5, 0xdf, 0x7c, 0x6f, 0x88, 0x4c,
+        0x8e, 0x19, 0xf5, 0xe2, 0xe2, 0x18, 0x9e, 0x67, 0x0c, 0xae, 0x00, 0x80, 0x4d, 0xe1, 0x2b, 0x02,
+        0x66, 0x22, 0x5e, 0x1c, 0xd2, 0x34, 0x01, 0x80, 0xec, 0x9f, 0x22, 0x72, 0x2f, 0x4b, 0xd5, 0x7a
+    },
+    {
+        0x3f, 0x27, 0xd7, 0x26, 0x6b, 0xbe, 0x2f, 0xa0, 0xc0, 0x37, 0x00, 0xef, 0xf7, 0xc5, 0x67, 0xb7,
+        0xd6, 0x68, 0x97, 0x29, 0x82, 0x70, 0x21, 0xee, 0x7d, 0xc4, 0x4b, 0xfd, 0xc4, 0x02, 0x5c, 0x51,
+        0xa0, 0x9e, 0x56, 0xfe, 0x36, 0x70, 0xa2, 0xcd, 0xf4, 0xde, 0x9f, 0x3d, 0x6f, 0xf1, 0xf8, 0xcf,
+        0xeb, 0x66, 0x3c, 0xe8, 0x33, 0xcd, 0xf9, 0x99, 0xe5, 0x29, 0x64, 0xa2, 0x2e, 0x58, 0xaf, 0xd0,
+        0xa1, 0x36, 0x97, 0x24, 0x77, 0x6c, 0x53, 0x79, 0x8e, 0xed, 0x5e, 0x59, 0xae, 0xdb, 0xf0, 0x5e,
+        0xa7, 0x98, 0x9f, 0x42, 0xc0, 0x15, 0x34, 0xde, 0x53, 0xaf, 0x1b, 0xaf, 0xa6, 0x62, 0xd8, 0x81,
+        0xf7, 0x2c, 0xcc, 0xca, 0x5b, 0x27, 0x85, 0x00, 0x7f, 0x74, 0x46, 0xaa, 0xe0, 0x2c, 0xc8, 0xe0,
+        0x8e, 0x84, 0xe1, 0xe0, 0x55, 0x7c, 0xb9, 0xc2, 0xe9, 0xe5, 0x5a, 0xf3, 0xb6, 0x42, 0x13, 0x72,
+        0xb5, 0x8c, 0x79, 0xaf, 0x5d, 0x90, 0x38, 0x65, 0x9b, 0x7b, 0x3e, 0x6f, 0xdc, 0x47, 0x82, 0xc5,
+        0xc6, 0xeb, 0x30, 0xf0, 0xbe, 0x1f, 0x86, 0x9e, 0x01, 0xba, 0x13, 0x7b, 0x4e, 0x2b, 0xda, 0x51,
+        0x89, 0x48, 0x28, 0x93, 0x15, 0xca, 0xa4, 0x34, 0x38, 0x12, 0x5a, 0xaa, 0xaf, 0x98, 0xfa, 0x19,
+        0x87, 0x68, 0xb4, 0xb6, 0x65, 0x0f, 0xc0, 0xa1, 0x13, 0x08, 0xdd, 0xe9, 0x1e, 0xc6, 0xde, 0xb9,
+        0xa1, 0x9e, 0x0d, 0x6d, 0x89, 0x21, 0xb2, 0x8b, 0xae, 0xf4, 0x39, 0xc9, 0xde, 0xa5, 0x3b, 0x26,
+        0xf7, 0x50, 0xaf, 0xbc, 0x50, 0x21, 0x4c, 0x71, 0x0a, 0xea, 0xf2, 0xf9, 0x05, 0x30, 0x15, 0x19,
+        0x0f, 0x0a, 0x0c, 0xc9, 0x45, 0x96, 0x66, 0x3f, 0x3f, 0xc3, 0xd2, 0x3f, 0x89, 0x99, 0xd3, 0x0e,
+        0x54, 0x8b, 0x19, 0xb5, 0x02, 0x05, 0x63, 0x62, 0xcf, 0x23, 0xcc, 0x9f, 0x38, 0x24, 0x6e, 0x47
+    }
+};
+
+#endif // BLOODHORN_BENCH_RSA_H
@@ -0,0 +1,514 @@
+# bootbench.py
+#
+# This file is part of BloodHorn and is licensed under the BSD License.
+# See the root of the repository for license details.
+#
+
+"""
+Boot Latency Benchmark
+
+Boots BloodHorn.efi under QEMU with OVMF (x86_64) or AAVMF (AArch64) a few
+times and reports how long each boot phase took, against a stored baseline.
+
+Every run uses the same generated disks:
+  - a GPT disk with a FAT32 ESP (the loader, bloodhorn.ini, a stub kernel
+    and initrd) and an ext2 partition,
+  - an ISO 9660 image on a CD drive,
+each with payload files of the configured sizes, so probing, mounting and
+loading have real work to do. The config turns on boot_trace, which makes
+the loader print its timeline on the console just before
+ExitBootServices. The table is read from the serial port, and QEMU is
+stopped as soon as it is complete; the stub kernel never has to run.
+
+Phases are the timeline's span names; a phase's time is the sum of its
+spans in one boot, and the report shows the median over all runs.
+"handoff" is the timeline offset of the last event, i.e. time from the
+loader's start to ExitBootServices.
+
+Optional scenarios add the phases the plain boot does not reach; each
+one is part of the baseline key, so they are compared like for like:
+  --menu    a one-second countdown, so menu_paint (the first frame) runs
+  --tpm     a swtpm TPM 2.0, so the loads are measured (tpm_measure)
+  --net     the initrd served over HTTP by this script through QEMU's
+            user network, so it arrives through net_fetch (needs firmware
+            built with the HTTP stack)
+With --memory one more boot runs with trace_memory on; allocations
+are deterministic, so one is enough, and the timed runs are spared the
+profiler's overhead. The memory a phase left allocated (KiB) and the
+boot's peak come from that boot. --json writes both for bench/budget.py.
+
+Example:
+    python3 bench/bootbench.py --efi BloodHorn.efi --arch X64 --runs 5
+    python3 bench/bootbench.py --efi BloodHorn.efi --update-baseline
+    python3 bench/bootbench.py --efi BloodHorn.efi --menu --tpm --net --memory --json boot.json
+
+Needs qemu-system-x86_64 or qemu-system-aarch64, OVMF/AAVMF, mkfs.fat,
+mcopy (mtools), mke2fs, sfdisk and xorriso (or genisoimage); --tpm needs
+swtpm.
+"""
+
+import argparse
+import functools
+import http.server
+import json
+import os
+import random
+import re
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+MIB = 1024 * 1024
+
+ARCHES = {
+    "X64": {
+        "qemu": "qemu-system-x86_64",
+        "machine": ["-machine", "q35"],
+        "boot_name": "BOOTX64.EFI",
+        "tpm": "tpm-tis",
+        "firmware": [
+            ("/usr/share/OVMF/OVMF_CODE.fd", "/usr/share/OVMF/OVMF_VARS.fd"),
+            ("/usr/share/OVMF/OVMF_CODE_4M.fd", "/usr/share/OVMF/OVMF_VARS_4M.fd"),
+            ("/usr/share/edk2/ovmf/OVMF_CODE.fd", "/usr/share/edk2/ovmf/OVMF_VARS.fd"),
+            ("/usr/share/edk2/x64/OVMF_CODE.fd", "/usr/share/edk2/x64/OVMF_VARS.fd"),
+        ],
+    },
+    "AARCH64": {
+        "qemu": "qemu-system-aarch64",
+        "machine": ["-machine", "virt", "-cpu", "max"],
+        "boot_name": "BOOTAA64.EFI",
+        "tpm": "tpm-tis-device",
+        "firmware": [
+            ("/usr/share/AAVMF/AAVMF_CODE.fd", "/usr/share/AAVMF/AAVMF_VARS.fd"),
+            ("/usr/share/edk2/aarch64/QEMU_EFI-pflash.raw", "/usr/share/edk2/aarch64/vars-template-pflash.raw"),
+        ],
+    },
+}
+
+ESP_SIZE = 64 * MIB         # Smallest size mkfs.fat makes FAT32 of with 512-byte sectors
+PART_ALIGN = MIB
+
+TABLE_HEADER = re.compile(r"start\(us\)\s+dur\(us\)\s+mem\(KiB\)\s+phase")
+TABLE_ROW = re.compile(r"^\s*(\d+)\s+(\d+|-|open)\s+(-?\d+|-)  (\s*)(\S.*?)\s*$")
+# Printed after the table when allocations were counted
+PEAK = re.compile(r"Peak memory: (\d+) KiB")
+# Where QEMU's user network puts the host
+HOST_FROM_GUEST = "10.0.2.2"
+# Terminal escapes the firmware console adds on the serial port
+ANSI = re.compile(r"\x1b\[[0-9;?]*[A-Za-z]|\x1b[()][0-9A-Za-z]|\r")
+
+
+def fail(message):
+    sys.exit("bootbench: " + message)
+
+
+def run(cmd, **kwargs):
+    try:
+        subprocess.run(cmd, check=True, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, **kwargs)
+    except FileNotFoundError:
+        fail("%s not found" % cmd[0])
+    except subprocess.CalledProcessError as e:
+        fail("%s failed: %s" % (" ".join(cmd), e.stderr.decode(errors="replace").strip()))
+
+
+def parse_size(text):
+    units = {"k": 1024, "m": MIB, "g": 1024 * MIB}
+    text = text.strip().lower()
+    if text and text[-1] in units:
+        return int(float(text[:-1]) * units[text[-1]])
+    return int(text)
+
+
+def filler(size, seed):
+    """Deterministic random bytes, so every run and every checkout reads and
+    hashes the same data, and nothing along the way can compress it."""
+    return random.Random(seed).randbytes(size)
+
+
+def stub_kernel_x64(size):
+    """bzImage header (boot protocol 2.15) in front of a hlt loop, padded to
+    size: enough for the loader to place and hand off to it."""
+    setup_sects = 1
+    image = bytearray(filler(max(size, 8192), 0x4B45524E))
+    image[0x1F1] = setup_sects
+    struct.pack_into("<H", image, 0x1FE, 0xAA55)
+    image[0x202:0x206] = b"HdrS"
+    struct.pack_into("<H", image, 0x206, 0x020F)
+    image[0x211] = 0x01                                    # LOADED_HIGH
+    struct.pack_into("<I", image, 0x214, 0x100000)         # code32_start
+    struct.pack_into("<I", image, 0x230, 0x200000)         # kernel_alignment
+    image[0x234] = 1                                       # relocatable_kernel
+    struct.pack_into("<H", image, 0x236, 0x0003)           # XLF_KERNEL_64 | XLF_CAN_BE_LOADED_ABOVE_4G
+    struct.pack_into("<I", image, 0x238, 255)              # cmdline_size
+    struct.pack_into("<Q", image, 0x258, 0x1000000)        # pref_address
+    struct.pack_into("<I", image, 0x260, (len(image) + 0xFFFFF) & ~0xFFFFF)  # init_size
+    code = (setup_sects + 1) * 512
+    hlt_loop = b"\xf4\xeb\xfd"
+    image[code:code + 3] = hlt_loop                        # 32-bit entry
+    image[code + 0x200:code + 0x203] = hlt_loop            # 64-bit entry
+    return bytes(image)
+
+
+def stub_kernel_aarch64(size):
+    """arm64 Image header in front of a wfi loop, padded to size."""
+    image = bytearray(filler(max(size, 4096), 0x4B45524E))
+    struct.pack_into("<II", image, 0, 0xD503207F, 0x14000000)   # wfi; b .
+    struct.pack_into("<QQQ", image, 8, 0, len(image), 0xA)      # text_offset, image_size, 4K pages anywhere
+    struct.pack_into("<QQQ", image, 32, 0, 0, 0)
+    struct.pack_into("<II", image, 56, 0x644D5241, 0)           # "ARM\x64"
+    return bytes(image)
+
+
+def write_file(path, data):
+    with open(path, "wb") as f:
+        f.write(data)
+
+
+def config_text(scenario, trace_memory):
+    """bloodhorn.ini for one boot of the scenario."""
+    boot = "[boot]\ndefault=linux\nmenu_timeout=%d\nboot_trace=true\n" % (1 if scenario["menu"] else 0)
+    if trace_memory:
+        boot += "trace_memory=true\n"
+    initrd = scenario["initrd_url"] or "/initrd.img"
+    return boot + "\n[linux]\nkernel=/vmlinuz\ninitrd=%s\ncmdline=console=ttyS0\n" % initrd
+
+
+def set_config(disk, text, work):
+    """Replace bloodhorn.ini on the ESP inside the assembled disk."""
+    path = os.path.join(work, "bloodhorn.ini")
+    with open(path, "w") as f:
+        f.write(text)
+    run(["mcopy", "-o", "-i", "%s@@%d" % (disk, PART_ALIGN), path, "::/bloodhorn.ini"])
+
+
+def build_disks(work, arch, efi, sizes, scenario):
+    """The GPT disk (ESP + ext2) and the ISO, with the payloads in place."""
+    kernel = (stub_kernel_x64 if arch == "X64" else stub_kernel_aarch64)(sizes["kernel"])
+
+    esp_dir = os.path.join(work, "esp")
+    os.makedirs(os.path.join(esp_dir, "EFI", "BOOT"))
+    shutil.copyfile(efi, os.path.join(esp_dir, "EFI", "BOOT", ARCHES[arch]["boot_name"]))
+    write_file(os.path.join(esp_dir, "vmlinuz"), kernel)
+    write_file(os.path.join(esp_dir, "initrd.img"), filler(sizes["initrd"], 0x494E4954))
+    write_file(os.path.join(esp_dir, "payload.bin"), filler(sizes["fat"], 0x46415433))
+    with open(os.path.join(esp_dir, "bloodhorn.ini"), "w") as f:
+        f.write(config_text(scenario, False))
+
+    esp_bytes = max(ESP_SIZE, (sum(os.path.getsize(os.path.join(r, n))
+                                   for r, _, ns in os.walk(esp_dir) for n in ns) * 5 // 4 + 8 * MIB) // MIB * MIB)
+    esp = os.path.join(work, "esp.img")
+    write_file(esp, b"")
+    os.truncate(esp, esp_bytes)
+    run(["mkfs.fat", "-F", "32", "-n", "BHBENCH", esp])
+    run(["mcopy", "-s", "-i", esp] + [os.path.join(esp_dir, n) for n in sorted(os.listdir(esp_dir))] + ["::/"])
+
+    ext2_dir = os.path.join(work, "ext2")
+    os.makedirs(ext2_dir)
+    write_file(os.path.join(ext2_dir, "payload.bin"), filler(sizes["ext2"], 0x45585432))
+    ext2_bytes = (sizes["ext2"] * 5 // 4 + 8 * MIB) // MIB * MIB
+    ext2 = os.path.join(work, "ext2.img")
+    write_file(ext2, b"")
+    os.truncate(ext2, ext2_bytes)
+    run(["mke2fs", "-q", "-F", "-t", "ext2", "-d", ext2_dir, ext2])
+
+    # GPT: ESP then ext2, each on a 1 MiB boundary
+    disk = os.path.join(work, "disk.img")
+    esp_start = PART_ALIGN
+    ext2_start = esp_start + esp_bytes
+    write_file(disk, b"")
+    os.truncate(disk, ext2_start + ext2_bytes + PART_ALIGN)
+    table = ("label: gpt\n"
+             "start=%d, size=%d, type=C12A7328-F81F-11D2-BA4B-00A0C93EC93B\n"
+             "start=%d, size=%d, type=0FC63DAF-8483-4772-8E79-3D69D8477DE4\n"
+             % (esp_start // 512, esp_bytes // 512, ext2_start // 512, ext2_bytes // 512))
+    run(["sfdisk", "-q", disk], input=table.encode())
+    with open(disk, "r+b") as out:
+        for image, start in ((esp, esp_start), (ext2, ext2_start)):
+            out.seek(start)
+            with open(image, "rb") as f:
+                shutil.copyfileobj(f, out, MIB)
+
+    iso_dir = os.path.join(work, "iso")
+    os.makedirs(iso_dir)
+    write_file(os.path.join(iso_dir, "payload.bin"), filler(sizes["iso"], 0x49534F39))
+    iso = os.path.join(work, "payload.iso")
+    tool = shutil.which("xorriso")
+    if tool:
+        run([tool, "-as", "mkisofs", "-quiet", "-R", "-o", iso, iso_dir])
+    else:
+        run(["genisoimage", "-quiet", "-R", "-o", iso, iso_dir])
+    return disk, iso
+
+
+def find_firmware(arch, code, variables):
+    if code and variables:
+        return code, variables
+    for c, v in ARCHES[arch]["firmware"]:
+        if os.path.exists(c) and os.path.exists(v):
+            return c, v
+    fail("no firmware found for %s; pass --code and --vars" % arch)
+
+
+def start_swtpm(work):
+    """A fresh TPM 2.0 for one boot; returns the process and its socket."""
+    state = os.path.join(work, "tpm")
+    os.makedirs(state, exist_ok=True)
+    sock = os.path.join(work, "swtpm.sock")
+    if os.path.exists(sock):
+        os.unlink(sock)
+    try:
+        tpm = subprocess.Popen(["swtpm", "socket", "--tpm2", "--tpmstate", "dir=%s" % state,
+                                "--ctrl", "type=unixio,path=%s" % sock, "--flags", "startup-clear"],
+                               stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    except FileNotFoundError:
+        fail("swtpm not found; --tpm needs it")
+    deadline = time.monotonic() + 5
+    while not os.path.exists(sock):
+        if time.monotonic() > deadline or tpm.poll() is not None:
+            tpm.kill()
+            fail("swtpm did not start")
+        time.sleep(0.02)
+    return tpm, sock
+
+
+class PayloadServer:
+    """Serves the directory over HTTP on a free port for --net."""
+
+    def __init__(self, directory):
+        handler = functools.partial(QuietHandler, directory=directory)
+        self.httpd = http.server.ThreadingHTTPServer(("127.0.0.1", 0), handler)
+        self.port = self.httpd.server_address[1]
+        self.thread = threading.Thread(target=self.httpd.serve_forever, daemon=True)
+        self.thread.start()
+
+    def close(self):
+        self.httpd.shutdown()
+        self.httpd.server_close()
+
+
+class QuietHandler(http.server.SimpleHTTPRequestHandler):
+    def log_message(self, *args):
+        pass
+
+
+def boot_once(arch, firmware, disk, iso, work, timeout, log, scenario):
+    """One boot; returns the timeline rows (start_us, dur_us or None,
+    mem_kib or None, depth, name) and the peak KiB, or None."""
+    spec = ARCHES[arch]
+    variables = os.path.join(work, "vars.fd")
+    shutil.copyfile(firmware[1], variables)
+    cmd = [spec["qemu"]] + spec["machine"] + [
+        "-m", "1024", "-smp", "2", "-no-reboot", "-display", "none", "-serial", "stdio", "-monitor", "none",
+        "-drive", "if=pflash,format=raw,unit=0,readonly=on,file=%s" % firmware[0],
+        "-drive", "if=pflash,format=raw,unit=1,file=%s" % variables,
+        "-drive", "if=none,id=disk,format=raw,snapshot=on,file=%s" % disk,
+        "-device", "virtio-blk-pci,drive=disk,bootindex=0",
+        "-drive", "if=none,id=cd,format=raw,readonly=on,file=%s" % iso,
+    ]
+    cmd += ["-device", "ide-cd,drive=cd"] if arch == "X64" else ["-device", "virtio-scsi-pci", "-device", "scsi-cd,drive=cd"]
+    if scenario["initrd_url"]:
+        cmd += ["-netdev", "user,id=net0", "-device", "virtio-net-pci,netdev=net0"]
+    tpm = None
+    if scenario["tpm"]:
+        tpm, sock = start_swtpm(work)
+        cmd += ["-chardev", "socket,id=chrtpm,path=%s" % sock, "-tpmdev", "emulator,id=tpm0,chardev=chrtpm",
+                "-device", "%s,tpmdev=tpm0" % spec["tpm"]]
+    if os.access("/dev/kvm", os.R_OK | os.W_OK) and (arch == "X64") == (os.uname().machine == "x86_64"):
+        cmd += ["-accel", "kvm"]
+
+    try:
+        qemu = subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, stdin=subprocess.DEVNULL)
+    except FileNotFoundError:
+        if tpm:
+            tpm.kill()
+        fail("%s not found" % spec["qemu"])
+    os.set_blocking(qemu.stdout.fileno(), False)
+
+    rows, in_table, pending = [], False, b""
+    deadline = time.monotonic() + timeout
+    try:
+        while time.monotonic() < deadline and qemu.poll() is None:
+            chunk = qemu.stdout.read()
+            if not chunk:
+                time.sleep(0.02)
+                continue
+            if log:
+                log.write(chunk)
+            pending += chunk
+            *lines, pending = pending.split(b"\n")
+            for raw in lines:
+                line = ANSI.sub("", raw.decode("latin-1"))
+                if TABLE_HEADER.search(line):
+                    rows, in_table = [], True
+                    continue
+                if not in_table:
+                    continue
+                m = TABLE_ROW.match(line)
+                if not m:
+                    # The table ends at the first line that is not a row,
+                    # which is the peak when allocations were counted
+                    peak = PEAK.search(line)
+                    return rows, int(peak.group(1)) if peak else None
+                dur = None if m.group(2) in ("-", "open") else int(m.group(2))
+                mem = None if m.group(3) == "-" else int(m.group(3))
+                rows.append((int(m.group(1)), dur, mem, len(m.group(4)) // 2, m.group(5)))
+    finally:
+        qemu.kill()
+        qemu.wait()
+        if tpm:
+            tpm.kill()
+            tpm.wait()
+    fail("no boot timeline within %d s%s" % (timeout, "" if log else "; rerun with --log to see the console"))
+
+
+def phases(rows):
+    totals = {}
+    for start, dur, _mem, _depth, name in rows:
+        if dur is not None:
+            totals[name] = totals.get(name, 0) + dur
+    totals["handoff"] = max(row[0] for row in rows)
+    return totals
+
+
+def memory(rows, peak):
+    """KiB each phase left allocated, summed over its spans, and the peak."""
+    totals = {}
+    for _start, _dur, mem, _depth, name in rows:
+        if mem is not None:
+            totals[name] = totals.get(name, 0) + mem
+    if peak is not None:
+        totals["peak"] = peak
+    return totals
+
+
+def median(values):
+    values = sorted(values)
+    mid = len(values) // 2
+    return values[mid] if len(values) % 2 else (values[mid - 1] + values[mid]) // 2
+
+
+def report(result, baseline, tolerance, floor_us):
+    """Print the table; True when some phase got slower than allowed."""
+    regressed = False
+    print("%-28s %12s %12s %9s" % ("phase", "median(us)", "baseline", "change"))
+    for name in sorted(result, key=lambda n: (n == "handoff", n)):
+        now = result[name]
+        base = baseline.get(name)
+        if base is None:
+            print("%-28s %12d %12s %9s" % (name, now, "-", "new"))
+            continue
+        change = (now - base) * 100.0 / base if base else 0.0
+        flag = ""
+        if now - base > floor_us and change > tolerance:
+            flag = "  REGRESSION"
+            regressed = True
+        print("%-28s %12d %12d %+8.1f%%%s" % (name, now, base, change, flag))
+    for name in sorted(set(baseline) - set(result)):
+        print("%-28s %12s %12d %9s" % (name, "-", baseline[name], "gone"))
+    return regressed
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Time BloodHorn's boot phases under QEMU")
+    parser.add_argument("--efi", required=True, help="BloodHorn.efi to boot")
+    parser.add_argument("--arch", default="X64", choices=sorted(ARCHES))
+    parser.add_argument("--runs", type=int, default=5, help="boots to take the median of")
+    parser.add_argument("--kernel-size", default="8M", help="stub kernel size on the ESP")
+    parser.add_argument("--initrd-size", default="32M", help="initrd size on the ESP")
+    parser.add_argument("--fat-size", default="16M", help="extra payload on the FAT32 ESP")
+    parser.add_argument("--ext2-size", default="16M", help="payload on the ext2 partition")
+    parser.add_argument("--iso-size", default="16M", help="payload on the ISO 9660 CD")
+    parser.add_argument("--code", help="firmware code image (OVMF_CODE.fd / AAVMF_CODE.fd)")
+    parser.add_argument("--vars", help="firmware variable store template")
+    parser.add_argument("--baseline", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "boot-baseline.json"))
+    parser.add_argument("--update-baseline", action="store_true", help="store this result as the baseline")
+    parser.add_argument("--tolerance", type=float, default=10.0, help="percent a phase may grow")
+    parser.add_argument("--floor-us", type=int, default=500, help="growth below this is never a regression")
+    parser.add_argument("--timeout", type=int, default=120, help="seconds per boot")
+    parser.add_argument("--log", help="append the raw serial console here")
+    parser.add_argument("--menu", action="store_true", help="show the countdown for a second (menu_paint)")
+    parser.add_argument("--tpm", action="store_true", help="attach a swtpm TPM 2.0 (tpm_measure)")
+    parser.add_argument("--net", action="store_true", help="fetch the initrd over HTTP (net_fetch)")
+    parser.add_argument("--memory", action="store_true", help="one more boot counting what each phase holds")
+    parser.add_argument("--json", help="write the result here for bench/budget.py")
+    args = parser.parse_args()
+
+    if not os.path.isfile(args.efi):
+        fail("%s not found; build it first (make %s)" % (args.efi, args.arch.lower()))
+    if args.runs < 1:
+        fail("--runs must be at least 1")
+    sizes = {
+        "kernel": parse_size(args.kernel_size),
+        "initrd": parse_size(args.initrd_size),
+        "fat": parse_size(args.fat_size),
+        "ext2": parse_size(args.ext2_size),
+        "iso": parse_size(args.iso_size),
+    }
+    firmware = find_firmware(args.arch, args.code, args.vars)
+    scenario = {"menu": args.menu, "tpm": args.tpm, "initrd_url": None}
+
+    samples = {}
+    held = {}
+    log = open(args.log, "ab") if args.log else None
+    with tempfile.TemporaryDirectory(prefix="bootbench-") as work:
+        server = None
+        if args.net:
+            # The ESP's own initrd, served as it is
+            server = PayloadServer(os.path.join(work, "esp"))
+            scenario["initrd_url"] = "http://%s:%d/initrd.img" % (HOST_FROM_GUEST, server.port)
+        try:
+            disk, iso = build_disks(work, args.arch, args.efi, sizes, scenario)
+            for i in range(args.runs):
+                rows, _peak = boot_once(args.arch, firmware, disk, iso, work, args.timeout, log, scenario)
+                result = phases(rows)
+                print("run %d/%d: handoff at %d us" % (i + 1, args.runs, result["handoff"]), file=sys.stderr)
+                for name, us in result.items():
+                    samples.setdefault(name, []).append(us)
+            if args.memory:
+                set_config(disk, config_text(scenario, True), work)
+                held = memory(*boot_once(args.arch, firmware, disk, iso, work, args.timeout, log, scenario))
+                if "peak" not in held:
+                    fail("no memory figures; is this BloodHorn.efi built with trace_memory?")
+        finally:
+            if server:
+                server.close()
+    if log:
+        log.close()
+    # A phase missing from some runs is reported over the runs that had it
+    result = {name: median(values) for name, values in samples.items()}
+
+    key = "%s kernel=%d initrd=%d fat=%d ext2=%d iso=%d" % (
+        args.arch, sizes["kernel"], sizes["initrd"], sizes["fat"], sizes["ext2"], sizes["iso"])
+    key += "".join(" " + name for name in ("menu", "tpm", "net") if getattr(args, name))
+    stored = {}
+    if os.path.exists(args.baseline):
+        with open(args.baseline) as f:
+            stored = json.load(f)
+    if args.update_baseline:
+        stored[key] = result
+        with open(args.baseline, "w") as f:
+            json.dump(stored, f, indent=2, sort_keys=True)
+            f.write("\n")
+        print("baseline for '%s' written to %s" % (key, args.baseline), file=sys.stderr)
+    elif key not in stored:
+        print("no baseline for '%s'; store one with --update-baseline" % key, file=sys.stderr)
+    regressed = report(result, {} if args.update_baseline else stored.get(key, {}), args.tolerance, args.floor_us)
+    if held:
+        print()
+        print("%-28s %12s" % ("phase", "held(KiB)"))
+        for name in sorted(held, key=lambda n: (n == "peak", n)):
+            print("%-28s %12d" % (name, held[name]))
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"key": key, "time_us": result, "memory_kib": held}, f, indent=2, sort_keys=True)
+            f.write("\n")
+    if regressed:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
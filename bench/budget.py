@@ -0,0 +1,165 @@
+#
+# budget.py
+#
+# This file is part of BloodHorn and is licensed under the BSD License.
+# See the root of the repository for license details.
+#
+
+"""
+Boot-Time Budget Gate
+
+Holds the benchmark harnesses' results to the ceilings in
+bench/budgets.json and fails, with a line per span, when anything is
+over. Where bootbench.py and corpus_perf.py compare a run with the last
+one, this compares it with a fixed limit, so a regression that creeps in
+over many small changes is still caught.
+
+  --boot  bootbench.py --json output. Budgets are per scenario: the
+          baseline key of the run (architecture, payload sizes and the
+          menu/tpm/net scenarios), then per phase "max_us" for the time
+          and "max_kib" for what the phase left allocated ("peak" is the
+          boot's peak footprint, "handoff" the time to ExitBootServices).
+  --host  hostbench --json output. Budgets are per case, "max_ns" per
+          operation: the fs/ drivers over FAT32, ext2 and ISO 9660 images
+          and the security/ hashes and signature checks.
+
+A phase or case the budget names but the results lack fails as well, so
+a scenario that silently stops reaching it (no TPM, a skipped image)
+does not pass. Results without a budget are listed and do not fail.
+
+Example:
+    python3 bench/budget.py --boot Build/bench-results/boot.json --host Build/bench-results/host.json
+    python3 bench/budget.py --host Build/bench-results/host.json --update --headroom 50
+
+--update writes the budgets for these results instead of checking them,
+as the result plus --headroom percent; entries for other scenarios and
+cases are kept. Tighten the shipped ceilings that way from a run on the
+reference machine.
+"""
+
+import argparse
+import json
+import os
+import sys
+
+# (metric in the results, key in the budget, unit)
+BOOT_METRICS = [("time_us", "max_us", "us"), ("memory_kib", "max_kib", "KiB")]
+HOST_METRICS = [("ns", "max_ns", "ns")]
+
+
+def fail(message):
+    sys.exit("budget: " + message)
+
+
+def load(path):
+    try:
+        with open(path) as f:
+            return json.load(f)
+    except OSError as e:
+        fail("%s: %s" % (path, e.strerror))
+    except ValueError as e:
+        fail("%s: %s" % (path, e))
+
+
+def compare(title, measured, budgets, metrics):
+    """Print one line per budgeted or measured span; returns the failures.
+
+    measured: metric -> span -> value; budgets: span -> {budget key: limit}.
+    """
+    failures = 0
+    print(title)
+    print("  %-28s %-6s %14s %14s %9s" % ("span", "metric", "measured", "budget", "status"))
+    spans = set(budgets)
+    for metric, _limit, _unit in metrics:
+        spans.update(measured.get(metric, {}))
+    for span in sorted(spans, key=lambda n: (n in ("handoff", "peak"), n)):
+        limits = budgets.get(span, {})
+        for metric, limit_key, unit in metrics:
+            value = measured.get(metric, {}).get(span)
+            limit = limits.get(limit_key)
+            if value is None and limit is None:
+                continue
+            if limit is None:
+                status = "unbudgeted"
+            elif value is None:
+                status = "MISSING"
+                failures += 1
+            elif value > limit:
+                status = "OVER %+.0f%%" % ((value - limit) * 100.0 / limit if limit else 100.0)
+                failures += 1
+            else:
+                status = "ok %3.0f%%" % (value * 100.0 / limit if limit else 0.0)
+            print("  %-28s %-6s %14s %14s %9s" % (
+                span, unit,
+                "-" if value is None else "%d" % value,
+                "-" if limit is None else "%d" % limit,
+                status))
+    print()
+    return failures
+
+
+def host_measured(results):
+    """hostbench --json as metric -> case -> value; skipped cases are absent."""
+    cases = results.get("cases", {})
+    return {"ns": {name: case["ns"] for name, case in cases.items() if "ns" in case}}
+
+
+def host_skipped(results):
+    return {name: case["skipped"] for name, case in results.get("cases", {}).items() if "skipped" in case}
+
+
+def with_headroom(value, headroom):
+    return int(value * (1.0 + headroom / 100.0)) + 1
+
+
+def main():
+    default_budgets = os.path.join(os.path.dirname(os.path.abspath(__file__)), "budgets.json")
+    parser = argparse.ArgumentParser(description="Check benchmark results against BloodHorn's boot-time budgets")
+    parser.add_argument("--budgets", default=default_budgets, help="budget file")
+    parser.add_argument("--boot", help="bootbench.py --json result")
+    parser.add_argument("--host", help="hostbench --json result")
+    parser.add_argument("--update", action="store_true", help="write budgets for these results instead")
+    parser.add_argument("--headroom", type=float, default=50.0, help="percent --update adds to each result")
+    args = parser.parse_args()
+
+    if not args.boot and not args.host:
+        fail("nothing to check; pass --boot and/or --host")
+    budgets = load(args.budgets) if os.path.exists(args.budgets) else {}
+    boot = load(args.boot) if args.boot else None
+    host = load(args.host) if args.host else None
+
+    if args.update:
+        if boot:
+            scenario = budgets.setdefault("boot", {}).setdefault(boot["key"], {})
+            for metric, limit_key, _unit in BOOT_METRICS:
+                for span, value in boot.get(metric, {}).items():
+                    scenario.setdefault(span, {})[limit_key] = with_headroom(max(value, 0), args.headroom)
+        if host:
+            for metric, limit_key, _unit in HOST_METRICS:
+                for case, value in host_measured(host)[metric].items():
+                    budgets.setdefault("host", {}).setdefault(case, {})[limit_key] = with_headroom(
+                        value, args.headroom)
+        with open(args.budgets, "w") as f:
+            json.dump(budgets, f, indent=2, sort_keys=True)
+            f.write("\n")
+        print("budgets written to %s" % args.budgets, file=sys.stderr)
+        return
+
+    failures = 0
+    if boot:
+        scenarios = budgets.get("boot", {})
+        if boot["key"] not in scenarios:
+            fail("no boot budget for '%s'; budgeted: %s" % (boot["key"], ", ".join(sorted(scenarios)) or "none"))
+        failures += compare("boot: %s" % boot["key"], boot, scenarios[boot["key"]], BOOT_METRICS)
+    if host:
+        failures += compare("host", host_measured(host), budgets.get("host", {}), HOST_METRICS)
+        for case, reason in sorted(host_skipped(host).items()):
+            if case in budgets.get("host", {}):
+                print("  %s skipped: %s" % (case, reason))
+    if failures:
+        sys.exit("budget: %d span%s over budget or missing" % (failures, "" if failures == 1 else "s"))
+    print("all spans within budget", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,196 @@
+/*
+ * bench_crypto.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ *
+ * Hash, AES and RSA throughput on the host, over the same pattern and
+ * RSA key as BloodHornBench.efi.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hostbench.h"
+#include "../../security/crypto.h"
+#include "../bench_rsa.h"
+
+#define BENCH_CRYPTO_MAX_SIZE   (1024 * 1024)
+#define KIB                     1024
+#define MIB                     (1024 * 1024)
+
+static uint8_t *data = NULL;
+static uint8_t *out = NULL;
+static uint8_t *plain = NULL;
+static crypto_aes_ctx_t aes128;
+static crypto_aes_ctx_t aes256;
+static crypto_rsa_public_key_t rsa_key;
+static uint8_t rsa_hash[CRYPTO_SHA256_DIGEST_LENGTH];
+
+static const uint8_t aes_key[32] = {
+    0x60, 0x3d, 0xeb, 0x10, 0x15, 0xca, 0x71, 0xbe, 0x2b, 0x73, 0xae, 0xf0, 0x85, 0x7d, 0x77, 0x81,
+    0x1f, 0x35, 0x2c, 0x07, 0x3b, 0x61, 0x08, 0xd7, 0x2d, 0x98, 0x10, 0xa3, 0x09, 0x14, 0xdf, 0xf4
+};
+static const uint8_t iv[16] = { 0 };
+
+bool bench_crypto_setup(bool software_only) {
+    data = (uint8_t *)malloc(BENCH_CRYPTO_MAX_SIZE);
+    out = (uint8_t *)malloc(BENCH_CRYPTO_MAX_SIZE);
+    plain = (uint8_t *)malloc(BENCH_CRYPTO_MAX_SIZE);
+    if (!data || !out || !plain) {
+        fprintf(stderr, "hostbench: out of memory for crypto buffers\n");
+        return false;
+    }
+    // The pattern the embedded signatures were made over
+    for (uint32_t i = 0; i < BENCH_CRYPTO_MAX_SIZE; i++) {
+        data[i] = (uint8_t)(i * 167 + 13);
+    }
+
+    crypto_init_hardware_acceleration(software_only ? CRYPTO_HW_NONE : (crypto_hw_support_t)~0u);
+    crypto_aes_init(&aes128, aes_key, 128);
+    crypto_aes_init(&aes256, aes_key, 256);
+
+    // The key blob is [key_bits][e][n], e and n each key_bits / 8 bytes
+    memset(&rsa_key, 0, sizeof(rsa_key));
+    rsa_key.key_bits = 2048;
+    memcpy(rsa_key.e, mBenchRsaKey + 4 + 256 - sizeof(rsa_key.e), sizeof(rsa_key.e));
+    memcpy(rsa_key.n, mBenchRsaKey + 4 + 256, 256);
+    sha256_hash(data, 4 * KIB, rsa_hash);
+
+    printf("crypto backends: sha256 %s, sha512 %s, blake3 %s, aes %s, ghash %s\n", crypto_sha256_backend_name(),
+           crypto_sha512_backend_name(), crypto_blake3_backend_name(), crypto_aes_backend_name(),
+           crypto_ghash_backend_name());
+    return true;
+}
+
+void bench_crypto_teardown(void) {
+    crypto_zeroize_context(&aes128, sizeof(aes128));
+    crypto_zeroize_context(&aes256, sizeof(aes256));
+    free(data);
+    free(out);
+    free(plain);
+    data = NULL;
+    out = NULL;
+    plain = NULL;
+}
+
+static void bm_sha256(bench_state_t *s) {
+    uint8_t hash[CRYPTO_SHA256_DIGEST_LENGTH];
+    for (uint64_t i = 0; i < s->iterations; i++) {
+        sha256_hash(data, (uint32_t)s->arg, hash);
+        bench_consume(hash, sizeof(hash));
+    }
+    s->bytes = s->arg;
+}
+
+static void bm_sha512(bench_state_t *s) {
+    uint8_t hash[CRYPTO_SHA512_DIGEST_LENGTH];
+    for (uint64_t i = 0; i < s->iterations; i++) {
+        sha512_hash(data, (uint32_t)s->arg, hash);
+        bench_consume(hash, sizeof(hash));
+    }
+    s->bytes = s->arg;
+}
+
+static void bm_blake3(bench_state_t *s) {
+    uint8_t hash[CRYPTO_BLAKE3_DIGEST_LENGTH];
+    for (uint64_t i = 0; i < s->iterations; i++) {
+        blake3_hash(data, (uint32_t)s->arg, hash);
+        bench_consume(hash, sizeof(hash));
+    }
+    s->bytes = s->arg;
+}
+
+static void bm_aes128_cbc_decrypt(bench_state_t *s) {
+    for (uint64_t i = 0; i < s->iterations; i++) {
+        if (crypto_aes_cbc_decrypt(&aes128, iv, data, (uint32_t)s->arg, out) != CRYPTO_SUCCESS) {
+            s->error = "crypto_aes_cbc_decrypt failed";
+            return;
+        }
+        bench_consume(out, s->arg);
+    }
+    s->bytes = s->arg;
+}
+
+static void bm_aes256_ctr(bench_state_t *s) {
+    for (uint64_t i = 0; i < s->iterations; i++) {
+        if (crypto_aes_ctr_crypt(&aes256, iv, data, (uint32_t)s->arg, out) != CRYPTO_SUCCESS) {
+            s->error = "crypto_aes_ctr_crypt failed";
+            return;
+        }
+        bench_consume(out, s->arg);
+    }
+    s->bytes = s->arg;
+}
+
+static void bm_aes256_gcm_encrypt(bench_state_t *s) {
+    uint8_t tag[16];
+    for (uint64_t i = 0; i < s->iterations; i++) {
+        if (crypto_aes_gcm_encrypt(&aes256, iv, 12, NULL, 0, data, (uint32_t)s->arg, out, tag) != CRYPTO_SUCCESS) {
+            s->error = "crypto_aes_gcm_encrypt failed";
+            return;
+        }
+        bench_consume(tag, sizeof(tag));
+    }
+    s->bytes = s->arg;
+}
+
+static void bm_aes256_gcm_decrypt(bench_state_t *s) {
+    uint8_t tag[16];
+
+    // Decrypt a real ciphertext so the tag check passes
+    if (crypto_aes_gcm_encrypt(&aes256, iv, 12, NULL, 0, data, (uint32_t)s->arg, out, tag) != CRYPTO_SUCCESS) {
+        s->error = "crypto_aes_gcm_encrypt failed";
+        return;
+    }
+    for (uint64_t i = 0; i < s->iterations; i++) {
+        if (crypto_aes_gcm_decrypt(&aes256, iv, 12, NULL, 0, out, (uint32_t)s->arg, tag, plain) != CRYPTO_SUCCESS) {
+            s->error = "crypto_aes_gcm_decrypt failed";
+            return;
+        }
+        bench_consume(plain, s->arg);
+    }
+    s->bytes = s->arg;
+}
+
+static void bm_rsa2048_verify(bench_state_t *s) {
+    for (uint64_t i = 0; i < s->iterations; i++) {
+        if (crypto_rsa_verify_pkcs1v15(&rsa_key, rsa_hash, sizeof(rsa_hash), mBenchRsaSig[0], 256) != CRYPTO_SUCCESS) {
+            s->error = "signature did not verify";
+            return;
+        }
+    }
+    s->items = 1;
+}
+
+// Hash plus verify, as secure boot does it for a 4 KiB image
+static void bm_verify_signature(bench_state_t *s) {
+    for (uint64_t i = 0; i < s->iterations; i++) {
+        if (verify_signature(data, 4 * KIB, mBenchRsaSig[0], mBenchRsaKey) != CRYPTO_SUCCESS) {
+            s->error = "signature did not verify";
+            return;
+        }
+    }
+    s->items = 1;
+}
+
+const bench_case_t bench_crypto_cases[] = {
+    { "sha256/4k",                  bm_sha256,              4 * KIB },
+    { "sha256/1m",                  bm_sha256,              MIB },
+    { "sha512/4k",                  bm_sha512,              4 * KIB },
+    { "sha512/1m",                  bm_sha512,              MIB },
+    { "blake3/4k",                  bm_blake3,              4 * KIB },
+    { "blake3/1m",                  bm_blake3,              MIB },
+    { "aes128_cbc_decrypt/4k",      bm_aes128_cbc_decrypt,  4 * KIB },
+    { "aes128_cbc_decrypt/1m",      bm_aes128_cbc_decrypt,  MIB },
+    { "aes256_ctr/4k",              bm_aes256_ctr,          4 * KIB },
+    { "aes256_ctr/1m",              bm_aes256_ctr,          MIB },
+    { "aes256_gcm_encrypt/4k",      bm_aes256_gcm_encrypt,  4 * KIB },
+    { "aes256_gcm_encrypt/1m",      bm_aes256_gcm_encrypt,  MIB },
+    { "aes256_gcm_decrypt/4k",      bm_aes256_gcm_decrypt,  4 * KIB },
+    { "aes256_gcm_decrypt/1m",      bm_aes256_gcm_decrypt,  MIB },
+    { "rsa2048_verify",             bm_rsa2048_verify,      0 },
+    { "verify_signature/4k",        bm_verify_signature,    0 },
+};
+
+const uint32_t bench_crypto_case_count = sizeof(bench_crypto_cases) / sizeof(bench_crypto_cases[0]);
@@ -0,0 +1,342 @@
+/*
+ * bench_fs.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ *
+ * Filesystem driver benchmarks over RAM-disk images. Nothing is assumed
+ * about an image's contents: at setup the root and its subdirectories are
+ * listed, and the files found there (and the largest of them) are what
+ * the lookup, scan and read cases use, so any FAT32, ext2 or ISO 9660
+ * image works, including a copy of a real ESP.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hostbench.h"
+#include "../../fs/fs_mount.h"
+#include "../../fs/fat32.h"
+#include "../../fs/ext2.h"
+#include "../../fs/iso9660.h"
+
+#define BENCH_FS_PATH_MAX       FS_DCACHE_PATH_MAX
+#define BENCH_FS_MAX_DIRS       256
+#define BENCH_FS_MAX_FILES      4096
+#define BENCH_FS_LIST_SIZE      (64 * 1024)
+#define BENCH_FS_READ_SIZE      (4 * 1024 * 1024)
+
+typedef char bench_path_t[BENCH_FS_PATH_MAX];
+
+typedef struct {
+    const char *fstype;
+    const char *mount;
+    const char **image;
+    // Driver-level path walk, bypassing the VFS dentry cache
+    int (*lookup)(void *priv, const char *path);
+
+    block_device_t *dev;
+    mount_point_t *mp;
+    bench_path_t *dirs;         // Relative to the volume root
+    uint32_t dir_count;
+    bench_path_t *files;
+    uint32_t file_count;
+    bench_path_t big;           // Largest file found
+    uint32_t big_size;
+} bench_volume_t;
+
+enum { VOLUME_FAT, VOLUME_EXT2, VOLUME_ISO, VOLUME_COUNT };
+
+static int lookup_fat32(void *priv, const char *path) {
+    uint32_t cluster, size;
+    return fat32_find_file((fat32_private_t *)priv, path, &cluster, &size);
+}
+
+static int lookup_ext2(void *priv, const char *path) {
+    uint32_t inode;
+    return ext2_find_file((ext2_private_t *)priv, path, &inode);
+}
+
+static int lookup_iso9660(void *priv, const char *path) {
+    uint32_t extent, size;
+    return iso9660_find_file((iso9660_private_t *)priv, path, &extent, &size);
+}
+
+static bench_volume_t volumes[VOLUME_COUNT] = {
+    [VOLUME_FAT]  = { "fat32",   "/fat",  &bench_images.fat,  lookup_fat32 },
+    [VOLUME_EXT2] = { "ext2",    "/ext2", &bench_images.ext2, lookup_ext2 },
+    [VOLUME_ISO]  = { "iso9660", "/iso",  &bench_images.iso,  lookup_iso9660 },
+};
+
+static char *list_buf = NULL;
+static uint8_t *read_buf = NULL;
+
+// Mount path plus a volume-relative path
+static void full_path(const bench_volume_t *v, const char *rel, bench_path_t out) {
+    snprintf(out, BENCH_FS_PATH_MAX, "%s%s", v->mount, rel);
+}
+
+// Record the entries of one directory; subdirectories only when `descend`
+static void discover_dir(bench_volume_t *v, const char *rel, bool descend) {
+    bench_path_t path;
+    full_path(v, rel, path);
+    int len = fs_list_dir(path, list_buf, BENCH_FS_LIST_SIZE - 1);
+    if (len <= 0) {
+        return;
+    }
+    list_buf[len] = '\0';
+
+    for (char *name = list_buf, *end; *name; name = end + 1) {
+        end = strchr(name, '\n');
+        if (!end) {
+            break;
+        }
+        *end = '\0';
+        if (!*name || !strcmp(name, ".") || !strcmp(name, "..")) {
+            continue;
+        }
+
+        bench_path_t child;
+        uint32_t size;
+        bool is_dir;
+        if ((size_t)snprintf(child, sizeof(child), "%s/%s", strcmp(rel, "/") ? rel : "", name) >= sizeof(child)) {
+            continue;
+        }
+        full_path(v, child, path);
+        if (fs_get_info(path, &size, &is_dir) != 0) {
+            continue;
+        }
+        if (is_dir) {
+            if (descend && v->dir_count < BENCH_FS_MAX_DIRS) {
+                strcpy(v->dirs[v->dir_count++], child);
+            }
+        } else {
+            if (v->file_count < BENCH_FS_MAX_FILES) {
+                strcpy(v->files[v->file_count++], child);
+            }
+            if (size > v->big_size) {
+                v->big_size = size;
+                strcpy(v->big, child);
+            }
+        }
+    }
+}
+
+static bool volume_open(bench_volume_t *v) {
+    if (!*v->image) {
+        return false;
+    }
+    v->dev = ramdisk_open(*v->image);
+    if (!v->dev) {
+        return false;
+    }
+    if (fs_mount_device(v->mount, v->fstype, v->dev, 0, NULL) != 0) {
+        fprintf(stderr, "hostbench: %s is not a %s volume\n", *v->image, v->fstype);
+        ramdisk_close(v->dev);
+        v->dev = NULL;
+        return false;
+    }
+    v->mp = fs_get_mount_point(v->mount);
+    v->dirs = (bench_path_t *)calloc(BENCH_FS_MAX_DIRS, sizeof(bench_path_t));
+    v->files = (bench_path_t *)calloc(BENCH_FS_MAX_FILES, sizeof(bench_path_t));
+    if (!v->dirs || !v->files) {
+        return false;
+    }
+
+    strcpy(v->dirs[v->dir_count++], "/");
+    discover_dir(v, "/", true);
+    for (uint32_t d = 1; d < v->dir_count; d++) {
+        discover_dir(v, v->dirs[d], false);
+    }
+    printf("%s: %s, %u directories, %u files, largest %s (%u bytes)\n", v->fstype, *v->image, v->dir_count,
+           v->file_count, v->big_size ? v->big : "-", v->big_size);
+    return true;
+}
+
+static void volume_close(bench_volume_t *v) {
+    if (v->mp) {
+        fs_unmount(v->mount);
+        v->mp = NULL;
+    }
+    ramdisk_close(v->dev);
+    free(v->dirs);
+    free(v->files);
+    v->dev = NULL;
+    v->dirs = NULL;
+    v->files = NULL;
+    v->dir_count = 0;
+    v->file_count = 0;
+    v->big_size = 0;
+}
+
+bool bench_fs_setup(void) {
+    bool any = false;
+
+    list_buf = (char *)malloc(BENCH_FS_LIST_SIZE);
+    read_buf = (uint8_t *)malloc(BENCH_FS_READ_SIZE);
+    if (!list_buf || !read_buf) {
+        fprintf(stderr, "hostbench: out of memory for filesystem buffers\n");
+        return false;
+    }
+    fs_init();
+    for (uint32_t i = 0; i < VOLUME_COUNT; i++) {
+        any |= volume_open(&volumes[i]);
+    }
+    if (!any) {
+        printf("no disk images given (--fat, --ext2, --iso): filesystem cases skipped\n");
+    }
+    return any;
+}
+
+void bench_fs_teardown(void) {
+    for (uint32_t i = 0; i < VOLUME_COUNT; i++) {
+        volume_close(&volumes[i]);
+    }
+    blockdev_detach();
+    free(list_buf);
+    free(read_buf);
+    list_buf = NULL;
+    read_buf = NULL;
+}
+
+static bench_volume_t *volume_for(bench_state_t *s) {
+    bench_volume_t *v = &volumes[s->arg];
+    if (!v->mp) {
+        s->error = "no image for this filesystem";
+        return NULL;
+    }
+    return v;
+}
+
+// Mount from a cold block cache: superblock, FAT/group descriptor and
+// path table reads all come from the RAM disk
+static void bm_mount(bench_state_t *s) {
+    bench_volume_t *v = volume_for(s);
+    if (!v) {
+        return;
+    }
+    for (uint64_t i = 0; i < s->iterations; i++) {
+        fs_unmount(v->mount);
+        blockdev_invalidate_device(v->dev);
+        if (fs_mount_device(v->mount, v->fstype, v->dev, 0, NULL) != 0) {
+            v->mp = NULL;
+            s->error = "remount failed";
+            return;
+        }
+    }
+    v->mp = fs_get_mount_point(v->mount);
+    s->items = 1;
+}
+
+// Path walks over every discovered file in turn, through the driver
+static void bm_lookup(bench_state_t *s) {
+    bench_volume_t *v = volume_for(s);
+    if (!v) {
+        return;
+    }
+    if (v->file_count == 0) {
+        s->error = "no files on the image";
+        return;
+    }
+    block_device_t *previous = blockdev_select(v->dev);
+    for (uint64_t i = 0; i < s->iterations; i++) {
+        // Stride through the list so neighbouring lookups hit different directories
+        const char *path = v->files[(i * 2654435761u) % v->file_count];
+        if (v->lookup(v->mp->private_data, path) != 0) {
+            s->error = "lookup failed";
+            break;
+        }
+    }
+    blockdev_select(previous);
+    s->items = 1;
+}
+
+// Whole-directory scans through the VFS
+static void bm_list_dir(bench_state_t *s) {
+    bench_volume_t *v = volume_for(s);
+    if (!v) {
+        return;
+    }
+    for (uint64_t i = 0; i < s->iterations; i++) {
+        bench_path_t path;
+        full_path(v, v->dirs[i % v->dir_count], path);
+        if (fs_list_dir(path, list_buf, BENCH_FS_LIST_SIZE) < 0) {
+            s->error = "listing failed";
+            return;
+        }
+        bench_consume(list_buf, BENCH_FS_LIST_SIZE);
+    }
+    s->items = 1;
+}
+
+// Sequential reads of the largest file, BENCH_FS_READ_SIZE at a time
+static void bm_read(bench_state_t *s) {
+    bench_volume_t *v = volume_for(s);
+    if (!v) {
+        return;
+    }
+    if (v->big_size == 0) {
+        s->error = "no non-empty file on the image";
+        return;
+    }
+    uint32_t chunk = v->big_size < BENCH_FS_READ_SIZE ? v->big_size : BENCH_FS_READ_SIZE;
+    uint32_t offset = 0;
+    bench_path_t path;
+    full_path(v, v->big, path);
+    for (uint64_t i = 0; i < s->iterations; i++) {
+        if (offset + chunk > v->big_size) {
+            offset = 0;
+        }
+        if (fs_read(path, read_buf, chunk, offset) != (int)chunk) {
+            s->error = "read failed";
+            return;
+        }
+        bench_consume(read_buf, chunk);
+        offset += chunk;
+    }
+    s->bytes = chunk;
+}
+
+// Follow the largest file's cluster chain end to end through the FAT cache
+static void bm_fat_chain_walk(bench_state_t *s) {
+    bench_volume_t *v = volume_for(s);
+    if (!v) {
+        return;
+    }
+    fat32_private_t *priv = (fat32_private_t *)v->mp->private_data;
+    uint32_t first, size;
+    uint64_t clusters = 0;
+
+    block_device_t *previous = blockdev_select(v->dev);
+    if (v->big_size == 0 || fat32_find_file(priv, v->big, &first, &size) != 0) {
+        blockdev_select(previous);
+        s->error = "no non-empty file on the image";
+        return;
+    }
+    for (uint64_t i = 0; i < s->iterations; i++) {
+        clusters = 0;
+        for (uint32_t c = first; c >= 2 && c < 0x0FFFFFF8; c = fat32_get_cluster(priv, c)) {
+            clusters++;
+        }
+    }
+    blockdev_select(previous);
+    s->items = clusters;
+}
+
+const bench_case_t bench_fs_cases[] = {
+    { "fat32/mount",        bm_mount,           VOLUME_FAT },
+    { "fat32/chain_walk",   bm_fat_chain_walk,  VOLUME_FAT },
+    { "fat32/lookup",       bm_lookup,          VOLUME_FAT },
+    { "fat32/list_dir",     bm_list_dir,        VOLUME_FAT },
+    { "fat32/read",         bm_read,            VOLUME_FAT },
+    { "ext2/mount",         bm_mount,           VOLUME_EXT2 },
+    { "ext2/lookup",        bm_lookup,          VOLUME_EXT2 },
+    { "ext2/list_dir",      bm_list_dir,        VOLUME_EXT2 },
+    { "ext2/read",          bm_read,            VOLUME_EXT2 },
+    { "iso9660/mount",      bm_mount,           VOLUME_ISO },
+    { "iso9660/lookup",     bm_lookup,          VOLUME_ISO },
+    { "iso9660/list_dir",   bm_list_dir,        VOLUME_ISO },
+    { "iso9660/read",       bm_read,            VOLUME_ISO },
+};
+
+const uint32_t bench_fs_case_count = sizeof(bench_fs_cases) / sizeof(bench_fs_cases[0]);
@@ -0,0 +1,23 @@
+/*
+ * bloodhorn.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ *
+ * Host stand-in for the libb umbrella header, found first through
+ * -Ibench/host. Only the parts that build on their own are pulled in:
+ * enough for bhshim.h, and so for the net/ code behind it.
+ */
+
+#ifndef BLOODHORN_H
+#define BLOODHORN_H
+
+#include <bloodhorn/types.h>
+#include <bloodhorn/status.h>
+#include <bloodhorn/memory.h>
+#include <bloodhorn/debug.h>
+
+// The Rust shim's status for a rejected argument, as the real header has it
+#define BH_INVALID_PARAMETER     -2
+
+#endif // BLOODHORN_H
@@ -0,0 +1,58 @@
+/*
+ * compat.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ *
+ * Host stand-in for the root compat.h: the host benchmarks put this
+ * directory first on the include path, so fs/ and security/ get the
+ * system C library instead of cLib and cc-runtime.
+ */
+
+#ifndef _COMPAT_H_
+#define _COMPAT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// Same EDK2-style types and aliases as the root compat.h outside EDK2
+typedef uint8_t   UINT8;
+typedef uint16_t  UINT16;
+typedef uint32_t  UINT32;
+typedef uint64_t  UINT64;
+typedef int8_t    INT8;
+typedef int16_t   INT16;
+typedef int32_t   INT32;
+typedef int64_t   INT64;
+typedef size_t    UINTN;
+typedef void      VOID;
+typedef int       BOOLEAN;
+typedef UINTN     EFI_STATUS;
+
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
+#define EFIAPI
+#define IN
+#define OUT
+#define OPTIONAL
+#define CONST const
+
+#define CopyMem(dest, src, size) memcpy((dest), (src), (size))
+#define SetMem(buf, size, val) memset((buf), (val), (size))
+#define ZeroMem(buf, size) memset((buf), 0, (size))
+#define CompareMem(a, b, len) memcmp((a), (b), (len))
+
+#define StrLen(s) strlen((const char*)(s))
+#define StrCmp strcmp
+#define StrnCmp strncmp
+#define AsciiStrLen strlen
+#define AsciiStrCmp strcmp
+
+#endif // _COMPAT_H_
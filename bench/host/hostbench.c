@@ -0,0 +1,330 @@
+/*
+ * hostbench.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ *
+ * Driver for the host micro-benchmarks: option parsing, the timing loop,
+ * RAM disks and the few firmware hooks the modules expect.
+ */
+
+#include <getopt.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hostbench.h"
+#include "bloodhorn/trace.h"
+#include "bloodhorn/parallel.h"
+
+bench_images_t bench_images;
+
+static double min_time = 0.5;
+static regex_t filter;
+static bool filtered = false;
+static bool list_only = false;
+static FILE *json_out = NULL;      // --json: per-case results for bench/budget.py
+static bool json_first = true;
+
+// The timeline tracer lives in libb; mounts here are not on a boot path
+bh_trace_span_t bh_trace_begin(const char* name) {
+    (void)name;
+    return BH_TRACE_INVALID_SPAN;
+}
+
+void bh_trace_end(bh_trace_span_t span) {
+    (void)span;
+}
+
+// So does the task pool; here parallel work runs on the caller
+bh_uint32_t bh_parallel_workers(void) {
+    return 1;
+}
+
+void bh_parallel_for(bh_size_t count, bh_size_t grain, bh_parallel_body_t body, void* arg) {
+    (void)grain;
+    if (count > 0) {
+        body(0, count, arg);
+    }
+}
+
+void bench_consume(const void *p, size_t len) {
+    (void)len;
+    __asm__ volatile("" : : "r"(p) : "memory");
+}
+
+// A whole image in memory behind the block_device_t interface
+typedef struct {
+    block_device_t dev;
+    uint8_t *data;
+    uint64_t size;
+} ramdisk_t;
+
+static int ramdisk_read(block_device_t *dev, uint64_t sector, uint32_t count, void *buf) {
+    ramdisk_t *disk = (ramdisk_t *)dev->context;
+    uint64_t offset = sector * BLOCKDEV_SECTOR_SIZE;
+    uint64_t len = (uint64_t)count * BLOCKDEV_SECTOR_SIZE;
+
+    if (sector >= dev->sector_count || count > dev->sector_count - sector) {
+        return -1;
+    }
+    memcpy(buf, disk->data + offset, len);
+    return 0;
+}
+
+block_device_t *ramdisk_open(const char *path) {
+    FILE *f = fopen(path, "rb");
+    ramdisk_t *disk = NULL;
+
+    if (!f) {
+        fprintf(stderr, "hostbench: cannot open %s\n", path);
+        return NULL;
+    }
+    if (fseek(f, 0, SEEK_END) != 0) {
+        goto fail;
+    }
+    long size = ftell(f);
+    if (size < BLOCKDEV_SECTOR_SIZE || fseek(f, 0, SEEK_SET) != 0) {
+        goto fail;
+    }
+    disk = (ramdisk_t *)calloc(1, sizeof(*disk));
+    if (!disk || !(disk->data = (uint8_t *)malloc((size_t)size))) {
+        goto fail;
+    }
+    if (fread(disk->data, 1, (size_t)size, f) != (size_t)size) {
+        goto fail;
+    }
+    fclose(f);
+
+    disk->size = (uint64_t)size;
+    disk->dev.name = path;
+    disk->dev.sector_count = disk->size / BLOCKDEV_SECTOR_SIZE;
+    disk->dev.read = ramdisk_read;
+    disk->dev.context = disk;
+    return &disk->dev;
+
+fail:
+    fprintf(stderr, "hostbench: cannot read %s\n", path);
+    if (disk) {
+        free(disk->data);
+        free(disk);
+    }
+    fclose(f);
+    return NULL;
+}
+
+void ramdisk_close(block_device_t *dev) {
+    if (dev) {
+        ramdisk_t *disk = (ramdisk_t *)dev->context;
+        free(disk->data);
+        free(disk);
+    }
+}
+
+static double clock_seconds(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// "1.23 us" style, like Google Benchmark's time columns
+static void format_time(char *out, size_t size, double seconds) {
+    if (seconds < 1e-6) {
+        snprintf(out, size, "%.1f ns", seconds * 1e9);
+    } else if (seconds < 1e-3) {
+        snprintf(out, size, "%.2f us", seconds * 1e6);
+    } else if (seconds < 1.0) {
+        snprintf(out, size, "%.2f ms", seconds * 1e3);
+    } else {
+        snprintf(out, size, "%.3f s", seconds);
+    }
+}
+
+static void format_rate(char *out, size_t size, double per_second, const char *unit, double scale) {
+    static const char prefixes[] = " kMGT";
+    uint32_t p = 0;
+
+    while (per_second >= scale && p + 1 < sizeof(prefixes) - 1) {
+        per_second /= scale;
+        p++;
+    }
+    if (p == 0) {
+        snprintf(out, size, "%.1f %s/s", per_second, unit);
+    } else {
+        snprintf(out, size, "%.2f %c%s%s/s", per_second, prefixes[p], scale == 1024.0 ? "i" : "", unit);
+    }
+}
+
+static void json_case(const char *name, const char *error, double seconds, uint64_t bytes, uint64_t iterations) {
+    if (!json_out) {
+        return;
+    }
+    fprintf(json_out, "%s\n    \"%s\": ", json_first ? "" : ",", name);
+    json_first = false;
+    if (error) {
+        fprintf(json_out, "{\"skipped\": \"%s\"}", error);
+    } else {
+        fprintf(json_out, "{\"ns\": %.0f, \"bytes\": %llu, \"iterations\": %llu}", seconds * 1e9,
+                (unsigned long long)bytes, (unsigned long long)iterations);
+    }
+}
+
+static void print_header(void) {
+    static bool printed = false;
+
+    if (!printed) {
+        printf("%-40s %12s %12s %12s  %s\n", "Benchmark", "Time", "CPU", "Iterations", "Throughput");
+        printf("----------------------------------------------------------------------------------------------\n");
+        printed = true;
+    }
+}
+
+static void run_case(const bench_case_t *c) {
+    bench_state_t state;
+    double wall = 0.0;
+    double cpu = 0.0;
+    uint64_t iterations = 1;
+
+    // Grow the iteration count until one run is long enough to trust
+    for (;;) {
+        memset(&state, 0, sizeof(state));
+        state.iterations = iterations;
+        state.arg = c->arg;
+
+        double wall_start = clock_seconds(CLOCK_MONOTONIC);
+        double cpu_start = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+        c->run(&state);
+        cpu = clock_seconds(CLOCK_PROCESS_CPUTIME_ID) - cpu_start;
+        wall = clock_seconds(CLOCK_MONOTONIC) - wall_start;
+
+        if (state.error || wall >= min_time || iterations >= 1000000000ull) {
+            break;
+        }
+        double scale = wall > 0.0 ? min_time * 1.4 / wall : 10.0;
+        uint64_t next = (uint64_t)((double)iterations * (scale < 10.0 ? scale : 10.0));
+        iterations = next > iterations ? next : iterations + 1;
+    }
+
+    print_header();
+    if (state.error) {
+        printf("%-40s SKIPPED: %s\n", c->name, state.error);
+        json_case(c->name, state.error, 0.0, 0, 0);
+        return;
+    }
+    json_case(c->name, NULL, wall / (double)state.iterations, state.bytes, state.iterations);
+
+    char wall_text[32];
+    char cpu_text[32];
+    char rate[64] = "";
+    format_time(wall_text, sizeof(wall_text), wall / (double)state.iterations);
+    format_time(cpu_text, sizeof(cpu_text), cpu / (double)state.iterations);
+    if (state.bytes) {
+        format_rate(rate, sizeof(rate), (double)(state.bytes * state.iterations) / wall, "B", 1024.0);
+    } else if (state.items) {
+        format_rate(rate, sizeof(rate), (double)(state.items * state.iterations) / wall, "items", 1000.0);
+    }
+    printf("%-40s %12s %12s %12llu  %s\n", c->name, wall_text, cpu_text,
+           (unsigned long long)state.iterations, rate);
+    fflush(stdout);
+}
+
+static void run_table(const bench_case_t *cases, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (filtered && regexec(&filter, cases[i].name, 0, NULL, 0) != 0) {
+            continue;
+        }
+        if (list_only) {
+            printf("%s\n", cases[i].name);
+        } else {
+            run_case(&cases[i]);
+        }
+    }
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: hostbench [--filter REGEX] [--min-time SECONDS] [--software]\n"
+            "                 [--fat IMAGE] [--ext2 IMAGE] [--iso IMAGE] [--list] [--json FILE]\n");
+}
+
+int main(int argc, char **argv) {
+    static const struct option options[] = {
+        { "filter",   required_argument, NULL, 'f' },
+        { "min-time", required_argument, NULL, 't' },
+        { "software", no_argument,       NULL, 's' },
+        { "fat",      required_argument, NULL, 'F' },
+        { "ext2",     required_argument, NULL, 'E' },
+        { "iso",      required_argument, NULL, 'I' },
+        { "list",     no_argument,       NULL, 'l' },
+        { "json",     required_argument, NULL, 'j' },
+        { "help",     no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    bool software_only = false;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "f:t:sl", options, NULL)) != -1) {
+        switch (opt) {
+        case 'f':
+            if (regcomp(&filter, optarg, REG_EXTENDED | REG_NOSUB) != 0) {
+                fprintf(stderr, "hostbench: bad filter '%s'\n", optarg);
+                return 2;
+            }
+            filtered = true;
+            break;
+        case 't':
+            min_time = atof(optarg);
+            if (min_time <= 0.0) {
+                min_time = 0.5;
+            }
+            break;
+        case 's':
+            software_only = true;
+            break;
+        case 'F':
+            bench_images.fat = optarg;
+            break;
+        case 'E':
+            bench_images.ext2 = optarg;
+            break;
+        case 'I':
+            bench_images.iso = optarg;
+            break;
+        case 'l':
+            list_only = true;
+            break;
+        case 'j':
+            json_out = fopen(optarg, "w");
+            if (!json_out) {
+                fprintf(stderr, "hostbench: cannot write %s\n", optarg);
+                return 2;
+            }
+            break;
+        default:
+            usage();
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+
+    if (json_out) {
+        fprintf(json_out, "{\n  \"cases\": {");
+    }
+    if (list_only || bench_crypto_setup(software_only)) {
+        run_table(bench_crypto_cases, bench_crypto_case_count);
+        bench_crypto_teardown();
+    }
+    if (list_only || bench_fs_setup()) {
+        run_table(bench_fs_cases, bench_fs_case_count);
+        bench_fs_teardown();
+    }
+
+    if (json_out) {
+        fprintf(json_out, "\n  }\n}\n");
+        fclose(json_out);
+    }
+    if (filtered) {
+        regfree(&filter);
+    }
+    return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * hostbench.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ *
+ * Host micro-benchmarks for fs/ and security/. The modules are built
+ * unchanged for the host; disks are image files loaded into memory and
+ * served through the same block layer the firmware uses, so the numbers
+ * (and perf/VTune profiles) cover the driver code rather than any I/O.
+ */
+
+#ifndef BLOODHORN_HOSTBENCH_H
+#define BLOODHORN_HOSTBENCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../../fs/blockdev.h"
+
+// Passed to a benchmark: run the measured operation `iterations` times,
+// then say how much work one iteration was. The harness grows
+// `iterations` until a run lasts at least the minimum time.
+typedef struct {
+    uint64_t iterations;
+    uint64_t arg;               // From the case table (a size, a count)
+    uint64_t bytes;             // Per iteration, for a throughput column
+    uint64_t items;             // Per iteration, for an items/s column
+    const char *error;          // Set to skip the case with this reason
+} bench_state_t;
+
+typedef void (*bench_fn_t)(bench_state_t *state);
+
+typedef struct {
+    const char *name;
+    bench_fn_t run;
+    uint64_t arg;
+} bench_case_t;
+
+// Case tables, one per source file
+extern const bench_case_t bench_fs_cases[];
+extern const uint32_t bench_fs_case_count;
+extern const bench_case_t bench_crypto_cases[];
+extern const uint32_t bench_crypto_case_count;
+
+// Set up once before any case runs; return false to skip the whole file
+bool bench_fs_setup(void);
+void bench_fs_teardown(void);
+bool bench_crypto_setup(bool software_only);
+void bench_crypto_teardown(void);
+
+// Disk images named on the command line, NULL when not given
+typedef struct {
+    const char *fat;
+    const char *ext2;
+    const char *iso;
+} bench_images_t;
+
+extern bench_images_t bench_images;
+
+// Load an image file into memory as a block device (NULL on failure)
+block_device_t *ramdisk_open(const char *path);
+void ramdisk_close(block_device_t *dev);
+
+// Keep the compiler from discarding a result
+void bench_consume(const void *p, size_t len);
+
+#endif // BLOODHORN_HOSTBENCH_H
@@ -0,0 +1,76 @@
+#!/bin/sh
+# This file is part of BloodHorn and is licensed under the BSD License.
+# See the root of the repository for license details.
+#
+# Build the FAT32, ext2 and ISO 9660 images the host benchmarks mount:
+# DIRS directories of FILES small files each, plus one BIG_MB file for the
+# read and FAT chain cases. Usage: mkimages.sh OUT_DIR
+# Needs mkfs.fat and mcopy (dosfstools, mtools), mke2fs (e2fsprogs) and
+# xorriso or genisoimage; an image whose tools are missing is skipped.
+
+set -eu
+
+OUT=${1:?usage: mkimages.sh OUT_DIR}
+DIRS=${DIRS:-32}
+FILES=${FILES:-128}
+BIG_MB=${BIG_MB:-64}
+
+have() {
+    command -v "$1" >/dev/null 2>&1
+}
+
+mkdir -p "$OUT"
+TREE="$OUT/tree"
+STAMP="$OUT/.tree-$DIRS-$FILES-$BIG_MB"
+
+if [ ! -f "$STAMP" ]; then
+    rm -rf "$TREE" "$OUT"/.tree-*
+    mkdir -p "$TREE"
+    d=0
+    while [ "$d" -lt "$DIRS" ]; do
+        dir=$(printf '%s/d%03d' "$TREE" "$d")
+        mkdir "$dir"
+        f=0
+        while [ "$f" -lt "$FILES" ]; do
+            # 8.3 names, so the FAT driver's short-name lookups find them
+            head -c $((512 + (d * 131 + f * 17) % 3584)) /dev/urandom > "$(printf '%s/f%04d.cfg' "$dir" "$f")"
+            f=$((f + 1))
+        done
+        d=$((d + 1))
+    done
+    head -c $((BIG_MB * 1024 * 1024)) /dev/urandom > "$TREE/big.bin"
+    rm -f "$OUT/fat.img" "$OUT/ext2.img" "$OUT/iso.img"
+    touch "$STAMP"
+fi
+
+# Room for the tree plus filesystem overhead, in MiB
+SIZE_MB=$((BIG_MB + DIRS * FILES * 8 / 1024 + 64))
+
+if [ ! -f "$OUT/fat.img" ]; then
+    if have mkfs.fat && have mcopy; then
+        # One sector per cluster: the longest chains the volume allows
+        truncate -s "${SIZE_MB}M" "$OUT/fat.img"
+        mkfs.fat -F 32 -s 1 -n BHBENCH "$OUT/fat.img" >/dev/null
+        mcopy -s -i "$OUT/fat.img" "$TREE"/* ::/
+    else
+        echo "mkimages: mkfs.fat/mcopy not found, skipping fat.img" >&2
+    fi
+fi
+
+if [ ! -f "$OUT/ext2.img" ]; then
+    if have mke2fs; then
+        mke2fs -q -F -t ext2 -b 4096 -d "$TREE" "$OUT/ext2.img" "${SIZE_MB}M"
+    else
+        echo "mkimages: mke2fs not found, skipping ext2.img" >&2
+    fi
+fi
+
+if [ ! -f "$OUT/iso.img" ]; then
+    if have xorriso; then
+        xorriso -as mkisofs -quiet -R -J -V BHBENCH -o "$OUT/iso.img" "$TREE"
+    elif have genisoimage; then
+        genisoimage -quiet -R -J -V BHBENCH -o "$OUT/iso.img" "$TREE"
+    else
+        echo "mkimages: xorriso/genisoimage not found, skipping iso.img" >&2
+    fi
+fi
@@ -0,0 +1,18 @@
+/*
+ * mm.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ *
+ * Host stand-in for the kernel allocator the filesystem drivers use.
+ */
+
+#ifndef BLOODHORN_HOST_MM_H
+#define BLOODHORN_HOST_MM_H
+
+#include <stdlib.h>
+
+#define kmalloc(size)   malloc(size)
+#define kfree(ptr)      free(ptr)
+
+#endif // BLOODHORN_HOST_MM_H
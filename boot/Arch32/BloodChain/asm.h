@@ -12,7 +12,9 @@
 #error "This header is for assembly files only"
 #endif
 
-// Offsets for the bcbp_header structure
+// Offsets for the 1.0 bcbp_header the real-mode stage builds. The 2.0
+// block (module index, string table, digests) is only built by
+// bloodchain.c; kernels tell the two apart by the major version.
 .equ BCBP_MAGIC_OFFSET, 0
 .equ BCBP_VERSION_OFFSET, 4
 .equ BCBP_ENTRY_POINT_OFFSET, 8
@@ -36,6 +38,8 @@
 .equ BCBP_MODTYPE_EFI, 0x06
 .equ BCBP_MODTYPE_CONFIG, 0x07
 .equ BCBP_MODTYPE_DRIVER, 0x08
+.equ BCBP_MODTYPE_TPM_LOG, 0x09
+.equ BCBP_MODTYPE_BOOT_LOG, 0x0A
 
 // Magic number for BCBP header
 .equ BCBP_MAGIC, 0x424C4348  // 'BLCH'
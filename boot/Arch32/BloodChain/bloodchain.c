@@ -8,171 +8,196 @@
 #include "bloodchain.h"
 #include <string.h>
 
-// Internal function to calculate required memory for modules and strings
-static size_t calculate_required_memory(const struct bcbp_header *hdr) {
-    if (!hdr || hdr->magic != BCBP_MAGIC) return 0;
-    
-    size_t total = sizeof(struct bcbp_header);
-    total += hdr->module_count * sizeof(struct bcbp_module);
-    
-    // Add space for module names and command lines
-    const struct bcbp_module *mod = (const struct bcbp_module *)hdr->modules;
-    for (uint64_t i = 0; i < hdr->module_count; i++) {
-        if (mod[i].name) {
-            total += strlen((const char *)mod[i].name) + 1;
-        }
-        if (mod[i].cmdline) {
-            total += strlen((const char *)mod[i].cmdline) + 1;
-        }
-    }
-    
-    return total;
+static char *string_table(const struct bcbp_header *hdr) {
+    return (char *)hdr + hdr->string_offset;
+}
+
+static uint32_t *name_index(const struct bcbp_header *hdr) {
+    return (uint32_t *)((uint8_t *)hdr + hdr->index_offset);
 }
 
-void bcbp_init(struct bcbp_header *hdr, uint64_t entry_point, uint64_t boot_device) {
-    if (!hdr) return;
-    
+// Copy a string into the table; its offset, or 0 when it does not fit
+static uint32_t add_string(struct bcbp_header *hdr, const char *s) {
+    size_t len = strlen(s) + 1;
+    uint32_t capacity = hdr->block_size - hdr->string_offset;
+    if (len > capacity - hdr->string_size) return 0;
+
+    uint32_t offset = hdr->string_size;
+    memcpy(string_table(hdr) + offset, s, len);
+    hdr->string_size += (uint32_t)len;
+    hdr->total_size = hdr->string_offset + hdr->string_size;
+    return offset;
+}
+
+int bcbp_init(struct bcbp_header *hdr, uint32_t block_size, uint64_t entry_point, uint64_t boot_device) {
+    if (!hdr) return -1;
+
     // Clear the entire header
     memset(hdr, 0, sizeof(struct bcbp_header));
-    
+
     // Set magic and version
     hdr->magic = BCBP_MAGIC;
     hdr->version = BCBP_VERSION;
-    
+
     // Set entry point and boot device
     hdr->entry_point = entry_point;
     hdr->boot_device = boot_device;
-    
-    // Initialize module list (starts right after the header)
-    hdr->modules = (uint64_t)(hdr + 1);
+
+    // Half the block for records and index, the rest for strings; one
+    // bucket per record, rounded up to a power of two
+    uint32_t capacity = 0;
+    if (block_size > sizeof(struct bcbp_header)) {
+        capacity = (block_size - sizeof(struct bcbp_header)) / (2 * (sizeof(struct bcbp_module) + 2 * sizeof(uint32_t)));
+    }
+    if (capacity > BCBP_MAX_MODULES) capacity = BCBP_MAX_MODULES;
+    if (capacity == 0) return -1;
+    uint32_t buckets = 1;
+    while (buckets < capacity) buckets <<= 1;
+
+    hdr->header_size = sizeof(struct bcbp_header);
+    hdr->module_size = sizeof(struct bcbp_module);
+    hdr->block_size = block_size;
+    hdr->module_offset = (sizeof(struct bcbp_header) + 7) & ~7u;
+    hdr->module_capacity = capacity;
+    hdr->index_offset = hdr->module_offset + capacity * sizeof(struct bcbp_module);
+    hdr->index_buckets = buckets;
+    hdr->string_offset = hdr->index_offset + buckets * sizeof(uint32_t);
+    memset(name_index(hdr), 0xFF, buckets * sizeof(uint32_t));
+    string_table(hdr)[0] = 0;
+    hdr->string_size = 1;
+    hdr->total_size = hdr->string_offset + hdr->string_size;
+
+    hdr->modules = (uint64_t)(uintptr_t)((uint8_t *)hdr + hdr->module_offset);
     hdr->module_count = 0;
-    
+
     // Initialize security features (to be set by bootloader)
     hdr->secure_boot = 0;
     hdr->tpm_available = 0;
     hdr->uefi_64bit = 0;
+    return 0;
 }
 
-void bcbp_add_module(struct bcbp_header *hdr, uint64_t start, uint64_t size,
-                    const char *name, uint8_t type, const char *cmdline) {
-    if (!hdr || hdr->magic != BCBP_MAGIC || !name || size == 0) return;
-    
-    // Get module array
-    struct bcbp_module *mods = (struct bcbp_module *)hdr->modules;
-    
-    // Calculate where the string data starts (after all module structures)
-    char *str_ptr = (char *)(mods + hdr->module_count + 1);
-    
-    // Find the end of the current string data
-    for (uint64_t i = 0; i < hdr->module_count; i++) {
-        if (mods[i].name) {
-            const char *name_str = (const char *)mods[i].name;
-            size_t len = strlen(name_str) + 1;
-            if ((char *)name_str + len > str_ptr) {
-                str_ptr = (char *)name_str + len;
-            }
-        }
-        if (mods[i].cmdline) {
-            const char *cmd_str = (const char *)mods[i].cmdline;
-            size_t len = strlen(cmd_str) + 1;
-            if ((char *)cmd_str + len > str_ptr) {
-                str_ptr = (char *)cmd_str + len;
-            }
-        }
+struct bcbp_module *bcbp_add_module(struct bcbp_header *hdr, uint64_t start, uint64_t size,
+                                    const char *name, uint8_t type, const char *cmdline) {
+    if (!hdr || hdr->magic != BCBP_MAGIC || !name || !*name || size == 0) return NULL;
+    if (hdr->module_count >= hdr->module_capacity) return NULL;
+
+    // Strings first, so a full table leaves no half-added record
+    uint32_t saved_size = hdr->string_size;
+    uint32_t name_offset = add_string(hdr, name);
+    uint32_t cmdline_offset = 0;
+    if (name_offset && cmdline && *cmdline) {
+        cmdline_offset = add_string(hdr, cmdline);
+        if (!cmdline_offset) name_offset = 0;
     }
-    
-    // Add new module
-    struct bcbp_module *mod = &mods[hdr->module_count++];
-    
-    // Set module fields
+    if (!name_offset) {
+        hdr->string_size = saved_size;
+        hdr->total_size = hdr->string_offset + hdr->string_size;
+        return NULL;
+    }
+
+    uint32_t idx = (uint32_t)hdr->module_count++;
+    struct bcbp_module *mod = bcbp_get_module(hdr, idx);
+    memset(mod, 0, sizeof(*mod));
     mod->start = start;
     mod->size = size;
     mod->type = type;
-    
-    // Store name
-    mod->name = (uint64_t)str_ptr;
-    strcpy(str_ptr, name);
-    str_ptr += strlen(name) + 1;
-    
-    // Store command line if provided
-    if (cmdline && *cmdline) {
-        mod->cmdline = (uint64_t)str_ptr;
-        strcpy(str_ptr, cmdline);
-        str_ptr += strlen(cmdline) + 1;
+    mod->name_hash = bcbp_name_hash(name);
+    mod->name_offset = name_offset;
+    mod->name = (uint64_t)(uintptr_t)(string_table(hdr) + name_offset);
+    mod->cmdline_offset = cmdline_offset;
+    mod->cmdline = cmdline_offset ? (uint64_t)(uintptr_t)(string_table(hdr) + cmdline_offset) : 0;
+    mod->next = BCBP_INDEX_END;
+
+    // Append to the end of its chain so lookups find the first of a name
+    uint32_t *bucket = &name_index(hdr)[mod->name_hash & (hdr->index_buckets - 1)];
+    if (*bucket == BCBP_INDEX_END) {
+        *bucket = idx;
     } else {
-        mod->cmdline = 0;
+        struct bcbp_module *tail = bcbp_get_module(hdr, *bucket);
+        while (tail->next != BCBP_INDEX_END) {
+            tail = bcbp_get_module(hdr, tail->next);
+        }
+        tail->next = idx;
     }
+    return mod;
+}
+
+void bcbp_set_module_digest(struct bcbp_module *mod, const uint8_t *digest) {
+    if (!mod || !digest) return;
+    memcpy(mod->sha256, digest, sizeof(mod->sha256));
+    mod->flags |= BCBP_MODFLAG_SHA256;
 }
 
 struct bcbp_module *bcbp_find_module(struct bcbp_header *hdr, const char *name) {
     if (!hdr || hdr->magic != BCBP_MAGIC || !name) return NULL;
-    
-    struct bcbp_module *mod = (struct bcbp_module *)hdr->modules;
-    
-    for (uint64_t i = 0; i < hdr->module_count; i++) {
-        if (mod[i].name && strcmp((const char *)mod[i].name, name) == 0) {
-            return &mod[i];
+
+    uint32_t hash = bcbp_name_hash(name);
+    uint32_t idx = name_index(hdr)[hash & (hdr->index_buckets - 1)];
+    while (idx != BCBP_INDEX_END && idx < hdr->module_count) {
+        struct bcbp_module *mod = bcbp_get_module(hdr, idx);
+        if (mod->name_hash == hash && strcmp(bcbp_module_name(hdr, mod), name) == 0) {
+            return mod;
         }
+        idx = mod->next;
     }
-    
+
     return NULL;
 }
 
 int bcbp_validate(const struct bcbp_header *hdr) {
     // Check pointer
     if (!hdr) return -1;
-    
+
     // Check magic number
     if (hdr->magic != BCBP_MAGIC) return -2;
-    
-    // Check version compatibility (only major version matters for compatibility)
-    if ((hdr->version >> 16) > (BCBP_VERSION >> 16)) {
-        return -3; // Major version is higher than supported
+
+    // 2.0 changed the module layout, so only this major version is readable
+    if ((hdr->version >> 16) != (BCBP_VERSION >> 16)) {
+        return -3;
     }
-    
+
     // Check for reasonable module count
-    if (hdr->module_count > 1024) return -4;
-    
-    // If we have modules, verify the modules pointer is valid
-    if (hdr->module_count > 0) {
-        // Modules must start after the header
-        if (hdr->modules <= (uint64_t)hdr || 
-            hdr->modules >= (uint64_t)hdr + calculate_required_memory(hdr)) {
-            return -5; // Invalid modules pointer
+    if (hdr->module_count > BCBP_MAX_MODULES || hdr->module_count > hdr->module_capacity) return -4;
+
+    // The regions must follow each other inside the block
+    uint64_t index_end = (uint64_t)hdr->index_offset + (uint64_t)hdr->index_buckets * sizeof(uint32_t);
+    if (hdr->header_size != sizeof(struct bcbp_header) || hdr->module_size != sizeof(struct bcbp_module) ||
+        hdr->module_offset < hdr->header_size ||
+        hdr->index_offset < hdr->module_offset + (uint64_t)hdr->module_capacity * sizeof(struct bcbp_module) ||
+        hdr->index_buckets == 0 || (hdr->index_buckets & (hdr->index_buckets - 1)) ||
+        hdr->string_offset < index_end || hdr->string_size == 0 ||
+        (uint64_t)hdr->string_offset + hdr->string_size != hdr->total_size ||
+        hdr->total_size > hdr->block_size) {
+        return -5;
+    }
+
+    // A NUL at the end of the used table terminates every string in it
+    const char *strings = (const char *)hdr + hdr->string_offset;
+    if (strings[hdr->string_size - 1] != 0) return -8;
+
+    // Chains only point forward, so each record is checked on its own
+    const uint32_t *index = (const uint32_t *)((const uint8_t *)hdr + hdr->index_offset);
+    for (uint32_t b = 0; b < hdr->index_buckets; b++) {
+        if (index[b] != BCBP_INDEX_END && index[b] >= hdr->module_count) return -11;
+    }
+    const struct bcbp_module *mod = (const struct bcbp_module *)((const uint8_t *)hdr + hdr->module_offset);
+    for (uint64_t i = 0; i < hdr->module_count; i++) {
+        // Check module type is valid
+        if (mod[i].type < BCBP_MODTYPE_KERNEL || mod[i].type > BCBP_MODTYPE_BOOT_LOG) {
+            return -6; // Invalid module type
+        }
+        if (mod[i].name_offset == 0 || mod[i].name_offset >= hdr->string_size) {
+            return -7; // Invalid name
         }
-        
-        // Verify each module
-        const struct bcbp_module *mod = (const struct bcbp_module *)hdr->modules;
-        for (uint64_t i = 0; i < hdr->module_count; i++) {
-            // Check module type is valid
-            if (mod[i].type < BCBP_MODTYPE_KERNEL || mod[i].type > BCBP_MODTYPE_DRIVER) {
-                return -6; // Invalid module type
-            }
-            
-            // Check name pointer is valid
-            if (mod[i].name) {
-                if (mod[i].name < (uint64_t)hdr || 
-                    mod[i].name >= (uint64_t)hdr + calculate_required_memory(hdr)) {
-                    return -7; // Invalid name pointer
-                }
-                if (strnlen((const char *)mod[i].name, 256) == 256) {
-                    return -8; // Name too long or not null-terminated
-                }
-            }
-            
-            // Check command line pointer if present
-            if (mod[i].cmdline) {
-                if (mod[i].cmdline < (uint64_t)hdr || 
-                    mod[i].cmdline >= (uint64_t)hdr + calculate_required_memory(hdr)) {
-                    return -9; // Invalid command line pointer
-                }
-                if (strnlen((const char *)mod[i].cmdline, 4096) == 4096) {
-                    return -10; // Command line too long or not null-terminated
-                }
-            }
+        if (mod[i].cmdline_offset >= hdr->string_size) {
+            return -9; // Invalid command line
+        }
+        if (mod[i].next != BCBP_INDEX_END && (mod[i].next <= i || mod[i].next >= hdr->module_count)) {
+            return -11; // Broken name index
         }
     }
-    
+
     return 0; // Valid
 }
 
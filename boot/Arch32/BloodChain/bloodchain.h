@@ -5,33 +5,142 @@
  * See the root of the repository for license details.
  */
 
-void bcbp_init(struct bcbp_header *hdr, uint64_t entry_point, uint64_t boot_device);
+#ifndef BLOODCHAIN_H
+#define BLOODCHAIN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// BloodChain 2.0 boot information is one position-independent block:
+//
+//   [bcbp_header][bcbp_module * module_capacity][uint32_t * index_buckets][strings]
+//
+// Everything past the header is found by offsets from the header, so the
+// kernel can map the first total_size bytes anywhere and use them in place.
+// Module names are hashed (bcbp_name_hash) into a chained index: bucket
+// heads in the index, chains through each record's `next`, in the order
+// the modules were added. Offset 0 of the string table is an empty string.
+struct bcbp_header {
+    uint32_t magic;          // 0x424C4348 ("BLCH")
+    uint32_t version;        // Protocol version (2.0 = 0x00020000)
+    uint64_t entry_point;    // 64-bit entry point address
+    uint64_t flags;          // Boot flags
+    uint64_t boot_device;    // Boot device identifier
+    uint64_t acpi_rsdp;      // ACPI RSDP address (0 if not available)
+    uint64_t smbios;         // SMBIOS entry point, _SM3_ or _SM_ (0 if not available)
+    uint64_t framebuffer;    // Framebuffer information (0 if not available)
+    uint64_t module_count;   // Number of loaded modules
+    uint64_t modules;        // Address of the module table as loaded
+    uint8_t  secure_boot;    // Secure boot status (0=disabled, 1=enabled)
+    uint8_t  tpm_available;  // TPM available (0=no, 1=yes)
+    uint8_t  uefi_64bit;     // 64-bit UEFI (0=no, 1=yes)
+    uint8_t  reserved[5];    // Reserved for future use
+    uint8_t  signature[64];  // Cryptographic signature (optional)
+    // 2.0: offsets are from the start of the header
+    uint32_t header_size;    // sizeof(struct bcbp_header)
+    uint32_t module_size;    // sizeof(struct bcbp_module)
+    uint32_t total_size;     // Bytes of the block in use
+    uint32_t block_size;     // Bytes of the block available
+    uint32_t module_offset;
+    uint32_t module_capacity;
+    uint32_t index_offset;
+    uint32_t index_buckets;  // A power of two
+    uint32_t string_offset;
+    uint32_t string_size;    // Bytes of the string table in use
+} __attribute__((packed));
+
+struct bcbp_module {
+    uint64_t start;          // Module start address
+    uint64_t size;           // Module size in bytes
+    uint64_t cmdline;        // Command line address as loaded (0 if none)
+    uint64_t name;           // Module name address as loaded
+    uint8_t  type;           // Module type (BCBP_MODTYPE_*)
+    uint8_t  flags;          // BCBP_MODFLAG_*
+    uint8_t  reserved[2];
+    uint32_t name_hash;      // bcbp_name_hash of the name
+    uint32_t name_offset;    // Into the string table
+    uint32_t cmdline_offset; // Into the string table (0 if none)
+    uint32_t next;           // Next module in this name's bucket, or BCBP_INDEX_END
+    uint32_t reserved2;
+    uint8_t  sha256[32];     // Digest of [start, start + size) with BCBP_MODFLAG_SHA256
+} __attribute__((packed));
+
+// Module Types
+#define BCBP_MODTYPE_KERNEL     0x01  // OS Kernel
+#define BCBP_MODTYPE_INITRD     0x02  // Initial RAM disk
+#define BCBP_MODTYPE_ACPI       0x03  // ACPI tables
+#define BCBP_MODTYPE_SMBIOS     0x04  // SMBIOS tables
+#define BCBP_MODTYPE_DEVICETREE 0x05  // Device tree blob
+#define BCBP_MODTYPE_EFI        0x06  // EFI runtime services
+#define BCBP_MODTYPE_CONFIG     0x07  // Configuration file
+#define BCBP_MODTYPE_DRIVER     0x08  // Hardware driver
+
+// The loader hashed the module as it handed it over; a kernel that trusts
+// the loader can use sha256 instead of hashing the module again
+#define BCBP_MODFLAG_SHA256     0x01
+
+#define BCBP_INDEX_END          0xFFFFFFFFu
+#define BCBP_MAX_MODULES        1024
+
+// FNV-1a over the NUL-terminated name; loader and kernel must agree on it
+static inline uint32_t bcbp_name_hash(const char *name) {
+    uint32_t hash = 0x811C9DC5u;
+    while (*name) {
+        hash ^= (uint8_t)*name++;
+        hash *= 0x01000193u;
+    }
+    return hash;
+}
+
+/**
+ * Lay out an empty BCBP block
+ *
+ * @param hdr          Start of the block, which the header heads
+ * @param block_size   Bytes available for header, modules, index and strings
+ * @param entry_point  Kernel entry point
+ * @param boot_device  Boot device identifier
+ * @return             0, or -1 if the block cannot hold even one module
+ */
+int bcbp_init(struct bcbp_header *hdr, uint32_t block_size, uint64_t entry_point, uint64_t boot_device);
 
 /**
  * Add a module to the BCBP structure
- * 
+ *
  * @param hdr      Pointer to the BCBP header
  * @param start    Physical start address of the module
  * @param size     Size of the module in bytes
  * @param name     Name of the module (will be copied)
  * @param type     Module type (BCBP_MODTYPE_*)
  * @param cmdline  Command line string for the module (optional, can be NULL)
+ * @return         The new record, or NULL if the table or strings are full
+ */
+struct bcbp_module *bcbp_add_module(struct bcbp_header *hdr, uint64_t start, uint64_t size,
+                                    const char *name, uint8_t type, const char *cmdline);
+
+/**
+ * Record the SHA-256 of a module's contents
+ *
+ * @param mod     Module record
+ * @param digest  32-byte SHA-256 digest
  */
-void bcbp_add_module(struct bcbp_header *hdr, uint64_t start, uint64_t size,
-                    const char *name, uint8_t type, const char *cmdline);
+void bcbp_set_module_digest(struct bcbp_module *mod, const uint8_t *digest);
 
 /**
- * Find a module by name
- * 
+ * Find a module by name through the hashed index
+ *
  * @param hdr   Pointer to the BCBP header
  * @param name  Name of the module to find
- * @return      Pointer to the module, or NULL if not found
+ * @return      The first module added with that name, or NULL if not found
  */
 struct bcbp_module *bcbp_find_module(struct bcbp_header *hdr, const char *name);
 
 /**
  * Validate the BCBP structure
- * 
+ *
  * @param hdr  Pointer to the BCBP header
  * @return     0 if valid, negative error code otherwise
  */
@@ -39,7 +148,7 @@ int bcbp_validate(const struct bcbp_header *hdr);
 
 /**
  * Set up ACPI RSDP pointer
- * 
+ *
  * @param hdr    Pointer to the BCBP header
  * @param rsdp   Physical address of the ACPI RSDP
  */
@@ -47,7 +156,7 @@ void bcbp_set_acpi_rsdp(struct bcbp_header *hdr, uint64_t rsdp);
 
 /**
  * Set up SMBIOS entry point
- * 
+ *
  * @param hdr      Pointer to the BCBP header
  * @param smbios   Physical address of the SMBIOS entry point
  */
@@ -55,7 +164,7 @@ void bcbp_set_smbios(struct bcbp_header *hdr, uint64_t smbios);
 
 /**
  * Set up framebuffer information
- * 
+ *
  * @param hdr          Pointer to the BCBP header
  * @param framebuffer  Physical address of the framebuffer
  */
@@ -72,7 +181,7 @@ extern "C" {
 
 /**
  * Get the boot information structure
- * 
+ *
  * @return  Pointer to the BCBP header (passed in RDI by bootloader)
  */
 static inline struct bcbp_header *bcbp_get_boot_info(void) {
@@ -83,14 +192,26 @@ static inline struct bcbp_header *bcbp_get_boot_info(void) {
 
 /**
  * Get module by index
- * 
+ *
  * @param hdr  Pointer to the BCBP header
  * @param idx  Module index (0-based)
  * @return     Pointer to the module, or NULL if out of bounds
  */
 static inline struct bcbp_module *bcbp_get_module(struct bcbp_header *hdr, uint64_t idx) {
     if (idx >= hdr->module_count) return NULL;
-    return ((struct bcbp_module *)hdr->modules) + idx;
+    return (struct bcbp_module *)((uint8_t *)hdr + hdr->module_offset) + idx;
+}
+
+/**
+ * Module name and command line, found through the string table so they
+ * work wherever the block is mapped
+ */
+static inline const char *bcbp_module_name(const struct bcbp_header *hdr, const struct bcbp_module *mod) {
+    return (const char *)hdr + hdr->string_offset + mod->name_offset;
+}
+
+static inline const char *bcbp_module_cmdline(const struct bcbp_header *hdr, const struct bcbp_module *mod) {
+    return (const char *)hdr + hdr->string_offset + mod->cmdline_offset;
 }
 
 #ifdef __cplusplus
@@ -99,8 +220,14 @@ static inline struct bcbp_module *bcbp_get_module(struct bcbp_header *hdr, uint6
 
 // Constants for bootloader use
 #define BCBP_MAGIC     0x424C4348  // "BLCH"
-#define BCBP_VERSION   0x00010000  // 1.0
+#define BCBP_VERSION   0x00020000  // 2.0
 #define BCBP_HEADER_SIZE  sizeof(struct bcbp_header)
 #define BCBP_MODULE_SIZE  sizeof(struct bcbp_module)
 
+// TCG2 crypto-agile TPM event log (start/size cover the bytes in use)
+#define BCBP_MODTYPE_TPM_LOG  0x09
+
+// Text rendered from the libb debug ring at handoff (size excludes the NUL)
+#define BCBP_MODTYPE_BOOT_LOG 0x0A
+
 #endif // BLOODCHAIN_H
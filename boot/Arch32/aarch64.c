@@ -8,7 +8,9 @@
 #include <stdint.h>
 #include "compat.h"
 #include <string.h>
+#include "../libb/include/bloodhorn/memory.h"
 #include "aarch64.h"
+#include "loadseg.h"
 
 extern void* allocate_memory(uint32_t size);
 extern int load_file(const char* path, uint8_t** data, uint32_t* size);
@@ -49,10 +51,26 @@ struct aarch64_linux_header {
     uint64_t hdr_string_size;
 };
 
+static int aarch64_start_linux(uint64_t kernel_size, uint64_t text_offset, const char* initrd_path, const char* cmdline);
+
 int aarch64_load_kernel(const char* kernel_path, const char* initrd_path, const char* cmdline) {
+    static loadseg_t image;
     uint8_t* kernel_data = NULL;
     uint64_t kernel_size = 0;
     
+    // Read in place to 0x40000000 when the image is a plain file on the
+    // boot volume, with no buffer in between
+    if (loadseg_open(&image, kernel_path) == 0) {
+        struct aarch64_linux_header* header = (struct aarch64_linux_header*)image.head;
+        if (image.head_len < sizeof(*header) || header->magic != 0x644d5241) {
+            return -1;
+        }
+        if (loadseg_load(&image, 0, image.size, 0x40000000, image.size) != 0) {
+            return -1;
+        }
+        return aarch64_start_linux(image.size, header->text_offset, initrd_path, cmdline);
+    }
+    
     if (load_file(kernel_path, &kernel_data, (uint32_t*)&kernel_size) != 0) {
         return -1;
     }
@@ -69,18 +87,31 @@ int aarch64_load_kernel(const char* kernel_path, const char* initrd_path, const
 int aarch64_boot_linux(uint8_t* kernel_data, uint64_t kernel_size, const char* initrd_path, const char* cmdline) {
     struct aarch64_linux_header* header = (struct aarch64_linux_header*)kernel_data;
     
+    bh_memory_copy((void*)0x40000000, kernel_data, kernel_size);
+    return aarch64_start_linux(kernel_size, header->text_offset, initrd_path, cmdline);
+}
+
+// Initrd, command line and boot parameters around a kernel already at
+// 0x40000000, then the jump
+static int aarch64_start_linux(uint64_t kernel_size, uint64_t text_offset, const char* initrd_path, const char* cmdline) {
     uint64_t kernel_load_addr = 0x40000000;
     uint64_t dtb_addr = 0x40000000 + kernel_size;
     uint64_t initrd_addr = 0;
     uint64_t initrd_size = 0;
     
     if (initrd_path && strlen(initrd_path) > 0) {
-        uint8_t* initrd_data = NULL;
         uint32_t initrd_size32 = 0;
-        if (load_file(initrd_path, &initrd_data, &initrd_size32) == 0) {
+        initrd_addr = dtb_addr + 0x10000;
+        if (loadseg_file(initrd_path, initrd_addr, &initrd_size32) == 0) {
             initrd_size = initrd_size32;
-            initrd_addr = dtb_addr + 0x10000;
-            memcpy((void*)initrd_addr, initrd_data, initrd_size);
+        } else {
+            uint8_t* initrd_data = NULL;
+            if (load_file(initrd_path, &initrd_data, &initrd_size32) == 0) {
+                initrd_size = initrd_size32;
+                bh_memory_copy((void*)initrd_addr, initrd_data, initrd_size);
+            } else {
+                initrd_addr = 0;
+            }
         }
     }
     
@@ -92,8 +123,6 @@ int aarch64_boot_linux(uint8_t* kernel_data, uint64_t kernel_size, const char* i
         strcpy((char*)cmdline_addr, cmdline);
     }
     
-    memcpy((void*)kernel_load_addr, kernel_data, kernel_size);
-    
     struct aarch64_boot_params* params = (struct aarch64_boot_params*)0x40000000 - 0x1000;
     memset(params, 0, sizeof(struct aarch64_boot_params));
     
@@ -107,7 +136,16 @@ int aarch64_boot_linux(uint8_t* kernel_data, uint64_t kernel_size, const char* i
     params->mem_start = 0x40000000;
     params->mem_size = 0x80000000;
     
-    uint64_t entry_point = kernel_load_addr + header->text_offset;
+    // The kernel starts with its caches off: clean to the point of
+    // coherency just what was written, and invalidate the I-cache only
+    // over the image
+    bh_memory_flush((void*)kernel_load_addr, kernel_size);
+    bh_memory_sync_code((void*)kernel_load_addr, kernel_size);
+    bh_memory_flush((void*)initrd_addr, initrd_size);
+    bh_memory_flush((void*)cmdline_addr, cmdline_size);
+    bh_memory_flush(params, sizeof(*params));
+    
+    uint64_t entry_point = kernel_load_addr + text_offset;
     void (*kernel_entry)(uint64_t, uint64_t, uint64_t) = (void*)entry_point;
     kernel_entry(0, dtb_addr, (uint64_t)params);
     
@@ -126,7 +164,7 @@ int aarch64_boot_uefi(uint8_t* kernel_data, uint64_t kernel_size, const char* cm
         strcpy((char*)cmdline_addr, cmdline);
     }
     
-    memcpy((void*)kernel_load_addr, kernel_data, kernel_size);
+    bh_memory_copy((void*)kernel_load_addr, kernel_data, kernel_size);
     
     struct aarch64_boot_params* params = (struct aarch64_boot_params*)0x40000000 - 0x1000;
     memset(params, 0, sizeof(struct aarch64_boot_params));
@@ -139,6 +177,11 @@ int aarch64_boot_uefi(uint8_t* kernel_data, uint64_t kernel_size, const char* cm
     params->mem_start = 0x40000000;
     params->mem_size = 0x80000000;
     
+    bh_memory_flush((void*)kernel_load_addr, kernel_size);
+    bh_memory_sync_code((void*)kernel_load_addr, kernel_size);
+    bh_memory_flush((void*)cmdline_addr, cmdline_size);
+    bh_memory_flush(params, sizeof(*params));
+    
     void (*kernel_entry)(uint64_t, uint64_t, uint64_t) = (void*)kernel_load_addr;
     kernel_entry(0, dtb_addr, (uint64_t)params);
     
@@ -8,64 +8,18 @@
 #include <stdint.h>
 #include "compat.h"
 #include <string.h>
+#include "../libb/include/bloodhorn/memory.h"
 #include "chainload.h"
+#include "../../fs/blockdev.h"
+#include "../../fs/fs_mount.h"
+#include "../../fs/partition.h"
 
-extern int read_sector(uint32_t lba, uint8_t* buf); // made it an int cuz IT NEEDS A ARTHIMATIC TYPE U BUFFON
 extern int load_file(const char* path, uint8_t** data, uint32_t* size);
 
-struct mbr_partition {
-    uint8_t status;
-    uint8_t chs_start[3];
-    uint8_t type;
-    uint8_t chs_end[3];
-    uint32_t lba_start;
-    uint32_t sector_count;
-};
-
-struct mbr {
-    uint8_t bootstrap[446];
-    struct mbr_partition partitions[4];
-    uint16_t signature;
-};
-
-struct gpt_header {
-    uint64_t signature;
-    uint32_t revision;
-    uint32_t header_size;
-    uint32_t header_crc32;
-    uint32_t reserved;
-    uint64_t current_lba;
-    uint64_t backup_lba;
-    uint64_t first_usable_lba;
-    uint64_t last_usable_lba;
-    uint8_t disk_guid[16];
-    uint64_t partition_entry_lba;
-    uint32_t num_partition_entries;
-    uint32_t size_of_partition_entry;
-    uint32_t partition_entry_array_crc32;
-};
-
-struct gpt_partition {
-    uint8_t partition_type_guid[16];
-    uint8_t unique_partition_guid[16];
-    uint64_t starting_lba;
-    uint64_t ending_lba;
-    uint64_t attributes;
-    uint16_t partition_name[36];
-};
-
 int chainload_mbr(const char* device_path, int partition) {
-    uint8_t mbr_data[512];
-    
-    // Read MBR from device
-    if (read_sector(0, mbr_data) != 0) {
-        return -1;
-    }
-    
-    struct mbr* mbr = (struct mbr*)mbr_data;
-    
-    // Verify MBR signature
-    if (mbr->signature != 0xAA55) {
+    // The partition table is read and checked once per disk
+    const part_table_t* table = part_table_get(NULL);
+    if (!table || table->scheme != PART_SCHEME_MBR) {
         return -1;
     }
     
@@ -74,21 +28,23 @@ int chainload_mbr(const char* device_path, int partition) {
         return -1;
     }
     
-    struct mbr_partition* part = &mbr->partitions[partition];
+    const part_entry_t* part = part_find_slot(table, (uint32_t)partition);
+    if (!part) {
+        return -1; // Empty partition
+    }
     
     // Check if partition is active
-    if (part->status != 0x80 && part->status != 0x00) {
+    if (part->mbr_status != 0x80 && part->mbr_status != 0x00) {
         return -1;
     }
     
-    // Check if partition has valid type
-    if (part->type == 0x00) {
-        return -1; // Empty partition
+    if (part->start > UINT32_MAX) {
+        return -1;
     }
     
     // Read boot sector from partition
     uint8_t boot_sector[512];
-    if (read_sector(part->lba_start, boot_sector) != 0) {
+    if (read_sector((uint32_t)part->start, boot_sector) != 0) {
         return -1;
     }
     
@@ -139,7 +95,7 @@ int chainload_file(const char* bootloader_path) {
         uint32_t remaining_size = bootloader_size - 512;
         uint32_t high_mem_addr = 0x1000; // 4KB
         
-        memcpy((void*)high_mem_addr, bootloader_data + 512, remaining_size);
+        bh_memory_copy((void*)high_mem_addr, bootloader_data + 512, remaining_size);
     }
     
     // Jump to bootloader
@@ -149,45 +105,15 @@ int chainload_file(const char* bootloader_path) {
     return 0;
 }
 
-int chainload_gpt(const char* device_path, int partition) {
-    uint8_t gpt_header_data[512];
-    
-    // Read GPT header from LBA 1
-    if (read_sector(1, gpt_header_data) != 0) {
-        return -1;
-    }
-    
-    struct gpt_header* gpt_header = (struct gpt_header*)gpt_header_data;
-    
-    // Verify GPT signature
-    if (gpt_header->signature != 0x5452415020494645) { // "EFI PART"
-        return -1;
-    }
-    
-    // Check if partition is valid
-    if (partition < 0 || partition >= gpt_header->num_partition_entries) {
-        return -1;
-    }
-    
-    // Read partition entry
-    uint8_t partition_entry_data[512];
-    uint32_t entry_lba = gpt_header->partition_entry_lba + (partition * gpt_header->size_of_partition_entry) / 512;
-    uint32_t entry_offset = (partition * gpt_header->size_of_partition_entry) % 512;
-    
-    if (read_sector(entry_lba, partition_entry_data) != 0) {
-        return -1;
-    }
-    
-    struct gpt_partition* gpt_part = (struct gpt_partition*)(partition_entry_data + entry_offset);
-    
-    // Check if partition is valid
-    if (gpt_part->starting_lba == 0 || gpt_part->ending_lba == 0) {
+// Boot the first sector of a GPT partition
+static int chainload_gpt_entry(const part_entry_t* gpt_part) {
+    if (!gpt_part || gpt_part->start > UINT32_MAX) {
         return -1;
     }
     
     // Read boot sector from partition
     uint8_t boot_sector[512];
-    if (read_sector(gpt_part->starting_lba, boot_sector) != 0) {
+    if (read_sector((uint32_t)gpt_part->start, boot_sector) != 0) {
         return -1;
     }
     
@@ -206,23 +132,60 @@ int chainload_gpt(const char* device_path, int partition) {
     return 0;
 }
 
-int chainload_iso(const char* iso_path) {
-    uint8_t* iso_data = NULL;
-    uint32_t iso_size = 0;
-    
-    // Load ISO file
-    if (load_file(iso_path, &iso_data, &iso_size) != 0) {
+int chainload_gpt(const char* device_path, int partition) {
+    // Header and entry array come from the cached, CRC-checked table
+    const part_table_t* table = part_table_get(NULL);
+    if (!table || table->scheme != PART_SCHEME_GPT || partition < 0) {
         return -1;
     }
     
-    // Check if it's a valid ISO
-    if (iso_size < 32768) { // At least 16 sectors
+    return chainload_gpt_entry(part_find_slot(table, (uint32_t)partition));
+}
+
+int chainload_gpt_id(const char* id) {
+    const part_table_t* table = part_table_get(NULL);
+    uint8_t guid[16];
+    
+    if (!table || table->scheme != PART_SCHEME_GPT || !id) {
         return -1;
     }
     
-    // Read boot sector from ISO (sector 16)
+    // A unique partition GUID, else a partition label
+    if (part_guid_parse(id, guid) == 0) {
+        return chainload_gpt_entry(part_find_guid(table, guid));
+    }
+    return chainload_gpt_entry(part_find_label(table, id));
+}
+
+int chainload_iso(const char* iso_path) {
     uint8_t boot_sector[2048];
-    memcpy(boot_sector, iso_data + 16 * 2048, 2048);
+    
+    // Read just the descriptor at sector 16 through the VFS when the ISO
+    // sits on a mounted filesystem, instead of loading the whole image
+    fs_file_t* iso = fs_open(iso_path);
+    if (iso) {
+        int got = fs_file_pread(iso, boot_sector, sizeof(boot_sector), 16 * 2048);
+        fs_close(iso);
+        if (got != (int)sizeof(boot_sector)) {
+            return -1; // Too small to be an ISO
+        }
+    } else {
+        uint8_t* iso_data = NULL;
+        uint32_t iso_size = 0;
+        
+        // Load ISO file
+        if (load_file(iso_path, &iso_data, &iso_size) != 0) {
+            return -1;
+        }
+        
+        // Check if it's a valid ISO
+        if (iso_size < 17 * 2048) { // At least 16 sectors plus the descriptor
+            return -1;
+        }
+        
+        // Read boot sector from ISO (sector 16)
+        memcpy(boot_sector, iso_data + 16 * 2048, 2048);
+    }
     
     // Check for El Torito boot signature
     if (memcmp(boot_sector + 1, "CD001", 5) != 0) {
@@ -276,7 +239,7 @@ int chainload_verify_bootloader(const char* bootloader_path) {
 
 int boot_chainload_kernel(uint8_t* bootloader_data, uint32_t bootloader_size) {
     uint8_t* bootloader_dest = (uint8_t*)0x7C00;
-    memcpy(bootloader_dest, bootloader_data, bootloader_size);
+    bh_memory_copy(bootloader_dest, bootloader_data, bootloader_size);
     
     void (*bootloader_entry)(void) = (void*)0x7C00;
     bootloader_entry();
@@ -87,6 +87,8 @@ struct gpt_partition {
 int chainload_mbr(const char* device_path, int partition);
 int chainload_file(const char* bootloader_path);
 int chainload_gpt(const char* device_path, int partition);
+// Chainload the GPT partition with this unique GUID (text form) or label
+int chainload_gpt_id(const char* id);
 int chainload_iso(const char* iso_path);
 int chainload_verify_bootloader(const char* bootloader_path);
 int boot_chainload_kernel(uint8_t* bootloader_data, uint32_t bootloader_size);
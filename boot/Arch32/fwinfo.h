@@ -0,0 +1,100 @@
+/*
+ * fwinfo.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_FWINFO_H
+#define BLOODHORN_FWINFO_H
+
+#include <stdint.h>
+#include "compat.h"
+
+// Firmware data the protocol loaders hand on to kernels, read from the
+// firmware by uefi/fwinfo.c. The memory map is read afresh on each call,
+// into a buffer kept for the next snapshot to reuse. The ACPI and SMBIOS
+// tables are located once and indexed, by table signature and by
+// structure type, for every later caller.
+
+// Memory types, in the E820/Multiboot numbering
+#define FWINFO_MEM_AVAILABLE        1
+#define FWINFO_MEM_RESERVED         2
+#define FWINFO_MEM_ACPI_RECLAIMABLE 3
+#define FWINFO_MEM_ACPI_NVS         4
+#define FWINFO_MEM_BAD              5
+
+typedef struct {
+    uint64_t addr;
+    uint64_t len;
+    uint32_t type;
+} fwinfo_mmap_entry_t;
+
+// A linear RGB framebuffer
+typedef struct {
+    uint64_t addr;
+    uint32_t pitch;             // Bytes per scan line
+    uint32_t width;
+    uint32_t height;
+    uint8_t bpp;
+    uint8_t red_pos, red_size;
+    uint8_t green_pos, green_size;
+    uint8_t blue_pos, blue_size;
+} fwinfo_framebuffer_t;
+
+// Stores entry `index` of the memory map in a loader's own table format.
+// While adjacent ranges merge, the same index is stored again with the
+// grown range, so the table is written in one pass with no staging copy.
+typedef void (*fwinfo_mmap_put_t)(void* table, uint32_t index, const fwinfo_mmap_entry_t* entry);
+
+// The memory map, sorted, with adjacent entries of one type merged. Loader
+// and boot-services memory count as available, so the allocations a
+// loader makes after the call leave the merged map as it was. Stores up to
+// `max` entries through `put` (NULL only counts) and returns the total
+// count (0 when the map cannot be read).
+uint32_t fwinfo_memory_map_to(void* table, uint32_t max, fwinfo_mmap_put_t put);
+
+// The same from the snapshot the last call took, without reading the map
+// again: a table sized from the count can be filled with exactly that
+// many entries
+uint32_t fwinfo_memory_map_again(void* table, uint32_t max, fwinfo_mmap_put_t put);
+
+// The GOP framebuffer; -1 when there is none or it is blit-only
+int fwinfo_framebuffer(fwinfo_framebuffer_t* fb);
+
+// The ACPI RSDP (2.0 when present, else 1.0) and its length; NULL if none
+const void* fwinfo_acpi_rsdp(uint32_t* size, int* is_v2);
+
+// The index'th ACPI table with a 4-character signature ("FACP", "SSDT",
+// ...), in RSDT/XSDT order; the DSDT and FACS are found too. NULL past
+// the last one.
+const void* fwinfo_acpi_table(const char* signature, uint32_t index);
+
+// The SMBIOS structure table (SMBIOS 3 when present) with its length and
+// version; NULL if none
+const void* fwinfo_smbios(uint32_t* size, uint8_t* major, uint8_t* minor);
+
+// The entry point the structure table was found through, _SM3_ or _SM_
+// (check the anchor); NULL if none
+const void* fwinfo_smbios_entry(void);
+
+#define FWINFO_SMBIOS_TYPES         256
+
+// How many SMBIOS structures of a type there are, and the index'th of
+// them in table order (NULL past the last)
+uint32_t fwinfo_smbios_count(uint8_t type);
+const void* fwinfo_smbios_structure(uint8_t type, uint32_t index);
+
+// String `number` (1-based, as the structure's string fields hold it) of
+// an SMBIOS structure; "" for 0 or a number past its strings
+const char* fwinfo_smbios_string(const void* structure, uint8_t number);
+
+// Entry points to use when the system table lists no ACPI or SMBIOS
+// tables (coreboot publishes its own); either may be NULL
+void fwinfo_tables_fallback(const void* rsdp, const void* smbios_entry);
+
+// Drop the index after tables were installed or patched; the next call
+// locates and indexes them again
+void fwinfo_tables_changed(void);
+
+#endif
@@ -8,6 +8,7 @@
 #include <stdint.h>
 #include "compat.h"
 #include <string.h>
+#include "../libb/include/bloodhorn/memory.h"
 #include "ia32.h"
 
 extern void* allocate_memory(uint32_t size);
@@ -65,7 +66,7 @@ int ia32_boot_linux(uint8_t* kernel_data, uint32_t kernel_size, const char* init
     if (setup_size == 0) setup_size = 4 * 512;
     
     uint8_t* kernel_dest = (uint8_t*)0x100000;
-    memcpy(kernel_dest, kernel_data + setup_size, kernel_size - setup_size);
+    bh_memory_copy(kernel_dest, kernel_data + setup_size, kernel_size - setup_size);
     
     uint32_t initrd_addr = 0;
     uint32_t initrd_size = 0;
@@ -73,7 +74,7 @@ int ia32_boot_linux(uint8_t* kernel_data, uint32_t kernel_size, const char* init
         uint8_t* initrd_data = NULL;
         if (load_file(initrd_path, &initrd_data, &initrd_size) == 0) {
             initrd_addr = 0x100000 + kernel_size - setup_size;
-            memcpy((void*)initrd_addr, initrd_data, initrd_size);
+            bh_memory_copy((void*)initrd_addr, initrd_data, initrd_size);
         }
     }
     
@@ -114,7 +115,7 @@ int ia32_boot_multiboot1(uint8_t* kernel_data, uint32_t kernel_size, const char*
     }
     
     uint32_t kernel_entry = 0x100000;
-    memcpy((void*)kernel_entry, kernel_data, kernel_size);
+    bh_memory_copy((void*)kernel_entry, kernel_data, kernel_size);
     
     void (*entry_point)(uint32_t, uint32_t) = (void*)kernel_entry;
     entry_point(0x2BADB002, (uint32_t)info);
@@ -152,7 +153,7 @@ int ia32_boot_multiboot2(uint8_t* kernel_data, uint32_t kernel_size, const char*
     info->total_size += 8;
     
     uint32_t kernel_entry = 0x100000;
-    memcpy((void*)kernel_entry, kernel_data, kernel_size);
+    bh_memory_copy((void*)kernel_entry, kernel_data, kernel_size);
     
     void (*entry_point)(uint32_t, uint32_t) = (void*)kernel_entry;
     entry_point(0x36d76289, (uint32_t)info);
@@ -9,9 +9,22 @@
 #include "compat.h"
 #include <string.h>
 #include "limine.h"
+#include "loadseg.h"
+#include "pagetable.h"
+#include "fwinfo.h"
+#include "magicscan.h"
 // go to line 65
 extern void* allocate_memory(uint32_t size);
 extern int load_file(const char* path, uint8_t** data, uint32_t* size);
+extern uint64_t memory_top(void);
+
+// The E820 types of fwinfo less one are Limine's
+static void limine_put_memmap(void* table, uint32_t index, const fwinfo_mmap_entry_t* entry) {
+    struct limine_memmap_entry* e = (struct limine_memmap_entry*)table + index;
+    e->base = entry->addr;
+    e->length = entry->len;
+    e->type = entry->type - FWINFO_MEM_AVAILABLE + LIMINE_MEMMAP_USABLE;
+}
 
 struct limine_memmap_request memmap_request = {
     .id = LIMINE_MEMMAP_REQUEST,
@@ -118,12 +131,111 @@ struct limine_framebuffer_request framebuffer_request = {
     .revision = 0
 };
 
+#define LIMINE_HHDM_BASE    0xffff800000000000ULL
+#define LIMINE_KERNEL_BASE  0xffffffff80000000ULL
+
+// Where a PT_LOAD segment goes: higher-half segments into the block at
+// load_addr, the rest at their own addresses
+static uint64_t limine_segment_addr(const struct elf64_phdr* ph, uint64_t load_addr) {
+    return ph->p_vaddr >= LIMINE_KERNEL_BASE ? ph->p_vaddr - LIMINE_KERNEL_BASE + load_addr : ph->p_vaddr;
+}
+
+// A response the loader has, for the request whose third ID word is `id`
+// (the first two are the common magic every request opens with)
+typedef struct {
+    uint64_t id;
+    void* response;
+} limine_answer_t;
+
+#define LIMINE_REQUEST_ID       16      // Offset of the third ID word
+#define LIMINE_REQUEST_RESPONSE 40      // Offset of the response pointer
+
+// Point a request, as loaded, at its response; responses are handed over
+// as `hhdm`-based addresses
+static void limine_answer(uint8_t* request, const limine_answer_t* answers, uint32_t count, uint64_t hhdm) {
+    uint64_t id;
+    memcpy(&id, request + LIMINE_REQUEST_ID, sizeof(id));
+    for (uint32_t i = 0; i < count; i++) {
+        if (answers[i].id == id && answers[i].response) {
+            uint64_t response = (uint64_t)(uintptr_t)answers[i].response + hhdm;
+            memcpy(request + LIMINE_REQUEST_RESPONSE, &response, sizeof(response));
+            return;
+        }
+    }
+}
+
+// Answer the requests a scan of the file found, at the addresses their
+// segments were loaded to. A request outside every segment's file bytes
+// (e.g. in a section that is not loaded) is not the kernel's to read.
+static void limine_answer_file(const magicscan_t* scan, const struct elf64_header* elf_header,
+                               const struct elf64_phdr* phdr, uint64_t load_addr,
+                               const limine_answer_t* answers, uint32_t count, uint64_t hhdm) {
+    for (uint32_t h = 0; h < scan->count; h++) {
+        uint64_t offset = scan->hits[h].offset;
+        if (scan->hits[h].kind != MAGICSCAN_LIMINE) {
+            continue;
+        }
+        for (int i = 0; i < elf_header->e_phnum; i++) {
+            if (phdr[i].p_type == PT_LOAD && offset >= phdr[i].p_offset &&
+                offset - phdr[i].p_offset + LIMINE_REQUEST_RESPONSE + 8 <= phdr[i].p_filesz) {
+                uint64_t addr = limine_segment_addr(&phdr[i], load_addr) + offset - phdr[i].p_offset;
+                limine_answer((uint8_t*)(uintptr_t)addr, answers, count, hhdm);
+                break;
+            }
+        }
+    }
+}
+
+// Build and load the long-mode tables for the handoff: all of physical
+// memory identity-mapped (this loader and the firmware keep running on
+// it) and again at the HHDM, both with the largest pages that fit, and
+// the kernel's segments at their virtual addresses with their own
+// write/execute permissions. Cacheability under 4GB is left to the MTRRs,
+// which keep the MMIO holes uncached under the huge pages.
+static int limine_map_kernel(const struct elf64_header* elf_header, const struct elf64_phdr* phdr,
+                             uint64_t load_addr, uint64_t span) {
+    static pagetable_t pt;
+    uint64_t top = memory_top();
+    if (top < 0x100000000ULL) {
+        top = 0x100000000ULL; // LAPIC, IOAPIC and framebuffers are often missing from the map
+    }
+    if (pagetable_init(&pt, top, span) != 0 ||
+        pagetable_map(&pt, 0, 0, top, PAGETABLE_WRITE) != 0 ||
+        pagetable_map(&pt, LIMINE_HHDM_BASE, 0, top, PAGETABLE_WRITE | PAGETABLE_NX) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < elf_header->e_phnum; i++) {
+        if (phdr[i].p_type != PT_LOAD || phdr[i].p_vaddr < LIMINE_KERNEL_BASE) {
+            continue;
+        }
+        uint64_t flags = (phdr[i].p_flags & PF_W ? PAGETABLE_WRITE : 0) |
+                         (phdr[i].p_flags & PF_X ? 0 : PAGETABLE_NX);
+        if (pagetable_map(&pt, phdr[i].p_vaddr, phdr[i].p_vaddr - LIMINE_KERNEL_BASE + load_addr,
+                          phdr[i].p_memsz, flags) != 0) {
+            return -1;
+        }
+    }
+    return pagetable_activate(&pt);
+}
+
 int limine_load_kernel(const char* kernel_path, const char* cmdline) {
+    static loadseg_t image;
     uint8_t* kernel_data = NULL;
     uint32_t kernel_size = 0;
+    int in_place = 0;
     
-    // Load kernel file
-    if (load_file(kernel_path, &kernel_data, &kernel_size) != 0) {
+    // The ELF and program headers come from the head of the file; when
+    // they all fit there the segments are read from disk straight to their
+    // addresses, otherwise the whole file is loaded first
+    if (loadseg_open(&image, kernel_path) == 0) {
+        struct elf64_header* head = (struct elf64_header*)image.head;
+        in_place = image.head_len >= sizeof(*head) &&
+                   head->e_phoff + (uint64_t)head->e_phnum * sizeof(struct elf64_phdr) <= image.head_len;
+    }
+    if (in_place) {
+        kernel_data = image.head;
+        kernel_size = image.size;
+    } else if (load_file(kernel_path, &kernel_data, &kernel_size) != 0) {
         return -1;
     }
     
@@ -140,45 +252,71 @@ int limine_load_kernel(const char* kernel_path, const char* cmdline) {
         return -1;
     }
     
-    // Load kernel to preferred address
+    struct elf64_phdr* phdr = (struct elf64_phdr*)(kernel_data + elf_header->e_phoff);
+    
+    // A higher-half kernel is mapped wherever it is put, so its segments
+    // get one 2MB-aligned block (huge-page mappable, random with [boot]
+    // kaslr) spanning all of them; 2MB is the fallback
     uint64_t load_addr = 0x200000; // 2MB
-    if (elf_header->e_entry >= 0xffffffff80000000) {
-        load_addr = elf_header->e_entry;
+    uint64_t span = 0;
+    for (int i = 0; i < elf_header->e_phnum; i++) {
+        if (phdr[i].p_type == PT_LOAD && phdr[i].p_vaddr >= LIMINE_KERNEL_BASE) {
+            uint64_t end = phdr[i].p_vaddr - LIMINE_KERNEL_BASE + phdr[i].p_memsz;
+            if (end > span) span = end;
+        }
+    }
+    if (span) {
+        uint64_t base;
+        if (loadseg_place(span, LOADSEG_HUGE_PAGE, 0x100000, 0, LOADSEG_PLACE_RELOCATABLE, &base) == 0) {
+            load_addr = base;
+        }
     }
     
-    // Load ELF segments
-    struct elf64_phdr* phdr = (struct elf64_phdr*)(kernel_data + elf_header->e_phoff);
+    // Load ELF segments. Copies out of the buffer and all BSS zeroing are
+    // batched and shared out between the processors; disk reads stay here
+    static loadseg_batch_t batch;
+    batch.count = 0;
     for (int i = 0; i < elf_header->e_phnum; i++) {
         if (phdr[i].p_type == PT_LOAD) {
-            uint64_t vaddr = phdr[i].p_vaddr;
-            if (vaddr >= 0xffffffff80000000) {
-                vaddr -= 0xffffffff80000000;
-                vaddr += load_addr;
+            uint64_t vaddr = limine_segment_addr(&phdr[i], load_addr);
+            
+            if (in_place) {
+                // BSS is queued and zeroed once every segment is in
+                if (loadseg_load(&image, phdr[i].p_offset, phdr[i].p_filesz, vaddr, phdr[i].p_memsz) != 0) {
+                    return -1;
+                }
+                continue;
             }
             
-            memcpy((void*)vaddr, kernel_data + phdr[i].p_offset, phdr[i].p_filesz);
+            loadseg_queue(&batch, vaddr, kernel_data + phdr[i].p_offset, phdr[i].p_filesz);
             
             // Zero out BSS
             if (phdr[i].p_memsz > phdr[i].p_filesz) {
-                memset((void*)(vaddr + phdr[i].p_filesz), 0, phdr[i].p_memsz - phdr[i].p_filesz);
+                loadseg_queue(&batch, vaddr + phdr[i].p_filesz, NULL, phdr[i].p_memsz - phdr[i].p_filesz);
             }
         }
     }
+    if (in_place) {
+        loadseg_finish(&image);
+    } else {
+        loadseg_run(&batch);
+    }
     
-    // Setup Limine requests
+    // Setup Limine requests. The memory map is counted, its table
+    // allocated (loader memory merges into usable ranges, so the count
+    // holds), then the same snapshot is converted into it.
     struct limine_memmap_response* memmap_response = allocate_memory(sizeof(struct limine_memmap_response));
-    memmap_response->entry_count = 1;
-    memmap_response->entries = allocate_memory(sizeof(struct limine_memmap_entry));
-    memmap_response->entries[0].base = 0;
-    memmap_response->entries[0].length = 0x100000000; // 4GB
-    memmap_response->entries[0].type = LIMINE_MEMMAP_USABLE;
+    uint32_t mmap_count = fwinfo_memory_map_to(NULL, 0, NULL);
+    memmap_response->entries = allocate_memory(mmap_count * sizeof(struct limine_memmap_entry));
+    memmap_response->entry_count = memmap_response->entries ?
+        fwinfo_memory_map_again(memmap_response->entries, mmap_count, limine_put_memmap) : 0;
     
     struct limine_kernel_address_response* kernel_address_response = allocate_memory(sizeof(struct limine_kernel_address_response));
     kernel_address_response->physical_base = load_addr;
-    kernel_address_response->virtual_base = 0xffffffff80000000;
+    kernel_address_response->virtual_base = LIMINE_KERNEL_BASE;
     
     struct limine_hhdm_response* hhdm_response = allocate_memory(sizeof(struct limine_hhdm_response));
-    hhdm_response->offset = 0xffff800000000000;
+    hhdm_response->offset = LIMINE_HHDM_BASE;
     
     struct limine_framebuffer_response* framebuffer_response = allocate_memory(sizeof(struct limine_framebuffer_response));
     framebuffer_response->framebuffer_count = 1;
@@ -196,7 +334,37 @@ int limine_load_kernel(const char* kernel_path, const char* cmdline) {
     framebuffer_response->framebuffers[0].blue_mask_size = 5;
     framebuffer_response->framebuffers[0].blue_mask_shift = 0;
     
-    // Jump to kernel
+    // Hand each response to the kernel through its request, wherever in
+    // its sections it put it. A file in memory is scanned once; one read
+    // in place is scanned segment by segment where it landed.
+    limine_answer_t answers[] = {
+        { LIMINE_MEMMAP_REQUEST, memmap_response },
+        { LIMINE_KERNEL_ADDRESS_REQUEST, kernel_address_response },
+        { LIMINE_HHDM_REQUEST, hhdm_response },
+        { LIMINE_FRAMEBUFFER_REQUEST, framebuffer_response },
+    };
+    uint32_t answer_count = sizeof(answers) / sizeof(answers[0]);
+    static magicscan_t scan;
+    if (in_place) {
+        for (int i = 0; i < elf_header->e_phnum; i++) {
+            if (phdr[i].p_type != PT_LOAD || phdr[i].p_filesz > UINT32_MAX) {
+                continue;
+            }
+            uint8_t* dest = (uint8_t*)(uintptr_t)limine_segment_addr(&phdr[i], load_addr);
+            magicscan_image(dest, (uint32_t)phdr[i].p_filesz, MAGICSCAN_LIMINE, &scan);
+            for (uint32_t h = 0; h < scan.count; h++) {
+                limine_answer(dest + scan.hits[h].offset, answers, answer_count, LIMINE_HHDM_BASE);
+            }
+        }
+    } else {
+        magicscan_image(kernel_data, kernel_size, MAGICSCAN_LIMINE, &scan);
+        limine_answer_file(&scan, elf_header, phdr, load_addr, answers, answer_count, LIMINE_HHDM_BASE);
+    }
+    
+    // Jump to kernel, on tables that map its higher half; the firmware's
+    // own tables only identity-map, so without ours the jump only works
+    // for kernels linked low
+    limine_map_kernel(elf_header, phdr, load_addr, span);
     void (*kernel_entry)(void) = (void*)elf_header->e_entry;
     kernel_entry();
     
@@ -226,7 +394,8 @@ int limine_verify_kernel(const char* kernel_path) {
     return 0;
 } 
 
-int boot_limine_kernel(uint8_t* kernel_data, uint32_t kernel_size, const char* cmdline) {
+int boot_limine_kernel(uint8_t* kernel_data, uint32_t kernel_size, const magicscan_t* scan,
+                       const char* cmdline) {
     struct elf64_header* elf_header = (struct elf64_header*)kernel_data;
     
     if (elf_header->e_ident[0] != 0x7F || elf_header->e_ident[1] != 'E' || 
@@ -241,14 +410,17 @@ int boot_limine_kernel(uint8_t* kernel_data, uint32_t kernel_size, const char* c
     uint64_t entry_point = elf_header->e_entry;
     struct elf64_phdr* phdr = (struct elf64_phdr*)(kernel_data + elf_header->e_phoff);
     
+    static loadseg_batch_t batch;
+    batch.count = 0;
     for (int i = 0; i < elf_header->e_phnum; i++) {
         if (phdr[i].p_type == 1) {
-            memcpy((void*)phdr[i].p_vaddr, kernel_data + phdr[i].p_offset, phdr[i].p_filesz);
+            loadseg_queue(&batch, phdr[i].p_vaddr, kernel_data + phdr[i].p_offset, phdr[i].p_filesz);
             if (phdr[i].p_memsz > phdr[i].p_filesz) {
-                memset((void*)(phdr[i].p_vaddr + phdr[i].p_filesz), 0, phdr[i].p_memsz - phdr[i].p_filesz);
+                loadseg_queue(&batch, phdr[i].p_vaddr + phdr[i].p_filesz, NULL, phdr[i].p_memsz - phdr[i].p_filesz);
             }
         }
     }
+    loadseg_run(&batch);
     
     struct limine_kernel_file_response* kernel_response = (struct limine_kernel_file_response*)0x1000;
     kernel_response->revision = 0;
@@ -263,6 +435,16 @@ int boot_limine_kernel(uint8_t* kernel_data, uint32_t kernel_size, const char* c
         strcpy(kernel_response->kernel_file->cmdline, cmdline);
     }
     
+    // Segments went to their own addresses on the firmware's identity map,
+    // which a block at the kernel base stands for
+    static magicscan_t own;
+    if (!scan) {
+        magicscan_image(kernel_data, kernel_size, MAGICSCAN_LIMINE, &own);
+        scan = &own;
+    }
+    limine_answer_t answer = { LIMINE_KERNEL_FILE_REQUEST, kernel_response };
+    limine_answer_file(scan, elf_header, phdr, LIMINE_KERNEL_BASE, &answer, 1, 0);
+    
     void (*entry)(void) = (void*)entry_point;
     entry();
     
@@ -10,6 +10,7 @@
 
 #include <stdint.h>
 #include "compat.h"
+#include "magicscan.h"
 
 // Limine protocol request IDs (fixed duplicate values)
 #define LIMINE_ENTRY_REQUEST                0x13a86c035aa1c6d5ULL
@@ -49,6 +50,8 @@
 #define ELFCLASS64  2
 #define EM_X86_64   62
 #define PT_LOAD     1
+#define PF_X        1
+#define PF_W        2
 
 // ...existing code...
 
@@ -358,6 +361,9 @@ struct limine_loader_info_request {
 
 int limine_load_kernel(const char* kernel_path, const char* cmdline);
 int limine_verify_kernel(const char* kernel_path);
-int boot_limine_kernel(uint8_t* kernel_data, uint32_t kernel_size, const char* cmdline);
+// Boot an image already in memory. `scan` is the magicscan_image result
+// of the caller's protocol detection, or NULL to scan here.
+int boot_limine_kernel(uint8_t* kernel_data, uint32_t kernel_size, const magicscan_t* scan,
+                       const char* cmdline);
 
 #endif // BLOODHORN_LIMINE_H 
\ No newline at end of file
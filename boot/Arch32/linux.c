@@ -6,12 +6,22 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
 #include "compat.h"
 #include <string.h>
+#include "../libb/include/bloodhorn/memory.h"
 #include "linux.h"
+#include "../../fs/blockdev.h"
+#include "../../fs/fs_mount.h"
+#include "loadseg.h"
+#include "../../security/tpm2.h"
 
-extern void read_sector(uint32_t lba, uint8_t* buf);
 extern void* allocate_memory(uint32_t size);
+extern int get_file_size(const char* path, uint32_t* size);
+extern int load_image_file(const char* path, uint8_t** data, uint32_t* size);
+extern int load_image_file_pair(const char* first_path, uint8_t** first_data, uint32_t* first_size,
+                                const char* second_path, uint8_t** second_data, uint32_t* second_size);
+extern int linux_efi_boot(const char* kernel_path, const char* initrd_path, const char* cmdline);
 
 struct linux_kernel_header {
     uint8_t setup_sects;
@@ -54,49 +64,258 @@ struct linux_kernel_header {
     uint32_t handover_offset;
 };
 
-int linux_load_kernel(const char* kernel_path, const char* initrd_path, const char* cmdline) {
-    uint8_t* kernel_data = NULL;
-    uint32_t kernel_size = 0;
+// Where the protected-mode kernel goes: anywhere suitably aligned below
+// 4GB for a relocatable kernel (boot protocol 2.05+), at random with
+// [boot] kaslr, else the traditional 1MB
+static uint32_t linux_kernel_base(const struct linux_kernel_header* header, uint32_t kernel_size) {
+    if (header->version >= 0x0205 && header->relocatable_kernel) {
+        uint64_t align = header->kernel_alignment ? header->kernel_alignment : LOADSEG_HUGE_PAGE;
+        uint64_t need = header->version >= 0x020A && header->init_size > kernel_size ? header->init_size : kernel_size;
+        uint64_t base;
+        if (loadseg_place(need, align, 0x100000, 0x100000000ULL, LOADSEG_PLACE_RELOCATABLE, &base) == 0) {
+            return (uint32_t)base;
+        }
+    }
+    return 0x100000;
+}
+
+// Highest address an initrd may end at
+static uint64_t linux_initrd_max(const struct linux_kernel_header* header) {
+    if (header->version >= 0x0203 && header->initrd_addr_max) {
+        return (uint64_t)header->initrd_addr_max + 1;
+    }
+    return 0x38000000;
+}
+
+// An initrd already in memory, copied to the top of the memory it may
+// use, or right after the kernel if none is free
+static uint32_t linux_place_initrd(const struct linux_kernel_header* header, const uint8_t* data, uint32_t size,
+                                   uint32_t after_kernel) {
+    uint64_t addr;
+    if (loadseg_place(size, 4096, 0x100000, linux_initrd_max(header), LOADSEG_PLACE_TOP_DOWN, &addr) != 0) {
+        addr = after_kernel;
+    }
+    bh_memory_copy((void*)(uintptr_t)addr, data, size);
+    return (uint32_t)addr;
+}
+
+// An initrd list ("microcode.img;initrd.img;site.img"), split in place
+// into its paths
+typedef struct {
+    uint32_t count;
+    loadseg_read_t part[LINUX_MAX_INITRDS];
+    char names[LINUX_INITRD_LIST_MAX];
+} linux_initrd_list_t;
+
+static linux_initrd_list_t g_initrds;
+
+static uint32_t linux_split_initrds(linux_initrd_list_t* list, const char* paths) {
+    size_t len = strlen(paths);
     
-    // Load kernel file
-    if (load_file(kernel_path, &kernel_data, &kernel_size) != 0) {
-        return -1;
+    list->count = 0;
+    if (len >= sizeof(list->names)) {
+        return 0;
     }
+    memcpy(list->names, paths, len + 1);
+    for (char* p = list->names; *p && list->count < LINUX_MAX_INITRDS; ) {
+        char* end = strchr(p, ';');
+        if (end) {
+            *end = '\0';
+        }
+        while (*p == ' ') p++;
+        for (char* q = p + strlen(p); q > p && q[-1] == ' '; q--) {
+            q[-1] = '\0';
+        }
+        if (*p) {
+            list->part[list->count++].path = p;
+        }
+        if (!end) {
+            break;
+        }
+        p = end + 1;
+    }
+    return list->count;
+}
+
+// Extend PCR 10 with each part as it lies in the region, in one batch
+static void linux_measure_initrds(const linux_initrd_list_t* list) {
+    TPM2_MEASUREMENT items[LINUX_MAX_INITRDS];
+    uint32_t count = 0;
     
-    // Parse kernel header
-    struct linux_kernel_header* header = (struct linux_kernel_header*)kernel_data;
+    if (!tpm2_is_available()) {
+        return;
+    }
+    for (uint32_t i = 0; i < list->count; i++) {
+        if (list->part[i].status != 0 || list->part[i].size == 0) {
+            continue;
+        }
+        items[count].pcr_index = TPM2_PCR_INITRD;
+        items[count].event_type = EV_IPL;
+        items[count].data = (const void*)(uintptr_t)list->part[i].dest;
+        items[count].data_size = list->part[i].size;
+        items[count].description = list->part[i].path;
+        items[count].digest = NULL;
+        count++;
+    }
+    tpm2_measure_batch(items, count);
+}
+
+// Several initrds back to back in one region at the top of the memory
+// they may use, each read straight to its offset with the reads in
+// flight together. Every part starts 4-byte aligned as the kernel's cpio
+// unpacker expects, and the padding is zeroed, which it skips. Parts are
+// taken as stored: the kernel unpacks compressed archives itself. A part
+// that is missing is left out; -1 when none could be read.
+static int linux_place_initrds(const struct linux_kernel_header* header, linux_initrd_list_t* list,
+                               uint32_t* addr, uint32_t* size) {
+    uint64_t total = 0;
+    uint64_t base;
     
-    // Verify it's a Linux kernel
-    if (header->header != 0x53726448) { // "HdrS" magic
+    for (uint32_t i = 0; i < list->count; i++) {
+        loadseg_read_t* part = &list->part[i];
+        part->status = -1;
+        if (get_file_size(part->path, &part->size) != 0) {
+            part->size = 0;
+            continue;
+        }
+        part->dest = total;
+        total = (total + part->size + 3) & ~3ULL;
+    }
+    if (total == 0 || total > 0xFFFFFFFFULL ||
+        loadseg_place(total, 4096, 0x100000, linux_initrd_max(header), LOADSEG_PLACE_TOP_DOWN, &base) != 0) {
         return -1;
     }
     
-    // Calculate setup size
-    uint32_t setup_size = (header->setup_sects + 1) * 512;
-    if (setup_size == 0) setup_size = 4 * 512; // Default 4 sectors
+    uint8_t* region = (uint8_t*)(uintptr_t)base;
+    uint32_t reads = 0;
+    for (uint32_t i = 0; i < list->count; i++) {
+        loadseg_read_t* part = &list->part[i];
+        if (part->size == 0) {
+            continue;
+        }
+        uint64_t pad = ((part->size + 3) & ~3U) - part->size;
+        memset(region + part->dest + part->size, 0, (size_t)pad);
+        part->dest += base;
+        list->part[reads++] = *part;
+    }
+    list->count = reads;
+    loadseg_read_files(list->part, list->count);
     
-    // Load kernel to 0x100000 (1MB)
-    uint8_t* kernel_dest = (uint8_t*)0x100000;
-    memcpy(kernel_dest, kernel_data + setup_size, kernel_size - setup_size);
+    // A part that failed to read leaves a hole; close it up
+    uint64_t end = base;
+    for (uint32_t i = 0; i < list->count; i++) {
+        loadseg_read_t* part = &list->part[i];
+        if (part->status != 0) {
+            continue;
+        }
+        if (part->dest != end) {
+            memmove((void*)(uintptr_t)end, (const void*)(uintptr_t)part->dest, part->size);
+            part->dest = end;
+        }
+        end = (end + part->size + 3) & ~3ULL;
+    }
+    if (end == base) {
+        return -1;
+    }
+    linux_measure_initrds(list);
+    *addr = (uint32_t)base;
+    *size = (uint32_t)(end - base);
+    return 0;
+}
+
+static int linux_is_initrd_list(const char* paths) {
+    return paths && strchr(paths, ';') != NULL;
+}
+
+static void linux_load_initrd_list(const struct linux_kernel_header* header, const char* paths,
+                                   uint32_t* addr, uint32_t* size) {
+    if (linux_split_initrds(&g_initrds, paths) == 0 || linux_place_initrds(header, &g_initrds, addr, size) != 0) {
+        *addr = 0;
+        *size = 0;
+    }
+}
+
+static int g_lazy_initrd = 0;
+static int g_efi_stub = 1;
+
+void linux_set_lazy_initrd(int enable) {
+    g_lazy_initrd = enable;
+}
+
+void linux_set_efi_stub(int enable) {
+    g_efi_stub = enable;
+}
+
+// GPT disk GUID from the header at LBA 1 (of 512- or 4096-byte blocks),
+// else the MBR disk signature
+static void linux_disk_id(block_device_t* dev, uint8_t* id) {
+    static const uint64_t gpt_header[] = { 1, 4096 / BLOCKDEV_SECTOR_SIZE };
+    uint8_t sector[BLOCKDEV_SECTOR_SIZE];
     
-    // Load initrd if specified
-    uint32_t initrd_addr = 0;
-    uint32_t initrd_size = 0;
-    if (initrd_path && strlen(initrd_path) > 0) {
-        uint8_t* initrd_data = NULL;
-        if (load_file(initrd_path, &initrd_data, &initrd_size) == 0) {
-            // Place initrd after kernel
-            initrd_addr = 0x100000 + kernel_size - setup_size;
-            memcpy((void*)initrd_addr, initrd_data, initrd_size);
+    memset(id, 0, 16);
+    for (int i = 0; i < 2; i++) {
+        if (blockdev_read_raw(dev, gpt_header[i], 1, sector) == 0 && memcmp(sector, "EFI PART", 8) == 0) {
+            memcpy(id, sector + 56, 16);
+            return;
         }
     }
+    if (blockdev_read_raw(dev, 0, 1, sector) == 0) {
+        memcpy(id, sector + 440, 4);
+    }
+}
+
+// Describe the initrd's extents in a setup_data node instead of loading
+// it. Returns 0 once the node is chained onto the boot parameters, -1 to
+// have the caller load the initrd the usual way.
+static int linux_defer_initrd(const struct linux_kernel_header* header, const char* initrd_path) {
+    block_device_t* dev = NULL;
+    uint32_t size = 0;
+    
+    if (!g_lazy_initrd || header->version < 0x0209) {
+        return -1;
+    }
+    int count = fs_map_file(initrd_path, NULL, 0, &size, &dev);
+    if (count <= 0) {
+        return -1;
+    }
+    
+    blockdev_extent_t* extents = allocate_memory((uint32_t)count * sizeof(*extents));
+    uint32_t len = sizeof(struct linux_lazy_initrd) + (uint32_t)count * sizeof(struct linux_lazy_initrd_extent);
+    uint64_t addr;
+    if (!extents || fs_map_file(initrd_path, extents, (uint32_t)count, NULL, NULL) != count ||
+        loadseg_place(sizeof(struct linux_setup_data) + len, 4096, 0x100000, 0x100000000ULL,
+                      LOADSEG_PLACE_TOP_DOWN, &addr) != 0) {
+        return -1;
+    }
+    
+    struct linux_setup_data* node = (struct linux_setup_data*)(uintptr_t)addr;
+    struct linux_lazy_initrd* lazy = (struct linux_lazy_initrd*)node->data;
+    lazy->version = LINUX_LAZY_INITRD_VERSION;
+    lazy->extent_count = (uint32_t)count;
+    lazy->size = size;
+    linux_disk_id(dev, lazy->disk_id);
+    for (int i = 0; i < count; i++) {
+        lazy->extents[i].offset = extents[i].offset;
+        lazy->extents[i].sector = extents[i].sector;
+        lazy->extents[i].sectors = extents[i].sectors;
+        lazy->extents[i].reserved = 0;
+    }
     
-    // Setup boot parameters
     struct linux_boot_params* params = (struct linux_boot_params*)0x90000;
-    memset(params, 0, sizeof(struct linux_boot_params));
+    node->type = LINUX_SETUP_DATA_LAZY_INITRD;
+    node->len = len;
+    node->next = params->setup_data;
+    params->setup_data = addr;
+    return 0;
+}
+
+// Command line, initrd and memory fields of the boot parameters whose
+// setup code is already at 0x90000, then the jump to the kernel
+static int linux_start(uint32_t kernel_base, uint32_t initrd_addr, uint32_t initrd_size, const char* cmdline) {
+    struct linux_boot_params* params = (struct linux_boot_params*)0x90000;
     
-    // Copy setup code
-    memcpy(params, kernel_data, setup_size);
+    // Where the kernel really is, which relocation may have moved
+    params->code32_start = kernel_base;
     
     // Set command line
     if (cmdline && strlen(cmdline) > 0) {
@@ -115,36 +334,70 @@ int linux_load_kernel(const char* kernel_path, const char* initrd_path, const ch
     params->ext_mem_k = 0x7FE00; // Extended memory in KB
     
     // Jump to kernel
-    void (*kernel_entry)(struct linux_boot_params*) = (void*)0x100000;
+    void (*kernel_entry)(struct linux_boot_params*) = (void*)(uintptr_t)kernel_base;
     kernel_entry(params);
     
     return 0;
 }
 
-int linux_verify_kernel(const char* kernel_path) {
-    uint8_t* kernel_data = NULL;
-    uint32_t kernel_size = 0;
+// Setup code from disk to 0x90000 and the protected-mode kernel to its
+// base, with no copy of the image in between; the initrd (or each part of
+// an initrd list) goes to the top of its allowed range the same way unless
+// it is compressed. An initrd already in memory comes as `initrd_data`
+// with no path, and is copied to the same place.
+static int linux_load_in_place(loadseg_t* image, const char* initrd_path, const uint8_t* initrd_data,
+                               uint32_t initrd_data_size, const char* cmdline) {
+    struct linux_kernel_header* header = (struct linux_kernel_header*)image->head;
     
-    if (load_file(kernel_path, &kernel_data, &kernel_size) != 0) {
+    if (header->header != 0x53726448) { // "HdrS" magic
         return -1;
     }
     
-    struct linux_kernel_header* header = (struct linux_kernel_header*)kernel_data;
-    
-    // Check magic number
-    if (header->header != 0x53726448) {
+    uint32_t setup_size = (header->setup_sects + 1) * 512;
+    if (setup_size > image->size) {
         return -1;
     }
+    uint32_t kernel_size = image->size - setup_size;
+    uint32_t kernel_base = linux_kernel_base(header, kernel_size);
+    uint64_t initrd_max = linux_initrd_max(header);
     
-    // Check version
-    if (header->version < 0x0200) { // Require 2.0+
+    struct linux_boot_params* params = (struct linux_boot_params*)0x90000;
+    memset(params, 0, sizeof(struct linux_boot_params));
+    if (loadseg_load(image, 0, setup_size, 0x90000, setup_size) != 0 ||
+        loadseg_load(image, setup_size, kernel_size, kernel_base, kernel_size) != 0) {
         return -1;
     }
     
-    return 0;
-} 
+    uint32_t initrd_addr = 0;
+    uint32_t initrd_size = 0;
+    if (initrd_data && initrd_data_size > 0) {
+        initrd_size = initrd_data_size;
+        initrd_addr = linux_place_initrd(header, initrd_data, initrd_size, kernel_base + kernel_size);
+    } else if (linux_is_initrd_list(initrd_path)) {
+        linux_load_initrd_list(header, initrd_path, &initrd_addr, &initrd_size);
+    } else if (initrd_path && strlen(initrd_path) > 0 && linux_defer_initrd(header, initrd_path) != 0) {
+        uint64_t placed;
+        if (loadseg_place_file(initrd_path, 4096, initrd_max, LOADSEG_PLACE_TOP_DOWN, &placed, &initrd_size) == 0) {
+            initrd_addr = (uint32_t)placed;
+        } else {
+            uint8_t* initrd_data = NULL;
+            if (load_image_file(initrd_path, &initrd_data, &initrd_size) == 0) {
+                initrd_addr = linux_place_initrd(header, initrd_data, initrd_size, kernel_base + kernel_size);
+            } else {
+                initrd_size = 0;
+            }
+        }
+    }
+    
+    loadseg_finish(image);
+    return linux_start(kernel_base, initrd_addr, initrd_size, cmdline);
+}
 
-int boot_linux_kernel(uint8_t* kernel_data, uint32_t kernel_size, uint8_t* initrd_data, uint32_t initrd_size, const char* cmdline) {
+// A kernel already in memory. `lazy_path` is an initrd not loaded yet:
+// deferred to the kernel when it can be, else loaded here, as is an
+// initrd list.
+static int linux_boot_buffered(uint8_t* kernel_data, uint32_t kernel_size, uint8_t* initrd_data, uint32_t initrd_size,
+                               const char* lazy_path, const char* cmdline) {
     struct linux_kernel_header* header = (struct linux_kernel_header*)kernel_data;
     
     if (header->header != 0x53726448) {
@@ -154,35 +407,116 @@ int boot_linux_kernel(uint8_t* kernel_data, uint32_t kernel_size, uint8_t* initr
     uint32_t setup_size = (header->setup_sects + 1) * 512;
     if (setup_size == 0) setup_size = 4 * 512;
     
-    uint8_t* kernel_dest = (uint8_t*)0x100000;
-    memcpy(kernel_dest, kernel_data + setup_size, kernel_size - setup_size);
+    uint32_t kernel_base = linux_kernel_base(header, kernel_size - setup_size);
+    uint8_t* kernel_dest = (uint8_t*)(uintptr_t)kernel_base;
+    bh_memory_copy(kernel_dest, kernel_data + setup_size, kernel_size - setup_size);
+    
+    struct linux_boot_params* params = (struct linux_boot_params*)0x90000;
+    memset(params, 0, sizeof(struct linux_boot_params));
+    
+    memcpy(params, kernel_data, setup_size);
     
     uint32_t initrd_addr = 0;
+    if (linux_is_initrd_list(lazy_path)) {
+        linux_load_initrd_list(header, lazy_path, &initrd_addr, &initrd_size);
+        initrd_data = NULL;
+    } else if (lazy_path && linux_defer_initrd(header, lazy_path) != 0 &&
+               load_image_file(lazy_path, &initrd_data, &initrd_size) != 0) {
+        initrd_data = NULL;
+    }
     if (initrd_data && initrd_size > 0) {
-        initrd_addr = 0x100000 + kernel_size - setup_size;
-        memcpy((void*)initrd_addr, initrd_data, initrd_size);
+        initrd_addr = linux_place_initrd(header, initrd_data, initrd_size, kernel_base + kernel_size - setup_size);
     }
     
-    struct linux_boot_params* params = (struct linux_boot_params*)0x90000;
-    memset(params, 0, sizeof(struct linux_boot_params));
+    return linux_start(kernel_base, initrd_addr, initrd_size, cmdline);
+}
+
+int linux_load_kernel(const char* kernel_path, const char* initrd_path, const char* cmdline) {
+    static loadseg_t image;
+    uint8_t* kernel_data = NULL;
+    uint32_t kernel_size = 0;
+    uint8_t* initrd_data = NULL;
+    uint32_t initrd_size = 0;
+    int have_initrd = (initrd_path && strlen(initrd_path) > 0);
     
-    memcpy(params, kernel_data, setup_size);
+    // A kernel with an EFI stub is started as the UEFI application it is:
+    // it decompresses itself and asks for the initrd over LoadFile2, so
+    // none of the copies to fixed addresses below happen. A lazy initrd
+    // needs boot parameters we build, so it keeps the legacy protocol.
+    if (g_efi_stub && !(have_initrd && g_lazy_initrd)) {
+        int rc = linux_efi_boot(kernel_path, initrd_path, cmdline);
+        if (rc != -2) {
+            return rc;
+        }
+    }
     
-    if (cmdline && strlen(cmdline) > 0) {
-        strcpy((char*)0x90000 + 0x0020, cmdline);
-        params->cmd_line_ptr = 0x90020;
+    if (loadseg_open(&image, kernel_path) == 0) {
+        return linux_load_in_place(&image, initrd_path, NULL, 0, cmdline);
     }
     
-    if (initrd_addr > 0) {
-        params->ramdisk_image = initrd_addr;
-        params->ramdisk_size = initrd_size;
+    // Compressed or remote: load kernel and initrd together so their reads
+    // overlap where the firmware supports asynchronous file I/O; compressed
+    // images come back decompressed. A lazy initrd is decided on once the
+    // kernel header is in, and an initrd list is placed as one region once
+    // the kernel's limits are known, so with those the kernel comes alone.
+    if (have_initrd && (g_lazy_initrd || linux_is_initrd_list(initrd_path))) {
+        if (load_image_file(kernel_path, &kernel_data, &kernel_size) != 0) {
+            return -1;
+        }
+        return linux_boot_buffered(kernel_data, kernel_size, NULL, 0, initrd_path, cmdline);
+    }
+    if (have_initrd) {
+        int rc = load_image_file_pair(kernel_path, &kernel_data, &kernel_size,
+                                      initrd_path, &initrd_data, &initrd_size);
+        if (rc == -1) {
+            return -1;
+        }
+        if (rc != 0) {
+            initrd_data = NULL;
+            initrd_size = 0;
+        }
+    } else if (load_image_file(kernel_path, &kernel_data, &kernel_size) != 0) {
+        return -1;
     }
     
-    params->mem_upper = 0x7FE00;
-    params->ext_mem_k = 0x7FE00;
+    return boot_linux_kernel(kernel_data, kernel_size, initrd_data, initrd_size, cmdline);
+}
+
+int linux_boot_image(const uint8_t* kernel_data, uint32_t kernel_size, const uint8_t* initrd_data,
+                     uint32_t initrd_size, const char* cmdline) {
+    static loadseg_t image;
     
-    void (*kernel_entry)(struct linux_boot_params*) = (void*)0x100000;
-    kernel_entry(params);
+    // Compressed as a whole: there is no decompressor on this path, and
+    // mkpayload.py stores kernels as they come out of the kernel build
+    if (loadseg_open_memory(&image, kernel_data, kernel_size) != 0) {
+        return -1;
+    }
+    return linux_load_in_place(&image, NULL, initrd_data, initrd_size, cmdline);
+}
+
+int linux_verify_kernel(const char* kernel_path) {
+    uint8_t* kernel_data = NULL;
+    uint32_t kernel_size = 0;
+    
+    if (load_image_file(kernel_path, &kernel_data, &kernel_size) != 0) {
+        return -1;
+    }
+    
+    struct linux_kernel_header* header = (struct linux_kernel_header*)kernel_data;
+    
+    // Check magic number
+    if (header->header != 0x53726448) {
+        return -1;
+    }
+    
+    // Check version
+    if (header->version < 0x0200) { // Require 2.0+
+        return -1;
+    }
     
     return 0;
-} 
\ No newline at end of file
+} 
+
+int boot_linux_kernel(uint8_t* kernel_data, uint32_t kernel_size, uint8_t* initrd_data, uint32_t initrd_size, const char* cmdline) {
+    return linux_boot_buffered(kernel_data, kernel_size, initrd_data, initrd_size, NULL, cmdline);
+}
@@ -53,7 +53,56 @@ struct linux_boot_params {
     uint32_t ext_mem_k;
 };
 
+// Experimental lazy initrd ([boot] lazy_initrd): the initrd is not read
+// at all. One setup_data node of type LINUX_SETUP_DATA_LAZY_INITRD says
+// where its bytes lie on disk, for a kernel-side driver to fetch them when
+// the initramfs is first needed; ramdisk_image/ramdisk_size stay zero.
+// Needs boot protocol 2.09 (setup_data) and a file whose filesystem can
+// map its extents; otherwise the initrd is loaded as usual.
+#define LINUX_SETUP_DATA_LAZY_INITRD    0x42480001  // Vendor type: "BH", 1
+#define LINUX_LAZY_INITRD_VERSION       1
+
+struct linux_setup_data {
+    uint64_t next;
+    uint32_t type;
+    uint32_t len;
+    uint8_t data[];
+};
+
+struct linux_lazy_initrd_extent {
+    uint64_t offset;        // Start within the file, in 512-byte sectors
+    uint64_t sector;        // Start on the disk, in 512-byte sectors from LBA 0
+    uint32_t sectors;
+    uint32_t reserved;
+};
+
+struct linux_lazy_initrd {
+    uint32_t version;
+    uint32_t extent_count;
+    uint64_t size;          // File size in bytes
+    uint8_t disk_id[16];    // GPT disk GUID, or the MBR signature in the first 4 bytes
+    struct linux_lazy_initrd_extent extents[];
+};
+
+void linux_set_lazy_initrd(int enable);
+
+// An initrd path may be a list, "microcode.img;initrd.img;site.img": the
+// parts are concatenated in one region, each 4-byte aligned and read
+// straight to its offset, as the kernel unpacks back-to-back cpio archives
+#define LINUX_MAX_INITRDS       8
+#define LINUX_INITRD_LIST_MAX   512
+
+// [linux] efistub: boot kernels that carry an EFI stub through it (on by
+// default); kernels without one, or not on the boot volume, fall back to
+// the legacy boot protocol
+void linux_set_efi_stub(int enable);
+
 int linux_load_kernel(const char* kernel_path, const char* initrd_path, const char* cmdline);
+// Kernel and initrd already in memory (a payload bundle's sections):
+// booted the load-in-place way, each copied once to where it runs. -1 if
+// the kernel is not an uncompressed bzImage.
+int linux_boot_image(const uint8_t* kernel_data, uint32_t kernel_size, const uint8_t* initrd_data,
+                     uint32_t initrd_size, const char* cmdline);
 int linux_verify_kernel(const char* kernel_path);
 int boot_linux_kernel(uint8_t* kernel_data, uint32_t kernel_size, uint8_t* initrd_data, uint32_t initrd_size, const char* cmdline);
 
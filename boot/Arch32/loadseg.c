@@ -0,0 +1,179 @@
+/*
+ * loadseg.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "compat.h"
+#include <string.h>
+#include "loadseg.h"
+#include "../../compress/decompress.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <emmintrin.h>
+#endif
+
+extern int get_file_size(const char* path, uint32_t* size);
+extern int read_file_range(const char* path, uint32_t offset, uint8_t* dest, uint32_t length);
+extern int reserve_memory(uint64_t addr, uint64_t size);
+extern int place_memory(uint64_t size, uint64_t align, uint64_t min, uint64_t max, uint32_t flags, uint64_t* addr);
+extern void parallel_memory_jobs(const loadseg_job_t* jobs, uint32_t count);
+extern uint32_t read_files_into(loadseg_read_t* reads, uint32_t count);
+
+// Below this a BSS is cleared with ordinary stores and left in cache for
+// the kernel; above it streaming stores keep it from evicting everything
+#define LOADSEG_STREAM_MIN  (256 * 1024)
+
+int loadseg_open(loadseg_t* ls, const char* path) {
+    memset(ls, 0, offsetof(loadseg_t, head));
+    ls->bss.count = 0;
+    if (!path || get_file_size(path, &ls->size) != 0) return -1;
+    ls->path = path;
+    ls->head_len = ls->size < LOADSEG_HEAD_SIZE ? ls->size : LOADSEG_HEAD_SIZE;
+    if (ls->head_len == 0 || read_file_range(path, 0, ls->head, ls->head_len) != 0) return -1;
+    // The decompressor needs the whole stream, so these go the buffered way
+    if (decomp_detect(ls->head, ls->head_len) != DECOMP_NONE) return -1;
+    return 0;
+}
+
+int loadseg_open_memory(loadseg_t* ls, const uint8_t* data, uint32_t size) {
+    memset(ls, 0, offsetof(loadseg_t, head));
+    ls->bss.count = 0;
+    if (!data || size == 0) return -1;
+    ls->mem = data;
+    ls->size = size;
+    ls->head_len = size < LOADSEG_HEAD_SIZE ? size : LOADSEG_HEAD_SIZE;
+    memcpy(ls->head, data, ls->head_len);
+    if (decomp_detect(ls->head, ls->head_len) != DECOMP_NONE) return -1;
+    return 0;
+}
+
+int loadseg_load(loadseg_t* ls, uint64_t offset, uint64_t filesz, uint64_t dest, uint64_t memsz) {
+    if (offset > ls->size || filesz > ls->size - offset) return -1;
+    if (memsz < filesz) memsz = filesz;
+    uint8_t* bss = (uint8_t*)(uintptr_t)dest + filesz;
+    uint64_t bss_len = memsz - filesz;
+
+    // Firmware-owned pages are written anyway, as the buffered loaders
+    // always did; the claim only keeps later allocations out
+    reserve_memory(dest, memsz);
+
+    // What the head already holds is not read twice
+    uint8_t* out = (uint8_t*)(uintptr_t)dest;
+    if (ls->mem) {
+        memcpy(out, ls->mem + offset, (size_t)filesz);
+        filesz = 0;
+    } else if (offset < ls->head_len) {
+        uint64_t n = ls->head_len - offset;
+        if (n > filesz) n = filesz;
+        memcpy(out, ls->head + offset, (size_t)n);
+        out += n;
+        offset += n;
+        filesz -= n;
+    }
+    if (filesz && read_file_range(ls->path, (uint32_t)offset, out, (uint32_t)filesz) != 0) return -1;
+
+    if (bss_len) loadseg_queue(&ls->bss, (uint64_t)(uintptr_t)bss, NULL, bss_len);
+    return 0;
+}
+
+void loadseg_finish(loadseg_t* ls) {
+    loadseg_run(&ls->bss);
+}
+
+void loadseg_queue(loadseg_batch_t* batch, uint64_t dest, const uint8_t* src, uint64_t len) {
+    if (len == 0) return;
+    if (batch->count == LOADSEG_MAX_JOBS) loadseg_run(batch);
+    batch->job[batch->count].dest = dest;
+    batch->job[batch->count].src = src;
+    batch->job[batch->count].len = len;
+    batch->count++;
+}
+
+void loadseg_run(loadseg_batch_t* batch) {
+    if (batch->count) parallel_memory_jobs(batch->job, batch->count);
+    batch->count = 0;
+}
+
+int loadseg_file(const char* path, uint64_t dest, uint32_t* size) {
+    static loadseg_t ls;
+    if (loadseg_open(&ls, path) != 0 || loadseg_load(&ls, 0, ls.size, dest, ls.size) != 0) return -1;
+    *size = ls.size;
+    return 0;
+}
+
+int loadseg_place(uint64_t size, uint64_t align, uint64_t min, uint64_t max, uint32_t flags, uint64_t* addr) {
+    return place_memory(size, align, min, max, flags, addr);
+}
+
+int loadseg_place_file(const char* path, uint64_t align, uint64_t max, uint32_t flags, uint64_t* addr, uint32_t* size) {
+    static loadseg_t ls;
+    if (loadseg_open(&ls, path) != 0 || loadseg_place(ls.size, align, 0x100000, max, flags, addr) != 0 ||
+        loadseg_load(&ls, 0, ls.size, *addr, ls.size) != 0) return -1;
+    *size = ls.size;
+    return 0;
+}
+
+uint32_t loadseg_read_files(loadseg_read_t* reads, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) reserve_memory(reads[i].dest, reads[i].size);
+    return count ? read_files_into(reads, count) : 0;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+// 64 bytes per iteration with SSE2 streaming stores, then a fence so the
+// kernel sees the zeroes before its first load
+static uint8_t* zero_stream(uint8_t* p, uint64_t blocks) {
+    __m128i z = _mm_setzero_si128();
+    for (uint64_t i = 0; i < blocks; i++, p += 64) {
+        _mm_stream_si128((__m128i*)p, z);
+        _mm_stream_si128((__m128i*)(p + 16), z);
+        _mm_stream_si128((__m128i*)(p + 32), z);
+        _mm_stream_si128((__m128i*)(p + 48), z);
+    }
+    _mm_sfence();
+    return p;
+}
+#elif defined(__aarch64__) && defined(__GNUC__)
+// DC ZVA zeroes a whole block (usually 64 bytes) per instruction, without
+// reading the line first; DCZID_EL0 gives the size and whether it is allowed
+static uint64_t zva_block(void) {
+    uint64_t dczid;
+    __asm__ volatile ("mrs %0, dczid_el0" : "=r" (dczid));
+    return (dczid & 0x10) ? 0 : 4ull << (dczid & 0xF);
+}
+
+static uint8_t* zero_stream(uint8_t* p, uint64_t blocks) {
+    for (uint64_t i = 0; i < blocks; i++, p += 64) {
+        __asm__ volatile ("dc zva, %0" :: "r" (p) : "memory");
+    }
+    __asm__ volatile ("dsb ish" ::: "memory");
+    return p;
+}
+#endif
+
+void loadseg_zero(void* dst, uint64_t len) {
+    uint8_t* p = (uint8_t*)dst;
+#if (defined(__x86_64__) || defined(__aarch64__)) && defined(__GNUC__)
+#if defined(__aarch64__)
+    static uint64_t block = ~0ull;
+    if (block == ~0ull) block = zva_block();
+    // zero_stream steps in 64 bytes, so only a 64-byte ZVA block will do
+    if (block != 64) {
+        memset(p, 0, (size_t)len);
+        return;
+    }
+#endif
+    if (len >= LOADSEG_STREAM_MIN) {
+        uint64_t head = (64 - ((uintptr_t)p & 63)) & 63;
+        memset(p, 0, (size_t)head);
+        p += head;
+        len -= head;
+        p = zero_stream(p, len / 64);
+        len &= 63;
+    }
+#endif
+    memset(p, 0, (size_t)len);
+}
@@ -0,0 +1,103 @@
+/*
+ * loadseg.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_LOADSEG_H
+#define BLOODHORN_LOADSEG_H
+
+#include <stdint.h>
+#include "compat.h"
+
+// Load-in-place: the protocol loaders parse headers out of the first
+// LOADSEG_HEAD_SIZE bytes of an image, then read each segment from disk
+// straight to its final address instead of through a whole-image buffer.
+// BSS is not zeroed as each segment goes in but once, in loadseg_finish,
+// after the last file byte has landed.
+#define LOADSEG_HEAD_SIZE   (8 * 1024)
+#define LOADSEG_MAX_JOBS    16
+
+// Memory-only work of a load: copy `len` bytes from `src` to `dest`, or
+// zero them when `src` is NULL. A batch is run in one go, shared out
+// between the processors (parallel_memory_jobs in uefi/mpfill.c).
+typedef struct {
+    uint64_t dest;
+    const uint8_t* src;
+    uint64_t len;
+} loadseg_job_t;
+
+typedef struct {
+    uint32_t count;
+    loadseg_job_t job[LOADSEG_MAX_JOBS];
+} loadseg_batch_t;
+
+typedef struct {
+    const char* path;
+    const uint8_t* mem;                 // Image already in memory; NULL: read from path
+    uint32_t size;                      // Whole file
+    uint32_t head_len;                  // Bytes of it in head
+    uint8_t head[LOADSEG_HEAD_SIZE];
+    loadseg_batch_t bss;                // Zeroing left for loadseg_finish
+} loadseg_t;
+
+// Read the head of an image. Fails (-1) when the file cannot be read in
+// place: missing, not on the boot volume, or compressed, which callers
+// load the buffered way instead.
+int loadseg_open(loadseg_t* ls, const char* path);
+
+// The same for an image that is already in memory (a payload bundle's
+// kernel): segments are copied from `data` instead of read, one copy each
+int loadseg_open_memory(loadseg_t* ls, const uint8_t* data, uint32_t size);
+
+// Put `filesz` bytes from `offset` of the image at `dest` and queue the
+// `memsz - filesz` bytes after them for zeroing. The destination pages are
+// claimed first where they are free. Returns 0 or -1.
+int loadseg_load(loadseg_t* ls, uint64_t offset, uint64_t filesz, uint64_t dest, uint64_t memsz);
+
+// Zero the queued BSS ranges
+void loadseg_finish(loadseg_t* ls);
+
+// Add a job to a batch, running the batch first if it is full; then run
+// what is queued and empty the batch
+void loadseg_queue(loadseg_batch_t* batch, uint64_t dest, const uint8_t* src, uint64_t len);
+void loadseg_run(loadseg_batch_t* batch);
+
+// A whole (uncompressed) file at `dest`, e.g. an initrd; -1 leaves the
+// caller to load it the buffered way
+int loadseg_file(const char* path, uint64_t dest, uint32_t* size);
+
+// Placement of images that need not sit at a fixed address, through the
+// engine in uefi/memplace.c (flag values are its MEM_PLACE_* ones). Used
+// for relocatable kernels, initrds and modules; fixed-address images only
+// claim their range.
+#define LOADSEG_PLACE_TOP_DOWN      0x1     // Highest fit below max
+#define LOADSEG_PLACE_RELOCATABLE   0x2     // Anywhere it fits; random with [boot] kaslr
+#define LOADSEG_HUGE_PAGE           (2 * 1024 * 1024)
+
+// Claim `size` bytes aligned to `align` in [min, max); 0 or -1
+int loadseg_place(uint64_t size, uint64_t align, uint64_t min, uint64_t max, uint32_t flags, uint64_t* addr);
+
+// loadseg_file at an address placed for it below `max`
+int loadseg_place_file(const char* path, uint64_t align, uint64_t max, uint32_t flags, uint64_t* addr, uint32_t* size);
+
+// One whole file of a loadseg_read_files batch
+typedef struct {
+    const char* path;
+    uint64_t dest;
+    uint32_t size;                      // The file must be exactly this long
+    int status;                         // Out: 0, or -1 when it was not read
+} loadseg_read_t;
+
+// Read several files straight to their destinations, claiming the pages
+// first, with the reads in flight together where the firmware supports
+// asynchronous I/O (read_files_into in uefi/uefi.c). Files are read as
+// stored; returns how many failed.
+uint32_t loadseg_read_files(loadseg_read_t* reads, uint32_t count);
+
+// Zero memory with the widest stores available, non-temporal where the
+// range is too big to be worth keeping in cache
+void loadseg_zero(void* dst, uint64_t len);
+
+#endif
@@ -8,50 +8,144 @@
 #include <stdint.h>
 #include "compat.h"
 #include <string.h>
+#include "../libb/include/bloodhorn/memory.h"
 #include "loongarch64.h"
+#include "../platform/fdt.h"
 
 extern void* allocate_memory(uint32_t size);
 extern int load_file(const char* path, uint8_t** data, uint32_t* size);
+// The DTB firmware handed over (U-Boot, the EFI config table); NULL if none
+extern const void* get_firmware_fdt(void);
 
-struct loongarch64_boot_params {
-    uint64_t dtb_addr;
-    uint64_t initrd_addr;
-    uint64_t initrd_size;
-    uint64_t cmdline_addr;
-    uint64_t cmdline_size;
-    uint64_t kernel_addr;
-    uint64_t kernel_size;
+// Cached direct-mapped window the kernel and its data are addressed through
+#define LOONGARCH64_DMW_BASE        0x9000000000000000ULL
+#define LOONGARCH64_DMW_MASK        0xFFFF000000000000ULL
+#define LOONGARCH64_KERNEL_PHYS     0x200000ULL     // Link address, so the kernel itself never moves
+#define LOONGARCH64_PAGE_SIZE       0x4000ULL
+
+// Where each piece of the handoff goes, as DMW addresses
+struct loongarch64_layout {
     uint64_t mem_start;
     uint64_t mem_size;
-    uint64_t acpi_rsdp;
-    uint64_t efi_systab;
+    uint64_t kernel_addr;
+    uint64_t initrd_addr;
+    uint64_t cmdline_addr;
+    uint64_t params_addr;
+    uint64_t dtb_addr;
+    uint64_t dtb_size;          // 0 when there is no tree to hand on
 };
 
-struct loongarch64_linux_header {
-    uint32_t code0;
-    uint32_t code1;
-    uint64_t text_offset;
-    uint64_t image_size;
-    uint64_t flags;
-    uint32_t version;
-    uint32_t res1;
-    uint64_t res2;
-    uint64_t res3;
-    uint64_t res4;
-    uint32_t magic;
-    uint32_t hdr_offset;
-    uint32_t hdr_size;
-    uint32_t end_offset;
-    uint32_t end_size;
-    uint64_t hdr_version;
-    uint64_t comp_version;
-    uint64_t name_offset;
-    uint64_t name_size;
-    uint64_t id_offset;
-    uint64_t id_size;
-    uint64_t hdr_string_offset;
-    uint64_t hdr_string_size;
-};
+static uint64_t loongarch64_phys(const void* p) {
+    return (uint64_t)(uintptr_t)p & ~LOONGARCH64_DMW_MASK;
+}
+
+/*
+ * Lay the handoff out from one in-place scan of the firmware's tree: RAM
+ * and the reserved ranges come from it, and the initrd, parameters and
+ * command line are placed after the kernel clear of them, with no further
+ * firmware calls. The blob is handed on as it is, with /chosen patched in
+ * place when it has the room and relaid once when it has not. Without a
+ * tree that describes RAM, the fixed layout is used.
+ */
+static int loongarch64_plan_handoff(struct loongarch64_layout* l, uint64_t image_size, const uint8_t* initrd_data,
+                                    uint64_t initrd_size, const char* cmdline, uint64_t cmdline_size) {
+    const void* fdt = get_firmware_fdt();
+    struct fdt_boot_info info;
+
+    memset(l, 0, sizeof(*l));
+    l->kernel_addr = LOONGARCH64_DMW_BASE | LOONGARCH64_KERNEL_PHYS;
+    if (!fdt || fdt_scan_boot_info(fdt, &info) != BH_STATUS_SUCCESS || info.memory_count == 0) {
+        l->mem_start = LOONGARCH64_DMW_BASE;
+        l->mem_size = 0x800000000;
+        l->dtb_addr = 0x9000000000300000;
+        l->initrd_addr = initrd_size ? l->dtb_addr + 0x100000 : 0;
+        l->cmdline_addr = cmdline_size ? l->dtb_addr + 0x100000 + initrd_size + 0x1000 : 0;
+        l->params_addr = 0x9000000000100000;
+        return 0;
+    }
+
+    l->mem_start = LOONGARCH64_DMW_BASE | info.memory[0].base;
+    l->mem_size = info.memory[0].size;
+
+    // The kernel goes where it is linked; a tree that reserves part of
+    // that range cannot be booted this way
+    if (fdt_boot_info_place(&info, LOONGARCH64_KERNEL_PHYS, image_size, LOONGARCH64_PAGE_SIZE) !=
+        LOONGARCH64_KERNEL_PHYS) {
+        return -1;
+    }
+
+    int need = fdt_chosen_size(cmdline_size ? cmdline : NULL, initrd_size != 0);
+    if (!fdt_boot_info_reserve(&info, LOONGARCH64_KERNEL_PHYS, image_size) ||
+        !fdt_boot_info_reserve(&info, loongarch64_phys(fdt), fdt_totalsize(fdt) + (uint64_t)need) ||
+        !fdt_boot_info_reserve(&info, loongarch64_phys(initrd_data), initrd_size) ||
+        !fdt_boot_info_reserve(&info, loongarch64_phys(cmdline), cmdline_size)) {
+        return -1;
+    }
+
+    uint64_t next = LOONGARCH64_KERNEL_PHYS + image_size;
+    uint64_t at;
+    if (initrd_size) {
+        at = fdt_boot_info_place(&info, next, initrd_size, LOONGARCH64_PAGE_SIZE);
+        if (!at) {
+            return -1;
+        }
+        l->initrd_addr = LOONGARCH64_DMW_BASE | at;
+        next = at + initrd_size;
+    }
+    at = fdt_boot_info_place(&info, next, sizeof(struct loongarch64_boot_params), LOONGARCH64_PAGE_SIZE);
+    if (!at) {
+        return -1;
+    }
+    l->params_addr = LOONGARCH64_DMW_BASE | at;
+    next = at + sizeof(struct loongarch64_boot_params);
+    if (cmdline_size) {
+        at = fdt_boot_info_place(&info, next, cmdline_size, 8);
+        if (!at) {
+            return -1;
+        }
+        l->cmdline_addr = LOONGARCH64_DMW_BASE | at;
+        next = at + cmdline_size;
+    }
+
+    uint64_t initrd_phys = l->initrd_addr & ~LOONGARCH64_DMW_MASK;
+    if (fdt_free_space(fdt) >= need &&
+        fdt_set_chosen((void*)fdt, cmdline_size ? cmdline : NULL, initrd_phys, initrd_phys + initrd_size) == 0) {
+        l->dtb_addr = (uint64_t)(uintptr_t)fdt;
+        l->dtb_size = fdt_totalsize(fdt);
+        return 0;
+    }
+    uint64_t dtb_size = fdt_totalsize(fdt) + (uint64_t)need;
+    at = fdt_boot_info_place(&info, next, dtb_size, 8);
+    if (!at) {
+        return -1;
+    }
+    l->dtb_addr = LOONGARCH64_DMW_BASE | at;
+    if (fdt_open_into(fdt, (void*)(uintptr_t)l->dtb_addr, (int)dtb_size) != 0 ||
+        fdt_set_chosen((void*)(uintptr_t)l->dtb_addr, cmdline_size ? cmdline : NULL, initrd_phys,
+                       initrd_phys + initrd_size) != 0) {
+        return -1;
+    }
+    l->dtb_size = dtb_size;
+    return 0;
+}
+
+static void loongarch64_fill_params(const struct loongarch64_layout* l, uint64_t initrd_size, uint64_t cmdline_size,
+                                    uint64_t kernel_size) {
+    struct loongarch64_boot_params* params = (struct loongarch64_boot_params*)(uintptr_t)l->params_addr;
+    memset(params, 0, sizeof(struct loongarch64_boot_params));
+
+    params->dtb_addr = l->dtb_addr;
+    params->initrd_addr = l->initrd_addr;
+    params->initrd_size = initrd_size;
+    params->cmdline_addr = l->cmdline_addr;
+    params->cmdline_size = cmdline_size;
+    params->kernel_addr = l->kernel_addr;
+    params->kernel_size = kernel_size;
+    params->mem_start = l->mem_start;
+    params->mem_size = l->mem_size;
+    params->acpi_rsdp = 0;
+    params->efi_systab = 0;
+}
 
 int loongarch64_load_kernel(const char* kernel_path, const char* initrd_path, const char* cmdline) {
     uint8_t* kernel_data = NULL;
@@ -72,93 +166,71 @@ int loongarch64_load_kernel(const char* kernel_path, const char* initrd_path, co
 
 int loongarch64_boot_linux(uint8_t* kernel_data, uint64_t kernel_size, const char* initrd_path, const char* cmdline) {
     struct loongarch64_linux_header* header = (struct loongarch64_linux_header*)kernel_data;
-    
-    uint64_t kernel_load_addr = 0x9000000000200000;
-    uint64_t dtb_addr = 0x9000000000300000;
-    uint64_t initrd_addr = 0;
+    struct loongarch64_layout layout;
+    uint8_t* initrd_data = NULL;
     uint64_t initrd_size = 0;
     
     if (initrd_path && strlen(initrd_path) > 0) {
-        uint8_t* initrd_data = NULL;
         uint32_t initrd_size32 = 0;
-        if (load_file(initrd_path, &initrd_data, &initrd_size32) == 0) {
+        if (load_file(initrd_path, &initrd_data, &initrd_size32) == 0 && initrd_data) {
             initrd_size = initrd_size32;
-            initrd_addr = dtb_addr + 0x100000;
-            if (initrd_data && initrd_size > 0) {
-                memcpy((void*)initrd_addr, initrd_data, initrd_size);
-            }
         }
     }
 
-    uint64_t cmdline_addr = 0;
-    uint64_t cmdline_size = 0;
-    if (cmdline && strlen(cmdline) > 0) {
-        cmdline_addr = initrd_addr + initrd_size + 0x1000;
-        cmdline_size = strlen(cmdline) + 1;
-        // Use strncpy for buffer safety assumes cmdline_addr points to a buffer of at least cmdline_size
-        strncpy((char*)cmdline_addr, cmdline, cmdline_size - 1);
-        ((char*)cmdline_addr)[cmdline_size - 1] = '\0';
+    uint64_t cmdline_size = cmdline && strlen(cmdline) > 0 ? strlen(cmdline) + 1 : 0;
+    uint64_t image_size = header->image_size > kernel_size ? header->image_size : kernel_size;
+    if (loongarch64_plan_handoff(&layout, image_size, initrd_data, initrd_size, cmdline, cmdline_size) != 0) {
+        return -1;
     }
 
+    if (initrd_size > 0) {
+        bh_memory_copy((void*)(uintptr_t)layout.initrd_addr, initrd_data, initrd_size);
+    }
+    if (cmdline_size) {
+        memcpy((char*)(uintptr_t)layout.cmdline_addr, cmdline, cmdline_size);
+    }
     if (kernel_data && kernel_size > 0) {
-        memcpy((void*)kernel_load_addr, kernel_data, kernel_size);
+        bh_memory_copy((void*)(uintptr_t)layout.kernel_addr, kernel_data, kernel_size);
     }
-
-    struct loongarch64_boot_params* params = (struct loongarch64_boot_params*)0x9000000000100000;
-    memset(params, 0, sizeof(struct loongarch64_boot_params));
+    loongarch64_fill_params(&layout, initrd_size, cmdline_size, kernel_size);
     
-    params->dtb_addr = dtb_addr;
-    params->initrd_addr = initrd_addr;
-    params->initrd_size = initrd_size;
-    params->cmdline_addr = cmdline_addr;
-    params->cmdline_size = cmdline_size;
-    params->kernel_addr = kernel_load_addr;
-    params->kernel_size = kernel_size;
-    params->mem_start = 0x9000000000000000;
-    params->mem_size = 0x800000000;
-    params->acpi_rsdp = 0;
-    params->efi_systab = 0;
+    // Coherent caches: barriers over what was written, and the I-cache
+    // made to see the image
+    bh_memory_flush((void*)(uintptr_t)layout.kernel_addr, kernel_size);
+    bh_memory_sync_code((void*)(uintptr_t)layout.kernel_addr, kernel_size);
+    bh_memory_flush((void*)(uintptr_t)layout.dtb_addr, layout.dtb_size);
+    bh_memory_flush((void*)(uintptr_t)layout.params_addr, sizeof(struct loongarch64_boot_params));
     
-    uint64_t entry_point = kernel_load_addr + header->text_offset;
+    uint64_t entry_point = layout.kernel_addr + header->text_offset;
     void (*kernel_entry)(uint64_t, uint64_t, uint64_t) = (void*)entry_point;
-    kernel_entry(0, dtb_addr, (uint64_t)params);
+    kernel_entry(0, layout.dtb_addr, layout.params_addr);
     
     return 0;
 }
 
 int loongarch64_boot_uefi(uint8_t* kernel_data, uint64_t kernel_size, const char* cmdline) {
-    uint64_t kernel_load_addr = 0x9000000000200000;
-    uint64_t dtb_addr = 0x9000000000300000;
-    
-    uint64_t cmdline_addr = 0;
-    uint64_t cmdline_size = 0;
-    if (cmdline && strlen(cmdline) > 0) {
-        cmdline_addr = dtb_addr + 0x100000;
-        cmdline_size = strlen(cmdline) + 1;
-        // Use strncpy for buffer safety; assumes cmdline_addr points to a buffer of at least cmdline_size
-        strncpy((char*)cmdline_addr, cmdline, cmdline_size - 1);
-        ((char*)cmdline_addr)[cmdline_size - 1] = '\0';
+    struct loongarch64_layout layout;
+    uint64_t cmdline_size = cmdline && strlen(cmdline) > 0 ? strlen(cmdline) + 1 : 0;
+
+    if (loongarch64_plan_handoff(&layout, kernel_size, NULL, 0, cmdline, cmdline_size) != 0) {
+        return -1;
     }
 
+    if (cmdline_size) {
+        memcpy((char*)(uintptr_t)layout.cmdline_addr, cmdline, cmdline_size);
+    }
     if (kernel_data && kernel_size > 0) {
-        memcpy((void*)kernel_load_addr, kernel_data, kernel_size);
+        bh_memory_copy((void*)(uintptr_t)layout.kernel_addr, kernel_data, kernel_size);
     }
+    loongarch64_fill_params(&layout, 0, cmdline_size, kernel_size);
     
-    struct loongarch64_boot_params* params = (struct loongarch64_boot_params*)0x9000000000100000;
-    memset(params, 0, sizeof(struct loongarch64_boot_params));
-    
-    params->dtb_addr = dtb_addr;
-    params->cmdline_addr = cmdline_addr;
-    params->cmdline_size = cmdline_size;
-    params->kernel_addr = kernel_load_addr;
-    params->kernel_size = kernel_size;
-    params->mem_start = 0x9000000000000000;
-    params->mem_size = 0x800000000;
-    params->acpi_rsdp = 0;
-    params->efi_systab = 0;
+    bh_memory_flush((void*)(uintptr_t)layout.kernel_addr, kernel_size);
+    bh_memory_sync_code((void*)(uintptr_t)layout.kernel_addr, kernel_size);
+    bh_memory_flush((void*)(uintptr_t)layout.dtb_addr, layout.dtb_size);
+    bh_memory_flush((void*)(uintptr_t)layout.params_addr, sizeof(struct loongarch64_boot_params));
     
-    void (*kernel_entry)(uint64_t, uint64_t, uint64_t) = (void*)kernel_load_addr;
-    kernel_entry(0, dtb_addr, (uint64_t)params);
+    void (*kernel_entry)(uint64_t, uint64_t, uint64_t) = (void*)(uintptr_t)layout.kernel_addr;
+    kernel_entry(0, layout.dtb_addr, layout.params_addr);
     
     return 0;
 }
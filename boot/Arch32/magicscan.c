@@ -0,0 +1,204 @@
+/*
+ * magicscan.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "compat.h"
+#include <string.h>
+#include "magicscan.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+#elif defined(__aarch64__) && defined(__GNUC__)
+#include <arm_neon.h>
+#endif
+
+// First 32-bit word of each magic as it sits in a little-endian image
+#define MAGICSCAN_WORD_MB1      0x1BADB002u
+#define MAGICSCAN_WORD_MB2      0xE85250D6u
+#define MAGICSCAN_WORD_LIMINE   ((uint32_t)LIMINE_COMMON_MAGIC_0)
+
+// A Limine request is its four ID words, a revision and a response pointer
+#define MAGICSCAN_LIMINE_REQUEST_SIZE   48
+
+static uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t read64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static void magicscan_add(magicscan_t* out, uint32_t offset, uint32_t kind) {
+    out->found |= kind;
+    if (out->count < MAGICSCAN_MAX_HITS) {
+        out->hits[out->count].offset = offset;
+        out->hits[out->count].kind = kind;
+        out->count++;
+    } else {
+        out->dropped++;
+    }
+}
+
+// A word at `offset` matched one of the first words; keep it if it is a
+// whole header or request of a kind asked for, at its alignment and inside
+// its window
+static void magicscan_check(const uint8_t* data, uint32_t size, uint32_t offset, uint32_t kinds,
+                            magicscan_t* out) {
+    const uint8_t* p = data + offset;
+    uint32_t word = read32(p);
+
+    if (word == MAGICSCAN_WORD_MB1) {
+        if ((kinds & MAGICSCAN_MB1) && offset < MAGICSCAN_MB1_END && size - offset >= 12 &&
+            word + read32(p + 4) + read32(p + 8) == 0) {
+            magicscan_add(out, offset, MAGICSCAN_MB1);
+        }
+    } else if (word == MAGICSCAN_WORD_MB2) {
+        uint32_t length = size - offset >= 16 ? read32(p + 8) : 0;
+        if ((kinds & MAGICSCAN_MB2) && (offset & 7) == 0 && offset < MAGICSCAN_MB2_END &&
+            length >= 16 && length <= size - offset &&
+            word + read32(p + 4) + length + read32(p + 12) == 0) {
+            magicscan_add(out, offset, MAGICSCAN_MB2);
+        }
+    } else if (word == MAGICSCAN_WORD_LIMINE) {
+        if ((kinds & MAGICSCAN_LIMINE) && (offset & 7) == 0 && size - offset >= MAGICSCAN_LIMINE_REQUEST_SIZE &&
+            read64(p) == LIMINE_COMMON_MAGIC_0 && read64(p + 8) == LIMINE_COMMON_MAGIC_1) {
+            magicscan_add(out, offset, MAGICSCAN_LIMINE);
+        }
+    }
+}
+
+static void magicscan_words(const uint8_t* data, uint32_t size, uint32_t from, uint32_t end, uint32_t kinds,
+                            magicscan_t* out) {
+    for (uint32_t offset = from; offset + 4 <= end; offset += 4) {
+        uint32_t word = read32(data + offset);
+        if (word == MAGICSCAN_WORD_MB1 || word == MAGICSCAN_WORD_MB2 || word == MAGICSCAN_WORD_LIMINE) {
+            magicscan_check(data, size, offset, kinds, out);
+        }
+    }
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+static AVX2_TARGET uint32_t magicscan_avx2(const uint8_t* data, uint32_t size, uint32_t end, uint32_t kinds,
+                                           magicscan_t* out) {
+    const __m256i mb1 = _mm256_set1_epi32((int)MAGICSCAN_WORD_MB1);
+    const __m256i mb2 = _mm256_set1_epi32((int)MAGICSCAN_WORD_MB2);
+    const __m256i limine = _mm256_set1_epi32((int)MAGICSCAN_WORD_LIMINE);
+    uint32_t offset = 0;
+    for (; offset + 32 <= end; offset += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(data + offset));
+        __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi32(v, mb1), _mm256_cmpeq_epi32(v, mb2)),
+                                      _mm256_cmpeq_epi32(v, limine));
+        uint32_t mask = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(hit));
+        while (mask) {
+            magicscan_check(data, size, offset + 4 * (uint32_t)__builtin_ctz(mask), kinds, out);
+            mask &= mask - 1;
+        }
+    }
+    return offset;
+}
+
+static uint32_t magicscan_sse2(const uint8_t* data, uint32_t size, uint32_t end, uint32_t kinds,
+                               magicscan_t* out) {
+    const __m128i mb1 = _mm_set1_epi32((int)MAGICSCAN_WORD_MB1);
+    const __m128i mb2 = _mm_set1_epi32((int)MAGICSCAN_WORD_MB2);
+    const __m128i limine = _mm_set1_epi32((int)MAGICSCAN_WORD_LIMINE);
+    uint32_t offset = 0;
+    for (; offset + 16 <= end; offset += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + offset));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi32(v, mb1), _mm_cmpeq_epi32(v, mb2)),
+                                   _mm_cmpeq_epi32(v, limine));
+        uint32_t mask = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(hit));
+        while (mask) {
+            magicscan_check(data, size, offset + 4 * (uint32_t)__builtin_ctz(mask), kinds, out);
+            mask &= mask - 1;
+        }
+    }
+    return offset;
+}
+
+// AVX2 and the YMM state enabled in XCR0, which firmware does not always do
+static int magicscan_has_avx2(void) {
+    static int has = -1;
+    if (has < 0) {
+        uint32_t eax, ebx, ecx, edx;
+        has = 0;
+        __asm__ volatile ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (0), "c" (0));
+        if (eax >= 7) {
+            __asm__ volatile ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1), "c" (0));
+            if ((ecx & (1u << 27)) && (ecx & (1u << 28))) {
+                uint32_t xcr0_lo, xcr0_hi;
+                __asm__ volatile ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+                if ((xcr0_lo & 0x6) == 0x6) {
+                    __asm__ volatile ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (7), "c" (0));
+                    has = (ebx & (1u << 5)) != 0;
+                }
+            }
+        }
+    }
+    return has;
+}
+#elif defined(__aarch64__) && defined(__GNUC__)
+// NEON has no movemask; a horizontal max says whether any lane matched,
+// and the rare block that did is walked lane by lane
+static uint32_t magicscan_neon(const uint8_t* data, uint32_t size, uint32_t end, uint32_t kinds,
+                               magicscan_t* out) {
+    const uint32x4_t mb1 = vdupq_n_u32(MAGICSCAN_WORD_MB1);
+    const uint32x4_t mb2 = vdupq_n_u32(MAGICSCAN_WORD_MB2);
+    const uint32x4_t limine = vdupq_n_u32(MAGICSCAN_WORD_LIMINE);
+    uint32_t offset = 0;
+    for (; offset + 16 <= end; offset += 16) {
+        uint32x4_t v = vreinterpretq_u32_u8(vld1q_u8(data + offset));
+        uint32x4_t hit = vorrq_u32(vorrq_u32(vceqq_u32(v, mb1), vceqq_u32(v, mb2)), vceqq_u32(v, limine));
+        if (vmaxvq_u32(hit)) {
+            magicscan_words(data, size, offset, offset + 16, kinds, out);
+        }
+    }
+    return offset;
+}
+#endif
+
+void magicscan_image(const uint8_t* data, uint32_t size, uint32_t kinds, magicscan_t* out) {
+    out->count = 0;
+    out->found = 0;
+    out->dropped = 0;
+    if (!data || !kinds) {
+        return;
+    }
+
+    // Multiboot headers only count inside their windows, so a scan for
+    // them alone stops at the end of the wider one
+    uint32_t end = size;
+    if (!(kinds & MAGICSCAN_LIMINE)) {
+        uint32_t window = (kinds & MAGICSCAN_MB2) ? MAGICSCAN_MB2_END : MAGICSCAN_MB1_END;
+        if (end > window) end = window;
+    }
+
+    uint32_t offset = 0;
+#if defined(__x86_64__) && defined(__GNUC__)
+    offset = magicscan_has_avx2() ? magicscan_avx2(data, size, end, kinds, out)
+                                  : magicscan_sse2(data, size, end, kinds, out);
+#elif defined(__aarch64__) && defined(__GNUC__)
+    offset = magicscan_neon(data, size, end, kinds, out);
+#endif
+    magicscan_words(data, size, offset, end, kinds, out);
+}
+
+int32_t magicscan_first(const magicscan_t* scan, uint32_t kind) {
+    for (uint32_t i = 0; i < scan->count; i++) {
+        if (scan->hits[i].kind == kind) {
+            return (int32_t)scan->hits[i].offset;
+        }
+    }
+    return -1;
+}
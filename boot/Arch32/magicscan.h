@@ -0,0 +1,58 @@
+/*
+ * magicscan.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_MAGICSCAN_H
+#define BLOODHORN_MAGICSCAN_H
+
+#include <stdint.h>
+#include "compat.h"
+
+// One pass over a kernel image for every boot protocol's marker, each at
+// the alignment and within the window its specification gives:
+//
+//   - Multiboot 1 header: 4-aligned, in the first 8 KiB
+//   - Multiboot 2 header: 8-aligned, in the first 32 KiB
+//   - Limine request: 8-aligned, anywhere (the two common-magic words that
+//     open every request's ID)
+//
+// The image is compared 32 (AVX2) or 16 (SSE2, NEON) bytes at a time
+// against the first 32-bit word of all three magics at once; only blocks
+// with a candidate are looked at word by word. Multiboot candidates are
+// kept only when their checksum holds and their length fits the image, so
+// every hit is a real header or request.
+#define MAGICSCAN_MB1       (1u << 0)
+#define MAGICSCAN_MB2       (1u << 1)
+#define MAGICSCAN_LIMINE    (1u << 2)
+#define MAGICSCAN_ALL       (MAGICSCAN_MB1 | MAGICSCAN_MB2 | MAGICSCAN_LIMINE)
+
+#define MAGICSCAN_MB1_END       8192
+#define MAGICSCAN_MB2_END       32768
+#define MAGICSCAN_MAX_HITS      64      // Limine kernels carry a few dozen requests at most
+
+#define LIMINE_COMMON_MAGIC_0   0xc7b1dd30df4c8b88ULL
+#define LIMINE_COMMON_MAGIC_1   0x0a82e883a194f07bULL
+
+typedef struct {
+    uint32_t offset;                    // From the start of the scanned data
+    uint32_t kind;                      // One MAGICSCAN_* bit
+} magicscan_hit_t;
+
+typedef struct {
+    magicscan_hit_t hits[MAGICSCAN_MAX_HITS];   // In image order
+    uint32_t count;
+    uint32_t found;                     // Kinds with at least one hit
+    uint32_t dropped;                   // Hits past the table
+} magicscan_t;
+
+// Scan `size` bytes for the kinds in `kinds`. `out` is reset first, so
+// results of several scans are not merged.
+void magicscan_image(const uint8_t* data, uint32_t size, uint32_t kinds, magicscan_t* out);
+
+// Offset of the first hit of `kind`, or -1
+int32_t magicscan_first(const magicscan_t* scan, uint32_t kind);
+
+#endif
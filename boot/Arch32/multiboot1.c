@@ -8,65 +8,243 @@
 #include <stdint.h>
 #include "compat.h"
 #include <string.h>
+#include "../libb/include/bloodhorn/memory.h"
 #include "multiboot1.h"
+#include "loadseg.h"
+#include "magicscan.h"
+#include "../../compress/decompress.h"
+#include "../../security/tpm2.h"
 
 extern void* allocate_memory(uint32_t size);
 extern int load_file(const char* path, uint8_t** data, uint32_t* size);
+extern int load_image_file(const char* path, uint8_t** data, uint32_t* size);
+extern int get_file_size(const char* path, uint32_t* size);
 
-struct multiboot_info {
-    uint32_t flags;
-    uint32_t mem_lower;
-    uint32_t mem_upper;
-    uint32_t boot_device;
-    uint32_t cmdline;
-    uint32_t mods_count;
-    uint32_t mods_addr;
-    uint32_t syms[4];
-    uint32_t mmap_length;
-    uint32_t mmap_addr;
-    uint32_t drives_length;
-    uint32_t drives_addr;
-    uint32_t config_table;
-    uint32_t boot_loader_name;
-    uint32_t apm_table;
-    uint32_t vbe_control_info;
-    uint32_t vbe_mode_info;
-    uint16_t vbe_mode;
-    uint16_t vbe_interface_seg;
-    uint16_t vbe_interface_off;
-    uint16_t vbe_interface_len;
-};
-
-struct multiboot_mmap_entry {
+#define MULTIBOOT1_4GB  0x100000000ULL
+
+// Modules queued for the next boot, in order
+typedef struct multiboot1_module_entry {
+    struct multiboot1_module_entry* next;
+    char* path;
+    char* cmdline;
+    uint64_t start;
     uint32_t size;
-    uint64_t addr;
-    uint64_t len;
-    uint32_t type;
-};
-
-struct multiboot_module {
-    uint32_t mod_start;
-    uint32_t mod_end;
-    uint32_t string;
-    uint32_t reserved;
-};
+} multiboot1_module_entry_t;
+
+static multiboot1_module_entry_t* g_modules = NULL;
+static multiboot1_module_entry_t** g_modules_tail = &g_modules;
+static uint32_t g_module_count = 0;
+
+static uint64_t page_round(uint64_t size) {
+    return (size + 4095) & ~4095ULL;
+}
+
+static char* copy_string(const char* s) {
+    uint32_t len = s ? (uint32_t)strlen(s) : 0;
+    char* copy = allocate_memory(len + 1);
+    if (copy) {
+        if (len) memcpy(copy, s, len);
+        copy[len] = 0;
+    }
+    return copy;
+}
+
+int multiboot1_add_module(const char* module_path, const char* cmdline) {
+    if (!module_path || !*module_path) {
+        return -1;
+    }
+    multiboot1_module_entry_t* m = allocate_memory(sizeof(*m));
+    if (!m) {
+        return -1;
+    }
+    memset(m, 0, sizeof(*m));
+    m->path = copy_string(module_path);
+    m->cmdline = copy_string(cmdline);
+    if (!m->path || !m->cmdline) {
+        return -1;
+    }
+    *g_modules_tail = m;
+    g_modules_tail = &m->next;
+    g_module_count++;
+    return 0;
+}
+
+void multiboot1_clear_modules(void) {
+    g_modules = NULL;
+    g_modules_tail = &g_modules;
+    g_module_count = 0;
+}
+
+// All slots come from one block placed below 4GB, sized from the file
+// sizes before any data is read, and every module is read straight into
+// its slot with the reads overlapped. Compressed modules come back as
+// stored and, like those that could not be read in place, are loaded
+// again the buffered way (decompressed) into their slot or a block of
+// their own.
+static int multiboot1_load_modules(void) {
+    loadseg_read_t* reads;
+    uint64_t total = 0;
+    uint64_t base = 0;
+    uint32_t i = 0;
+    
+    if (g_module_count == 0) {
+        return 0;
+    }
+    reads = allocate_memory(g_module_count * sizeof(*reads));
+    if (!reads) {
+        return -1;
+    }
+    for (multiboot1_module_entry_t* m = g_modules; m; m = m->next, i++) {
+        reads[i].path = m->path;
+        reads[i].status = -1;
+        if (get_file_size(m->path, &reads[i].size) != 0) {
+            reads[i].size = 0;
+        }
+        m->size = reads[i].size;
+        total += page_round(m->size);
+    }
+    if (total && loadseg_place(total, 4096, 0x100000, MULTIBOOT1_4GB, LOADSEG_PLACE_TOP_DOWN, &base) != 0) {
+        base = 0;
+    }
+    
+    // Only non-empty files that got a slot go in the overlapped batch
+    uint64_t slot = base;
+    uint32_t batched = 0;
+    for (i = 0; i < g_module_count; i++) {
+        reads[i].dest = slot;
+        slot += page_round(reads[i].size);
+        if (base && reads[i].size) {
+            reads[batched++] = reads[i];
+        }
+    }
+    loadseg_read_files(reads, batched);
+    
+    i = 0;
+    slot = base;
+    for (multiboot1_module_entry_t* m = g_modules; m; m = m->next) {
+        uint32_t slot_size = m->size;
+        int in_place = i < batched && reads[i].path == m->path;
+        if (in_place) {
+            i++;
+            in_place = reads[i - 1].status == 0 &&
+                       decomp_detect((const uint8_t*)(uintptr_t)slot, slot_size) == DECOMP_NONE;
+        }
+        if (in_place) {
+            m->start = slot;
+            m->size = slot_size;
+        } else {
+            uint8_t* data = NULL;
+            uint32_t size = 0;
+            uint64_t addr = slot;
+            if (load_image_file(m->path, &data, &size) != 0) {
+                return -1;
+            }
+            if ((!base || size > slot_size) &&
+                loadseg_place(size, 4096, 0x100000, MULTIBOOT1_4GB, LOADSEG_PLACE_TOP_DOWN, &addr) != 0) {
+                return -1;
+            }
+            bh_memory_copy((void*)(uintptr_t)addr, data, size);
+            m->start = addr;
+            m->size = size;
+        }
+        slot += page_round(slot_size);
+    }
+    return 0;
+}
+
+// Hash every module in one batch, interleaved across SIMD lanes, and
+// extend PCR 10 with the digests
+static void multiboot1_measure_modules(void) {
+    if (g_module_count == 0 || !tpm2_is_available()) {
+        return;
+    }
+    TPM2_MEASUREMENT* items = allocate_memory(g_module_count * sizeof(*items));
+    uint32_t count = 0;
+    if (!items) {
+        return;
+    }
+    for (multiboot1_module_entry_t* m = g_modules; m; m = m->next) {
+        if (m->size == 0) {
+            continue;
+        }
+        items[count].pcr_index = TPM2_PCR_INITRD;
+        items[count].event_type = EV_IPL;
+        items[count].data = (const void*)(uintptr_t)m->start;
+        items[count].data_size = m->size;
+        items[count].description = m->path;
+        items[count].digest = NULL;
+        count++;
+    }
+    tpm2_measure_batch(items, count);
+}
+
+// The kernel's module list and command lines, in one block below 4GB
+static int multiboot1_module_info(struct multiboot_info* mb_info) {
+    uint64_t size = (uint64_t)g_module_count * sizeof(struct multiboot_module);
+    uint64_t addr = 0;
+    
+    if (g_module_count == 0) {
+        return 0;
+    }
+    for (multiboot1_module_entry_t* m = g_modules; m; m = m->next) {
+        size += strlen(m->cmdline) + 1;
+    }
+    if (loadseg_place(size, 4096, 0x1000, MULTIBOOT1_4GB, LOADSEG_PLACE_TOP_DOWN, &addr) != 0) {
+        return -1;
+    }
+    
+    struct multiboot_module* modules = (struct multiboot_module*)(uintptr_t)addr;
+    char* strings = (char*)(modules + g_module_count);
+    uint32_t i = 0;
+    for (multiboot1_module_entry_t* m = g_modules; m; m = m->next, i++) {
+        uint32_t len = (uint32_t)strlen(m->cmdline) + 1;
+        memcpy(strings, m->cmdline, len);
+        modules[i].mod_start = (uint32_t)m->start;
+        modules[i].mod_end = (uint32_t)(m->start + m->size);
+        modules[i].string = (uint32_t)(uintptr_t)strings;
+        modules[i].reserved = 0;
+        strings += len;
+    }
+    mb_info->flags |= MULTIBOOT_INFO_MODS;
+    mb_info->mods_count = g_module_count;
+    mb_info->mods_addr = (uint32_t)addr;
+    return 0;
+}
+
+// Offset of the Multiboot 1 header (magic and checksum checked), or -1.
+// `scan` is one already made of this image, or NULL to make it here.
+static int32_t multiboot1_find_header(const uint8_t* data, uint32_t size, const magicscan_t* scan) {
+    static magicscan_t own;
+    if (!scan) {
+        magicscan_image(data, size, MAGICSCAN_MB1, &own);
+        scan = &own;
+    }
+    return magicscan_first(scan, MAGICSCAN_MB1);
+}
 
 int multiboot1_load_kernel(const char* kernel_path, const char* cmdline) {
+    static loadseg_t image;
     uint8_t* kernel_data = NULL;
     uint32_t kernel_size = 0;
-    
-    // Load kernel file
-    if (load_file(kernel_path, &kernel_data, &kernel_size) != 0) {
+    int in_place = loadseg_open(&image, kernel_path) == 0;
+    
+    // Only the header is read now when the kernel can go straight from disk
+    // to its load address; otherwise load the whole file
+    if (in_place) {
+        kernel_data = image.head;
+        kernel_size = image.size;
+    } else if (load_file(kernel_path, &kernel_data, &kernel_size) != 0) {
         return -1;
     }
     
-    // Parse Multiboot 1 header
-    uint32_t* header = (uint32_t*)kernel_data;
-    
-    // Verify Multiboot 1 magic
-    if (header[0] != MULTIBOOT_HEADER_MAGIC) {
+    // The header is 4-aligned anywhere in the first 8 KiB, all of which
+    // the head holds. The fields read below run to its eleventh word.
+    uint32_t held = in_place ? image.head_len : kernel_size;
+    int32_t header_offset = multiboot1_find_header(kernel_data, held, NULL);
+    if (header_offset < 0 || held - (uint32_t)header_offset < 44) {
         return -1;
     }
+    uint32_t* header = (uint32_t*)(kernel_data + header_offset);
     
     // Find header address
     uint32_t header_addr = 0;
@@ -94,12 +272,23 @@ int multiboot1_load_kernel(const char* kernel_path, const char* cmdline) {
     uint32_t load_size = load_end_addr - load_addr;
     if (load_size > kernel_size) load_size = kernel_size;
     
-    memcpy((void*)load_addr, kernel_data, load_size);
+    if (in_place) {
+        if (loadseg_load(&image, 0, load_size, load_addr, load_size) != 0) {
+            return -1;
+        }
+    } else {
+        bh_memory_copy((void*)load_addr, kernel_data, load_size);
+    }
     
     // Zero out BSS
     if (bss_end_addr > load_end_addr) {
-        memset((void*)load_end_addr, 0, bss_end_addr - load_end_addr);
+        loadseg_zero((void*)(uintptr_t)load_end_addr, bss_end_addr - load_end_addr);
+    }
+    
+    if (multiboot1_load_modules() != 0) {
+        return -1;
     }
+    multiboot1_measure_modules();
     
     // Setup Multiboot 1 info structure
     struct multiboot_info* mb_info = (struct multiboot_info*)0x90000;
@@ -137,6 +326,10 @@ int multiboot1_load_kernel(const char* kernel_path, const char* cmdline) {
     mb_info->mmap_length = 2 * sizeof(struct multiboot_mmap_entry);
     mb_info->mmap_addr = (uint32_t)mmap;
     
+    if (multiboot1_module_info(mb_info) != 0) {
+        return -1;
+    }
+    
     // Jump to kernel
     void (*kernel_entry)(uint32_t, struct multiboot_info*) = (void*)entry_addr;
     kernel_entry(MULTIBOOT_BOOTLOADER_MAGIC, mb_info);
@@ -152,57 +345,16 @@ int multiboot1_verify_kernel(const char* kernel_path) {
         return -1;
     }
     
-    uint32_t* header = (uint32_t*)kernel_data;
-    
-    // Check Multiboot 1 magic
-    if (header[0] != MULTIBOOT_HEADER_MAGIC) {
-        return -1;
-    }
-    
-    // Check header checksum
-    uint32_t checksum = 0;
-    for (int i = 0; i < 8; i++) {
-        checksum += header[i];
-    }
-    if (checksum != 0) {
-        return -1;
-    }
-    
-    return 0;
+    // Magic and checksum are checked by the search
+    return multiboot1_find_header(kernel_data, kernel_size, NULL) < 0 ? -1 : 0;
 }
 
-int multiboot1_load_module(const char* module_path, const char* cmdline) {
-    uint8_t* module_data = NULL;
-    uint32_t module_size = 0;
-    
-    if (load_file(module_path, &module_data, &module_size) != 0) {
+int boot_multiboot1_kernel(uint8_t* kernel_data, uint32_t kernel_size, const magicscan_t* scan,
+                           const char* cmdline) {
+    if (multiboot1_find_header(kernel_data, kernel_size, scan) < 0) {
         return -1;
     }
     
-    // Load module to high memory
-    uint32_t module_addr = 0x200000; // 2MB
-    memcpy((void*)module_addr, module_data, module_size);
-    
-    // Add to module list
-    struct multiboot_module* modules = (struct multiboot_module*)0x90200;
-    static int module_count = 0;
-    
-    modules[module_count].mod_start = module_addr;
-    modules[module_count].mod_end = module_addr + module_size;
-    modules[module_count].string = 0x90300 + module_count * 64;
-    
-    // Copy module command line
-    if (cmdline && strlen(cmdline) > 0) {
-        char* cmdline_addr = (char*)modules[module_count].string;
-        strcpy(cmdline_addr, cmdline);
-    }
-    
-    module_count++;
-    
-    return 0;
-} 
-
-int boot_multiboot1_kernel(uint8_t* kernel_data, uint32_t kernel_size, const char* cmdline) {
     struct multiboot_info* info = (struct multiboot_info*)0x1000;
     memset(info, 0, sizeof(struct multiboot_info));
     
@@ -216,7 +368,7 @@ int boot_multiboot1_kernel(uint8_t* kernel_data, uint32_t kernel_size, const cha
     }
     
     uint32_t kernel_entry = 0x100000;
-    memcpy((void*)kernel_entry, kernel_data, kernel_size);
+    bh_memory_copy((void*)kernel_entry, kernel_data, kernel_size);
     
     void (*entry_point)(uint32_t, uint32_t) = (void*)kernel_entry;
     entry_point(MULTIBOOT_BOOTLOADER_MAGIC, (uint32_t)info);
@@ -9,6 +9,7 @@
 #define BLOODHORN_MULTIBOOT1_H
 #include <stdint.h>
 #include "compat.h"
+#include "magicscan.h"
 
 #define MULTIBOOT_HEADER_MAGIC 0x1BADB002
 #define MULTIBOOT_BOOTLOADER_MAGIC 0x2BADB002
@@ -92,7 +93,16 @@ struct multiboot_elf_section_header_table {
 
 int multiboot1_load_kernel(const char* kernel_path, const char* cmdline);
 int multiboot1_verify_kernel(const char* kernel_path);
-int multiboot1_load_module(const char* module_path, const char* cmdline);
-int boot_multiboot1_kernel(uint8_t* kernel_data, uint32_t kernel_size, const char* cmdline);
+
+// Modules for the next multiboot1_load_kernel. The list grows as needed;
+// path and command line are copied. At boot every module is read from
+// disk straight into a page-aligned slot below 4GB, the reads overlapped,
+// and measured into the TPM in one batch.
+int multiboot1_add_module(const char* module_path, const char* cmdline);
+void multiboot1_clear_modules(void);
+// Boot an image already in memory. `scan` is the magicscan_image result
+// of the caller's protocol detection, or NULL to scan here.
+int boot_multiboot1_kernel(uint8_t* kernel_data, uint32_t kernel_size, const magicscan_t* scan,
+                           const char* cmdline);
 
 #endif // BLOODHORN_MULTIBOOT1_H 
\ No newline at end of file
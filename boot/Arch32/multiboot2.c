@@ -6,464 +6,521 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
 #include "compat.h"
 #include <string.h>
+#include "../libb/include/bloodhorn/memory.h"
 #include "multiboot2.h"
+#include "loadseg.h"
+#include "fwinfo.h"
+#include "magicscan.h"
 
-extern void* allocate_memory(uint32_t size);
-extern int load_file(const char* path, uint8_t** data, uint32_t* size);
+extern int load_image_file(const char* path, uint8_t** data, uint32_t* size);
+extern int get_file_size(const char* path, uint32_t* size);
 
-struct multiboot2_info {
-    uint32_t total_size;
-    uint32_t reserved;
-    uint8_t tags[];
-};
-
-struct multiboot2_tag {
-    uint32_t type;
-    uint32_t size;
-};
-
-struct multiboot2_tag_string {
-    uint32_t type;
-    uint32_t size;
-    char string[];
-};
-
-struct multiboot2_tag_basic_meminfo {
-    uint32_t type;
-    uint32_t size;
-    uint32_t mem_lower;
-    uint32_t mem_upper;
-};
+#define MULTIBOOT2_4GB          0x100000000ULL
 
-struct multiboot2_tag_bootdev {
-    uint32_t type;
-    uint32_t size;
-    uint32_t biosdev;
-    uint32_t partition;
-    uint32_t subpartition;
+// Just the ELF header fields the loader reads
+struct multiboot2_elf32_header {
+    uint8_t e_ident[16];
+    uint16_t e_type;
+    uint16_t e_machine;
+    uint32_t e_version;
+    uint32_t e_entry;
+    uint32_t e_phoff;
+    uint32_t e_shoff;
+    uint32_t e_flags;
+    uint16_t e_ehsize;
+    uint16_t e_phentsize;
+    uint16_t e_phnum;
+    uint16_t e_shentsize;
+    uint16_t e_shnum;
+    uint16_t e_shstrndx;
 };
 
-struct multiboot2_tag_mmap {
-    uint32_t type;
-    uint32_t size;
-    uint32_t entry_size;
-    uint32_t entry_version;
-    struct multiboot2_mmap_entry entries[];
+struct multiboot2_elf64_header {
+    uint8_t e_ident[16];
+    uint16_t e_type;
+    uint16_t e_machine;
+    uint32_t e_version;
+    uint64_t e_entry;
+    uint64_t e_phoff;
+    uint64_t e_shoff;
+    uint32_t e_flags;
+    uint16_t e_ehsize;
+    uint16_t e_phentsize;
+    uint16_t e_phnum;
+    uint16_t e_shentsize;
+    uint16_t e_shnum;
+    uint16_t e_shstrndx;
 };
 
-struct multiboot2_mmap_entry {
-    uint64_t addr;
-    uint64_t len;
-    uint32_t type;
-    uint32_t zero;
+struct multiboot2_elf32_phdr {
+    uint32_t p_type;
+    uint32_t p_offset;
+    uint32_t p_vaddr;
+    uint32_t p_paddr;
+    uint32_t p_filesz;
+    uint32_t p_memsz;
+    uint32_t p_flags;
+    uint32_t p_align;
 };
 
-struct multiboot2_tag_vbe {
-    uint32_t type;
-    uint32_t size;
-    uint16_t vbe_mode;
-    uint16_t vbe_interface_seg;
-    uint16_t vbe_interface_off;
-    uint16_t vbe_interface_len;
-    struct multiboot2_vbe_info_block vbe_control_info;
-    struct multiboot2_vbe_mode_info_block vbe_mode_info;
+struct multiboot2_elf64_phdr {
+    uint32_t p_type;
+    uint32_t p_flags;
+    uint64_t p_offset;
+    uint64_t p_vaddr;
+    uint64_t p_paddr;
+    uint64_t p_filesz;
+    uint64_t p_memsz;
+    uint64_t p_align;
 };
 
-struct multiboot2_vbe_info_block {
-    uint8_t vbe_signature[4];
-    uint16_t vbe_version;
-    uint32_t oem_string_ptr;
-    uint32_t capabilities;
-    uint32_t video_mode_ptr;
-    uint16_t total_memory;
-    uint16_t oem_software_rev;
-    uint32_t oem_vendor_name_ptr;
-    uint32_t oem_product_name_ptr;
-    uint32_t oem_product_rev_ptr;
-    uint8_t reserved[222];
-    uint8_t oem_data[256];
-};
-
-struct multiboot2_vbe_mode_info_block {
-    uint16_t mode_attributes;
-    uint8_t win_a_attributes;
-    uint8_t win_b_attributes;
-    uint16_t win_granularity;
-    uint16_t win_size;
-    uint16_t win_a_segment;
-    uint16_t win_b_segment;
-    uint32_t win_func_ptr;
-    uint16_t bytes_per_scan_line;
-    uint16_t x_resolution;
-    uint16_t y_resolution;
-    uint8_t x_char_size;
-    uint8_t y_char_size;
-    uint8_t number_of_planes;
-    uint8_t bits_per_pixel;
-    uint8_t number_of_banks;
-    uint8_t memory_model;
-    uint8_t bank_size;
-    uint8_t number_of_image_pages;
-    uint8_t reserved1;
-    uint8_t red_mask_size;
-    uint8_t red_field_position;
-    uint8_t green_mask_size;
-    uint8_t green_field_position;
-    uint8_t blue_mask_size;
-    uint8_t blue_field_position;
-    uint8_t reserved_mask_size;
-    uint8_t reserved_field_position;
-    uint8_t direct_color_mode_info;
-    uint32_t framebuffer;
-    uint32_t off_screen_mem_offset;
-    uint16_t off_screen_mem_size;
-    uint8_t reserved2[206];
-};
-
-struct multiboot2_tag_framebuffer {
-    uint32_t type;
+// Modules queued for the next Multiboot 2 boot
+typedef struct {
+    char path[MULTIBOOT2_PATH_MAX];
+    char cmdline[MULTIBOOT2_CMDLINE_MAX];
+    uint64_t start;
     uint32_t size;
-    uint64_t framebuffer_addr;
-    uint32_t framebuffer_pitch;
-    uint32_t framebuffer_width;
-    uint32_t framebuffer_height;
-    uint8_t framebuffer_bpp;
-    uint8_t framebuffer_type;
-    uint8_t reserved;
-    union {
-        struct {
-            uint32_t framebuffer_palette_num_colors;
-            struct multiboot2_color_info framebuffer_palette[];
-        };
-        struct {
-            uint8_t framebuffer_red_field_position;
-            uint8_t framebuffer_red_mask_size;
-            uint8_t framebuffer_green_field_position;
-            uint8_t framebuffer_green_mask_size;
-            uint8_t framebuffer_blue_field_position;
-            uint8_t framebuffer_blue_mask_size;
-        };
-    };
-};
+} multiboot2_module_t;
 
-struct multiboot2_color_info {
-    uint8_t red_value;
-    uint8_t green_value;
-    uint8_t blue_value;
-};
+static multiboot2_module_t g_modules[MULTIBOOT2_MAX_MODULES];
+static uint32_t g_module_count = 0;
 
-struct multiboot2_tag_elf_sections {
-    uint32_t type;
-    uint32_t size;
-    uint32_t num;
-    uint32_t entsize;
+// What the kernel image told us, and the ELF section headers it carries
+typedef struct {
+    uint64_t entry;
+    const uint8_t* shdrs;
+    uint32_t shnum;
+    uint32_t shentsize;
     uint32_t shndx;
-    char sections[];
-};
-
-struct multiboot2_tag_apm {
-    uint32_t type;
-    uint32_t size;
-    uint16_t version;
-    uint16_t cseg;
-    uint32_t offset;
-    uint16_t cseg_16;
-    uint16_t dseg;
-    uint16_t flags;
-    uint16_t cseg_len;
-    uint16_t cseg_16_len;
-    uint16_t dseg_len;
-};
-
-struct multiboot2_tag_efi32 {
-    uint32_t type;
-    uint32_t size;
-    uint32_t pointer;
-};
+} multiboot2_image_t;
 
-struct multiboot2_tag_efi64 {
-    uint32_t type;
-    uint32_t size;
-    uint64_t pointer;
-};
-
-struct multiboot2_tag_smbios {
-    uint32_t type;
-    uint32_t size;
-    uint8_t major;
-    uint8_t minor;
-    uint8_t reserved[6];
-    uint8_t tables[];
-};
+// Everything the boot information is built from, gathered before the
+// sizing pass so sizing and writing see the same data
+typedef struct {
+    const char* cmdline;
+    const multiboot2_image_t* image;
+    uint32_t mmap_count;
+    uint32_t mem_lower;         // KiB of conventional memory from 0, out of the map
+    uint32_t mem_upper;         // ... and from 1MB
+    fwinfo_framebuffer_t fb;
+    int have_fb;
+    const void* rsdp;
+    uint32_t rsdp_size;
+    int rsdp_v2;
+    const void* smbios;
+    uint32_t smbios_size;
+    uint8_t smbios_major;
+    uint8_t smbios_minor;
+} multiboot2_sources_t;
 
-struct multiboot2_tag_old_acpi {
-    uint32_t type;
+// Tag writer. With no buffer it only adds up sizes, so one emission
+// routine both sizes the boot information and writes it.
+typedef struct {
+    uint8_t* base;              // NULL while sizing
     uint32_t size;
-    uint8_t rsdp[];
-};
-
-struct multiboot2_tag_new_acpi {
-    uint32_t type;
-    uint32_t size;
-    uint8_t rsdp[];
-};
+} multiboot2_writer_t;
 
-struct multiboot2_tag_network {
-    uint32_t type;
-    uint32_t size;
-    uint8_t dhcpack[];
-};
+static uint64_t page_round(uint64_t size) {
+    return (size + 4095) & ~4095ULL;
+}
 
-struct multiboot2_tag_efi_mmap {
-    uint32_t type;
-    uint32_t size;
-    uint32_t descr_size;
-    uint32_t descr_vers;
-    uint8_t efi_mmap[];
-};
+int multiboot2_add_module(const char* module_path, const char* cmdline) {
+    if (g_module_count >= MULTIBOOT2_MAX_MODULES || !module_path || strlen(module_path) >= MULTIBOOT2_PATH_MAX) {
+        return -1;
+    }
+    multiboot2_module_t* m = &g_modules[g_module_count++];
+    strcpy(m->path, module_path);
+    m->cmdline[0] = 0;
+    if (cmdline) {
+        strncpy(m->cmdline, cmdline, MULTIBOOT2_CMDLINE_MAX - 1);
+        m->cmdline[MULTIBOOT2_CMDLINE_MAX - 1] = 0;
+    }
+    return 0;
+}
 
-struct multiboot2_tag_efi32_ih {
-    uint32_t type;
-    uint32_t size;
-    uint32_t pointer;
-};
+void multiboot2_clear_modules(void) {
+    g_module_count = 0;
+}
 
-struct multiboot2_tag_efi64_ih {
-    uint32_t type;
-    uint32_t size;
-    uint64_t pointer;
-};
+// Every module gets a page-aligned slot in one block placed below 4GB,
+// sized from the file sizes before any data is read, and is read from
+// disk straight into it. Modules that cannot be read in place
+// (compressed, remote) are loaded whole and get a block of their own.
+static int multiboot2_load_modules(void) {
+    static loadseg_t image;
+    uint32_t slot_size[MULTIBOOT2_MAX_MODULES];
+    uint64_t total = 0;
+    uint64_t base = 0;
+    
+    for (uint32_t i = 0; i < g_module_count; i++) {
+        if (get_file_size(g_modules[i].path, &slot_size[i]) != 0) {
+            slot_size[i] = 0;
+        }
+        total += page_round(slot_size[i]);
+    }
+    if (total && loadseg_place(total, 4096, 0x100000, MULTIBOOT2_4GB, LOADSEG_PLACE_TOP_DOWN, &base) != 0) {
+        base = 0;
+    }
+    
+    uint64_t slot = base;
+    for (uint32_t i = 0; i < g_module_count; i++) {
+        multiboot2_module_t* m = &g_modules[i];
+        if (base && slot_size[i] && loadseg_open(&image, m->path) == 0 && image.size == slot_size[i] &&
+            loadseg_load(&image, 0, image.size, slot, image.size) == 0) {
+            m->start = slot;
+            m->size = image.size;
+        } else {
+            uint8_t* data = NULL;
+            uint32_t size = 0;
+            uint64_t addr = slot;
+            if (load_image_file(m->path, &data, &size) != 0) {
+                return -1;
+            }
+            if ((!base || size > slot_size[i]) &&
+                loadseg_place(size, 4096, 0x100000, MULTIBOOT2_4GB, LOADSEG_PLACE_TOP_DOWN, &addr) != 0) {
+                return -1;
+            }
+            bh_memory_copy((void*)(uintptr_t)addr, data, size);
+            m->start = addr;
+            m->size = size;
+        }
+        slot += page_round(slot_size[i]);
+    }
+    return 0;
+}
 
-struct multiboot2_tag_load_base_addr {
-    uint32_t type;
-    uint32_t size;
-    uint32_t load_base_addr;
-};
+// Offset of the Multiboot 2 header within the image, or -1. The scan
+// checks the magic, checksum and length; `scan` is one already made of
+// this image (protocol detection), or NULL to make it here.
+static int32_t multiboot2_find_header(const uint8_t* data, uint32_t size, const magicscan_t* scan) {
+    static magicscan_t own;
+    if (!scan) {
+        magicscan_image(data, size, MAGICSCAN_MB2, &own);
+        scan = &own;
+    }
+    return magicscan_first(scan, MAGICSCAN_MB2);
+}
 
-int multiboot2_load_kernel(const char* kernel_path, const char* cmdline) {
-    uint8_t* kernel_data = NULL;
-    uint32_t kernel_size = 0;
-    
-    // Load kernel file
-    if (load_file(kernel_path, &kernel_data, &kernel_size) != 0) {
+// Put the image's segments at their physical addresses; the ELF program
+// headers unless the header carries an address tag
+static int multiboot2_load_image(const uint8_t* data, uint32_t size, const magicscan_t* scan,
+                                 multiboot2_image_t* out) {
+    static loadseg_batch_t batch;
+    int32_t header_offset = multiboot2_find_header(data, size, scan);
+    if (header_offset < 0) {
         return -1;
     }
     
-    // Parse Multiboot 2 header
-    uint32_t* header = (uint32_t*)kernel_data;
-    
-    // Verify Multiboot 2 magic
-    if (header[0] != MULTIBOOT2_HEADER_MAGIC) {
-        return -1;
+    const uint32_t* header = (const uint32_t*)(data + header_offset);
+    const struct multiboot2_header_tag_address* address = NULL;
+    uint64_t entry = 0;
+    
+    // Header tags are a 16-bit type, 16-bit flags and a 32-bit size, each
+    // padded to 8 bytes. A tag must fit in what is left of the header, which
+    // also keeps the rounded step from wrapping back to 0.
+    uint32_t offset = 16;
+    while (offset + 8 <= header[2]) {
+        const uint8_t* tag = (const uint8_t*)header + offset;
+        uint16_t type = *(const uint16_t*)tag;
+        uint32_t tag_size = *(const uint32_t*)(tag + 4);
+        if (type == MULTIBOOT2_HEADER_TAG_END || tag_size < 8 || tag_size > header[2] - offset) {
+            break;
+        }
+        if (type == MULTIBOOT2_HEADER_TAG_ADDRESS && tag_size >= sizeof(*address)) {
+            address = (const struct multiboot2_header_tag_address*)tag;
+        } else if (type == MULTIBOOT2_HEADER_TAG_ENTRY_ADDRESS &&
+                   tag_size >= sizeof(struct multiboot2_header_tag_entry_address)) {
+            entry = ((const struct multiboot2_header_tag_entry_address*)tag)->entry_addr;
+        }
+        offset += (tag_size + 7) & ~7u;
     }
     
-    // Find header address and entry point
-    uint32_t header_addr = 0;
-    uint32_t load_addr = 0;
-    uint32_t load_end_addr = 0;
-    uint32_t bss_end_addr = 0;
-    uint32_t entry_addr = 0;
-    
-    // Parse header tags
-    uint32_t offset = 8;
-    while (offset < kernel_size) {
-        struct multiboot2_tag* tag = (struct multiboot2_tag*)(kernel_data + offset);
-        
-        if (tag->type == MULTIBOOT2_HEADER_TAG_END) {
-            break;
+    memset(out, 0, sizeof(*out));
+    batch.count = 0;
+    if (address) {
+        // The file is loaded from where the header says load_addr falls
+        uint32_t load_offset = (uint32_t)header_offset - (address->header_addr - address->load_addr);
+        if (load_offset > size) {
+            return -1;
+        }
+        uint32_t load_size = address->load_end_addr ? address->load_end_addr - address->load_addr
+                                                    : size - load_offset;
+        if (load_size > size - load_offset) {
+            load_size = size - load_offset;
+        }
+        loadseg_queue(&batch, address->load_addr, data + load_offset, load_size);
+        if (address->bss_end_addr > address->load_addr + load_size) {
+            loadseg_queue(&batch, address->load_addr + load_size, NULL,
+                          address->bss_end_addr - (address->load_addr + load_size));
+        }
+        out->entry = entry ? entry : address->load_addr;
+    } else if (size >= sizeof(struct multiboot2_elf64_header) && memcmp(data, "\x7f" "ELF", 4) == 0 &&
+               data[4] == 2) {
+        const struct multiboot2_elf64_header* eh = (const struct multiboot2_elf64_header*)data;
+        if (eh->e_phoff > size ||
+            (uint64_t)eh->e_phnum * sizeof(struct multiboot2_elf64_phdr) > size - eh->e_phoff) {
+            return -1;
         }
-        
-        if (tag->type == MULTIBOOT2_HEADER_TAG_INFORMATION_REQUEST) {
-            // Handle information request
-        } else if (tag->type == MULTIBOOT2_HEADER_TAG_ADDRESS) {
-            struct multiboot2_header_tag_address* addr_tag = (struct multiboot2_header_tag_address*)tag;
-            header_addr = addr_tag->header_addr;
-            load_addr = addr_tag->load_addr;
-            load_end_addr = addr_tag->load_end_addr;
-            bss_end_addr = addr_tag->bss_end_addr;
-        } else if (tag->type == MULTIBOOT2_HEADER_TAG_ENTRY_ADDRESS) {
-            struct multiboot2_header_tag_entry_address* entry_tag = (struct multiboot2_header_tag_entry_address*)tag;
-            entry_addr = entry_tag->entry_addr;
+        // Formed only once the offset is known to be inside the image
+        const struct multiboot2_elf64_phdr* ph = (const struct multiboot2_elf64_phdr*)(data + eh->e_phoff);
+        for (uint32_t i = 0; i < eh->e_phnum; i++) {
+            if (ph[i].p_type != 1 || ph[i].p_offset > size || ph[i].p_filesz > size - ph[i].p_offset) {
+                continue;
+            }
+            loadseg_queue(&batch, ph[i].p_paddr, data + ph[i].p_offset, ph[i].p_filesz);
+            if (ph[i].p_memsz > ph[i].p_filesz) {
+                loadseg_queue(&batch, ph[i].p_paddr + ph[i].p_filesz, NULL, ph[i].p_memsz - ph[i].p_filesz);
+            }
         }
-        
-        offset += tag->size;
-        if (tag->size % 8 != 0) {
-            offset += 8 - (tag->size % 8);
+        out->entry = entry ? entry : eh->e_entry;
+        if (eh->e_shnum && eh->e_shoff <= size && (uint64_t)eh->e_shnum * eh->e_shentsize <= size - eh->e_shoff) {
+            out->shdrs = data + eh->e_shoff;
+            out->shnum = eh->e_shnum;
+            out->shentsize = eh->e_shentsize;
+            out->shndx = eh->e_shstrndx;
         }
+    } else if (size >= sizeof(struct multiboot2_elf32_header) && memcmp(data, "\x7f" "ELF", 4) == 0 &&
+               data[4] == 1) {
+        const struct multiboot2_elf32_header* eh = (const struct multiboot2_elf32_header*)data;
+        if (eh->e_phoff + (uint64_t)eh->e_phnum * sizeof(struct multiboot2_elf32_phdr) > size) {
+            return -1;
+        }
+        const struct multiboot2_elf32_phdr* ph = (const struct multiboot2_elf32_phdr*)(data + eh->e_phoff);
+        for (uint32_t i = 0; i < eh->e_phnum; i++) {
+            if (ph[i].p_type != 1 || (uint64_t)ph[i].p_offset + ph[i].p_filesz > size) {
+                continue;
+            }
+            loadseg_queue(&batch, ph[i].p_paddr, data + ph[i].p_offset, ph[i].p_filesz);
+            if (ph[i].p_memsz > ph[i].p_filesz) {
+                loadseg_queue(&batch, (uint64_t)ph[i].p_paddr + ph[i].p_filesz, NULL, ph[i].p_memsz - ph[i].p_filesz);
+            }
+        }
+        out->entry = entry ? entry : eh->e_entry;
+        if (eh->e_shnum && eh->e_shoff + (uint64_t)eh->e_shnum * eh->e_shentsize <= size) {
+            out->shdrs = data + eh->e_shoff;
+            out->shnum = eh->e_shnum;
+            out->shentsize = eh->e_shentsize;
+            out->shndx = eh->e_shstrndx;
+        }
+    } else {
+        return -1; // Neither an address tag nor ELF: nothing says where it goes
     }
-    
-    // Default values if not specified
-    if (load_addr == 0) load_addr = 0x100000; // 1MB
-    if (entry_addr == 0) entry_addr = load_addr;
-    
-    // Load kernel to specified address
-    uint32_t load_size = load_end_addr - load_addr;
-    if (load_size > kernel_size) load_size = kernel_size;
-    
-    memcpy((void*)load_addr, kernel_data, load_size);
-    
-    // Zero out BSS
-    if (bss_end_addr > load_end_addr) {
-        memset((void*)load_end_addr, 0, bss_end_addr - load_end_addr);
+    loadseg_run(&batch);
+    return 0;
+}
+
+// Reserve the next tag: its type and size are filled in when writing, and
+// the caller fills the rest only when the returned pointer is not NULL
+static void* multiboot2_tag(multiboot2_writer_t* w, uint32_t type, uint32_t size) {
+    uint8_t* tag = w->base ? w->base + w->size : NULL;
+    if (tag) {
+        ((struct multiboot2_tag*)tag)->type = type;
+        ((struct multiboot2_tag*)tag)->size = size;
     }
-    
-    // Setup Multiboot 2 info structure
-    struct multiboot2_info* mb_info = (struct multiboot2_info*)0x90000;
-    memset(mb_info, 0, sizeof(struct multiboot2_info));
-    
-    uint32_t info_offset = sizeof(struct multiboot2_info);
-    
-    // Add command line tag
-    if (cmdline && strlen(cmdline) > 0) {
-        struct multiboot2_tag_string* cmdline_tag = (struct multiboot2_tag_string*)((uint8_t*)mb_info + info_offset);
-        cmdline_tag->type = MULTIBOOT2_TAG_TYPE_CMDLINE;
-        cmdline_tag->size = sizeof(struct multiboot2_tag_string) + strlen(cmdline) + 1;
-        strcpy(cmdline_tag->string, cmdline);
-        
-        info_offset += cmdline_tag->size;
-        if (cmdline_tag->size % 8 != 0) {
-            info_offset += 8 - (cmdline_tag->size % 8);
+    w->size += (size + 7) & ~7u;
+    return tag;
+}
+
+static void multiboot2_string_tag(multiboot2_writer_t* w, uint32_t type, const char* string) {
+    uint32_t len = (uint32_t)strlen(string) + 1;
+    struct multiboot2_tag_string* tag = multiboot2_tag(w, type, sizeof(*tag) + len);
+    if (tag) {
+        memcpy(tag->string, string, len);
+    }
+}
+
+static void multiboot2_put_mmap(void* table, uint32_t index, const fwinfo_mmap_entry_t* entry) {
+    struct multiboot2_mmap_entry* e = (struct multiboot2_mmap_entry*)table + index;
+    e->addr = entry->addr;
+    e->len = entry->len;
+    e->type = entry->type;
+    e->zero = 0;
+}
+
+// Conventional memory from 0 and from 1MB, in KiB, while the map is
+// counted; an entry stored again as it grows just overwrites its figure
+static void multiboot2_put_meminfo(void* table, uint32_t index, const fwinfo_mmap_entry_t* e) {
+    multiboot2_sources_t* src = (multiboot2_sources_t*)table;
+    (void)index;
+    if (e->type != FWINFO_MEM_AVAILABLE) {
+        return;
+    }
+    if (e->addr == 0) {
+        src->mem_lower = (uint32_t)((e->len < 0xA0000 ? e->len : 0xA0000) / 1024);
+    } else if (e->addr <= 0x100000 && e->addr + e->len > 0x100000) {
+        uint64_t end = e->addr + e->len < MULTIBOOT2_4GB ? e->addr + e->len : MULTIBOOT2_4GB;
+        src->mem_upper = (uint32_t)((end - 0x100000) / 1024);
+    }
+}
+
+static void multiboot2_emit(multiboot2_writer_t* w, const multiboot2_sources_t* src) {
+    w->size = sizeof(struct multiboot2_info);
+    
+    multiboot2_string_tag(w, MULTIBOOT2_TAG_TYPE_CMDLINE, src->cmdline ? src->cmdline : "");
+    multiboot2_string_tag(w, MULTIBOOT2_TAG_TYPE_BOOT_LOADER_NAME, "BloodHorn");
+    
+    for (uint32_t i = 0; i < g_module_count; i++) {
+        const multiboot2_module_t* m = &g_modules[i];
+        uint32_t len = (uint32_t)strlen(m->cmdline) + 1;
+        struct multiboot2_tag_module* tag = multiboot2_tag(w, MULTIBOOT2_TAG_TYPE_MODULE, sizeof(*tag) + len);
+        if (tag) {
+            tag->mod_start = (uint32_t)m->start;
+            tag->mod_end = (uint32_t)(m->start + m->size);
+            memcpy(tag->cmdline, m->cmdline, len);
         }
     }
     
-    // Add basic memory info tag
-    struct multiboot2_tag_basic_meminfo* meminfo_tag = (struct multiboot2_tag_basic_meminfo*)((uint8_t*)mb_info + info_offset);
-    meminfo_tag->type = MULTIBOOT2_TAG_TYPE_BASIC_MEMINFO;
-    meminfo_tag->size = sizeof(struct multiboot2_tag_basic_meminfo);
-    meminfo_tag->mem_lower = 640; // 640KB
-    meminfo_tag->mem_upper = 0x7FE00; // Extended memory in KB
-    
-    info_offset += meminfo_tag->size;
-    if (meminfo_tag->size % 8 != 0) {
-        info_offset += 8 - (meminfo_tag->size % 8);
+    struct multiboot2_tag_basic_meminfo* meminfo =
+        multiboot2_tag(w, MULTIBOOT2_TAG_TYPE_BASIC_MEMINFO, sizeof(*meminfo));
+    if (meminfo) {
+        meminfo->mem_lower = src->mem_lower;
+        meminfo->mem_upper = src->mem_upper;
     }
     
-    // Add boot device tag
-    struct multiboot2_tag_bootdev* bootdev_tag = (struct multiboot2_tag_bootdev*)((uint8_t*)mb_info + info_offset);
-    bootdev_tag->type = MULTIBOOT2_TAG_TYPE_BOOTDEV;
-    bootdev_tag->size = sizeof(struct multiboot2_tag_bootdev);
-    bootdev_tag->biosdev = 0x80; // First hard disk
-    bootdev_tag->partition = 0;
-    bootdev_tag->subpartition = 0;
-    
-    info_offset += bootdev_tag->size;
-    if (bootdev_tag->size % 8 != 0) {
-        info_offset += 8 - (bootdev_tag->size % 8);
+    // Converted from the snapshot the sizing pass counted, straight into
+    // the tag
+    struct multiboot2_tag_mmap* mmap = multiboot2_tag(w, MULTIBOOT2_TAG_TYPE_MMAP,
+        sizeof(*mmap) + src->mmap_count * sizeof(struct multiboot2_mmap_entry));
+    if (mmap) {
+        mmap->entry_size = sizeof(struct multiboot2_mmap_entry);
+        mmap->entry_version = 0;
+        fwinfo_memory_map_again(mmap->entries, src->mmap_count, multiboot2_put_mmap);
     }
     
-    // Add memory map tag
-    struct multiboot2_tag_mmap* mmap_tag = (struct multiboot2_tag_mmap*)((uint8_t*)mb_info + info_offset);
-    mmap_tag->type = MULTIBOOT2_TAG_TYPE_MMAP;
-    mmap_tag->size = sizeof(struct multiboot2_tag_mmap) + 2 * sizeof(struct multiboot2_mmap_entry);
-    mmap_tag->entry_size = sizeof(struct multiboot2_mmap_entry);
-    mmap_tag->entry_version = 0;
-    
-    mmap_tag->entries[0].addr = 0;
-    mmap_tag->entries[0].len = 0x100000; // 1MB
-    mmap_tag->entries[0].type = MULTIBOOT2_MMAP_TYPE_AVAILABLE;
-    mmap_tag->entries[0].zero = 0;
+    if (src->have_fb) {
+        // Common part plus the six RGB field bytes
+        struct multiboot2_tag_framebuffer* fb = multiboot2_tag(w, MULTIBOOT2_TAG_TYPE_FRAMEBUFFER,
+            offsetof(struct multiboot2_tag_framebuffer, framebuffer_blue_mask_size) + 1);
+        if (fb) {
+            fb->framebuffer_addr = src->fb.addr;
+            fb->framebuffer_pitch = src->fb.pitch;
+            fb->framebuffer_width = src->fb.width;
+            fb->framebuffer_height = src->fb.height;
+            fb->framebuffer_bpp = src->fb.bpp;
+            fb->framebuffer_type = 1; // Direct RGB
+            fb->reserved = 0;
+            fb->framebuffer_red_field_position = src->fb.red_pos;
+            fb->framebuffer_red_mask_size = src->fb.red_size;
+            fb->framebuffer_green_field_position = src->fb.green_pos;
+            fb->framebuffer_green_mask_size = src->fb.green_size;
+            fb->framebuffer_blue_field_position = src->fb.blue_pos;
+            fb->framebuffer_blue_mask_size = src->fb.blue_size;
+        }
+    }
     
-    mmap_tag->entries[1].addr = 0x100000;
-    mmap_tag->entries[1].len = 0x7FF00000; // ~2GB
-    mmap_tag->entries[1].type = MULTIBOOT2_MMAP_TYPE_AVAILABLE;
-    mmap_tag->entries[1].zero = 0;
+    if (src->image->shdrs) {
+        uint32_t len = src->image->shnum * src->image->shentsize;
+        struct multiboot2_tag_elf_sections* elf = multiboot2_tag(w, MULTIBOOT2_TAG_TYPE_ELF_SECTIONS, sizeof(*elf) + len);
+        if (elf) {
+            elf->num = src->image->shnum;
+            elf->entsize = src->image->shentsize;
+            elf->shndx = src->image->shndx;
+            memcpy(elf->sections, src->image->shdrs, len);
+        }
+    }
     
-    info_offset += mmap_tag->size;
-    if (mmap_tag->size % 8 != 0) {
-        info_offset += 8 - (mmap_tag->size % 8);
+    if (src->rsdp) {
+        struct multiboot2_tag_new_acpi* acpi = multiboot2_tag(w,
+            src->rsdp_v2 ? MULTIBOOT2_TAG_TYPE_ACPI_NEW : MULTIBOOT2_TAG_TYPE_ACPI_OLD, sizeof(*acpi) + src->rsdp_size);
+        if (acpi) {
+            memcpy(acpi->rsdp, src->rsdp, src->rsdp_size);
+        }
     }
     
-    // Add end tag
-    struct multiboot2_tag* end_tag = (struct multiboot2_tag*)((uint8_t*)mb_info + info_offset);
-    end_tag->type = MULTIBOOT2_TAG_TYPE_END;
-    end_tag->size = sizeof(struct multiboot2_tag);
+    if (src->smbios) {
+        struct multiboot2_tag_smbios* smbios = multiboot2_tag(w, MULTIBOOT2_TAG_TYPE_SMBIOS,
+                                                              sizeof(*smbios) + src->smbios_size);
+        if (smbios) {
+            smbios->major = src->smbios_major;
+            smbios->minor = src->smbios_minor;
+            memset(smbios->reserved, 0, sizeof(smbios->reserved));
+            memcpy(smbios->tables, src->smbios, src->smbios_size);
+        }
+    }
     
-    info_offset += end_tag->size;
+    multiboot2_tag(w, MULTIBOOT2_TAG_TYPE_END, sizeof(struct multiboot2_tag));
+    if (w->base) {
+        ((struct multiboot2_info*)w->base)->total_size = w->size;
+        ((struct multiboot2_info*)w->base)->reserved = 0;
+    }
+}
+
+// Load the image and its modules, then build the boot information in one
+// page-aligned block: one pass sizes every tag, the next writes them in
+// place, with no tag moved or patched afterwards
+static int multiboot2_boot(const uint8_t* kernel_data, uint32_t kernel_size, const magicscan_t* scan,
+                           const char* cmdline) {
+    static multiboot2_sources_t src;
+    multiboot2_image_t image;
+    
+    if (multiboot2_load_image(kernel_data, kernel_size, scan, &image) != 0 || multiboot2_load_modules() != 0) {
+        return -1;
+    }
     
-    // Set total size
-    mb_info->total_size = info_offset;
-    mb_info->reserved = 0;
+    // The map is read after every load; loader memory merges into the
+    // available ranges, so placing the info block leaves it unchanged
+    memset(&src, 0, sizeof(src));
+    src.cmdline = cmdline;
+    src.image = &image;
+    src.mmap_count = fwinfo_memory_map_to(&src, UINT32_MAX, multiboot2_put_meminfo);
+    src.have_fb = fwinfo_framebuffer(&src.fb) == 0;
+    src.rsdp = fwinfo_acpi_rsdp(&src.rsdp_size, &src.rsdp_v2);
+    src.smbios = fwinfo_smbios(&src.smbios_size, &src.smbios_major, &src.smbios_minor);
+    
+    multiboot2_writer_t w = { NULL, 0 };
+    multiboot2_emit(&w, &src);
+    uint64_t info_addr;
+    if (loadseg_place(w.size, 4096, 0x100000, MULTIBOOT2_4GB, LOADSEG_PLACE_TOP_DOWN, &info_addr) != 0) {
+        return -1;
+    }
+    w.base = (uint8_t*)(uintptr_t)info_addr;
+    multiboot2_emit(&w, &src);
     
     // Jump to kernel
-    void (*kernel_entry)(uint32_t, struct multiboot2_info*) = (void*)entry_addr;
-    kernel_entry(MULTIBOOT2_BOOTLOADER_MAGIC, mb_info);
+    void (*kernel_entry)(uint32_t, uint32_t) = (void*)(uintptr_t)image.entry;
+    kernel_entry(MULTIBOOT2_BOOTLOADER_MAGIC, (uint32_t)info_addr);
     
     return 0;
 }
 
-int multiboot2_verify_kernel(const char* kernel_path) {
+int multiboot2_load_kernel(const char* kernel_path, const char* cmdline) {
     uint8_t* kernel_data = NULL;
     uint32_t kernel_size = 0;
     
-    if (load_file(kernel_path, &kernel_data, &kernel_size) != 0) {
-        return -1;
-    }
-    
-    uint32_t* header = (uint32_t*)kernel_data;
-    
-    // Check Multiboot 2 magic
-    if (header[0] != MULTIBOOT2_HEADER_MAGIC) {
+    // Load kernel file (decompressed if it is gzip, lz4 or zstd)
+    if (load_image_file(kernel_path, &kernel_data, &kernel_size) != 0) {
         return -1;
     }
+    return multiboot2_boot(kernel_data, kernel_size, NULL, cmdline);
+}
+
+int multiboot2_verify_kernel(const char* kernel_path) {
+    uint8_t* kernel_data = NULL;
+    uint32_t kernel_size = 0;
     
-    // Check architecture
-    if (header[1] != MULTIBOOT2_ARCHITECTURE_I386) {
+    if (load_image_file(kernel_path, &kernel_data, &kernel_size) != 0) {
         return -1;
     }
     
-    // Check header length
-    if (header[2] < 8 || header[2] > kernel_size) {
+    // Magic, length and checksum are checked by the search
+    int32_t offset = multiboot2_find_header(kernel_data, kernel_size, NULL);
+    if (offset < 0) {
         return -1;
     }
     
-    // Check header checksum
-    uint32_t checksum = 0;
-    for (uint32_t i = 0; i < header[2] / 4; i++) {
-        checksum += header[i];
-    }
-    if (checksum != 0) {
+    // Check architecture
+    const uint32_t* header = (const uint32_t*)(kernel_data + offset);
+    if (header[1] != MULTIBOOT2_ARCHITECTURE_I386) {
         return -1;
     }
     
     return 0;
 } 
 
-int boot_multiboot2_kernel(uint8_t* kernel_data, uint32_t kernel_size, const char* cmdline) {
-    struct multiboot2_info* info = (struct multiboot2_info*)0x1000;
-    uint8_t* tag_ptr = (uint8_t*)info + 8;
-    
-    info->total_size = 8;
-    info->reserved = 0;
-    
-    struct multiboot2_tag_basic_meminfo* meminfo = (struct multiboot2_tag_basic_meminfo*)tag_ptr;
-    meminfo->type = 4;
-    meminfo->size = 16;
-    meminfo->mem_lower = 640;
-    meminfo->mem_upper = 0x7FE00;
-    tag_ptr += meminfo->size;
-    info->total_size += meminfo->size;
-    
-    if (cmdline && strlen(cmdline) > 0) {
-        struct multiboot2_tag_string* cmdline_tag = (struct multiboot2_tag_string*)tag_ptr;
-        cmdline_tag->type = 1;
-        strcpy(cmdline_tag->string, cmdline);
-        cmdline_tag->size = 8 + strlen(cmdline) + 1;
-        tag_ptr += cmdline_tag->size;
-        info->total_size += cmdline_tag->size;
-    }
-    
-    struct multiboot2_tag* end_tag = (struct multiboot2_tag*)tag_ptr;
-    end_tag->type = 0;
-    end_tag->size = 8;
-    info->total_size += 8;
-    
-    uint32_t kernel_entry = 0x100000;
-    memcpy((void*)kernel_entry, kernel_data, kernel_size);
-    
-    void (*entry_point)(uint32_t, uint32_t) = (void*)kernel_entry;
-    entry_point(0x36d76289, (uint32_t)info);
-    
-    return 0;
-} 
\ No newline at end of file
+int boot_multiboot2_kernel(uint8_t* kernel_data, uint32_t kernel_size, const magicscan_t* scan,
+                           const char* cmdline) {
+    return multiboot2_boot(kernel_data, kernel_size, scan, cmdline);
+}
@@ -9,6 +9,7 @@
 #define BLOODHORN_MULTIBOOT2_H
 #include <stdint.h>
 #include "compat.h"
+#include "magicscan.h"
 
 #define MULTIBOOT2_HEADER_MAGIC 0xE85250D6
 #define MULTIBOOT2_BOOTLOADER_MAGIC 0x36D76289
@@ -77,6 +78,14 @@ struct multiboot2_tag_string {
     char string[];
 };
 
+struct multiboot2_tag_module {
+    uint32_t type;
+    uint32_t size;
+    uint32_t mod_start;
+    uint32_t mod_end;
+    char cmdline[];
+};
+
 struct multiboot2_tag_basic_meminfo {
     uint32_t type;
     uint32_t size;
@@ -92,14 +101,6 @@ struct multiboot2_tag_bootdev {
     uint32_t subpartition;
 };
 
-struct multiboot2_tag_mmap {
-    uint32_t type;
-    uint32_t size;
-    uint32_t entry_size;
-    uint32_t entry_version;
-    struct multiboot2_mmap_entry entries[];
-};
-
 struct multiboot2_mmap_entry {
     uint64_t addr;
     uint64_t len;
@@ -107,15 +108,12 @@ struct multiboot2_mmap_entry {
     uint32_t zero;
 };
 
-struct multiboot2_tag_vbe {
+struct multiboot2_tag_mmap {
     uint32_t type;
     uint32_t size;
-    uint16_t vbe_mode;
-    uint16_t vbe_interface_seg;
-    uint16_t vbe_interface_off;
-    uint16_t vbe_interface_len;
-    struct multiboot2_vbe_info_block vbe_control_info;
-    struct multiboot2_vbe_mode_info_block vbe_mode_info;
+    uint32_t entry_size;
+    uint32_t entry_version;
+    struct multiboot2_mmap_entry entries[];
 };
 
 struct multiboot2_vbe_info_block {
@@ -169,6 +167,23 @@ struct multiboot2_vbe_mode_info_block {
     uint8_t reserved2[206];
 };
 
+struct multiboot2_tag_vbe {
+    uint32_t type;
+    uint32_t size;
+    uint16_t vbe_mode;
+    uint16_t vbe_interface_seg;
+    uint16_t vbe_interface_off;
+    uint16_t vbe_interface_len;
+    struct multiboot2_vbe_info_block vbe_control_info;
+    struct multiboot2_vbe_mode_info_block vbe_mode_info;
+};
+
+struct multiboot2_color_info {
+    uint8_t red_value;
+    uint8_t green_value;
+    uint8_t blue_value;
+};
+
 struct multiboot2_tag_framebuffer {
     uint32_t type;
     uint32_t size;
@@ -178,7 +193,7 @@ struct multiboot2_tag_framebuffer {
     uint32_t framebuffer_height;
     uint8_t framebuffer_bpp;
     uint8_t framebuffer_type;
-    uint8_t reserved;
+    uint16_t reserved;
     union {
         struct {
             uint32_t framebuffer_palette_num_colors;
@@ -195,12 +210,6 @@ struct multiboot2_tag_framebuffer {
     };
 };
 
-struct multiboot2_color_info {
-    uint8_t red_value;
-    uint8_t green_value;
-    uint8_t blue_value;
-};
-
 struct multiboot2_tag_elf_sections {
     uint32_t type;
     uint32_t size;
@@ -338,8 +347,21 @@ struct multiboot2_header_tag_relocatable {
     uint32_t preference;
 };
 
+// Modules for the next multiboot2_load_kernel, in order. Paths and
+// command lines are copied; each module is given a page-aligned slot
+// below 4GB and a module tag.
+#define MULTIBOOT2_MAX_MODULES  64
+#define MULTIBOOT2_PATH_MAX     128
+#define MULTIBOOT2_CMDLINE_MAX  128
+
+int multiboot2_add_module(const char* module_path, const char* cmdline);
+void multiboot2_clear_modules(void);
+
 int multiboot2_load_kernel(const char* kernel_path, const char* cmdline);
 int multiboot2_verify_kernel(const char* kernel_path);
-int boot_multiboot2_kernel(uint8_t* kernel_data, uint32_t kernel_size, const char* cmdline);
+// Boot an image already in memory. `scan` is the magicscan_image result
+// of the caller's protocol detection, or NULL to scan here.
+int boot_multiboot2_kernel(uint8_t* kernel_data, uint32_t kernel_size, const magicscan_t* scan,
+                           const char* cmdline);
 
 #endif // BLOODHORN_MULTIBOOT2_H 
\ No newline at end of file
@@ -0,0 +1,163 @@
+/*
+ * pagetable.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <stdint.h>
+#include "compat.h"
+#include <string.h>
+#include "pagetable.h"
+#include "loadseg.h"
+
+#define PT_PRESENT  (1ULL << 0)
+#define PT_HUGE     (1ULL << 7)     // PS: a 2 MiB PD or 1 GiB PDPT entry
+#define PT_ADDR     0x000FFFFFFFFFF000ULL
+#define PT_ATTR     (PAGETABLE_WRITE | PAGETABLE_NX)
+
+#define SIZE_4K     0x1000ULL
+#define SIZE_2M     0x200000ULL
+#define SIZE_1G     0x40000000ULL
+#define SIZE_512G   0x8000000000ULL
+
+static uint64_t round_up(uint64_t v, uint64_t a) {
+    return (v + a - 1) & ~(a - 1);
+}
+
+static void probe_cpu(pagetable_t* pt) {
+    pt->has_1g = 0;
+    pt->has_nx = 0;
+#if defined(__x86_64__) && defined(__GNUC__)
+    uint32_t eax, ebx, ecx, edx;
+    __asm__ volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0x80000000));
+    if (eax >= 0x80000001) {
+        __asm__ volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0x80000001));
+        pt->has_1g = (edx >> 26) & 1;
+        pt->has_nx = (edx >> 20) & 1;
+    }
+#endif
+}
+
+// Table pages for one map of `size` bytes: the levels above the leaves,
+// plus a page table at each unaligned end
+static uint64_t tables_for(const pagetable_t* pt, uint64_t size, int small_pages) {
+    uint64_t pages = round_up(size, SIZE_512G) / SIZE_512G;
+    if (!pt->has_1g || small_pages) {
+        pages += round_up(size, SIZE_1G) / SIZE_1G + 1;
+    }
+    return pages + (small_pages ? round_up(size, SIZE_2M) / SIZE_2M : 0) + 2;
+}
+
+int pagetable_init(pagetable_t* pt, uint64_t phys_top, uint64_t extra) {
+    memset(pt, 0, sizeof(*pt));
+    probe_cpu(pt);
+
+    // PML4, then identity and HHDM of all of memory, then the extra
+    // (kernel) mappings with a few pages of slack for segment edges
+    uint64_t pages = 1 + 2 * tables_for(pt, phys_top, 0);
+    if (extra) {
+        pages += tables_for(pt, extra, 1) + 8;
+    }
+    if (pages > 0xFFFFFFFF ||
+        loadseg_place(pages * SIZE_4K, SIZE_4K, 0x100000, 0x100000000ULL, LOADSEG_PLACE_TOP_DOWN, &pt->pool) != 0) {
+        return -1;
+    }
+    pt->pool_pages = (uint32_t)pages;
+    pt->used = 1;
+    pt->pml4 = pt->pool;
+    memset((void*)(uintptr_t)pt->pml4, 0, SIZE_4K);
+    return 0;
+}
+
+static uint64_t* next_table(pagetable_t* pt, uint64_t* entry) {
+    if (*entry & PT_PRESENT) {
+        if (*entry & PT_HUGE) {
+            return NULL;
+        }
+        // Upper levels stay permissive; the leaf decides
+        *entry = (*entry & ~PAGETABLE_NX) | PAGETABLE_WRITE;
+        return (uint64_t*)(uintptr_t)(*entry & PT_ADDR);
+    }
+    if (pt->used >= pt->pool_pages) {
+        return NULL;
+    }
+    uint64_t page = pt->pool + (uint64_t)pt->used++ * SIZE_4K;
+    memset((void*)(uintptr_t)page, 0, SIZE_4K);
+    *entry = page | PT_PRESENT | PAGETABLE_WRITE;
+    return (uint64_t*)(uintptr_t)page;
+}
+
+static void set_leaf(uint64_t* entry, uint64_t value) {
+    if ((*entry & PT_PRESENT) && (*entry & PT_ADDR) == (value & PT_ADDR)) {
+        // Page shared by two segments: writable if either is, executable
+        // if either is
+        value |= *entry & PAGETABLE_WRITE;
+        value &= *entry | ~PAGETABLE_NX;
+    }
+    *entry = value;
+}
+
+int pagetable_map(pagetable_t* pt, uint64_t virt, uint64_t phys, uint64_t size, uint64_t flags) {
+    uint64_t end = round_up(virt + size, SIZE_4K);
+    phys -= virt & (SIZE_4K - 1);
+    virt &= ~(SIZE_4K - 1);
+    flags &= PT_ATTR;
+    if (!pt->has_nx) {
+        flags &= ~PAGETABLE_NX;
+    }
+
+    while (virt < end) {
+        uint64_t left = end - virt;
+        uint64_t* pdpt = next_table(pt, &((uint64_t*)(uintptr_t)pt->pml4)[(virt >> 39) & 511]);
+        if (!pdpt) {
+            return -1;
+        }
+        uint64_t* e = &pdpt[(virt >> 30) & 511];
+        if (pt->has_1g && left >= SIZE_1G && !((virt | phys) & (SIZE_1G - 1)) && !(*e & PT_PRESENT)) {
+            *e = phys | PT_PRESENT | PT_HUGE | flags;
+            virt += SIZE_1G;
+            phys += SIZE_1G;
+            continue;
+        }
+        uint64_t* pd = next_table(pt, e);
+        if (!pd) {
+            return -1;
+        }
+        e = &pd[(virt >> 21) & 511];
+        if (left >= SIZE_2M && !((virt | phys) & (SIZE_2M - 1)) && !(*e & PT_PRESENT)) {
+            *e = phys | PT_PRESENT | PT_HUGE | flags;
+            virt += SIZE_2M;
+            phys += SIZE_2M;
+            continue;
+        }
+        uint64_t* ptab = next_table(pt, e);
+        if (!ptab) {
+            return -1;
+        }
+        set_leaf(&ptab[(virt >> 12) & 511], phys | PT_PRESENT | flags);
+        virt += SIZE_4K;
+        phys += SIZE_4K;
+    }
+    return 0;
+}
+
+int pagetable_activate(const pagetable_t* pt) {
+#if defined(__x86_64__) && defined(__GNUC__)
+    uint64_t cr0;
+    if (pt->has_nx) {
+        uint32_t lo, hi;
+        __asm__ volatile ("rdmsr" : "=a"(lo), "=d"(hi) : "c"(0xC0000080));
+        lo |= 1u << 11;
+        __asm__ volatile ("wrmsr" : : "a"(lo), "d"(hi), "c"(0xC0000080));
+    }
+    __asm__ volatile ("mov %%cr0, %0" : "=r"(cr0));
+    cr0 |= 1ULL << 16;
+    __asm__ volatile ("mov %0, %%cr0" : : "r"(cr0) : "memory");
+    __asm__ volatile ("mov %0, %%cr3" : : "r"(pt->pml4) : "memory");
+    return 0;
+#else
+    (void)pt;
+    return -1;
+#endif
+}
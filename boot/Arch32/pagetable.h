@@ -0,0 +1,43 @@
+/*
+ * pagetable.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_PAGETABLE_H
+#define BLOODHORN_PAGETABLE_H
+
+#include <stdint.h>
+#include "compat.h"
+
+// 4-level x86_64 page tables for a long-mode handoff. Physical memory is
+// mapped with the largest pages the alignment allows: 1 GiB where CPUID
+// reports them, else 2 MiB, with 4 KiB pages only at unaligned edges.
+// Every table page comes from one contiguous pool placed below 4 GiB.
+#define PAGETABLE_WRITE     (1ULL << 1)     // Writable; read-only is enforced with CR0.WP
+#define PAGETABLE_NX        (1ULL << 63)    // No execute; dropped when the CPU lacks NX
+
+typedef struct {
+    uint64_t pool;          // Physical base of the table pages
+    uint32_t pool_pages;
+    uint32_t used;
+    uint64_t pml4;
+    int has_1g;             // CPUID.80000001h:EDX[26]
+    int has_nx;             // CPUID.80000001h:EDX[20]
+} pagetable_t;
+
+// Probe the CPU and place a pool sized for an identity map plus HHDM of
+// [0, phys_top) and `extra` bytes mapped with 4 KiB pages. Returns 0 or -1.
+int pagetable_init(pagetable_t* pt, uint64_t phys_top, uint64_t extra);
+
+// Map [virt, virt + size) to phys. Both are rounded out to 4 KiB; pages
+// shared with an earlier mapping keep the more permissive attributes.
+// Returns -1 when the pool runs out or a huge page is in the way.
+int pagetable_map(pagetable_t* pt, uint64_t virt, uint64_t phys, uint64_t size, uint64_t flags);
+
+// Load CR3 with the tables, turning on EFER.NXE and CR0.WP first; the
+// caller must have identity-mapped the code and stack it runs on
+int pagetable_activate(const pagetable_t* pt);
+
+#endif
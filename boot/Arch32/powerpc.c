@@ -10,9 +10,11 @@
 #include <stdbool.h>
 #include <string.h>
 #include "powerpc.h"
+#include "../libb/include/bloodhorn/memory.h"
 #include "../boot.h"
 #include "../platform/platform.h"
 #include "../platform/devicetree.h"
+#include "../platform/openfirmware.h"
 
 // CPU information structure
 static struct ppc_cpu_info cpu_info;
@@ -256,6 +258,7 @@ static void ppc_detect_cpu(void) {
     asm volatile("mfspr %0, 1019" : "=r"(l1cfbr));
     
     cpu_info.l1_cache_line_size = 1 << ((l1cfbr >> 16) & 0x1F);
+    bh_memory_set_cache_line(cpu_info.l1_cache_line_size);
     cpu_info.icache_size = (l1cfar & 0x7FF) * cpu_info.l1_cache_line_size;
     cpu_info.dcache_size = ((l1cfbr >> 24) & 0x7FF) * cpu_info.l1_cache_line_size;
     
@@ -658,3 +661,142 @@ void ppc_reset(void) {
     // Fallback to platform-specific reset
     for(;;) asm volatile("wait");
 }
+
+// Write back freshly loaded code and drop stale instructions for it
+void ppc_sync_icache(void *addr, size_t size) {
+    uintptr_t line = cpu_info.l1_cache_line_size ? cpu_info.l1_cache_line_size : 32;
+    uintptr_t start = (uintptr_t)addr & ~(line - 1);
+    uintptr_t end = (uintptr_t)addr + size;
+
+    for (uintptr_t p = start; p < end; p += line)
+        dcbst((void *)p);
+    ppc_sync();
+    for (uintptr_t p = start; p < end; p += line)
+        icbi((void *)p);
+    ppc_sync();
+    ppc_isync();
+}
+
+// Kernel loading through Open Firmware
+#define PPC_ELF_CLASS64     2
+#define PPC_EM_PPC64        21
+#define PPC_PT_LOAD         1
+#define PPC_MAX_PHDRS       16
+#define PPC_PAGE_SIZE       4096ULL
+
+struct ppc_elf64_ehdr {
+    uint8_t  e_ident[16];
+    uint16_t e_type;
+    uint16_t e_machine;
+    uint32_t e_version;
+    uint64_t e_entry;
+    uint64_t e_phoff;
+    uint64_t e_shoff;
+    uint32_t e_flags;
+    uint16_t e_ehsize;
+    uint16_t e_phentsize;
+    uint16_t e_phnum;
+    uint16_t e_shentsize;
+    uint16_t e_shnum;
+    uint16_t e_shstrndx;
+};
+
+struct ppc_elf64_phdr {
+    uint32_t p_type;
+    uint32_t p_flags;
+    uint64_t p_offset;
+    uint64_t p_vaddr;
+    uint64_t p_paddr;
+    uint64_t p_filesz;
+    uint64_t p_memsz;
+    uint64_t p_align;
+};
+
+// Read `size` bytes at `offset`, seeking only when the device is not
+// already there; `position` follows the device across calls
+static bh_status_t ppc_ofw_read_at(uint32_t ihandle, uint64_t *position, uint64_t offset,
+                                   void *dest, size_t size) {
+    size_t got = 0;
+
+    if (*position != offset) {
+        if (ofw_seek(ihandle, offset) != BH_STATUS_SUCCESS)
+            return BH_STATUS_IO_ERROR;
+        *position = offset;
+    }
+    if (ofw_read(ihandle, dest, size, &got) != BH_STATUS_SUCCESS)
+        return BH_STATUS_IO_ERROR;
+    *position += got;
+    return got == size ? BH_STATUS_SUCCESS : BH_STATUS_INVALID_DATA;
+}
+
+/*
+ * Load an ELF64 kernel from an Open Firmware path ("disk:2,\\vmlinux").
+ * The span of its PT_LOAD segments is claimed from firmware in one go at
+ * its physical address, then each segment's file bytes are read straight
+ * into place with ofw_read's large transfers; a seek is only issued for
+ * a segment that does not follow the previous one in the file. Returns 0
+ * and the entry point, or -1 with nothing left claimed.
+ */
+int ppc_load_elf_ofw(const char *path, uint64_t *entry) {
+    struct ppc_elf64_ehdr ehdr;
+    struct ppc_elf64_phdr phdr[PPC_MAX_PHDRS];
+    uint64_t position = 0;
+    uint64_t lo = UINT64_MAX, hi = 0;
+    uint32_t ihandle;
+    int result = -1;
+
+    if (!path || !entry || ofw_open(path, &ihandle) != BH_STATUS_SUCCESS)
+        return -1;
+
+    if (ppc_ofw_read_at(ihandle, &position, 0, &ehdr, sizeof(ehdr)) != BH_STATUS_SUCCESS ||
+        memcmp(ehdr.e_ident, "\x7f" "ELF", 4) != 0 || ehdr.e_ident[4] != PPC_ELF_CLASS64 ||
+        ehdr.e_machine != PPC_EM_PPC64 || ehdr.e_phentsize != sizeof(phdr[0]) ||
+        ehdr.e_phnum == 0 || ehdr.e_phnum > PPC_MAX_PHDRS ||
+        ppc_ofw_read_at(ihandle, &position, ehdr.e_phoff, phdr,
+                        ehdr.e_phnum * sizeof(phdr[0])) != BH_STATUS_SUCCESS)
+        goto out;
+
+    for (uint16_t i = 0; i < ehdr.e_phnum; i++) {
+        if (phdr[i].p_type != PPC_PT_LOAD || phdr[i].p_memsz == 0)
+            continue;
+        if (phdr[i].p_filesz > phdr[i].p_memsz || phdr[i].p_paddr + phdr[i].p_memsz < phdr[i].p_paddr)
+            goto out;
+        if (phdr[i].p_paddr < lo)
+            lo = phdr[i].p_paddr;
+        if (phdr[i].p_paddr + phdr[i].p_memsz > hi)
+            hi = phdr[i].p_paddr + phdr[i].p_memsz;
+    }
+    if (hi == 0)
+        goto out;
+    lo &= ~(PPC_PAGE_SIZE - 1);
+    hi = (hi + PPC_PAGE_SIZE - 1) & ~(PPC_PAGE_SIZE - 1);
+
+    // The whole image is claimed before any of it is read, so a range
+    // firmware is using fails the load before the disk is touched
+    if (ofw_claim_memory(lo, hi - lo, 0) != BH_STATUS_SUCCESS)
+        goto out;
+
+    result = 0;
+    for (uint16_t i = 0; i < ehdr.e_phnum && result == 0; i++) {
+        uint8_t *dest = (uint8_t *)(uintptr_t)phdr[i].p_paddr;
+
+        if (phdr[i].p_type != PPC_PT_LOAD || phdr[i].p_memsz == 0)
+            continue;
+        if (phdr[i].p_filesz &&
+            ppc_ofw_read_at(ihandle, &position, phdr[i].p_offset, dest,
+                            (size_t)phdr[i].p_filesz) != BH_STATUS_SUCCESS) {
+            result = -1;
+            break;
+        }
+        memset(dest + phdr[i].p_filesz, 0, (size_t)(phdr[i].p_memsz - phdr[i].p_filesz));
+        ppc_sync_icache(dest, (size_t)phdr[i].p_memsz);
+    }
+    if (result == 0)
+        *entry = ehdr.e_entry;
+    else
+        ofw_release_memory(lo, hi - lo);
+
+out:
+    ofw_close(ihandle);
+    return result;
+}
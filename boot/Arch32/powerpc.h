@@ -452,6 +452,7 @@ struct device_tree_node;
 
 int ppc_boot_linux(void *kernel, size_t size, const char *cmdline);
 int ppc_boot_elf(void *elf);
+int ppc_load_elf_ofw(const char *path, uint64_t *entry);
 int ppc_load_device_tree(struct device_tree_node **dt);
 void ppc_set_bootargs(const char *cmdline);
 
@@ -8,50 +8,123 @@
 #include <stdint.h>
 #include "compat.h"
 #include <string.h>
+#include "../libb/include/bloodhorn/memory.h"
 #include "riscv64.h"
+#include "../platform/fdt.h"
 
 extern void* allocate_memory(uint32_t size);
 extern int load_file(const char* path, uint8_t** data, uint32_t* size);
+// The DTB firmware handed over (U-Boot, OpenSBI, the EFI config table); NULL if none
+extern const void* get_firmware_fdt(void);
 
-struct riscv64_boot_params {
-    uint64_t dtb_addr;
-    uint64_t initrd_addr;
-    uint64_t initrd_size;
-    uint64_t cmdline_addr;
-    uint64_t cmdline_size;
-    uint64_t kernel_addr;
-    uint64_t kernel_size;
+#define RISCV64_IMAGE_ALIGN     0x200000ULL     // Image must start 2 MiB aligned
+#define RISCV64_PAGE_SIZE       0x1000ULL
+
+// Where each piece of the handoff goes
+struct riscv64_layout {
     uint64_t mem_start;
     uint64_t mem_size;
     uint64_t hartid;
-    uint64_t fdt_addr;
+    uint64_t hart_count;
+    uint64_t kernel_addr;
+    uint64_t initrd_addr;
+    uint64_t cmdline_addr;
+    uint64_t params_addr;
+    uint64_t dtb_addr;
+    uint64_t dtb_size;          // 0 when there is no tree to hand on
 };
 
-struct riscv64_linux_header {
-    uint32_t code0;
-    uint32_t code1;
-    uint64_t text_offset;
-    uint64_t image_size;
-    uint64_t flags;
-    uint32_t version;
-    uint32_t res1;
-    uint64_t res2;
-    uint64_t res3;
-    uint64_t res4;
-    uint32_t magic;
-    uint32_t hdr_offset;
-    uint32_t hdr_size;
-    uint32_t end_offset;
-    uint32_t end_size;
-    uint64_t hdr_version;
-    uint64_t comp_version;
-    uint64_t name_offset;
-    uint64_t name_size;
-    uint64_t id_offset;
-    uint64_t id_size;
-    uint64_t hdr_string_offset;
-    uint64_t hdr_string_size;
-};
+/*
+ * Lay the handoff out from one in-place scan of the firmware's tree: RAM,
+ * the hart count and boot hart, and every reserved range (OpenSBI's own
+ * among them) come from it, so nothing traps into SBI on the way to the
+ * kernel. The blob is handed on as it is, with /chosen patched in place
+ * when it has the room and relaid once after the kernel when it has not.
+ * Without a tree that describes RAM, the fixed QEMU virt layout is used.
+ */
+static int riscv64_plan_handoff(struct riscv64_layout* l, uint64_t image_size, const uint8_t* initrd_data,
+                                uint64_t initrd_size, const char* cmdline, uint64_t cmdline_size) {
+    const void* fdt = get_firmware_fdt();
+    struct fdt_boot_info info;
+
+    memset(l, 0, sizeof(*l));
+    if (!fdt || fdt_scan_boot_info(fdt, &info) != BH_STATUS_SUCCESS || info.memory_count == 0) {
+        l->mem_start = 0x80000000;
+        l->mem_size = 0x80000000;
+        l->hart_count = 1;
+        l->kernel_addr = 0x80200000;
+        l->dtb_addr = 0x82000000;
+        l->initrd_addr = initrd_size ? l->dtb_addr + 0x100000 : 0;
+        l->cmdline_addr = cmdline_size ? l->dtb_addr + 0x100000 + initrd_size + 0x1000 : 0;
+        l->params_addr = 0x80000000;
+        return 0;
+    }
+
+    l->mem_start = info.memory[0].base;
+    l->mem_size = info.memory[0].size;
+    l->hartid = info.boot_cpu;
+    l->hart_count = info.cpu_count ? info.cpu_count : 1;
+
+    // What is still being read from must not be written over
+    int need = fdt_chosen_size(cmdline_size ? cmdline : NULL, initrd_size != 0);
+    if (!fdt_boot_info_reserve(&info, (uint64_t)(uintptr_t)fdt, fdt_totalsize(fdt) + (uint64_t)need) ||
+        !fdt_boot_info_reserve(&info, (uint64_t)(uintptr_t)initrd_data, initrd_size) ||
+        !fdt_boot_info_reserve(&info, (uint64_t)(uintptr_t)cmdline, cmdline_size)) {
+        return -1;
+    }
+
+    l->kernel_addr = fdt_boot_info_place(&info, l->mem_start, image_size, RISCV64_IMAGE_ALIGN);
+    uint64_t next = l->kernel_addr + image_size;
+    if (initrd_size) {
+        l->initrd_addr = fdt_boot_info_place(&info, next, initrd_size, RISCV64_PAGE_SIZE);
+        next = l->initrd_addr + initrd_size;
+    }
+    l->params_addr = fdt_boot_info_place(&info, next, sizeof(struct riscv64_boot_params), RISCV64_PAGE_SIZE);
+    next = l->params_addr + sizeof(struct riscv64_boot_params);
+    if (cmdline_size) {
+        l->cmdline_addr = fdt_boot_info_place(&info, next, cmdline_size, 8);
+        next = l->cmdline_addr + cmdline_size;
+    }
+    if (!l->kernel_addr || (initrd_size && !l->initrd_addr) || !l->params_addr ||
+        (cmdline_size && !l->cmdline_addr)) {
+        return -1;
+    }
+
+    uint64_t initrd_end = l->initrd_addr + initrd_size;
+    if (fdt_free_space(fdt) >= need &&
+        fdt_set_chosen((void*)fdt, cmdline_size ? cmdline : NULL, l->initrd_addr, initrd_end) == 0) {
+        l->dtb_addr = (uint64_t)(uintptr_t)fdt;
+        l->dtb_size = fdt_totalsize(fdt);
+        return 0;
+    }
+    uint64_t dtb_size = fdt_totalsize(fdt) + (uint64_t)need;
+    l->dtb_addr = fdt_boot_info_place(&info, next, dtb_size, 8);
+    if (!l->dtb_addr || fdt_open_into(fdt, (void*)(uintptr_t)l->dtb_addr, (int)dtb_size) != 0 ||
+        fdt_set_chosen((void*)(uintptr_t)l->dtb_addr, cmdline_size ? cmdline : NULL, l->initrd_addr, initrd_end) != 0) {
+        return -1;
+    }
+    l->dtb_size = dtb_size;
+    return 0;
+}
+
+static void riscv64_fill_params(const struct riscv64_layout* l, uint64_t initrd_size, uint64_t cmdline_size,
+                                uint64_t kernel_size) {
+    struct riscv64_boot_params* params = (struct riscv64_boot_params*)(uintptr_t)l->params_addr;
+    memset(params, 0, sizeof(struct riscv64_boot_params));
+
+    params->dtb_addr = l->dtb_addr;
+    params->initrd_addr = l->initrd_addr;
+    params->initrd_size = initrd_size;
+    params->cmdline_addr = l->cmdline_addr;
+    params->cmdline_size = cmdline_size;
+    params->kernel_addr = l->kernel_addr;
+    params->kernel_size = kernel_size;
+    params->mem_start = l->mem_start;
+    params->mem_size = l->mem_size;
+    params->hartid = l->hartid;
+    params->fdt_addr = l->dtb_addr;
+    params->hart_count = l->hart_count;
+}
 
 int riscv64_load_kernel(const char* kernel_path, const char* initrd_path, const char* cmdline) {
     uint8_t* kernel_data = NULL;
@@ -72,83 +145,69 @@ int riscv64_load_kernel(const char* kernel_path, const char* initrd_path, const
 
 int riscv64_boot_linux(uint8_t* kernel_data, uint64_t kernel_size, const char* initrd_path, const char* cmdline) {
     struct riscv64_linux_header* header = (struct riscv64_linux_header*)kernel_data;
-    
-    uint64_t kernel_load_addr = 0x80200000;
-    uint64_t dtb_addr = 0x82000000;
-    uint64_t initrd_addr = 0;
+    struct riscv64_layout layout;
+    uint8_t* initrd_data = NULL;
     uint64_t initrd_size = 0;
     
     if (initrd_path && strlen(initrd_path) > 0) {
-        uint8_t* initrd_data = NULL;
         uint32_t initrd_size32 = 0;
         if (load_file(initrd_path, &initrd_data, &initrd_size32) == 0) {
             initrd_size = initrd_size32;
-            initrd_addr = dtb_addr + 0x100000;
-            memcpy((void*)initrd_addr, initrd_data, initrd_size);
         }
     }
     
-    uint64_t cmdline_addr = 0;
-    uint64_t cmdline_size = 0;
-    if (cmdline && strlen(cmdline) > 0) {
-        cmdline_addr = initrd_addr + initrd_size + 0x1000;
-        cmdline_size = strlen(cmdline) + 1;
-        strcpy((char*)cmdline_addr, cmdline);
+    uint64_t cmdline_size = cmdline && strlen(cmdline) > 0 ? strlen(cmdline) + 1 : 0;
+    uint64_t image_size = header->image_size > kernel_size ? header->image_size : kernel_size;
+    if (riscv64_plan_handoff(&layout, image_size, initrd_data, initrd_size, cmdline, cmdline_size) != 0) {
+        return -1;
     }
     
-    memcpy((void*)kernel_load_addr, kernel_data, kernel_size);
-    
-    struct riscv64_boot_params* params = (struct riscv64_boot_params*)0x80000000;
-    memset(params, 0, sizeof(struct riscv64_boot_params));
-    
-    params->dtb_addr = dtb_addr;
-    params->initrd_addr = initrd_addr;
-    params->initrd_size = initrd_size;
-    params->cmdline_addr = cmdline_addr;
-    params->cmdline_size = cmdline_size;
-    params->kernel_addr = kernel_load_addr;
-    params->kernel_size = kernel_size;
-    params->mem_start = 0x80000000;
-    params->mem_size = 0x80000000;
-    params->hartid = 0;
-    params->fdt_addr = dtb_addr;
-    
-    uint64_t entry_point = kernel_load_addr + header->text_offset;
+    if (initrd_size) {
+        bh_memory_copy((void*)(uintptr_t)layout.initrd_addr, initrd_data, initrd_size);
+    }
+    if (cmdline_size) {
+        memcpy((char*)(uintptr_t)layout.cmdline_addr, cmdline, cmdline_size);
+    }
+    bh_memory_copy((void*)(uintptr_t)layout.kernel_addr, kernel_data, kernel_size);
+    riscv64_fill_params(&layout, initrd_size, cmdline_size, kernel_size);
+    
+    // Just the ranges written; on cores without Zicbom these are fences
+    bh_memory_flush((void*)(uintptr_t)layout.kernel_addr, kernel_size);
+    bh_memory_sync_code((void*)(uintptr_t)layout.kernel_addr, kernel_size);
+    bh_memory_flush((void*)(uintptr_t)layout.initrd_addr, initrd_size);
+    bh_memory_flush((void*)(uintptr_t)layout.cmdline_addr, cmdline_size);
+    bh_memory_flush((void*)(uintptr_t)layout.dtb_addr, layout.dtb_size);
+    bh_memory_flush((void*)(uintptr_t)layout.params_addr, sizeof(struct riscv64_boot_params));
+    
+    uint64_t entry_point = layout.kernel_addr + header->text_offset;
     void (*kernel_entry)(uint64_t, uint64_t, uint64_t) = (void*)entry_point;
-    kernel_entry(0, dtb_addr, (uint64_t)params);
+    kernel_entry(layout.hartid, layout.dtb_addr, layout.params_addr);
     
     return 0;
 }
 
 int riscv64_boot_opensbi(uint8_t* kernel_data, uint64_t kernel_size, const char* cmdline) {
-    uint64_t kernel_load_addr = 0x80200000;
-    uint64_t dtb_addr = 0x82000000;
+    struct riscv64_layout layout;
+    uint64_t cmdline_size = cmdline && strlen(cmdline) > 0 ? strlen(cmdline) + 1 : 0;
     
-    uint64_t cmdline_addr = 0;
-    uint64_t cmdline_size = 0;
-    if (cmdline && strlen(cmdline) > 0) {
-        cmdline_addr = dtb_addr + 0x100000;
-        cmdline_size = strlen(cmdline) + 1;
-        strcpy((char*)cmdline_addr, cmdline);
+    if (riscv64_plan_handoff(&layout, kernel_size, NULL, 0, cmdline, cmdline_size) != 0) {
+        return -1;
     }
     
-    memcpy((void*)kernel_load_addr, kernel_data, kernel_size);
-    
-    struct riscv64_boot_params* params = (struct riscv64_boot_params*)0x80000000;
-    memset(params, 0, sizeof(struct riscv64_boot_params));
+    if (cmdline_size) {
+        memcpy((char*)(uintptr_t)layout.cmdline_addr, cmdline, cmdline_size);
+    }
+    bh_memory_copy((void*)(uintptr_t)layout.kernel_addr, kernel_data, kernel_size);
+    riscv64_fill_params(&layout, 0, cmdline_size, kernel_size);
     
-    params->dtb_addr = dtb_addr;
-    params->cmdline_addr = cmdline_addr;
-    params->cmdline_size = cmdline_size;
-    params->kernel_addr = kernel_load_addr;
-    params->kernel_size = kernel_size;
-    params->mem_start = 0x80000000;
-    params->mem_size = 0x80000000;
-    params->hartid = 0;
-    params->fdt_addr = dtb_addr;
+    bh_memory_flush((void*)(uintptr_t)layout.kernel_addr, kernel_size);
+    bh_memory_sync_code((void*)(uintptr_t)layout.kernel_addr, kernel_size);
+    bh_memory_flush((void*)(uintptr_t)layout.cmdline_addr, cmdline_size);
+    bh_memory_flush((void*)(uintptr_t)layout.dtb_addr, layout.dtb_size);
+    bh_memory_flush((void*)(uintptr_t)layout.params_addr, sizeof(struct riscv64_boot_params));
     
-    void (*kernel_entry)(uint64_t, uint64_t, uint64_t) = (void*)kernel_load_addr;
-    kernel_entry(0, dtb_addr, (uint64_t)params);
+    void (*kernel_entry)(uint64_t, uint64_t, uint64_t) = (void*)(uintptr_t)layout.kernel_addr;
+    kernel_entry(layout.hartid, layout.dtb_addr, layout.params_addr);
     
     return 0;
 }
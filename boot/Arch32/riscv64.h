@@ -22,6 +22,7 @@ struct riscv64_boot_params {
     uint64_t mem_size;
     uint64_t hartid;
     uint64_t fdt_addr;
+    uint64_t hart_count;        // Enabled harts in the tree
 };
 
 struct riscv64_linux_header {
@@ -8,7 +8,9 @@
 #include <stdint.h>
 #include "compat.h"
 #include <string.h>
+#include "../libb/include/bloodhorn/memory.h"
 #include "x86_64.h"
+#include "loadseg.h"
 
 extern void* allocate_memory(uint32_t size);
 extern int load_file(const char* path, uint8_t** data, uint32_t* size);
@@ -37,10 +39,16 @@ struct x86_64_boot_params {
     uint16_t vbe_interface_len;
 };
 
+static int x86_64_load_in_place(loadseg_t* image, const char* initrd_path, const char* cmdline);
+
 int x86_64_load_kernel(const char* kernel_path, const char* initrd_path, const char* cmdline) {
+    static loadseg_t image;
     uint8_t* kernel_data = NULL;
     uint64_t kernel_size = 0;
     
+    if (loadseg_open(&image, kernel_path) == 0) {
+        return x86_64_load_in_place(&image, initrd_path, cmdline);
+    }
     if (load_file(kernel_path, &kernel_data, (uint32_t*)&kernel_size) != 0) {
         return -1;
     }
@@ -58,31 +66,51 @@ int x86_64_load_kernel(const char* kernel_path, const char* initrd_path, const c
     return -1;
 }
 
-int x86_64_boot_linux(uint8_t* kernel_data, uint64_t kernel_size, const char* initrd_path, const char* cmdline) {
-    struct linux_kernel_header* header = (struct linux_kernel_header*)kernel_data;
-    
-    uint32_t setup_size = (header->setup_sects + 1) * 512;
-    if (setup_size == 0) setup_size = 4 * 512;
-    
-    uint8_t* kernel_dest = (uint8_t*)0x100000;
-    memcpy(kernel_dest, kernel_data + setup_size, kernel_size - setup_size);
-    
-    uint64_t initrd_addr = 0;
-    uint64_t initrd_size = 0;
-    if (initrd_path && strlen(initrd_path) > 0) {
+// A relocatable kernel (boot protocol 2.05+) anywhere aligned below 4GB,
+// at random with [boot] kaslr; others at 1MB
+static uint64_t x86_64_kernel_base(const struct linux_kernel_header* header, uint64_t kernel_size) {
+    if (header->version >= 0x0205 && header->relocatable_kernel) {
+        uint64_t align = header->kernel_alignment ? header->kernel_alignment : LOADSEG_HUGE_PAGE;
+        uint64_t need = header->version >= 0x020A && header->init_size > kernel_size ? header->init_size : kernel_size;
+        uint64_t base;
+        if (loadseg_place(need, align, 0x100000, 0x100000000ULL, LOADSEG_PLACE_RELOCATABLE, &base) == 0) {
+            return base;
+        }
+    }
+    return 0x100000;
+}
+
+// Initrd at the top of the memory the kernel allows for it, read in place
+// where it can be; right after the kernel when nothing there is free
+static uint64_t x86_64_place_initrd(const struct linux_kernel_header* header, const char* initrd_path,
+                                    uint64_t after_kernel, uint64_t* initrd_size) {
+    uint64_t initrd_max = header->version >= 0x0203 && header->initrd_addr_max ?
+                          (uint64_t)header->initrd_addr_max + 1 : 0x38000000;
+    uint64_t initrd_addr;
+    uint32_t initrd_size32 = 0;
+    *initrd_size = 0;
+    if (!initrd_path || strlen(initrd_path) == 0) {
+        return 0;
+    }
+    if (loadseg_place_file(initrd_path, 4096, initrd_max, LOADSEG_PLACE_TOP_DOWN, &initrd_addr, &initrd_size32) != 0) {
         uint8_t* initrd_data = NULL;
-        uint32_t initrd_size32 = 0;
-        if (load_file(initrd_path, &initrd_data, &initrd_size32) == 0) {
-            initrd_size = initrd_size32;
-            initrd_addr = 0x100000 + kernel_size - setup_size;
-            memcpy((void*)initrd_addr, initrd_data, initrd_size);
+        if (load_file(initrd_path, &initrd_data, &initrd_size32) != 0) {
+            return 0;
+        }
+        if (loadseg_place(initrd_size32, 4096, 0x100000, initrd_max, LOADSEG_PLACE_TOP_DOWN, &initrd_addr) != 0) {
+            initrd_addr = after_kernel;
         }
+        bh_memory_copy((void*)initrd_addr, initrd_data, initrd_size32);
     }
-    
+    *initrd_size = initrd_size32;
+    return initrd_addr;
+}
+
+// Boot parameters around the setup code already at 0x90000, then the jump
+static int x86_64_start_linux(uint64_t kernel_base, uint64_t initrd_addr, uint64_t initrd_size, const char* cmdline) {
     struct linux_boot_params* params = (struct linux_boot_params*)0x90000;
-    memset(params, 0, sizeof(struct linux_boot_params));
     
-    memcpy(params, kernel_data, setup_size);
+    params->code32_start = kernel_base;
     
     if (cmdline && strlen(cmdline) > 0) {
         strcpy((char*)0x90000 + 0x0020, cmdline);
@@ -97,13 +125,35 @@ int x86_64_boot_linux(uint8_t* kernel_data, uint64_t kernel_size, const char* in
     params->mem_upper = 0x7FE00;
     params->ext_mem_k = 0x7FE00;
     
-    void (*kernel_entry)(struct linux_boot_params*) = (void*)0x100000;
+    void (*kernel_entry)(struct linux_boot_params*) = (void*)kernel_base;
     kernel_entry(params);
     
     return 0;
 }
 
-int x86_64_boot_multiboot1(uint8_t* kernel_data, uint64_t kernel_size, const char* cmdline) {
+int x86_64_boot_linux(uint8_t* kernel_data, uint64_t kernel_size, const char* initrd_path, const char* cmdline) {
+    struct linux_kernel_header* header = (struct linux_kernel_header*)kernel_data;
+    
+    uint32_t setup_size = (header->setup_sects + 1) * 512;
+    if (setup_size == 0) setup_size = 4 * 512;
+    
+    uint64_t kernel_base = x86_64_kernel_base(header, kernel_size - setup_size);
+    uint8_t* kernel_dest = (uint8_t*)kernel_base;
+    bh_memory_copy(kernel_dest, kernel_data + setup_size, kernel_size - setup_size);
+    
+    uint64_t initrd_size = 0;
+    uint64_t initrd_addr = x86_64_place_initrd(header, initrd_path, kernel_base + kernel_size - setup_size, &initrd_size);
+    
+    struct linux_boot_params* params = (struct linux_boot_params*)0x90000;
+    memset(params, 0, sizeof(struct linux_boot_params));
+    
+    memcpy(params, kernel_data, setup_size);
+    
+    return x86_64_start_linux(kernel_base, initrd_addr, initrd_size, cmdline);
+}
+
+// Boot information for a Multiboot 1 kernel already at 1MB, then the jump
+static int x86_64_start_multiboot1(const char* cmdline) {
     struct x86_64_boot_params* info = (struct x86_64_boot_params*)0x1000;
     memset(info, 0, sizeof(struct x86_64_boot_params));
     
@@ -117,15 +167,19 @@ int x86_64_boot_multiboot1(uint8_t* kernel_data, uint64_t kernel_size, const cha
     }
     
     uint64_t kernel_entry = 0x100000;
-    memcpy((void*)kernel_entry, kernel_data, kernel_size);
-    
     void (*entry_point)(uint32_t, uint64_t) = (void*)kernel_entry;
     entry_point(0x2BADB002, (uint64_t)info);
     
     return 0;
 }
 
-int x86_64_boot_multiboot2(uint8_t* kernel_data, uint64_t kernel_size, const char* cmdline) {
+int x86_64_boot_multiboot1(uint8_t* kernel_data, uint64_t kernel_size, const char* cmdline) {
+    bh_memory_copy((void*)0x100000, kernel_data, kernel_size);
+    return x86_64_start_multiboot1(cmdline);
+}
+
+// Boot information for a Multiboot 2 kernel already at 1MB, then the jump
+static int x86_64_start_multiboot2(const char* cmdline) {
     struct multiboot2_info* info = (struct multiboot2_info*)0x1000;
     uint8_t* tag_ptr = (uint8_t*)info + 8;
     
@@ -155,14 +209,52 @@ int x86_64_boot_multiboot2(uint8_t* kernel_data, uint64_t kernel_size, const cha
     info->total_size += 8;
     
     uint64_t kernel_entry = 0x100000;
-    memcpy((void*)kernel_entry, kernel_data, kernel_size);
-    
     void (*entry_point)(uint32_t, uint64_t) = (void*)kernel_entry;
     entry_point(0x36d76289, (uint64_t)info);
     
     return 0;
 }
 
+int x86_64_boot_multiboot2(uint8_t* kernel_data, uint64_t kernel_size, const char* cmdline) {
+    bh_memory_copy((void*)0x100000, kernel_data, kernel_size);
+    return x86_64_start_multiboot2(cmdline);
+}
+
+// The same protocols with the image read from disk straight to where it
+// runs: setup code to 0x90000 and the kernel proper to 1MB for Linux, the
+// whole file to 1MB for Multiboot
+static int x86_64_load_in_place(loadseg_t* image, const char* initrd_path, const char* cmdline) {
+    uint32_t* header = (uint32_t*)image->head;
+    
+    if (header[0] == 0x53726448) {
+        struct linux_kernel_header* linux_header = (struct linux_kernel_header*)image->head;
+        uint32_t setup_size = (linux_header->setup_sects + 1) * 512;
+        if (setup_size > image->size) {
+            return -1;
+        }
+        uint32_t body_size = image->size - setup_size;
+        uint64_t kernel_base = x86_64_kernel_base(linux_header, body_size);
+        
+        struct linux_boot_params* params = (struct linux_boot_params*)0x90000;
+        memset(params, 0, sizeof(struct linux_boot_params));
+        if (loadseg_load(image, 0, setup_size, 0x90000, setup_size) != 0 ||
+            loadseg_load(image, setup_size, body_size, kernel_base, body_size) != 0) {
+            return -1;
+        }
+        
+        uint64_t initrd_size = 0;
+        uint64_t initrd_addr = x86_64_place_initrd(linux_header, initrd_path, kernel_base + body_size, &initrd_size);
+        return x86_64_start_linux(kernel_base, initrd_addr, initrd_size, cmdline);
+    } else if (header[0] == 0x1BADB002 || header[0] == 0xE85250D6) {
+        if (loadseg_load(image, 0, image->size, 0x100000, image->size) != 0) {
+            return -1;
+        }
+        return header[0] == 0x1BADB002 ? x86_64_start_multiboot1(cmdline) : x86_64_start_multiboot2(cmdline);
+    }
+    
+    return -1;
+}
+
 int x86_64_verify_kernel(const char* kernel_path) {
     uint8_t* kernel_data = NULL;
     uint32_t kernel_size = 0;
@@ -18,20 +18,476 @@
 #include <Library/DevicePathLib.h>
 #include <Protocol/SimpleFileSystem.h>
 #include <Protocol/LoadedImage.h>
+#include "../../uefi/uefi.h"
+#include "../secure.h"
+#include "../plugin.h"
+#include "../../security/crypto.h"
+#include "../libb/include/bloodhorn/time.h"
+#include "../libb/include/bloodhorn/trace.h"
+#include "../libb/include/bloodhorn/memory.h"
+#include "../libb/include/bloodhorn/counters.h"
+#include "../libb/include/bloodhorn/hash.h"
+#include "../../fs/blockdev.h"
 
 // =============================================================================
 // INTERNAL STATE
 // =============================================================================
 
+// Each entry has its own allocation, so the boot order and the indexes can
+// hold pointers that stay valid while the order grows or is permuted
 typedef struct {
-    BOOT_MANAGER_ENTRY Entries[BOOT_MANAGER_MAX_ENTRIES];
+    BOOT_MANAGER_ENTRY Entry;
+    UINTN Position;                     // Index in the boot order
+    EFI_STATUS VerifyStatus;            // Result of the kernel check; EFI_NOT_STARTED until it ran
+} BOOT_ENTRY_NODE;
+
+// Open-addressed index slot; free while Node is NULL
+typedef struct {
+    UINT32 Hash;
+    BOOT_ENTRY_NODE* Node;
+} BOOT_ENTRY_SLOT;
+
+typedef struct {
+    BOOT_ENTRY_NODE** Order;            // Entries in boot order
     UINTN EntryCount;
+    UINTN Capacity;
+    BOOT_ENTRY_SLOT* IdIndex;           // Both indexes have IndexSize slots,
+    BOOT_ENTRY_SLOT* NameIndex;         // kept at most half full
+    UINTN IndexSize;
+    BOOT_ENTRY_NODE* Default;
     UINT32 NextEntryId;
     BOOT_MANAGER_PROTOCOL *BootManagerProtocol;
 } BOOT_MANAGER_CONTEXT;
 
 static BOOT_MANAGER_CONTEXT gBootManagerContext = {0};
 
+#define BOOT_ENTRY_MIN_CAPACITY     16
+#define BOOT_ENTRY_PLACED           MAX_UINTN
+
+// =============================================================================
+// BOOT ENTRY STORE
+// =============================================================================
+
+STATIC UINT32 BootEntryIdHash(UINT32 Id) {
+    Id ^= Id >> 16;
+    Id *= 0x7FEB352D;
+    Id ^= Id >> 15;
+    Id *= 0x846CA68B;
+    Id ^= Id >> 16;
+    return Id;
+}
+
+STATIC UINT32 BootEntryNameHash(CONST CHAR16* Name) {
+    return bh_fnv1a_str16(Name);
+}
+
+STATIC VOID BootEntryIndexInsert(BOOT_ENTRY_SLOT* Index, UINT32 Hash, BOOT_ENTRY_NODE* Node) {
+    UINTN Mask = gBootManagerContext.IndexSize - 1;
+    UINTN At = Hash & Mask;
+    while (Index[At].Node != NULL) {
+        At = (At + 1) & Mask;
+    }
+    Index[At].Hash = Hash;
+    Index[At].Node = Node;
+}
+
+/**
+ * Rebuild both indexes from the boot order, resizing them to hold at least
+ * MinEntries. Removals and renames come through here too; they are rare
+ * next to lookups, and a rebuild is cheaper than tombstones to reason about.
+ */
+STATIC EFI_STATUS BootEntryIndexRebuild(UINTN MinEntries) {
+    UINTN Size = BOOT_ENTRY_MIN_CAPACITY * 2;
+    while (Size < MinEntries * 2) {
+        Size <<= 1;
+    }
+
+    if (Size != gBootManagerContext.IndexSize) {
+        BOOT_ENTRY_SLOT* IdIndex = AllocateZeroPool(Size * sizeof(BOOT_ENTRY_SLOT));
+        BOOT_ENTRY_SLOT* NameIndex = AllocateZeroPool(Size * sizeof(BOOT_ENTRY_SLOT));
+        if (!IdIndex || !NameIndex) {
+            if (IdIndex) FreePool(IdIndex);
+            if (NameIndex) FreePool(NameIndex);
+            return EFI_OUT_OF_RESOURCES;
+        }
+        if (gBootManagerContext.IdIndex) FreePool(gBootManagerContext.IdIndex);
+        if (gBootManagerContext.NameIndex) FreePool(gBootManagerContext.NameIndex);
+        gBootManagerContext.IdIndex = IdIndex;
+        gBootManagerContext.NameIndex = NameIndex;
+        gBootManagerContext.IndexSize = Size;
+    } else {
+        ZeroMem(gBootManagerContext.IdIndex, Size * sizeof(BOOT_ENTRY_SLOT));
+        ZeroMem(gBootManagerContext.NameIndex, Size * sizeof(BOOT_ENTRY_SLOT));
+    }
+
+    for (UINTN i = 0; i < gBootManagerContext.EntryCount; i++) {
+        BOOT_ENTRY_NODE* Node = gBootManagerContext.Order[i];
+        BootEntryIndexInsert(gBootManagerContext.IdIndex, BootEntryIdHash(Node->Entry.EntryId), Node);
+        BootEntryIndexInsert(gBootManagerContext.NameIndex, BootEntryNameHash(Node->Entry.Name), Node);
+    }
+    return EFI_SUCCESS;
+}
+
+STATIC BOOT_ENTRY_NODE* FindBootEntryNode(UINT32 EntryId) {
+    if (gBootManagerContext.IndexSize == 0) {
+        return NULL;
+    }
+    UINTN Mask = gBootManagerContext.IndexSize - 1;
+    UINT32 Hash = BootEntryIdHash(EntryId);
+    for (UINTN At = Hash & Mask; gBootManagerContext.IdIndex[At].Node != NULL; At = (At + 1) & Mask) {
+        BOOT_ENTRY_SLOT* Slot = &gBootManagerContext.IdIndex[At];
+        if (Slot->Hash == Hash && Slot->Node->Entry.EntryId == EntryId) {
+            return Slot->Node;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Find boot entry by ID
+ */
+STATIC BOOT_MANAGER_ENTRY* FindBootEntryById(UINT32 EntryId) {
+    BOOT_ENTRY_NODE* Node = FindBootEntryNode(EntryId);
+    return Node ? &Node->Entry : NULL;
+}
+
+/**
+ * Find boot entry by display name; duplicates resolve to the earliest in
+ * boot order
+ */
+EFI_STATUS EFIAPI FindBootEntryByName(
+    IN CONST CHAR16 *Name,
+    OUT UINT32 *EntryId
+    )
+{
+    BOOT_ENTRY_NODE* Found = NULL;
+
+    if (!Name || !EntryId) {
+        return EFI_INVALID_PARAMETER;
+    }
+    if (gBootManagerContext.IndexSize == 0) {
+        return EFI_NOT_FOUND;
+    }
+
+    UINTN Mask = gBootManagerContext.IndexSize - 1;
+    UINT32 Hash = BootEntryNameHash(Name);
+    for (UINTN At = Hash & Mask; gBootManagerContext.NameIndex[At].Node != NULL; At = (At + 1) & Mask) {
+        BOOT_ENTRY_SLOT* Slot = &gBootManagerContext.NameIndex[At];
+        if (Slot->Hash == Hash && StrCmp(Slot->Node->Entry.Name, Name) == 0 &&
+            (!Found || Slot->Node->Position < Found->Position)) {
+            Found = Slot->Node;
+        }
+    }
+    if (!Found) {
+        return EFI_NOT_FOUND;
+    }
+    *EntryId = Found->Entry.EntryId;
+    return EFI_SUCCESS;
+}
+
+/**
+ * Append a copy of Entry to the boot order under a fresh ID
+ */
+STATIC EFI_STATUS BootEntryStoreAppend(CONST BOOT_MANAGER_ENTRY* Entry, OUT BOOT_ENTRY_NODE** Added) {
+    EFI_STATUS Status;
+
+    if (gBootManagerContext.EntryCount == gBootManagerContext.Capacity) {
+        UINTN NewCapacity = MAX(gBootManagerContext.Capacity * 2, BOOT_ENTRY_MIN_CAPACITY);
+        BOOT_ENTRY_NODE** Order = ReallocatePool(gBootManagerContext.Capacity * sizeof(BOOT_ENTRY_NODE*),
+                                                 NewCapacity * sizeof(BOOT_ENTRY_NODE*),
+                                                 gBootManagerContext.Order);
+        if (!Order) {
+            return EFI_OUT_OF_RESOURCES;
+        }
+        gBootManagerContext.Order = Order;
+        gBootManagerContext.Capacity = NewCapacity;
+    }
+
+    BOOT_ENTRY_NODE* Node = AllocatePool(sizeof(BOOT_ENTRY_NODE));
+    if (!Node) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    CopyMem(&Node->Entry, Entry, sizeof(BOOT_MANAGER_ENTRY));
+    Node->Entry.EntryId = gBootManagerContext.NextEntryId++;
+    Node->Entry.Flags &= ~BOOT_ENTRY_FLAG_VERIFIED;     // Only a check in this boot sets it
+    Node->Position = gBootManagerContext.EntryCount;
+    Node->VerifyStatus = EFI_NOT_STARTED;
+    gBootManagerContext.Order[gBootManagerContext.EntryCount++] = Node;
+
+    if (gBootManagerContext.EntryCount * 2 > gBootManagerContext.IndexSize) {
+        Status = BootEntryIndexRebuild(gBootManagerContext.EntryCount);
+        if (EFI_ERROR(Status)) {
+            gBootManagerContext.EntryCount--;
+            FreePool(Node);
+            return Status;
+        }
+    } else {
+        BootEntryIndexInsert(gBootManagerContext.IdIndex, BootEntryIdHash(Node->Entry.EntryId), Node);
+        BootEntryIndexInsert(gBootManagerContext.NameIndex, BootEntryNameHash(Node->Entry.Name), Node);
+    }
+
+    if (Node->Entry.Flags & BOOT_ENTRY_FLAG_DEFAULT) {
+        if (gBootManagerContext.Default) {
+            gBootManagerContext.Default->Entry.Flags &= ~BOOT_ENTRY_FLAG_DEFAULT;
+        }
+        gBootManagerContext.Default = Node;
+    }
+    if (Added) {
+        *Added = Node;
+    }
+    return EFI_SUCCESS;
+}
+
+/**
+ * Drop every entry
+ */
+STATIC VOID BootEntryStoreClear(VOID) {
+    for (UINTN i = 0; i < gBootManagerContext.EntryCount; i++) {
+        FreePool(gBootManagerContext.Order[i]);
+    }
+    gBootManagerContext.EntryCount = 0;
+    gBootManagerContext.Default = NULL;
+    if (gBootManagerContext.IndexSize) {
+        ZeroMem(gBootManagerContext.IdIndex, gBootManagerContext.IndexSize * sizeof(BOOT_ENTRY_SLOT));
+        ZeroMem(gBootManagerContext.NameIndex, gBootManagerContext.IndexSize * sizeof(BOOT_ENTRY_SLOT));
+    }
+}
+
+// =============================================================================
+// PERSISTENT STATE
+// =============================================================================
+
+// Statistics and configuration share one NV variable. It is read the first
+// time either is needed and written back at most once, from
+// BootManagerFlushState before ExitBootServices: every variable write is a
+// slow SPI flash update that wears the part.
+#define BOOT_MANAGER_STATE_VARIABLE     L"BloodHornBootManager"
+#define BOOT_MANAGER_STATE_MAGIC        SIGNATURE_32('B', 'H', 'B', 'M')
+#define BOOT_MANAGER_STATE_VERSION      2
+#define BOOT_MANAGER_STATE_ATTRIBUTES   (EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS | \
+                                         EFI_VARIABLE_RUNTIME_ACCESS)
+
+// Phase durations of one entry's last boots, a ring of samples per phase
+typedef struct {
+    UINT32      EntryId;
+    UINT32      Recorded;               // Boots recorded; 0 marks a free slot
+    UINT32      LastBoot;               // SuccessfulBoots at the latest sample, for eviction
+    UINT32      Samples[BOOT_TIMING_PHASE_COUNT][BOOT_MANAGER_TIMING_SAMPLES];  // Microseconds
+} BOOT_ENTRY_TIMING_HISTORY;
+
+typedef struct {
+    UINT32      Magic;
+    UINT16      Version;
+    UINT16      Size;
+    UINT32      Crc32;                  // Over the whole blob, computed with this field zero
+    UINT32      SuccessfulBoots;
+    UINT32      FailedBoots;
+    UINT64      TotalBootTime;
+    UINT32      LastBootEntryId;
+    UINT32      DefaultTimeout;
+    UINT8       DefaultBootEnvironment;
+    UINT8       Flags;
+    UINT8       SecureBootPolicy;
+    UINT8       Reserved;
+    EFI_GUID    SystemGuid;
+    CHAR16      ThemePath[BOOT_MANAGER_MAX_PATH_LENGTH];
+    CHAR16      ConfigPath[BOOT_MANAGER_MAX_PATH_LENGTH];
+    BOOT_ENTRY_TIMING_HISTORY Timings[BOOT_MANAGER_TIMED_ENTRIES];
+} BOOT_MANAGER_STATE;
+
+STATIC BOOT_MANAGER_STATE mState;
+STATIC BOOLEAN mStateLoaded = FALSE;
+STATIC BOOLEAN mStateDirty = FALSE;
+
+// Entry started through BootEntryWithEnvironment this boot; 0 for none
+STATIC UINT32 mBootingEntryId = 0;
+STATIC BOOLEAN mBootRecorded = FALSE;
+
+STATIC UINT32 BootManagerStateCrc(BOOT_MANAGER_STATE* State) {
+    UINT32 Saved = State->Crc32;
+    UINT32 Crc = 0;
+    State->Crc32 = 0;
+    gBS->CalculateCrc32(State, sizeof(*State), &Crc);
+    State->Crc32 = Saved;
+    return Crc;
+}
+
+/**
+ * The persistent state, loaded on first use. A missing, foreign or
+ * corrupt blob is replaced by defaults, which are written at the next flush.
+ */
+STATIC BOOT_MANAGER_STATE* BootManagerState(VOID) {
+    if (mStateLoaded) {
+        return &mState;
+    }
+    mStateLoaded = TRUE;
+
+    UINTN Size = sizeof(mState);
+    EFI_STATUS Status = gRT->GetVariable(BOOT_MANAGER_STATE_VARIABLE, &gBloodHornVariableGuid, NULL, &Size, &mState);
+    if (!EFI_ERROR(Status) && Size == sizeof(mState) && mState.Magic == BOOT_MANAGER_STATE_MAGIC &&
+        mState.Version == BOOT_MANAGER_STATE_VERSION && mState.Size == sizeof(mState) &&
+        mState.Crc32 == BootManagerStateCrc(&mState)) {
+        return &mState;
+    }
+
+    ZeroMem(&mState, sizeof(mState));
+    mState.Magic = BOOT_MANAGER_STATE_MAGIC;
+    mState.Version = BOOT_MANAGER_STATE_VERSION;
+    mState.Size = (UINT16)sizeof(mState);
+    mState.DefaultTimeout = 5;
+    mState.DefaultBootEnvironment = BOOT_ENVIRONMENT_AUTO;
+    mState.Flags = BOOT_MANAGER_FLAG_SECURE_BOOT;
+    mState.SecureBootPolicy = 1;
+    StrCpyS(mState.ThemePath, ARRAY_SIZE(mState.ThemePath), L"\\EFI\\BloodHorn\\themes\\default");
+    StrCpyS(mState.ConfigPath, ARRAY_SIZE(mState.ConfigPath), L"\\EFI\\BloodHorn\\bootmgr.conf");
+    crypto_random_bytes((UINT8*)&mState.SystemGuid, sizeof(mState.SystemGuid));
+    mStateDirty = TRUE;
+    return &mState;
+}
+
+/**
+ * Timed phase a trace span belongs to, or BOOT_TIMING_PHASE_COUNT
+ */
+STATIC UINTN BootTimingPhase(CONST CHAR8* Name) {
+    // Loads that hash on the fly are labelled "load+hash"
+    if (AsciiStrnCmp(Name, BH_TRACE_PHASE_LOAD, sizeof(BH_TRACE_PHASE_LOAD) - 1) == 0) {
+        return BOOT_TIMING_LOAD;
+    }
+    if (AsciiStrCmp(Name, BH_TRACE_PHASE_VERIFY) == 0) {
+        return BOOT_TIMING_VERIFY;
+    }
+    if (AsciiStrCmp(Name, BH_TRACE_PHASE_TPM_MEASURE) == 0) {
+        return BOOT_TIMING_MEASURE;
+    }
+    if (AsciiStrCmp(Name, BH_TRACE_PHASE_HANDOFF) == 0) {
+        return BOOT_TIMING_HANDOFF;
+    }
+    return BOOT_TIMING_PHASE_COUNT;
+}
+
+/**
+ * History slot for EntryId: its own, else a free one, else the one booted
+ * longest ago
+ */
+STATIC BOOT_ENTRY_TIMING_HISTORY* BootTimingSlot(BOOT_MANAGER_STATE* State, UINT32 EntryId) {
+    BOOT_ENTRY_TIMING_HISTORY* Victim = &State->Timings[0];
+
+    for (UINTN i = 0; i < BOOT_MANAGER_TIMED_ENTRIES; i++) {
+        BOOT_ENTRY_TIMING_HISTORY* Slot = &State->Timings[i];
+        if (Slot->Recorded && Slot->EntryId == EntryId) {
+            return Slot;
+        }
+        if (Victim->Recorded && (!Slot->Recorded || Slot->LastBoot < Victim->LastBoot)) {
+            Victim = Slot;
+        }
+    }
+
+    ZeroMem(Victim, sizeof(*Victim));
+    Victim->EntryId = EntryId;
+    return Victim;
+}
+
+/**
+ * Count this boot and add its phase durations to the booted entry's history.
+ * A phase's time is the sum of its outermost spans; spans still open (the
+ * handoff) count up to now.
+ */
+STATIC VOID BootManagerRecordBoot(BOOT_MANAGER_STATE* State) {
+    UINT64 Ticks[BOOT_TIMING_PHASE_COUNT] = { 0 };
+    UINT64 OpenUntil[BOOT_TIMING_PHASE_COUNT] = { 0 };
+    UINT64 End = 0;
+
+    UINTN Count = bh_trace_get_event_count();
+    bh_trace_event_t* Events = Count ? AllocatePool(Count * sizeof(*Events)) : NULL;
+    if (Events) {
+        Count = bh_trace_get_events(Events, Count);
+        for (UINTN i = 0; i < Count; i++) {
+            UINT64 SpanEnd = Events[i].start_ticks + Events[i].duration_ticks;
+            End = MAX(End, SpanEnd);
+            if (Events[i].type != BH_TRACE_EVENT_SPAN) {
+                continue;
+            }
+            UINTN Phase = BootTimingPhase(Events[i].name);
+            // Events come in start order, so a span inside one of its own
+            // phase starts before the outer one ends
+            if (Phase == BOOT_TIMING_PHASE_COUNT || Events[i].start_ticks < OpenUntil[Phase]) {
+                continue;
+            }
+            Ticks[Phase] += Events[i].duration_ticks;
+            OpenUntil[Phase] = SpanEnd;
+        }
+        FreePool(Events);
+    }
+
+    UINT32 EntryId = mBootingEntryId;
+    if (!EntryId && gBootManagerContext.Default) {
+        EntryId = gBootManagerContext.Default->Entry.EntryId;
+    }
+
+    State->SuccessfulBoots++;
+    State->TotalBootTime += bh_ticks_to_nanoseconds(End) / 1000;
+    State->LastBootEntryId = EntryId;
+
+    BOOT_ENTRY_TIMING_HISTORY* History = BootTimingSlot(State, EntryId);
+    UINTN Sample = History->Recorded % BOOT_MANAGER_TIMING_SAMPLES;
+    for (UINTN Phase = 0; Phase < BOOT_TIMING_PHASE_COUNT; Phase++) {
+        UINT64 Us = bh_ticks_to_nanoseconds(Ticks[Phase]) / 1000;
+        History->Samples[Phase][Sample] = (UINT32)MIN(Us, MAX_UINT32);
+    }
+    History->Recorded++;
+    History->LastBoot = State->SuccessfulBoots;
+}
+
+/**
+ * Nearest-rank percentiles and maximum over the recorded part of a ring
+ */
+STATIC VOID BootPhaseTiming(CONST UINT32* Ring, UINT32 Recorded, OUT BOOT_PHASE_TIMING* Timing) {
+    UINT32 Sorted[BOOT_MANAGER_TIMING_SAMPLES];
+    UINTN Count = MIN(Recorded, BOOT_MANAGER_TIMING_SAMPLES);
+
+    ZeroMem(Timing, sizeof(*Timing));
+    if (Count == 0) {
+        return;
+    }
+
+    for (UINTN i = 0; i < Count; i++) {
+        UINT32 Value = Ring[i];
+        UINTN j = i;
+        for (; j > 0 && Sorted[j - 1] > Value; j--) {
+            Sorted[j] = Sorted[j - 1];
+        }
+        Sorted[j] = Value;
+    }
+
+    Timing->P50 = Sorted[(Count * 50 + 99) / 100 - 1];
+    Timing->P95 = Sorted[(Count * 95 + 99) / 100 - 1];
+    Timing->Max = Sorted[Count - 1];
+}
+
+/**
+ * Record this boot and write the state back if anything changed since it
+ * was loaded
+ */
+EFI_STATUS EFIAPI BootManagerFlushState(VOID) {
+    // Only a handoff flushes, so this is where a boot counts as done
+    if (!mBootRecorded) {
+        BootManagerRecordBoot(BootManagerState());
+        mBootRecorded = TRUE;
+        mStateDirty = TRUE;
+    }
+    if (!mStateDirty) {
+        return EFI_SUCCESS;
+    }
+
+    mState.Crc32 = BootManagerStateCrc(&mState);
+    EFI_STATUS Status = gRT->SetVariable(BOOT_MANAGER_STATE_VARIABLE, &gBloodHornVariableGuid,
+                                         BOOT_MANAGER_STATE_ATTRIBUTES, sizeof(mState), &mState);
+    if (!EFI_ERROR(Status)) {
+        mStateDirty = FALSE;
+    }
+    return Status;
+}
+
 // =============================================================================
 // UTILITY FUNCTIONS
 // =============================================================================
@@ -90,6 +546,19 @@ STATIC UINT8 GetBootEntryTypeForArchitecture(VOID) {
     return BOOT_ENTRY_TYPE_LINUX; // Default fallback
 }
 
+/**
+ * Device handle of the volume BloodHorn was loaded from
+ */
+STATIC EFI_STATUS BootDeviceHandle(OUT EFI_HANDLE* Device) {
+    EFI_LOADED_IMAGE_PROTOCOL* LoadedImage = NULL;
+    EFI_STATUS Status = gBS->HandleProtocol(gImageHandle, &gEfiLoadedImageProtocolGuid, (VOID**)&LoadedImage);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    *Device = LoadedImage->DeviceHandle;
+    return EFI_SUCCESS;
+}
+
 /**
  * Execute boot entry based on type
  */
@@ -99,6 +568,7 @@ STATIC EFI_STATUS ExecuteBootEntryByType(
     )
 {
     EFI_STATUS Status = EFI_SUCCESS;
+    EFI_HANDLE Device = NULL;
     
     switch (Entry->EntryType) {
         case BOOT_ENTRY_TYPE_MULTIBOOT1:
@@ -122,11 +592,14 @@ STATIC EFI_STATUS ExecuteBootEntryByType(
             break;
             
         case BOOT_ENTRY_TYPE_UEFI_APPLICATION:
-            Status = LoadAndStartImageFromPath(gImageHandle, Entry->DevicePath, Entry->KernelData, Entry->KernelSize);
+            Status = BootDeviceHandle(&Device);
+            if (!EFI_ERROR(Status)) {
+                Status = LoadAndStartImageFromPath(gImageHandle, Device, Entry->DevicePath);
+            }
             break;
             
         case BOOT_ENTRY_TYPE_RECOVERY:
-            Status = shell_start();
+            Status = StartPlugin(L"shell");
             break;
             
         case BOOT_ENTRY_TYPE_FIRMWARE_SETTINGS:
@@ -176,7 +649,17 @@ EFI_STATUS EFIAPI BootEntryWithEnvironment(
            BootEnvironment == BOOT_ENVIRONMENT_LEGACY_BIOS ? L"Legacy BIOS" :
            BootEnvironment == BOOT_ENVIRONMENT_WINDOWS_BOOT_MGR ? L"Windows Boot Manager" : L"Unknown");
     
-    return ExecuteBootEntryByType(Entry, TargetEnvironment);
+    // Timings recorded at handoff belong to this entry
+    mBootingEntryId = EntryId;
+    EFI_STATUS Status = ExecuteBootEntryByType(Entry, TargetEnvironment);
+    if (EFI_ERROR(Status)) {
+        BOOT_MANAGER_STATE* State = BootManagerState();
+        State->FailedBoots++;
+        State->LastBootEntryId = EntryId;
+        mStateDirty = TRUE;
+        mBootingEntryId = 0;
+    }
+    return Status;
 }
 
 /**
@@ -216,9 +699,9 @@ STATIC EFI_STATUS BootWindowsBootManager(BOOT_MANAGER_ENTRY* Entry) {
         
         // Look for Windows Boot Manager files
         CHAR16 *BootMgrPaths[] = {
-            L"\EFI\Microsoft\Boot\bootmgfw.efi",
-            L"\bootmgr.efi",
-            L"\EFI\BOOT\BOOTX64.EFI"
+            L"\\EFI\\Microsoft\\Boot\\bootmgfw.efi",
+            L"\\bootmgr.efi",
+            L"\\EFI\\BOOT\\BOOTX64.EFI"
         };
         
         for (UINTN j = 0; j < ARRAY_SIZE(BootMgrPaths); j++) {
@@ -229,12 +712,12 @@ STATIC EFI_STATUS BootWindowsBootManager(BOOT_MANAGER_ENTRY* Entry) {
                 // Update entry with actual path
                 StrCpyS(Entry->DevicePath, sizeof(Entry->DevicePath), BootMgrPaths[j]);
                 
-                // Load and execute Windows Boot Manager
-                Status = LoadAndStartImageFromPath(gImageHandle, BootMgrPaths[j], NULL, 0);
-                
+                // Close ours first; the firmware reads it from this volume
                 BootMgrFile->Close(BootMgrFile);
                 RootDir->Close(RootDir);
                 
+                Status = LoadAndStartImageFromPath(gImageHandle, HandleBuffer[i], BootMgrPaths[j]);
+                
                 if (HandleBuffer) {
                     FreePool(HandleBuffer);
                 }
@@ -292,22 +775,12 @@ STATIC BOOT_MANAGER_PROTOCOL gBootManagerProtocolInstance = {
     GetSystemInformation,                        // GetSystemInformation
     ExportConfiguration,                         // ExportConfiguration
     ImportConfiguration,                         // ImportConfiguration
+    ConvertConfiguration,                        // ConvertConfiguration
+    GetPerformanceCounters,                      // GetPerformanceCounters
     
     &gBootManagerContext                         // PrivateData
 };
 
-/**
- * Get boot entry by ID
- */
-STATIC BOOT_MANAGER_ENTRY* FindBootEntryById(UINT32 EntryId) {
-    for (UINTN i = 0; i < gBootManagerContext.EntryCount; i++) {
-        if (gBootManagerContext.Entries[i].EntryId == EntryId) {
-            return &gBootManagerContext.Entries[i];
-        }
-    }
-    return NULL;
-}
-
 /**
  * Get boot entry by ID (protocol function)
  */
@@ -336,16 +809,20 @@ EFI_STATUS EFIAPI GetBootEntry(
 EFI_STATUS EFIAPI GetBootOrder(
     IN BOOT_MANAGER_PROTOCOL *This,
     OUT UINT32 *EntryOrder,
-    OUT UINTN *EntryCount
+    IN OUT UINTN *EntryCount
     )
 {
     if (!This || !EntryOrder || !EntryCount) {
         return EFI_INVALID_PARAMETER;
     }
     
+    if (*EntryCount < gBootManagerContext.EntryCount) {
+        *EntryCount = gBootManagerContext.EntryCount;
+        return EFI_BUFFER_TOO_SMALL;
+    }
     *EntryCount = gBootManagerContext.EntryCount;
     for (UINTN i = 0; i < gBootManagerContext.EntryCount; i++) {
-        EntryOrder[i] = gBootManagerContext.Entries[i].EntryId;
+        EntryOrder[i] = gBootManagerContext.Order[i]->Entry.EntryId;
     }
     
     return EFI_SUCCESS;
@@ -363,14 +840,156 @@ EFI_STATUS EFIAPI GetDefaultEntry(
         return EFI_INVALID_PARAMETER;
     }
     
+    if (!gBootManagerContext.Default) {
+        return EFI_NOT_FOUND;
+    }
+    *EntryId = gBootManagerContext.Default->Entry.EntryId;
+    return EFI_SUCCESS;
+}
+
+// =============================================================================
+// ENTRY VERIFICATION
+// =============================================================================
+
+// State carried between the chunks of one entry's kernel
+typedef struct {
+    BOOLEAN             Manifest;       // Chunks are checked against a signed manifest
+    merkle_stream_t     Stream;
+    IMAGE_CACHE_LOOKUP  Lookup;
+} ENTRY_VERIFY_STREAM;
+
+STATIC EFI_STATUS EntryVerifyChunk(VOID* Context, CONST VOID* Data, UINTN Length) {
+    ENTRY_VERIFY_STREAM* Verify = (ENTRY_VERIFY_STREAM*)Context;
+
+    ImageCacheChunk(&Verify->Lookup, Data, Length);
+    if (Verify->Manifest &&
+        merkle_stream_update(&Verify->Stream, (CONST uint8_t*)Data, (uint32_t)Length) != CRYPTO_SUCCESS) {
+        return EFI_SECURITY_VIOLATION;
+    }
+    return EFI_SUCCESS;
+}
+
+/**
+ * One pass over an entry's kernel. With UseCache, a file an earlier boot
+ * passed under the same key only has its edges compared; EFI_NOT_READY
+ * means they differ and a full check is needed. Otherwise each chunk is
+ * checked against the signed manifest as it streams in, or the appended
+ * signature once the image is in.
+ */
+STATIC EFI_STATUS VerifyEntryKernelPass(
+    IN CONST BOOT_MANAGER_ENTRY* Entry,
+    IN CONST UINT8* Key,
+    IN UINTN KeySize,
+    IN CONST UINT8* Identity,
+    IN BOOLEAN UseCache
+    )
+{
+    ENTRY_VERIFY_STREAM Verify;
+    merkle_manifest_t Manifest;
+    LOADED_FILE ManifestFile;
+    LOADED_FILE Image;
+    EFI_STATUS Status;
+
+    ZeroMem(&Verify, sizeof(Verify));
+    BOOLEAN Cached = ImageCacheBegin(Entry->KernelPath, Identity, &Verify.Lookup) && UseCache;
+    if (!Cached) {
+        Status = LoadImageManifest(Entry->KernelPath, Entry->SignatureAlgorithm, Key, KeySize,
+                                   &Manifest, &ManifestFile);
+        if (EFI_ERROR(Status) && Status != EFI_NOT_FOUND) {
+            return Status;
+        }
+        if (!EFI_ERROR(Status)) {
+            Verify.Manifest = TRUE;
+            merkle_stream_init(&Verify.Stream, &Manifest);
+        }
+    }
+
+    Status = LoadBootFile(Entry->KernelPath, FILE_LOAD_POOL, EntryVerifyChunk, &Verify, &Image);
+    if (!EFI_ERROR(Status)) {
+        if (Cached) {
+            Status = ImageCacheConfirm(&Verify.Lookup) ? EFI_SUCCESS : EFI_NOT_READY;
+        } else if (Verify.Manifest) {
+            Status = merkle_stream_final(&Verify.Stream) == CRYPTO_SUCCESS ? EFI_SUCCESS : EFI_SECURITY_VIOLATION;
+        } else {
+            Status = VerifyImageSignatureEx(Image.Buffer, Image.Size, Entry->SignatureAlgorithm, Key, KeySize);
+        }
+        if (!EFI_ERROR(Status) && !Cached) {
+            ImageCacheRecord(&Verify.Lookup, Identity);
+        }
+        FreeLoadedFile(&Image);
+    }
+
+    if (Verify.Manifest) {
+        FreeLoadedFile(&ManifestFile);
+    }
+    return Status;
+}
+
+/**
+ * Check an entry's kernel (and initrd) against the key stored for its
+ * vendor, keeping the result on the entry for later calls
+ */
+STATIC EFI_STATUS VerifyEntryNode(IN OUT BOOT_ENTRY_NODE* Node) {
+    BOOT_MANAGER_ENTRY* Entry = &Node->Entry;
+    UINT8 Key[BOOT_MANAGER_MAX_KEY_SIZE];
+    UINTN KeySize = sizeof(Key);
+    UINT8 Identity[CRYPTO_SHA512_DIGEST_LENGTH];
+    crypto_sha512_ctx_t Sha;
+    EFI_STATUS Status;
+
+    if (Node->VerifyStatus != EFI_NOT_STARTED) {
+        return Node->VerifyStatus;
+    }
+
+    if (Entry->KernelPath[0] == L'\0') {
+        Status = EFI_NOT_FOUND;
+    } else {
+        Status = gRT->GetVariable(BOOT_MANAGER_KEY_VARIABLE_NAME, &Entry->VendorGuid, NULL, &KeySize, Key);
+    }
+
+    if (!EFI_ERROR(Status)) {
+        // Cache records vouch for "passed under this scheme and key"
+        crypto_sha512_init(&Sha);
+        crypto_sha512_update(&Sha, &Entry->SignatureAlgorithm, 1);
+        crypto_sha512_update(&Sha, Key, (uint32_t)KeySize);
+        crypto_sha512_final(&Sha, Identity);
+
+        Status = VerifyEntryKernelPass(Entry, Key, KeySize, Identity, TRUE);
+        if (Status == EFI_NOT_READY) {
+            Status = VerifyEntryKernelPass(Entry, Key, KeySize, Identity, FALSE);
+        }
+        crypto_memzero_secure(Key, sizeof(Key));
+    }
+
+    if (!EFI_ERROR(Status) && Entry->InitrdPath[0] != L'\0') {
+        Status = VerifyInitrdFile(Entry->InitrdPath);
+    }
+
+    Node->VerifyStatus = Status;
+    if (!EFI_ERROR(Status)) {
+        Entry->Flags |= BOOT_ENTRY_FLAG_VERIFIED;
+    }
+    return Status;
+}
+
+/**
+ * Next active entry with a kernel whose check has not run yet: EntryId
+ * first, then the others in boot order
+ */
+STATIC BOOT_ENTRY_NODE* NextUnverifiedEntry(IN UINT32 EntryId) {
+    BOOT_ENTRY_NODE* Node = FindBootEntryNode(EntryId);
+
+    if (Node && Node->VerifyStatus == EFI_NOT_STARTED) {
+        return Node;
+    }
     for (UINTN i = 0; i < gBootManagerContext.EntryCount; i++) {
-        if (gBootManagerContext.Entries[i].Flags & BOOT_ENTRY_FLAG_DEFAULT) {
-            *EntryId = gBootManagerContext.Entries[i].EntryId;
-            return EFI_SUCCESS;
+        Node = gBootManagerContext.Order[i];
+        if (Node->VerifyStatus == EFI_NOT_STARTED && (Node->Entry.Flags & BOOT_ENTRY_FLAG_ACTIVE) &&
+            Node->Entry.KernelPath[0] != L'\0') {
+            return Node;
         }
     }
-    
-    return EFI_NOT_FOUND;
+    return NULL;
 }
 
 /**
@@ -386,60 +1005,21 @@ EFI_STATUS EFIAPI VerifyBootEntry(
         return EFI_INVALID_PARAMETER;
     }
     
-    BOOT_MANAGER_ENTRY* Entry = FindBootEntryById(EntryId);
-    if (!Entry) {
+    BOOT_ENTRY_NODE* Node = FindBootEntryNode(EntryId);
+    if (!Node) {
         return EFI_NOT_FOUND;
     }
     
-    EFI_STATUS Status = EFI_SUCCESS;
-    *Verified = FALSE;
-    
-    // Load and verify kernel file
-    if (Entry->KernelPath[0] != L'\0') {
-        EFI_FILE_HANDLE FileHandle = NULL;
-        EFI_FILE_INFO *FileInfo = NULL;
-        UINT8 *FileBuffer = NULL;
-        UINTN FileSize = 0;
-        UINT8 Hash[64]; // SHA-512 hash
-        
-        Status = LoadFileFromPath(Entry->KernelPath, &FileBuffer, &FileSize);
-        if (EFI_ERROR(Status)) {
-            Print(L"Failed to load kernel file: %r\n", Status);
-            return Status;
-        }
-        
-        // Compute SHA-512 hash
-        Status = Sha512HashAll(FileBuffer, FileSize, Hash);
-        if (EFI_ERROR(Status)) {
-            Print(L"Failed to compute kernel hash: %r\n", Status);
-            FreePool(FileBuffer);
-            return Status;
-        }
-        
-        // Verify against stored signature (simplified verification)
-        Status = VerifyCryptographicSignature(Hash, sizeof(Hash), Entry->VendorGuid);
-        if (!EFI_ERROR(Status)) {
-            *Verified = TRUE;
-            Entry->Flags |= BOOT_ENTRY_FLAG_VERIFIED;
-            Print(L"Kernel verification successful\n");
-        } else {
-            Print(L"Kernel verification failed: %r\n", Status);
-        }
-        
-        if (FileBuffer) {
-            FreePool(FileBuffer);
-        }
+    EFI_STATUS Status = VerifyEntryNode(Node);
+    *Verified = !EFI_ERROR(Status);
+    if (Status == EFI_NOT_FOUND && Node->Entry.KernelPath[0] == L'\0') {
+        return EFI_SUCCESS; // Nothing to verify
     }
-    
-    // Verify initrd if present
-    if (Entry->InitrdPath[0] != L'\0' && *Verified) {
-        EFI_STATUS InitrdStatus = VerifyInitrdFile(Entry->InitrdPath);
-        if (EFI_ERROR(InitrdStatus)) {
-            Print(L"Initrd verification failed: %r\n", InitrdStatus);
-            *Verified = FALSE;
-        }
+    if (EFI_ERROR(Status)) {
+        Print(L"Kernel verification failed: %r\n", Status);
+    } else {
+        Print(L"Kernel verification successful\n");
     }
-    
     return Status;
 }
 
@@ -487,21 +1067,42 @@ EFI_STATUS EFIAPI MeasureBootEntry(
     
     UINTN EventDataSize = (StrLen(EventData) + 1) * sizeof(CHAR16);
     
-    // Hash the event data
-    UINT8 EventHash[64]; // SHA-512
-    Status = Sha512HashAll((UINT8*)EventData, EventDataSize, EventHash);
-    if (EFI_ERROR(Status)) {
-        Print(L"Failed to hash event data: %r\n", Status);
+    // Hash the event text and whatever images are resident in one batch;
+    // the PCR is extended with the list of their SHA-256 digests
+    crypto_sha256_job_t Jobs[3];
+    UINT8 DigestList[3 * CRYPTO_SHA256_DIGEST_LENGTH];
+    UINT8 EventHash[CRYPTO_SHA256_DIGEST_LENGTH];
+    UINT32 JobCount = 0;
+
+    Jobs[JobCount].data = (CONST UINT8*)EventData;
+    Jobs[JobCount].len = (UINT32)EventDataSize;
+    JobCount++;
+    if (Entry->KernelData && Entry->KernelSize > 0 && Entry->KernelSize <= MAX_UINT32) {
+        Jobs[JobCount].data = Entry->KernelData;
+        Jobs[JobCount].len = (UINT32)Entry->KernelSize;
+        JobCount++;
+    }
+    if (Entry->InitrdData && Entry->InitrdSize > 0 && Entry->InitrdSize <= MAX_UINT32) {
+        Jobs[JobCount].data = Entry->InitrdData;
+        Jobs[JobCount].len = (UINT32)Entry->InitrdSize;
+        JobCount++;
+    }
+    for (UINT32 i = 0; i < JobCount; i++) {
+        Jobs[i].digest = DigestList + i * CRYPTO_SHA256_DIGEST_LENGTH;
+    }
+
+    if (crypto_sha256_multi(Jobs, JobCount) != CRYPTO_SUCCESS) {
+        Print(L"Failed to hash boot entry\n");
         *MeasurementSize = 0;
-        return Status;
+        return EFI_DEVICE_ERROR;
     }
     
     // Extend TPM PCR with measurement
     Status = Tcg2Protocol->HashLogExtendEvent(
                      Tcg2Protocol,
                      0, // PE_COFF_IMAGE
-                     EventHash,
-                     32, // Use first 32 bytes (SHA-256)
+                     DigestList,
+                     JobCount * CRYPTO_SHA256_DIGEST_LENGTH,
                      &EventLog.Header,
                      EventData,
                      EventDataSize,
@@ -509,7 +1110,8 @@ EFI_STATUS EFIAPI MeasureBootEntry(
                      );
     
     if (!EFI_ERROR(Status)) {
-        // Return the measurement hash
+        // Return the SHA-256 the TPM extended with
+        sha256_hash(DigestList, JobCount * CRYPTO_SHA256_DIGEST_LENGTH, EventHash);
         CopyMem(Measurement, EventHash, MIN(*MeasurementSize, 32));
         *MeasurementSize = 32;
         Print(L"TPM measurement successful for entry: %s\n", Entry->Name);
@@ -533,72 +1135,53 @@ EFI_STATUS EFIAPI GetBootStatistics(
         return EFI_INVALID_PARAMETER;
     }
     
-    EFI_STATUS Status;
-    
     // Calculate current statistics
     ZeroMem(Statistics, sizeof(BOOT_MANAGER_STATISTICS));
     Statistics->TotalEntries = (UINT32)gBootManagerContext.EntryCount;
     
     for (UINTN i = 0; i < gBootManagerContext.EntryCount; i++) {
-        if (gBootManagerContext.Entries[i].Flags & BOOT_ENTRY_FLAG_ACTIVE) {
+        UINT8 Flags = gBootManagerContext.Order[i]->Entry.Flags;
+        if (Flags & BOOT_ENTRY_FLAG_ACTIVE) {
             Statistics->ActiveEntries++;
         }
-        if (gBootManagerContext.Entries[i].Flags & BOOT_ENTRY_FLAG_SECURE_BOOT) {
+        if (Flags & BOOT_ENTRY_FLAG_SECURE_BOOT) {
             Statistics->SecureBootEntries++;
         }
-        if (gBootManagerContext.Entries[i].Flags & BOOT_ENTRY_FLAG_VERIFIED) {
+        if (Flags & BOOT_ENTRY_FLAG_VERIFIED) {
             Statistics->VerifiedEntries++;
         }
     }
     
-    // Load persistent statistics from UEFI variables
-    UINTN VarSize = sizeof(UINT32);
-    Status = gRT->GetVariable(
-                 L"BloodHornBootCount",
-                 &gBloodHornVariableGuid,
-                 NULL,
-                 &VarSize,
-                 &Statistics->SuccessfulBoots
-                 );
-    if (EFI_ERROR(Status)) {
-        Statistics->SuccessfulBoots = 0;
-    }
+    // Persistent counters
+    BOOT_MANAGER_STATE* State = BootManagerState();
+    Statistics->SuccessfulBoots = State->SuccessfulBoots;
+    Statistics->FailedBoots = State->FailedBoots;
+    Statistics->TotalBootTime = State->TotalBootTime;
+    Statistics->LastBootEntryId = State->LastBootEntryId;
     
-    VarSize = sizeof(UINT32);
-    Status = gRT->GetVariable(
-                 L"BloodHornBootFailures",
-                 &gBloodHornVariableGuid,
-                 NULL,
-                 &VarSize,
-                 &Statistics->FailedBoots
-                 );
-    if (EFI_ERROR(Status)) {
-        Statistics->FailedBoots = 0;
-    }
-    
-    VarSize = sizeof(UINT64);
-    Status = gRT->GetVariable(
-                 L"BloodHornTotalBootTime",
-                 &gBloodHornVariableGuid,
-                 NULL,
-                 &VarSize,
-                 &Statistics->TotalBootTime
-                 );
-    if (EFI_ERROR(Status)) {
-        Statistics->TotalBootTime = 0;
-    }
-    
-    VarSize = sizeof(UINT32);
-    Status = gRT->GetVariable(
-                 L"BloodHornLastBootEntry",
-                 &gBloodHornVariableGuid,
-                 NULL,
-                 &VarSize,
-                 &Statistics->LastBootEntryId
-                 );
-    if (EFI_ERROR(Status)) {
-        Statistics->LastBootEntryId = 0;
+    // Per-entry latency, most recently booted first
+    UINTN Order[BOOT_MANAGER_TIMED_ENTRIES];
+    UINTN Timed = 0;
+    for (UINTN i = 0; i < BOOT_MANAGER_TIMED_ENTRIES; i++) {
+        if (!State->Timings[i].Recorded) {
+            continue;
+        }
+        UINTN Pos = Timed++;
+        for (; Pos > 0 && State->Timings[Order[Pos - 1]].LastBoot < State->Timings[i].LastBoot; Pos--) {
+            Order[Pos] = Order[Pos - 1];
+        }
+        Order[Pos] = i;
+    }
+    for (UINTN i = 0; i < Timed; i++) {
+        CONST BOOT_ENTRY_TIMING_HISTORY* History = &State->Timings[Order[i]];
+        BOOT_ENTRY_TIMING* Timing = &Statistics->EntryTimings[i];
+        Timing->EntryId = History->EntryId;
+        Timing->Samples = MIN(History->Recorded, BOOT_MANAGER_TIMING_SAMPLES);
+        for (UINTN Phase = 0; Phase < BOOT_TIMING_PHASE_COUNT; Phase++) {
+            BootPhaseTiming(History->Samples[Phase], History->Recorded, &Timing->Phase[Phase]);
+        }
     }
+    Statistics->TimedEntries = (UINT32)Timed;
     
     // Calculate average boot time
     UINT32 TotalBoots = Statistics->SuccessfulBoots + Statistics->FailedBoots;
@@ -621,288 +1204,631 @@ EFI_STATUS EFIAPI GetBootConfiguration(
         return EFI_INVALID_PARAMETER;
     }
     
-    EFI_STATUS Status;
-    UINTN VarSize;
+    BOOT_MANAGER_STATE* State = BootManagerState();
     
     ZeroMem(Configuration, sizeof(BOOT_MANAGER_CONFIGURATION));
     Configuration->Version = BOOT_MANAGER_PROTOCOL_VERSION;
+    Configuration->DefaultTimeout = State->DefaultTimeout;
+    Configuration->DefaultBootEnvironment = State->DefaultBootEnvironment;
+    Configuration->Flags = State->Flags;
+    Configuration->SecureBootPolicy = State->SecureBootPolicy;
+    CopyMem(Configuration->ThemePath, State->ThemePath, sizeof(State->ThemePath));
+    CopyMem(Configuration->ConfigPath, State->ConfigPath, sizeof(State->ConfigPath));
+    CopyMem(&Configuration->SystemGuid, &State->SystemGuid, sizeof(EFI_GUID));
     
-    // Load configuration from UEFI variables
-    VarSize = sizeof(UINT32);
-    Status = gRT->GetVariable(
-                 L"BloodHornDefaultTimeout",
-                 &gBloodHornVariableGuid,
-                 NULL,
-                 &VarSize,
-                 &Configuration->DefaultTimeout
-                 );
-    if (EFI_ERROR(Status)) {
-        Configuration->DefaultTimeout = 5; // 5 seconds default
+    return EFI_SUCCESS;
+}
+
+/**
+ * Set boot configuration
+ */
+EFI_STATUS EFIAPI SetBootConfiguration(
+    IN BOOT_MANAGER_PROTOCOL *This,
+    IN CONST BOOT_MANAGER_CONFIGURATION *Configuration
+    )
+{
+    if (!This || !Configuration) {
+        return EFI_INVALID_PARAMETER;
     }
     
-    VarSize = sizeof(UINT8);
-    Status = gRT->GetVariable(
-                 L"BloodHornBootEnvironment",
-                 &gBloodHornVariableGuid,
-                 NULL,
-                 &VarSize,
-                 &Configuration->DefaultBootEnvironment
-                 );
-    if (EFI_ERROR(Status)) {
-        Configuration->DefaultBootEnvironment = BOOT_ENVIRONMENT_AUTO;
+    // Validate configuration version
+    if (Configuration->Version != BOOT_MANAGER_PROTOCOL_VERSION) {
+        Print(L"Configuration version mismatch\n");
+        return EFI_INVALID_PARAMETER;
     }
     
-    VarSize = sizeof(UINT8);
-    Status = gRT->GetVariable(
-                 L"BloodHornFlags",
-                 &gBloodHornVariableGuid,
-                 NULL,
-                 &VarSize,
-                 &Configuration->Flags
-                 );
-    if (EFI_ERROR(Status)) {
-        Configuration->Flags = BOOT_MANAGER_FLAG_SECURE_BOOT;
-    }
+    // Staged in the state blob; BootManagerFlushState writes it once
+    BOOT_MANAGER_STATE* State = BootManagerState();
+    BOOT_MANAGER_STATE Previous;
+    CopyMem(&Previous, State, sizeof(Previous));
     
-    VarSize = sizeof(UINT8);
-    Status = gRT->GetVariable(
-                 L"BloodHornSecureBootPolicy",
-                 &gBloodHornVariableGuid,
-                 NULL,
-                 &VarSize,
-                 &Configuration->SecureBootPolicy
-                 );
-    if (EFI_ERROR(Status)) {
-        Configuration->SecureBootPolicy = 1; // Enabled
+    State->DefaultTimeout = Configuration->DefaultTimeout;
+    State->DefaultBootEnvironment = Configuration->DefaultBootEnvironment;
+    State->Flags = Configuration->Flags;
+    State->SecureBootPolicy = Configuration->SecureBootPolicy;
+    StrnCpyS(State->ThemePath, ARRAY_SIZE(State->ThemePath), Configuration->ThemePath, ARRAY_SIZE(State->ThemePath) - 1);
+    StrnCpyS(State->ConfigPath, ARRAY_SIZE(State->ConfigPath), Configuration->ConfigPath, ARRAY_SIZE(State->ConfigPath) - 1);
+    CopyMem(&State->SystemGuid, &Configuration->SystemGuid, sizeof(EFI_GUID));
+    
+    if (CompareMem(&Previous, State, sizeof(Previous)) != 0) {
+        mStateDirty = TRUE;
+    }
+    return EFI_SUCCESS;
+}
+
+/**
+ * Reset boot statistics
+ */
+EFI_STATUS EFIAPI ResetBootStatistics(
+    IN BOOT_MANAGER_PROTOCOL *This
+    )
+{
+    if (!This) {
+        return EFI_INVALID_PARAMETER;
     }
     
-    // Load string configurations
-    VarSize = sizeof(Configuration->ThemePath);
-    Status = gRT->GetVariable(
-                 L"BloodHornThemePath",
-                 &gBloodHornVariableGuid,
-                 NULL,
-                 &VarSize,
-                 Configuration->ThemePath
-                 );
-    if (EFI_ERROR(Status)) {
-        StrCpyS(Configuration->ThemePath, sizeof(Configuration->ThemePath), L"\\EFI\\BloodHorn\\themes\\default");
+    BOOT_MANAGER_STATE* State = BootManagerState();
+    if (State->SuccessfulBoots || State->FailedBoots || State->TotalBootTime || State->LastBootEntryId) {
+        State->SuccessfulBoots = 0;
+        State->FailedBoots = 0;
+        State->TotalBootTime = 0;
+        State->LastBootEntryId = 0;
+        mStateDirty = TRUE;
     }
     
-    VarSize = sizeof(Configuration->ConfigPath);
-    Status = gRT->GetVariable(
-                 L"BloodHornConfigPath",
-                 &gBloodHornVariableGuid,
-                 NULL,
-                 &VarSize,
-                 Configuration->ConfigPath
-                 );
+    Print(L"Boot statistics reset successfully\n");
+    return EFI_SUCCESS;
+}
+
+STATIC CONST CHAR8* mTimingPhaseNames[BOOT_TIMING_PHASE_COUNT] = { "load", "verify", "measure", "handoff" };
+
+/**
+ * Append the per-entry latency table to an export buffer in Format
+ */
+STATIC VOID AppendEntryTimings(
+    IN OUT CHAR8 *Buffer,
+    IN UINTN BufferSize,
+    IN UINT8 Format,
+    IN CONST BOOT_MANAGER_STATISTICS *Stats
+    )
+{
+    UINTN Used = AsciiStrLen(Buffer);
+    
+    for (UINT32 i = 0; i < Stats->TimedEntries; i++) {
+        CONST BOOT_ENTRY_TIMING* Timing = &Stats->EntryTimings[i];
+        
+        if (Format == 0) {
+            Used += AsciiSPrint(Buffer + Used, BufferSize - Used, "%a      { \"entry_id\": %u, \"samples\": %u",
+                                i ? ",\n" : "", Timing->EntryId, Timing->Samples);
+        } else if (Format == 1) {
+            Used += AsciiSPrint(Buffer + Used, BufferSize - Used, "      <Entry Id=\"%u\" Samples=\"%u\">\n",
+                                Timing->EntryId, Timing->Samples);
+        } else {
+            Used += AsciiSPrint(Buffer + Used, BufferSize - Used, "\n[Timing.%u]\nsamples=%u\n",
+                                Timing->EntryId, Timing->Samples);
+        }
+        
+        for (UINTN Phase = 0; Phase < BOOT_TIMING_PHASE_COUNT; Phase++) {
+            CONST BOOT_PHASE_TIMING* P = &Timing->Phase[Phase];
+            CONST CHAR8* Name = mTimingPhaseNames[Phase];
+            if (Format == 0) {
+                Used += AsciiSPrint(Buffer + Used, BufferSize - Used, ", \"%a\": { \"p50\": %u, \"p95\": %u, \"max\": %u }",
+                                    Name, P->P50, P->P95, P->Max);
+            } else if (Format == 1) {
+                Used += AsciiSPrint(Buffer + Used, BufferSize - Used,
+                                    "        <Phase Name=\"%a\" P50=\"%u\" P95=\"%u\" Max=\"%u\"/>\n",
+                                    Name, P->P50, P->P95, P->Max);
+            } else {
+                Used += AsciiSPrint(Buffer + Used, BufferSize - Used, "%a_p50=%u\n%a_p95=%u\n%a_max=%u\n",
+                                    Name, P->P50, Name, P->P95, Name, P->Max);
+            }
+        }
+        
+        if (Format == 0) {
+            Used += AsciiSPrint(Buffer + Used, BufferSize - Used, " }");
+        } else if (Format == 1) {
+            Used += AsciiSPrint(Buffer + Used, BufferSize - Used, "      </Entry>\n");
+        }
+    }
+}
+
+// =============================================================================
+// BINARY CONFIGURATION EXPORT
+// =============================================================================
+
+STATIC EFI_STATUS GetRootDir(OUT EFI_FILE_HANDLE* RootDir);
+STATIC EFI_STATUS ValidateBootEntry(CONST BOOT_MANAGER_ENTRY* Entry);
+
+// File I/O goes through one buffer of this size each way, however many
+// entries there are
+#define BOOT_EXPORT_BUFFER_SIZE     4096
+
+// Where a TLV field lives in its structure
+typedef struct {
+    UINT16 Tag;
+    UINT16 Offset;
+    UINT16 Size;
+    BOOLEAN String;                     // CHAR16 array; otherwise a number of Size bytes
+} BOOT_EXPORT_FIELD;
+
+#define BOOT_EXPORT_FIELD_OF(Tag, Type, Member, String) \
+    { Tag, (UINT16)OFFSET_OF(Type, Member), (UINT16)sizeof(((Type*)0)->Member), String }
+
+STATIC CONST BOOT_EXPORT_FIELD mExportConfigFields[] = {
+    BOOT_EXPORT_FIELD_OF(BOOT_EXPORT_CONFIG_TIMEOUT, BOOT_MANAGER_CONFIGURATION, DefaultTimeout, FALSE),
+    BOOT_EXPORT_FIELD_OF(BOOT_EXPORT_CONFIG_ENVIRONMENT, BOOT_MANAGER_CONFIGURATION, DefaultBootEnvironment, FALSE),
+    BOOT_EXPORT_FIELD_OF(BOOT_EXPORT_CONFIG_FLAGS, BOOT_MANAGER_CONFIGURATION, Flags, FALSE),
+    BOOT_EXPORT_FIELD_OF(BOOT_EXPORT_CONFIG_SECURE_BOOT, BOOT_MANAGER_CONFIGURATION, SecureBootPolicy, FALSE),
+    BOOT_EXPORT_FIELD_OF(BOOT_EXPORT_CONFIG_ICON, BOOT_MANAGER_CONFIGURATION, DefaultIconPath, TRUE),
+    BOOT_EXPORT_FIELD_OF(BOOT_EXPORT_CONFIG_THEME, BOOT_MANAGER_CONFIGURATION, ThemePath, TRUE),
+    BOOT_EXPORT_FIELD_OF(BOOT_EXPORT_CONFIG_PATH, BOOT_MANAGER_CONFIGURATION, ConfigPath, TRUE),
+    BOOT_EXPORT_FIELD_OF(BOOT_EXPORT_CONFIG_SYSTEM_GUID, BOOT_MANAGER_CONFIGURATION, SystemGuid, FALSE),
+};
+
+STATIC CONST BOOT_EXPORT_FIELD mExportEntryFields[] = {
+    BOOT_EXPORT_FIELD_OF(BOOT_EXPORT_ENTRY_NAME, BOOT_MANAGER_ENTRY, Name, TRUE),
+    BOOT_EXPORT_FIELD_OF(BOOT_EXPORT_ENTRY_DESCRIPTION, BOOT_MANAGER_ENTRY, Description, TRUE),
+    BOOT_EXPORT_FIELD_OF(BOOT_EXPORT_ENTRY_DEVICE_PATH, BOOT_MANAGER_ENTRY, DevicePath, TRUE),
+    BOOT_EXPORT_FIELD_OF(BOOT_EXPORT_ENTRY_KERNEL, BOOT_MANAGER_ENTRY, KernelPath, TRUE),
+    BOOT_EXPORT_FIELD_OF(BOOT_EXPORT_ENTRY_INITRD, BOOT_MANAGER_ENTRY, InitrdPath, TRUE),
+    BOOT_EXPORT_FIELD_OF(BOOT_EXPORT_ENTRY_CMDLINE, BOOT_MANAGER_ENTRY, CommandLine, TRUE),
+    BOOT_EXPORT_FIELD_OF(BOOT_EXPORT_ENTRY_ICON, BOOT_MANAGER_ENTRY, IconPath, TRUE),
+    BOOT_EXPORT_FIELD_OF(BOOT_EXPORT_ENTRY_TYPE, BOOT_MANAGER_ENTRY, EntryType, FALSE),
+    BOOT_EXPORT_FIELD_OF(BOOT_EXPORT_ENTRY_ENVIRONMENT, BOOT_MANAGER_ENTRY, BootEnvironment, FALSE),
+    BOOT_EXPORT_FIELD_OF(BOOT_EXPORT_ENTRY_FLAGS, BOOT_MANAGER_ENTRY, Flags, FALSE),
+    BOOT_EXPORT_FIELD_OF(BOOT_EXPORT_ENTRY_SIGNATURE, BOOT_MANAGER_ENTRY, SignatureAlgorithm, FALSE),
+    BOOT_EXPORT_FIELD_OF(BOOT_EXPORT_ENTRY_VENDOR_GUID, BOOT_MANAGER_ENTRY, VendorGuid, FALSE),
+    BOOT_EXPORT_FIELD_OF(BOOT_EXPORT_ENTRY_TIMEOUT, BOOT_MANAGER_ENTRY, Timeout, FALSE),
+    BOOT_EXPORT_FIELD_OF(BOOT_EXPORT_ENTRY_LOAD_ADDRESS, BOOT_MANAGER_ENTRY, LoadAddress, FALSE),
+    BOOT_EXPORT_FIELD_OF(BOOT_EXPORT_ENTRY_ENTRY_ADDRESS, BOOT_MANAGER_ENTRY, EntryAddress, FALSE),
+    BOOT_EXPORT_FIELD_OF(BOOT_EXPORT_ENTRY_ATTRIBUTES, BOOT_MANAGER_ENTRY, Attributes, FALSE),
+};
+
+typedef struct {
+    EFI_FILE_HANDLE File;
+    EFI_STATUS Status;                  // First write error; later writes are dropped
+    UINTN Used;
+    UINT8 Buffer[BOOT_EXPORT_BUFFER_SIZE];
+} BOOT_EXPORT_WRITER;
+
+typedef struct {
+    EFI_FILE_HANDLE File;
+    UINTN Used;                         // Bytes of Buffer consumed
+    UINTN Size;                         // Bytes of Buffer filled
+    UINT8 Buffer[BOOT_EXPORT_BUFFER_SIZE];
+} BOOT_EXPORT_READER;
+
+/**
+ * Open Path on the boot volume for reading, or as a new empty file
+ */
+STATIC EFI_STATUS OpenExportFile(IN CONST CHAR16* Path, IN BOOLEAN Create, OUT EFI_FILE_HANDLE* File) {
+    EFI_FILE_HANDLE RootDir;
+    EFI_STATUS Status = GetRootDir(&RootDir);
     if (EFI_ERROR(Status)) {
-        StrCpyS(Configuration->ConfigPath, sizeof(Configuration->ConfigPath), L"\\EFI\\BloodHorn\\bootmgr.conf");
+        return Status;
+    }
+    if (!Create) {
+        return RootDir->Open(RootDir, File, (CHAR16*)Path, EFI_FILE_MODE_READ, 0);
     }
     
-    VarSize = sizeof(EFI_GUID);
-    Status = gRT->GetVariable(
-                 L"BloodHornSystemGuid",
-                 &gBloodHornVariableGuid,
-                 NULL,
-                 &VarSize,
-                 &Configuration->SystemGuid
-                 );
-    if (EFI_ERROR(Status)) {
-        // Generate a random system GUID if not exists
-        Status = gBS->CreateEvent(0, 0, NULL, NULL, (EFI_EVENT*)&Configuration->SystemGuid);
-        if (!EFI_ERROR(Status)) {
-            gRT->SetVariable(
-                L"BloodHornSystemGuid",
-                &gBloodHornVariableGuid,
-                EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS,
-                sizeof(EFI_GUID),
-                &Configuration->SystemGuid
-                );
+    // Writing over an older, longer export would leave its tail behind
+    if (!EFI_ERROR(RootDir->Open(RootDir, File, (CHAR16*)Path, EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE, 0))) {
+        (*File)->Delete(*File);
+    }
+    return RootDir->Open(RootDir, File, (CHAR16*)Path,
+                         EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE, 0);
+}
+
+STATIC EFI_STATUS ExportFlush(IN OUT BOOT_EXPORT_WRITER* Writer) {
+    if (Writer->Used && !EFI_ERROR(Writer->Status)) {
+        UINTN Size = Writer->Used;
+        Writer->Status = Writer->File->Write(Writer->File, &Size, Writer->Buffer);
+        if (!EFI_ERROR(Writer->Status) && Size != Writer->Used) {
+            Writer->Status = EFI_VOLUME_FULL;
+        }
+    }
+    Writer->Used = 0;
+    return Writer->Status;
+}
+
+STATIC VOID ExportWrite(IN OUT BOOT_EXPORT_WRITER* Writer, IN CONST VOID* Data, IN UINTN Length) {
+    while (Length && !EFI_ERROR(Writer->Status)) {
+        if (Writer->Used == sizeof(Writer->Buffer)) {
+            ExportFlush(Writer);
+            continue;
         }
+        UINTN Chunk = MIN(Length, sizeof(Writer->Buffer) - Writer->Used);
+        CopyMem(Writer->Buffer + Writer->Used, Data, Chunk);
+        Writer->Used += Chunk;
+        Data = (CONST UINT8*)Data + Chunk;
+        Length -= Chunk;
+    }
+}
+
+STATIC VOID ExportPrint(IN OUT BOOT_EXPORT_WRITER* Writer, IN CONST CHAR8* Format, ...) {
+    CHAR8 Line[BOOT_MANAGER_MAX_CMDLINE_LENGTH + 64];
+    VA_LIST Args;
+    
+    VA_START(Args, Format);
+    UINTN Length = AsciiVSPrint(Line, sizeof(Line), Format, Args);
+    VA_END(Args);
+    ExportWrite(Writer, Line, Length);
+}
+
+/**
+ * Bytes a field takes in a record's value, 0 if it is left out
+ */
+STATIC UINTN ExportFieldLength(IN CONST BOOT_EXPORT_FIELD* Field, IN CONST VOID* Base) {
+    CONST UINT8* Value = (CONST UINT8*)Base + Field->Offset;
+    if (Field->String) {
+        return StrnLenS((CONST CHAR16*)Value, Field->Size / sizeof(CHAR16)) * sizeof(CHAR16);
     }
+    return IsZeroBuffer(Value, Field->Size) ? 0 : Field->Size;
+}
+
+/**
+ * Write Base as one record of its non-empty fields
+ */
+STATIC VOID ExportWriteRecord(
+    IN OUT BOOT_EXPORT_WRITER* Writer,
+    IN UINT16 Type,
+    IN CONST BOOT_EXPORT_FIELD* Fields,
+    IN UINTN FieldCount,
+    IN CONST VOID* Base
+    )
+{
+    BOOT_MANAGER_EXPORT_TLV Record = { Type, 0 };
     
+    for (UINTN i = 0; i < FieldCount; i++) {
+        UINTN Length = ExportFieldLength(&Fields[i], Base);
+        if (Length) {
+            Record.Length += (UINT16)(sizeof(BOOT_MANAGER_EXPORT_TLV) + Length);
+        }
+    }
+    ExportWrite(Writer, &Record, sizeof(Record));
+    for (UINTN i = 0; i < FieldCount; i++) {
+        BOOT_MANAGER_EXPORT_TLV Field = { Fields[i].Tag, (UINT16)ExportFieldLength(&Fields[i], Base) };
+        if (Field.Length) {
+            ExportWrite(Writer, &Field, sizeof(Field));
+            ExportWrite(Writer, (CONST UINT8*)Base + Fields[i].Offset, Field.Length);
+        }
+    }
+}
+
+/**
+ * Read Length bytes into Data, or skip them if Data is NULL
+ */
+STATIC EFI_STATUS ExportRead(IN OUT BOOT_EXPORT_READER* Reader, OUT VOID* Data OPTIONAL, IN UINTN Length) {
+    while (Length) {
+        if (Reader->Used == Reader->Size) {
+            UINTN Size = sizeof(Reader->Buffer);
+            EFI_STATUS Status = Reader->File->Read(Reader->File, &Size, Reader->Buffer);
+            if (EFI_ERROR(Status)) {
+                return Status;
+            }
+            if (!Size) {
+                return EFI_END_OF_FILE;
+            }
+            Reader->Used = 0;
+            Reader->Size = Size;
+        }
+        UINTN Chunk = MIN(Length, Reader->Size - Reader->Used);
+        if (Data) {
+            CopyMem(Data, Reader->Buffer + Reader->Used, Chunk);
+            Data = (UINT8*)Data + Chunk;
+        }
+        Reader->Used += Chunk;
+        Length -= Chunk;
+    }
     return EFI_SUCCESS;
 }
 
 /**
- * Set boot configuration
+ * Decode Length bytes of fields into Base. Strings present replace the old
+ * value; fields absent keep theirs.
  */
-EFI_STATUS EFIAPI SetBootConfiguration(
-    IN BOOT_MANAGER_PROTOCOL *This,
-    IN CONST BOOT_MANAGER_CONFIGURATION *Configuration
+STATIC EFI_STATUS ExportReadFields(
+    IN OUT BOOT_EXPORT_READER* Reader,
+    IN CONST BOOT_EXPORT_FIELD* Fields,
+    IN UINTN FieldCount,
+    IN OUT VOID* Base,
+    IN UINTN Length
     )
 {
-    if (!This || !Configuration) {
-        return EFI_INVALID_PARAMETER;
+    while (Length) {
+        BOOT_MANAGER_EXPORT_TLV Tlv;
+        if (Length < sizeof(Tlv)) {
+            return EFI_VOLUME_CORRUPTED;
+        }
+        EFI_STATUS Status = ExportRead(Reader, &Tlv, sizeof(Tlv));
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+        Length -= sizeof(Tlv);
+        if (Tlv.Length > Length) {
+            return EFI_VOLUME_CORRUPTED;
+        }
+        Length -= Tlv.Length;
+        
+        CONST BOOT_EXPORT_FIELD* Field = NULL;
+        for (UINTN i = 0; i < FieldCount && !Field; i++) {
+            if (Fields[i].Tag == Tlv.Type) {
+                Field = &Fields[i];
+            }
+        }
+        UINT8* Value = Field ? (UINT8*)Base + Field->Offset : NULL;
+        UINTN Take = 0;
+        if (Field && Field->String) {
+            // Truncated to fit, with room for the terminator
+            ZeroMem(Value, Field->Size);
+            Take = MIN(Tlv.Length, Field->Size - sizeof(CHAR16)) & ~(UINTN)1;
+        } else if (Field && Tlv.Length == Field->Size) {
+            Take = Tlv.Length;
+        }
+        Status = ExportRead(Reader, Value, Take);
+        if (!EFI_ERROR(Status)) {
+            Status = ExportRead(Reader, NULL, Tlv.Length - Take);
+        }
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
     }
-    
-    EFI_STATUS Status;
-    
-    // Validate configuration version
-    if (Configuration->Version != BOOT_MANAGER_PROTOCOL_VERSION) {
-        Print(L"Configuration version mismatch\n");
-        return EFI_INVALID_PARAMETER;
+    return EFI_SUCCESS;
+}
+
+/**
+ * Open a binary export and check its header
+ */
+STATIC EFI_STATUS OpenExportReader(IN CONST CHAR16* Path, OUT BOOT_EXPORT_READER** Reader) {
+    BOOT_MANAGER_EXPORT_HEADER Header;
+    BOOT_EXPORT_READER* New = AllocateZeroPool(sizeof(BOOT_EXPORT_READER));
+    if (!New) {
+        return EFI_OUT_OF_RESOURCES;
     }
     
-    // Save configuration to UEFI variables
-    Status = gRT->SetVariable(
-                 L"BloodHornDefaultTimeout",
-                 &gBloodHornVariableGuid,
-                 EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS,
-                 sizeof(UINT32),
-                 &Configuration->DefaultTimeout
-                 );
+    EFI_STATUS Status = OpenExportFile(Path, FALSE, &New->File);
     if (EFI_ERROR(Status)) {
-        Print(L"Failed to save timeout: %r\n", Status);
+        FreePool(New);
         return Status;
     }
-    
-    Status = gRT->SetVariable(
-                 L"BloodHornBootEnvironment",
-                 &gBloodHornVariableGuid,
-                 EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS,
-                 sizeof(UINT8),
-                 &Configuration->DefaultBootEnvironment
-                 );
+    Status = ExportRead(New, &Header, sizeof(Header));
+    if (Status == EFI_END_OF_FILE ||
+        (!EFI_ERROR(Status) && Header.Magic != BOOT_MANAGER_EXPORT_MAGIC)) {
+        Status = EFI_VOLUME_CORRUPTED;
+    } else if (!EFI_ERROR(Status) && Header.Version != BOOT_MANAGER_EXPORT_VERSION) {
+        Status = EFI_UNSUPPORTED;
+    }
     if (EFI_ERROR(Status)) {
-        Print(L"Failed to save boot environment: %r\n", Status);
+        New->File->Close(New->File);
+        FreePool(New);
         return Status;
     }
+    *Reader = New;
+    return EFI_SUCCESS;
+}
+
+STATIC VOID CloseExportReader(IN BOOT_EXPORT_READER* Reader) {
+    Reader->File->Close(Reader->File);
+    FreePool(Reader);
+}
+
+/**
+ * Read the next record. A configuration record is decoded over *Config,
+ * an entry record into a cleared *Entry; other records are skipped. A file
+ * that ends before its END record is reported as corrupted.
+ */
+STATIC EFI_STATUS ExportReadRecord(
+    IN OUT BOOT_EXPORT_READER* Reader,
+    OUT UINT16* Type,
+    IN OUT BOOT_MANAGER_CONFIGURATION* Config,
+    OUT BOOT_MANAGER_ENTRY* Entry
+    )
+{
+    BOOT_MANAGER_EXPORT_TLV Record;
+    EFI_STATUS Status = ExportRead(Reader, &Record, sizeof(Record));
+    
+    if (!EFI_ERROR(Status)) {
+        *Type = Record.Type;
+        if (Record.Type == BOOT_EXPORT_RECORD_CONFIG) {
+            Status = ExportReadFields(Reader, mExportConfigFields, ARRAY_SIZE(mExportConfigFields), Config, Record.Length);
+        } else if (Record.Type == BOOT_EXPORT_RECORD_ENTRY) {
+            ZeroMem(Entry, sizeof(BOOT_MANAGER_ENTRY));
+            Status = ExportReadFields(Reader, mExportEntryFields, ARRAY_SIZE(mExportEntryFields), Entry, Record.Length);
+        } else {
+            Status = ExportRead(Reader, NULL, Record.Length);
+        }
+    }
+    return Status == EFI_END_OF_FILE ? EFI_VOLUME_CORRUPTED : Status;
+}
+
+/**
+ * Remove the entries in [From, To) of the boot order
+ */
+STATIC VOID BootEntryStoreDrop(IN UINTN From, IN UINTN To) {
+    UINTN Dropped = To - From;
+    
+    for (UINTN i = From; i < To; i++) {
+        if (gBootManagerContext.Default == gBootManagerContext.Order[i]) {
+            gBootManagerContext.Default = NULL;
+        }
+        FreePool(gBootManagerContext.Order[i]);
+    }
+    for (UINTN i = To; i < gBootManagerContext.EntryCount; i++) {
+        gBootManagerContext.Order[i - Dropped] = gBootManagerContext.Order[i];
+        gBootManagerContext.Order[i - Dropped]->Position = i - Dropped;
+    }
+    gBootManagerContext.EntryCount -= Dropped;
+    BootEntryIndexRebuild(gBootManagerContext.EntryCount);
+}
+
+/**
+ * Stream the configuration and every entry to Path, one record at a time
+ */
+STATIC EFI_STATUS ExportBinaryConfiguration(IN CONST BOOT_MANAGER_CONFIGURATION* Config, IN CONST CHAR16* Path) {
+    BOOT_MANAGER_EXPORT_HEADER Header = { BOOT_MANAGER_EXPORT_MAGIC, BOOT_MANAGER_EXPORT_VERSION, 0 };
+    BOOT_MANAGER_EXPORT_TLV End = { BOOT_EXPORT_RECORD_END, 0 };
+    BOOT_EXPORT_WRITER* Writer = AllocateZeroPool(sizeof(BOOT_EXPORT_WRITER));
+    if (!Writer) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    
+    EFI_STATUS Status = OpenExportFile(Path, TRUE, &Writer->File);
+    if (!EFI_ERROR(Status)) {
+        ExportWrite(Writer, &Header, sizeof(Header));
+        ExportWriteRecord(Writer, BOOT_EXPORT_RECORD_CONFIG, mExportConfigFields, ARRAY_SIZE(mExportConfigFields), Config);
+        for (UINTN i = 0; i < gBootManagerContext.EntryCount; i++) {
+            ExportWriteRecord(Writer, BOOT_EXPORT_RECORD_ENTRY, mExportEntryFields, ARRAY_SIZE(mExportEntryFields),
+                              &gBootManagerContext.Order[i]->Entry);
+        }
+        ExportWrite(Writer, &End, sizeof(End));
+        Status = ExportFlush(Writer);
+        Writer->File->Close(Writer->File);
+    }
+    FreePool(Writer);
+    return Status;
+}
+
+/**
+ * Read a binary export. Its entries are appended as they are read and
+ * take the old ones' place only once the END record is reached; on any
+ * error they are dropped again and nothing changes.
+ */
+STATIC EFI_STATUS ImportBinaryConfiguration(IN BOOT_MANAGER_PROTOCOL* This, IN CONST CHAR16* Path) {
+    BOOT_EXPORT_READER* Reader = NULL;
+    BOOT_MANAGER_CONFIGURATION Config;
+    UINTN Kept = gBootManagerContext.EntryCount;
+    BOOT_ENTRY_NODE* Default = gBootManagerContext.Default;
+    BOOLEAN HaveConfig = FALSE;
+    UINT16 Type = 0;
     
-    Status = gRT->SetVariable(
-                 L"BloodHornFlags",
-                 &gBloodHornVariableGuid,
-                 EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS,
-                 sizeof(UINT8),
-                 &Configuration->Flags
-                 );
-    if (EFI_ERROR(Status)) {
-        Print(L"Failed to save flags: %r\n", Status);
-        return Status;
+    BOOT_MANAGER_ENTRY* Entry = AllocatePool(sizeof(BOOT_MANAGER_ENTRY));
+    if (!Entry) {
+        return EFI_OUT_OF_RESOURCES;
     }
-    
-    Status = gRT->SetVariable(
-                 L"BloodHornSecureBootPolicy",
-                 &gBloodHornVariableGuid,
-                 EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS,
-                 sizeof(UINT8),
-                 &Configuration->SecureBootPolicy
-                 );
-    if (EFI_ERROR(Status)) {
-        Print(L"Failed to save secure boot policy: %r\n", Status);
-        return Status;
+    EFI_STATUS Status = GetBootConfiguration(This, &Config);
+    if (!EFI_ERROR(Status)) {
+        Status = OpenExportReader(Path, &Reader);
     }
-    
-    // Save string configurations
-    Status = gRT->SetVariable(
-                 L"BloodHornThemePath",
-                 &gBloodHornVariableGuid,
-                 EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS,
-                 StrSize(Configuration->ThemePath),
-                 Configuration->ThemePath
-                 );
-    if (EFI_ERROR(Status)) {
-        Print(L"Failed to save theme path: %r\n", Status);
-        return Status;
+    while (!EFI_ERROR(Status) && Type != BOOT_EXPORT_RECORD_END) {
+        Status = ExportReadRecord(Reader, &Type, &Config, Entry);
+        if (EFI_ERROR(Status)) {
+            break;
+        }
+        if (Type == BOOT_EXPORT_RECORD_CONFIG) {
+            HaveConfig = TRUE;
+        } else if (Type == BOOT_EXPORT_RECORD_ENTRY) {
+            Status = ValidateBootEntry(Entry);
+            if (!EFI_ERROR(Status)) {
+                Status = BootEntryStoreAppend(Entry, NULL);
+            }
+        }
     }
-    
-    Status = gRT->SetVariable(
-                 L"BloodHornConfigPath",
-                 &gBloodHornVariableGuid,
-                 EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS,
-                 StrSize(Configuration->ConfigPath),
-                 Configuration->ConfigPath
-                 );
-    if (EFI_ERROR(Status)) {
-        Print(L"Failed to save config path: %r\n", Status);
-        return Status;
+    if (Reader) {
+        CloseExportReader(Reader);
     }
     
-    Status = gRT->SetVariable(
-                 L"BloodHornSystemGuid",
-                 &gBloodHornVariableGuid,
-                 EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS,
-                 sizeof(EFI_GUID),
-                 &Configuration->SystemGuid
-                 );
-    if (EFI_ERROR(Status)) {
-        Print(L"Failed to save system GUID: %r\n", Status);
-        return Status;
+    if (!EFI_ERROR(Status) && HaveConfig) {
+        Status = SetBootConfiguration(This, &Config);
     }
-    
-    Print(L"Boot configuration saved successfully\n");
-    return EFI_SUCCESS;
+    if (!EFI_ERROR(Status)) {
+        BootEntryStoreDrop(0, Kept);
+    } else {
+        BootEntryStoreDrop(Kept, gBootManagerContext.EntryCount);
+        if (Default) {
+            Default->Entry.Flags |= BOOT_ENTRY_FLAG_DEFAULT;
+            gBootManagerContext.Default = Default;
+        }
+    }
+    FreePool(Entry);
+    return Status;
 }
 
 /**
- * Reset boot statistics
+ * Convert a binary export to INI text
  */
-EFI_STATUS EFIAPI ResetBootStatistics(
-    IN BOOT_MANAGER_PROTOCOL *This
+EFI_STATUS EFIAPI ConvertConfiguration(
+    IN BOOT_MANAGER_PROTOCOL *This,
+    IN CHAR16 *BinaryPath,
+    IN CHAR16 *TextPath
     )
 {
-    if (!This) {
+    if (!This || !BinaryPath || !TextPath) {
         return EFI_INVALID_PARAMETER;
     }
     
-    EFI_STATUS Status;
-    
-    // Reset all statistics variables to zero
-    UINT32 ZeroValue = 0;
-    UINT64 Zero64 = 0;
+    BOOT_EXPORT_READER* Reader = NULL;
+    BOOT_EXPORT_WRITER* Writer = AllocateZeroPool(sizeof(BOOT_EXPORT_WRITER));
+    BOOT_MANAGER_ENTRY* Entry = AllocatePool(sizeof(BOOT_MANAGER_ENTRY));
+    BOOT_MANAGER_CONFIGURATION Config;
+    UINT16 Type = 0;
+    UINT32 Index = 0;
+    EFI_STATUS Status = EFI_OUT_OF_RESOURCES;
     
-    Status = gRT->SetVariable(
-                 L"BloodHornBootCount",
-                 &gBloodHornVariableGuid,
-                 EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS,
-                 sizeof(UINT32),
-                 &ZeroValue
-                 );
-    if (EFI_ERROR(Status)) {
-        Print(L"Failed to reset boot count: %r\n", Status);
-        return Status;
+    if (Writer && Entry) {
+        Status = OpenExportReader(BinaryPath, &Reader);
     }
-    
-    Status = gRT->SetVariable(
-                 L"BloodHornBootFailures",
-                 &gBloodHornVariableGuid,
-                 EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS,
-                 sizeof(UINT32),
-                 &ZeroValue
-                 );
-    if (EFI_ERROR(Status)) {
-        Print(L"Failed to reset boot failures: %r\n", Status);
-        return Status;
+    if (!EFI_ERROR(Status)) {
+        Status = OpenExportFile(TextPath, TRUE, &Writer->File);
+        if (EFI_ERROR(Status)) {
+            CloseExportReader(Reader);
+        }
     }
-    
-    Status = gRT->SetVariable(
-                 L"BloodHornTotalBootTime",
-                 &gBloodHornVariableGuid,
-                 EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS,
-                 sizeof(UINT64),
-                 &Zero64
-                 );
-    if (EFI_ERROR(Status)) {
-        Print(L"Failed to reset total boot time: %r\n", Status);
-        return Status;
+    if (!EFI_ERROR(Status)) {
+        ExportPrint(Writer, "; Converted from %s (binary format %u)\n", BinaryPath, BOOT_MANAGER_EXPORT_VERSION);
+        while (!EFI_ERROR(Writer->Status) && Type != BOOT_EXPORT_RECORD_END) {
+            ZeroMem(&Config, sizeof(Config));
+            Status = ExportReadRecord(Reader, &Type, &Config, Entry);
+            if (EFI_ERROR(Status)) {
+                break;
+            }
+            if (Type == BOOT_EXPORT_RECORD_CONFIG) {
+                ExportPrint(Writer,
+                            "\n[BloodHorn Configuration]\n"
+                            "default_timeout=%u\n"
+                            "boot_environment=%u\n"
+                            "flags=0x%02x\n"
+                            "secure_boot_policy=%u\n"
+                            "default_icon_path=%s\n"
+                            "theme_path=%s\n"
+                            "config_path=%s\n"
+                            "system_guid=%g\n",
+                            Config.DefaultTimeout, Config.DefaultBootEnvironment, Config.Flags,
+                            Config.SecureBootPolicy, Config.DefaultIconPath, Config.ThemePath,
+                            Config.ConfigPath, &Config.SystemGuid);
+            } else if (Type == BOOT_EXPORT_RECORD_ENTRY) {
+                // One line per print: the command line alone nearly fills the buffer
+                ExportPrint(Writer, "\n[Entry.%u]\nname=%s\n", Index++, Entry->Name);
+                ExportPrint(Writer, "type=%u\nenvironment=%u\nflags=0x%02x\nsignature=%u\n",
+                            Entry->EntryType, Entry->BootEnvironment, Entry->Flags, Entry->SignatureAlgorithm);
+                ExportPrint(Writer, "description=%s\n", Entry->Description);
+                ExportPrint(Writer, "device_path=%s\n", Entry->DevicePath);
+                ExportPrint(Writer, "kernel=%s\n", Entry->KernelPath);
+                ExportPrint(Writer, "initrd=%s\n", Entry->InitrdPath);
+                ExportPrint(Writer, "cmdline=%s\n", Entry->CommandLine);
+                ExportPrint(Writer, "icon=%s\n", Entry->IconPath);
+                ExportPrint(Writer, "vendor_guid=%g\ntimeout=%u\nload_address=0x%lx\nentry_address=0x%lx\nattributes=0x%x\n",
+                            &Entry->VendorGuid, Entry->Timeout, Entry->LoadAddress, Entry->EntryAddress, Entry->Attributes);
+            }
+        }
+        if (!EFI_ERROR(Status)) {
+            Status = ExportFlush(Writer);
+        }
+        Writer->File->Close(Writer->File);
+        CloseExportReader(Reader);
     }
     
-    Status = gRT->SetVariable(
-                 L"BloodHornLastBootEntry",
-                 &gBloodHornVariableGuid,
-                 EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS,
-                 sizeof(UINT32),
-                 &ZeroValue
-                 );
-    if (EFI_ERROR(Status)) {
-        Print(L"Failed to reset last boot entry: %r\n", Status);
-        return Status;
+    if (Writer) {
+        FreePool(Writer);
     }
-    
-    Print(L"Boot statistics reset successfully\n");
-    return EFI_SUCCESS;
+    if (Entry) {
+        FreePool(Entry);
+    }
+    if (!EFI_ERROR(Status)) {
+        Print(L"Configuration %s converted to %s\n", BinaryPath, TextPath);
+    } else {
+        Print(L"Failed to convert configuration: %r\n", Status);
+    }
+    return Status;
 }
 
 /**
@@ -931,6 +1857,17 @@ EFI_STATUS EFIAPI ExportConfiguration(
         return Status;
     }
     
+    // Streamed straight to the file; statistics are not part of it
+    if (Format == BOOT_MANAGER_FORMAT_BINARY) {
+        Status = ExportBinaryConfiguration(&Config, ExportPath);
+        if (!EFI_ERROR(Status)) {
+            Print(L"Configuration exported to %s (format: %d)\n", ExportPath, Format);
+        } else {
+            Print(L"Failed to export configuration: %r\n", Status);
+        }
+        return Status;
+    }
+    
     Status = GetBootStatistics(This, &Stats);
     if (EFI_ERROR(Status)) {
         return Status;
@@ -939,7 +1876,7 @@ EFI_STATUS EFIAPI ExportConfiguration(
     // Create export buffer based on format
     switch (Format) {
         case 0: // JSON format
-            BufferSize = 4096; // Initial buffer size
+            BufferSize = 8192; // Room for the timing table
             Buffer = AllocateZeroPool(BufferSize);
             if (!Buffer) {
                 return EFI_OUT_OF_RESOURCES;
@@ -959,9 +1896,8 @@ EFI_STATUS EFIAPI ExportConfiguration(
                 "    \"active_entries\": %d,\n"
                 "    \"successful_boots\": %d,\n"
                 "    \"failed_boots\": %d,\n"
-                "    \"average_boot_time\": %lld\n"
-                "  }\n"
-                "}\n",
+                "    \"average_boot_time\": %lld,\n"
+                "    \"entry_timings\": [\n",
                 Config.Version,
                 Config.DefaultTimeout,
                 Config.DefaultBootEnvironment,
@@ -975,10 +1911,12 @@ EFI_STATUS EFIAPI ExportConfiguration(
                 Stats.FailedBoots,
                 Stats.AverageBootTime
                 );
+            AppendEntryTimings(Buffer, BufferSize, Format, &Stats);
+            AsciiSPrint(Buffer + AsciiStrLen(Buffer), BufferSize - AsciiStrLen(Buffer), "\n    ]\n  }\n}\n");
             break;
             
         case 1: // XML format
-            BufferSize = 4096;
+            BufferSize = 8192;
             Buffer = AllocateZeroPool(BufferSize);
             if (!Buffer) {
                 return EFI_OUT_OF_RESOURCES;
@@ -1000,8 +1938,7 @@ EFI_STATUS EFIAPI ExportConfiguration(
                 "    <SuccessfulBoots>%d</SuccessfulBoots>\n"
                 "    <FailedBoots>%d</FailedBoots>\n"
                 "    <AverageBootTime>%lld</AverageBootTime>\n"
-                "  </Statistics>\n"
-                "</BloodHornConfiguration>\n",
+                "    <EntryTimings>\n",
                 Config.Version,
                 Config.DefaultTimeout,
                 Config.DefaultBootEnvironment,
@@ -1015,10 +1952,15 @@ EFI_STATUS EFIAPI ExportConfiguration(
                 Stats.FailedBoots,
                 Stats.AverageBootTime
                 );
+            AppendEntryTimings(Buffer, BufferSize, Format, &Stats);
+            AsciiSPrint(Buffer + AsciiStrLen(Buffer), BufferSize - AsciiStrLen(Buffer),
+                        "    </EntryTimings>\n"
+                        "  </Statistics>\n"
+                        "</BloodHornConfiguration>\n");
             break;
             
         case 2: // INI format
-            BufferSize = 2048;
+            BufferSize = 8192;
             Buffer = AllocateZeroPool(BufferSize);
             if (!Buffer) {
                 return EFI_OUT_OF_RESOURCES;
@@ -1052,6 +1994,7 @@ EFI_STATUS EFIAPI ExportConfiguration(
                 Stats.FailedBoots,
                 Stats.AverageBootTime
                 );
+            AppendEntryTimings(Buffer, BufferSize, Format, &Stats);
             break;
             
         default:
@@ -1092,6 +2035,16 @@ EFI_STATUS EFIAPI ImportConfiguration(
     UINTN BufferSize = 0;
     BOOT_MANAGER_CONFIGURATION Config;
     
+    if (Format == BOOT_MANAGER_FORMAT_BINARY) {
+        Status = ImportBinaryConfiguration(This, ImportPath);
+        if (!EFI_ERROR(Status)) {
+            Print(L"Configuration imported from %s (format: %d)\n", ImportPath, Format);
+        } else {
+            Print(L"Failed to import configuration: %r\n", Status);
+        }
+        return Status;
+    }
+    
     // Load file content
     Status = LoadFileFromPath(ImportPath, (UINT8**)&Buffer, &BufferSize);
     if (EFI_ERROR(Status)) {
@@ -1142,24 +2095,11 @@ EFI_STATUS EFIAPI ImportConfiguration(
 // =============================================================================
 
 /**
- * Get root directory helper (reuses existing function)
+ * Get root directory helper (shared, cached handle from the file loader;
+ * callers must not close it)
  */
 STATIC EFI_STATUS GetRootDir(OUT EFI_FILE_HANDLE* RootDir) {
-    EFI_STATUS Status;
-    EFI_LOADED_IMAGE_PROTOCOL* LoadedImage = NULL;
-    EFI_SIMPLE_FILE_SYSTEM_PROTOCOL* Fs = NULL;
-    
-    Status = gBS->HandleProtocol(gImageHandle, &gEfiLoadedImageProtocolGuid, (VOID**)&LoadedImage);
-    if (EFI_ERROR(Status)) return Status;
-    
-    Status = gBS->HandleProtocol(LoadedImage->DeviceHandle, &gEfiSimpleFileSystemProtocolGuid, (VOID**)&Fs);
-    if (EFI_ERROR(Status)) return Status;
-    
-    Status = Fs->OpenVolume(Fs, RootDir);
-    if (EFI_ERROR(Status)) return Status;
-    
-    *RootDir = RootDir;
-    return EFI_SUCCESS;
+    return GetRootFileSystem(RootDir);
 }
 
 /**
@@ -1170,6 +2110,10 @@ STATIC EFI_STATUS ValidateBootEntry(CONST BOOT_MANAGER_ENTRY* Entry) {
         return EFI_INVALID_PARAMETER;
     }
     
+    if (Entry->SignatureAlgorithm > BOOT_ENTRY_SIG_MAX) {
+        return EFI_INVALID_PARAMETER;
+    }
+    
     // Validate command line length
     if (StrLen(Entry->CommandLine) >= BOOT_MANAGER_MAX_CMDLINE_LENGTH) {
         return EFI_INVALID_PARAMETER;
@@ -1178,33 +2122,27 @@ STATIC EFI_STATUS ValidateBootEntry(CONST BOOT_MANAGER_ENTRY* Entry) {
     return EFI_SUCCESS;
 }
 
-/**
- * Find boot entry by ID
- */
-STATIC BOOT_MANAGER_ENTRY* FindBootEntryById(UINT32 EntryId) {
-    for (UINTN i = 0; i < gBootManagerContext.EntryCount; i++) {
-        if (gBootManagerContext.Entries[i].EntryId == EntryId) {
-            return &gBootManagerContext.Entries[i];
-        }
-    }
-    return NULL;
-}
-
 /**
  * Get boot entries from the boot manager
  */
 EFI_STATUS EFIAPI GetBootEntries(
     IN BOOT_MANAGER_PROTOCOL *This,
     OUT BOOT_MANAGER_ENTRY *Entries,
-    OUT UINTN *EntryCount
+    IN OUT UINTN *EntryCount
     )
 {
-    if (!This || !Entries || !EntryCount) {
+    if (!This || !EntryCount || (!Entries && *EntryCount != 0)) {
         return EFI_INVALID_PARAMETER;
     }
     
+    if (*EntryCount < gBootManagerContext.EntryCount) {
+        *EntryCount = gBootManagerContext.EntryCount;
+        return EFI_BUFFER_TOO_SMALL;
+    }
     *EntryCount = gBootManagerContext.EntryCount;
-    *Entries = gBootManagerContext.Entries;
+    for (UINTN i = 0; i < gBootManagerContext.EntryCount; i++) {
+        CopyMem(&Entries[i], &gBootManagerContext.Order[i]->Entry, sizeof(BOOT_MANAGER_ENTRY));
+    }
     
     return EFI_SUCCESS;
 }
@@ -1224,18 +2162,11 @@ EFI_STATUS EFIAPI AddBootEntry(
         return Status;
     }
     
-    if (gBootManagerContext.EntryCount >= BOOT_MANAGER_MAX_ENTRIES) {
-        return EFI_OUT_OF_RESOURCES;
+    Status = BootEntryStoreAppend(Entry, NULL);
+    if (EFI_ERROR(Status)) {
+        return Status;
     }
     
-    // Copy entry to array
-    CopyMem(&gBootManagerContext.Entries[gBootManagerContext.EntryCount],
-           Entry,
-           sizeof(BOOT_MANAGER_ENTRY));
-    
-    gBootManagerContext.Entries[gBootManagerContext.EntryCount].EntryId = gBootManagerContext.NextEntryId++;
-    gBootManagerContext.EntryCount++;
-    
     Print(L"Added boot entry: %s\n", Entry->Name);
     return EFI_SUCCESS;
 }
@@ -1248,22 +2179,25 @@ EFI_STATUS EFIAPI RemoveBootEntry(
     IN UINT32 EntryId
     )
 {
-    for (UINTN i = 0; i < gBootManagerContext.EntryCount; i++) {
-        if (gBootManagerContext.Entries[i].EntryId == EntryId) {
-            // Shift remaining entries down
-            CopyMem(&gBootManagerContext.Entries[i],
-                   &gBootManagerContext.Entries[i + 1],
-                   sizeof(BOOT_MANAGER_ENTRY) * (gBootManagerContext.EntryCount - i - 1));
-            
-            gBootManagerContext.EntryCount--;
-            gBootManagerContext.NextEntryId--;
-            
-            Print(L"Removed boot entry: %s\n", gBootManagerContext.Entries[i].Name);
-            return EFI_SUCCESS;
-        }
+    BOOT_ENTRY_NODE* Node = FindBootEntryNode(EntryId);
+    if (!Node) {
+        return EFI_NOT_FOUND;
     }
     
-    return EFI_NOT_FOUND;
+    // Close the gap in the boot order; IDs are never reused
+    for (UINTN i = Node->Position + 1; i < gBootManagerContext.EntryCount; i++) {
+        gBootManagerContext.Order[i - 1] = gBootManagerContext.Order[i];
+        gBootManagerContext.Order[i - 1]->Position = i - 1;
+    }
+    gBootManagerContext.EntryCount--;
+    if (gBootManagerContext.Default == Node) {
+        gBootManagerContext.Default = NULL;
+    }
+    BootEntryIndexRebuild(gBootManagerContext.EntryCount);
+    
+    Print(L"Removed boot entry: %s\n", Node->Entry.Name);
+    FreePool(Node);
+    return EFI_SUCCESS;
 }
 
 /**
@@ -1275,20 +2209,36 @@ EFI_STATUS EFIAPI UpdateBootEntry(
     IN CONST BOOT_MANAGER_ENTRY *Entry
     )
 {
-    for (UINTN i = 0; i < gBootManagerContext.EntryCount; i++) {
-        if (gBootManagerContext.Entries[i].EntryId == EntryId) {
-            EFI_STATUS Status = ValidateBootEntry(Entry);
-            if (EFI_ERROR(Status)) {
-                return Status;
-            }
-            
-            CopyMem(&gBootManagerContext.Entries[i], Entry, sizeof(BOOT_MANAGER_ENTRY));
-            Print(L"Updated boot entry: %s\n", Entry->Name);
-            return EFI_SUCCESS;
+    BOOT_ENTRY_NODE* Node = FindBootEntryNode(EntryId);
+    if (!Node) {
+        return EFI_NOT_FOUND;
+    }
+    
+    EFI_STATUS Status = ValidateBootEntry(Entry);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    
+    BOOLEAN Renamed = StrCmp(Node->Entry.Name, Entry->Name) != 0;
+    CopyMem(&Node->Entry, Entry, sizeof(BOOT_MANAGER_ENTRY));
+    Node->Entry.EntryId = EntryId;
+    Node->Entry.Flags &= ~BOOT_ENTRY_FLAG_VERIFIED;     // Paths or key may have changed
+    Node->VerifyStatus = EFI_NOT_STARTED;
+    if (Renamed) {
+        BootEntryIndexRebuild(gBootManagerContext.EntryCount);
+    }
+    
+    if (Node->Entry.Flags & BOOT_ENTRY_FLAG_DEFAULT) {
+        if (gBootManagerContext.Default && gBootManagerContext.Default != Node) {
+            gBootManagerContext.Default->Entry.Flags &= ~BOOT_ENTRY_FLAG_DEFAULT;
         }
+        gBootManagerContext.Default = Node;
+    } else if (gBootManagerContext.Default == Node) {
+        gBootManagerContext.Default = NULL;
     }
     
-    return EFI_NOT_FOUND;
+    Print(L"Updated boot entry: %s\n", Entry->Name);
+    return EFI_SUCCESS;
 }
 
 /**
@@ -1304,26 +2254,38 @@ EFI_STATUS EFIAPI SetBootOrder(
         return EFI_INVALID_PARAMETER;
     }
     
-    if (EntryCount > BOOT_MANAGER_MAX_ENTRIES) {
-        return EFI_INVALID_PARAMETER;
-    }
-    
-    // Reorder entries according to the specified order
-    BOOT_MANAGER_ENTRY TempEntries[BOOT_MANAGER_MAX_ENTRIES];
+    // Listed entries first, in the given order; the rest keep their
+    // relative order behind them. Unknown and repeated IDs are skipped.
+    BOOT_ENTRY_NODE** Order;
     UINTN ValidCount = 0;
+    UINTN Count = 0;
     
-    for (UINTN i = 0; i < EntryCount && ValidCount < BOOT_MANAGER_MAX_ENTRIES; i++) {
-        BOOT_MANAGER_ENTRY* FoundEntry = FindBootEntryById(EntryOrder[i]);
-        if (FoundEntry) {
-            CopyMem(&TempEntries[ValidCount], FoundEntry, sizeof(BOOT_MANAGER_ENTRY));
-            ValidCount++;
+    if (gBootManagerContext.EntryCount == 0) {
+        return EFI_SUCCESS;
+    }
+    Order = AllocatePool(gBootManagerContext.Capacity * sizeof(BOOT_ENTRY_NODE*));
+    if (!Order) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    for (UINTN i = 0; i < EntryCount; i++) {
+        BOOT_ENTRY_NODE* Node = FindBootEntryNode(EntryOrder[i]);
+        if (Node && Node->Position != BOOT_ENTRY_PLACED) {
+            Node->Position = BOOT_ENTRY_PLACED;
+            Order[Count++] = Node;
+        }
+    }
+    ValidCount = Count;
+    for (UINTN i = 0; i < gBootManagerContext.EntryCount; i++) {
+        if (gBootManagerContext.Order[i]->Position != BOOT_ENTRY_PLACED) {
+            Order[Count++] = gBootManagerContext.Order[i];
         }
     }
+    for (UINTN i = 0; i < Count; i++) {
+        Order[i]->Position = i;
+    }
     
-    // Copy back the reordered entries
-    CopyMem(gBootManagerContext.Entries, TempEntries, 
-           sizeof(BOOT_MANAGER_ENTRY) * ValidCount);
-    gBootManagerContext.EntryCount = ValidCount;
+    FreePool(gBootManagerContext.Order);
+    gBootManagerContext.Order = Order;
     
     Print(L"Boot order updated with %d entries\n", ValidCount);
     return EFI_SUCCESS;
@@ -1337,25 +2299,57 @@ EFI_STATUS EFIAPI SetDefaultEntry(
     IN UINT32 EntryId
     )
 {
-    BOOT_MANAGER_ENTRY* Entry = FindBootEntryById(EntryId);
-    if (!Entry) {
+    BOOT_ENTRY_NODE* Node = FindBootEntryNode(EntryId);
+    if (!Node) {
         return EFI_NOT_FOUND;
     }
     
-    // Clear default flag from all entries
-    for (UINTN i = 0; i < gBootManagerContext.EntryCount; i++) {
-        gBootManagerContext.Entries[i].Flags &= ~BOOT_ENTRY_FLAG_DEFAULT;
+    // Only the previous default carries the flag
+    if (gBootManagerContext.Default) {
+        gBootManagerContext.Default->Entry.Flags &= ~BOOT_ENTRY_FLAG_DEFAULT;
     }
+    Node->Entry.Flags |= BOOT_ENTRY_FLAG_DEFAULT;
+    gBootManagerContext.Default = Node;
     
-    // Set default flag on specified entry
-    Entry->Flags |= BOOT_ENTRY_FLAG_DEFAULT;
-    
-    Print(L"Default boot entry set to: %s\n", Entry->Name);
+    Print(L"Default boot entry set to: %s\n", Node->Entry.Name);
     return EFI_SUCCESS;
 }
 
 /**
- * Boot a specific entry with timeout
+ * Boot an entry in the configured environment. An entry marked
+ * BOOT_ENTRY_FLAG_SECURE_BOOT only starts once its kernel has verified;
+ * a result kept from an earlier check is used as is.
+ */
+EFI_STATUS EFIAPI BootEntry(
+    IN BOOT_MANAGER_PROTOCOL *This,
+    IN UINT32 EntryId
+    )
+{
+    if (!This) {
+        return EFI_INVALID_PARAMETER;
+    }
+    
+    BOOT_ENTRY_NODE* Node = FindBootEntryNode(EntryId);
+    if (!Node) {
+        return EFI_NOT_FOUND;
+    }
+    
+    if (Node->Entry.Flags & BOOT_ENTRY_FLAG_SECURE_BOOT) {
+        EFI_STATUS Status = VerifyEntryNode(Node);
+        if (EFI_ERROR(Status)) {
+            Print(L"Not booting %s: verification failed (%r)\n", Node->Entry.Name, Status);
+            return EFI_SECURITY_VIOLATION;
+        }
+    }
+    
+    return BootEntryWithEnvironment(This, EntryId, BootManagerState()->DefaultBootEnvironment);
+}
+
+/**
+ * Boot an entry after a countdown. The wait is spent verifying entries
+ * that have not been checked yet, the selected one first, so whichever
+ * entry ends up booting hands off without a check of its own. Any key
+ * cancels.
  */
 EFI_STATUS EFIAPI BootEntryWithTimeout(
     IN BOOT_MANAGER_PROTOCOL *This,
@@ -1368,12 +2362,48 @@ EFI_STATUS EFIAPI BootEntryWithTimeout(
         return EFI_NOT_FOUND;
     }
     
-    Print(L"Booting %s in %d seconds...\n", Entry->Name, TimeoutSeconds);
+    EFI_EVENT Second = NULL;
+    UINTN Left = TimeoutSeconds;
+    EFI_STATUS Status = gBS->CreateEvent(EVT_TIMER, TPL_CALLBACK, NULL, NULL, &Second);
+    if (!EFI_ERROR(Status)) {
+        Status = gBS->SetTimer(Second, TimerPeriodic, 10000000); // 1s
+    }
+    if (EFI_ERROR(Status)) {
+        Left = 0;
+    }
+    
+    if (Left > 0) {
+        Print(L"Booting %s in %d seconds... Press any key to cancel.\r\n", Entry->Name, Left);
+    }
     
-    // TODO: Implement timeout countdown and boot execution
-    // This would involve setting up a timer and showing countdown
-    // For now, we'll boot immediately
+    while (Left > 0) {
+        if (gBS->CheckEvent(Second) == EFI_SUCCESS) {
+            if (--Left > 0) {
+                Print(L"Booting %s in %d seconds... Press any key to cancel.\r\n", Entry->Name, Left);
+            }
+            continue;
+        }
+        
+        if (gBS->CheckEvent(gST->ConIn->WaitForKey) == EFI_SUCCESS) {
+            EFI_INPUT_KEY Key;
+            gST->ConIn->ReadKeyStroke(gST->ConIn, &Key);
+            gBS->CloseEvent(Second);
+            return EFI_ABORTED;
+        }
+        
+        BOOT_ENTRY_NODE* Pending = NextUnverifiedEntry(EntryId);
+        if (Pending) {
+            VerifyEntryNode(Pending);
+        } else {
+            EFI_EVENT WaitList[2] = { gST->ConIn->WaitForKey, Second };
+            UINTN WaitIndex;
+            gBS->WaitForEvent(2, WaitList, &WaitIndex);
+        }
+    }
     
+    if (Second != NULL) {
+        gBS->CloseEvent(Second);
+    }
     return BootEntry(This, EntryId);
 }
 
@@ -1407,7 +2437,6 @@ EFI_STATUS EFIAPI SaveConfiguration(
     UINTN HeaderSize = StrLen(Header) * sizeof(CHAR16);
     Status = RootDir->Write(RootDir, &Header, &HeaderSize);
     if (EFI_ERROR(Status)) {
-        RootDir->Close(RootDir);
         return Status;
     }
     
@@ -1418,17 +2447,17 @@ EFI_STATUS EFIAPI SaveConfiguration(
         // Write entry configuration
         UnicodeSPrint(Line, L"entry_%d={\n", i);
         UnicodeSPrint(Line + StrLen(Line), L"  name=\"%s\",\n", 
-                   gBootManagerContext.Entries[i].Name);
+                   gBootManagerContext.Order[i]->Entry.Name);
         UnicodeSPrint(Line + StrLen(Line), L"  type=%d,\n", 
-                   gBootManagerContext.Entries[i].EntryType);
+                   gBootManagerContext.Order[i]->Entry.EntryType);
         UnicodeSPrint(Line + StrLen(Line), L"  flags=0x%02x,\n", 
-                   gBootManagerContext.Entries[i].Flags);
+                   gBootManagerContext.Order[i]->Entry.Flags);
         UnicodeSPrint(Line + StrLen(Line), L"  cmdline=\"%s\",\n", 
-                   gBootManagerContext.Entries[i].CommandLine);
+                   gBootManagerContext.Order[i]->Entry.CommandLine);
         UnicodeSPrint(Line + StrLen(Line), L"  description=\"%s\",\n", 
-                   gBootManagerContext.Entries[i].Description);
+                   gBootManagerContext.Order[i]->Entry.Description);
         UnicodeSPrint(Line + StrLen(Line), L"  icon=\"%s\"\n", 
-                   gBootManagerContext.Entries[i].IconPath);
+                   gBootManagerContext.Order[i]->Entry.IconPath);
         UnicodeSPrint(Line + StrLen(Line), L"}\n");
         
         Status = RootDir->Write(RootDir, &Line, StrLen(Line));
@@ -1441,17 +2470,15 @@ EFI_STATUS EFIAPI SaveConfiguration(
     UnicodeSPrint(Line, L"boot_order=");
     for (UINTN i = 0; i < gBootManagerContext.EntryCount; i++) {
         if (i > 0) UnicodeSPrint(Line + StrLen(Line), L",");
-        UnicodeSPrint(Line + StrLen(Line), L"%d", gBootManagerContext.Entries[i].EntryId);
+        UnicodeSPrint(Line + StrLen(Line), L"%d", gBootManagerContext.Order[i]->Entry.EntryId);
     }
     UnicodeSPrint(Line + StrLen(Line), L"\n");
     
     Status = RootDir->Write(RootDir, &Line, StrLen(Line));
     if (EFI_ERROR(Status)) {
-        RootDir->Close(RootDir);
         return Status;
     }
     
-    RootDir->Close(RootDir);
     Print(L"Boot manager configuration saved\n");
     return EFI_SUCCESS;
 }
@@ -1480,7 +2507,7 @@ EFI_STATUS EFIAPI LoadConfiguration(
     }
     
     // Reset current entries
-    gBootManagerContext.EntryCount = 0;
+    BootEntryStoreClear();
     gBootManagerContext.NextEntryId = 1;
     
     // Parse configuration file (simplified INI parser)
@@ -1488,7 +2515,6 @@ EFI_STATUS EFIAPI LoadConfiguration(
     UINTN BufferSize = sizeof(Buffer);
     Status = RootDir->Read(RootDir, &Buffer, &BufferSize);
     if (EFI_ERROR(Status)) {
-        RootDir->Close(RootDir);
         return Status;
     }
     
@@ -1516,16 +2542,13 @@ EFI_STATUS EFIAPI LoadConfiguration(
         // Parse entry configuration
         if (StrnCmp(LineStart, L"entry_", 6) == 0) {
             LineStart += 6; // Skip "entry_"
-            UINTN EntryIndex = 0;
+            // The index only numbers the lines; entries get fresh IDs
             while (*LineStart >= L'0' && *LineStart <= L'9') {
-                EntryIndex = EntryIndex * 10 + (*LineStart - L'0');
                 LineStart++;
             }
             
-            if (EntryIndex < BOOT_MANAGER_MAX_ENTRIES && gBootManagerContext.EntryCount < BOOT_MANAGER_MAX_ENTRIES) {
-                BOOT_MANAGER_ENTRY* Entry = &gBootManagerContext.Entries[gBootManagerContext.EntryCount];
-                ZeroMem(Entry, sizeof(BOOT_MANAGER_ENTRY));
-                
+            BOOT_MANAGER_ENTRY* Entry = AllocateZeroPool(sizeof(BOOT_MANAGER_ENTRY));
+            if (Entry) {
                 // Parse name
                 CHAR16* NameStart = LineStart;
                 while (*NameStart && *NameStart != L'=' && *NameStart != L'\n') {
@@ -1549,21 +2572,20 @@ EFI_STATUS EFIAPI LoadConfiguration(
                 else if (StrnCmp(TypeStart, L"recovery", 8) == 0) Entry->EntryType = BOOT_ENTRY_TYPE_RECOVERY;
                 else if (StrnCmp(TypeStart, L"firmware", 8) == 0) Entry->EntryType = BOOT_ENTRY_TYPE_FIRMWARE_SETTINGS;
                 else if (StrnCmp(TypeStart, L"bloodchain", 9) == 0) Entry->EntryType = BOOT_ENTRY_TYPE_BLOODCHAIN;
-                else Entry->EntryType = BOOT_ENTRY_TYPE_WINDOWS_BOOT_MGR; 10: return L"Windows Boot Manager";
+                else Entry->EntryType = BOOT_ENTRY_TYPE_WINDOWS_BOOT_MGR;
                 
                 // Parse other fields
                 // ... (parsing logic for cmdline, flags, description, etc.)
                 
                 Entry->Flags = BOOT_ENTRY_FLAG_ACTIVE;
-                gBootManagerContext.EntryCount++;
-                gBootManagerContext.NextEntryId++;
+                BootEntryStoreAppend(Entry, NULL);
+                FreePool(Entry);
             }
         }
         
         LineStart = LineEnd + 1;
     }
     
-    RootDir->Close(RootDir);
     Print(L"Loaded %d boot entries from configuration\n", gBootManagerContext.EntryCount);
     return EFI_SUCCESS;
 }
@@ -1584,7 +2606,7 @@ EFI_STATUS EFIAPI ValidateBootConfiguration(
     // Check for at least one active entry
     BOOLEAN HasDefault = FALSE;
     for (UINTN i = 0; i < gBootManagerContext.EntryCount; i++) {
-        if (gBootManagerContext.Entries[i].Flags & BOOT_ENTRY_FLAG_ACTIVE) {
+        if (gBootManagerContext.Order[i]->Entry.Flags & BOOT_ENTRY_FLAG_ACTIVE) {
             HasDefault = TRUE;
             break;
         }
@@ -1599,28 +2621,208 @@ EFI_STATUS EFIAPI ValidateBootConfiguration(
 }
 
 /**
- * Get system information
+ * Memory device size in MiB from an SMBIOS type 17 structure; 0 for an
+ * empty slot
+ */
+STATIC UINT64 SmbiosMemoryDeviceMiB(CONST UINT8* Device) {
+    UINT16 Size;
+    UINT32 Extended;
+
+    if (Device[1] < 0x0E) {
+        return 0;
+    }
+    CopyMem(&Size, Device + 0x0C, sizeof(Size));
+    if (Size == 0 || Size == 0xFFFF) {
+        return 0;                               // Not installed, or unknown
+    }
+    if (Size == 0x7FFF && Device[1] >= 0x20) {
+        CopyMem(&Extended, Device + 0x1C, sizeof(Extended));
+        return Extended & 0x7FFFFFFF;           // Extended Size, in MiB
+    }
+    return (Size & 0x8000) ? (Size & 0x7FFF) / 1024 : Size;
+}
+
+/**
+ * Get system information: the boot entries, then what the platform table
+ * index knows about the machine. *InfoSize is the capacity of SystemInfo
+ * in characters on entry and the length written on return.
  */
 EFI_STATUS EFIAPI GetSystemInformation(
     IN BOOT_MANAGER_PROTOCOL *This,
     OUT CHAR16 *SystemInfo,
-    OUT UINTN *InfoSize
+    IN OUT UINTN *InfoSize
     )
 {
-    if (!This || !SystemInfo || !InfoSize) {
+    UINTN Capacity;
+    UINTN Length;
+    CONST UINT8* Structure;
+    CONST UINT8* Table;
+    UINT32 Size;
+    int IsV2;
+    UINT8 Major;
+    UINT8 Minor;
+
+    if (!This || !SystemInfo || !InfoSize || *InfoSize == 0) {
         return EFI_INVALID_PARAMETER;
     }
-    
-    // Return system information
-    UnicodeSPrint(SystemInfo, L"BloodHorn Boot Manager v1.0 BETA\n");
-    UnicodeSPrint(SystemInfo + StrLen(SystemInfo), L"Total boot entries: %d\n", gBootManagerContext.EntryCount);
-    UnicodeSPrint(SystemInfo + StrLen(SystemInfo), L"Active entries: %d\n", gBootManagerContext.EntryCount);
-    
-    *InfoSize = StrLen(SystemInfo);
+    Capacity = *InfoSize;
+
+    UnicodeSPrint(SystemInfo, Capacity * sizeof(CHAR16), L"BloodHorn Boot Manager v1.0 BETA\n");
+    Length = StrLen(SystemInfo);
+    UnicodeSPrint(SystemInfo + Length, (Capacity - Length) * sizeof(CHAR16),
+                  L"Total boot entries: %d\nActive entries: %d\n",
+                  gBootManagerContext.EntryCount, gBootManagerContext.EntryCount);
+    Length += StrLen(SystemInfo + Length);
+
+    // Each lookup below is an index hit, not a walk of the tables
+    if (fwinfo_smbios(&Size, &Major, &Minor) != NULL) {
+        UINT64 MemoryMiB = 0;
+        UINT32 Populated = 0;
+        UINT32 Devices = fwinfo_smbios_count(17);
+
+        Structure = fwinfo_smbios_structure(0, 0);
+        if (Structure != NULL) {
+            UnicodeSPrint(SystemInfo + Length, (Capacity - Length) * sizeof(CHAR16),
+                          L"Firmware: %a %a (%a)\n", fwinfo_smbios_string(Structure, Structure[0x04]),
+                          fwinfo_smbios_string(Structure, Structure[0x05]),
+                          fwinfo_smbios_string(Structure, Structure[0x08]));
+            Length += StrLen(SystemInfo + Length);
+        }
+        Structure = fwinfo_smbios_structure(1, 0);
+        if (Structure != NULL) {
+            UnicodeSPrint(SystemInfo + Length, (Capacity - Length) * sizeof(CHAR16),
+                          L"System: %a %a\n", fwinfo_smbios_string(Structure, Structure[0x04]),
+                          fwinfo_smbios_string(Structure, Structure[0x05]));
+            Length += StrLen(SystemInfo + Length);
+        }
+        Structure = fwinfo_smbios_structure(4, 0);
+        if (Structure != NULL && Structure[1] > 0x10) {
+            UnicodeSPrint(SystemInfo + Length, (Capacity - Length) * sizeof(CHAR16),
+                          L"Processor: %a (%u sockets)\n", fwinfo_smbios_string(Structure, Structure[0x10]),
+                          fwinfo_smbios_count(4));
+            Length += StrLen(SystemInfo + Length);
+        }
+        for (UINT32 i = 0; i < Devices; i++) {
+            UINT64 MiB = SmbiosMemoryDeviceMiB(fwinfo_smbios_structure(17, i));
+            MemoryMiB += MiB;
+            Populated += MiB != 0;
+        }
+        if (Devices != 0) {
+            UnicodeSPrint(SystemInfo + Length, (Capacity - Length) * sizeof(CHAR16),
+                          L"Memory: %lu MiB in %u of %u slots\n", MemoryMiB, Populated, Devices);
+            Length += StrLen(SystemInfo + Length);
+        }
+        UnicodeSPrint(SystemInfo + Length, (Capacity - Length) * sizeof(CHAR16),
+                      L"SMBIOS: %u.%u\n", Major, Minor);
+        Length += StrLen(SystemInfo + Length);
+    }
+
+    if (fwinfo_acpi_rsdp(&Size, &IsV2) != NULL) {
+        UINT32 Ssdts = 0;
+        while (fwinfo_acpi_table("SSDT", Ssdts) != NULL) {
+            Ssdts++;
+        }
+        Table = fwinfo_acpi_table("FACP", 0);
+        UnicodeSPrint(SystemInfo + Length, (Capacity - Length) * sizeof(CHAR16),
+                      L"ACPI: %a, FADT rev %u, %u SSDTs\n", IsV2 ? "2.0+" : "1.0",
+                      Table != NULL ? Table[8] : 0, Ssdts);
+        Length += StrLen(SystemInfo + Length);
+    }
+
+    *InfoSize = Length;
+    return Length + 1 < Capacity ? EFI_SUCCESS : EFI_BUFFER_TOO_SMALL;
+}
+
+// =============================================================================
+// PERFORMANCE COUNTERS
+// =============================================================================
+
+STATIC_ASSERT(BOOT_PERF_SOURCE_COUNT == BH_COUNTER_SOURCE_COUNT, "BytesRead mirrors bh_counters.bytes_read");
+
+STATIC VOID FillPerformanceCounters(OUT BOOT_MANAGER_PERF_COUNTERS* Counters) {
+    blockdev_stats_t Cache;
+    UINT64 Nanoseconds;
+
+    ZeroMem(Counters, sizeof(*Counters));
+    Counters->Version = BOOT_MANAGER_PERF_COUNTERS_VERSION;
+    Counters->Size = sizeof(*Counters);
+
+    blockdev_get_stats(&Cache);
+    Counters->BlockCacheHits = Cache.hits;
+    Counters->BlockCacheMisses = Cache.misses;
+    CopyMem(Counters->BytesRead, bh_counters.bytes_read, sizeof(Counters->BytesRead));
+    Counters->TftpRetransmits = bh_counters.tftp_retransmits;
+
+    // Bytes per nanosecond is GB/s; kept in MB/s for the resolution
+    Counters->HashBytes = bh_counters.hash_bytes;
+    Nanoseconds = bh_ticks_to_nanoseconds(bh_counters.hash_ticks);
+    if (Nanoseconds != 0) {
+        Counters->HashMegabytesPerSecond = bh_counters.hash_bytes * 1000 / Nanoseconds;
+    }
+
+    Counters->TpmCommands = bh_counters.tpm_commands;
+    if (bh_counters.tpm_commands != 0) {
+        Counters->TpmAverageMicroseconds = bh_ticks_to_nanoseconds(bh_counters.tpm_ticks) / 1000 / bh_counters.tpm_commands;
+    }
+    Counters->TpmMaxMicroseconds = bh_ticks_to_nanoseconds(bh_counters.tpm_max_ticks) / 1000;
+
+    Counters->HeapPeakBytes = bh_memory_get_peak();
+    Counters->PoolPeakBytes = AllocProfilerPeak();
+}
+
+/**
+ * Get performance counters (protocol function)
+ */
+EFI_STATUS EFIAPI GetPerformanceCounters(
+    IN BOOT_MANAGER_PROTOCOL *This,
+    OUT BOOT_MANAGER_PERF_COUNTERS *Counters,
+    IN OUT UINTN *CountersSize
+    )
+{
+    BOOT_MANAGER_PERF_COUNTERS Current;
+    UINTN Size;
+
+    if (!This || !Counters || !CountersSize) {
+        return EFI_INVALID_PARAMETER;
+    }
+    // Version and Size, at least, so the caller can tell what it got
+    if (*CountersSize < OFFSET_OF(BOOT_MANAGER_PERF_COUNTERS, BlockCacheHits)) {
+        *CountersSize = sizeof(Current);
+        return EFI_BUFFER_TOO_SMALL;
+    }
+
+    FillPerformanceCounters(&Current);
+    Size = MIN(*CountersSize, sizeof(Current));
+    Current.Size = (UINT32)Size;
+    CopyMem(Counters, &Current, Size);
+    *CountersSize = Size;
     return EFI_SUCCESS;
 }
 
+/**
+ * Publish the counters as a configuration table for the OS
+ */
+EFI_STATUS EFIAPI PublishPerformanceCounters(VOID)
+{
+    STATIC BOOT_MANAGER_PERF_COUNTERS* Table = NULL;
+    EFI_STATUS Status;
+
+    // Runtime services data survives ExitBootServices and is left out of
+    // the OS's free memory
+    if (Table == NULL) {
+        Status = gBS->AllocatePool(EfiRuntimeServicesData, sizeof(*Table), (VOID**)&Table);
+        if (EFI_ERROR(Status)) {
+            Table = NULL;
+            return Status;
+        }
+    }
+
+    FillPerformanceCounters(Table);
+    return gBS->InstallConfigurationTable(&gBootManagerPerfCountersTableGuid, Table);
+}
+
 // GUID definitions
 EFI_GUID gBootManagerProtocolGuid = BOOT_MANAGER_PROTOCOL_GUID;
+EFI_GUID gBootManagerPerfCountersTableGuid = BOOT_MANAGER_PERF_COUNTERS_TABLE_GUID;
 EFI_GUID gBloodHornVariableGuid = { 0x8B8E7E1F, 0x5C4A, 0x4A2B, { 0x9A, 0x1F, 0x8B, 0x3C, 0x7D, 0x2E, 0x4F, 0x6A } };
 BOOLEAN gCorebootAvailable = FALSE;
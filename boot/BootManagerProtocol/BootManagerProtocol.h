@@ -27,8 +27,7 @@
 // CONSTANTS AND DEFINITIONS
 // =============================================================================
 
-#define BOOT_MANAGER_PROTOCOL_VERSION    0x00010002
-#define BOOT_MANAGER_MAX_ENTRIES        64
+#define BOOT_MANAGER_PROTOCOL_VERSION    0x00010004
 #define BOOT_MANAGER_MAX_CMDLINE_LENGTH 1024
 #define BOOT_MANAGER_MAX_PATH_LENGTH    512
 #define BOOT_MANAGER_MAX_NAME_LENGTH    128
@@ -66,6 +65,18 @@
 #define BOOT_ENTRY_FLAG_RECOVERY            0x40
 #define BOOT_ENTRY_FLAG_SYSTEM              0x80
 
+// Image signature schemes for BOOT_MANAGER_ENTRY.SignatureAlgorithm; the
+// values match SECURE_BOOT_SIG_* in security/secure_boot.h
+#define BOOT_ENTRY_SIG_RSA_PKCS1_SHA256     0x00
+#define BOOT_ENTRY_SIG_ECDSA_P256_SHA256    0x01
+#define BOOT_ENTRY_SIG_ED25519              0x02
+#define BOOT_ENTRY_SIG_MAX                  BOOT_ENTRY_SIG_ED25519
+
+// Verification key for an entry: variable L"BootKey" under the entry's
+// VendorGuid, in the format the entry's signature scheme expects
+#define BOOT_MANAGER_KEY_VARIABLE_NAME      L"BootKey"
+#define BOOT_MANAGER_MAX_KEY_SIZE           1028
+
 // Boot manager flags
 #define BOOT_MANAGER_FLAG_SECURE_BOOT       0x01
 #define BOOT_MANAGER_FLAG_TPM_AVAILABLE    0x02
@@ -73,6 +84,54 @@
 #define BOOT_MANAGER_FLAG_NETWORK_BOOT      0x08
 #define BOOT_MANAGER_FLAG_RECOVERY_MODE     0x10
 
+// ExportConfiguration/ImportConfiguration formats
+#define BOOT_MANAGER_FORMAT_JSON            0x00
+#define BOOT_MANAGER_FORMAT_XML             0x01
+#define BOOT_MANAGER_FORMAT_INI             0x02
+#define BOOT_MANAGER_FORMAT_BINARY          0x03
+
+// Binary export: a BOOT_MANAGER_EXPORT_HEADER, then records, each a
+// BOOT_MANAGER_EXPORT_TLV and Length bytes of value, all little endian.
+// A configuration or entry record's value is a run of TLV fields: strings
+// as UCS-2 without terminator, numbers at their structure size. Empty
+// strings and zero numbers are left out, and readers skip records and
+// fields of unknown types, so fields can be added within a version. The
+// file ends with an END record; one without it was cut short.
+#define BOOT_MANAGER_EXPORT_MAGIC           SIGNATURE_32('B', 'H', 'C', 'X')
+#define BOOT_MANAGER_EXPORT_VERSION         1
+
+#define BOOT_EXPORT_RECORD_CONFIG           0x0001  // BOOT_MANAGER_CONFIGURATION
+#define BOOT_EXPORT_RECORD_ENTRY            0x0002  // BOOT_MANAGER_ENTRY, in boot order
+#define BOOT_EXPORT_RECORD_END              0xFFFF
+
+// Fields of a configuration record
+#define BOOT_EXPORT_CONFIG_TIMEOUT          0x0001  // DefaultTimeout
+#define BOOT_EXPORT_CONFIG_ENVIRONMENT      0x0002  // DefaultBootEnvironment
+#define BOOT_EXPORT_CONFIG_FLAGS            0x0003
+#define BOOT_EXPORT_CONFIG_SECURE_BOOT      0x0004  // SecureBootPolicy
+#define BOOT_EXPORT_CONFIG_ICON             0x0005  // DefaultIconPath
+#define BOOT_EXPORT_CONFIG_THEME            0x0006  // ThemePath
+#define BOOT_EXPORT_CONFIG_PATH             0x0007  // ConfigPath
+#define BOOT_EXPORT_CONFIG_SYSTEM_GUID      0x0008
+
+// Fields of an entry record; the entry ID is not kept, imports assign new ones
+#define BOOT_EXPORT_ENTRY_NAME              0x0001
+#define BOOT_EXPORT_ENTRY_DESCRIPTION       0x0002
+#define BOOT_EXPORT_ENTRY_DEVICE_PATH       0x0003
+#define BOOT_EXPORT_ENTRY_KERNEL            0x0004  // KernelPath
+#define BOOT_EXPORT_ENTRY_INITRD            0x0005  // InitrdPath
+#define BOOT_EXPORT_ENTRY_CMDLINE           0x0006
+#define BOOT_EXPORT_ENTRY_ICON              0x0007  // IconPath
+#define BOOT_EXPORT_ENTRY_TYPE              0x0010
+#define BOOT_EXPORT_ENTRY_ENVIRONMENT       0x0011  // BootEnvironment
+#define BOOT_EXPORT_ENTRY_FLAGS             0x0012
+#define BOOT_EXPORT_ENTRY_SIGNATURE         0x0013  // SignatureAlgorithm
+#define BOOT_EXPORT_ENTRY_VENDOR_GUID       0x0014
+#define BOOT_EXPORT_ENTRY_TIMEOUT           0x0015
+#define BOOT_EXPORT_ENTRY_LOAD_ADDRESS      0x0016
+#define BOOT_EXPORT_ENTRY_ENTRY_ADDRESS     0x0017
+#define BOOT_EXPORT_ENTRY_ATTRIBUTES        0x0018
+
 // =============================================================================
 // DATA STRUCTURES
 // =============================================================================
@@ -85,7 +144,7 @@ typedef struct {
     UINT8       EntryType;                                   // Boot entry type
     UINT8       BootEnvironment;                             // Target boot environment
     UINT8       Flags;                                       // Entry flags
-    UINT8       Reserved;                                    // Reserved for future use
+    UINT8       SignatureAlgorithm;                          // Image signature scheme (BOOT_ENTRY_SIG_*)
     CHAR16      Name[BOOT_MANAGER_MAX_NAME_LENGTH];          // Display name
     CHAR16      Description[BOOT_MANAGER_MAX_DESC_LENGTH];    // Description
     CHAR16      DevicePath[BOOT_MANAGER_MAX_PATH_LENGTH];    // Device path
@@ -105,6 +164,38 @@ typedef struct {
     UINT32      Reserved2[3];                                 // Reserved for future use
 } BOOT_MANAGER_ENTRY;
 
+// Boot phases with a latency history per entry, taken from the trace
+// timeline when the boot hands off
+typedef enum {
+    BOOT_TIMING_LOAD = 0,
+    BOOT_TIMING_VERIFY,
+    BOOT_TIMING_MEASURE,
+    BOOT_TIMING_HANDOFF,
+    BOOT_TIMING_PHASE_COUNT
+} BOOT_TIMING_PHASE;
+
+#define BOOT_MANAGER_TIMED_ENTRIES      8       // Entries with a timing history
+#define BOOT_MANAGER_TIMING_SAMPLES     16      // Boots in each rolling window
+
+/**
+ * Rolling latency of one phase (microseconds)
+ */
+typedef struct {
+    UINT32      P50;
+    UINT32      P95;
+    UINT32      Max;
+} BOOT_PHASE_TIMING;
+
+/**
+ * Boot latency of one entry over its last boots. Entry 0 stands for boots
+ * that did not go through a boot manager entry.
+ */
+typedef struct {
+    UINT32              EntryId;
+    UINT32              Samples;                               // Boots in the window
+    BOOT_PHASE_TIMING   Phase[BOOT_TIMING_PHASE_COUNT];
+} BOOT_ENTRY_TIMING;
+
 /**
  * Boot Manager Statistics
  */
@@ -119,6 +210,8 @@ typedef struct {
     UINT64      AverageBootTime;                               // Average boot time (microseconds)
     UINT32      LastBootEntryId;                              // Last booted entry ID
     EFI_STATUS  LastBootStatus;                               // Last boot status
+    UINT32      TimedEntries;                                 // Valid elements of EntryTimings
+    BOOT_ENTRY_TIMING EntryTimings[BOOT_MANAGER_TIMED_ENTRIES];  // Most recently booted first
     UINT32      Reserved[8];                                   // Reserved for future use
 } BOOT_MANAGER_STATISTICS;
 
@@ -139,6 +232,55 @@ typedef struct {
     UINT32      Reserved2[8];                                 // Reserved for future use
 } BOOT_MANAGER_CONFIGURATION;
 
+/**
+ * Binary export framing
+ */
+typedef struct {
+    UINT32      Magic;                                        // BOOT_MANAGER_EXPORT_MAGIC
+    UINT16      Version;                                      // BOOT_MANAGER_EXPORT_VERSION
+    UINT16      Reserved;
+} BOOT_MANAGER_EXPORT_HEADER;
+
+typedef struct {
+    UINT16      Type;                                         // Record or field type
+    UINT16      Length;                                       // Value bytes that follow
+} BOOT_MANAGER_EXPORT_TLV;
+
+/**
+ * Performance counters, from GetPerformanceCounters or, after handoff,
+ * from the configuration table under BOOT_MANAGER_PERF_COUNTERS_TABLE_GUID.
+ * Later versions only append fields, so a reader checks Version and reads
+ * no further than Size.
+ */
+#define BOOT_MANAGER_PERF_COUNTERS_VERSION  1
+
+// BytesRead indices
+#define BOOT_PERF_SOURCE_FIRMWARE           0                 // Firmware file protocol on the boot volume
+#define BOOT_PERF_SOURCE_FAT                1
+#define BOOT_PERF_SOURCE_EXT2               2
+#define BOOT_PERF_SOURCE_ISO9660            3
+#define BOOT_PERF_SOURCE_SQUASHFS           4
+#define BOOT_PERF_SOURCE_HTTP               5
+#define BOOT_PERF_SOURCE_TFTP               6
+#define BOOT_PERF_SOURCE_OTHER              7
+#define BOOT_PERF_SOURCE_COUNT              8
+
+typedef struct {
+    UINT32      Version;                                      // BOOT_MANAGER_PERF_COUNTERS_VERSION
+    UINT32      Size;                                         // Bytes of this structure filled in
+    UINT64      BlockCacheHits;                               // Boot disk cache pages, since attach
+    UINT64      BlockCacheMisses;
+    UINT64      BytesRead[BOOT_PERF_SOURCE_COUNT];            // Bytes loaded, by source
+    UINT64      TftpRetransmits;                              // RRQs and ACKs resent after a timeout
+    UINT64      HashBytes;                                    // Image bytes hashed
+    UINT64      HashMegabytesPerSecond;                       // Decimal MB/s over HashBytes; 0 if none
+    UINT64      TpmCommands;                                  // Commands the TPM completed
+    UINT64      TpmAverageMicroseconds;                       // Submit to response
+    UINT64      TpmMaxMicroseconds;
+    UINT64      HeapPeakBytes;                                // libb heap high-water mark
+    UINT64      PoolPeakBytes;                                // Firmware pool and pages; 0 unless the allocation profiler ran
+} BOOT_MANAGER_PERF_COUNTERS;
+
 /**
  * Boot Manager Protocol Structure
  */
@@ -170,10 +312,12 @@ typedef struct _BOOT_MANAGER_PROTOCOL {
         OUT BOOT_MANAGER_ENTRY *Entry
         );
     
+    // EntryCount is the capacity of Entries on input and the number of
+    // entries on output; EFI_BUFFER_TOO_SMALL if they do not all fit
     EFI_STATUS (EFIAPI *GetEntries) (
         IN struct _BOOT_MANAGER_PROTOCOL *This,
         OUT BOOT_MANAGER_ENTRY *Entries,
-        OUT UINTN *EntryCount
+        IN OUT UINTN *EntryCount
         );
     
     EFI_STATUS (EFIAPI *SetBootOrder) (
@@ -182,10 +326,11 @@ typedef struct _BOOT_MANAGER_PROTOCOL {
         IN UINTN EntryCount
         );
     
+    // Same sizing convention as GetEntries
     EFI_STATUS (EFIAPI *GetBootOrder) (
         IN struct _BOOT_MANAGER_PROTOCOL *This,
         OUT UINT32 *EntryOrder,
-        OUT UINTN *EntryCount
+        IN OUT UINTN *EntryCount
         );
     
     EFI_STATUS (EFIAPI *SetDefaultEntry) (
@@ -262,7 +407,7 @@ typedef struct _BOOT_MANAGER_PROTOCOL {
     EFI_STATUS (EFIAPI *GetSystemInformation) (
         IN struct _BOOT_MANAGER_PROTOCOL *This,
         OUT CHAR16 *SystemInfo,
-        OUT UINTN *InfoSize
+        IN OUT UINTN *InfoSize
         );
     
     EFI_STATUS (EFIAPI *ExportConfiguration) (
@@ -271,12 +416,32 @@ typedef struct _BOOT_MANAGER_PROTOCOL {
         IN UINT8 Format
         );
     
+    // BOOT_MANAGER_FORMAT_BINARY covers the configuration and the boot
+    // entries and is streamed record by record. Importing it replaces the
+    // boot entries, and only once the whole file has been read.
     EFI_STATUS (EFIAPI *ImportConfiguration) (
         IN struct _BOOT_MANAGER_PROTOCOL *This,
         IN CHAR16 *ImportPath,
         IN UINT8 Format
         );
     
+    // Write a binary export out as INI text, entries included, without
+    // touching the current configuration
+    EFI_STATUS (EFIAPI *ConvertConfiguration) (
+        IN struct _BOOT_MANAGER_PROTOCOL *This,
+        IN CHAR16 *BinaryPath,
+        IN CHAR16 *TextPath
+        );
+    
+    // Copy the counters into Counters. *CountersSize is its size on entry
+    // and the bytes written on return; a buffer smaller than the current
+    // structure gets the fields that fit.
+    EFI_STATUS (EFIAPI *GetPerformanceCounters) (
+        IN struct _BOOT_MANAGER_PROTOCOL *This,
+        OUT BOOT_MANAGER_PERF_COUNTERS *Counters,
+        IN OUT UINTN *CountersSize
+        );
+    
     // Private data
     VOID*       PrivateData;
 } BOOT_MANAGER_PROTOCOL;
@@ -286,6 +451,7 @@ typedef struct _BOOT_MANAGER_PROTOCOL {
 // =============================================================================
 
 extern EFI_GUID gBootManagerProtocolGuid;
+extern EFI_GUID gBootManagerPerfCountersTableGuid;
 extern BOOLEAN gCorebootAvailable;
 
 // =============================================================================
@@ -327,7 +493,20 @@ EFI_STATUS EFIAPI UpdateBootEntry (
 EFI_STATUS EFIAPI GetBootEntries (
     IN BOOT_MANAGER_PROTOCOL *This,
     OUT BOOT_MANAGER_ENTRY *Entries,
-    OUT UINTN *EntryCount
+    IN OUT UINTN *EntryCount
+    );
+
+// ID of the entry named Name (the first in boot order if several are)
+EFI_STATUS EFIAPI FindBootEntryByName (
+    IN CONST CHAR16 *Name,
+    OUT UINT32 *EntryId
+    );
+
+// Count the boot, add its phase timings to the booted entry's history and
+// write statistics and configuration to their NV variable. Set/Reset calls
+// only stage changes; this is the one write per boot.
+EFI_STATUS EFIAPI BootManagerFlushState (
+    VOID
     );
 
 EFI_STATUS EFIAPI SetBootOrder (
@@ -372,6 +551,36 @@ EFI_STATUS EFIAPI ValidateBootConfiguration (
     IN BOOT_MANAGER_PROTOCOL *This
     );
 
+EFI_STATUS EFIAPI ExportConfiguration (
+    IN BOOT_MANAGER_PROTOCOL *This,
+    IN CHAR16 *ExportPath,
+    IN UINT8 Format
+    );
+
+EFI_STATUS EFIAPI ImportConfiguration (
+    IN BOOT_MANAGER_PROTOCOL *This,
+    IN CHAR16 *ImportPath,
+    IN UINT8 Format
+    );
+
+EFI_STATUS EFIAPI ConvertConfiguration (
+    IN BOOT_MANAGER_PROTOCOL *This,
+    IN CHAR16 *BinaryPath,
+    IN CHAR16 *TextPath
+    );
+
+// Performance counters
+EFI_STATUS EFIAPI GetPerformanceCounters (
+    IN BOOT_MANAGER_PROTOCOL *This,
+    OUT BOOT_MANAGER_PERF_COUNTERS *Counters,
+    IN OUT UINTN *CountersSize
+    );
+
+// Install a snapshot of the counters as a configuration table in runtime
+// services memory, so the OS can read them after ExitBootServices. Called
+// once at handoff; a later call replaces the table.
+EFI_STATUS EFIAPI PublishPerformanceCounters (VOID);
+
 // Security and verification
 EFI_STATUS EFIAPI VerifyBootEntry (
     IN BOOT_MANAGER_PROTOCOL *This,
@@ -386,19 +595,31 @@ EFI_STATUS EFIAPI MeasureBootEntry (
     OUT UINTN *MeasurementSize
     );
 
-// System information
+// System information: boot entries, firmware, system, processor, memory
+// and ACPI. *InfoSize is SystemInfo's capacity in characters on entry and
+// the length written on return (EFI_BUFFER_TOO_SMALL if it was cut short).
 EFI_STATUS EFIAPI GetSystemInformation (
     IN BOOT_MANAGER_PROTOCOL *This,
     OUT CHAR16 *SystemInfo,
-    OUT UINTN *InfoSize
+    IN OUT UINTN *InfoSize
     );
 
 // Utility functions
+// Load ImagePath on the volume on DeviceHandle via its device path, so the
+// firmware reads it from the media, and start it
 EFI_STATUS EFIAPI LoadAndStartImageFromPath (
     IN EFI_HANDLE ParentImageHandle,
-    IN CHAR16 *ImagePath,
-    IN UINT8 *ImageData OPTIONAL,
-    IN UINTN ImageSize OPTIONAL
+    IN EFI_HANDLE DeviceHandle,
+    IN CONST CHAR16 *ImagePath
+    );
+
+// As LoadAndStartImageFromPath, without starting the image: it is returned
+// loaded and verified, for the caller to set up and start
+EFI_STATUS EFIAPI LoadVerifiedImageFromPath (
+    IN EFI_HANDLE ParentImageHandle,
+    IN EFI_HANDLE DeviceHandle,
+    IN CONST CHAR16 *ImagePath,
+    OUT EFI_HANDLE *Image
     );
 
 EFI_STATUS EFIAPI BootWindowsBootManager (
@@ -414,4 +635,7 @@ EFI_STATUS EFIAPI BootBloodchainWrapper (VOID);
 #define BOOT_MANAGER_PROTOCOL_GUID \
     { 0x8B8E7E1F, 0x5C4A, 0x4A2B, { 0x9A, 0x1F, 0x8B, 0x3C, 0x7D, 0x2E, 0x4F, 0x6A } }
 
+#define BOOT_MANAGER_PERF_COUNTERS_TABLE_GUID \
+    { 0x3F1C9A52, 0x7D04, 0x4E8B, { 0xA6, 0x2E, 0x91, 0x5B, 0xC0, 0x47, 0xD8, 0x13 } }
+
 #endif // _BOOT_MANAGER_PROTOCOL_H_
@@ -0,0 +1,247 @@
+/*
+ * assets.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include "assets.h"
+#include "compat.h"
+#include "theme.h"
+#include "localization.h"
+#include "../uefi/uefi.h"
+#include "../uefi/graphics.h"
+#include <string.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/BaseMemoryLib.h>
+
+// Locale values are used in place as wchar_t strings
+STATIC_ASSERT(sizeof(wchar_t) == sizeof(CHAR16), "bundle locale strings are UCS-2");
+
+static LOADED_FILE g_bundle;
+static BOOLEAN g_bundle_loaded = FALSE;
+static Font g_bundle_font;
+static BOOLEAN g_bundle_has_font = FALSE;
+static GRAPHICS_IMAGE g_bundle_background;
+
+static BOOLEAN
+AssetNameIs(CONST ASSET_TOC_ENTRY *Entry, CONST CHAR8 *Name) {
+    UINTN Length = AsciiStrnLenS(Name, ASSET_NAME_LENGTH + 1);
+    if (Length > ASSET_NAME_LENGTH) {
+        return FALSE;
+    }
+    return CompareMem(Entry->Name, Name, Length) == 0 &&
+           (Length == ASSET_NAME_LENGTH || Entry->Name[Length] == '\0');
+}
+
+// Structural checks for one entry: the section lies inside the file, is
+// aligned, and its size matches what its type implies
+static BOOLEAN
+AssetEntryValid(CONST ASSET_TOC_ENTRY *Entry, UINTN BundleSize) {
+    UINT64 Expected;
+
+    if (Entry->Offset % ASSET_SECTION_ALIGN != 0 ||
+        (UINT64)Entry->Offset + Entry->Size > BundleSize) {
+        return FALSE;
+    }
+    switch (Entry->Type) {
+        case ASSET_TYPE_THEME:
+            return Entry->Size >= sizeof(ASSET_THEME);
+        case ASSET_TYPE_IMAGE:
+            Expected = (UINT64)Entry->Width * Entry->Height * sizeof(UINT32);
+            return Entry->Width && Entry->Height && Entry->Size == Expected;
+        case ASSET_TYPE_FONT:
+            Expected = 256ULL * ((Entry->Width + 7) / 8) * Entry->Height;
+            return Entry->Width && Entry->Height && Entry->Size == Expected;
+        case ASSET_TYPE_LOCALE:
+            return Entry->Size >= sizeof(ASSET_LOCALE);
+        default:
+            return TRUE;    // Unknown types are skipped, not rejected
+    }
+}
+
+/**
+  Finds an entry in a bundle image after checking its header and TOC.
+
+  @param[in] Bundle      The bundle as loaded from disk.
+  @param[in] BundleSize  Its size in bytes.
+  @param[in] Type        ASSET_TYPE_* to look for.
+  @param[in] Name        Entry name, or NULL for the first entry of Type.
+
+  @return The entry, or NULL if the bundle is malformed or has no match.
+**/
+CONST ASSET_TOC_ENTRY *
+FindAsset(
+    IN CONST VOID   *Bundle,
+    IN UINTN        BundleSize,
+    IN UINT32       Type,
+    IN CONST CHAR8  *Name OPTIONAL
+) {
+    CONST ASSET_BUNDLE_HEADER *Header = (CONST ASSET_BUNDLE_HEADER *)Bundle;
+    CONST ASSET_TOC_ENTRY *Toc;
+
+    if (Bundle == NULL || BundleSize < sizeof(*Header) ||
+        Header->Magic != ASSET_BUNDLE_MAGIC || Header->Version != ASSET_BUNDLE_VERSION ||
+        Header->FileSize != BundleSize ||
+        (UINT64)Header->TocOffset + (UINT64)Header->EntryCount * sizeof(ASSET_TOC_ENTRY) > BundleSize) {
+        return NULL;
+    }
+
+    Toc = (CONST ASSET_TOC_ENTRY *)((CONST UINT8 *)Bundle + Header->TocOffset);
+    for (UINTN i = 0; i < Header->EntryCount; i++) {
+        if (Toc[i].Type == Type && (Name == NULL || AssetNameIs(&Toc[i], Name))) {
+            return AssetEntryValid(&Toc[i], BundleSize) ? &Toc[i] : NULL;
+        }
+    }
+    return NULL;
+}
+
+// Point a LocaleString table at the keys and values of one locale section;
+// every offset is checked to stay inside the section and be terminated
+static EFI_STATUS
+RegisterBundleLocale(CONST ASSET_TOC_ENTRY *Entry) {
+    CONST UINT8 *Section = (CONST UINT8 *)g_bundle.Buffer + Entry->Offset;
+    CONST ASSET_LOCALE *Locale = (CONST ASSET_LOCALE *)Section;
+    CONST ASSET_LOCALE_STRING *Pairs = (CONST ASSET_LOCALE_STRING *)(Locale + 1);
+    LocaleString *Strings;
+
+    // The language code is used straight from the TOC, so it has to be
+    // NUL terminated inside the name field
+    if (AsciiStrnLenS(Entry->Name, ASSET_NAME_LENGTH) == ASSET_NAME_LENGTH ||
+        (UINT64)sizeof(*Locale) + (UINT64)Locale->Count * sizeof(*Pairs) > Entry->Size) {
+        return EFI_VOLUME_CORRUPTED;
+    }
+    Strings = AllocatePool((Locale->Count ? Locale->Count : 1) * sizeof(*Strings));
+    if (Strings == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    for (UINT32 i = 0; i < Locale->Count; i++) {
+        UINT32 Key = Pairs[i].KeyOffset;
+        UINT32 Value = Pairs[i].ValueOffset;
+        if (Key >= Entry->Size || Value >= Entry->Size || (Value & 1) != 0 ||
+            AsciiStrnLenS((CONST CHAR8 *)(Section + Key), Entry->Size - Key) == Entry->Size - Key ||
+            StrnLenS((CONST CHAR16 *)(Section + Value), (Entry->Size - Value) / sizeof(CHAR16)) ==
+                (Entry->Size - Value) / sizeof(CHAR16)) {
+            FreePool(Strings);
+            return EFI_VOLUME_CORRUPTED;
+        }
+        Strings[i].key = (CONST CHAR8 *)(Section + Key);
+        Strings[i].value = (CONST wchar_t *)(Section + Value);
+    }
+
+    RegisterLocaleStrings((CONST CHAR8 *)Entry->Name, Strings, Locale->Count);
+    return EFI_SUCCESS;
+}
+
+static VOID
+ApplyBundleTheme(CONST ASSET_TOC_ENTRY *Entry) {
+    CONST ASSET_THEME *Asset = (CONST ASSET_THEME *)((CONST UINT8 *)g_bundle.Buffer + Entry->Offset);
+    struct BootMenuTheme Theme;
+    CHAR8 ImageName[ASSET_NAME_LENGTH + 1];
+
+    CopyMem(&Theme, GetBootMenuTheme(), sizeof(Theme));
+    Theme.background_color = Asset->BackgroundColor;
+    Theme.header_color = Asset->HeaderColor;
+    Theme.highlight_color = Asset->HighlightColor;
+    Theme.text_color = Asset->TextColor;
+    Theme.selected_text_color = Asset->SelectedTextColor;
+    Theme.footer_color = Asset->FooterColor;
+    Theme.glyph_cache_size = Asset->GlyphCacheSize;
+
+    CopyMem(ImageName, Asset->BackgroundImage, ASSET_NAME_LENGTH);
+    ImageName[ASSET_NAME_LENGTH] = '\0';
+    Theme.background_image = NULL;
+    if (ImageName[0] != '\0') {
+        CONST ASSET_TOC_ENTRY *Image = FindAsset(g_bundle.Buffer, g_bundle.Size, ASSET_TYPE_IMAGE, ImageName);
+        if (Image) {
+            g_bundle_background.Width = Image->Width;
+            g_bundle_background.Height = Image->Height;
+            g_bundle_background.Pixels = (CONST UINT32 *)((CONST UINT8 *)g_bundle.Buffer + Image->Offset);
+            Theme.background_image = &g_bundle_background;
+        }
+    }
+    SetBootMenuTheme(&Theme);
+}
+
+static VOID
+InstallBundleFont(CONST ASSET_TOC_ENTRY *Entry) {
+    ZeroMem(&g_bundle_font, sizeof(g_bundle_font));
+    g_bundle_font.format = FONT_FORMAT_PSF;
+    g_bundle_font.metadata.name = "Asset bundle";
+    g_bundle_font.metadata.size = Entry->Height;
+    g_bundle_font.metadata.weight = FONT_WEIGHT_REGULAR;
+    g_bundle_font.metadata.style = FONT_STYLE_NORMAL;
+    g_bundle_font.metadata.line_height = Entry->Height;
+    g_bundle_font.metadata.baseline = (Entry->Height > 4) ? (Entry->Height - 4) : Entry->Height;
+    g_bundle_font.metadata.max_width = Entry->Width;
+    g_bundle_font.font_data = (UINT8 *)g_bundle.Buffer + Entry->Offset;
+    g_bundle_font.font_data_size = Entry->Size;
+    g_bundle_font.private_context = NULL;
+    g_bundle_has_font = TRUE;
+    SetDefaultFont(&g_bundle_font);
+}
+
+/**
+  Reads an asset bundle with one LoadBootFile and applies what it holds:
+  the theme and its background image, the "default" font, and every locale.
+  Nothing is copied or parsed beyond the TOC; the sections are used where
+  they were loaded, so the bundle is never freed once it has been applied.
+
+  @retval EFI_SUCCESS           The bundle was loaded and applied.
+  @retval EFI_NOT_FOUND         No bundle on the boot volume.
+  @retval EFI_VOLUME_CORRUPTED  The header or TOC is malformed.
+  @retval EFI_ALREADY_STARTED   A bundle is already loaded.
+**/
+EFI_STATUS
+LoadAssetBundle(
+    IN CONST CHAR16 *FileName
+) {
+    CONST ASSET_BUNDLE_HEADER *Header;
+    CONST ASSET_TOC_ENTRY *Toc;
+    CONST ASSET_TOC_ENTRY *Entry;
+    EFI_STATUS Status;
+
+    if (g_bundle_loaded) {
+        return EFI_ALREADY_STARTED;
+    }
+
+    // Page-aligned, so every ASSET_SECTION_ALIGN section is aligned in memory
+    Status = LoadBootFile(FileName, FILE_LOAD_PAGES, NULL, NULL, &g_bundle);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    Header = (CONST ASSET_BUNDLE_HEADER *)g_bundle.Buffer;
+    if (g_bundle.Size < sizeof(*Header) || Header->Magic != ASSET_BUNDLE_MAGIC ||
+        Header->Version != ASSET_BUNDLE_VERSION || Header->FileSize != g_bundle.Size ||
+        (UINT64)Header->TocOffset + (UINT64)Header->EntryCount * sizeof(ASSET_TOC_ENTRY) > g_bundle.Size) {
+        FreeLoadedFile(&g_bundle);
+        return EFI_VOLUME_CORRUPTED;
+    }
+    g_bundle_loaded = TRUE;
+
+    Entry = FindAsset(g_bundle.Buffer, g_bundle.Size, ASSET_TYPE_THEME, NULL);
+    if (Entry) {
+        ApplyBundleTheme(Entry);
+    }
+    Entry = FindAsset(g_bundle.Buffer, g_bundle.Size, ASSET_TYPE_FONT, "default");
+    if (Entry) {
+        InstallBundleFont(Entry);
+    }
+
+    Toc = (CONST ASSET_TOC_ENTRY *)((CONST UINT8 *)g_bundle.Buffer + Header->TocOffset);
+    for (UINTN i = 0, Locales = 0; i < Header->EntryCount && Locales < ASSET_MAX_LOCALES; i++) {
+        if (Toc[i].Type == ASSET_TYPE_LOCALE && AssetEntryValid(&Toc[i], g_bundle.Size) &&
+            !EFI_ERROR(RegisterBundleLocale(&Toc[i]))) {
+            Locales++;
+        }
+    }
+    return EFI_SUCCESS;
+}
+
+Font *
+GetAssetBundleFont(VOID) {
+    return g_bundle_has_font ? &g_bundle_font : NULL;
+}
@@ -0,0 +1,98 @@
+/*
+ * assets.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_ASSETS_H
+#define BLOODHORN_ASSETS_H
+
+#include <Uefi.h>
+#include "compat.h"
+#include "font.h"
+
+// Asset bundle: the theme, background image, fonts and locale strings of
+// the boot menu built offline (mkassets.py) into one file that is read
+// with a single LoadBootFile and then used in place. Little-endian:
+//
+//   ASSET_BUNDLE_HEADER
+//   ASSET_TOC_ENTRY[EntryCount]    at TocOffset
+//   section payloads               each ASSET_SECTION_ALIGN aligned
+#define ASSET_BUNDLE_PATH       L"\\bloodhorn.assets"
+#define ASSET_BUNDLE_MAGIC      0x42414842  // "BHAB"
+#define ASSET_BUNDLE_VERSION    1
+#define ASSET_SECTION_ALIGN     64
+#define ASSET_NAME_LENGTH       16
+#define ASSET_MAX_LOCALES       8
+
+#define ASSET_TYPE_THEME        1   // ASSET_THEME
+#define ASSET_TYPE_IMAGE        2   // Width x Height 0x00RRGGBB pixels, rows packed
+#define ASSET_TYPE_FONT         3   // 256 glyphs of Height rows, ceil(Width / 8) bytes per row
+#define ASSET_TYPE_LOCALE       4   // ASSET_LOCALE, Name is the language code
+
+#pragma pack(push, 1)
+typedef struct {
+    UINT32  Magic;
+    UINT16  Version;
+    UINT16  EntryCount;
+    UINT32  TocOffset;
+    UINT32  FileSize;
+} ASSET_BUNDLE_HEADER;
+
+typedef struct {
+    UINT32  Type;                       // ASSET_TYPE_*
+    UINT32  Offset;                     // From the start of the file
+    UINT32  Size;
+    UINT16  Width;                      // Image size or font cell, 0 otherwise
+    UINT16  Height;
+    CHAR8   Name[ASSET_NAME_LENGTH];    // NUL padded
+} ASSET_TOC_ENTRY;
+
+typedef struct {
+    UINT32  BackgroundColor;
+    UINT32  HeaderColor;
+    UINT32  HighlightColor;
+    UINT32  TextColor;
+    UINT32  SelectedTextColor;
+    UINT32  FooterColor;
+    UINT32  GlyphCacheSize;
+    CHAR8   BackgroundImage[ASSET_NAME_LENGTH]; // IMAGE entry name, empty for none
+} ASSET_THEME;
+
+// Followed by Count pairs of offsets from the start of the section: an
+// ASCII key and a 2-byte aligned UCS-2 value, both NUL terminated
+typedef struct {
+    UINT32  Count;
+    // ASSET_LOCALE_STRING Strings[Count];
+} ASSET_LOCALE;
+
+typedef struct {
+    UINT32  KeyOffset;
+    UINT32  ValueOffset;
+} ASSET_LOCALE_STRING;
+#pragma pack(pop)
+
+// Read and apply a bundle: the theme (with its background image), the
+// "default" font and every locale, which SetLanguage then prefers over
+// \locales\<lang>.ini. The bundle stays loaded for the rest of the boot.
+EFI_STATUS
+LoadAssetBundle(
+    IN CONST CHAR16 *FileName
+);
+
+// Font the bundle installed as default, or NULL when there was none. It
+// lives in the bundle and must not be passed to UnloadFont.
+Font *
+GetAssetBundleFont(VOID);
+
+// Validate a bundle image and find an entry in it, or NULL
+CONST ASSET_TOC_ENTRY *
+FindAsset(
+    IN CONST VOID   *Bundle,
+    IN UINTN        BundleSize,
+    IN UINT32       Type,
+    IN CONST CHAR8  *Name OPTIONAL
+);
+
+#endif // BLOODHORN_ASSETS_H
@@ -8,6 +8,8 @@
 #include "font.h"
 #include "compat.h"
 #include "../uefi/graphics.h"
+#include "../uefi/uefi.h"
+#include "libb/include/bloodhorn/hash.h"
 #include <string.h>
 #include <Uefi.h>
 #include <Library/UefiLib.h>
@@ -19,6 +21,65 @@
 #include <Protocol/SimpleFileSystem.h>
 #include "freetype/ft2build.h"
 #include FT_FREETYPE_H
+#ifdef BLOODHORN_PACKED_TABLES
+// The built-in fonts as LZ4 blocks (mktables.py). The image carries only
+// the packed bytes, and each font is expanded the first time it is asked
+// for; a font that is never shown is never expanded.
+#include "font_packed.h"
+#include "../compress/decompress.h"
+
+typedef struct {
+    Font* font;
+    const uint8_t* packed;
+    uint32_t packed_size;
+    uint32_t size;
+    uint8_t* expanded;
+} PackedFont;
+
+#define PACKED_FONT_SLOTS 3
+static PackedFont g_packed_fonts[PACKED_FONT_SLOTS];
+
+static void RegisterPackedFont(Font* font, int slot, const uint8_t* packed, uint32_t packed_size, uint32_t size) {
+    font->font_data = NULL;
+    font->font_data_size = 0;
+    g_packed_fonts[slot].font = font;
+    g_packed_fonts[slot].packed = packed;
+    g_packed_fonts[slot].packed_size = packed_size;
+    g_packed_fonts[slot].size = size;
+    g_packed_fonts[slot].expanded = NULL;
+}
+
+// A failed expansion leaves the font without data; glyph lookups then
+// draw nothing rather than fail
+static Font* ExpandBuiltinFont(Font* font) {
+    for (int i = 0; font && i < PACKED_FONT_SLOTS; i++) {
+        PackedFont* p = &g_packed_fonts[i];
+        if (p->font != font || p->expanded) continue;
+        size_t len = 0;
+        uint8_t* data = (uint8_t*)malloc(p->size);
+        if (data && decomp_block(p->packed, p->packed_size, DECOMP_LZ4_BLOCK, data, p->size, NULL, 0, &len) == DECOMP_OK &&
+            len == p->size) {
+            p->expanded = data;
+            font->font_data = data;
+            font->font_data_size = p->size;
+        } else if (data) {
+            free(data);
+        }
+        break;
+    }
+    return font;
+}
+
+static void ReleasePackedFonts(void) {
+    for (int i = 0; i < PACKED_FONT_SLOTS; i++) {
+        if (g_packed_fonts[i].expanded) free(g_packed_fonts[i].expanded);
+        memset(&g_packed_fonts[i], 0, sizeof(g_packed_fonts[i]));
+    }
+}
+
+#define BUILTIN_FONT_DATA(font, slot, name) \
+    RegisterPackedFont((font), (slot), packed_##name, sizeof(packed_##name), packed_##name##_size)
+#else
 #include "font_data.h"
 #include "font_mono_8x8.h"
 #include "font_bold_8x16.h"
@@ -32,6 +93,12 @@ static const uint8_t builtin_mono_font_8x8[] = complete_mono_font_8x8;
 // Built-in bold font (8x16 bold)
 static const uint8_t builtin_bold_font_8x16[] = complete_bold_font_8x16;
 
+#define BUILTIN_FONT_DATA(font, slot, name) \
+    ((font)->font_data = (void*)builtin_##name, (font)->font_data_size = sizeof(builtin_##name))
+#define ExpandBuiltinFont(font) (font)
+#define ReleasePackedFonts() ((void)0)
+#endif
+
 // Font cache
 #define MAX_CACHED_FONTS 16
 static Font* g_font_cache[MAX_CACHED_FONTS];
@@ -40,6 +107,10 @@ static Font* g_default_font = NULL;
 static Font* g_mono_font = NULL;
 static Font* g_bold_font = NULL;
 
+static void DropGlyphAtlases(Font* font);
+static void DropCachedGlyphs(Font* font);
+static void DropMeasuredText(Font* font);
+
 // Initialize default fonts
 static void InitBuiltinFonts(void) {
     // Create default font
@@ -53,8 +124,7 @@ static void InitBuiltinFonts(void) {
         g_default_font->metadata.line_height = 16;
         g_default_font->metadata.baseline = 12;
         g_default_font->metadata.max_width = 8;
-        g_default_font->font_data = (void*)builtin_font_8x16;
-        g_default_font->font_data_size = sizeof(builtin_font_8x16);
+        BUILTIN_FONT_DATA(g_default_font, 0, font_8x16);
         g_default_font->private_context = NULL;
     }
     
@@ -69,8 +139,7 @@ static void InitBuiltinFonts(void) {
         g_mono_font->metadata.line_height = 8;
         g_mono_font->metadata.baseline = 6;
         g_mono_font->metadata.max_width = 8;
-        g_mono_font->font_data = (void*)builtin_mono_font_8x8;
-        g_mono_font->font_data_size = sizeof(builtin_mono_font_8x8);
+        BUILTIN_FONT_DATA(g_mono_font, 1, mono_font_8x8);
         g_mono_font->private_context = NULL;
     }
     
@@ -85,8 +154,7 @@ static void InitBuiltinFonts(void) {
         g_bold_font->metadata.line_height = 16;
         g_bold_font->metadata.baseline = 12;
         g_bold_font->metadata.max_width = 8;
-        g_bold_font->font_data = (void*)builtin_bold_font_8x16;
-        g_bold_font->font_data_size = sizeof(builtin_bold_font_8x16);
+        BUILTIN_FONT_DATA(g_bold_font, 2, bold_font_8x16);
         g_bold_font->private_context = NULL;
     }
 }
@@ -98,6 +166,10 @@ void InitFontSystem(void) {
 }
 
 void ShutdownFontSystem(void) {
+    DropGlyphAtlases(NULL);
+    DropCachedGlyphs(NULL);
+    DropMeasuredText(NULL);
+    ReleasePackedFonts();
     for (int i = 0; i < g_font_cache_count; i++) {
         if (g_font_cache[i]) {
             UnloadFont(g_font_cache[i]);
@@ -121,15 +193,15 @@ void ShutdownFontSystem(void) {
 }
 
 Font* GetDefaultFont(void) {
-    return g_default_font;
+    return ExpandBuiltinFont(g_default_font);
 }
 
 Font* GetMonospaceFont(void) {
-    return g_mono_font;
+    return ExpandBuiltinFont(g_mono_font);
 }
 
 Font* GetBoldFont(void) {
-    return g_bold_font;
+    return ExpandBuiltinFont(g_bold_font);
 }
 
 void SetDefaultFont(Font* font) {
@@ -140,108 +212,492 @@ void SetDefaultFont(Font* font) {
 
 FT_Library ft_library = NULL;
 
-static int32_t RenderPsfGlyph(Font* font, uint32_t codepoint, int32_t x, int32_t y, GlyphRenderOptions* options) {
-    if (!font || !font->font_data || codepoint >= 256) {
+// Where glyph pixels land: the graphics back buffer when there is one (the
+// caller flushes it), otherwise the framebuffer itself, or a caller's
+// surface. Only the first two report dirty rectangles to the graphics layer.
+typedef struct {
+    uint32_t* pixels;
+    uint32_t stride;
+    uint32_t width;
+    uint32_t height;
+    uint8_t track_dirty;
+} GlyphTarget;
+
+static int GetGlyphTarget(GlyphTarget* target) {
+    target->track_dirty = 1;
+    target->pixels = GetBackBuffer(&target->width, &target->height);
+    if (target->pixels) {
+        target->stride = target->width;
+        return 1;
+    }
+    if (!GraphicsOutput) {
         return 0;
     }
-    
-    const uint8_t* font_data = (const uint8_t*)font->font_data;
-    uint8_t height = font->metadata.line_height;
-    uint32_t bytes_per_glyph = height; // 1 byte per row for 8-pixel wide PSF
-    const uint8_t* glyph_data = &font_data[codepoint * bytes_per_glyph];
-    
-    // Render the PSF bitmap
-    for (int row = 0; row < height; row++) {
-        uint8_t byte_data = glyph_data[row];
-        for (int col = 0; col < 8; col++) {
-            if (byte_data & (0x80 >> col)) {
-                // Pixel is set, draw it
-                uint32_t pixel_x = x + col;
-                uint32_t pixel_y = y + row;
-                if (GraphicsOutput) {
-                    uint32_t* framebuffer = (uint32_t*)GraphicsOutput->Mode->FrameBufferBase;
-                    uint32_t pixels_per_scanline = GraphicsOutput->Mode->Info->PixelsPerScanLine;
-                    
-                    if (pixel_x < GraphicsOutput->Mode->Info->HorizontalResolution &&
-                        pixel_y < GraphicsOutput->Mode->Info->VerticalResolution) {
-                        framebuffer[pixel_y * pixels_per_scanline + pixel_x] = options->color;
-                    }
-                }
+    target->pixels = (uint32_t*)GraphicsOutput->Mode->FrameBufferBase;
+    target->stride = GraphicsOutput->Mode->Info->PixelsPerScanLine;
+    target->width = GraphicsOutput->Mode->Info->HorizontalResolution;
+    target->height = GraphicsOutput->Mode->Info->VerticalResolution;
+    return 1;
+}
+
+static inline void PlotPixel(const GlyphTarget* target, uint32_t x, uint32_t y, uint32_t color) {
+    if (x < target->width && y < target->height) {
+        target->pixels[(uintptr_t)y * target->stride + x] = color;
+    }
+}
+
+// PSF fonts with a unicode table keep a codepoint-to-glyph index in
+// private_context, built once at load: a page table over the BMP (the
+// menus' UCS-2 strings reach no further), so a lookup is two loads.
+// Fonts without a table map codepoint N to glyph N.
+#define GLYPH_INDEX_PAGES   256
+#define GLYPH_INDEX_NONE    0xFFFF
+
+typedef struct {
+    uint16_t page_count;
+    uint16_t pages[GLYPH_INDEX_PAGES];      // codepoint >> 8 -> page + 1, 0 = no glyphs
+    uint16_t glyphs[][256];                 // codepoint & 0xFF -> glyph
+} GlyphIndex;
+
+// Glyph number of a codepoint in a bitmap or PSF font, or -1 when the
+// font maps nothing there. Built-in bitmap fonts cover ASCII 32-126.
+static int32_t GetGlyphIndex(const Font* font, uint32_t codepoint) {
+    if (font->format == FONT_FORMAT_BITMAP) {
+        return (codepoint >= 32 && codepoint <= 126) ? (int32_t)(codepoint - 32) : -1;
+    }
+    if (font->format != FONT_FORMAT_PSF) return -1;
+
+    const GlyphIndex* index = (const GlyphIndex*)font->private_context;
+    if (!index) return codepoint <= 0xFFFF ? (int32_t)codepoint : -1;
+    if (codepoint > 0xFFFF) return -1;
+    uint16_t page = index->pages[codepoint >> 8];
+    if (!page) return -1;
+    uint16_t glyph = index->glyphs[page - 1][codepoint & 0xFF];
+    return glyph == GLYPH_INDEX_NONE ? -1 : glyph;
+}
+
+static uint32_t GetGlyphBytesPerRow(const Font* font) {
+    return font->format == FONT_FORMAT_BITMAP ? 1 : (font->metadata.max_width + 7) / 8;
+}
+
+// Glyphs the font's data holds
+static uint32_t GetGlyphCount(const Font* font) {
+    uint32_t bytes_per_glyph = GetGlyphBytesPerRow(font) * font->metadata.line_height;
+    return bytes_per_glyph ? font->font_data_size / bytes_per_glyph : 0;
+}
+
+// Row bits of one glyph of a bitmap or PSF font (MSB = leftmost pixel),
+// ceil(width / 8) bytes per row, or NULL past the end of the font
+static const uint8_t* GetGlyphBits(const Font* font, uint32_t glyph, uint32_t* bytes_per_row) {
+    if (!font->font_data) return NULL;
+    if (font->format != FONT_FORMAT_BITMAP && font->format != FONT_FORMAT_PSF) return NULL;
+
+    uint32_t row_bytes = GetGlyphBytesPerRow(font);
+    uint32_t bytes_per_glyph = row_bytes * font->metadata.line_height;
+    if ((uint64_t)(glyph + 1) * bytes_per_glyph > font->font_data_size) return NULL;
+    *bytes_per_row = row_bytes;
+    return (const uint8_t*)font->font_data + (size_t)glyph * bytes_per_glyph;
+}
+
+// Glyph number and bits of a codepoint, or -1
+static int32_t LookupGlyph(const Font* font, uint32_t codepoint) {
+    uint32_t bytes_per_row;
+    int32_t glyph = GetGlyphIndex(font, codepoint);
+    if (glyph < 0 || !GetGlyphBits(font, (uint32_t)glyph, &bytes_per_row)) return -1;
+    return glyph;
+}
+
+static uint32_t GetGlyphWidth(Font* font) {
+    return font->format == FONT_FORMAT_BITMAP ? 8 : font->metadata.max_width;
+}
+
+// Pre-rasterized glyphs for one (font, color, background) combination,
+// by glyph number. Each glyph is expanded the first time it is drawn into
+// width x height 32-bit pixels; with a transparent background, set pixels
+// carry FONT_ATLAS_INK so blitting can skip the rest.
+#define FONT_ATLAS_MAX      8
+#define FONT_ATLAS_INK      0xFF000000u
+
+typedef struct {
+    Font* font;
+    uint32_t color;
+    uint32_t bg_color;
+    uint8_t use_bg;
+    uint32_t width;
+    uint32_t height;
+    uint32_t glyph_count;
+    uint32_t* glyphs[];
+} GlyphAtlas;
+
+static GlyphAtlas* g_atlases[FONT_ATLAS_MAX];
+static int g_atlas_next = 0;
+
+static void FreeGlyphAtlas(GlyphAtlas* atlas) {
+    for (uint32_t i = 0; i < atlas->glyph_count; i++) {
+        if (atlas->glyphs[i]) free(atlas->glyphs[i]);
+    }
+    free(atlas);
+}
+
+// Drop the atlases built for `font`, or all of them when it is NULL
+static void DropGlyphAtlases(Font* font) {
+    for (int i = 0; i < FONT_ATLAS_MAX; i++) {
+        if (g_atlases[i] && (!font || g_atlases[i]->font == font)) {
+            FreeGlyphAtlas(g_atlases[i]);
+            g_atlases[i] = NULL;
+        }
+    }
+}
+
+// Atlas for this font and these colors: an existing one, else a new one
+// in an empty slot or in place of the oldest
+static GlyphAtlas* GetGlyphAtlas(Font* font, const GlyphRenderOptions* options) {
+    uint32_t color = options->color & ~FONT_ATLAS_INK;
+    uint32_t bg_color = options->use_bg ? (options->bg_color & ~FONT_ATLAS_INK) : 0;
+    int slot = -1;
+
+    if (font->format != FONT_FORMAT_BITMAP && font->format != FONT_FORMAT_PSF) return NULL;
+    for (int i = 0; i < FONT_ATLAS_MAX; i++) {
+        GlyphAtlas* atlas = g_atlases[i];
+        if (!atlas) {
+            if (slot < 0) slot = i;
+            continue;
+        }
+        if (atlas->font == font && atlas->color == color &&
+            atlas->use_bg == (options->use_bg != 0) && atlas->bg_color == bg_color) {
+            return atlas;
+        }
+    }
+
+    uint32_t glyph_count = GetGlyphCount(font);
+    size_t atlas_size = sizeof(GlyphAtlas) + (size_t)glyph_count * sizeof(uint32_t*);
+    GlyphAtlas* atlas = (GlyphAtlas*)malloc(atlas_size);
+    if (!atlas) return NULL;
+    memset(atlas, 0, atlas_size);
+    atlas->glyph_count = glyph_count;
+    atlas->font = font;
+    atlas->color = color;
+    atlas->bg_color = bg_color;
+    atlas->use_bg = options->use_bg != 0;
+    atlas->width = GetGlyphWidth(font);
+    atlas->height = font->metadata.line_height;
+
+    if (slot < 0) {
+        slot = g_atlas_next;
+        g_atlas_next = (g_atlas_next + 1) % FONT_ATLAS_MAX;
+        FreeGlyphAtlas(g_atlases[slot]);
+    }
+    g_atlases[slot] = atlas;
+    return atlas;
+}
+
+// Expanded pixels of one glyph, rasterizing it on first use
+static const uint32_t* GetAtlasGlyph(GlyphAtlas* atlas, uint32_t glyph) {
+    uint32_t bytes_per_row;
+    const uint8_t* bits;
+
+    if (glyph >= atlas->glyph_count) return NULL;
+    if (atlas->glyphs[glyph]) return atlas->glyphs[glyph];
+
+    bits = GetGlyphBits(atlas->font, glyph, &bytes_per_row);
+    if (!bits || !atlas->width || !atlas->height) return NULL;
+
+    uint32_t* pixels = (uint32_t*)malloc((size_t)atlas->width * atlas->height * sizeof(uint32_t));
+    if (!pixels) return NULL;
+
+    uint32_t ink = atlas->use_bg ? atlas->color : (atlas->color | FONT_ATLAS_INK);
+    uint32_t* out = pixels;
+    for (uint32_t row = 0; row < atlas->height; row++, bits += bytes_per_row) {
+        for (uint32_t col = 0; col < atlas->width; col++) {
+            *out++ = (bits[col >> 3] & (0x80 >> (col & 7))) ? ink : atlas->bg_color;
+        }
+    }
+    atlas->glyphs[glyph] = pixels;
+    return pixels;
+}
+
+// Copy an expanded glyph to (x, y), clipped once for the whole glyph
+static void BlitAtlasGlyph(const GlyphTarget* target, const GlyphAtlas* atlas, const uint32_t* pixels,
+                           int32_t x, int32_t y) {
+    int32_t col0 = x < 0 ? -x : 0;
+    int32_t row0 = y < 0 ? -y : 0;
+    int32_t col1 = (int32_t)atlas->width;
+    int32_t row1 = (int32_t)atlas->height;
+
+    if ((int64_t)x + col1 > (int64_t)target->width) col1 = (int32_t)((int64_t)target->width - x);
+    if ((int64_t)y + row1 > (int64_t)target->height) row1 = (int32_t)((int64_t)target->height - y);
+    if (col0 >= col1 || row0 >= row1) return;
+
+    uint32_t span = (uint32_t)(col1 - col0);
+    const uint32_t* src = pixels + (uint32_t)row0 * atlas->width + (uint32_t)col0;
+    uint32_t* dst = target->pixels + (uintptr_t)(uint32_t)(y + row0) * target->stride + (uint32_t)(x + col0);
+
+    for (int32_t row = row0; row < row1; row++, src += atlas->width, dst += target->stride) {
+        if (atlas->use_bg) {
+            memcpy(dst, src, span * sizeof(uint32_t));
+        } else {
+            for (uint32_t i = 0; i < span; i++) {
+                if (src[i] & FONT_ATLAS_INK) dst[i] = src[i] & ~FONT_ATLAS_INK;
+            }
+        }
+    }
+    if (target->track_dirty) {
+        MarkDirtyRect((uint32_t)(x + col0), (uint32_t)(y + row0), span, (uint32_t)(row1 - row0));
+    }
+}
+
+// Bitmap and PSF glyphs by glyph number: from the atlas when one is
+// available, bit by bit when it could not be allocated
+static int32_t RenderBitmapGlyph(Font* font, GlyphAtlas* atlas, const GlyphTarget* target,
+                                 uint32_t glyph, int32_t x, int32_t y, GlyphRenderOptions* options) {
+    uint32_t bytes_per_row;
+    const uint32_t* pixels = atlas ? GetAtlasGlyph(atlas, glyph) : NULL;
+    if (pixels) {
+        BlitAtlasGlyph(target, atlas, pixels, x, y);
+        return font->metadata.max_width;
+    }
+
+    const uint8_t* bits = GetGlyphBits(font, glyph, &bytes_per_row);
+    if (!bits) return 0;
+
+    uint32_t width = GetGlyphWidth(font);
+    for (uint32_t row = 0; row < font->metadata.line_height; row++, bits += bytes_per_row) {
+        for (uint32_t col = 0; col < width; col++) {
+            uint32_t pixel_x = x + col;
+            uint32_t pixel_y = y + row;
+            if (bits[col >> 3] & (0x80 >> (col & 7))) {
+                PlotPixel(target, pixel_x, pixel_y, options->color);
             } else if (options->use_bg) {
-                // Draw background pixel
-                uint32_t pixel_x = x + col;
-                uint32_t pixel_y = y + row;
-                
-                if (GraphicsOutput) {
-                    uint32_t* framebuffer = (uint32_t*)GraphicsOutput->Mode->FrameBufferBase;
-                    uint32_t pixels_per_scanline = GraphicsOutput->Mode->Info->PixelsPerScanLine;
-                    
-                    if (pixel_x < GraphicsOutput->Mode->Info->HorizontalResolution &&
-                        pixel_y < GraphicsOutput->Mode->Info->VerticalResolution) {
-                        framebuffer[pixel_y * pixels_per_scanline + pixel_x] = options->bg_color;
-                    }
-                }
+                PlotPixel(target, pixel_x, pixel_y, options->bg_color);
             }
         }
     }
-    
-    return font->metadata.max_width; // PSF fonts are typically 8 pixels wide
+    if (target->track_dirty) {
+        MarkDirtyRect(x, y, width, font->metadata.line_height);
+    }
+    return font->metadata.max_width;
 }
 
-static int32_t RenderBitmapGlyph(Font* font, uint32_t codepoint, int32_t x, int32_t y, GlyphRenderOptions* options) {
-    if (!font || !font->font_data || codepoint < 32 || codepoint > 126) {
-        return 0;
+// Scalable (TTF/OTF) fonts keep one FreeType face in private_context,
+// created on first use and resized only when metadata.size changes.
+typedef struct {
+    FT_Face face;
+    uint16_t pixel_size;        // Size the face is currently set to, 0 = none
+} ScalableFace;
+
+// Rendered coverage bitmaps of scalable glyphs, keyed by (font, codepoint,
+// pixel size) and evicted least recently used first once the cache holds
+// more than g_glyph_cache_limit glyphs (see SetGlyphCacheSize).
+#define GLYPH_CACHE_DEFAULT_SIZE    256
+#define GLYPH_CACHE_BUCKETS         256
+
+typedef struct CachedGlyph {
+    struct CachedGlyph* hash_next;
+    struct CachedGlyph* lru_prev;   // Towards the most recently used
+    struct CachedGlyph* lru_next;
+    Font* font;
+    uint32_t codepoint;
+    uint16_t pixel_size;
+    int32_t left;                   // Bitmap origin relative to the pen,
+    int32_t top;                    // FreeType style (top is up from the baseline)
+    int32_t advance;
+    uint32_t width;
+    uint32_t rows;
+    uint8_t coverage[];             // width * rows, 0 = empty, 255 = solid
+} CachedGlyph;
+
+static CachedGlyph* g_glyph_buckets[GLYPH_CACHE_BUCKETS];
+static CachedGlyph* g_glyph_lru_head = NULL;
+static CachedGlyph* g_glyph_lru_tail = NULL;
+static uint32_t g_glyph_cache_count = 0;
+static uint32_t g_glyph_cache_limit = GLYPH_CACHE_DEFAULT_SIZE;
+
+static uint32_t GlyphCacheBucket(const Font* font, uint32_t codepoint, uint16_t pixel_size) {
+    uintptr_t h = (uintptr_t)font >> 4;
+    h ^= codepoint * 0x9E3779B1u;
+    h ^= (uintptr_t)pixel_size << 20;
+    return (uint32_t)(h ^ (h >> 11)) & (GLYPH_CACHE_BUCKETS - 1);
+}
+
+static void GlyphLruUnlink(CachedGlyph* glyph) {
+    if (glyph->lru_prev) glyph->lru_prev->lru_next = glyph->lru_next;
+    else g_glyph_lru_head = glyph->lru_next;
+    if (glyph->lru_next) glyph->lru_next->lru_prev = glyph->lru_prev;
+    else g_glyph_lru_tail = glyph->lru_prev;
+    glyph->lru_prev = glyph->lru_next = NULL;
+}
+
+static void GlyphLruPushFront(CachedGlyph* glyph) {
+    glyph->lru_prev = NULL;
+    glyph->lru_next = g_glyph_lru_head;
+    if (g_glyph_lru_head) g_glyph_lru_head->lru_prev = glyph;
+    g_glyph_lru_head = glyph;
+    if (!g_glyph_lru_tail) g_glyph_lru_tail = glyph;
+}
+
+static void FreeCachedGlyph(CachedGlyph* glyph) {
+    CachedGlyph** link = &g_glyph_buckets[GlyphCacheBucket(glyph->font, glyph->codepoint, glyph->pixel_size)];
+    while (*link && *link != glyph) link = &(*link)->hash_next;
+    if (*link) *link = glyph->hash_next;
+    GlyphLruUnlink(glyph);
+    g_glyph_cache_count--;
+    free(glyph);
+}
+
+static void TrimGlyphCache(uint32_t limit) {
+    while (g_glyph_cache_count > limit && g_glyph_lru_tail) {
+        FreeCachedGlyph(g_glyph_lru_tail);
     }
-    
-    const uint8_t* font_data = (const uint8_t*)font->font_data;
-    uint32_t glyph_index = codepoint - 32;
-    uint32_t bytes_per_glyph = (font->metadata.line_height * font->metadata.max_width + 7) / 8;
-    
-    if (font->metadata.line_height == 16 && font->metadata.max_width == 8) {
-        bytes_per_glyph = 16; // 8x16 = 16 bytes per character
-    } else if (font->metadata.line_height == 8 && font->metadata.max_width == 8) {
-        bytes_per_glyph = 8;  // 8x8 = 8 bytes per character
+}
+
+// Drop the cached glyphs of `font`, or all of them when it is NULL
+static void DropCachedGlyphs(Font* font) {
+    CachedGlyph* glyph = g_glyph_lru_head;
+    while (glyph) {
+        CachedGlyph* next = glyph->lru_next;
+        if (!font || glyph->font == font) FreeCachedGlyph(glyph);
+        glyph = next;
     }
-    
-    const uint8_t* glyph_data = &font_data[glyph_index * bytes_per_glyph];
-    
-    // Render the bitmap
-    for (int row = 0; row < font->metadata.line_height; row++) {
-        uint8_t byte_data = glyph_data[row];
-        for (int col = 0; col < 8; col++) {
-            if (byte_data & (0x80 >> col)) {
-                // Pixel is set, draw it
-                uint32_t pixel_x = x + col;
-                uint32_t pixel_y = y + row;
-                // Pixel Drawing starts from here.
-                if (GraphicsOutput) {
-                    uint32_t* framebuffer = (uint32_t*)GraphicsOutput->Mode->FrameBufferBase;
-                    uint32_t pixels_per_scanline = GraphicsOutput->Mode->Info->PixelsPerScanLine;
-                    
-                    if (pixel_x < GraphicsOutput->Mode->Info->HorizontalResolution &&
-                        pixel_y < GraphicsOutput->Mode->Info->VerticalResolution) {
-                        framebuffer[pixel_y * pixels_per_scanline + pixel_x] = options->color;
-                    }
-                }
-            } else if (options->use_bg) {
-                // Draw background pixel
-                uint32_t pixel_x = x + col;
-                uint32_t pixel_y = y + row;
-                
-                if (GraphicsOutput) {
-                    uint32_t* framebuffer = (uint32_t*)GraphicsOutput->Mode->FrameBufferBase;
-                    uint32_t pixels_per_scanline = GraphicsOutput->Mode->Info->PixelsPerScanLine;
-                    
-                    if (pixel_x < GraphicsOutput->Mode->Info->HorizontalResolution &&
-                        pixel_y < GraphicsOutput->Mode->Info->VerticalResolution) {
-                        framebuffer[pixel_y * pixels_per_scanline + pixel_x] = options->bg_color;
-                    }
+}
+
+void SetGlyphCacheSize(uint32_t max_glyphs) {
+    g_glyph_cache_limit = max_glyphs ? max_glyphs : GLYPH_CACHE_DEFAULT_SIZE;
+    TrimGlyphCache(g_glyph_cache_limit);
+}
+
+void SetFontPixelSize(Font* font, uint16_t pixel_size) {
+    if (!font || !pixel_size) return;
+    font->metadata.size = pixel_size;
+}
+
+// The font's face at its current pixel size, or NULL if FreeType cannot
+// open it. Resizing also refreshes the line metrics the layout code uses.
+static FT_Face GetScalableFace(Font* font) {
+    ScalableFace* scalable = (ScalableFace*)font->private_context;
+
+    if (!ft_library && FT_Init_FreeType(&ft_library)) {
+        return NULL;
+    }
+    if (!scalable) {
+        scalable = (ScalableFace*)malloc(sizeof(ScalableFace));
+        if (!scalable) return NULL;
+        if (FT_New_Memory_Face(ft_library, font->font_data, font->font_data_size, 0, &scalable->face)) {
+            free(scalable);
+            return NULL;
+        }
+        scalable->pixel_size = 0;
+        font->private_context = scalable;
+    }
+    if (scalable->pixel_size != font->metadata.size) {
+        if (FT_Set_Char_Size(scalable->face, 0, font->metadata.size * 64, 72, 72)) {
+            return NULL;
+        }
+        scalable->pixel_size = font->metadata.size;
+        const FT_Size_Metrics* metrics = &scalable->face->size->metrics;
+        font->metadata.baseline = (uint16_t)(metrics->ascender >> 6);
+        font->metadata.line_height = (uint16_t)(metrics->height >> 6);
+        font->metadata.max_width = (uint16_t)(metrics->max_advance >> 6);
+    }
+    return scalable->face;
+}
+
+// Coverage bitmap of one scalable glyph at the font's current size, from
+// the cache or freshly rasterized into it
+static CachedGlyph* GetCachedGlyph(Font* font, uint32_t codepoint) {
+    uint16_t pixel_size = font->metadata.size;
+    uint32_t bucket = GlyphCacheBucket(font, codepoint, pixel_size);
+
+    for (CachedGlyph* glyph = g_glyph_buckets[bucket]; glyph; glyph = glyph->hash_next) {
+        if (glyph->font == font && glyph->codepoint == codepoint && glyph->pixel_size == pixel_size) {
+            GlyphLruUnlink(glyph);
+            GlyphLruPushFront(glyph);
+            return glyph;
+        }
+    }
+
+    FT_Face face = GetScalableFace(font);
+    if (!face || FT_Load_Char(face, codepoint, FT_LOAD_RENDER | FT_LOAD_TARGET_NORMAL)) {
+        return NULL;
+    }
+
+    FT_Bitmap* bitmap = &face->glyph->bitmap;
+    size_t pixels = (size_t)bitmap->width * bitmap->rows;
+    CachedGlyph* glyph = (CachedGlyph*)malloc(sizeof(CachedGlyph) + pixels);
+    if (!glyph) return NULL;
+
+    glyph->font = font;
+    glyph->codepoint = codepoint;
+    glyph->pixel_size = pixel_size;
+    glyph->left = face->glyph->bitmap_left;
+    glyph->top = face->glyph->bitmap_top;
+    glyph->advance = (int32_t)(face->glyph->advance.x >> 6);
+    glyph->width = bitmap->width;
+    glyph->rows = bitmap->rows;
+    for (uint32_t row = 0; row < bitmap->rows; row++) {
+        const uint8_t* src = bitmap->buffer + (ptrdiff_t)row * bitmap->pitch;
+        uint8_t* dst = glyph->coverage + (size_t)row * bitmap->width;
+        if (bitmap->pixel_mode == FT_PIXEL_MODE_MONO) {
+            for (uint32_t col = 0; col < bitmap->width; col++) {
+                dst[col] = (src[col >> 3] & (0x80 >> (col & 7))) ? 255 : 0;
+            }
+        } else {
+            memcpy(dst, src, bitmap->width);
+        }
+    }
+
+    glyph->hash_next = g_glyph_buckets[bucket];
+    g_glyph_buckets[bucket] = glyph;
+    GlyphLruPushFront(glyph);
+    g_glyph_cache_count++;
+    TrimGlyphCache(g_glyph_cache_limit);
+    return glyph;
+}
+
+static inline uint32_t BlendPixel(uint32_t color, uint32_t under, uint32_t alpha) {
+    uint32_t rb = ((color & 0xFF00FF) * alpha + (under & 0xFF00FF) * (255 - alpha)) / 255;
+    uint32_t g = ((color & 0x00FF00) * alpha + (under & 0x00FF00) * (255 - alpha)) / 255;
+    return (rb & 0xFF00FF) | (g & 0x00FF00);
+}
+
+// Draw a scalable glyph with its pen at (x, y + baseline), y being the top
+// of the line as for the bitmap fonts. Coverage blends against the
+// background color, or against what is already there when use_bg is off.
+static int32_t RenderScalableGlyph(Font* font, const GlyphTarget* target, uint32_t codepoint,
+                                   int32_t x, int32_t y, GlyphRenderOptions* options) {
+    CachedGlyph* glyph = GetCachedGlyph(font, codepoint);
+    if (!glyph) return 0;
+
+    int32_t gx = x + glyph->left;
+    int32_t gy = y + font->metadata.baseline - glyph->top;
+    int32_t col0 = gx < 0 ? -gx : 0;
+    int32_t row0 = gy < 0 ? -gy : 0;
+    int32_t col1 = (int32_t)glyph->width;
+    int32_t row1 = (int32_t)glyph->rows;
+
+    if (target) {
+        if ((int64_t)gx + col1 > (int64_t)target->width) col1 = (int32_t)((int64_t)target->width - gx);
+        if ((int64_t)gy + row1 > (int64_t)target->height) row1 = (int32_t)((int64_t)target->height - gy);
+    }
+    if (target && col0 < col1 && row0 < row1) {
+        uint32_t color = options->color & 0xFFFFFF;
+        uint32_t bg_color = options->bg_color & 0xFFFFFF;
+        for (int32_t row = row0; row < row1; row++) {
+            const uint8_t* cov = glyph->coverage + (uint32_t)row * glyph->width + (uint32_t)col0;
+            uint32_t* dst = target->pixels + (uintptr_t)(uint32_t)(gy + row) * target->stride + (uint32_t)(gx + col0);
+            for (int32_t i = 0; i < col1 - col0; i++) {
+                uint32_t alpha = cov[i];
+                if (alpha == 255) {
+                    dst[i] = color;
+                } else if (alpha || options->use_bg) {
+                    dst[i] = BlendPixel(color, options->use_bg ? bg_color : dst[i], alpha);
                 }
             }
         }
+        if (target->track_dirty) {
+            MarkDirtyRect((uint32_t)(gx + col0), (uint32_t)(gy + row0), (uint32_t)(col1 - col0), (uint32_t)(row1 - row0));
+        }
     }
-    
-    return font->metadata.max_width;
+    return glyph->advance > 0 ? glyph->advance : font->metadata.max_width;
 }
 
 int32_t RenderGlyph(Font* font, uint32_t codepoint, int32_t x, int32_t y, GlyphRenderOptions* options) {
@@ -249,85 +705,77 @@ int32_t RenderGlyph(Font* font, uint32_t codepoint, int32_t x, int32_t y, GlyphR
     
     switch (font->format) {
         case FONT_FORMAT_BITMAP:
-            return RenderBitmapGlyph(font, codepoint, x, y, options);
-        case FONT_FORMAT_PSF:
-            return RenderPsfGlyph(font, codepoint, x, y, options);
+        case FONT_FORMAT_PSF: {
+            GlyphTarget target;
+            int32_t glyph = LookupGlyph(font, codepoint);
+            if (glyph < 0) return 0;
+            if (!GetGlyphTarget(&target)) return font->metadata.max_width;
+            return RenderBitmapGlyph(font, GetGlyphAtlas(font, options), &target, (uint32_t)glyph, x, y, options);
+        }
         case FONT_FORMAT_TTF:
         case FONT_FORMAT_OTF: {
-            if (!ft_library) {
-                FT_Error error = FT_Init_FreeType(&ft_library);
-                if (error) {
-                    return 0;
-                }
-            }
-            
-            FT_Face face;
-            FT_Error error = FT_New_Memory_Face(ft_library, font->font_data, font->font_data_size, 0, &face);
-            if (error) {
-                return 0;
-            }
-            
-            error = FT_Set_Char_Size(face, 0, font->metadata.size * 64, 72, 72);
-            if (error) {
-                FT_Done_Face(face);
-                return 0;
-            }
-            
-            error = FT_Load_Char(face, codepoint, FT_LOAD_RENDER | FT_LOAD_TARGET_NORMAL);
-            if (error) {
-                FT_Done_Face(face);
-                return 0;
-            }
-            
-            FT_Bitmap* bitmap = &face->glyph->bitmap;
-            int32_t bitmap_left = face->glyph->bitmap_left;
-            int32_t bitmap_top = face->glyph->bitmap_top;
-            
-            for (int row = 0; row < bitmap->rows; row++) {
-                for (int col = 0; col < bitmap->width; col++) {
-                    uint32_t pixel_x = x + col + bitmap_left;
-                    uint32_t pixel_y = y + bitmap_top - row - 1;
-                    
-                    if (pixel_x < GraphicsOutput->Mode->Info->HorizontalResolution &&
-                        pixel_y < GraphicsOutput->Mode->Info->VerticalResolution) {
-                        uint32_t* framebuffer = (uint32_t*)GraphicsOutput->Mode->FrameBufferBase;
-                        uint32_t pixels_per_scanline = GraphicsOutput->Mode->Info->PixelsPerScanLine;
-                        
-                        uint8_t alpha = bitmap->buffer[row * bitmap->pitch + col];
-                        if (alpha > 0) {
-                            uint32_t color = options->color;
-                            if (options->use_bg && alpha < 255) {
-                                uint32_t bg_color = options->bg_color;
-                                // Alpha blending
-                                uint32_t result_color = ((color & 0xFF) * alpha + (bg_color & 0xFF) * (255 - alpha)) / 255 |
-                                                      (((color & 0xFF00) >> 8) * alpha + ((bg_color & 0xFF00) >> 8) * (255 - alpha)) / 255 << 8 |
-                                                      (((color & 0xFF0000) >> 16) * alpha + ((bg_color & 0xFF0000) >> 16) * (255 - alpha)) / 255 << 16;
-                                framebuffer[pixel_y * pixels_per_scanline + pixel_x] = result_color;
-                            } else {
-                                framebuffer[pixel_y * pixels_per_scanline + pixel_x] = color;
-                            }
-                        } else if (options->use_bg) {
-                            framebuffer[pixel_y * pixels_per_scanline + pixel_x] = options->bg_color;
-                        }
-                    }
-                }
-            }
-            
-            int32_t advance = face->glyph->advance.x >> 6;
-            FT_Done_Face(face);
-            return advance > 0 ? advance : font->metadata.max_width;
+            GlyphTarget target;
+            int have_target = GetGlyphTarget(&target);
+            return RenderScalableGlyph(font, have_target ? &target : NULL, codepoint, x, y, options);
         }
         default:
             return 0;
     }
 }
 
+// Same as RenderGlyph, but into the caller's surface; bitmap and PSF
+// glyphs still come from the shared atlas
+int32_t RenderGlyphToSurface(Font* font, const FontSurface* surface, uint32_t codepoint,
+                             int32_t x, int32_t y, GlyphRenderOptions* options) {
+    if (!font || !surface || !surface->pixels || !options) return 0;
+
+    GlyphTarget target;
+    target.pixels = surface->pixels;
+    target.stride = surface->stride;
+    target.width = surface->width;
+    target.height = surface->height;
+    target.track_dirty = 0;
+
+    switch (font->format) {
+        case FONT_FORMAT_BITMAP:
+        case FONT_FORMAT_PSF: {
+            int32_t glyph = LookupGlyph(font, codepoint);
+            if (glyph < 0) return 0;
+            return RenderBitmapGlyph(font, GetGlyphAtlas(font, options), &target, (uint32_t)glyph, x, y, options);
+        }
+        case FONT_FORMAT_TTF:
+        case FONT_FORMAT_OTF:
+            return RenderScalableGlyph(font, &target, codepoint, x, y, options);
+        default:
+            return 0;
+    }
+}
+
 int32_t RenderText(Font* font, const wchar_t* text, int32_t x, int32_t y, GlyphRenderOptions* options) {
     if (!font || !text || !options) return 0;
     
     int32_t current_x = x;
     int32_t text_width = 0;
     
+    // Bitmap and PSF fonts: resolve the target and the atlas once for the
+    // whole string instead of once per glyph
+    if (font->format == FONT_FORMAT_BITMAP || font->format == FONT_FORMAT_PSF) {
+        GlyphTarget target;
+        GlyphAtlas* atlas = GetGlyphAtlas(font, options);
+        int have_target = GetGlyphTarget(&target);
+        
+        for (; *text; text++) {
+            int32_t glyph = LookupGlyph(font, *text);
+            if (glyph < 0) continue;
+            int32_t glyph_width = have_target
+                ? RenderBitmapGlyph(font, atlas, &target, (uint32_t)glyph, current_x, y, options)
+                : font->metadata.max_width;
+            current_x += glyph_width;
+            text_width += glyph_width;
+        }
+        return text_width;
+    }
+    
     while (*text) {
         uint32_t codepoint = *text;
         int32_t glyph_width = RenderGlyph(font, codepoint, current_x, y, options);
@@ -339,20 +787,81 @@ int32_t RenderText(Font* font, const wchar_t* text, int32_t x, int32_t y, GlyphR
     return text_width;
 }
 
+// Widths of recently measured strings: menus measure the same labels on
+// every redraw. Direct-mapped on a hash of the text; strings longer than
+// MEASURE_CACHE_TEXT are measured every time.
+#define MEASURE_CACHE_SLOTS 64
+#define MEASURE_CACHE_TEXT  64
+
+typedef struct {
+    Font* font;                 // NULL: empty slot
+    uint16_t pixel_size;
+    uint16_t length;
+    int32_t width;
+    wchar_t text[MEASURE_CACHE_TEXT];
+} MeasuredText;
+
+static MeasuredText g_measured[MEASURE_CACHE_SLOTS];
+
+// Drop the widths measured with `font`, or all of them when it is NULL
+static void DropMeasuredText(Font* font) {
+    for (int i = 0; i < MEASURE_CACHE_SLOTS; i++) {
+        if (!font || g_measured[i].font == font) g_measured[i].font = NULL;
+    }
+}
+
+static int32_t MeasureTextWidth(Font* font, const wchar_t* text) {
+    int32_t width = 0;
+
+    // Scalable fonts: the sum of the real advances (which also warms the
+    // glyph cache)
+    if (font->format == FONT_FORMAT_TTF || font->format == FONT_FORMAT_OTF) {
+        for (const wchar_t* p = text; *p; p++) {
+            CachedGlyph* glyph = GetCachedGlyph(font, *p);
+            if (glyph) width += glyph->advance;
+        }
+        return width;
+    }
+    for (const wchar_t* p = text; *p; p++) {
+        if (LookupGlyph(font, *p) >= 0) width += font->metadata.max_width;
+    }
+    return width;
+}
+
 void MeasureText(Font* font, const wchar_t* text, TextMetrics* metrics) {
     if (!font || !text || !metrics) return;
     
-    metrics->width = 0;
+    // Scalable fonts: sizing the face fixes the line metrics
+    if (font->format == FONT_FORMAT_TTF || font->format == FONT_FORMAT_OTF) {
+        GetScalableFace(font);
+    }
     metrics->height = font->metadata.line_height;
     metrics->ascent = font->metadata.baseline;
     metrics->descent = font->metadata.line_height - font->metadata.baseline;
-    
-    while (*text) {
-        if (*text >= 32 && *text <= 126) {
-            metrics->width += font->metadata.max_width;
-        }
-        text++;
+
+    uint32_t hash = BH_FNV1A_INIT;
+    uint32_t length = 0;
+    for (; text[length] && length <= MEASURE_CACHE_TEXT; length++) {
+        hash = bh_fnv1a_step(hash, (uint32_t)text[length]);
+    }
+    if (length > MEASURE_CACHE_TEXT) {
+        metrics->width = MeasureTextWidth(font, text);
+        return;
     }
+
+    MeasuredText* slot = &g_measured[(hash ^ (hash >> 16)) & (MEASURE_CACHE_SLOTS - 1)];
+    if (slot->font == font && slot->pixel_size == font->metadata.size && slot->length == length &&
+        memcmp(slot->text, text, length * sizeof(wchar_t)) == 0) {
+        metrics->width = slot->width;
+        return;
+    }
+
+    metrics->width = MeasureTextWidth(font, text);
+    slot->font = font;
+    slot->pixel_size = font->metadata.size;
+    slot->length = (uint16_t)length;
+    slot->width = metrics->width;
+    memcpy(slot->text, text, length * sizeof(wchar_t));
 }
 
 Font* LoadFontFromMemory(const void* data, uint32_t size, FontFormat format) {
@@ -389,43 +898,21 @@ Font* LoadFontFromMemory(const void* data, uint32_t size, FontFormat format) {
     return font;
 }
 
-static EFI_STATUS get_root(EFI_FILE_HANDLE* root) {
-    EFI_STATUS Status;
-    EFI_LOADED_IMAGE_PROTOCOL* LoadedImage = NULL;
-    EFI_SIMPLE_FILE_SYSTEM_PROTOCOL* Fs = NULL;
-    extern EFI_HANDLE gImageHandle;
-    extern EFI_BOOT_SERVICES* gBS;
-    Status = gBS->HandleProtocol(gImageHandle, &gEfiLoadedImageProtocolGuid, (VOID**)&LoadedImage);
-    if (EFI_ERROR(Status)) return Status;
-    Status = gBS->HandleProtocol(LoadedImage->DeviceHandle, &gEfiSimpleFileSystemProtocolGuid, (VOID**)&Fs);
-    if (EFI_ERROR(Status)) return Status;
-    return Fs->OpenVolume(Fs, root);
-}
-
 static EFI_STATUS read_file(CONST CHAR16* path, VOID** out, UINTN* out_size) {
     *out = NULL; *out_size = 0;
-    EFI_STATUS Status; EFI_FILE_HANDLE root=NULL, file=NULL;
-    Status = get_root(&root); if (EFI_ERROR(Status)) return Status;
-    Status = root->Open(root, &file, (CHAR16*)path, EFI_FILE_MODE_READ, 0);
-    if (EFI_ERROR(Status)) return Status;
-    EFI_FILE_INFO* info = NULL; UINTN info_sz = 0;
-    Status = file->GetInfo(file, &gEfiFileInfoGuid, &info_sz, NULL);
-    if (Status == EFI_BUFFER_TOO_SMALL) {
-        info = AllocateZeroPool(info_sz);
-        if (!info) { file->Close(file); return EFI_OUT_OF_RESOURCES; }
-        Status = file->GetInfo(file, &gEfiFileInfoGuid, &info_sz, info);
-    }
-    if (EFI_ERROR(Status)) { if (info) FreePool(info); file->Close(file); return Status; }
-    UINTN size = (UINTN)info->FileSize; VOID* buf = AllocateZeroPool(size);
-    if (!buf) { FreePool(info); file->Close(file); return EFI_OUT_OF_RESOURCES; }
-    Status = file->Read(file, &size, buf);
-    file->Close(file); FreePool(info);
-    if (EFI_ERROR(Status)) { FreePool(buf); return Status; }
-    *out = buf; *out_size = size; return EFI_SUCCESS;
+    return ReadFile((CHAR16*)path, out, out_size);
 }
 
+// Unicode table after the glyphs of a PSF font, if it has one
+typedef struct {
+    const UINT8* data;
+    UINTN size;
+    BOOLEAN psf2;               // UTF-8 entries; PSF1 has UCS-2
+} PSF_UNICODE_TABLE;
+
 // Enhanced PSF1/PSF2 detection and extraction
-static BOOLEAN parse_psf1(const UINT8* data, UINTN size, UINT8* out_height, const UINT8** glyphs, UINTN* glyph_count) {
+static BOOLEAN parse_psf1(const UINT8* data, UINTN size, UINT8* out_height, const UINT8** glyphs, UINTN* glyph_count,
+                          PSF_UNICODE_TABLE* unicode) {
     if (size < 4) return FALSE;
     // PSF1 magic 0x36 0x04
     if (!(data[0] == 0x36 && data[1] == 0x04)) return FALSE;
@@ -436,10 +923,17 @@ static BOOLEAN parse_psf1(const UINT8* data, UINTN size, UINT8* out_height, cons
     UINTN table_off = 4; // followed by glyphs
     if (size < table_off + (UINTN)charsize * (*glyph_count)) return FALSE;
     *glyphs = data + table_off;
+
+    // PSF1_MODEHASTAB or PSF1_MODEHASSEQ
+    UINTN end = table_off + (UINTN)charsize * (*glyph_count);
+    unicode->data = (mode & 0x06) ? data + end : NULL;
+    unicode->size = (mode & 0x06) ? size - end : 0;
+    unicode->psf2 = FALSE;
     return TRUE;
 }
 
-static BOOLEAN parse_psf2(const UINT8* data, UINTN size, UINT8* out_height, UINT8* out_width, const UINT8** glyphs, UINTN* glyph_count) {
+static BOOLEAN parse_psf2(const UINT8* data, UINTN size, UINT8* out_height, UINT8* out_width, const UINT8** glyphs, UINTN* glyph_count,
+                          PSF_UNICODE_TABLE* unicode) {
     if (size < 32) return FALSE;
     // PSF2 magic
     if (!(data[0] == 0x72 && data[1] == 0xb5 && data[2] == 0x4a && data[3] == 0x86)) return FALSE;
@@ -456,11 +950,102 @@ static BOOLEAN parse_psf2(const UINT8* data, UINTN size, UINT8* out_height, UINT
     *out_width = (UINT8)width;
     *glyph_count = numglyphs;
     
-    if (headersize > size || size < headersize + bytesperglyph * numglyphs) return FALSE;
+    // Glyphs are read as packed rows of the header's size
+    if (height > 255 || width > 255 || bytesperglyph != ((width + 7) / 8) * height) return FALSE;
+    UINT64 end = (UINT64)headersize + (UINT64)bytesperglyph * numglyphs;
+    if (headersize > size || size < end) return FALSE;
     *glyphs = data + headersize;
+
+    // PSF2_HAS_UNICODE_TABLE
+    unicode->data = (flags & 0x01) ? data + end : NULL;
+    unicode->size = (flags & 0x01) ? size - (UINTN)end : 0;
+    unicode->psf2 = TRUE;
     return TRUE;
 }
 
+// Next codepoint of a PSF unicode table entry. Returns 1 with a
+// codepoint, 0 at the entry's terminator, -1 at a start-of-sequence
+// marker (the codepoints after it, up to the terminator, form one
+// multi-codepoint sequence) or when the table is cut short.
+static int psf_next_codepoint(const PSF_UNICODE_TABLE* table, UINTN* pos, UINT32* codepoint) {
+    const UINT8* p = table->data + *pos;
+    UINTN left = table->size - *pos;
+
+    if (!table->psf2) {
+        if (left < 2) { *pos = table->size; return -1; }
+        UINT32 unit = p[0] | (p[1] << 8);
+        *pos += 2;
+        if (unit == 0xFFFF) return 0;
+        if (unit == 0xFFFE) return -1;
+        *codepoint = unit;
+        return 1;
+    }
+
+    if (left < 1) return -1;
+    UINT8 lead = p[0];
+    if (lead == 0xFF) { *pos += 1; return 0; }
+    if (lead == 0xFE) { *pos += 1; return -1; }
+    UINTN len = lead < 0x80 ? 1 : (lead & 0xE0) == 0xC0 ? 2 : (lead & 0xF0) == 0xE0 ? 3 : (lead & 0xF8) == 0xF0 ? 4 : 0;
+    if (!len || left < len) { *pos += 1; *codepoint = 0xFFFD; return 1; }
+    UINT32 cp = len == 1 ? lead : lead & (0x7F >> len);
+    for (UINTN i = 1; i < len; i++) cp = (cp << 6) | (p[i] & 0x3F);
+    *pos += len;
+    *codepoint = cp;
+    return 1;
+}
+
+// Build the codepoint-to-glyph index from a unicode table: one pass to
+// find the pages in use, one to fill them. Single codepoints only; the
+// first glyph listed for a codepoint wins. NULL without a table (the
+// identity mapping applies) or if it cannot be allocated.
+static GlyphIndex* build_glyph_index(const PSF_UNICODE_TABLE* table, UINTN glyph_count) {
+    UINT8 used[GLYPH_INDEX_PAGES];
+    GlyphIndex* index = NULL;
+
+    if (!table->data || !table->size) return NULL;
+    if (glyph_count > GLYPH_INDEX_NONE) glyph_count = GLYPH_INDEX_NONE;
+
+    for (int fill = 0; fill < 2; fill++) {
+        UINTN pos = 0;
+        if (!fill) memset(used, 0, sizeof(used));
+        for (UINTN glyph = 0; glyph < glyph_count && pos < table->size; glyph++) {
+            BOOLEAN in_sequence = FALSE;
+            for (;;) {
+                UINT32 cp;
+                int rc = psf_next_codepoint(table, &pos, &cp);
+                if (rc == 0) break;
+                if (rc < 0) {
+                    if (pos >= table->size) break;
+                    in_sequence = TRUE;
+                    continue;
+                }
+                if (in_sequence || cp > 0xFFFF) continue;
+                if (!fill) {
+                    used[cp >> 8] = 1;
+                } else {
+                    uint16_t* slot = &index->glyphs[index->pages[cp >> 8] - 1][cp & 0xFF];
+                    if (*slot == GLYPH_INDEX_NONE) *slot = (uint16_t)glyph;
+                }
+            }
+        }
+
+        if (!fill) {
+            uint16_t pages = 0;
+            for (int i = 0; i < GLYPH_INDEX_PAGES; i++) pages += used[i];
+            if (!pages) return NULL;
+            index = (GlyphIndex*)malloc(sizeof(GlyphIndex) + (size_t)pages * sizeof(index->glyphs[0]));
+            if (!index) return NULL;
+            index->page_count = pages;
+            memset(index->glyphs, 0xFF, (size_t)pages * sizeof(index->glyphs[0]));
+            pages = 0;
+            for (int i = 0; i < GLYPH_INDEX_PAGES; i++) {
+                index->pages[i] = used[i] ? ++pages : 0;
+            }
+        }
+    }
+    return index;
+}
+
 static BOOLEAN is_ttf_font(const UINT8* data, UINTN size) {
     if (size < 4) return FALSE;
     // Check for TrueType/OpenType signatures
@@ -483,7 +1068,8 @@ Font* LoadFontFile(const char* filename) {
     
     // Try PSF2 first (more capable)
     UINT8 height = 0, width = 0; const UINT8* glyphs = NULL; UINTN glyph_count = 0;
-    if (parse_psf2(bytes, filesz, &height, &width, &glyphs, &glyph_count)) {
+    PSF_UNICODE_TABLE unicode;
+    if (parse_psf2(bytes, filesz, &height, &width, &glyphs, &glyph_count, &unicode)) {
         UINTN bytes_per_row = (width + 7) / 8;
         UINTN table_sz = bytes_per_row * height * glyph_count;
         UINT8* table = AllocateZeroPool(table_sz);
@@ -502,14 +1088,15 @@ Font* LoadFontFile(const char* filename) {
         font->metadata.max_width = width;
         font->font_data = table;
         font->font_data_size = (uint32_t)table_sz;
-        font->private_context = filebuf;
+        font->private_context = build_glyph_index(&unicode, glyph_count);
+        FreePool(filebuf);
         
         if (g_font_cache_count < MAX_CACHED_FONTS) g_font_cache[g_font_cache_count++] = font;
         return font;
     }
     
     // Try PSF1
-    if (parse_psf1(bytes, filesz, &height, &glyphs, &glyph_count)) {
+    if (parse_psf1(bytes, filesz, &height, &glyphs, &glyph_count, &unicode)) {
         UINTN table_sz = height * glyph_count; // 1 byte per row, width=8
         UINT8* table = AllocateZeroPool(table_sz);
         if (!table) { FreePool(filebuf); return GetDefaultFont(); }
@@ -527,7 +1114,8 @@ Font* LoadFontFile(const char* filename) {
         font->metadata.max_width = 8;
         font->font_data = table;
         font->font_data_size = (uint32_t)table_sz;
-        font->private_context = filebuf;
+        font->private_context = build_glyph_index(&unicode, glyph_count);
+        FreePool(filebuf);
         
         if (g_font_cache_count < MAX_CACHED_FONTS) g_font_cache[g_font_cache_count++] = font;
         return font;
@@ -572,6 +1160,10 @@ Font* LoadFontFile(const char* filename) {
 void UnloadFont(Font* font) {
     if (!font) return;
     
+    DropGlyphAtlases(font);
+    DropCachedGlyphs(font);
+    DropMeasuredText(font);
+    
     // Remove from cache
     for (int i = 0; i < g_font_cache_count; i++) {
         if (g_font_cache[i] == font) {
@@ -587,12 +1179,18 @@ void UnloadFont(Font* font) {
         free(font->font_data);
     }
     if (font->private_context) {
-        FreePool(font->private_context);
+        if (font->format == FONT_FORMAT_TTF || font->format == FONT_FORMAT_OTF) {
+            FT_Done_Face(((ScalableFace*)font->private_context)->face);
+        }
+        free(font->private_context);
     }
     free(font);
 }
 
 void ClearFontCache(void) {
+    DropGlyphAtlases(NULL);
+    DropCachedGlyphs(NULL);
+    DropMeasuredText(NULL);
     for (int i = 0; i < g_font_cache_count; i++) {
         if (g_font_cache[i] && 
             g_font_cache[i] != g_default_font && 
@@ -70,6 +70,15 @@ typedef struct {
     uint8_t subpixel;         // Boolean
 } GlyphRenderOptions;
 
+// Caller-owned 32-bit pixel surface (stride in pixels), for text drawn
+// outside the graphics back buffer, e.g. straight to a coreboot framebuffer
+typedef struct {
+    uint32_t* pixels;
+    uint32_t stride;
+    uint32_t width;
+    uint32_t height;
+} FontSurface;
+
 // Text metrics
 typedef struct {
     int32_t width;
@@ -89,9 +98,16 @@ Font* GetMonospaceFont(void);
 Font* GetBoldFont(void);
 void SetDefaultFont(Font* font);
 
+// Scalable (TTF/OTF) fonts: pixel size to render at, and how many
+// rasterized glyphs to keep across all sizes (0 restores the default)
+void SetFontPixelSize(Font* font, uint16_t pixel_size);
+void SetGlyphCacheSize(uint32_t max_glyphs);
+
 // Text rendering functions
 int32_t RenderGlyph(Font* font, uint32_t codepoint, int32_t x, int32_t y, GlyphRenderOptions* options);
 int32_t RenderText(Font* font, const wchar_t* text, int32_t x, int32_t y, GlyphRenderOptions* options);
+int32_t RenderGlyphToSurface(Font* font, const FontSurface* surface, uint32_t codepoint,
+                             int32_t x, int32_t y, GlyphRenderOptions* options);
 void MeasureText(Font* font, const wchar_t* text, TextMetrics* metrics);
 
 // Font cache management
@@ -0,0 +1,165 @@
+/*
+ * font_packed.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+// Generated by mktables.py from the raw font headers; do not edit.
+// LZ4 blocks, expanded by boot/font.c with BLOODHORN_PACKED_TABLES.
+
+// boot/font_data.h: 1520 bytes packed to 800
+static const uint32_t packed_font_8x16_size = 1520;
+static const uint8_t packed_font_8x16[] = {
+    0x1D, 0x00, 0x01, 0x00, 0xA2, 0x18, 0x3C, 0x3C, 0x3C, 0x18, 0x18, 0x18, 0x00, 0x18, 0x18, 0x10,
+    0x00, 0x48, 0x66, 0x66, 0x66, 0x24, 0x20, 0x00, 0x41, 0x6C, 0x6C, 0xFE, 0x6C, 0x04, 0x00, 0x02,
+    0x0F, 0x00, 0x45, 0x10, 0x10, 0x7C, 0x10, 0x04, 0x00, 0x03, 0x21, 0x00, 0x27, 0x38, 0x38, 0x30,
+    0x00, 0xA2, 0x38, 0x6C, 0x6C, 0x38, 0x76, 0xDC, 0xCC, 0xCC, 0xCC, 0x76, 0x10, 0x00, 0x49, 0x30,
+    0x30, 0x30, 0x60, 0x70, 0x00, 0x21, 0x30, 0x60, 0x01, 0x00, 0x13, 0x30, 0x70, 0x00, 0x31, 0x60,
+    0x30, 0x18, 0x01, 0x00, 0x07, 0x26, 0x00, 0x58, 0x66, 0x3C, 0xFF, 0x3C, 0x66, 0x33, 0x00, 0x24,
+    0x18, 0x7E, 0x9E, 0x00, 0x07, 0x14, 0x00, 0x26, 0x18, 0x30, 0x0E, 0x00, 0x1F, 0xFE, 0xD8, 0x00,
+    0x00, 0x05, 0x32, 0x00, 0x73, 0x60, 0x30, 0x18, 0x0C, 0x06, 0x03, 0x01, 0x0E, 0x00, 0x23, 0x3C,
+    0x66, 0x01, 0x00, 0x14, 0x3C, 0x28, 0x00, 0x12, 0x38, 0x81, 0x00, 0x14, 0x7E, 0x20, 0x00, 0x73,
+    0x06, 0x0C, 0x18, 0x30, 0x60, 0xC0, 0xC6, 0x54, 0x00, 0x84, 0x3C, 0x66, 0x06, 0x06, 0x1C, 0x06,
+    0x06, 0x06, 0x30, 0x00, 0x30, 0x0C, 0x1C, 0x3C, 0x10, 0x01, 0x33, 0x0C, 0x0C, 0x0C, 0x7B, 0x00,
+    0x47, 0xC0, 0xC0, 0xFC, 0x06, 0x20, 0x00, 0x48, 0x3C, 0x60, 0xC0, 0xFC, 0x60, 0x00, 0x11, 0xFE,
+    0x4F, 0x00, 0x00, 0x01, 0x00, 0x06, 0x80, 0x00, 0x01, 0x84, 0x00, 0x04, 0x30, 0x00, 0x00, 0x0C,
+    0x00, 0x10, 0x3E, 0x24, 0x00, 0x09, 0xBA, 0x00, 0x07, 0xF1, 0x00, 0x03, 0x10, 0x00, 0x03, 0xEF,
+    0x00, 0x03, 0x4E, 0x00, 0x23, 0x30, 0x18, 0x80, 0x00, 0x41, 0x00, 0x00, 0x00, 0x7E, 0x03, 0x00,
+    0x07, 0xEE, 0x00, 0x26, 0x0C, 0x0C, 0x50, 0x00, 0x20, 0x3C, 0x66, 0xD1, 0x00, 0x06, 0xE0, 0x01,
+    0x93, 0x7C, 0xC6, 0xC6, 0xDE, 0xDE, 0xDE, 0xDC, 0xC0, 0xC0, 0x33, 0x00, 0xA2, 0x10, 0x38, 0x6C,
+    0xC6, 0xC6, 0xFE, 0xC6, 0xC6, 0xC6, 0xC6, 0x10, 0x00, 0x00, 0xBD, 0x00, 0x10, 0x7C, 0x94, 0x00,
+    0x14, 0xFC, 0x40, 0x00, 0x64, 0xC2, 0xC0, 0xC0, 0xC0, 0xC0, 0xC2, 0xB0, 0x00, 0x22, 0xF8, 0x6C,
+    0x3F, 0x01, 0x23, 0x6C, 0xF8, 0xE0, 0x00, 0x83, 0x66, 0x62, 0x68, 0x78, 0x68, 0x60, 0x62, 0x66,
+    0x30, 0x01, 0x03, 0x10, 0x00, 0x37, 0x60, 0x60, 0xF0, 0x40, 0x00, 0x52, 0xDE, 0xC6, 0xC6, 0x66,
+    0x3A, 0x10, 0x00, 0x00, 0x6A, 0x00, 0x01, 0x6F, 0x00, 0x03, 0x70, 0x00, 0x00, 0x7D, 0x02, 0x01,
+    0x01, 0x00, 0x03, 0x60, 0x00, 0x10, 0x1E, 0xBE, 0x00, 0x52, 0x0C, 0xCC, 0xCC, 0xCC, 0x78, 0x10,
+    0x00, 0xA2, 0xE6, 0x66, 0x66, 0x6C, 0x78, 0x78, 0x6C, 0x66, 0x66, 0xE6, 0x10, 0x00, 0x12, 0xF0,
+    0x3F, 0x02, 0x23, 0x60, 0x62, 0x70, 0x00, 0x57, 0xC6, 0xEE, 0xFE, 0xFE, 0xD6, 0x50, 0x00, 0x67,
+    0xC6, 0xE6, 0xF6, 0xFE, 0xDE, 0xCE, 0x60, 0x00, 0x11, 0x66, 0x1D, 0x00, 0x14, 0xC6, 0xC0, 0x00,
+    0x01, 0xE0, 0x00, 0x00, 0x41, 0x00, 0x05, 0xA0, 0x00, 0x01, 0x1F, 0x00, 0x55, 0xD6, 0xDE, 0x7C,
+    0x0C, 0x0E, 0x20, 0x00, 0x00, 0xE4, 0x00, 0x03, 0x70, 0x00, 0x93, 0x3C, 0x66, 0xC6, 0xC0, 0x60,
+    0x38, 0x0C, 0x06, 0x06, 0x10, 0x01, 0x24, 0x7E, 0x7E, 0xB1, 0x00, 0x06, 0xD0, 0x00, 0x01, 0x01,
+    0x00, 0x19, 0x7C, 0x10, 0x00, 0x22, 0x6C, 0x38, 0x1E, 0x03, 0x01, 0x10, 0x00, 0x53, 0xD6, 0xD6,
+    0xD6, 0xFE, 0xEE, 0x41, 0x03, 0x84, 0xC6, 0xC6, 0x6C, 0x7C, 0x38, 0x38, 0x7C, 0x6C, 0xA0, 0x00,
+    0x01, 0x0B, 0x02, 0x07, 0x50, 0x00, 0x30, 0xFE, 0xC6, 0x86, 0xBD, 0x01, 0x15, 0xC2, 0x80, 0x02,
+    0x13, 0x30, 0x01, 0x00, 0x03, 0xC0, 0x00, 0xA3, 0x00, 0x80, 0xC0, 0xE0, 0x70, 0x38, 0x1C, 0x0E,
+    0x06, 0x02, 0x20, 0x00, 0x01, 0x30, 0x01, 0x32, 0x0C, 0x0C, 0x0C, 0x20, 0x00, 0x00, 0xCF, 0x01,
+    0x0E, 0x0D, 0x03, 0x02, 0x01, 0x00, 0x10, 0xFF, 0x8F, 0x03, 0x07, 0x38, 0x02, 0x04, 0x12, 0x03,
+    0x63, 0x06, 0x3E, 0x66, 0x66, 0x66, 0x3B, 0x0E, 0x00, 0x31, 0x70, 0x60, 0x60, 0xFF, 0x01, 0x03,
+    0xCF, 0x00, 0x01, 0x02, 0x01, 0x34, 0x60, 0x60, 0x60, 0x3F, 0x01, 0x31, 0x00, 0x0E, 0x06, 0x2F,
+    0x00, 0x05, 0x30, 0x00, 0x01, 0x62, 0x02, 0x34, 0x7E, 0x60, 0x60, 0x20, 0x00, 0x50, 0x1C, 0x36,
+    0x30, 0x30, 0x7C, 0xB0, 0x00, 0x03, 0xC0, 0x01, 0x31, 0x00, 0x00, 0x3B, 0xE2, 0x02, 0x2A, 0x06,
+    0x0F, 0x60, 0x00, 0x03, 0x5F, 0x01, 0x00, 0x98, 0x02, 0x01, 0x81, 0x03, 0x04, 0x40, 0x00, 0x20,
+    0x06, 0x06, 0x63, 0x00, 0x45, 0x06, 0x06, 0x06, 0x36, 0x30, 0x00, 0x02, 0x01, 0x02, 0x04, 0x60,
+    0x04, 0x0A, 0x2F, 0x02, 0x31, 0x00, 0x00, 0x00, 0x6E, 0x04, 0x25, 0xCC, 0xCC, 0x10, 0x00, 0x01,
+    0x5F, 0x00, 0x16, 0x66, 0x41, 0x04, 0x02, 0xF2, 0x03, 0x06, 0x30, 0x00, 0x02, 0xDF, 0x00, 0x04,
+    0x00, 0x02, 0x0C, 0xA0, 0x00, 0x00, 0x20, 0x00, 0x07, 0x1F, 0x02, 0x75, 0x00, 0x00, 0x00, 0x3E,
+    0x60, 0x60, 0x3C, 0xFF, 0x01, 0x13, 0x00, 0xDE, 0x00, 0x25, 0x36, 0x1C, 0x20, 0x00, 0x09, 0xFF,
+    0x01, 0x04, 0x10, 0x00, 0x16, 0x6C, 0x14, 0x05, 0x01, 0x01, 0x02, 0x13, 0xFE, 0xFF, 0x01, 0x00,
+    0x10, 0x00, 0x38, 0x6C, 0x38, 0x38, 0xA6, 0x01, 0x01, 0x30, 0x00, 0x07, 0x80, 0x00, 0x54, 0xFE,
+    0xCC, 0x18, 0x30, 0x60, 0xFF, 0x01, 0x60, 0x00, 0x0E, 0x18, 0x18, 0x18, 0x70, 0xF1, 0x00, 0x01,
+    0x9E, 0x02, 0x01, 0xF9, 0x04, 0x09, 0x80, 0x02, 0x00, 0x1C, 0x00, 0x00, 0x24, 0x00, 0x24, 0x18,
+    0x70, 0x0E, 0x01, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+// boot/font_mono_8x8.h: 760 bytes packed to 644
+static const uint32_t packed_mono_font_8x8_size = 760;
+static const uint8_t packed_mono_font_8x8[] = {
+    0x13, 0x00, 0x01, 0x00, 0xA2, 0x18, 0x3C, 0x3C, 0x18, 0x18, 0x00, 0x18, 0x00, 0x36, 0x36, 0x10,
+    0x00, 0xF2, 0x14, 0x36, 0x36, 0x7F, 0x36, 0x7F, 0x36, 0x36, 0x00, 0x0C, 0x3E, 0x03, 0x1E, 0x30,
+    0x1F, 0x0C, 0x00, 0x00, 0x63, 0x33, 0x18, 0x0C, 0x66, 0x63, 0x00, 0x1C, 0x36, 0x1C, 0x6E, 0x3B,
+    0x33, 0x6E, 0x00, 0x06, 0x06, 0x03, 0x38, 0x00, 0xF3, 0x0E, 0x0C, 0x06, 0x06, 0x06, 0x0C, 0x18,
+    0x00, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x0C, 0x06, 0x00, 0x00, 0x66, 0x3C, 0xFF, 0x3C, 0x66, 0x00,
+    0x00, 0x00, 0x0C, 0x0C, 0x3F, 0x0C, 0x0C, 0x5D, 0x00, 0x00, 0x18, 0x00, 0x34, 0x00, 0x00, 0x3F,
+    0x6C, 0x00, 0xE0, 0x00, 0x0C, 0x0C, 0x00, 0x60, 0x30, 0x18, 0x0C, 0x06, 0x03, 0x01, 0x00, 0x3E,
+    0x63, 0x01, 0x00, 0xC0, 0x3E, 0x00, 0x0C, 0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x3F, 0x00, 0x1E, 0x33,
+    0x1A, 0x00, 0x10, 0x7F, 0x08, 0x00, 0xF0, 0x15, 0x1C, 0x60, 0x33, 0x1E, 0x00, 0x38, 0x3C, 0x36,
+    0x33, 0x7F, 0x30, 0x78, 0x00, 0x7F, 0x60, 0x7C, 0x06, 0x06, 0x33, 0x1E, 0x00, 0x1C, 0x36, 0x60,
+    0x7C, 0x66, 0x66, 0x3B, 0x00, 0x7F, 0x63, 0x03, 0x06, 0x0C, 0x0C, 0x0C, 0x40, 0x00, 0x00, 0x03,
+    0x00, 0x00, 0x08, 0x00, 0x41, 0x3F, 0x06, 0x0C, 0x38, 0x5C, 0x00, 0x06, 0x04, 0x00, 0x10, 0x06,
+    0xA0, 0x00, 0x10, 0x03, 0xA0, 0x00, 0x01, 0x7F, 0x00, 0x20, 0x3F, 0x00, 0xA8, 0x00, 0x00, 0x7A,
+    0x00, 0x00, 0x60, 0x00, 0x30, 0x18, 0x0C, 0x00, 0x40, 0x00, 0xF2, 0x1E, 0x7B, 0x7B, 0x7B, 0x03,
+    0x1E, 0x00, 0x0C, 0x1E, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x00, 0x3F, 0x66, 0x66, 0x3E, 0x66, 0x66,
+    0x3F, 0x00, 0x3C, 0x66, 0x03, 0x03, 0x03, 0x66, 0x3C, 0x00, 0x1F, 0x36, 0x66, 0x66, 0x66, 0x36,
+    0x1F, 0x00, 0x7F, 0x46, 0x16, 0x1E, 0x16, 0x46, 0x7F, 0x08, 0x00, 0x21, 0x06, 0x0F, 0x20, 0x00,
+    0x51, 0x73, 0x66, 0x7C, 0x00, 0x33, 0x37, 0x00, 0x30, 0x33, 0x00, 0x1E, 0xBF, 0x00, 0xF0, 0x1A,
+    0x0C, 0x1E, 0x00, 0x78, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E, 0x00, 0x67, 0x66, 0x36, 0x1E, 0x36,
+    0x66, 0x67, 0x00, 0x0F, 0x06, 0x06, 0x06, 0x46, 0x66, 0x7F, 0x00, 0x63, 0x77, 0x7F, 0x7F, 0x6B,
+    0x63, 0x63, 0x00, 0x63, 0x67, 0x6F, 0x7B, 0x73, 0x63, 0x48, 0x01, 0x51, 0x63, 0x63, 0x63, 0x36,
+    0x1C, 0x70, 0x00, 0xB1, 0x06, 0x06, 0x0F, 0x00, 0x1E, 0x33, 0x33, 0x33, 0x3B, 0x1E, 0x38, 0x10,
+    0x00, 0x00, 0x38, 0x00, 0xA2, 0x1E, 0x33, 0x07, 0x0E, 0x38, 0x33, 0x1E, 0x00, 0x3F, 0x2D, 0x58,
+    0x00, 0x11, 0x33, 0x01, 0x00, 0x12, 0x3F, 0x08, 0x00, 0xB0, 0x1E, 0x0C, 0x00, 0x63, 0x63, 0x63,
+    0x6B, 0x7F, 0x77, 0x63, 0x00, 0x45, 0x00, 0x30, 0x1C, 0x36, 0x63, 0x18, 0x00, 0x10, 0x1E, 0x28,
+    0x00, 0xA0, 0x7F, 0x63, 0x31, 0x18, 0x4C, 0x66, 0x7F, 0x00, 0x1E, 0x06, 0x01, 0x00, 0x20, 0x1E,
+    0x00, 0xFD, 0x00, 0x60, 0x30, 0x60, 0x40, 0x00, 0x1E, 0x18, 0x01, 0x00, 0x30, 0x1E, 0x00, 0x08,
+    0x2D, 0x00, 0x06, 0x01, 0x00, 0x21, 0xFF, 0x0C, 0x1C, 0x01, 0x00, 0x01, 0x00, 0xA0, 0x1E, 0x30,
+    0x3E, 0x33, 0x6E, 0x00, 0x07, 0x06, 0x06, 0x3E, 0x60, 0x01, 0x50, 0x00, 0x00, 0x1E, 0x33, 0x03,
+    0x80, 0x01, 0x61, 0x30, 0x30, 0x3E, 0x33, 0x33, 0x6E, 0x10, 0x00, 0x20, 0x3F, 0x03, 0x80, 0x01,
+    0x20, 0x06, 0x0F, 0xB0, 0x00, 0xF0, 0x03, 0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x1F, 0x07,
+    0x06, 0x36, 0x6E, 0x66, 0x66, 0x67, 0x00, 0x0C, 0x00, 0xC1, 0x01, 0x42, 0x1E, 0x00, 0x30, 0x00,
+    0x01, 0x01, 0x20, 0x07, 0x06, 0x01, 0x01, 0x11, 0x67, 0x16, 0x00, 0x00, 0x18, 0x00, 0x30, 0x00,
+    0x00, 0x33, 0x01, 0x01, 0x40, 0x00, 0x00, 0x00, 0x1F, 0xC2, 0x00, 0x01, 0x50, 0x00, 0x00, 0x28,
+    0x01, 0x30, 0x00, 0x00, 0x3B, 0x02, 0x01, 0x13, 0x0F, 0x50, 0x00, 0x61, 0x78, 0x00, 0x00, 0x3B,
+    0x6E, 0x66, 0x60, 0x00, 0x01, 0x79, 0x02, 0x70, 0x00, 0x08, 0x0C, 0x3E, 0x0C, 0x0C, 0x2C, 0xA4,
+    0x00, 0x00, 0x37, 0x00, 0x00, 0x88, 0x00, 0x02, 0x00, 0x01, 0x60, 0x00, 0x00, 0x63, 0x6B, 0x7F,
+    0x7F, 0xAD, 0x02, 0x00, 0x01, 0x01, 0x00, 0x58, 0x00, 0x11, 0x33, 0x90, 0x00, 0xF1, 0x01, 0x00,
+    0x00, 0x3F, 0x19, 0x0C, 0x26, 0x3F, 0x00, 0x38, 0x0C, 0x0C, 0x07, 0x0C, 0x0C, 0x38, 0x00, 0xF7,
+    0x00, 0x30, 0x18, 0x18, 0x00, 0x0D, 0x00, 0xC0, 0x0C, 0x0C, 0x07, 0x00, 0x00, 0x6E, 0x3B, 0x00,
+    0x00, 0x00, 0x00, 0x00,
+};
+
+// boot/font_bold_8x16.h: 1521 bytes packed to 775
+static const uint32_t packed_bold_font_8x16_size = 1521;
+static const uint8_t packed_bold_font_8x16[] = {
+    0x1D, 0x00, 0x01, 0x00, 0xA2, 0x18, 0x3C, 0x7E, 0x7E, 0x7E, 0x18, 0x18, 0x00, 0x18, 0x18, 0x10,
+    0x00, 0x57, 0x66, 0x66, 0xFF, 0xFF, 0x66, 0x20, 0x00, 0x42, 0x6C, 0x6C, 0xFE, 0xFE, 0x04, 0x00,
+    0x01, 0x0F, 0x00, 0x45, 0x10, 0x38, 0x7C, 0x10, 0x04, 0x00, 0x03, 0x21, 0x00, 0x27, 0x38, 0x38,
+    0x30, 0x00, 0xA2, 0x38, 0x6C, 0x6C, 0x38, 0x76, 0xDC, 0xCC, 0xCC, 0xCC, 0x76, 0x10, 0x00, 0x49,
+    0x30, 0x30, 0x60, 0x60, 0x70, 0x00, 0x21, 0x30, 0x60, 0x01, 0x00, 0x13, 0x30, 0x70, 0x00, 0x31,
+    0x60, 0x30, 0x18, 0x01, 0x00, 0x16, 0x30, 0x26, 0x00, 0x57, 0x66, 0x3C, 0xFF, 0xFF, 0x3C, 0x84,
+    0x00, 0x6A, 0x30, 0x30, 0xFC, 0xFC, 0x30, 0x30, 0xB7, 0x00, 0x0A, 0x57, 0x00, 0x2D, 0xFC, 0xFC,
+    0xD8, 0x00, 0x06, 0x31, 0x00, 0x73, 0x60, 0x30, 0x18, 0x0C, 0x06, 0x03, 0x01, 0x0E, 0x00, 0x00,
+    0xEF, 0x00, 0x01, 0x01, 0x00, 0x13, 0x3C, 0x90, 0x00, 0x22, 0x38, 0x38, 0x81, 0x00, 0x24, 0x7E,
+    0x7E, 0x21, 0x00, 0x01, 0x31, 0x00, 0x35, 0x06, 0xC6, 0xFE, 0x10, 0x00, 0x54, 0x60, 0x38, 0x60,
+    0x60, 0x60, 0x31, 0x00, 0x40, 0x1C, 0x3C, 0x7C, 0x6C, 0x11, 0x01, 0x22, 0x0C, 0x0C, 0x10, 0x00,
+    0x84, 0xFE, 0xC0, 0xC0, 0xFC, 0x3E, 0x06, 0x06, 0x06, 0x20, 0x00, 0x57, 0x3C, 0x60, 0xC0, 0xFC,
+    0xFE, 0x61, 0x00, 0x33, 0xFE, 0xFE, 0x0C, 0xF4, 0x00, 0x06, 0x81, 0x00, 0x01, 0x85, 0x00, 0x04,
+    0x30, 0x00, 0x00, 0x0C, 0x00, 0x10, 0x3E, 0x24, 0x00, 0x09, 0xBB, 0x00, 0x07, 0xF1, 0x00, 0x03,
+    0x10, 0x00, 0x03, 0x20, 0x00, 0x03, 0x4E, 0x00, 0x23, 0x30, 0x18, 0x80, 0x00, 0x01, 0x63, 0x00,
+    0x02, 0x04, 0x00, 0x05, 0xEF, 0x00, 0x26, 0x0C, 0x0C, 0x50, 0x00, 0x20, 0x3C, 0x7E, 0xD1, 0x00,
+    0x15, 0x18, 0x51, 0x00, 0x93, 0x7C, 0xFE, 0xFE, 0xDE, 0xDE, 0xDE, 0xDC, 0xC0, 0xC0, 0xF0, 0x00,
+    0x42, 0x30, 0x78, 0xCC, 0xFE, 0x01, 0x00, 0x03, 0x4C, 0x01, 0x30, 0xFE, 0xFE, 0xFE, 0x04, 0x00,
+    0x13, 0xFE, 0x54, 0x01, 0x84, 0x3C, 0x7E, 0xE6, 0xC0, 0xC0, 0xC0, 0xC0, 0xE6, 0xB0, 0x00, 0x13,
+    0xF8, 0x2E, 0x00, 0x24, 0xFE, 0xF8, 0x7D, 0x00, 0x64, 0xE6, 0xEC, 0xFC, 0xFC, 0xE8, 0xE6, 0x40,
+    0x00, 0x03, 0x10, 0x00, 0x23, 0xE0, 0xE0, 0x20, 0x00, 0x01, 0x40, 0x00, 0x54, 0xFE, 0xFE, 0xFE,
+    0x7E, 0x3A, 0x20, 0x00, 0x04, 0x01, 0x00, 0x03, 0x20, 0x00, 0x12, 0x3C, 0x80, 0x01, 0x13, 0x3C,
+    0x60, 0x00, 0x20, 0x1E, 0x1E, 0xBF, 0x00, 0x46, 0xCC, 0xCC, 0xCC, 0x78, 0x50, 0x00, 0x35, 0xF8,
+    0xF8, 0xEC, 0x60, 0x00, 0x22, 0xF8, 0xE0, 0x01, 0x00, 0x13, 0xE6, 0x10, 0x00, 0x10, 0xE6, 0x4B,
+    0x00, 0x57, 0xD6, 0xE6, 0xE6, 0xE6, 0xE6, 0x10, 0x00, 0x25, 0xDE, 0xCE, 0x10, 0x00, 0x22, 0x3C,
+    0x7E, 0x6E, 0x00, 0x04, 0xC0, 0x00, 0x01, 0xE0, 0x00, 0x00, 0x41, 0x00, 0x05, 0xA0, 0x00, 0x04,
+    0x20, 0x00, 0x25, 0x0C, 0x0E, 0x20, 0x00, 0x17, 0xEC, 0xA0, 0x00, 0x74, 0x7E, 0xFE, 0xE0, 0xF0,
+    0x78, 0x1C, 0x0E, 0x10, 0x01, 0x24, 0xFE, 0xFE, 0xB2, 0x00, 0x0B, 0xD0, 0x00, 0x19, 0x7C, 0x10,
+    0x00, 0x22, 0x7C, 0x38, 0x1F, 0x03, 0x05, 0x20, 0x00, 0x15, 0xFC, 0xD0, 0x00, 0x66, 0xEC, 0xF8,
+    0x78, 0x78, 0xF8, 0xEC, 0x30, 0x01, 0x00, 0x2D, 0x00, 0x00, 0x01, 0x00, 0x04, 0x10, 0x00, 0x45,
+    0x8E, 0x1C, 0x38, 0x70, 0xEF, 0x00, 0x21, 0x00, 0x3C, 0x1C, 0x00, 0x33, 0x38, 0x38, 0x38, 0xC0,
+    0x00, 0xA3, 0x00, 0x80, 0xC0, 0xE0, 0x70, 0x38, 0x1C, 0x0E, 0x06, 0x02, 0x20, 0x00, 0x00, 0x2F,
+    0x01, 0x00, 0x01, 0x00, 0x02, 0x20, 0x00, 0x34, 0x10, 0x38, 0x7C, 0x3A, 0x00, 0x0D, 0x01, 0x00,
+    0x10, 0xFF, 0xEF, 0x01, 0x2C, 0x38, 0x1C, 0x17, 0x00, 0x20, 0x7C, 0x0E, 0x03, 0x01, 0x13, 0x7B,
+    0x0E, 0x00, 0x38, 0xF0, 0xE0, 0xE0, 0xFF, 0x01, 0x01, 0x32, 0x02, 0x34, 0xE0, 0xE0, 0xE0, 0xDF,
+    0x00, 0x31, 0x00, 0x1E, 0x0E, 0x2F, 0x00, 0x05, 0x30, 0x00, 0x01, 0x52, 0x02, 0x34, 0xFE, 0xFE,
+    0xE0, 0x20, 0x00, 0x00, 0x30, 0x03, 0x10, 0xFC, 0xA2, 0x02, 0x03, 0x60, 0x01, 0x31, 0x00, 0x00,
+    0x7B, 0x5F, 0x01, 0x2A, 0x0E, 0x1F, 0x60, 0x00, 0x04, 0xA6, 0x00, 0x40, 0x38, 0x38, 0x00, 0x78,
+    0xDF, 0x00, 0x04, 0x40, 0x00, 0x20, 0x0E, 0x0E, 0x63, 0x00, 0x33, 0x0E, 0x0E, 0x0E, 0xA0, 0x02,
+    0x84, 0xF0, 0xE0, 0xE0, 0xFE, 0xF8, 0xF8, 0xF8, 0xEC, 0x30, 0x00, 0x01, 0x2D, 0x00, 0x07, 0x30,
+    0x00, 0x38, 0x00, 0x00, 0xF6, 0x4F, 0x02, 0x03, 0xC2, 0x01, 0x08, 0x10, 0x00, 0x01, 0xA0, 0x00,
+    0x05, 0xC0, 0x00, 0x03, 0x20, 0x00, 0x14, 0xFC, 0x00, 0x02, 0x0C, 0xA0, 0x00, 0x00, 0x20, 0x00,
+    0x07, 0x1F, 0x02, 0x41, 0x00, 0x00, 0x00, 0x7E, 0x00, 0x02, 0x04, 0x10, 0x01, 0x74, 0x70, 0x70,
+    0xFC, 0x70, 0x70, 0x70, 0x70, 0x4F, 0x02, 0x05, 0xE2, 0x01, 0x06, 0x60, 0x00, 0x03, 0x00, 0x02,
+    0x0A, 0x10, 0x00, 0x04, 0xFF, 0x01, 0x00, 0x10, 0x00, 0x45, 0xEC, 0x78, 0x78, 0x78, 0xD0, 0x00,
+    0x03, 0x20, 0x00, 0x07, 0x80, 0x00, 0x55, 0xFE, 0xFE, 0x8C, 0x18, 0x70, 0xC0, 0x00, 0x50, 0x1E,
+    0x38, 0x38, 0x38, 0xF0, 0xF1, 0x00, 0x14, 0x1E, 0x30, 0x01, 0x04, 0x01, 0x00, 0x03, 0x20, 0x01,
+    0x00, 0x1B, 0x00, 0x00, 0x0F, 0x00, 0x14, 0xF0, 0x0E, 0x01, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
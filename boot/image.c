@@ -0,0 +1,593 @@
+/*
+ * image.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include "image.h"
+#include "compat.h"
+#include "theme.h"
+#include "../uefi/uefi.h"
+#include "../compress/decompress.h"
+#include <string.h>
+#include <Library/UefiLib.h>
+#include <Library/PrintLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/BaseMemoryLib.h>
+
+static GRAPHICS_IMAGE g_theme_background;
+
+static UINT32 ReadLe16(CONST UINT8 *p) { return (UINT32)p[0] | ((UINT32)p[1] << 8); }
+static UINT32 ReadLe32(CONST UINT8 *p) { return ReadLe16(p) | (ReadLe16(p + 2) << 16); }
+static UINT32 ReadBe16(CONST UINT8 *p) { return ((UINT32)p[0] << 8) | p[1]; }
+static UINT32 ReadBe32(CONST UINT8 *p) { return (ReadBe16(p) << 16) | ReadBe16(p + 2); }
+
+// Straight-alpha color over the matte, as 0x00RRGGBB
+static UINT32
+Composite(UINT32 R, UINT32 G, UINT32 B, UINT32 A, UINT32 Matte) {
+    if (A < 255) {
+        UINT32 Inv = 255 - A;
+        R = (R * A + ((Matte >> 16) & 0xFF) * Inv + 127) / 255;
+        G = (G * A + ((Matte >> 8) & 0xFF) * Inv + 127) / 255;
+        B = (B * A + (Matte & 0xFF) * Inv + 127) / 255;
+    }
+    return (R << 16) | (G << 8) | B;
+}
+
+static EFI_STATUS
+AllocateImage(UINT32 Width, UINT32 Height, GRAPHICS_IMAGE *Image, UINT32 **Pixels) {
+    if (Width == 0 || Height == 0 || Width > IMAGE_MAX_DIMENSION || Height > IMAGE_MAX_DIMENSION) {
+        return EFI_UNSUPPORTED;
+    }
+    *Pixels = AllocatePool((UINTN)Width * Height * sizeof(UINT32));
+    if (*Pixels == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    Image->Width = Width;
+    Image->Height = Height;
+    Image->Pixels = *Pixels;
+    return EFI_SUCCESS;
+}
+
+// Position and width of a BI_BITFIELDS channel mask
+static VOID
+MaskShift(UINT32 Mask, UINT32 *Shift, UINT32 *Bits) {
+    *Shift = 0;
+    *Bits = 0;
+    if (Mask == 0) {
+        return;
+    }
+    while ((Mask & 1) == 0) {
+        Mask >>= 1;
+        (*Shift)++;
+    }
+    while (Mask & 1) {
+        Mask >>= 1;
+        (*Bits)++;
+    }
+}
+
+// One masked channel widened or narrowed to 8 bits
+static UINT32
+MaskChannel(UINT32 Value, UINT32 Shift, UINT32 Bits) {
+    if (Bits == 0) {
+        return 0;
+    }
+    Value = (Value >> Shift) & (Bits >= 32 ? 0xFFFFFFFF : ((1u << Bits) - 1));
+    return Bits >= 8 ? Value >> (Bits - 8) : Value * 255 / ((1u << Bits) - 1);
+}
+
+static EFI_STATUS
+DecodeBmp(CONST UINT8 *Data, UINTN Size, UINT32 Matte, GRAPHICS_IMAGE *Image) {
+    UINT32 Masks[4] = { 0x00FF0000, 0x0000FF00, 0x000000FF, 0 };
+    UINT32 Shift[4], Bits[4];
+    UINT32 *Pixels;
+    EFI_STATUS Status;
+
+    if (Size < 54) {
+        return EFI_VOLUME_CORRUPTED;
+    }
+    UINT32 PixelOffset = ReadLe32(Data + 10);
+    UINT32 HeaderSize = ReadLe32(Data + 14);
+    INT32 Width = (INT32)ReadLe32(Data + 18);
+    INT32 Height = (INT32)ReadLe32(Data + 22);
+    UINT32 Bpp = ReadLe16(Data + 28);
+    UINT32 Compression = ReadLe32(Data + 30);
+    UINT32 Colors = ReadLe32(Data + 46);
+
+    if (HeaderSize < 40 || 14ULL + HeaderSize > Size) {
+        return EFI_VOLUME_CORRUPTED;
+    }
+    if (Width <= 0 || Height == 0 || Height < -IMAGE_MAX_DIMENSION) {
+        return EFI_UNSUPPORTED;
+    }
+    BOOLEAN TopDown = Height < 0;
+    UINT32 Rows = TopDown ? (UINT32)-Height : (UINT32)Height;
+
+    if (Bpp == 16) {
+        Masks[0] = 0x7C00;
+        Masks[1] = 0x03E0;
+        Masks[2] = 0x001F;
+    }
+    if (Compression == 3) { // BI_BITFIELDS
+        // The masks follow a BITMAPINFOHEADER, and sit at the same place
+        // inside the larger V2+ headers
+        if ((Bpp != 16 && Bpp != 32) || Size < 14 + 40 + 12) {
+            return EFI_UNSUPPORTED;
+        }
+        Masks[0] = ReadLe32(Data + 54);
+        Masks[1] = ReadLe32(Data + 58);
+        Masks[2] = ReadLe32(Data + 62);
+        Masks[3] = (HeaderSize >= 56) ? ReadLe32(Data + 66) : 0;
+    } else if (Compression != 0 || (Bpp != 8 && Bpp != 16 && Bpp != 24 && Bpp != 32)) {
+        return EFI_UNSUPPORTED;
+    }
+    for (UINTN c = 0; c < 4; c++) {
+        MaskShift(Masks[c], &Shift[c], &Bits[c]);
+    }
+
+    CONST UINT8 *Palette = Data + 14 + HeaderSize;
+    if (Bpp == 8) {
+        Colors = Colors ? Colors : 256;
+        if (Colors > 256 || 14ULL + HeaderSize + Colors * 4ULL > Size) {
+            return EFI_VOLUME_CORRUPTED;
+        }
+    }
+
+    UINT64 Stride = ((UINT64)Width * Bpp + 31) / 32 * 4;
+    if ((UINT64)PixelOffset + Stride * Rows > Size) {
+        return EFI_VOLUME_CORRUPTED;
+    }
+    Status = AllocateImage((UINT32)Width, Rows, Image, &Pixels);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    for (UINT32 y = 0; y < Rows; y++) {
+        CONST UINT8 *Src = Data + PixelOffset + (TopDown ? y : Rows - 1 - y) * Stride;
+        UINT32 *Dst = Pixels + (UINTN)y * (UINT32)Width;
+        for (UINT32 x = 0; x < (UINT32)Width; x++) {
+            if (Bpp == 8) {
+                CONST UINT8 *Entry = Palette + 4 * (Src[x] < Colors ? Src[x] : 0);
+                Dst[x] = ((UINT32)Entry[2] << 16) | ((UINT32)Entry[1] << 8) | Entry[0];
+            } else if (Bpp == 24) {
+                Dst[x] = ((UINT32)Src[3 * x + 2] << 16) | ((UINT32)Src[3 * x + 1] << 8) | Src[3 * x];
+            } else {
+                UINT32 Value = (Bpp == 16) ? ReadLe16(Src + 2 * x) : ReadLe32(Src + 4 * x);
+                Dst[x] = Composite(
+                    MaskChannel(Value, Shift[0], Bits[0]),
+                    MaskChannel(Value, Shift[1], Bits[1]),
+                    MaskChannel(Value, Shift[2], Bits[2]),
+                    Bits[3] ? MaskChannel(Value, Shift[3], Bits[3]) : 255,
+                    Matte
+                );
+            }
+        }
+    }
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS
+DecodeQoi(CONST UINT8 *Data, UINTN Size, UINT32 Matte, GRAPHICS_IMAGE *Image) {
+    UINT8 Index[64][4];
+    UINT8 Px[4] = { 0, 0, 0, 255 };
+    UINT32 *Pixels;
+    UINT32 Run = 0;
+    EFI_STATUS Status;
+
+    // 14-byte header, then the ops, then an 8-byte end marker
+    if (Size < 14 + 8 || (Data[12] != 3 && Data[12] != 4)) {
+        return EFI_VOLUME_CORRUPTED;
+    }
+    Status = AllocateImage(ReadBe32(Data + 4), ReadBe32(Data + 8), Image, &Pixels);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    ZeroMem(Index, sizeof(Index));
+
+    UINTN Pos = 14;
+    UINTN End = Size - 8;
+    UINTN Count = (UINTN)Image->Width * Image->Height;
+    for (UINTN i = 0; i < Count; i++) {
+        if (Run > 0) {
+            Run--;
+        } else {
+            if (Pos >= End) {
+                break;
+            }
+            UINT8 B1 = Data[Pos++];
+            if (B1 == 0xFE || B1 == 0xFF) {         // QOI_OP_RGB, QOI_OP_RGBA
+                UINTN Bytes = (B1 == 0xFE) ? 3 : 4;
+                if (Bytes > End - Pos) {
+                    break;
+                }
+                CopyMem(Px, Data + Pos, Bytes);
+                Pos += Bytes;
+            } else if ((B1 & 0xC0) == 0x00) {       // QOI_OP_INDEX
+                CopyMem(Px, Index[B1], 4);
+            } else if ((B1 & 0xC0) == 0x40) {       // QOI_OP_DIFF
+                Px[0] += ((B1 >> 4) & 3) - 2;
+                Px[1] += ((B1 >> 2) & 3) - 2;
+                Px[2] += (B1 & 3) - 2;
+            } else if ((B1 & 0xC0) == 0x80) {       // QOI_OP_LUMA
+                if (Pos >= End) {
+                    break;
+                }
+                UINT8 B2 = Data[Pos++];
+                INT32 Dg = (INT32)(B1 & 0x3F) - 32;
+                Px[0] += Dg - 8 + ((B2 >> 4) & 0x0F);
+                Px[1] += Dg;
+                Px[2] += Dg - 8 + (B2 & 0x0F);
+            } else {                                // QOI_OP_RUN
+                Run = B1 & 0x3F;
+            }
+            CopyMem(Index[(Px[0] * 3 + Px[1] * 5 + Px[2] * 7 + Px[3] * 11) % 64], Px, 4);
+        }
+        Pixels[i] = Composite(Px[0], Px[1], Px[2], Px[3], Matte);
+        if (i + 1 == Count) {
+            return EFI_SUCCESS;
+        }
+    }
+
+    FreeImage(Image);
+    return EFI_VOLUME_CORRUPTED;
+}
+
+// Feeds the concatenated IDAT payloads to the inflater in place, without
+// gathering them into one buffer first
+typedef struct {
+    CONST UINT8 *Data;
+    UINTN       Size;
+    UINTN       Next;       // Next chunk header
+    CONST UINT8 *Chunk;     // Unread part of the current IDAT
+    UINT32      Remaining;
+} PNG_IDAT_READER;
+
+static int
+PngReadIdat(void *Context, uint8_t *Buf, uint32_t Len) {
+    PNG_IDAT_READER *Reader = (PNG_IDAT_READER *)Context;
+    uint32_t Done = 0;
+
+    while (Done < Len) {
+        if (Reader->Remaining == 0) {
+            // Chunk bounds were checked when the file was scanned
+            if (Reader->Next + 12 > Reader->Size) {
+                break;
+            }
+            UINT32 Length = ReadBe32(Reader->Data + Reader->Next);
+            CONST UINT8 *Type = Reader->Data + Reader->Next + 4;
+            if (CompareMem(Type, "IEND", 4) == 0) {
+                break;
+            }
+            Reader->Chunk = Type + 4;
+            Reader->Next += 12 + (UINTN)Length;
+            Reader->Remaining = (CompareMem(Type, "IDAT", 4) == 0) ? Length : 0;
+            continue;
+        }
+        uint32_t Take = MIN(Len - Done, Reader->Remaining);
+        CopyMem(Buf + Done, Reader->Chunk, Take);
+        Reader->Chunk += Take;
+        Reader->Remaining -= Take;
+        Done += Take;
+    }
+    return (int)Done;
+}
+
+// Sample Index of a row at its full precision (16-bit samples whole)
+static UINT32
+PngSample(CONST UINT8 *Row, UINTN Index, UINT32 Depth) {
+    switch (Depth) {
+        case 16:
+            return ReadBe16(Row + 2 * Index);
+        case 8:
+            return Row[Index];
+        default: {
+            UINTN PerByte = 8 / Depth;
+            UINT32 Shift = 8 - Depth * (UINT32)(Index % PerByte + 1);
+            return (Row[Index / PerByte] >> Shift) & ((1u << Depth) - 1);
+        }
+    }
+}
+
+static UINT32
+PngScale(UINT32 Sample, UINT32 Depth) {
+    if (Depth == 16) {
+        return Sample >> 8;
+    }
+    return (Depth == 8) ? Sample : Sample * 255 / ((1u << Depth) - 1);
+}
+
+static UINT8
+Paeth(UINT8 A, UINT8 B, UINT8 C) {
+    INT32 P = (INT32)A + B - C;
+    INT32 Pa = P > A ? P - A : A - P;
+    INT32 Pb = P > B ? P - B : B - P;
+    INT32 Pc = P > C ? P - C : C - P;
+    if (Pa <= Pb && Pa <= Pc) {
+        return A;
+    }
+    return (Pb <= Pc) ? B : C;
+}
+
+static EFI_STATUS
+DecodePng(CONST UINT8 *Data, UINTN Size, UINT32 Matte, GRAPHICS_IMAGE *Image) {
+    static CONST UINT8 Channels[7] = { 1, 0, 3, 1, 2, 0, 4 };
+    UINT32 Width = 0, Height = 0, Depth = 0, ColorType = 0;
+    UINT8 Palette[256][3];
+    UINT8 Alpha[256];
+    UINT32 PaletteCount = 0, AlphaCount = 0;
+    UINT32 Key[3] = { 0, 0, 0 };
+    BOOLEAN HasHeader = FALSE, HasData = FALSE, HasKey = FALSE, Ended = FALSE;
+    UINT32 *Pixels;
+    EFI_STATUS Status;
+
+    // Scan and check every chunk up front so the inflater's reader can
+    // walk them blindly
+    for (UINTN Pos = 8; !Ended; ) {
+        if (Size - Pos < 12) {
+            return EFI_VOLUME_CORRUPTED;
+        }
+        UINT32 Length = ReadBe32(Data + Pos);
+        CONST UINT8 *Type = Data + Pos + 4;
+        CONST UINT8 *Body = Type + 4;
+        if (Length > Size - Pos - 12 ||
+            decomp_crc32(0, Type, (size_t)Length + 4) != ReadBe32(Body + Length)) {
+            return EFI_VOLUME_CORRUPTED;
+        }
+
+        if (CompareMem(Type, "IHDR", 4) == 0) {
+            if (Length != 13 || HasHeader) {
+                return EFI_VOLUME_CORRUPTED;
+            }
+            Width = ReadBe32(Body);
+            Height = ReadBe32(Body + 4);
+            Depth = Body[8];
+            ColorType = Body[9];
+            if (Body[10] != 0 || Body[11] != 0 || ColorType > 6 || Channels[ColorType] == 0) {
+                return EFI_VOLUME_CORRUPTED;
+            }
+            // Depths each color type allows: 1/2/4 only for gray and palette,
+            // 16 for everything but palette
+            if (!(Depth == 8 || (Depth == 16 && ColorType != 3) ||
+                  ((Depth == 1 || Depth == 2 || Depth == 4) && (ColorType == 0 || ColorType == 3)))) {
+                return EFI_VOLUME_CORRUPTED;
+            }
+            if (Body[12] != 0) {
+                return EFI_UNSUPPORTED;     // Adam7 interlacing
+            }
+            HasHeader = TRUE;
+        } else if (!HasHeader) {
+            return EFI_VOLUME_CORRUPTED;    // IHDR must come first
+        } else if (CompareMem(Type, "PLTE", 4) == 0) {
+            if (Length % 3 != 0 || Length > sizeof(Palette)) {
+                return EFI_VOLUME_CORRUPTED;
+            }
+            PaletteCount = Length / 3;
+            CopyMem(Palette, Body, Length);
+        } else if (CompareMem(Type, "tRNS", 4) == 0) {
+            if (ColorType == 3 && Length <= sizeof(Alpha)) {
+                AlphaCount = Length;
+                CopyMem(Alpha, Body, Length);
+            } else if (ColorType == 0 && Length >= 2) {
+                Key[0] = ReadBe16(Body);
+                HasKey = TRUE;
+            } else if (ColorType == 2 && Length >= 6) {
+                Key[0] = ReadBe16(Body);
+                Key[1] = ReadBe16(Body + 2);
+                Key[2] = ReadBe16(Body + 4);
+                HasKey = TRUE;
+            }
+        } else if (CompareMem(Type, "IDAT", 4) == 0) {
+            HasData = TRUE;
+        } else if (CompareMem(Type, "IEND", 4) == 0) {
+            Ended = TRUE;
+        } else if ((Type[0] & 0x20) == 0) {
+            return EFI_UNSUPPORTED;         // Unknown critical chunk
+        }
+        Pos += 12 + (UINTN)Length;
+    }
+    if (!HasData || (ColorType == 3 && PaletteCount == 0)) {
+        return EFI_VOLUME_CORRUPTED;
+    }
+
+    Status = AllocateImage(Width, Height, Image, &Pixels);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    // Inflate every filtered row (a filter byte, then the samples) at once
+    UINT32 BitsPerPixel = Channels[ColorType] * Depth;
+    UINTN RowBytes = ((UINTN)Width * BitsPerPixel + 7) / 8;
+    UINTN RawSize = (RowBytes + 1) * Height;
+    UINT8 *Raw = AllocatePool(RawSize);
+    if (Raw == NULL) {
+        FreeImage(Image);
+        return EFI_OUT_OF_RESOURCES;
+    }
+    PNG_IDAT_READER Reader = { Data, Size, 8, NULL, 0 };
+    decomp_stream_t Stream;
+    int Result = decomp_open(&Stream, PngReadIdat, &Reader);
+    if (Result == DECOMP_OK) {
+        Result = decomp_run(&Stream, DECOMP_ZLIB, Raw, RawSize, NULL, NULL);
+        if (Result == DECOMP_OK && Stream.out_len != RawSize) {
+            Result = DECOMP_ERR_CORRUPT;
+        }
+    }
+    decomp_close(&Stream);
+    if (Result != DECOMP_OK) {
+        FreePool(Raw);
+        FreeImage(Image);
+        return (Result == DECOMP_ERR_NO_MEMORY) ? EFI_OUT_OF_RESOURCES : EFI_VOLUME_CORRUPTED;
+    }
+
+    // Undo the per-row filters in place; Bpp is the byte distance to the
+    // corresponding sample of the previous pixel
+    UINTN Bpp = MAX(1, BitsPerPixel / 8);
+    for (UINT32 y = 0; y < Height; y++) {
+        UINT8 *Cur = Raw + y * (RowBytes + 1) + 1;
+        CONST UINT8 *Up = (y > 0) ? Cur - (RowBytes + 1) : NULL;
+        UINT8 Filter = Cur[-1];
+        for (UINTN i = 0; i < RowBytes && Filter != 0; i++) {
+            UINT8 A = (i >= Bpp) ? Cur[i - Bpp] : 0;
+            UINT8 B = Up ? Up[i] : 0;
+            UINT8 C = (Up && i >= Bpp) ? Up[i - Bpp] : 0;
+            switch (Filter) {
+                case 1: Cur[i] += A; break;
+                case 2: Cur[i] += B; break;
+                case 3: Cur[i] += (UINT8)(((UINT32)A + B) >> 1); break;
+                case 4: Cur[i] += Paeth(A, B, C); break;
+                default:
+                    FreePool(Raw);
+                    FreeImage(Image);
+                    return EFI_VOLUME_CORRUPTED;
+            }
+        }
+    }
+
+    for (UINT32 y = 0; y < Height; y++) {
+        CONST UINT8 *Row = Raw + y * (RowBytes + 1) + 1;
+        UINT32 *Dst = Pixels + (UINTN)y * Width;
+        for (UINT32 x = 0; x < Width; x++) {
+            UINT32 R, G, B, A = 255;
+            switch (ColorType) {
+                case 0:
+                    R = PngSample(Row, x, Depth);
+                    A = (HasKey && R == Key[0]) ? 0 : 255;
+                    R = G = B = PngScale(R, Depth);
+                    break;
+                case 2:
+                    R = PngSample(Row, 3 * (UINTN)x, Depth);
+                    G = PngSample(Row, 3 * (UINTN)x + 1, Depth);
+                    B = PngSample(Row, 3 * (UINTN)x + 2, Depth);
+                    A = (HasKey && R == Key[0] && G == Key[1] && B == Key[2]) ? 0 : 255;
+                    R = PngScale(R, Depth);
+                    G = PngScale(G, Depth);
+                    B = PngScale(B, Depth);
+                    break;
+                case 3: {
+                    UINT32 i = PngSample(Row, x, Depth);
+                    if (i >= PaletteCount) {
+                        i = 0;
+                    }
+                    R = Palette[i][0];
+                    G = Palette[i][1];
+                    B = Palette[i][2];
+                    A = (i < AlphaCount) ? Alpha[i] : 255;
+                    break;
+                }
+                case 4:
+                    R = G = B = PngScale(PngSample(Row, 2 * (UINTN)x, Depth), Depth);
+                    A = PngScale(PngSample(Row, 2 * (UINTN)x + 1, Depth), Depth);
+                    break;
+                default:
+                    R = PngScale(PngSample(Row, 4 * (UINTN)x, Depth), Depth);
+                    G = PngScale(PngSample(Row, 4 * (UINTN)x + 1, Depth), Depth);
+                    B = PngScale(PngSample(Row, 4 * (UINTN)x + 2, Depth), Depth);
+                    A = PngScale(PngSample(Row, 4 * (UINTN)x + 3, Depth), Depth);
+                    break;
+            }
+            Dst[x] = Composite(R, G, B, A, Matte);
+        }
+    }
+
+    FreePool(Raw);
+    return EFI_SUCCESS;
+}
+
+/**
+  Decodes an image file held in memory.
+
+  @param[in]  Data      The file contents.
+  @param[in]  Size      Their size in bytes.
+  @param[in]  Matte     0x00RRGGBB color that transparent pixels are composited over.
+  @param[out] Image     The decoded image; free it with FreeImage.
+
+  @retval EFI_SUCCESS           The image was decoded.
+  @retval EFI_UNSUPPORTED       Not a BMP, PNG or QOI file, or a variant that is not supported.
+  @retval EFI_VOLUME_CORRUPTED  The file is malformed or truncated.
+  @retval EFI_OUT_OF_RESOURCES  Not enough memory for the pixels.
+**/
+EFI_STATUS
+DecodeImage(
+    IN  CONST VOID      *Data,
+    IN  UINTN           Size,
+    IN  UINT32          Matte,
+    OUT GRAPHICS_IMAGE  *Image
+) {
+    static CONST UINT8 PngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    CONST UINT8 *Bytes = (CONST UINT8 *)Data;
+
+    if (Data == NULL || Image == NULL) {
+        return EFI_INVALID_PARAMETER;
+    }
+    ZeroMem(Image, sizeof(*Image));
+
+    if (Size >= 8 && CompareMem(Bytes, PngSignature, 8) == 0) {
+        return DecodePng(Bytes, Size, Matte, Image);
+    }
+    if (Size >= 4 && CompareMem(Bytes, "qoif", 4) == 0) {
+        return DecodeQoi(Bytes, Size, Matte, Image);
+    }
+    if (Size >= 2 && Bytes[0] == 'B' && Bytes[1] == 'M') {
+        return DecodeBmp(Bytes, Size, Matte, Image);
+    }
+    return EFI_UNSUPPORTED;
+}
+
+VOID
+FreeImage(
+    IN OUT GRAPHICS_IMAGE *Image
+) {
+    if (Image && Image->Pixels) {
+        FreePool((VOID *)Image->Pixels);
+    }
+    if (Image) {
+        ZeroMem(Image, sizeof(*Image));
+    }
+}
+
+/**
+  Loads the theme's background image and installs it in the current theme.
+  The file is only needed while it is decoded; the pixels stay allocated
+  for as long as the theme refers to them.
+
+  @param[in] FileName   Path of the image on the boot volume.
+
+  @retval EFI_SUCCESS   The image was loaded and installed.
+  @retval Other         The file could not be read or decoded; the theme is unchanged.
+**/
+EFI_STATUS
+LoadThemeBackground(
+    IN CONST CHAR8 *FileName
+) {
+    struct BootMenuTheme Theme;
+    GRAPHICS_IMAGE Decoded;
+    LOADED_FILE File;
+    CHAR16 Path[256];
+    EFI_STATUS Status;
+
+    if (FileName == NULL || FileName[0] == '\0') {
+        return EFI_INVALID_PARAMETER;
+    }
+    UnicodeSPrint(Path, sizeof(Path), L"%a", FileName);
+    Status = LoadBootFile(Path, FILE_LOAD_POOL, NULL, NULL, &File);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    CopyMem(&Theme, GetBootMenuTheme(), sizeof(Theme));
+    Status = DecodeImage(File.Buffer, File.Size, Theme.background_color, &Decoded);
+    FreeLoadedFile(&File);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    // Only drop a previous image once the theme no longer points at it
+    Theme.background_image = &g_theme_background;
+    GRAPHICS_IMAGE Previous = g_theme_background;
+    g_theme_background = Decoded;
+    SetBootMenuTheme(&Theme);
+    FreeImage(&Previous);
+    return EFI_SUCCESS;
+}
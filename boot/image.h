@@ -0,0 +1,43 @@
+/*
+ * image.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_IMAGE_H
+#define BLOODHORN_IMAGE_H
+
+#include <Uefi.h>
+#include "compat.h"
+#include "../uefi/graphics.h"
+
+// Largest width or height DecodeImage accepts
+#define IMAGE_MAX_DIMENSION 16384
+
+// Decode a BMP (8/24/32-bit, uncompressed or bitfields), PNG (any color
+// type and depth, not interlaced) or QOI file into 0x00RRGGBB pixels.
+// Transparent pixels are composited over Matte, since nothing is drawn
+// beneath a background. Release the result with FreeImage.
+EFI_STATUS
+DecodeImage(
+    IN  CONST VOID      *Data,
+    IN  UINTN           Size,
+    IN  UINT32          Matte,
+    OUT GRAPHICS_IMAGE  *Image
+);
+
+VOID
+FreeImage(
+    IN OUT GRAPHICS_IMAGE *Image
+);
+
+// Load and decode the theme's background image from the boot volume and
+// install it in the current theme. It is decoded once here; scaling and
+// conversion to the display format happen once per mode in DrawBackground.
+EFI_STATUS
+LoadThemeBackground(
+    IN CONST CHAR8 *FileName
+);
+
+#endif // BLOODHORN_IMAGE_H
@@ -246,19 +246,6 @@ void bh_init_system_table(bh_system_table_t* table) {
 }
 
 // Helper functions
-void* bh_malloc(bh_size_t size) {
-    if (bh_system_table && bh_system_table->alloc) {
-        return bh_system_table->alloc(size);
-    }
-    return NULL;
-}
-
-void bh_free(void* ptr) {
-    if (bh_system_table && bh_system_table->free) {
-        bh_system_table->free(ptr);
-    }
-}
-
 void bh_putc(char c) {
     if (bh_system_table && bh_system_table->putc) {
         bh_system_table->putc(c);
@@ -349,6 +336,10 @@ bh_status_t bh_initialize(bh_system_table_t* system_table) {
     // Initialize subsystems if available
     bh_status_t status = BH_SUCCESS;
     
+    // Move timing onto the CPU counter where it can be calibrated; the
+    // firmware timer stays in use otherwise
+    bh_clock_calibrate();
+    
     // Log successful initialization
     if (bh_system_table->puts) {
         bh_system_table->puts("BloodHorn library initialized successfully");
@@ -496,51 +487,6 @@ const char* bh_status_to_string(bh_status_t status) {
     }
 }
 
-// Utility functions for common operations
-bh_status_t bh_memory_copy(void* dest, const void* src, bh_size_t size) {
-    if (!dest || !src) {
-        return BH_INVALID_ARGUMENT;
-    }
-    
-    if (size == 0) {
-        return BH_SUCCESS;
-    }
-    
-    char* d = (char*)dest;
-    const char* s = (const char*)src;
-    
-    // Handle overlapping memory regions
-    if (d < s) {
-        for (bh_size_t i = 0; i < size; i++) {
-            d[i] = s[i];
-        }
-    } else if (d > s) {
-        for (bh_size_t i = size; i > 0; i--) {
-            d[i - 1] = s[i - 1];
-        }
-    }
-    // If d == s, no copy needed
-    
-    return BH_SUCCESS;
-}
-
-bh_status_t bh_memory_set(void* dest, int value, bh_size_t size) {
-    if (!dest) {
-        return BH_INVALID_ARGUMENT;
-    }
-    
-    if (size == 0) {
-        return BH_SUCCESS;
-    }
-    
-    char* d = (char*)dest;
-    for (bh_size_t i = 0; i < size; i++) {
-        d[i] = (char)value;
-    }
-    
-    return BH_SUCCESS;
-}
-
 bh_status_t bh_memory_compare(const void* ptr1, const void* ptr2, bh_size_t size, int* result) {
     if (!ptr1 || !ptr2 || !result) {
         return BH_INVALID_ARGUMENT;
@@ -0,0 +1,180 @@
+/*
+ * cache.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <bloodhorn/bloodhorn.h>
+#include <bloodhorn/memory.h>
+
+// Ranged cache maintenance for handing images to a kernel. Only the bytes
+// a loader wrote are walked, a line at a time, so the cost follows the
+// size of the kernel, DTB and initrd rather than the size of the caches
+// (a set/way flush of every level on a large ARM server takes far longer
+// than cleaning a 30 MB kernel by address).
+//
+//   - AArch64: line sizes from CTR_EL0; DC CIVAC/IVAC to the point of
+//     coherency, DC CVAU + IC IVAU for code, each skipped when CTR_EL0
+//     says the hardware needs no help (IDC, DIC).
+//   - RISC-V: Zicbom CBO.FLUSH/INVAL by block where the build targets it,
+//     else fences (the boot protocol hands over with caches on, and harts
+//     are coherent); FENCE.I for code.
+//   - LoongArch: caches are coherent with memory and DMA, so barriers only
+//     (DBAR, IBAR).
+//   - PowerPC: DCBF, and DCBST + ICBI for code, stepped by the L1 line
+//     size the platform code reports.
+//   - x86: coherent; nothing to do beyond ordering.
+
+#if defined(__powerpc__) || defined(__powerpc64__)
+#define CACHE_DEFAULT_LINE  32      // Smallest PowerPC line: always a safe step
+#else
+#define CACHE_DEFAULT_LINE  64
+#endif
+
+static bh_size_t cache_line_hint = 0;
+
+void bh_memory_set_cache_line(bh_size_t line) {
+    // A step must be a power of two for the alignment below
+    if (line && (line & (line - 1)) == 0) {
+        cache_line_hint = line;
+    }
+}
+
+#if defined(__aarch64__) && defined(__GNUC__)
+#define CTR_IDC     (1ULL << 28)    // No D-cache clean needed for I/D coherence
+#define CTR_DIC     (1ULL << 29)    // No I-cache invalidation needed
+
+static uint64_t cache_ctr(void) {
+    uint64_t ctr;
+    __asm__ volatile ("mrs %0, ctr_el0" : "=r" (ctr));
+    return ctr;
+}
+
+static bh_size_t cache_dline(uint64_t ctr) {
+    return (bh_size_t)4 << ((ctr >> 16) & 0xF);
+}
+
+static bh_size_t cache_iline(uint64_t ctr) {
+    return (bh_size_t)4 << (ctr & 0xF);
+}
+#endif
+
+static bh_size_t cache_line(void) {
+#if defined(__aarch64__) && defined(__GNUC__)
+    return cache_dline(cache_ctr());
+#else
+    return cache_line_hint ? cache_line_hint : CACHE_DEFAULT_LINE;
+#endif
+}
+
+#define CACHE_FOR_EACH_LINE(p, addr, size, line) \
+    for (uintptr_t p = (uintptr_t)(addr) & ~((uintptr_t)(line) - 1); p < (uintptr_t)(addr) + (size); p += (line))
+
+bh_status_t bh_memory_flush(void* addr, bh_size_t size) {
+    if (!addr && size) return BH_INVALID_PARAMETER;
+    if (size == 0) return BH_SUCCESS;
+    bh_size_t line = cache_line();
+    (void)line;
+
+#if defined(__aarch64__) && defined(__GNUC__)
+    CACHE_FOR_EACH_LINE(p, addr, size, line) {
+        __asm__ volatile ("dc civac, %0" :: "r" (p) : "memory");
+    }
+    __asm__ volatile ("dsb sy" ::: "memory");
+#elif defined(__riscv) && defined(__riscv_zicbom) && defined(__GNUC__)
+    CACHE_FOR_EACH_LINE(p, addr, size, line) {
+        __asm__ volatile (".insn i 0x0F, 2, x0, %0, 2" :: "r" (p) : "memory");    // cbo.flush
+    }
+    __asm__ volatile ("fence rw, rw" ::: "memory");
+#elif defined(__riscv) && defined(__GNUC__)
+    __asm__ volatile ("fence rw, rw" ::: "memory");
+#elif defined(__loongarch__) && defined(__GNUC__)
+    __asm__ volatile ("dbar 0" ::: "memory");
+#elif (defined(__powerpc__) || defined(__powerpc64__)) && defined(__GNUC__)
+    CACHE_FOR_EACH_LINE(p, addr, size, line) {
+        __asm__ volatile ("dcbf 0, %0" :: "r" (p) : "memory");
+    }
+    __asm__ volatile ("sync" ::: "memory");
+#elif (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+    __asm__ volatile ("mfence" ::: "memory");
+#endif
+    return BH_SUCCESS;
+}
+
+bh_status_t bh_memory_invalidate(void* addr, bh_size_t size) {
+    if (!addr && size) return BH_INVALID_PARAMETER;
+    if (size == 0) return BH_SUCCESS;
+    bh_size_t line = cache_line();
+    (void)line;
+
+#if defined(__aarch64__) && defined(__GNUC__)
+    // Partial lines at either end would lose their neighbours' dirty bytes
+    // to a plain invalidate, so those are cleaned as well
+    uintptr_t start = (uintptr_t)addr;
+    uintptr_t end = start + size;
+    CACHE_FOR_EACH_LINE(p, addr, size, line) {
+        if (p < start || p + line > end) {
+            __asm__ volatile ("dc civac, %0" :: "r" (p) : "memory");
+        } else {
+            __asm__ volatile ("dc ivac, %0" :: "r" (p) : "memory");
+        }
+    }
+    __asm__ volatile ("dsb sy" ::: "memory");
+#elif defined(__riscv) && defined(__riscv_zicbom) && defined(__GNUC__)
+    uintptr_t start = (uintptr_t)addr;
+    uintptr_t end = start + size;
+    CACHE_FOR_EACH_LINE(p, addr, size, line) {
+        if (p < start || p + line > end) {
+            __asm__ volatile (".insn i 0x0F, 2, x0, %0, 2" :: "r" (p) : "memory");    // cbo.flush
+        } else {
+            __asm__ volatile (".insn i 0x0F, 2, x0, %0, 0" :: "r" (p) : "memory");    // cbo.inval
+        }
+    }
+    __asm__ volatile ("fence rw, rw" ::: "memory");
+#else
+    // DCBI is privileged and discards neighbours' data; a flush is as good
+    // for memory that was only read before the device wrote it
+    return bh_memory_flush(addr, size);
+#endif
+    return BH_SUCCESS;
+}
+
+bh_status_t bh_memory_sync_code(void* addr, bh_size_t size) {
+    if (!addr && size) return BH_INVALID_PARAMETER;
+    if (size == 0) return BH_SUCCESS;
+
+#if defined(__aarch64__) && defined(__GNUC__)
+    uint64_t ctr = cache_ctr();
+    if (!(ctr & CTR_IDC)) {
+        bh_size_t dline = cache_dline(ctr);
+        CACHE_FOR_EACH_LINE(p, addr, size, dline) {
+            __asm__ volatile ("dc cvau, %0" :: "r" (p) : "memory");
+        }
+    }
+    __asm__ volatile ("dsb ish" ::: "memory");
+    if (!(ctr & CTR_DIC)) {
+        bh_size_t iline = cache_iline(ctr);
+        CACHE_FOR_EACH_LINE(p, addr, size, iline) {
+            __asm__ volatile ("ic ivau, %0" :: "r" (p) : "memory");
+        }
+        __asm__ volatile ("dsb ish" ::: "memory");
+    }
+    __asm__ volatile ("isb" ::: "memory");
+#elif defined(__riscv) && defined(__GNUC__)
+    __asm__ volatile ("fence rw, rw\n\tfence.i" ::: "memory");
+#elif defined(__loongarch__) && defined(__GNUC__)
+    __asm__ volatile ("dbar 0\n\tibar 0" ::: "memory");
+#elif (defined(__powerpc__) || defined(__powerpc64__)) && defined(__GNUC__)
+    bh_size_t line = cache_line();
+    CACHE_FOR_EACH_LINE(p, addr, size, line) {
+        __asm__ volatile ("dcbst 0, %0" :: "r" (p) : "memory");
+    }
+    __asm__ volatile ("sync" ::: "memory");
+    CACHE_FOR_EACH_LINE(p, addr, size, line) {
+        __asm__ volatile ("icbi 0, %0" :: "r" (p) : "memory");
+    }
+    __asm__ volatile ("sync\n\tisync" ::: "memory");
+#endif
+    return BH_SUCCESS;
+}
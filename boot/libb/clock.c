@@ -0,0 +1,329 @@
+/*
+ * clock.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <bloodhorn/bloodhorn.h>
+#include <bloodhorn/time.h>
+
+// Performance counter frequency cache (time.h)
+bh_uint64_t bh_performance_frequency = 0;
+
+// Set once the CPU counter runs at a known rate; reads then stay off the
+// firmware timer, which may be an I/O port behind a slow bus
+static bh_bool_t clock_cpu_counter = BH_FALSE;
+
+// Calibration window, and the fewest firmware ticks it may span so that a
+// coarse firmware timer still gives a usable rate
+#define CLOCK_CALIBRATION_US        2000
+#define CLOCK_CALIBRATION_MIN_TICKS 50
+
+// Firmware reads allowed while waiting for its timer to move at all
+#define CLOCK_EDGE_SPIN_LIMIT       100000000UL
+
+#if defined(__x86_64__) || defined(__i386__)
+
+static inline bh_uint64_t clock_cpu_read(void) {
+    bh_uint32_t lo, hi;
+    // lfence keeps the read from being hoisted above earlier loads
+    __asm__ volatile ("lfence; rdtsc" : "=a"(lo), "=d"(hi) : : "memory");
+    return ((bh_uint64_t)hi << 32) | lo;
+}
+
+static inline void clock_cpu_relax(void) {
+    __asm__ volatile ("pause");
+}
+
+static void clock_cpuid(bh_uint32_t leaf, bh_uint32_t regs[4]) {
+    __asm__ volatile ("cpuid"
+                      : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3])
+                      : "a"(leaf), "c"(0));
+}
+
+// Only an invariant TSC keeps one rate through P- and C-state changes
+static bh_bool_t clock_cpu_usable(void) {
+    bh_uint32_t regs[4];
+
+    clock_cpuid(0x80000000, regs);
+    if (regs[0] < 0x80000007) {
+        return BH_FALSE;
+    }
+    clock_cpuid(0x80000007, regs);
+    return (regs[3] & (1u << 8)) != 0;
+}
+
+// Rate from the crystal ratio in leaf 0x15, where the CPU reports one
+static bh_uint64_t clock_cpu_nominal(void) {
+    bh_uint32_t regs[4];
+
+    clock_cpuid(0, regs);
+    if (regs[0] < 0x15) {
+        return 0;
+    }
+    clock_cpuid(0x15, regs);
+    if (!regs[0] || !regs[1] || !regs[2]) {
+        return 0;
+    }
+    return (bh_uint64_t)regs[2] * regs[1] / regs[0];
+}
+
+#elif defined(__aarch64__)
+
+static inline bh_uint64_t clock_cpu_read(void) {
+    bh_uint64_t value;
+    __asm__ volatile ("isb; mrs %0, cntvct_el0" : "=r"(value) : : "memory");
+    return value;
+}
+
+static inline void clock_cpu_relax(void) {
+    __asm__ volatile ("yield");
+}
+
+static bh_bool_t clock_cpu_usable(void) {
+    return BH_TRUE;
+}
+
+// Programmed by firmware; used only when there is nothing to check it by
+static bh_uint64_t clock_cpu_nominal(void) {
+    bh_uint64_t value;
+    __asm__ volatile ("mrs %0, cntfrq_el0" : "=r"(value));
+    return value & 0xFFFFFFFF;
+}
+
+#elif defined(__riscv)
+
+static inline bh_uint64_t clock_cpu_read(void) {
+#if __riscv_xlen == 64
+    bh_uint64_t value;
+    __asm__ volatile ("rdtime %0" : "=r"(value));
+    return value;
+#else
+    bh_uint32_t hi, lo, again;
+    do {
+        __asm__ volatile ("rdtimeh %0" : "=r"(hi));
+        __asm__ volatile ("rdtime %0" : "=r"(lo));
+        __asm__ volatile ("rdtimeh %0" : "=r"(again));
+    } while (hi != again);
+    return ((bh_uint64_t)hi << 32) | lo;
+#endif
+}
+
+static inline void clock_cpu_relax(void) {
+}
+
+static bh_bool_t clock_cpu_usable(void) {
+    return BH_TRUE;
+}
+
+// The timebase is only described by the device tree
+static bh_uint64_t clock_cpu_nominal(void) {
+    return 0;
+}
+
+#elif defined(__loongarch64)
+
+static inline bh_uint64_t clock_cpu_read(void) {
+    bh_uint64_t value;
+    __asm__ volatile ("rdtime.d %0, $zero" : "=r"(value));
+    return value;
+}
+
+static inline void clock_cpu_relax(void) {
+}
+
+static bh_uint32_t clock_cpucfg(bh_uint32_t word) {
+    bh_uint32_t value;
+    __asm__ volatile ("cpucfg %0, %1" : "=r"(value) : "r"(word));
+    return value;
+}
+
+static bh_bool_t clock_cpu_usable(void) {
+    return (clock_cpucfg(2) & (1u << 14)) != 0;     // Constant timer
+}
+
+// Crystal frequency times the multiplier over the divider (CPUCFG 4/5)
+static bh_uint64_t clock_cpu_nominal(void) {
+    bh_uint32_t crystal = clock_cpucfg(4);
+    bh_uint32_t ratio = clock_cpucfg(5);
+    bh_uint32_t mul = ratio & 0xFFFF;
+    bh_uint32_t div = ratio >> 16;
+
+    if (!crystal || !mul || !div) {
+        return 0;
+    }
+    return (bh_uint64_t)crystal * mul / div;
+}
+
+#elif defined(__powerpc__) || defined(__powerpc64__)
+
+static inline bh_uint64_t clock_cpu_read(void) {
+#if defined(__powerpc64__)
+    bh_uint64_t value;
+    __asm__ volatile ("mftb %0" : "=r"(value));
+    return value;
+#else
+    bh_uint32_t hi, lo, again;
+    do {
+        __asm__ volatile ("mftbu %0" : "=r"(hi));
+        __asm__ volatile ("mftb %0" : "=r"(lo));
+        __asm__ volatile ("mftbu %0" : "=r"(again));
+    } while (hi != again);
+    return ((bh_uint64_t)hi << 32) | lo;
+#endif
+}
+
+static inline void clock_cpu_relax(void) {
+}
+
+static bh_bool_t clock_cpu_usable(void) {
+    return BH_TRUE;
+}
+
+// The timebase is only described by the device tree
+static bh_uint64_t clock_cpu_nominal(void) {
+    return 0;
+}
+
+#else
+
+static inline bh_uint64_t clock_cpu_read(void) {
+    return 0;
+}
+
+static inline void clock_cpu_relax(void) {
+}
+
+static bh_bool_t clock_cpu_usable(void) {
+    return BH_FALSE;
+}
+
+static bh_uint64_t clock_cpu_nominal(void) {
+    return 0;
+}
+
+#endif
+
+void bh_clock_set_frequency(bh_uint64_t frequency) {
+    if (frequency == 0 || !clock_cpu_usable()) {
+        return;
+    }
+    bh_performance_frequency = frequency;
+    clock_cpu_counter = BH_TRUE;
+}
+
+// Count CPU ticks over a window of the firmware timer that starts on one
+// of its edges; without a firmware timer, take the rate the CPU reports
+bh_status_t bh_clock_calibrate(void) {
+    bh_uint64_t (*reference)(void) = NULL;
+    bh_uint64_t reference_frequency = 0;
+    bh_uint64_t frequency;
+
+    if (!clock_cpu_usable()) {
+        return BH_NOT_SUPPORTED;
+    }
+    if (bh_system_table && bh_system_table->get_performance_counter &&
+        bh_system_table->get_performance_frequency) {
+        reference = bh_system_table->get_performance_counter;
+        reference_frequency = bh_system_table->get_performance_frequency();
+    }
+
+    if (reference && reference_frequency) {
+        bh_uint64_t span = reference_frequency * CLOCK_CALIBRATION_US / 1000000;
+        bh_uint64_t r0, r1, r2, c0, c1;
+        unsigned long spins = 0;
+
+        if (span < CLOCK_CALIBRATION_MIN_TICKS) {
+            span = CLOCK_CALIBRATION_MIN_TICKS;
+        }
+
+        r0 = reference();
+        while ((r1 = reference()) == r0) {
+            if (++spins == CLOCK_EDGE_SPIN_LIMIT) {
+                return BH_DEVICE_ERROR;
+            }
+        }
+        c0 = clock_cpu_read();
+        while ((r2 = reference()) - r1 < span) {
+        }
+        c1 = clock_cpu_read();
+
+        frequency = (c1 - c0) * reference_frequency / (r2 - r1);
+    } else {
+        frequency = clock_cpu_nominal();
+    }
+
+    if (frequency == 0) {
+        return BH_NOT_SUPPORTED;
+    }
+    bh_clock_set_frequency(frequency);
+    return BH_SUCCESS;
+}
+
+bh_uint64_t bh_get_performance_counter(void) {
+    if (clock_cpu_counter) {
+        return clock_cpu_read();
+    }
+    if (bh_system_table && bh_system_table->get_performance_counter) {
+        return bh_system_table->get_performance_counter();
+    }
+    return 0;
+}
+
+bh_uint64_t bh_get_performance_frequency(void) {
+    if (bh_performance_frequency == 0 && bh_system_table && bh_system_table->get_performance_frequency) {
+        bh_performance_frequency = bh_system_table->get_performance_frequency();
+    }
+    return bh_performance_frequency;
+}
+
+bh_uint64_t bh_ticks_to_nanoseconds(bh_uint64_t ticks) {
+    bh_uint64_t freq = bh_get_performance_frequency();
+    if (freq == 0) {
+        return ticks;
+    }
+    // Split to avoid overflowing ticks * 1e9
+    return (ticks / freq) * 1000000000ULL + ((ticks % freq) * 1000000000ULL) / freq;
+}
+
+bh_uint64_t bh_nanoseconds_to_ticks(bh_uint64_t nanoseconds) {
+    bh_uint64_t freq = bh_get_performance_frequency();
+    if (freq == 0) {
+        return nanoseconds;
+    }
+    return (nanoseconds / 1000000000ULL) * freq + ((nanoseconds % 1000000000ULL) * freq) / 1000000000ULL;
+}
+
+bh_uint64_t bh_get_timestamp(void) {
+    return bh_ticks_to_nanoseconds(bh_get_performance_counter());
+}
+
+// Busy-waits on the performance counter; without one there is nothing to
+// measure the delay against
+bh_status_t bh_sleep_microseconds(bh_uint64_t microseconds) {
+    bh_uint64_t start, ticks;
+
+    if (bh_get_performance_frequency() == 0 ||
+        (!clock_cpu_counter && !(bh_system_table && bh_system_table->get_performance_counter))) {
+        return BH_NOT_SUPPORTED;
+    }
+    ticks = bh_nanoseconds_to_ticks(microseconds * 1000ULL);
+    start = bh_get_performance_counter();
+    while (bh_get_performance_counter() - start < ticks) {
+        clock_cpu_relax();
+    }
+    return BH_SUCCESS;
+}
+
+bh_status_t bh_sleep_milliseconds(bh_uint64_t milliseconds) {
+    return bh_sleep_microseconds(milliseconds * 1000ULL);
+}
+
+bh_status_t bh_sleep_seconds(bh_uint64_t seconds) {
+    return bh_sleep_milliseconds(seconds * 1000ULL);
+}
+
+void bh_busy_wait_microseconds(bh_uint64_t microseconds) {
+    bh_sleep_microseconds(microseconds);
+}
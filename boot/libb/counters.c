@@ -0,0 +1,67 @@
+/*
+ * counters.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <bloodhorn/counters.h>
+
+bh_counters_t bh_counters;
+
+// Driver names as the fs/ drivers register them
+static const struct {
+    const char* name;
+    bh_counter_source_t source;
+} counters_fs_sources[] = {
+    { "fat32", BH_COUNTER_SOURCE_FAT },
+    { "ext2", BH_COUNTER_SOURCE_EXT2 },
+    { "iso9660", BH_COUNTER_SOURCE_ISO9660 },
+    { "squashfs", BH_COUNTER_SOURCE_SQUASHFS },
+};
+
+static bh_bool_t counters_name_equal(const char* a, const char* b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+void bh_counters_reset(void) {
+    bh_uint8_t* bytes = (bh_uint8_t*)&bh_counters;
+    for (bh_size_t i = 0; i < sizeof(bh_counters); i++) {
+        bytes[i] = 0;
+    }
+}
+
+void bh_counters_add_read(bh_counter_source_t source, bh_uint64_t bytes) {
+    if ((unsigned)source >= BH_COUNTER_SOURCE_COUNT) {
+        source = BH_COUNTER_SOURCE_OTHER;
+    }
+    bh_counters.bytes_read[source] += bytes;
+}
+
+bh_counter_source_t bh_counters_source_for_fs(const char* fs_name) {
+    if (fs_name) {
+        for (bh_size_t i = 0; i < sizeof(counters_fs_sources) / sizeof(counters_fs_sources[0]); i++) {
+            if (counters_name_equal(fs_name, counters_fs_sources[i].name)) {
+                return counters_fs_sources[i].source;
+            }
+        }
+    }
+    return BH_COUNTER_SOURCE_OTHER;
+}
+
+void bh_counters_add_hash(bh_uint64_t bytes, bh_uint64_t ticks) {
+    bh_counters.hash_bytes += bytes;
+    bh_counters.hash_ticks += ticks;
+}
+
+void bh_counters_add_tpm(bh_uint64_t ticks) {
+    bh_counters.tpm_commands++;
+    bh_counters.tpm_ticks += ticks;
+    if (ticks > bh_counters.tpm_max_ticks) {
+        bh_counters.tpm_max_ticks = ticks;
+    }
+}
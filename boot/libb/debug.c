@@ -0,0 +1,799 @@
+/*
+ * debug.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <bloodhorn/bloodhorn.h>
+#include <bloodhorn/debug.h>
+#include <bloodhorn/memory.h>
+#include <bloodhorn/time.h>
+#include <stdarg.h>
+
+bh_debug_config_t bh_debug_config = {
+    .min_level = BH_DEBUG_LEVEL_INFO,
+    .category_mask = BH_DEBUG_CAT_ALL,
+    .flags = BH_DEBUG_FLAG_DEFAULT,
+    .output = BH_DEBUG_OUTPUT_CONSOLE,
+};
+bh_bool_t bh_debug_initialized = BH_FALSE;
+
+// One message as captured at the call site. commit holds the sequence
+// number plus one once the record is complete, so a reader can tell a
+// finished record from one being written or already reused.
+typedef struct {
+    bh_uint32_t commit;
+    bh_uint8_t level;
+    bh_uint8_t nargs;           // Text records: bytes of text
+    bh_uint8_t flags;           // DEBUG_RECORD_*
+    bh_uint8_t string_used;
+    bh_uint32_t category;
+    bh_uint32_t line;
+    bh_uint64_t timestamp;
+    const char* format;
+    const char* file;
+    const char* function;
+    union {
+        struct {
+            bh_uint64_t args[BH_DEBUG_RECORD_MAX_ARGS];
+            char strings[BH_DEBUG_RECORD_STRING_SIZE];
+        };
+        char text[BH_DEBUG_RECORD_MAX_ARGS * 8 + BH_DEBUG_RECORD_STRING_SIZE];
+    };
+} debug_record_t;
+
+#define DEBUG_RECORD_PRINTED    0x01    // Already written out by the immediate path
+#define DEBUG_RECORD_TEXT       0x02    // From bh_debug_write: text, no format
+#define DEBUG_RECORD_MORE       0x04    // The message goes on in the next record
+
+// Longest message bh_debug_write keeps, in records
+#define DEBUG_TEXT_MAX_RECORDS  8
+
+// %s argument that was NULL
+#define DEBUG_NULL_STRING ((bh_uint64_t)-1)
+
+// Longest line the immediate and flush paths print in one go
+#define DEBUG_LINE_SIZE 256
+
+static debug_record_t debug_ring_default[BH_DEBUG_RING_RECORDS];
+static debug_record_t* debug_ring = debug_ring_default;
+static bh_uint32_t debug_ring_size = BH_DEBUG_RING_RECORDS;
+static bh_uint32_t debug_head = 0;      // Next sequence number to hand out
+static bh_uint32_t debug_flushed = 0;   // First record bh_debug_flush has not seen
+static bh_uint32_t debug_cleared = 0;   // Records before this were cleared
+static char* debug_text = NULL;         // Owned by bh_debug_get_memory_buffer
+
+// Bounded text writer; keeps counting past the end so callers can size buffers
+typedef struct {
+    char* buffer;
+    bh_size_t size;
+    bh_size_t length;
+} debug_writer_t;
+
+static void debug_put_char(debug_writer_t* w, char c) {
+    if (w->buffer && w->length + 1 < w->size) {
+        w->buffer[w->length] = c;
+    }
+    w->length++;
+}
+
+static void debug_put_string(debug_writer_t* w, const char* s) {
+    while (*s) {
+        debug_put_char(w, *s++);
+    }
+}
+
+static void debug_finish(debug_writer_t* w) {
+    if (w->buffer && w->size) {
+        w->buffer[w->length < w->size ? w->length : w->size - 1] = '\0';
+    }
+}
+
+// One conversion of a format string
+typedef struct {
+    char conv;
+    char pad;                   // ' ' or '0'
+    bh_bool_t left;
+    bh_uint32_t width;
+    bh_uint32_t length;         // 0 int, 1 long, 2 long long, 3 size_t
+} debug_spec_t;
+
+// Parse the conversion after a '%'; *p is left past it. Returns the
+// conversion character, or 0 at the end of the string.
+static char debug_parse_spec(const char** p, debug_spec_t* spec) {
+    const char* s = *p;
+
+    spec->pad = ' ';
+    spec->left = BH_FALSE;
+    spec->width = 0;
+    spec->length = 0;
+
+    for (;; s++) {
+        if (*s == '-') {
+            spec->left = BH_TRUE;
+        } else if (*s == '0') {
+            spec->pad = '0';
+        } else {
+            break;
+        }
+    }
+    while (*s >= '0' && *s <= '9') {
+        spec->width = spec->width * 10 + (bh_uint32_t)(*s++ - '0');
+    }
+    if (*s == 'l') {
+        spec->length = 1;
+        if (*++s == 'l') {
+            spec->length = 2;
+            s++;
+        }
+    } else if (*s == 'z') {
+        spec->length = 3;
+        s++;
+    } else {
+        while (*s == 'h') {
+            s++;            // Promoted to int anyway
+        }
+    }
+
+    spec->conv = *s;
+    if (*s) {
+        s++;
+    }
+    *p = s;
+    return spec->conv;
+}
+
+static bh_bool_t debug_takes_arg(char conv) {
+    switch (conv) {
+        case 'd': case 'i': case 'u': case 'x': case 'X':
+        case 'p': case 's': case 'c':
+            return BH_TRUE;
+        default:
+            return BH_FALSE;
+    }
+}
+
+// Copy a %s argument into the record, cutting it to the space left
+static bh_uint64_t debug_store_string(debug_record_t* r, const char* s) {
+    bh_uint32_t start = r->string_used;
+
+    if (!s) {
+        return DEBUG_NULL_STRING;
+    }
+    if (start >= sizeof(r->strings)) {
+        return sizeof(r->strings) - 1;  // The final terminator
+    }
+    while (*s && r->string_used < sizeof(r->strings) - 1) {
+        r->strings[r->string_used++] = *s++;
+    }
+    r->strings[r->string_used++] = '\0';
+    return start;
+}
+
+// Raw arguments only: walk the conversions and take each one as its type
+static void debug_capture(debug_record_t* r, const char* format, va_list* args) {
+    const char* p = format;
+    debug_spec_t spec;
+    bh_uint64_t value;
+
+    r->nargs = 0;
+    r->string_used = 0;
+    r->strings[sizeof(r->strings) - 1] = '\0';
+
+    while (*p && r->nargs < BH_DEBUG_RECORD_MAX_ARGS) {
+        if (*p++ != '%') {
+            continue;
+        }
+        if (!debug_takes_arg(debug_parse_spec(&p, &spec))) {
+            continue;
+        }
+
+        switch (spec.conv) {
+            case 'd':
+            case 'i':
+                if (spec.length == 2) {
+                    value = (bh_uint64_t)va_arg(*args, long long);
+                } else if (spec.length == 1) {
+                    value = (bh_uint64_t)(long long)va_arg(*args, long);
+                } else if (spec.length == 3) {
+                    value = (bh_uint64_t)(long long)va_arg(*args, bh_intptr_t);
+                } else {
+                    value = (bh_uint64_t)(long long)va_arg(*args, int);
+                }
+                break;
+            case 'p':
+                value = (bh_uintptr_t)va_arg(*args, void*);
+                break;
+            case 's':
+                value = debug_store_string(r, va_arg(*args, const char*));
+                break;
+            case 'c':
+                value = (bh_uint8_t)va_arg(*args, int);
+                break;
+            default:
+                if (spec.length == 2) {
+                    value = va_arg(*args, unsigned long long);
+                } else if (spec.length == 1) {
+                    value = va_arg(*args, unsigned long);
+                } else if (spec.length == 3) {
+                    value = va_arg(*args, bh_size_t);
+                } else {
+                    value = va_arg(*args, unsigned int);
+                }
+                break;
+        }
+        r->args[r->nargs++] = value;
+    }
+}
+
+static void debug_put_arg(debug_writer_t* w, const debug_spec_t* spec, const debug_record_t* r, bh_uint64_t value) {
+    static const char lower[] = "0123456789abcdef";
+    static const char upper[] = "0123456789ABCDEF";
+    const char* digits = lower;
+    const char* text;
+    char tmp[24];
+    const char* prefix = "";
+    bh_uint32_t n = 0;
+    bh_uint32_t base = 10;
+    bh_uint32_t len;
+
+    switch (spec->conv) {
+        case 's':
+            if (value == DEBUG_NULL_STRING) {
+                text = "(null)";
+            } else {
+                text = r->strings + (bh_size_t)value;
+            }
+            for (len = 0; text[len]; len++) {
+            }
+            goto pad_text;
+        case 'c':
+            tmp[0] = (char)value;
+            tmp[1] = '\0';
+            text = tmp;
+            len = 1;
+            goto pad_text;
+        case 'd':
+        case 'i':
+            if ((long long)value < 0) {
+                prefix = "-";
+                value = (bh_uint64_t)-(long long)value;
+            }
+            break;
+        case 'p':
+            prefix = "0x";
+            base = 16;
+            break;
+        case 'X':
+            digits = upper;
+            base = 16;
+            break;
+        case 'x':
+            base = 16;
+            break;
+        default:
+            break;
+    }
+
+    do {
+        tmp[n++] = digits[value % base];
+        value /= base;
+    } while (value);
+
+    len = n;
+    for (const char* q = prefix; *q; q++) {
+        len++;
+    }
+    if (!spec->left && spec->pad == '0') {
+        // Zeros go between the sign and the digits
+        debug_put_string(w, prefix);
+        for (; len < spec->width; len++) {
+            debug_put_char(w, '0');
+        }
+    } else {
+        if (!spec->left) {
+            for (; len < spec->width; len++) {
+                debug_put_char(w, ' ');
+            }
+        }
+        debug_put_string(w, prefix);
+    }
+    while (n) {
+        debug_put_char(w, tmp[--n]);
+    }
+    for (; len < spec->width; len++) {
+        debug_put_char(w, ' ');
+    }
+    return;
+
+pad_text:
+    if (!spec->left) {
+        for (; len < spec->width; len++) {
+            debug_put_char(w, ' ');
+        }
+    }
+    debug_put_string(w, text);
+    for (; len < spec->width; len++) {
+        debug_put_char(w, ' ');
+    }
+}
+
+static const char* debug_level_name(bh_uint32_t level) {
+    switch (level) {
+        case BH_DEBUG_LEVEL_ERROR:      return "ERROR";
+        case BH_DEBUG_LEVEL_WARNING:    return "WARN";
+        case BH_DEBUG_LEVEL_INFO:       return "INFO";
+        case BH_DEBUG_LEVEL_VERBOSE:    return "VERBOSE";
+        default:                        return "TRACE";
+    }
+}
+
+static void debug_put_uint(debug_writer_t* w, bh_uint64_t value, bh_uint32_t width, char pad) {
+    debug_spec_t spec = { 'u', pad, BH_FALSE, width, 0 };
+    debug_put_arg(w, &spec, NULL, value);
+}
+
+// Render one record as a line, prefixed as the current flags ask. A record
+// that continues the previous one's text gets no prefix, and one whose
+// text goes on in the next record no line ending.
+static void debug_format_record(debug_writer_t* w, const debug_record_t* r, bh_bool_t continued) {
+    bh_debug_flags_t flags = bh_debug_config.flags;
+    const char* p = r->format;
+    debug_spec_t spec;
+    bh_uint32_t arg = 0;
+
+    if (continued) {
+        // Only the text
+    } else if (flags & BH_DEBUG_FLAG_TIMESTAMP) {
+        bh_uint64_t us = bh_ticks_to_nanoseconds(r->timestamp) / 1000;
+        debug_put_char(w, '[');
+        debug_put_uint(w, us / 1000000, 5, ' ');
+        debug_put_char(w, '.');
+        debug_put_uint(w, us % 1000000, 6, '0');
+        debug_put_string(w, "] ");
+    }
+    if (!continued && (flags & BH_DEBUG_FLAG_LEVEL)) {
+        debug_put_string(w, debug_level_name(r->level));
+        debug_put_string(w, ": ");
+    }
+    if (!continued && (flags & BH_DEBUG_FLAG_FILE) && r->file) {
+        const char* base = r->file;
+        for (const char* q = r->file; *q; q++) {
+            if (*q == '/' || *q == '\\') {
+                base = q + 1;
+            }
+        }
+        debug_put_string(w, base);
+        if (flags & BH_DEBUG_FLAG_LINE) {
+            debug_put_char(w, ':');
+            debug_put_uint(w, r->line, 0, ' ');
+        }
+        debug_put_string(w, ": ");
+    }
+    if (!continued && (flags & BH_DEBUG_FLAG_FUNCTION) && r->function) {
+        debug_put_string(w, r->function);
+        debug_put_string(w, ": ");
+    }
+
+    if (r->flags & DEBUG_RECORD_TEXT) {
+        for (bh_uint32_t i = 0; i < r->nargs; i++) {
+            debug_put_char(w, r->text[i]);
+        }
+        if (!(r->flags & DEBUG_RECORD_MORE)) {
+            debug_put_string(w, "\r\n");
+        }
+        return;
+    }
+
+    while (*p) {
+        const char* start = p;
+        if (*p != '%') {
+            debug_put_char(w, *p++);
+            continue;
+        }
+        p++;
+        if (*p == '%') {
+            debug_put_char(w, '%');
+            p++;
+            continue;
+        }
+        if (!debug_takes_arg(debug_parse_spec(&p, &spec))) {
+            while (start < p) {
+                debug_put_char(w, *start++);
+            }
+        } else if (arg < r->nargs) {
+            debug_put_arg(w, &spec, r, r->args[arg++]);
+        } else {
+            debug_put_char(w, '?');  // Past BH_DEBUG_RECORD_MAX_ARGS
+        }
+    }
+    debug_put_string(w, "\r\n");
+}
+
+static void debug_emit(const debug_record_t* r, bh_bool_t continued) {
+    char line[DEBUG_LINE_SIZE];
+    debug_writer_t w = { line, sizeof(line), 0 };
+
+    debug_format_record(&w, r, continued);
+    if (w.length >= sizeof(line)) {
+        // Keep the line ending on a cut line
+        w.length = sizeof(line) - 3;
+        debug_put_string(&w, "\r\n");
+    }
+    debug_finish(&w);
+    bh_puts(line);
+}
+
+// Copy out a committed record. The copy is checked against the commit word
+// again afterwards, since a writer may have reused the slot meanwhile.
+static bh_bool_t debug_read(bh_uint32_t seq, debug_record_t* out) {
+    const debug_record_t* r = &debug_ring[seq & (debug_ring_size - 1)];
+
+    if (__atomic_load_n(&r->commit, __ATOMIC_ACQUIRE) != seq + 1) {
+        return BH_FALSE;
+    }
+    *out = *r;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&r->commit, __ATOMIC_RELAXED) == seq + 1;
+}
+
+// Oldest sequence number still held in the ring
+static bh_uint32_t debug_first(bh_uint32_t head, bh_uint32_t from) {
+    if (head - from > debug_ring_size) {
+        return head - debug_ring_size;
+    }
+    return from;
+}
+
+bh_status_t bh_debug_initialize(const bh_debug_config_t* config) {
+    if (config) {
+        bh_debug_config = *config;
+    }
+
+    // A bigger ring than the built-in one comes from the heap; records
+    // taken before this point are dropped with the old ring
+    bh_size_t records = bh_debug_config.memory_buffer_size / sizeof(debug_record_t);
+    if (debug_ring == debug_ring_default && records > BH_DEBUG_RING_RECORDS) {
+        bh_uint32_t size = BH_DEBUG_RING_RECORDS;
+        while ((bh_size_t)size * 2 <= records && size < 0x80000000U) {
+            size *= 2;
+        }
+        debug_record_t* ring = bh_memory_allocate(size * sizeof(debug_record_t), 64, BH_MEMORY_ZERO);
+        if (ring) {
+            debug_ring = ring;
+            debug_ring_size = size;
+            debug_cleared = debug_flushed = __atomic_load_n(&debug_head, __ATOMIC_ACQUIRE);
+        }
+    }
+
+    bh_debug_initialized = BH_TRUE;
+    return BH_SUCCESS;
+}
+
+void bh_debug_shutdown(void) {
+    if (!bh_debug_initialized) {
+        return;
+    }
+    bh_debug_flush();
+    if (debug_text) {
+        bh_free(debug_text);
+        debug_text = NULL;
+    }
+    bh_debug_initialized = BH_FALSE;
+}
+
+void bh_debug_set_level(bh_debug_level_t level) {
+    bh_debug_config.min_level = level;
+}
+
+bh_debug_level_t bh_debug_get_level(void) {
+    return bh_debug_config.min_level;
+}
+
+void bh_debug_set_category_mask(bh_debug_category_t mask) {
+    bh_debug_config.category_mask = mask;
+}
+
+bh_debug_category_t bh_debug_get_category_mask(void) {
+    return bh_debug_config.category_mask;
+}
+
+void bh_debug_set_flags(bh_debug_flags_t flags) {
+    bh_debug_config.flags = flags;
+}
+
+bh_debug_flags_t bh_debug_get_flags(void) {
+    return bh_debug_config.flags;
+}
+
+void bh_debug_print(
+    bh_debug_level_t level,
+    bh_debug_category_t category,
+    const char* file,
+    bh_uint32_t line,
+    const char* function,
+    const char* format,
+    ...
+) {
+    va_list args;
+    va_start(args, format);
+    bh_debug_vprint(level, category, file, line, function, format, args);
+    va_end(args);
+}
+
+// Each call reserves a ring slot with one atomic add and stores the raw
+// arguments; in binary mode nothing is formatted until the ring is read
+void bh_debug_vprint(
+    bh_debug_level_t level,
+    bh_debug_category_t category,
+    const char* file,
+    bh_uint32_t line,
+    const char* function,
+    const char* format,
+    __builtin_va_list args
+) {
+    debug_record_t local;
+    debug_record_t* r = &local;
+    bh_debug_flags_t flags = bh_debug_config.flags;
+    bh_bool_t record = (flags & (BH_DEBUG_FLAG_MEMORY | BH_DEBUG_FLAG_BINARY)) != 0;
+    bh_bool_t print = !(flags & BH_DEBUG_FLAG_BINARY) || level == BH_DEBUG_LEVEL_ERROR;
+    bh_uint32_t seq = 0;
+    va_list ap;
+
+    if (!format || level == BH_DEBUG_LEVEL_NONE || level > bh_debug_config.min_level ||
+        !(category & bh_debug_config.category_mask)) {
+        return;
+    }
+
+    if (record) {
+        seq = __atomic_fetch_add(&debug_head, 1, __ATOMIC_RELAXED);
+        r = &debug_ring[seq & (debug_ring_size - 1)];
+        __atomic_store_n(&r->commit, 0, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+
+    r->level = (bh_uint8_t)level;
+    r->flags = print ? DEBUG_RECORD_PRINTED : 0;
+    r->category = (bh_uint32_t)category;
+    r->line = line;
+    r->timestamp = bh_get_performance_counter();
+    r->format = format;
+    r->file = file;
+    r->function = function;
+
+    va_copy(ap, args);
+    debug_capture(r, format, &ap);
+    va_end(ap);
+
+    if (record) {
+        __atomic_store_n(&r->commit, seq + 1, __ATOMIC_RELEASE);
+    }
+    if (print) {
+        debug_emit(r, BH_FALSE);
+    }
+    if (level == BH_DEBUG_LEVEL_ERROR && bh_debug_config.break_on_error) {
+        bh_debug_break();
+    }
+}
+
+// Consecutive records for one message: a single atomic add reserves them
+// all, so other writers cannot land in between
+void bh_debug_write(bh_debug_level_t level, bh_debug_category_t category, const char* text, bh_size_t length) {
+    const bh_size_t chunk = sizeof(((debug_record_t*)0)->text);
+    debug_record_t local;
+    debug_record_t* r = &local;
+    bh_debug_flags_t flags = bh_debug_config.flags;
+    bh_bool_t record = (flags & (BH_DEBUG_FLAG_MEMORY | BH_DEBUG_FLAG_BINARY)) != 0;
+    bh_bool_t print = !(flags & BH_DEBUG_FLAG_BINARY) || level == BH_DEBUG_LEVEL_ERROR;
+    bh_uint64_t timestamp = bh_get_performance_counter();
+    bh_uint32_t count, seq = 0;
+
+    if (!text || level == BH_DEBUG_LEVEL_NONE || level > bh_debug_config.min_level ||
+        !(category & bh_debug_config.category_mask)) {
+        return;
+    }
+    // Longer messages are cut; an empty one still makes a line
+    if (length > chunk * DEBUG_TEXT_MAX_RECORDS) {
+        length = chunk * DEBUG_TEXT_MAX_RECORDS;
+    }
+    count = length ? (bh_uint32_t)((length + chunk - 1) / chunk) : 1;
+    // A ring smaller than the message keeps its end
+    if (record && count > debug_ring_size) {
+        text += length - (bh_size_t)debug_ring_size * chunk;
+        length = (bh_size_t)debug_ring_size * chunk;
+        count = debug_ring_size;
+    }
+
+    if (record) {
+        seq = __atomic_fetch_add(&debug_head, count, __ATOMIC_RELAXED);
+    }
+    for (bh_uint32_t i = 0; i < count; i++) {
+        bh_size_t take = length > chunk ? chunk : length;
+
+        if (record) {
+            r = &debug_ring[(seq + i) & (debug_ring_size - 1)];
+            __atomic_store_n(&r->commit, 0, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+        }
+        r->level = (bh_uint8_t)level;
+        r->nargs = (bh_uint8_t)take;
+        r->flags = DEBUG_RECORD_TEXT | (print ? DEBUG_RECORD_PRINTED : 0) | (i + 1 < count ? DEBUG_RECORD_MORE : 0);
+        r->string_used = 0;
+        r->category = (bh_uint32_t)category;
+        r->line = 0;
+        r->timestamp = timestamp;
+        r->format = NULL;
+        r->file = NULL;
+        r->function = NULL;
+        for (bh_size_t k = 0; k < take; k++) {
+            r->text[k] = text[k];
+        }
+        text += take;
+        length -= take;
+
+        if (record) {
+            __atomic_store_n(&r->commit, seq + i + 1, __ATOMIC_RELEASE);
+        }
+        if (print) {
+            debug_emit(r, i > 0);
+        }
+    }
+    if (level == BH_DEBUG_LEVEL_ERROR && bh_debug_config.break_on_error) {
+        bh_debug_break();
+    }
+}
+
+void bh_debug_flush(void) {
+    debug_record_t r;
+    bh_uint32_t head = __atomic_load_n(&debug_head, __ATOMIC_ACQUIRE);
+    bh_uint32_t seq;
+    bh_bool_t continued = BH_FALSE;
+
+    for (seq = debug_first(head, debug_flushed); seq != head; seq++) {
+        if (!debug_read(seq, &r)) {
+            continued = BH_FALSE;
+            continue;
+        }
+        if (!(r.flags & DEBUG_RECORD_PRINTED)) {
+            debug_emit(&r, continued);
+        }
+        continued = (r.flags & DEBUG_RECORD_MORE) != 0;
+    }
+    debug_flushed = head;
+}
+
+void bh_debug_hexdump(const void* data, bh_size_t size, bh_uintptr_t address) {
+    static const char hex[] = "0123456789abcdef";
+    const bh_uint8_t* bytes = (const bh_uint8_t*)data;
+    char line[96];
+    bh_size_t offset, i;
+
+    if (!data) {
+        return;
+    }
+
+    for (offset = 0; offset < size; offset += 16) {
+        debug_writer_t w = { line, sizeof(line), 0 };
+
+        for (i = sizeof(bh_uintptr_t) * 2; i > 0; i--) {
+            debug_put_char(&w, hex[((address + offset) >> ((i - 1) * 4)) & 0xF]);
+        }
+        debug_put_string(&w, "  ");
+        for (i = 0; i < 16; i++) {
+            if (offset + i < size) {
+                debug_put_char(&w, hex[bytes[offset + i] >> 4]);
+                debug_put_char(&w, hex[bytes[offset + i] & 0xF]);
+                debug_put_char(&w, ' ');
+            } else {
+                debug_put_string(&w, "   ");
+            }
+        }
+        debug_put_char(&w, ' ');
+        for (i = 0; i < 16 && offset + i < size; i++) {
+            bh_uint8_t c = bytes[offset + i];
+            debug_put_char(&w, (c >= 0x20 && c < 0x7F) ? (char)c : '.');
+        }
+        debug_put_string(&w, "\r\n");
+        debug_finish(&w);
+        bh_puts(line);
+    }
+}
+
+void bh_debug_assert(
+    bh_bool_t condition,
+    const char* file,
+    bh_uint32_t line,
+    const char* function,
+    const char* message
+) {
+    if (condition) {
+        return;
+    }
+    bh_debug_print(BH_DEBUG_LEVEL_ERROR, BH_DEBUG_CAT_GENERAL, file, line, function,
+                   "Assertion failed: %s", message);
+    if (bh_debug_config.break_on_assert) {
+        bh_debug_break();
+    }
+}
+
+bh_status_t bh_debug_format_log(char* buffer, bh_size_t buffer_size, bh_size_t* written) {
+    debug_writer_t w = { buffer, buffer_size, 0 };
+    debug_record_t r;
+    bh_uint32_t head = __atomic_load_n(&debug_head, __ATOMIC_ACQUIRE);
+    bh_uint32_t seq;
+
+    bh_bool_t continued = BH_FALSE;
+
+    for (seq = debug_first(head, debug_cleared); seq != head; seq++) {
+        if (!debug_read(seq, &r)) {
+            continued = BH_FALSE;
+            continue;
+        }
+        debug_format_record(&w, &r, continued);
+        continued = (r.flags & DEBUG_RECORD_MORE) != 0;
+    }
+    debug_finish(&w);
+
+    if (written) {
+        *written = w.length;
+    }
+    if (!buffer || w.length >= buffer_size) {
+        return BH_BUFFER_TOO_SMALL;
+    }
+    return BH_SUCCESS;
+}
+
+bh_status_t bh_debug_get_memory_buffer(const char** buffer, bh_size_t* size) {
+    bh_size_t length = 0;
+
+    if (!buffer || !size) {
+        return BH_INVALID_ARGUMENT;
+    }
+    if (debug_text) {
+        bh_free(debug_text);
+        debug_text = NULL;
+    }
+
+    bh_debug_format_log(NULL, 0, &length);
+    debug_text = bh_malloc(length + 1);
+    if (!debug_text) {
+        return BH_OUT_OF_MEMORY;
+    }
+    // Records logged since sizing the text are left for the next call
+    bh_debug_format_log(debug_text, length + 1, NULL);
+
+    *buffer = debug_text;
+    *size = length;
+    return BH_SUCCESS;
+}
+
+void bh_debug_clear_memory_buffer(void) {
+    debug_cleared = debug_flushed = __atomic_load_n(&debug_head, __ATOMIC_ACQUIRE);
+    if (debug_text) {
+        bh_free(debug_text);
+        debug_text = NULL;
+    }
+}
+
+bh_status_t bh_debug_save_log(const char* filename) {
+    const char* text;
+    bh_size_t size;
+    bh_status_t status;
+
+    if (!filename) {
+        filename = bh_debug_config.output_file;
+    }
+    if (!filename) {
+        return BH_INVALID_ARGUMENT;
+    }
+    if (!bh_system_table || !bh_system_table->write_file) {
+        return BH_NOT_SUPPORTED;
+    }
+
+    status = bh_debug_get_memory_buffer(&text, &size);
+    if (status != BH_SUCCESS) {
+        return status;
+    }
+    return bh_system_table->write_file(filename, text, size);
+}
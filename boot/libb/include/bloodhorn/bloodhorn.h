@@ -154,6 +154,29 @@ typedef struct {
     // Debugging
     void (*debug_break)(void);
     
+    // High-resolution timing (optional; used by bh_get_performance_counter)
+    bh_uint64_t (*get_performance_counter)(void);
+    bh_uint64_t (*get_performance_frequency)(void);
+    
+    // Whole 4 KiB pages for the libb heap (optional; the heap falls back
+    // to alloc). free_pages may be left unset where pages are never returned.
+    void* (*alloc_pages)(bh_size_t pages);
+    void (*free_pages)(void* base, bh_size_t pages);
+    
+    // Replace a file on the boot device (optional; used by bh_debug_save_log)
+    bh_status_t (*write_file)(const char* path, const void* data, bh_size_t size);
+    
+    // Application processors for the task pool (optional; all three or
+    // none). start_aps runs worker on every idle AP without waiting and
+    // returns how many it started; aps_idle reports when all have returned.
+    bh_uint32_t (*get_ap_count)(void);
+    bh_uint32_t (*start_aps)(void (*worker)(void* context), void* context);
+    bh_bool_t (*aps_idle)(void);
+    
+    // Bytes of pool and pages the loader holds (optional; returns false
+    // while nothing is counting them). Gives the boot trace its memory column.
+    bh_bool_t (*get_memory_in_use)(bh_uint64_t* bytes);
+    
 } bh_system_table_t;
 
 // Global system table (set by the bootloader)
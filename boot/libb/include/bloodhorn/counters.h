@@ -0,0 +1,88 @@
+/*
+ * counters.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_COUNTERS_H
+#define BLOODHORN_COUNTERS_H
+
+#include <bloodhorn/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Hot-path counters, bumped inline by the code they describe and read
+// once when the loader reports them. Nothing here allocates or logs, so a
+// counter may be added from a read loop or a timer notification. Times
+// are in performance-counter ticks (bh_get_performance_counter).
+
+// Where loaded bytes came from
+typedef enum {
+    BH_COUNTER_SOURCE_FIRMWARE = 0,     // Firmware file protocol on the boot volume
+    BH_COUNTER_SOURCE_FAT,              // Loader's own drivers on a mounted volume
+    BH_COUNTER_SOURCE_EXT2,
+    BH_COUNTER_SOURCE_ISO9660,
+    BH_COUNTER_SOURCE_SQUASHFS,
+    BH_COUNTER_SOURCE_HTTP,
+    BH_COUNTER_SOURCE_TFTP,
+    BH_COUNTER_SOURCE_OTHER,
+    BH_COUNTER_SOURCE_COUNT
+} bh_counter_source_t;
+
+typedef struct {
+    bh_uint64_t bytes_read[BH_COUNTER_SOURCE_COUNT];
+    bh_uint64_t tftp_retransmits;       // RRQs and ACKs sent again after a timeout
+    bh_uint64_t hash_bytes;             // Image bytes through a digest
+    bh_uint64_t hash_ticks;             // Time spent hashing them
+    bh_uint64_t tpm_commands;           // Commands completed by the TPM
+    bh_uint64_t tpm_ticks;              // Submit to response, summed
+    bh_uint64_t tpm_max_ticks;          // Slowest single command
+} bh_counters_t;
+
+// Updated in place by the instrumented paths
+extern bh_counters_t bh_counters;
+
+/**
+ * @brief Zero every counter
+ */
+void bh_counters_reset(void);
+
+/**
+ * @brief Count bytes that landed in memory from a source
+ *
+ * @param source Where they came from
+ * @param bytes Byte count
+ */
+void bh_counters_add_read(bh_counter_source_t source, bh_uint64_t bytes);
+
+/**
+ * @brief Map a mounted filesystem's driver name ("fat32", "ext2", ...) to its source
+ *
+ * @param fs_name Driver name, may be NULL
+ * @return bh_counter_source_t BH_COUNTER_SOURCE_OTHER if the name is unknown
+ */
+bh_counter_source_t bh_counters_source_for_fs(const char* fs_name);
+
+/**
+ * @brief Count one digest update
+ *
+ * @param bytes Bytes hashed
+ * @param ticks Time the update took
+ */
+void bh_counters_add_hash(bh_uint64_t bytes, bh_uint64_t ticks);
+
+/**
+ * @brief Count one completed TPM command
+ *
+ * @param ticks Time from submit to response
+ */
+void bh_counters_add_tpm(bh_uint64_t ticks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BLOODHORN_COUNTERS_H
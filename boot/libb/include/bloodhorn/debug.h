@@ -42,6 +42,7 @@ typedef enum {
     BH_DEBUG_FLAG_CONSOLE       = 0x0400,    // Output to console
     BH_DEBUG_FLAG_FILE_OUTPUT   = 0x0800,    // Output to file
     BH_DEBUG_FLAG_MEMORY        = 0x1000,    // Keep in memory buffer
+    BH_DEBUG_FLAG_BINARY        = 0x2000,    // Record only; format on dump (errors still print)
     BH_DEBUG_FLAG_DEFAULT       = (BH_DEBUG_FLAG_TIMESTAMP | 
                                    BH_DEBUG_FLAG_LEVEL | 
                                    BH_DEBUG_FLAG_CONSOLE)
@@ -68,6 +69,13 @@ typedef enum {
     BH_DEBUG_CAT_ALL            = 0xFFFFFFFF
 } bh_debug_category_t;
 
+// Binary log ring. Each message is kept as its format string pointer, a
+// timestamp and the raw arguments; text is produced only when the ring is
+// dumped. %s arguments are copied into the record and cut to fit.
+#define BH_DEBUG_RING_RECORDS       512     // Default capacity (power of two)
+#define BH_DEBUG_RECORD_MAX_ARGS    6       // Conversions past this print as "?"
+#define BH_DEBUG_RECORD_STRING_SIZE 32      // Bytes for copied %s arguments
+
 // Debug output destinations
 typedef enum {
     BH_DEBUG_OUTPUT_NONE = 0,
@@ -228,6 +236,25 @@ void bh_debug_vprint(
     __builtin_va_list args
 );
 
+/**
+ * @brief Log text that is already formatted, such as from Rust code
+ *
+ * The message goes into the same ring as bh_debug_print, under the same
+ * level and category filters, spread over consecutive records when it is
+ * long. It need not be NUL-terminated and takes no line ending.
+ *
+ * @param level Debug level
+ * @param category Debug category
+ * @param text Message text
+ * @param length Bytes of text
+ */
+void bh_debug_write(bh_debug_level_t level, bh_debug_category_t category, const char* text, bh_size_t length);
+
+/**
+ * @brief Write out records that binary mode has not printed yet
+ */
+void bh_debug_flush(void);
+
 /**
  * @brief Print memory dump
  * 
@@ -291,6 +318,9 @@ void bh_debug_assert(
 
 /**
  * @brief Get debug memory buffer
+ *
+ * The ring is formatted into a buffer owned by the debug subsystem, which
+ * stays valid until the next call or bh_debug_clear_memory_buffer.
  * 
  * @param buffer [out] Pointer to buffer data
  * @param size [out] Buffer size
@@ -303,6 +333,16 @@ bh_status_t bh_debug_get_memory_buffer(const char** buffer, bh_size_t* size);
  */
 void bh_debug_clear_memory_buffer(void);
 
+/**
+ * @brief Format the memory ring as text, oldest record first
+ *
+ * @param buffer Output buffer (may be NULL to size the text)
+ * @param buffer_size Size of buffer in bytes
+ * @param written [out] Length of the full text, without the terminator
+ * @return bh_status_t BH_BUFFER_TOO_SMALL if the text was cut short
+ */
+bh_status_t bh_debug_format_log(char* buffer, bh_size_t buffer_size, bh_size_t* written);
+
 /**
  * @brief Save debug log to file
  * 
@@ -0,0 +1,86 @@
+/*
+ * hash.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_HASH_H
+#define BLOODHORN_HASH_H
+
+#include <bloodhorn/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 32-bit FNV-1a, the hash behind the loader's open-addressing tables
+// (config keys, environment overrides, boot entries, locale strings,
+// path components, shell commands). Header-only so the shell, the host
+// benchmark and the fuzz targets get it without another source file.
+// Callers that fold case or separators, or hash wider code units, run
+// bh_fnv1a_step over their own loop.
+
+#define BH_FNV1A_INIT   2166136261u
+#define BH_FNV1A_PRIME  16777619u
+
+/**
+ * @brief Fold one code unit into a running hash
+ *
+ * @param hash BH_FNV1A_INIT or the previous step's result
+ * @param unit Byte, CHAR16 or code point
+ * @return bh_uint32_t Updated hash
+ */
+static inline bh_uint32_t bh_fnv1a_step(bh_uint32_t hash, bh_uint32_t unit) {
+    return (hash ^ unit) * BH_FNV1A_PRIME;
+}
+
+/**
+ * @brief Hash a byte range
+ *
+ * @param data Bytes, may be NULL when len is 0
+ * @param len Byte count
+ * @return bh_uint32_t FNV-1a of the bytes
+ */
+static inline bh_uint32_t bh_fnv1a(const void* data, bh_size_t len) {
+    const bh_uint8_t* bytes = (const bh_uint8_t*)data;
+    bh_uint32_t hash = BH_FNV1A_INIT;
+    for (bh_size_t i = 0; i < len; i++) {
+        hash = bh_fnv1a_step(hash, bytes[i]);
+    }
+    return hash;
+}
+
+/**
+ * @brief Hash a NUL-terminated byte string
+ *
+ * @param str String, without its terminator
+ * @return bh_uint32_t FNV-1a of the string
+ */
+static inline bh_uint32_t bh_fnv1a_str(const char* str) {
+    bh_uint32_t hash = BH_FNV1A_INIT;
+    while (*str) {
+        hash = bh_fnv1a_step(hash, (bh_uint8_t)*str++);
+    }
+    return hash;
+}
+
+/**
+ * @brief Hash a NUL-terminated UCS-2 string (CHAR16), one step per unit
+ *
+ * @param str String, without its terminator
+ * @return bh_uint32_t FNV-1a of the code units
+ */
+static inline bh_uint32_t bh_fnv1a_str16(const bh_uint16_t* str) {
+    bh_uint32_t hash = BH_FNV1A_INIT;
+    while (*str) {
+        hash = bh_fnv1a_step(hash, *str++);
+    }
+    return hash;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BLOODHORN_HASH_H
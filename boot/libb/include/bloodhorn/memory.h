@@ -93,11 +93,41 @@ typedef struct {
     uint32_t descriptor_version;         ///< Descriptor version
 } bh_memory_map_t;
 
+/**
+ * @brief Allocate from the libb heap
+ * 
+ * Requests up to 1 KiB come from per-size-class slabs; larger ones get
+ * whole pages. Blocks are 16-byte aligned.
+ * 
+ * @param size Size of memory to allocate in bytes
+ * @return void* Pointer to allocated memory, or NULL on failure
+ */
+void* bh_malloc(bh_size_t size);
+
+/**
+ * @brief Return a block from bh_malloc, bh_realloc or bh_memory_allocate
+ * 
+ * @param ptr Pointer to memory to free (NULL is ignored)
+ */
+void bh_free(void* ptr);
+
+/**
+ * @brief Resize a heap block, moving it when it no longer fits
+ * 
+ * @param ptr Block to resize, or NULL to allocate
+ * @param size New size in bytes; 0 frees the block
+ * @return void* The resized block, or NULL on failure (ptr is kept)
+ */
+void* bh_realloc(void* ptr, bh_size_t size);
+
 /**
  * @brief Allocate memory
  * 
+ * Served by the libb heap. BH_MEMORY_ZERO is honored; the caching and
+ * placement flags are not, use bh_memory_allocate_contiguous for those.
+ * 
  * @param size Size of memory to allocate in bytes
- * @param alignment Memory alignment (must be power of 2)
+ * @param alignment Memory alignment (must be power of 2, 0 for the default)
  * @param flags Memory allocation flags
  * @return void* Pointer to allocated memory, or NULL on failure
  */
@@ -111,6 +141,44 @@ void* bh_memory_allocate(bh_size_t size, bh_size_t alignment, bh_memory_flags_t
  */
 void bh_memory_free(void* ptr, bh_size_t size);
 
+/**
+ * @brief Copy memory; the ranges may overlap
+ * 
+ * Dispatched by size: byte loops for small copies, the CPU's string or
+ * vector instructions for medium ones, and non-temporal stores for
+ * copies larger than the last-level cache.
+ * 
+ * @param dest Destination
+ * @param src Source
+ * @param size Bytes to copy
+ * @return bh_status_t Status code
+ */
+bh_status_t bh_memory_copy(void* dest, const void* src, bh_size_t size);
+
+/**
+ * @brief Copy one piece of a larger move
+ * 
+ * Like bh_memory_copy, but the choice of kernel is made on the size of the
+ * whole move, so a large copy split between processors still streams.
+ * 
+ * @param dest Destination of the piece
+ * @param src Source of the piece
+ * @param size Bytes in the piece
+ * @param total Bytes in the whole move
+ * @return bh_status_t Status code
+ */
+bh_status_t bh_memory_copy_part(void* dest, const void* src, bh_size_t size, bh_size_t total);
+
+/**
+ * @brief Fill memory with a byte value, dispatched like bh_memory_copy
+ * 
+ * @param dest Destination
+ * @param value Byte value (converted to unsigned char)
+ * @param size Bytes to fill
+ * @return bh_status_t Status code
+ */
+bh_status_t bh_memory_set(void* dest, int value, bh_size_t size);
+
 /**
  * @brief Get the memory map
  * 
@@ -159,6 +227,10 @@ bh_status_t bh_memory_unlock(void* addr, bh_size_t size);
 /**
  * @brief Flush memory region from cache
  * 
+ * Cleans and invalidates the data cache lines covering the range to the
+ * point of coherency, so a kernel entered with its caches off sees what
+ * was written. Only the range is walked (cache.c).
+ * 
  * @param addr Starting address
  * @param size Size of memory region
  * @return bh_status_t Status code
@@ -168,12 +240,37 @@ bh_status_t bh_memory_flush(void* addr, bh_size_t size);
 /**
  * @brief Invalidate memory region in cache
  * 
+ * For memory a device wrote behind the cache. Lines only partly inside
+ * the range are cleaned first, so neighbouring data survives.
+ * 
  * @param addr Starting address
  * @param size Size of memory region
  * @return bh_status_t Status code
  */
 bh_status_t bh_memory_invalidate(void* addr, bh_size_t size);
 
+/**
+ * @brief Make code written as data executable
+ * 
+ * Cleans the data cache to the point of unification and invalidates the
+ * instruction cache over the range; for executable segments only.
+ * 
+ * @param addr Starting address
+ * @param size Size of memory region
+ * @return bh_status_t Status code
+ */
+bh_status_t bh_memory_sync_code(void* addr, bh_size_t size);
+
+/**
+ * @brief Set the cache line size used to step through ranges
+ * 
+ * For architectures that cannot read it from the CPU (PowerPC, RISC-V
+ * with Zicbom); AArch64 uses CTR_EL0 and ignores this.
+ * 
+ * @param line Line size in bytes, a power of two
+ */
+void bh_memory_set_cache_line(bh_size_t line);
+
 /**
  * @brief Allocate physically contiguous memory
  * 
@@ -242,12 +339,12 @@ void* bh_memory_map_physical(
 bh_status_t bh_memory_unmap(void* addr, bh_size_t size);
 
 /**
- * @brief Get memory statistics
+ * @brief Get libb heap statistics
  * 
- * @param total [out] Total physical memory in bytes
- * @param free [out] Free physical memory in bytes
- * @param used [out] Used physical memory in bytes
- * @param reserved [out] Reserved physical memory in bytes
+ * @param total [out] Bytes of pages the heap holds
+ * @param free [out] Bytes on the slab freelists
+ * @param used [out] Bytes in live blocks
+ * @param reserved [out] Page bytes lost to headers and rounding
  * @return bh_status_t Status code
  */
 bh_status_t bh_memory_get_stats(
@@ -257,6 +354,65 @@ bh_status_t bh_memory_get_stats(
     bh_size_t* reserved
 );
 
+/**
+ * @brief Highest bytes in live libb heap blocks since boot
+ * 
+ * @return bh_size_t Peak of the used count from bh_memory_get_stats
+ */
+bh_size_t bh_memory_get_peak(void);
+
+/**
+ * @brief Scoped allocation arena
+ * 
+ * Bump allocation for one boot phase: objects are never freed one by one,
+ * the whole arena is rewound to a mark or destroyed when the phase ends.
+ * Destroy phase arenas before ExitBootServices.
+ */
+typedef struct bh_arena bh_arena_t;
+
+/**
+ * @brief Arena position to rewind to
+ */
+typedef struct {
+    void* chunk;                ///< Current chunk when taken
+    void* large;                ///< Newest dedicated block when taken
+    bh_size_t used;             ///< Fill of the current chunk
+} bh_arena_mark_t;
+
+/**
+ * @brief Create an arena
+ * 
+ * @param chunk_size Bytes per chunk taken from the heap, or 0 for 16 KiB
+ * @return bh_arena_t* The arena, or NULL on failure
+ */
+bh_arena_t* bh_arena_create(bh_size_t chunk_size);
+
+/**
+ * @brief Allocate from an arena
+ * 
+ * @param arena Arena to allocate from
+ * @param size Bytes wanted; the block is 16-byte aligned
+ * @return void* Pointer to uninitialized memory, or NULL on failure
+ */
+void* bh_arena_alloc(bh_arena_t* arena, bh_size_t size);
+
+/**
+ * @brief Record the arena's current position
+ */
+bh_arena_mark_t bh_arena_mark(const bh_arena_t* arena);
+
+/**
+ * @brief Release everything allocated since a mark
+ * 
+ * Marks taken after this one become invalid.
+ */
+void bh_arena_rewind(bh_arena_t* arena, bh_arena_mark_t mark);
+
+/**
+ * @brief Release an arena and all of its allocations
+ */
+void bh_arena_destroy(bh_arena_t* arena);
+
 /**
  * @brief Check if memory is readable
  * 
@@ -0,0 +1,93 @@
+/*
+ * parallel.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_PARALLEL_H
+#define BLOODHORN_PARALLEL_H
+
+#include <bloodhorn/types.h>
+#include <bloodhorn/status.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Task pool on the application processors. Tasks may run on an AP, so
+// they only compute: no firmware calls, no system table, no libb heap, no
+// logging, and no parallel work of their own. Without APs (single core,
+// coreboot, no start_aps hook) everything runs on the caller.
+
+// Most processors a bh_parallel_for is spread over, the caller included
+#define BH_PARALLEL_MAX_WORKERS 16
+
+// Pending tasks the pool holds; a start beyond that runs on the caller
+#define BH_PARALLEL_QUEUE_SIZE  64
+
+typedef void (*bh_task_fn_t)(void* arg);
+
+// One chunk [begin, end) of a bh_parallel_for range
+typedef void (*bh_parallel_body_t)(bh_size_t begin, bh_size_t end, void* arg);
+
+// A task in flight; owned by the caller until bh_future_wait returns
+typedef struct {
+    bh_task_fn_t fn;
+    void* arg;
+    volatile bh_uint32_t state;     // BH_FUTURE_*
+} bh_future_t;
+
+#define BH_FUTURE_IDLE      0
+#define BH_FUTURE_QUEUED    1
+#define BH_FUTURE_RUNNING   2
+#define BH_FUTURE_DONE      3
+
+/**
+ * @brief Processors parallel work is spread over, the caller included
+ *
+ * @return bh_uint32_t 1 when there are no usable APs
+ */
+bh_uint32_t bh_parallel_workers(void);
+
+/**
+ * @brief Run body over [0, count) in chunks of grain, on every processor
+ *
+ * Chunks are claimed one at a time, so uneven chunks balance out. The
+ * caller works too and returns once every chunk is done.
+ *
+ * @param count Number of items
+ * @param grain Items per chunk (0 is taken as 1)
+ * @param body Called once per chunk
+ * @param arg Passed to body
+ */
+void bh_parallel_for(bh_size_t count, bh_size_t grain, bh_parallel_body_t body, void* arg);
+
+/**
+ * @brief Queue fn(arg) for an AP and return at once
+ *
+ * Without APs, or with the queue full, the task runs on the spot. A
+ * queued task no AP has taken yet runs when it is waited for.
+ *
+ * @param future Caller-owned; must stay valid until bh_future_wait
+ * @param fn Task to run
+ * @param arg Passed to fn
+ * @return bh_status_t BH_SUCCESS, or BH_INVALID_ARGUMENT
+ */
+bh_status_t bh_future_start(bh_future_t* future, bh_task_fn_t fn, void* arg);
+
+/**
+ * @brief Whether a started task has finished
+ */
+bh_bool_t bh_future_ready(const bh_future_t* future);
+
+/**
+ * @brief Wait for a started task, running queued ones meanwhile
+ */
+void bh_future_wait(bh_future_t* future);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BLOODHORN_PARALLEL_H
@@ -144,6 +144,25 @@ bh_status_t bh_clock_getres(bh_clock_type_t clock_type, bh_uint64_t* resolution)
  */
 bh_uint64_t bh_get_timestamp(void);
 
+/**
+ * @brief Calibrate the CPU counter and use it for the performance counter
+ *
+ * The invariant TSC (x86), CNTVCT_EL0 (AArch64), the time CSR (RISC-V),
+ * the stable counter (LoongArch) or the timebase (PowerPC) is timed
+ * against the system table's performance counter once. Without one, the
+ * rate the CPU reports is taken. bh_initialize calls this.
+ *
+ * @return bh_status_t BH_NOT_SUPPORTED if the firmware timer stays in use
+ */
+bh_status_t bh_clock_calibrate(void);
+
+/**
+ * @brief Use the CPU counter at a rate known from elsewhere
+ *
+ * @param frequency Counter rate in Hz, e.g. a device tree timebase-frequency
+ */
+void bh_clock_set_frequency(bh_uint64_t frequency);
+
 /**
  * @brief Get performance counter frequency
  * 
@@ -0,0 +1,137 @@
+/*
+ * trace.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_TRACE_H
+#define BLOODHORN_TRACE_H
+
+#include <bloodhorn/types.h>
+#include <bloodhorn/status.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Capacity of the trace ring; the oldest events are overwritten when full
+#define BH_TRACE_MAX_EVENTS     512
+
+// Maximum nesting depth tracked for open spans
+#define BH_TRACE_MAX_DEPTH      16
+
+// Well-known boot phase names, so every subsystem reports the same label
+#define BH_TRACE_PHASE_CONFIG       "config"
+#define BH_TRACE_PHASE_MENU         "menu"
+#define BH_TRACE_PHASE_MENU_PAINT   "menu_paint"
+#define BH_TRACE_PHASE_FS_PROBE     "fs_probe"
+#define BH_TRACE_PHASE_FS_MOUNT     "fs_mount"
+#define BH_TRACE_PHASE_LOAD         "load"
+#define BH_TRACE_PHASE_HASH         "hash"
+#define BH_TRACE_PHASE_VERIFY       "verify"
+#define BH_TRACE_PHASE_TPM_MEASURE  "tpm_measure"
+#define BH_TRACE_PHASE_NET_FETCH    "net_fetch"
+#define BH_TRACE_PHASE_HANDOFF      "handoff"
+#define BH_TRACE_PHASE_EXIT_BS      "exit_boot_services"
+
+// Event kinds (mirrors the Chrome trace "ph" field)
+typedef enum {
+    BH_TRACE_EVENT_SPAN = 0,    // Complete span with a duration ('X')
+    BH_TRACE_EVENT_INSTANT      // Point-in-time marker ('i')
+} bh_trace_event_type_t;
+
+// One recorded event. Names must be string literals or otherwise outlive
+// the trace buffer.
+typedef struct {
+    const char* name;
+    bh_uint64_t start_ticks;
+    bh_uint64_t duration_ticks;
+    bh_uint16_t depth;
+    bh_uint16_t type;
+    bh_int64_t memory_bytes;    // Held at the span's end less at its start
+} bh_trace_event_t;
+
+// Handle returned by bh_trace_begin and consumed by bh_trace_end
+typedef bh_int32_t bh_trace_span_t;
+
+#define BH_TRACE_INVALID_SPAN   (-1)
+
+// memory_bytes of instants, and of spans while the system table's
+// get_memory_in_use had nothing to report
+#define BH_TRACE_NO_MEMORY      (-(bh_int64_t)0x7FFFFFFFFFFFFFFF - 1)
+
+/**
+ * @brief Reset the trace buffer and take the timeline origin
+ */
+void bh_trace_reset(void);
+
+/**
+ * @brief Enable or disable recording (enabled by default)
+ *
+ * @param enabled Whether new events are recorded
+ */
+void bh_trace_set_enabled(bh_bool_t enabled);
+
+/**
+ * @brief Open a nested span
+ *
+ * @param name Phase name (string literal)
+ * @return bh_trace_span_t Span handle, BH_TRACE_INVALID_SPAN if not recorded
+ */
+bh_trace_span_t bh_trace_begin(const char* name);
+
+/**
+ * @brief Close a span opened by bh_trace_begin
+ *
+ * @param span Span handle
+ */
+void bh_trace_end(bh_trace_span_t span);
+
+/**
+ * @brief Record an instant marker
+ *
+ * @param name Marker name (string literal)
+ */
+void bh_trace_mark(const char* name);
+
+/**
+ * @brief Get the recorded events in chronological order
+ *
+ * @param events [out] Destination array
+ * @param max_events Capacity of events
+ * @return bh_size_t Number of events copied
+ */
+bh_size_t bh_trace_get_events(bh_trace_event_t* events, bh_size_t max_events);
+
+/**
+ * @brief Number of events currently held in the ring
+ *
+ * @return bh_size_t Event count
+ */
+bh_size_t bh_trace_get_event_count(void);
+
+/**
+ * @brief Format the timeline as Chrome trace JSON (chrome://tracing, Perfetto)
+ *
+ * @param buffer [out] Destination buffer (may be NULL to query the size)
+ * @param buffer_size Size of buffer in bytes
+ * @param written [out] Bytes needed/written, excluding the terminator
+ * @return bh_status_t BH_SUCCESS, or BH_BUFFER_TOO_SMALL with written set
+ */
+bh_status_t bh_trace_export_chrome_json(char* buffer, bh_size_t buffer_size, bh_size_t* written);
+
+/**
+ * @brief Print the timeline as an indented table through bh_printf
+ */
+void bh_trace_print(void);
+
+#define BH_TRACE_BEGIN(var, name)   bh_trace_span_t var = bh_trace_begin(name)
+#define BH_TRACE_END(var)           bh_trace_end(var)
+#define BH_TRACE_MARK(name)         bh_trace_mark(name)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BLOODHORN_TRACE_H
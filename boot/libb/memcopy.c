@@ -0,0 +1,335 @@
+/*
+ * memcopy.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <bloodhorn/bloodhorn.h>
+#include <bloodhorn/memory.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <cpuid.h>
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__GNUC__)
+#include <arm_neon.h>
+#endif
+
+// Copy and fill kernels behind bh_memory_copy and bh_memory_set, picked
+// by size:
+//
+//   - below MEMCOPY_SMALL bytes, plain byte loops (headers, params, strings);
+//   - up to the last-level cache size, the CPU's string instructions on
+//     x86 (rep movsb/stosb with ERMS, else rep movsq/stosq) and 64-byte
+//     NEON blocks on AArch64;
+//   - past the cache size, non-temporal stores, so moving a kernel or
+//     initrd does not evict everything else on the way through.
+//
+// Copies are overlap-safe. Overlapping moves toward higher addresses run
+// backwards a word at a time; they are rare and never the bulk path.
+
+#define MEMCOPY_SMALL           64
+#define MEMCOPY_DEFAULT_LLC     (8 * 1024 * 1024)
+
+static bh_size_t memcopy_stream_min = 0;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+static bh_bool_t memcopy_erms = BH_FALSE;
+
+// Largest cache from CPUID leaf 4 (Intel), else the L3 size from
+// 0x80000006 (AMD)
+static bh_size_t memcopy_llc_size(void) {
+    unsigned int eax, ebx, ecx, edx;
+    bh_size_t llc = 0;
+
+    if (__get_cpuid_max(0, NULL) >= 4) {
+        for (unsigned int i = 0; i < 16; i++) {
+            __cpuid_count(4, i, eax, ebx, ecx, edx);
+            if ((eax & 0x1F) == 0) {
+                break;
+            }
+            bh_size_t size = (bh_size_t)((ebx >> 22) + 1) * (((ebx >> 12) & 0x3FF) + 1) *
+                             ((ebx & 0xFFF) + 1) * ((bh_size_t)ecx + 1);
+            if (size > llc) {
+                llc = size;
+            }
+        }
+    }
+    if (llc == 0 && __get_cpuid_max(0x80000000, NULL) >= 0x80000006) {
+        __cpuid(0x80000006, eax, ebx, ecx, edx);
+        llc = (bh_size_t)(edx >> 18) * 512 * 1024;
+    }
+    return llc;
+}
+
+static void memcopy_init(void) {
+    unsigned int eax, ebx, ecx, edx;
+
+    if (__get_cpuid_max(0, NULL) >= 7) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        memcopy_erms = (ebx & (1u << 9)) != 0;
+    }
+    bh_size_t llc = memcopy_llc_size();
+    memcopy_stream_min = llc ? llc : MEMCOPY_DEFAULT_LLC;
+}
+
+static void memcopy_forward(bh_uint8_t* d, const bh_uint8_t* s, bh_size_t n) {
+    if (memcopy_erms) {
+        __asm__ volatile ("rep movsb" : "+D" (d), "+S" (s), "+c" (n) :: "memory");
+        return;
+    }
+    bh_size_t words = n / 8;
+    __asm__ volatile ("rep movsq" : "+D" (d), "+S" (s), "+c" (words) :: "memory");
+    n &= 7;
+    __asm__ volatile ("rep movsb" : "+D" (d), "+S" (s), "+c" (n) :: "memory");
+}
+
+// Destination aligned to 64 first; loads stay unaligned
+static void memcopy_stream(bh_uint8_t* d, const bh_uint8_t* s, bh_size_t n) {
+    bh_size_t head = (64 - ((bh_uintptr_t)d & 63)) & 63;
+    memcopy_forward(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+
+    for (; n >= 64; n -= 64, d += 64, s += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i*)s);
+        __m128i b = _mm_loadu_si128((const __m128i*)(s + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(s + 32));
+        __m128i e = _mm_loadu_si128((const __m128i*)(s + 48));
+        _mm_stream_si128((__m128i*)d, a);
+        _mm_stream_si128((__m128i*)(d + 16), b);
+        _mm_stream_si128((__m128i*)(d + 32), c);
+        _mm_stream_si128((__m128i*)(d + 48), e);
+    }
+    _mm_sfence();
+    memcopy_forward(d, s, n);
+}
+
+static void memfill_forward(bh_uint8_t* d, bh_uint8_t value, bh_size_t n) {
+    if (memcopy_erms) {
+        __asm__ volatile ("rep stosb" : "+D" (d), "+c" (n) : "a" (value) : "memory");
+        return;
+    }
+    bh_uint64_t pattern = value * 0x0101010101010101ull;
+    bh_size_t words = n / 8;
+    __asm__ volatile ("rep stosq" : "+D" (d), "+c" (words) : "a" (pattern) : "memory");
+    n &= 7;
+    __asm__ volatile ("rep stosb" : "+D" (d), "+c" (n) : "a" (value) : "memory");
+}
+
+static void memfill_stream(bh_uint8_t* d, bh_uint8_t value, bh_size_t n) {
+    bh_size_t head = (64 - ((bh_uintptr_t)d & 63)) & 63;
+    memfill_forward(d, value, head);
+    d += head;
+    n -= head;
+
+    __m128i v = _mm_set1_epi8((char)value);
+    for (; n >= 64; n -= 64, d += 64) {
+        _mm_stream_si128((__m128i*)d, v);
+        _mm_stream_si128((__m128i*)(d + 16), v);
+        _mm_stream_si128((__m128i*)(d + 32), v);
+        _mm_stream_si128((__m128i*)(d + 48), v);
+    }
+    _mm_sfence();
+    memfill_forward(d, value, n);
+}
+
+#elif defined(__aarch64__) && defined(__GNUC__)
+// The cache geometry registers are not readable at every exception level
+// firmware may leave us in, so the threshold is fixed. SVE is not enabled
+// by all firmware; NEON is architectural.
+static void memcopy_init(void) {
+    memcopy_stream_min = MEMCOPY_DEFAULT_LLC;
+}
+
+static void memcopy_forward(bh_uint8_t* d, const bh_uint8_t* s, bh_size_t n) {
+    for (; n >= 64; n -= 64, d += 64, s += 64) {
+        uint8x16x4_t v = vld1q_u8_x4(s);
+        vst1q_u8_x4(d, v);
+    }
+    for (; n >= 16; n -= 16, d += 16, s += 16) {
+        vst1q_u8(d, vld1q_u8(s));
+    }
+    while (n--) {
+        *d++ = *s++;
+    }
+}
+
+// STNP is a non-temporal hint for pair stores
+static void memcopy_stream(bh_uint8_t* d, const bh_uint8_t* s, bh_size_t n) {
+    for (; n >= 64; n -= 64, d += 64, s += 64) {
+        __asm__ volatile (
+            "ldp q0, q1, [%1]\n\t"
+            "ldp q2, q3, [%1, #32]\n\t"
+            "stnp q0, q1, [%0]\n\t"
+            "stnp q2, q3, [%0, #32]"
+            :: "r" (d), "r" (s) : "v0", "v1", "v2", "v3", "memory");
+    }
+    __asm__ volatile ("dmb ishst" ::: "memory");
+    memcopy_forward(d, s, n);
+}
+
+static void memfill_forward(bh_uint8_t* d, bh_uint8_t value, bh_size_t n) {
+    uint8x16_t v = vdupq_n_u8(value);
+    for (; n >= 64; n -= 64, d += 64) {
+        vst1q_u8(d, v);
+        vst1q_u8(d + 16, v);
+        vst1q_u8(d + 32, v);
+        vst1q_u8(d + 48, v);
+    }
+    for (; n >= 16; n -= 16, d += 16) {
+        vst1q_u8(d, v);
+    }
+    while (n--) {
+        *d++ = value;
+    }
+}
+
+static void memfill_stream(bh_uint8_t* d, bh_uint8_t value, bh_size_t n) {
+    uint8x16_t v = vdupq_n_u8(value);
+    for (; n >= 64; n -= 64, d += 64) {
+        __asm__ volatile (
+            "stnp %q1, %q1, [%0]\n\t"
+            "stnp %q1, %q1, [%0, #32]"
+            :: "r" (d), "w" (v) : "memory");
+    }
+    __asm__ volatile ("dmb ishst" ::: "memory");
+    memfill_forward(d, value, n);
+}
+
+#else
+// Word at a time once the destination is aligned
+static void memcopy_init(void) {
+    memcopy_stream_min = (bh_size_t)-1;
+}
+
+static void memcopy_forward(bh_uint8_t* d, const bh_uint8_t* s, bh_size_t n) {
+    if ((((bh_uintptr_t)d ^ (bh_uintptr_t)s) & (sizeof(bh_uintptr_t) - 1)) == 0) {
+        while (n && ((bh_uintptr_t)d & (sizeof(bh_uintptr_t) - 1))) {
+            *d++ = *s++;
+            n--;
+        }
+        for (; n >= sizeof(bh_uintptr_t); n -= sizeof(bh_uintptr_t)) {
+            *(bh_uintptr_t*)d = *(const bh_uintptr_t*)s;
+            d += sizeof(bh_uintptr_t);
+            s += sizeof(bh_uintptr_t);
+        }
+    }
+    while (n--) {
+        *d++ = *s++;
+    }
+}
+
+static void memcopy_stream(bh_uint8_t* d, const bh_uint8_t* s, bh_size_t n) {
+    memcopy_forward(d, s, n);
+}
+
+static void memfill_forward(bh_uint8_t* d, bh_uint8_t value, bh_size_t n) {
+    bh_uintptr_t pattern = (bh_uintptr_t)-1 / 0xFF * value;
+    while (n && ((bh_uintptr_t)d & (sizeof(bh_uintptr_t) - 1))) {
+        *d++ = value;
+        n--;
+    }
+    for (; n >= sizeof(bh_uintptr_t); n -= sizeof(bh_uintptr_t), d += sizeof(bh_uintptr_t)) {
+        *(bh_uintptr_t*)d = pattern;
+    }
+    while (n--) {
+        *d++ = value;
+    }
+}
+
+static void memfill_stream(bh_uint8_t* d, bh_uint8_t value, bh_size_t n) {
+    memfill_forward(d, value, n);
+}
+#endif
+
+// Overlapping move to a higher address: from the end, a word at a time
+// when both sides can be aligned together
+static void memcopy_backward(bh_uint8_t* d, const bh_uint8_t* s, bh_size_t n) {
+    d += n;
+    s += n;
+    if ((((bh_uintptr_t)d ^ (bh_uintptr_t)s) & 7) == 0) {
+        while (n && ((bh_uintptr_t)d & 7)) {
+            *--d = *--s;
+            n--;
+        }
+        for (; n >= 8; n -= 8) {
+            d -= 8;
+            s -= 8;
+            *(bh_uint64_t*)d = *(const bh_uint64_t*)s;
+        }
+    }
+    while (n--) {
+        *--d = *--s;
+    }
+}
+
+bh_status_t bh_memory_copy_part(void* dest, const void* src, bh_size_t size, bh_size_t total) {
+    if (!dest || !src) {
+        return BH_INVALID_ARGUMENT;
+    }
+
+    bh_uint8_t* d = (bh_uint8_t*)dest;
+    const bh_uint8_t* s = (const bh_uint8_t*)src;
+    if (size == 0 || d == s) {
+        return BH_SUCCESS;
+    }
+
+    if (size < MEMCOPY_SMALL) {
+        if (d < s || d >= s + size) {
+            for (bh_size_t i = 0; i < size; i++) {
+                d[i] = s[i];
+            }
+        } else {
+            for (bh_size_t i = size; i > 0; i--) {
+                d[i - 1] = s[i - 1];
+            }
+        }
+        return BH_SUCCESS;
+    }
+
+    if (d > s && d < s + size) {
+        memcopy_backward(d, s, size);
+        return BH_SUCCESS;
+    }
+
+    if (memcopy_stream_min == 0) {
+        memcopy_init();
+    }
+    // Streaming stores would race a source that runs into the destination
+    if (total >= memcopy_stream_min && (s + size <= d || d + size <= s)) {
+        memcopy_stream(d, s, size);
+    } else {
+        memcopy_forward(d, s, size);
+    }
+    return BH_SUCCESS;
+}
+
+bh_status_t bh_memory_copy(void* dest, const void* src, bh_size_t size) {
+    return bh_memory_copy_part(dest, src, size, size);
+}
+
+bh_status_t bh_memory_set(void* dest, int value, bh_size_t size) {
+    if (!dest) {
+        return BH_INVALID_ARGUMENT;
+    }
+
+    bh_uint8_t* d = (bh_uint8_t*)dest;
+    if (size < MEMCOPY_SMALL) {
+        for (bh_size_t i = 0; i < size; i++) {
+            d[i] = (bh_uint8_t)value;
+        }
+        return BH_SUCCESS;
+    }
+
+    if (memcopy_stream_min == 0) {
+        memcopy_init();
+    }
+    if (size >= memcopy_stream_min) {
+        memfill_stream(d, (bh_uint8_t)value, size);
+    } else {
+        memfill_forward(d, (bh_uint8_t)value, size);
+    }
+    return BH_SUCCESS;
+}
@@ -0,0 +1,432 @@
+/*
+ * memory.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <bloodhorn/bloodhorn.h>
+#include <bloodhorn/memory.h>
+
+// Heap behind bh_malloc and bh_memory_allocate. Small requests come from
+// slab pages carved into one size class each and kept on per-class
+// freelists; anything larger, or aligned past 16 bytes, gets whole pages
+// of its own. Pages come from the system table's alloc_pages hook, or
+// from the pool allocator with the alignment done here when there is none.
+//
+// Every block starts with a heap_page_t at the base of its first page,
+// so the header of any pointer handed out is found by rounding ptr - 1
+// down to the page size.
+
+#define HEAP_PAGE_SIZE          4096
+#define HEAP_HEADER_SIZE        32      // sizeof(heap_page_t), rounded up
+#define HEAP_MIN_ALIGN          16
+#define HEAP_CLASS_COUNT        7       // 16 .. 1024 bytes
+#define HEAP_MAX_SMALL          1024
+
+#define HEAP_MAGIC_SLAB         0x424C5348  // "HSLB"
+#define HEAP_MAGIC_LARGE        0x47524C48  // "HLRG"
+
+typedef struct {
+    bh_uint32_t magic;
+    bh_uint32_t size_class;     // Slab: index into the class tables
+    bh_size_t pages;            // Pages obtained for the block
+    void* raw;                  // What the page source returned
+    bh_size_t size;             // Large: bytes requested
+} heap_page_t;
+
+BH_STATIC_ASSERT(sizeof(heap_page_t) <= HEAP_HEADER_SIZE, "heap header outgrew its slot");
+
+typedef struct heap_free_block {
+    struct heap_free_block* next;
+} heap_free_block_t;
+
+static const bh_size_t heap_class_size[HEAP_CLASS_COUNT] = {
+    16, 32, 64, 128, 256, 512, 1024
+};
+
+static heap_free_block_t* heap_freelist[HEAP_CLASS_COUNT];
+
+// Usage counters for bh_memory_get_stats
+static bh_size_t heap_pages_held = 0;
+static bh_size_t heap_bytes_used = 0;
+static bh_size_t heap_bytes_free = 0;
+static bh_size_t heap_bytes_peak = 0;
+
+static heap_page_t* heap_header(void* ptr) {
+    return (heap_page_t*)(((bh_uintptr_t)ptr - 1) & ~(bh_uintptr_t)(HEAP_PAGE_SIZE - 1));
+}
+
+static int heap_class_for(bh_size_t size) {
+    for (int i = 0; i < HEAP_CLASS_COUNT; i++) {
+        if (size <= heap_class_size[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Get pages from the platform. Without a page hook the pool allocator is
+ * asked for one extra page's worth so the block can be rounded up to a
+ * page boundary; raw keeps the pointer to give back.
+ */
+static void* heap_pages_alloc(bh_size_t pages, void** raw) {
+    if (!bh_system_table || pages == 0 || pages > ((bh_size_t)-1) / HEAP_PAGE_SIZE - 1) {
+        return NULL;
+    }
+
+    if (bh_system_table->alloc_pages) {
+        void* base = bh_system_table->alloc_pages(pages);
+        *raw = base;
+        return base;
+    }
+
+    if (!bh_system_table->alloc) {
+        return NULL;
+    }
+    void* block = bh_system_table->alloc(pages * HEAP_PAGE_SIZE + HEAP_PAGE_SIZE - 1);
+    if (!block) {
+        return NULL;
+    }
+    *raw = block;
+    return (void*)(((bh_uintptr_t)block + HEAP_PAGE_SIZE - 1) & ~(bh_uintptr_t)(HEAP_PAGE_SIZE - 1));
+}
+
+static void heap_pages_release(void* raw, bh_size_t pages) {
+    if (bh_system_table->alloc_pages) {
+        // Platforms that hand out pages for good leave free_pages unset
+        if (bh_system_table->free_pages) {
+            bh_system_table->free_pages(raw, pages);
+        }
+    } else if (bh_system_table->free) {
+        bh_system_table->free(raw);
+    }
+}
+
+// Carve a fresh page into blocks of one class. Slab pages stay with their
+// class once made; the freelist threads through all of them.
+static bh_bool_t heap_refill(int cls) {
+    void* raw;
+    heap_page_t* page = (heap_page_t*)heap_pages_alloc(1, &raw);
+    if (!page) {
+        return BH_FALSE;
+    }
+
+    page->magic = HEAP_MAGIC_SLAB;
+    page->size_class = (bh_uint32_t)cls;
+    page->pages = 1;
+    page->raw = raw;
+    page->size = 0;
+
+    bh_size_t size = heap_class_size[cls];
+    bh_uint8_t* block = (bh_uint8_t*)page + HEAP_HEADER_SIZE;
+    bh_uint8_t* end = (bh_uint8_t*)page + HEAP_PAGE_SIZE;
+    for (; block + size <= end; block += size) {
+        heap_free_block_t* free_block = (heap_free_block_t*)block;
+        free_block->next = heap_freelist[cls];
+        heap_freelist[cls] = free_block;
+        heap_bytes_free += size;
+    }
+
+    heap_pages_held++;
+    return BH_TRUE;
+}
+
+static void* heap_alloc_small(int cls) {
+    if (!heap_freelist[cls] && !heap_refill(cls)) {
+        return NULL;
+    }
+
+    heap_free_block_t* block = heap_freelist[cls];
+    heap_freelist[cls] = block->next;
+    heap_bytes_free -= heap_class_size[cls];
+    heap_bytes_used += heap_class_size[cls];
+    if (heap_bytes_used > heap_bytes_peak) {
+        heap_bytes_peak = heap_bytes_used;
+    }
+    return block;
+}
+
+/*
+ * A block of whole pages. The header takes the first page's base and the
+ * caller's memory starts at the alignment past it (at least the header
+ * slot). Alignment beyond a page over-allocates so an aligned address one
+ * page into the block can always be found, with the header page before it.
+ */
+static void* heap_alloc_large(bh_size_t size, bh_size_t alignment) {
+    bh_size_t offset = alignment > HEAP_HEADER_SIZE ? alignment : HEAP_HEADER_SIZE;
+    bh_size_t pages;
+    void* raw;
+
+    if (offset > HEAP_PAGE_SIZE) {
+        offset = HEAP_PAGE_SIZE;
+    }
+    if (size > ((bh_size_t)-1) - alignment - 2 * HEAP_PAGE_SIZE) {
+        return NULL;
+    }
+    pages = (offset + size + HEAP_PAGE_SIZE - 1) / HEAP_PAGE_SIZE;
+    if (alignment > HEAP_PAGE_SIZE) {
+        pages += (alignment - HEAP_PAGE_SIZE) / HEAP_PAGE_SIZE;
+    }
+
+    bh_uint8_t* base = (bh_uint8_t*)heap_pages_alloc(pages, &raw);
+    if (!base) {
+        return NULL;
+    }
+
+    bh_uint8_t* user = base + offset;
+    if (alignment > HEAP_PAGE_SIZE) {
+        user = (bh_uint8_t*)(((bh_uintptr_t)user + alignment - 1) & ~(bh_uintptr_t)(alignment - 1));
+    }
+
+    heap_page_t* page = heap_header(user);
+    page->magic = HEAP_MAGIC_LARGE;
+    page->size_class = 0;
+    page->pages = pages;
+    page->raw = raw;
+    page->size = size;
+
+    heap_pages_held += pages;
+    heap_bytes_used += size;
+    if (heap_bytes_used > heap_bytes_peak) {
+        heap_bytes_peak = heap_bytes_used;
+    }
+    return user;
+}
+
+static void* heap_alloc(bh_size_t size, bh_size_t alignment) {
+    if (size == 0) {
+        size = 1;
+    }
+    if (alignment <= HEAP_MIN_ALIGN && size <= HEAP_MAX_SMALL) {
+        return heap_alloc_small(heap_class_for(size));
+    }
+    return heap_alloc_large(size, alignment);
+}
+
+// Usable bytes behind a pointer from the heap, or 0 if it isn't one
+static bh_size_t heap_block_size(void* ptr) {
+    heap_page_t* page = heap_header(ptr);
+    if (page->magic == HEAP_MAGIC_SLAB && page->size_class < HEAP_CLASS_COUNT) {
+        return heap_class_size[page->size_class];
+    }
+    if (page->magic == HEAP_MAGIC_LARGE) {
+        return page->size;
+    }
+    return 0;
+}
+
+void* bh_malloc(bh_size_t size) {
+    return heap_alloc(size, 0);
+}
+
+void bh_free(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    heap_page_t* page = heap_header(ptr);
+    if (page->magic == HEAP_MAGIC_SLAB && page->size_class < HEAP_CLASS_COUNT) {
+        bh_uint32_t cls = page->size_class;
+        heap_free_block_t* block = (heap_free_block_t*)ptr;
+        block->next = heap_freelist[cls];
+        heap_freelist[cls] = block;
+        heap_bytes_used -= heap_class_size[cls];
+        heap_bytes_free += heap_class_size[cls];
+    } else if (page->magic == HEAP_MAGIC_LARGE) {
+        bh_size_t pages = page->pages;
+        void* raw = page->raw;
+        heap_bytes_used -= page->size;
+        heap_pages_held -= pages;
+        page->magic = 0;
+        heap_pages_release(raw, pages);
+    }
+}
+
+void* bh_realloc(void* ptr, bh_size_t size) {
+    if (!ptr) {
+        return bh_malloc(size);
+    }
+    if (size == 0) {
+        bh_free(ptr);
+        return NULL;
+    }
+
+    // Stay put while the slab class still fits
+    bh_size_t old_size = heap_block_size(ptr);
+    heap_page_t* page = heap_header(ptr);
+    if (page->magic == HEAP_MAGIC_SLAB && size <= old_size &&
+        (page->size_class == 0 || size > heap_class_size[page->size_class - 1])) {
+        return ptr;
+    }
+
+    void* grown = bh_malloc(size);
+    if (!grown) {
+        return NULL;
+    }
+    const bh_uint8_t* src = (const bh_uint8_t*)ptr;
+    bh_uint8_t* dst = (bh_uint8_t*)grown;
+    for (bh_size_t i = 0; i < old_size && i < size; i++) {
+        dst[i] = src[i];
+    }
+    bh_free(ptr);
+    return grown;
+}
+
+void* bh_memory_allocate(bh_size_t size, bh_size_t alignment, bh_memory_flags_t flags) {
+    if (alignment & (alignment - 1)) {
+        return NULL;
+    }
+
+    void* ptr = heap_alloc(size, alignment);
+    if (ptr && (flags & BH_MEMORY_ZERO)) {
+        bh_uint8_t* bytes = (bh_uint8_t*)ptr;
+        for (bh_size_t i = 0; i < size; i++) {
+            bytes[i] = 0;
+        }
+    }
+    return ptr;
+}
+
+void bh_memory_free(void* ptr, bh_size_t size) {
+    (void)size;
+    bh_free(ptr);
+}
+
+bh_status_t bh_memory_get_stats(bh_size_t* total, bh_size_t* free, bh_size_t* used, bh_size_t* reserved) {
+    bh_size_t held = heap_pages_held * HEAP_PAGE_SIZE;
+
+    if (total) {
+        *total = held;
+    }
+    if (free) {
+        *free = heap_bytes_free;
+    }
+    if (used) {
+        *used = heap_bytes_used;
+    }
+    if (reserved) {
+        *reserved = held - heap_bytes_free - heap_bytes_used;
+    }
+    return BH_SUCCESS;
+}
+
+bh_size_t bh_memory_get_peak(void) {
+    return heap_bytes_peak;
+}
+
+// Arenas: bump allocation over a list of heap chunks, newest first.
+// Requests over a quarter of the chunk size get a block of their own on
+// a separate list so the space left in the current chunk is not thrown
+// away. A mark is the head of both lists plus the fill of the head
+// chunk, so rewinding frees whatever was pushed since and restores it.
+
+#define ARENA_DEFAULT_CHUNK     (16 * 1024)
+#define ARENA_ALIGN             16
+
+typedef struct bh_arena_chunk {
+    struct bh_arena_chunk* next;
+    bh_size_t size;             // Usable bytes after the header
+    bh_size_t used;
+} bh_arena_chunk_t;
+
+struct bh_arena {
+    bh_arena_chunk_t* chunks;
+    bh_arena_chunk_t* large;
+    bh_size_t chunk_size;
+};
+
+#define ARENA_CHUNK_HEADER ((sizeof(bh_arena_chunk_t) + ARENA_ALIGN - 1) & ~(bh_size_t)(ARENA_ALIGN - 1))
+
+static void arena_free_until(bh_arena_chunk_t* chunk, bh_arena_chunk_t* stop) {
+    while (chunk && chunk != stop) {
+        bh_arena_chunk_t* next = chunk->next;
+        bh_free(chunk);
+        chunk = next;
+    }
+}
+
+bh_arena_t* bh_arena_create(bh_size_t chunk_size) {
+    bh_arena_t* arena = (bh_arena_t*)bh_malloc(sizeof(*arena));
+    if (!arena) {
+        return NULL;
+    }
+    if (chunk_size <= ARENA_CHUNK_HEADER + ARENA_ALIGN) {
+        chunk_size = ARENA_DEFAULT_CHUNK;
+    }
+    arena->chunks = NULL;
+    arena->large = NULL;
+    arena->chunk_size = chunk_size - ARENA_CHUNK_HEADER;
+    return arena;
+}
+
+void* bh_arena_alloc(bh_arena_t* arena, bh_size_t size) {
+    if (!arena || size > ((bh_size_t)-1) - ARENA_CHUNK_HEADER - ARENA_ALIGN) {
+        return NULL;
+    }
+    size = (size + ARENA_ALIGN - 1) & ~(bh_size_t)(ARENA_ALIGN - 1);
+    if (size == 0) {
+        size = ARENA_ALIGN;
+    }
+
+    if (size > arena->chunk_size / 4) {
+        bh_arena_chunk_t* block = (bh_arena_chunk_t*)bh_malloc(ARENA_CHUNK_HEADER + size);
+        if (!block) {
+            return NULL;
+        }
+        block->size = size;
+        block->used = size;
+        block->next = arena->large;
+        arena->large = block;
+        return (bh_uint8_t*)block + ARENA_CHUNK_HEADER;
+    }
+
+    bh_arena_chunk_t* chunk = arena->chunks;
+    if (!chunk || chunk->size - chunk->used < size) {
+        chunk = (bh_arena_chunk_t*)bh_malloc(ARENA_CHUNK_HEADER + arena->chunk_size);
+        if (!chunk) {
+            return NULL;
+        }
+        chunk->size = arena->chunk_size;
+        chunk->used = 0;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+    }
+
+    void* ptr = (bh_uint8_t*)chunk + ARENA_CHUNK_HEADER + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+bh_arena_mark_t bh_arena_mark(const bh_arena_t* arena) {
+    bh_arena_mark_t mark = { NULL, NULL, 0 };
+    if (arena) {
+        mark.chunk = arena->chunks;
+        mark.large = arena->large;
+        mark.used = arena->chunks ? arena->chunks->used : 0;
+    }
+    return mark;
+}
+
+void bh_arena_rewind(bh_arena_t* arena, bh_arena_mark_t mark) {
+    if (!arena) {
+        return;
+    }
+    arena_free_until(arena->large, (bh_arena_chunk_t*)mark.large);
+    arena->large = (bh_arena_chunk_t*)mark.large;
+    arena_free_until(arena->chunks, (bh_arena_chunk_t*)mark.chunk);
+    arena->chunks = (bh_arena_chunk_t*)mark.chunk;
+    if (arena->chunks) {
+        arena->chunks->used = mark.used;
+    }
+}
+
+void bh_arena_destroy(bh_arena_t* arena) {
+    if (!arena) {
+        return;
+    }
+    arena_free_until(arena->large, NULL);
+    arena_free_until(arena->chunks, NULL);
+    bh_free(arena);
+}
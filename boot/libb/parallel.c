@@ -0,0 +1,183 @@
+/*
+ * parallel.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <bloodhorn/bloodhorn.h>
+#include <bloodhorn/parallel.h>
+
+// Pending tasks. The caller is the only producer and publishes at tail;
+// any processor claims at head with a compare-and-swap. A slot is read
+// before the claim, and the producer never reuses a slot at or past head,
+// so a claim that succeeds always got the task it read.
+static bh_future_t* parallel_queue[BH_PARALLEL_QUEUE_SIZE];
+static bh_uint32_t parallel_head = 0;
+static bh_uint32_t parallel_tail = 0;
+
+// APs reported by the platform; -1 until asked
+static bh_int32_t parallel_aps = -1;
+
+// An AP start is outstanding; workers may still be draining the queue
+static bh_bool_t parallel_aps_busy = BH_FALSE;
+
+typedef struct {
+    bh_parallel_body_t body;
+    void* arg;
+    bh_size_t count;
+    bh_size_t grain;
+    bh_size_t next;         // First item not yet claimed
+} parallel_range_t;
+
+static inline void parallel_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __asm__ volatile ("pause");
+#elif defined(__aarch64__)
+    __asm__ volatile ("yield");
+#endif
+}
+
+static bh_future_t* parallel_take(void) {
+    bh_uint32_t head = __atomic_load_n(&parallel_head, __ATOMIC_ACQUIRE);
+
+    while (head != __atomic_load_n(&parallel_tail, __ATOMIC_ACQUIRE)) {
+        bh_future_t* future = parallel_queue[head % BH_PARALLEL_QUEUE_SIZE];
+        if (__atomic_compare_exchange_n(&parallel_head, &head, head + 1, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            return future;
+        }
+    }
+    return NULL;
+}
+
+static void parallel_run(bh_future_t* future) {
+    __atomic_store_n(&future->state, BH_FUTURE_RUNNING, __ATOMIC_RELAXED);
+    future->fn(future->arg);
+    __atomic_store_n(&future->state, BH_FUTURE_DONE, __ATOMIC_RELEASE);
+}
+
+// Runs on the APs: drain the queue, then return to the platform
+static void parallel_worker(void* context) {
+    bh_future_t* future;
+
+    (void)context;
+    while ((future = parallel_take()) != NULL) {
+        parallel_run(future);
+    }
+}
+
+// Put the APs to work on the queue unless they still are. Workers that
+// have just seen it empty miss a new task; its waiter runs it instead.
+static void parallel_kick(void) {
+    if (parallel_aps_busy) {
+        if (!bh_system_table->aps_idle()) {
+            return;
+        }
+        parallel_aps_busy = BH_FALSE;
+    }
+    parallel_aps_busy = bh_system_table->start_aps(parallel_worker, NULL) != 0;
+}
+
+bh_uint32_t bh_parallel_workers(void) {
+    if (parallel_aps < 0) {
+        if (bh_system_table && bh_system_table->get_ap_count &&
+            bh_system_table->start_aps && bh_system_table->aps_idle) {
+            parallel_aps = (bh_int32_t)bh_system_table->get_ap_count();
+        } else {
+            parallel_aps = 0;
+        }
+    }
+    return (bh_uint32_t)parallel_aps + 1;
+}
+
+bh_status_t bh_future_start(bh_future_t* future, bh_task_fn_t fn, void* arg) {
+    bh_uint32_t tail;
+
+    if (!future || !fn) {
+        return BH_INVALID_ARGUMENT;
+    }
+    future->fn = fn;
+    future->arg = arg;
+    future->state = BH_FUTURE_QUEUED;
+
+    tail = parallel_tail;
+    if (bh_parallel_workers() == 1 ||
+        tail - __atomic_load_n(&parallel_head, __ATOMIC_ACQUIRE) >= BH_PARALLEL_QUEUE_SIZE) {
+        parallel_run(future);
+        return BH_SUCCESS;
+    }
+
+    parallel_queue[tail % BH_PARALLEL_QUEUE_SIZE] = future;
+    __atomic_store_n(&parallel_tail, tail + 1, __ATOMIC_RELEASE);
+    parallel_kick();
+    return BH_SUCCESS;
+}
+
+bh_bool_t bh_future_ready(const bh_future_t* future) {
+    return future && __atomic_load_n(&future->state, __ATOMIC_ACQUIRE) == BH_FUTURE_DONE;
+}
+
+void bh_future_wait(bh_future_t* future) {
+    if (!future || future->state == BH_FUTURE_IDLE) {
+        return;
+    }
+    // Help with the queue rather than spin; the task may be in it
+    while (__atomic_load_n(&future->state, __ATOMIC_ACQUIRE) != BH_FUTURE_DONE) {
+        bh_future_t* queued = parallel_take();
+        if (queued) {
+            parallel_run(queued);
+        } else {
+            parallel_relax();
+        }
+    }
+}
+
+static void parallel_range_task(void* arg) {
+    parallel_range_t* range = (parallel_range_t*)arg;
+
+    for (;;) {
+        bh_size_t begin = __atomic_fetch_add(&range->next, range->grain, __ATOMIC_RELAXED);
+        if (begin >= range->count) {
+            break;
+        }
+        bh_size_t end = range->count - begin < range->grain ? range->count : begin + range->grain;
+        range->body(begin, end, range->arg);
+    }
+}
+
+void bh_parallel_for(bh_size_t count, bh_size_t grain, bh_parallel_body_t body, void* arg) {
+    bh_future_t helpers[BH_PARALLEL_MAX_WORKERS - 1];
+    parallel_range_t range;
+    bh_size_t chunks, n;
+
+    if (count == 0 || !body) {
+        return;
+    }
+    if (grain == 0) {
+        grain = 1;
+    }
+    chunks = (count - 1) / grain + 1;
+
+    n = bh_parallel_workers() - 1;
+    if (n > chunks - 1) {
+        n = chunks - 1;
+    }
+    if (n > BH_PARALLEL_MAX_WORKERS - 1) {
+        n = BH_PARALLEL_MAX_WORKERS - 1;
+    }
+
+    range.body = body;
+    range.arg = arg;
+    range.count = count;
+    range.grain = grain;
+    range.next = 0;
+
+    for (bh_size_t i = 0; i < n; i++) {
+        bh_future_start(&helpers[i], parallel_range_task, &range);
+    }
+    parallel_range_task(&range);
+    for (bh_size_t i = 0; i < n; i++) {
+        bh_future_wait(&helpers[i]);
+    }
+}
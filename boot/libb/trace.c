@@ -0,0 +1,474 @@
+/*
+ * trace.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <bloodhorn/bloodhorn.h>
+#include <bloodhorn/debug.h>
+#include <bloodhorn/time.h>
+#include <bloodhorn/trace.h>
+
+// Event ring. Spans are written when they open so the ring stays in start
+// order; bh_trace_end fills in the duration if the slot has not been reused.
+static bh_trace_event_t trace_events[BH_TRACE_MAX_EVENTS];
+static bh_uint32_t trace_sequence[BH_TRACE_MAX_EVENTS];
+static bh_int64_t trace_memory_start[BH_TRACE_MAX_EVENTS];     // Held when each span opened
+static bh_uint32_t trace_next_sequence = 0;
+static bh_uint32_t trace_depth = 0;
+static bh_uint64_t trace_origin = 0;
+static bh_bool_t trace_started = BH_FALSE;
+static bh_bool_t trace_enabled = BH_TRUE;
+
+// Span not yet closed by bh_trace_end
+#define TRACE_OPEN_DURATION ((bh_uint64_t)-1)
+
+static void trace_start_if_needed(void) {
+    if (!trace_started) {
+        trace_origin = bh_get_performance_counter();
+        trace_started = BH_TRUE;
+    }
+}
+
+// Bytes the loader holds now, or BH_TRACE_NO_MEMORY when nothing counts them
+static bh_int64_t trace_memory_in_use(void) {
+    bh_uint64_t bytes;
+
+    if (bh_system_table && bh_system_table->get_memory_in_use && bh_system_table->get_memory_in_use(&bytes)) {
+        return (bh_int64_t)bytes;
+    }
+    return BH_TRACE_NO_MEMORY;
+}
+
+// Growth since a span opened; not known unless counted at both ends
+static bh_int64_t trace_memory_since(bh_int64_t start) {
+    bh_int64_t now = start == BH_TRACE_NO_MEMORY ? BH_TRACE_NO_MEMORY : trace_memory_in_use();
+
+    return now == BH_TRACE_NO_MEMORY ? BH_TRACE_NO_MEMORY : now - start;
+}
+
+static bh_trace_event_t* trace_record(const char* name, bh_trace_event_type_t type, bh_uint32_t* sequence) {
+    bh_uint32_t seq;
+    bh_uint32_t slot;
+    bh_trace_event_t* event;
+
+    trace_start_if_needed();
+
+    seq = trace_next_sequence++;
+    slot = seq % BH_TRACE_MAX_EVENTS;
+    event = &trace_events[slot];
+
+    event->name = name ? name : "?";
+    event->start_ticks = bh_get_performance_counter() - trace_origin;
+    event->duration_ticks = 0;
+    event->depth = (bh_uint16_t)trace_depth;
+    event->type = (bh_uint16_t)type;
+    event->memory_bytes = BH_TRACE_NO_MEMORY;
+    trace_sequence[slot] = seq;
+
+    if (sequence) {
+        *sequence = seq;
+    }
+    return event;
+}
+
+void bh_trace_reset(void) {
+    trace_next_sequence = 0;
+    trace_depth = 0;
+    trace_started = BH_FALSE;
+    trace_start_if_needed();
+}
+
+void bh_trace_set_enabled(bh_bool_t enabled) {
+    trace_enabled = enabled;
+}
+
+bh_trace_span_t bh_trace_begin(const char* name) {
+    bh_trace_event_t* event;
+    bh_uint32_t seq;
+
+    if (!trace_enabled) {
+        return BH_TRACE_INVALID_SPAN;
+    }
+
+    event = trace_record(name, BH_TRACE_EVENT_SPAN, &seq);
+    event->duration_ticks = TRACE_OPEN_DURATION;
+    trace_memory_start[seq % BH_TRACE_MAX_EVENTS] = trace_memory_in_use();
+
+    if (trace_depth < BH_TRACE_MAX_DEPTH) {
+        trace_depth++;
+    }
+
+    return (bh_trace_span_t)(seq & 0x7FFFFFFF);
+}
+
+void bh_trace_end(bh_trace_span_t span) {
+    bh_uint32_t slot;
+    bh_trace_event_t* event;
+    bh_uint64_t now;
+
+    if (span == BH_TRACE_INVALID_SPAN) {
+        return;
+    }
+
+    if (trace_depth > 0) {
+        trace_depth--;
+    }
+
+    slot = (bh_uint32_t)span % BH_TRACE_MAX_EVENTS;
+    if ((trace_sequence[slot] & 0x7FFFFFFF) != (bh_uint32_t)span) {
+        return; // Overwritten by newer events
+    }
+
+    event = &trace_events[slot];
+    if (event->duration_ticks != TRACE_OPEN_DURATION) {
+        return; // Already closed
+    }
+
+    now = bh_get_performance_counter() - trace_origin;
+    event->duration_ticks = now > event->start_ticks ? now - event->start_ticks : 0;
+    event->memory_bytes = trace_memory_since(trace_memory_start[slot]);
+}
+
+void bh_trace_mark(const char* name) {
+    if (!trace_enabled) {
+        return;
+    }
+    trace_record(name, BH_TRACE_EVENT_INSTANT, NULL);
+}
+
+bh_size_t bh_trace_get_event_count(void) {
+    return trace_next_sequence < BH_TRACE_MAX_EVENTS ? trace_next_sequence : BH_TRACE_MAX_EVENTS;
+}
+
+bh_size_t bh_trace_get_events(bh_trace_event_t* events, bh_size_t max_events) {
+    bh_size_t count = bh_trace_get_event_count();
+    bh_uint32_t first = trace_next_sequence - (bh_uint32_t)count;
+    bh_uint64_t now;
+    bh_size_t i;
+
+    if (!events) {
+        return 0;
+    }
+    if (count > max_events) {
+        count = max_events;
+    }
+
+    now = trace_started ? bh_get_performance_counter() - trace_origin : 0;
+    for (i = 0; i < count; i++) {
+        bh_uint32_t slot = (first + (bh_uint32_t)i) % BH_TRACE_MAX_EVENTS;
+
+        events[i] = trace_events[slot];
+        // Report spans that are still open as running until now
+        if (events[i].duration_ticks == TRACE_OPEN_DURATION) {
+            events[i].duration_ticks = now > events[i].start_ticks ? now - events[i].start_ticks : 0;
+            events[i].memory_bytes = trace_memory_since(trace_memory_start[slot]);
+        }
+    }
+    return count;
+}
+
+// Bounded text writer; keeps counting past the end so callers can size buffers
+typedef struct {
+    char* buffer;
+    bh_size_t size;
+    bh_size_t length;
+} trace_writer_t;
+
+static void trace_put_char(trace_writer_t* w, char c) {
+    if (w->buffer && w->length + 1 < w->size) {
+        w->buffer[w->length] = c;
+    }
+    w->length++;
+}
+
+static void trace_put_string(trace_writer_t* w, const char* s) {
+    while (*s) {
+        trace_put_char(w, *s++);
+    }
+}
+
+static void trace_put_json_string(trace_writer_t* w, const char* s) {
+    static const char hex[] = "0123456789abcdef";
+
+    trace_put_char(w, '"');
+    while (*s) {
+        unsigned char c = (unsigned char)*s++;
+        if (c == '"' || c == '\\') {
+            trace_put_char(w, '\\');
+            trace_put_char(w, (char)c);
+        } else if (c < 0x20) {
+            trace_put_string(w, "\\u00");
+            trace_put_char(w, hex[c >> 4]);
+            trace_put_char(w, hex[c & 0xF]);
+        } else {
+            trace_put_char(w, (char)c);
+        }
+    }
+    trace_put_char(w, '"');
+}
+
+static void trace_put_uint(trace_writer_t* w, bh_uint64_t value, bh_uint32_t width) {
+    char digits[21];
+    bh_uint32_t n = 0;
+
+    do {
+        digits[n++] = (char)('0' + (value % 10));
+        value /= 10;
+    } while (value && n < sizeof(digits));
+
+    while (width > n) {
+        trace_put_char(w, ' ');
+        width--;
+    }
+    while (n) {
+        trace_put_char(w, digits[--n]);
+    }
+}
+
+static void trace_put_int(trace_writer_t* w, bh_int64_t value, bh_uint32_t width) {
+    bh_uint64_t magnitude = value < 0 ? 0 - (bh_uint64_t)value : (bh_uint64_t)value;
+    bh_uint64_t digits = 1;
+
+    for (bh_uint64_t rest = magnitude / 10; rest; rest /= 10) {
+        digits++;
+    }
+    if (value < 0) {
+        while (width > digits + 1) {
+            trace_put_char(w, ' ');
+            width--;
+        }
+        trace_put_char(w, '-');
+        width = 0;
+    }
+    trace_put_uint(w, magnitude, width);
+}
+
+static void trace_finish(trace_writer_t* w) {
+    if (w->buffer && w->size) {
+        w->buffer[w->length < w->size ? w->length : w->size - 1] = '\0';
+    }
+}
+
+static bh_uint64_t trace_ticks_to_us(bh_uint64_t ticks) {
+    return bh_ticks_to_nanoseconds(ticks) / 1000;
+}
+
+bh_status_t bh_trace_export_chrome_json(char* buffer, bh_size_t buffer_size, bh_size_t* written) {
+    trace_writer_t w = { buffer, buffer_size, 0 };
+    bh_trace_event_t event;
+    bh_size_t count = bh_trace_get_event_count();
+    bh_uint32_t first = trace_next_sequence - (bh_uint32_t)count;
+    bh_size_t i;
+
+    trace_put_string(&w, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (i = 0; i < count; i++) {
+        event = trace_events[(first + i) % BH_TRACE_MAX_EVENTS];
+
+        if (i) {
+            trace_put_char(&w, ',');
+        }
+        trace_put_string(&w, "\n{\"name\":");
+        trace_put_json_string(&w, event.name);
+        trace_put_string(&w, ",\"cat\":\"boot\",\"pid\":1,\"tid\":1,\"ts\":");
+        trace_put_uint(&w, trace_ticks_to_us(event.start_ticks), 0);
+
+        if (event.type == BH_TRACE_EVENT_INSTANT) {
+            trace_put_string(&w, ",\"ph\":\"i\",\"s\":\"g\"");
+        } else if (event.duration_ticks == TRACE_OPEN_DURATION) {
+            // Chrome closes unmatched 'B' events at the end of the trace
+            trace_put_string(&w, ",\"ph\":\"B\"");
+        } else {
+            trace_put_string(&w, ",\"ph\":\"X\",\"dur\":");
+            trace_put_uint(&w, trace_ticks_to_us(event.duration_ticks), 0);
+        }
+
+        trace_put_string(&w, ",\"args\":{\"depth\":");
+        trace_put_uint(&w, event.depth, 0);
+        if (event.memory_bytes != BH_TRACE_NO_MEMORY) {
+            trace_put_string(&w, ",\"memory_bytes\":");
+            trace_put_int(&w, event.memory_bytes, 0);
+        }
+        trace_put_string(&w, "}}");
+    }
+    trace_put_string(&w, "\n]}\n");
+    trace_finish(&w);
+
+    if (written) {
+        *written = w.length;
+    }
+    if (!buffer || w.length >= buffer_size) {
+        return BH_BUFFER_TOO_SMALL;
+    }
+    return BH_SUCCESS;
+}
+
+void bh_trace_print(void) {
+    char line[128];
+    trace_writer_t w;
+    bh_trace_event_t event;
+    bh_size_t count = bh_trace_get_event_count();
+    bh_uint32_t first = trace_next_sequence - (bh_uint32_t)count;
+    bh_size_t i;
+    bh_uint32_t indent;
+
+    // mem(KiB) is what a span left allocated, when something counts it
+    bh_puts("   start(us)     dur(us)    mem(KiB)  phase\r\n");
+    for (i = 0; i < count; i++) {
+        event = trace_events[(first + i) % BH_TRACE_MAX_EVENTS];
+
+        w.buffer = line;
+        w.size = sizeof(line);
+        w.length = 0;
+
+        trace_put_uint(&w, trace_ticks_to_us(event.start_ticks), 12);
+        trace_put_char(&w, ' ');
+        if (event.type == BH_TRACE_EVENT_INSTANT) {
+            trace_put_string(&w, "           -");
+        } else if (event.duration_ticks == TRACE_OPEN_DURATION) {
+            trace_put_string(&w, "        open");
+        } else {
+            trace_put_uint(&w, trace_ticks_to_us(event.duration_ticks), 12);
+        }
+        trace_put_char(&w, ' ');
+        if (event.memory_bytes == BH_TRACE_NO_MEMORY) {
+            trace_put_string(&w, "           -");
+        } else {
+            trace_put_int(&w, event.memory_bytes / 1024, 12);
+        }
+        trace_put_string(&w, "  ");
+        for (indent = 0; indent < event.depth; indent++) {
+            trace_put_string(&w, "  ");
+        }
+        trace_put_string(&w, event.name);
+        trace_put_string(&w, "\r\n");
+        trace_finish(&w);
+
+        bh_puts(line);
+    }
+
+    if (trace_next_sequence > BH_TRACE_MAX_EVENTS) {
+        bh_puts("(oldest events overwritten)\r\n");
+    }
+}
+
+// Performance counters (debug.h). Each running counter also opens a trace
+// span so the aggregate numbers and the timeline come from the same clock.
+
+#define BH_PERF_MAX_COUNTERS 32
+
+static bh_perf_counter_t perf_counters[BH_PERF_MAX_COUNTERS];
+static bh_trace_span_t perf_spans[BH_PERF_MAX_COUNTERS];
+static bh_bool_t perf_in_use[BH_PERF_MAX_COUNTERS];
+
+static bh_int32_t perf_index(bh_perf_counter_t* counter) {
+    if (counter < perf_counters || counter >= perf_counters + BH_PERF_MAX_COUNTERS) {
+        return -1;
+    }
+    return (bh_int32_t)(counter - perf_counters);
+}
+
+bh_perf_counter_t* bh_perf_create_counter(const char* name) {
+    bh_uint32_t i;
+
+    for (i = 0; i < BH_PERF_MAX_COUNTERS; i++) {
+        if (!perf_in_use[i]) {
+            perf_in_use[i] = BH_TRUE;
+            perf_spans[i] = BH_TRACE_INVALID_SPAN;
+            perf_counters[i].name = name;
+            bh_perf_reset_counter(&perf_counters[i]);
+            return &perf_counters[i];
+        }
+    }
+    return NULL;
+}
+
+void bh_perf_start_counter(bh_perf_counter_t* counter) {
+    bh_int32_t index = perf_index(counter);
+
+    if (index < 0) {
+        return;
+    }
+    perf_spans[index] = bh_trace_begin(counter->name);
+    counter->start_time = bh_get_performance_counter();
+}
+
+void bh_perf_stop_counter(bh_perf_counter_t* counter) {
+    bh_int32_t index = perf_index(counter);
+    bh_uint64_t elapsed;
+
+    if (index < 0 || counter->start_time == 0) {
+        return;
+    }
+
+    elapsed = bh_get_performance_counter() - counter->start_time;
+    counter->start_time = 0;
+    counter->total_time += elapsed;
+    counter->call_count++;
+    if (elapsed < counter->min_time) {
+        counter->min_time = elapsed;
+    }
+    if (elapsed > counter->max_time) {
+        counter->max_time = elapsed;
+    }
+
+    bh_trace_end(perf_spans[index]);
+    perf_spans[index] = BH_TRACE_INVALID_SPAN;
+}
+
+void bh_perf_reset_counter(bh_perf_counter_t* counter) {
+    if (!counter) {
+        return;
+    }
+    counter->start_time = 0;
+    counter->total_time = 0;
+    counter->call_count = 0;
+    counter->min_time = (bh_uint64_t)-1;
+    counter->max_time = 0;
+}
+
+void bh_perf_print_counters(void) {
+    char line[96];
+    trace_writer_t w;
+    bh_uint32_t i;
+
+    bh_puts("       calls    total(us)      min(us)      max(us)  counter\r\n");
+    for (i = 0; i < BH_PERF_MAX_COUNTERS; i++) {
+        bh_perf_counter_t* c = &perf_counters[i];
+        if (!perf_in_use[i]) {
+            continue;
+        }
+
+        w.buffer = line;
+        w.size = sizeof(line);
+        w.length = 0;
+
+        trace_put_uint(&w, c->call_count, 12);
+        trace_put_char(&w, ' ');
+        trace_put_uint(&w, trace_ticks_to_us(c->total_time), 12);
+        trace_put_char(&w, ' ');
+        trace_put_uint(&w, c->call_count ? trace_ticks_to_us(c->min_time) : 0, 12);
+        trace_put_char(&w, ' ');
+        trace_put_uint(&w, trace_ticks_to_us(c->max_time), 12);
+        trace_put_string(&w, "  ");
+        trace_put_string(&w, c->name ? c->name : "?");
+        trace_put_string(&w, "\r\n");
+        trace_finish(&w);
+
+        bh_puts(line);
+    }
+}
+
+void bh_perf_destroy_counter(bh_perf_counter_t* counter) {
+    bh_int32_t index = perf_index(counter);
+
+    if (index < 0) {
+        return;
+    }
+    if (perf_spans[index] != BH_TRACE_INVALID_SPAN) {
+        bh_trace_end(perf_spans[index]);
+    }
+    perf_in_use[index] = BH_FALSE;
+    perf_spans[index] = BH_TRACE_INVALID_SPAN;
+}
@@ -6,6 +6,8 @@
  */
 #include "localization.h"
 #include "compat.h"
+#include "../uefi/uefi.h"
+#include "libb/include/bloodhorn/hash.h"
 #include <string.h>
 #include <Uefi.h>
 #include <Library/UefiLib.h>
@@ -29,99 +31,169 @@ static const struct { const char* key; const wchar_t* en; const wchar_t* es; } t
 
 static const char* current_lang = "en";
 
-typedef struct { const char* key; wchar_t* value; } loc_kv_t;
-static loc_kv_t* g_loc = NULL;
-static UINTN g_loc_count = 0;
+// Locales registered in place (RegisterLocaleStrings)
+#define MAX_REGISTERED_LOCALES 8
+static struct { const char* lang; const LocaleString* strings; uint32_t count; } g_registered[MAX_REGISTERED_LOCALES];
+static UINTN g_registered_count = 0;
 
-static VOID free_locale_table(void) {
-    if (!g_loc) return;
-    for (UINTN i = 0; i < g_loc_count; ++i) {
-        if (g_loc[i].value) FreePool(g_loc[i].value);
+// The active locale: its strings (registered, or parsed from
+// \locales\<lang>.ini) and an open-addressed hash index over them, kept
+// at most half full. Everything allocated for it lives in g_loc_block,
+// so switching languages frees exactly one block.
+#define LOC_SLOT_EMPTY 0xFFFFFFFFu
+typedef struct { uint32_t hash; uint32_t entry; } loc_slot_t;
+static const LocaleString* g_loc = NULL;
+static uint32_t g_loc_count = 0;
+static loc_slot_t* g_loc_slots = NULL;
+static uint32_t g_loc_mask = 0;
+static VOID* g_loc_block = NULL;
+
+static uint32_t locale_hash(const char* key) {
+    return bh_fnv1a_str(key);
+}
+
+// Slots needed to index `count` strings at no more than half load
+static uint32_t locale_slot_count(uint32_t count) {
+    uint32_t n = 4;
+    while (n < count * 2) n <<= 1;
+    return n;
+}
+
+// Fill `slots` (locale_slot_count(count) of them) for `strings`. Keys
+// that appear twice keep their first value, as a linear search would.
+static VOID build_locale_index(loc_slot_t* slots, uint32_t nslots, const LocaleString* strings, uint32_t count) {
+    SetMem(slots, sizeof(loc_slot_t) * nslots, 0xFF);
+    for (uint32_t i = 0; i < count; i++) {
+        if (!strings[i].key) continue;
+        uint32_t h = locale_hash(strings[i].key);
+        uint32_t at = h & (nslots - 1);
+        while (slots[at].entry != LOC_SLOT_EMPTY &&
+               !(slots[at].hash == h && strcmp(strings[slots[at].entry].key, strings[i].key) == 0)) {
+            at = (at + 1) & (nslots - 1);
+        }
+        if (slots[at].entry == LOC_SLOT_EMPTY) {
+            slots[at].hash = h;
+            slots[at].entry = i;
+        }
+    }
+    g_loc_slots = slots;
+    g_loc_mask = nslots - 1;
+}
+
+void RegisterLocaleStrings(const char* lang_code, const LocaleString* strings, uint32_t count) {
+    if (!lang_code || !strings) return;
+    for (UINTN i = 0; i < g_registered_count; ++i) {
+        if (strcmp(g_registered[i].lang, lang_code) == 0) {
+            g_registered[i].strings = strings;
+            g_registered[i].count = count;
+            return;
+        }
     }
-    FreePool(g_loc);
+    if (g_registered_count == MAX_REGISTERED_LOCALES) return;
+    g_registered[g_registered_count].lang = lang_code;
+    g_registered[g_registered_count].strings = strings;
+    g_registered[g_registered_count].count = count;
+    g_registered_count++;
+}
+
+static VOID free_locale_table(void) {
+    if (g_loc_block) FreePool(g_loc_block);
+    g_loc_block = NULL;
     g_loc = NULL; g_loc_count = 0;
+    g_loc_slots = NULL; g_loc_mask = 0;
 }
 
-static EFI_STATUS get_root(EFI_FILE_HANDLE* root) {
-    EFI_STATUS Status;
-    EFI_LOADED_IMAGE_PROTOCOL* LoadedImage = NULL;
-    EFI_SIMPLE_FILE_SYSTEM_PROTOCOL* Fs = NULL;
-    extern EFI_HANDLE gImageHandle;
-    extern EFI_BOOT_SERVICES* gBS;
-    Status = gBS->HandleProtocol(gImageHandle, &gEfiLoadedImageProtocolGuid, (VOID**)&LoadedImage);
-    if (EFI_ERROR(Status)) return Status;
-    Status = gBS->HandleProtocol(LoadedImage->DeviceHandle, &gEfiSimpleFileSystemProtocolGuid, (VOID**)&Fs);
-    if (EFI_ERROR(Status)) return Status;
-    return Fs->OpenVolume(Fs, root);
+// Index a registered locale; its strings stay where they are
+static VOID use_registered_locale(const LocaleString* strings, uint32_t count) {
+    free_locale_table();
+    g_loc = strings;
+    g_loc_count = count;
+    uint32_t nslots = locale_slot_count(count);
+    g_loc_block = AllocatePool(sizeof(loc_slot_t) * nslots);
+    // Without the index, lookups fall back to a linear search
+    if (g_loc_block) build_locale_index((loc_slot_t*)g_loc_block, nslots, strings, count);
 }
 
 static EFI_STATUS read_text_file(CONST CHAR16* path, CHAR8** out, UINTN* out_len) {
     *out = NULL; *out_len = 0;
-    EFI_FILE_HANDLE root = NULL, file = NULL; EFI_STATUS Status;
-    Status = get_root(&root); if (EFI_ERROR(Status)) return Status;
-    Status = root->Open(root, &file, (CHAR16*)path, EFI_FILE_MODE_READ, 0);
+    LOADED_FILE file;
+    EFI_STATUS Status = LoadBootFile(path, FILE_LOAD_TEXT, NULL, NULL, &file);
     if (EFI_ERROR(Status)) return Status;
-    EFI_FILE_INFO* info = NULL; UINTN info_sz = 0;
-    Status = file->GetInfo(file, &gEfiFileInfoGuid, &info_sz, NULL);
-    if (Status == EFI_BUFFER_TOO_SMALL) {
-        info = AllocateZeroPool(info_sz);
-        if (!info) { file->Close(file); return EFI_OUT_OF_RESOURCES; }
-        Status = file->GetInfo(file, &gEfiFileInfoGuid, &info_sz, info);
-    }
-    if (EFI_ERROR(Status)) { if (info) FreePool(info); file->Close(file); return Status; }
-    UINTN size = (UINTN)info->FileSize; CHAR8* buf = AllocateZeroPool(size + 1);
-    if (!buf) { FreePool(info); file->Close(file); return EFI_OUT_OF_RESOURCES; }
-    Status = file->Read(file, &size, buf);
-    file->Close(file); FreePool(info);
-    if (EFI_ERROR(Status)) { FreePool(buf); return Status; }
-    buf[size] = 0; *out = buf; *out_len = size; return EFI_SUCCESS;
+    *out = (CHAR8*)file.Buffer; *out_len = file.Size; return EFI_SUCCESS;
 }
 
-static VOID parse_locale_ini(CHAR8* text) {
+static BOOLEAN is_blank(CHAR8 c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+// Parse `key = value` lines into one block laid out as
+// [index slots][LocaleString entries][wide values][keys]. The text is
+// only read, so the file buffer can be freed right after.
+static VOID parse_locale_ini(CONST CHAR8* text, UINTN len) {
     free_locale_table();
-    // Count lines with '='
-    UINTN cap = 0, count = 0; CHAR8* p = text;
-    while (*p) { CHAR8* e = p; while (*e && *e!='\n') e++; if (AsciiStrStr(p, "=")) count++; p = (*e=='\n') ? e+1 : e; }
-    cap = count ? count : 1; g_loc = AllocateZeroPool(sizeof(loc_kv_t)*cap); g_loc_count = 0;
-    p = text;
-    while (*p) {
-        CHAR8* e = p; while (*e && *e!='\n') e++; UINTN len = (UINTN)(e-p);
-        CHAR8* line = AllocateZeroPool(len+1); if (!line) return; CopyMem(line,p,len); line[len]=0;
-        // trim
+    // Upper bounds first: entries from the lines holding '=', and string
+    // space from the text length (every key and value is a piece of it)
+    uint32_t count = 0;
+    for (CONST CHAR8* p = text; *p; ) {
+        CONST CHAR8* e = p; BOOLEAN eq = FALSE;
+        while (*e && *e != '\n') { if (*e == '=') eq = TRUE; e++; }
+        if (eq) count++;
+        p = (*e == '\n') ? e + 1 : e;
+    }
+    if (count == 0) return;
+    uint32_t nslots = locale_slot_count(count);
+    UINTN chars = len + count;
+    UINT8* block = AllocatePool(sizeof(loc_slot_t) * nslots + sizeof(LocaleString) * count +
+                                chars * sizeof(wchar_t) + chars);
+    if (!block) return;
+    loc_slot_t* slots = (loc_slot_t*)block;
+    LocaleString* strings = (LocaleString*)(slots + nslots);
+    wchar_t* wout = (wchar_t*)(strings + count);
+    CHAR8* kout = (CHAR8*)(wout + chars);
+
+    uint32_t n = 0;
+    for (CONST CHAR8* p = text; *p; ) {
+        CONST CHAR8* e = p; CONST CHAR8* eq = NULL;
+        while (*e && *e != '\n') { if (!eq && *e == '=') eq = e; e++; }
         // skip comments
-        if (line[0] != '#' && line[0] != ';' && AsciiStrStr(line, "=")) {
-            CHAR8* eq = AsciiStrStr(line, "="); *eq = 0; CHAR8* k=line; CHAR8* v=eq+1;
-            // trim simple
-            while (*k==' '||*k=='\t') k++; while (*v==' '||*v=='\t') v++;
-            UINTN vl = AsciiStrLen(v); while (vl>0 && (v[vl-1]=='\r'||v[vl-1]==' '||v[vl-1]=='\t')) { v[vl-1]=0; vl--; }
-            // convert to wide
-            UINTN wlen = AsciiStrLen(v);
-            wchar_t* w = AllocateZeroPool((wlen+1)*sizeof(wchar_t));
-            if (!w) { FreePool(line); return; }
-            for (UINTN i=0;i<wlen;i++) w[i] = (wchar_t)(UINT8)v[i];
-            // duplicate key string
-            UINTN kl = AsciiStrLen(k);
-            CHAR8* kdup = AllocateZeroPool(kl + 1);
-            if (!kdup) { FreePool(w); FreePool(line); return; }
-            CopyMem(kdup, k, kl);
-            g_loc[g_loc_count].key = (const char*)kdup;
-            g_loc[g_loc_count].value = (wchar_t*)w;
-            g_loc_count++;
+        if (eq && p[0] != '#' && p[0] != ';') {
+            CONST CHAR8* k = p; CONST CHAR8* ke = eq;
+            CONST CHAR8* v = eq + 1; CONST CHAR8* ve = e;
+            while (k < ke && is_blank(*k)) k++;
+            while (ke > k && is_blank(ke[-1])) ke--;
+            while (v < ve && is_blank(*v)) v++;
+            while (ve > v && is_blank(ve[-1])) ve--;
+            strings[n].key = (const char*)kout;
+            while (k < ke) *kout++ = *k++;
+            *kout++ = 0;
+            strings[n].value = wout;
+            while (v < ve) *wout++ = (wchar_t)(UINT8)*v++;
+            *wout++ = 0;
+            n++;
         }
-        FreePool(line);
-        p = (*e=='\n') ? e+1 : e;
+        p = (*e == '\n') ? e + 1 : e;
     }
+
+    g_loc_block = block;
+    g_loc = strings;
+    g_loc_count = n;
+    build_locale_index(slots, nslots, strings, n);
 }
 
 void SetLanguage(const char* lang_code) {
     current_lang = (lang_code && lang_code[0]) ? lang_code : "en";
+    // A registered (bundled) locale needs no file read at all
+    for (UINTN i = 0; i < g_registered_count; ++i) {
+        if (strcmp(g_registered[i].lang, current_lang) == 0) {
+            use_registered_locale(g_registered[i].strings, g_registered[i].count);
+            return;
+        }
+    }
     // Try to load locales/<lang>.ini if present
     CHAR16 path[64];
     path[0]=L'\0';
     UnicodeSPrint(path, sizeof(path), L"\\locales\\%a.ini", current_lang);
     CHAR8* buf = NULL; UINTN blen = 0;
     if (!EFI_ERROR(read_text_file(path, &buf, &blen)) && buf) {
-        parse_locale_ini(buf);
+        parse_locale_ini(buf, blen);
         FreePool(buf);
     } else {
         free_locale_table();
@@ -133,11 +205,21 @@ const char* GetCurrentLanguage(void) {
 }
 
 const wchar_t* GetLocalizedString(const char* key) {
-    // First look in loaded locale table
+    // First look in the active locale, then the built-ins
     if (g_loc && key) {
-        for (UINTN i=0;i<g_loc_count;i++) {
-            if (g_loc[i].key && strcmp(g_loc[i].key, key) == 0) {
-                return g_loc[i].value ? g_loc[i].value : L"";
+        if (g_loc_slots) {
+            uint32_t h = locale_hash(key);
+            for (uint32_t at = h & g_loc_mask; g_loc_slots[at].entry != LOC_SLOT_EMPTY; at = (at + 1) & g_loc_mask) {
+                const LocaleString* s = &g_loc[g_loc_slots[at].entry];
+                if (g_loc_slots[at].hash == h && strcmp(s->key, key) == 0) {
+                    return s->value ? s->value : L"";
+                }
+            }
+        } else {
+            for (uint32_t i = 0; i < g_loc_count; i++) {
+                if (g_loc[i].key && strcmp(g_loc[i].key, key) == 0) {
+                    return g_loc[i].value ? g_loc[i].value : L"";
+                }
             }
         }
     }
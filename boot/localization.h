@@ -8,8 +8,21 @@
 #ifndef BLOODHORN_LOCALIZATION_H
 #define BLOODHORN_LOCALIZATION_H
 
+#include <stdint.h>
+
+// One key/value pair of a locale supplied in place
+typedef struct {
+    const char* key;
+    const wchar_t* value;
+} LocaleString;
+
 const wchar_t* GetLocalizedString(const char* key);
 void SetLanguage(const char* lang_code);
 const char* GetCurrentLanguage(void);
 
+// Make `count` strings for `lang_code` available without a file read (the
+// asset bundle does this); SetLanguage prefers them over
+// \locales\<lang>.ini. Both the code and the table must stay valid.
+void RegisterLocaleStrings(const char* lang_code, const LocaleString* strings, uint32_t count);
+
 #endif // BLOODHORN_LOCALIZATION_H
\ No newline at end of file
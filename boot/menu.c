@@ -11,6 +11,7 @@
 #include <Library/MemoryAllocationLib.h>
 #include <Protocol/SimpleTextInEx.h>
 #include "../uefi/graphics.h"
+#include "../uefi/uefi.h"
 #include "theme.h"
 #include "localization.h"
 #include "mouse.h"
@@ -28,6 +29,9 @@
 #define MAX_ENTRY_LENGTH 64
 #define VISIBLE_MENU_ENTRIES 10
 
+// Shortest interval between two frames (100 ns units, ~60 Hz)
+#define MENU_REDRAW_TICK 166667
+
 /*
  * Boot menu architecture overview (high-level yapping):
  *
@@ -40,6 +44,8 @@
  *   `InitializeGraphics`, `DrawRect`, `ClearScreen` (and any platform
  *   provided primitives like `GraphicsOutput`). The menu only decides
  *   *what* to draw and *where*; it does not care how pixels hit the screen.
+ *   Those primitives compose into an off-screen back buffer, and each
+ *   frame ends with `FlushGraphics`, which blits just the dirty regions.
  *
  * - The color palette and optional background image are provided by
  *   `boot/theme.c` through `GetBootMenuTheme()`. Configuration code or
@@ -262,87 +268,284 @@ AddBootEntry(
     return EFI_SUCCESS;
 }
 
+// Menu geometry shared by the drawing code and the mouse hit testing.
+// We place the menu box in the center horizontally by allocating a
+// quarter-screen margin on each side and let it float vertically at a
+// fixed Y offset. The chosen dimensions (row height 50, padding 40)
+// define the geometry that both sides must agree on.
+#define MENU_ROW_HEIGHT         50
+#define MENU_BAND_HEIGHT        40
+#define MENU_SCROLLBAR_WIDTH    4
+#define MENU_SCROLLBAR_MIN      8
+
+typedef struct {
+    INT32 ScreenWidth;
+    INT32 ScreenHeight;
+    INT32 MenuX;
+    INT32 MenuY;
+    INT32 MenuWidth;
+    INT32 MenuHeight;
+    INT32 TextX;
+    INT32 TextY;        // Baseline row of the first visible entry
+    INT32 BandX;        // Row bands (highlight and hit area) span BandX..BandX+BandWidth
+    INT32 BandWidth;
+    INT32 ScrollX;      // Scrollbar track, in the margin right of the bands
+    INT32 ScrollY;
+    INT32 ScrollHeight;
+} MENU_LAYOUT;
+
+static VOID
+GetMenuLayout(MENU_LAYOUT *Layout)
+{
+    Layout->ScreenWidth = GraphicsOutput->Mode->Info->HorizontalResolution;
+    Layout->ScreenHeight = GraphicsOutput->Mode->Info->VerticalResolution;
+    Layout->MenuX = Layout->ScreenWidth / 4;
+    Layout->MenuY = 100;
+    Layout->MenuWidth = Layout->ScreenWidth / 2;
+    Layout->MenuHeight = (VISIBLE_MENU_ENTRIES * MENU_ROW_HEIGHT) + 40;
+    Layout->TextX = Layout->MenuX + 20;
+    Layout->TextY = Layout->MenuY + 20;
+    Layout->BandX = Layout->MenuX + 10;
+    Layout->BandWidth = Layout->MenuWidth - 20;
+    Layout->ScrollX = Layout->BandX + Layout->BandWidth + (10 - MENU_SCROLLBAR_WIDTH) / 2;
+    Layout->ScrollY = Layout->TextY - 5;
+    Layout->ScrollHeight = (VISIBLE_MENU_ENTRIES - 1) * MENU_ROW_HEIGHT + MENU_BAND_HEIGHT;
+}
+
+// Top of the band of visible slot `Slot`. The band is offset slightly
+// relative to the row's TextY so the text appears visually centered
+// inside it.
+static INT32
+GetMenuBandY(CONST MENU_LAYOUT *Layout, UINTN Slot)
+{
+    return Layout->TextY + (INT32)Slot * MENU_ROW_HEIGHT - 5;
+}
+
+// Entry under (X, Y), or -1 when the point is not on a visible row's band
+static INTN
+MenuHitTest(CONST MENU_LAYOUT *Layout, INT32 X, INT32 Y)
+{
+    if (X < Layout->BandX || X >= Layout->BandX + Layout->BandWidth || Y < GetMenuBandY(Layout, 0)) {
+        return -1;
+    }
+    UINTN Slot = (UINTN)(Y - GetMenuBandY(Layout, 0)) / MENU_ROW_HEIGHT;
+    if (Slot >= VISIBLE_MENU_ENTRIES || Y >= GetMenuBandY(Layout, Slot) + MENU_BAND_HEIGHT ||
+        (UINTN)MenuScrollOffset + Slot >= BootEntryCount) {
+        return -1;
+    }
+    return MenuScrollOffset + (INTN)Slot;
+}
+
+// What the back buffer currently shows, so a frame only repaints what
+// changed: a selection move inside the same scroll window touches two
+// rows, a scroll the rows and the scrollbar, and anything else (the first
+// frame) the whole screen.
+static BOOLEAN MenuFrameValid = FALSE;
+static INTN DrawnSelectedEntry = -1;
+static INTN DrawnScrollOffset = -1;
+
+// Paints one visible row: the highlight (or menu box) color over the
+// row's band, then its label.
+static VOID
+DrawMenuRow(CONST MENU_LAYOUT *Layout, UINTN Index)
+{
+    const struct BootMenuTheme* theme = GetBootMenuTheme();
+    INT32 BandY = GetMenuBandY(Layout, Index - MenuScrollOffset);
+    BOOLEAN Selected = (Index == (UINTN)SelectedEntry);
+
+    DrawRect(Layout->BandX, BandY, Layout->BandWidth, MENU_BAND_HEIGHT,
+             Selected ? theme->highlight_color : theme->header_color);
+    // Compose the label for this row. We allocate a small constant
+    // margin (+8) over MAX_ENTRY_LENGTH to account for the optional
+    // "(x) " hotkey prefix. The earlier AddBootEntry cap ensures we
+    // never overflow this buffer.
+    wchar_t entry_label[MAX_ENTRY_LENGTH+8];
+    if (BootEntryHotkeys[Index]) {
+        swprintf(entry_label, sizeof(entry_label)/sizeof(wchar_t), L"(%c) %s", BootEntryHotkeys[Index], BootEntries[Index].Name);
+    } else {
+        swprintf(entry_label, sizeof(entry_label)/sizeof(wchar_t), L"%s", BootEntries[Index].Name);
+    }
+    PrintXY(Layout->TextX, BandY + 5, Selected ? theme->selected_text_color : theme->text_color, 0x00000000, L"%s", entry_label);
+}
+
+// Scrollbar for lists longer than the window: the thumb covers the
+// visible share of the list at the window's position within it.
+static VOID
+DrawMenuScrollbar(CONST MENU_LAYOUT *Layout)
+{
+    const struct BootMenuTheme* theme = GetBootMenuTheme();
+
+    if (BootEntryCount <= VISIBLE_MENU_ENTRIES) {
+        return;
+    }
+    INT32 Thumb = (INT32)((UINTN)Layout->ScrollHeight * VISIBLE_MENU_ENTRIES / BootEntryCount);
+    Thumb = MAX(Thumb, MENU_SCROLLBAR_MIN);
+    INT32 Travel = Layout->ScrollHeight - Thumb;
+    INT32 ThumbY = Layout->ScrollY +
+                   (INT32)((UINTN)Travel * (UINTN)MenuScrollOffset / (BootEntryCount - VISIBLE_MENU_ENTRIES));
+
+    DrawRect(Layout->ScrollX, Layout->ScrollY, MENU_SCROLLBAR_WIDTH, Layout->ScrollHeight, theme->header_color);
+    DrawRect(Layout->ScrollX, ThumbY, MENU_SCROLLBAR_WIDTH, Thumb, theme->footer_color);
+}
+
 /**
   Draws the boot menu on the screen.
+
+  The frame is composed in the graphics back buffer and only the regions
+  that changed since the previous frame are copied to the screen.
 **/
 VOID
 DrawBootMenu() {
     const struct BootMenuTheme* theme = GetBootMenuTheme();
-    // Background layer: either a full-screen image specified by the
-    // theme, or a solid-color fill acting as a canvas. This is drawn
-    // once per frame before we start painting higher-level UI elements.
-    if (theme->background_image) {
-        DrawImage(theme->background_image, 0, 0);
-    } else {
+    MENU_LAYOUT Layout;
+
+    GetMenuLayout(&Layout);
+
+    if (MenuFrameValid && DrawnScrollOffset == MenuScrollOffset) {
+        // Same window: repaint just the rows whose highlight changed
+        if (DrawnSelectedEntry != SelectedEntry) {
+            DrawMenuRow(&Layout, (UINTN)DrawnSelectedEntry);
+            DrawMenuRow(&Layout, (UINTN)SelectedEntry);
+            DrawnSelectedEntry = SelectedEntry;
+        }
+        FlushGraphics();
+        return;
+    }
+    if (MenuFrameValid) {
+        // Scrolled: every visible row changed, the rest of the frame did
+        // not. With a long list the window is always full, so each band
+        // is simply painted over.
+        for (UINTN i = MenuScrollOffset; i < BootEntryCount && i < MenuScrollOffset + VISIBLE_MENU_ENTRIES; i++) {
+            DrawMenuRow(&Layout, i);
+        }
+        DrawMenuScrollbar(&Layout);
+        FlushGraphics();
+        DrawnSelectedEntry = SelectedEntry;
+        DrawnScrollOffset = MenuScrollOffset;
+        return;
+    }
+
+    // Background layer: the theme's image scaled to cover the screen (it
+    // is scaled and converted once, then copied on every full redraw), or
+    // a solid-color fill acting as a canvas. This is drawn once before we
+    // start painting higher-level UI elements.
+    const GRAPHICS_IMAGE* background = theme->background_image;
+    if (!background || EFI_ERROR(DrawBackground(background))) {
+        // No memory for a scaled copy: the image as is, over the fill
         ClearScreen(theme->background_color);
+        if (background) {
+            DrawImage(background, 0, 0);
+        }
     }
-    INT32 ScreenWidth = GraphicsOutput->Mode->Info->HorizontalResolution;
-    INT32 ScreenHeight = GraphicsOutput->Mode->Info->VerticalResolution;
 
     // Header band across the top of the screen. We conceptually treat the
     // screen as a 2D coordinate system [0, ScreenWidth) x [0, ScreenHeight)
     // in pixel space, with (0,0) at the top-left corner.
-    DrawRect(0, 0, ScreenWidth, 60, theme->header_color);
-    // We place the menu box in the center horizontally by allocating a
-    // quarter-screen margin on each side and let it float vertically at a
-    // fixed Y offset. The chosen dimensions (row height 50, padding 40)
-    // define the geometry that both the drawing code and the mouse hit
-    // testing code must agree on.
-    INT32 MenuX = ScreenWidth / 4;
-    INT32 MenuY = 100;
-    INT32 MenuWidth = ScreenWidth / 2;
-    INT32 MenuHeight = (VISIBLE_MENU_ENTRIES * 50) + 40;
-    DrawRect(MenuX, MenuY, MenuWidth, MenuHeight, theme->header_color);
-    INT32 TextX = MenuX + 20;
-    INT32 TextY = MenuY + 20;
+    DrawRect(0, 0, Layout.ScreenWidth, 60, theme->header_color);
+    DrawRect(Layout.MenuX, Layout.MenuY, Layout.MenuWidth, Layout.MenuHeight, theme->header_color);
     const wchar_t* menu_title = GetLocalizedString("menu_title");
     // Center the title text in the header by assuming an approximate
     // glyph width of 10 pixels. This is intentionally approximate rather
     // than font-metric perfect; it trades precision for simplicity and
     // keeps the coordinates deterministic.
-    PrintXY((ScreenWidth - StrLen(menu_title) * 10) / 2, 30, theme->selected_text_color, theme->header_color, L"%s", menu_title);
+    PrintXY((Layout.ScreenWidth - StrLen(menu_title) * 10) / 2, 30, theme->selected_text_color, theme->header_color, L"%s", menu_title);
     // Draw visible entries
     // For each logically visible entry index i in the current window, we
     // compute the corresponding row slot. Any change to MenuScrollOffset
     // or VISIBLE_MENU_ENTRIES must preserve the invariant that the loop
     // bounds below stay within [0, BootEntryCount).
     for (UINTN i = MenuScrollOffset; i < BootEntryCount && i < MenuScrollOffset + VISIBLE_MENU_ENTRIES; i++) {
-        if (i == (UINTN)SelectedEntry) {
-            // Highlight band under the selected entry. Note that we offset
-            // the rectangle slightly relative to TextY so the text appears
-            // visually centered inside it.
-            DrawRect(MenuX + 10, TextY - 5, MenuWidth - 20, 40, theme->highlight_color);
-        }
-        // Compose the label for this row. We allocate a small constant
-        // margin (+8) over MAX_ENTRY_LENGTH to account for the optional
-        // "(x) " hotkey prefix. The earlier AddBootEntry cap ensures we
-        // never overflow this buffer.
-        wchar_t entry_label[MAX_ENTRY_LENGTH+8];
-        if (BootEntryHotkeys[i]) {
-            swprintf(entry_label, sizeof(entry_label)/sizeof(wchar_t), L"(%c) %s", BootEntryHotkeys[i], BootEntries[i].Name);
-        } else {
-            swprintf(entry_label, sizeof(entry_label)/sizeof(wchar_t), L"%s", BootEntries[i].Name);
-        }
-        PrintXY(TextX, TextY, (i == (UINTN)SelectedEntry) ? theme->selected_text_color : theme->text_color, 0x00000000, L"%s", entry_label);
-        TextY += 50;
-    }
-    // Up/down arrows if needed
-    // Visual affordances for scrollability: if MenuScrollOffset is
-    // strictly greater than zero, it means there exist entries above the
-    // current window, so we draw an upward arrow in the upper-right.
-    if (MenuScrollOffset > 0) {
-        PrintXY(MenuX + MenuWidth - 40, MenuY + 10, theme->footer_color, 0x00000000, L"↑");
-    }
-    // Symmetrically, if the window end is strictly less than BootEntryCount
-    // there exist entries below the visible area, so we draw a down arrow.
-    if (MenuScrollOffset + VISIBLE_MENU_ENTRIES < BootEntryCount) {
-        PrintXY(MenuX + MenuWidth - 40, MenuY + MenuHeight - 30, theme->footer_color, 0x00000000, L"↓");
+        DrawMenuRow(&Layout, i);
     }
+    // Visual affordance for scrollability: the scrollbar shows where the
+    // window sits in a list longer than it.
+    DrawMenuScrollbar(&Layout);
     const wchar_t* instructions = GetLocalizedString("instructions");
     // Same approximate-centering trick as the title, but anchored near the
     // bottom edge of the menu box.
     UINTN InstructionsWidth = StrLen(instructions) * 10;
-    PrintXY((ScreenWidth - InstructionsWidth) / 2, MenuY + MenuHeight + 20, theme->footer_color, 0x00000000, L"%s", instructions);
+    PrintXY((Layout.ScreenWidth - InstructionsWidth) / 2, Layout.MenuY + Layout.MenuHeight + 20, theme->footer_color, 0x00000000, L"%s", instructions);
+
+    FlushGraphics();
+    MenuFrameValid = TRUE;
+    DrawnSelectedEntry = SelectedEntry;
+    DrawnScrollOffset = MenuScrollOffset;
+}
+
+// Hands the screen over to the selected entry: the menu's back buffer is
+// no longer needed once a loader (or the OS after it) owns the display.
+static EFI_STATUS
+RunSelectedEntry(VOID)
+{
+    ReleaseBackBuffer();
+    MenuFrameValid = FALSE;
+    if (BootEntries[SelectedEntry].BootFunction != NULL) {
+        return BootEntries[SelectedEntry].BootFunction();
+    }
+    return EFI_SUCCESS;
+}
+
+// Applies one keystroke to the menu state. Returns TRUE when the menu is
+// done (an entry ran, or the user backed out) with its result in *Result.
+static BOOLEAN
+HandleMenuKey(CONST EFI_INPUT_KEY *Key, EFI_STATUS *Result)
+{
+    // Hotkey support: map a UnicodeChar coming from the firmware to our
+    // ASCII-based hotkey table. We intentionally fold to lower-case in
+    // the same way AssignHotkeys() did, so the relation is symmetric.
+    if (Key->UnicodeChar) {
+        CHAR16 c = Key->UnicodeChar;
+        // Apply the same simple ASCII folding that AssignHotkeys uses
+        // so that users can press either upper‑ or lower‑case letters.
+        if (c >= L'A' && c <= L'Z') {
+            c = (CHAR16)(c - L'A' + L'a');
+        }
+        for (UINTN i = 0; i < BootEntryCount; ++i) {
+            if (BootEntryHotkeys[i] == c) {
+                SelectedEntry = (INTN)i;
+                EnsureSelectedEntryVisible();
+                break;
+            }
+        }
+    }
+    // At this point we have consumed any hotkey-like characters. We now
+    // branch on two orthogonal dimensions:
+    //   - Key.UnicodeChar for printable/semantic keys like Enter.
+    //   - Key.ScanCode for non-printable navigation keys.
+    switch (Key->UnicodeChar) {
+        case CHAR_CARRIAGE_RETURN:
+            *Result = RunSelectedEntry();
+            return TRUE;
+        case 0:
+            switch (Key->ScanCode) {
+                case SCAN_UP:
+                    // Wrap around when the user navigates past the
+                    // first entry, then normalize the scroll window.
+                    if (SelectedEntry > 0) {
+                        SelectedEntry--;
+                    } else if (BootEntryCount > 0) {
+                        SelectedEntry = (INTN)(BootEntryCount - 1);
+                    }
+                    EnsureSelectedEntryVisible();
+                    break;
+                case SCAN_DOWN:
+                    // Same idea as above but moving forward; wrap to
+                    // the first entry when we reach the bottom.
+                    if ((UINTN)SelectedEntry < BootEntryCount - 1) {
+                        SelectedEntry++;
+                    } else if (BootEntryCount > 0) {
+                        SelectedEntry = 0;
+                    }
+                    EnsureSelectedEntryVisible();
+                    break;
+                case SCAN_ESC:
+                    ReleaseBackBuffer();
+                    *Result = EFI_ABORTED;
+                    return TRUE;
+            }
+            break;
+    }
+    return FALSE;
 }
 
 /**
@@ -354,8 +557,16 @@ DrawBootMenu() {
 EFI_STATUS
 ShowBootMenu() {
     EFI_STATUS Status;
-    EFI_EVENT WaitList[1];
+    EFI_STATUS GraphicsStatus;      // Decides the back-end for the whole menu
+    EFI_STATUS Result = EFI_SUCCESS;
+    EFI_EVENT WaitList[2 + MOUSE_MAX_DEVICES * 2];
+    UINTN WaitCount;
     UINTN WaitIndex;
+    UINTN TickIndex = (UINTN)-1;
+    EFI_EVENT RedrawTick = NULL;
+    BOOLEAN TickArmed = FALSE;
+    BOOLEAN Dirty = TRUE;
+    BOOLEAN Done = FALSE;
     EFI_INPUT_KEY Key;
     struct MouseState mouse = {0};
     // Reset menu selection/scroll every time we enter the menu so that
@@ -365,6 +576,7 @@ ShowBootMenu() {
     // well-defined initial configuration regardless of historical uses.
     SelectedEntry = 0;
     MenuScrollOffset = 0;
+    MenuFrameValid = FALSE;
 
     // LoadThemeAndLanguageFromConfig(); // removed, now in main.c
     // Load localization based on configured language. The localization
@@ -380,10 +592,17 @@ ShowBootMenu() {
     // UEFI text mode rendering in the loop below. Logically, this is a
     // branch in our rendering back-end: one branch uses pixel primitives,
     // the other relies on firmware text output.
-    Status = InitializeGraphics();
-    if (EFI_ERROR(Status)) {
+    GraphicsStatus = InitializeGraphics();
+    if (EFI_ERROR(GraphicsStatus)) {
         gST->ConOut->ClearScreen(gST->ConOut);
+    } else if (GetDefaultFont() == NULL) {
+        // Labels are rendered with the built-in bitmap font into the
+        // same back buffer as the rest of the frame.
+        InitFontSystem();
     }
+    // A scalable theme font re-rasterizes nothing across redraws as long
+    // as the glyphs on screen fit the theme's cache.
+    SetGlyphCacheSize(GetBootMenuTheme()->glyph_cache_size);
     // Ensure that there is always at least one entry so the user can
     // escape back into the firmware UI even if configuration did not
     // provide any boot targets. This establishes a liveness property:
@@ -402,124 +621,89 @@ ShowBootMenu() {
     // If graphics are not available we still call InitMouse(), but all
     // coordinate‑based logic is guarded behind a successful graphics init.
     InitMouse();
-    while (TRUE) {
-        if (!EFI_ERROR(Status)) {
-            // Graphical back-end: we own the full frame and can redraw it
-            // every loop iteration. The drawing routine consumes only the
-            // abstract menu state; it does not perform any input.
-            DrawBootMenu();
-        } else {
-            // Text-mode back-end: here we approximate the same information
-            // using firmware text output. This is intentionally minimalistic
-            // but must preserve the same interaction semantics.
-            gST->ConOut->ClearScreen(gST->ConOut);
-            Print(L"\r\n  BloodHorn Boot Menu\r\n\r\n");
-            for (UINTN i = 0; i < BootEntryCount; i++) {
-                Print(L"  %c %s\r\n", (i == (UINTN)SelectedEntry) ? '>' : ' ', BootEntries[i].Name);
-            }
-            Print(L"\r\n  Use arrow keys to select, Enter to boot, ESC to exit");
-        }
+    if (!EFI_ERROR(GraphicsStatus)) {
+        SetMouseBounds((INT32)GraphicsOutput->Mode->Info->HorizontalResolution,
+                       (INT32)GraphicsOutput->Mode->Info->VerticalResolution);
+    }
 
-        // Mouse support (only meaningful when graphics is active so that
-        // `GraphicsOutput` is valid and the visual layout matches what we
-        // use for hit‑testing).
-        if (!EFI_ERROR(Status)) {
-            GetMouseState(&mouse);
-            INT32 MenuX = GraphicsOutput->Mode->Info->HorizontalResolution / 4;
-            INT32 MenuY = 100;
-            INT32 MenuWidth = GraphicsOutput->Mode->Info->HorizontalResolution / 2;
-            INT32 TextX = MenuX + 20;
-            INT32 TextY = MenuY + 20;
-            for (UINTN i = MenuScrollOffset; i < BootEntryCount && i < MenuScrollOffset + VISIBLE_MENU_ENTRIES; i++) {
-                INT32 entryY = TextY + (i - MenuScrollOffset) * 50;
-                // The hit-test region for each row is defined to match the
-                // drawing coordinates in DrawBootMenu: same X range, and a
-                // Y slice of height 40px starting slightly above TextY.
-                if (mouse.x >= TextX && mouse.x < TextX + MenuWidth - 40 && mouse.y >= entryY && mouse.y < entryY + 40) {
-                    SelectedEntry = (INTN)i;
-                    EnsureSelectedEntryVisible();
-                    if (mouse.left_button) {
-                        if (BootEntries[SelectedEntry].BootFunction != NULL) {
-                            return BootEntries[SelectedEntry].BootFunction();
-                        }
-                        return EFI_SUCCESS;
-                    }
+    // Everything the loop sleeps on: the keyboard, every pointer device
+    // and the redraw tick. Between events WaitForEvent leaves the CPU in
+    // the firmware's idle loop (HLT/WFI) instead of spinning.
+    WaitList[0] = gST->ConIn->WaitForKey;
+    WaitCount = 1 + GetMouseWaitEvents(&WaitList[1], ARRAY_SIZE(WaitList) - 2);
+    if (!EFI_ERROR(gBS->CreateEvent(EVT_TIMER, TPL_CALLBACK, NULL, NULL, &RedrawTick))) {
+        TickIndex = WaitCount;
+        WaitList[WaitCount++] = RedrawTick;
+    }
+
+    while (!Done) {
+        // At most one frame per tick: input arriving while a tick is
+        // pending only marks the frame dirty, and the tick paints it
+        if (Dirty && !TickArmed) {
+            if (!EFI_ERROR(GraphicsStatus)) {
+                // Graphical back-end: we own the full frame and can redraw it
+                // whenever the state changes. The drawing routine consumes only
+                // the abstract menu state; it does not perform any input.
+                DrawBootMenu();
+            } else {
+                // Text-mode back-end: here we approximate the same information
+                // using firmware text output. This is intentionally minimalistic
+                // but must preserve the same interaction semantics.
+                gST->ConOut->ClearScreen(gST->ConOut);
+                Print(L"\r\n  BloodHorn Boot Menu\r\n\r\n");
+                for (UINTN i = 0; i < BootEntryCount; i++) {
+                    Print(L"  %c %s\r\n", (i == (UINTN)SelectedEntry) ? '>' : ' ', BootEntries[i].Name);
                 }
+                Print(L"\r\n  Use arrow keys to select, Enter to boot, ESC to exit");
             }
+            Dirty = FALSE;
+            TickArmed = RedrawTick != NULL && !EFI_ERROR(gBS->SetTimer(RedrawTick, TimerRelative, MENU_REDRAW_TICK));
         }
-        // Wait for key or mouse event. In practice we only wait on the
-        // keyboard event, but mouse state is sampled every frame and does
-        // not block.
-        WaitList[0] = gST->ConIn->WaitForKey;
-        Status = gBS->WaitForEvent(1, WaitList, &WaitIndex);
-        if (EFI_ERROR(Status)) {
-            continue;
-        }
-        Status = gST->ConIn->ReadKeyStroke(gST->ConIn, &Key);
+
+        Status = gBS->WaitForEvent(WaitCount, WaitList, &WaitIndex);
         if (EFI_ERROR(Status)) {
             continue;
         }
-        // Hotkey support: map a UnicodeChar coming from the firmware to our
-        // ASCII-based hotkey table. We intentionally fold to lower-case in
-        // the same way AssignHotkeys() did, so the relation is symmetric.
-        if (Key.UnicodeChar) {
-            CHAR16 c = Key.UnicodeChar;
-            // Apply the same simple ASCII folding that AssignHotkeys uses
-            // so that users can press either upper‑ or lower‑case letters.
-            if (c >= L'A' && c <= L'Z') {
-                c = (CHAR16)(c - L'A' + L'a');
+
+        if (WaitIndex == TickIndex) {
+            TickArmed = FALSE;
+        } else if (WaitIndex == 0) {
+            // Apply every keystroke already queued: while an arrow key is
+            // held, the repeats that arrive during one (slow) frame cost a
+            // single redraw instead of piling up.
+            while (!Done && !EFI_ERROR(gST->ConIn->ReadKeyStroke(gST->ConIn, &Key))) {
+                Done = HandleMenuKey(&Key, &Result);
+                Dirty = TRUE;
             }
-            for (UINTN i = 0; i < BootEntryCount; ++i) {
-                if (BootEntryHotkeys[i] == c) {
-                    SelectedEntry = (INTN)i;
-                    EnsureSelectedEntryVisible();
-                    break;
+        } else if (!EFI_ERROR(GraphicsStatus) && GetMouseState(&mouse)) {
+            // A pointer moved or clicked. Hovering a row selects it, using
+            // the same band geometry DrawMenuRow paints, so an idle pointer
+            // never overrides a keyboard selection.
+            MENU_LAYOUT Layout;
+            GetMenuLayout(&Layout);
+            INTN Hit = MenuHitTest(&Layout, mouse.x, mouse.y);
+            if (Hit >= 0) {
+                Dirty = Dirty || Hit != SelectedEntry;
+                SelectedEntry = Hit;
+                EnsureSelectedEntryVisible();
+                if (mouse.left_button) {
+                    Result = RunSelectedEntry();
+                    Done = TRUE;
                 }
             }
         }
-        // At this point we have consumed any hotkey-like characters. We now
-        // branch on two orthogonal dimensions:
-        //   - Key.UnicodeChar for printable/semantic keys like Enter.
-        //   - Key.ScanCode for non-printable navigation keys.
-        switch (Key.UnicodeChar) {
-            case CHAR_CARRIAGE_RETURN:
-                if (BootEntries[SelectedEntry].BootFunction != NULL) {
-                    return BootEntries[SelectedEntry].BootFunction();
-                }
-                return EFI_SUCCESS;
-            case 0:
-                switch (Key.ScanCode) {
-                    case SCAN_UP:
-                        // Wrap around when the user navigates past the
-                        // first entry, then normalize the scroll window.
-                        if (SelectedEntry > 0) {
-                            SelectedEntry--;
-                        } else if (BootEntryCount > 0) {
-                            SelectedEntry = (INTN)(BootEntryCount - 1);
-                        }
-                        EnsureSelectedEntryVisible();
-                        break;
-                    case SCAN_DOWN:
-                        // Same idea as above but moving forward; wrap to
-                        // the first entry when we reach the bottom.
-                        if ((UINTN)SelectedEntry < BootEntryCount - 1) {
-                            SelectedEntry++;
-                        } else if (BootEntryCount > 0) {
-                            SelectedEntry = 0;
-                        }
-                        EnsureSelectedEntryVisible();
-                        break;
-                    case SCAN_ESC:
-                        return EFI_ABORTED;
-                }
-                break;
-        }
     }
-    return EFI_SUCCESS;
+
+    if (RedrawTick) {
+        gBS->CloseEvent(RedrawTick);
+    }
+    return Result;
 }
 
 /**
   Helper function to print text at specific coordinates with foreground and background colors.
+  In graphics mode the text is drawn into the back buffer and shows up on
+  the next FlushGraphics; otherwise it goes to the firmware text console.
   
   @param[in] X          The X coordinate.
   @param[in] Y          The Y coordinate.
@@ -550,6 +734,24 @@ PrintXY(
     UnicodeVSPrint(Buffer, sizeof(Buffer), Format, Args);
     VA_END(Args);
     
+    // Graphics mode: render into the back buffer with the default font so
+    // the text reaches the screen with the rest of the frame. BgColor 0
+    // means transparent, as used by callers drawing over the menu box.
+    Font* font = GetDefaultFont();
+    if (font && GetBackBuffer(NULL, NULL)) {
+        GlyphRenderOptions options = {0};
+        options.color = FgColor;
+        options.bg_color = BgColor;
+        options.opacity = 255;
+        options.use_bg = (BgColor != 0x00000000);
+        RenderText(font, (const wchar_t*)Buffer, (int32_t)X, (int32_t)Y, &options);
+        return;
+    }
+
+    // The firmware console writes to the screen directly; get the composed
+    // frame out first so a later flush does not paint over this text.
+    FlushGraphics();
+    
     // Set cursor position in the firmware text console coordinate system.
     gST->ConOut->SetCursorPosition(gST->ConOut, (UINTN)X, (UINTN)Y);
     
@@ -569,3 +771,109 @@ PrintXY(
     // firmware output is not accidentally tinted by our attributes.
     gST->ConOut->SetAttribute(gST->ConOut, EFI_TEXT_ATTR(EFI_WHITE, EFI_BLACK));
 }
+
+// Load progress panel, centered above the bottom edge of the screen
+#define PROGRESS_PANEL_WIDTH    480
+#define PROGRESS_PANEL_HEIGHT   64
+#define PROGRESS_PANEL_MARGIN   40
+#define PROGRESS_BAR_HEIGHT     8
+
+// Last path or URL component, which is what tells loads apart
+static CONST CHAR16*
+ProgressBaseName(CONST CHAR16* Name)
+{
+    CONST CHAR16* Base = Name;
+    for (; *Name != L'\0'; Name++) {
+        if ((*Name == L'\\' || *Name == L'/') && Name[1] != L'\0') {
+            Base = Name + 1;
+        }
+    }
+    return Base;
+}
+
+// "done / total MB  rate MB/s  ETA s", in tenths of a MiB
+static VOID
+FormatLoadProgress(CONST LOAD_PROGRESS* Progress, UINT64 Done, CHAR16* Buffer, UINTN Size)
+{
+    UINT64 DoneTenths = Done * 10 / SIZE_1MB;
+    UINT64 RateTenths = Progress->BytesPerSecond * 10 / SIZE_1MB;
+
+    if (Progress->Finished) {
+        UINT64 Ms = Progress->ElapsedUs / 1000;
+        UnicodeSPrint(Buffer, Size, L"%lu.%lu MB in %lu.%lu s, %lu.%lu MB/s",
+                      DoneTenths / 10, DoneTenths % 10, Ms / 1000, Ms % 1000 / 100, RateTenths / 10, RateTenths % 10);
+    } else if (Progress->Total != 0) {
+        UINT64 TotalTenths = Progress->Total * 10 / SIZE_1MB;
+        UnicodeSPrint(Buffer, Size, L"%lu.%lu / %lu.%lu MB  %lu.%lu MB/s  ETA %lu s",
+                      DoneTenths / 10, DoneTenths % 10, TotalTenths / 10, TotalTenths % 10,
+                      RateTenths / 10, RateTenths % 10, Progress->EtaSeconds);
+    } else {
+        UnicodeSPrint(Buffer, Size, L"%lu.%lu MB  %lu.%lu MB/s",
+                      DoneTenths / 10, DoneTenths % 10, RateTenths / 10, RateTenths % 10);
+    }
+}
+
+// LOAD_PROGRESS_HOOK: repaints the panel, at most ~10 times a second. The
+// menu has released its back buffer by the time anything loads, so the
+// panel usually goes straight to the framebuffer; with a back buffer it
+// is marked dirty and flushed alone. Without graphics it is one console
+// line rewritten in place.
+static VOID
+DrawLoadProgress(CONST LOAD_PROGRESS* Progress)
+{
+    const struct BootMenuTheme* theme = GetBootMenuTheme();
+    UINT64 Done = Progress->Total != 0 ? MIN(Progress->Done, Progress->Total) : Progress->Done;
+    CONST CHAR16* Name = ProgressBaseName(Progress->Name);
+    CHAR16 Figures[96];
+    Font* font = GetDefaultFont();
+
+    FormatLoadProgress(Progress, Done, Figures, sizeof(Figures));
+
+    if (GraphicsOutput == NULL || font == NULL) {
+        // Padded so a shorter line covers the last one
+        Print(L"\r%-24s %-52s", Name, Figures);
+        if (Progress->Finished) {
+            Print(L"\n");
+        }
+        return;
+    }
+
+    UINT32 ScreenWidth = GraphicsOutput->Mode->Info->HorizontalResolution;
+    UINT32 ScreenHeight = GraphicsOutput->Mode->Info->VerticalResolution;
+    UINT32 Width = MIN(PROGRESS_PANEL_WIDTH, ScreenWidth);
+    UINT32 X = (ScreenWidth - Width) / 2;
+    UINT32 Y = ScreenHeight > PROGRESS_PANEL_HEIGHT + PROGRESS_PANEL_MARGIN ?
+               ScreenHeight - PROGRESS_PANEL_HEIGHT - PROGRESS_PANEL_MARGIN : 0;
+    UINT32 BarWidth = Width - 24;
+    UINT32 Filled = Progress->Total != 0 ? (UINT32)(Done * BarWidth / Progress->Total) : 0;
+
+    DrawRect(X, Y, Width, PROGRESS_PANEL_HEIGHT, theme->header_color);
+
+    GlyphRenderOptions options = {0};
+    options.color = theme->selected_text_color;
+    options.opacity = 255;
+    RenderText(font, (const wchar_t*)Name, (int32_t)X + 12, (int32_t)Y + 8, &options);
+    options.color = theme->text_color;
+    RenderText(font, (const wchar_t*)Figures, (int32_t)X + 12, (int32_t)Y + 28, &options);
+
+    // A bar only when there is a size to measure against
+    if (Progress->Total != 0) {
+        UINT32 BarY = Y + PROGRESS_PANEL_HEIGHT - 12;
+        DrawRect(X + 12, BarY, BarWidth, PROGRESS_BAR_HEIGHT, theme->background_color);
+        if (Filled != 0) {
+            DrawRect(X + 12, BarY, Filled, PROGRESS_BAR_HEIGHT, theme->highlight_color);
+        }
+    }
+    FlushGraphics();
+}
+
+/**
+  Shows a progress panel (bytes done, MB/s and ETA) during loads that take
+  longer than a moment: kernels, initrds and network downloads.
+**/
+VOID
+EFIAPI
+InstallLoadProgressOverlay(VOID)
+{
+    SetLoadProgressHook(DrawLoadProgress);
+}
@@ -33,4 +33,9 @@ PrintXY(
     ...
 );
 
+// Show a progress panel (bytes, MB/s, ETA) during long file loads and
+// downloads
+VOID EFIAPI
+InstallLoadProgressOverlay(VOID);
+
 #endif // _BOOT_MENU_H_
\ No newline at end of file
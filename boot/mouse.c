@@ -9,22 +9,104 @@
 #include "compat.h"
 #include <Uefi.h>
 #include <Library/UefiBootServicesTableLib.h>
+#include <Library/MemoryAllocationLib.h>
 #include <Protocol/SimplePointer.h>
+#include <Protocol/AbsolutePointer.h>
 
-static EFI_SIMPLE_POINTER_PROTOCOL* SimplePointer = NULL;
+static EFI_SIMPLE_POINTER_PROTOCOL* SimplePointers[MOUSE_MAX_DEVICES];
+static UINTN SimplePointerCount = 0;
+static EFI_ABSOLUTE_POINTER_PROTOCOL* AbsolutePointers[MOUSE_MAX_DEVICES];
+static UINTN AbsolutePointerCount = 0;
+static INT32 BoundsWidth = 0;
+static INT32 BoundsHeight = 0;
+
+// Every instance of a protocol, not just the first: a touch panel and a
+// USB mouse commonly coexist
+static UINTN
+LocatePointers(EFI_GUID* guid, VOID** out) {
+    EFI_HANDLE* handles = NULL;
+    UINTN handle_count = 0;
+    UINTN found = 0;
+
+    if (EFI_ERROR(gBS->LocateHandleBuffer(ByProtocol, guid, NULL, &handle_count, &handles))) {
+        return 0;
+    }
+    for (UINTN i = 0; i < handle_count && found < MOUSE_MAX_DEVICES; i++) {
+        if (!EFI_ERROR(gBS->HandleProtocol(handles[i], guid, &out[found]))) {
+            found++;
+        }
+    }
+    FreePool(handles);
+    return found;
+}
 
 VOID EFIAPI InitMouse(VOID) {
-    EFI_STATUS Status;
-    Status = gBS->LocateProtocol(&gEfiSimplePointerProtocolGuid, NULL, (VOID**)&SimplePointer);
+    SimplePointerCount = LocatePointers(&gEfiSimplePointerProtocolGuid, (VOID**)SimplePointers);
+    AbsolutePointerCount = LocatePointers(&gEfiAbsolutePointerProtocolGuid, (VOID**)AbsolutePointers);
+    for (UINTN i = 0; i < SimplePointerCount; i++) {
+        SimplePointers[i]->Reset(SimplePointers[i], FALSE);
+    }
+    for (UINTN i = 0; i < AbsolutePointerCount; i++) {
+        AbsolutePointers[i]->Reset(AbsolutePointers[i], FALSE);
+    }
+}
+
+VOID EFIAPI SetMouseBounds(INT32 width, INT32 height) {
+    BoundsWidth = width;
+    BoundsHeight = height;
+}
+
+UINTN EFIAPI GetMouseWaitEvents(EFI_EVENT* events, UINTN capacity) {
+    UINTN count = 0;
+    for (UINTN i = 0; i < SimplePointerCount && count < capacity; i++) {
+        events[count++] = SimplePointers[i]->WaitForInput;
+    }
+    for (UINTN i = 0; i < AbsolutePointerCount && count < capacity; i++) {
+        events[count++] = AbsolutePointers[i]->WaitForInput;
+    }
+    return count;
+}
+
+// Map an absolute axis reading onto [0, extent)
+static INT32
+ScaleAxis(UINT64 value, UINT64 min, UINT64 max, INT32 extent) {
+    if (max <= min || extent <= 0) {
+        return (INT32)value;
+    }
+    value = (value < min) ? min : (value > max ? max : value);
+    return (INT32)((value - min) * (UINT64)(extent - 1) / (max - min));
+}
+
+BOOLEAN EFIAPI GetMouseState(struct MouseState* state) {
+    struct MouseState before;
+
+    if (!state) return FALSE;
+    before = *state;
+
+    // GetState only reports EFI_SUCCESS when something happened since the
+    // last call, so idle devices cost one call each and change nothing
+    for (UINTN i = 0; i < SimplePointerCount; i++) {
+        EFI_SIMPLE_POINTER_STATE mouse;
+        if (EFI_ERROR(SimplePointers[i]->GetState(SimplePointers[i], &mouse))) continue;
+        state->x += (INT32)mouse.RelativeMovementX;
+        state->y += (INT32)mouse.RelativeMovementY;
+        state->left_button = mouse.LeftButton ? TRUE : FALSE;
+        state->right_button = mouse.RightButton ? TRUE : FALSE;
+    }
+    for (UINTN i = 0; i < AbsolutePointerCount; i++) {
+        EFI_ABSOLUTE_POINTER_STATE touch;
+        EFI_ABSOLUTE_POINTER_MODE* mode = AbsolutePointers[i]->Mode;
+        if (EFI_ERROR(AbsolutePointers[i]->GetState(AbsolutePointers[i], &touch))) continue;
+        state->x = ScaleAxis(touch.CurrentX, mode->AbsoluteMinX, mode->AbsoluteMaxX, BoundsWidth);
+        state->y = ScaleAxis(touch.CurrentY, mode->AbsoluteMinY, mode->AbsoluteMaxY, BoundsHeight);
+        state->left_button = (touch.ActiveButtons & EFI_ABSP_TouchActive) ? TRUE : FALSE;
+        state->right_button = (touch.ActiveButtons & EFI_ABS_AltActive) ? TRUE : FALSE;
+    }
+
+    if (BoundsWidth > 0 && BoundsHeight > 0) {
+        state->x = (state->x < 0) ? 0 : (state->x >= BoundsWidth ? BoundsWidth - 1 : state->x);
+        state->y = (state->y < 0) ? 0 : (state->y >= BoundsHeight ? BoundsHeight - 1 : state->y);
+    }
+    return before.x != state->x || before.y != state->y ||
+           before.left_button != state->left_button || before.right_button != state->right_button;
 }
-VOID EFIAPI GetMouseState(struct MouseState* state) {
-    if (!SimplePointer || !state) return;
-
-    EFI_SIMPLE_POINTER_STATE Mouse;
-    EFI_STATUS Status = SimplePointer->GetState(SimplePointer, &Mouse);
-    if (EFI_ERROR(Status)) return;
-    state->x += (INT32)Mouse.RelativeMovementX;
-    state->y += (INT32)Mouse.RelativeMovementY;
-    state->left_button = Mouse.LeftButton ? TRUE : FALSE;
-    state->right_button = Mouse.RightButton ? TRUE : FALSE;
-}
\ No newline at end of file
@@ -11,6 +11,9 @@
 #include <Uefi.h>
 #include "compat.h"
 
+// Pointer devices (relative and absolute) watched at once
+#define MOUSE_MAX_DEVICES 4
+
 struct MouseState {
     INT32 x;
     INT32 y;
@@ -19,6 +22,15 @@ struct MouseState {
 };
 
 VOID EFIAPI InitMouse(VOID);
-VOID EFIAPI GetMouseState(struct MouseState* state);
 
-#endif // BLOODHORN_MOUSE_H
\ No newline at end of file
+// Fold any pending movement into *state. Returns TRUE if it changed.
+BOOLEAN EFIAPI GetMouseState(struct MouseState* state);
+
+// Screen area the pointer moves in; absolute devices are scaled to it
+VOID EFIAPI SetMouseBounds(INT32 width, INT32 height);
+
+// WaitForInput events of the pointer devices, for the caller's
+// WaitForEvent set. Returns how many were stored.
+UINTN EFIAPI GetMouseWaitEvents(EFI_EVENT* events, UINTN capacity);
+
+#endif // BLOODHORN_MOUSE_H
@@ -0,0 +1,251 @@
+/*
+ * payload.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include "payload.h"
+#include "compat.h"
+#include "secure.h"
+#include "../security/crypto.h"
+#include "../security/secure_boot.h"
+#include "libb/include/bloodhorn/counters.h"
+#include <Library/UefiLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiRuntimeServicesTableLib.h>
+#include <Library/BaseLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Guid/GlobalVariable.h>
+#include <Protocol/FirmwareVolume2.h>
+
+#if BH_PAYLOAD_BUNDLE == PAYLOAD_SOURCE_IMAGE
+// mPayloadBundle (UINT64 words, so the header is aligned) and
+// mPayloadBundleSize, written by mkpayload.py --header
+#include "payload_data.h"
+#endif
+
+#if BH_PAYLOAD_BUNDLE == PAYLOAD_SOURCE_FV
+/**
+  Reads the bundle's RAW section from whichever firmware volume carries
+  PAYLOAD_BUNDLE_FILE_GUID, into pool the firmware allocates.
+**/
+STATIC EFI_STATUS
+ReadPayloadFromFv(
+    OUT VOID    **Buffer,
+    OUT UINTN   *Size
+) {
+    EFI_GUID FileGuid = PAYLOAD_BUNDLE_FILE_GUID;
+    EFI_HANDLE *Handles = NULL;
+    UINTN Count = 0;
+    EFI_STATUS Status;
+
+    Status = gBS->LocateHandleBuffer(ByProtocol, &gEfiFirmwareVolume2ProtocolGuid, NULL, &Count, &Handles);
+    if (EFI_ERROR(Status)) {
+        return EFI_NOT_FOUND;
+    }
+    Status = EFI_NOT_FOUND;
+    for (UINTN i = 0; i < Count; i++) {
+        EFI_FIRMWARE_VOLUME2_PROTOCOL *Fv;
+        UINT32 Authentication;
+
+        if (EFI_ERROR(gBS->HandleProtocol(Handles[i], &gEfiFirmwareVolume2ProtocolGuid, (VOID **)&Fv))) {
+            continue;
+        }
+        *Buffer = NULL;
+        *Size = 0;
+        Status = Fv->ReadSection(Fv, &FileGuid, EFI_SECTION_RAW, 0, Buffer, Size, &Authentication);
+        if (!EFI_ERROR(Status)) {
+            bh_counters_add_read(BH_COUNTER_SOURCE_FIRMWARE, *Size);
+            break;
+        }
+    }
+    FreePool(Handles);
+    return Status;
+}
+#endif
+
+// The section lies inside the signed part and starts on a page boundary
+STATIC BOOLEAN
+PayloadEntryValid(CONST PAYLOAD_TOC_ENTRY *Entry, UINT32 SignedSize) {
+    return Entry->Offset % PAYLOAD_SECTION_ALIGN == 0 &&
+           (UINT64)Entry->Offset + Entry->Size <= SignedSize;
+}
+
+/**
+  Checks the header and TOC and points Bundle at the first section of
+  each type. Unknown types are skipped.
+**/
+STATIC EFI_STATUS
+ParsePayloadBundle(
+    IN OUT PAYLOAD_BUNDLE   *Bundle
+) {
+    CONST PAYLOAD_BUNDLE_HEADER *Header = (CONST PAYLOAD_BUNDLE_HEADER *)Bundle->Buffer;
+    CONST PAYLOAD_TOC_ENTRY *Toc;
+
+    if (Bundle->Size < sizeof(*Header) || Header->Magic != PAYLOAD_BUNDLE_MAGIC ||
+        Header->Version != PAYLOAD_BUNDLE_VERSION || Header->SignedSize > Bundle->Size ||
+        (UINT64)Header->TocOffset + (UINT64)Header->EntryCount * sizeof(PAYLOAD_TOC_ENTRY) > Header->SignedSize) {
+        return EFI_VOLUME_CORRUPTED;
+    }
+
+    Toc = (CONST PAYLOAD_TOC_ENTRY *)(Bundle->Buffer + Header->TocOffset);
+    for (UINTN i = 0; i < Header->EntryCount; i++) {
+        CONST UINT8 *Section = Bundle->Buffer + Toc[i].Offset;
+
+        if (!PayloadEntryValid(&Toc[i], Header->SignedSize)) {
+            return EFI_VOLUME_CORRUPTED;
+        }
+        switch (Toc[i].Type) {
+            case PAYLOAD_TYPE_KERNEL:
+                if (Bundle->Kernel == NULL) {
+                    Bundle->Kernel = Section;
+                    Bundle->KernelSize = Toc[i].Size;
+                }
+                break;
+            case PAYLOAD_TYPE_INITRD:
+                if (Bundle->Initrd == NULL) {
+                    Bundle->Initrd = Section;
+                    Bundle->InitrdSize = Toc[i].Size;
+                }
+                break;
+            case PAYLOAD_TYPE_CONFIG:
+                if (Bundle->Config == NULL) {
+                    Bundle->Config = Section;
+                    Bundle->ConfigSize = Toc[i].Size;
+                }
+                break;
+            case PAYLOAD_TYPE_HASHES:
+                if (Bundle->Hashes == NULL) {
+                    Bundle->Hashes = (CONST CHAR8 *)Section;
+                    Bundle->HashesSize = Toc[i].Size;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return EFI_SUCCESS;
+}
+
+/**
+  Finds, reads and verifies the payload bundle of this build.
+
+  The firmware volume copy is read with one ReadSection; a compiled-in
+  bundle is not read at all. Either way the signature is checked over the
+  whole bundle before any section is looked at, so the sections need no
+  hashes of their own.
+
+  @retval EFI_SUCCESS               Bundle points at a verified bundle.
+  @retval EFI_NOT_FOUND             The build or the firmware has no bundle.
+  @retval EFI_VOLUME_CORRUPTED      The header or TOC is malformed.
+  @retval EFI_SECURITY_VIOLATION    No PK to check it with, or the signature
+                                    does not verify or is revoked.
+**/
+EFI_STATUS
+LoadPayloadBundle(
+    OUT PAYLOAD_BUNDLE  *Bundle
+) {
+    UINT8 PublicKey[4 + 2 * CRYPTO_RSA4096_KEY_LENGTH];
+    UINTN PublicKeySize = sizeof(PublicKey);
+    CONST PAYLOAD_BUNDLE_HEADER *Header;
+    VOID *Pool = NULL;
+    int SignatureSize;
+    EFI_STATUS Status;
+
+    if (Bundle == NULL) {
+        return EFI_INVALID_PARAMETER;
+    }
+    ZeroMem(Bundle, sizeof(*Bundle));
+
+#if BH_PAYLOAD_BUNDLE == PAYLOAD_SOURCE_IMAGE
+    Bundle->Buffer = (CONST UINT8 *)mPayloadBundle;
+    Bundle->Size = mPayloadBundleSize;
+#elif BH_PAYLOAD_BUNDLE == PAYLOAD_SOURCE_FV
+    Status = ReadPayloadFromFv(&Pool, &Bundle->Size);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    Bundle->Buffer = (CONST UINT8 *)Pool;
+#else
+    return EFI_NOT_FOUND;
+#endif
+
+    Header = (CONST PAYLOAD_BUNDLE_HEADER *)Bundle->Buffer;
+    if (Bundle->Size < sizeof(*Header) || Header->Magic != PAYLOAD_BUNDLE_MAGIC) {
+        Status = EFI_VOLUME_CORRUPTED;
+        goto Fail;
+    }
+
+    // The signature follows the signed part; anything after it is padding
+    // from the section or the compiled-in word array
+    Status = gRT->GetVariable(L"PK", &gEfiGlobalVariableGuid, NULL, &PublicKeySize, PublicKey);
+    if (EFI_ERROR(Status)) {
+        Status = EFI_SECURITY_VIOLATION;
+    } else {
+        SignatureSize = secure_boot_signature_length(SECURE_BOOT_SIG_RSA_PKCS1_SHA256, PublicKey,
+                                                     (uint32_t)PublicKeySize);
+        if (SignatureSize <= 0 || (UINT64)Header->SignedSize + (UINT64)SignatureSize > Bundle->Size) {
+            Status = EFI_SECURITY_VIOLATION;
+        } else {
+            Status = VerifyImageSignature(Bundle->Buffer, Header->SignedSize + (UINTN)SignatureSize,
+                                          PublicKey, PublicKeySize);
+        }
+    }
+    crypto_memzero_secure(PublicKey, sizeof(PublicKey));
+    if (EFI_ERROR(Status)) {
+        goto Fail;
+    }
+
+    Status = ParsePayloadBundle(Bundle);
+    if (!EFI_ERROR(Status)) {
+        return EFI_SUCCESS;
+    }
+
+Fail:
+    if (Pool != NULL) {
+        FreePool(Pool);
+    }
+    ZeroMem(Bundle, sizeof(*Bundle));
+    return Status;
+}
+
+EFI_STATUS
+ForEachPayloadSetting(
+    IN CONST PAYLOAD_BUNDLE *Bundle,
+    IN config_entry_fn      Fn,
+    IN VOID                 *Context
+) {
+    CONST UINT8 *At = Bundle->Config;
+    CONST UINT8 *End = At + Bundle->ConfigSize;
+    UINT32 Line = 0;
+
+    while (At < End) {
+        PAYLOAD_SETTING Setting;
+        UINTN Length;
+
+        if ((UINTN)(End - At) < sizeof(Setting)) {
+            return EFI_VOLUME_CORRUPTED;
+        }
+        CopyMem(&Setting, At, sizeof(Setting));
+        At += sizeof(Setting);
+        Length = (UINTN)Setting.SectionLength + Setting.KeyLength + Setting.ValueLength;
+        if ((UINTN)(End - At) < Length) {
+            return EFI_VOLUME_CORRUPTED;
+        }
+
+        config_entry Entry = {
+            { (CONST char *)At, Setting.SectionLength },
+            { (CONST char *)At + Setting.SectionLength, Setting.KeyLength },
+            { (CONST char *)At + Setting.SectionLength + Setting.KeyLength, Setting.ValueLength },
+            0,
+            ++Line
+        };
+        At += Length;
+        if (Fn(Context, &Entry) != 0) {
+            break;
+        }
+    }
+    return EFI_SUCCESS;
+}
@@ -0,0 +1,124 @@
+/*
+ * payload.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_PAYLOAD_H
+#define BLOODHORN_PAYLOAD_H
+
+#include <Uefi.h>
+#include "compat.h"
+#include "../config/config_parse.h"
+
+// Payload bundle: the kernel, initrd, settings and allowlist of a
+// single-purpose device, built offline (mkpayload.py) and shipped inside
+// BloodHorn.efi or a firmware volume instead of on a filesystem. It is
+// read in one go, its signature checked once, and then used in place.
+// Little-endian:
+//
+//   PAYLOAD_BUNDLE_HEADER
+//   PAYLOAD_TOC_ENTRY[EntryCount]  at TocOffset
+//   section payloads               each PAYLOAD_SECTION_ALIGN aligned
+//   RSA PKCS#1 SHA-256 signature   over everything before it, under PK
+#define PAYLOAD_BUNDLE_MAGIC        0x42504842  // "BHPB"
+#define PAYLOAD_BUNDLE_VERSION      1
+#define PAYLOAD_SECTION_ALIGN       4096
+#define PAYLOAD_NAME_LENGTH         16
+
+#define PAYLOAD_TYPE_KERNEL         1   // bzImage, stored uncompressed
+#define PAYLOAD_TYPE_INITRD         2   // One or more cpio archives, each 4-byte aligned
+#define PAYLOAD_TYPE_CONFIG         3   // PAYLOAD_SETTING records
+#define PAYLOAD_TYPE_HASHES         4   // known_hashes manifest text, unsigned
+
+// Where the build looks for its bundle, from PcdPayloadBundle in
+// BloodHornPcd.dsc. NONE leaves the boot as it always was.
+#define PAYLOAD_SOURCE_NONE         0
+#define PAYLOAD_SOURCE_IMAGE        1   // Compiled in from boot/payload_data.h
+#define PAYLOAD_SOURCE_FV           2   // FREEFORM file PAYLOAD_BUNDLE_FILE_GUID in a firmware volume
+
+#ifndef BH_PAYLOAD_BUNDLE
+#ifdef _PCD_VALUE_PcdPayloadBundle
+#define BH_PAYLOAD_BUNDLE _PCD_VALUE_PcdPayloadBundle
+#else
+#define BH_PAYLOAD_BUNDLE PAYLOAD_SOURCE_NONE
+#endif
+#endif
+
+// PcdPayloadBundleFallback: FALSE refuses to boot anything else when the
+// bundle is missing, forged or its kernel does not start
+#ifndef BH_PAYLOAD_FALLBACK
+#ifdef _PCD_VALUE_PcdPayloadBundleFallback
+#define BH_PAYLOAD_FALLBACK _PCD_VALUE_PcdPayloadBundleFallback
+#else
+#define BH_PAYLOAD_FALLBACK 1
+#endif
+#endif
+
+// Name of the bundle's file in BloodHorn.fdf
+#define PAYLOAD_BUNDLE_FILE_GUID \
+    { 0x9d1b4e27, 0x6c35, 0x4a8f, { 0xb0, 0xe2, 0x5f, 0x7a, 0x41, 0xc9, 0x3d, 0x06 } }
+
+#pragma pack(push, 1)
+typedef struct {
+    UINT32  Magic;
+    UINT16  Version;
+    UINT16  EntryCount;
+    UINT32  TocOffset;
+    UINT32  SignedSize;                 // Header to the end of the last section
+} PAYLOAD_BUNDLE_HEADER;
+
+typedef struct {
+    UINT32  Type;                       // PAYLOAD_TYPE_*
+    UINT32  Offset;                     // From the start of the bundle
+    UINT32  Size;
+    UINT32  Reserved;
+    CHAR8   Name[PAYLOAD_NAME_LENGTH];  // Path the section stands for, NUL padded
+} PAYLOAD_TOC_ENTRY;
+
+// One setting, already split and unescaped by mkpayload.py; the section,
+// key and value bytes follow without terminators
+typedef struct {
+    UINT8   SectionLength;
+    UINT8   KeyLength;
+    UINT16  ValueLength;
+} PAYLOAD_SETTING;
+#pragma pack(pop)
+
+// A verified bundle and the sections the boot uses; a missing section
+// has a NULL pointer and size 0
+typedef struct {
+    CONST UINT8 *Buffer;
+    UINTN       Size;
+    CONST UINT8 *Kernel;
+    UINT32      KernelSize;
+    CONST UINT8 *Initrd;
+    UINT32      InitrdSize;
+    CONST UINT8 *Config;
+    UINT32      ConfigSize;
+    CONST CHAR8 *Hashes;
+    UINT32      HashesSize;
+} PAYLOAD_BUNDLE;
+
+// Find the bundle this build was made with, read it with a single read,
+// check its layout and its signature under PK, and point Bundle at its
+// sections. EFI_NOT_FOUND when the build or the firmware has none. The
+// bundle stays loaded for the rest of the boot.
+EFI_STATUS
+LoadPayloadBundle(
+    OUT PAYLOAD_BUNDLE  *Bundle
+);
+
+// Hand every setting of the CONFIG section to Fn as a config_entry, the
+// same way the INI and JSON tokenizers do; values are never escaped and
+// `line` counts records. EFI_VOLUME_CORRUPTED if a record overruns the
+// section, after the ones before it were applied.
+EFI_STATUS
+ForEachPayloadSetting(
+    IN CONST PAYLOAD_BUNDLE *Bundle,
+    IN config_entry_fn      Fn,
+    IN VOID                 *Context
+);
+
+#endif // BLOODHORN_PAYLOAD_H
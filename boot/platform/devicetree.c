@@ -12,101 +12,377 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include "devicetree.h"
+#include "fdt.h"
 #include "platform.h"
 #include "uboot.h"
 #include "openfirmware.h"
 #include "../libb/include/bloodhorn/bootinfo.h"
+#include "../libb/include/bloodhorn/hash.h"
 #include "../Arch32/powerpc.h"
 
+#define DT_TAG_SIZE         4
+#define DT_HEADER_SIZE      40      // Version 17 header
+#define DT_RSV_ENTRY_SIZE   16
+#define DT_MAX_DEPTH        64
+#define DT_ALIGN4(x)        (((x) + 3) & ~(size_t)3)
+
 // Global device tree state
 static struct device_tree_node* dt_root = NULL;
 static void* dt_blob = NULL;
 static size_t dt_blob_size = 0;
 static bool dt_initialized = false;
 
-// Memory allocation tracking
-struct dt_memory_block {
-    void* ptr;
-    size_t size;
-    struct dt_memory_block* next;
+// Tree arena: a libb arena for the tree's memory plus recycled property
+// records
+struct dt_index;
+
+struct dt_arena {
+    bh_arena_t* mem;
+    struct device_tree_property* free_props;    // Removed, reusable
+    struct dt_index* index;                     // Lookup indexes, NULL until needed
+    const uint8_t* rsvmap;                      // Reserve map of the parsed blob,
+    uint32_t rsvmap_size;                       // terminator included
+    uint32_t boot_cpuid_phys;
+};
+
+// Lookup indexes of one tree: open-addressed tables in one heap block.
+// Equal keys keep document order along their probe sequence, so the first
+// match is the first node in the tree.
+struct dt_index_slot {
+    uint32_t hash;                  // Path/compatible hash, or the phandle
+    const char* key;                // Compatible string (by_compat only)
+    struct device_tree_node* node;  // NULL = empty
 };
 
-static struct dt_memory_block* dt_memory_blocks = NULL;
+struct dt_index_table {
+    struct dt_index_slot* slots;
+    uint32_t mask;
+    uint32_t used;
+};
+
+struct dt_index {
+    struct dt_index_table by_phandle;
+    struct dt_index_table by_path;
+    struct dt_index_table by_compat;
+    bool compat_stale;              // A compatible list changed since the build
+};
 
 // Error tracking
 static char dt_last_error[256] = {0};
 
+// Serialised form of a tree, measured before anything is written
+struct dt_fdt_layout {
+    uint32_t* table;                // Name hashes to offsets (scratch block)
+    uint32_t* nameoffs;             // Name offset of each property, in write order
+    char* strings;                  // Deduplicated strings block
+    uint32_t strings_size;
+    uint32_t struct_size;
+    const uint8_t* rsvmap;
+    uint32_t rsvmap_size;
+    uint32_t boot_cpuid_phys;
+    size_t total;
+};
+
 // Helper functions
 static void* dt_malloc(size_t size);
 static void dt_free(void* ptr);
 static void* dt_realloc(void* ptr, size_t size);
 static void dt_set_error(const char* format, ...);
 static char* dt_strdup(const char* str);
+static struct dt_arena* dt_arena_create(void);
+static void dt_arena_destroy(struct dt_arena* arena);
+static void* dt_arena_alloc(struct dt_arena* arena, size_t size);
+static char* dt_arena_strdup(struct dt_arena* arena, const char* str);
+static struct dt_arena* dt_node_arena(struct device_tree_node* node);
+static struct dt_index* dt_tree_index(const struct device_tree_node* root);
+static void dt_index_invalidate(const struct device_tree_node* node);
+static void dt_index_add_path(struct device_tree_node* node);
+static void dt_index_add_phandle(struct device_tree_node* node);
+static bh_status_t dt_update_path(struct device_tree_node* node);
 static uint32_t dt_be32_to_cpu(uint32_t val);
 static uint32_t dt_cpu_to_be32(uint32_t val);
 static uint64_t dt_be64_to_cpu(uint64_t val);
 static uint64_t dt_cpu_to_be64(uint64_t val);
+static struct device_tree_node* dt_new_root(void);
 static bh_status_t dt_parse_fdt_blob(const void* blob, size_t size, struct device_tree_node** root);
+static bh_status_t dt_measure_fdt_blob(const struct device_tree_node* root, struct dt_fdt_layout* layout);
+static void dt_write_fdt_blob(const struct device_tree_node* root, const struct dt_fdt_layout* layout, uint8_t* out);
 static bh_status_t dt_build_fdt_blob(const struct device_tree_node* root, void** blob, size_t* size);
-static bh_status_t dt_parse_node_properties(const void* blob, const void* prop_ptr, 
-                                           struct device_tree_node* node);
-static bh_status_t dt_parse_node_children(const void* blob, const void* struct_ptr, 
-                                         struct device_tree_node* parent);
-static bh_status_t dt_write_node_to_blob(const struct device_tree_node* node, void** blob, 
-                                        size_t* offset, const char* strings_block, 
-                                        size_t* strings_offset);
-static bh_status_t dt_write_property_to_blob(const struct device_tree_property* prop, 
-                                             void** blob, size_t* offset, 
-                                             const char* strings_block, 
-                                             size_t* strings_offset);
-
-// Memory allocation with tracking
+static struct device_tree_property* dt_new_property(struct dt_arena* arena, char* name,
+                                                    const void* value, size_t length);
+static void dt_property_changed(struct device_tree_node* node, const struct device_tree_property* prop);
+
+// Heap memory handed to callers (blobs, strings, region arrays); tree
+// memory comes from the arena below
 static void* dt_malloc(size_t size) {
-    void* ptr = platform_malloc(size);
-    if (ptr) {
-        struct dt_memory_block* block = platform_malloc(sizeof(struct dt_memory_block));
-        if (block) {
-            block->ptr = ptr;
-            block->size = size;
-            block->next = dt_memory_blocks;
-            dt_memory_blocks = block;
-        }
-    }
-    return ptr;
+    return platform_malloc(size);
 }
 
 static void dt_free(void* ptr) {
     if (ptr) {
-        // Find and remove from tracking list
-        struct dt_memory_block** current = &dt_memory_blocks;
-        while (*current) {
-            if ((*current)->ptr == ptr) {
-                struct dt_memory_block* to_remove = *current;
-                *current = to_remove->next;
-                platform_free(to_remove);
-                break;
-            }
-            current = &(*current)->next;
-        }
         platform_free(ptr);
     }
 }
 
 static void* dt_realloc(void* ptr, size_t size) {
-    void* new_ptr = platform_realloc(ptr, size);
-    if (new_ptr && new_ptr != ptr) {
-        // Update tracking
-        struct dt_memory_block* current = dt_memory_blocks;
-        while (current) {
-            if (current->ptr == ptr) {
-                current->ptr = new_ptr;
-                current->size = size;
-                break;
+    return platform_realloc(ptr, size);
+}
+
+static struct dt_arena* dt_arena_create(void) {
+    struct dt_arena* arena = platform_malloc(sizeof(struct dt_arena));
+    if (arena) {
+        arena->mem = bh_arena_create(DT_ARENA_CHUNK_SIZE);
+        if (!arena->mem) {
+            platform_free(arena);
+            return NULL;
+        }
+        arena->free_props = NULL;
+        arena->index = NULL;
+        arena->rsvmap = NULL;
+        arena->rsvmap_size = 0;
+        arena->boot_cpuid_phys = 0;
+    }
+    return arena;
+}
+
+static void dt_arena_destroy(struct dt_arena* arena) {
+    if (!arena) {
+        return;
+    }
+    bh_arena_destroy(arena->mem);
+    dt_free(arena->index);
+    platform_free(arena);
+}
+
+static void* dt_arena_alloc(struct dt_arena* arena, size_t size) {
+    return bh_arena_alloc(arena->mem, size);
+}
+
+static char* dt_arena_strdup(struct dt_arena* arena, const char* str) {
+    size_t len = strlen(str) + 1;
+    char* copy = dt_arena_alloc(arena, len);
+    if (copy) {
+        memcpy(copy, str, len);
+    }
+    return copy;
+}
+
+// The arena of the tree `node` is in; a tree the caller built by hand gets
+// one on first use, owned by the node it was asked for
+static struct dt_arena* dt_node_arena(struct device_tree_node* node) {
+    if (!node->arena) {
+        node->arena = dt_arena_create();
+    }
+    return node->arena;
+}
+
+// Pre-order successor of `node` within the subtree rooted at `top`
+static struct device_tree_node* dt_tree_next(const struct device_tree_node* node,
+                                             const struct device_tree_node* top) {
+    if (node->children) {
+        return node->children;
+    }
+    while (node && node != top) {
+        if (node->sibling) {
+            return node->sibling;
+        }
+        node = node->parent;
+    }
+    return NULL;
+}
+
+static struct device_tree_node* dt_tree_top(const struct device_tree_node* node) {
+    while (node->parent) {
+        node = node->parent;
+    }
+    return (struct device_tree_node*)node;
+}
+
+static bool dt_is_within(const struct device_tree_node* node, const struct device_tree_node* root) {
+    for (; node; node = node->parent) {
+        if (node == root) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t dt_hash_string(const char* str, size_t len) {
+    return bh_fnv1a(str, len);
+}
+
+static uint32_t dt_hash_phandle(uint32_t phandle) {
+    return phandle * 0x9E3779B1u;
+}
+
+// Slots for `count` keys at under half load, with room to grow in place
+static uint32_t dt_table_slots(uint32_t count) {
+    uint32_t slots = 16;
+    while (slots < 2 * count + 16) {
+        slots <<= 1;
+    }
+    return slots;
+}
+
+static bool dt_table_insert(struct dt_index_table* table, uint32_t hash, uint32_t probe,
+                            const char* key, struct device_tree_node* node) {
+    if ((table->used + 1) * 2 > table->mask + 1) {
+        return false;
+    }
+    uint32_t i = probe & table->mask;
+    while (table->slots[i].node) {
+        i = (i + 1) & table->mask;
+    }
+    table->slots[i].hash = hash;
+    table->slots[i].key = key;
+    table->slots[i].node = node;
+    table->used++;
+    return true;
+}
+
+static const struct device_tree_property* dt_compatible_prop(const struct device_tree_node* node) {
+    for (const struct device_tree_property* prop = node->properties; prop; prop = prop->next) {
+        if (strcmp(prop->name, "compatible") == 0) {
+            return prop;
+        }
+    }
+    return NULL;
+}
+
+static bool dt_node_is_compatible(const struct device_tree_node* node, const char* compatible, size_t len) {
+    const struct device_tree_property* prop = dt_compatible_prop(node);
+    const char* str = prop ? prop->value : NULL;
+    const char* end = str ? str + prop->length : NULL;
+    
+    while (str && str < end) {
+        const char* nul = memchr(str, '\0', (size_t)(end - str));
+        if (!nul) {
+            break;
+        }
+        if ((size_t)(nul - str) == len && memcmp(str, compatible, len) == 0) {
+            return true;
+        }
+        str = nul + 1;
+    }
+    return false;
+}
+
+// The number of distinct strings in a node's compatible list, each also
+// added to `table` when one is given
+static uint32_t dt_index_compatibles(struct device_tree_node* node, struct dt_index_table* table) {
+    const struct device_tree_property* prop = dt_compatible_prop(node);
+    const char* start = prop ? prop->value : NULL;
+    const char* end = start ? start + prop->length : NULL;
+    uint32_t count = 0;
+    
+    for (const char* str = start; str && str < end; ) {
+        const char* nul = memchr(str, '\0', (size_t)(end - str));
+        if (!nul) {
+            break;
+        }
+        
+        // Skip empty entries and repeats of an earlier entry
+        bool repeat = nul == str;
+        for (const char* prev = start; !repeat && prev < str; prev += strlen(prev) + 1) {
+            repeat = strcmp(prev, str) == 0;
+        }
+        if (!repeat) {
+            if (table) {
+                uint32_t hash = dt_hash_string(str, (size_t)(nul - str));
+                dt_table_insert(table, hash, hash, str, node);
             }
-            current = current->next;
+            count++;
+        }
+        str = nul + 1;
+    }
+    return count;
+}
+
+static struct dt_index* dt_index_build(struct device_tree_node* top) {
+    uint32_t nodes = 0, phandles = 0, compatibles = 0;
+    
+    for (struct device_tree_node* n = top; n; n = dt_tree_next(n, top)) {
+        nodes++;
+        phandles += n->phandle != 0;
+        compatibles += dt_index_compatibles(n, NULL);
+    }
+    
+    uint32_t phandle_slots = dt_table_slots(phandles);
+    uint32_t path_slots = dt_table_slots(nodes);
+    uint32_t compat_slots = dt_table_slots(compatibles);
+    size_t bytes = sizeof(struct dt_index) +
+                   (size_t)(phandle_slots + path_slots + compat_slots) * sizeof(struct dt_index_slot);
+    
+    struct dt_index* index = dt_malloc(bytes);
+    if (!index) {
+        return NULL;
+    }
+    memset(index, 0, bytes);
+    
+    struct dt_index_slot* slots = (struct dt_index_slot*)(index + 1);
+    index->by_phandle.slots = slots;
+    index->by_phandle.mask = phandle_slots - 1;
+    index->by_path.slots = slots + phandle_slots;
+    index->by_path.mask = path_slots - 1;
+    index->by_compat.slots = slots + phandle_slots + path_slots;
+    index->by_compat.mask = compat_slots - 1;
+    
+    for (struct device_tree_node* n = top; n; n = dt_tree_next(n, top)) {
+        if (n->phandle) {
+            dt_table_insert(&index->by_phandle, n->phandle, dt_hash_phandle(n->phandle), NULL, n);
+        }
+        if (n->full_path) {
+            uint32_t hash = dt_hash_string(n->full_path, strlen(n->full_path));
+            dt_table_insert(&index->by_path, hash, hash, NULL, n);
         }
+        dt_index_compatibles(n, &index->by_compat);
+    }
+    return index;
+}
+
+// The indexes of the tree holding `root`, built if missing; NULL when out
+// of memory (callers then walk the tree)
+static struct dt_index* dt_tree_index(const struct device_tree_node* root) {
+    struct device_tree_node* top = dt_tree_top(root);
+    struct dt_arena* arena = dt_node_arena(top);
+    
+    if (!arena) {
+        return NULL;
+    }
+    if (!arena->index) {
+        arena->index = dt_index_build(top);
+    }
+    return arena->index;
+}
+
+static void dt_index_invalidate(const struct device_tree_node* node) {
+    if (node && node->arena && node->arena->index) {
+        dt_free(node->arena->index);
+        node->arena->index = NULL;
+    }
+}
+
+// Keep a built index current for a new node or a first phandle, which the
+// tables have room for most of the time; otherwise drop it
+static void dt_index_add_path(struct device_tree_node* node) {
+    struct dt_index* index = node->arena ? node->arena->index : NULL;
+    if (!index) {
+        return;
+    }
+    uint32_t hash = dt_hash_string(node->full_path, strlen(node->full_path));
+    if (!dt_table_insert(&index->by_path, hash, hash, NULL, node)) {
+        dt_index_invalidate(node);
+    }
+}
+
+static void dt_index_add_phandle(struct device_tree_node* node) {
+    struct dt_index* index = node->arena ? node->arena->index : NULL;
+    if (!index) {
+        return;
+    }
+    if (!dt_table_insert(&index->by_phandle, node->phandle, dt_hash_phandle(node->phandle), NULL, node)) {
+        dt_index_invalidate(node);
     }
-    return new_ptr;
 }
 
 // Error handling
@@ -156,16 +432,13 @@ bh_status_t dt_load_from_blob(const void* blob, size_t size, struct device_tree_
         return BH_STATUS_INVALID_PARAMETER;
     }
     
-    // Validate FDT header
+    // Validate FDT header (block bounds too, which the parser relies on)
     const struct fdt_header* header = (const struct fdt_header*)blob;
-    if (dt_be32_to_cpu(header->magic) != FDT_MAGIC) {
-        dt_set_error("Invalid FDT magic number");
-        return BH_STATUS_INVALID_DATA;
-    }
-    
-    if (dt_be32_to_cpu(header->version) < FDT_VERSION) {
-        dt_set_error("Unsupported FDT version");
-        return BH_STATUS_UNSUPPORTED;
+    int err = fdt_check_header(blob);
+    if (err) {
+        dt_set_error(err == -FDT_ERR_BADMAGIC ? "Invalid FDT magic number" :
+                     err == -FDT_ERR_BADVERSION ? "Unsupported FDT version" : "Malformed FDT header");
+        return fdt_status(err);
     }
     
     if (dt_be32_to_cpu(header->totalsize) > size) {
@@ -220,6 +493,22 @@ bh_status_t dt_load_from_platform(void** blob, size_t* size) {
     return BH_STATUS_NOT_FOUND;
 }
 
+// Create an empty tree (a root node and nothing else) to build by hand;
+// dt_cleanup frees it
+bh_status_t dt_create_tree(struct device_tree_node** root) {
+    if (!root) {
+        dt_set_error("Invalid parameters");
+        return BH_STATUS_INVALID_PARAMETER;
+    }
+    
+    *root = dt_new_root();
+    if (!*root) {
+        dt_set_error("Memory allocation failed");
+        return BH_STATUS_NO_MEMORY;
+    }
+    return BH_STATUS_SUCCESS;
+}
+
 // Save device tree to flattened blob
 bh_status_t dt_save_to_blob(const struct device_tree_node* root, void** blob, size_t* size) {
     if (!root || !blob || !size) {
@@ -236,6 +525,32 @@ bh_status_t dt_save_to_blob(const struct device_tree_node* root, void** blob, si
     return status;
 }
 
+// Serialise into caller memory (e.g. pages placed for the kernel). With
+// too small a buffer (or none) *size still gets the exact size needed.
+bh_status_t dt_save_to_buffer(const struct device_tree_node* root, void* buffer, size_t capacity, size_t* size) {
+    if (!root || !size) {
+        dt_set_error("Invalid parameters");
+        return BH_STATUS_INVALID_PARAMETER;
+    }
+    
+    struct dt_fdt_layout layout;
+    bh_status_t status = dt_measure_fdt_blob(root, &layout);
+    if (status != BH_STATUS_SUCCESS) {
+        return status;
+    }
+    
+    *size = layout.total;
+    if (!buffer || capacity < layout.total) {
+        dt_free(layout.table);
+        dt_set_error("Buffer of %zu bytes too small for %zu-byte blob", capacity, layout.total);
+        return BH_STATUS_INVALID_PARAMETER;
+    }
+    
+    dt_write_fdt_blob(root, &layout, buffer);
+    dt_free(layout.table);
+    return BH_STATUS_SUCCESS;
+}
+
 // Validate device tree
 bh_status_t dt_validate(const struct device_tree_node* root, struct dt_validation_info* info) {
     if (!root || !info) {
@@ -267,75 +582,32 @@ bh_status_t dt_validate(const struct device_tree_node* root, struct dt_validatio
     return BH_STATUS_SUCCESS;
 }
 
-// Cleanup device tree
+// Cleanup device tree: the root's arena holds every node, name, path and
+// value of the tree, so one pass over its chunks frees it all
 bh_status_t dt_cleanup(struct device_tree_node* root) {
     if (!root) {
         return BH_STATUS_INVALID_PARAMETER;
     }
     
-    // Recursively free all nodes and properties
-    struct device_tree_node* current = root;
-    struct device_tree_node* next = NULL;
-    
-    while (current) {
-        // Free properties
-        struct device_tree_property* prop = current->properties;
-        while (prop) {
-            struct device_tree_property* next_prop = prop->next;
-            if (prop->name) {
-                dt_free(prop->name);
-            }
-            if (prop->value) {
-                dt_free(prop->value);
-            }
-            dt_free(prop);
-            prop = next_prop;
-        }
-        
-        // Free node name and path
-        if (current->name) {
-            dt_free(current->name);
-        }
-        if (current->full_path) {
-            dt_free(current->full_path);
-        }
-        
-        // Move to next node (depth-first traversal)
-        if (current->children) {
-            next = current->children;
-        } else if (current->sibling) {
-            next = current->sibling;
-        } else {
-            // Go up to find next sibling
-            struct device_tree_node* parent = current->parent;
-            while (parent && !parent->sibling) {
-                parent = parent->parent;
-            }
-            next = parent ? parent->sibling : NULL;
-        }
-        
-        dt_free(current);
-        current = next;
-    }
-    
-    // Free memory tracking
-    struct dt_memory_block* current_block = dt_memory_blocks;
-    while (current_block) {
-        struct dt_memory_block* next_block = current_block->next;
-        dt_free(current_block);
-        current_block = next_block;
+    if (dt_root == root) {
+        dt_root = NULL;
+        dt_blob = NULL;
+        dt_blob_size = 0;
     }
-    dt_memory_blocks = NULL;
-    
-    dt_root = NULL;
-    dt_blob = NULL;
-    dt_blob_size = 0;
-    dt_initialized = false;
     
+    // The root itself may live in the arena; read it before releasing
+    struct dt_arena* arena = root->arena;
+    root->arena = NULL;
+    dt_arena_destroy(arena);
     return BH_STATUS_SUCCESS;
 }
 
-// Find node by path
+
+// Find node by path: through the path index when `root` is the top of its
+// tree, else (or for paths past DT_PATH_MAX) by walking down from `root`
+static bh_status_t dt_walk_path(const struct device_tree_node* root, const char* path,
+                                struct device_tree_node** node);
+
 bh_status_t dt_find_node(const struct device_tree_node* root, const char* path, 
                          struct device_tree_node** node) {
     if (!root || !path || !node) {
@@ -343,6 +615,53 @@ bh_status_t dt_find_node(const struct device_tree_node* root, const char* path,
         return BH_STATUS_INVALID_PARAMETER;
     }
     
+    if (root->parent) {
+        return dt_walk_path(root, path, node);
+    }
+    
+    // Normalise to the form full_path has: "/a/b", or "/" for the root
+    char key[DT_PATH_MAX];
+    size_t len = 0;
+    const char* p = path;
+    
+    for (;;) {
+        while (*p == '/') {
+            p++;
+        }
+        if (!*p || len >= sizeof(key) - 1) {
+            break;
+        }
+        key[len++] = '/';
+        while (*p && *p != '/' && len < sizeof(key) - 1) {
+            key[len++] = *p++;
+        }
+    }
+    if (len == 0) {
+        key[len++] = '/';
+    }
+    key[len] = '\0';
+    
+    struct dt_index* index = *p ? NULL : dt_tree_index(root);
+    if (!index) {
+        return dt_walk_path(root, path, node);
+    }
+    
+    uint32_t hash = dt_hash_string(key, len);
+    for (uint32_t i = hash & index->by_path.mask; index->by_path.slots[i].node;
+         i = (i + 1) & index->by_path.mask) {
+        struct dt_index_slot* slot = &index->by_path.slots[i];
+        if (slot->hash == hash && strcmp(slot->node->full_path, key) == 0) {
+            *node = slot->node;
+            return BH_STATUS_SUCCESS;
+        }
+    }
+    
+    dt_set_error("Path '%s' not found", path);
+    return BH_STATUS_NOT_FOUND;
+}
+
+static bh_status_t dt_walk_path(const struct device_tree_node* root, const char* path,
+                                struct device_tree_node** node) {
     // Handle absolute path
     const char* current_path = path;
     if (current_path[0] == '/') {
@@ -441,7 +760,63 @@ bh_status_t dt_find_node_by_property(const struct device_tree_node* root, const
 // Find node by compatible string
 bh_status_t dt_find_node_by_compatible(const struct device_tree_node* root, const char* compatible, 
                                        struct device_tree_node** node) {
-    return dt_find_node_by_property(root, "compatible", compatible, strlen(compatible) + 1, node);
+    if (!root || !compatible || !node) {
+        dt_set_error("Invalid parameters");
+        return BH_STATUS_INVALID_PARAMETER;
+    }
+    
+    if (dt_find_all_by_compatible(root, compatible, node, 1) == 0) {
+        dt_set_error("Node compatible with '%s' not found", compatible);
+        return BH_STATUS_NOT_FOUND;
+    }
+    return BH_STATUS_SUCCESS;
+}
+
+// Every node under `root` listing `compatible`: fills up to `max` and
+// returns how many there are
+uint32_t dt_find_all_by_compatible(const struct device_tree_node* root, const char* compatible,
+                                   struct device_tree_node** nodes, uint32_t max) {
+    if (!root || !compatible || (max && !nodes)) {
+        return 0;
+    }
+    
+    size_t len = strlen(compatible);
+    uint32_t count = 0;
+    struct dt_index* index = dt_tree_index(root);
+    
+    if (!index) {
+        // No memory for the index: scan the subtree
+        for (const struct device_tree_node* n = root; n; n = dt_tree_next(n, root)) {
+            if (dt_node_is_compatible(n, compatible, len)) {
+                if (count < max) {
+                    nodes[count] = (struct device_tree_node*)n;
+                }
+                count++;
+            }
+        }
+        return count;
+    }
+    
+    uint32_t hash = dt_hash_string(compatible, len);
+    if (index->compat_stale) {
+        dt_index_invalidate(root);
+        index = dt_tree_index(root);
+        if (!index) {
+            return dt_find_all_by_compatible(root, compatible, nodes, max);
+        }
+    }
+    for (uint32_t i = hash & index->by_compat.mask; index->by_compat.slots[i].node;
+         i = (i + 1) & index->by_compat.mask) {
+        struct dt_index_slot* slot = &index->by_compat.slots[i];
+        if (slot->hash != hash || strcmp(slot->key, compatible) != 0 || !dt_is_within(slot->node, root)) {
+            continue;
+        }
+        if (count < max) {
+            nodes[count] = slot->node;
+        }
+        count++;
+    }
+    return count;
 }
 
 // Find node by phandle
@@ -452,29 +827,24 @@ bh_status_t dt_find_node_by_phandle(const struct device_tree_node* root, uint32_
         return BH_STATUS_INVALID_PARAMETER;
     }
     
-    // Recursive search
-    struct device_tree_node* current = (struct device_tree_node*)root;
-    struct device_tree_node* stack[64];
-    int stack_top = -1;
-    
-    while (current || stack_top >= 0) {
-        if (current) {
-            // Check current node
-            if (current->phandle == phandle) {
-                *node = current;
+    struct dt_index* index = phandle ? dt_tree_index(root) : NULL;
+    if (index) {
+        uint32_t hash = dt_hash_phandle(phandle);
+        for (uint32_t i = hash & index->by_phandle.mask; index->by_phandle.slots[i].node;
+             i = (i + 1) & index->by_phandle.mask) {
+            struct device_tree_node* candidate = index->by_phandle.slots[i].node;
+            if (candidate->phandle == phandle && dt_is_within(candidate, root)) {
+                *node = candidate;
                 return BH_STATUS_SUCCESS;
             }
-            
-            // Push children onto stack
-            if (current->children) {
-                stack[++stack_top] = current->children;
+        }
+    } else if (phandle) {
+        // No memory for the index: scan the subtree
+        for (const struct device_tree_node* n = root; n; n = dt_tree_next(n, root)) {
+            if (n->phandle == phandle) {
+                *node = (struct device_tree_node*)n;
+                return BH_STATUS_SUCCESS;
             }
-            
-            // Move to sibling
-            current = current->sibling;
-        } else {
-            // Pop from stack
-            current = stack[stack_top--];
         }
     }
     
@@ -490,35 +860,31 @@ bh_status_t dt_add_node(struct device_tree_node* parent, const char* name,
         return BH_STATUS_INVALID_PARAMETER;
     }
     
-    // Create new node
-    struct device_tree_node* new_node = dt_malloc(sizeof(struct device_tree_node));
+    // Create new node (a failure part way leaves only arena garbage)
+    struct dt_arena* arena = dt_node_arena(parent);
+    struct device_tree_node* new_node = arena ? dt_arena_alloc(arena, sizeof(struct device_tree_node)) : NULL;
     if (!new_node) {
         dt_set_error("Memory allocation failed");
         return BH_STATUS_NO_MEMORY;
     }
     
     memset(new_node, 0, sizeof(struct device_tree_node));
-    new_node->name = dt_strdup(name);
-    if (!new_node->name) {
-        dt_free(new_node);
-        dt_set_error("Memory allocation failed");
-        return BH_STATUS_NO_MEMORY;
-    }
+    new_node->arena = arena;
+    new_node->name = dt_arena_strdup(arena, name);
     
-    // Build full path
+    // Build full path (the root's "/" is not doubled)
     if (parent->full_path) {
-        size_t path_len = strlen(parent->full_path) + strlen(name) + 2;
-        new_node->full_path = dt_malloc(path_len);
+        const char* prefix = strcmp(parent->full_path, "/") == 0 ? "" : parent->full_path;
+        size_t path_len = strlen(prefix) + strlen(name) + 2;
+        new_node->full_path = dt_arena_alloc(arena, path_len);
         if (new_node->full_path) {
-            snprintf(new_node->full_path, path_len, "%s/%s", parent->full_path, name);
+            snprintf(new_node->full_path, path_len, "%s/%s", prefix, name);
         }
     } else {
-        new_node->full_path = dt_strdup(name);
+        new_node->full_path = dt_arena_strdup(arena, name);
     }
     
-    if (!new_node->full_path) {
-        dt_free(new_node->name);
-        dt_free(new_node);
+    if (!new_node->name || !new_node->full_path) {
         dt_set_error("Memory allocation failed");
         return BH_STATUS_NO_MEMORY;
     }
@@ -533,6 +899,7 @@ bh_status_t dt_add_node(struct device_tree_node* parent, const char* name,
     // Insert at beginning of children list
     new_node->sibling = parent->children;
     parent->children = new_node;
+    dt_index_add_path(new_node);
     
     *node = new_node;
     return BH_STATUS_SUCCESS;
@@ -549,6 +916,7 @@ bh_status_t dt_remove_node(struct device_tree_node* parent, struct device_tree_n
     struct device_tree_node** current = &parent->children;
     while (*current) {
         if (*current == node) {
+            dt_index_invalidate(parent);
             *current = node->sibling;
             node->parent = NULL;
             node->sibling = NULL;
@@ -561,6 +929,27 @@ bh_status_t dt_remove_node(struct device_tree_node* parent, struct device_tree_n
     return BH_STATUS_NOT_FOUND;
 }
 
+// Rebuild a node's full path from its parent's, in place when it fits
+static bh_status_t dt_update_path(struct device_tree_node* node) {
+    const char* parent_path = node->parent ? node->parent->full_path : NULL;
+    const char* prefix = parent_path && strcmp(parent_path, "/") != 0 ? parent_path : "";
+    size_t path_len = strlen(prefix) + strlen(node->name) + 2;
+    
+    if (!node->full_path || strlen(node->full_path) + 1 < path_len) {
+        struct dt_arena* arena = dt_node_arena(node);
+        node->full_path = arena ? dt_arena_alloc(arena, path_len) : NULL;
+        if (!node->full_path) {
+            return BH_STATUS_NO_MEMORY;
+        }
+    }
+    if (parent_path) {
+        snprintf(node->full_path, path_len, "%s/%s", prefix, node->name);
+    } else {
+        memcpy(node->full_path, node->name, strlen(node->name) + 1);
+    }
+    return BH_STATUS_SUCCESS;
+}
+
 // Move node to new parent
 bh_status_t dt_move_node(struct device_tree_node* node, struct device_tree_node* new_parent) {
     if (!node || !new_parent) {
@@ -578,19 +967,14 @@ bh_status_t dt_move_node(struct device_tree_node* node, struct device_tree_node*
     new_parent->children = node;
     node->parent = new_parent;
     
-    // Update full path
-    if (node->full_path) {
-        dt_free(node->full_path);
-    }
-    
-    if (new_parent->full_path) {
-        size_t path_len = strlen(new_parent->full_path) + strlen(node->name) + 2;
-        node->full_path = dt_malloc(path_len);
-        if (node->full_path) {
-            snprintf(node->full_path, path_len, "%s/%s", new_parent->full_path, node->name);
+    // The node stays in the arena it was made in, so it is only moved
+    // within its own tree; its paths and those below it change
+    dt_index_invalidate(new_parent);
+    for (struct device_tree_node* n = node; n; n = dt_tree_next(n, node)) {
+        if (dt_update_path(n) != BH_STATUS_SUCCESS) {
+            dt_set_error("Memory allocation failed");
+            return BH_STATUS_NO_MEMORY;
         }
-    } else {
-        node->full_path = dt_strdup(node->name);
     }
     
     return BH_STATUS_SUCCESS;
@@ -629,85 +1013,136 @@ bh_status_t dt_set_property(struct device_tree_node* node, const char* name,
     
     // Check if property already exists
     struct device_tree_property* prop = node->properties;
+    struct device_tree_property** tail = &node->properties;
     while (prop) {
         if (strcmp(prop->name, name) == 0) {
-            // Update existing property
-            if (prop->value) {
-                dt_free(prop->value);
-            }
-            if (length > 0) {
-                prop->value = dt_malloc(length);
-                if (!prop->value) {
-                    dt_set_error("Memory allocation failed");
-                    return BH_STATUS_NO_MEMORY;
-                }
-                memcpy(prop->value, value, length);
-            } else {
-                prop->value = NULL;
-            }
-            prop->length = length;
-            return BH_STATUS_SUCCESS;
+            break;
         }
+        tail = &prop->next;
         prop = prop->next;
     }
     
-    // Create new property
-    prop = dt_malloc(sizeof(struct device_tree_property));
-    if (!prop) {
-        dt_set_error("Memory allocation failed");
-        return BH_STATUS_NO_MEMORY;
-    }
-    
-    memset(prop, 0, sizeof(struct device_tree_property));
-    prop->name = dt_strdup(name);
-    if (!prop->name) {
-        dt_free(prop);
+    struct dt_arena* arena = dt_node_arena(node);
+    if (!arena) {
         dt_set_error("Memory allocation failed");
         return BH_STATUS_NO_MEMORY;
     }
     
-    if (length > 0) {
-        prop->value = dt_malloc(length);
-        if (!prop->value) {
-            dt_free(prop->name);
-            dt_free(prop);
+    if (!prop) {
+        // Create new property, appended so the blob order is kept
+        char* copy = dt_arena_strdup(arena, name);
+        prop = copy ? dt_new_property(arena, copy, value, length) : NULL;
+        if (!prop) {
             dt_set_error("Memory allocation failed");
             return BH_STATUS_NO_MEMORY;
         }
-        memcpy(prop->value, value, length);
+        *tail = prop;
+    } else {
+        // Rewrite in place when the value fits; a larger one gets new arena
+        // space (the old bytes are reclaimed with the tree)
+        if (length > prop->capacity) {
+            void* storage = dt_arena_alloc(arena, length);
+            if (!storage) {
+                dt_set_error("Memory allocation failed");
+                return BH_STATUS_NO_MEMORY;
+            }
+            prop->value = storage;
+            prop->capacity = length;
+        }
+        
+        if (length > 0) {
+            memcpy(prop->value, value, length);
+        }
+        prop->length = length;
     }
     
-    prop->length = length;
-    
-    // Add to property list
-    prop->next = node->properties;
-    node->properties = prop;
-    
+    dt_property_changed(node, prop);
     return BH_STATUS_SUCCESS;
 }
 
-// Remove property
-bh_status_t dt_remove_property(struct device_tree_node* node, const char* name) {
-    if (!node || !name) {
-        dt_set_error("Invalid parameters");
-        return BH_STATUS_INVALID_PARAMETER;
+// A property record holding a copy of `value`, named by `name` (already
+// arena memory); a removed record is reused when there is one
+static struct device_tree_property* dt_new_property(struct dt_arena* arena, char* name,
+                                                    const void* value, size_t length) {
+    struct device_tree_property* prop = arena->free_props;
+    if (prop) {
+        arena->free_props = prop->next;
+    } else {
+        prop = dt_arena_alloc(arena, sizeof(struct device_tree_property));
+        if (!prop) {
+            return NULL;
+        }
     }
     
-    struct device_tree_property** current = &node->properties;
-    while (*current) {
-        if (strcmp((*current)->name, name) == 0) {
-            struct device_tree_property* to_remove = *current;
-            *current = to_remove->next;
-            
-            if (to_remove->name) {
-                dt_free(to_remove->name);
-            }
-            if (to_remove->value) {
-                dt_free(to_remove->value);
-            }
-            dt_free(to_remove);
-            
-            return BH_STATUS_SUCCESS;
+    memset(prop, 0, sizeof(struct device_tree_property));
+    prop->name = name;
+    prop->value = prop->inline_value;
+    prop->capacity = DT_PROP_INLINE_SIZE;
+    
+    if (length > DT_PROP_INLINE_SIZE) {
+        prop->value = dt_arena_alloc(arena, length);
+        if (!prop->value) {
+            prop->next = arena->free_props;
+            arena->free_props = prop;
+            return NULL;
+        }
+        prop->capacity = length;
+    }
+    if (length > 0) {
+        memcpy(prop->value, value, length);
+    }
+    prop->length = length;
+    return prop;
+}
+
+// Fields and lookup indexes that follow a property's value
+static void dt_property_changed(struct device_tree_node* node, const struct device_tree_property* prop) {
+    if (strcmp(prop->name, "phandle") == 0 || strcmp(prop->name, "linux,phandle") == 0) {
+        uint32_t old_phandle = node->phandle;
+        node->phandle = prop->length == sizeof(uint32_t) ? fdt_be32(prop->value) : 0;
+        if (old_phandle && old_phandle != node->phandle) {
+            dt_index_invalidate(node);
+        } else if (!old_phandle && node->phandle) {
+            dt_index_add_phandle(node);
+        }
+    } else if (strcmp(prop->name, "compatible") == 0) {
+        if (node->arena && node->arena->index) {
+            node->arena->index->compat_stale = true;
+        }
+    } else if (strcmp(prop->name, "#address-cells") == 0 && prop->length == sizeof(uint32_t)) {
+        node->address_cells = fdt_be32(prop->value);
+    } else if (strcmp(prop->name, "#size-cells") == 0 && prop->length == sizeof(uint32_t)) {
+        node->size_cells = fdt_be32(prop->value);
+    }
+}
+
+// Remove property
+bh_status_t dt_remove_property(struct device_tree_node* node, const char* name) {
+    if (!node || !name) {
+        dt_set_error("Invalid parameters");
+        return BH_STATUS_INVALID_PARAMETER;
+    }
+    
+    struct device_tree_property** current = &node->properties;
+    while (*current) {
+        if (strcmp((*current)->name, name) == 0) {
+            struct device_tree_property* to_remove = *current;
+            *current = to_remove->next;
+            
+            if (strcmp(name, "phandle") == 0 || strcmp(name, "linux,phandle") == 0) {
+                node->phandle = 0;
+                dt_index_invalidate(node);
+            } else if (strcmp(name, "compatible") == 0 && node->arena && node->arena->index) {
+                node->arena->index->compat_stale = true;
+            }
+            
+            // Keep the record for the next new property of this tree
+            if (node->arena) {
+                to_remove->next = node->arena->free_props;
+                node->arena->free_props = to_remove;
+            }
+            
+            return BH_STATUS_SUCCESS;
         }
         current = &(*current)->next;
     }
@@ -824,130 +1259,325 @@ bh_status_t dt_set_bool_property(struct device_tree_node* node, const char* name
     }
 }
 
-// Parse FDT blob (simplified implementation)
-static bh_status_t dt_parse_fdt_blob(const void* blob, size_t size, struct device_tree_node** root) {
-    const struct fdt_header* header = (const struct fdt_header*)blob;
+// An empty root node, the first allocation of a fresh arena
+static struct device_tree_node* dt_new_root(void) {
+    struct dt_arena* arena = dt_arena_create();
+    struct device_tree_node* node = arena ? dt_arena_alloc(arena, sizeof(struct device_tree_node)) : NULL;
+    if (!node) {
+        dt_arena_destroy(arena);
+        return NULL;
+    }
     
-    // Get structure block
-    const void* struct_ptr = (const char*)blob + dt_be32_to_cpu(header->off_dt_struct);
-    const void* strings_ptr = (const char*)blob + dt_be32_to_cpu(header->off_dt_strings);
+    memset(node, 0, sizeof(struct device_tree_node));
+    node->arena = arena;
+    node->name = dt_arena_strdup(arena, "");
+    node->full_path = dt_arena_strdup(arena, "/");
+    node->address_cells = 1;
+    node->size_cells = 1;
+    if (!node->name || !node->full_path) {
+        dt_arena_destroy(arena);
+        return NULL;
+    }
+    return node;
+}
+
+// Parse FDT blob into a tree on a fresh arena. Property names point into
+// one arena copy of the strings block, and the reserve map is kept for
+// dt_build_fdt_blob. The header was checked by the caller.
+static bh_status_t dt_parse_fdt_blob(const void* blob, size_t size, struct device_tree_node** root) {
+    (void)size;
     
-    // Create root node
-    struct device_tree_node* node = dt_malloc(sizeof(struct device_tree_node));
+    struct device_tree_node* node = dt_new_root();
     if (!node) {
         dt_set_error("Memory allocation failed");
         return BH_STATUS_NO_MEMORY;
     }
+    struct dt_arena* arena = node->arena;
     
-    memset(node, 0, sizeof(struct device_tree_node));
-    node->name = dt_strdup("");
-    node->full_path = dt_strdup("/");
-    node->address_cells = 1;
-    node->size_cells = 1;
+    uint32_t strings_size = fdt_size_dt_strings(blob);
+    char* strings = dt_arena_alloc(arena, strings_size + 1);
     
-    if (!node->name || !node->full_path) {
+    uint32_t rsv_size = 0;
+    const uint8_t* rsv = (const uint8_t*)blob + fdt_off_mem_rsvmap(blob);
+    uint32_t rsv_avail = fdt_totalsize(blob) - fdt_off_mem_rsvmap(blob);
+    while (rsv_size + DT_RSV_ENTRY_SIZE <= rsv_avail) {
+        rsv_size += DT_RSV_ENTRY_SIZE;
+        if (!fdt_be32(rsv + rsv_size - 16) && !fdt_be32(rsv + rsv_size - 12) &&
+            !fdt_be32(rsv + rsv_size - 8) && !fdt_be32(rsv + rsv_size - 4)) {
+            break;
+        }
+    }
+    uint8_t* rsv_copy = dt_arena_alloc(arena, rsv_size);
+    
+    if (!strings || !rsv_copy) {
         dt_cleanup(node);
         dt_set_error("Memory allocation failed");
         return BH_STATUS_NO_MEMORY;
     }
-    
-    // Parse structure block
-    const uint32_t* ptr = (const uint32_t*)struct_ptr;
-    while (ptr < (const uint32_t*)((const char*)blob + dt_be32_to_cpu(header->off_dt_struct) + 
-                                    dt_be32_to_cpu(header->size_dt_struct))) {
-        uint32_t token = dt_be32_to_cpu(*ptr++);
+    memcpy(strings, (const char*)blob + fdt_off_dt_strings(blob), strings_size);
+    strings[strings_size] = '\0';
+    memcpy(rsv_copy, rsv, rsv_size);
+    arena->rsvmap = rsv_copy;
+    arena->rsvmap_size = rsv_size;
+    arena->boot_cpuid_phys = fdt_be32((const uint8_t*)blob + 28);
+    
+    // Walk the structure block, appending children and properties so the
+    // tree keeps the blob's order
+    struct device_tree_node* stack[DT_MAX_DEPTH];
+    struct device_tree_node* last_child[DT_MAX_DEPTH];
+    struct device_tree_property* last_prop[DT_MAX_DEPTH];
+    int depth = -1;
+    int offset = 0;
+    bool done = false;
+    
+    while (!done) {
+        int next;
+        uint32_t tag = fdt_next_tag(blob, offset, &next);
         
-        switch (token) {
+        switch (tag) {
             case FDT_BEGIN_NODE: {
-                // Get node name
-                const char* node_name = (const char*)ptr;
-                while (*ptr != 0) {
-                    ptr++;
+                struct device_tree_node* current = node;
+                if (depth + 1 >= DT_MAX_DEPTH) {
+                    dt_set_error("Device tree nested deeper than %d", DT_MAX_DEPTH);
+                    dt_cleanup(node);
+                    return BH_STATUS_INVALID_DATA;
                 }
-                ptr = (const uint32_t*)((const char*)ptr + 4 - ((uintptr_t)ptr % 4));
-                
-                // Create node (simplified - full implementation would build tree)
+                if (depth >= 0) {
+                    struct device_tree_node* parent = stack[depth];
+                    current = dt_arena_alloc(arena, sizeof(struct device_tree_node));
+                    if (current) {
+                        memset(current, 0, sizeof(struct device_tree_node));
+                        current->arena = arena;
+                        current->parent = parent;
+                        current->address_cells = parent->address_cells;
+                        current->size_cells = parent->size_cells;
+                        current->interrupt_cells = parent->interrupt_cells;
+                        current->interrupt_parent = parent->interrupt_parent;
+                        current->name = dt_arena_strdup(arena, fdt_get_name(blob, offset, NULL));
+                    }
+                    if (!current || !current->name || dt_update_path(current) != BH_STATUS_SUCCESS) {
+                        dt_cleanup(node);
+                        dt_set_error("Memory allocation failed");
+                        return BH_STATUS_NO_MEMORY;
+                    }
+                    if (last_child[depth]) {
+                        last_child[depth]->sibling = current;
+                    } else {
+                        parent->children = current;
+                    }
+                    last_child[depth] = current;
+                } else if (offset != 0) {
+                    dt_set_error("Nodes after the root node");
+                    dt_cleanup(node);
+                    return BH_STATUS_INVALID_DATA;
+                }
+                depth++;
+                stack[depth] = current;
+                last_child[depth] = NULL;
+                last_prop[depth] = NULL;
                 break;
             }
             
             case FDT_PROP: {
-                uint32_t len = dt_be32_to_cpu(*ptr++);
-                uint32_t nameoff = dt_be32_to_cpu(*ptr++);
-                const char* prop_name = (const char*)strings_ptr + nameoff;
-                
-                // Align to 4-byte boundary
-                ptr = (const uint32_t*)((const char*)ptr + 3 - ((uintptr_t)ptr % 3));
-                
-                // Get property value
-                const void* prop_value = ptr;
-                ptr = (const uint32_t*)((const char*)ptr + len);
-                
-                // Align to 4-byte boundary
-                ptr = (const uint32_t*)((const char*)ptr + 3 - ((uintptr_t)ptr % 3));
+                int len;
+                const void* value = fdt_getprop_by_offset(blob, offset, NULL, &len);
+                uint32_t nameoff = fdt_be32((const uint8_t*)blob + fdt_off_dt_struct(blob) + offset + 8);
+                if (depth < 0 || !value || nameoff >= strings_size) {
+                    dt_set_error("Invalid FDT property at offset %d", offset);
+                    dt_cleanup(node);
+                    return BH_STATUS_INVALID_DATA;
+                }
                 
-                // Add property to node (simplified)
+                struct device_tree_property* prop = dt_new_property(arena, strings + nameoff, value, (size_t)len);
+                if (!prop) {
+                    dt_cleanup(node);
+                    dt_set_error("Memory allocation failed");
+                    return BH_STATUS_NO_MEMORY;
+                }
+                if (last_prop[depth]) {
+                    last_prop[depth]->next = prop;
+                } else {
+                    stack[depth]->properties = prop;
+                }
+                last_prop[depth] = prop;
+                dt_property_changed(stack[depth], prop);
                 break;
             }
             
             case FDT_END_NODE:
+                if (depth < 0) {
+                    dt_set_error("Unbalanced FDT_END_NODE");
+                    dt_cleanup(node);
+                    return BH_STATUS_INVALID_DATA;
+                }
+                depth--;
                 break;
                 
             case FDT_NOP:
                 break;
                 
             case FDT_END:
-                goto parse_complete;
-                
             default:
-                dt_set_error("Invalid FDT token: 0x%x", token);
-                dt_cleanup(node);
-                return BH_STATUS_INVALID_DATA;
+                if (next < 0 || depth != -1) {
+                    dt_set_error("Invalid FDT structure at offset %d", offset);
+                    dt_cleanup(node);
+                    return BH_STATUS_INVALID_DATA;
+                }
+                done = true;
+                break;
         }
+        offset = next;
     }
     
-parse_complete:
     *root = node;
     return BH_STATUS_SUCCESS;
 }
 
-// Build FDT blob (simplified implementation)
-static bh_status_t dt_build_fdt_blob(const struct device_tree_node* root, void** blob, size_t* size) {
-    // This is a simplified implementation
-    // A full implementation would:
-    // 1. Calculate required size for all structures
-    // 2. Allocate blob
-    // 3. Write header
-    // 4. Write memory reserve map
-    // 5. Write structure block
-    // 6. Write strings block
-    // 7. Update header offsets
-    
-    // For now, return a minimal blob
-    size_t blob_size = sizeof(struct fdt_header) + 1024; // Simplified size
-    void* new_blob = dt_malloc(blob_size);
-    if (!new_blob) {
+// Measure pass: the structure block size, and every property name interned
+// once into the strings block, its offset remembered for the write pass
+static bh_status_t dt_measure_fdt_blob(const struct device_tree_node* root, struct dt_fdt_layout* layout) {
+    static const uint8_t empty_rsvmap[DT_RSV_ENTRY_SIZE] = {0};
+    size_t struct_size = DT_TAG_SIZE;   // FDT_END
+    size_t names_size = 0;
+    uint32_t prop_count = 0;
+    
+    for (const struct device_tree_node* n = root; n; n = dt_tree_next(n, root)) {
+        const char* name = n == root ? "" : n->name;
+        struct_size += 2 * DT_TAG_SIZE + DT_ALIGN4(strlen(name) + 1);
+        for (const struct device_tree_property* prop = n->properties; prop; prop = prop->next) {
+            struct_size += 3 * DT_TAG_SIZE + DT_ALIGN4(prop->length);
+            names_size += strlen(prop->name) + 1;
+            prop_count++;
+        }
+    }
+    if (struct_size > UINT32_MAX - names_size) {
+        dt_set_error("Device tree too large to serialise");
+        return BH_STATUS_INVALID_DATA;
+    }
+    
+    // One scratch block: hash table, name offsets, then the strings
+    uint32_t slots = dt_table_slots(prop_count);
+    size_t scratch = ((size_t)slots + prop_count) * sizeof(uint32_t) + names_size + 1;
+    layout->table = dt_malloc(scratch);
+    if (!layout->table) {
         dt_set_error("Memory allocation failed");
         return BH_STATUS_NO_MEMORY;
     }
+    memset(layout->table, 0xFF, (size_t)slots * sizeof(uint32_t));
+    layout->nameoffs = layout->table + slots;
+    layout->strings = (char*)(layout->nameoffs + prop_count);
+    layout->strings_size = 0;
+    
+    uint32_t mask = slots - 1;
+    uint32_t count = 0;
+    for (const struct device_tree_node* n = root; n; n = dt_tree_next(n, root)) {
+        for (const struct device_tree_property* prop = n->properties; prop; prop = prop->next) {
+            size_t len = strlen(prop->name);
+            uint32_t i = dt_hash_string(prop->name, len) & mask;
+            
+            while (layout->table[i] != UINT32_MAX && strcmp(layout->strings + layout->table[i], prop->name) != 0) {
+                i = (i + 1) & mask;
+            }
+            if (layout->table[i] == UINT32_MAX) {
+                layout->table[i] = layout->strings_size;
+                memcpy(layout->strings + layout->strings_size, prop->name, len + 1);
+                layout->strings_size += (uint32_t)len + 1;
+            }
+            layout->nameoffs[count++] = layout->table[i];
+        }
+    }
     
-    memset(new_blob, 0, blob_size);
-    
-    // Write header (simplified)
-    struct fdt_header* header = (struct fdt_header*)new_blob;
-    header->magic = dt_cpu_to_be32(FDT_MAGIC);
-    header->totalsize = dt_cpu_to_be32(blob_size);
-    header->version = dt_cpu_to_be32(FDT_VERSION);
-    header->last_comp_version = dt_cpu_to_be32(FDT_LAST_COMPAT_VERSION);
-    header->boot_cpuid_phys = dt_cpu_to_be32(0);
-    header->off_dt_struct = dt_cpu_to_be32(sizeof(struct fdt_header));
-    header->off_dt_strings = dt_cpu_to_be32(sizeof(struct fdt_header) + 512);
-    header->off_mem_rsvmap = dt_cpu_to_be32(sizeof(struct fdt_header) + 512 + 256);
-    header->size_dt_strings = dt_cpu_to_be32(256);
-    header->size_dt_struct = dt_cpu_to_be32(512);
+    const struct dt_arena* arena = root->arena;
+    layout->rsvmap = arena && arena->rsvmap ? arena->rsvmap : empty_rsvmap;
+    layout->rsvmap_size = arena && arena->rsvmap ? arena->rsvmap_size : DT_RSV_ENTRY_SIZE;
+    layout->boot_cpuid_phys = arena ? arena->boot_cpuid_phys : 0;
+    layout->struct_size = (uint32_t)struct_size;
+    layout->total = DT_HEADER_SIZE + layout->rsvmap_size + struct_size + layout->strings_size;
+    return BH_STATUS_SUCCESS;
+}
+
+// Write pass: header, reserve map (the parsed blob's, or empty), structure
+// block and strings block into `out`, which holds exactly layout->total
+static void dt_write_fdt_blob(const struct device_tree_node* root, const struct dt_fdt_layout* layout, uint8_t* out) {
+    uint32_t off_rsvmap = DT_HEADER_SIZE;
+    uint32_t off_struct = off_rsvmap + layout->rsvmap_size;
+    uint32_t off_strings = off_struct + layout->struct_size;
+    
+    memset(out, 0, layout->total);
+    fdt_set_be32(out + 0, FDT_MAGIC);
+    fdt_set_be32(out + 4, (uint32_t)layout->total);
+    fdt_set_be32(out + 8, off_struct);
+    fdt_set_be32(out + 12, off_strings);
+    fdt_set_be32(out + 16, off_rsvmap);
+    fdt_set_be32(out + 20, FDT_VERSION);
+    fdt_set_be32(out + 24, FDT_LAST_COMPAT_VERSION);
+    fdt_set_be32(out + 28, layout->boot_cpuid_phys);
+    fdt_set_be32(out + 32, layout->strings_size);
+    fdt_set_be32(out + 36, layout->struct_size);
+    memcpy(out + off_rsvmap, layout->rsvmap, layout->rsvmap_size);
+    memcpy(out + off_strings, layout->strings, layout->strings_size);
+    
+    // Nodes in pre-order, closing each one once its subtree is out
+    uint8_t* p = out + off_struct;
+    const uint32_t* nameoff = layout->nameoffs;
+    const struct device_tree_node* n = root;
+    
+    while (n) {
+        const char* name = n == root ? "" : n->name;
+        fdt_set_be32(p, FDT_BEGIN_NODE);
+        memcpy(p + DT_TAG_SIZE, name, strlen(name));
+        p += DT_TAG_SIZE + DT_ALIGN4(strlen(name) + 1);
+        
+        for (const struct device_tree_property* prop = n->properties; prop; prop = prop->next) {
+            fdt_set_be32(p, FDT_PROP);
+            fdt_set_be32(p + 4, prop->length);
+            fdt_set_be32(p + 8, *nameoff++);
+            if (prop->length) {
+                memcpy(p + 3 * DT_TAG_SIZE, prop->value, prop->length);
+            }
+            p += 3 * DT_TAG_SIZE + DT_ALIGN4(prop->length);
+        }
+        
+        if (n->children) {
+            n = n->children;
+            continue;
+        }
+        for (;;) {
+            fdt_set_be32(p, FDT_END_NODE);
+            p += DT_TAG_SIZE;
+            if (n == root) {
+                n = NULL;
+                break;
+            }
+            if (n->sibling) {
+                n = n->sibling;
+                break;
+            }
+            n = n->parent;
+        }
+    }
+    fdt_set_be32(p, FDT_END);
+}
+
+// Build FDT blob in one exact-size allocation
+static bh_status_t dt_build_fdt_blob(const struct device_tree_node* root, void** blob, size_t* size) {
+    struct dt_fdt_layout layout;
+    bh_status_t status = dt_measure_fdt_blob(root, &layout);
+    if (status != BH_STATUS_SUCCESS) {
+        return status;
+    }
     
-    *blob = new_blob;
-    *size = blob_size;
+    uint8_t* out = dt_malloc(layout.total);
+    if (!out) {
+        dt_free(layout.table);
+        dt_set_error("Memory allocation failed");
+        return BH_STATUS_NO_MEMORY;
+    }
     
+    dt_write_fdt_blob(root, &layout, out);
+    dt_free(layout.table);
+    *blob = out;
+    *size = layout.total;
     return BH_STATUS_SUCCESS;
 }
 
@@ -1035,6 +1665,458 @@ bh_status_t dt_get_memory_regions(const struct device_tree_node* root, struct dt
     return BH_STATUS_SUCCESS;
 }
 
+// Overlay application. An overlay is patched in a scratch copy, so the
+// caller's DTBO stays untouched and fixups are plain in-place writes.
+struct dt_overlay {
+    uint8_t* fdt;                       // Scratch copy
+    uint32_t delta;                     // Added to the overlay's own phandles
+    uint32_t* next_phandle;             // Next free phandle in the tree
+    struct device_tree_node* top;       // Tree being merged into
+};
+
+// A be32 cell inside property `prop_name` of overlay node `node`
+static uint8_t* dt_overlay_cell(struct dt_overlay* ov, int node, const char* prop_name, uint32_t offset) {
+    int len;
+    const uint8_t* value = fdt_getprop(ov->fdt, node, prop_name, &len);
+    if (!value || len < 4 || offset > (uint32_t)len - 4) {
+        return NULL;
+    }
+    return (uint8_t*)value + offset;
+}
+
+// Rebase every phandle the overlay defines, and the largest one it uses
+// Every property of every node names a NUL-terminated string inside the
+// strings block. Checked once up front so the passes below may strlen
+// and strcmp names straight out of the overlay.
+static bool dt_overlay_names_valid(const struct dt_overlay* ov) {
+    int depth = 0;
+    int node;
+    
+    for (node = fdt_next_node(ov->fdt, -1, &depth); node >= 0; node = fdt_next_node(ov->fdt, node, &depth)) {
+        int prop;
+        for (prop = fdt_first_property_offset(ov->fdt, node); prop >= 0;
+             prop = fdt_next_property_offset(ov->fdt, prop)) {
+            const char* name;
+            int len;
+            if (!fdt_getprop_by_offset(ov->fdt, prop, &name, &len)) {
+                return false;
+            }
+        }
+        if (prop != -FDT_ERR_NOTFOUND) {
+            return false;
+        }
+    }
+    return node == -FDT_ERR_NOTFOUND;
+}
+
+static uint32_t dt_overlay_rebase_phandles(struct dt_overlay* ov) {
+    static const char* const names[] = { "phandle", "linux,phandle" };
+    uint32_t max = 0;
+    int depth = 0;
+    
+    for (int node = fdt_next_node(ov->fdt, -1, &depth); node >= 0; node = fdt_next_node(ov->fdt, node, &depth)) {
+        for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+            uint8_t* cell = dt_overlay_cell(ov, node, names[i], 0);
+            uint32_t phandle = cell ? fdt_be32(cell) : 0;
+            if (phandle && phandle != UINT32_MAX) {
+                if (phandle > max) {
+                    max = phandle;
+                }
+                fdt_set_be32(cell, phandle + ov->delta);
+            }
+        }
+    }
+    return max;
+}
+
+// __local_fixups__ mirrors the overlay's nodes; each property lists the
+// offsets of phandle cells in the same-named property of the mirrored node
+static bh_status_t dt_overlay_local_fixups(struct dt_overlay* ov, int fixup, int node, int depth) {
+    if (depth >= DT_MAX_DEPTH) {
+        return BH_STATUS_INVALID_DATA;
+    }
+    
+    for (int prop = fdt_first_property_offset(ov->fdt, fixup); prop >= 0;
+         prop = fdt_next_property_offset(ov->fdt, prop)) {
+        const char* name;
+        int len;
+        const uint8_t* offsets = fdt_getprop_by_offset(ov->fdt, prop, &name, &len);
+        
+        for (int i = 0; name && i + 4 <= len; i += 4) {
+            uint8_t* cell = dt_overlay_cell(ov, node, name, fdt_be32(offsets + i));
+            if (!cell) {
+                dt_set_error("Bad __local_fixups__ entry for '%s'", name);
+                return BH_STATUS_INVALID_DATA;
+            }
+            fdt_set_be32(cell, fdt_be32(cell) + ov->delta);
+        }
+    }
+    
+    for (int sub = fdt_first_subnode(ov->fdt, fixup); sub >= 0; sub = fdt_next_subnode(ov->fdt, sub)) {
+        const char* name = fdt_get_name(ov->fdt, sub, NULL);
+        int target = fdt_subnode_offset(ov->fdt, node, name);
+        if (target < 0) {
+            dt_set_error("__local_fixups__ node '%s' has no counterpart", name);
+            return BH_STATUS_INVALID_DATA;
+        }
+        bh_status_t status = dt_overlay_local_fixups(ov, sub, target, depth + 1);
+        if (status != BH_STATUS_SUCCESS) {
+            return status;
+        }
+    }
+    return BH_STATUS_SUCCESS;
+}
+
+// The phandle of the tree node labelled `label`, assigning one if needed
+static bh_status_t dt_overlay_symbol_phandle(struct dt_overlay* ov, const char* label, uint32_t* phandle) {
+    struct device_tree_node* symbols;
+    struct device_tree_node* target;
+    void* path;
+    size_t len;
+    
+    if (dt_find_node(ov->top, "/__symbols__", &symbols) != BH_STATUS_SUCCESS ||
+        dt_get_property(symbols, label, &path, &len) != BH_STATUS_SUCCESS ||
+        len == 0 || ((char*)path)[len - 1] != '\0' ||
+        dt_find_node(ov->top, path, &target) != BH_STATUS_SUCCESS) {
+        dt_set_error("Overlay label '%s' not found in base tree", label);
+        return BH_STATUS_NOT_FOUND;
+    }
+    
+    if (!target->phandle) {
+        bh_status_t status = dt_set_u32_property(target, "phandle", (*ov->next_phandle)++);
+        if (status != BH_STATUS_SUCCESS) {
+            return status;
+        }
+    }
+    *phandle = target->phandle;
+    return BH_STATUS_SUCCESS;
+}
+
+// __fixups__ properties are labels, each with "path:property:offset"
+// entries naming cells that must hold the label's phandle
+static bh_status_t dt_overlay_fixups(struct dt_overlay* ov, int fixups) {
+    for (int prop = fdt_first_property_offset(ov->fdt, fixups); prop >= 0;
+         prop = fdt_next_property_offset(ov->fdt, prop)) {
+        const char* label;
+        int len;
+        const char* entries = fdt_getprop_by_offset(ov->fdt, prop, &label, &len);
+        uint32_t phandle;
+        
+        if (!label || !entries || len == 0 || entries[len - 1] != '\0') {
+            dt_set_error("Malformed __fixups__ property");
+            return BH_STATUS_INVALID_DATA;
+        }
+        bh_status_t status = dt_overlay_symbol_phandle(ov, label, &phandle);
+        if (status != BH_STATUS_SUCCESS) {
+            return status;
+        }
+        
+        for (const char* entry = entries; entry < entries + len; entry += strlen(entry) + 1) {
+            char path[DT_PATH_MAX];
+            const char* colon1 = strchr(entry, ':');
+            const char* colon2 = colon1 ? strchr(colon1 + 1, ':') : NULL;
+            
+            if (!colon2 || (size_t)(colon1 - entry) >= sizeof(path) ||
+                (size_t)(colon2 - colon1 - 1) >= sizeof(path)) {
+                dt_set_error("Malformed __fixups__ entry '%s'", entry);
+                return BH_STATUS_INVALID_DATA;
+            }
+            
+            memcpy(path, entry, (size_t)(colon1 - entry));
+            path[colon1 - entry] = '\0';
+            int node = fdt_path_offset(ov->fdt, path);
+            
+            memcpy(path, colon1 + 1, (size_t)(colon2 - colon1 - 1));
+            path[colon2 - colon1 - 1] = '\0';
+            uint32_t offset = (uint32_t)strtoul(colon2 + 1, NULL, 10);
+            
+            uint8_t* cell = node >= 0 ? dt_overlay_cell(ov, node, path, offset) : NULL;
+            if (!cell) {
+                dt_set_error("Bad __fixups__ entry '%s'", entry);
+                return BH_STATUS_INVALID_DATA;
+            }
+            fdt_set_be32(cell, phandle);
+        }
+    }
+    return BH_STATUS_SUCCESS;
+}
+
+// The child of `parent` named exactly `name`, through the path index when
+// the whole path fits
+static struct device_tree_node* dt_find_child(struct device_tree_node* parent, const char* name) {
+    char path[DT_PATH_MAX];
+    const char* prefix = parent->full_path && strcmp(parent->full_path, "/") != 0 ? parent->full_path : "";
+    
+    if (parent->full_path && strlen(prefix) + strlen(name) + 2 <= sizeof(path)) {
+        struct device_tree_node* child;
+        snprintf(path, sizeof(path), "%s/%s", prefix, name);
+        if (dt_find_node(dt_tree_top(parent), path, &child) == BH_STATUS_SUCCESS && child->parent == parent) {
+            return child;
+        }
+        return NULL;
+    }
+    
+    for (struct device_tree_node* child = parent->children; child; child = child->sibling) {
+        if (strcmp(child->name, name) == 0) {
+            return child;
+        }
+    }
+    return NULL;
+}
+
+// Merge overlay node `node` (properties, then subnodes) into `target`
+static bh_status_t dt_overlay_merge(struct dt_overlay* ov, struct device_tree_node* target, int node, int depth) {
+    if (depth >= DT_MAX_DEPTH) {
+        return BH_STATUS_INVALID_DATA;
+    }
+    
+    for (int prop = fdt_first_property_offset(ov->fdt, node); prop >= 0;
+         prop = fdt_next_property_offset(ov->fdt, prop)) {
+        const char* name;
+        int len;
+        const void* value = fdt_getprop_by_offset(ov->fdt, prop, &name, &len);
+        if (!name || !value) {
+            return BH_STATUS_INVALID_DATA;
+        }
+        bh_status_t status = dt_set_property(target, name, value, (size_t)len);
+        if (status != BH_STATUS_SUCCESS) {
+            return status;
+        }
+    }
+    
+    for (int sub = fdt_first_subnode(ov->fdt, node); sub >= 0; sub = fdt_next_subnode(ov->fdt, sub)) {
+        const char* name = fdt_get_name(ov->fdt, sub, NULL);
+        struct device_tree_node* child = dt_find_child(target, name);
+        bh_status_t status = BH_STATUS_SUCCESS;
+        
+        if (!child) {
+            status = dt_add_node(target, name, &child);
+        }
+        if (status == BH_STATUS_SUCCESS) {
+            status = dt_overlay_merge(ov, child, sub, depth + 1);
+        }
+        if (status != BH_STATUS_SUCCESS) {
+            return status;
+        }
+    }
+    return BH_STATUS_SUCCESS;
+}
+
+// The tree node a fragment applies to
+static bh_status_t dt_overlay_target(struct dt_overlay* ov, int fragment, struct device_tree_node** target) {
+    int len;
+    const uint8_t* phandle = fdt_getprop(ov->fdt, fragment, "target", &len);
+    
+    if (phandle && len == 4) {
+        return dt_find_node_by_phandle(ov->top, fdt_be32(phandle), target);
+    }
+    
+    const char* path = fdt_getprop(ov->fdt, fragment, "target-path", &len);
+    if (!path || len == 0 || path[len - 1] != '\0') {
+        dt_set_error("Overlay fragment without a target");
+        return BH_STATUS_INVALID_DATA;
+    }
+    
+    // An alias stands for the path it names
+    if (path[0] != '/') {
+        struct device_tree_node* aliases;
+        void* alias;
+        size_t alias_len;
+        if (dt_find_node(ov->top, "/aliases", &aliases) != BH_STATUS_SUCCESS ||
+            dt_get_property(aliases, path, &alias, &alias_len) != BH_STATUS_SUCCESS ||
+            alias_len == 0 || ((char*)alias)[alias_len - 1] != '\0') {
+            dt_set_error("Overlay target alias '%s' not found", path);
+            return BH_STATUS_NOT_FOUND;
+        }
+        path = alias;
+    }
+    return dt_find_node(ov->top, path, target);
+}
+
+// Overlay __symbols__ point into fragments ("/fragment@0/__overlay__/x");
+// the tree's /__symbols__ gets them rewritten to where they now live
+static bh_status_t dt_overlay_symbols(struct dt_overlay* ov, int symbols) {
+    struct device_tree_node* tree_symbols;
+    
+    if (dt_find_node(ov->top, "/__symbols__", &tree_symbols) != BH_STATUS_SUCCESS) {
+        bh_status_t status = dt_add_node(ov->top, "__symbols__", &tree_symbols);
+        if (status != BH_STATUS_SUCCESS) {
+            return status;
+        }
+    }
+    
+    for (int prop = fdt_first_property_offset(ov->fdt, symbols); prop >= 0;
+         prop = fdt_next_property_offset(ov->fdt, prop)) {
+        const char* label;
+        int len;
+        const char* path = fdt_getprop_by_offset(ov->fdt, prop, &label, &len);
+        if (!label || !path || len == 0 || path[len - 1] != '\0') {
+            return BH_STATUS_INVALID_DATA;
+        }
+        
+        const char* marker = strstr(path, "/__overlay__");
+        if (path[0] != '/' || !marker || (marker[12] != '/' && marker[12] != '\0')) {
+            // Not inside a fragment: copied as it is
+            bh_status_t status = dt_set_property(tree_symbols, label, path, (size_t)len);
+            if (status != BH_STATUS_SUCCESS) {
+                return status;
+            }
+            continue;
+        }
+        
+        char fragment_path[DT_PATH_MAX];
+        char full[DT_PATH_MAX];
+        struct device_tree_node* target;
+        
+        if ((size_t)(marker - path) >= sizeof(fragment_path)) {
+            return BH_STATUS_INVALID_DATA;
+        }
+        memcpy(fragment_path, path, (size_t)(marker - path));
+        fragment_path[marker - path] = '\0';
+        
+        int fragment = fdt_path_offset(ov->fdt, fragment_path);
+        if (fragment < 0 || dt_overlay_target(ov, fragment, &target) != BH_STATUS_SUCCESS) {
+            dt_set_error("Overlay symbol '%s' has no fragment target", label);
+            return BH_STATUS_INVALID_DATA;
+        }
+        
+        const char* rest = marker + 12;
+        const char* prefix = strcmp(target->full_path, "/") == 0 && *rest ? "" : target->full_path;
+        int full_len = snprintf(full, sizeof(full), "%s%s", prefix, rest);
+        if (full_len < 0 || (size_t)full_len >= sizeof(full)) {
+            return BH_STATUS_INVALID_DATA;
+        }
+        
+        bh_status_t status = dt_set_property(tree_symbols, label, full, (size_t)full_len + 1);
+        if (status != BH_STATUS_SUCCESS) {
+            return status;
+        }
+    }
+    return BH_STATUS_SUCCESS;
+}
+
+static bh_status_t dt_apply_overlay(struct dt_overlay* ov) {
+    bh_status_t status;
+    
+    if (!dt_overlay_names_valid(ov)) {
+        dt_set_error("Overlay property name outside its strings block");
+        return BH_STATUS_INVALID_DATA;
+    }
+    uint32_t max = dt_overlay_rebase_phandles(ov);
+    
+    if (max > UINT32_MAX - 1 - ov->delta) {
+        dt_set_error("Overlay phandles overflow");
+        return BH_STATUS_INVALID_DATA;
+    }
+    *ov->next_phandle = ov->delta + max + 1;
+    
+    int local_fixups = fdt_path_offset(ov->fdt, "/__local_fixups__");
+    if (local_fixups >= 0) {
+        status = dt_overlay_local_fixups(ov, local_fixups, 0, 0);
+        if (status != BH_STATUS_SUCCESS) {
+            return status;
+        }
+    }
+    
+    int fixups = fdt_path_offset(ov->fdt, "/__fixups__");
+    if (fixups >= 0) {
+        status = dt_overlay_fixups(ov, fixups);
+        if (status != BH_STATUS_SUCCESS) {
+            return status;
+        }
+    }
+    
+    for (int fragment = fdt_first_subnode(ov->fdt, 0); fragment >= 0;
+         fragment = fdt_next_subnode(ov->fdt, fragment)) {
+        int overlay = fdt_subnode_offset(ov->fdt, fragment, "__overlay__");
+        struct device_tree_node* target;
+        
+        // __fixups__, __local_fixups__ and __symbols__ have no __overlay__
+        if (overlay < 0) {
+            continue;
+        }
+        status = dt_overlay_target(ov, fragment, &target);
+        if (status == BH_STATUS_SUCCESS) {
+            status = dt_overlay_merge(ov, target, overlay, 0);
+        }
+        if (status != BH_STATUS_SUCCESS) {
+            return status;
+        }
+    }
+    
+    int symbols = fdt_path_offset(ov->fdt, "/__symbols__");
+    return symbols >= 0 ? dt_overlay_symbols(ov, symbols) : BH_STATUS_SUCCESS;
+}
+
+bh_status_t dt_apply_overlays(struct device_tree_node* root, const void* const* overlays,
+                              const size_t* sizes, uint32_t count) {
+    if (!root || (count && (!overlays || !sizes))) {
+        dt_set_error("Invalid parameters");
+        return BH_STATUS_INVALID_PARAMETER;
+    }
+    
+    struct dt_overlay ov;
+    uint32_t next_phandle = 1;
+    
+    ov.top = dt_tree_top(root);
+    ov.next_phandle = &next_phandle;
+    for (const struct device_tree_node* n = ov.top; n; n = dt_tree_next(n, ov.top)) {
+        if (n->phandle != UINT32_MAX && n->phandle >= next_phandle) {
+            next_phandle = n->phandle + 1;
+        }
+    }
+    
+    for (uint32_t i = 0; i < count; i++) {
+        int err = overlays[i] ? fdt_check_header(overlays[i]) : -FDT_ERR_BADOFFSET;
+        if (err || fdt_totalsize(overlays[i]) > sizes[i]) {
+            dt_set_error("Overlay %u is not a valid FDT", i);
+            return err ? fdt_status(err) : BH_STATUS_INVALID_DATA;
+        }
+        
+        ov.fdt = dt_malloc(fdt_totalsize(overlays[i]));
+        if (!ov.fdt) {
+            dt_set_error("Memory allocation failed");
+            return BH_STATUS_NO_MEMORY;
+        }
+        memcpy(ov.fdt, overlays[i], fdt_totalsize(overlays[i]));
+        ov.delta = next_phandle - 1;
+        
+        bh_status_t status = dt_apply_overlay(&ov);
+        dt_free(ov.fdt);
+        if (status != BH_STATUS_SUCCESS) {
+            return status;
+        }
+    }
+    return BH_STATUS_SUCCESS;
+}
+
+bh_status_t dt_apply_overlays_to_blob(const void* base, size_t base_size, const void* const* overlays,
+                                      const size_t* sizes, uint32_t count, void** blob, size_t* size) {
+    if (!base || !blob || !size) {
+        dt_set_error("Invalid parameters");
+        return BH_STATUS_INVALID_PARAMETER;
+    }
+    
+    int err = fdt_check_header(base);
+    if (err || fdt_totalsize(base) > base_size) {
+        dt_set_error("Base device tree is not a valid FDT");
+        return err ? fdt_status(err) : BH_STATUS_INVALID_DATA;
+    }
+    
+    struct device_tree_node* root;
+    bh_status_t status = dt_parse_fdt_blob(base, base_size, &root);
+    if (status != BH_STATUS_SUCCESS) {
+        return status;
+    }
+    
+    status = dt_apply_overlays(root, overlays, sizes, count);
+    if (status == BH_STATUS_SUCCESS) {
+        status = dt_build_fdt_blob(root, blob, size);
+    }
+    dt_cleanup(root);
+    return status;
+}
+
 // Error string function
 const char* dt_error_string(bh_status_t status) {
     switch (status) {
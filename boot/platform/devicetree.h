@@ -53,6 +53,17 @@ struct fdt_property {
     uint8_t data[];             // Property data
 } __attribute__((packed));
 
+// Nodes, names, paths and property values of a tree come from one bump
+// arena owned by its root: nothing is freed on its own, and dt_cleanup on
+// the root releases the whole tree at once. Values up to
+// DT_PROP_INLINE_SIZE bytes (cells, phandles, short strings) live inside
+// the property itself.
+#define DT_ARENA_CHUNK_SIZE     (16 * 1024)
+#define DT_PROP_INLINE_SIZE     16
+#define DT_PATH_MAX             256     // Longest path dt_find_node looks up by index
+
+struct dt_arena;
+
 // Device tree node structure
 struct device_tree_node {
     char* name;                 // Node name
@@ -67,6 +78,7 @@ struct device_tree_node {
     uint32_t size_cells;        // #size-cells value
     uint32_t interrupt_cells;   // #interrupt-cells value
     uint32_t interrupt_parent;  // interrupt-parent value
+    struct dt_arena* arena;     // Allocator of the tree the node belongs to
 };
 
 // Device tree property structure
@@ -74,7 +86,9 @@ struct device_tree_property {
     char* name;                 // Property name
     void* value;                // Property value
     uint32_t length;            // Property length
+    uint32_t capacity;          // Bytes available at value
     struct device_tree_property* next; // Next property
+    uint8_t inline_value[DT_PROP_INLINE_SIZE]; // Storage for short values
 };
 
 // Device tree iterator structure
@@ -321,16 +335,24 @@ struct dt_validation_info {
 // Core device tree operations
 bh_status_t dt_load_from_blob(const void* blob, size_t size, struct device_tree_node** root);
 bh_status_t dt_load_from_platform(void** blob, size_t* size);
+bh_status_t dt_create_tree(struct device_tree_node** root);
 bh_status_t dt_save_to_blob(const struct device_tree_node* root, void** blob, size_t* size);
+bh_status_t dt_save_to_buffer(const struct device_tree_node* root, void* buffer, size_t capacity, size_t* size);
 bh_status_t dt_validate(const struct device_tree_node* root, struct dt_validation_info* info);
 bh_status_t dt_cleanup(struct device_tree_node* root);
 
-// Node operations
+// Node operations. Path, phandle and compatible lookups use hashed
+// indexes of the whole tree, built on first use and rebuilt after any node
+// is added, removed or moved or a phandle/compatible property changes.
+// dt_find_node_by_compatible matches any entry of a node's compatible list
+// and, like dt_find_all_by_compatible, reports nodes in document order.
 bh_status_t dt_find_node(const struct device_tree_node* root, const char* path, struct device_tree_node** node);
 bh_status_t dt_find_node_by_property(const struct device_tree_node* root, const char* prop_name, 
                                      const void* prop_value, size_t prop_size, struct device_tree_node** node);
 bh_status_t dt_find_node_by_compatible(const struct device_tree_node* root, const char* compatible, 
                                        struct device_tree_node** node);
+uint32_t dt_find_all_by_compatible(const struct device_tree_node* root, const char* compatible,
+                                   struct device_tree_node** nodes, uint32_t max);
 bh_status_t dt_find_node_by_phandle(const struct device_tree_node* root, uint32_t phandle, 
                                     struct device_tree_node** node);
 bh_status_t dt_add_node(struct device_tree_node* parent, const char* name, struct device_tree_node** node);
@@ -499,6 +521,23 @@ bh_status_t dt_compare_trees(const struct device_tree_node* tree1, const struct
                              bool* identical);
 bh_status_t dt_merge_trees(struct device_tree_node* dest, const struct device_tree_node* src);
 
+// Overlay operations. DTBOs are read in place from their blobs and merged
+// into the tree through its phandle and path indexes: each overlay's own
+// phandles are rebased above the tree's, __local_fixups__ references
+// follow them, __fixups__ references are resolved through /__symbols__
+// (giving the target a phandle if it has none), then every fragment's
+// __overlay__ is merged into its target/target-path node and the
+// overlay's __symbols__ are added. Overlays apply in order, so later ones
+// may target nodes and labels added by earlier ones. On error the tree may
+// hold the overlays applied so far.
+bh_status_t dt_apply_overlays(struct device_tree_node* root, const void* const* overlays,
+                              const size_t* sizes, uint32_t count);
+
+// Base blob plus overlays to a new blob, built once after all overlays are
+// merged; the base is left as it was
+bh_status_t dt_apply_overlays_to_blob(const void* base, size_t base_size, const void* const* overlays,
+                                      const size_t* sizes, uint32_t count, void** blob, size_t* size);
+
 // Platform-specific operations
 bh_status_t dt_load_from_uboot(void** blob, size_t* size);
 bh_status_t dt_load_from_openfirmware(void** blob, size_t* size);
@@ -0,0 +1,972 @@
+/*
+ * fdt.c - In-place flattened device tree access for BloodHorn
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "fdt.h"
+#include "devicetree.h"
+
+#define FDT_ALIGN4(x) (((x) + 3) & ~3)
+#define FDT_RSV_ENTRY_SIZE 16
+#define FDT_PROP_HDR_SIZE 12    // tag, len, nameoff
+
+// Version 16 headers lack size_dt_struct; the block then runs to FDT_END
+static uint32_t fdt_struct_size(const void* fdt) {
+    if (fdt_version(fdt) >= 17) {
+        return fdt_size_dt_struct(fdt);
+    }
+
+    uint32_t avail = fdt_totalsize(fdt) - fdt_off_dt_struct(fdt);
+    const uint8_t* s = (const uint8_t*)fdt + fdt_off_dt_struct(fdt);
+    uint32_t off = 0;
+
+    while (off + FDT_TAG_SIZE <= avail) {
+        uint32_t tag = fdt_be32(s + off);
+        off += FDT_TAG_SIZE;
+        if (tag == FDT_END) {
+            return off;
+        }
+        if (tag == FDT_BEGIN_NODE) {
+            while (off < avail && s[off]) off++;
+            off = FDT_ALIGN4(off + 1);
+        } else if (tag == FDT_PROP) {
+            if (off + 8 > avail) break;
+            off = FDT_ALIGN4(off + 8 + fdt_be32(s + off));
+        } else if (tag != FDT_END_NODE && tag != FDT_NOP) {
+            break;
+        }
+    }
+    return 0;
+}
+
+static const uint8_t* fdt_struct(const void* fdt) {
+    return (const uint8_t*)fdt + fdt_off_dt_struct(fdt);
+}
+
+static const char* fdt_strings(const void* fdt) {
+    return (const char*)fdt + fdt_off_dt_strings(fdt);
+}
+
+// `len` bytes at struct offset `offset`, or NULL if they run off the block
+static const uint8_t* fdt_ptr(const void* fdt, int offset, int len) {
+    uint32_t size = fdt_struct_size(fdt);
+
+    if (offset < 0 || len < 0 || (uint32_t)offset > size || (uint32_t)len > size - (uint32_t)offset) {
+        return NULL;
+    }
+    return fdt_struct(fdt) + offset;
+}
+
+int fdt_check_header(const void* fdt) {
+    if (!fdt) {
+        return -FDT_ERR_BADOFFSET;
+    }
+    if (fdt_magic(fdt) != FDT_MAGIC) {
+        return -FDT_ERR_BADMAGIC;
+    }
+    if (fdt_version(fdt) < 16 || fdt_be32((const uint8_t*)fdt + 24) > FDT_VERSION) {
+        return -FDT_ERR_BADVERSION;
+    }
+
+    uint32_t total = fdt_totalsize(fdt);
+    uint32_t hdr = fdt_version(fdt) >= 17 ? FDT_V17_HEADER_SIZE : FDT_V17_HEADER_SIZE - 4;
+    uint32_t off_struct = fdt_off_dt_struct(fdt);
+    uint32_t off_strings = fdt_off_dt_strings(fdt);
+    uint32_t off_rsv = fdt_off_mem_rsvmap(fdt);
+
+    if (total < hdr || off_rsv < hdr || off_rsv > total ||
+        off_struct < hdr || off_struct > total ||
+        off_strings < hdr || off_strings > total ||
+        fdt_size_dt_strings(fdt) > total - off_strings) {
+        return -FDT_ERR_TRUNCATED;
+    }
+    if (fdt_version(fdt) >= 17 && fdt_size_dt_struct(fdt) > total - off_struct) {
+        return -FDT_ERR_TRUNCATED;
+    }
+    if (fdt_struct_size(fdt) < FDT_TAG_SIZE) {
+        return -FDT_ERR_BADSTRUCTURE;
+    }
+    return 0;
+}
+
+uint32_t fdt_next_tag(const void* fdt, int offset, int* next) {
+    const uint8_t* p = fdt_ptr(fdt, offset, FDT_TAG_SIZE);
+    uint32_t size = fdt_struct_size(fdt);
+
+    *next = -FDT_ERR_TRUNCATED;
+    if (!p) {
+        return FDT_END;
+    }
+
+    uint32_t tag = fdt_be32(p);
+    uint32_t end = (uint32_t)offset + FDT_TAG_SIZE;
+
+    switch (tag) {
+        case FDT_BEGIN_NODE: {
+            const uint8_t* name = fdt_struct(fdt) + end;
+            const uint8_t* nul = memchr(name, 0, size - end);
+            if (!nul) {
+                return FDT_END;
+            }
+            end += (uint32_t)(nul - name) + 1;
+            break;
+        }
+        case FDT_PROP: {
+            const uint8_t* hdr = fdt_ptr(fdt, (int)end, 8);
+            if (!hdr) {
+                return FDT_END;
+            }
+            uint32_t len = fdt_be32(hdr);
+            if (len > size - end - 8) {
+                return FDT_END;
+            }
+            end += 8 + len;
+            break;
+        }
+        case FDT_END:
+        case FDT_END_NODE:
+        case FDT_NOP:
+            break;
+        default:
+            *next = -FDT_ERR_BADSTRUCTURE;
+            return FDT_END;
+    }
+
+    end = FDT_ALIGN4(end);
+    *next = end > size ? -FDT_ERR_TRUNCATED : (int)end;
+    return tag;
+}
+
+// The offset just past a node's name, or an error if `node` is not a node
+static int fdt_node_body(const void* fdt, int node) {
+    int next;
+
+    if (node < 0 || (node % FDT_TAG_SIZE) || fdt_next_tag(fdt, node, &next) != FDT_BEGIN_NODE) {
+        return -FDT_ERR_BADOFFSET;
+    }
+    return next;
+}
+
+// A property tag at `prop`, or an error
+static int fdt_prop_body(const void* fdt, int prop) {
+    int next;
+
+    if (prop < 0 || (prop % FDT_TAG_SIZE) || fdt_next_tag(fdt, prop, &next) != FDT_PROP) {
+        return -FDT_ERR_BADOFFSET;
+    }
+    return next;
+}
+
+int fdt_next_node(const void* fdt, int offset, int* depth) {
+    int next = 0;
+    uint32_t tag;
+
+    if (offset >= 0) {
+        next = fdt_node_body(fdt, offset);
+        if (next < 0) {
+            return next;
+        }
+    }
+
+    do {
+        offset = next;
+        tag = fdt_next_tag(fdt, offset, &next);
+        switch (tag) {
+            case FDT_PROP:
+            case FDT_NOP:
+                break;
+            case FDT_BEGIN_NODE:
+                if (depth) (*depth)++;
+                break;
+            case FDT_END_NODE:
+                if (depth && --(*depth) < 0) {
+                    return -FDT_ERR_NOTFOUND;
+                }
+                break;
+            case FDT_END:
+            default:
+                return next < 0 ? next : -FDT_ERR_NOTFOUND;
+        }
+    } while (tag != FDT_BEGIN_NODE);
+
+    return offset;
+}
+
+int fdt_first_subnode(const void* fdt, int parent) {
+    int depth = 0;
+    int offset = fdt_next_node(fdt, parent, &depth);
+
+    if (offset < 0) {
+        return offset;
+    }
+    return depth == 1 ? offset : -FDT_ERR_NOTFOUND;
+}
+
+int fdt_next_subnode(const void* fdt, int offset) {
+    int depth = 1;
+
+    // Skip the node's own children: stop at the next node back at depth 1
+    do {
+        offset = fdt_next_node(fdt, offset, &depth);
+        if (offset < 0 || depth < 1) {
+            return -FDT_ERR_NOTFOUND;
+        }
+    } while (depth > 1);
+
+    return offset;
+}
+
+const char* fdt_get_name(const void* fdt, int node, int* len) {
+    int body = fdt_node_body(fdt, node);
+
+    if (body < 0) {
+        if (len) *len = body;
+        return NULL;
+    }
+
+    const char* name = (const char*)fdt_struct(fdt) + node + FDT_TAG_SIZE;
+    if (len) *len = (int)strlen(name);
+    return name;
+}
+
+static int fdt_name_matches(const char* node_name, const char* name, int namelen) {
+    if (strncmp(node_name, name, (size_t)namelen) != 0) {
+        return 0;
+    }
+    if (node_name[namelen] == '\0') {
+        return 1;
+    }
+    // "name" without a unit address also matches "name@..."
+    return !memchr(name, '@', (size_t)namelen) && node_name[namelen] == '@';
+}
+
+int fdt_subnode_offset_namelen(const void* fdt, int parent, const char* name, int namelen) {
+    int err = fdt_check_header(fdt);
+    if (err) {
+        return err;
+    }
+
+    for (int node = fdt_first_subnode(fdt, parent); node >= 0; node = fdt_next_subnode(fdt, node)) {
+        const char* node_name = fdt_get_name(fdt, node, NULL);
+        if (node_name && fdt_name_matches(node_name, name, namelen)) {
+            return node;
+        }
+    }
+    return -FDT_ERR_NOTFOUND;
+}
+
+int fdt_subnode_offset(const void* fdt, int parent, const char* name) {
+    return fdt_subnode_offset_namelen(fdt, parent, name, (int)strlen(name));
+}
+
+int fdt_path_offset(const void* fdt, const char* path) {
+    int err = fdt_check_header(fdt);
+    if (err) {
+        return err;
+    }
+    if (!path || !*path) {
+        return -FDT_ERR_BADPATH;
+    }
+
+    const char* p = path;
+    int node = 0;
+
+    // An alias stands in for the path up to the first '/'
+    if (*p != '/') {
+        const char* slash = strchr(p, '/');
+        int alias_len = slash ? (int)(slash - p) : (int)strlen(p);
+        int aliases = fdt_path_offset(fdt, "/aliases");
+        int len;
+
+        if (aliases < 0) {
+            return -FDT_ERR_BADPATH;
+        }
+        const char* target = fdt_getprop_namelen(fdt, aliases, p, alias_len, &len);
+        if (!target || len < 2 || target[0] != '/' || target[len - 1]) {
+            return -FDT_ERR_BADPATH;
+        }
+        node = fdt_path_offset(fdt, target);
+        if (node < 0) {
+            return node;
+        }
+        p += alias_len;
+    }
+
+    while (*p) {
+        while (*p == '/') p++;
+        if (!*p) {
+            break;
+        }
+
+        const char* q = strchr(p, '/');
+        int len = q ? (int)(q - p) : (int)strlen(p);
+
+        node = fdt_subnode_offset_namelen(fdt, node, p, len);
+        if (node < 0) {
+            return node;
+        }
+        p += len;
+    }
+    return node;
+}
+
+int fdt_parent_offset(const void* fdt, int node) {
+    int body = fdt_node_body(fdt, node);
+    if (body < 0) {
+        return body;
+    }
+    if (node == 0) {
+        return -FDT_ERR_NOTFOUND;
+    }
+
+    // Remember the most recent node opened at each depth on the way down
+    int stack[64];
+    int depth = 0;
+
+    for (int offset = fdt_next_node(fdt, -1, &depth); offset >= 0; offset = fdt_next_node(fdt, offset, &depth)) {
+        if (depth < 1 || depth > (int)(sizeof(stack) / sizeof(stack[0]))) {
+            return -FDT_ERR_BADSTRUCTURE;
+        }
+        stack[depth - 1] = offset;
+        if (offset == node) {
+            return depth >= 2 ? stack[depth - 2] : -FDT_ERR_NOTFOUND;
+        }
+    }
+    return -FDT_ERR_BADOFFSET;
+}
+
+// The first property tag at or after `offset`, skipping NOPs
+static int fdt_next_prop_from(const void* fdt, int offset) {
+    int next;
+
+    for (;;) {
+        uint32_t tag = fdt_next_tag(fdt, offset, &next);
+        if (tag == FDT_PROP) {
+            return offset;
+        }
+        if (tag != FDT_NOP) {
+            return (tag == FDT_END && next < 0) ? next : -FDT_ERR_NOTFOUND;
+        }
+        offset = next;
+    }
+}
+
+int fdt_first_property_offset(const void* fdt, int node) {
+    int body = fdt_node_body(fdt, node);
+    return body < 0 ? body : fdt_next_prop_from(fdt, body);
+}
+
+int fdt_next_property_offset(const void* fdt, int prop) {
+    int next = fdt_prop_body(fdt, prop);
+    return next < 0 ? next : fdt_next_prop_from(fdt, next);
+}
+
+const void* fdt_getprop_by_offset(const void* fdt, int prop, const char** name, int* len) {
+    int next = fdt_prop_body(fdt, prop);
+    if (next < 0) {
+        if (len) *len = next;
+        return NULL;
+    }
+
+    const uint8_t* p = fdt_struct(fdt) + prop;
+    uint32_t nameoff = fdt_be32(p + 8);
+    uint32_t strsize = fdt_size_dt_strings(fdt);
+
+    // The name must end inside the strings block, or strlen/strcmp on it
+    // runs off the blob
+    if (nameoff >= strsize || !memchr(fdt_strings(fdt) + nameoff, '\0', strsize - nameoff)) {
+        if (name) *name = NULL;
+        if (len) *len = -FDT_ERR_BADSTRUCTURE;
+        return NULL;
+    }
+
+    if (name) *name = fdt_strings(fdt) + nameoff;
+    if (len) *len = (int)fdt_be32(p + 4);
+    return p + FDT_PROP_HDR_SIZE;
+}
+
+int fdt_find_string(const void* fdt, const char* s, int len) {
+    const char* strtab = fdt_strings(fdt);
+    const char* end = strtab + fdt_size_dt_strings(fdt);
+    const char* p = strtab;
+
+    if (len <= 0) {
+        return -FDT_ERR_NOTFOUND;
+    }
+
+    // Also matches a tail of a longer string, which dtc shares names by
+    while (p + len < end) {
+        p = memchr(p, s[0], (size_t)(end - p - len));
+        if (!p) {
+            break;
+        }
+        if (memcmp(p, s, (size_t)len) == 0 && p[len] == '\0') {
+            return (int)(p - strtab);
+        }
+        p++;
+    }
+    return -FDT_ERR_NOTFOUND;
+}
+
+// Property `name` of `node`. The name is interned once into a strings
+// block offset; tags with that nameoff match without a string compare, and
+// only names starting with the same byte are compared at all (a blob may
+// hold the same string at more than one offset).
+static int fdt_find_prop(const void* fdt, int node, const char* name, int namelen) {
+    int nameoff = fdt_find_string(fdt, name, namelen);
+    if (nameoff < 0) {
+        int body = fdt_node_body(fdt, node);
+        return body < 0 ? body : -FDT_ERR_NOTFOUND;
+    }
+
+    const char* strtab = fdt_strings(fdt);
+    uint32_t strsize = fdt_size_dt_strings(fdt);
+
+    for (int prop = fdt_first_property_offset(fdt, node); prop >= 0; prop = fdt_next_property_offset(fdt, prop)) {
+        uint32_t off = fdt_be32(fdt_struct(fdt) + prop + 8);
+        if (off == (uint32_t)nameoff) {
+            return prop;
+        }
+        if (off < strsize && strtab[off] == name[0] &&
+            (size_t)namelen < strsize - off &&
+            memcmp(strtab + off, name, (size_t)namelen) == 0 && strtab[off + namelen] == '\0') {
+            return prop;
+        }
+    }
+    return -FDT_ERR_NOTFOUND;
+}
+
+const void* fdt_getprop_namelen(const void* fdt, int node, const char* name, int namelen, int* len) {
+    int err = fdt_check_header(fdt);
+    int prop = err ? err : fdt_find_prop(fdt, node, name, namelen);
+
+    if (prop < 0) {
+        if (len) *len = prop;
+        return NULL;
+    }
+    return fdt_getprop_by_offset(fdt, prop, NULL, len);
+}
+
+const void* fdt_getprop(const void* fdt, int node, const char* name, int* len) {
+    return fdt_getprop_namelen(fdt, node, name, (int)strlen(name), len);
+}
+
+// Size of the reserve map including its terminating entry
+static int fdt_rsvmap_size(const void* fdt) {
+    const uint8_t* p = (const uint8_t*)fdt + fdt_off_mem_rsvmap(fdt);
+    uint32_t avail = fdt_totalsize(fdt) - fdt_off_mem_rsvmap(fdt);
+    uint32_t size = 0;
+
+    while (size + FDT_RSV_ENTRY_SIZE <= avail) {
+        const uint8_t* e = p + size;
+        size += FDT_RSV_ENTRY_SIZE;
+        if (!fdt_be32(e) && !fdt_be32(e + 4) && !fdt_be32(e + 8) && !fdt_be32(e + 12)) {
+            return (int)size;
+        }
+    }
+    return -FDT_ERR_TRUNCATED;
+}
+
+int fdt_open_into(const void* fdt, void* buf, int bufsize) {
+    int err = fdt_check_header(fdt);
+    if (err) {
+        return err;
+    }
+
+    int rsv_size = fdt_rsvmap_size(fdt);
+    if (rsv_size < 0) {
+        return rsv_size;
+    }
+
+    uint32_t struct_size = fdt_struct_size(fdt);
+    uint32_t strings_size = fdt_size_dt_strings(fdt);
+    uint32_t off_rsv = FDT_V17_HEADER_SIZE;     // Already 8-byte aligned
+    uint32_t off_struct = off_rsv + (uint32_t)rsv_size;
+    uint32_t off_strings = off_struct + struct_size;
+    uint32_t needed = off_strings + strings_size;
+
+    if (bufsize < 0 || (uint32_t)bufsize < needed) {
+        return -FDT_ERR_NOSPACE;
+    }
+
+    const uint8_t* src = (const uint8_t*)fdt;
+    uint8_t* dst = (uint8_t*)buf;
+    uint32_t src_rsv = fdt_off_mem_rsvmap(fdt);
+    uint32_t src_struct = fdt_off_dt_struct(fdt);
+    uint32_t src_strings = fdt_off_dt_strings(fdt);
+
+    // Within one buffer, blocks already in order only ever move down, so
+    // moving them front to back never overwrites one not yet moved
+    if (dst < src + fdt_totalsize(fdt) && src < dst + bufsize) {
+        if (dst != src || !(src_rsv < src_struct && src_struct < src_strings)) {
+            return -FDT_ERR_BADLAYOUT;
+        }
+    }
+
+    memmove(dst + off_rsv, src + src_rsv, (size_t)rsv_size);
+    memmove(dst + off_struct, src + src_struct, struct_size);
+    memmove(dst + off_strings, src + src_strings, strings_size);
+    if (dst != src) {
+        memcpy(dst, src, 28);   // magic .. boot_cpuid_phys
+    }
+
+    fdt_set_be32(dst + 4, (uint32_t)bufsize);
+    fdt_set_be32(dst + 8, off_struct);
+    fdt_set_be32(dst + 12, off_strings);
+    fdt_set_be32(dst + 16, off_rsv);
+    fdt_set_be32(dst + 20, FDT_VERSION);
+    fdt_set_be32(dst + 24, 16);
+    fdt_set_be32(dst + 32, strings_size);
+    fdt_set_be32(dst + 36, struct_size);
+    return 0;
+}
+
+// Writes need the open_into layout: a v17 header with the strings block
+// last, right after the structure block
+static int fdt_check_writable(const void* fdt) {
+    int err = fdt_check_header(fdt);
+    if (err) {
+        return err;
+    }
+    if (fdt_version(fdt) < 17 ||
+        fdt_off_mem_rsvmap(fdt) >= fdt_off_dt_struct(fdt) ||
+        fdt_off_dt_struct(fdt) + fdt_size_dt_struct(fdt) != fdt_off_dt_strings(fdt)) {
+        return -FDT_ERR_BADLAYOUT;
+    }
+    return 0;
+}
+
+int fdt_free_space(const void* fdt) {
+    return (int)(fdt_totalsize(fdt) - fdt_off_dt_strings(fdt) - fdt_size_dt_strings(fdt));
+}
+
+int fdt_pack(void* fdt) {
+    int err = fdt_check_writable(fdt);
+    if (err) {
+        return err;
+    }
+    fdt_set_be32((uint8_t*)fdt + 4, fdt_off_dt_strings(fdt) + fdt_size_dt_strings(fdt));
+    return 0;
+}
+
+// Replace `oldlen` bytes at struct offset `offset` with room for `newlen`,
+// sliding the rest of the structure block and the strings block after it
+static int fdt_splice_struct(void* fdt, int offset, int oldlen, int newlen) {
+    uint8_t* s = (uint8_t*)fdt + fdt_off_dt_struct(fdt);
+    uint32_t tail = fdt_size_dt_struct(fdt) - (uint32_t)(offset + oldlen) + fdt_size_dt_strings(fdt);
+    int delta = newlen - oldlen;
+
+    if (delta > fdt_free_space(fdt)) {
+        return -FDT_ERR_NOSPACE;
+    }
+
+    memmove(s + offset + newlen, s + offset + oldlen, tail);
+    fdt_set_be32((uint8_t*)fdt + 36, (uint32_t)((int)fdt_size_dt_struct(fdt) + delta));
+    fdt_set_be32((uint8_t*)fdt + 12, (uint32_t)((int)fdt_off_dt_strings(fdt) + delta));
+    return 0;
+}
+
+int fdt_setprop(void* fdt, int node, const char* name, const void* val, int len) {
+    int err = fdt_check_writable(fdt);
+    if (err) {
+        return err;
+    }
+    if (!name || !*name || len < 0 || (len && !val)) {
+        return -FDT_ERR_BADOFFSET;
+    }
+
+    int namelen = (int)strlen(name);
+    int prop = fdt_find_prop(fdt, node, name, namelen);
+    uint8_t* s = (uint8_t*)fdt + fdt_off_dt_struct(fdt);
+
+    if (prop >= 0) {
+        int oldlen = FDT_ALIGN4((int)fdt_be32(s + prop + 4));
+        err = fdt_splice_struct(fdt, prop + FDT_PROP_HDR_SIZE, oldlen, FDT_ALIGN4(len));
+        if (err) {
+            return err;
+        }
+    } else if (prop == -FDT_ERR_NOTFOUND) {
+        // New properties go first in the node, ahead of any subnodes
+        int nameoff = fdt_find_string(fdt, name, namelen);
+        int need = FDT_PROP_HDR_SIZE + FDT_ALIGN4(len) + (nameoff < 0 ? namelen + 1 : 0);
+
+        if (need > fdt_free_space(fdt)) {
+            return -FDT_ERR_NOSPACE;
+        }
+
+        prop = fdt_node_body(fdt, node);
+        fdt_splice_struct(fdt, prop, 0, FDT_PROP_HDR_SIZE + FDT_ALIGN4(len));
+        if (nameoff < 0) {
+            char* strtab = (char*)fdt + fdt_off_dt_strings(fdt);
+            nameoff = (int)fdt_size_dt_strings(fdt);
+            memcpy(strtab + nameoff, name, (size_t)namelen + 1);
+            fdt_set_be32((uint8_t*)fdt + 32, (uint32_t)(nameoff + namelen + 1));
+        }
+        fdt_set_be32(s + prop, FDT_PROP);
+        fdt_set_be32(s + prop + 8, (uint32_t)nameoff);
+    } else {
+        return prop;
+    }
+
+    fdt_set_be32(s + prop + 4, (uint32_t)len);
+    if (len) {
+        memcpy(s + prop + FDT_PROP_HDR_SIZE, val, (size_t)len);
+    }
+    memset(s + prop + FDT_PROP_HDR_SIZE + len, 0, (size_t)(FDT_ALIGN4(len) - len));
+    return 0;
+}
+
+int fdt_setprop_string(void* fdt, int node, const char* name, const char* str) {
+    return fdt_setprop(fdt, node, name, str, (int)strlen(str) + 1);
+}
+
+int fdt_delprop(void* fdt, int node, const char* name) {
+    int err = fdt_check_writable(fdt);
+    if (err) {
+        return err;
+    }
+
+    int prop = fdt_find_prop(fdt, node, name, (int)strlen(name));
+    if (prop < 0) {
+        return prop;
+    }
+
+    // The name stays in the strings block; fdt_pack does not reclaim it
+    // either, as other properties may share it
+    int len = FDT_ALIGN4((int)fdt_be32((uint8_t*)fdt + fdt_off_dt_struct(fdt) + prop + 4));
+    return fdt_splice_struct(fdt, prop, FDT_PROP_HDR_SIZE + len, 0);
+}
+
+int fdt_add_subnode(void* fdt, int parent, const char* name) {
+    int err = fdt_check_writable(fdt);
+    if (err) {
+        return err;
+    }
+    if (!name || !*name || strchr(name, '/')) {
+        return -FDT_ERR_BADPATH;
+    }
+
+    int namelen = (int)strlen(name);
+    int existing = fdt_subnode_offset_namelen(fdt, parent, name, namelen);
+    if (existing >= 0) {
+        const char* found = fdt_get_name(fdt, existing, NULL);
+        if (found && strcmp(found, name) == 0) {
+            return -FDT_ERR_EXISTS;
+        }
+    } else if (existing != -FDT_ERR_NOTFOUND) {
+        return existing;
+    }
+
+    // After the parent's properties (and any NOPs among them)
+    int offset = fdt_node_body(fdt, parent);
+    int next;
+    uint32_t tag;
+
+    if (offset < 0) {
+        return offset;
+    }
+    while ((tag = fdt_next_tag(fdt, offset, &next)) == FDT_PROP || tag == FDT_NOP) {
+        offset = next;
+    }
+    if (next < 0) {
+        return next;
+    }
+
+    int nodelen = FDT_TAG_SIZE + FDT_ALIGN4(namelen + 1) + FDT_TAG_SIZE;
+    err = fdt_splice_struct(fdt, offset, 0, nodelen);
+    if (err) {
+        return err;
+    }
+
+    uint8_t* p = (uint8_t*)fdt + fdt_off_dt_struct(fdt) + offset;
+    memset(p, 0, (size_t)nodelen);
+    fdt_set_be32(p, FDT_BEGIN_NODE);
+    memcpy(p + FDT_TAG_SIZE, name, (size_t)namelen);
+    fdt_set_be32(p + nodelen - FDT_TAG_SIZE, FDT_END_NODE);
+    return offset;
+}
+
+bh_status_t fdt_status(int err) {
+    if (err >= 0) {
+        return BH_STATUS_SUCCESS;
+    }
+
+    switch (-err) {
+        case FDT_ERR_NOTFOUND:
+            return BH_STATUS_NOT_FOUND;
+        case FDT_ERR_EXISTS:
+            return BH_STATUS_ALREADY_EXISTS;
+        case FDT_ERR_NOSPACE:
+            return BH_STATUS_NO_MEMORY;
+        case FDT_ERR_BADOFFSET:
+        case FDT_ERR_BADPATH:
+            return BH_STATUS_INVALID_PARAMETER;
+        case FDT_ERR_BADVERSION:
+            return BH_STATUS_UNSUPPORTED;
+        default:
+            return BH_STATUS_INVALID_DATA;
+    }
+}
+
+bh_status_t fdt_get_timebase_frequency(const void* fdt, uint64_t* frequency) {
+    const uint8_t* prop = NULL;
+    int cpus, len = 0;
+
+    if (!fdt || !frequency) {
+        return BH_STATUS_INVALID_PARAMETER;
+    }
+    cpus = fdt_path_offset(fdt, "/cpus");
+    if (cpus < 0) {
+        return fdt_status(cpus);
+    }
+
+    // Per-CPU nodes carry it on most boards; older trees put it on /cpus
+    int cpu = fdt_first_subnode(fdt, cpus);
+    if (cpu >= 0) {
+        prop = fdt_getprop(fdt, cpu, "timebase-frequency", &len);
+    }
+    if (!prop) {
+        prop = fdt_getprop(fdt, cpus, "timebase-frequency", &len);
+    }
+
+    if (prop && len == 4) {
+        *frequency = fdt_be32(prop);
+    } else if (prop && len == 8) {
+        *frequency = ((uint64_t)fdt_be32(prop) << 32) | fdt_be32(prop + 4);
+    } else {
+        return BH_STATUS_NOT_FOUND;
+    }
+    return *frequency ? BH_STATUS_SUCCESS : BH_STATUS_INVALID_DATA;
+}
+
+// A "reg" number `cells` 32-bit words wide
+static uint64_t fdt_read_cells(const uint8_t* p, uint32_t cells) {
+    uint64_t v = 0;
+    for (uint32_t i = 0; i < cells; i++) {
+        v = (v << 32) | fdt_be32(p + 4 * i);
+    }
+    return v;
+}
+
+static uint32_t fdt_getprop_cells(const void* fdt, int node, const char* name, uint32_t fallback) {
+    int len;
+    const uint8_t* p = fdt_getprop(fdt, node, name, &len);
+    return p && len == 4 ? fdt_be32(p) : fallback;
+}
+
+static bool fdt_prop_is(const void* fdt, int node, const char* name, const char* value) {
+    int len;
+    const char* p = fdt_getprop(fdt, node, name, &len);
+    return p && len == (int)strlen(value) + 1 && memcmp(p, value, (size_t)len) == 0;
+}
+
+// Append a node's (address, size) pairs; false if `list` overflowed
+static bool fdt_add_reg(const void* fdt, int node, uint32_t ac, uint32_t sc,
+                        struct fdt_region* list, uint32_t* count) {
+    int len;
+    const uint8_t* p = fdt_getprop(fdt, node, "reg", &len);
+    uint32_t stride = (ac + sc) * 4;
+
+    if (!p || ac < 1 || ac > 2 || sc < 1 || sc > 2) {
+        return true;
+    }
+    for (int off = 0; off + (int)stride <= len; off += (int)stride) {
+        uint64_t size = fdt_read_cells(p + off + ac * 4, sc);
+        if (size == 0) {
+            continue;
+        }
+        if (*count == FDT_BOOT_MAX_REGIONS) {
+            return false;
+        }
+        list[*count].base = fdt_read_cells(p + off, ac);
+        list[*count].size = size;
+        (*count)++;
+    }
+    return true;
+}
+
+enum {
+    FDT_SCAN_OTHER,
+    FDT_SCAN_CPUS,
+    FDT_SCAN_RESERVED,
+};
+
+bh_status_t fdt_scan_boot_info(const void* fdt, struct fdt_boot_info* info) {
+    if (!fdt || !info) {
+        return BH_STATUS_INVALID_PARAMETER;
+    }
+    int err = fdt_check_header(fdt);
+    if (err) {
+        return fdt_status(err);
+    }
+    memset(info, 0, sizeof(*info));
+
+    // Reserve map first: entries up to the all-zero terminator
+    const uint8_t* rsv = (const uint8_t*)fdt + fdt_off_mem_rsvmap(fdt);
+    int rsv_size = fdt_rsvmap_size(fdt);
+    if (rsv_size < 0) {
+        return fdt_status(rsv_size);
+    }
+    for (int off = 0; off + FDT_RSV_ENTRY_SIZE < rsv_size; off += FDT_RSV_ENTRY_SIZE) {
+        uint64_t size = fdt_read_cells(rsv + off + 8, 2);
+        if (size == 0) {
+            continue;
+        }
+        if (info->reserved_count == FDT_BOOT_MAX_REGIONS) {
+            return BH_STATUS_NO_MEMORY;
+        }
+        info->reserved[info->reserved_count].base = fdt_read_cells(rsv + off, 2);
+        info->reserved[info->reserved_count].size = size;
+        info->reserved_count++;
+    }
+
+    // Then every node once, in document order. Only depth 1 (memory,
+    // /cpus, /reserved-memory, /chosen) and their children matter; the
+    // cell sizes come from the node each one hangs off.
+    uint32_t root_ac = 2, root_sc = 1, child_ac = 0, child_sc = 0;
+    int kind = FDT_SCAN_OTHER;
+    bool boot_cpu_known = false;
+    int depth = -1;
+
+    for (int node = fdt_next_node(fdt, -1, &depth); node >= 0; node = fdt_next_node(fdt, node, &depth)) {
+        if (depth == 0) {
+            root_ac = fdt_getprop_cells(fdt, node, "#address-cells", 2);
+            root_sc = fdt_getprop_cells(fdt, node, "#size-cells", 1);
+            continue;
+        }
+        if (depth == 1) {
+            int namelen;
+            const char* name = fdt_get_name(fdt, node, &namelen);
+
+            kind = FDT_SCAN_OTHER;
+            if (!name) {
+                continue;
+            }
+            if (fdt_prop_is(fdt, node, "device_type", "memory")) {
+                fdt_add_reg(fdt, node, root_ac, root_sc, info->memory, &info->memory_count);
+            } else if (namelen == 4 && memcmp(name, "cpus", 4) == 0) {
+                kind = FDT_SCAN_CPUS;
+                child_ac = fdt_getprop_cells(fdt, node, "#address-cells", 1);
+            } else if (namelen == 15 && memcmp(name, "reserved-memory", 15) == 0) {
+                kind = FDT_SCAN_RESERVED;
+                child_ac = fdt_getprop_cells(fdt, node, "#address-cells", root_ac);
+                child_sc = fdt_getprop_cells(fdt, node, "#size-cells", root_sc);
+            } else if (namelen == 6 && memcmp(name, "chosen", 6) == 0) {
+                int len;
+                const uint8_t* p = fdt_getprop(fdt, node, "boot-hartid", &len);
+                if (p && (len == 4 || len == 8)) {
+                    info->boot_cpu = fdt_read_cells(p, (uint32_t)len / 4);
+                    boot_cpu_known = true;
+                }
+            }
+            continue;
+        }
+        if (depth != 2 || kind == FDT_SCAN_OTHER) {
+            continue;
+        }
+
+        if (kind == FDT_SCAN_CPUS) {
+            if (!fdt_prop_is(fdt, node, "device_type", "cpu") ||
+                fdt_prop_is(fdt, node, "status", "disabled") || fdt_prop_is(fdt, node, "status", "fail")) {
+                continue;
+            }
+            if (info->cpu_count++ == 0 && !boot_cpu_known) {
+                int len;
+                const uint8_t* p = fdt_getprop(fdt, node, "reg", &len);
+                if (p && child_ac >= 1 && child_ac <= 2 && len >= (int)child_ac * 4) {
+                    info->boot_cpu = fdt_read_cells(p, child_ac);
+                }
+            }
+        } else if (!fdt_add_reg(fdt, node, child_ac, child_sc, info->reserved, &info->reserved_count)) {
+            return BH_STATUS_NO_MEMORY;
+        }
+    }
+    return BH_STATUS_SUCCESS;
+}
+
+bool fdt_boot_info_reserve(struct fdt_boot_info* info, uint64_t base, uint64_t size) {
+    if (size == 0) {
+        return true;
+    }
+    if (info->reserved_count == FDT_BOOT_MAX_REGIONS) {
+        return false;
+    }
+    info->reserved[info->reserved_count].base = base;
+    info->reserved[info->reserved_count].size = size;
+    info->reserved_count++;
+    return true;
+}
+
+uint64_t fdt_boot_info_place(const struct fdt_boot_info* info, uint64_t from, uint64_t size, uint64_t align) {
+    if (!info || size == 0 || align == 0 || (align & (align - 1))) {
+        return 0;
+    }
+
+    for (uint32_t m = 0; m < info->memory_count; m++) {
+        uint64_t end = info->memory[m].base + info->memory[m].size;
+        uint64_t at = from > info->memory[m].base ? from : info->memory[m].base;
+        uint32_t r = 0;
+
+        at = (at + align - 1) & ~(align - 1);
+        // Step past each reserved range in the way until a pass finds none
+        while (at >= from && at < end && size <= end - at) {
+            for (r = 0; r < info->reserved_count; r++) {
+                const struct fdt_region* res = &info->reserved[r];
+                if (at < res->base + res->size && res->base < at + size) {
+                    at = (res->base + res->size + align - 1) & ~(align - 1);
+                    break;
+                }
+            }
+            if (r == info->reserved_count) {
+                return at;
+            }
+        }
+    }
+    return 0;
+}
+
+int fdt_chosen_size(const char* cmdline, bool initrd) {
+    static const char* const names[] = { "chosen", "bootargs", "linux,initrd-start", "linux,initrd-end" };
+    int size = FDT_TAG_SIZE + FDT_ALIGN4((int)strlen(names[0]) + 1) + FDT_TAG_SIZE;
+
+    // Worst case: every name new to the strings block
+    if (cmdline) {
+        size += FDT_PROP_HDR_SIZE + FDT_ALIGN4((int)strlen(cmdline) + 1) + (int)strlen(names[1]) + 1;
+    }
+    if (initrd) {
+        size += 2 * (FDT_PROP_HDR_SIZE + 8) + (int)strlen(names[2]) + 1 + (int)strlen(names[3]) + 1;
+    }
+    return size;
+}
+
+int fdt_set_chosen(void* fdt, const char* cmdline, uint64_t initrd_start, uint64_t initrd_end) {
+    int root = fdt_next_node(fdt, -1, NULL);
+    int chosen, err;
+
+    if (root < 0) {
+        return root;
+    }
+    chosen = fdt_subnode_offset(fdt, root, "chosen");
+    if (chosen == -FDT_ERR_NOTFOUND) {
+        chosen = fdt_add_subnode(fdt, root, "chosen");
+    }
+    if (chosen < 0) {
+        return chosen;
+    }
+    if (cmdline && (err = fdt_setprop_string(fdt, chosen, "bootargs", cmdline)) != 0) {
+        return err;
+    }
+    if (initrd_end > initrd_start) {
+        err = fdt_setprop_u64(fdt, chosen, "linux,initrd-start", initrd_start);
+        if (!err) {
+            err = fdt_setprop_u64(fdt, chosen, "linux,initrd-end", initrd_end);
+        }
+        return err;
+    }
+    return 0;
+}
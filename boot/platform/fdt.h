@@ -0,0 +1,184 @@
+/*
+ * fdt.h - In-place flattened device tree access for BloodHorn
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef _FDT_H_
+#define _FDT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "../libb/include/bloodhorn/bootinfo.h"
+
+// Accessors that work directly on a DTB, libfdt style: nothing is
+// allocated and no node tree is built. Nodes and properties are named by
+// their offset in the structure block; functions returning int give an
+// offset (>= 0) or a negative FDT_ERR_* code.
+//
+// Writes edit the blob in place, sliding the rest of the blob up or down.
+// The bytes between the end of the strings block and totalsize are the
+// free space writes grow into: fdt_open_into lays a blob out that way in
+// a larger buffer, and fdt_pack trims it again. Any write moves what
+// follows it, so offsets and pointers taken before a write are stale after
+// it (except the offset of the node written to).
+
+// Error codes (returned negated)
+#define FDT_ERR_NOTFOUND        1   // No such node or property
+#define FDT_ERR_EXISTS          2   // Node already exists
+#define FDT_ERR_NOSPACE         3   // Not enough free space in the blob
+#define FDT_ERR_BADOFFSET       4   // Offset is not a node/property tag
+#define FDT_ERR_BADPATH         5   // Malformed path
+#define FDT_ERR_TRUNCATED       8   // Structure block ends early
+#define FDT_ERR_BADMAGIC        9
+#define FDT_ERR_BADVERSION      10
+#define FDT_ERR_BADSTRUCTURE    11  // Invalid tag sequence
+#define FDT_ERR_BADLAYOUT       12  // Blocks not in rsvmap, struct, strings order
+
+#define FDT_V17_HEADER_SIZE     40
+#define FDT_TAG_SIZE            4
+
+// Header fields (the blob is big-endian)
+static inline uint32_t fdt_be32(const void* p) {
+    const uint8_t* b = (const uint8_t*)p;
+    return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+}
+
+static inline void fdt_set_be32(void* p, uint32_t v) {
+    uint8_t* b = (uint8_t*)p;
+    b[0] = (uint8_t)(v >> 24);
+    b[1] = (uint8_t)(v >> 16);
+    b[2] = (uint8_t)(v >> 8);
+    b[3] = (uint8_t)v;
+}
+
+#define fdt_magic(fdt)              fdt_be32((const uint8_t*)(fdt) + 0)
+#define fdt_totalsize(fdt)          fdt_be32((const uint8_t*)(fdt) + 4)
+#define fdt_off_dt_struct(fdt)      fdt_be32((const uint8_t*)(fdt) + 8)
+#define fdt_off_dt_strings(fdt)     fdt_be32((const uint8_t*)(fdt) + 12)
+#define fdt_off_mem_rsvmap(fdt)     fdt_be32((const uint8_t*)(fdt) + 16)
+#define fdt_version(fdt)            fdt_be32((const uint8_t*)(fdt) + 20)
+#define fdt_size_dt_strings(fdt)    fdt_be32((const uint8_t*)(fdt) + 32)
+#define fdt_size_dt_struct(fdt)     fdt_be32((const uint8_t*)(fdt) + 36)
+
+// Check the header and that every block lies inside totalsize
+int fdt_check_header(const void* fdt);
+
+// The tag at `offset`; *next gets the offset of the following tag (or a
+// negative error with FDT_END returned)
+uint32_t fdt_next_tag(const void* fdt, int offset, int* next);
+
+// Node iteration. fdt_next_node visits every node in document order
+// (offset -1 gives the root) and tracks the depth relative to the start.
+int fdt_next_node(const void* fdt, int offset, int* depth);
+int fdt_first_subnode(const void* fdt, int parent);
+int fdt_next_subnode(const void* fdt, int offset);
+
+// The node's name ("" for the root) and its length
+const char* fdt_get_name(const void* fdt, int node, int* len);
+
+// A child by name: "name@unit" matches exactly, "name" also matches the
+// first "name@..." child
+int fdt_subnode_offset_namelen(const void* fdt, int parent, const char* name, int namelen);
+int fdt_subnode_offset(const void* fdt, int parent, const char* name);
+
+// A node by absolute path, or by alias ("serial0/...") through /aliases
+int fdt_path_offset(const void* fdt, const char* path);
+
+// The parent of a node (a forward scan from the root)
+int fdt_parent_offset(const void* fdt, int node);
+
+// Property iteration
+int fdt_first_property_offset(const void* fdt, int node);
+int fdt_next_property_offset(const void* fdt, int prop);
+const void* fdt_getprop_by_offset(const void* fdt, int prop, const char** name, int* len);
+
+// The offset of `s` in the strings block, or -FDT_ERR_NOTFOUND. Every
+// property name is in the block, so a lookup for a name that is not there
+// needs no walk at all; one that is compares offsets rather than strings.
+int fdt_find_string(const void* fdt, const char* s, int len);
+
+// A property's value and length; NULL with *len = -FDT_ERR_* if absent
+const void* fdt_getprop_namelen(const void* fdt, int node, const char* name, int namelen, int* len);
+const void* fdt_getprop(const void* fdt, int node, const char* name, int* len);
+
+// Relayout into `buf` (which may be `fdt`) as header, reserve map,
+// structure and strings, with totalsize = bufsize
+int fdt_open_into(const void* fdt, void* buf, int bufsize);
+
+// Shrink totalsize to the bytes in use
+int fdt_pack(void* fdt);
+
+// Set (replacing or adding) or delete a property of `node`
+int fdt_setprop(void* fdt, int node, const char* name, const void* val, int len);
+int fdt_delprop(void* fdt, int node, const char* name);
+
+static inline int fdt_setprop_u32(void* fdt, int node, const char* name, uint32_t val) {
+    uint8_t be[4];
+    fdt_set_be32(be, val);
+    return fdt_setprop(fdt, node, name, be, sizeof(be));
+}
+
+static inline int fdt_setprop_u64(void* fdt, int node, const char* name, uint64_t val) {
+    uint8_t be[8];
+    fdt_set_be32(be, (uint32_t)(val >> 32));
+    fdt_set_be32(be + 4, (uint32_t)val);
+    return fdt_setprop(fdt, node, name, be, sizeof(be));
+}
+
+int fdt_setprop_string(void* fdt, int node, const char* name, const char* str);
+
+// Add an empty child node after the parent's properties; its offset
+int fdt_add_subnode(void* fdt, int parent, const char* name);
+
+// Free bytes left for writes
+int fdt_free_space(const void* fdt);
+
+// Map an FDT_ERR_* result onto a BloodHorn status
+bh_status_t fdt_status(int err);
+
+// Timebase rate from the first CPU node, or from /cpus itself
+bh_status_t fdt_get_timebase_frequency(const void* fdt, uint64_t* frequency);
+
+#define FDT_BOOT_MAX_REGIONS    32
+
+struct fdt_region {
+    uint64_t base;
+    uint64_t size;
+};
+
+// What a kernel handoff needs from the tree, gathered in one walk of the
+// blob so the loader asks firmware nothing else
+struct fdt_boot_info {
+    struct fdt_region memory[FDT_BOOT_MAX_REGIONS];     // /memory "reg", in tree order
+    uint32_t memory_count;
+    struct fdt_region reserved[FDT_BOOT_MAX_REGIONS];   // Reserve map and /reserved-memory "reg"
+    uint32_t reserved_count;
+    uint32_t cpu_count;         // Enabled /cpus/cpu nodes (harts on RISC-V)
+    uint64_t boot_cpu;          // /chosen "boot-hartid", else the first CPU's "reg"
+};
+
+// Fill `info` from the blob without changing it. Memory beyond
+// FDT_BOOT_MAX_REGIONS ranges is left out; reserved ranges beyond it fail
+// with BH_STATUS_NO_MEMORY, as placing anything would no longer be safe.
+bh_status_t fdt_scan_boot_info(const void* fdt, struct fdt_boot_info* info);
+
+// Keep `size` bytes at `base` out of fdt_boot_info_place (the loader's own
+// buffers, the blob itself); false if the list is full
+bool fdt_boot_info_reserve(struct fdt_boot_info* info, uint64_t base, uint64_t size);
+
+// The first `align`-aligned address at or above `from`, in memory order of
+// the tree, where `size` bytes fit in RAM clear of every reserved range;
+// 0 if there is none
+uint64_t fdt_boot_info_place(const struct fdt_boot_info* info, uint64_t from, uint64_t size, uint64_t align);
+
+// Free space fdt_set_chosen needs for `cmdline` (may be NULL) and an initrd
+int fdt_chosen_size(const char* cmdline, bool initrd);
+
+// Set /chosen "bootargs" and, for initrd_end > initrd_start,
+// "linux,initrd-start"/"-end", adding /chosen if the tree has none
+int fdt_set_chosen(void* fdt, const char* cmdline, uint64_t initrd_start, uint64_t initrd_end);
+
+#endif /* _FDT_H_ */
@@ -11,6 +11,10 @@
 #include <string.h>
 #include <stdarg.h>
 #include "openfirmware.h"
+#include "devicetree.h"
+#include "fdt.h"
+#include "platform.h"
+#include "../libb/include/bloodhorn/bloodhorn.h"
 #include "../libb/include/bloodhorn/bootinfo.h"
 #include "../Arch32/powerpc.h"
 
@@ -22,6 +26,31 @@ static bool ofw_detected = false;
 static uint32_t ofw_stdout_ihandle = 0;
 static uint32_t ofw_stdin_ihandle = 0;
 
+// Characters from ofw_putc are batched into one "write" call per line,
+// since every client-interface call costs far more than the byte it sends
+#define OFW_CONSOLE_BUFFER_SIZE 256
+static char ofw_console_buffer[OFW_CONSOLE_BUFFER_SIZE];
+static size_t ofw_console_pending = 0;
+
+// Tree snapshot: the whole firmware tree as an FDT, with each node's
+// package handle recorded in blob (pre-)order and hashed for lookup
+struct ofw_snapshot_node {
+    uint32_t phandle;           // OFW package handle
+    int offset;                 // Node offset in the blob
+};
+
+static uint8_t* ofw_fdt = NULL;
+static size_t ofw_fdt_capacity = 0;
+static struct ofw_snapshot_node* ofw_snap_nodes = NULL;
+static uint32_t ofw_snap_count = 0;
+static uint32_t ofw_snap_capacity = 0;
+static uint32_t* ofw_snap_hash = NULL;     // Node number + 1, 0 = empty
+static uint32_t ofw_snap_shift = 0;
+
+static int ofw_snapshot_offset(uint32_t phandle);
+static bool ofw_snapshot_phandle(int offset, uint32_t* phandle);
+static void ofw_snapshot_setprop(uint32_t phandle, const char* propname, const void* value, size_t size);
+
 // OpenFirmware entry point (provided by firmware)
 extern uint32_t ofw_entry_point;
 
@@ -57,6 +86,63 @@ static bh_status_t ofw_call_method_va(const char* service, int nargs, int nret,
     return BH_STATUS_SUCCESS;
 }
 
+// Client interface call with cells in and out: inputs go in args[0..nargs)
+// and firmware fills the nret returns after them
+static bh_status_t ofw_call_cells(const char* service, int nargs, int nret, const uint32_t* in, uint32_t* out) {
+    if (!ofw_ci || !service || nargs + nret > 12) {
+        return BH_STATUS_INVALID_PARAMETER;
+    }
+    
+    struct ofw_args ofw_args;
+    ofw_args.service = service;
+    ofw_args.nargs = nargs;
+    ofw_args.nret = nret;
+    for (int i = 0; i < nargs; i++) {
+        ofw_args.args[i] = in[i];
+    }
+    for (int i = 0; i < nret; i++) {
+        ofw_args.args[nargs + i] = (uint32_t)OFW_FAILURE;
+    }
+    
+    uint32_t result = ((uint32_t (*)(struct ofw_args*))ofw_ci->entry_point)(&ofw_args);
+    if (result != OFW_SUCCESS) {
+        return BH_STATUS_IO_ERROR;
+    }
+    
+    for (int i = 0; i < nret; i++) {
+        out[i] = ofw_args.args[nargs + i];
+    }
+    return BH_STATUS_SUCCESS;
+}
+
+// Pages for the libb heap: "claim" with a nonzero alignment lets firmware
+// pick the address, and "release" gives the pages back
+#define OFW_HEAP_PAGE_SIZE 4096
+
+static void* ofw_heap_alloc_pages(bh_size_t pages) {
+    if (pages > UINT32_MAX / OFW_HEAP_PAGE_SIZE) {
+        return NULL;
+    }
+    uint32_t in[3] = { 0, (uint32_t)(pages * OFW_HEAP_PAGE_SIZE), OFW_HEAP_PAGE_SIZE };
+    uint32_t base;
+    if (ofw_call_cells("claim", 3, 1, in, &base) != BH_STATUS_SUCCESS || base == (uint32_t)OFW_FAILURE) {
+        return NULL;
+    }
+    return (void*)(uintptr_t)base;
+}
+
+static void ofw_heap_free_pages(void* base, bh_size_t pages) {
+    uint32_t in[2] = { (uint32_t)(uintptr_t)base, (uint32_t)(pages * OFW_HEAP_PAGE_SIZE) };
+    ofw_call_cells("release", 2, 0, in, NULL);
+}
+
+static bh_system_table_t ofw_system_table = {
+    .putc = ofw_putc,
+    .puts = ofw_puts,
+    .alloc_pages = ofw_heap_alloc_pages,
+    .free_pages = ofw_heap_free_pages,
+};
+
 // Platform detection
 bh_status_t ofw_detect_platform(void) {
     // Check if we have OpenFirmware boot arguments
@@ -116,6 +202,19 @@ bh_status_t ofw_initialize_platform(bh_boot_info_t* boot_info) {
                 "%d.%d", ofw_ci->version, ofw_ci->revision);
     }
     
+    // The heap has to be fed before the snapshot allocates; a table the
+    // loader already installed is kept
+    bh_init_system_table(&ofw_system_table);
+    
+    // Snapshot the tree first so the reads below stay out of firmware; if
+    // it cannot be taken they simply go to firmware
+    if (ofw_snapshot_tree() == BH_STATUS_SUCCESS) {
+        uint64_t timebase;
+        if (fdt_get_timebase_frequency(ofw_fdt, &timebase) == BH_STATUS_SUCCESS) {
+            bh_clock_set_frequency(timebase);
+        }
+    }
+    
     // Initialize console
     bh_status_t status = ofw_console_init();
     if (status != BH_STATUS_SUCCESS) {
@@ -175,6 +274,14 @@ bh_status_t ofw_find_device(const char* path, uint32_t* phandle) {
         return BH_STATUS_INVALID_PARAMETER;
     }
     
+    // Device arguments (":...") need firmware to interpret them
+    if (ofw_fdt && !strchr(path, ':')) {
+        int offset = fdt_path_offset(ofw_fdt, path);
+        if (offset >= 0 && ofw_snapshot_phandle(offset, phandle)) {
+            return BH_STATUS_SUCCESS;
+        }
+    }
+    
     return ofw_call_method("finddevice", 1, 2, path, phandle);
 }
 
@@ -184,6 +291,18 @@ bh_status_t ofw_get_prop(uint32_t phandle, const char* propname, void* buffer, s
         return BH_STATUS_INVALID_PARAMETER;
     }
     
+    int offset = ofw_snapshot_offset(phandle);
+    if (offset >= 0) {
+        int len;
+        const void* value = fdt_getprop(ofw_fdt, offset, propname, &len);
+        if (!value) {
+            return BH_STATUS_NOT_FOUND;
+        }
+        memcpy(buffer, value, (size_t)len < *size ? (size_t)len : *size);
+        *size = (size_t)len;
+        return BH_STATUS_SUCCESS;
+    }
+    
     uint32_t actual_size;
     bh_status_t status = ofw_call_method("getprop", 3, 2, phandle, propname, buffer, &actual_size);
     
@@ -200,7 +319,12 @@ bh_status_t ofw_set_prop(uint32_t phandle, const char* propname, const void* buf
         return BH_STATUS_INVALID_PARAMETER;
     }
     
-    return ofw_call_method("setprop", 4, 1, phandle, propname, buffer, size);
+    bh_status_t status = ofw_call_method("setprop", 4, 1, phandle, propname, buffer, size);
+    if (status == BH_STATUS_SUCCESS && ofw_fdt) {
+        ofw_snapshot_setprop(phandle, propname, buffer, size);
+    }
+    
+    return status;
 }
 
 // Get next property
@@ -209,6 +333,29 @@ bh_status_t ofw_next_prop(uint32_t phandle, const char* prevprop, char* nextprop
         return BH_STATUS_INVALID_PARAMETER;
     }
     
+    int offset = ofw_snapshot_offset(phandle);
+    if (offset >= 0) {
+        // The property after `prevprop`, or the first for none
+        bool take = !prevprop || !prevprop[0];
+        for (int prop = fdt_first_property_offset(ofw_fdt, offset); prop >= 0;
+             prop = fdt_next_property_offset(ofw_fdt, prop)) {
+            const char* name;
+            int len;
+            if (!fdt_getprop_by_offset(ofw_fdt, prop, &name, &len)) {
+                return BH_STATUS_INVALID_DATA;
+            }
+            if (take) {
+                if (strlen(name) >= size) {
+                    return BH_STATUS_INVALID_PARAMETER;
+                }
+                strcpy(nextprop, name);
+                return BH_STATUS_SUCCESS;
+            }
+            take = strcmp(name, prevprop) == 0;
+        }
+        return BH_STATUS_NOT_FOUND;
+    }
+    
     return ofw_call_method("nextprop", 3, 1, phandle, prevprop, nextprop);
 }
 
@@ -218,6 +365,16 @@ bh_status_t ofw_prop_len(uint32_t phandle, const char* propname, size_t* length)
         return BH_STATUS_INVALID_PARAMETER;
     }
     
+    int offset = ofw_snapshot_offset(phandle);
+    if (offset >= 0) {
+        int len;
+        if (!fdt_getprop(ofw_fdt, offset, propname, &len)) {
+            return BH_STATUS_NOT_FOUND;
+        }
+        *length = (size_t)len;
+        return BH_STATUS_SUCCESS;
+    }
+    
     uint32_t len;
     bh_status_t status = ofw_call_method("proplen", 2, 1, phandle, propname, &len);
     
@@ -253,6 +410,313 @@ bh_status_t ofw_instance_to_package(uint32_t ihandle, uint32_t* phandle) {
     return ofw_call_method("instance-to-package", 1, 2, ihandle, phandle);
 }
 
+// Tree snapshot. Every property read through the client interface is a
+// firmware call, microseconds each on PowerPC, and platform setup makes a
+// great many of them. The tree is walked once into an FDT instead, and the
+// reads above are served from it; packages the snapshot does not know fall
+// through to firmware, and setprop writes through to both.
+
+static uint32_t ofw_snapshot_hash(uint32_t phandle) {
+    // Package handles are firmware pointers: fold the high bits down
+    // before taking the top bits of the product
+    phandle ^= phandle >> 16;
+    return (phandle * 0x9E3779B1u) >> ofw_snap_shift;
+}
+
+// Offset of the package in the snapshot, or -1 (no snapshot, or unknown)
+static int ofw_snapshot_offset(uint32_t phandle) {
+    if (!ofw_fdt) {
+        return -1;
+    }
+    
+    uint32_t mask = (UINT32_MAX >> ofw_snap_shift);
+    for (uint32_t i = ofw_snapshot_hash(phandle); ofw_snap_hash[i]; i = (i + 1) & mask) {
+        const struct ofw_snapshot_node* node = &ofw_snap_nodes[ofw_snap_hash[i] - 1];
+        if (node->phandle == phandle) {
+            return node->offset;
+        }
+    }
+    return -1;
+}
+
+// The package at a blob offset (nodes are in offset order)
+static bool ofw_snapshot_phandle(int offset, uint32_t* phandle) {
+    uint32_t lo = 0;
+    uint32_t hi = ofw_snap_count;
+    
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (ofw_snap_nodes[mid].offset < offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < ofw_snap_count && ofw_snap_nodes[lo].offset == offset) {
+        *phandle = ofw_snap_nodes[lo].phandle;
+        return true;
+    }
+    return false;
+}
+
+// Node offsets in blob order; rerun after any write moves them
+static bool ofw_snapshot_reindex(void) {
+    uint32_t i = 0;
+    int depth = 0;
+    
+    for (int offset = fdt_next_node(ofw_fdt, -1, &depth); offset >= 0 && depth >= 0;
+         offset = fdt_next_node(ofw_fdt, offset, &depth)) {
+        if (i == ofw_snap_count) {
+            return false;
+        }
+        ofw_snap_nodes[i++].offset = offset;
+    }
+    return i == ofw_snap_count;
+}
+
+static bool ofw_snapshot_record(uint32_t phandle) {
+    if (ofw_snap_count == ofw_snap_capacity) {
+        uint32_t capacity = ofw_snap_capacity ? ofw_snap_capacity * 2 : 256;
+        struct ofw_snapshot_node* grown = platform_realloc(ofw_snap_nodes, capacity * sizeof(*grown));
+        if (!grown) {
+            return false;
+        }
+        ofw_snap_nodes = grown;
+        ofw_snap_capacity = capacity;
+    }
+    ofw_snap_nodes[ofw_snap_count].phandle = phandle;
+    ofw_snap_nodes[ofw_snap_count].offset = -1;
+    ofw_snap_count++;
+    return true;
+}
+
+// Copy one package (properties, then children in firmware order) into
+// `node`. Per property this is a nextprop and a getprop into the shared
+// buffer; only a value larger than the buffer needs a second getprop.
+static bh_status_t ofw_snapshot_package(uint32_t phandle, struct device_tree_node* node,
+                                        uint8_t* buffer, int depth) {
+    if (depth >= OFW_SNAPSHOT_MAX_DEPTH) {
+        return BH_STATUS_INVALID_DATA;
+    }
+    if (!ofw_snapshot_record(phandle)) {
+        return BH_STATUS_NO_MEMORY;
+    }
+    
+    char prev[OFW_PROP_NAME_MAX] = "";
+    char name[OFW_PROP_NAME_MAX];
+    for (;;) {
+        uint32_t in[4] = { phandle, (uint32_t)(uintptr_t)prev, (uint32_t)(uintptr_t)name, 0 };
+        uint32_t flag;
+        if (ofw_call_cells(OFW_SERVICE_NEXTPROP, 3, 1, in, &flag) != BH_STATUS_SUCCESS || flag != 1) {
+            break;
+        }
+        
+        uint32_t len;
+        in[1] = (uint32_t)(uintptr_t)name;
+        in[2] = (uint32_t)(uintptr_t)buffer;
+        in[3] = OFW_SNAPSHOT_PROP_BUFFER;
+        if (ofw_call_cells(OFW_SERVICE_GETPROP, 4, 1, in, &len) == BH_STATUS_SUCCESS && len != (uint32_t)OFW_FAILURE) {
+            bh_status_t status;
+            if (len <= OFW_SNAPSHOT_PROP_BUFFER) {
+                status = dt_set_property(node, name, buffer, len);
+            } else {
+                uint8_t* large = platform_malloc(len);
+                if (!large) {
+                    return BH_STATUS_NO_MEMORY;
+                }
+                in[2] = (uint32_t)(uintptr_t)large;
+                in[3] = len;
+                status = ofw_call_cells(OFW_SERVICE_GETPROP, 4, 1, in, &len);
+                if (status == BH_STATUS_SUCCESS) {
+                    status = dt_set_property(node, name, large, len);
+                }
+                platform_free(large);
+            }
+            if (status != BH_STATUS_SUCCESS) {
+                return status;
+            }
+        }
+        memcpy(prev, name, sizeof(prev));
+    }
+    
+    // References (interrupt-parent and the like) hold package handles, so
+    // the flattened tree names each node by its handle, as Linux's prom_init
+    // does when it flattens the tree itself
+    void* value;
+    size_t length;
+    if (dt_get_property(node, OFW_PROP_PHANDLE, &value, &length) != BH_STATUS_SUCCESS &&
+        dt_get_property(node, OFW_PROP_LINUX_PHANDLE, &value, &length) != BH_STATUS_SUCCESS) {
+        bh_status_t status = dt_set_u32_property(node, OFW_PROP_PHANDLE, phandle);
+        if (status != BH_STATUS_SUCCESS) {
+            return status;
+        }
+    }
+    
+    uint32_t child;
+    if (ofw_call_cells(OFW_SERVICE_CHILD, 1, 1, &phandle, &child) != BH_STATUS_SUCCESS) {
+        child = 0;
+    }
+    while (child && child != (uint32_t)OFW_FAILURE) {
+        // The unit name is the last component of the package's path
+        char path[OFW_SNAPSHOT_PATH_MAX];
+        uint32_t in[3] = { child, (uint32_t)(uintptr_t)path, sizeof(path) - 1 };
+        uint32_t len;
+        if (ofw_call_cells(OFW_SERVICE_PACKAGE_TO_PATH, 3, 1, in, &len) != BH_STATUS_SUCCESS ||
+            len == (uint32_t)OFW_FAILURE || len >= sizeof(path)) {
+            return BH_STATUS_INVALID_DATA;
+        }
+        path[len] = '\0';
+        const char* slash = strrchr(path, '/');
+        
+        struct device_tree_node* child_node;
+        bh_status_t status = dt_add_node(node, slash ? slash + 1 : path, &child_node);
+        if (status == BH_STATUS_SUCCESS) {
+            status = ofw_snapshot_package(child, child_node, buffer, depth + 1);
+        }
+        if (status != BH_STATUS_SUCCESS) {
+            return status;
+        }
+        
+        if (ofw_call_cells(OFW_SERVICE_PEER, 1, 1, &child, &child) != BH_STATUS_SUCCESS) {
+            break;
+        }
+    }
+    
+    // dt_add_node prepends; restore firmware order to match the record
+    struct device_tree_node* reversed = NULL;
+    while (node->children) {
+        struct device_tree_node* next = node->children->sibling;
+        node->children->sibling = reversed;
+        reversed = node->children;
+        node->children = next;
+    }
+    node->children = reversed;
+    return BH_STATUS_SUCCESS;
+}
+
+// Release the snapshot; later reads go to firmware again
+void ofw_snapshot_release(void) {
+    platform_free(ofw_fdt);
+    platform_free(ofw_snap_nodes);
+    platform_free(ofw_snap_hash);
+    ofw_fdt = NULL;
+    ofw_fdt_capacity = 0;
+    ofw_snap_nodes = NULL;
+    ofw_snap_count = 0;
+    ofw_snap_capacity = 0;
+    ofw_snap_hash = NULL;
+}
+
+// Walk the firmware tree once into an FDT (a no-op once taken)
+bh_status_t ofw_snapshot_tree(void) {
+    if (ofw_fdt) {
+        return BH_STATUS_SUCCESS;
+    }
+    if (!ofw_ci) {
+        return BH_STATUS_NOT_AVAILABLE;
+    }
+    
+    uint32_t none = 0;
+    uint32_t root_phandle;
+    bh_status_t status = ofw_call_cells(OFW_SERVICE_PEER, 1, 1, &none, &root_phandle);
+    if (status != BH_STATUS_SUCCESS || !root_phandle || root_phandle == (uint32_t)OFW_FAILURE) {
+        return BH_STATUS_NOT_FOUND;
+    }
+    
+    struct device_tree_node* root;
+    uint8_t* buffer = platform_malloc(OFW_SNAPSHOT_PROP_BUFFER);
+    status = buffer ? dt_create_tree(&root) : BH_STATUS_NO_MEMORY;
+    if (status != BH_STATUS_SUCCESS) {
+        platform_free(buffer);
+        return status;
+    }
+    
+    status = ofw_snapshot_package(root_phandle, root, buffer, 0);
+    platform_free(buffer);
+    
+    // Serialise with headroom for setprop write-through
+    size_t size = 0;
+    if (status == BH_STATUS_SUCCESS) {
+        dt_save_to_buffer(root, NULL, 0, &size);
+        ofw_fdt_capacity = size + OFW_SNAPSHOT_HEADROOM;
+        ofw_fdt = size ? platform_malloc(ofw_fdt_capacity) : NULL;
+        status = ofw_fdt ? dt_save_to_buffer(root, ofw_fdt, ofw_fdt_capacity, &size) : BH_STATUS_NO_MEMORY;
+    }
+    dt_cleanup(root);
+    if (status == BH_STATUS_SUCCESS && fdt_open_into(ofw_fdt, ofw_fdt, (int)ofw_fdt_capacity) < 0) {
+        status = BH_STATUS_INVALID_DATA;
+    }
+    
+    // Phandle hash at most half full
+    uint32_t bits = 4;
+    while ((1u << bits) < ofw_snap_count * 2) {
+        bits++;
+    }
+    ofw_snap_shift = 32 - bits;
+    ofw_snap_hash = status == BH_STATUS_SUCCESS ? platform_malloc(sizeof(uint32_t) << bits) : NULL;
+    if (status == BH_STATUS_SUCCESS && (!ofw_snap_hash || !ofw_snapshot_reindex())) {
+        status = ofw_snap_hash ? BH_STATUS_INVALID_DATA : BH_STATUS_NO_MEMORY;
+    }
+    if (status != BH_STATUS_SUCCESS) {
+        ofw_snapshot_release();
+        return status;
+    }
+    
+    memset(ofw_snap_hash, 0, sizeof(uint32_t) << bits);
+    for (uint32_t n = 0; n < ofw_snap_count; n++) {
+        uint32_t i = ofw_snapshot_hash(ofw_snap_nodes[n].phandle);
+        while (ofw_snap_hash[i]) {
+            i = (i + 1) & ((1u << bits) - 1);
+        }
+        ofw_snap_hash[i] = n + 1;
+    }
+    return BH_STATUS_SUCCESS;
+}
+
+// Mirror a firmware setprop into the snapshot, growing it if need be; if
+// that fails the snapshot is dropped rather than left stale
+static void ofw_snapshot_setprop(uint32_t phandle, const char* propname, const void* value, size_t size) {
+    int offset = ofw_snapshot_offset(phandle);
+    if (offset < 0) {
+        return;
+    }
+    
+    int err = fdt_setprop(ofw_fdt, offset, propname, value, (int)size);
+    if (err == -FDT_ERR_NOSPACE) {
+        size_t capacity = ofw_fdt_capacity * 2 + size;
+        uint8_t* grown = platform_malloc(capacity);
+        err = grown ? fdt_open_into(ofw_fdt, grown, (int)capacity) : -FDT_ERR_NOSPACE;
+        if (err == 0) {
+            platform_free(ofw_fdt);
+            ofw_fdt = grown;
+            ofw_fdt_capacity = capacity;
+            err = fdt_setprop(ofw_fdt, offset, propname, value, (int)size);
+        } else {
+            platform_free(grown);
+        }
+    }
+    
+    if (err < 0 || !ofw_snapshot_reindex()) {
+        ofw_snapshot_release();
+    }
+}
+
+// The snapshot as an FDT (owned by this module), taking it if need be
+bh_status_t ofw_get_fdt(const void** blob, size_t* size) {
+    if (!blob || !size) {
+        return BH_STATUS_INVALID_PARAMETER;
+    }
+    
+    bh_status_t status = ofw_snapshot_tree();
+    if (status != BH_STATUS_SUCCESS) {
+        return status;
+    }
+    
+    *blob = ofw_fdt;
+    *size = fdt_totalsize(ofw_fdt);
+    return BH_STATUS_SUCCESS;
+}
+
 // Initialize console
 bh_status_t ofw_console_init(void) {
     // Find standard I/O devices
@@ -280,10 +744,20 @@ bh_status_t ofw_console_init(void) {
 }
 
 // Console output
+void ofw_console_flush(void) {
+    if (ofw_stdout_ihandle && ofw_console_pending) {
+        size_t bytes_written;
+        ofw_write(ofw_stdout_ihandle, ofw_console_buffer, ofw_console_pending, &bytes_written);
+    }
+    ofw_console_pending = 0;
+}
+
 void ofw_putc(char c) {
     if (ofw_stdout_ihandle) {
-        size_t bytes_written;
-        ofw_write(ofw_stdout_ihandle, &c, 1, &bytes_written);
+        ofw_console_buffer[ofw_console_pending++] = c;
+        if (c == '\n' || ofw_console_pending == OFW_CONSOLE_BUFFER_SIZE) {
+            ofw_console_flush();
+        }
     }
 }
 
@@ -291,12 +765,14 @@ void ofw_puts(const char* s) {
     if (ofw_stdout_ihandle && s) {
         size_t len = strlen(s);
         size_t bytes_written;
+        ofw_console_flush();
         ofw_write(ofw_stdout_ihandle, s, len, &bytes_written);
     }
 }
 
-// Console input
+// Console input. Pending output goes out first so a prompt is visible.
 int ofw_getc(void) {
+    ofw_console_flush();
     if (ofw_stdin_ihandle) {
         char c;
         size_t bytes_read;
@@ -309,6 +785,8 @@ int ofw_getc(void) {
 }
 
 int ofw_tstc(void) {
+    // Input polling is where the loader idles; use it to drain output
+    ofw_console_flush();
     if (ofw_stdin_ihandle) {
         // This would need a specific OFW method to test for input
         // For now, return 0 (no input available)
@@ -323,28 +801,50 @@ bh_status_t ofw_open(const char* path, uint32_t* ihandle) {
         return BH_STATUS_INVALID_PARAMETER;
     }
     
-    return ofw_call_method("open", 1, 2, path, ihandle);
+    uint32_t in[1] = { (uint32_t)(uintptr_t)path };
+    if (ofw_call_cells(OFW_SERVICE_OPEN, 1, 1, in, ihandle) != BH_STATUS_SUCCESS ||
+        *ihandle == 0 || *ihandle == (uint32_t)OFW_FAILURE) {
+        return BH_STATUS_NOT_FOUND;
+    }
+    return BH_STATUS_SUCCESS;
 }
 
 // Close device
 bh_status_t ofw_close(uint32_t ihandle) {
-    return ofw_call_method("close", 1, 1, ihandle);
+    return ofw_call_cells(OFW_SERVICE_CLOSE, 1, 0, &ihandle, NULL);
 }
 
-// Read from device
+// Read from device. Every client interface call costs the same fixed
+// round trip through firmware whatever its length, so large requests go
+// down in OFW_READ_CHUNK_SIZE pieces straight into the caller's buffer.
+// Stops early at the end of the device or file, or when a console has
+// nothing more to give.
 bh_status_t ofw_read(uint32_t ihandle, void* buffer, size_t size, size_t* bytes_read) {
     if (!buffer || !bytes_read) {
         return BH_STATUS_INVALID_PARAMETER;
     }
     
-    uint32_t actual_bytes;
-    bh_status_t status = ofw_call_method("read", 3, 2, ihandle, buffer, size, &actual_bytes);
-    
-    if (status == BH_STATUS_SUCCESS) {
-        *bytes_read = actual_bytes;
+    uint8_t* out = (uint8_t*)buffer;
+    size_t done = 0;
+    while (done < size) {
+        uint32_t chunk = size - done > OFW_READ_CHUNK_SIZE ? OFW_READ_CHUNK_SIZE : (uint32_t)(size - done);
+        uint32_t in[3] = { ihandle, (uint32_t)(uintptr_t)(out + done), chunk };
+        uint32_t actual;
+        if (ofw_call_cells(OFW_SERVICE_READ, 3, 1, in, &actual) != BH_STATUS_SUCCESS ||
+            actual == (uint32_t)OFW_FAILURE || actual > chunk) {
+            if (done == 0) {
+                return BH_STATUS_IO_ERROR;
+            }
+            break;
+        }
+        done += actual;
+        if (actual < chunk) {
+            break;
+        }
     }
     
-    return status;
+    *bytes_read = done;
+    return BH_STATUS_SUCCESS;
 }
 
 // Write to device
@@ -365,10 +865,40 @@ bh_status_t ofw_write(uint32_t ihandle, const void* buffer, size_t size, size_t*
 
 // Seek in device
 bh_status_t ofw_seek(uint32_t ihandle, uint64_t position) {
-    uint32_t pos_hi = position >> 32;
-    uint32_t pos_lo = position & 0xFFFFFFFF;
+    uint32_t in[3] = { ihandle, (uint32_t)(position >> 32), (uint32_t)position };
+    uint32_t result;
     
-    return ofw_call_method("seek", 3, 1, ihandle, pos_hi, pos_lo);
+    if (ofw_call_cells(OFW_SERVICE_SEEK, 3, 1, in, &result) != BH_STATUS_SUCCESS ||
+        result == (uint32_t)OFW_FAILURE) {
+        return BH_STATUS_IO_ERROR;
+    }
+    return BH_STATUS_SUCCESS;
+}
+
+// Claim [virt, virt + size) for the caller. With align 0 firmware must
+// hand out exactly that range (a kernel's link address); otherwise it
+// picks an address, and only the heap does that.
+bh_status_t ofw_claim_memory(uint64_t virt, uint64_t size, uint32_t align) {
+    if (size == 0 || virt > UINT32_MAX || size > UINT32_MAX - virt) {
+        return BH_STATUS_INVALID_PARAMETER;
+    }
+    
+    uint32_t in[3] = { (uint32_t)virt, (uint32_t)size, align };
+    uint32_t base;
+    if (ofw_call_cells(OFW_SERVICE_CLAIM, 3, 1, in, &base) != BH_STATUS_SUCCESS ||
+        base == (uint32_t)OFW_FAILURE || (align == 0 && base != (uint32_t)virt)) {
+        return BH_STATUS_NO_MEMORY;
+    }
+    return BH_STATUS_SUCCESS;
+}
+
+bh_status_t ofw_release_memory(uint64_t virt, uint64_t size) {
+    if (size == 0 || virt > UINT32_MAX || size > UINT32_MAX - virt) {
+        return BH_STATUS_INVALID_PARAMETER;
+    }
+    
+    uint32_t in[2] = { (uint32_t)virt, (uint32_t)size };
+    return ofw_call_cells(OFW_SERVICE_RELEASE, 2, 0, in, NULL);
 }
 
 // Get boot arguments
@@ -539,6 +1069,11 @@ bh_status_t ofw_get_ticks(uint32_t* ticks) {
 }
 
 void ofw_delay(uint32_t ms) {
+    // The timebase avoids a client-interface call per poll
+    if (bh_sleep_milliseconds(ms) == BH_SUCCESS) {
+        return;
+    }
+    
     uint32_t ticks;
     if (ofw_milliseconds_to_ticks(ms, &ticks) == BH_STATUS_SUCCESS) {
         uint32_t start_ticks;
@@ -559,15 +1094,18 @@ bh_status_t ofw_arch_init(void) {
 
 bh_status_t ofw_arch_cleanup(void) {
     // Cleanup PowerPC-specific OpenFirmware features
+    ofw_console_flush();
     return BH_STATUS_SUCCESS;
 }
 
 void ofw_reset(void) {
+    ofw_console_flush();
     // Use OpenFirmware reset method
     ofw_call_method("reset-all", 0, 0);
 }
 
 void ofw_power_off(void) {
+    ofw_console_flush();
     // Use OpenFirmware power off method
     ofw_call_method("power-off", 0, 0);
 }
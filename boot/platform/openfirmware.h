@@ -84,6 +84,8 @@ struct ofw_memory {
 #define OFW_SERVICE_EXIT        "exit"
 #define OFW_SERVICE_QUIT        "quit"
 #define OFW_SERVICE_CHAIN       "chain"
+#define OFW_SERVICE_CLAIM       "claim"
+#define OFW_SERVICE_RELEASE     "release"
 #define OFW_SERVICE_MILLI_TO_TICKS "milliseconds"
 #define OFW_SERVICE_TICKS       "ticks"
 
@@ -117,6 +119,13 @@ struct ofw_memory {
 #define OFW_PROP_PHANDLE       "phandle"
 #define OFW_PROP_LINUX_PHANDLE "linux,phandle"
 
+// Tree snapshot limits
+#define OFW_SNAPSHOT_PROP_BUFFER    4096    // Values larger than this cost a second getprop
+#define OFW_SNAPSHOT_HEADROOM       4096    // Free space left for setprop write-through
+#define OFW_SNAPSHOT_MAX_DEPTH      64
+#define OFW_SNAPSHOT_PATH_MAX       512
+#define OFW_PROP_NAME_MAX           32      // IEEE 1275: names are at most 31 characters
+
 // OpenFirmware boot arguments
 struct ofw_boot_args {
     uint32_t client_interface;  // Client interface pointer
@@ -139,6 +148,12 @@ bh_status_t ofw_prop_len(uint32_t phandle, const char* propname, size_t* length)
 bh_status_t ofw_package_to_path(uint32_t phandle, char* buffer, size_t* size);
 bh_status_t ofw_instance_to_package(uint32_t ihandle, uint32_t* phandle);
 
+// OpenFirmware tree snapshot: the tree is read once into an FDT and the
+// property calls above are answered from it
+bh_status_t ofw_snapshot_tree(void);
+void ofw_snapshot_release(void);
+bh_status_t ofw_get_fdt(const void** blob, size_t* size);
+
 // OpenFirmware tree traversal
 bh_status_t ofw_get_root_node(struct ofw_node** root);
 bh_status_t ofw_get_child_node(struct ofw_node* parent, struct ofw_node** child);
@@ -155,6 +170,9 @@ bh_status_t ofw_release_memory(uint64_t virt, uint64_t size);
 bh_status_t ofw_map_physical(uint64_t phys, uint64_t virt, uint64_t size);
 
 // OpenFirmware I/O
+// Largest single "read" ofw_read issues; big reads are split into these
+#define OFW_READ_CHUNK_SIZE     (4u * 1024 * 1024)
+
 bh_status_t ofw_open(const char* path, uint32_t* ihandle);
 bh_status_t ofw_close(uint32_t ihandle);
 bh_status_t ofw_read(uint32_t ihandle, void* buffer, size_t size, size_t* bytes_read);
@@ -165,6 +183,7 @@ bh_status_t ofw_seek(uint32_t ihandle, uint64_t position);
 bh_status_t ofw_console_init(void);
 void ofw_putc(char c);
 void ofw_puts(const char* s);
+void ofw_console_flush(void);   // Write out what ofw_putc has batched
 int ofw_getc(void);
 int ofw_tstc(void);
 
@@ -14,72 +14,87 @@
 #include "uboot.h"
 #include "openfirmware.h"
 #include "../libb/include/bloodhorn/bootinfo.h"
+#include "../libb/include/bloodhorn/time.h"
 #include "../Arch32/powerpc.h"
 
 // Platform manager instance
 struct platform_manager platform_mgr = {0};
 
+// Backend ops are file-local when dispatched through platform_mgr. A build
+// bound to one backend exports them so the inline wrappers in platform.h
+// can call them directly.
+#if BH_PLATFORM_BOUND
+#define BH_PLATFORM_OP_LINKAGE
+#else
+#define BH_PLATFORM_OP_LINKAGE static
+#endif
+
 // Forward declarations for platform operations
-static bh_status_t uboot_platform_detect(void);
-static bh_status_t uboot_platform_initialize(bh_boot_info_t* boot_info);
-static bh_status_t uboot_platform_cleanup(void);
-static void uboot_platform_putc(char c);
-static void uboot_platform_puts(const char* s);
-static int uboot_platform_getc(void);
-static int uboot_platform_tstc(void);
-static bh_status_t uboot_platform_get_memory_map(bh_memory_map_t* memory_map);
-static void* uboot_platform_malloc(size_t size);
-static void uboot_platform_free(void* ptr);
-static void* uboot_platform_realloc(void* ptr, size_t size);
-static bh_status_t uboot_platform_get_device_tree(void** fdt, size_t* size);
-static bh_status_t uboot_platform_get_property(const char* node_path, const char* prop_name, 
+#if BH_PLATFORM_HAS_UBOOT
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_detect(void);
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_initialize(bh_boot_info_t* boot_info);
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_cleanup(void);
+BH_PLATFORM_OP_LINKAGE void uboot_platform_putc(char c);
+BH_PLATFORM_OP_LINKAGE void uboot_platform_puts(const char* s);
+BH_PLATFORM_OP_LINKAGE int uboot_platform_getc(void);
+BH_PLATFORM_OP_LINKAGE int uboot_platform_tstc(void);
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_get_memory_map(bh_memory_map_t* memory_map);
+BH_PLATFORM_OP_LINKAGE void* uboot_platform_malloc(size_t size);
+BH_PLATFORM_OP_LINKAGE void uboot_platform_free(void* ptr);
+BH_PLATFORM_OP_LINKAGE void* uboot_platform_realloc(void* ptr, size_t size);
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_get_device_tree(void** fdt, size_t* size);
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_get_property(const char* node_path, const char* prop_name, 
                                                 void* buffer, size_t* size);
-static bh_status_t uboot_platform_set_property(const char* node_path, const char* prop_name, 
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_set_property(const char* node_path, const char* prop_name, 
                                                 const void* value, size_t size);
-static bh_status_t uboot_platform_get_command_line(char** cmdline, size_t* size);
-static bh_status_t uboot_platform_get_initrd_info(void** initrd, size_t* size);
-static bh_status_t uboot_platform_load_kernel(const char* path, void** kernel, size_t* size);
-static bh_status_t uboot_platform_boot_kernel(void* kernel, size_t size, const char* cmdline);
-static uint64_t uboot_platform_get_time(void);
-static void uboot_platform_delay(uint32_t ms);
-static void uboot_platform_udelay(uint32_t us);
-static void uboot_platform_reset(void);
-static void uboot_platform_power_off(void);
-static bh_status_t uboot_platform_arch_init(void);
-static bh_status_t uboot_platform_arch_cleanup(void);
-static bh_status_t uboot_platform_print_info(void);
-static bh_status_t uboot_platform_debug_print(const char* format, ...);
-
-static bh_status_t ofw_platform_detect(void);
-static bh_status_t ofw_platform_initialize(bh_boot_info_t* boot_info);
-static bh_status_t ofw_platform_cleanup(void);
-static void ofw_platform_putc(char c);
-static void ofw_platform_puts(const char* s);
-static int ofw_platform_getc(void);
-static int ofw_platform_tstc(void);
-static bh_status_t ofw_platform_get_memory_map(bh_memory_map_t* memory_map);
-static void* ofw_platform_malloc(size_t size);
-static void ofw_platform_free(void* ptr);
-static void* ofw_platform_realloc(void* ptr, size_t size);
-static bh_status_t ofw_platform_get_device_tree(void** fdt, size_t* size);
-static bh_status_t ofw_platform_get_property(const char* node_path, const char* prop_name, 
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_get_command_line(char** cmdline, size_t* size);
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_get_initrd_info(void** initrd, size_t* size);
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_load_kernel(const char* path, void** kernel, size_t* size);
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_boot_kernel(void* kernel, size_t size, const char* cmdline);
+BH_PLATFORM_OP_LINKAGE uint64_t uboot_platform_get_time(void);
+BH_PLATFORM_OP_LINKAGE void uboot_platform_delay(uint32_t ms);
+BH_PLATFORM_OP_LINKAGE void uboot_platform_udelay(uint32_t us);
+BH_PLATFORM_OP_LINKAGE void uboot_platform_reset(void);
+BH_PLATFORM_OP_LINKAGE void uboot_platform_power_off(void);
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_arch_init(void);
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_arch_cleanup(void);
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_print_info(void);
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_debug_print(const char* format, ...);
+#endif
+
+#if BH_PLATFORM_HAS_OPENFIRMWARE
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_detect(void);
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_initialize(bh_boot_info_t* boot_info);
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_cleanup(void);
+BH_PLATFORM_OP_LINKAGE void ofw_platform_putc(char c);
+BH_PLATFORM_OP_LINKAGE void ofw_platform_puts(const char* s);
+BH_PLATFORM_OP_LINKAGE int ofw_platform_getc(void);
+BH_PLATFORM_OP_LINKAGE int ofw_platform_tstc(void);
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_get_memory_map(bh_memory_map_t* memory_map);
+BH_PLATFORM_OP_LINKAGE void* ofw_platform_malloc(size_t size);
+BH_PLATFORM_OP_LINKAGE void ofw_platform_free(void* ptr);
+BH_PLATFORM_OP_LINKAGE void* ofw_platform_realloc(void* ptr, size_t size);
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_get_device_tree(void** fdt, size_t* size);
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_get_property(const char* node_path, const char* prop_name, 
                                              void* buffer, size_t* size);
-static bh_status_t ofw_platform_set_property(const char* node_path, const char* prop_name, 
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_set_property(const char* node_path, const char* prop_name, 
                                              const void* value, size_t size);
-static bh_status_t ofw_platform_get_command_line(char** cmdline, size_t* size);
-static bh_status_t ofw_platform_get_initrd_info(void** initrd, size_t* size);
-static bh_status_t ofw_platform_load_kernel(const char* path, void** kernel, size_t* size);
-static bh_status_t ofw_platform_boot_kernel(void* kernel, size_t size, const char* cmdline);
-static uint64_t ofw_platform_get_time(void);
-static void ofw_platform_delay(uint32_t ms);
-static void ofw_platform_udelay(uint32_t us);
-static void ofw_platform_reset(void);
-static void ofw_platform_power_off(void);
-static bh_status_t ofw_platform_arch_init(void);
-static bh_status_t ofw_platform_arch_cleanup(void);
-static bh_status_t ofw_platform_print_info(void);
-static bh_status_t ofw_platform_debug_print(const char* format, ...);
-
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_get_command_line(char** cmdline, size_t* size);
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_get_initrd_info(void** initrd, size_t* size);
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_load_kernel(const char* path, void** kernel, size_t* size);
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_boot_kernel(void* kernel, size_t size, const char* cmdline);
+BH_PLATFORM_OP_LINKAGE uint64_t ofw_platform_get_time(void);
+BH_PLATFORM_OP_LINKAGE void ofw_platform_delay(uint32_t ms);
+BH_PLATFORM_OP_LINKAGE void ofw_platform_udelay(uint32_t us);
+BH_PLATFORM_OP_LINKAGE void ofw_platform_reset(void);
+BH_PLATFORM_OP_LINKAGE void ofw_platform_power_off(void);
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_arch_init(void);
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_arch_cleanup(void);
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_print_info(void);
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_debug_print(const char* format, ...);
+#endif
+
+#if BH_PLATFORM_HAS_UBOOT
 // U-Boot platform operations
 static const struct platform_operations uboot_ops = {
     .detect = uboot_platform_detect,
@@ -111,6 +126,16 @@ static const struct platform_operations uboot_ops = {
     .debug_print = uboot_platform_debug_print,
 };
 
+static struct platform_descriptor uboot_platform = {
+    .type = BH_PLATFORM_UBOOT,
+    .name = "U-Boot",
+    .description = "U-Boot bootloader platform support",
+    .ops = &uboot_ops,
+    .priority = 100,
+};
+#endif
+
+#if BH_PLATFORM_HAS_OPENFIRMWARE
 // OpenFirmware platform operations
 static const struct platform_operations ofw_ops = {
     .detect = ofw_platform_detect,
@@ -142,15 +167,6 @@ static const struct platform_operations ofw_ops = {
     .debug_print = ofw_platform_debug_print,
 };
 
-// Platform descriptors
-static struct platform_descriptor uboot_platform = {
-    .type = BH_PLATFORM_UBOOT,
-    .name = "U-Boot",
-    .description = "U-Boot bootloader platform support",
-    .ops = &uboot_ops,
-    .priority = 100,
-};
-
 static struct platform_descriptor ofw_platform = {
     .type = BH_PLATFORM_OPENFIRMWARE,
     .name = "OpenFirmware",
@@ -158,6 +174,7 @@ static struct platform_descriptor ofw_platform = {
     .ops = &ofw_ops,
     .priority = 90,
 };
+#endif
 
 // Initialize platform manager
 bh_status_t platform_manager_init(void) {
@@ -170,16 +187,21 @@ bh_status_t platform_manager_init(void) {
     platform_mgr.current_platform = NULL;
     platform_mgr.initialized = false;
     
-    // Register built-in platforms
-    bh_status_t status = platform_register(&uboot_platform);
+    // Register built-in platforms; a bound build only carries its own
+    bh_status_t status;
+#if BH_PLATFORM_HAS_UBOOT
+    status = platform_register(&uboot_platform);
     if (status != BH_STATUS_SUCCESS) {
         return status;
     }
+#endif
     
+#if BH_PLATFORM_HAS_OPENFIRMWARE
     status = platform_register(&ofw_platform);
     if (status != BH_STATUS_SUCCESS) {
         return status;
     }
+#endif
     
     platform_mgr.initialized = true;
     return BH_STATUS_SUCCESS;
@@ -393,74 +415,57 @@ bool platform_is_initialized(void) {
     return platform_mgr.initialized && platform_mgr.current_platform != NULL;
 }
 
+#if BH_PLATFORM_HAS_UBOOT
 // U-Boot platform operation implementations
-static bh_status_t uboot_platform_detect(void) {
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_detect(void) {
     return uboot_detect_platform();
 }
 
-static bh_status_t uboot_platform_initialize(bh_boot_info_t* boot_info) {
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_initialize(bh_boot_info_t* boot_info) {
     return uboot_initialize_platform(boot_info);
 }
 
-static bh_status_t uboot_platform_cleanup(void) {
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_cleanup(void) {
     return uboot_arch_cleanup();
 }
 
-static void uboot_platform_putc(char c) {
+BH_PLATFORM_OP_LINKAGE void uboot_platform_putc(char c) {
     uboot_putc(c);
 }
 
-static void uboot_platform_puts(const char* s) {
+BH_PLATFORM_OP_LINKAGE void uboot_platform_puts(const char* s) {
     uboot_puts(s);
 }
 
-static int uboot_platform_getc(void) {
+BH_PLATFORM_OP_LINKAGE int uboot_platform_getc(void) {
     return uboot_getc();
 }
 
-static int uboot_platform_tstc(void) {
+BH_PLATFORM_OP_LINKAGE int uboot_platform_tstc(void) {
     return uboot_tstc();
 }
 
-static bh_status_t uboot_platform_get_memory_map(bh_memory_map_t* memory_map) {
-    if (!memory_map) {
-        return BH_STATUS_INVALID_PARAMETER;
-    }
-    
-    // Get board information
-    struct uboot_bdinfo* bd;
-    bh_status_t status = uboot_get_bdinfo(&bd);
-    if (status != BH_STATUS_SUCCESS) {
-        return status;
-    }
-    
-    // Add main memory region
-    bh_memory_range_t memory_range = {0};
-    memory_range.start = bd->bi_memstart;
-    memory_range.end = bd->bi_memstart + bd->bi_memsize;
-    memory_range.type = BH_MEMORY_TYPE_RAM;
-    memory_range.flags = BH_MEMORY_FLAG_AVAILABLE;
-    
-    return bh_memory_map_add_range(memory_map, &memory_range);
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_get_memory_map(bh_memory_map_t* memory_map) {
+    return uboot_get_memory_map(memory_map);
 }
 
-static void* uboot_platform_malloc(size_t size) {
+BH_PLATFORM_OP_LINKAGE void* uboot_platform_malloc(size_t size) {
     return uboot_malloc(size);
 }
 
-static void uboot_platform_free(void* ptr) {
+BH_PLATFORM_OP_LINKAGE void uboot_platform_free(void* ptr) {
     uboot_free(ptr);
 }
 
-static void* uboot_platform_realloc(void* ptr, size_t size) {
+BH_PLATFORM_OP_LINKAGE void* uboot_platform_realloc(void* ptr, size_t size) {
     return uboot_realloc(ptr, size);
 }
 
-static bh_status_t uboot_platform_get_device_tree(void** fdt, size_t* size) {
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_get_device_tree(void** fdt, size_t* size) {
     return uboot_get_device_tree(fdt, size);
 }
 
-static bh_status_t uboot_platform_get_property(const char* node_path, const char* prop_name, 
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_get_property(const char* node_path, const char* prop_name, 
                                                 void* buffer, size_t* size) {
     if (!node_path || !prop_name || !buffer || !size) {
         return BH_STATUS_INVALID_PARAMETER;
@@ -476,7 +481,7 @@ static bh_status_t uboot_platform_get_property(const char* node_path, const char
     return uboot_fdt_getprop(fdt, node_path, prop_name, buffer, size);
 }
 
-static bh_status_t uboot_platform_set_property(const char* node_path, const char* prop_name, 
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_set_property(const char* node_path, const char* prop_name, 
                                                 const void* value, size_t size) {
     if (!node_path || !prop_name || !value) {
         return BH_STATUS_INVALID_PARAMETER;
@@ -492,59 +497,57 @@ static bh_status_t uboot_platform_set_property(const char* node_path, const char
     return uboot_fdt_setprop(fdt, node_path, prop_name, value, size);
 }
 
-static bh_status_t uboot_platform_get_command_line(char** cmdline, size_t* size) {
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_get_command_line(char** cmdline, size_t* size) {
     return uboot_get_command_line(cmdline, size);
 }
 
-static bh_status_t uboot_platform_get_initrd_info(void** initrd, size_t* size) {
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_get_initrd_info(void** initrd, size_t* size) {
     return uboot_get_initrd_info(initrd, size);
 }
 
-static bh_status_t uboot_platform_load_kernel(const char* path, void** kernel, size_t* size) {
-    // This would implement kernel loading from U-Boot filesystem
-    // For now, return not implemented
-    return BH_STATUS_NOT_IMPLEMENTED;
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_load_kernel(const char* path, void** kernel, size_t* size) {
+    return uboot_load_file(path, UBOOT_LOAD_ALIGN, kernel, size);
 }
 
-static bh_status_t uboot_platform_boot_kernel(void* kernel, size_t size, const char* cmdline) {
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_boot_kernel(void* kernel, size_t size, const char* cmdline) {
     // This would implement kernel booting using U-Boot bootm command
     // For now, return not implemented
     return BH_STATUS_NOT_IMPLEMENTED;
 }
 
-static uint64_t uboot_platform_get_time(void) {
+BH_PLATFORM_OP_LINKAGE uint64_t uboot_platform_get_time(void) {
     return uboot_get_timer();
 }
 
-static void uboot_platform_delay(uint32_t ms) {
+BH_PLATFORM_OP_LINKAGE void uboot_platform_delay(uint32_t ms) {
     uboot_mdelay(ms);
 }
 
-static void uboot_platform_udelay(uint32_t us) {
+BH_PLATFORM_OP_LINKAGE void uboot_platform_udelay(uint32_t us) {
     uboot_udelay(us);
 }
 
-static void uboot_platform_reset(void) {
+BH_PLATFORM_OP_LINKAGE void uboot_platform_reset(void) {
     uboot_reset();
 }
 
-static void uboot_platform_power_off(void) {
+BH_PLATFORM_OP_LINKAGE void uboot_platform_power_off(void) {
     uboot_power_off();
 }
 
-static bh_status_t uboot_platform_arch_init(void) {
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_arch_init(void) {
     return uboot_arch_init();
 }
 
-static bh_status_t uboot_platform_arch_cleanup(void) {
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_arch_cleanup(void) {
     return uboot_arch_cleanup();
 }
 
-static bh_status_t uboot_platform_print_info(void) {
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_print_info(void) {
     return uboot_print_info();
 }
 
-static bh_status_t uboot_platform_debug_print(const char* format, ...) {
+BH_PLATFORM_OP_LINKAGE bh_status_t uboot_platform_debug_print(const char* format, ...) {
     va_list args;
     va_start(args, format);
     
@@ -559,36 +562,39 @@ static bh_status_t uboot_platform_debug_print(const char* format, ...) {
     return BH_STATUS_SUCCESS;
 }
 
+#endif /* BH_PLATFORM_HAS_UBOOT */
+
+#if BH_PLATFORM_HAS_OPENFIRMWARE
 // OpenFirmware platform operation implementations
-static bh_status_t ofw_platform_detect(void) {
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_detect(void) {
     return ofw_detect_platform();
 }
 
-static bh_status_t ofw_platform_initialize(bh_boot_info_t* boot_info) {
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_initialize(bh_boot_info_t* boot_info) {
     return ofw_initialize_platform(boot_info);
 }
 
-static bh_status_t ofw_platform_cleanup(void) {
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_cleanup(void) {
     return ofw_arch_cleanup();
 }
 
-static void ofw_platform_putc(char c) {
+BH_PLATFORM_OP_LINKAGE void ofw_platform_putc(char c) {
     ofw_putc(c);
 }
 
-static void ofw_platform_puts(const char* s) {
+BH_PLATFORM_OP_LINKAGE void ofw_platform_puts(const char* s) {
     ofw_puts(s);
 }
 
-static int ofw_platform_getc(void) {
+BH_PLATFORM_OP_LINKAGE int ofw_platform_getc(void) {
     return ofw_getc();
 }
 
-static int ofw_platform_tstc(void) {
+BH_PLATFORM_OP_LINKAGE int ofw_platform_tstc(void) {
     return ofw_tstc();
 }
 
-static bh_status_t ofw_platform_get_memory_map(bh_memory_map_t* memory_map) {
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_get_memory_map(bh_memory_map_t* memory_map) {
     if (!memory_map) {
         return BH_STATUS_INVALID_PARAMETER;
     }
@@ -627,47 +633,35 @@ static bh_status_t ofw_platform_get_memory_map(bh_memory_map_t* memory_map) {
     return BH_STATUS_SUCCESS;
 }
 
-static void* ofw_platform_malloc(size_t size) {
-    // OpenFirmware doesn't provide malloc, use claim memory
-    uint64_t virt = 0;
-    bh_status_t status = ofw_claim_memory(virt, size, 8); // 8-byte alignment
-    if (status == BH_STATUS_SUCCESS) {
-        return (void*)virt;
-    }
-    return NULL;
+// OpenFirmware only claims whole ranges; the libb heap sits on top
+BH_PLATFORM_OP_LINKAGE void* ofw_platform_malloc(size_t size) {
+    return bh_malloc(size);
 }
 
-static void ofw_platform_free(void* ptr) {
-    // OpenFirmware doesn't provide free, use release memory
-    if (ptr) {
-        // We would need to track the size to release properly
-        // For now, this is a limitation
-    }
+BH_PLATFORM_OP_LINKAGE void ofw_platform_free(void* ptr) {
+    bh_free(ptr);
 }
 
-static void* ofw_platform_realloc(void* ptr, size_t size) {
-    // Simple realloc implementation
-    void* new_ptr = ofw_platform_malloc(size);
-    if (new_ptr && ptr) {
-        // Copy old data (we don't know the old size, so this is limited)
-        // This is a simplified implementation
-        ofw_platform_free(ptr);
-    }
-    return new_ptr;
+BH_PLATFORM_OP_LINKAGE void* ofw_platform_realloc(void* ptr, size_t size) {
+    return bh_realloc(ptr, size);
 }
 
-static bh_status_t ofw_platform_get_device_tree(void** fdt, size_t* size) {
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_get_device_tree(void** fdt, size_t* size) {
     if (!fdt || !size) {
         return BH_STATUS_INVALID_PARAMETER;
     }
     
-    // OpenFirmware device tree is the live tree, not a blob
-    // We would need to flatten it to return a blob
-    // For now, return not implemented
-    return BH_STATUS_NOT_IMPLEMENTED;
+    // The live tree flattened once by the snapshot; the blob stays owned
+    // by openfirmware.c
+    const void* blob;
+    bh_status_t status = ofw_get_fdt(&blob, size);
+    if (status == BH_STATUS_SUCCESS) {
+        *fdt = (void*)blob;
+    }
+    return status;
 }
 
-static bh_status_t ofw_platform_get_property(const char* node_path, const char* prop_name, 
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_get_property(const char* node_path, const char* prop_name, 
                                              void* buffer, size_t* size) {
     if (!node_path || !prop_name || !buffer || !size) {
         return BH_STATUS_INVALID_PARAMETER;
@@ -682,7 +676,7 @@ static bh_status_t ofw_platform_get_property(const char* node_path, const char*
     return ofw_get_prop(phandle, prop_name, buffer, size);
 }
 
-static bh_status_t ofw_platform_set_property(const char* node_path, const char* prop_name, 
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_set_property(const char* node_path, const char* prop_name, 
                                              const void* value, size_t size) {
     if (!node_path || !prop_name || !value) {
         return BH_STATUS_INVALID_PARAMETER;
@@ -697,11 +691,11 @@ static bh_status_t ofw_platform_set_property(const char* node_path, const char*
     return ofw_set_prop(phandle, prop_name, value, size);
 }
 
-static bh_status_t ofw_platform_get_command_line(char** cmdline, size_t* size) {
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_get_command_line(char** cmdline, size_t* size) {
     return ofw_get_command_line(cmdline, size);
 }
 
-static bh_status_t ofw_platform_get_initrd_info(void** initrd, size_t* size) {
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_get_initrd_info(void** initrd, size_t* size) {
     uint64_t initrd_start, initrd_end;
     bh_status_t status = ofw_get_initrd_info(&initrd_start, &initrd_end);
     if (status == BH_STATUS_SUCCESS) {
@@ -711,17 +705,17 @@ static bh_status_t ofw_platform_get_initrd_info(void** initrd, size_t* size) {
     return status;
 }
 
-static bh_status_t ofw_platform_load_kernel(const char* path, void** kernel, size_t* size) {
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_load_kernel(const char* path, void** kernel, size_t* size) {
     // This would implement kernel loading from OpenFirmware filesystem
     return BH_STATUS_NOT_IMPLEMENTED;
 }
 
-static bh_status_t ofw_platform_boot_kernel(void* kernel, size_t size, const char* cmdline) {
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_boot_kernel(void* kernel, size_t size, const char* cmdline) {
     // This would implement kernel booting using OpenFirmware boot method
     return BH_STATUS_NOT_IMPLEMENTED;
 }
 
-static uint64_t ofw_platform_get_time(void) {
+BH_PLATFORM_OP_LINKAGE uint64_t ofw_platform_get_time(void) {
     uint32_t ticks;
     bh_status_t status = ofw_get_ticks(&ticks);
     if (status == BH_STATUS_SUCCESS) {
@@ -730,38 +724,41 @@ static uint64_t ofw_platform_get_time(void) {
     return 0;
 }
 
-static void ofw_platform_delay(uint32_t ms) {
+BH_PLATFORM_OP_LINKAGE void ofw_platform_delay(uint32_t ms) {
     ofw_delay(ms);
 }
 
-static void ofw_platform_udelay(uint32_t us) {
-    ofw_delay(us / 1000);
+BH_PLATFORM_OP_LINKAGE void ofw_platform_udelay(uint32_t us) {
+    // Firmware only counts milliseconds; the timebase keeps short delays
+    if (bh_sleep_microseconds(us) != BH_SUCCESS) {
+        ofw_delay(us / 1000);
+    }
 }
 
-static void ofw_platform_reset(void) {
+BH_PLATFORM_OP_LINKAGE void ofw_platform_reset(void) {
     ofw_reset();
 }
 
-static void ofw_platform_power_off(void) {
+BH_PLATFORM_OP_LINKAGE void ofw_platform_power_off(void) {
     ofw_power_off();
 }
 
-static bh_status_t ofw_platform_arch_init(void) {
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_arch_init(void) {
     return ofw_arch_init();
 }
 
-static bh_status_t ofw_platform_arch_cleanup(void) {
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_arch_cleanup(void) {
     return ofw_arch_cleanup();
 }
 
-static bh_status_t ofw_platform_print_info(void) {
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_print_info(void) {
     ofw_puts("BloodHorn OpenFirmware Platform Information\r\n");
     ofw_puts("========================================\r\n");
     ofw_puts("OpenFirmware detected and initialized\r\n");
     return BH_STATUS_SUCCESS;
 }
 
-static bh_status_t ofw_platform_debug_print(const char* format, ...) {
+BH_PLATFORM_OP_LINKAGE bh_status_t ofw_platform_debug_print(const char* format, ...) {
     va_list args;
     va_start(args, format);
     
@@ -775,3 +772,4 @@ static bh_status_t ofw_platform_debug_print(const char* format, ...) {
     va_end(args);
     return BH_STATUS_SUCCESS;
 }
+#endif /* BH_PLATFORM_HAS_OPENFIRMWARE */
@@ -13,6 +13,33 @@
 #include <stdbool.h>
 #include "../libb/include/bloodhorn/bootinfo.h"
 
+// Build-time backend selection, from PcdPlatformBackend in BloodHornPcd.dsc.
+// The values follow bh_platform_type_t. BH_PLATFORM_BACKEND_DYNAMIC builds
+// every backend and picks one at runtime through platform_mgr; any other
+// value builds only that backend and binds the hot console, timer and heap
+// wrappers below straight to it, so LTO can inline them.
+#define BH_PLATFORM_BACKEND_DYNAMIC       0
+#define BH_PLATFORM_BACKEND_OPENFIRMWARE  4
+#define BH_PLATFORM_BACKEND_UBOOT         5
+
+#ifndef BH_PLATFORM_BACKEND
+#ifdef _PCD_VALUE_PcdPlatformBackend
+#define BH_PLATFORM_BACKEND _PCD_VALUE_PcdPlatformBackend
+#else
+#define BH_PLATFORM_BACKEND BH_PLATFORM_BACKEND_DYNAMIC
+#endif
+#endif
+
+#define BH_PLATFORM_BOUND (BH_PLATFORM_BACKEND != BH_PLATFORM_BACKEND_DYNAMIC)
+#define BH_PLATFORM_HAS_UBOOT \
+    (!BH_PLATFORM_BOUND || BH_PLATFORM_BACKEND == BH_PLATFORM_BACKEND_UBOOT)
+#define BH_PLATFORM_HAS_OPENFIRMWARE \
+    (!BH_PLATFORM_BOUND || BH_PLATFORM_BACKEND == BH_PLATFORM_BACKEND_OPENFIRMWARE)
+
+#if BH_PLATFORM_BOUND && !BH_PLATFORM_HAS_UBOOT && !BH_PLATFORM_HAS_OPENFIRMWARE
+#error "PcdPlatformBackend names a backend without platform operations"
+#endif
+
 // Platform operations structure - unified interface for all platforms
 struct platform_operations {
     // Platform detection and initialization
@@ -92,35 +119,73 @@ bh_status_t platform_detect_all(void);
 bh_status_t platform_initialize(bh_boot_info_t* boot_info);
 bh_status_t platform_cleanup(void);
 
+#if BH_PLATFORM_BACKEND == BH_PLATFORM_BACKEND_UBOOT
+#define BH_PLATFORM_OP(name) uboot_platform_##name
+#elif BH_PLATFORM_BACKEND == BH_PLATFORM_BACKEND_OPENFIRMWARE
+#define BH_PLATFORM_OP(name) ofw_platform_##name
+#endif
+
+#if BH_PLATFORM_BOUND
+// Operations of the bound backend, defined in platform.c
+void BH_PLATFORM_OP(putc)(char c);
+void BH_PLATFORM_OP(puts)(const char* s);
+int BH_PLATFORM_OP(getc)(void);
+int BH_PLATFORM_OP(tstc)(void);
+void* BH_PLATFORM_OP(malloc)(size_t size);
+void BH_PLATFORM_OP(free)(void* ptr);
+void* BH_PLATFORM_OP(realloc)(void* ptr, size_t size);
+uint64_t BH_PLATFORM_OP(get_time)(void);
+void BH_PLATFORM_OP(delay)(uint32_t ms);
+void BH_PLATFORM_OP(udelay)(uint32_t us);
+#endif
+
 // Platform operations (delegated to current platform)
 static inline bh_status_t platform_putc(char c) {
+#if BH_PLATFORM_BOUND
+    BH_PLATFORM_OP(putc)(c);
+    return BH_STATUS_SUCCESS;
+#else
     if (platform_mgr.current_platform && platform_mgr.current_platform->ops->putc) {
         platform_mgr.current_platform->ops->putc(c);
         return BH_STATUS_SUCCESS;
     }
     return BH_STATUS_NOT_AVAILABLE;
+#endif
 }
 
 static inline bh_status_t platform_puts(const char* s) {
+#if BH_PLATFORM_BOUND
+    BH_PLATFORM_OP(puts)(s);
+    return BH_STATUS_SUCCESS;
+#else
     if (platform_mgr.current_platform && platform_mgr.current_platform->ops->puts) {
         platform_mgr.current_platform->ops->puts(s);
         return BH_STATUS_SUCCESS;
     }
     return BH_STATUS_NOT_AVAILABLE;
+#endif
 }
 
 static inline int platform_getc(void) {
+#if BH_PLATFORM_BOUND
+    return BH_PLATFORM_OP(getc)();
+#else
     if (platform_mgr.current_platform && platform_mgr.current_platform->ops->getc) {
         return platform_mgr.current_platform->ops->getc();
     }
     return -1;
+#endif
 }
 
 static inline int platform_tstc(void) {
+#if BH_PLATFORM_BOUND
+    return BH_PLATFORM_OP(tstc)();
+#else
     if (platform_mgr.current_platform && platform_mgr.current_platform->ops->tstc) {
         return platform_mgr.current_platform->ops->tstc();
     }
     return 0;
+#endif
 }
 
 static inline bh_status_t platform_get_memory_map(bh_memory_map_t* memory_map) {
@@ -131,23 +196,35 @@ static inline bh_status_t platform_get_memory_map(bh_memory_map_t* memory_map) {
 }
 
 static inline void* platform_malloc(size_t size) {
+#if BH_PLATFORM_BOUND
+    return BH_PLATFORM_OP(malloc)(size);
+#else
     if (platform_mgr.current_platform && platform_mgr.current_platform->ops->malloc) {
         return platform_mgr.current_platform->ops->malloc(size);
     }
     return NULL;
+#endif
 }
 
 static inline void platform_free(void* ptr) {
+#if BH_PLATFORM_BOUND
+    BH_PLATFORM_OP(free)(ptr);
+#else
     if (platform_mgr.current_platform && platform_mgr.current_platform->ops->free) {
         platform_mgr.current_platform->ops->free(ptr);
     }
+#endif
 }
 
 static inline void* platform_realloc(void* ptr, size_t size) {
+#if BH_PLATFORM_BOUND
+    return BH_PLATFORM_OP(realloc)(ptr, size);
+#else
     if (platform_mgr.current_platform && platform_mgr.current_platform->ops->realloc) {
         return platform_mgr.current_platform->ops->realloc(ptr, size);
     }
     return NULL;
+#endif
 }
 
 static inline bh_status_t platform_get_device_tree(void** fdt, size_t* size) {
@@ -202,22 +279,34 @@ static inline bh_status_t platform_boot_kernel(void* kernel, size_t size, const
 }
 
 static inline uint64_t platform_get_time(void) {
+#if BH_PLATFORM_BOUND
+    return BH_PLATFORM_OP(get_time)();
+#else
     if (platform_mgr.current_platform && platform_mgr.current_platform->ops->get_time) {
         return platform_mgr.current_platform->ops->get_time();
     }
     return 0;
+#endif
 }
 
 static inline void platform_delay(uint32_t ms) {
+#if BH_PLATFORM_BOUND
+    BH_PLATFORM_OP(delay)(ms);
+#else
     if (platform_mgr.current_platform && platform_mgr.current_platform->ops->delay) {
         platform_mgr.current_platform->ops->delay(ms);
     }
+#endif
 }
 
 static inline void platform_udelay(uint32_t us) {
+#if BH_PLATFORM_BOUND
+    BH_PLATFORM_OP(udelay)(us);
+#else
     if (platform_mgr.current_platform && platform_mgr.current_platform->ops->udelay) {
         platform_mgr.current_platform->ops->udelay(us);
     }
+#endif
 }
 
 static inline void platform_reset(void) {
@@ -10,6 +10,8 @@
 #include <stdbool.h>
 #include <string.h>
 #include "uboot.h"
+#include "fdt.h"
+#include "../libb/include/bloodhorn/bloodhorn.h"
 #include "../libb/include/bloodhorn/bootinfo.h"
 #include "../Arch32/powerpc.h"
 
@@ -18,8 +20,18 @@ static struct uboot_global_data* gd = NULL;
 static struct uboot_bdinfo* bd = NULL;
 static void* fdt_blob = NULL;
 static size_t fdt_size = 0;
+static bool fdt_owned = false;     // fdt_blob was reallocated by us to grow it
 static bool uboot_detected = false;
 
+// Memory layout, sorted and merged; built on first use
+static struct uboot_mem_region uboot_ram[UBOOT_MAX_MEM_REGIONS];
+static struct uboot_mem_region uboot_reserved[UBOOT_MAX_MEM_REGIONS];
+static struct uboot_mem_region uboot_free_ram[UBOOT_MAX_MEM_REGIONS];
+static uint32_t uboot_ram_count = 0;
+static uint32_t uboot_reserved_count = 0;
+static uint32_t uboot_free_count = 0;
+static bool uboot_layout_valid = false;
+
 // U-Boot global data register locations (PowerPC specific)
 #define UBOOT_GD_REGISTER  0x00000000  // Typically stored in a known register
 #define UBOOT_MAGIC_ADDR   0x00000000  // Magic number location
@@ -30,6 +42,18 @@ extern void uboot_console_init(void);
 extern void uboot_serial_putc(char c);
 extern int uboot_serial_getc(void);
 extern int uboot_serial_tstc(void);
+extern int uboot_fs_size(const char* path, uint64_t* size);
+extern int uboot_fs_read(const char* path, void* buffer, uint64_t size, uint64_t* actual);
+
+// Hand the device tree's timebase rate to libb so its clock runs on mftb
+static void uboot_set_timebase(void) {
+    uint64_t frequency;
+
+    if (fdt_blob && fdt_check_header(fdt_blob) == 0 &&
+        fdt_get_timebase_frequency(fdt_blob, &frequency) == BH_STATUS_SUCCESS) {
+        bh_clock_set_frequency(frequency);
+    }
+}
 
 // Platform detection
 bh_status_t uboot_detect_platform(void) {
@@ -47,6 +71,7 @@ bh_status_t uboot_detect_platform(void) {
             if (gd->fdt_addr && gd->fdt_size) {
                 fdt_blob = (void*)gd->fdt_addr;
                 fdt_size = gd->fdt_size;
+                uboot_set_timebase();
             }
             return BH_STATUS_SUCCESS;
         }
@@ -154,6 +179,7 @@ bh_status_t uboot_parse_boot_info(const struct uboot_boot_info* uboot_info, bh_b
     if (uboot_info->flags & UBOOT_FLAG_FDT_VALID && uboot_info->device_tree_addr) {
         fdt_blob = (void*)uboot_info->device_tree_addr;
         fdt_size = uboot_info->device_tree_size;
+        uboot_set_timebase();
     }
     
     // Check for 64-bit flag
@@ -250,50 +276,351 @@ bh_status_t uboot_get_initrd(void** initrd, size_t* size) {
     return BH_STATUS_NOT_IMPLEMENTED;
 }
 
-// Setup memory map for U-Boot
-bh_status_t uboot_setup_memory_map(bh_boot_info_t* boot_info) {
-    if (!boot_info || !bd) {
+// Add [start, end) to a sorted table, merging what it overlaps or touches
+static bool uboot_region_add(struct uboot_mem_region* table, uint32_t* count, uint64_t start, uint64_t end) {
+    if (start >= end) {
+        return true;
+    }
+    
+    uint32_t i = 0;
+    while (i < *count && table[i].end < start) {
+        i++;
+    }
+    
+    uint32_t j = i;
+    while (j < *count && table[j].start <= end) {
+        start = table[j].start < start ? table[j].start : start;
+        end = table[j].end > end ? table[j].end : end;
+        j++;
+    }
+    
+    if (i == j) {
+        if (*count == UBOOT_MAX_MEM_REGIONS) {
+            return false;
+        }
+        memmove(&table[i + 1], &table[i], (*count - i) * sizeof(*table));
+        (*count)++;
+    } else if (j > i + 1) {
+        memmove(&table[i + 1], &table[j], (*count - j) * sizeof(*table));
+        *count -= j - i - 1;
+    }
+    table[i].start = start;
+    table[i].end = end;
+    return true;
+}
+
+// Take [start, end) out of a sorted table, splitting a region it falls inside
+static bool uboot_region_remove(struct uboot_mem_region* table, uint32_t* count, uint64_t start, uint64_t end) {
+    for (uint32_t i = 0; i < *count && start < end; i++) {
+        struct uboot_mem_region* r = &table[i];
+        if (r->end <= start || r->start >= end) {
+            continue;
+        }
+        
+        if (r->start < start && r->end > end) {
+            if (*count == UBOOT_MAX_MEM_REGIONS) {
+                return false;
+            }
+            memmove(&table[i + 1], &table[i], (*count - i) * sizeof(*table));
+            (*count)++;
+            table[i].end = start;
+            table[i + 1].start = end;
+            return true;
+        }
+        
+        if (r->start >= start && r->end <= end) {
+            memmove(&table[i], &table[i + 1], (*count - i - 1) * sizeof(*table));
+            (*count)--;
+            i--;
+        } else if (r->start < start) {
+            r->end = start;
+        } else {
+            r->start = end;
+        }
+    }
+    return true;
+}
+
+// One address or size of `cells` big-endian cells
+static uint64_t uboot_fdt_cells(const uint8_t* p, int cells) {
+    uint64_t value = 0;
+    for (int i = 0; i < cells; i++) {
+        value = (value << 32) | fdt_be32(p + i * 4);
+    }
+    return value;
+}
+
+static int uboot_fdt_cell_count(const void* fdt, int node, const char* name, int fallback) {
+    int len;
+    const void* prop = fdt_getprop(fdt, node, name, &len);
+    if (!prop || len != 4 || fdt_be32(prop) > 2) {
+        return fallback;
+    }
+    return (int)fdt_be32(prop);
+}
+
+// Add every (address, size) pair of the node's reg to a table
+static bool uboot_fdt_add_reg(const void* fdt, int node, int address_cells, int size_cells,
+                              struct uboot_mem_region* table, uint32_t* count) {
+    int len;
+    const uint8_t* reg = fdt_getprop(fdt, node, "reg", &len);
+    int entry = (address_cells + size_cells) * 4;
+    if (!reg || entry == 0) {
+        return true;
+    }
+    
+    for (int off = 0; off + entry <= len; off += entry) {
+        uint64_t start = uboot_fdt_cells(reg + off, address_cells);
+        uint64_t size = uboot_fdt_cells(reg + off + address_cells * 4, size_cells);
+        uint64_t end = start + size < start ? UINT64_MAX : start + size;
+        if (!uboot_region_add(table, count, start, end)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool uboot_fdt_node_enabled(const void* fdt, int node) {
+    int len;
+    const char* status = fdt_getprop(fdt, node, "status", &len);
+    return !status || strcmp(status, "okay") == 0 || strcmp(status, "ok") == 0;
+}
+
+// RAM and reserved ranges from the FDT, read in place
+static bh_status_t uboot_scan_fdt_layout(const void* fdt) {
+    int address_cells = uboot_fdt_cell_count(fdt, 0, "#address-cells", 2);
+    int size_cells = uboot_fdt_cell_count(fdt, 0, "#size-cells", 1);
+    
+    for (int node = fdt_first_subnode(fdt, 0); node >= 0; node = fdt_next_subnode(fdt, node)) {
+        int name_len;
+        const char* name = fdt_get_name(fdt, node, &name_len);
+        int len;
+        const char* type = fdt_getprop(fdt, node, "device_type", &len);
+        bool memory = (type && strcmp(type, "memory") == 0) ||
+                      (name_len >= 6 && strncmp(name, "memory", 6) == 0 && (name_len == 6 || name[6] == '@'));
+        
+        if (memory && uboot_fdt_node_enabled(fdt, node) &&
+            !uboot_fdt_add_reg(fdt, node, address_cells, size_cells, uboot_ram, &uboot_ram_count)) {
+            return BH_STATUS_NO_MEMORY;
+        }
+    }
+    
+    // Reserve map: (address, size) pairs up to a zero entry
+    const uint8_t* rsv = (const uint8_t*)fdt + fdt_off_mem_rsvmap(fdt);
+    const uint8_t* rsv_end = (const uint8_t*)fdt + fdt_off_dt_struct(fdt);
+    for (; rsv + 16 <= rsv_end; rsv += 16) {
+        uint64_t start = uboot_fdt_cells(rsv, 2);
+        uint64_t size = uboot_fdt_cells(rsv + 8, 2);
+        if (!start && !size) {
+            break;
+        }
+        if (!uboot_region_add(uboot_reserved, &uboot_reserved_count, start, start + size)) {
+            return BH_STATUS_NO_MEMORY;
+        }
+    }
+    
+    int reserved = fdt_path_offset(fdt, "/reserved-memory");
+    if (reserved >= 0) {
+        int rsv_address_cells = uboot_fdt_cell_count(fdt, reserved, "#address-cells", address_cells);
+        int rsv_size_cells = uboot_fdt_cell_count(fdt, reserved, "#size-cells", size_cells);
+        for (int node = fdt_first_subnode(fdt, reserved); node >= 0; node = fdt_next_subnode(fdt, node)) {
+            if (uboot_fdt_node_enabled(fdt, node) &&
+                !uboot_fdt_add_reg(fdt, node, rsv_address_cells, rsv_size_cells,
+                                   uboot_reserved, &uboot_reserved_count)) {
+                return BH_STATUS_NO_MEMORY;
+            }
+        }
+    }
+    
+    uint64_t blob = (uint64_t)(uintptr_t)fdt;
+    if (!uboot_region_add(uboot_reserved, &uboot_reserved_count, blob, blob + fdt_totalsize(fdt))) {
+        return BH_STATUS_NO_MEMORY;
+    }
+    return BH_STATUS_SUCCESS;
+}
+
+static bh_status_t uboot_scan_layout(void) {
+    uboot_ram_count = 0;
+    uboot_reserved_count = 0;
+    uboot_free_count = 0;
+    
+    if (fdt_blob && fdt_check_header(fdt_blob) == 0) {
+        bh_status_t status = uboot_scan_fdt_layout(fdt_blob);
+        if (status != BH_STATUS_SUCCESS) {
+            return status;
+        }
+    }
+    
+    if (uboot_ram_count == 0) {
+        if (!bd || !bd->bi_memsize) {
+            return BH_STATUS_NOT_FOUND;
+        }
+        uboot_region_add(uboot_ram, &uboot_ram_count, bd->bi_memstart, (uint64_t)bd->bi_memstart + bd->bi_memsize);
+    }
+    
+    // U-Boot relocated itself to the top of its bank; everything from our
+    // stack up (monitor, heap, board data) is still live
+    if (gd && gd->start_addr_sp) {
+        uint64_t sp = gd->start_addr_sp;
+        uint64_t low = sp > UBOOT_STACK_RESERVE ? sp - UBOOT_STACK_RESERVE : 0;
+        for (uint32_t i = 0; i < uboot_ram_count; i++) {
+            if (uboot_ram[i].start <= sp && sp < uboot_ram[i].end &&
+                !uboot_region_add(uboot_reserved, &uboot_reserved_count, low, uboot_ram[i].end)) {
+                return BH_STATUS_NO_MEMORY;
+            }
+        }
+    }
+    
+    memcpy(uboot_free_ram, uboot_ram, uboot_ram_count * sizeof(*uboot_ram));
+    uboot_free_count = uboot_ram_count;
+    for (uint32_t i = 0; i < uboot_reserved_count; i++) {
+        if (!uboot_region_remove(uboot_free_ram, &uboot_free_count, uboot_reserved[i].start, uboot_reserved[i].end)) {
+            return BH_STATUS_NO_MEMORY;
+        }
+    }
+    
+    uboot_layout_valid = true;
+    return BH_STATUS_SUCCESS;
+}
+
+// Memory map: free RAM, then every reserved range, then flash and SRAM
+bh_status_t uboot_get_memory_map(bh_memory_map_t* memory_map) {
+    if (!memory_map) {
         return BH_STATUS_INVALID_PARAMETER;
     }
     
-    // Add main memory region
+    if (!uboot_layout_valid) {
+        bh_status_t status = uboot_scan_layout();
+        if (status != BH_STATUS_SUCCESS) {
+            return status;
+        }
+    }
+    
     bh_memory_range_t memory_range = {0};
-    memory_range.start = bd->bi_memstart;
-    memory_range.end = bd->bi_memstart + bd->bi_memsize;
-    memory_range.type = BH_MEMORY_TYPE_RAM;
-    memory_range.flags = BH_MEMORY_FLAG_AVAILABLE;
+    for (uint32_t i = 0; i < uboot_free_count; i++) {
+        memory_range.start = uboot_free_ram[i].start;
+        memory_range.end = uboot_free_ram[i].end;
+        memory_range.type = BH_MEMORY_TYPE_RAM;
+        memory_range.flags = BH_MEMORY_FLAG_AVAILABLE;
+        
+        bh_status_t status = bh_memory_map_add_range(memory_map, &memory_range);
+        if (status != BH_STATUS_SUCCESS) {
+            return status;
+        }
+    }
     
-    bh_status_t status = bh_memory_map_add_range(&boot_info->memory_map, &memory_range);
-    if (status != BH_STATUS_SUCCESS) {
-        return status;
+    for (uint32_t i = 0; i < uboot_reserved_count; i++) {
+        memory_range.start = uboot_reserved[i].start;
+        memory_range.end = uboot_reserved[i].end;
+        memory_range.type = BH_MEMORY_TYPE_RESERVED;
+        memory_range.flags = 0;
+        
+        bh_status_t status = bh_memory_map_add_range(memory_map, &memory_range);
+        if (status != BH_STATUS_SUCCESS) {
+            return status;
+        }
     }
     
     // Add flash memory if present
-    if (bd->bi_flashsize > 0) {
+    if (bd && bd->bi_flashsize > 0) {
         memory_range.start = bd->bi_flashstart;
         memory_range.end = bd->bi_flashstart + bd->bi_flashsize;
         memory_range.type = BH_MEMORY_TYPE_FLASH;
         memory_range.flags = BH_MEMORY_FLAG_READONLY;
         
-        status = bh_memory_map_add_range(&boot_info->memory_map, &memory_range);
+        bh_status_t status = bh_memory_map_add_range(memory_map, &memory_range);
         if (status != BH_STATUS_SUCCESS) {
             return status;
         }
     }
     
     // Add SRAM if present
-    if (bd->bi_sramsize > 0) {
+    if (bd && bd->bi_sramsize > 0) {
         memory_range.start = bd->bi_sramstart;
         memory_range.end = bd->bi_sramstart + bd->bi_sramsize;
         memory_range.type = BH_MEMORY_TYPE_SRAM;
         memory_range.flags = BH_MEMORY_FLAG_AVAILABLE;
         
-        status = bh_memory_map_add_range(&boot_info->memory_map, &memory_range);
+        bh_status_t status = bh_memory_map_add_range(memory_map, &memory_range);
+        if (status != BH_STATUS_SUCCESS) {
+            return status;
+        }
+    }
+    
+    return BH_STATUS_SUCCESS;
+}
+
+// Setup memory map for U-Boot
+bh_status_t uboot_setup_memory_map(bh_boot_info_t* boot_info) {
+    if (!boot_info) {
+        return BH_STATUS_INVALID_PARAMETER;
+    }
+    
+    return uboot_get_memory_map(&boot_info->memory_map);
+}
+
+// Reserve `size` bytes at an `align`-aligned address (a power of two) from
+// the lowest free RAM the CPU can address; the range is reserved for good
+bh_status_t uboot_alloc_region(uint64_t size, uint64_t align, uint64_t* address) {
+    if (!size || !address || (align & (align - 1))) {
+        return BH_STATUS_INVALID_PARAMETER;
+    }
+    
+    if (!uboot_layout_valid) {
+        bh_status_t status = uboot_scan_layout();
         if (status != BH_STATUS_SUCCESS) {
             return status;
         }
     }
     
+    uint64_t mask = align ? align - 1 : 0;
+    for (uint32_t i = 0; i < uboot_free_count; i++) {
+        uint64_t start = (uboot_free_ram[i].start + mask) & ~mask;
+        if (start < uboot_free_ram[i].start || start >= uboot_free_ram[i].end ||
+            uboot_free_ram[i].end - start < size || start + size - 1 > (uint64_t)UINTPTR_MAX) {
+            continue;
+        }
+        
+        if (!uboot_region_add(uboot_reserved, &uboot_reserved_count, start, start + size) ||
+            !uboot_region_remove(uboot_free_ram, &uboot_free_count, start, start + size)) {
+            return BH_STATUS_NO_MEMORY;
+        }
+        *address = start;
+        return BH_STATUS_SUCCESS;
+    }
+    
+    return BH_STATUS_NO_MEMORY;
+}
+
+// Read a file straight into a range reserved for it: no heap buffer and no
+// second copy, whatever the size of the U-Boot heap
+bh_status_t uboot_load_file(const char* path, uint64_t align, void** data, size_t* size) {
+    if (!path || !data || !size) {
+        return BH_STATUS_INVALID_PARAMETER;
+    }
+    
+    uint64_t file_size;
+    if (uboot_fs_size(path, &file_size) != 0) {
+        return BH_STATUS_NOT_FOUND;
+    }
+    if (file_size == 0 || file_size > SIZE_MAX) {
+        return BH_STATUS_INVALID_DATA;
+    }
+    
+    uint64_t address;
+    bh_status_t status = uboot_alloc_region(file_size, align, &address);
+    if (status != BH_STATUS_SUCCESS) {
+        return status;
+    }
+    
+    uint64_t actual;
+    void* buffer = (void*)(uintptr_t)address;
+    if (uboot_fs_read(path, buffer, file_size, &actual) != 0 || actual != file_size) {
+        return BH_STATUS_IO_ERROR;
+    }
+    
+    *data = buffer;
+    *size = (size_t)file_size;
     return BH_STATUS_SUCCESS;
 }
 
@@ -343,6 +670,109 @@ bh_status_t uboot_print_info(void) {
     return BH_STATUS_SUCCESS;
 }
 
+// Device tree utilities, on the blob in place (fdt.c)
+bh_status_t uboot_fdt_get_node_offset(const void* fdt, const char* path, int* offset) {
+    if (!fdt || !path || !offset) {
+        return BH_STATUS_INVALID_PARAMETER;
+    }
+    
+    int node = fdt_path_offset(fdt, path);
+    if (node < 0) {
+        return fdt_status(node);
+    }
+    
+    *offset = node;
+    return BH_STATUS_SUCCESS;
+}
+
+// On return *size is the property length, also when the buffer is too small
+bh_status_t uboot_fdt_getprop(const void* fdt, const char* path, const char* prop, void* value, size_t* size) {
+    if (!fdt || !path || !prop || !size) {
+        return BH_STATUS_INVALID_PARAMETER;
+    }
+    
+    int node = fdt_path_offset(fdt, path);
+    if (node < 0) {
+        return fdt_status(node);
+    }
+    
+    int len;
+    const void* data = fdt_getprop(fdt, node, prop, &len);
+    if (!data) {
+        return fdt_status(len);
+    }
+    
+    size_t capacity = *size;
+    *size = (size_t)len;
+    if (!value || capacity < (size_t)len) {
+        return BH_STATUS_INVALID_PARAMETER;
+    }
+    
+    memcpy(value, data, (size_t)len);
+    return BH_STATUS_SUCCESS;
+}
+
+bh_status_t uboot_fdt_get_string(const void* fdt, int offset, const char* prop, char* str, size_t size) {
+    if (!fdt || !prop || !str || !size) {
+        return BH_STATUS_INVALID_PARAMETER;
+    }
+    
+    int len;
+    const char* data = fdt_getprop(fdt, offset, prop, &len);
+    if (!data) {
+        return fdt_status(len);
+    }
+    if (len == 0 || data[len - 1] != '\0') {
+        return BH_STATUS_INVALID_DATA;
+    }
+    if ((size_t)len > size) {
+        return BH_STATUS_INVALID_PARAMETER;
+    }
+    
+    memcpy(str, data, (size_t)len);
+    return BH_STATUS_SUCCESS;
+}
+
+// The property is rewritten in place. U-Boot hands over a packed blob, so
+// when the one from uboot_get_device_tree runs out of room it is moved once
+// into a buffer with headroom and later edits land there.
+bh_status_t uboot_fdt_setprop(void* fdt, const char* path, const char* prop, const void* value, size_t size) {
+    if (!fdt || !path || !prop || (size && !value) || size > UBOOT_FDT_MAX_GROW) {
+        return BH_STATUS_INVALID_PARAMETER;
+    }
+    
+    int node = fdt_path_offset(fdt, path);
+    if (node < 0) {
+        return fdt_status(node);
+    }
+    
+    int err = fdt_setprop(fdt, node, prop, value, (int)size);
+    if ((err == -FDT_ERR_NOSPACE || err == -FDT_ERR_BADLAYOUT) && fdt == fdt_blob) {
+        size_t grown = fdt_totalsize(fdt) + size + strlen(prop) + UBOOT_FDT_HEADROOM;
+        void* buf = uboot_malloc(grown);
+        if (!buf) {
+            return BH_STATUS_NO_MEMORY;
+        }
+        
+        err = fdt_open_into(fdt, buf, (int)grown);
+        if (err) {
+            uboot_free(buf);
+            return fdt_status(err);
+        }
+        if (fdt_owned) {
+            uboot_free(fdt_blob);
+        }
+        fdt_blob = fdt = buf;
+        fdt_size = grown;
+        fdt_owned = true;
+        
+        // Offsets keep their meaning across fdt_open_into
+        err = fdt_setprop(fdt, node, prop, value, (int)size);
+    }
+    
+    return fdt_status(err);
+}
+
 // Console I/O functions
 void uboot_putc(char c) {
     if (gd && gd->have_console) {
@@ -370,20 +800,38 @@ int uboot_tstc(void) {
     return 0;
 }
 
-// Memory allocation (simplified - uses U-Boot's malloc if available)
+// Memory allocation: the libb heap, fed whole pages carved out of free
+// RAM. U-Boot has nothing to hand pages back to, so they stay reserved
+// and the heap keeps them for reuse.
+#define UBOOT_HEAP_PAGE_SIZE 4096
+
+static void* uboot_heap_pages(bh_size_t pages) {
+    uint64_t address;
+    if (uboot_alloc_region((uint64_t)pages * UBOOT_HEAP_PAGE_SIZE, UBOOT_HEAP_PAGE_SIZE, &address) != BH_STATUS_SUCCESS) {
+        return NULL;
+    }
+    return (void*)(uintptr_t)address;
+}
+
+static bh_system_table_t uboot_system_table = {
+    .putc = uboot_putc,
+    .puts = uboot_puts,
+    .alloc_pages = uboot_heap_pages,
+};
+
 void* uboot_malloc(size_t size) {
-    // This would interface with U-Boot's malloc implementation
-    // For now, return NULL to indicate not implemented
-    return NULL;
+    // Keeps a table the loader already installed
+    bh_init_system_table(&uboot_system_table);
+    return bh_malloc(size);
 }
 
 void uboot_free(void* ptr) {
-    // Interface with U-Boot's free implementation
+    bh_free(ptr);
 }
 
 void* uboot_realloc(void* ptr, size_t size) {
-    // Interface with U-Boot's realloc implementation
-    return NULL;
+    bh_init_system_table(&uboot_system_table);
+    return bh_realloc(ptr, size);
 }
 
 // Timing functions
@@ -393,7 +841,11 @@ uint64_t uboot_get_timer(void) {
 }
 
 void uboot_udelay(unsigned long usec) {
-    // Simple delay using timebase
+    // Timed against the calibrated clock once the timebase rate is known
+    if (bh_sleep_microseconds(usec) == BH_SUCCESS) {
+        return;
+    }
+
     uint64_t start = ppc_mftb();
     uint64_t ticks = (usec * 512) / 1000000; // Assuming 512MHz timebase
     
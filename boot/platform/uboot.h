@@ -95,6 +95,7 @@ bh_status_t uboot_get_device_tree(void** fdt, size_t* size);
 bh_status_t uboot_get_command_line(char** cmdline, size_t* size);
 bh_status_t uboot_get_initrd(void** initrd, size_t* size);
 bh_status_t uboot_setup_memory_map(bh_boot_info_t* boot_info);
+bh_status_t uboot_get_memory_map(bh_memory_map_t* memory_map);
 bh_status_t uboot_setup_console(void);
 bh_status_t uboot_print_info(void);
 
@@ -103,12 +104,36 @@ bh_status_t uboot_env_get(const char* name, char* value, size_t size);
 bh_status_t uboot_env_set(const char* name, const char* value);
 bh_status_t uboot_env_list(void (*callback)(const char* name, const char* value, void* data), void* data);
 
-// U-Boot device tree utilities
+// U-Boot device tree utilities. Properties are read and written in the
+// blob itself; a blob too full for a write is copied once into a buffer
+// with UBOOT_FDT_HEADROOM spare bytes, which uboot_get_device_tree then
+// returns.
+#define UBOOT_FDT_HEADROOM      (16 * 1024)
+#define UBOOT_FDT_MAX_GROW      (1024 * 1024)   // Largest property uboot_fdt_setprop writes
+
 bh_status_t uboot_fdt_getprop(const void* fdt, const char* path, const char* prop, void* value, size_t* size);
 bh_status_t uboot_fdt_setprop(void* fdt, const char* path, const char* prop, const void* value, size_t size);
 bh_status_t uboot_fdt_get_node_offset(const void* fdt, const char* path, int* offset);
 bh_status_t uboot_fdt_get_string(const void* fdt, int offset, const char* prop, char* str, size_t size);
 
+// U-Boot memory layout. RAM comes from the FDT /memory nodes (bdinfo when
+// there are none); the FDT reserve map, /reserved-memory, the blob itself
+// and U-Boot's relocated image, heap and stack above gd->start_addr_sp are
+// carved out of it. Loads take aligned ranges from what is left, so large
+// images never pass through the small U-Boot heap; those ranges stay
+// reserved until the kernel is started.
+#define UBOOT_MAX_MEM_REGIONS   32
+#define UBOOT_STACK_RESERVE     (1024 * 1024)       // Below start_addr_sp: the stack we run on
+#define UBOOT_LOAD_ALIGN        (2 * 1024 * 1024)   // Kernel images (arm64 Image needs 2 MiB)
+
+struct uboot_mem_region {
+    uint64_t start;
+    uint64_t end;                // Exclusive
+};
+
+bh_status_t uboot_alloc_region(uint64_t size, uint64_t align, uint64_t* address);
+bh_status_t uboot_load_file(const char* path, uint64_t align, void** data, size_t* size);
+
 // U-Boot console I/O
 void uboot_putc(char c);
 void uboot_puts(const char* s);
@@ -0,0 +1,130 @@
+/*
+ * plugin.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <Uefi.h>
+#include "compat.h"
+#include <Library/UefiLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/PrintLib.h>
+#include <Library/DevicePathLib.h>
+#include <Protocol/LoadedImage.h>
+#include "BootManagerProtocol/BootManagerProtocol.h"
+#include "plugin.h"
+
+#define PLUGIN_DIRECTORY    L"plugins"
+#define PLUGIN_PATH_MAX     260
+
+EFI_GUID gBloodHornCoreProtocolGuid = BLOODHORN_CORE_PROTOCOL_GUID;
+
+STATIC BLOODHORN_CORE_PROTOCOL mCoreProtocol = {
+    BLOODHORN_CORE_PROTOCOL_REVISION,
+    CreateBootFile,
+    WriteBootFile,
+    LoadHttpFile,
+    FreeLoadedFile,
+    GetOpenBlockDevice,
+    IcmpEchoSweep,
+    InstallBootProfiler,
+    BootProfilerReset,
+    BootProfilerPrint,
+    BootProfilerSave,
+    AllocProfilerPrint,
+    AllocProfilerSave,
+    fs_open,
+    fs_file_read,
+    fs_file_pread,
+    fs_file_size,
+    fs_close,
+    fs_list_dir,
+    blockdev_read_raw,
+    blockdev_print_stats,
+    part_table_get,
+    part_guid_format,
+    pxe_network_init,
+    pxe_get_network_info,
+    pxe_get_nics,
+    pxe_download,
+    bh_get_performance_frequency,
+    bh_get_performance_counter,
+    bh_ticks_to_nanoseconds,
+    bh_nanoseconds_to_ticks,
+    bh_sleep_microseconds,
+    bh_perf_print_counters,
+    bh_trace_reset,
+    bh_trace_print,
+    bh_trace_export_chrome_json,
+};
+
+STATIC BOOLEAN mCoreProtocolInstalled = FALSE;
+
+// Directory part of the loader's own file path, without the trailing
+// backslash: "" for a loader in the root or one started from memory
+STATIC UINTN LoaderDirectory(
+    IN  EFI_LOADED_IMAGE_PROTOCOL  *LoadedImage,
+    OUT CONST CHAR16               **Directory
+) {
+    CONST CHAR16 *Path = NULL;
+    UINTN Length = 0;
+
+    for (EFI_DEVICE_PATH_PROTOCOL *Node = LoadedImage->FilePath;
+         Node != NULL && !IsDevicePathEnd(Node);
+         Node = NextDevicePathNode(Node)) {
+        if (DevicePathType(Node) != MEDIA_DEVICE_PATH || DevicePathSubType(Node) != MEDIA_FILEPATH_DP || Path) {
+            Path = NULL;
+            break;
+        }
+        Path = ((FILEPATH_DEVICE_PATH *)Node)->PathName;
+    }
+
+    *Directory = Path;
+    if (Path) {
+        for (UINTN i = 0; Path[i] != L'\0'; i++) {
+            if (Path[i] == L'\\') {
+                Length = i;
+            }
+        }
+    }
+    return Length;
+}
+
+EFI_STATUS EFIAPI StartPlugin(IN CONST CHAR16 *Name) {
+    EFI_LOADED_IMAGE_PROTOCOL *LoadedImage = NULL;
+    CONST CHAR16 *Directory = NULL;
+    CHAR16 Path[PLUGIN_PATH_MAX];
+    UINTN Length;
+    EFI_STATUS Status;
+
+    Status = gBS->HandleProtocol(gImageHandle, &gEfiLoadedImageProtocolGuid, (VOID **)&LoadedImage);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    if (!mCoreProtocolInstalled) {
+        EFI_HANDLE Handle = gImageHandle;
+        Status = gBS->InstallMultipleProtocolInterfaces(&Handle, &gBloodHornCoreProtocolGuid, &mCoreProtocol, NULL);
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+        mCoreProtocolInstalled = TRUE;
+    }
+
+    Length = LoaderDirectory(LoadedImage, &Directory);
+    if (Length + StrLen(PLUGIN_DIRECTORY) + StrLen(Name) + 7 > ARRAY_SIZE(Path)) {
+        return EFI_BAD_BUFFER_SIZE;
+    }
+    UnicodeSPrint(Path, sizeof(Path), L"%.*s\\%s\\%s.efi", Length, Directory ? Directory : L"", PLUGIN_DIRECTORY, Name);
+
+    Status = LoadAndStartImageFromPath(gImageHandle, LoadedImage->DeviceHandle, Path);
+    if (Status == EFI_NOT_FOUND) {
+        Print(L"Plugin %s is not installed (%s).\n", Name, Path);
+    } else if (EFI_ERROR(Status)) {
+        Print(L"Plugin %s failed: %r\n", Name, Status);
+    }
+    return Status;
+}
@@ -0,0 +1,101 @@
+/*
+ * plugin.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_BOOT_PLUGIN_H
+#define BLOODHORN_BOOT_PLUGIN_H
+
+#include <Base.h>
+#include <Uefi.h>
+#include "compat.h"
+#include "../uefi/uefi.h"
+#include "../fs/fs_mount.h"
+#include "../fs/blockdev.h"
+#include "../fs/partition.h"
+#include "../net/pxe.h"
+#include "libb/include/bloodhorn/debug.h"
+#include "libb/include/bloodhorn/trace.h"
+#include "libb/include/bloodhorn/time.h"
+
+// Plugins are UEFI applications kept next to the loader as
+// <loader dir>\plugins\<name>.efi and started only when something needs
+// them, so a boot that never opens the recovery shell never reads it.
+// They go through the same allowlist, dbx and firmware Secure Boot checks
+// as any other image BloodHorn starts (LoadAndStartImageFromPath).
+//
+// A plugin reaches the loader's state (mounts, open disks, the PXE lease,
+// profilers, the boot trace) through this protocol, installed on the
+// loader's image handle. Both sides come from the same build, so the
+// members use the loader's own calling convention; a plugin refuses to
+// run against any other revision.
+#define BLOODHORN_CORE_PROTOCOL_GUID \
+    { 0x337361ec, 0xd8b0, 0x45b1, { 0x87, 0x5e, 0x88, 0x18, 0xd4, 0xe8, 0x43, 0xa4 } }
+
+#define BLOODHORN_CORE_PROTOCOL_REVISION    1
+
+typedef struct {
+    UINT32 Revision;
+
+    // Boot volume (uefi/uefi.h)
+    EFI_STATUS (*CreateBootFile)(CONST CHAR16* FileName, EFI_FILE_PROTOCOL** Handle);
+    EFI_STATUS (*WriteBootFile)(CONST CHAR16* FileName, CONST VOID* Buffer, UINTN Size);
+    EFI_STATUS (*LoadHttpFile)(CONST CHAR16* Url, UINT32 Flags, FILE_LOAD_CHUNK_CALLBACK Callback,
+                               VOID* Context, LOADED_FILE* File);
+    VOID (*FreeLoadedFile)(LOADED_FILE* File);
+    EFI_STATUS (*GetOpenBlockDevice)(UINTN Index, struct block_device** Device);
+    EFI_STATUS (*IcmpEchoSweep)(CONST UINT32* Targets, UINTN Count, UINT16 Sequence, UINT32 TimeoutMs,
+                                UINT32* RttUs);
+
+    // Profilers
+    EFI_STATUS (*InstallBootProfiler)(BOOLEAN Enable);
+    VOID (*BootProfilerReset)(VOID);
+    VOID (*BootProfilerPrint)(UINTN Top);
+    EFI_STATUS (*BootProfilerSave)(CONST CHAR16* FileName);
+    VOID (*AllocProfilerPrint)(UINTN Top);
+    EFI_STATUS (*AllocProfilerSave)(CONST CHAR16* FileName);
+
+    // Mounted filesystems and disks (fs/)
+    fs_file_t* (*fs_open)(const char* path);
+    int (*fs_file_read)(fs_file_t* file, uint8_t* buf, uint32_t size);
+    int (*fs_file_pread)(fs_file_t* file, uint8_t* buf, uint32_t size, uint32_t offset);
+    uint32_t (*fs_file_size)(const fs_file_t* file);
+    void (*fs_close)(fs_file_t* file);
+    int (*fs_list_dir)(const char* path, char* buffer, uint32_t size);
+    int (*blockdev_read_raw)(block_device_t* dev, uint64_t sector, uint32_t count, void* buf);
+    void (*blockdev_print_stats)(void);
+    const part_table_t* (*part_table_get)(block_device_t* dev);
+    void (*part_guid_format)(const uint8_t* guid, char* out);
+
+    // Network boot (net/pxe.h)
+    int (*pxe_network_init)(void);
+    struct pxe_network_info* (*pxe_get_network_info)(void);
+    int (*pxe_get_nics)(const pxe_nic_t** nics);
+    int (*pxe_download)(const char* server, const char* path, const pxe_sink_t* sink, uint32_t default_size,
+                        uint8_t** data, uint32_t* size);
+
+    // libb clock, counters and boot trace
+    bh_uint64_t (*bh_get_performance_frequency)(void);
+    bh_uint64_t (*bh_get_performance_counter)(void);
+    bh_uint64_t (*bh_ticks_to_nanoseconds)(bh_uint64_t ticks);
+    bh_uint64_t (*bh_nanoseconds_to_ticks)(bh_uint64_t nanoseconds);
+    bh_status_t (*bh_sleep_microseconds)(bh_uint64_t microseconds);
+    void (*bh_perf_print_counters)(void);
+    void (*bh_trace_reset)(void);
+    void (*bh_trace_print)(void);
+    bh_status_t (*bh_trace_export_chrome_json)(char* buffer, bh_size_t buffer_size, bh_size_t* written);
+} BLOODHORN_CORE_PROTOCOL;
+
+extern EFI_GUID gBloodHornCoreProtocolGuid;
+
+// Start plugins\<Name>.efi from the loader's directory and wait for it to
+// return. EFI_NOT_FOUND when it is not installed; verification failures
+// come back as from LoadAndStartImageFromPath.
+EFI_STATUS EFIAPI
+StartPlugin(
+    IN CONST CHAR16 *Name
+);
+
+#endif // BLOODHORN_BOOT_PLUGIN_H
@@ -9,51 +9,228 @@
 #include "compat.h"
 #include <Library/UefiLib.h>
 #include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiRuntimeServicesTableLib.h>
 #include <Library/BaseMemoryLib.h>
 #include <Library/MemoryAllocationLib.h>
 #include <Library/BaseCryptLib.h>
+#include <Library/PrintLib.h>
+#include <Library/SynchronizationLib.h>
+#include <Library/DevicePathLib.h>
+#include <Library/Tpm2CommandLib.h>
+#include <Protocol/MpService.h>
+#include <Protocol/LoadedImage.h>
 #include <Protocol/ImageAuthentication.h>
 #include <Guid/ImageAuthentication.h>
 #include <Guid/GlobalVariable.h>
+#include "../security/crypto.h"
+#include "../security/secure_boot.h"
+#include "../security/merkle.h"
+#include "../security/image_cache.h"
+#include "../security/sigdb.h"
+#include "../uefi/uefi.h"
+#include "../boot/libb/include/bloodhorn/counters.h"
+#include "../boot/libb/include/bloodhorn/time.h"
+#include "secure.h"
 
-EFI_STATUS EFIAPI VerifyImageSignature(
+extern EFI_GUID gBloodHornVariableGuid;
+
+// Verified-image cache and the secret its MAC key is derived from. Both are
+// boot-services-only, so the running OS can neither read nor plant them.
+#define IMAGE_CACHE_VARIABLE        L"BloodHornImageCache"
+#define IMAGE_CACHE_KEY_VARIABLE    L"BloodHornImageCacheKey"
+#define IMAGE_CACHE_ATTRIBUTES      (EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS)
+
+STATIC image_cache_t mImageCache;
+STATIC UINT8 mImageCacheKey[CRYPTO_SHA256_DIGEST_LENGTH];
+STATIC BOOLEAN mImageCacheKeyReady = FALSE;
+STATIC BOOLEAN mImageCacheReady = FALSE;
+
+// SHA-256 values of images this loader handed to a kernel, as they sat in
+// memory, for the warm-reboot fast path; sealed with the image cache key
+#define RESIDENT_IMAGE_VARIABLE     L"BloodHornResidentImages"
+#define RESIDENT_IMAGE_VERSION      1
+#define RESIDENT_IMAGE_MAX          16
+
+typedef struct {
+    UINT32 Version;
+    UINT32 Count;                   // Most recent first
+    UINT8 Digests[RESIDENT_IMAGE_MAX][CRYPTO_SHA256_DIGEST_LENGTH];
+    UINT8 Mac[CRYPTO_SHA256_DIGEST_LENGTH];
+} RESIDENT_IMAGE_TABLE;
+
+STATIC RESIDENT_IMAGE_TABLE mResidentImages;
+STATIC BOOLEAN mResidentImagesReady = FALSE;
+
+// A passing run of the crypto self-tests, for the build and CPU features it
+// ran on; sealed with the image cache key
+#define SELF_TEST_VARIABLE          L"BloodHornSelfTest"
+#define SELF_TEST_VERSION           1
+
+typedef struct {
+    UINT32 Version;
+    UINT32 Features;                // crypto_detect_hardware_support() at the time
+    UINT8 Binary[CRYPTO_SHA256_DIGEST_LENGTH];  // SHA-256 of the loader file
+    UINT64 TestedAt;                // Hour of the run by the RTC (0: no clock)
+    UINT8 Mac[CRYPTO_SHA256_DIGEST_LENGTH];
+} SELF_TEST_RECORD;
+
+// The firmware's db and dbx, parsed once per boot. A dbx that is present
+// but cannot be read or parsed revokes everything.
+STATIC sigdb_t mSigDb;
+STATIC sigdb_t mSigDbx;
+STATIC BOOLEAN mSigDbReady = FALSE;
+STATIC BOOLEAN mSigDbxBroken = FALSE;
+
+// Read one signature database variable into Db. The variable data stays
+// allocated, since the certificates point into it; an absent variable is
+// an empty database.
+STATIC EFI_STATUS SignatureDatabaseLoad(IN CHAR16 *Name, OUT sigdb_t *Db) {
+    EFI_STATUS Status;
+    UINTN Size = 0;
+    UINT8 *Data;
+    UINT8 (*Slots)[SIGDB_DIGEST_LENGTH];
+    UINT32 SlotCount;
+
+    ZeroMem(Db, sizeof(*Db));
+    Status = gRT->GetVariable(Name, &gEfiImageSecurityDatabaseGuid, NULL, &Size, NULL);
+    if (Status == EFI_NOT_FOUND) {
+        return EFI_SUCCESS;
+    }
+    if (Status != EFI_BUFFER_TOO_SMALL || Size > MAX_UINT32) {
+        return EFI_ERROR(Status) ? Status : EFI_BAD_BUFFER_SIZE;
+    }
+
+    Data = AllocatePool(Size);
+    if (!Data) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    Status = gRT->GetVariable(Name, &gEfiImageSecurityDatabaseGuid, NULL, &Size, Data);
+    if (EFI_ERROR(Status)) {
+        FreePool(Data);
+        return Status;
+    }
+
+    SlotCount = sigdb_slots(Data, (uint32_t)Size);
+    Slots = AllocatePool((UINTN)SlotCount * SIGDB_DIGEST_LENGTH);
+    if (!Slots || sigdb_parse(Db, Data, (uint32_t)Size, Slots, SlotCount) < 0) {
+        if (Slots) {
+            FreePool(Slots);
+        }
+        FreePool(Data);
+        ZeroMem(Db, sizeof(*Db));
+        return Slots ? EFI_VOLUME_CORRUPTED : EFI_OUT_OF_RESOURCES;
+    }
+    return EFI_SUCCESS;
+}
+
+STATIC VOID SignatureDatabasesLoad(VOID) {
+    if (mSigDbReady) {
+        return;
+    }
+    mSigDbReady = TRUE;
+    SignatureDatabaseLoad(EFI_IMAGE_SECURITY_DATABASE, &mSigDb);
+    mSigDbxBroken = EFI_ERROR(SignatureDatabaseLoad(EFI_IMAGE_SECURITY_DATABASE1, &mSigDbx));
+}
+
+// dbx revokes the signing key or, by the SHA-256 of the signed bytes, the
+// image itself. Hashing costs a pass over the image, so it is only done
+// when dbx lists any image hashes at all.
+STATIC BOOLEAN ImageRevoked(
+    IN CONST UINT8  *Data,
+    IN UINTN        DataSize,
+    IN UINT8        Algorithm,
+    IN CONST UINT8  *PublicKey,
+    IN UINTN        PublicKeySize
+) {
+    UINT8 Digest[SIGDB_DIGEST_LENGTH];
+
+    SignatureDatabasesLoad();
+    if (mSigDbxBroken || sigdb_has_key(&mSigDbx, Algorithm, PublicKey, (uint32_t)PublicKeySize)) {
+        return TRUE;
+    }
+    if (!ImageRevocationsListed()) {
+        return FALSE;
+    }
+    sha256_hash(Data, (uint32_t)DataSize, Digest);
+    return ImageDigestRevoked(Digest);
+}
+
+BOOLEAN EFIAPI ImageRevocationsListed(VOID) {
+    SignatureDatabasesLoad();
+    return mSigDbxBroken || mSigDbx.digest_count != 0 || mSigDbx.has_zero_digest;
+}
+
+BOOLEAN EFIAPI ImageDigestRevoked(
+    IN CONST UINT8  *Digest
+) {
+    SignatureDatabasesLoad();
+    return mSigDbxBroken || sigdb_has_digest(&mSigDbx, Digest) != 0;
+}
+
+// No key given: the image passes if db lists its SHA-256 (the whole file,
+// unsigned) or if it carries a signature under one of db's certificates
+STATIC EFI_STATUS VerifyImageAgainstDb(
+    IN CONST UINT8  *Image,
+    IN UINTN        ImageSize
+) {
+    UINT8 Digest[SIGDB_DIGEST_LENGTH];
+
+    SignatureDatabasesLoad();
+    if (mSigDbxBroken) {
+        return EFI_SECURITY_VIOLATION;
+    }
+    if (mSigDb.digest_count != 0 || mSigDb.has_zero_digest) {
+        sha256_hash(Image, (uint32_t)ImageSize, Digest);
+        if (sigdb_has_digest(&mSigDb, Digest) && !sigdb_has_digest(&mSigDbx, Digest)) {
+            return EFI_SUCCESS;
+        }
+    }
+
+    for (UINT32 i = 0; i < mSigDb.cert_count; i++) {
+        CONST sigdb_key_t *Key = &mSigDb.certs[i].key;
+        if (Key->length != 0 &&
+            !EFI_ERROR(VerifyImageSignatureEx(Image, ImageSize, Key->algorithm, Key->data, Key->length))) {
+            return EFI_SUCCESS;
+        }
+    }
+    return EFI_SECURITY_VIOLATION;
+}
+
+EFI_STATUS EFIAPI VerifyImageSignatureEx(
     IN CONST VOID    *ImageBuffer,
     IN UINTN         ImageSize,
+    IN UINT8         Algorithm,
     IN CONST UINT8   *PublicKey,
     IN UINTN         PublicKeySize
 ) {
-    if (!ImageBuffer || ImageSize == 0 || !PublicKey || PublicKeySize == 0) {
+    if (!ImageBuffer || ImageSize == 0) {
         return EFI_INVALID_PARAMETER;
     }
-    
-    // Validate signature size - don't assume 256 bytes
-    if (ImageSize < 64) return EFI_SECURITY_VIOLATION; // Minimum signature size
-    
-    // Try different signature formats
-    UINTN SignatureSize = 256; // Default to RSA-2048
-    if (PublicKeySize >= 512) {
-        // Check if it's RSA-4096
-        uint32_t key_bits = (PublicKey[0] << 24) | (PublicKey[1] << 16) | (PublicKey[2] << 8) | PublicKey[3];
-        if (key_bits >= 4096) {
-            SignatureSize = 512;
-        }
+    if (!PublicKey) {
+        return VerifyImageAgainstDb((CONST UINT8*)ImageBuffer, ImageSize);
+    }
+    if (PublicKeySize == 0) {
+        return EFI_INVALID_PARAMETER;
     }
     
-    if (ImageSize < SignatureSize) {
+    // The signature is appended to the image; its length follows from the
+    // scheme and, for RSA, the key_bits field of the key blob
+    int SignatureSize = secure_boot_signature_length(Algorithm, PublicKey, (uint32_t)PublicKeySize);
+    if (SignatureSize <= 0 || ImageSize <= (UINTN)SignatureSize) {
         return EFI_SECURITY_VIOLATION;
     }
     
     UINTN DataSize = ImageSize - SignatureSize;
     CONST UINT8* Data = (CONST UINT8*)ImageBuffer;
     CONST UINT8* Signature = Data + DataSize;
-    UINT8 Hash[32];
     
-    if (!Sha256HashAll(Data, DataSize, Hash)) {
+    if (ImageRevoked(Data, DataSize, Algorithm, PublicKey, PublicKeySize)) {
         return EFI_SECURITY_VIOLATION;
     }
     
-    // Use our improved crypto verification
-    int crypto_result = verify_signature(Data, (uint32_t)DataSize, Signature, PublicKey);
+    int crypto_result = secure_boot_verify_ex(Algorithm, Data, (uint32_t)DataSize,
+                                              Signature, (uint32_t)SignatureSize,
+                                              PublicKey, (uint32_t)PublicKeySize);
     if (crypto_result != CRYPTO_SUCCESS) {
         return EFI_SECURITY_VIOLATION;
     }
@@ -61,6 +238,16 @@ EFI_STATUS EFIAPI VerifyImageSignature(
     return EFI_SUCCESS;
 }
 
+EFI_STATUS EFIAPI VerifyImageSignature(
+    IN CONST VOID    *ImageBuffer,
+    IN UINTN         ImageSize,
+    IN CONST UINT8   *PublicKey,
+    IN UINTN         PublicKeySize
+) {
+    return VerifyImageSignatureEx(ImageBuffer, ImageSize, SECURE_BOOT_SIG_RSA_PKCS1_SHA256,
+                                  PublicKey, PublicKeySize);
+}
+
 BOOLEAN EFIAPI IsSecureBootEnabled(VOID) {
     EFI_STATUS Status;
     UINT8 SecureBoot = 0;
@@ -69,6 +256,271 @@ BOOLEAN EFIAPI IsSecureBootEnabled(VOID) {
     return !EFI_ERROR(Status) && (SecureBoot == 1);
 }
 
+// Chunks of one resident range shared out between the BSP and the APs
+typedef struct {
+    CONST merkle_manifest_t *Manifest;
+    CONST UINT8             *Data;          // Start of chunk FirstChunk
+    UINT32                  FirstChunk;
+    UINT32                  ChunkCount;
+    volatile UINT32         Next;           // Chunks claimed so far
+    volatile UINT32         Failed;
+} CHUNK_VERIFY_JOB;
+
+// Runs on every processor: claim chunks until none are left or one failed.
+// Only touches the job and the SHA-256 code, so it is AP-safe.
+STATIC VOID EFIAPI VerifyChunkWorker(IN OUT VOID *Buffer) {
+    CHUNK_VERIFY_JOB *Job = (CHUNK_VERIFY_JOB *)Buffer;
+
+    while (!Job->Failed) {
+        UINT32 Slot = InterlockedIncrement(&Job->Next) - 1;
+        if (Slot >= Job->ChunkCount) {
+            break;
+        }
+
+        UINT32 Index = Job->FirstChunk + Slot;
+        UINT64 Offset = merkle_chunk_offset(Job->Manifest, Index) -
+                        merkle_chunk_offset(Job->Manifest, Job->FirstChunk);
+        if (merkle_verify_chunk(Job->Manifest, Index, Job->Data + Offset,
+                                merkle_chunk_length(Job->Manifest, Index)) != CRYPTO_SUCCESS) {
+            Job->Failed = 1;
+        }
+    }
+}
+
+EFI_STATUS EFIAPI VerifyImageChunks(
+    IN CONST merkle_manifest_t  *Manifest,
+    IN CONST VOID               *Data,
+    IN UINT32                   FirstChunk,
+    IN UINT32                   ChunkCount
+) {
+    EFI_MP_SERVICES_PROTOCOL *Mp = NULL;
+    EFI_EVENT Done = NULL;
+    UINTN Processors = 0;
+    UINTN Enabled = 0;
+    CHUNK_VERIFY_JOB Job;
+
+    if (!Manifest || !Data || ChunkCount == 0 ||
+        FirstChunk >= Manifest->chunk_count || ChunkCount > Manifest->chunk_count - FirstChunk) {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    ZeroMem(&Job, sizeof(Job));
+    Job.Manifest = Manifest;
+    Job.Data = (CONST UINT8 *)Data;
+    Job.FirstChunk = FirstChunk;
+    Job.ChunkCount = ChunkCount;
+
+    // The manifest check already ran SHA-256 on the BSP, so the hash
+    // backend is chosen before any AP calls into it
+    if (ChunkCount > 1 &&
+        !EFI_ERROR(gBS->LocateProtocol(&gEfiMpServiceProtocolGuid, NULL, (VOID **)&Mp)) &&
+        !EFI_ERROR(Mp->GetNumberOfProcessors(Mp, &Processors, &Enabled)) && Enabled > 1 &&
+        !EFI_ERROR(gBS->CreateEvent(0, 0, NULL, NULL, &Done))) {
+        if (EFI_ERROR(Mp->StartupAllAPs(Mp, VerifyChunkWorker, FALSE, Done, 0, &Job, NULL))) {
+            gBS->CloseEvent(Done);
+            Done = NULL;
+        }
+    }
+
+    // The BSP takes its share either way, and all of it without APs
+    VerifyChunkWorker(&Job);
+
+    if (Done != NULL) {
+        UINTN Index;
+        gBS->WaitForEvent(1, &Done, &Index);
+        gBS->CloseEvent(Done);
+    }
+
+    return Job.Failed ? EFI_SECURITY_VIOLATION : EFI_SUCCESS;
+}
+
+// BLAKE3 subtrees of one buffer shared out between the BSP and the APs
+#define BLAKE3_SUBTREE_SIZE     (64 * 1024)
+#define BLAKE3_BATCH_SUBTREES   64
+
+typedef struct {
+    CONST UINT8             *Data;          // Start of subtree 0
+    UINT64                  FirstChunk;
+    UINT32                  Count;
+    volatile UINT32         Next;           // Subtrees claimed so far
+    UINT8                   Cvs[BLAKE3_BATCH_SUBTREES][CRYPTO_BLAKE3_DIGEST_LENGTH];
+} BLAKE3_JOB;
+
+// Runs on every processor; only touches the job and the BLAKE3 code
+STATIC VOID EFIAPI Blake3Worker(IN OUT VOID *Buffer) {
+    BLAKE3_JOB *Job = (BLAKE3_JOB *)Buffer;
+
+    for (;;) {
+        UINT32 Slot = InterlockedIncrement(&Job->Next) - 1;
+        if (Slot >= Job->Count) {
+            break;
+        }
+        crypto_blake3_subtree(Job->Data + (UINTN)Slot * BLAKE3_SUBTREE_SIZE, BLAKE3_SUBTREE_SIZE,
+                              Job->FirstChunk + (UINT64)Slot * (BLAKE3_SUBTREE_SIZE / CRYPTO_BLAKE3_CHUNK_LENGTH),
+                              Job->Cvs[Slot]);
+    }
+}
+
+VOID EFIAPI Blake3UpdateParallel(
+    IN OUT crypto_blake3_ctx_t  *Ctx,
+    IN CONST VOID               *Data,
+    IN UINTN                    Length
+) {
+    EFI_MP_SERVICES_PROTOCOL *Mp = NULL;
+    CONST UINT8 *Bytes = (CONST UINT8 *)Data;
+    UINTN Processors = 0;
+    UINTN Enabled = 0;
+    EFI_TPL Tpl;
+    STATIC BLAKE3_JOB Job;
+    UINT64 Start = bh_get_performance_counter();
+    UINTN Total = Length;
+
+    // Waiting on the APs needs TPL_APPLICATION; a stream callback or a
+    // timer runs above it and hashes on the BSP alone
+    Tpl = gBS->RaiseTPL(TPL_HIGH_LEVEL);
+    gBS->RestoreTPL(Tpl);
+
+    if (Length >= 2 * BLAKE3_SUBTREE_SIZE && Tpl == TPL_APPLICATION &&
+        !EFI_ERROR(gBS->LocateProtocol(&gEfiMpServiceProtocolGuid, NULL, (VOID **)&Mp)) &&
+        !EFI_ERROR(Mp->GetNumberOfProcessors(Mp, &Processors, &Enabled)) && Enabled > 1) {
+        // Pick the backend on the BSP before any AP calls into it
+        crypto_blake3_backend_name();
+
+        // Up to the next subtree boundary on the BSP
+        UINT64 Position = crypto_blake3_position(Ctx);
+        UINTN Head = (UINTN)((BLAKE3_SUBTREE_SIZE - Position % BLAKE3_SUBTREE_SIZE) % BLAKE3_SUBTREE_SIZE);
+        crypto_blake3_update(Ctx, Bytes, (uint32_t)Head);
+        Bytes += Head;
+        Length -= Head;
+
+        // Whole subtrees in parallel, always keeping input back for final
+        while (Length > BLAKE3_SUBTREE_SIZE) {
+            EFI_EVENT Done = NULL;
+            UINTN Count = (Length - 1) / BLAKE3_SUBTREE_SIZE;
+            if (Count > BLAKE3_BATCH_SUBTREES) {
+                Count = BLAKE3_BATCH_SUBTREES;
+            }
+
+            Job.Data = Bytes;
+            Job.FirstChunk = crypto_blake3_position(Ctx) / CRYPTO_BLAKE3_CHUNK_LENGTH;
+            Job.Count = (UINT32)Count;
+            Job.Next = 0;
+            if (!EFI_ERROR(gBS->CreateEvent(0, 0, NULL, NULL, &Done)) &&
+                EFI_ERROR(Mp->StartupAllAPs(Mp, Blake3Worker, FALSE, Done, 0, &Job, NULL))) {
+                gBS->CloseEvent(Done);
+                Done = NULL;
+            }
+            Blake3Worker(&Job);
+            if (Done != NULL) {
+                UINTN Index;
+                gBS->WaitForEvent(1, &Done, &Index);
+                gBS->CloseEvent(Done);
+            }
+
+            for (UINTN i = 0; i < Count; i++) {
+                crypto_blake3_append_subtree(Ctx, Job.Cvs[i], BLAKE3_SUBTREE_SIZE);
+            }
+            Bytes += Count * BLAKE3_SUBTREE_SIZE;
+            Length -= Count * BLAKE3_SUBTREE_SIZE;
+        }
+    }
+
+    crypto_blake3_update(Ctx, Bytes, (uint32_t)Length);
+    bh_counters_add_hash(Total, bh_get_performance_counter() - Start);
+}
+
+EFI_STATUS EFIAPI LoadImageManifest(
+    IN  CONST CHAR16        *FileName,
+    IN  UINT8               Algorithm,
+    IN  CONST UINT8         *PublicKey,
+    IN  UINTN               PublicKeySize,
+    OUT merkle_manifest_t   *Manifest,
+    OUT LOADED_FILE         *ManifestFile
+) {
+    EFI_STATUS Status;
+    CHAR16 Name[256];
+
+    if (!FileName || !PublicKey || !Manifest || !ManifestFile) {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    UnicodeSPrint(Name, sizeof(Name), L"%s.manifest", FileName);
+    Status = LoadBootFile(Name, FILE_LOAD_POOL, NULL, NULL, ManifestFile);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    // dbx can name the signed root of a manifest in place of an image hash
+    SignatureDatabasesLoad();
+    if (merkle_manifest_verify((CONST uint8_t *)ManifestFile->Buffer, (uint32_t)ManifestFile->Size,
+                               Algorithm, PublicKey, (uint32_t)PublicKeySize,
+                               Manifest) != CRYPTO_SUCCESS ||
+        mSigDbxBroken || sigdb_has_key(&mSigDbx, Algorithm, PublicKey, (uint32_t)PublicKeySize) ||
+        sigdb_has_digest(&mSigDbx, Manifest->root)) {
+        FreeLoadedFile(ManifestFile);
+        return EFI_SECURITY_VIOLATION;
+    }
+    return EFI_SUCCESS;
+}
+
+EFI_STATUS EFIAPI LoadVerifiedChunks(
+    IN  CONST CHAR16            *FileName,
+    IN  CONST merkle_manifest_t *Manifest,
+    IN  UINT32                  FirstChunk,
+    IN  UINT32                  ChunkCount,
+    IN  UINT32                  Flags,
+    OUT LOADED_FILE             *File
+) {
+    EFI_STATUS Status;
+    UINT64 Offset, End;
+
+    if (!FileName || !Manifest || !File || ChunkCount == 0 ||
+        FirstChunk >= Manifest->chunk_count || ChunkCount > Manifest->chunk_count - FirstChunk) {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    Offset = merkle_chunk_offset(Manifest, FirstChunk);
+    End = merkle_chunk_offset(Manifest, FirstChunk + ChunkCount - 1) +
+          merkle_chunk_length(Manifest, FirstChunk + ChunkCount - 1);
+    if (End - Offset > MAX_UINTN) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    Status = LoadBootFileRange(FileName, Offset, (UINTN)(End - Offset), Flags, NULL, NULL, File);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    // A short file fails here too: the last chunk's length will not match
+    if (File->Size != (UINTN)(End - Offset)) {
+        FreeLoadedFile(File);
+        return EFI_SECURITY_VIOLATION;
+    }
+
+    Status = VerifyImageChunks(Manifest, File->Buffer, FirstChunk, ChunkCount);
+    if (EFI_ERROR(Status)) {
+        FreeLoadedFile(File);
+    }
+    return Status;
+}
+
+// Check each manifest chunk as LoadBootFile hands it over
+STATIC EFI_STATUS ManifestStreamChunk(VOID *Context, CONST VOID *Data, UINTN Length) {
+    if (merkle_stream_update((merkle_stream_t *)Context, (CONST uint8_t *)Data,
+                             (uint32_t)Length) != CRYPTO_SUCCESS) {
+        return EFI_SECURITY_VIOLATION;
+    }
+    return EFI_SUCCESS;
+}
+
+/**
+  Loads a kernel image, checking it while it is read when Secure Boot is on.
+
+  With a signed FileName.manifest next to the image, every chunk is checked
+  against its leaf as soon as it lands and the load stops at the first bad
+  one. Without a manifest the whole image is read and its appended
+  signature checked at the end.
+**/
 EFI_STATUS EFIAPI LoadAndVerifyKernel(
     IN  CHAR16  *FileName,
     OUT VOID    **ImageBuffer,
@@ -79,36 +531,427 @@ EFI_STATUS EFIAPI LoadAndVerifyKernel(
     }
     
     EFI_STATUS Status;
-    VOID *Buffer = NULL;
-    UINTN Size = 0;
+    LOADED_FILE Image;
     
-    Status = ReadFile(FileName, &Buffer, &Size);
-    if (EFI_ERROR(Status)) return Status;
+    if (!IsSecureBootEnabled()) {
+        return ReadFile(FileName, ImageBuffer, ImageSize);
+    }
     
-    if (IsSecureBootEnabled()) {
-        // Load public key from a secure variable
-        UINT8 PublicKey[512]; // Support up to RSA-4096
-        UINTN PublicKeySize = sizeof(PublicKey);
-        Status = gRT->GetVariable(L"PK", &gEfiGlobalVariableGuid, NULL, &PublicKeySize, PublicKey);
-        if (EFI_ERROR(Status)) {
-            FreePool(Buffer);
-            return Status;
+    // Load public key from a secure variable
+    UINT8 PublicKey[4 + 2 * CRYPTO_RSA4096_KEY_LENGTH]; // Support up to RSA-4096
+    UINTN PublicKeySize = sizeof(PublicKey);
+    Status = gRT->GetVariable(L"PK", &gEfiGlobalVariableGuid, NULL, &PublicKeySize, PublicKey);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    
+    merkle_manifest_t Manifest;
+    LOADED_FILE ManifestFile;
+    Status = LoadImageManifest(FileName, SECURE_BOOT_SIG_RSA_PKCS1_SHA256, PublicKey, PublicKeySize,
+                               &Manifest, &ManifestFile);
+    if (!EFI_ERROR(Status)) {
+        merkle_stream_t Stream;
+        merkle_stream_init(&Stream, &Manifest);
+        Status = LoadBootFile(FileName, FILE_LOAD_POOL, ManifestStreamChunk, &Stream, &Image);
+        if (merkle_stream_final(&Stream) != CRYPTO_SUCCESS && !EFI_ERROR(Status)) {
+            FreeLoadedFile(&Image);
+            Status = EFI_SECURITY_VIOLATION;
         }
-        
-        Status = VerifyImageSignature(Buffer, Size, PublicKey, PublicKeySize);
+        FreeLoadedFile(&ManifestFile);
+    } else if (Status == EFI_NOT_FOUND) {
+        // No manifest: fall back to the appended signature
+        Status = LoadBootFile(FileName, FILE_LOAD_POOL, NULL, NULL, &Image);
+        if (!EFI_ERROR(Status)) {
+            Status = VerifyImageSignature(Image.Buffer, Image.Size, PublicKey, PublicKeySize);
+            if (EFI_ERROR(Status)) {
+                FreeLoadedFile(&Image);
+            }
+        }
+    }
+    
+    // Zero out public key after use
+    crypto_memzero_secure(PublicKey, sizeof(PublicKey));
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    
+    *ImageBuffer = Image.Buffer;
+    *ImageSize = Image.Size;
+    return EFI_SUCCESS;
+}
+
+/**
+  Derives the cache MAC key: HMAC-SHA256 under a random secret kept in a
+  boot-services-only variable, over the SHA-256 values of PCR 0 (firmware),
+  4 (boot manager, i.e. this loader) and 7 (Secure Boot policy) when a TPM
+  is present. Updating the firmware, the loader or the key databases thus
+  changes the key and silently drops every cached verification.
+**/
+STATIC EFI_STATUS ImageCacheDeriveKey(VOID) {
+    EFI_STATUS Status;
+    UINT8 Secret[CRYPTO_SHA256_DIGEST_LENGTH];
+    STATIC CONST CHAR8 Label[] = "BloodHorn image cache";
+    UINT8 Material[sizeof(Label) + 3 * CRYPTO_SHA256_DIGEST_LENGTH];
+    UINTN MaterialSize = 0;
+    UINTN Size = sizeof(Secret);
+    UINT32 Attributes = 0;
+
+    Status = gRT->GetVariable(IMAGE_CACHE_KEY_VARIABLE, &gBloodHornVariableGuid, &Attributes, &Size, Secret);
+    if (EFI_ERROR(Status) || Size != sizeof(Secret) || Attributes != IMAGE_CACHE_ATTRIBUTES) {
+        TPM2B_DIGEST Random;
+
+        // First boot, or a variable someone else created: start over
+        gRT->SetVariable(IMAGE_CACHE_KEY_VARIABLE, &gBloodHornVariableGuid, 0, 0, NULL);
+        ZeroMem(&Random, sizeof(Random));
+        if (!EFI_ERROR(Tpm2GetRandom(sizeof(Secret), &Random)) && Random.size == sizeof(Secret)) {
+            CopyMem(Secret, Random.buffer, sizeof(Secret));
+        } else if (crypto_random_bytes(Secret, sizeof(Secret)) != CRYPTO_SUCCESS) {
+            return EFI_NOT_READY;
+        }
+        crypto_memzero_secure(&Random, sizeof(Random));
+
+        Status = gRT->SetVariable(IMAGE_CACHE_KEY_VARIABLE, &gBloodHornVariableGuid, IMAGE_CACHE_ATTRIBUTES,
+                                  sizeof(Secret), Secret);
         if (EFI_ERROR(Status)) {
-            FreePool(Buffer);
-            // Zero out sensitive data
-            crypto_zeroize(PublicKey, sizeof(PublicKey));
+            crypto_memzero_secure(Secret, sizeof(Secret));
             return Status;
         }
-        
-        // Zero out public key after use
-        crypto_zeroize(PublicKey, sizeof(PublicKey));
     }
-    
-    *ImageBuffer = Buffer;
-    *ImageSize = Size;
+
+    CopyMem(Material, Label, sizeof(Label));
+    MaterialSize = sizeof(Label);
+
+    TPML_PCR_SELECTION Selection;
+    TPML_PCR_SELECTION Selected;
+    TPML_DIGEST Pcrs;
+    UINT32 UpdateCounter;
+    ZeroMem(&Selection, sizeof(Selection));
+    Selection.count = 1;
+    Selection.pcrSelections[0].hash = TPM_ALG_SHA256;
+    Selection.pcrSelections[0].sizeofSelect = PCR_SELECT_MIN;
+    Selection.pcrSelections[0].pcrSelect[0] = (1 << 0) | (1 << 4) | (1 << 7);
+    if (!EFI_ERROR(Tpm2PcrRead(&Selection, &UpdateCounter, &Selected, &Pcrs))) {
+        for (UINT32 i = 0; i < Pcrs.count && i < 3; i++) {
+            if (Pcrs.digests[i].size == CRYPTO_SHA256_DIGEST_LENGTH) {
+                CopyMem(Material + MaterialSize, Pcrs.digests[i].buffer, CRYPTO_SHA256_DIGEST_LENGTH);
+                MaterialSize += CRYPTO_SHA256_DIGEST_LENGTH;
+            }
+        }
+    }
+
+    crypto_hmac_sha256(Secret, sizeof(Secret), Material, (uint32_t)MaterialSize, mImageCacheKey);
+    crypto_memzero_secure(Secret, sizeof(Secret));
+    return EFI_SUCCESS;
+}
+
+// Derive the key once per boot
+STATIC BOOLEAN ImageCacheKeyLoad(VOID) {
+    if (!mImageCacheKeyReady) {
+        mImageCacheKeyReady = !EFI_ERROR(ImageCacheDeriveKey());
+    }
+    return mImageCacheKeyReady;
+}
+
+// Load the cache once per boot; an unreadable or forged one starts empty
+STATIC BOOLEAN ImageCacheLoad(VOID) {
+    if (mImageCacheReady) {
+        return TRUE;
+    }
+    if (!ImageCacheKeyLoad()) {
+        return FALSE;
+    }
+
+    UINTN Size = sizeof(mImageCache);
+    EFI_STATUS Status = gRT->GetVariable(IMAGE_CACHE_VARIABLE, &gBloodHornVariableGuid, NULL, &Size, &mImageCache);
+    if (EFI_ERROR(Status) || Size != sizeof(mImageCache)) {
+        image_cache_init(&mImageCache);
+    } else {
+        image_cache_open(&mImageCache, mImageCacheKey, sizeof(mImageCacheKey));
+    }
+    mImageCacheReady = TRUE;
+    return TRUE;
+}
+
+// Partition GUID of the boot volume (MBR: disk signature and partition number)
+STATIC VOID ImageCacheVolumeId(OUT UINT8 *Id) {
+    EFI_LOADED_IMAGE_PROTOCOL *LoadedImage = NULL;
+
+    ZeroMem(Id, 16);
+    if (EFI_ERROR(gBS->HandleProtocol(gImageHandle, &gEfiLoadedImageProtocolGuid, (VOID **)&LoadedImage))) {
+        return;
+    }
+    for (EFI_DEVICE_PATH_PROTOCOL *Node = DevicePathFromHandle(LoadedImage->DeviceHandle);
+         Node != NULL && !IsDevicePathEnd(Node);
+         Node = NextDevicePathNode(Node)) {
+        if (DevicePathType(Node) == MEDIA_DEVICE_PATH && DevicePathSubType(Node) == MEDIA_HARDDRIVE_DP) {
+            HARDDRIVE_DEVICE_PATH *Hd = (HARDDRIVE_DEVICE_PATH *)Node;
+            if (Hd->SignatureType == SIGNATURE_TYPE_GUID) {
+                CopyMem(Id, Hd->Signature, 16);
+            } else {
+                CopyMem(Id, Hd->Signature, 4);
+                CopyMem(Id + 4, &Hd->PartitionNumber, sizeof(Hd->PartitionNumber));
+            }
+            return;
+        }
+    }
+}
+
+BOOLEAN EFIAPI ImageCacheBegin(
+    IN  CONST CHAR16        *FileName,
+    IN  CONST UINT8         *ExpectedDigest OPTIONAL,
+    OUT IMAGE_CACHE_LOOKUP  *Lookup
+) {
+    EFI_TIME Time;
+    UINT64 Size;
+
+    if (!Lookup) {
+        return FALSE;
+    }
+    ZeroMem(&Lookup->Key, sizeof(Lookup->Key));
+    image_cache_edges_init(&Lookup->Edges);
+    Lookup->Record = NULL;
+    Lookup->Usable = FALSE;
+
+    if (!FileName || StrLen(FileName) >= IMAGE_CACHE_PATH_LEN ||
+        EFI_ERROR(GetBootFileInfo(FileName, &Size, &Time)) || !ImageCacheLoad()) {
+        return FALSE;
+    }
+
+    ImageCacheVolumeId(Lookup->Key.volume_guid);
+    CopyMem(Lookup->Key.path, FileName, StrSize(FileName));
+    Lookup->Key.size = Size;
+    Lookup->Key.mtime = LShiftU64(Time.Year, 40) | LShiftU64(Time.Month, 32) | LShiftU64(Time.Day, 24) |
+                        LShiftU64(Time.Hour, 16) | LShiftU64(Time.Minute, 8) | Time.Second;
+    Lookup->Key.mtime_ns = Time.Nanosecond;
+    Lookup->Usable = TRUE;
+
+    Lookup->Record = image_cache_find(&mImageCache, &Lookup->Key, ExpectedDigest);
+    return Lookup->Record != NULL;
+}
+
+EFI_STATUS EFIAPI ImageCacheChunk(
+    IN VOID         *Context,
+    IN CONST VOID   *Data,
+    IN UINTN        Length
+) {
+    IMAGE_CACHE_LOOKUP *Lookup = (IMAGE_CACHE_LOOKUP *)Context;
+
+    if (Lookup->Usable) {
+        image_cache_edges_update(&Lookup->Edges, (CONST uint8_t *)Data, (uint32_t)Length);
+    }
+    return EFI_SUCCESS;
+}
+
+BOOLEAN EFIAPI ImageCacheConfirm(
+    IN OUT IMAGE_CACHE_LOOKUP  *Lookup
+) {
+    if (!Lookup || !Lookup->Usable) {
+        return FALSE;
+    }
+    image_cache_edges_final(&Lookup->Edges, Lookup->Key.edge_hash);
+    return Lookup->Edges.total == Lookup->Key.size && image_cache_match(Lookup->Record, &Lookup->Key);
+}
+
+VOID EFIAPI ImageCacheRecord(
+    IN OUT IMAGE_CACHE_LOOKUP  *Lookup,
+    IN     CONST UINT8         *Digest
+) {
+    if (!Lookup || !Lookup->Usable || !Digest || Lookup->Edges.total != Lookup->Key.size) {
+        return;
+    }
+
+    image_cache_edges_final(&Lookup->Edges, Lookup->Key.edge_hash);
+    image_cache_store(&mImageCache, &Lookup->Key, Digest);
+    image_cache_seal(&mImageCache, mImageCacheKey, sizeof(mImageCacheKey));
+    gRT->SetVariable(IMAGE_CACHE_VARIABLE, &gBloodHornVariableGuid, IMAGE_CACHE_ATTRIBUTES,
+                     sizeof(mImageCache), &mImageCache);
+}
+
+// Load the resident table once per boot; a stale or forged one starts empty
+STATIC BOOLEAN ResidentImagesLoad(VOID) {
+    UINT8 Mac[CRYPTO_SHA256_DIGEST_LENGTH];
+
+    if (mResidentImagesReady) {
+        return TRUE;
+    }
+    if (!ImageCacheLoad()) {
+        return FALSE;
+    }
+
+    UINTN Size = sizeof(mResidentImages);
+    EFI_STATUS Status = gRT->GetVariable(RESIDENT_IMAGE_VARIABLE, &gBloodHornVariableGuid, NULL, &Size,
+                                         &mResidentImages);
+    if (!EFI_ERROR(Status) && Size == sizeof(mResidentImages)) {
+        crypto_hmac_sha256(mImageCacheKey, sizeof(mImageCacheKey), (CONST uint8_t *)&mResidentImages,
+                           OFFSET_OF(RESIDENT_IMAGE_TABLE, Mac), Mac);
+    }
+    if (EFI_ERROR(Status) || Size != sizeof(mResidentImages) ||
+        mResidentImages.Version != RESIDENT_IMAGE_VERSION || mResidentImages.Count > RESIDENT_IMAGE_MAX ||
+        crypto_memcmp_constant_time(Mac, mResidentImages.Mac, sizeof(Mac)) != 0) {
+        ZeroMem(&mResidentImages, sizeof(mResidentImages));
+        mResidentImages.Version = RESIDENT_IMAGE_VERSION;
+    }
+    mResidentImagesReady = TRUE;
+    return TRUE;
+}
+
+STATIC INTN ResidentImageFind(IN CONST UINT8 *Digest) {
+    for (UINT32 i = 0; i < mResidentImages.Count; i++) {
+        if (CompareMem(mResidentImages.Digests[i], Digest, CRYPTO_SHA256_DIGEST_LENGTH) == 0) {
+            return (INTN)i;
+        }
+    }
+    return -1;
+}
+
+BOOLEAN EFIAPI ResidentImageKnown(
+    IN CONST UINT8  *Digest
+) {
+    return Digest != NULL && ResidentImagesLoad() && ResidentImageFind(Digest) >= 0;
+}
+
+VOID EFIAPI ResidentImageRecord(
+    IN CONST UINT8  *Digests,
+    IN UINTN        Count
+) {
+    BOOLEAN Changed = FALSE;
+
+    if (!Digests || !ResidentImagesLoad()) {
+        return;
+    }
+
+    for (UINTN i = 0; i < Count; i++) {
+        CONST UINT8 *Digest = Digests + i * CRYPTO_SHA256_DIGEST_LENGTH;
+        INTN Found = ResidentImageFind(Digest);
+        UINT32 Shift;
+        if (Found == 0) {
+            continue;
+        }
+        // Move to the front, dropping the oldest when full
+        Shift = Found > 0 ? (UINT32)Found : MIN(mResidentImages.Count, RESIDENT_IMAGE_MAX - 1);
+        CopyMem(mResidentImages.Digests[1], mResidentImages.Digests[0], Shift * CRYPTO_SHA256_DIGEST_LENGTH);
+        CopyMem(mResidentImages.Digests[0], Digest, CRYPTO_SHA256_DIGEST_LENGTH);
+        if (Found < 0) {
+            mResidentImages.Count = Shift + 1;
+        }
+        Changed = TRUE;
+    }
+
+    // Unchanged on every reboot of the same kernel; spare the flash then
+    if (Changed) {
+        crypto_hmac_sha256(mImageCacheKey, sizeof(mImageCacheKey), (CONST uint8_t *)&mResidentImages,
+                           OFFSET_OF(RESIDENT_IMAGE_TABLE, Mac), mResidentImages.Mac);
+        gRT->SetVariable(RESIDENT_IMAGE_VARIABLE, &gBloodHornVariableGuid, IMAGE_CACHE_ATTRIBUTES,
+                         sizeof(mResidentImages), &mResidentImages);
+    }
+}
+
+// Hours since 0000-03-01 in the proleptic Gregorian calendar; only
+// differences matter, and the time zone is ignored
+STATIC UINT64 EfiTimeHours(IN CONST EFI_TIME *Time) {
+    UINT32 Year = Time->Year - (Time->Month <= 2 ? 1 : 0);
+    UINT32 Month = Time->Month > 2 ? Time->Month - 3 : Time->Month + 9;
+    UINT32 Era = Year / 400;
+    UINT32 YearOfEra = Year - Era * 400;
+    UINT32 DayOfEra = YearOfEra * 365 + YearOfEra / 4 - YearOfEra / 100 + (153 * Month + 2) / 5 + Time->Day - 1;
+    return ((UINT64)Era * 146097 + DayOfEra) * 24 + Time->Hour;
+}
+
+STATIC EFI_STATUS SelfTestHashChunk(
+    IN VOID         *Context,
+    IN CONST VOID   *Data,
+    IN UINTN        Length
+) {
+    crypto_sha256_update((crypto_sha256_ctx_t *)Context, (CONST uint8_t *)Data, (uint32_t)Length);
+    return EFI_SUCCESS;
+}
+
+// SHA-256 of this loader's file as stored. The image in memory will not
+// do: relocation makes it differ with the load address.
+STATIC EFI_STATUS LoaderFileDigest(OUT UINT8 *Digest) {
+    EFI_LOADED_IMAGE_PROTOCOL *LoadedImage = NULL;
+    CONST CHAR16 *Path = NULL;
+    crypto_sha256_ctx_t Ctx;
+    FILE_STREAM *Stream = NULL;
+    EFI_STATUS Status;
+
+    Status = gBS->HandleProtocol(gImageHandle, &gEfiLoadedImageProtocolGuid, (VOID **)&LoadedImage);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    // A single file path node; a loader started from memory has none
+    for (EFI_DEVICE_PATH_PROTOCOL *Node = LoadedImage->FilePath;
+         Node != NULL && !IsDevicePathEnd(Node);
+         Node = NextDevicePathNode(Node)) {
+        if (DevicePathType(Node) != MEDIA_DEVICE_PATH || DevicePathSubType(Node) != MEDIA_FILEPATH_DP || Path) {
+            return EFI_UNSUPPORTED;
+        }
+        Path = ((FILEPATH_DEVICE_PATH *)Node)->PathName;
+    }
+    if (!Path) {
+        return EFI_UNSUPPORTED;
+    }
+
+    crypto_sha256_init(&Ctx);
+    Status = StartFileStream(LoadedImage->DeviceHandle, Path, SelfTestHashChunk, &Ctx, &Stream);
+    if (!EFI_ERROR(Status)) {
+        Status = FinishFileStream(Stream, TRUE);
+    }
+    crypto_sha256_final(&Ctx, Digest);
+    return Status;
+}
+
+EFI_STATUS EFIAPI RunCryptoSelfTests(
+    IN SELF_TEST_POLICY Policy,
+    IN UINT32           IntervalHours
+) {
+    SELF_TEST_RECORD Record;
+    SELF_TEST_RECORD Stored;
+    UINT8 Mac[CRYPTO_SHA256_DIGEST_LENGTH];
+    EFI_TIME Now;
+    BOOLEAN Keyed;
+
+    if (Policy == SelfTestOff) {
+        return EFI_SUCCESS;
+    }
+
+    ZeroMem(&Record, sizeof(Record));
+    Record.Version = SELF_TEST_VERSION;
+    Record.Features = (UINT32)crypto_detect_hardware_support();
+    if (!EFI_ERROR(gRT->GetTime(&Now, NULL)) && Now.Month >= 1 && Now.Month <= 12) {
+        Record.TestedAt = EfiTimeHours(&Now);
+    }
+
+    // Without a key or a digest of the loader nothing is remembered
+    Keyed = Policy == SelfTestCached && ImageCacheKeyLoad() && !EFI_ERROR(LoaderFileDigest(Record.Binary));
+    if (Keyed) {
+        UINTN Size = sizeof(Stored);
+        EFI_STATUS Status = gRT->GetVariable(SELF_TEST_VARIABLE, &gBloodHornVariableGuid, NULL, &Size, &Stored);
+        if (!EFI_ERROR(Status) && Size == sizeof(Stored)) {
+            crypto_hmac_sha256(mImageCacheKey, sizeof(mImageCacheKey), (CONST uint8_t *)&Stored,
+                               OFFSET_OF(SELF_TEST_RECORD, Mac), Mac);
+            // A clock that went back, or none, counts as overdue
+            if (crypto_memcmp_constant_time(Mac, Stored.Mac, sizeof(Mac)) == 0 &&
+                Stored.Version == Record.Version && Stored.Features == Record.Features &&
+                CompareMem(Stored.Binary, Record.Binary, sizeof(Record.Binary)) == 0 &&
+                (IntervalHours == 0 ||
+                 (Stored.TestedAt != 0 && Record.TestedAt >= Stored.TestedAt &&
+                  Record.TestedAt - Stored.TestedAt < IntervalHours))) {
+                return EFI_SUCCESS;
+            }
+        }
+    }
+
+    if (crypto_run_all_self_tests() != CRYPTO_SUCCESS) {
+        gRT->SetVariable(SELF_TEST_VARIABLE, &gBloodHornVariableGuid, 0, 0, NULL);
+        return EFI_SECURITY_VIOLATION;
+    }
+    if (Keyed) {
+        crypto_hmac_sha256(mImageCacheKey, sizeof(mImageCacheKey), (CONST uint8_t *)&Record,
+                           OFFSET_OF(SELF_TEST_RECORD, Mac), Record.Mac);
+        gRT->SetVariable(SELF_TEST_VARIABLE, &gBloodHornVariableGuid, IMAGE_CACHE_ATTRIBUTES,
+                         sizeof(Record), &Record);
+    }
     return EFI_SUCCESS;
 }
 
@@ -5,14 +5,19 @@
  * See the root of the repository for license details.
  */
 
-#ifndef BLOODHORN_SECURE_BOOT_H
-#define BLOODHORN_SECURE_BOOT_H
+#ifndef BLOODHORN_BOOT_SECURE_H
+#define BLOODHORN_BOOT_SECURE_H
 
 #include <Base.h>
 #include <Uefi.h>
 #include "compat.h"
+#include "../security/merkle.h"
+#include "../security/image_cache.h"
+#include "../uefi/uefi.h"
 
-// Function to verify an image signature
+// Function to verify an image signature. Images, keys and manifest roots
+// listed in dbx are refused; with a NULL PublicKey the image must be listed
+// in db by SHA-256 or be signed under one of db's certificates.
 EFI_STATUS EFIAPI
 VerifyImageSignature(
     IN CONST VOID    *ImageBuffer,
@@ -20,6 +25,31 @@ VerifyImageSignature(
     IN CONST UINT8   *PublicKey,
     IN UINTN         PublicKeySize
 );
+
+// Same, for a signature scheme chosen per boot entry
+// (SECURE_BOOT_SIG_* from security/secure_boot.h)
+EFI_STATUS EFIAPI
+VerifyImageSignatureEx(
+    IN CONST VOID    *ImageBuffer,
+    IN UINTN         ImageSize,
+    IN UINT8         Algorithm,
+    IN CONST UINT8   *PublicKey,
+    IN UINTN         PublicKeySize
+);
+
+// TRUE when dbx lists image hashes, so hashing an image for
+// ImageDigestRevoked is worth a pass over it (also TRUE for a dbx that
+// could not be parsed)
+BOOLEAN EFIAPI
+ImageRevocationsListed(VOID);
+
+// TRUE if dbx lists this SHA-256: the Authenticode hash of a PE image
+// (security/authenticode.h), else the hash of the signed bytes
+BOOLEAN EFIAPI
+ImageDigestRevoked(
+    IN CONST UINT8  *Digest
+);
+
 // Function to check if Secure Boot is enabled
 BOOLEAN EFIAPI
 IsSecureBootEnabled(VOID);
@@ -32,6 +62,130 @@ LoadAndVerifyKernel(
     OUT UINTN   *ImageSize
 );
 
+// Read and check FileName.manifest, the detached chunk manifest of an image
+// (format in security/merkle.h). Manifest points into ManifestFile, which
+// the caller releases with FreeLoadedFile once done with both.
+EFI_STATUS EFIAPI
+LoadImageManifest(
+    IN  CONST CHAR16        *FileName,
+    IN  UINT8               Algorithm,
+    IN  CONST UINT8         *PublicKey,
+    IN  UINTN               PublicKeySize,
+    OUT merkle_manifest_t   *Manifest,
+    OUT LOADED_FILE         *ManifestFile
+);
+
+// Check ChunkCount resident chunks starting at FirstChunk (Data holds the
+// first of them), spread over the application processors when MP services
+// are available
+EFI_STATUS EFIAPI
+VerifyImageChunks(
+    IN CONST merkle_manifest_t  *Manifest,
+    IN CONST VOID               *Data,
+    IN UINT32                   FirstChunk,
+    IN UINT32                   ChunkCount
+);
+
+// crypto_blake3_update, with the whole 64 KiB subtrees of a large buffer
+// hashed on the application processors too when MP services are there
+// and the caller runs at TPL_APPLICATION
+VOID EFIAPI
+Blake3UpdateParallel(
+    IN OUT crypto_blake3_ctx_t  *Ctx,
+    IN CONST VOID               *Data,
+    IN UINTN                    Length
+);
+
+// Read and check only the given chunks of a large image (e.g. the parts of
+// an initramfs that are needed), leaving the rest on disk
+EFI_STATUS EFIAPI
+LoadVerifiedChunks(
+    IN  CONST CHAR16            *FileName,
+    IN  CONST merkle_manifest_t *Manifest,
+    IN  UINT32                  FirstChunk,
+    IN  UINT32                  ChunkCount,
+    IN  UINT32                  Flags,
+    OUT LOADED_FILE             *File
+);
+
+// Warm-boot shortcut for images pinned to a known SHA-512: an earlier boot
+// that hashed the same file (security/image_cache.h) lets this one skip it
+typedef struct {
+    image_cache_key_t           Key;        // Identity of the file being loaded
+    image_cache_edges_t         Edges;      // Its first and last bytes, as stored
+    CONST image_cache_record_t  *Record;    // Matching record from an earlier boot
+    BOOLEAN                     Usable;     // The file can be cached at all
+} IMAGE_CACHE_LOOKUP;
+
+// Look FileName up before loading it. TRUE when an earlier boot verified
+// the same volume, path, size and time against ExpectedDigest; the edges
+// still have to pass ImageCacheConfirm once the file is in. With a NULL
+// ExpectedDigest any record for the file matches, and the caller judges
+// Lookup->Record->digest itself (e.g. against an allowlist).
+BOOLEAN EFIAPI
+ImageCacheBegin(
+    IN  CONST CHAR16        *FileName,
+    IN  CONST UINT8         *ExpectedDigest OPTIONAL,
+    OUT IMAGE_CACHE_LOOKUP  *Lookup
+);
+
+// FILE_LOAD_CHUNK_CALLBACK collecting the edges; Context is the lookup
+EFI_STATUS EFIAPI
+ImageCacheChunk(
+    IN VOID         *Context,
+    IN CONST VOID   *Data,
+    IN UINTN        Length
+);
+
+// After the load: TRUE if the file still matches the record
+BOOLEAN EFIAPI
+ImageCacheConfirm(
+    IN OUT IMAGE_CACHE_LOOKUP  *Lookup
+);
+
+// After a full hash check passed: remember the file and persist the cache
+VOID EFIAPI
+ImageCacheRecord(
+    IN OUT IMAGE_CACHE_LOOKUP  *Lookup,
+    IN     CONST UINT8         *Digest
+);
+
+// Images handed over in memory (by SHA-256 of their bytes as resident),
+// remembered for the warm-reboot fast path under the image cache's key, so
+// the table is dropped along with it by firmware, loader or key updates.
+// Digests holds Count digests back to back.
+VOID EFIAPI
+ResidentImageRecord(
+    IN CONST UINT8  *Digests,
+    IN UINTN        Count
+);
+
+// TRUE if an image with this SHA-256 was handed over by an earlier boot
+BOOLEAN EFIAPI
+ResidentImageKnown(
+    IN CONST UINT8  *Digest
+);
+
+// How RunCryptoSelfTests treats the known-answer tests of security/crypto
+typedef enum {
+    SelfTestOff,        // Not run
+    SelfTestCached,     // Run when the loader build or CPU features change
+    SelfTestAlways      // Run on every boot, nothing remembered
+} SELF_TEST_POLICY;
+
+// Run crypto_run_all_self_tests as Policy says. Under SelfTestCached a
+// pass is kept in a boot-services-only NV variable keyed by the SHA-256 of
+// the loader file and crypto_detect_hardware_support(), sealed like the
+// image cache (so firmware, loader and key database updates drop it), and
+// later boots with the same key skip the tests. A nonzero IntervalHours
+// also runs them once the last run is that many hours old by the RTC.
+// EFI_SECURITY_VIOLATION if a test fails.
+EFI_STATUS EFIAPI
+RunCryptoSelfTests(
+    IN SELF_TEST_POLICY Policy,
+    IN UINT32           IntervalHours
+);
+
 // Function to execute a loaded kernel
 EFI_STATUS EFIAPI
 ExecuteKernel(
@@ -39,4 +193,4 @@ ExecuteKernel(
     IN UINTN    ImageSize,
     IN CHAR16   *CmdLine OPTIONAL
 ); // 
-#endif // _SECURE_BOOT_H_
+#endif // BLOODHORN_BOOT_SECURE_H
@@ -16,7 +16,8 @@ static struct BootMenuTheme current_theme = {
     .text_color = 0xCCCCCC,
     .selected_text_color = 0xFFFFFF,
     .footer_color = 0x8888AA,
-    .background_image = NULL
+    .background_image = NULL,
+    .glyph_cache_size = 256
 };
 
 void SetBootMenuTheme(const struct BootMenuTheme* theme) {
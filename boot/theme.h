@@ -18,7 +18,8 @@ struct BootMenuTheme {
     uint32_t text_color;
     uint32_t selected_text_color;
     uint32_t footer_color;
-    void* background_image;
+    void* background_image;     // GRAPHICS_IMAGE (uefi/graphics.h), or NULL
+    uint32_t glyph_cache_size;  // Rasterized TTF/OTF glyphs to keep, 0 = default
 };
 
 void SetBootMenuTheme(const struct BootMenuTheme* theme);
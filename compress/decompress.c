@@ -0,0 +1,467 @@
+/*
+ * decompress.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include "decompress.h"
+#include "compat.h"
+#include <string.h>
+#include <stdlib.h>
+
+int decomp_open(decomp_stream_t *s, decomp_read_fn read, void *context) {
+    memset(s, 0, sizeof(*s));
+    s->read = read;
+    s->read_context = context;
+    s->in = (uint8_t *)malloc(DECOMP_INPUT_SIZE);
+    if (!s->in) {
+        return DECOMP_ERR_NO_MEMORY;
+    }
+
+    int n = decomp_refill(s);
+    return n < 0 ? n : DECOMP_OK;
+}
+
+void decomp_close(decomp_stream_t *s) {
+    if (!s->in_borrowed) {
+        free(s->in);
+    }
+    s->in = NULL;
+    s->in_pos = s->in_len = 0;
+}
+
+// Replace the (fully consumed) input buffer with the next piece of input.
+// Returns the number of bytes now buffered, 0 at end of input.
+int decomp_refill(decomp_stream_t *s) {
+    if (s->in_error) {
+        return s->in_error;
+    }
+    if (s->in_eof) {
+        return 0;
+    }
+
+    int n = s->read(s->read_context, s->in, DECOMP_INPUT_SIZE);
+    if (n < 0) {
+        s->in_error = DECOMP_ERR_IO;
+        return s->in_error;
+    }
+    if (n == 0) {
+        s->in_eof = true;
+    }
+    s->in_pos = 0;
+    s->in_len = (uint32_t)n;
+    return n;
+}
+
+int decomp_read_exact(decomp_stream_t *s, void *dst, size_t len) {
+    uint8_t *out = (uint8_t *)dst;
+
+    while (len > 0) {
+        if (s->in_pos == s->in_len && decomp_refill(s) <= 0) {
+            return s->in_error ? s->in_error : DECOMP_ERR_CORRUPT; // Truncated
+        }
+        uint32_t n = s->in_len - s->in_pos;
+        if (n > len) {
+            n = (uint32_t)len;
+        }
+        memcpy(out, s->in + s->in_pos, n);
+        s->in_pos += n;
+        out += n;
+        len -= n;
+    }
+    return DECOMP_OK;
+}
+
+int decomp_skip(decomp_stream_t *s, uint64_t len) {
+    while (len > 0) {
+        if (s->in_pos == s->in_len && decomp_refill(s) <= 0) {
+            return s->in_error ? s->in_error : DECOMP_ERR_CORRUPT;
+        }
+        uint32_t n = s->in_len - s->in_pos;
+        if (n > len) {
+            n = (uint32_t)len;
+        }
+        s->in_pos += n;
+        len -= n;
+    }
+    return DECOMP_OK;
+}
+
+bool decomp_input_done(decomp_stream_t *s) {
+    return s->in_pos == s->in_len && decomp_refill(s) <= 0;
+}
+
+// Workspace allocations are 16-byte aligned and never given back one by
+// one: a codec allocates its state once per run
+void *decomp_alloc(decomp_stream_t *s, size_t size) {
+    if (!s->work) {
+        return malloc(size);
+    }
+    size_t at = (s->work_used + 15) & ~(size_t)15;
+    if (at > s->work_size || size > s->work_size - at) {
+        return NULL;
+    }
+    s->work_used = at + size;
+    return s->work + at;
+}
+
+void decomp_free(decomp_stream_t *s, void *p) {
+    if (!s->work) {
+        free(p);
+    }
+}
+
+int decomp_reserve_slow(decomp_stream_t *s, size_t len) {
+    if (len > SIZE_MAX - s->out_len) {
+        return DECOMP_ERR_TOO_LARGE;
+    }
+    size_t need = s->out_len + len;
+    if (!s->grow) {
+        return DECOMP_ERR_TOO_LARGE;
+    }
+
+    // Double so a stream of unknown size regrows O(log n) times
+    size_t capacity = s->out_capacity > SIZE_MAX / 2 ? SIZE_MAX : s->out_capacity * 2;
+    if (capacity < need) {
+        capacity = need;
+    }
+    if (s->grow(s->grow_context, capacity, &s->out, &s->out_capacity) != 0 &&
+        (capacity == need || s->grow(s->grow_context, need, &s->out, &s->out_capacity) != 0)) {
+        return DECOMP_ERR_TOO_LARGE;
+    }
+    return s->out_capacity >= need ? DECOMP_OK : DECOMP_ERR_TOO_LARGE;
+}
+
+static uint32_t read_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t read_le64(const uint8_t *p) {
+    return (uint64_t)read_le32(p) | ((uint64_t)read_le32(p + 4) << 32);
+}
+
+decomp_format_t decomp_detect(const uint8_t *data, size_t len) {
+    if (len >= 3 && data[0] == 0x1F && data[1] == 0x8B && data[2] == 8) {
+        return DECOMP_GZIP;
+    }
+    if (len >= 4) {
+        uint32_t magic = read_le32(data);
+        if (magic == 0xFD2FB528) {
+            return DECOMP_ZSTD;
+        }
+        if (magic == 0x184D2204 || magic == 0x184C2102) {
+            return DECOMP_LZ4;
+        }
+    }
+    return DECOMP_NONE;
+}
+
+const char *decomp_format_name(decomp_format_t format) {
+    switch (format) {
+    case DECOMP_GZIP: return "gzip";
+    case DECOMP_LZ4:  return "lz4";
+    case DECOMP_ZSTD: return "zstd";
+    case DECOMP_ZLIB: return "zlib";
+    case DECOMP_LZ4_BLOCK: return "lz4 block";
+    default:          return "none";
+    }
+}
+
+uint64_t decomp_size_hint(const decomp_stream_t *s, decomp_format_t format) {
+    const uint8_t *p = s->in + s->in_pos;
+    uint32_t len = s->in_len - s->in_pos;
+
+    if (format == DECOMP_ZSTD && len >= 5) {
+        uint8_t fhd = p[4];
+        uint32_t fcs_flag = fhd >> 6;
+        bool single_segment = (fhd >> 5) & 1;
+        static const uint8_t did_sizes[4] = {0, 1, 2, 4};
+        uint32_t pos = 5 + (single_segment ? 0 : 1) + did_sizes[fhd & 3];
+
+        if (fcs_flag == 0 && !single_segment) {
+            return 0; // Not recorded
+        }
+        uint32_t fcs_size = fcs_flag == 0 ? 1 : (1u << fcs_flag);
+        if (pos + fcs_size > len) {
+            return 0;
+        }
+        switch (fcs_size) {
+        case 1: return p[pos];
+        case 2: return (uint64_t)(p[pos] | (p[pos + 1] << 8)) + 256;
+        case 4: return read_le32(p + pos);
+        default: return read_le64(p + pos);
+        }
+    }
+
+    if (format == DECOMP_LZ4 && len >= 14 && read_le32(p) == 0x184D2204 && (p[4] & 0x08)) {
+        return read_le64(p + 6); // Content size follows FLG and BD
+    }
+    return 0;
+}
+
+int decomp_run(decomp_stream_t *s, decomp_format_t format, uint8_t *out, size_t capacity,
+               decomp_grow_fn grow, void *grow_context) {
+    int status;
+
+    s->out = out;
+    s->out_capacity = out ? capacity : 0;
+    s->out_len = 0;
+    s->grow = grow;
+    s->grow_context = grow_context;
+
+    switch (format) {
+    case DECOMP_GZIP: status = gzip_decompress(s); break;
+    case DECOMP_LZ4:  status = lz4_decompress(s); break;
+    case DECOMP_ZSTD: status = zstd_decompress(s); break;
+    case DECOMP_ZLIB: status = zlib_decompress(s); break;
+    case DECOMP_LZ4_BLOCK: status = lz4_block_decompress(s); break;
+    default:          return DECOMP_ERR_UNSUPPORTED;
+    }
+
+    // A failing read surfaces inside the codecs as truncated input
+    if (status != DECOMP_OK && s->in_error) {
+        status = s->in_error;
+    }
+    return status;
+}
+
+typedef struct {
+    const uint8_t *data;
+    size_t remaining;
+} decomp_memory_t;
+
+static int decomp_memory_read(void *context, uint8_t *buf, uint32_t len) {
+    decomp_memory_t *m = (decomp_memory_t *)context;
+    if (len > m->remaining) {
+        len = (uint32_t)m->remaining;
+    }
+    memcpy(buf, m->data, len);
+    m->data += len;
+    m->remaining -= len;
+    return (int)len;
+}
+
+// Input that is all in memory is decoded where it lies: the stream's input
+// buffer is the caller's, and it ends there
+static void decomp_borrow(decomp_stream_t *s, const uint8_t *data, size_t size) {
+    memset(s, 0, sizeof(*s));
+    s->in = (uint8_t *)data;
+    s->in_len = (uint32_t)size;
+    s->in_eof = true;
+    s->in_borrowed = true;
+}
+
+int decomp_buffer(const uint8_t *data, size_t size, decomp_format_t format, uint8_t *out, size_t capacity,
+                  decomp_grow_fn grow, void *grow_context, size_t *out_len) {
+    decomp_memory_t memory = { data, size };
+    decomp_stream_t s;
+
+    int status = DECOMP_OK;
+    if (size <= UINT32_MAX) {
+        decomp_borrow(&s, data, size);
+    } else {
+        status = decomp_open(&s, decomp_memory_read, &memory);
+    }
+    if (status == DECOMP_OK) {
+        status = decomp_run(&s, format, out, capacity, grow, grow_context);
+    }
+    if (out_len) {
+        *out_len = status == DECOMP_OK ? s.out_len : 0;
+    }
+    decomp_close(&s);
+    return status;
+}
+
+int decomp_block(const uint8_t *data, size_t size, decomp_format_t format, uint8_t *out, size_t capacity,
+                 void *work, size_t work_size, size_t *out_len) {
+    decomp_stream_t s;
+
+    *out_len = 0;
+    if (size > UINT32_MAX) {
+        return DECOMP_ERR_TOO_LARGE;
+    }
+    decomp_borrow(&s, data, size);
+    s.work = (uint8_t *)work;
+    s.work_size = work ? work_size : 0;
+
+    int status = decomp_run(&s, format, out, capacity, NULL, NULL);
+    if (status == DECOMP_OK) {
+        *out_len = s.out_len;
+    }
+    return status;
+}
+
+// Never 0, so a caller can always hand decomp_block a workspace
+size_t decomp_workspace_size(decomp_format_t format) {
+    switch (format) {
+    case DECOMP_GZIP:
+    case DECOMP_ZLIB: return inflate_workspace_size() + 16;
+    case DECOMP_ZSTD: return zstd_workspace_size() + 16;
+    default:          return 16;    // LZ4 decodes from the input in place
+    }
+}
+
+// CRC-32 (IEEE 802.3, reflected) for the gzip trailer
+static uint32_t crc32_table[256];
+static bool crc32_ready = false;
+
+uint32_t decomp_crc32(uint32_t crc, const uint8_t *data, size_t len) {
+    if (!crc32_ready) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            crc32_table[i] = c;
+        }
+        crc32_ready = true;
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc = crc32_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Adler-32 for the zlib trailer; 5552 is the longest run whose sums
+// cannot overflow 32 bits before the modulo
+uint32_t decomp_adler32(uint32_t adler, const uint8_t *data, size_t len) {
+    uint32_t a = adler & 0xFFFF;
+    uint32_t b = adler >> 16;
+
+    while (len > 0) {
+        size_t n = len < 5552 ? len : 5552;
+        len -= n;
+        while (n--) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+// xxHash32 for LZ4 header, block and content checksums
+#define XXH32_P1    2654435761u
+#define XXH32_P2    2246822519u
+#define XXH32_P3    3266489917u
+#define XXH32_P4    668265263u
+#define XXH32_P5    374761393u
+
+static uint32_t rotl32(uint32_t x, int r) {
+    return (x << r) | (x >> (32 - r));
+}
+
+static uint32_t xxh32_round(uint32_t acc, uint32_t input) {
+    return rotl32(acc + input * XXH32_P2, 13) * XXH32_P1;
+}
+
+uint32_t decomp_xxh32(const uint8_t *data, size_t len, uint32_t seed) {
+    const uint8_t *p = data;
+    const uint8_t *end = data + len;
+    uint32_t h;
+
+    if (len >= 16) {
+        uint32_t v1 = seed + XXH32_P1 + XXH32_P2;
+        uint32_t v2 = seed + XXH32_P2;
+        uint32_t v3 = seed;
+        uint32_t v4 = seed - XXH32_P1;
+        do {
+            v1 = xxh32_round(v1, read_le32(p));
+            v2 = xxh32_round(v2, read_le32(p + 4));
+            v3 = xxh32_round(v3, read_le32(p + 8));
+            v4 = xxh32_round(v4, read_le32(p + 12));
+            p += 16;
+        } while (end - p >= 16);
+        h = rotl32(v1, 1) + rotl32(v2, 7) + rotl32(v3, 12) + rotl32(v4, 18);
+    } else {
+        h = seed + XXH32_P5;
+    }
+
+    h += (uint32_t)len;
+    for (; end - p >= 4; p += 4) {
+        h = rotl32(h + read_le32(p) * XXH32_P3, 17) * XXH32_P4;
+    }
+    for (; p < end; p++) {
+        h = rotl32(h + *p * XXH32_P5, 11) * XXH32_P1;
+    }
+
+    h ^= h >> 15;
+    h *= XXH32_P2;
+    h ^= h >> 13;
+    h *= XXH32_P3;
+    h ^= h >> 16;
+    return h;
+}
+
+// xxHash64 for zstd content checksums
+#define XXH64_P1    11400714785074694791ull
+#define XXH64_P2    14029467366897019727ull
+#define XXH64_P3    1609587929392839161ull
+#define XXH64_P4    9650029242287828579ull
+#define XXH64_P5    2870177450012600261ull
+
+static uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+    return rotl64(acc + input * XXH64_P2, 31) * XXH64_P1;
+}
+
+static uint64_t xxh64_merge(uint64_t acc, uint64_t v) {
+    acc ^= xxh64_round(0, v);
+    return acc * XXH64_P1 + XXH64_P4;
+}
+
+uint64_t decomp_xxh64(const uint8_t *data, size_t len, uint64_t seed) {
+    const uint8_t *p = data;
+    const uint8_t *end = data + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        uint64_t v1 = seed + XXH64_P1 + XXH64_P2;
+        uint64_t v2 = seed + XXH64_P2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH64_P1;
+        do {
+            v1 = xxh64_round(v1, read_le64(p));
+            v2 = xxh64_round(v2, read_le64(p + 8));
+            v3 = xxh64_round(v3, read_le64(p + 16));
+            v4 = xxh64_round(v4, read_le64(p + 24));
+            p += 32;
+        } while (end - p >= 32);
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxh64_merge(h, v1);
+        h = xxh64_merge(h, v2);
+        h = xxh64_merge(h, v3);
+        h = xxh64_merge(h, v4);
+    } else {
+        h = seed + XXH64_P5;
+    }
+
+    h += (uint64_t)len;
+    for (; end - p >= 8; p += 8) {
+        h ^= xxh64_round(0, read_le64(p));
+        h = rotl64(h, 27) * XXH64_P1 + XXH64_P4;
+    }
+    if (end - p >= 4) {
+        h ^= (uint64_t)read_le32(p) * XXH64_P1;
+        h = rotl64(h, 23) * XXH64_P2 + XXH64_P3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= *p * XXH64_P5;
+        h = rotl64(h, 11) * XXH64_P1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH64_P2;
+    h ^= h >> 29;
+    h *= XXH64_P3;
+    h ^= h >> 32;
+    return h;
+}
@@ -0,0 +1,150 @@
+/*
+ * decompress.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_DECOMPRESS_H
+#define BLOODHORN_DECOMPRESS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "compat.h"
+
+// Streaming decompression for kernel and initrd images. The decoder pulls
+// compressed input through a read callback in DECOMP_INPUT_SIZE pieces (so
+// the caller sees, and can hash, every compressed byte exactly once) and
+// writes the output straight into one flat buffer: the load destination.
+// Back-references resolve against that buffer, so no separate window is
+// kept.
+
+typedef enum {
+    DECOMP_NONE = 0,            // Not a recognised compressed stream
+    DECOMP_GZIP,                // RFC 1952, one or more members
+    DECOMP_LZ4,                 // LZ4 frame format, or the legacy format used for initramfs
+    DECOMP_ZSTD,                // RFC 8878 frames (skippable frames allowed)
+    DECOMP_ZLIB,                // RFC 1950, one stream; never detected, only requested (PNG data)
+    DECOMP_LZ4_BLOCK            // One bare LZ4 block (SquashFS); only requested, and only from memory
+} decomp_format_t;
+
+#define DECOMP_INPUT_SIZE       (64 * 1024)
+
+// Error codes
+#define DECOMP_OK               0
+#define DECOMP_ERR_CORRUPT      -1      // Malformed or truncated stream
+#define DECOMP_ERR_NO_MEMORY    -2
+#define DECOMP_ERR_IO           -3      // The read callback failed
+#define DECOMP_ERR_TOO_LARGE    -4      // Output buffer could not grow
+#define DECOMP_ERR_CHECKSUM     -5      // Content checksum mismatch
+#define DECOMP_ERR_UNSUPPORTED  -6      // Dictionaries and the like
+
+// Store up to `len` compressed bytes in `buf`; returns the count, 0 at end
+// of input, or a negative value on error
+typedef int (*decomp_read_fn)(void *context, uint8_t *buf, uint32_t len);
+
+// Enlarge the output buffer to at least `need` bytes, keeping its contents;
+// update *buf and *capacity and return 0, or nonzero to fail
+typedef int (*decomp_grow_fn)(void *context, size_t need, uint8_t **buf, size_t *capacity);
+
+typedef struct {
+    // Input
+    decomp_read_fn read;
+    void *read_context;
+    uint8_t *in;                // DECOMP_INPUT_SIZE bytes
+    uint32_t in_pos;
+    uint32_t in_len;
+    bool in_eof;
+    bool in_borrowed;           // `in` is the caller's memory, all of the input
+    int in_error;               // Sticky error from the read callback
+
+    // Output
+    uint8_t *out;
+    size_t out_capacity;
+    size_t out_len;
+    decomp_grow_fn grow;        // NULL = fixed-size output
+    void *grow_context;
+
+    // Codec state comes from here when set, else from malloc
+    uint8_t *work;
+    size_t work_size;
+    size_t work_used;
+} decomp_stream_t;
+
+// Start a stream and buffer its first DECOMP_INPUT_SIZE bytes, which is
+// enough for decomp_detect and decomp_size_hint to look at
+int decomp_open(decomp_stream_t *s, decomp_read_fn read, void *context);
+void decomp_close(decomp_stream_t *s);
+
+// Format of a stream from its first bytes
+decomp_format_t decomp_detect(const uint8_t *data, size_t len);
+const char *decomp_format_name(decomp_format_t format);
+
+// Decompressed size recorded in the frame header of the buffered input, or
+// 0 when the format does not say (gzip keeps it in its trailer)
+uint64_t decomp_size_hint(const decomp_stream_t *s, decomp_format_t format);
+
+// Decompress the whole stream into `out` (grown through `grow` as needed).
+// On success s->out and s->out_len describe the result. Input following
+// the last complete frame is left unread.
+int decomp_run(decomp_stream_t *s, decomp_format_t format, uint8_t *out, size_t capacity,
+               decomp_grow_fn grow, void *grow_context);
+
+// Decompress a buffer already in memory
+int decomp_buffer(const uint8_t *data, size_t size, decomp_format_t format, uint8_t *out, size_t capacity,
+                  decomp_grow_fn grow, void *grow_context, size_t *out_len);
+
+// Decompress a buffer already in memory into a fixed `out`, with codec
+// state carved from `work` (decomp_workspace_size bytes for the format).
+// The input is read in place and nothing is allocated, so this is safe on
+// an application processor. With `work` NULL state comes from malloc.
+int decomp_block(const uint8_t *data, size_t size, decomp_format_t format, uint8_t *out, size_t capacity,
+                 void *work, size_t work_size, size_t *out_len);
+size_t decomp_workspace_size(decomp_format_t format);
+
+// Codec state: from the workspace when the stream has one (released all
+// at once with it), else the heap
+void *decomp_alloc(decomp_stream_t *s, size_t size);
+void decomp_free(decomp_stream_t *s, void *p);
+
+// Input helpers shared by the codecs
+int decomp_refill(decomp_stream_t *s);
+int decomp_read_exact(decomp_stream_t *s, void *dst, size_t len);
+int decomp_skip(decomp_stream_t *s, uint64_t len);
+bool decomp_input_done(decomp_stream_t *s);
+int decomp_reserve_slow(decomp_stream_t *s, size_t len);
+
+static inline int decomp_read_byte(decomp_stream_t *s) {
+    if (s->in_pos == s->in_len && decomp_refill(s) <= 0) {
+        return -1;
+    }
+    return s->in[s->in_pos++];
+}
+
+// Make room for `len` more output bytes
+static inline int decomp_reserve(decomp_stream_t *s, size_t len) {
+    if (len <= s->out_capacity - s->out_len) {
+        return DECOMP_OK;
+    }
+    return decomp_reserve_slow(s, len);
+}
+
+// Checksums used inside the formats
+uint32_t decomp_crc32(uint32_t crc, const uint8_t *data, size_t len);
+uint32_t decomp_adler32(uint32_t adler, const uint8_t *data, size_t len);
+uint32_t decomp_xxh32(const uint8_t *data, size_t len, uint32_t seed);
+uint64_t decomp_xxh64(const uint8_t *data, size_t len, uint64_t seed);
+
+// Codecs (decompress.c dispatches here)
+int gzip_decompress(decomp_stream_t *s);
+int zlib_decompress(decomp_stream_t *s);
+int lz4_decompress(decomp_stream_t *s);
+int lz4_block_decompress(decomp_stream_t *s);
+int zstd_decompress(decomp_stream_t *s);
+
+// Bytes of codec state each allocates
+size_t inflate_workspace_size(void);
+size_t zstd_workspace_size(void);
+
+#endif // BLOODHORN_DECOMPRESS_H
@@ -0,0 +1,545 @@
+/*
+ * inflate.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include "decompress.h"
+#include "compat.h"
+#include <string.h>
+#include <stdlib.h>
+
+// DEFLATE (RFC 1951) inside gzip members (RFC 1952) or a zlib stream
+// (RFC 1950). Codes of up to
+// INFLATE_FAST_BITS bits decode with one table lookup; longer ones fall
+// back to a canonical walk over the per-length counts.
+
+#define INFLATE_FAST_BITS   10
+#define INFLATE_MAX_BITS    15
+#define INFLATE_MAX_LITLEN  288
+#define INFLATE_MAX_DIST    30
+
+typedef struct {
+    uint16_t count[INFLATE_MAX_BITS + 1];
+    uint16_t symbol[INFLATE_MAX_LITLEN];
+    uint16_t fast[1 << INFLATE_FAST_BITS];  // (length << 9) | symbol, 0 = long code
+} inflate_huffman_t;
+
+typedef struct {
+    decomp_stream_t *s;
+    uint64_t bits;              // Bit buffer, LSB first
+    uint32_t bit_count;
+    inflate_huffman_t lit;
+    inflate_huffman_t dist;
+} inflate_state_t;
+
+static const uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+// Top up the bit buffer as far as the input allows. Running out is not an
+// error here: the last code of a stream may need fewer bits than peeked.
+static void inflate_fill(inflate_state_t *st) {
+    decomp_stream_t *s = st->s;
+
+    while (st->bit_count <= 56) {
+        if (s->in_pos == s->in_len && decomp_refill(s) <= 0) {
+            return;
+        }
+        st->bits |= (uint64_t)s->in[s->in_pos++] << st->bit_count;
+        st->bit_count += 8;
+    }
+}
+
+static int inflate_bits(inflate_state_t *st, uint32_t n, uint32_t *value) {
+    if (st->bit_count < n) {
+        inflate_fill(st);
+        if (st->bit_count < n) {
+            return DECOMP_ERR_CORRUPT; // Truncated
+        }
+    }
+    *value = (uint32_t)(st->bits & ((1ull << n) - 1));
+    st->bits >>= n;
+    st->bit_count -= n;
+    return DECOMP_OK;
+}
+
+// Next whole byte, from the bit buffer first (used once the deflate data
+// ends on a byte boundary: trailers, headers of following members)
+static int inflate_byte(inflate_state_t *st) {
+    if (st->bit_count >= 8) {
+        int b = (int)(st->bits & 0xFF);
+        st->bits >>= 8;
+        st->bit_count -= 8;
+        return b;
+    }
+    return decomp_read_byte(st->s);
+}
+
+static void inflate_align(inflate_state_t *st) {
+    st->bits >>= st->bit_count & 7;
+    st->bit_count &= ~7u;
+}
+
+static int inflate_build(inflate_huffman_t *h, const uint8_t *lengths, uint32_t n) {
+    uint16_t offsets[INFLATE_MAX_BITS + 1];
+
+    memset(h->count, 0, sizeof(h->count));
+    for (uint32_t i = 0; i < n; i++) {
+        h->count[lengths[i]]++;
+    }
+
+    // Over-subscribed sets cannot be decoded; incomplete ones (a single
+    // distance code, say) are legal and simply never match the gap
+    int left = 1;
+    for (uint32_t len = 1; len <= INFLATE_MAX_BITS; len++) {
+        left = (left << 1) - h->count[len];
+        if (left < 0) {
+            return DECOMP_ERR_CORRUPT;
+        }
+    }
+
+    offsets[1] = 0;
+    for (uint32_t len = 1; len < INFLATE_MAX_BITS; len++) {
+        offsets[len + 1] = offsets[len] + h->count[len];
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        if (lengths[i] != 0) {
+            h->symbol[offsets[lengths[i]]++] = (uint16_t)i;
+        }
+    }
+
+    // Walk the canonical codes of the short lengths into the lookup table.
+    // Deflate stores codes MSB first in an LSB-first stream, so each code
+    // is bit-reversed to index the table.
+    memset(h->fast, 0, sizeof(h->fast));
+    uint32_t code = 0;
+    uint32_t index = 0;
+    for (uint32_t len = 1; len <= INFLATE_FAST_BITS; len++) {
+        for (uint32_t k = 0; k < h->count[len]; k++, code++, index++) {
+            uint32_t reversed = 0;
+            for (uint32_t b = 0; b < len; b++) {
+                reversed |= ((code >> b) & 1) << (len - 1 - b);
+            }
+            uint16_t entry = (uint16_t)((len << 9) | h->symbol[index]);
+            for (uint32_t slot = reversed; slot < (1u << INFLATE_FAST_BITS); slot += 1u << len) {
+                h->fast[slot] = entry;
+            }
+        }
+        code <<= 1;
+    }
+    return DECOMP_OK;
+}
+
+static int inflate_decode(inflate_state_t *st, const inflate_huffman_t *h) {
+    if (st->bit_count < INFLATE_MAX_BITS) {
+        inflate_fill(st);
+    }
+
+    uint16_t entry = h->fast[st->bits & ((1u << INFLATE_FAST_BITS) - 1)];
+    if (entry != 0) {
+        uint32_t len = entry >> 9;
+        if (len > st->bit_count) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        st->bits >>= len;
+        st->bit_count -= len;
+        return entry & 0x1FF;
+    }
+
+    int code = 0, first = 0, index = 0;
+    for (uint32_t len = 1; len <= INFLATE_MAX_BITS && len <= st->bit_count; len++) {
+        code |= (int)((st->bits >> (len - 1)) & 1);
+        int count = h->count[len];
+        if (code - count < first) {
+            st->bits >>= len;
+            st->bit_count -= len;
+            return h->symbol[index + (code - first)];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return DECOMP_ERR_CORRUPT;
+}
+
+static int inflate_stored(inflate_state_t *st) {
+    decomp_stream_t *s = st->s;
+    uint8_t header[4];
+
+    inflate_align(st);
+    for (int i = 0; i < 4; i++) {
+        int b = inflate_byte(st);
+        if (b < 0) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        header[i] = (uint8_t)b;
+    }
+    uint32_t len = header[0] | (header[1] << 8);
+    if ((len ^ (header[2] | (header[3] << 8))) != 0xFFFF) {
+        return DECOMP_ERR_CORRUPT;
+    }
+
+    int status = decomp_reserve(s, len);
+    if (status != DECOMP_OK) {
+        return status;
+    }
+    while (len > 0 && st->bit_count >= 8) {
+        s->out[s->out_len++] = (uint8_t)inflate_byte(st);
+        len--;
+    }
+    status = decomp_read_exact(s, s->out + s->out_len, len);
+    if (status == DECOMP_OK) {
+        s->out_len += len;
+    }
+    return status;
+}
+
+static int inflate_codes(inflate_state_t *st, size_t member_start) {
+    decomp_stream_t *s = st->s;
+
+    for (;;) {
+        int sym = inflate_decode(st, &st->lit);
+        if (sym < 0) {
+            return DECOMP_ERR_CORRUPT;
+        }
+
+        if (sym < 256) {
+            if (s->out_len == s->out_capacity) {
+                int status = decomp_reserve(s, 1);
+                if (status != DECOMP_OK) {
+                    return status;
+                }
+            }
+            s->out[s->out_len++] = (uint8_t)sym;
+            continue;
+        }
+        if (sym == 256) {
+            return DECOMP_OK; // End of block
+        }
+
+        sym -= 257;
+        if (sym >= 29) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        uint32_t extra;
+        if (inflate_bits(st, length_extra[sym], &extra) != DECOMP_OK) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        uint32_t len = length_base[sym] + extra;
+
+        int dsym = inflate_decode(st, &st->dist);
+        if (dsym < 0 || dsym >= INFLATE_MAX_DIST) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        if (inflate_bits(st, dist_extra[dsym], &extra) != DECOMP_OK) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        size_t dist = dist_base[dsym] + extra;
+        if (dist > s->out_len - member_start) {
+            return DECOMP_ERR_CORRUPT; // Reaches before the member
+        }
+
+        int status = decomp_reserve(s, len);
+        if (status != DECOMP_OK) {
+            return status;
+        }
+        uint8_t *dst = s->out + s->out_len;
+        const uint8_t *src = dst - dist;
+        if (dist >= len) {
+            memcpy(dst, src, len);
+        } else {
+            for (uint32_t i = 0; i < len; i++) {
+                dst[i] = src[i]; // Overlapping run
+            }
+        }
+        s->out_len += len;
+    }
+}
+
+static int inflate_fixed(inflate_state_t *st) {
+    static bool built = false;
+    static inflate_huffman_t fixed_lit, fixed_dist;
+
+    if (!built) {
+        uint8_t lengths[INFLATE_MAX_LITLEN];
+        uint32_t i = 0;
+        for (; i < 144; i++) lengths[i] = 8;
+        for (; i < 256; i++) lengths[i] = 9;
+        for (; i < 280; i++) lengths[i] = 7;
+        for (; i < 288; i++) lengths[i] = 8;
+        inflate_build(&fixed_lit, lengths, INFLATE_MAX_LITLEN);
+        for (i = 0; i < INFLATE_MAX_DIST; i++) lengths[i] = 5;
+        inflate_build(&fixed_dist, lengths, INFLATE_MAX_DIST);
+        built = true;
+    }
+
+    memcpy(&st->lit, &fixed_lit, sizeof(fixed_lit));
+    memcpy(&st->dist, &fixed_dist, sizeof(fixed_dist));
+    return DECOMP_OK;
+}
+
+static int inflate_dynamic(inflate_state_t *st) {
+    static const uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    uint8_t lengths[INFLATE_MAX_LITLEN + INFLATE_MAX_DIST];
+    uint32_t nlen, ndist, ncode, v;
+
+    if (inflate_bits(st, 5, &nlen) || inflate_bits(st, 5, &ndist) || inflate_bits(st, 4, &ncode)) {
+        return DECOMP_ERR_CORRUPT;
+    }
+    nlen += 257;
+    ndist += 1;
+    ncode += 4;
+    if (nlen > INFLATE_MAX_LITLEN || ndist > INFLATE_MAX_DIST) {
+        return DECOMP_ERR_CORRUPT;
+    }
+
+    // Code-length code, reusing the literal table as scratch
+    memset(lengths, 0, 19);
+    for (uint32_t i = 0; i < ncode; i++) {
+        if (inflate_bits(st, 3, &v)) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        lengths[order[i]] = (uint8_t)v;
+    }
+    if (inflate_build(&st->lit, lengths, 19) != DECOMP_OK) {
+        return DECOMP_ERR_CORRUPT;
+    }
+
+    uint32_t index = 0;
+    while (index < nlen + ndist) {
+        int sym = inflate_decode(st, &st->lit);
+        if (sym < 0) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        if (sym < 16) {
+            lengths[index++] = (uint8_t)sym;
+            continue;
+        }
+
+        uint8_t repeat_len = 0;
+        uint32_t repeat;
+        if (sym == 16) {
+            if (index == 0 || inflate_bits(st, 2, &repeat)) {
+                return DECOMP_ERR_CORRUPT;
+            }
+            repeat_len = lengths[index - 1];
+            repeat += 3;
+        } else if (sym == 17) {
+            if (inflate_bits(st, 3, &repeat)) {
+                return DECOMP_ERR_CORRUPT;
+            }
+            repeat += 3;
+        } else {
+            if (inflate_bits(st, 7, &repeat)) {
+                return DECOMP_ERR_CORRUPT;
+            }
+            repeat += 11;
+        }
+        if (index + repeat > nlen + ndist) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        memset(lengths + index, repeat_len, repeat);
+        index += repeat;
+    }
+
+    if (lengths[256] == 0) {
+        return DECOMP_ERR_CORRUPT; // No end-of-block code
+    }
+    if (inflate_build(&st->lit, lengths, nlen) != DECOMP_OK ||
+        inflate_build(&st->dist, lengths + nlen, ndist) != DECOMP_OK) {
+        return DECOMP_ERR_CORRUPT;
+    }
+    return DECOMP_OK;
+}
+
+static int inflate_member_data(inflate_state_t *st) {
+    size_t member_start = st->s->out_len;
+    uint32_t last, type;
+
+    do {
+        int status;
+        if (inflate_bits(st, 1, &last) || inflate_bits(st, 2, &type)) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        switch (type) {
+        case 0:
+            status = inflate_stored(st);
+            break;
+        case 1:
+            status = inflate_fixed(st);
+            if (status == DECOMP_OK) status = inflate_codes(st, member_start);
+            break;
+        case 2:
+            status = inflate_dynamic(st);
+            if (status == DECOMP_OK) status = inflate_codes(st, member_start);
+            break;
+        default:
+            status = DECOMP_ERR_CORRUPT;
+            break;
+        }
+        if (status != DECOMP_OK) {
+            return status;
+        }
+    } while (!last);
+    return DECOMP_OK;
+}
+
+// Skip a zero-terminated header field (file name, comment)
+static int gzip_skip_string(inflate_state_t *st) {
+    int b;
+    while ((b = inflate_byte(st)) > 0) {
+    }
+    return b == 0 ? DECOMP_OK : DECOMP_ERR_CORRUPT;
+}
+
+static int gzip_member(inflate_state_t *st) {
+    decomp_stream_t *s = st->s;
+    uint8_t header[10];
+
+    for (int i = 0; i < 10; i++) {
+        int b = inflate_byte(st);
+        if (b < 0) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        header[i] = (uint8_t)b;
+    }
+    if (header[0] != 0x1F || header[1] != 0x8B || header[2] != 8 || (header[3] & 0xE0)) {
+        return DECOMP_ERR_CORRUPT;
+    }
+
+    uint8_t flags = header[3];
+    if (flags & 0x04) { // FEXTRA
+        int lo = inflate_byte(st), hi = inflate_byte(st);
+        if (lo < 0 || hi < 0) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        for (int n = lo | (hi << 8); n > 0; n--) {
+            if (inflate_byte(st) < 0) {
+                return DECOMP_ERR_CORRUPT;
+            }
+        }
+    }
+    if ((flags & 0x08) && gzip_skip_string(st) != DECOMP_OK) { // FNAME
+        return DECOMP_ERR_CORRUPT;
+    }
+    if ((flags & 0x10) && gzip_skip_string(st) != DECOMP_OK) { // FCOMMENT
+        return DECOMP_ERR_CORRUPT;
+    }
+    if ((flags & 0x02) && (inflate_byte(st) < 0 || inflate_byte(st) < 0)) { // FHCRC
+        return DECOMP_ERR_CORRUPT;
+    }
+
+    size_t start = s->out_len;
+    int status = inflate_member_data(st);
+    if (status != DECOMP_OK) {
+        return status;
+    }
+
+    // Trailer: CRC-32 and size (mod 2^32) of the member's output
+    uint8_t trailer[8];
+    inflate_align(st);
+    for (int i = 0; i < 8; i++) {
+        int b = inflate_byte(st);
+        if (b < 0) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        trailer[i] = (uint8_t)b;
+    }
+    uint32_t crc = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | ((uint32_t)trailer[3] << 24);
+    uint32_t isize = trailer[4] | (trailer[5] << 8) | (trailer[6] << 16) | ((uint32_t)trailer[7] << 24);
+    size_t produced = s->out_len - start;
+    if ((uint32_t)produced != isize || decomp_crc32(0, s->out + start, produced) != crc) {
+        return DECOMP_ERR_CHECKSUM;
+    }
+    return DECOMP_OK;
+}
+
+// True if another gzip member follows; anything else (zero padding to a
+// sector boundary, typically) ends the stream like gzip(1) does
+static bool gzip_next_member(inflate_state_t *st) {
+    decomp_stream_t *s = st->s;
+
+    if (st->bit_count >= 8) {
+        return (st->bits & 0xFF) == 0x1F;
+    }
+    if (s->in_pos == s->in_len && decomp_refill(s) <= 0) {
+        return false;
+    }
+    return s->in[s->in_pos] == 0x1F;
+}
+
+size_t inflate_workspace_size(void) {
+    return sizeof(inflate_state_t);
+}
+
+int gzip_decompress(decomp_stream_t *s) {
+    inflate_state_t *st = (inflate_state_t *)decomp_alloc(s, sizeof(inflate_state_t));
+    if (!st) {
+        return DECOMP_ERR_NO_MEMORY;
+    }
+    memset(st, 0, sizeof(*st));
+    st->s = s;
+
+    int status;
+    do {
+        status = gzip_member(st);
+    } while (status == DECOMP_OK && gzip_next_member(st));
+
+    decomp_free(s, st);
+    return status;
+}
+
+int zlib_decompress(decomp_stream_t *s) {
+    inflate_state_t *st = (inflate_state_t *)decomp_alloc(s, sizeof(inflate_state_t));
+    if (!st) {
+        return DECOMP_ERR_NO_MEMORY;
+    }
+    memset(st, 0, sizeof(*st));
+    st->s = s;
+
+    // CMF/FLG: deflate with a window of at most 32K, header check, no
+    // preset dictionary
+    int status;
+    int cmf = inflate_byte(st), flg = inflate_byte(st);
+    if (cmf < 0 || flg < 0 || (cmf & 0x0F) != 8 || (cmf >> 4) > 7 || ((cmf << 8) | flg) % 31 != 0) {
+        status = DECOMP_ERR_CORRUPT;
+    } else if (flg & 0x20) {
+        status = DECOMP_ERR_UNSUPPORTED;
+    } else {
+        size_t start = s->out_len;
+        status = inflate_member_data(st);
+        if (status == DECOMP_OK) {
+            // Trailer: Adler-32 of the output, big-endian
+            uint32_t adler = 0;
+            inflate_align(st);
+            for (int i = 0; i < 4 && status == DECOMP_OK; i++) {
+                int b = inflate_byte(st);
+                if (b < 0) {
+                    status = DECOMP_ERR_CORRUPT;
+                }
+                adler = (adler << 8) | (uint32_t)(b & 0xFF);
+            }
+            if (status == DECOMP_OK && decomp_adler32(1, s->out + start, s->out_len - start) != adler) {
+                status = DECOMP_ERR_CHECKSUM;
+            }
+        }
+    }
+
+    decomp_free(s, st);
+    return status;
+}
@@ -0,0 +1,343 @@
+/*
+ * lz4.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include "decompress.h"
+#include "compat.h"
+#include <string.h>
+#include <stdlib.h>
+
+// LZ4 frame format, plus the legacy format (`lz4 -l`) that the kernel's
+// initramfs unpacker expects and the bare blocks SquashFS stores.
+// Compressed blocks are decoded straight out of the input buffer when they
+// sit in it whole, and copied aside when they straddle a refill.
+
+#define LZ4_MAGIC               0x184D2204
+#define LZ4_LEGACY_MAGIC        0x184C2102
+#define LZ4_SKIPPABLE_MASK      0xFFFFFFF0
+#define LZ4_SKIPPABLE_MAGIC     0x184D2A50
+#define LZ4_LEGACY_BLOCK_MAX    (8 * 1024 * 1024)
+
+static uint32_t lz4_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int lz4_read_le32(decomp_stream_t *s, uint32_t *value) {
+    uint8_t b[4];
+    int status = decomp_read_exact(s, b, 4);
+    if (status == DECOMP_OK) {
+        *value = lz4_le32(b);
+    }
+    return status;
+}
+
+// Decode one compressed block. Matches may reach back into earlier blocks
+// of the same frame, which are still in the output buffer.
+static int lz4_decode_block(decomp_stream_t *s, const uint8_t *src, uint32_t size, size_t frame_start) {
+    const uint8_t *ip = src;
+    const uint8_t *end = src + size;
+
+    for (;;) {
+        if (ip >= end) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        uint32_t token = *ip++;
+
+        size_t literals = token >> 4;
+        if (literals == 15) {
+            uint32_t b;
+            do {
+                if (ip >= end) {
+                    return DECOMP_ERR_CORRUPT;
+                }
+                b = *ip++;
+                literals += b;
+            } while (b == 255);
+        }
+        if (literals > (size_t)(end - ip)) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        int status = decomp_reserve(s, literals);
+        if (status != DECOMP_OK) {
+            return status;
+        }
+        if (literals) { // out is still NULL when the first sequence is match-only
+            memcpy(s->out + s->out_len, ip, literals);
+            s->out_len += literals;
+            ip += literals;
+        }
+
+        if (ip == end) {
+            return DECOMP_OK; // The last sequence has no match
+        }
+
+        if (end - ip < 2) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > s->out_len - frame_start) {
+            return DECOMP_ERR_CORRUPT;
+        }
+
+        size_t match = token & 15;
+        if (match == 15) {
+            uint32_t b;
+            do {
+                if (ip >= end) {
+                    return DECOMP_ERR_CORRUPT;
+                }
+                b = *ip++;
+                match += b;
+            } while (b == 255);
+        }
+        match += 4;
+
+        status = decomp_reserve(s, match);
+        if (status != DECOMP_OK) {
+            return status;
+        }
+        uint8_t *dst = s->out + s->out_len;
+        const uint8_t *ref = dst - offset;
+        if (offset >= match) {
+            memcpy(dst, ref, match);
+        } else {
+            for (size_t i = 0; i < match; i++) {
+                dst[i] = ref[i]; // Overlapping run
+            }
+        }
+        s->out_len += match;
+    }
+}
+
+// Fetch a block of `size` input bytes: a pointer into the input buffer if
+// it is all there, otherwise a copy in `scratch`
+static int lz4_fetch(decomp_stream_t *s, uint32_t size, uint8_t *scratch, const uint8_t **data) {
+    if (s->in_pos == s->in_len && decomp_refill(s) <= 0) {
+        return s->in_error ? s->in_error : DECOMP_ERR_CORRUPT;
+    }
+    if (s->in_len - s->in_pos >= size) {
+        *data = s->in + s->in_pos;
+        s->in_pos += size;
+        return DECOMP_OK;
+    }
+    if (!scratch) {
+        return DECOMP_ERR_CORRUPT; // Truncated input in memory
+    }
+    *data = scratch;
+    return decomp_read_exact(s, scratch, size);
+}
+
+static int lz4_frame(decomp_stream_t *s, uint8_t **scratch, uint32_t *scratch_size) {
+    static const uint32_t block_sizes[8] = {0, 0, 0, 0, 64 << 10, 256 << 10, 1 << 20, 4 << 20};
+    uint8_t desc[14];
+    int status;
+
+    // FLG, BD, then the optional content size and dictionary ID
+    if ((status = decomp_read_exact(s, desc, 2)) != DECOMP_OK) {
+        return status;
+    }
+    uint8_t flg = desc[0], bd = desc[1];
+    if ((flg >> 6) != 1 || (flg & 0x02) || (bd & 0x8F) || block_sizes[(bd >> 4) & 7] == 0) {
+        return DECOMP_ERR_CORRUPT;
+    }
+    if (flg & 0x01) {
+        return DECOMP_ERR_UNSUPPORTED; // Dictionary
+    }
+    bool block_checksum = (flg & 0x10) != 0;
+    bool content_checksum = (flg & 0x04) != 0;
+    uint32_t desc_len = 2;
+    if (flg & 0x08) {
+        if ((status = decomp_read_exact(s, desc + 2, 8)) != DECOMP_OK) {
+            return status;
+        }
+        desc_len += 8;
+    }
+
+    int hc = decomp_read_byte(s);
+    if (hc < 0 || ((decomp_xxh32(desc, desc_len, 0) >> 8) & 0xFF) != (uint32_t)hc) {
+        return DECOMP_ERR_CORRUPT;
+    }
+
+    // Input in memory never straddles a refill, so needs no scratch
+    uint32_t block_max = block_sizes[(bd >> 4) & 7];
+    if (!s->in_borrowed && *scratch_size < block_max) {
+        decomp_free(s, *scratch);
+        *scratch = (uint8_t *)decomp_alloc(s, block_max);
+        *scratch_size = *scratch ? block_max : 0;
+        if (!*scratch) {
+            return DECOMP_ERR_NO_MEMORY;
+        }
+    }
+
+    size_t frame_start = s->out_len;
+    uint64_t content_size = 0;
+    if (flg & 0x08) {
+        for (int i = 7; i >= 0; i--) {
+            content_size = (content_size << 8) | desc[2 + i];
+        }
+        if (content_size > SIZE_MAX) {
+            return DECOMP_ERR_TOO_LARGE;
+        }
+        if ((status = decomp_reserve(s, (size_t)content_size)) != DECOMP_OK) {
+            return status;
+        }
+    }
+
+    for (;;) {
+        uint32_t header;
+        if ((status = lz4_read_le32(s, &header)) != DECOMP_OK) {
+            return status;
+        }
+        if (header == 0) {
+            break; // EndMark
+        }
+
+        uint32_t size = header & 0x7FFFFFFF;
+        if (size > block_max) {
+            return DECOMP_ERR_CORRUPT;
+        }
+
+        const uint8_t *data;
+        if ((status = lz4_fetch(s, size, *scratch, &data)) != DECOMP_OK) {
+            return status;
+        }
+        // Hash and decode before reading the checksum: a refill for it
+        // may reuse the input buffer `data` points into
+        uint32_t actual = block_checksum ? decomp_xxh32(data, size, 0) : 0;
+        if (header & 0x80000000) {
+            if ((status = decomp_reserve(s, size)) != DECOMP_OK) {
+                return status;
+            }
+            memcpy(s->out + s->out_len, data, size);
+            s->out_len += size;
+        } else if ((status = lz4_decode_block(s, data, size, frame_start)) != DECOMP_OK) {
+            return status;
+        }
+
+        if (block_checksum) {
+            uint32_t expected;
+            if ((status = lz4_read_le32(s, &expected)) != DECOMP_OK) {
+                return status;
+            }
+            if (actual != expected) {
+                return DECOMP_ERR_CHECKSUM;
+            }
+        }
+    }
+
+    if ((flg & 0x08) && s->out_len - frame_start != content_size) {
+        return DECOMP_ERR_CORRUPT;
+    }
+    if (content_checksum) {
+        uint32_t expected;
+        if ((status = lz4_read_le32(s, &expected)) != DECOMP_OK) {
+            return status;
+        }
+        if (decomp_xxh32(s->out + frame_start, s->out_len - frame_start, 0) != expected) {
+            return DECOMP_ERR_CHECKSUM;
+        }
+    }
+    return DECOMP_OK;
+}
+
+// Legacy frames: bare blocks of up to 8 MiB output each, until the input
+// ends or another magic number starts a new frame
+static int lz4_legacy_frame(decomp_stream_t *s, uint8_t **scratch, uint32_t *scratch_size, uint32_t *next_magic) {
+    uint32_t bound = LZ4_LEGACY_BLOCK_MAX + LZ4_LEGACY_BLOCK_MAX / 255 + 16;
+    size_t frame_start = s->out_len;
+    int status;
+
+    *next_magic = 0;
+    if (!s->in_borrowed && *scratch_size < bound) {
+        decomp_free(s, *scratch);
+        *scratch = (uint8_t *)decomp_alloc(s, bound);
+        *scratch_size = *scratch ? bound : 0;
+        if (!*scratch) {
+            return DECOMP_ERR_NO_MEMORY;
+        }
+    }
+
+    while (!decomp_input_done(s)) {
+        uint32_t size;
+        if ((status = lz4_read_le32(s, &size)) != DECOMP_OK) {
+            return status;
+        }
+        if (size == LZ4_LEGACY_MAGIC || size == LZ4_MAGIC || size == 0) {
+            *next_magic = size;
+            return DECOMP_OK;
+        }
+        if (size > bound) {
+            return DECOMP_ERR_CORRUPT;
+        }
+
+        const uint8_t *data;
+        if ((status = lz4_fetch(s, size, *scratch, &data)) != DECOMP_OK) {
+            return status;
+        }
+        if ((status = lz4_decode_block(s, data, size, frame_start)) != DECOMP_OK) {
+            return status;
+        }
+    }
+    return DECOMP_OK;
+}
+
+int lz4_decompress(decomp_stream_t *s) {
+    uint8_t *scratch = NULL;
+    uint32_t scratch_size = 0;
+    uint32_t magic;
+    int status = lz4_read_le32(s, &magic);
+    bool first = true;
+
+    while (status == DECOMP_OK) {
+        if (magic == LZ4_MAGIC) {
+            status = lz4_frame(s, &scratch, &scratch_size);
+            magic = 0;
+        } else if (magic == LZ4_LEGACY_MAGIC) {
+            status = lz4_legacy_frame(s, &scratch, &scratch_size, &magic);
+            if (status == DECOMP_OK && magic != 0) {
+                first = false;
+                continue; // The block size field was the next frame's magic
+            }
+        } else if ((magic & LZ4_SKIPPABLE_MASK) == LZ4_SKIPPABLE_MAGIC && !first) {
+            uint32_t size;
+            status = lz4_read_le32(s, &size);
+            if (status == DECOMP_OK) {
+                status = decomp_skip(s, size);
+            }
+        } else {
+            if (first) {
+                status = DECOMP_ERR_CORRUPT;
+            }
+            break; // Trailing data
+        }
+        first = false;
+
+        if (status != DECOMP_OK || decomp_input_done(s)) {
+            break;
+        }
+        status = lz4_read_le32(s, &magic);
+        if (status != DECOMP_OK) {
+            status = DECOMP_OK; // Fewer than four trailing bytes
+            break;
+        }
+    }
+
+    decomp_free(s, scratch);
+    return status;
+}
+
+// A bare block has no header, end mark or length of its own: it is the
+// whole input, which has to be in memory already
+int lz4_block_decompress(decomp_stream_t *s) {
+    if (!s->in_borrowed) {
+        return DECOMP_ERR_UNSUPPORTED;
+    }
+    const uint8_t *data = s->in + s->in_pos;
+    uint32_t size = s->in_len - s->in_pos;
+    s->in_pos = s->in_len;
+    return lz4_decode_block(s, data, size, s->out_len);
+}
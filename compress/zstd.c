@@ -0,0 +1,901 @@
+/*
+ * zstd.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include "decompress.h"
+#include "compat.h"
+#include <string.h>
+#include <stdlib.h>
+
+// Zstandard frames (RFC 8878). The decoder works one block (at most
+// 128 KiB in, 128 KiB out) at a time; sequences copy straight from the
+// output buffer, which holds the whole frame, so no window is kept.
+
+#define ZSTD_MAGIC              0xFD2FB528
+#define ZSTD_SKIPPABLE_MASK     0xFFFFFFF0
+#define ZSTD_SKIPPABLE_MAGIC    0x184D2A50
+#define ZSTD_BLOCK_MAX          (128 * 1024)
+
+#define ZSTD_HUF_MAX_BITS       11
+#define ZSTD_HUF_MAX_SYMBOLS    256
+#define ZSTD_FSE_MAX_LOG        9
+#define ZSTD_FSE_MAX_SYMBOLS    256
+
+#define ZSTD_LL_MAX_LOG         9
+#define ZSTD_ML_MAX_LOG         9
+#define ZSTD_OF_MAX_LOG         8
+#define ZSTD_HUF_WEIGHT_MAX_LOG 6
+
+#define ZSTD_LL_SYMBOLS         36
+#define ZSTD_ML_SYMBOLS         53
+#define ZSTD_OF_SYMBOLS         32
+
+typedef struct {
+    uint8_t symbol;
+    uint8_t bits;
+    uint16_t base;
+} zstd_fse_entry_t;
+
+typedef struct {
+    zstd_fse_entry_t table[1 << ZSTD_FSE_MAX_LOG];
+    uint32_t log;
+    bool valid;
+} zstd_fse_t;
+
+typedef struct {
+    uint8_t symbol[1 << ZSTD_HUF_MAX_BITS];
+    uint8_t bits[1 << ZSTD_HUF_MAX_BITS];
+    uint32_t max_bits;
+    bool valid;
+} zstd_huf_t;
+
+typedef struct {
+    decomp_stream_t *s;
+    size_t frame_start;
+    uint32_t rep[3];
+    zstd_huf_t huf;             // Kept for treeless literals
+    zstd_fse_t ll, of, ml;      // Kept for repeat mode
+    uint8_t literals[ZSTD_BLOCK_MAX];
+    uint8_t block[ZSTD_BLOCK_MAX];
+} zstd_ctx_t;
+
+static const uint32_t ll_base[ZSTD_LL_SYMBOLS] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+    16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 128, 256, 512, 1024, 2048, 4096,
+    8192, 16384, 32768, 65536
+};
+static const uint8_t ll_bits[ZSTD_LL_SYMBOLS] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12,
+    13, 14, 15, 16
+};
+static const uint32_t ml_base[ZSTD_ML_SYMBOLS] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+    19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+    35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027, 2051,
+    4099, 8195, 16387, 32771, 65539
+};
+static const uint8_t ml_bits[ZSTD_ML_SYMBOLS] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11,
+    12, 13, 14, 15, 16
+};
+
+// Predefined distributions (RFC 8878, 3.1.1.3.2.2)
+static const int16_t ll_default[ZSTD_LL_SYMBOLS] = {
+    4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+    -1, -1, -1, -1
+};
+static const int16_t ml_default[ZSTD_ML_SYMBOLS] = {
+    1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+    -1, -1, -1, -1, -1
+};
+static const int16_t of_default[29] = {
+    1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1
+};
+
+static uint32_t zstd_highbit(uint32_t v) {
+    uint32_t n = 0;
+    while (v >>= 1) n++;
+    return n;
+}
+
+// `n` (<= 32) bits starting `pos` bits into a little-endian byte string
+static uint64_t zstd_load_bits(const uint8_t *src, size_t len, uint64_t pos, uint32_t n) {
+    size_t byte = (size_t)(pos >> 3);
+    uint64_t v = 0;
+
+    if (n == 0) {
+        return 0;
+    }
+    if (byte + 8 <= len) {
+        for (int i = 0; i < 8; i++) {
+            v |= (uint64_t)src[byte + i] << (8 * i);
+        }
+    } else {
+        for (size_t i = 0; byte + i < len; i++) {
+            v |= (uint64_t)src[byte + i] << (8 * i);
+        }
+    }
+    return (v >> (pos & 7)) & ((1ull << n) - 1);
+}
+
+// Forward bitstream (FSE table descriptions)
+typedef struct {
+    const uint8_t *src;
+    size_t len;
+    uint64_t pos;
+} zstd_fwd_bits_t;
+
+static uint32_t zstd_fwd_read(zstd_fwd_bits_t *b, uint32_t n) {
+    uint32_t v = (uint32_t)zstd_load_bits(b->src, b->len, b->pos, n);
+    b->pos += n;
+    return v;
+}
+
+// Backward bitstream (Huffman streams, FSE-coded data). Reading past the
+// start yields zeros; well-formed streams end exactly at bit 0.
+typedef struct {
+    const uint8_t *src;
+    size_t len;
+    int64_t pos;                // Bits still unread
+} zstd_bits_t;
+
+static int zstd_bits_init(zstd_bits_t *b, const uint8_t *src, size_t len) {
+    if (len == 0 || src[len - 1] == 0) {
+        return DECOMP_ERR_CORRUPT; // No sentinel bit
+    }
+    b->src = src;
+    b->len = len;
+    b->pos = (int64_t)len * 8 - 8 + zstd_highbit(src[len - 1]);
+    return DECOMP_OK;
+}
+
+static uint32_t zstd_bits_read(zstd_bits_t *b, uint32_t n) {
+    b->pos -= n;
+    if (b->pos >= 0) {
+        return (uint32_t)zstd_load_bits(b->src, b->len, (uint64_t)b->pos, n);
+    }
+    int64_t missing = -b->pos;
+    if (missing >= n) {
+        return 0;
+    }
+    return (uint32_t)(zstd_load_bits(b->src, b->len, 0, n - (uint32_t)missing) << missing);
+}
+
+// Build a decoding table from normalized counts (-1 = "less than one")
+static int zstd_fse_build(zstd_fse_t *t, const int16_t *counts, uint32_t symbols, uint32_t log) {
+    uint32_t size = 1u << log;
+    uint32_t high = size;
+    uint16_t next[ZSTD_FSE_MAX_SYMBOLS];
+
+    for (uint32_t s = 0; s < symbols; s++) {
+        if (counts[s] == -1) {
+            if (high == 0) {
+                return DECOMP_ERR_CORRUPT;
+            }
+            t->table[--high].symbol = (uint8_t)s;
+            next[s] = 1;
+        }
+    }
+
+    uint32_t step = (size >> 1) + (size >> 3) + 3;
+    uint32_t mask = size - 1;
+    uint32_t pos = 0;
+    for (uint32_t s = 0; s < symbols; s++) {
+        if (counts[s] <= 0) {
+            continue;
+        }
+        next[s] = (uint16_t)counts[s];
+        for (int16_t i = 0; i < counts[s]; i++) {
+            t->table[pos].symbol = (uint8_t)s;
+            do {
+                pos = (pos + step) & mask;
+            } while (pos >= high);
+        }
+    }
+    if (pos != 0) {
+        return DECOMP_ERR_CORRUPT;
+    }
+
+    for (uint32_t i = 0; i < size; i++) {
+        uint32_t state = next[t->table[i].symbol]++;
+        uint32_t bits = log - zstd_highbit(state);
+        t->table[i].bits = (uint8_t)bits;
+        t->table[i].base = (uint16_t)((state << bits) - size);
+    }
+    t->log = log;
+    t->valid = true;
+    return DECOMP_OK;
+}
+
+static void zstd_fse_rle(zstd_fse_t *t, uint8_t symbol) {
+    t->table[0].symbol = symbol;
+    t->table[0].bits = 0;
+    t->table[0].base = 0;
+    t->log = 0;
+    t->valid = true;
+}
+
+// Parse an FSE table description; returns the bytes it took, or < 0
+static int zstd_fse_read(zstd_fse_t *t, const uint8_t *src, size_t len, uint32_t max_symbols, uint32_t max_log) {
+    int16_t counts[ZSTD_FSE_MAX_SYMBOLS];
+    zstd_fwd_bits_t b = { src, len, 0 };
+
+    if (len == 0) {
+        return DECOMP_ERR_CORRUPT;
+    }
+    uint32_t log = zstd_fwd_read(&b, 4) + 5;
+    if (log > max_log) {
+        return DECOMP_ERR_CORRUPT;
+    }
+
+    int32_t remaining = 1 << log;
+    uint32_t symbol = 0;
+    while (remaining > 0 && symbol < max_symbols) {
+        uint32_t bits = zstd_highbit((uint32_t)remaining + 1) + 1;
+        uint32_t value = zstd_fwd_read(&b, bits);
+        uint32_t lower_mask = (1u << (bits - 1)) - 1;
+        uint32_t threshold = (1u << bits) - 1 - ((uint32_t)remaining + 1);
+
+        if ((value & lower_mask) < threshold) {
+            b.pos--; // Small values fit in one bit less
+            value &= lower_mask;
+        } else if (value > lower_mask) {
+            value -= threshold;
+        }
+
+        int32_t count = (int32_t)value - 1;
+        remaining -= count < 0 ? -count : count;
+        counts[symbol++] = (int16_t)count;
+
+        if (count == 0) {
+            // Runs of zero counts: 2-bit repeat flags, 3 = keep going
+            uint32_t repeat;
+            do {
+                repeat = zstd_fwd_read(&b, 2);
+                for (uint32_t i = 0; i < repeat && symbol < max_symbols; i++) {
+                    counts[symbol++] = 0;
+                }
+            } while (repeat == 3);
+        }
+        if (b.pos > (uint64_t)len * 8) {
+            return DECOMP_ERR_CORRUPT;
+        }
+    }
+    if (remaining != 0) {
+        return DECOMP_ERR_CORRUPT;
+    }
+
+    int status = zstd_fse_build(t, counts, symbol, log);
+    return status != DECOMP_OK ? status : (int)((b.pos + 7) / 8);
+}
+
+static void zstd_fse_init_state(const zstd_fse_t *t, zstd_bits_t *b, uint32_t *state) {
+    *state = zstd_bits_read(b, t->log);
+}
+
+static uint8_t zstd_fse_decode(const zstd_fse_t *t, zstd_bits_t *b, uint32_t *state) {
+    const zstd_fse_entry_t *e = &t->table[*state];
+    *state = e->base + zstd_bits_read(b, e->bits);
+    return e->symbol;
+}
+
+static int zstd_huf_build(zstd_huf_t *h, const uint8_t *weights, uint32_t count) {
+    uint8_t bits[ZSTD_HUF_MAX_SYMBOLS];
+    uint32_t weight_sum = 0;
+
+    if (count == 0 || count >= ZSTD_HUF_MAX_SYMBOLS) {
+        return DECOMP_ERR_CORRUPT;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (weights[i] > ZSTD_HUF_MAX_BITS) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        weight_sum += weights[i] ? 1u << (weights[i] - 1) : 0;
+    }
+    if (weight_sum == 0) {
+        return DECOMP_ERR_CORRUPT;
+    }
+
+    // The last weight is implied: it completes the sum to a power of two
+    uint32_t max_bits = zstd_highbit(weight_sum) + 1;
+    uint32_t left_over = (1u << max_bits) - weight_sum;
+    if (max_bits > ZSTD_HUF_MAX_BITS || (left_over & (left_over - 1)) != 0) {
+        return DECOMP_ERR_CORRUPT;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        bits[i] = weights[i] ? (uint8_t)(max_bits + 1 - weights[i]) : 0;
+    }
+    bits[count] = (uint8_t)(max_bits - zstd_highbit(left_over));
+    uint32_t symbols = count + 1;
+
+    // Longest codes take the lowest table positions
+    uint32_t rank_count[ZSTD_HUF_MAX_BITS + 1] = {0};
+    uint32_t rank_index[ZSTD_HUF_MAX_BITS + 1];
+    for (uint32_t i = 0; i < symbols; i++) {
+        rank_count[bits[i]]++;
+    }
+    rank_index[max_bits] = 0;
+    for (uint32_t i = max_bits; i >= 1; i--) {
+        rank_index[i - 1] = rank_index[i] + rank_count[i] * (1u << (max_bits - i));
+        memset(&h->bits[rank_index[i]], (int)i, rank_index[i - 1] - rank_index[i]);
+    }
+    if (rank_index[0] != (1u << max_bits)) {
+        return DECOMP_ERR_CORRUPT;
+    }
+    for (uint32_t i = 0; i < symbols; i++) {
+        if (bits[i] != 0) {
+            uint32_t len = 1u << (max_bits - bits[i]);
+            memset(&h->symbol[rank_index[bits[i]]], (int)i, len);
+            rank_index[bits[i]] += len;
+        }
+    }
+
+    h->max_bits = max_bits;
+    h->valid = true;
+    return DECOMP_OK;
+}
+
+// Parse a Huffman tree description; returns the bytes it took, or < 0
+static int zstd_huf_read(zstd_ctx_t *ctx, const uint8_t *src, size_t len) {
+    uint8_t weights[ZSTD_HUF_MAX_SYMBOLS];
+    uint32_t count = 0;
+    size_t used;
+
+    if (len == 0) {
+        return DECOMP_ERR_CORRUPT;
+    }
+    uint32_t header = src[0];
+
+    if (header >= 128) {
+        // Direct 4-bit weights
+        count = header - 127;
+        used = 1 + (count + 1) / 2;
+        if (used > len) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            uint8_t byte = src[1 + i / 2];
+            weights[i] = (i & 1) ? (byte & 15) : (byte >> 4);
+        }
+    } else {
+        // FSE-compressed weights, two interleaved states
+        used = 1 + header;
+        if (used > len) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        zstd_fse_t *table = &ctx->of; // Scratch: the sequence tables are read after the literals
+        bool of_valid = ctx->of.valid;
+        zstd_fse_t saved;
+        if (of_valid) {
+            memcpy(&saved, &ctx->of, sizeof(saved));
+        }
+
+        int n = zstd_fse_read(table, src + 1, header, ZSTD_HUF_MAX_SYMBOLS, ZSTD_HUF_WEIGHT_MAX_LOG);
+        zstd_bits_t b;
+        int status = n < 0 ? n : zstd_bits_init(&b, src + 1 + n, header - (size_t)n);
+        if (status == DECOMP_OK) {
+            uint32_t s1, s2;
+            zstd_fse_init_state(table, &b, &s1);
+            zstd_fse_init_state(table, &b, &s2);
+            for (;;) {
+                if (count + 2 > ZSTD_HUF_MAX_SYMBOLS) {
+                    status = DECOMP_ERR_CORRUPT;
+                    break;
+                }
+                weights[count++] = zstd_fse_decode(table, &b, &s1);
+                if (b.pos < 0) {
+                    weights[count++] = table->table[s2].symbol;
+                    break;
+                }
+                weights[count++] = zstd_fse_decode(table, &b, &s2);
+                if (b.pos < 0) {
+                    weights[count++] = table->table[s1].symbol;
+                    break;
+                }
+            }
+        }
+
+        if (of_valid) {
+            memcpy(&ctx->of, &saved, sizeof(saved));
+        } else {
+            ctx->of.valid = false;
+        }
+        if (status != DECOMP_OK) {
+            return status;
+        }
+    }
+
+    int status = zstd_huf_build(&ctx->huf, weights, count);
+    return status != DECOMP_OK ? status : (int)used;
+}
+
+static int zstd_huf_stream(const zstd_huf_t *h, const uint8_t *src, size_t len, uint8_t *out, size_t count) {
+    zstd_bits_t b;
+    uint32_t mask = (1u << h->max_bits) - 1;
+
+    if (zstd_bits_init(&b, src, len) != DECOMP_OK) {
+        return DECOMP_ERR_CORRUPT;
+    }
+    uint32_t state = zstd_bits_read(&b, h->max_bits);
+    for (size_t i = 0; i < count; i++) {
+        uint32_t bits = h->bits[state];
+        out[i] = h->symbol[state];
+        state = ((state << bits) + zstd_bits_read(&b, bits)) & mask;
+    }
+    return b.pos == -(int64_t)h->max_bits ? DECOMP_OK : DECOMP_ERR_CORRUPT;
+}
+
+static uint32_t zstd_le(const uint8_t *p, uint32_t n) {
+    uint32_t v = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        v |= (uint32_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+// Literals section; returns the bytes it took and points *lit at the result
+static int zstd_literals(zstd_ctx_t *ctx, const uint8_t *src, size_t len, const uint8_t **lit, size_t *lit_size) {
+    if (len == 0) {
+        return DECOMP_ERR_CORRUPT;
+    }
+    uint32_t type = src[0] & 3;
+    uint32_t format = (src[0] >> 2) & 3;
+
+    if (type == 0 || type == 1) {
+        // Raw or RLE
+        uint32_t header, size;
+        if (format == 0 || format == 2) {
+            header = 1;
+            size = src[0] >> 3;
+        } else if (format == 1) {
+            header = 2;
+            if (len < 2) return DECOMP_ERR_CORRUPT;
+            size = zstd_le(src, 2) >> 4;
+        } else {
+            header = 3;
+            if (len < 3) return DECOMP_ERR_CORRUPT;
+            size = zstd_le(src, 3) >> 4;
+        }
+        if (size > ZSTD_BLOCK_MAX) {
+            return DECOMP_ERR_CORRUPT;
+        }
+
+        *lit_size = size;
+        if (type == 0) {
+            if (header + size > len) {
+                return DECOMP_ERR_CORRUPT;
+            }
+            *lit = src + header;
+            return (int)(header + size);
+        }
+        if (header + 1 > len) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        memset(ctx->literals, src[header], size);
+        *lit = ctx->literals;
+        return (int)(header + 1);
+    }
+
+    // Huffman-coded, with a new tree (2) or the previous one (3)
+    uint32_t header, size, compressed;
+    bool four_streams = format != 0;
+    if (format <= 1) {
+        header = 3;
+        if (len < 3) return DECOMP_ERR_CORRUPT;
+        uint32_t h = zstd_le(src, 3);
+        size = (h >> 4) & 0x3FF;
+        compressed = (h >> 14) & 0x3FF;
+    } else if (format == 2) {
+        header = 4;
+        if (len < 4) return DECOMP_ERR_CORRUPT;
+        uint32_t h = zstd_le(src, 4);
+        size = (h >> 4) & 0x3FFF;
+        compressed = h >> 18;
+    } else {
+        header = 5;
+        if (len < 5) return DECOMP_ERR_CORRUPT;
+        uint64_t h = zstd_le(src, 4) | ((uint64_t)src[4] << 32);
+        size = (uint32_t)(h >> 4) & 0x3FFFF;
+        compressed = (uint32_t)(h >> 22) & 0x3FFFF;
+    }
+    if (size > ZSTD_BLOCK_MAX || header + compressed > len) {
+        return DECOMP_ERR_CORRUPT;
+    }
+
+    const uint8_t *p = src + header;
+    size_t remaining = compressed;
+    if (type == 2) {
+        int used = zstd_huf_read(ctx, p, remaining);
+        if (used < 0) {
+            return used;
+        }
+        p += used;
+        remaining -= (size_t)used;
+    } else if (!ctx->huf.valid) {
+        return DECOMP_ERR_CORRUPT; // Treeless literals without a tree
+    }
+
+    int status;
+    if (!four_streams) {
+        status = zstd_huf_stream(&ctx->huf, p, remaining, ctx->literals, size);
+    } else {
+        if (remaining < 6) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        size_t sizes[4];
+        sizes[0] = zstd_le(p, 2);
+        sizes[1] = zstd_le(p + 2, 2);
+        sizes[2] = zstd_le(p + 4, 2);
+        if (sizes[0] + sizes[1] + sizes[2] + 6 > remaining) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        sizes[3] = remaining - 6 - sizes[0] - sizes[1] - sizes[2];
+
+        size_t segment = (size + 3) / 4;
+        if (segment * 3 > size) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        const uint8_t *stream = p + 6;
+        status = DECOMP_OK;
+        for (int i = 0; i < 4 && status == DECOMP_OK; i++) {
+            size_t count = i < 3 ? segment : size - segment * 3;
+            status = zstd_huf_stream(&ctx->huf, stream, sizes[i], ctx->literals + segment * i, count);
+            stream += sizes[i];
+        }
+    }
+    if (status != DECOMP_OK) {
+        return status;
+    }
+
+    *lit = ctx->literals;
+    *lit_size = size;
+    return (int)(header + compressed);
+}
+
+// One of the three sequence tables, per its compression mode
+static int zstd_seq_table(zstd_fse_t *t, uint32_t mode, const uint8_t *src, size_t len,
+                          const int16_t *defaults, uint32_t default_symbols, uint32_t default_log,
+                          uint32_t max_symbols, uint32_t max_log) {
+    switch (mode) {
+    case 0: // Predefined
+        return zstd_fse_build(t, defaults, default_symbols, default_log) == DECOMP_OK ? 0 : DECOMP_ERR_CORRUPT;
+    case 1: // RLE
+        if (len < 1 || src[0] >= max_symbols) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        zstd_fse_rle(t, src[0]);
+        return 1;
+    case 2: // FSE table description
+        return zstd_fse_read(t, src, len, max_symbols, max_log);
+    default: // Repeat
+        return t->valid ? 0 : DECOMP_ERR_CORRUPT;
+    }
+}
+
+static int zstd_copy_literals(decomp_stream_t *s, const uint8_t **lit, size_t *lit_left, size_t count) {
+    if (count > *lit_left) {
+        return DECOMP_ERR_CORRUPT;
+    }
+    int status = decomp_reserve(s, count);
+    if (status != DECOMP_OK) {
+        return status;
+    }
+    memcpy(s->out + s->out_len, *lit, count);
+    s->out_len += count;
+    *lit += count;
+    *lit_left -= count;
+    return DECOMP_OK;
+}
+
+static int zstd_compressed_block(zstd_ctx_t *ctx, const uint8_t *src, size_t len) {
+    decomp_stream_t *s = ctx->s;
+    const uint8_t *lit;
+    size_t lit_size;
+
+    int used = zstd_literals(ctx, src, len, &lit, &lit_size);
+    if (used < 0) {
+        return used;
+    }
+    src += used;
+    len -= (size_t)used;
+
+    // Sequences section header
+    if (len < 1) {
+        return DECOMP_ERR_CORRUPT;
+    }
+    uint32_t sequences = src[0];
+    if (sequences == 0) {
+        return zstd_copy_literals(s, &lit, &lit_size, lit_size);
+    }
+    if (sequences < 128) {
+        src += 1;
+        len -= 1;
+    } else if (sequences < 255) {
+        if (len < 2) return DECOMP_ERR_CORRUPT;
+        sequences = ((sequences - 128) << 8) + src[1];
+        src += 2;
+        len -= 2;
+    } else {
+        if (len < 3) return DECOMP_ERR_CORRUPT;
+        sequences = src[1] + (src[2] << 8) + 0x7F00;
+        src += 3;
+        len -= 3;
+    }
+
+    if (len < 1 || (src[0] & 3) != 0) {
+        return DECOMP_ERR_CORRUPT;
+    }
+    uint32_t modes = src[0];
+    src += 1;
+    len -= 1;
+
+    int n = zstd_seq_table(&ctx->ll, modes >> 6, src, len, ll_default, ZSTD_LL_SYMBOLS, 6,
+                           ZSTD_LL_SYMBOLS, ZSTD_LL_MAX_LOG);
+    if (n < 0) return n;
+    src += n;
+    len -= (size_t)n;
+    n = zstd_seq_table(&ctx->of, (modes >> 4) & 3, src, len, of_default, 29, 5,
+                       ZSTD_OF_SYMBOLS, ZSTD_OF_MAX_LOG);
+    if (n < 0) return n;
+    src += n;
+    len -= (size_t)n;
+    n = zstd_seq_table(&ctx->ml, (modes >> 2) & 3, src, len, ml_default, ZSTD_ML_SYMBOLS, 6,
+                       ZSTD_ML_SYMBOLS, ZSTD_ML_MAX_LOG);
+    if (n < 0) return n;
+    src += n;
+    len -= (size_t)n;
+
+    zstd_bits_t b;
+    if (zstd_bits_init(&b, src, len) != DECOMP_OK) {
+        return DECOMP_ERR_CORRUPT;
+    }
+    uint32_t ll_state, of_state, ml_state;
+    zstd_fse_init_state(&ctx->ll, &b, &ll_state);
+    zstd_fse_init_state(&ctx->of, &b, &of_state);
+    zstd_fse_init_state(&ctx->ml, &b, &ml_state);
+
+    for (uint32_t i = 0; i < sequences; i++) {
+        uint32_t of_code = ctx->of.table[of_state].symbol;
+        uint32_t ll_code = ctx->ll.table[ll_state].symbol;
+        uint32_t ml_code = ctx->ml.table[ml_state].symbol;
+        if (of_code >= ZSTD_OF_SYMBOLS || ll_code >= ZSTD_LL_SYMBOLS || ml_code >= ZSTD_ML_SYMBOLS) {
+            return DECOMP_ERR_CORRUPT;
+        }
+
+        // Extra bits come in offset, match length, literal length order
+        uint32_t offset_value = (1u << of_code) + zstd_bits_read(&b, of_code);
+        size_t match = ml_base[ml_code] + zstd_bits_read(&b, ml_bits[ml_code]);
+        size_t literals = ll_base[ll_code] + zstd_bits_read(&b, ll_bits[ll_code]);
+
+        if (i + 1 < sequences) {
+            ll_state = ctx->ll.table[ll_state].base + zstd_bits_read(&b, ctx->ll.table[ll_state].bits);
+            ml_state = ctx->ml.table[ml_state].base + zstd_bits_read(&b, ctx->ml.table[ml_state].bits);
+            of_state = ctx->of.table[of_state].base + zstd_bits_read(&b, ctx->of.table[of_state].bits);
+        }
+
+        // Repeat offsets
+        uint32_t offset;
+        if (offset_value > 3) {
+            offset = offset_value - 3;
+            ctx->rep[2] = ctx->rep[1];
+            ctx->rep[1] = ctx->rep[0];
+            ctx->rep[0] = offset;
+        } else {
+            uint32_t index = offset_value - 1 + (literals == 0 ? 1 : 0);
+            if (index == 0) {
+                offset = ctx->rep[0];
+            } else {
+                offset = index < 3 ? ctx->rep[index] : ctx->rep[0] - 1;
+                if (index > 1) {
+                    ctx->rep[2] = ctx->rep[1];
+                }
+                ctx->rep[1] = ctx->rep[0];
+                ctx->rep[0] = offset;
+            }
+        }
+
+        int status = zstd_copy_literals(s, &lit, &lit_size, literals);
+        if (status != DECOMP_OK) {
+            return status;
+        }
+
+        if (offset == 0 || offset > s->out_len - ctx->frame_start) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        if ((status = decomp_reserve(s, match)) != DECOMP_OK) {
+            return status;
+        }
+        uint8_t *dst = s->out + s->out_len;
+        const uint8_t *ref = dst - offset;
+        if (offset >= match) {
+            memcpy(dst, ref, match);
+        } else {
+            for (size_t k = 0; k < match; k++) {
+                dst[k] = ref[k]; // Overlapping run
+            }
+        }
+        s->out_len += match;
+    }
+    if (b.pos != 0) {
+        return DECOMP_ERR_CORRUPT;
+    }
+
+    return zstd_copy_literals(s, &lit, &lit_size, lit_size);
+}
+
+static int zstd_frame(zstd_ctx_t *ctx) {
+    decomp_stream_t *s = ctx->s;
+    int status;
+
+    int fhd = decomp_read_byte(s);
+    if (fhd < 0 || (fhd & 0x08)) {
+        return DECOMP_ERR_CORRUPT;
+    }
+    uint32_t fcs_flag = (uint32_t)fhd >> 6;
+    bool single_segment = (fhd >> 5) & 1;
+    bool checksum = (fhd >> 2) & 1;
+
+    if (!single_segment && decomp_read_byte(s) < 0) {
+        return DECOMP_ERR_CORRUPT; // Window descriptor: the whole frame stays in memory anyway
+    }
+
+    static const uint8_t did_sizes[4] = {0, 1, 2, 4};
+    uint8_t field[8];
+    uint32_t did_size = did_sizes[fhd & 3];
+    if ((status = decomp_read_exact(s, field, did_size)) != DECOMP_OK) {
+        return status;
+    }
+    if (did_size && zstd_le(field, did_size) != 0) {
+        return DECOMP_ERR_UNSUPPORTED; // Dictionary
+    }
+
+    uint32_t fcs_size = fcs_flag == 0 ? (single_segment ? 1 : 0) : (1u << fcs_flag);
+    uint64_t content_size = 0;
+    if ((status = decomp_read_exact(s, field, fcs_size)) != DECOMP_OK) {
+        return status;
+    }
+    for (uint32_t i = fcs_size; i > 0; i--) {
+        content_size = (content_size << 8) | field[i - 1];
+    }
+    if (fcs_size == 2) {
+        content_size += 256;
+    }
+    if (fcs_size != 0) {
+        if (content_size > SIZE_MAX) {
+            return DECOMP_ERR_TOO_LARGE;
+        }
+        if ((status = decomp_reserve(s, (size_t)content_size)) != DECOMP_OK) {
+            return status;
+        }
+    }
+
+    ctx->frame_start = s->out_len;
+    ctx->rep[0] = 1;
+    ctx->rep[1] = 4;
+    ctx->rep[2] = 8;
+    ctx->huf.valid = false;
+    ctx->ll.valid = ctx->of.valid = ctx->ml.valid = false;
+
+    bool last = false;
+    while (!last) {
+        uint8_t header[3];
+        if ((status = decomp_read_exact(s, header, 3)) != DECOMP_OK) {
+            return status;
+        }
+        uint32_t h = zstd_le(header, 3);
+        uint32_t type = (h >> 1) & 3;
+        uint32_t size = h >> 3;
+        last = h & 1;
+
+        if (size > ZSTD_BLOCK_MAX) {
+            return DECOMP_ERR_CORRUPT;
+        }
+        if (type == 0) {
+            // Raw
+            if ((status = decomp_reserve(s, size)) != DECOMP_OK ||
+                (status = decomp_read_exact(s, s->out + s->out_len, size)) != DECOMP_OK) {
+                return status;
+            }
+            s->out_len += size;
+        } else if (type == 1) {
+            // RLE: one byte, repeated `size` times
+            int byte = decomp_read_byte(s);
+            if (byte < 0) {
+                return DECOMP_ERR_CORRUPT;
+            }
+            if ((status = decomp_reserve(s, size)) != DECOMP_OK) {
+                return status;
+            }
+            memset(s->out + s->out_len, byte, size);
+            s->out_len += size;
+        } else if (type == 2) {
+            // Decode in place when the block is wholly buffered
+            const uint8_t *data = ctx->block;
+            if (s->in_pos == s->in_len) {
+                decomp_refill(s);
+            }
+            if (s->in_len - s->in_pos >= size) {
+                data = s->in + s->in_pos;
+                s->in_pos += size;
+            } else if ((status = decomp_read_exact(s, ctx->block, size)) != DECOMP_OK) {
+                return status;
+            }
+            size_t before = s->out_len;
+            if ((status = zstd_compressed_block(ctx, data, size)) != DECOMP_OK) {
+                return status;
+            }
+            if (s->out_len - before > ZSTD_BLOCK_MAX) {
+                return DECOMP_ERR_CORRUPT;
+            }
+        } else {
+            return DECOMP_ERR_CORRUPT;
+        }
+    }
+
+    if (fcs_size != 0 && s->out_len - ctx->frame_start != content_size) {
+        return DECOMP_ERR_CORRUPT;
+    }
+    if (checksum) {
+        uint8_t expected[4];
+        if ((status = decomp_read_exact(s, expected, 4)) != DECOMP_OK) {
+            return status;
+        }
+        uint32_t actual = (uint32_t)decomp_xxh64(s->out + ctx->frame_start, s->out_len - ctx->frame_start, 0);
+        if (actual != zstd_le(expected, 4)) {
+            return DECOMP_ERR_CHECKSUM;
+        }
+    }
+    return DECOMP_OK;
+}
+
+size_t zstd_workspace_size(void) {
+    return sizeof(zstd_ctx_t);
+}
+
+int zstd_decompress(decomp_stream_t *s) {
+    zstd_ctx_t *ctx = (zstd_ctx_t *)decomp_alloc(s, sizeof(zstd_ctx_t));
+    if (!ctx) {
+        return DECOMP_ERR_NO_MEMORY;
+    }
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->s = s;
+
+    int status = DECOMP_OK;
+    bool first = true;
+    while (status == DECOMP_OK && !(!first && decomp_input_done(s))) {
+        uint8_t magic_bytes[4];
+        if (decomp_read_exact(s, magic_bytes, 4) != DECOMP_OK) {
+            status = first ? DECOMP_ERR_CORRUPT : DECOMP_OK; // Fewer than four trailing bytes
+            break;
+        }
+        uint32_t magic = zstd_le(magic_bytes, 4);
+
+        if (magic == ZSTD_MAGIC) {
+            status = zstd_frame(ctx);
+        } else if ((magic & ZSTD_SKIPPABLE_MASK) == ZSTD_SKIPPABLE_MAGIC) {
+            status = decomp_read_exact(s, magic_bytes, 4);
+            if (status == DECOMP_OK) {
+                status = decomp_skip(s, zstd_le(magic_bytes, 4));
+            }
+        } else {
+            if (first) {
+                status = DECOMP_ERR_CORRUPT;
+            }
+            break; // Trailing data (padding)
+        }
+        first = false;
+    }
+
+    decomp_free(s, ctx);
+    return status;
+}
@@ -10,15 +10,18 @@
 #include <stdio.h>
 #include "compat.h"
 #include <string.h>
+#include <stdlib.h>
 #include "config_ini.h"
 
-int parse_ini(const char* filename, struct boot_menu_entry* entries, int max_entries) {
+int parse_ini(const char* filename, struct boot_menu_entry** out) {
     FILE* f = fopen(filename, "r");
     if (!f) return -1;
     char line[256];
     char current_section[64] = "";
+    struct boot_menu_entry* entries = NULL;
+    int capacity = 0;
     int count = 0;
-    while (fgets(line, sizeof(line), f) && count < max_entries) {
+    while (fgets(line, sizeof(line), f)) {
         char* p = line;
         while (*p == ' ' || *p == '\t') p++;
         if (*p == ';' || *p == '#') continue;
@@ -41,11 +44,24 @@ int parse_ini(const char* filename, struct boot_menu_entry* entries, int max_ent
         while (*value == ' ' || *value == '\t') value++;
         char* nl = strchr(value, '\n');
         if (nl) *nl = 0;
+        if (count == capacity) {
+            // Grow geometrically so hundreds of entries cost few copies
+            int grown = capacity ? capacity * 2 : 16;
+            struct boot_menu_entry* more = realloc(entries, (size_t)grown * sizeof(*entries));
+            if (!more) {
+                free(entries);
+                fclose(f);
+                return -1;
+            }
+            entries = more;
+            capacity = grown;
+        }
         snprintf(entries[count].section, sizeof(entries[count].section), "%s", current_section);
         snprintf(entries[count].name, sizeof(entries[count].name), "%s", key);
         snprintf(entries[count].path, sizeof(entries[count].path), "%s", value);
         count++;
     }
     fclose(f);
+    *out = entries;
     return count;
 } 
\ No newline at end of file
@@ -5,6 +5,9 @@
  * See the root of the repository for license details.
  */
 
+#ifndef BLOODHORN_CONFIG_INI_H
+#define BLOODHORN_CONFIG_INI_H
+
 struct boot_menu_entry {
     char section[128];
     char name[64];
@@ -12,13 +15,13 @@ struct boot_menu_entry {
 };
 
 /**
- * Parse INI configuration file and populate boot menu entries
+ * Parse INI configuration file into boot menu entries
  *
  * @param filename The path to the INI configuration file
- * @param entries Array to store parsed boot menu entries
- * @param max_entries Maximum number of entries to parse
- * @return Number of entries successfully parsed
+ * @param entries Receives an array grown to fit every entry; free() it
+ * @return Number of entries parsed, or -1 if the file cannot be read or
+ *         memory runs out
  */
-int parse_ini(const char* filename, struct boot_menu_entry* entries, int max_entries);
+int parse_ini(const char* filename, struct boot_menu_entry** entries);
 
-#endif // BLOODHORN_CONFIG_INI_H 
+#endif // BLOODHORN_CONFIG_INI_H
@@ -7,6 +7,13 @@
 
 #ifndef BLOODHORN_CONFIG_JSON_H
 #define BLOODHORN_CONFIG_JSON_H
-struct config_json { char key[32]; char value[128]; };
-int config_json_parse(const char* json, struct config_json* out);
-#endif 
\ No newline at end of file
+#include "config_parse.h"
+
+// One member, as views into the parsed text (section is the enclosing
+// object's key, empty at top level)
+struct config_json { config_sv section; config_sv key; config_sv value; int escaped; };
+
+// Returns the number of members, or -1 if the text is malformed or has
+// more than max_entries members
+int config_json_parse(const char* json, struct config_json* out, int max_entries);
+#endif
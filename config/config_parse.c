@@ -0,0 +1,299 @@
+/*
+ * config_parse.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+// Zero-copy INI and JSON tokenizers shared by the configuration loaders
+#include "config_parse.h"
+#include "compat.h"
+#include <string.h>
+
+#define CONFIG_JSON_MAX_DEPTH 32
+
+typedef struct {
+    const char* p;
+    const char* end;
+    uint32_t line;
+    config_entry_fn fn;
+    void* ctx;
+    config_error* err;
+} config_parser;
+
+static int config_fail(config_parser* ps, const char* what) {
+    if (ps->err) {
+        ps->err->line = ps->line;
+        ps->err->what = what;
+    }
+    return CONFIG_ERR_SYNTAX;
+}
+
+static int config_emit(config_parser* ps, config_sv section, config_sv key, config_sv value, int escaped) {
+    config_entry e = { section, key, value, escaped, ps->line };
+    if (ps->fn(ps->ctx, &e)) {
+        if (ps->err) {
+            ps->err->line = ps->line;
+            ps->err->what = "stopped";
+        }
+        return CONFIG_ERR_STOPPED;
+    }
+    return CONFIG_OK;
+}
+
+static int config_is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static config_sv config_trim(const char* start, const char* end) {
+    while (start < end && config_is_space(*start)) start++;
+    while (end > start && config_is_space(end[-1])) end--;
+    config_sv sv = { start, (size_t)(end - start) };
+    return sv;
+}
+
+int config_sv_ieq(config_sv sv, const char* s) {
+    size_t i = 0;
+    for (; i < sv.len; i++) {
+        char a = sv.ptr[i], b = s[i];
+        if (b == 0) return 0;
+        if (a >= 'A' && a <= 'Z') a = (char)(a - 'A' + 'a');
+        if (b >= 'A' && b <= 'Z') b = (char)(b - 'A' + 'a');
+        if (a != b) return 0;
+    }
+    return s[i] == 0;
+}
+
+/*
+ * INI: "[section]" headers, "key = value" lines, '#' and ';' comments.
+ * Lines without '=' are ignored, as they always were.
+ */
+int config_parse_ini(const char* buf, size_t len, config_entry_fn fn, void* ctx, config_error* err) {
+    config_parser ps = { buf, buf + len, 1, fn, ctx, err };
+    config_sv section = { buf, 0 };
+
+    while (ps.p < ps.end) {
+        const char* start = ps.p;
+        const char* eq = NULL;
+        while (ps.p < ps.end && *ps.p != '\n') {
+            unsigned char c = (unsigned char)*ps.p;
+            if ((c < 0x20 && c != '\t' && c != '\r') || c == 0x7F) {
+                return config_fail(&ps, "control character");
+            }
+            if (c == '=' && !eq) eq = ps.p;
+            ps.p++;
+        }
+        config_sv line = config_trim(start, ps.p);
+
+        if (line.len == 0 || line.ptr[0] == '#' || line.ptr[0] == ';') {
+            // Blank or comment
+        } else if (line.ptr[0] == '[') {
+            const char* rb = memchr(line.ptr, ']', line.len);
+            if (!rb) return config_fail(&ps, "unterminated section header");
+            section = config_trim(line.ptr + 1, rb);
+        } else if (eq) {
+            config_sv key = config_trim(line.ptr, eq);
+            config_sv value = config_trim(eq + 1, line.ptr + line.len);
+            if (key.len == 0) return config_fail(&ps, "empty key");
+            int rc = config_emit(&ps, section, key, value, 0);
+            if (rc != CONFIG_OK) return rc;
+        }
+
+        if (ps.p < ps.end) {
+            ps.p++;
+            ps.line++;
+        }
+    }
+    return CONFIG_OK;
+}
+
+static void json_skip_space(config_parser* ps) {
+    while (ps->p < ps->end) {
+        char c = *ps->p;
+        if (c == '\n') {
+            ps->line++;
+        } else if (!config_is_space(c)) {
+            break;
+        }
+        ps->p++;
+    }
+}
+
+// A string token; the view excludes the quotes
+static int json_string(config_parser* ps, config_sv* out, int* escaped) {
+    if (ps->p >= ps->end || *ps->p != '"') return config_fail(ps, "expected string");
+    const char* start = ++ps->p;
+    *escaped = 0;
+    while (ps->p < ps->end && *ps->p != '"') {
+        unsigned char c = (unsigned char)*ps->p;
+        if (c < 0x20) return config_fail(ps, "control character in string");
+        if (c == '\\') {
+            if (ps->p + 1 >= ps->end || ps->p[1] == 0 || !strchr("\"\\/bfnrtu", ps->p[1])) {
+                return config_fail(ps, "invalid escape");
+            }
+            *escaped = 1;
+            ps->p++;
+        }
+        ps->p++;
+    }
+    if (ps->p >= ps->end) return config_fail(ps, "unterminated string");
+    out->ptr = start;
+    out->len = (size_t)(ps->p - start);
+    ps->p++;
+    return CONFIG_OK;
+}
+
+static int json_value(config_parser* ps, config_sv section, config_sv key, int emit, int depth);
+
+static int json_object(config_parser* ps, config_sv section, int emit, int depth) {
+    if (depth > CONFIG_JSON_MAX_DEPTH) return config_fail(ps, "nesting too deep");
+    ps->p++; // '{'
+    json_skip_space(ps);
+    if (ps->p < ps->end && *ps->p == '}') {
+        ps->p++;
+        return CONFIG_OK;
+    }
+    for (;;) {
+        config_sv key;
+        int escaped, rc;
+        json_skip_space(ps);
+        if ((rc = json_string(ps, &key, &escaped)) != CONFIG_OK) return rc;
+        json_skip_space(ps);
+        if (ps->p >= ps->end || *ps->p != ':') return config_fail(ps, "expected ':'");
+        ps->p++;
+        json_skip_space(ps);
+        if ((rc = json_value(ps, section, key, emit, depth)) != CONFIG_OK) return rc;
+        json_skip_space(ps);
+        if (ps->p < ps->end && *ps->p == ',') {
+            ps->p++;
+            continue;
+        }
+        if (ps->p < ps->end && *ps->p == '}') {
+            ps->p++;
+            return CONFIG_OK;
+        }
+        return config_fail(ps, "expected ',' or '}'");
+    }
+}
+
+// Arrays are checked but their elements are not entries
+static int json_array(config_parser* ps, int depth) {
+    config_sv none = { ps->p, 0 };
+    if (depth > CONFIG_JSON_MAX_DEPTH) return config_fail(ps, "nesting too deep");
+    ps->p++; // '['
+    json_skip_space(ps);
+    if (ps->p < ps->end && *ps->p == ']') {
+        ps->p++;
+        return CONFIG_OK;
+    }
+    for (;;) {
+        int rc;
+        json_skip_space(ps);
+        if ((rc = json_value(ps, none, none, 0, depth)) != CONFIG_OK) return rc;
+        json_skip_space(ps);
+        if (ps->p < ps->end && *ps->p == ',') {
+            ps->p++;
+            continue;
+        }
+        if (ps->p < ps->end && *ps->p == ']') {
+            ps->p++;
+            return CONFIG_OK;
+        }
+        return config_fail(ps, "expected ',' or ']'");
+    }
+}
+
+static int json_value(config_parser* ps, config_sv section, config_sv key, int emit, int depth) {
+    if (ps->p >= ps->end) return config_fail(ps, "expected value");
+
+    switch (*ps->p) {
+        case '{':
+            // A nested object's members belong to the section named by its key
+            return json_object(ps, key, emit, depth + 1);
+        case '[':
+            return json_array(ps, depth + 1);
+        case '"': {
+            config_sv value;
+            int escaped;
+            int rc = json_string(ps, &value, &escaped);
+            if (rc != CONFIG_OK || !emit) return rc;
+            return config_emit(ps, section, key, value, escaped);
+        }
+        default: {
+            // Numbers and the true/false/null literals
+            const char* start = ps->p;
+            while (ps->p < ps->end &&
+                   ((*ps->p >= '0' && *ps->p <= '9') || (*ps->p >= 'a' && *ps->p <= 'z') ||
+                    *ps->p == '-' || *ps->p == '+' || *ps->p == '.' || *ps->p == 'E')) {
+                ps->p++;
+            }
+            if (ps->p == start) return config_fail(ps, "expected value");
+            if (!emit) return CONFIG_OK;
+            config_sv value = { start, (size_t)(ps->p - start) };
+            return config_emit(ps, section, key, value, 0);
+        }
+    }
+}
+
+int config_parse_json(const char* buf, size_t len, config_entry_fn fn, void* ctx, config_error* err) {
+    config_parser ps = { buf, buf + len, 1, fn, ctx, err };
+    config_sv top = { buf, 0 };
+
+    json_skip_space(&ps);
+    if (ps.p >= ps.end || *ps.p != '{') return config_fail(&ps, "expected '{'");
+    int rc = json_object(&ps, top, 1, 1);
+    if (rc != CONFIG_OK) return rc;
+    json_skip_space(&ps);
+    // Tolerate a trailing NUL from text loaded into a terminated buffer
+    if (ps.p < ps.end && *ps.p != 0) return config_fail(&ps, "trailing data");
+    return CONFIG_OK;
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+int config_sv_unescape(config_sv sv, int escaped, char* dst, size_t size) {
+    size_t out = 0;
+
+    if (size == 0) return -1;
+    for (size_t i = 0; i < sv.len; i++) {
+        char c = sv.ptr[i];
+        if (escaped && c == '\\' && i + 1 < sv.len) {
+            c = sv.ptr[++i];
+            switch (c) {
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'n': c = '\n'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                case 'u': {
+                    // Only the ASCII range fits the byte-string fields
+                    int v = 0;
+                    if (i + 4 >= sv.len) goto fail;
+                    for (int k = 1; k <= 4; k++) {
+                        int d = hex_digit(sv.ptr[i + k]);
+                        if (d < 0) goto fail;
+                        v = (v << 4) | d;
+                    }
+                    if (v == 0 || v > 0x7F) goto fail;
+                    c = (char)v;
+                    i += 4;
+                    break;
+                }
+                default: break; // '"', '\\' and '/' stand for themselves
+            }
+        }
+        if (out + 1 >= size) goto fail;
+        dst[out++] = c;
+    }
+    dst[out] = 0;
+    return (int)out;
+
+fail:
+    dst[0] = 0;
+    return -1;
+}
@@ -0,0 +1,56 @@
+/*
+ * config_parse.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_CONFIG_PARSE_H
+#define BLOODHORN_CONFIG_PARSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A run of bytes inside the configuration buffer; never NUL-terminated
+typedef struct {
+    const char* ptr;
+    size_t len;
+} config_sv;
+
+// One key/value pair as found in the text. Views point into the caller's
+// buffer. JSON string values exclude their quotes and keep any escapes,
+// which config_sv_unescape expands.
+typedef struct {
+    config_sv section;      // INI [section] or enclosing JSON object key; empty at top level
+    config_sv key;
+    config_sv value;
+    int escaped;            // value holds JSON backslash escapes
+    uint32_t line;
+} config_entry;
+
+// Return nonzero to stop the parse
+typedef int (*config_entry_fn)(void* ctx, const config_entry* entry);
+
+#define CONFIG_OK           0
+#define CONFIG_ERR_SYNTAX   -1      // Malformed text or a control character in a key or value
+#define CONFIG_ERR_STOPPED  -2      // The callback asked to stop
+
+typedef struct {
+    uint32_t line;
+    const char* what;
+} config_error;
+
+// Single pass over the buffer; keys and values are checked as they are
+// scanned and handed out as views, with no copies and no entry limit
+int config_parse_ini(const char* buf, size_t len, config_entry_fn fn, void* ctx, config_error* err);
+int config_parse_json(const char* buf, size_t len, config_entry_fn fn, void* ctx, config_error* err);
+
+// ASCII case-insensitive comparison of a view with a C string
+int config_sv_ieq(config_sv sv, const char* s);
+
+// Copy a value into dst (size bytes with the NUL), expanding JSON escapes
+// when escaped is set. Returns the length, or -1 if it does not fit or an
+// escape is invalid; dst is left empty then.
+int config_sv_unescape(config_sv sv, int escaped, char* dst, size_t size);
+
+#endif
@@ -0,0 +1,568 @@
+/*
+ * coreboot_ahci.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/DebugLib.h>
+#include <Library/IoLib.h>
+#include <Library/TimerLib.h>
+#include <Library/CacheMaintenanceLib.h>
+#include "coreboot_platform.h"
+#include "coreboot_ahci.h"
+
+#define AHCI_PCI_CLASS              0x010601    // Mass storage, SATA, AHCI
+#define AHCI_PCI_BAR                0x24        // ABAR
+
+// HBA registers
+#define AHCI_REG_CAP                0x00
+#define AHCI_REG_GHC                0x04
+#define AHCI_REG_PI                 0x0C
+#define AHCI_CAP_NCS(Cap)           ((((Cap) >> 8) & 0x1F) + 1)
+#define AHCI_CAP_SNCQ               BIT30
+#define AHCI_CAP_S64A               BIT31
+#define AHCI_GHC_AE                 BIT31
+#define AHCI_MAX_PORTS              32
+
+// Port registers
+#define AHCI_PORT_BASE(Port)        (0x100 + (Port) * 0x80)
+#define AHCI_PXCLB                  0x00
+#define AHCI_PXFB                   0x08
+#define AHCI_PXIS                   0x10
+#define AHCI_PXIE                   0x14
+#define AHCI_PXCMD                  0x18
+#define AHCI_PXTFD                  0x20
+#define AHCI_PXSIG                  0x24
+#define AHCI_PXSSTS                 0x28
+#define AHCI_PXSCTL                 0x2C
+#define AHCI_PXSERR                 0x30
+#define AHCI_PXSACT                 0x34
+#define AHCI_PXCI                   0x38
+
+#define AHCI_PXCMD_ST               BIT0
+#define AHCI_PXCMD_SUD              BIT1
+#define AHCI_PXCMD_POD              BIT2
+#define AHCI_PXCMD_FRE              BIT4
+#define AHCI_PXCMD_FR               BIT14
+#define AHCI_PXCMD_CR               BIT15
+#define AHCI_PXIS_TFES              BIT30
+#define AHCI_PXTFD_BUSY             (BIT7 | BIT3)   // BSY, DRQ
+#define AHCI_SSTS_DET_MASK          0xF
+#define AHCI_SSTS_DET_PRESENT       3           // Device present, link up
+#define AHCI_SCTL_DET_COMRESET      1
+#define AHCI_SIG_ATA                0x00000101
+
+// ATA
+#define ATA_FIS_H2D                 0x27
+#define ATA_FIS_COMMAND             0x80        // C bit: the FIS carries a command
+#define ATA_DEVICE_LBA              BIT6
+#define ATA_CMD_IDENTIFY            0xEC
+#define ATA_CMD_READ_DMA_EXT        0x25
+#define ATA_CMD_READ_FPDMA_QUEUED   0x60
+
+#define ATA_ID_QUEUE_DEPTH          75
+#define ATA_ID_SATA_CAPS            76
+#define ATA_ID_COMMAND_SET_2        83
+#define ATA_ID_LBA48_SECTORS        100
+#define ATA_ID_SECTOR_SIZE          106
+#define ATA_SATA_CAPS_NCQ           BIT8
+#define ATA_COMMAND_SET_2_LBA48     BIT10
+#define ATA_SECTOR_SIZE_VALID       0x4000      // Bits 15:14 = 01b
+#define ATA_SECTOR_SIZE_LONG        BIT12       // Logical sectors above 512 bytes
+
+#define AHCI_CFIS_DWORDS            5
+#define AHCI_COMMAND_TIMEOUT_US     5000000
+#define AHCI_POLL_US                1
+
+typedef struct {
+    UINT32 Flags;               // CFL in 4:0, W in 6, PRDTL in 31:16
+    UINT32 Prdbc;
+    UINT64 Ctba;                // 128-byte aligned
+    UINT32 Reserved[4];
+} AHCI_COMMAND_HEADER;
+
+typedef struct {
+    UINT64 Dba;                 // Word aligned
+    UINT32 Reserved;
+    UINT32 Dbc;                 // Byte count - 1
+} AHCI_PRD;
+
+// Buffers are physically contiguous here, so a command needs one PRD;
+// the padding keeps every table in the array 128-byte aligned
+typedef struct {
+    UINT8 Cfis[64];
+    UINT8 Acmd[16];
+    UINT8 Reserved[48];
+    AHCI_PRD Prd;
+    UINT8 Pad[112];
+} AHCI_COMMAND_TABLE;
+
+typedef struct {
+    UINTN Port;                 // Port register base
+    UINT32 Slots;               // Command slots (and NCQ tags) in use
+    BOOLEAN Ncq;
+    BOOLEAN Addr64;             // HBA takes structures above 4 GiB
+    AHCI_COMMAND_HEADER* CommandList;   // 32 headers, then the received-FIS area
+    AHCI_COMMAND_TABLE* Tables;         // One per slot
+    UINT32 Busy;                // Slots in flight
+    UINT8* Bounce;              // COREBOOT_AHCI_MAX_TRANSFER bytes
+    BOOLEAN Failed;             // The port could not be recovered
+    block_device_t Device;
+} AHCI_CONTROLLER;
+
+STATIC AHCI_CONTROLLER cb_ahci = {0};
+
+// x86 DMA is cache-coherent; elsewhere command structures and buffers
+// are cleaned before the HBA reads them and invalidated before the CPU does
+STATIC
+VOID
+AhciDmaToDevice (
+  IN VOID* Address,
+  IN UINTN Size
+  )
+{
+#if !defined(MDE_CPU_IA32) && !defined(MDE_CPU_X64)
+    WriteBackDataCacheRange(Address, Size);
+#endif
+}
+
+STATIC
+VOID
+AhciDmaFromDevice (
+  IN VOID* Address,
+  IN UINTN Size
+  )
+{
+#if !defined(MDE_CPU_IA32) && !defined(MDE_CPU_X64)
+    InvalidateDataCacheRange(Address, Size);
+#endif
+}
+
+STATIC
+UINT32
+AhciRead (
+  IN AHCI_CONTROLLER* Ahci,
+  IN UINTN Reg
+  )
+{
+    return MmioRead32(Ahci->Port + Reg);
+}
+
+STATIC
+VOID
+AhciWrite (
+  IN AHCI_CONTROLLER* Ahci,
+  IN UINTN Reg,
+  IN UINT32 Value
+  )
+{
+    MmioWrite32(Ahci->Port + Reg, Value);
+}
+
+STATIC
+EFI_STATUS
+AhciWaitClear (
+  IN AHCI_CONTROLLER* Ahci,
+  IN UINTN Reg,
+  IN UINT32 Mask,
+  IN UINT32 TimeoutMs
+  )
+{
+    for (UINT32 Waited = 0; Waited <= TimeoutMs; Waited++) {
+        if ((AhciRead(Ahci, Reg) & Mask) == 0) {
+            return EFI_SUCCESS;
+        }
+        MicroSecondDelay(1000);
+    }
+    return EFI_TIMEOUT;
+}
+
+STATIC
+EFI_STATUS
+AhciPortStop (
+  IN AHCI_CONTROLLER* Ahci
+  )
+{
+    AhciWrite(Ahci, AHCI_PXCMD, AhciRead(Ahci, AHCI_PXCMD) & ~AHCI_PXCMD_ST);
+    if (EFI_ERROR(AhciWaitClear(Ahci, AHCI_PXCMD, AHCI_PXCMD_CR, 500))) {
+        return EFI_TIMEOUT;
+    }
+    AhciWrite(Ahci, AHCI_PXCMD, AhciRead(Ahci, AHCI_PXCMD) & ~AHCI_PXCMD_FRE);
+    return AhciWaitClear(Ahci, AHCI_PXCMD, AHCI_PXCMD_FR, 500);
+}
+
+/**
+ * Point the port at our command list and FIS area and start it. A drive
+ * still busy from an earlier error is reset first.
+ */
+STATIC
+EFI_STATUS
+AhciPortStart (
+  IN AHCI_CONTROLLER* Ahci
+  )
+{
+    UINT64 List = (UINTN)Ahci->CommandList;
+    UINT64 Fis = List + 32 * sizeof(AHCI_COMMAND_HEADER);
+
+    AhciWrite(Ahci, AHCI_PXCLB, (UINT32)List);
+    AhciWrite(Ahci, AHCI_PXCLB + 4, (UINT32)RShiftU64(List, 32));
+    AhciWrite(Ahci, AHCI_PXFB, (UINT32)Fis);
+    AhciWrite(Ahci, AHCI_PXFB + 4, (UINT32)RShiftU64(Fis, 32));
+    AhciWrite(Ahci, AHCI_PXSERR, MAX_UINT32);
+    AhciWrite(Ahci, AHCI_PXIS, MAX_UINT32);
+    AhciWrite(Ahci, AHCI_PXIE, 0);
+    AhciWrite(Ahci, AHCI_PXCMD, AhciRead(Ahci, AHCI_PXCMD) | AHCI_PXCMD_SUD | AHCI_PXCMD_POD | AHCI_PXCMD_FRE);
+
+    if (EFI_ERROR(AhciWaitClear(Ahci, AHCI_PXTFD, AHCI_PXTFD_BUSY, 1000))) {
+        // COMRESET, then wait for the link to come back
+        AhciWrite(Ahci, AHCI_PXSCTL, (AhciRead(Ahci, AHCI_PXSCTL) & ~0xFu) | AHCI_SCTL_DET_COMRESET);
+        MicroSecondDelay(1000);
+        AhciWrite(Ahci, AHCI_PXSCTL, AhciRead(Ahci, AHCI_PXSCTL) & ~0xFu);
+
+        UINT32 Waited = 0;
+        while ((AhciRead(Ahci, AHCI_PXSSTS) & AHCI_SSTS_DET_MASK) != AHCI_SSTS_DET_PRESENT) {
+            if (++Waited > 1000) {
+                return EFI_DEVICE_ERROR;
+            }
+            MicroSecondDelay(1000);
+        }
+        AhciWrite(Ahci, AHCI_PXSERR, MAX_UINT32);
+        if (EFI_ERROR(AhciWaitClear(Ahci, AHCI_PXTFD, AHCI_PXTFD_BUSY, 5000))) {
+            return EFI_DEVICE_ERROR;
+        }
+    }
+
+    AhciWrite(Ahci, AHCI_PXCMD, AhciRead(Ahci, AHCI_PXCMD) | AHCI_PXCMD_ST);
+    return EFI_SUCCESS;
+}
+
+/**
+ * After a failed or stuck command: stop the port, which aborts everything
+ * in flight, and start it again (with a COMRESET if the drive stays busy,
+ * which also clears its NCQ error state)
+ */
+STATIC
+VOID
+AhciPortRecover (
+  IN AHCI_CONTROLLER* Ahci
+  )
+{
+    Ahci->Busy = 0;
+    if (EFI_ERROR(AhciPortStop(Ahci)) || EFI_ERROR(AhciPortStart(Ahci))) {
+        DEBUG((DEBUG_ERROR, "AHCI: port did not recover\n"));
+        Ahci->Failed = TRUE;
+    }
+}
+
+/**
+ * Fill a slot's header, FIS and PRD for a read of Bytes into Address
+ */
+STATIC
+VOID
+AhciBuildRead (
+  IN AHCI_CONTROLLER* Ahci,
+  IN UINT32 Slot,
+  IN UINT8 Command,
+  IN UINT64 Lba,
+  IN UINT32 Sectors,
+  IN UINTN Address,
+  IN UINTN Bytes
+  )
+{
+    AHCI_COMMAND_TABLE* Table = &Ahci->Tables[Slot];
+    AHCI_COMMAND_HEADER* Header = &Ahci->CommandList[Slot];
+    UINT8* Fis = Table->Cfis;
+
+    ZeroMem(Fis, sizeof(Table->Cfis));
+    Fis[0] = ATA_FIS_H2D;
+    Fis[1] = ATA_FIS_COMMAND;
+    Fis[2] = Command;
+    Fis[4] = (UINT8)Lba;
+    Fis[5] = (UINT8)RShiftU64(Lba, 8);
+    Fis[6] = (UINT8)RShiftU64(Lba, 16);
+    Fis[7] = ATA_DEVICE_LBA;
+    Fis[8] = (UINT8)RShiftU64(Lba, 24);
+    Fis[9] = (UINT8)RShiftU64(Lba, 32);
+    Fis[10] = (UINT8)RShiftU64(Lba, 40);
+    if (Command == ATA_CMD_READ_FPDMA_QUEUED) {
+        // Sector count moves to the feature field; the count field holds the tag
+        Fis[3] = (UINT8)Sectors;
+        Fis[11] = (UINT8)(Sectors >> 8);
+        Fis[12] = (UINT8)(Slot << 3);
+    } else {
+        Fis[12] = (UINT8)Sectors;
+        Fis[13] = (UINT8)(Sectors >> 8);
+    }
+
+    Table->Prd.Dba = Address;
+    Table->Prd.Reserved = 0;
+    Table->Prd.Dbc = (UINT32)Bytes - 1;
+
+    Header->Flags = AHCI_CFIS_DWORDS | (1u << 16);
+    Header->Prdbc = 0;
+    Header->Ctba = (UINTN)Table;
+
+    AhciDmaToDevice(Table, sizeof(*Table));
+    AhciDmaToDevice(Header, sizeof(*Header));
+}
+
+/**
+ * Read whole sectors into a word-aligned buffer. Every free slot gets a
+ * command, all of them are issued with one register write, and each slot
+ * the drive finishes is refilled, so the drive keeps a full queue to
+ * reorder until the request is done.
+ */
+STATIC
+EFI_STATUS
+AhciReadSectors (
+  IN  AHCI_CONTROLLER* Ahci,
+  IN  UINT64 Lba,
+  IN  UINT64 Sectors,
+  OUT VOID* Buffer
+  )
+{
+    UINT32 SlotMask = Ahci->Slots == 32 ? MAX_UINT32 : (1u << Ahci->Slots) - 1;
+    UINT8 Command = Ahci->Ncq ? ATA_CMD_READ_FPDMA_QUEUED : ATA_CMD_READ_DMA_EXT;
+    UINTN Address = (UINTN)Buffer;
+    UINT64 Remaining = Sectors;
+
+    AhciDmaToDevice(Buffer, (UINTN)Sectors * BLOCKDEV_SECTOR_SIZE);
+
+    while (Remaining > 0 || Ahci->Busy != 0) {
+        UINT32 Issued = 0;
+
+        // Without NCQ the drive takes one command at a time
+        while (Remaining > 0 && (~Ahci->Busy & SlotMask) != 0 && (Ahci->Ncq || Ahci->Busy == 0)) {
+            UINT32 Slot = (UINT32)LowBitSet32(~Ahci->Busy & SlotMask);
+            UINT32 Count = (UINT32)MIN(Remaining, COREBOOT_AHCI_MAX_TRANSFER / BLOCKDEV_SECTOR_SIZE);
+            UINTN Bytes = (UINTN)Count * BLOCKDEV_SECTOR_SIZE;
+
+            AhciBuildRead(Ahci, Slot, Command, Lba, Count, Address, Bytes);
+            Ahci->Busy |= 1u << Slot;
+            Issued |= 1u << Slot;
+            Lba += Count;
+            Address += Bytes;
+            Remaining -= Count;
+        }
+        if (Issued != 0) {
+            MemoryFence();
+            if (Ahci->Ncq) {
+                AhciWrite(Ahci, AHCI_PXSACT, Issued);
+            }
+            AhciWrite(Ahci, AHCI_PXCI, Issued);
+        }
+
+        // A queued command is done when the drive clears its SACT bit;
+        // CI only says the command was delivered
+        UINT32 Done = 0;
+        for (UINT32 Waited = 0; Done == 0; Waited += AHCI_POLL_US) {
+            if (AhciRead(Ahci, AHCI_PXIS) & AHCI_PXIS_TFES) {
+                DEBUG((DEBUG_WARN, "AHCI: read failed, task file 0x%x\n", AhciRead(Ahci, AHCI_PXTFD)));
+                AhciPortRecover(Ahci);
+                return EFI_DEVICE_ERROR;
+            }
+            Done = Ahci->Busy & ~AhciRead(Ahci, Ahci->Ncq ? AHCI_PXSACT : AHCI_PXCI);
+            if (Done == 0) {
+                if (Waited >= AHCI_COMMAND_TIMEOUT_US) {
+                    DEBUG((DEBUG_ERROR, "AHCI: read timed out, slots 0x%x outstanding\n", Ahci->Busy));
+                    AhciPortRecover(Ahci);
+                    return EFI_TIMEOUT;
+                }
+                MicroSecondDelay(AHCI_POLL_US);
+            }
+        }
+        Ahci->Busy &= ~Done;
+    }
+
+    AhciWrite(Ahci, AHCI_PXIS, AhciRead(Ahci, AHCI_PXIS));
+    AhciDmaFromDevice(Buffer, (UINTN)Sectors * BLOCKDEV_SECTOR_SIZE);
+    return EFI_SUCCESS;
+}
+
+STATIC
+int
+CorebootAhciRead (
+  block_device_t* dev,
+  uint64_t sector,
+  uint32_t count,
+  void* buf
+  )
+{
+    AHCI_CONTROLLER* Ahci = (AHCI_CONTROLLER*)dev->context;
+    UINT8* Out = buf;
+
+    if (Ahci->Failed || sector >= dev->sector_count || count > dev->sector_count - sector) {
+        return -1;
+    }
+
+    if (((UINTN)buf & 1) == 0) {
+        return EFI_ERROR(AhciReadSectors(Ahci, sector, count, buf)) ? -1 : 0;
+    }
+
+    // PRDs need a word-aligned address
+    while (count > 0) {
+        UINT32 Chunk = MIN(count, COREBOOT_AHCI_MAX_TRANSFER / BLOCKDEV_SECTOR_SIZE);
+        if (EFI_ERROR(AhciReadSectors(Ahci, sector, Chunk, Ahci->Bounce))) {
+            return -1;
+        }
+        CopyMem(Out, Ahci->Bounce, (UINTN)Chunk * BLOCKDEV_SECTOR_SIZE);
+        Out += (UINTN)Chunk * BLOCKDEV_SECTOR_SIZE;
+        sector += Chunk;
+        count -= Chunk;
+    }
+    return 0;
+}
+
+/**
+ * IDENTIFY DEVICE on slot 0: size, LBA48, NCQ depth
+ */
+STATIC
+EFI_STATUS
+AhciIdentify (
+  IN AHCI_CONTROLLER* Ahci,
+  IN UINT32 HbaSlots
+  )
+{
+    UINT16* Id = (UINT16*)Ahci->Bounce;
+    AHCI_COMMAND_TABLE* Table = &Ahci->Tables[0];
+
+    ZeroMem(Table->Cfis, sizeof(Table->Cfis));
+    Table->Cfis[0] = ATA_FIS_H2D;
+    Table->Cfis[1] = ATA_FIS_COMMAND;
+    Table->Cfis[2] = ATA_CMD_IDENTIFY;
+    Table->Prd.Dba = (UINTN)Id;
+    Table->Prd.Reserved = 0;
+    Table->Prd.Dbc = 511;
+    Ahci->CommandList[0].Flags = AHCI_CFIS_DWORDS | (1u << 16);
+    Ahci->CommandList[0].Prdbc = 0;
+    Ahci->CommandList[0].Ctba = (UINTN)Table;
+    AhciDmaToDevice(Table, sizeof(*Table));
+    AhciDmaToDevice(Ahci->CommandList, sizeof(AHCI_COMMAND_HEADER));
+    AhciDmaToDevice(Id, 512);
+
+    MemoryFence();
+    AhciWrite(Ahci, AHCI_PXCI, 1);
+    for (UINT32 Waited = 0; AhciRead(Ahci, AHCI_PXCI) & 1; Waited += AHCI_POLL_US) {
+        if ((AhciRead(Ahci, AHCI_PXIS) & AHCI_PXIS_TFES) || Waited >= AHCI_COMMAND_TIMEOUT_US) {
+            AhciPortRecover(Ahci);
+            return EFI_DEVICE_ERROR;
+        }
+        MicroSecondDelay(AHCI_POLL_US);
+    }
+    AhciWrite(Ahci, AHCI_PXIS, AhciRead(Ahci, AHCI_PXIS));
+    AhciDmaFromDevice(Id, 512);
+
+    // LBA48 is needed for both read commands; 4Kn drives are not handled
+    if (!(Id[ATA_ID_COMMAND_SET_2] & ATA_COMMAND_SET_2_LBA48)) {
+        return EFI_UNSUPPORTED;
+    }
+    if ((Id[ATA_ID_SECTOR_SIZE] & 0xC000) == ATA_SECTOR_SIZE_VALID && (Id[ATA_ID_SECTOR_SIZE] & ATA_SECTOR_SIZE_LONG)) {
+        return EFI_UNSUPPORTED;
+    }
+
+    UINT64 Sectors = 0;
+    for (UINTN Word = 0; Word < 4; Word++) {
+        Sectors |= LShiftU64(Id[ATA_ID_LBA48_SECTORS + Word], 16 * Word);
+    }
+    if (Sectors == 0) {
+        return EFI_UNSUPPORTED;
+    }
+    Ahci->Device.sector_count = Sectors;
+
+    if (Ahci->Ncq && (Id[ATA_ID_SATA_CAPS] & ATA_SATA_CAPS_NCQ)) {
+        Ahci->Slots = MIN(HbaSlots, (UINT32)(Id[ATA_ID_QUEUE_DEPTH] & 0x1F) + 1);
+    } else {
+        Ahci->Ncq = FALSE;
+        Ahci->Slots = 1;
+    }
+    return EFI_SUCCESS;
+}
+
+EFI_STATUS
+EFIAPI
+CorebootAhciInit (
+  OUT block_device_t** Device
+  )
+{
+    AHCI_CONTROLLER* Ahci = &cb_ahci;
+    UINTN PciAddress = 0;
+    EFI_STATUS Status;
+
+    if (Ahci->Device.read != NULL) {
+        *Device = &Ahci->Device;
+        return EFI_SUCCESS;
+    }
+    if (!CorebootPciFindClass(AHCI_PCI_CLASS, &PciAddress)) {
+        return EFI_NOT_FOUND;
+    }
+
+    UINT64 Base = CorebootPciEnableMemoryBar(PciAddress, AHCI_PCI_BAR);
+    if (Base == 0) {
+        return EFI_NOT_READY;                   // coreboot left the BAR unassigned
+    }
+
+    UINTN Abar = (UINTN)Base;
+    MmioWrite32(Abar + AHCI_REG_GHC, MmioRead32(Abar + AHCI_REG_GHC) | AHCI_GHC_AE);
+    UINT32 Cap = MmioRead32(Abar + AHCI_REG_CAP);
+    UINT32 Implemented = MmioRead32(Abar + AHCI_REG_PI);
+
+    // First port with a SATA disk linked up
+    UINT32 Port = 0;
+    for (; Port < AHCI_MAX_PORTS; Port++) {
+        UINTN PortBase = Abar + AHCI_PORT_BASE(Port);
+        if ((Implemented & (1u << Port)) &&
+            (MmioRead32(PortBase + AHCI_PXSSTS) & AHCI_SSTS_DET_MASK) == AHCI_SSTS_DET_PRESENT &&
+            MmioRead32(PortBase + AHCI_PXSIG) == AHCI_SIG_ATA) {
+            break;
+        }
+    }
+    if (Port == AHCI_MAX_PORTS) {
+        return EFI_NOT_FOUND;
+    }
+
+    ZeroMem(Ahci, sizeof(*Ahci));
+    Ahci->Port = Abar + AHCI_PORT_BASE(Port);
+    Ahci->Ncq = (Cap & AHCI_CAP_SNCQ) != 0;
+    Ahci->Addr64 = (Cap & AHCI_CAP_S64A) != 0;
+
+    // Command list (1 KiB) and received FISes (256 bytes) share a page
+    Ahci->CommandList = AllocatePages(1);
+    Ahci->Tables = AllocatePages(EFI_SIZE_TO_PAGES(32 * sizeof(AHCI_COMMAND_TABLE)));
+    Ahci->Bounce = AllocatePages(EFI_SIZE_TO_PAGES(COREBOOT_AHCI_MAX_TRANSFER));
+    if (Ahci->CommandList == NULL || Ahci->Tables == NULL || Ahci->Bounce == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    if (!Ahci->Addr64 && ((UINT64)(UINTN)Ahci->Tables >= SIZE_4GB || (UINT64)(UINTN)Ahci->Bounce >= SIZE_4GB ||
+                          (UINT64)(UINTN)Ahci->CommandList >= SIZE_4GB)) {
+        return EFI_UNSUPPORTED;
+    }
+    ZeroMem(Ahci->CommandList, EFI_PAGE_SIZE);
+    ZeroMem(Ahci->Tables, 32 * sizeof(AHCI_COMMAND_TABLE));
+    AhciDmaToDevice(Ahci->CommandList, EFI_PAGE_SIZE);
+
+    Status = AhciPortStop(Ahci);
+    if (!EFI_ERROR(Status)) {
+        Status = AhciPortStart(Ahci);
+    }
+    if (!EFI_ERROR(Status)) {
+        Status = AhciIdentify(Ahci, AHCI_CAP_NCS(Cap));
+    }
+    if (EFI_ERROR(Status)) {
+        DEBUG((DEBUG_WARN, "AHCI: port %u did not start: %r\n", Port, Status));
+        return Status;
+    }
+
+    DEBUG((DEBUG_INFO, "AHCI: port %u, %lu sectors, %a, %u slots\n",
+           Port, Ahci->Device.sector_count, Ahci->Ncq ? "NCQ" : "no NCQ", Ahci->Slots));
+
+    Ahci->Device.name = "ahci";
+    Ahci->Device.read = CorebootAhciRead;
+    Ahci->Device.context = Ahci;
+    *Device = &Ahci->Device;
+    return EFI_SUCCESS;
+}
@@ -0,0 +1,28 @@
+/*
+ * coreboot_ahci.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef COREBOOT_AHCI_H
+#define COREBOOT_AHCI_H
+
+#include <Uefi.h>
+#include "../fs/blockdev.h"
+
+// Polled AHCI driver for payload mode. The first SATA disk on the first
+// AHCI controller on the PCI bus becomes a block device. With NCQ (drive
+// and HBA both support it) a read is split into commands of up to
+// COREBOOT_AHCI_MAX_TRANSFER and up to 32 of them are queued at once:
+// every free tag is issued with one SACT and one CI write, and tags are
+// reused as the drive finishes them, in whatever order it chooses.
+// Without NCQ the same commands go out one at a time as READ DMA EXT.
+// Buffers at odd addresses go through a bounce buffer.
+#define COREBOOT_AHCI_MAX_TRANSFER  (256 * 1024)  // Per command
+
+// Find and start the controller and port. On success *Device reads the
+// disk and stays valid for the rest of the boot.
+EFI_STATUS EFIAPI CorebootAhciInit(OUT block_device_t** Device);
+
+#endif // COREBOOT_AHCI_H
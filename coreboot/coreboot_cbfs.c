@@ -0,0 +1,312 @@
+/*
+ * coreboot_cbfs.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include "coreboot_platform.h"
+#include "coreboot_cbfs.h"
+#include "../compress/decompress.h"
+#include "../uefi/uefi.h"
+
+// On-flash structures; every field is big-endian
+#define CBFS_HEADER_MAGIC       0x4F524243  // "ORBC"
+#define CBFS_HEADER_POINTER     0xFFFFFFFCULL
+#define CBFS_FILE_MAGIC         "LARCHIVE"
+#define CBFS_ALIGNMENT          64
+#define CBFS_NAME_MAX           256
+
+#define CBFS_FILE_ATTR_TAG_UNUSED       0x00000000
+#define CBFS_FILE_ATTR_TAG_UNUSED2      0xFFFFFFFF
+#define CBFS_FILE_ATTR_TAG_COMPRESSION  0x42435A4C  // "BCZL"
+
+typedef struct {
+    UINT32 magic;
+    UINT32 version;
+    UINT32 romsize;
+    UINT32 bootblocksize;
+    UINT32 align;
+    UINT32 offset;
+    UINT32 architecture;
+    UINT32 pad;
+} CBFS_MASTER_HEADER;
+
+typedef struct {
+    CHAR8 magic[8];
+    UINT32 len;
+    UINT32 type;
+    UINT32 attributes_offset;
+    UINT32 offset;
+} CBFS_FILE_HEADER;
+
+typedef struct {
+    UINT32 tag;
+    UINT32 len;
+    UINT32 compression;
+    UINT32 decompressed_size;
+} CBFS_ATTR_COMPRESSION;
+
+// Input side of a streamed decompression: the stored bytes of one file
+typedef struct {
+    CONST CBFS_MEDIA* media;
+    UINT64 offset;
+    UINT64 remaining;
+} CBFS_STREAM;
+
+/**
+ * Read from the region, straight from the mapping when there is one
+ */
+STATIC
+EFI_STATUS
+CbfsRead (
+  IN  CONST CBFS_MEDIA* Media,
+  IN  UINT64 Offset,
+  OUT VOID* Buffer,
+  IN  UINTN Size
+  )
+{
+    if (Offset > Media->Size || Size > Media->Size - Offset) {
+        return EFI_END_OF_MEDIA;
+    }
+    if (Media->Mapped) {
+        CopyMem(Buffer, Media->Mapped + Offset, Size);
+        return EFI_SUCCESS;
+    }
+    if (!Media->Read) {
+        return EFI_UNSUPPORTED;
+    }
+    return Media->Read(Media->Context, Offset, Buffer, Size);
+}
+
+/**
+ * decomp_read_fn over the stored bytes of a file
+ */
+STATIC
+int
+CbfsStreamRead (
+  void* context,
+  uint8_t* buf,
+  uint32_t len
+  )
+{
+    CBFS_STREAM* stream = (CBFS_STREAM*)context;
+    UINTN chunk = (UINTN)MIN((UINT64)len, stream->remaining);
+
+    if (chunk == 0) {
+        return 0;
+    }
+    if (EFI_ERROR(CbfsRead(stream->media, stream->offset, buf, chunk))) {
+        return DECOMP_ERR_IO;
+    }
+    stream->offset += chunk;
+    stream->remaining -= chunk;
+    return (int)chunk;
+}
+
+/**
+ * Find the boot flash CBFS region in the CPU address space
+ */
+EFI_STATUS
+EFIAPI
+CbfsOpenBootMedia (
+  OUT CBFS_MEDIA* Media
+  )
+{
+    if (!Media) {
+        return EFI_INVALID_PARAMETER;
+    }
+    SetMem(Media, sizeof(*Media), 0);
+
+#if defined(MDE_CPU_X64) || defined(MDE_CPU_IA32)
+    // x86 maps the boot flash so that it ends at 4 GiB
+    CONST COREBOOT_TABLE_INFO* info = CorebootGetTableInfo();
+    if (info && info->boot_media) {
+        CONST COREBOOT_BOOT_MEDIA* bm = info->boot_media;
+        if (bm->boot_media_size == 0 || bm->boot_media_size > SIZE_4GB ||
+            bm->cbfs_offset + bm->cbfs_size > bm->boot_media_size) {
+            return EFI_VOLUME_CORRUPTED;
+        }
+        Media->Mapped = (CONST UINT8*)(UINTN)(SIZE_4GB - bm->boot_media_size + bm->cbfs_offset);
+        Media->Size = bm->cbfs_size;
+        return EFI_SUCCESS;
+    }
+
+    // Older coreboot: a relative pointer to the master header in the last
+    // four bytes of the flash
+    INT32 rel = *(volatile INT32*)(UINTN)CBFS_HEADER_POINTER;
+    CONST CBFS_MASTER_HEADER* header = (CONST CBFS_MASTER_HEADER*)(UINTN)(SIZE_4GB + (INT64)rel);
+    if (rel >= 0 || SwapBytes32(header->magic) != CBFS_HEADER_MAGIC) {
+        return EFI_NOT_FOUND;
+    }
+
+    UINT32 romsize = SwapBytes32(header->romsize);
+    UINT32 offset = SwapBytes32(header->offset);
+    UINT32 bootblock = SwapBytes32(header->bootblocksize);
+    if (romsize == 0 || (UINT64)offset + bootblock > romsize) {
+        return EFI_VOLUME_CORRUPTED;
+    }
+    Media->Mapped = (CONST UINT8*)(UINTN)(SIZE_4GB - romsize + offset);
+    Media->Size = romsize - offset - bootblock;
+    return EFI_SUCCESS;
+#else
+    // Flash is not memory-mapped here; callers supply a read backend
+    return EFI_UNSUPPORTED;
+#endif
+}
+
+/**
+ * Walk the file headers for Name and describe its data
+ */
+EFI_STATUS
+EFIAPI
+CbfsLocate (
+  IN  CONST CBFS_MEDIA* Media,
+  IN  CONST CHAR8* Name,
+  OUT CBFS_FILE* File
+  )
+{
+    UINT8 record[sizeof(CBFS_FILE_HEADER) + CBFS_NAME_MAX];
+    UINTN name_len;
+    UINT64 pos = 0;
+
+    if (!Media || !Name || !File) {
+        return EFI_INVALID_PARAMETER;
+    }
+    name_len = AsciiStrLen(Name);
+    if (name_len >= CBFS_NAME_MAX) {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    while (pos + sizeof(CBFS_FILE_HEADER) <= Media->Size) {
+        CBFS_FILE_HEADER* header = (CBFS_FILE_HEADER*)record;
+        if (EFI_ERROR(CbfsRead(Media, pos, header, sizeof(*header)))) {
+            break;
+        }
+        if (CompareMem(header->magic, CBFS_FILE_MAGIC, sizeof(header->magic)) != 0) {
+            pos += CBFS_ALIGNMENT; // Padding between files
+            continue;
+        }
+
+        UINT32 len = SwapBytes32(header->len);
+        UINT32 type = SwapBytes32(header->type);
+        UINT32 attr_offset = SwapBytes32(header->attributes_offset);
+        UINT32 data_offset = SwapBytes32(header->offset);
+        if (data_offset < sizeof(*header) || pos + data_offset + len > Media->Size) {
+            return EFI_VOLUME_CORRUPTED;
+        }
+
+        // The name sits between the header and the attributes (or data)
+        UINT32 name_end = (attr_offset >= sizeof(*header) && attr_offset < data_offset) ? attr_offset : data_offset;
+        UINTN stored_name = name_end - sizeof(*header);
+        if (type != CBFS_TYPE_NULL && type != CBFS_TYPE_DELETED && stored_name > name_len &&
+            !EFI_ERROR(CbfsRead(Media, pos + sizeof(*header), record + sizeof(*header), name_len + 1)) &&
+            CompareMem(record + sizeof(*header), Name, name_len + 1) == 0) {
+            File->Type = type;
+            File->Compression = CBFS_COMPRESS_NONE;
+            File->DataOffset = pos + data_offset;
+            File->StoredSize = len;
+            File->Size = len;
+
+            // Attributes run from attr_offset up to the data
+            UINT32 attr = (attr_offset >= sizeof(*header)) ? attr_offset : data_offset;
+            while (attr + 2 * sizeof(UINT32) <= data_offset) {
+                CBFS_ATTR_COMPRESSION comp;
+                UINTN want = MIN(sizeof(comp), (UINTN)(data_offset - attr));
+                SetMem(&comp, sizeof(comp), 0);
+                if (EFI_ERROR(CbfsRead(Media, pos + attr, &comp, want))) {
+                    return EFI_DEVICE_ERROR;
+                }
+                UINT32 tag = SwapBytes32(comp.tag);
+                UINT32 attr_len = SwapBytes32(comp.len);
+                if (tag == CBFS_FILE_ATTR_TAG_UNUSED || tag == CBFS_FILE_ATTR_TAG_UNUSED2 ||
+                    attr_len < 2 * sizeof(UINT32)) {
+                    break;
+                }
+                if (tag == CBFS_FILE_ATTR_TAG_COMPRESSION && attr_len >= sizeof(comp) && want == sizeof(comp)) {
+                    File->Compression = SwapBytes32(comp.compression);
+                    File->Size = SwapBytes32(comp.decompressed_size);
+                }
+                attr += attr_len;
+            }
+            return EFI_SUCCESS;
+        }
+
+        pos = ALIGN_VALUE(pos + data_offset + len, CBFS_ALIGNMENT);
+    }
+
+    return EFI_NOT_FOUND;
+}
+
+/**
+ * Load a CBFS file into placed memory. Stored data is copied or streamed
+ * through the decompressor straight into the placement, with no
+ * intermediate buffer for the whole file.
+ */
+EFI_STATUS
+EFIAPI
+CbfsLoad (
+  IN  CONST CBFS_MEDIA* Media,
+  IN  CONST CHAR8* Name,
+  IN  UINT64 Align,
+  IN  UINT32 Flags,
+  OUT VOID** Buffer,
+  OUT UINTN* Size
+  )
+{
+    CBFS_FILE file;
+    EFI_PHYSICAL_ADDRESS dest;
+    EFI_STATUS Status;
+
+    if (!Buffer || !Size) {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    Status = CbfsLocate(Media, Name, &file);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    if (file.Size == 0) {
+        return EFI_LOAD_ERROR;
+    }
+    if (file.Compression != CBFS_COMPRESS_NONE && file.Compression != CBFS_COMPRESS_LZ4) {
+        DEBUG((DEBUG_ERROR, "CBFS: %a uses unsupported compression %u\n", Name, file.Compression));
+        return EFI_UNSUPPORTED;
+    }
+
+    Status = MemPlaceAllocate(file.Size, Align, 0, 0, Flags, &dest);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    if (file.Compression == CBFS_COMPRESS_NONE) {
+        Status = CbfsRead(Media, file.DataOffset, (VOID*)(UINTN)dest, file.Size);
+    } else {
+        CBFS_STREAM stream = { Media, file.DataOffset, file.StoredSize };
+        decomp_stream_t s;
+        int rc = decomp_open(&s, CbfsStreamRead, &stream);
+        if (rc == DECOMP_OK) {
+            rc = decomp_run(&s, DECOMP_LZ4, (uint8_t*)(UINTN)dest, file.Size, NULL, NULL);
+        }
+        if (rc == DECOMP_OK && s.out_len != file.Size) {
+            rc = DECOMP_ERR_CORRUPT;
+        }
+        decomp_close(&s);
+        Status = (rc == DECOMP_OK) ? EFI_SUCCESS :
+                 (rc == DECOMP_ERR_IO) ? EFI_DEVICE_ERROR : EFI_VOLUME_CORRUPTED;
+    }
+
+    if (EFI_ERROR(Status)) {
+        gBS->FreePages(dest, EFI_SIZE_TO_PAGES(file.Size));
+        return Status;
+    }
+
+    *Buffer = (VOID*)(UINTN)dest;
+    *Size = file.Size;
+    return EFI_SUCCESS;
+}
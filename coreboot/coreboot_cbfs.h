@@ -0,0 +1,67 @@
+/*
+ * coreboot_cbfs.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef COREBOOT_CBFS_H
+#define COREBOOT_CBFS_H
+
+#include <Uefi.h>
+
+// CBFS file types used by the loader
+#define CBFS_TYPE_NULL          0xFFFFFFFF
+#define CBFS_TYPE_DELETED       0x00000000
+#define CBFS_TYPE_PAYLOAD       0x00000020
+#define CBFS_TYPE_RAW           0x00000050
+
+// CBFS compression algorithms
+#define CBFS_COMPRESS_NONE      0
+#define CBFS_COMPRESS_LZMA      1
+#define CBFS_COMPRESS_LZ4       2
+
+// Read Size bytes at Offset into the CBFS region
+typedef EFI_STATUS (EFIAPI *CBFS_MEDIA_READ)(
+    IN  VOID*   Context,
+    IN  UINT64  Offset,
+    OUT VOID*   Buffer,
+    IN  UINTN   Size
+);
+
+// A CBFS region: memory-mapped (Mapped set), or behind a read callback for
+// flash that is not mapped into the address space
+typedef struct {
+    CONST UINT8*    Mapped;
+    CBFS_MEDIA_READ Read;
+    VOID*           Context;
+    UINT64          Size;
+} CBFS_MEDIA;
+
+// One file as found by CbfsLocate
+typedef struct {
+    UINT32 Type;
+    UINT32 Compression;     // CBFS_COMPRESS_*
+    UINT64 DataOffset;      // Into the region
+    UINT32 StoredSize;      // Bytes in CBFS
+    UINT32 Size;            // Bytes once decompressed
+} CBFS_FILE;
+
+// Memory-mapped boot flash, from the coreboot table's boot media record or
+// else the legacy master header pointer at the top of 4 GiB (x86 only)
+EFI_STATUS EFIAPI CbfsOpenBootMedia(OUT CBFS_MEDIA* Media);
+
+EFI_STATUS EFIAPI CbfsLocate(IN CONST CBFS_MEDIA* Media, IN CONST CHAR8* Name, OUT CBFS_FILE* File);
+
+// Load a file into memory from the placement engine (MEM_PLACE_* Flags),
+// decompressing straight into it
+EFI_STATUS EFIAPI CbfsLoad(
+    IN  CONST CBFS_MEDIA*   Media,
+    IN  CONST CHAR8*        Name,
+    IN  UINT64              Align,
+    IN  UINT32              Flags,
+    OUT VOID**              Buffer,
+    OUT UINTN*              Size
+);
+
+#endif // COREBOOT_CBFS_H
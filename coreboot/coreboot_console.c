@@ -0,0 +1,276 @@
+/*
+ * coreboot_console.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include "coreboot_platform.h"
+#include "coreboot_console.h"
+#include "../boot/font.h"
+
+#define CB_CONSOLE_TAB_WIDTH 8
+
+// Console state. The cursor row is signed so a write can start above the
+// top of the screen after its scroll has been applied up front.
+typedef struct {
+    BOOLEAN active;
+    UINT32* fb;
+    UINT32 stride;              // Framebuffer pitch in pixels
+    UINT32 width;
+    UINT32 height;
+    Font* font;
+    UINT32 cell_width;
+    UINT32 cell_height;
+    UINT32 cols;
+    UINT32 rows;
+    UINT32 col;
+    INT32 row;
+    GlyphRenderOptions colors;
+} CB_CONSOLE;
+
+STATIC CB_CONSOLE cb_console = {0};
+
+/**
+ * Pack an 8-bit per channel color into the framebuffer's pixel layout
+ */
+STATIC
+UINT32
+CorebootConsoleColor (
+  IN CONST COREBOOT_FB* fb,
+  IN UINT8 Red,
+  IN UINT8 Green,
+  IN UINT8 Blue
+  )
+{
+    return ((UINT32)(Red >> (8 - MIN(fb->red_mask_size, 8))) << fb->red_mask_pos) |
+           ((UINT32)(Green >> (8 - MIN(fb->green_mask_size, 8))) << fb->green_mask_pos) |
+           ((UINT32)(Blue >> (8 - MIN(fb->blue_mask_size, 8))) << fb->blue_mask_pos);
+}
+
+/**
+ * Fill whole scanlines [First, First + Count) with the background color
+ */
+STATIC
+VOID
+CorebootConsoleFillLines (
+  IN UINT32 First,
+  IN UINT32 Count
+  )
+{
+    for (UINT32 y = First; y < First + Count && y < cb_console.height; y++) {
+        SetMem32(cb_console.fb + (UINTN)y * cb_console.stride,
+                 cb_console.width * sizeof(UINT32), cb_console.colors.bg_color);
+    }
+}
+
+/**
+ * Scroll the text area up by Lines rows: one framebuffer move for what
+ * stays on screen, then a clear of the rows that came free
+ */
+STATIC
+VOID
+CorebootConsoleScroll (
+  IN UINT32 Lines
+  )
+{
+    UINT32 text_height = cb_console.rows * cb_console.cell_height;
+
+    if (Lines >= cb_console.rows) {
+        CorebootConsoleFillLines(0, text_height);
+        return;
+    }
+
+    UINT32 shift = Lines * cb_console.cell_height;
+    CopyMem(cb_console.fb,
+            cb_console.fb + (UINTN)shift * cb_console.stride,
+            (UINTN)(text_height - shift) * cb_console.stride * sizeof(UINT32));
+    CorebootConsoleFillLines(text_height - shift, shift);
+}
+
+/**
+ * Move the cursor for one character and, when Draw is set and the cell is
+ * on screen, paint its glyph. Counting and drawing share this so a write
+ * can be measured before any pixel is touched.
+ */
+STATIC
+VOID
+CorebootConsoleStep (
+  IN CHAR8 c,
+  IN OUT UINT32* Col,
+  IN OUT INT32* Row,
+  IN BOOLEAN Draw
+  )
+{
+    switch (c) {
+        case '\n':
+            *Col = 0;
+            (*Row)++;
+            return;
+        case '\r':
+            *Col = 0;
+            return;
+        case '\b':
+            if (*Col > 0) {
+                (*Col)--;
+            }
+            return;
+        case '\t':
+            *Col = MIN((*Col + CB_CONSOLE_TAB_WIDTH) & ~(CB_CONSOLE_TAB_WIDTH - 1), cb_console.cols);
+            return;
+        default:
+            break;
+    }
+
+    if ((UINT8)c < 0x20) {
+        return;
+    }
+    if ((UINT8)c > 0x7E) {
+        c = '?';
+    }
+
+    // Wrap lazily, so a line that exactly fills the screen doesn't scroll
+    if (*Col >= cb_console.cols) {
+        *Col = 0;
+        (*Row)++;
+    }
+
+    if (Draw && *Row >= 0) {
+        FontSurface surface = {
+            cb_console.fb, cb_console.stride, cb_console.width, cb_console.height
+        };
+        RenderGlyphToSurface(cb_console.font, &surface, (UINT32)c,
+                             (INT32)(*Col * cb_console.cell_width),
+                             *Row * (INT32)cb_console.cell_height,
+                             &cb_console.colors);
+    }
+    (*Col)++;
+}
+
+/**
+ * Bind the console to the coreboot framebuffer and clear it
+ *
+ * @return TRUE if the framebuffer is usable as a text console
+ */
+BOOLEAN
+EFIAPI
+CorebootConsoleInit (
+  VOID
+  )
+{
+    CONST COREBOOT_FB* fb = CorebootGetFramebuffer();
+
+    cb_console.active = FALSE;
+    if (!fb || !fb->physical_address || fb->bits_per_pixel != 32) {
+        return FALSE;
+    }
+
+    cb_console.font = GetDefaultFont();
+    if (!cb_console.font) {
+        InitFontSystem();
+        cb_console.font = GetDefaultFont();
+    }
+    if (!cb_console.font || !cb_console.font->metadata.max_width || !cb_console.font->metadata.line_height) {
+        return FALSE;
+    }
+
+    cb_console.fb = (UINT32*)(UINTN)fb->physical_address;
+    cb_console.stride = fb->bytes_per_line / sizeof(UINT32);
+    cb_console.width = fb->x_resolution;
+    cb_console.height = fb->y_resolution;
+    cb_console.cell_width = cb_console.font->metadata.max_width;
+    cb_console.cell_height = cb_console.font->metadata.line_height;
+    cb_console.cols = cb_console.width / cb_console.cell_width;
+    cb_console.rows = cb_console.height / cb_console.cell_height;
+    if (!cb_console.cols || !cb_console.rows || cb_console.stride < cb_console.width) {
+        return FALSE;
+    }
+
+    SetMem(&cb_console.colors, sizeof(cb_console.colors), 0);
+    cb_console.colors.color = CorebootConsoleColor(fb, 0xAA, 0xAA, 0xAA);
+    cb_console.colors.bg_color = CorebootConsoleColor(fb, 0x00, 0x00, 0x00);
+    cb_console.colors.opacity = 255;
+    cb_console.colors.use_bg = 1;   // Opaque cells blit as plain row copies
+
+    cb_console.active = TRUE;
+    CorebootConsoleClear();
+    return TRUE;
+}
+
+/**
+ * Check whether output is going to the framebuffer console
+ */
+BOOLEAN
+EFIAPI
+CorebootConsoleActive (
+  VOID
+  )
+{
+    return cb_console.active;
+}
+
+/**
+ * Write Len characters. The rows the text will push off the bottom are
+ * counted first and scrolled away in a single move; glyphs that would
+ * land above the screen afterwards are never drawn.
+ */
+VOID
+EFIAPI
+CorebootConsoleWrite (
+  IN CONST CHAR8* str,
+  IN UINTN len
+  )
+{
+    if (!cb_console.active || !str) {
+        return;
+    }
+
+    UINT32 col = cb_console.col;
+    INT32 row = cb_console.row;
+    for (UINTN i = 0; i < len; i++) {
+        CorebootConsoleStep(str[i], &col, &row, FALSE);
+    }
+
+    INT32 overflow = row - (INT32)(cb_console.rows - 1);
+    if (overflow > 0) {
+        CorebootConsoleScroll((UINT32)overflow);
+        cb_console.row -= overflow;
+    }
+
+    for (UINTN i = 0; i < len; i++) {
+        CorebootConsoleStep(str[i], &cb_console.col, &cb_console.row, TRUE);
+    }
+}
+
+/**
+ * Write one character
+ */
+VOID
+EFIAPI
+CorebootConsolePutc (
+  IN CHAR8 c
+  )
+{
+    CorebootConsoleWrite(&c, 1);
+}
+
+/**
+ * Clear the screen and home the cursor
+ */
+VOID
+EFIAPI
+CorebootConsoleClear (
+  VOID
+  )
+{
+    if (!cb_console.active) {
+        return;
+    }
+
+    CorebootConsoleFillLines(0, cb_console.height);
+    cb_console.col = 0;
+    cb_console.row = 0;
+}
@@ -0,0 +1,21 @@
+/*
+ * coreboot_console.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef COREBOOT_CONSOLE_H
+#define COREBOOT_CONSOLE_H
+
+#include <Uefi.h>
+
+// Text console drawn straight onto the coreboot linear framebuffer with the
+// built-in bitmap font. Only 32 bpp framebuffers are supported.
+BOOLEAN EFIAPI CorebootConsoleInit(VOID);
+BOOLEAN EFIAPI CorebootConsoleActive(VOID);
+VOID EFIAPI CorebootConsolePutc(IN CHAR8 c);
+VOID EFIAPI CorebootConsoleWrite(IN CONST CHAR8* str, IN UINTN len);
+VOID EFIAPI CorebootConsoleClear(VOID);
+
+#endif // COREBOOT_CONSOLE_H
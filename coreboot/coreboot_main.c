@@ -11,20 +11,24 @@
 #include <Library/BaseMemoryLib.h>
 #include <Library/MemoryAllocationLib.h>
 #include <Library/BaseLib.h>
-#include <Guid/Acpi.h>
 #include <stdarg.h>
 #include <Protocol/SimpleFileSystem.h>
 #include <Protocol/LoadedImage.h>
 #include <Guid/FileInfo.h>
 
 #include "coreboot_platform.h"
+#include "coreboot_console.h"
+#include "coreboot_serial.h"
+#include "../fs/blockdev.h"
 #include "../boot/menu.h"
 #include "../boot/theme.h"
 #include "../boot/localization.h"
 #include "../boot/mouse.h"
+#include "../boot/plugin.h"
 #include "../security/crypto.h"
 #include "../security/sha512.h"
 #include "../boot/libb/include/bloodhorn/bloodhorn.h"
+#include "../boot/Arch32/fwinfo.h"
 
 STATIC EFI_HANDLE gImageHandle = NULL;
 STATIC EFI_SYSTEM_TABLE* gST = NULL;
@@ -77,13 +81,24 @@ CorebootMain (
     Print(L"BloodHorn Bootloader (Coreboot Payload Mode)\n");
     Print(L"Coreboot firmware detected and initialized\n");
 
+    // No system table lists ACPI or SMBIOS here; coreboot's own pointers
+    // back the platform table index
+    fwinfo_tables_fallback(CorebootGetAcpiRsdp(), CorebootGetSmbiosEntryPoint());
+
+    if (CorebootSerialInit()) {
+        Print(L"Console output mirrored to the Coreboot serial port\n");
+    }
+
     // Initialize hardware using Coreboot services
     if (CorebootInitGraphics()) {
         Print(L"Graphics initialized using Coreboot framebuffer\n");
+        if (CorebootConsoleInit()) {
+            Print(L"Console output redirected to the Coreboot framebuffer\n");
+        }
     }
 
     if (CorebootInitStorage()) {
-        Print(L"Storage initialized by Coreboot\n");
+        Print(L"Disk attached: %a\n", blockdev_current()->name);
     }
 
     if (CorebootInitNetwork()) {
@@ -103,6 +118,7 @@ CorebootMain (
 
     // Should not reach here in normal operation
     Print(L"BloodHorn Coreboot payload terminated\n");
+    CorebootSerialFlush();
 }
 
 EFI_STATUS
@@ -118,6 +134,8 @@ BloodhornMainCoreboot (
         bh_system_table_t bloodhorn_system_table = {
             .alloc = (void* (*)(bh_size_t))AllocatePool,
             .free = (void (*)(void*))FreePool,
+            .alloc_pages = (void* (*)(bh_size_t))AllocatePages,
+            .free_pages = (void (*)(void*, bh_size_t))FreePages,
             .putc = (void (*)(char))bh_putc,
             .puts = (void (*)(const char*))bh_puts,
             .printf = (void (*)(const char*, ...))bh_printf,
@@ -397,7 +415,8 @@ ExecuteKernelImage (
         }
     }
 
-    // Start the image
+    // Start the image; it may never hand control back
+    CorebootSerialFlush();
     Status = gBS->StartImage(ImageHandle, NULL, NULL);
     if (EFI_ERROR(Status)) {
         Print(L"Failed to start kernel image: %r\n", Status);
@@ -509,18 +528,29 @@ BootBloodchainWrapper(VOID) {
 EFI_STATUS
 EFIAPI
 BootRecoveryShellWrapper(VOID) {
-    return shell_start();
+    return StartPlugin(L"shell");
 }
 
 STATIC VOID bh_putc(CHAR8 c) {
-    if (gST && gST->ConOut) {
+    if (CorebootConsoleActive()) {
+        CorebootConsolePutc(c);
+        CorebootSerialWrite(&c, 1);
+    } else if (gST && gST->ConOut) {
         CHAR16 wbuf[2] = { (CHAR16)c, 0 };
         gST->ConOut->OutputString(gST->ConOut, wbuf);
     }
 }
 
 STATIC VOID bh_puts(const CHAR8* str) {
-    if (gST && gST->ConOut && str) {
+    if (CorebootConsoleActive()) {
+        if (str) {
+            UINTN len = AsciiStrLen(str);
+            CorebootConsoleWrite(str, len);
+            CorebootConsolePutc('\n');
+            CorebootSerialWrite(str, len);
+            CorebootSerialWrite("\n", 1);
+        }
+    } else if (gST && gST->ConOut && str) {
         CHAR16 wbuf[512];
         UINTN i = 0;
         while (*str && i < 511) {
@@ -535,7 +565,12 @@ STATIC VOID bh_puts(const CHAR8* str) {
 STATIC VOID bh_printf(const CHAR8* format, ...) {
     VA_LIST args;
     VA_START(args, format);
-    if (gST && gST->ConOut) {
+    if (CorebootConsoleActive()) {
+        CHAR8 buf[512];
+        UINTN len = AsciiVSPrint(buf, sizeof(buf), format, args);
+        CorebootConsoleWrite(buf, len);
+        CorebootSerialWrite(buf, len);
+    } else if (gST && gST->ConOut) {
         CHAR16 wbuf[512];
         AsciiVSPrintUnicodeFormat(wbuf, sizeof(wbuf), (CHAR8*)format, args);
         gST->ConOut->OutputString(gST->ConOut, wbuf);
@@ -584,15 +619,9 @@ STATIC bh_status_t bh_get_graphics_info(bh_graphics_info_t* info) {
 }
 
 STATIC VOID* bh_get_rsdp(VOID) {
-    EFI_CONFIGURATION_TABLE* ConfigTable = gST->ConfigurationTable;
-    EFI_GUID AcpiTableGuid = ACPI_TABLE_GUID;
-
-    for (UINTN i = 0; i < gST->NumberOfTableEntries; i++) {
-        if (CompareGuid(&ConfigTable[i].VendorGuid, &AcpiTableGuid)) {
-            return ConfigTable[i].VendorTable;
-        }
-    }
-    return NULL;
+    UINT32 Size;
+    int IsV2;
+    return (VOID*)fwinfo_acpi_rsdp(&Size, &IsV2);
 }
 
 STATIC VOID* bh_get_boot_device(VOID) {
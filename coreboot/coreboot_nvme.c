@@ -0,0 +1,675 @@
+/*
+ * coreboot_nvme.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/DebugLib.h>
+#include <Library/IoLib.h>
+#include <Library/TimerLib.h>
+#include <Library/CacheMaintenanceLib.h>
+#include "coreboot_platform.h"
+#include "coreboot_nvme.h"
+
+#define NVME_PCI_CLASS              0x010802    // Mass storage, NVM, NVMe
+#define NVME_PCI_BAR                0x10
+
+// Controller registers
+#define NVME_REG_CAP                0x00
+#define NVME_REG_CC                 0x14
+#define NVME_REG_CSTS               0x1C
+#define NVME_REG_AQA                0x24
+#define NVME_REG_ASQ                0x28
+#define NVME_REG_ACQ                0x30
+#define NVME_REG_DOORBELL           0x1000
+
+#define NVME_CAP_MQES(Cap)          ((UINT32)((Cap) & 0xFFFF))           // Zero-based
+#define NVME_CAP_TO(Cap)            ((UINT32)(((Cap) >> 24) & 0xFF))     // 500 ms units
+#define NVME_CAP_DSTRD(Cap)         ((UINT32)(((Cap) >> 32) & 0xF))
+#define NVME_CAP_CSS_NVM(Cap)       (((Cap) >> 37) & 1)
+#define NVME_CAP_MPSMIN(Cap)        ((UINT32)(((Cap) >> 48) & 0xF))
+
+#define NVME_CC_EN                  BIT0
+#define NVME_CC_IOSQES              (6 << 16)   // 64-byte submission entries
+#define NVME_CC_IOCQES              (4 << 20)   // 16-byte completion entries
+#define NVME_CSTS_RDY               BIT0
+#define NVME_CSTS_CFS               BIT1
+
+// Commands
+#define NVME_ADMIN_CREATE_SQ        0x01
+#define NVME_ADMIN_CREATE_CQ        0x05
+#define NVME_ADMIN_IDENTIFY         0x06
+#define NVME_IO_READ                0x02
+
+#define NVME_CNS_NAMESPACE          0
+#define NVME_CNS_CONTROLLER         1
+#define NVME_CNS_ACTIVE_NAMESPACES  2
+
+// Identify data offsets
+#define NVME_ID_CTRL_MDTS           77
+#define NVME_ID_NS_NSZE             0
+#define NVME_ID_NS_FLBAS            26
+#define NVME_ID_NS_LBAF             128
+#define NVME_FLBAS_EXTENDED         BIT4        // Metadata interleaved with data
+
+#define NVME_PAGE_SIZE              EFI_PAGE_SIZE
+#define NVME_PAGE_MASK              (NVME_PAGE_SIZE - 1)
+#define NVME_PRP_PER_PAGE           (NVME_PAGE_SIZE / sizeof(UINT64))
+#define NVME_ADMIN_DEPTH            8
+#define NVME_IO_QID                 1
+#define NVME_COMMAND_TIMEOUT_US     5000000
+#define NVME_POLL_US                1
+
+typedef struct {
+    UINT32 Cdw0;                // Opcode, command id in 31:16
+    UINT32 Nsid;
+    UINT64 Reserved;
+    UINT64 Mptr;
+    UINT64 Prp1;
+    UINT64 Prp2;
+    UINT32 Cdw10;
+    UINT32 Cdw11;
+    UINT32 Cdw12;
+    UINT32 Cdw13;
+    UINT32 Cdw14;
+    UINT32 Cdw15;
+} NVME_SQE;
+
+typedef struct {
+    UINT32 Dw0;
+    UINT32 Dw1;
+    UINT16 SqHead;
+    UINT16 SqId;
+    UINT16 Cid;
+    UINT16 Status;              // Phase tag in bit 0
+} NVME_CQE;
+
+typedef struct {
+    UINT16 Qid;
+    UINT16 Depth;
+    NVME_SQE* Sq;
+    volatile NVME_CQE* Cq;
+    UINT16 SqTail;
+    UINT16 CqHead;
+    UINT16 Phase;               // Value of the phase tag a new entry carries
+} NVME_QUEUE;
+
+typedef struct {
+    UINTN Mmio;
+    UINT32 DoorbellStride;      // Bytes
+    UINT32 ReadyTimeoutMs;
+    NVME_QUEUE Admin;
+    NVME_QUEUE Io;
+    UINT32 NamespaceId;
+    UINT32 LbaShift;
+    UINT32 MaxTransfer;         // Bytes per command
+    UINT64* PrpLists;           // One page per command id
+    UINT64 Busy;                // Command ids in flight
+    UINT8* Bounce;              // MaxTransfer bytes
+    BOOLEAN Failed;             // A command timed out; the queues are unusable
+    block_device_t Device;
+} NVME_CONTROLLER;
+
+STATIC NVME_CONTROLLER cb_nvme = {0};
+
+// x86 DMA is cache-coherent; elsewhere queues and buffers are cleaned
+// before the controller reads them and invalidated before the CPU does
+STATIC
+VOID
+NvmeDmaToDevice (
+  IN VOID* Address,
+  IN UINTN Size
+  )
+{
+#if !defined(MDE_CPU_IA32) && !defined(MDE_CPU_X64)
+    WriteBackDataCacheRange(Address, Size);
+#endif
+}
+
+STATIC
+VOID
+NvmeDmaFromDevice (
+  IN VOID* Address,
+  IN UINTN Size
+  )
+{
+#if !defined(MDE_CPU_IA32) && !defined(MDE_CPU_X64)
+    InvalidateDataCacheRange(Address, Size);
+#endif
+}
+
+STATIC
+VOID
+NvmeDoorbell (
+  IN NVME_CONTROLLER* Nvme,
+  IN UINT16 Qid,
+  IN BOOLEAN Completion,
+  IN UINT16 Value
+  )
+{
+    MemoryFence();
+    MmioWrite32(Nvme->Mmio + NVME_REG_DOORBELL + (2 * Qid + (Completion ? 1 : 0)) * Nvme->DoorbellStride, Value);
+}
+
+/**
+ * Queue a command without telling the controller; the caller rings the
+ * doorbell once for a whole batch
+ */
+STATIC
+VOID
+NvmeQueuePush (
+  IN NVME_QUEUE* Queue,
+  IN CONST NVME_SQE* Command
+  )
+{
+    NVME_SQE* Slot = &Queue->Sq[Queue->SqTail];
+    CopyMem(Slot, Command, sizeof(*Slot));
+    NvmeDmaToDevice(Slot, sizeof(*Slot));
+    Queue->SqTail = (UINT16)((Queue->SqTail + 1) % Queue->Depth);
+}
+
+/**
+ * Take the next completion if the controller has posted one. The head
+ * doorbell is left for the caller, so a burst of completions costs one
+ * register write.
+ */
+STATIC
+BOOLEAN
+NvmeQueuePoll (
+  IN  NVME_QUEUE* Queue,
+  OUT NVME_CQE* Completion
+  )
+{
+    volatile NVME_CQE* Entry = &Queue->Cq[Queue->CqHead];
+    NvmeDmaFromDevice((VOID*)Entry, sizeof(*Entry));
+    if ((Entry->Status & 1) != Queue->Phase) {
+        return FALSE;
+    }
+
+    MemoryFence();
+    Completion->Dw0 = Entry->Dw0;
+    Completion->SqHead = Entry->SqHead;
+    Completion->Cid = Entry->Cid;
+    Completion->Status = Entry->Status;
+
+    Queue->CqHead++;
+    if (Queue->CqHead == Queue->Depth) {
+        Queue->CqHead = 0;
+        Queue->Phase ^= 1;
+    }
+    return TRUE;
+}
+
+/**
+ * Run one admin command to completion
+ */
+STATIC
+EFI_STATUS
+NvmeAdminCommand (
+  IN NVME_CONTROLLER* Nvme,
+  IN NVME_SQE* Command
+  )
+{
+    NVME_CQE Completion;
+
+    if (Nvme->Failed) {
+        return EFI_DEVICE_ERROR;
+    }
+
+    NvmeQueuePush(&Nvme->Admin, Command);
+    NvmeDoorbell(Nvme, 0, FALSE, Nvme->Admin.SqTail);
+
+    for (UINT32 Waited = 0; !NvmeQueuePoll(&Nvme->Admin, &Completion); Waited += NVME_POLL_US) {
+        if (Waited >= NVME_COMMAND_TIMEOUT_US) {
+            Nvme->Failed = TRUE;
+            return EFI_TIMEOUT;
+        }
+        MicroSecondDelay(NVME_POLL_US);
+    }
+    NvmeDoorbell(Nvme, 0, TRUE, Nvme->Admin.CqHead);
+
+    if ((Completion.Status >> 1) != 0) {
+        DEBUG((DEBUG_WARN, "NVMe: admin opcode 0x%x failed, status 0x%x\n", Command->Cdw0 & 0xFF, Completion.Status >> 1));
+        return EFI_DEVICE_ERROR;
+    }
+    return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+NvmeIdentify (
+  IN  NVME_CONTROLLER* Nvme,
+  IN  UINT32 Cns,
+  IN  UINT32 Nsid,
+  OUT UINT8* Data
+  )
+{
+    NVME_SQE Command;
+    ZeroMem(&Command, sizeof(Command));
+    Command.Cdw0 = NVME_ADMIN_IDENTIFY;
+    Command.Nsid = Nsid;
+    Command.Prp1 = (UINTN)Data;
+    Command.Cdw10 = Cns;
+
+    NvmeDmaToDevice(Data, NVME_PAGE_SIZE);
+    EFI_STATUS Status = NvmeAdminCommand(Nvme, &Command);
+    NvmeDmaFromDevice(Data, NVME_PAGE_SIZE);
+    return Status;
+}
+
+/**
+ * Allocate a queue's entries: one zeroed, page-aligned run each, since the
+ * queues are created physically contiguous
+ */
+STATIC
+EFI_STATUS
+NvmeAllocQueue (
+  OUT NVME_QUEUE* Queue,
+  IN  UINT16 Qid,
+  IN  UINT16 Depth
+  )
+{
+    UINTN SqPages = EFI_SIZE_TO_PAGES(Depth * sizeof(NVME_SQE));
+    UINTN CqPages = EFI_SIZE_TO_PAGES(Depth * sizeof(NVME_CQE));
+
+    Queue->Sq = AllocatePages(SqPages);
+    Queue->Cq = AllocatePages(CqPages);
+    if (Queue->Sq == NULL || Queue->Cq == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    ZeroMem(Queue->Sq, EFI_PAGES_TO_SIZE(SqPages));
+    ZeroMem((VOID*)Queue->Cq, EFI_PAGES_TO_SIZE(CqPages));
+    NvmeDmaToDevice((VOID*)Queue->Cq, EFI_PAGES_TO_SIZE(CqPages));
+
+    Queue->Qid = Qid;
+    Queue->Depth = Depth;
+    Queue->SqTail = 0;
+    Queue->CqHead = 0;
+    Queue->Phase = 1;
+    return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+NvmeWaitReady (
+  IN NVME_CONTROLLER* Nvme,
+  IN BOOLEAN Ready
+  )
+{
+    for (UINT32 Waited = 0; Waited <= Nvme->ReadyTimeoutMs; Waited++) {
+        UINT32 Csts = MmioRead32(Nvme->Mmio + NVME_REG_CSTS);
+        if (Csts == MAX_UINT32 || (Ready && (Csts & NVME_CSTS_CFS))) {
+            return EFI_DEVICE_ERROR;
+        }
+        if (((Csts & NVME_CSTS_RDY) != 0) == Ready) {
+            return EFI_SUCCESS;
+        }
+        MicroSecondDelay(1000);
+    }
+    return EFI_TIMEOUT;
+}
+
+/**
+ * Reset the controller and bring it up with the admin queue
+ */
+STATIC
+EFI_STATUS
+NvmeEnable (
+  IN NVME_CONTROLLER* Nvme
+  )
+{
+    UINT64 Cap = MmioRead64(Nvme->Mmio + NVME_REG_CAP);
+    EFI_STATUS Status;
+
+    // Queues and PRPs here are laid out in 4 KiB pages
+    if (!NVME_CAP_CSS_NVM(Cap) || NVME_CAP_MPSMIN(Cap) != 0) {
+        return EFI_UNSUPPORTED;
+    }
+    Nvme->DoorbellStride = 4 << NVME_CAP_DSTRD(Cap);
+    Nvme->ReadyTimeoutMs = MAX(NVME_CAP_TO(Cap), 1) * 500;
+
+    UINT32 Cc = MmioRead32(Nvme->Mmio + NVME_REG_CC);
+    if (Cc & NVME_CC_EN) {
+        MmioWrite32(Nvme->Mmio + NVME_REG_CC, Cc & ~NVME_CC_EN);
+    }
+    Status = NvmeWaitReady(Nvme, FALSE);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    UINT32 MaxDepth = NVME_CAP_MQES(Cap) + 1;
+    Status = NvmeAllocQueue(&Nvme->Admin, 0, (UINT16)MIN(NVME_ADMIN_DEPTH, MaxDepth));
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    Status = NvmeAllocQueue(&Nvme->Io, NVME_IO_QID, (UINT16)MIN(COREBOOT_NVME_QUEUE_DEPTH, MaxDepth));
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    MmioWrite32(Nvme->Mmio + NVME_REG_AQA, ((UINT32)(Nvme->Admin.Depth - 1) << 16) | (Nvme->Admin.Depth - 1));
+    MmioWrite64(Nvme->Mmio + NVME_REG_ASQ, (UINTN)Nvme->Admin.Sq);
+    MmioWrite64(Nvme->Mmio + NVME_REG_ACQ, (UINTN)Nvme->Admin.Cq);
+    MmioWrite32(Nvme->Mmio + NVME_REG_CC, NVME_CC_IOCQES | NVME_CC_IOSQES | NVME_CC_EN);
+    return NvmeWaitReady(Nvme, TRUE);
+}
+
+/**
+ * Create the polled I/O queue pair: completion queue first, since the
+ * submission queue names it
+ */
+STATIC
+EFI_STATUS
+NvmeCreateIoQueues (
+  IN NVME_CONTROLLER* Nvme
+  )
+{
+    NVME_SQE Command;
+    UINT32 Size = (UINT32)(Nvme->Io.Depth - 1) << 16;
+
+    ZeroMem(&Command, sizeof(Command));
+    Command.Cdw0 = NVME_ADMIN_CREATE_CQ;
+    Command.Prp1 = (UINTN)Nvme->Io.Cq;
+    Command.Cdw10 = Size | NVME_IO_QID;
+    Command.Cdw11 = BIT0;                       // Physically contiguous, interrupts off
+    EFI_STATUS Status = NvmeAdminCommand(Nvme, &Command);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    ZeroMem(&Command, sizeof(Command));
+    Command.Cdw0 = NVME_ADMIN_CREATE_SQ;
+    Command.Prp1 = (UINTN)Nvme->Io.Sq;
+    Command.Cdw10 = Size | NVME_IO_QID;
+    Command.Cdw11 = ((UINT32)NVME_IO_QID << 16) | BIT0;
+    return NvmeAdminCommand(Nvme, &Command);
+}
+
+/**
+ * Pick the first active namespace that holds plain data blocks
+ */
+STATIC
+EFI_STATUS
+NvmeSelectNamespace (
+  IN NVME_CONTROLLER* Nvme,
+  IN UINT8* Page
+  )
+{
+    UINT32 List[NVME_PAGE_SIZE / sizeof(UINT32)];
+
+    EFI_STATUS Status = NvmeIdentify(Nvme, NVME_CNS_ACTIVE_NAMESPACES, 0, Page);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    CopyMem(List, Page, sizeof(List));
+
+    for (UINTN Index = 0; Index < ARRAY_SIZE(List) && List[Index] != 0; Index++) {
+        if (EFI_ERROR(NvmeIdentify(Nvme, NVME_CNS_NAMESPACE, List[Index], Page))) {
+            continue;
+        }
+
+        UINT64 Blocks = ReadUnaligned64((UINT64*)(Page + NVME_ID_NS_NSZE));
+        UINT8 Flbas = Page[NVME_ID_NS_FLBAS];
+        UINT8* Format = Page + NVME_ID_NS_LBAF + 4 * (Flbas & 0xF);
+        UINT16 MetaSize = ReadUnaligned16((UINT16*)Format);
+        UINT32 LbaShift = Format[2];
+
+        // Interleaved metadata would land in the caller's buffer
+        if (Blocks == 0 || LbaShift < 9 || LbaShift > 12 || (MetaSize != 0 && (Flbas & NVME_FLBAS_EXTENDED))) {
+            continue;
+        }
+
+        Nvme->NamespaceId = List[Index];
+        Nvme->LbaShift = LbaShift;
+        Nvme->Device.sector_count = LShiftU64(Blocks, LbaShift - 9);
+        return EFI_SUCCESS;
+    }
+    return EFI_NOT_FOUND;
+}
+
+/**
+ * Describe one command's buffer: PRP1 covers up to the first page end,
+ * PRP2 the second page or a list of all the rest
+ */
+STATIC
+VOID
+NvmeBuildPrps (
+  IN NVME_CONTROLLER* Nvme,
+  IN NVME_SQE* Command,
+  IN UINT16 Cid,
+  IN UINTN Address,
+  IN UINTN Bytes
+  )
+{
+    UINTN First = NVME_PAGE_SIZE - (Address & NVME_PAGE_MASK);
+
+    Command->Prp1 = Address;
+    Command->Prp2 = 0;
+    if (Bytes <= First) {
+        return;
+    }
+    if (Bytes <= First + NVME_PAGE_SIZE) {
+        Command->Prp2 = Address + First;
+        return;
+    }
+
+    UINT64* List = Nvme->PrpLists + (UINTN)Cid * NVME_PRP_PER_PAGE;
+    UINTN Count = 0;
+    for (UINTN Page = Address + First; Page < Address + Bytes; Page += NVME_PAGE_SIZE) {
+        List[Count++] = Page;
+    }
+    NvmeDmaToDevice(List, Count * sizeof(UINT64));
+    Command->Prp2 = (UINTN)List;
+}
+
+/**
+ * Read whole namespace blocks into a dword-aligned buffer. Commands are
+ * queued until the submission queue is full, the doorbell is rung once,
+ * and every completion reaped frees a slot for the next command, so the
+ * drive always has the rest of the request in hand.
+ */
+STATIC
+EFI_STATUS
+NvmeReadBlocks (
+  IN  NVME_CONTROLLER* Nvme,
+  IN  UINT64 Lba,
+  IN  UINT64 Blocks,
+  OUT VOID* Buffer
+  )
+{
+    NVME_QUEUE* Queue = &Nvme->Io;
+    UINTN Address = (UINTN)Buffer;
+    UINT64 Remaining = LShiftU64(Blocks, Nvme->LbaShift);
+    UINTN BlockMask = ((UINTN)1 << Nvme->LbaShift) - 1;
+    UINT32 InFlight = 0;
+    EFI_STATUS Status = EFI_SUCCESS;
+
+    NvmeDmaToDevice(Buffer, (UINTN)Remaining);
+
+    while ((Remaining > 0 && !EFI_ERROR(Status)) || InFlight > 0) {
+        UINT32 Queued = 0;
+
+        // A queue holds Depth - 1 commands, so one in flight per entry
+        // can neither overrun the submission nor the completion queue
+        while (Remaining > 0 && !EFI_ERROR(Status) && InFlight < (UINT32)Queue->Depth - 1) {
+            UINTN Bytes = (Nvme->MaxTransfer - (Address & NVME_PAGE_MASK)) & ~BlockMask;
+            if (Bytes > Remaining) {
+                Bytes = (UINTN)Remaining;
+            }
+
+            UINT16 Cid = (UINT16)LowBitSet64(~Nvme->Busy);
+            NVME_SQE Command;
+            ZeroMem(&Command, sizeof(Command));
+            Command.Cdw0 = NVME_IO_READ | ((UINT32)Cid << 16);
+            Command.Nsid = Nvme->NamespaceId;
+            Command.Cdw10 = (UINT32)Lba;
+            Command.Cdw11 = (UINT32)RShiftU64(Lba, 32);
+            Command.Cdw12 = (UINT32)(Bytes >> Nvme->LbaShift) - 1;
+            NvmeBuildPrps(Nvme, &Command, Cid, Address, Bytes);
+            NvmeQueuePush(Queue, &Command);
+
+            Nvme->Busy |= LShiftU64(1, Cid);
+            Lba += Bytes >> Nvme->LbaShift;
+            Address += Bytes;
+            Remaining -= Bytes;
+            InFlight++;
+            Queued++;
+        }
+        if (Queued > 0) {
+            NvmeDoorbell(Nvme, Queue->Qid, FALSE, Queue->SqTail);
+        }
+
+        // Wait for at least one completion, then take every one posted
+        NVME_CQE Completion;
+        UINT32 Reaped = 0;
+        for (UINT32 Waited = 0; InFlight > 0; ) {
+            if (!NvmeQueuePoll(Queue, &Completion)) {
+                if (Reaped > 0) {
+                    break;
+                }
+                if (Waited >= NVME_COMMAND_TIMEOUT_US) {
+                    // Commands still owned by the controller may write
+                    // their buffers at any time; stop using the queues
+                    DEBUG((DEBUG_ERROR, "NVMe: read timed out with %u commands outstanding\n", InFlight));
+                    Nvme->Failed = TRUE;
+                    return EFI_TIMEOUT;
+                }
+                MicroSecondDelay(NVME_POLL_US);
+                Waited += NVME_POLL_US;
+                continue;
+            }
+
+            Nvme->Busy &= ~LShiftU64(1, Completion.Cid & 63);
+            InFlight--;
+            Reaped++;
+            if ((Completion.Status >> 1) != 0) {
+                DEBUG((DEBUG_WARN, "NVMe: read failed, status 0x%x\n", Completion.Status >> 1));
+                Status = EFI_DEVICE_ERROR;
+            }
+        }
+        if (Reaped > 0) {
+            NvmeDoorbell(Nvme, Queue->Qid, TRUE, Queue->CqHead);
+        }
+    }
+
+    NvmeDmaFromDevice(Buffer, (UINTN)LShiftU64(Blocks, Nvme->LbaShift));
+    return Status;
+}
+
+STATIC
+int
+CorebootNvmeRead (
+  block_device_t* dev,
+  uint64_t sector,
+  uint32_t count,
+  void* buf
+  )
+{
+    NVME_CONTROLLER* Nvme = (NVME_CONTROLLER*)dev->context;
+    UINT64 Offset = LShiftU64(sector, 9);
+    UINTN Size = (UINTN)count * BLOCKDEV_SECTOR_SIZE;
+    UINTN BlockMask = ((UINTN)1 << Nvme->LbaShift) - 1;
+    UINT8* Out = buf;
+
+    if (Nvme->Failed || sector >= dev->sector_count || count > dev->sector_count - sector) {
+        return -1;
+    }
+
+    if (((UINTN)Offset & BlockMask) == 0 && (Size & BlockMask) == 0 && ((UINTN)buf & 3) == 0) {
+        return EFI_ERROR(NvmeReadBlocks(Nvme, RShiftU64(Offset, Nvme->LbaShift), Size >> Nvme->LbaShift, buf)) ? -1 : 0;
+    }
+
+    // Partial namespace blocks (512-byte sectors on a 4 KiB-block drive) or
+    // a misaligned buffer: read whole blocks into the bounce buffer
+    while (Size > 0) {
+        UINTN Skip = (UINTN)Offset & BlockMask;
+        UINTN Span = MIN((Skip + Size + BlockMask) & ~BlockMask, Nvme->MaxTransfer);
+        UINTN Chunk = MIN(Span - Skip, Size);
+
+        if (EFI_ERROR(NvmeReadBlocks(Nvme, RShiftU64(Offset, Nvme->LbaShift), Span >> Nvme->LbaShift, Nvme->Bounce))) {
+            return -1;
+        }
+        CopyMem(Out, Nvme->Bounce + Skip, Chunk);
+        Out += Chunk;
+        Offset += Chunk;
+        Size -= Chunk;
+    }
+    return 0;
+}
+
+EFI_STATUS
+EFIAPI
+CorebootNvmeInit (
+  OUT block_device_t** Device
+  )
+{
+    NVME_CONTROLLER* Nvme = &cb_nvme;
+    UINTN PciAddress = 0;
+    EFI_STATUS Status;
+
+    if (Nvme->Device.read != NULL) {
+        *Device = &Nvme->Device;
+        return EFI_SUCCESS;
+    }
+    if (!CorebootPciFindClass(NVME_PCI_CLASS, &PciAddress)) {
+        return EFI_NOT_FOUND;
+    }
+
+    UINT64 Base = CorebootPciEnableMemoryBar(PciAddress, NVME_PCI_BAR);
+    if (Base == 0) {
+        return EFI_NOT_READY;                   // coreboot left the BAR unassigned
+    }
+
+    ZeroMem(Nvme, sizeof(*Nvme));
+    Nvme->Mmio = (UINTN)Base;
+    Status = NvmeEnable(Nvme);
+    if (EFI_ERROR(Status)) {
+        DEBUG((DEBUG_WARN, "NVMe: controller at 0x%lx did not start: %r\n", Base, Status));
+        return Status;
+    }
+
+    UINT8* Page = AllocatePages(1);
+    if (Page == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    // MDTS is a power of two of the minimum page size; 0 means no limit
+    Nvme->MaxTransfer = COREBOOT_NVME_MAX_TRANSFER;
+    Status = NvmeIdentify(Nvme, NVME_CNS_CONTROLLER, 0, Page);
+    if (!EFI_ERROR(Status) && Page[NVME_ID_CTRL_MDTS] != 0 && Page[NVME_ID_CTRL_MDTS] < 20) {
+        Nvme->MaxTransfer = MIN(Nvme->MaxTransfer, (UINT32)NVME_PAGE_SIZE << Page[NVME_ID_CTRL_MDTS]);
+    }
+    if (!EFI_ERROR(Status)) {
+        Status = NvmeSelectNamespace(Nvme, Page);
+    }
+    FreePages(Page, 1);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    Status = NvmeCreateIoQueues(Nvme);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    Nvme->PrpLists = AllocatePages(Nvme->Io.Depth);
+    Nvme->Bounce = AllocatePages(EFI_SIZE_TO_PAGES(Nvme->MaxTransfer));
+    if (Nvme->PrpLists == NULL || Nvme->Bounce == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    DEBUG((DEBUG_INFO, "NVMe: namespace %u, %lu sectors, %u-byte blocks, %u KiB per command, queue depth %u\n",
+           Nvme->NamespaceId, Nvme->Device.sector_count, 1u << Nvme->LbaShift,
+           Nvme->MaxTransfer / 1024, Nvme->Io.Depth));
+
+    Nvme->Device.name = "nvme";
+    Nvme->Device.read = CorebootNvmeRead;
+    Nvme->Device.context = Nvme;
+    *Device = &Nvme->Device;
+    return EFI_SUCCESS;
+}
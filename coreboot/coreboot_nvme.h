@@ -0,0 +1,32 @@
+/*
+ * coreboot_nvme.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef COREBOOT_NVME_H
+#define COREBOOT_NVME_H
+
+#include <Uefi.h>
+#include "../fs/blockdev.h"
+
+// Polled NVMe driver for payload mode, where no firmware block protocol
+// sits under the filesystem layer. The first NVMe controller on the PCI
+// bus is reset and brought up with one admin queue and one I/O queue pair,
+// interrupts off; its first active namespace becomes a block device.
+//
+// A read is split into commands of at most the controller's transfer limit
+// (MDTS), each described with PRP1/PRP2 or a PRP list, and up to a queue's
+// worth of them are submitted with one doorbell write and reaped as they
+// complete, so a large read keeps the drive's queue full. Requests that are
+// not whole namespace blocks, or land at an odd address, go through a
+// bounce buffer.
+#define COREBOOT_NVME_QUEUE_DEPTH   64          // Entries per I/O queue; one page of SQ
+#define COREBOOT_NVME_MAX_TRANSFER  (1024 * 1024) // Per command, below any MDTS
+
+// Find and start the controller. On success *Device reads the namespace
+// and stays valid for the rest of the boot.
+EFI_STATUS EFIAPI CorebootNvmeInit(OUT block_device_t** Device);
+
+#endif // COREBOOT_NVME_H
@@ -19,6 +19,10 @@
 #include <IndustryStandard/Acpi.h>
 #include <IndustryStandard/SmBios.h>
 #include "coreboot_platform.h"
+#include "coreboot_console.h"
+#include "coreboot_serial.h"
+#include "coreboot_cbfs.h"
+#include "../uefi/uefi.h"
 #include "coreboot_payload.h"
 #include "../boot/menu.h"
 #include "../boot/settings.h"
@@ -254,8 +258,13 @@ InitializeConsole (
   VOID
   )
 {
-    // Use Coreboot framebuffer for console output
-    // Initialize font rendering if needed
+    // Serial output is buffered alongside whatever else is available
+    CorebootSerialInit();
+
+    // Text console on the Coreboot framebuffer, using the built-in font
+    if (!CorebootConsoleInit()) {
+        return EFI_UNSUPPORTED;
+    }
     
     DEBUG((DEBUG_INFO, "Console initialized\n"));
     return EFI_SUCCESS;
@@ -582,6 +591,21 @@ BloodhornLoadKernel (
 
     Print(L"Loading kernel: %s\n", kernel_path_wide);
 
+    // Boot flash first: a kernel in CBFS needs no storage stack at all
+    CBFS_MEDIA cbfs;
+    if (!EFI_ERROR(CbfsOpenBootMedia(&cbfs))) {
+        Status = CbfsLoad(&cbfs, kernel_path, EFI_PAGE_SIZE, MEM_PLACE_RELOCATABLE, &buffer, &size);
+        if (!EFI_ERROR(Status)) {
+            *kernel_buffer = buffer;
+            *kernel_size = (UINT32)size;
+            Print(L"Kernel loaded from CBFS: %u bytes\n", *kernel_size);
+            return TRUE;
+        }
+        if (Status != EFI_NOT_FOUND) {
+            Print(L"Failed to load kernel from CBFS: %r\n", Status);
+        }
+    }
+
     // Get root directory using UEFI services (Coreboot provides this)
     Status = get_root_dir(&root_dir);
     if (EFI_ERROR(Status)) {
@@ -660,24 +684,8 @@ BloodhornExecuteKernel (
     Print(L"Executing kernel at 0x%llx (%u bytes)\n",
           (UINT64)(UINTN)kernel_buffer, kernel_size);
 
-    // Get Coreboot memory map for proper kernel setup
-    UINT32 mem_map_count = 0;
-    CONST COREBOOT_MEM_ENTRY* mem_map = CorebootGetMemoryMap(&mem_map_count);
-
-    if (!mem_map || mem_map_count == 0) {
-        Print(L"Failed to get Coreboot memory map for kernel execution\n");
-        return FALSE;
-    }
-
-    // Find suitable memory region for kernel execution
-    for (UINT32 i = 0; i < mem_map_count; i++) {
-        if (mem_map[i].type == CB_MEM_RAM && mem_map[i].size > largest_size) {
-            kernel_base = mem_map[i].addr;
-            largest_size = mem_map[i].size;
-        }
-    }
-
-    if (kernel_base == 0) {
+    // Largest RAM region, precomputed when the coreboot table was parsed
+    if (!CorebootFindLargestMemoryRegion(&kernel_base, &largest_size) || kernel_base == 0) {
         Print(L"No suitable RAM region found for kernel execution\n");
         return FALSE;
     }
@@ -1063,7 +1071,7 @@ extern EFI_STATUS get_root_dir(EFI_FILE_HANDLE* root_dir);
 extern EFI_STATUS CorebootReboot(VOID);
 extern CONST COREBOOT_FB* CorebootGetFramebuffer(VOID);
 extern UINT64 CorebootGetTotalMemory(VOID);
-extern UINT32 CorebootGetMemoryMap(UINT32* count);
+extern CONST COREBOOT_MEM_ENTRY* CorebootGetMemoryMap(UINT32* count);
 extern BOOLEAN CorebootInitGraphics(VOID);
 extern EFI_STATUS CorebootInitStorage(VOID);
 extern EFI_STATUS CorebootInitNetwork(VOID);
@@ -158,6 +158,7 @@ EFI_STATUS EFIAPI CorebootInitTpm(VOID);
 VOID EFIAPI CorebootReboot(VOID);
 VOID EFIAPI CorebootPrintSystemInfo(VOID);
 UINT64 EFIAPI CorebootGetTotalMemory(VOID);
+BOOLEAN EFIAPI CorebootFindLargestMemoryRegion(OUT UINT64* Addr, OUT UINT64* Size);
 
 // Forward declarations for memory entries and framebuffer
 typedef struct {
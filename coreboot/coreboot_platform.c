@@ -12,99 +12,30 @@
 #include <Library/MemoryAllocationLib.h>
 #include <Library/DebugLib.h>
 #include <Library/PrintLib.h>
+#include <Library/PciLib.h>
 #include <Guid/Acpi.h>
 #include <IndustryStandard/Acpi.h>
 #include <IndustryStandard/SmBios.h>
 
-// Coreboot firmware table structures
-#define COREBOOT_TABLE_MAGIC 0x43425442  // "CBTB"
-
-typedef struct {
-    UINT32 tag;
-    UINT32 size;
-} COREBOOT_TABLE_ENTRY;
-
-typedef struct {
-    UINT32 magic;
-    UINT32 header_bytes;
-    UINT32 header_checksum;
-    UINT32 table_bytes;
-    UINT32 table_checksum;
-    COREBOOT_TABLE_ENTRY entries[0];
-} COREBOOT_TABLE_HEADER;
-
-// Coreboot table tags
-#define CB_TAG_MEMORY     0x0001
-#define CB_TAG_HWRPB      0x0002
-#define CB_TAG_MAINBOARD  0x0003
-#define CB_TAG_VERSION    0x0004
-#define CB_TAG_EXTRA_VERSION 0x0005
-#define CB_TAG_BUILD      0x0006
-#define CB_TAG_COMPILE_TIME 0x0007
-#define CB_TAG_COMPILER   0x0008
-#define CB_TAG_LINKER     0x0009
-#define CB_TAG_ASSEMBLER  0x000a
-#define CB_TAG_FRAMEBUFFER 0x0012
-#define CB_TAG_SERIAL     0x0020
-#define CB_TAG_CONSOLE    0x0021
-#define CB_TAG_FORWARD    0x0022
-#define CB_TAG_LINK       0x0023
-#define CB_TAG_CBMEM_CONSOLE 0x0024
-#define CB_TAG_MRC_CACHE  0x0025
-#define CB_TAG_VBNV       0x0026
-#define CB_TAG_VBOOT_WORKBUF 0x0027
-#define CB_TAG_DMA       0x0030
-#define CB_TAG_BOARD_ID   0x0040
-
-// Memory map entry structure
-typedef struct {
-    UINT64 addr;
-    UINT64 size;
-    UINT32 type;
-} COREBOOT_MEM_ENTRY;
-
-// Memory types
-#define CB_MEM_RAM       1
-#define CB_MEM_RESERVED  2
-#define CB_MEM_ACPI      3
-#define CB_MEM_NVS       4
-#define CB_MEM_UNUSABLE  5
-#define CB_MEM_DISABLED  6
-
-// Framebuffer structure
-typedef struct {
-    UINT64 physical_address;
-    UINT32 x_resolution;
-    UINT32 y_resolution;
-    UINT32 bytes_per_line;
-    UINT8 bits_per_pixel;
-    UINT8 red_mask_pos;
-    UINT8 red_mask_size;
-    UINT8 green_mask_pos;
-    UINT8 green_mask_size;
-    UINT8 blue_mask_pos;
-    UINT8 blue_mask_size;
-    UINT8 reserved_mask_pos;
-    UINT8 reserved_mask_size;
-} COREBOOT_FB;
+#include "coreboot_platform.h"
+#include "coreboot_serial.h"
+#include "coreboot_nvme.h"
+#include "coreboot_ahci.h"
+
+// PCI configuration space
+#define PCI_VENDOR_ID_OFFSET        0x00
+#define PCI_COMMAND_OFFSET          0x04
+#define PCI_CLASS_OFFSET            0x08        // Revision, then prog-if, subclass, class
+#define PCI_HEADER_TYPE_OFFSET      0x0E
+#define PCI_SUBORDINATE_BUS_OFFSET  0x1A
+#define PCI_COMMAND_MEMORY          0x0002
+#define PCI_COMMAND_BUS_MASTER      0x0004
+#define PCI_BAR_IO                  0x01
+#define PCI_BAR_64BIT               0x04
 
 // Global Coreboot platform state
 STATIC COREBOOT_TABLE_HEADER* cb_header = NULL;
-STATIC COREBOOT_FB* cb_framebuffer = NULL;
-STATIC COREBOOT_MEM_ENTRY* cb_memory_map = NULL;
-STATIC UINT32 cb_memory_map_entries = 0;
-
-// Coreboot system information
-typedef struct {
-    CHAR8* version;
-    CHAR8* extra_version;
-    CHAR8* build;
-    CHAR8* compile_time;
-    CHAR8* compiler;
-    CHAR8* assembler;
-    UINT16 board_id;
-} COREBOOT_SYSINFO;
-
+STATIC COREBOOT_TABLE_INFO cb_info = {0};
 STATIC COREBOOT_SYSINFO cb_sysinfo = {0};
 
 /**
@@ -117,36 +48,39 @@ CorebootPlatformInit (
   VOID
   )
 {
+    cb_header = NULL;
+
     // Find Coreboot table in low memory
     for (UINT32 addr = 0x500; addr < 0x1000; addr += 16) {
-        cb_header = (COREBOOT_TABLE_HEADER*)(UINTN)addr;
+        COREBOOT_TABLE_HEADER* candidate = (COREBOOT_TABLE_HEADER*)(UINTN)addr;
 
         // Verify magic and checksums
-        if (cb_header->magic == COREBOOT_TABLE_MAGIC) {
+        if (candidate->magic == COREBOOT_TABLE_MAGIC) {
             UINT32 checksum = 0;
-            UINT8* ptr = (UINT8*)cb_header;
+            UINT8* ptr = (UINT8*)candidate;
 
             // Calculate header checksum
-            for (UINT32 i = 0; i < cb_header->header_bytes; i++) {
+            for (UINT32 i = 0; i < candidate->header_bytes; i++) {
                 checksum += ptr[i];
             }
             checksum = (UINT8)(0x100 - (checksum & 0xFF));
 
-            if (checksum != cb_header->header_checksum) {
+            if (checksum != candidate->header_checksum) {
                 continue; // Checksum mismatch
             }
 
             // Verify table checksum
             checksum = 0;
-            for (UINT32 i = 0; i < cb_header->table_bytes; i++) {
-                checksum += ptr[cb_header->header_bytes + i];
+            for (UINT32 i = 0; i < candidate->table_bytes; i++) {
+                checksum += ptr[candidate->header_bytes + i];
             }
             checksum = (UINT8)(0x100 - (checksum & 0xFF));
 
-            if (checksum != cb_header->table_checksum) {
+            if (checksum != candidate->table_checksum) {
                 continue; // Checksum mismatch
             }
 
+            cb_header = candidate;
             break; // Found valid Coreboot table
         }
     }
@@ -159,8 +93,69 @@ CorebootPlatformInit (
     return CorebootParseTable();
 }
 
+/**
+ * Insert a memory range into the sorted table, merging it with neighbours
+ * of the same type that it touches or overlaps
+ */
+STATIC
+VOID
+CorebootAddMemoryRange (
+  IN UINT64 Addr,
+  IN UINT64 Size,
+  IN UINT32 Type
+  )
+{
+    if (Size == 0) {
+        return;
+    }
+
+    UINT32 pos = 0;
+    while (pos < cb_info.mem_count && cb_info.mem[pos].addr < Addr) {
+        pos++;
+    }
+
+    // Extend the previous range if contiguous, otherwise insert a new one
+    COREBOOT_MEM_ENTRY* prev = (pos > 0) ? &cb_info.mem[pos - 1] : NULL;
+    if (prev && prev->type == Type && prev->addr + prev->size >= Addr) {
+        if (Addr + Size > prev->addr + prev->size) {
+            prev->size = Addr + Size - prev->addr;
+        }
+        pos--;
+    } else {
+        if (cb_info.mem_count == COREBOOT_MAX_MEM_RANGES) {
+            DEBUG((DEBUG_WARN, "Coreboot memory map truncated at %u ranges\n", cb_info.mem_count));
+            return;
+        }
+
+        CopyMem(&cb_info.mem[pos + 1], &cb_info.mem[pos],
+                (cb_info.mem_count - pos) * sizeof(COREBOOT_MEM_ENTRY));
+        cb_info.mem[pos].addr = Addr;
+        cb_info.mem[pos].size = Size;
+        cb_info.mem[pos].type = Type;
+        cb_info.mem_count++;
+    }
+
+    // Swallow following ranges the grown one now reaches
+    while (pos + 1 < cb_info.mem_count) {
+        COREBOOT_MEM_ENTRY* cur = &cb_info.mem[pos];
+        COREBOOT_MEM_ENTRY* next = &cb_info.mem[pos + 1];
+        if (next->type != cur->type || cur->addr + cur->size < next->addr) {
+            break;
+        }
+        if (next->addr + next->size > cur->addr + cur->size) {
+            cur->size = next->addr + next->size - cur->addr;
+        }
+        CopyMem(next, next + 1,
+                (cb_info.mem_count - pos - 2) * sizeof(COREBOOT_MEM_ENTRY));
+        cb_info.mem_count--;
+    }
+}
+
 /**
  * Parse Coreboot table entries
+ *
+ * Walks the table once and fills cb_info and cb_sysinfo; every query below
+ * is answered from them.
  */
 BOOLEAN
 EFIAPI
@@ -172,53 +167,101 @@ CorebootParseTable (
         return FALSE;
     }
 
-    COREBOOT_TABLE_ENTRY* entry = cb_header->entries;
+    SetMem(&cb_info, sizeof(cb_info), 0);
+    SetMem(&cb_sysinfo, sizeof(cb_sysinfo), 0);
 
-    for (UINT32 i = 0; i < 128; i++) { // Reasonable limit
-        if (entry->tag == 0) {
-            break; // End of entries
+    UINT8* cursor = (UINT8*)cb_header + cb_header->header_bytes;
+    UINT8* table_end = cursor + cb_header->table_bytes;
+
+    while (cursor + sizeof(COREBOOT_TABLE_ENTRY) <= table_end) {
+        COREBOOT_TABLE_ENTRY* entry = (COREBOOT_TABLE_ENTRY*)cursor;
+        UINT8* payload = cursor + sizeof(*entry);
+
+        if (entry->tag == 0 || entry->size < sizeof(*entry) ||
+            entry->size > (UINTN)(table_end - cursor)) {
+            break; // End of entries or malformed record
         }
 
         switch (entry->tag) {
-            case CB_TAG_MEMORY:
-                cb_memory_map = (COREBOOT_MEM_ENTRY*)((UINT8*)entry + sizeof(*entry));
-                cb_memory_map_entries = entry->size / sizeof(COREBOOT_MEM_ENTRY);
+            case CB_TAG_MEMORY: {
+                CONST COREBOOT_MEM_ENTRY* ranges = (CONST COREBOOT_MEM_ENTRY*)payload;
+                UINT32 count = (entry->size - sizeof(*entry)) / sizeof(COREBOOT_MEM_ENTRY);
+                for (UINT32 i = 0; i < count; i++) {
+                    CorebootAddMemoryRange(ranges[i].addr, ranges[i].size, ranges[i].type);
+                }
                 break;
+            }
 
             case CB_TAG_FRAMEBUFFER:
-                cb_framebuffer = (COREBOOT_FB*)((UINT8*)entry + sizeof(*entry));
+                cb_info.framebuffer = (CONST COREBOOT_FB*)payload;
+                break;
+
+            case CB_TAG_ACPI_RSDP:
+                cb_info.acpi_rsdp = (VOID*)(UINTN)ReadUnaligned64((CONST UINT64*)payload);
+                break;
+
+            case CB_TAG_CBMEM_ENTRY: {
+                CONST COREBOOT_CBMEM_ENTRY* cbmem = (CONST COREBOOT_CBMEM_ENTRY*)entry;
+                if (entry->size >= sizeof(*cbmem) && cbmem->id == CBMEM_ID_SMBIOS) {
+                    cb_info.smbios_entry = (VOID*)(UINTN)cbmem->address;
+                }
+                break;
+            }
+
+            case CB_TAG_BOOT_MEDIA_PARAMS:
+                if (entry->size >= sizeof(COREBOOT_BOOT_MEDIA)) {
+                    cb_info.boot_media = (CONST COREBOOT_BOOT_MEDIA*)entry;
+                }
+                break;
+
+            case CB_TAG_SERIAL:
+                if (entry->size >= sizeof(COREBOOT_SERIAL)) {
+                    cb_info.serial = (CONST COREBOOT_SERIAL*)entry;
+                }
                 break;
 
             case CB_TAG_VERSION:
-                cb_sysinfo.version = (CHAR8*)((UINT8*)entry + sizeof(*entry));
+                cb_sysinfo.version = (CHAR8*)payload;
                 break;
 
             case CB_TAG_EXTRA_VERSION:
-                cb_sysinfo.extra_version = (CHAR8*)((UINT8*)entry + sizeof(*entry));
+                cb_sysinfo.extra_version = (CHAR8*)payload;
                 break;
 
             case CB_TAG_BUILD:
-                cb_sysinfo.build = (CHAR8*)((UINT8*)entry + sizeof(*entry));
+                cb_sysinfo.build = (CHAR8*)payload;
                 break;
 
             case CB_TAG_COMPILE_TIME:
-                cb_sysinfo.compile_time = (CHAR8*)((UINT8*)entry + sizeof(*entry));
+                cb_sysinfo.compile_time = (CHAR8*)payload;
                 break;
 
             case CB_TAG_COMPILER:
-                cb_sysinfo.compiler = (CHAR8*)((UINT8*)entry + sizeof(*entry));
+                cb_sysinfo.compiler = (CHAR8*)payload;
                 break;
 
             case CB_TAG_ASSEMBLER:
-                cb_sysinfo.assembler = (CHAR8*)((UINT8*)entry + sizeof(*entry));
+                cb_sysinfo.assembler = (CHAR8*)payload;
                 break;
 
             case CB_TAG_BOARD_ID:
-                cb_sysinfo.board_id = *(UINT16*)((UINT8*)entry + sizeof(*entry));
+                cb_sysinfo.board_id = *(UINT16*)payload;
                 break;
         }
 
-        entry = (COREBOOT_TABLE_ENTRY*)((UINT8*)entry + entry->size);
+        cursor += entry->size;
+    }
+
+    // Totals over the merged map, so later queries are plain loads
+    for (UINT32 i = 0; i < cb_info.mem_count; i++) {
+        if (cb_info.mem[i].type != CB_MEM_RAM) {
+            continue;
+        }
+        cb_info.total_ram += cb_info.mem[i].size;
+        if (cb_info.mem[i].size > cb_info.largest_ram_size) {
+            cb_info.largest_ram_addr = cb_info.mem[i].addr;
+            cb_info.largest_ram_size = cb_info.mem[i].size;
+        }
     }
 
     return TRUE;
@@ -237,7 +280,19 @@ CorebootGetSysinfo (
 }
 
 /**
- * Get memory map from Coreboot
+ * Get the parsed coreboot table
+ */
+CONST COREBOOT_TABLE_INFO*
+EFIAPI
+CorebootGetTableInfo (
+  VOID
+  )
+{
+    return cb_header ? &cb_info : NULL;
+}
+
+/**
+ * Get memory map from Coreboot, sorted by address and merged
  */
 CONST COREBOOT_MEM_ENTRY*
 EFIAPI
@@ -246,9 +301,9 @@ CorebootGetMemoryMap (
   )
 {
     if (Count) {
-        *Count = cb_memory_map_entries;
+        *Count = cb_info.mem_count;
     }
-    return cb_memory_map;
+    return cb_info.mem_count ? cb_info.mem : NULL;
 }
 
 /**
@@ -260,7 +315,7 @@ CorebootGetFramebuffer (
   VOID
   )
 {
-    return cb_framebuffer;
+    return cb_info.framebuffer;
 }
 
 /**
@@ -284,18 +339,7 @@ CorebootGetTotalMemory (
   VOID
   )
 {
-    if (!cb_memory_map) {
-        return 0;
-    }
-
-    UINT64 total = 0;
-    for (UINT32 i = 0; i < cb_memory_map_entries; i++) {
-        if (cb_memory_map[i].type == CB_MEM_RAM) {
-            total += cb_memory_map[i].size;
-        }
-    }
-
-    return total;
+    return cb_info.total_ram;
 }
 
 /**
@@ -308,27 +352,12 @@ CorebootFindLargestMemoryRegion (
   OUT UINT64* Size
   )
 {
-    if (!cb_memory_map || !Addr || !Size) {
+    if (!Addr || !Size || cb_info.largest_ram_size == 0) {
         return FALSE;
     }
 
-    UINT64 largest_addr = 0;
-    UINT64 largest_size = 0;
-
-    for (UINT32 i = 0; i < cb_memory_map_entries; i++) {
-        if (cb_memory_map[i].type == CB_MEM_RAM &&
-            cb_memory_map[i].size > largest_size) {
-            largest_addr = cb_memory_map[i].addr;
-            largest_size = cb_memory_map[i].size;
-        }
-    }
-
-    if (largest_size == 0) {
-        return FALSE;
-    }
-
-    *Addr = largest_addr;
-    *Size = largest_size;
+    *Addr = cb_info.largest_ram_addr;
+    *Size = cb_info.largest_ram_size;
     return TRUE;
 }
 
@@ -341,7 +370,7 @@ CorebootInitGraphics (
   VOID
   )
 {
-    if (!cb_framebuffer) {
+    if (!cb_info.framebuffer) {
         return FALSE;
     }
 
@@ -359,8 +388,8 @@ CorebootGetFramebufferAddress (
   VOID
   )
 {
-    if (cb_framebuffer) {
-        return (VOID*)(UINTN)cb_framebuffer->physical_address;
+    if (cb_info.framebuffer) {
+        return (VOID*)(UINTN)cb_info.framebuffer->physical_address;
     }
     return NULL;
 }
@@ -376,13 +405,13 @@ CorebootGetFramebufferInfo (
   OUT UINT32* Bpp
   )
 {
-    if (!cb_framebuffer) {
+    if (!cb_info.framebuffer) {
         return FALSE;
     }
 
-    if (Width) *Width = cb_framebuffer->x_resolution;
-    if (Height) *Height = cb_framebuffer->y_resolution;
-    if (Bpp) *Bpp = cb_framebuffer->bits_per_pixel;
+    if (Width) *Width = cb_info.framebuffer->x_resolution;
+    if (Height) *Height = cb_info.framebuffer->y_resolution;
+    if (Bpp) *Bpp = cb_info.framebuffer->bits_per_pixel;
 
     return TRUE;
 }
@@ -402,7 +431,75 @@ CorebootInitPci (
 }
 
 /**
- * Initialize storage devices (handled by Coreboot)
+ * Find the first PCI function of a class (class, subclass and prog-if as
+ * one 24-bit code), walking only the buses behind bridges
+ */
+BOOLEAN
+EFIAPI
+CorebootPciFindClass (
+  IN  UINT32 ClassCode,
+  OUT UINTN* PciAddress
+  )
+{
+    UINT32 LastBus = 0;
+
+    for (UINT32 Bus = 0; Bus <= LastBus && Bus < 256; Bus++) {
+        for (UINT32 Dev = 0; Dev < 32; Dev++) {
+            for (UINT32 Func = 0; Func < 8; Func++) {
+                UINTN Address = PCI_LIB_ADDRESS(Bus, Dev, Func, 0);
+                if (PciRead16(Address + PCI_VENDOR_ID_OFFSET) == 0xFFFF) {
+                    if (Func == 0) {
+                        break;
+                    }
+                    continue;
+                }
+
+                UINT8 HeaderType = PciRead8(Address + PCI_HEADER_TYPE_OFFSET);
+                if ((HeaderType & 0x7F) == 1) {
+                    LastBus = MAX(LastBus, PciRead8(Address + PCI_SUBORDINATE_BUS_OFFSET));
+                } else if ((PciRead32(Address + PCI_CLASS_OFFSET) >> 8) == ClassCode) {
+                    *PciAddress = Address;
+                    return TRUE;
+                }
+
+                if (Func == 0 && !(HeaderType & 0x80)) {
+                    break;                      // Single-function device
+                }
+            }
+        }
+    }
+    return FALSE;
+}
+
+/**
+ * Address of a function's memory BAR, with memory decoding and bus
+ * mastering turned on; 0 if coreboot left it unassigned
+ */
+UINT64
+EFIAPI
+CorebootPciEnableMemoryBar (
+  IN UINTN PciAddress,
+  IN UINT32 BarOffset
+  )
+{
+    UINT32 Bar = PciRead32(PciAddress + BarOffset);
+    if (Bar & PCI_BAR_IO) {
+        return 0;
+    }
+
+    UINT64 Base = Bar & ~(UINT64)0xF;
+    if (Bar & PCI_BAR_64BIT) {
+        Base |= LShiftU64(PciRead32(PciAddress + BarOffset + 4), 32);
+    }
+    if (Base != 0) {
+        PciOr16(PciAddress + PCI_COMMAND_OFFSET, PCI_COMMAND_MEMORY | PCI_COMMAND_BUS_MASTER);
+    }
+    return Base;
+}
+
+/**
+ * Initialize storage: bring up a disk with the native drivers, NVMe first,
+ * then SATA, and make it the disk the filesystem layer reads from
  */
 BOOLEAN
 EFIAPI
@@ -410,9 +507,12 @@ CorebootInitStorage (
   VOID
   )
 {
-    // Storage controller initialization handled by Coreboot
-    // BloodHorn can access storage devices through standard interfaces
-    return TRUE;
+    block_device_t* Device = NULL;
+
+    if (EFI_ERROR(CorebootNvmeInit(&Device)) && EFI_ERROR(CorebootAhciInit(&Device))) {
+        return FALSE;
+    }
+    return blockdev_attach(Device) == 0;
 }
 
 /**
@@ -466,10 +566,9 @@ CorebootGetAcpiRsdp (
   VOID
   )
 {
-    // Coreboot generates ACPI tables
-    // BloodHorn can find RSDP in standard locations
-    // For now, return NULL - bootloader should find it itself
-    return NULL;
+    // NULL when coreboot did not publish one; the caller falls back to
+    // scanning the standard locations
+    return cb_info.acpi_rsdp;
 }
 
 /**
@@ -481,10 +580,9 @@ CorebootGetSmbiosEntryPoint (
   VOID
   )
 {
-    // Coreboot generates SMBIOS tables
-    // BloodHorn can find SMBIOS entry point in standard locations
-    // For now, return NULL - bootloader should find it itself
-    return NULL;
+    // NULL when coreboot did not publish one; the caller falls back to
+    // scanning the standard locations
+    return cb_info.smbios_entry;
 }
 
 /**
@@ -496,6 +594,8 @@ CorebootReboot (
   VOID
   )
 {
+    CorebootSerialFlush();
+
     // Use Coreboot's reset mechanism
     // For now, use standard reboot mechanism
     __asm__ volatile ("int $0x19"); // BIOS reboot
@@ -510,6 +610,8 @@ CorebootShutdown (
   VOID
   )
 {
+    CorebootSerialFlush();
+
     // Use Coreboot's power management
     // For now, use ACPI shutdown mechanism
     __asm__ volatile ("outw %w0, %w1" : : "a" (0x2000), "d" (0xB004)); // ACPI shutdown
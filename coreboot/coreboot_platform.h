@@ -50,7 +50,45 @@ typedef struct {
 #define CB_TAG_VBNV       0x0026
 #define CB_TAG_VBOOT_WORKBUF 0x0027
 #define CB_TAG_DMA       0x0030
+#define CB_TAG_BOOT_MEDIA_PARAMS 0x0030
+#define CB_TAG_CBMEM_ENTRY 0x0031
 #define CB_TAG_BOARD_ID   0x0040
+#define CB_TAG_ACPI_RSDP  0x0043
+
+// CBMEM entry carrying a table coreboot built for the OS
+typedef struct {
+    UINT32 tag;
+    UINT32 size;
+    UINT64 address;
+    UINT32 entry_size;
+    UINT32 id;
+} COREBOOT_CBMEM_ENTRY;
+
+#define CBMEM_ID_SMBIOS   0x534d4254  // "SMBT"
+
+// Where the boot flash and its CBFS region are (offsets into the flash)
+typedef struct {
+    UINT32 tag;
+    UINT32 size;
+    UINT64 fmap_offset;
+    UINT64 cbfs_offset;
+    UINT64 cbfs_size;
+    UINT64 boot_media_size;
+} COREBOOT_BOOT_MEDIA;
+
+// Console UART set up by coreboot (lb_serial); the record includes tag and size
+typedef struct {
+    UINT32 tag;
+    UINT32 size;
+    UINT32 type;
+    UINT32 baseaddr;
+    UINT32 baud;
+    UINT32 regwidth;            // Register stride in bytes for MMIO UARTs
+    UINT32 input_hertz;
+} COREBOOT_SERIAL;
+
+#define CB_SERIAL_TYPE_IO_MAPPED      1
+#define CB_SERIAL_TYPE_MEMORY_MAPPED  2
 
 // Memory map entry structure
 typedef struct {
@@ -95,12 +133,32 @@ typedef struct {
     UINT16 board_id;
 } COREBOOT_SYSINFO;
 
+// Upper bound on memory ranges kept after merging
+#define COREBOOT_MAX_MEM_RANGES 64
+
+// Everything later boot stages ask of the coreboot table, filled in by one
+// walk in CorebootParseTable. Memory ranges are sorted by address with
+// adjacent ranges of the same type merged.
+typedef struct {
+    COREBOOT_MEM_ENTRY mem[COREBOOT_MAX_MEM_RANGES];
+    UINT32 mem_count;
+    UINT64 total_ram;
+    UINT64 largest_ram_addr;
+    UINT64 largest_ram_size;
+    CONST COREBOOT_FB* framebuffer;
+    VOID* acpi_rsdp;
+    VOID* smbios_entry;
+    CONST COREBOOT_BOOT_MEDIA* boot_media;
+    CONST COREBOOT_SERIAL* serial;
+} COREBOOT_TABLE_INFO;
+
 // Platform initialization functions
 BOOLEAN EFIAPI CorebootPlatformInit(VOID);
 BOOLEAN EFIAPI CorebootParseTable(VOID);
 
 // System information functions
 CONST COREBOOT_SYSINFO* EFIAPI CorebootGetSysinfo(VOID);
+CONST COREBOOT_TABLE_INFO* EFIAPI CorebootGetTableInfo(VOID);
 BOOLEAN EFIAPI CorebootIsPresent(VOID);
 VOID EFIAPI CorebootPrintInfo(VOID);
 
@@ -117,7 +175,9 @@ BOOLEAN EFIAPI CorebootGetFramebufferInfo(OUT UINT32* Width, OUT UINT32* Height,
 
 // Hardware initialization functions (handled by Coreboot)
 BOOLEAN EFIAPI CorebootInitPci(VOID);
-BOOLEAN EFIAPI CorebootInitStorage(VOID);
+BOOLEAN EFIAPI CorebootPciFindClass(IN UINT32 ClassCode, OUT UINTN* PciAddress);
+UINT64 EFIAPI CorebootPciEnableMemoryBar(IN UINTN PciAddress, IN UINT32 BarOffset);
+BOOLEAN EFIAPI CorebootInitStorage(VOID);    // Attaches an NVMe or SATA disk
 BOOLEAN EFIAPI CorebootInitUsb(VOID);
 BOOLEAN EFIAPI CorebootInitNetwork(VOID);
 BOOLEAN EFIAPI CorebootInitTpm(VOID);
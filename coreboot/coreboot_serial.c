@@ -0,0 +1,289 @@
+/*
+ * coreboot_serial.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/IoLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include "coreboot_platform.h"
+#include "coreboot_serial.h"
+
+// 16550 registers, in units of the register stride
+#define UART_THR            0
+#define UART_FCR            2
+#define UART_IIR            2
+#define UART_LSR            5
+
+#define UART_FCR_FIFO_ENABLE    0x01
+#define UART_IIR_FIFO_MASK      0xC0
+#define UART_LSR_THRE           0x20    // Transmit holding register (or FIFO) empty
+#define UART_LSR_TEMT           0x40    // Transmitter completely idle
+
+#define UART_FIFO_DEPTH     16
+
+#define CB_SERIAL_RING_SIZE 8192        // Power of two
+#define CB_SERIAL_TICK      10000       // Timer period in 100 ns units (1 ms)
+
+typedef struct {
+    BOOLEAN active;
+    BOOLEAN mmio;
+    UINTN base;
+    UINT32 stride;
+    UINT32 fifo_depth;
+    UINT32 head;                // Next byte to queue
+    UINT32 tail;                // Next byte to send
+    EFI_EVENT timer;
+    CHAR8 ring[CB_SERIAL_RING_SIZE];
+} CB_SERIAL;
+
+STATIC CB_SERIAL cb_serial = {0};
+
+STATIC
+UINT8
+CorebootSerialIn (
+  IN UINT32 Reg
+  )
+{
+    if (!cb_serial.mmio) {
+        return IoRead8(cb_serial.base + Reg);
+    }
+    if (cb_serial.stride == 4) {
+        return (UINT8)MmioRead32(cb_serial.base + Reg * 4);
+    }
+    return MmioRead8(cb_serial.base + Reg * cb_serial.stride);
+}
+
+STATIC
+VOID
+CorebootSerialOut (
+  IN UINT32 Reg,
+  IN UINT8 Value
+  )
+{
+    if (!cb_serial.mmio) {
+        IoWrite8(cb_serial.base + Reg, Value);
+    } else if (cb_serial.stride == 4) {
+        MmioWrite32(cb_serial.base + Reg * 4, Value);
+    } else {
+        MmioWrite8(cb_serial.base + Reg * cb_serial.stride, Value);
+    }
+}
+
+/**
+ * The ring is shared with the timer notification; hold it off while the
+ * indices move
+ */
+STATIC
+EFI_TPL
+CorebootSerialLock (
+  VOID
+  )
+{
+    return gBS ? gBS->RaiseTPL(TPL_HIGH_LEVEL) : TPL_APPLICATION;
+}
+
+STATIC
+VOID
+CorebootSerialUnlock (
+  IN EFI_TPL Tpl
+  )
+{
+    if (gBS) {
+        gBS->RestoreTPL(Tpl);
+    }
+}
+
+/**
+ * Hand up to one FIFO's worth of queued bytes to the UART if its
+ * transmitter is empty. Called with the lock held.
+ *
+ * @return TRUE if anything was sent
+ */
+STATIC
+BOOLEAN
+CorebootSerialFill (
+  VOID
+  )
+{
+    UINT32 n;
+
+    if (cb_serial.head == cb_serial.tail || !(CorebootSerialIn(UART_LSR) & UART_LSR_THRE)) {
+        return FALSE;
+    }
+    for (n = 0; n < cb_serial.fifo_depth && cb_serial.tail != cb_serial.head; n++) {
+        CorebootSerialOut(UART_THR, (UINT8)cb_serial.ring[cb_serial.tail++ & (CB_SERIAL_RING_SIZE - 1)]);
+    }
+    return TRUE;
+}
+
+/**
+ * Queue one byte; a full ring is drained at line rate rather than dropped
+ */
+STATIC
+VOID
+CorebootSerialQueue (
+  IN CHAR8 c
+  )
+{
+    while (cb_serial.head - cb_serial.tail >= CB_SERIAL_RING_SIZE) {
+        if (!CorebootSerialFill()) {
+            CpuPause();
+        }
+    }
+    cb_serial.ring[cb_serial.head++ & (CB_SERIAL_RING_SIZE - 1)] = c;
+}
+
+STATIC
+VOID
+EFIAPI
+CorebootSerialTick (
+  IN EFI_EVENT Event,
+  IN VOID* Context
+  )
+{
+    CorebootSerialPoll();
+}
+
+/**
+ * Bind to the UART described by the coreboot table. Line settings are
+ * left as coreboot programmed them.
+ *
+ * @return TRUE if a usable UART was found
+ */
+BOOLEAN
+EFIAPI
+CorebootSerialInit (
+  VOID
+  )
+{
+    CONST COREBOOT_TABLE_INFO* info = CorebootGetTableInfo();
+    CONST COREBOOT_SERIAL* serial = info ? info->serial : NULL;
+
+    if (cb_serial.active) {
+        return TRUE;
+    }
+    if (!serial || !serial->baseaddr) {
+        return FALSE;
+    }
+
+    if (serial->type == CB_SERIAL_TYPE_IO_MAPPED) {
+        cb_serial.mmio = FALSE;
+        cb_serial.stride = 1;
+    } else if (serial->type == CB_SERIAL_TYPE_MEMORY_MAPPED) {
+        cb_serial.mmio = TRUE;
+        cb_serial.stride = serial->regwidth ? serial->regwidth : 1;
+    } else {
+        return FALSE;
+    }
+    cb_serial.base = serial->baseaddr;
+    cb_serial.head = cb_serial.tail = 0;
+
+    // Turn the FIFOs on without clearing them, as coreboot's last bytes
+    // may still be going out; the IIR then shows whether there are any
+    CorebootSerialOut(UART_FCR, UART_FCR_FIFO_ENABLE);
+    cb_serial.fifo_depth = ((CorebootSerialIn(UART_IIR) & UART_IIR_FIFO_MASK) == UART_IIR_FIFO_MASK) ?
+                           UART_FIFO_DEPTH : 1;
+
+    cb_serial.timer = NULL;
+    if (gBS && !EFI_ERROR(gBS->CreateEvent(EVT_TIMER | EVT_NOTIFY_SIGNAL, TPL_NOTIFY,
+                                           CorebootSerialTick, NULL, &cb_serial.timer))) {
+        gBS->SetTimer(cb_serial.timer, TimerPeriodic, CB_SERIAL_TICK);
+    }
+
+    cb_serial.active = TRUE;
+    return TRUE;
+}
+
+/**
+ * Check whether output is going to the coreboot UART
+ */
+BOOLEAN
+EFIAPI
+CorebootSerialActive (
+  VOID
+  )
+{
+    return cb_serial.active;
+}
+
+/**
+ * Queue Len characters, with '\n' sent as CR LF, and start sending them.
+ * Without a timer to drain the ring the write waits for it to empty.
+ */
+VOID
+EFIAPI
+CorebootSerialWrite (
+  IN CONST CHAR8* str,
+  IN UINTN len
+  )
+{
+    EFI_TPL Tpl;
+
+    if (!cb_serial.active || !str) {
+        return;
+    }
+
+    Tpl = CorebootSerialLock();
+    for (UINTN i = 0; i < len; i++) {
+        if (str[i] == '\n') {
+            CorebootSerialQueue('\r');
+        }
+        CorebootSerialQueue(str[i]);
+    }
+    CorebootSerialFill();
+    CorebootSerialUnlock(Tpl);
+
+    if (!cb_serial.timer) {
+        CorebootSerialFlush();
+    }
+}
+
+/**
+ * Move queued bytes on if the UART has room; cheap enough for idle loops
+ */
+VOID
+EFIAPI
+CorebootSerialPoll (
+  VOID
+  )
+{
+    EFI_TPL Tpl;
+
+    if (!cb_serial.active) {
+        return;
+    }
+    Tpl = CorebootSerialLock();
+    CorebootSerialFill();
+    CorebootSerialUnlock(Tpl);
+}
+
+/**
+ * Send everything queued and wait for the transmitter to go idle, for
+ * paths that reset, hand over or hang
+ */
+VOID
+EFIAPI
+CorebootSerialFlush (
+  VOID
+  )
+{
+    EFI_TPL Tpl;
+
+    if (!cb_serial.active) {
+        return;
+    }
+    Tpl = CorebootSerialLock();
+    while (cb_serial.head != cb_serial.tail) {
+        if (!CorebootSerialFill()) {
+            CpuPause();
+        }
+    }
+    while (!(CorebootSerialIn(UART_LSR) & UART_LSR_TEMT)) {
+        CpuPause();
+    }
+    CorebootSerialUnlock(Tpl);
+}
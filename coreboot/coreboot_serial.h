@@ -0,0 +1,24 @@
+/*
+ * coreboot_serial.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef COREBOOT_SERIAL_H
+#define COREBOOT_SERIAL_H
+
+#include <Uefi.h>
+
+// Buffered output on the 16550 UART coreboot reports in its table. Writes
+// are queued in a ring and handed to the UART a FIFO's worth at a time
+// whenever its transmitter is empty: on each write, from a periodic timer
+// and from CorebootSerialPoll. CorebootSerialFlush sends everything still
+// queued and must run before anything that may not return.
+BOOLEAN EFIAPI CorebootSerialInit(VOID);
+BOOLEAN EFIAPI CorebootSerialActive(VOID);
+VOID EFIAPI CorebootSerialWrite(IN CONST CHAR8* str, IN UINTN len);
+VOID EFIAPI CorebootSerialPoll(VOID);
+VOID EFIAPI CorebootSerialFlush(VOID);
+
+#endif // COREBOOT_SERIAL_H
@@ -0,0 +1,436 @@
+/*
+ * blockdev.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include "blockdev.h"
+#include "compat.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define PAGE_NONE       0xFFFF
+#define HASH_BUCKETS    128
+
+// One cached page of BLOCKDEV_PAGE_SECTORS sectors
+typedef struct {
+    block_device_t *dev;        // Owner (pages of several devices share the cache)
+    uint64_t index;             // Page number (sector / BLOCKDEV_PAGE_SECTORS)
+    uint32_t last_used;         // 0 = free slot
+    uint16_t next;              // Hash chain
+    uint16_t sectors;           // Valid sectors (short at the end of the disk)
+    bool prefetched;            // Brought in by readahead and not used yet
+} blockdev_page_t;
+
+// Loop device: a linear view of extents on a parent device
+typedef struct {
+    block_device_t dev;
+    block_device_t *parent;     // NULL = boot disk
+    uint32_t count;
+    blockdev_extent_t extents[];
+} blockdev_loop_t;
+
+static block_device_t *boot_dev = NULL;
+static block_device_t *current_dev = NULL;  // boot_dev unless a mount selected another
+static blockdev_page_t pages[BLOCKDEV_CACHE_PAGES];
+static uint16_t buckets[HASH_BUCKETS];
+static uint8_t *page_data = NULL;       // BLOCKDEV_CACHE_PAGES pages
+static uint8_t *fill_buf = NULL;        // Staging for one miss plus readahead
+static uint32_t page_clock = 0;
+static blockdev_stats_t stats;
+
+// Sequential stream detection
+static block_device_t *stream_dev = NULL;
+static uint64_t next_expected = 0;
+static uint32_t readahead_window = 0;
+
+static uint32_t page_hash(block_device_t *dev, uint64_t index) {
+    uint64_t key = index ^ ((uintptr_t)dev >> 4);
+    return (uint32_t)(key ^ (key >> 7)) % HASH_BUCKETS;
+}
+
+static void cache_clear(void) {
+    for (uint32_t i = 0; i < BLOCKDEV_CACHE_PAGES; i++) {
+        pages[i].last_used = 0;
+        pages[i].next = PAGE_NONE;
+        pages[i].prefetched = false;
+    }
+    for (uint32_t i = 0; i < HASH_BUCKETS; i++) {
+        buckets[i] = PAGE_NONE;
+    }
+    page_clock = 0;
+    next_expected = 0;
+    readahead_window = 0;
+}
+
+static bool cache_alloc(void) {
+    if (page_data) {
+        return true;
+    }
+
+    page_data = (uint8_t *)malloc((size_t)BLOCKDEV_CACHE_PAGES * BLOCKDEV_PAGE_SIZE);
+    fill_buf = (uint8_t *)malloc((size_t)(BLOCKDEV_READAHEAD_MAX + 1) * BLOCKDEV_PAGE_SIZE);
+    if (!page_data || !fill_buf) {
+        free(page_data);
+        free(fill_buf);
+        page_data = NULL;
+        fill_buf = NULL;
+        return false;
+    }
+
+    cache_clear();
+    return true;
+}
+
+static void cache_free(void) {
+    free(page_data);
+    free(fill_buf);
+    page_data = NULL;
+    fill_buf = NULL;
+    cache_clear();
+}
+
+static int device_read(uint64_t sector, uint32_t count, void *buf) {
+    return blockdev_read_raw(current_dev, sector, count, buf);
+}
+
+static blockdev_page_t *cache_lookup(uint64_t index) {
+    for (uint16_t i = buckets[page_hash(current_dev, index)]; i != PAGE_NONE; i = pages[i].next) {
+        if (pages[i].index == index && pages[i].dev == current_dev) {
+            return &pages[i];
+        }
+    }
+    return NULL;
+}
+
+static void cache_unlink(uint16_t slot) {
+    uint16_t *link = &buckets[page_hash(pages[slot].dev, pages[slot].index)];
+    while (*link != PAGE_NONE) {
+        if (*link == slot) {
+            *link = pages[slot].next;
+            break;
+        }
+        link = &pages[*link].next;
+    }
+}
+
+// Take a free slot, or the least recently used one
+static uint16_t cache_victim(void) {
+    uint16_t victim = 0;
+    for (uint16_t i = 0; i < BLOCKDEV_CACHE_PAGES; i++) {
+        if (pages[i].last_used == 0) {
+            return i;
+        }
+        if (pages[i].last_used < pages[victim].last_used) {
+            victim = i;
+        }
+    }
+    cache_unlink(victim);
+    return victim;
+}
+
+static void cache_insert(uint64_t index, const uint8_t *data, uint16_t sectors, bool prefetched) {
+    uint16_t slot = cache_victim();
+    uint32_t bucket = page_hash(current_dev, index);
+
+    pages[slot].dev = current_dev;
+    pages[slot].index = index;
+    pages[slot].sectors = sectors;
+    pages[slot].prefetched = prefetched;
+    pages[slot].last_used = ++page_clock;
+    pages[slot].next = buckets[bucket];
+    buckets[bucket] = slot;
+    memcpy(page_data + (size_t)slot * BLOCKDEV_PAGE_SIZE, data, (size_t)sectors * BLOCKDEV_SECTOR_SIZE);
+}
+
+// Fetch page `index` plus up to `ahead` following pages that are not
+// cached yet, with a single device read. The first `demand` pages are
+// wanted by the current request; the rest are readahead. Returns the
+// page at `index`.
+static blockdev_page_t *cache_fill(uint64_t index, uint32_t demand, uint32_t ahead) {
+    uint64_t first_sector = index * BLOCKDEV_PAGE_SECTORS;
+    uint32_t count = 1;
+
+    if (ahead < demand - 1) {
+        ahead = demand - 1;
+    }
+    while (count <= ahead && !cache_lookup(index + count)) {
+        count++;
+    }
+
+    uint64_t sectors = (uint64_t)count * BLOCKDEV_PAGE_SECTORS;
+    if (current_dev->sector_count) {
+        if (first_sector >= current_dev->sector_count) {
+            return NULL;
+        }
+        if (first_sector + sectors > current_dev->sector_count) {
+            sectors = current_dev->sector_count - first_sector;
+            count = (uint32_t)((sectors + BLOCKDEV_PAGE_SECTORS - 1) / BLOCKDEV_PAGE_SECTORS);
+        }
+    }
+
+    if (device_read(first_sector, (uint32_t)sectors, fill_buf) != 0) {
+        return NULL;
+    }
+
+    // Insert the readahead pages first so the demand page ends up most recent
+    for (uint32_t i = count; i-- > 0; ) {
+        uint64_t page_first = (uint64_t)i * BLOCKDEV_PAGE_SECTORS;
+        uint64_t valid = sectors - page_first;
+        if (valid > BLOCKDEV_PAGE_SECTORS) valid = BLOCKDEV_PAGE_SECTORS;
+        cache_insert(index + i, fill_buf + page_first * BLOCKDEV_SECTOR_SIZE, (uint16_t)valid, i >= demand);
+    }
+    if (count > demand) {
+        stats.readahead_pages += count - demand;
+    }
+
+    return cache_lookup(index);
+}
+
+// Track whether reads form a forward stream and size the readahead window
+static uint32_t update_stream(uint64_t sector, uint32_t count) {
+    if (stream_dev == current_dev && sector == next_expected && sector != 0) {
+        if (readahead_window == 0) {
+            readahead_window = BLOCKDEV_READAHEAD_MIN;
+        } else if (readahead_window < BLOCKDEV_READAHEAD_MAX) {
+            readahead_window *= 2;
+        }
+    } else {
+        readahead_window = 0;
+    }
+    stream_dev = current_dev;
+    next_expected = sector + count;
+    return readahead_window;
+}
+
+int blockdev_attach(block_device_t *dev) {
+    if (!dev || !dev->read) {
+        return -1;
+    }
+
+    boot_dev = dev;
+    current_dev = dev;
+    cache_clear();
+    blockdev_reset_stats();
+    return 0;
+}
+
+void blockdev_detach(void) {
+    boot_dev = NULL;
+    current_dev = NULL;
+    cache_free();
+}
+
+block_device_t *blockdev_select(block_device_t *dev) {
+    block_device_t *previous = current_dev;
+    current_dev = dev ? dev : boot_dev;
+    return previous;
+}
+
+block_device_t *blockdev_current(void) {
+    return current_dev;
+}
+
+int blockdev_read_raw(block_device_t *dev, uint64_t sector, uint32_t count, void *buf) {
+    if (!dev) dev = boot_dev;
+    if (!dev) {
+        return -1;
+    }
+    if (dev->sector_count && (sector >= dev->sector_count || count > dev->sector_count - sector)) {
+        return -1; // Past the end of the device
+    }
+
+    stats.device_reads++;
+    stats.device_sectors += count;
+    return dev->read(dev, sector, count, buf);
+}
+
+// Split a loop read at extent boundaries and forward each piece; sectors
+// that no extent covers (holes in a sparse image) read as zeros
+static int loop_read(block_device_t *dev, uint64_t sector, uint32_t count, void *buf) {
+    blockdev_loop_t *loop = (blockdev_loop_t *)dev->context;
+    uint8_t *dst = (uint8_t *)buf;
+
+    // Binary search for the extent holding the first sector
+    uint32_t lo = 0, hi = loop->count;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (loop->extents[mid].offset <= sector) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    for (uint32_t e = lo; count > 0; ) {
+        const blockdev_extent_t *ext = e < loop->count ? &loop->extents[e] : NULL;
+        uint32_t n;
+
+        if (!ext || sector < ext->offset) {
+            uint64_t gap = ext ? ext->offset - sector : count;
+            n = gap < count ? (uint32_t)gap : count;
+            memset(dst, 0, (size_t)n * BLOCKDEV_SECTOR_SIZE);
+        } else {
+            uint64_t skip = sector - ext->offset;
+            if (skip >= ext->sectors) {
+                e++;
+                continue;
+            }
+            n = (uint32_t)(ext->sectors - skip);
+            if (n > count) n = count;
+
+            if (blockdev_read_raw(loop->parent, ext->sector + skip, n, dst) != 0) {
+                return -1;
+            }
+        }
+        dst += (size_t)n * BLOCKDEV_SECTOR_SIZE;
+        sector += n;
+        count -= n;
+    }
+
+    return 0;
+}
+
+block_device_t *blockdev_create_loop(block_device_t *parent, const blockdev_extent_t *extents, uint32_t count,
+                                     uint64_t sector_count) {
+    if (!extents || count == 0) {
+        return NULL;
+    }
+
+    blockdev_loop_t *loop = (blockdev_loop_t *)malloc(sizeof(blockdev_loop_t) + (size_t)count * sizeof(blockdev_extent_t));
+    if (!loop) {
+        return NULL;
+    }
+
+    memcpy(loop->extents, extents, (size_t)count * sizeof(blockdev_extent_t));
+    loop->parent = parent;
+    loop->count = count;
+    loop->dev.name = "loop";
+    loop->dev.sector_count = extents[count - 1].offset + extents[count - 1].sectors;
+    if (sector_count > loop->dev.sector_count) {
+        loop->dev.sector_count = sector_count; // Sparse tail
+    }
+    loop->dev.read = loop_read;
+    loop->dev.context = loop;
+    return &loop->dev;
+}
+
+void blockdev_destroy_loop(block_device_t *dev) {
+    if (!dev || dev->read != loop_read) {
+        return;
+    }
+
+    blockdev_invalidate_device(dev);
+    if (current_dev == dev) {
+        current_dev = boot_dev;
+    }
+    free(dev->context);
+}
+
+int blockdev_read(uint64_t sector, uint32_t count, void *buf) {
+    if (!current_dev || !buf) {
+        return -1;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    uint32_t ahead = update_stream(sector, count);
+
+    if (count >= BLOCKDEV_BYPASS_SECTORS || !cache_alloc()) {
+        stats.bypass_reads++;
+        return device_read(sector, count, buf);
+    }
+
+    uint8_t *dst = (uint8_t *)buf;
+    while (count > 0) {
+        uint64_t index = sector / BLOCKDEV_PAGE_SECTORS;
+        uint32_t in_page = (uint32_t)(sector % BLOCKDEV_PAGE_SECTORS);
+        uint32_t n = BLOCKDEV_PAGE_SECTORS - in_page;
+        if (n > count) n = count;
+
+        blockdev_page_t *page = cache_lookup(index);
+        if (page) {
+            stats.hits++;
+            if (page->prefetched) {
+                stats.readahead_hits++;
+                page->prefetched = false;
+            }
+            page->last_used = ++page_clock;
+        } else {
+            // A miss fetches the rest of this request in the same read
+            uint32_t demand = (uint32_t)((sector + count - 1) / BLOCKDEV_PAGE_SECTORS - index) + 1;
+            stats.misses++;
+            page = cache_fill(index, demand, ahead);
+            if (!page) {
+                return -1;
+            }
+            page->prefetched = false;
+        }
+
+        if (in_page + n > page->sectors) {
+            return -1; // Past the end of the disk
+        }
+
+        uint16_t slot = (uint16_t)(page - pages);
+        memcpy(dst, page_data + (size_t)slot * BLOCKDEV_PAGE_SIZE + (size_t)in_page * BLOCKDEV_SECTOR_SIZE,
+               (size_t)n * BLOCKDEV_SECTOR_SIZE);
+
+        dst += (size_t)n * BLOCKDEV_SECTOR_SIZE;
+        sector += n;
+        count -= n;
+    }
+
+    return 0;
+}
+
+void blockdev_invalidate(void) {
+    cache_clear();
+}
+
+void blockdev_invalidate_device(block_device_t *dev) {
+    for (uint16_t i = 0; i < BLOCKDEV_CACHE_PAGES; i++) {
+        if (pages[i].last_used != 0 && pages[i].dev == dev) {
+            cache_unlink(i);
+            pages[i].last_used = 0;
+            pages[i].next = PAGE_NONE;
+        }
+    }
+    if (stream_dev == dev) {
+        stream_dev = NULL;
+    }
+}
+
+void blockdev_get_stats(blockdev_stats_t *out) {
+    if (out) {
+        *out = stats;
+    }
+}
+
+void blockdev_reset_stats(void) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+void blockdev_print_stats(void) {
+    uint64_t lookups = stats.hits + stats.misses;
+
+    printf("Block device: %s\n", current_dev && current_dev->name ? current_dev->name : "(none)");
+    printf("  cache hits:      %llu / %llu (%llu%%)\n",
+           (unsigned long long)stats.hits, (unsigned long long)lookups,
+           (unsigned long long)(lookups ? stats.hits * 100 / lookups : 0));
+    printf("  readahead:       %llu pages, %llu used\n",
+           (unsigned long long)stats.readahead_pages, (unsigned long long)stats.readahead_hits);
+    printf("  bypass reads:    %llu\n", (unsigned long long)stats.bypass_reads);
+    printf("  device reads:    %llu (%llu KiB)\n",
+           (unsigned long long)stats.device_reads, (unsigned long long)(stats.device_sectors / 2));
+}
+
+int read_sector(uint32_t lba, uint8_t *buf) {
+    return blockdev_read(lba, 1, buf);
+}
+
+int disk_read(void *buf, uint32_t lba, uint32_t count) {
+    return blockdev_read(lba, count, buf);
+}
@@ -0,0 +1,104 @@
+/*
+ * blockdev.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_BLOCKDEV_H
+#define BLOODHORN_BLOCKDEV_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "compat.h"
+
+// All LBAs seen by the filesystem drivers are 512-byte sectors from the
+// start of the disk; backends translate to their native block size.
+#define BLOCKDEV_SECTOR_SIZE        512
+
+// Read cache geometry: 4 KiB pages, 1 MiB total. The cache is read-only
+// (nothing is ever written back), so dropping it is always safe.
+#define BLOCKDEV_PAGE_SECTORS       8
+#define BLOCKDEV_PAGE_SIZE          (BLOCKDEV_PAGE_SECTORS * BLOCKDEV_SECTOR_SIZE)
+#define BLOCKDEV_CACHE_PAGES        256
+
+// Sequential readahead grows from BLOCKDEV_READAHEAD_MIN pages, doubling
+// on each sequential miss up to BLOCKDEV_READAHEAD_MAX (128 KiB)
+#define BLOCKDEV_READAHEAD_MIN      4
+#define BLOCKDEV_READAHEAD_MAX      32
+
+// Requests at least this large go straight to the device: bulk extent
+// reads are already efficient and would only evict metadata pages
+#define BLOCKDEV_BYPASS_SECTORS     128
+
+typedef struct block_device block_device_t;
+
+// A disk the filesystem layer reads from
+struct block_device {
+    const char *name;
+    uint64_t sector_count;      // Size in 512-byte sectors (0 = unknown)
+    int (*read)(block_device_t *dev, uint64_t sector, uint32_t count, void *buf);
+    void *context;              // Backend data
+};
+
+// Cache counters since attach or the last blockdev_reset_stats
+typedef struct {
+    uint64_t hits;              // Pages served from the cache
+    uint64_t misses;            // Pages that had to be fetched
+    uint64_t readahead_pages;   // Pages fetched ahead of demand
+    uint64_t readahead_hits;    // Prefetched pages that were later used
+    uint64_t bypass_reads;      // Large requests sent straight to the device
+    uint64_t device_reads;      // Backend read calls
+    uint64_t device_sectors;    // Sectors transferred by the backend
+} blockdev_stats_t;
+
+// A run of a file (or any byte range) that is contiguous on a device
+typedef struct {
+    uint64_t offset;            // Start within the file, in 512-byte sectors
+    uint64_t sector;            // Start on the device
+    uint32_t sectors;           // Length
+} blockdev_extent_t;
+
+// Make `dev` the boot disk: the default device behind read_sector,
+// disk_read and fs_read_sectors. The cache is dropped and memory for it is
+// allocated on first use.
+int blockdev_attach(block_device_t *dev);
+
+// Detach the boot disk and free the cache
+void blockdev_detach(void);
+
+// Route reads to `dev` (NULL = boot disk) until the next call; returns the
+// previous selection. The VFS selects a mount's device around driver calls.
+block_device_t *blockdev_select(block_device_t *dev);
+
+block_device_t *blockdev_current(void);
+
+// Uncached read from a specific device (for stacked devices)
+int blockdev_read_raw(block_device_t *dev, uint64_t sector, uint32_t count, void *buf);
+
+// Loop device presenting `extents` of `parent` (NULL = boot disk) as one
+// linear disk of `sector_count` sectors (0 = up to the last extent). The
+// extent array is copied; sector 0 is file offset 0 and gaps between
+// extents read as zeros.
+block_device_t *blockdev_create_loop(block_device_t *parent, const blockdev_extent_t *extents, uint32_t count,
+                                     uint64_t sector_count);
+void blockdev_destroy_loop(block_device_t *dev);
+
+// Read `count` 512-byte sectors through the cache (0 on success)
+int blockdev_read(uint64_t sector, uint32_t count, void *buf);
+
+// Forget every cached page (e.g. after something wrote to the disk)
+void blockdev_invalidate(void);
+
+// Forget the cached pages of one device
+void blockdev_invalidate_device(block_device_t *dev);
+
+void blockdev_get_stats(blockdev_stats_t *stats);
+void blockdev_reset_stats(void);
+void blockdev_print_stats(void);
+
+// Raw sector entry points used by the drivers and loaders
+int read_sector(uint32_t lba, uint8_t *buf);
+int disk_read(void *buf, uint32_t lba, uint32_t count);
+
+#endif // BLOODHORN_BLOCKDEV_H
@@ -11,39 +11,25 @@
 #include <stdio.h>
 #include "compat.h"
 #include "ext2.h"
-#include "fs_common.h"
+#include "blockdev.h"
 #include "mm.h"
 
-// External disk I/O function
-extern int disk_read(void *buf, uint32_t lba, uint32_t count);
-
-// Global filesystem instance
-static const filesystem_t ext2_fs = {
-    .name = "ext2",
-    .detect = ext2_detect,
-    .mount = ext2_mount,
-    .unmount = ext2_unmount,
-    .ops = &ext2_ops
-};
-
-// Filesystem operations
-static const fs_operations_t ext2_ops = {
-    .read_file = ext2_read_file,
-    .list_dir = ext2_list_dir,
-    .get_info = ext2_get_info,
-    .find_file = ext2_find_file
-};
-
 // Internal helper functions
-static int ext2_read_blocks(ext2_private_t *priv, uint32_t block, uint32_t count, void *buf) {
-    uint32_t lba = priv->lba + block * (priv->block_size / 512);
-    return disk_read(buf, lba, count * (priv->block_size / 512));
+static int ext2_read_blocks(ext2_private_t *priv, uint64_t block, uint32_t count, void *buf) {
+    uint32_t sectors_per_block = priv->block_size / 512;
+    uint32_t lba = (uint32_t)(priv->lba + block * sectors_per_block);
+    return disk_read(buf, lba, count * sectors_per_block);
 }
 
-static int ext2_read_block(ext2_private_t *priv, uint32_t block_num, void *buf) {
+int ext2_read_block(ext2_private_t *priv, uint32_t block_num, void *buf) {
     return ext2_read_blocks(priv, block_num, 1, buf);
 }
 
+// Group descriptors are 32 bytes, or s_desc_size bytes on 64bit ext4
+static struct ext2_group_desc *ext2_group(ext2_private_t *priv, uint32_t group) {
+    return (struct ext2_group_desc *)((uint8_t *)priv->gd + (size_t)group * priv->desc_size);
+}
+
 static int ext2_read_superblock(ext2_private_t *priv) {
     // Superblock is at offset 1024 bytes (block 1 for 1024-byte blocks)
     uint32_t lba = priv->lba + (1024 / 512);
@@ -54,43 +40,58 @@ static int ext2_read_group_descriptors(ext2_private_t *priv) {
     // Calculate number of block group descriptors
     priv->group_count = (priv->sb.s_blocks_count + priv->blocks_per_group - 1) / priv->blocks_per_group;
     
+    priv->desc_size = sizeof(struct ext2_group_desc);
+    if ((priv->sb.s_feature_incompat & EXT4_FEATURE_INCOMPAT_64BIT) &&
+        priv->sb.s_desc_size >= sizeof(struct ext2_group_desc)) {
+        priv->desc_size = priv->sb.s_desc_size;
+    }
+    
     // Allocate memory for group descriptors
-    uint32_t gd_size = priv->group_count * sizeof(struct ext2_group_desc);
-    priv->gd = (struct ext2_group_desc *)kmalloc(gd_size);
+    uint64_t gd_size = (uint64_t)priv->group_count * priv->desc_size;
+    uint64_t gd_blocks = (gd_size + priv->block_size - 1) / priv->block_size;
+    if (gd_blocks > priv->sb.s_blocks_count) {
+        return -1; // More descriptor blocks than the volume has
+    }
+    priv->gd = (struct ext2_group_desc *)kmalloc((size_t)gd_blocks * priv->block_size);
     if (!priv->gd) {
         return -1; // Out of memory
     }
     
     // Read group descriptors (starts at first block after superblock)
-    uint32_t gd_block = 1 + (priv->block_size > 1024 ? 1 : 0);
-    return ext2_read_blocks(priv, gd_block, 
-                           (gd_size + priv->block_size - 1) / priv->block_size, 
-                           priv->gd);
+    uint32_t gd_block = priv->sb.s_first_data_block + 1;
+    if (ext2_read_blocks(priv, gd_block, (uint32_t)gd_blocks, priv->gd) != 0) {
+        kfree(priv->gd);
+        priv->gd = NULL;
+        return -1; // Read error
+    }
+    return 0;
 }
 
 // Public interface implementation
-int ext2_detect(uint32_t lba) {
+static bool ext2_detect(uint32_t lba) {
     struct ext2_superblock sb;
     
     // Read superblock
     if (disk_read(&sb, lba + (1024 / 512), 2) != 0) {
-        return 0; // Read error
+        return false; // Read error
     }
     
     // Check magic number
     if (sb.s_magic != EXT2_SUPER_MAGIC) {
-        return 0; // Not an ext2 filesystem
+        return false; // Not an ext2 filesystem
     }
     
     // Check if this is a valid ext2 filesystem
     if (sb.s_rev_level == 0 && sb.s_first_ino != 11) {
-        return 0; // Invalid first inode
+        return false; // Invalid first inode
     }
     
-    return 1; // Valid ext2 filesystem
+    return true; // Valid ext2 filesystem
 }
 
-void *ext2_mount(uint32_t lba) {
+static void *ext2_mount(uint32_t lba, void *opts) {
+    (void)opts;
+    
     // Allocate and initialize private data
     ext2_private_t *priv = (ext2_private_t *)kmalloc(sizeof(ext2_private_t));
     if (!priv) {
@@ -107,8 +108,10 @@ void *ext2_mount(uint32_t lba) {
         return NULL; // Failed to read superblock
     }
     
-    // Verify superblock
-    if (priv->sb.s_magic != EXT2_SUPER_MAGIC) {
+    // Verify superblock; the geometry below divides and shifts by these
+    if (priv->sb.s_magic != EXT2_SUPER_MAGIC || priv->sb.s_blocks_per_group == 0 ||
+        priv->sb.s_inodes_per_group == 0 || priv->sb.s_log_block_size > EXT2_MAX_LOG_BLOCK_SIZE ||
+        priv->sb.s_inode_size > (1024u << priv->sb.s_log_block_size)) {
         kfree(priv);
         return NULL; // Invalid superblock
     }
@@ -127,23 +130,58 @@ void *ext2_mount(uint32_t lba) {
         return NULL; // Failed to read group descriptors
     }
     
+    // Inode table cache; without it inodes are read one block at a time
+    priv->inode_cache_data = (uint8_t *)kmalloc((size_t)EXT2_INODE_CACHE_BLOCKS * priv->block_size);
+    if (priv->inode_cache_data) {
+        for (uint32_t i = 0; i < EXT2_INODE_CACHE_BLOCKS; i++) {
+            priv->inode_cache[i].data = priv->inode_cache_data + (size_t)i * priv->block_size;
+        }
+    }
+    
     return priv;
 }
 
-void ext2_unmount(void *private_data) {
+static void ext2_unmount(void *private_data) {
     if (!private_data) return;
     
     ext2_private_t *priv = (ext2_private_t *)private_data;
     
-    // Free group descriptors
+    // Free group descriptors and the inode table cache
     if (priv->gd) {
         kfree(priv->gd);
     }
+    if (priv->inode_cache_data) {
+        kfree(priv->inode_cache_data);
+    }
     
     // Free private data
     kfree(priv);
 }
 
+// Inode table block `block` from the cache, read into the least recently
+// used slot on a miss
+static const uint8_t *ext2_inode_block(ext2_private_t *priv, uint64_t block) {
+    ext2_inode_cache_entry_t *victim = &priv->inode_cache[0];
+    for (uint32_t i = 0; i < EXT2_INODE_CACHE_BLOCKS; i++) {
+        ext2_inode_cache_entry_t *e = &priv->inode_cache[i];
+        if (e->last_used != 0 && e->block == block) {
+            e->last_used = ++priv->inode_cache_clock;
+            return e->data;
+        }
+        if (e->last_used < victim->last_used) {
+            victim = e;
+        }
+    }
+    
+    if (ext2_read_blocks(priv, block, 1, victim->data) != 0) {
+        victim->last_used = 0;
+        return NULL;
+    }
+    victim->block = block;
+    victim->last_used = ++priv->inode_cache_clock;
+    return victim->data;
+}
+
 int ext2_read_inode(ext2_private_t *priv, uint32_t inode_num, struct ext2_inode *inode) {
     if (!priv || !inode || inode_num == 0) {
         return -1; // Invalid parameters
@@ -156,13 +194,22 @@ int ext2_read_inode(ext2_private_t *priv, uint32_t inode_num, struct ext2_inode
     }
     
     // Get the inode table block for this group
-    uint32_t inode_table_block = priv->gd[group].bg_inode_table;
+    uint32_t inode_table_block = ext2_group(priv, group)->bg_inode_table;
     
     // Calculate the index of the inode in the inode table
     uint32_t index = (inode_num - 1) % priv->inodes_per_group;
     uint32_t block_offset = (index * priv->inode_size) / priv->block_size;
     uint32_t inode_offset = (index * priv->inode_size) % priv->block_size;
     
+    if (priv->inode_cache_data) {
+        const uint8_t *cached = ext2_inode_block(priv, (uint64_t)inode_table_block + block_offset);
+        if (!cached) {
+            return -1; // Read error
+        }
+        memcpy(inode, cached + inode_offset, sizeof(struct ext2_inode));
+        return 0;
+    }
+    
     // Read the block containing the inode
     uint8_t *block = (uint8_t *)kmalloc(priv->block_size);
     if (!block) {
@@ -181,234 +228,829 @@ int ext2_read_inode(ext2_private_t *priv, uint32_t inode_num, struct ext2_inode
     return 0;
 }
 
-int ext2_read_file(ext2_private_t *priv, uint32_t inode_num, uint8_t *buf, uint32_t max_size) {
-    struct ext2_inode inode;
-    if (ext2_read_inode(priv, inode_num, &inode) != 0) {
-        return -1; // Failed to read inode
+// Block mapping state for one bulk read: caches the last indirect block or
+// extent node seen at each tree level so neighbouring lookups are free
+#define EXT2_MAP_LEVELS 5
+
+typedef struct {
+    ext2_private_t *priv;
+    const struct ext2_inode *inode;
+    uint64_t cached[EXT2_MAP_LEVELS];
+    uint8_t *level_buf[EXT2_MAP_LEVELS];
+} ext2_map_ctx_t;
+
+static void ext2_map_init(ext2_map_ctx_t *ctx, ext2_private_t *priv, const struct ext2_inode *inode) {
+    ctx->priv = priv;
+    ctx->inode = inode;
+    for (int i = 0; i < EXT2_MAP_LEVELS; i++) {
+        ctx->cached[i] = 0;
+        ctx->level_buf[i] = NULL;
+    }
+}
+
+static void ext2_map_release(ext2_map_ctx_t *ctx) {
+    for (int i = 0; i < EXT2_MAP_LEVELS; i++) {
+        if (ctx->level_buf[i]) {
+            kfree(ctx->level_buf[i]);
+            ctx->level_buf[i] = NULL;
+        }
+    }
+}
+
+static const uint8_t *ext2_map_load(ext2_map_ctx_t *ctx, int level, uint64_t block) {
+    if (level >= EXT2_MAP_LEVELS || block == 0) {
+        return NULL;
+    }
+    if (!ctx->level_buf[level]) {
+        ctx->level_buf[level] = (uint8_t *)kmalloc(ctx->priv->block_size);
+        if (!ctx->level_buf[level]) {
+            return NULL;
+        }
+        ctx->cached[level] = 0;
     }
+    if (ctx->cached[level] != block) {
+        if (ext2_read_blocks(ctx->priv, block, 1, ctx->level_buf[level]) != 0) {
+            ctx->cached[level] = 0;
+            return NULL;
+        }
+        ctx->cached[level] = block;
+    }
+    return ctx->level_buf[level];
+}
+
+// Length of the physically contiguous (or all-hole) run starting at table[i]
+static uint32_t ext2_scan_run(const uint32_t *table, uint32_t i, uint32_t n, uint64_t *physical) {
+    uint32_t first = table[i];
+    uint32_t count = 1;
     
-    uint32_t file_size = inode.i_size;
-    uint32_t to_read = (file_size < max_size) ? file_size : max_size;
-    uint32_t read_bytes = 0;
+    if (first == 0) {
+        while (i + count < n && table[i + count] == 0) count++;
+    } else {
+        while (i + count < n && table[i + count] == first + count) count++;
+    }
+    *physical = first;
+    return count;
+}
+
+// Classic direct/indirect block map
+static int ext2_map_indirect(ext2_map_ctx_t *ctx, uint64_t logical, uint64_t *physical, uint32_t *count) {
+    uint32_t blocks[EXT2_N_BLOCKS];
+    uint64_t per = ctx->priv->block_size / 4;
+    const uint32_t *table;
     
-    for (int i = 0; i < 12 && read_bytes < to_read; ++i) {
-        if (inode.i_block[i] == 0) break;
-        
-        uint32_t chunk = (to_read - read_bytes > priv->block_size) ? priv->block_size : (to_read - read_bytes);
-        if (ext2_read_block(priv, inode.i_block[i], buf + read_bytes) != 0) {
-            return -1; // Read error
+    // The inode is packed: copy the map out rather than point into it
+    memcpy(blocks, ctx->inode->i_block, sizeof(blocks));
+    if (logical < EXT2_NDIR_BLOCKS) {
+        *count = ext2_scan_run(blocks, (uint32_t)logical, EXT2_NDIR_BLOCKS, physical);
+        return 0;
+    }
+    logical -= EXT2_NDIR_BLOCKS;
+    
+    uint32_t ind = blocks[EXT2_IND_BLOCK];
+    if (logical >= per) {
+        logical -= per;
+        if (logical < per * per) {
+            // Double indirect
+            table = (const uint32_t *)ext2_map_load(ctx, 0, blocks[EXT2_DIND_BLOCK]);
+            ind = table ? table[logical / per] : 0;
+            logical %= per;
+        } else {
+            // Triple indirect
+            logical -= per * per;
+            if (logical >= per * per * per) {
+                return -1; // Beyond the largest mappable file
+            }
+            table = (const uint32_t *)ext2_map_load(ctx, 0, blocks[EXT2_TIND_BLOCK]);
+            uint32_t dind = table ? table[logical / (per * per)] : 0;
+            table = (const uint32_t *)ext2_map_load(ctx, 1, dind);
+            ind = table ? table[(logical / per) % per] : 0;
+            logical %= per;
         }
-        read_bytes += chunk;
     }
     
+    table = (const uint32_t *)ext2_map_load(ctx, 2, ind);
+    if (!table) {
+        // Hole (or unreadable pointer block): one block of zeros
+        *physical = 0;
+        *count = 1;
+        return ind == 0 ? 0 : -1;
+    }
+    *count = ext2_scan_run(table, (uint32_t)logical, (uint32_t)per, physical);
     return 0;
 }
 
-int ext2_find_file(ext2_private_t *priv, const char *filename, uint32_t *inode_out) {
-    struct ext2_inode root_inode;
-    if (ext2_read_inode(priv, 2, &root_inode) != 0) {
-        return -1; // Failed to read root inode
+// ext4 extent tree
+static int ext2_map_extent(ext2_map_ctx_t *ctx, uint64_t logical, uint64_t *physical, uint32_t *count) {
+    const uint8_t *node = (const uint8_t *)ctx->inode->i_block;
+    // Entries fit after the header: 4 in i_block, the rest of a block below it
+    uint32_t capacity = (sizeof(ctx->inode->i_block) - sizeof(struct ext4_extent_header)) / sizeof(struct ext4_extent);
+    uint32_t depth = 0;
+    
+    for (int level = 0; ; level++) {
+        const struct ext4_extent_header *eh = (const struct ext4_extent_header *)node;
+        if (eh->eh_magic != EXT4_EXT_MAGIC || eh->eh_entries > eh->eh_max || eh->eh_max > capacity ||
+            (level > 0 && eh->eh_depth != depth - 1)) {
+            return -1; // Corrupt tree
+        }
+        depth = eh->eh_depth;
+        
+        if (eh->eh_depth == 0) {
+            const struct ext4_extent *ext = (const struct ext4_extent *)(eh + 1);
+            for (uint16_t i = 0; i < eh->eh_entries; i++) {
+                uint32_t len = ext[i].ee_len > 32768 ? ext[i].ee_len - 32768u : ext[i].ee_len;
+                if (logical < ext[i].ee_block) {
+                    // Hole before this extent
+                    *physical = 0;
+                    *count = (uint32_t)(ext[i].ee_block - logical);
+                    return 0;
+                }
+                if (logical < (uint64_t)ext[i].ee_block + len) {
+                    uint32_t skip = (uint32_t)(logical - ext[i].ee_block);
+                    uint64_t start = ((uint64_t)ext[i].ee_start_hi << 32) | ext[i].ee_start_lo;
+                    // Uninitialized extents read back as zeros
+                    *physical = ext[i].ee_len > 32768 ? 0 : start + skip;
+                    *count = len - skip;
+                    return 0;
+                }
+            }
+            // Past the last extent: sparse tail
+            *physical = 0;
+            *count = 1;
+            return 0;
+        }
+        
+        // Index node: descend into the last child starting at or before `logical`
+        const struct ext4_extent_idx *idx = (const struct ext4_extent_idx *)(eh + 1);
+        if (eh->eh_entries == 0) {
+            return -1;
+        }
+        uint16_t pick = 0;
+        while (pick + 1 < eh->eh_entries && idx[pick + 1].ei_block <= logical) {
+            pick++;
+        }
+        uint64_t child = ((uint64_t)idx[pick].ei_leaf_hi << 32) | idx[pick].ei_leaf_lo;
+        node = ext2_map_load(ctx, level, child);
+        if (!node) {
+            return -1;
+        }
+        capacity = (ctx->priv->block_size - sizeof(struct ext4_extent_header)) / sizeof(struct ext4_extent);
     }
+}
+
+static int ext2_map_block(ext2_map_ctx_t *ctx, uint64_t logical, uint64_t *physical, uint32_t *count) {
+    if (ctx->inode->i_flags & EXT4_EXTENTS_FL) {
+        return ext2_map_extent(ctx, logical, physical, count);
+    }
+    return ext2_map_indirect(ctx, logical, physical, count);
+}
+
+// Read `size` bytes at `offset` from an inode's data. Runs of physically
+// contiguous blocks are merged (across extent and indirect-block
+// boundaries) and read with one disk_read straight into `buf`; only
+// partial first/last blocks are bounced. Returns bytes read or -1.
+int ext2_read_inode_data(ext2_private_t *priv, const struct ext2_inode *inode, uint8_t *buf, uint32_t size, uint64_t offset) {
+    uint32_t bs = priv->block_size;
+    uint64_t file_size = inode->i_size;
     
-    uint32_t block_size = priv->block_size;
-    uint8_t dir[block_size];
-    if (ext2_read_block(priv, root_inode.i_block[0], dir) != 0) {
-        return -1; // Read error
+    if ((inode->i_mode & EXT2_S_IFMT) == EXT2_S_IFREG) {
+        file_size |= (uint64_t)inode->i_size_high << 32;
+    }
+    if (offset >= file_size) {
+        return 0;
+    }
+    if (size > file_size - offset) {
+        size = (uint32_t)(file_size - offset);
     }
     
-    uint32_t offset = 0;
-    while (offset < block_size) {
-        uint32_t inode_num = *(uint32_t *)&dir[offset];
-        uint16_t rec_len = *(uint16_t *)&dir[offset+4];
-        uint8_t name_len = dir[offset+6];
-        char name[256];
-        memcpy(name, dir+offset+8, name_len); name[name_len] = 0;
+    ext2_map_ctx_t ctx;
+    ext2_map_init(&ctx, priv, inode);
+    uint8_t *bounce = NULL;
+    uint32_t done = 0;
+    
+    while (done < size) {
+        uint64_t pos = offset + done;
+        uint64_t logical = pos / bs;
+        uint32_t in_block = (uint32_t)(pos % bs);
+        uint32_t remaining = size - done;
+        uint32_t needed = (uint32_t)(((uint64_t)in_block + remaining + bs - 1) / bs);
+        uint64_t physical;
+        uint32_t count;
         
-        if (inode_num && strcmp(name, filename) == 0) {
-            *inode_out = inode_num;
-            return 0;
+        if (ext2_map_block(&ctx, logical, &physical, &count) != 0) {
+            goto fail;
         }
+        if (count > needed) count = needed;
         
-        offset += rec_len;
-        if (rec_len == 0) break;
+        // Keep extending while the next mapping continues the same run
+        while (count < needed) {
+            uint64_t next_physical;
+            uint32_t next_count;
+            if (ext2_map_block(&ctx, logical + count, &next_physical, &next_count) != 0) {
+                break;
+            }
+            bool contiguous = physical == 0 ? next_physical == 0 : next_physical == physical + count;
+            if (!contiguous) {
+                break;
+            }
+            count += next_count;
+            if (count > needed) count = needed;
+        }
+        
+        uint64_t run_bytes = (uint64_t)count * bs - in_block;
+        uint32_t chunk = run_bytes < remaining ? (uint32_t)run_bytes : remaining;
+        uint8_t *dst = buf + done;
+        
+        if (physical == 0) {
+            memset(dst, 0, chunk); // Sparse
+        } else {
+            uint32_t left = chunk;
+            uint64_t block = physical;
+            
+            if (in_block != 0 || left < bs) {
+                // Leading partial block
+                if (!bounce && !(bounce = (uint8_t *)kmalloc(bs))) goto fail;
+                if (ext2_read_blocks(priv, block, 1, bounce) != 0) goto fail;
+                uint32_t part = bs - in_block < left ? bs - in_block : left;
+                memcpy(dst, bounce + in_block, part);
+                dst += part;
+                left -= part;
+                block++;
+            }
+            
+            uint32_t whole = left / bs;
+            if (whole > 0) {
+                if (ext2_read_blocks(priv, block, whole, dst) != 0) goto fail;
+                dst += (size_t)whole * bs;
+                left -= whole * bs;
+                block += whole;
+            }
+            
+            if (left > 0) {
+                // Trailing partial block
+                if (!bounce && !(bounce = (uint8_t *)kmalloc(bs))) goto fail;
+                if (ext2_read_blocks(priv, block, 1, bounce) != 0) goto fail;
+                memcpy(dst, bounce, left);
+            }
+        }
+        
+        done += chunk;
     }
     
+    if (bounce) kfree(bounce);
+    ext2_map_release(&ctx);
+    return (int)done;
+    
+fail:
+    if (bounce) kfree(bounce);
+    ext2_map_release(&ctx);
     return -1;
 }
 
-int ext2_list_dir(ext2_private_t *priv, const char *path, fs_dirent_t *entries, uint32_t max_entries) {
-    uint32_t inode_num;
+int ext2_read_file(ext2_private_t *priv, uint32_t inode_num, uint8_t *buf, uint32_t max_size) {
     struct ext2_inode inode;
+    if (ext2_read_inode(priv, inode_num, &inode) != 0) {
+        return -1; // Failed to read inode
+    }
     
-    // Find the inode for the given path
-    if (strcmp(path, "/") == 0) {
-        inode_num = 2; // Root directory
-    } else {
-        if (ext2_find_file(priv, path, &inode_num) != 0) {
-            return -1; // Path not found
+    return ext2_read_inode_data(priv, &inode, buf, max_size, 0);
+}
+
+// Call `visit` for each live entry of a directory inode; stops when it returns non-zero
+typedef int (*ext2_dir_visitor_t)(const struct ext2_dir_entry *de, void *context);
+
+// The entries of one directory block of `len` bytes; 1 or -1 when the
+// visitor stopped the walk, 0 otherwise
+static int ext2_walk_block(const uint8_t *block, uint32_t len, ext2_dir_visitor_t visit, void *context) {
+    uint32_t offset = 0;
+    while (offset + 8 <= len) {
+        const struct ext2_dir_entry *de = (const struct ext2_dir_entry *)(block + offset);
+        if (de->rec_len < 8 || offset + de->rec_len > len) {
+            break; // Corrupt entry; skip the rest of the block
+        }
+        
+        // Skip null inodes (unused entries)
+        if (de->inode != 0) {
+            int stop = visit(de, context);
+            if (stop) {
+                return stop > 0 ? 1 : -1;
+            }
         }
+        offset += de->rec_len;
+    }
+    return 0;
+}
+
+static int ext2_walk_dir(ext2_private_t *priv, const struct ext2_inode *dir, ext2_dir_visitor_t visit, void *context) {
+    uint32_t block_size = priv->block_size;
+    uint8_t *block = (uint8_t *)kmalloc(block_size);
+    if (!block) {
+        return -1; // Out of memory
     }
     
-    // Read the inode
-    if (ext2_read_inode(priv, inode_num, &inode) != 0) {
-        return -1; // Failed to read inode
+    for (uint64_t pos = 0; pos < dir->i_size; pos += block_size) {
+        int got = ext2_read_inode_data(priv, dir, block, block_size, pos);
+        if (got <= 0) {
+            kfree(block);
+            return -1; // Read error
+        }
+        
+        int stop = ext2_walk_block(block, (uint32_t)got, visit, context);
+        if (stop) {
+            kfree(block);
+            return stop;
+        }
     }
     
-    // Check if it's a directory
-    if ((inode.i_mode & EXT2_S_IFMT) != EXT2_S_IFDIR) {
-        return -1; // Not a directory
+    kfree(block);
+    return 0;
+}
+
+typedef struct {
+    const char *name;
+    size_t len;
+    uint32_t inode;
+} ext2_find_ctx_t;
+
+static int ext2_match_entry(const struct ext2_dir_entry *de, void *context) {
+    ext2_find_ctx_t *find = (ext2_find_ctx_t *)context;
+    if (de->name_len == find->len && memcmp(de->name, find->name, find->len) == 0) {
+        find->inode = de->inode;
+        return 1;
+    }
+    return 0;
+}
+
+// Directory name hashes, as the kernel computes them (fs/ext4/hash.c)
+#define EXT2_ROL32(x, s) (((x) << (s)) | ((x) >> (32 - (s))))
+
+static void ext2_tea_transform(uint32_t buf[4], const uint32_t in[4]) {
+    uint32_t sum = 0;
+    uint32_t b0 = buf[0], b1 = buf[1];
+    for (int n = 0; n < 16; n++) {
+        sum += 0x9E3779B9;
+        b0 += ((b1 << 4) + in[0]) ^ (b1 + sum) ^ ((b1 >> 5) + in[1]);
+        b1 += ((b0 << 4) + in[2]) ^ (b0 + sum) ^ ((b0 >> 5) + in[3]);
+    }
+    buf[0] += b0;
+    buf[1] += b1;
+}
+
+#define EXT2_MD4_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define EXT2_MD4_G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define EXT2_MD4_H(x, y, z) ((x) ^ (y) ^ (z))
+#define EXT2_MD4_ROUND(f, a, b, c, d, x, s) (a += f(b, c, d) + (x), a = EXT2_ROL32(a, s))
+
+static void ext2_half_md4_transform(uint32_t buf[4], const uint32_t in[8]) {
+    const uint32_t k2 = 0x5A827999, k3 = 0x6ED9EBA1;
+    uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+    
+    EXT2_MD4_ROUND(EXT2_MD4_F, a, b, c, d, in[0], 3);
+    EXT2_MD4_ROUND(EXT2_MD4_F, d, a, b, c, in[1], 7);
+    EXT2_MD4_ROUND(EXT2_MD4_F, c, d, a, b, in[2], 11);
+    EXT2_MD4_ROUND(EXT2_MD4_F, b, c, d, a, in[3], 19);
+    EXT2_MD4_ROUND(EXT2_MD4_F, a, b, c, d, in[4], 3);
+    EXT2_MD4_ROUND(EXT2_MD4_F, d, a, b, c, in[5], 7);
+    EXT2_MD4_ROUND(EXT2_MD4_F, c, d, a, b, in[6], 11);
+    EXT2_MD4_ROUND(EXT2_MD4_F, b, c, d, a, in[7], 19);
+    
+    EXT2_MD4_ROUND(EXT2_MD4_G, a, b, c, d, in[1] + k2, 3);
+    EXT2_MD4_ROUND(EXT2_MD4_G, d, a, b, c, in[3] + k2, 5);
+    EXT2_MD4_ROUND(EXT2_MD4_G, c, d, a, b, in[5] + k2, 9);
+    EXT2_MD4_ROUND(EXT2_MD4_G, b, c, d, a, in[7] + k2, 13);
+    EXT2_MD4_ROUND(EXT2_MD4_G, a, b, c, d, in[0] + k2, 3);
+    EXT2_MD4_ROUND(EXT2_MD4_G, d, a, b, c, in[2] + k2, 5);
+    EXT2_MD4_ROUND(EXT2_MD4_G, c, d, a, b, in[4] + k2, 9);
+    EXT2_MD4_ROUND(EXT2_MD4_G, b, c, d, a, in[6] + k2, 13);
+    
+    EXT2_MD4_ROUND(EXT2_MD4_H, a, b, c, d, in[3] + k3, 3);
+    EXT2_MD4_ROUND(EXT2_MD4_H, d, a, b, c, in[7] + k3, 9);
+    EXT2_MD4_ROUND(EXT2_MD4_H, c, d, a, b, in[2] + k3, 11);
+    EXT2_MD4_ROUND(EXT2_MD4_H, b, c, d, a, in[6] + k3, 15);
+    EXT2_MD4_ROUND(EXT2_MD4_H, a, b, c, d, in[1] + k3, 3);
+    EXT2_MD4_ROUND(EXT2_MD4_H, d, a, b, c, in[5] + k3, 9);
+    EXT2_MD4_ROUND(EXT2_MD4_H, c, d, a, b, in[0] + k3, 11);
+    EXT2_MD4_ROUND(EXT2_MD4_H, b, c, d, a, in[4] + k3, 15);
+    
+    buf[0] += a;
+    buf[1] += b;
+    buf[2] += c;
+    buf[3] += d;
+}
+
+// Pack up to `num` words of the name, padded with its length
+static void ext2_str2hashbuf(const char *msg, size_t len, uint32_t *buf, int num, bool is_unsigned) {
+    uint32_t pad = (uint32_t)len | ((uint32_t)len << 8);
+    pad |= pad << 16;
+    
+    uint32_t val = pad;
+    if (len > (size_t)num * 4) {
+        len = (size_t)num * 4;
+    }
+    for (size_t i = 0; i < len; i++) {
+        int c = is_unsigned ? (int)(unsigned char)msg[i] : (int)(signed char)msg[i];
+        val = (uint32_t)c + (val << 8);
+        if ((i % 4) == 3) {
+            *buf++ = val;
+            val = pad;
+            num--;
+        }
+    }
+    if (--num >= 0) {
+        *buf++ = val;
+    }
+    while (--num >= 0) {
+        *buf++ = pad;
+    }
+}
+
+static uint32_t ext2_legacy_hash(const char *name, size_t len, bool is_unsigned) {
+    uint32_t hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+    for (size_t i = 0; i < len; i++) {
+        int c = is_unsigned ? (int)(unsigned char)name[i] : (int)(signed char)name[i];
+        hash = hash1 + (hash0 ^ (uint32_t)(c * 7152373));
+        if (hash & 0x80000000) {
+            hash -= 0x7fffffff;
+        }
+        hash1 = hash0;
+        hash0 = hash;
+    }
+    return hash0 << 1;
+}
+
+// Major hash of a name, or -1 for a hash version this driver does not know
+static int ext2_dx_hash(ext2_private_t *priv, uint8_t version, const char *name, size_t len, uint32_t *hash_out) {
+    uint32_t buf[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+    uint32_t in[8];
+    uint32_t hash;
+    
+    uint32_t seed[4];
+    memcpy(seed, priv->sb.s_hash_seed, sizeof(seed));
+    if (seed[0] | seed[1] | seed[2] | seed[3]) {
+        memcpy(buf, seed, sizeof(buf));
+    }
+    
+    // Versions 0-2 stand for their unsigned twins on volumes made that way
+    if (version <= EXT2_DX_HASH_TEA && (priv->sb.s_flags & EXT2_FLAGS_UNSIGNED_HASH)) {
+        version += EXT2_DX_HASH_UNSIGNED_DELTA;
+    }
+    if (version > EXT2_DX_HASH_TEA + EXT2_DX_HASH_UNSIGNED_DELTA) {
+        return -1; // SipHash (casefolded names) and anything newer
+    }
+    bool is_unsigned = version >= EXT2_DX_HASH_UNSIGNED_DELTA;
+    
+    switch (version % EXT2_DX_HASH_UNSIGNED_DELTA) {
+    case EXT2_DX_HASH_LEGACY:
+        hash = ext2_legacy_hash(name, len, is_unsigned);
+        break;
+    case EXT2_DX_HASH_HALF_MD4:
+        for (size_t done = 0; done < len; done += 32) {
+            ext2_str2hashbuf(name + done, len - done, in, 8, is_unsigned);
+            ext2_half_md4_transform(buf, in);
+        }
+        hash = buf[1];
+        break;
+    default:
+        for (size_t done = 0; done < len; done += 16) {
+            ext2_str2hashbuf(name + done, len - done, in, 4, is_unsigned);
+            ext2_tea_transform(buf, in);
+        }
+        hash = buf[0];
+        break;
     }
     
+    hash &= ~1u;
+    if (hash == 0xfffffffe) {
+        hash = 0xfffffffc; // The end-of-directory cookie is reserved
+    }
+    *hash_out = hash;
+    return 0;
+}
+
+// The index entries of a root or interior node, checked against the block
+static const struct ext2_dx_entry *ext2_dx_entries(const uint8_t *block, uint32_t block_size, uint32_t offset,
+                                                   uint32_t *count) {
+    if (offset + sizeof(struct ext2_dx_countlimit) > block_size) {
+        return NULL;
+    }
+    const struct ext2_dx_countlimit *cl = (const struct ext2_dx_countlimit *)(block + offset);
+    if (cl->count == 0 || cl->count > cl->limit ||
+        offset + (uint32_t)cl->limit * sizeof(struct ext2_dx_entry) > block_size) {
+        return NULL;
+    }
+    *count = cl->count;
+    return (const struct ext2_dx_entry *)(block + offset);
+}
+
+// Last entry whose hash is at or below `hash`; the first entry's hash
+// field is the count and limit and stands for 0
+static uint32_t ext2_dx_search(const struct ext2_dx_entry *entries, uint32_t count, uint32_t hash) {
+    uint32_t lo = 1, hi = count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (entries[mid].hash > hash) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo - 1;
+}
+
+#define EXT2_DX_MAX_CONTINUED   8       // Leaf blocks followed for one colliding hash
+
+// Look a name up through a directory's htree: the root, one node per
+// index level and the leaf, instead of every block. Returns 1 and the
+// inode when found, 0 when the name is not there, -1 when the index
+// cannot be used (unknown hash, damaged node) and the caller should scan.
+static int ext2_htree_find(ext2_private_t *priv, const struct ext2_inode *dir, ext2_find_ctx_t *find) {
     uint32_t block_size = priv->block_size;
     uint8_t *block = (uint8_t *)kmalloc(block_size);
     if (!block) {
         return -1; // Out of memory
     }
     
-    uint32_t entry_count = 0;
+    int result = -1;
+    if (ext2_read_inode_data(priv, dir, block, block_size, 0) != (int)block_size) {
+        goto out;
+    }
     
-    // Read directory entries from direct blocks (simplified - only first 12 blocks)
-    for (int i = 0; i < 12 && inode.i_block[i] != 0; i++) {
-        if (ext2_read_block(priv, inode.i_block[i], block) != 0) {
-            kfree(block);
-            return -1; // Read error
+    // "." and ".." take 12 bytes each, then the root info
+    const struct ext2_dx_root_info *info = (const struct ext2_dx_root_info *)(block + 24);
+    uint32_t hash;
+    if (info->reserved_zero != 0 || info->info_length < 8 || info->indirect_levels >= EXT2_DX_MAX_LEVELS ||
+        ext2_dx_hash(priv, info->hash_version, find->name, find->len, &hash) != 0) {
+        goto out;
+    }
+    
+    // Walk down to the bottom index node, keeping the leaf the hash falls
+    // in and the blocks after it that continue the same hash (bit 0 set):
+    // names that collide can spill into those
+    uint32_t levels = info->indirect_levels;
+    uint32_t offset = 24 + info->info_length;
+    uint32_t leaves[EXT2_DX_MAX_CONTINUED];
+    uint32_t leaf_count = 0;
+    for (uint32_t level = 0;; level++) {
+        uint32_t count;
+        const struct ext2_dx_entry *entries = ext2_dx_entries(block, block_size, offset, &count);
+        if (!entries) {
+            goto out;
         }
-        
-        uint32_t offset = 0;
-        while (offset < block_size && entry_count < max_entries) {
-            struct ext2_dir_entry *de = (struct ext2_dir_entry *)(block + offset);
-            
-            // Skip null inodes (unused entries)
-            if (de->inode == 0) {
-                offset += de->rec_len;
-                continue;
-            }
-            
-            // Copy entry information
-            if (entries) {
-                fs_dirent_t *ent = &entries[entry_count];
-                ent->inode = de->inode;
-                ent->name_len = de->name_len;
-                ent->file_type = de->file_type;
-                memcpy(ent->name, de->name, de->name_len);
-                ent->name[de->name_len] = '\0';
-            }
-            
-            entry_count++;
-            offset += de->rec_len;
-            
-            if (de->rec_len == 0) {
-                break; // Prevent infinite loop
+        uint32_t at = ext2_dx_search(entries, count, hash);
+        uint32_t child = entries[at].block & 0x0FFFFFFF;
+        if ((uint64_t)child * block_size >= dir->i_size) {
+            goto out;
+        }
+        if (level == levels) {
+            leaves[leaf_count++] = child;
+            while (++at < count && leaf_count < EXT2_DX_MAX_CONTINUED && entries[at].hash == (hash | 1)) {
+                leaves[leaf_count++] = entries[at].block & 0x0FFFFFFF;
             }
+            break;
+        }
+        
+        // Interior nodes open with one empty entry covering the block
+        if (ext2_read_inode_data(priv, dir, block, block_size, (uint64_t)child * block_size) != (int)block_size) {
+            goto out;
+        }
+        offset = 8;
+    }
+    
+    result = 0;
+    for (uint32_t i = 0; i < leaf_count; i++) {
+        int got = ext2_read_inode_data(priv, dir, block, block_size, (uint64_t)leaves[i] * block_size);
+        if (got <= 0) {
+            result = -1;
+            break;
+        }
+        if (ext2_walk_block(block, (uint32_t)got, ext2_match_entry, find) == 1) {
+            result = 1;
+            break;
         }
     }
     
+out:
     kfree(block);
-    return entry_count;
+    return result;
 }
 
-int ext2_get_info(ext2_private_t *priv, uint32_t inode_num, fs_file_info_t *info) {
-    struct ext2_inode inode;
+// Resolve a path one component at a time from the root directory
+int ext2_find_file(ext2_private_t *priv, const char *filename, uint32_t *inode_out) {
+    uint32_t inode_num = 2; // Root directory
+    fs_path_iter_t iter;
+    fs_path_component_t comp;
+    bool indexed_fs = (priv->sb.s_feature_compat & EXT2_FEATURE_COMPAT_DIR_INDEX) != 0;
     
-    if (!info || ext2_read_inode(priv, inode_num, &inode) != 0) {
-        return -1; // Invalid parameters or failed to read inode
-    }
-    
-    // Fill in file information
-    info->size = inode.i_size;
-    info->mode = inode.i_mode;
-    info->uid = inode.i_uid;
-    info->gid = inode.i_gid;
-    info->atime = inode.i_atime;
-    info->ctime = inode.i_ctime;
-    info->mtime = inode.i_mtime;
-    info->links = inode.i_links_count;
-    
-    // Set file type
-    if ((inode.i_mode & EXT2_S_IFMT) == EXT2_S_IFREG) {
-        info->type = FS_FILE_REGULAR;
-    } else if ((inode.i_mode & EXT2_S_IFMT) == EXT2_S_IFDIR) {
-        info->type = FS_FILE_DIRECTORY;
-    } else if ((inode.i_mode & EXT2_S_IFMT) == EXT2_S_IFLNK) {
-        info->type = FS_FILE_SYMLINK;
-    } else if ((inode.i_mode & EXT2_S_IFMT) == EXT2_S_IFBLK) {
-        info->type = FS_FILE_BLOCK_DEVICE;
-    } else if ((inode.i_mode & EXT2_S_IFMT) == EXT2_S_IFCHR) {
-        info->type = FS_FILE_CHAR_DEVICE;
-    } else if ((inode.i_mode & EXT2_S_IFMT) == EXT2_S_IFIFO) {
-        info->type = FS_FILE_FIFO;
-    } else if ((inode.i_mode & EXT2_S_IFMT) == EXT2_S_IFSOCK) {
-        info->type = FS_FILE_SOCKET;
-    } else {
-        info->type = FS_FILE_UNKNOWN;
+    fs_path_iter_init(&iter, filename);
+    while (fs_path_next(&iter, &comp)) {
+        struct ext2_inode dir;
+        if (ext2_read_inode(priv, inode_num, &dir) != 0) {
+            return -1; // Failed to read inode
+        }
+        if ((dir.i_mode & EXT2_S_IFMT) != EXT2_S_IFDIR) {
+            return -1; // Not a directory
+        }
+        
+        // Indexed directories go through their hash tree; a tree this
+        // driver cannot follow is still a valid linear directory
+        ext2_find_ctx_t find = { comp.name, comp.len, 0 };
+        int found = -1;
+        if (indexed_fs && (dir.i_flags & EXT2_INDEX_FL)) {
+            found = ext2_htree_find(priv, &dir, &find);
+        }
+        if (found < 0) {
+            found = ext2_walk_dir(priv, &dir, ext2_match_entry, &find);
+        }
+        if (found != 1) {
+            return -1; // Not found
+        }
+        
+        inode_num = find.inode;
     }
     
+    *inode_out = inode_num;
     return 0;
 }
 
-// Wrapper functions for filesystem interface
-static int ext2_fs_read_file(void *private_data, const char *path, void *buf, uint32_t size, uint32_t offset) {
-    ext2_private_t *priv = (ext2_private_t *)private_data;
+// Append directory entry names to a text buffer, one per line
+typedef struct {
+    char *buffer;
+    uint32_t size;
+    uint32_t used;
+} ext2_list_ctx_t;
+
+static int ext2_collect_entry(const struct ext2_dir_entry *de, void *context) {
+    ext2_list_ctx_t *list = (ext2_list_ctx_t *)context;
+    
+    if (list->used + de->name_len + 1 > list->size) {
+        return 1; // Out of buffer space
+    }
+    
+    memcpy(list->buffer + list->used, de->name, de->name_len);
+    list->used += de->name_len;
+    list->buffer[list->used++] = '\n';
+    return 0;
+}
+
+static uint64_t ext2_inode_size(const struct ext2_inode *inode) {
+    uint64_t size = inode->i_size;
+    if ((inode->i_mode & EXT2_S_IFMT) == EXT2_S_IFREG) {
+        size |= (uint64_t)inode->i_size_high << 32;
+    }
+    return size;
+}
+
+// VFS operations: nodes carry the inode number
+static int ext2_lookup(mount_point_t *mp, const char *path, fs_node_t *node) {
+    ext2_private_t *priv = (ext2_private_t *)mp->private_data;
     uint32_t inode_num;
+    struct ext2_inode inode;
     
-    // Find the file inode
-    if (ext2_find_file(priv, path, &inode_num) != 0) {
+    if (ext2_find_file(priv, path, &inode_num) != 0 || ext2_read_inode(priv, inode_num, &inode) != 0) {
         return -1; // File not found
     }
     
-    // Read the file
-    uint8_t *buffer = (uint8_t *)buf;
-    uint32_t remaining = size;
-    uint32_t pos = 0;
+    uint64_t size = ext2_inode_size(&inode);
+    node->id = inode_num;
+    node->size = size > UINT32_MAX ? UINT32_MAX : (uint32_t)size;
+    node->is_dir = (inode.i_mode & EXT2_S_IFMT) == EXT2_S_IFDIR;
+    return 0;
+}
+
+static int ext2_read_node(mount_point_t *mp, const fs_node_t *node, uint8_t *buf, uint32_t size, uint32_t offset) {
+    ext2_private_t *priv = (ext2_private_t *)mp->private_data;
+    struct ext2_inode inode;
     
-    while (remaining > 0) {
-        uint32_t to_read = (remaining > priv->block_size) ? priv->block_size : remaining;
-        if (ext2_read_file(priv, inode_num, buffer + pos, to_read) != 0) {
-            return -1; // Read error
-        }
-        pos += to_read;
-        remaining -= to_read;
+    if (ext2_read_inode(priv, (uint32_t)node->id, &inode) != 0) {
+        return -1; // Failed to read inode
     }
     
-    return pos;
+    return ext2_read_inode_data(priv, &inode, buf, size, offset);
 }
 
-static int ext2_fs_list_dir(void *private_data, const char *path, fs_dirent_t *entries, uint32_t max_entries) {
-    ext2_private_t *priv = (ext2_private_t *)private_data;
-    return ext2_list_dir(priv, path, entries, max_entries);
+static int ext2_list_node(mount_point_t *mp, const fs_node_t *node, char *buffer, uint32_t size) {
+    ext2_private_t *priv = (ext2_private_t *)mp->private_data;
+    struct ext2_inode inode;
+    
+    if (!node->is_dir || ext2_read_inode(priv, (uint32_t)node->id, &inode) != 0) {
+        return -1; // Not a directory
+    }
+    
+    ext2_list_ctx_t list = { buffer, size, 0 };
+    if (ext2_walk_dir(priv, &inode, ext2_collect_entry, &list) < 0) {
+        return -1;
+    }
+    
+    return (int)list.used;
 }
 
-static int ext2_fs_get_info(void *private_data, const char *path, fs_file_info_t *info) {
-    ext2_private_t *priv = (ext2_private_t *)private_data;
-    uint32_t inode_num;
+// Emit one merged run of blocks as a device extent
+static int ext2_emit_run(ext2_private_t *priv, blockdev_extent_t *extents, uint32_t max_extents, int count,
+                         uint64_t logical, uint64_t physical, uint64_t length) {
+    uint32_t spb = priv->block_size / BLOCKDEV_SECTOR_SIZE;
     
-    if (strcmp(path, "/") == 0) {
-        inode_num = 2; // Root directory
-    } else if (ext2_find_file(priv, path, &inode_num) != 0) {
-        return -1; // File not found
+    if (length == 0) {
+        return count;
+    }
+    if (extents && (uint32_t)count < max_extents) {
+        extents[count].offset = logical * spb;
+        extents[count].sector = priv->lba + physical * spb;
+        extents[count].sectors = (uint32_t)(length * spb);
+    }
+    return count + 1;
+}
+
+// Describe the file's blocks as device extents, for loop mounts. Holes
+// (and uninitialized extents) are left uncovered and read back as zeros.
+static int ext2_map_node(mount_point_t *mp, const fs_node_t *node, blockdev_extent_t *extents, uint32_t max_extents) {
+    ext2_private_t *priv = (ext2_private_t *)mp->private_data;
+    struct ext2_inode inode;
+    
+    if (node->is_dir || ext2_read_inode(priv, (uint32_t)node->id, &inode) != 0) {
+        return -1;
+    }
+    
+    uint32_t spb = priv->block_size / BLOCKDEV_SECTOR_SIZE;
+    uint64_t blocks = (ext2_inode_size(&inode) + priv->block_size - 1) / priv->block_size;
+    ext2_map_ctx_t ctx;
+    ext2_map_init(&ctx, priv, &inode);
+    
+    int count = 0;
+    uint64_t run_logical = 0, run_physical = 0, run_length = 0;
+    for (uint64_t logical = 0; logical < blocks; ) {
+        uint64_t physical;
+        uint32_t n;
+        
+        if (ext2_map_block(&ctx, logical, &physical, &n) != 0) {
+            ext2_map_release(&ctx);
+            return -1; // Corrupt block map
+        }
+        if (n > blocks - logical) {
+            n = (uint32_t)(blocks - logical);
+        }
+        
+        // Extend the current run while physically contiguous and the run
+        // still fits an extent's 32-bit sector count
+        if (physical != 0 && run_length != 0 && physical == run_physical + run_length &&
+            (run_length + n) * spb <= UINT32_MAX) {
+            run_length += n;
+        } else {
+            count = ext2_emit_run(priv, extents, max_extents, count, run_logical, run_physical, run_length);
+            run_logical = logical;
+            run_physical = physical;
+            run_length = physical != 0 ? n : 0;
+        }
+        logical += n;
     }
+    count = ext2_emit_run(priv, extents, max_extents, count, run_logical, run_physical, run_length);
     
-    return ext2_get_info(priv, inode_num, info);
+    ext2_map_release(&ctx);
+    return count;
 }
 
-static int ext2_fs_find_file(void *private_data, const char *path, uint32_t *inode_out) {
-    ext2_private_t *priv = (ext2_private_t *)private_data;
-    return ext2_find_file(priv, path, inode_out);
+// Path-based operations resolve a node first
+static int ext2_read(mount_point_t *mp, const char *path, uint8_t *buf, uint32_t size, uint32_t offset) {
+    fs_node_t node;
+    if (ext2_lookup(mp, path, &node) != 0 || node.is_dir) {
+        return -1; // File not found
+    }
+    return ext2_read_node(mp, &node, buf, size, offset);
+}
+
+static int ext2_list_dir(mount_point_t *mp, const char *path, char *buffer, uint32_t size) {
+    fs_node_t node;
+    if (ext2_lookup(mp, path, &node) != 0) {
+        return -1; // Directory not found
+    }
+    return ext2_list_node(mp, &node, buffer, size);
+}
+
+static int ext2_get_info(mount_point_t *mp, const char *path, uint32_t *size, bool *is_dir) {
+    fs_node_t node;
+    if (ext2_lookup(mp, path, &node) != 0) {
+        return -1; // File not found
+    }
+    *size = node.size;
+    *is_dir = node.is_dir;
+    return 0;
 }
 
 // Filesystem operations structure
 const fs_operations_t ext2_ops = {
-    .read_file = ext2_fs_read_file,
-    .list_dir = ext2_fs_list_dir,
-    .get_info = ext2_fs_get_info,
-    .find_file = ext2_fs_find_file
+    .read = ext2_read,
+    .write = NULL, // Read-only
+    .list_dir = ext2_list_dir,
+    .get_info = ext2_get_info,
+    .lookup = ext2_lookup,
+    .read_node = ext2_read_node,
+    .list_node = ext2_list_node,
+    .map_node = ext2_map_node,
 };
 
 // Filesystem type structure
 const filesystem_t ext2_fs = {
     .name = "ext2",
+    .ops = &ext2_ops,
     .detect = ext2_detect,
     .mount = ext2_mount,
     .unmount = ext2_unmount,
-    .ops = &ext2_ops
-};
\ No newline at end of file
+};
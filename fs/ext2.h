@@ -15,6 +15,7 @@
 
 // Constants
 #define EXT2_SUPER_MAGIC      0xEF53
+#define EXT2_MAX_LOG_BLOCK_SIZE 6       // 64 KiB blocks, the largest ext4 allows
 #define EXT2_S_IFMT           0xF000
 #define EXT2_S_IFSOCK         0xC000
 #define EXT2_S_IFLNK          0xA000
@@ -28,6 +29,25 @@
 #define EXT2_SYNC_FL          0x10
 #define EXT2_NOATIME_FL       0x20
 #define EXT2_DIRSYNC_FL       0x40
+#define EXT2_INDEX_FL         0x1000    // Directory has a hashed (htree) index
+#define EXT4_EXTENTS_FL       0x80000
+
+// Compatible features we care about
+#define EXT2_FEATURE_COMPAT_DIR_INDEX 0x0020
+
+// Superblock s_flags
+#define EXT2_FLAGS_UNSIGNED_HASH      0x0002    // Hash names as unsigned chars
+
+// Incompatible features we care about
+#define EXT4_FEATURE_INCOMPAT_EXTENTS 0x0040
+#define EXT4_FEATURE_INCOMPAT_64BIT   0x0080
+
+// Block map layout
+#define EXT2_NDIR_BLOCKS      12
+#define EXT2_IND_BLOCK        12
+#define EXT2_DIND_BLOCK       13
+#define EXT2_TIND_BLOCK       14
+#define EXT2_N_BLOCKS         15
 
 // Superblock structure
 struct ext2_superblock {
@@ -79,7 +99,7 @@ struct ext2_superblock {
     uint32_t s_hash_seed[4];        // HTREE hash seed
     uint8_t  s_def_hash_version;    // Default hash version to use
     uint8_t  s_jnl_backup_type;     // Type of backup
-    uint16_t s_reserved_word_pad;
+    uint16_t s_desc_size;           // Group descriptor size (64bit feature)
     uint32_t s_default_mount_opts;
     uint32_t s_first_meta_bg;       // First metablock group
     uint32_t s_mkfs_time;           // When the filesystem was created
@@ -155,7 +175,7 @@ struct ext2_inode {
     uint32_t i_blocks;             // Blocks count
     uint32_t i_flags;              // File flags
     uint32_t i_osd1;               // OS dependent 1
-    uint32_t i_block[15];          // Pointers to blocks
+    uint32_t i_block[EXT2_N_BLOCKS]; // Pointers to blocks
     uint32_t i_generation;         // File version (for NFS)
     uint32_t i_file_acl;           // File ACL
     uint32_t i_size_high;          // High 32 bits of file size
@@ -163,6 +183,31 @@ struct ext2_inode {
     uint8_t  i_osd2[12];           // OS dependent 2
 } __attribute__((packed));
 
+// ext4 extent tree (stored in i_block and in index/leaf blocks)
+#define EXT4_EXT_MAGIC        0xF30A
+
+struct ext4_extent_header {
+    uint16_t eh_magic;             // EXT4_EXT_MAGIC
+    uint16_t eh_entries;           // Valid entries following the header
+    uint16_t eh_max;               // Capacity of the node
+    uint16_t eh_depth;             // 0 = leaf
+    uint32_t eh_generation;
+} __attribute__((packed));
+
+struct ext4_extent {
+    uint32_t ee_block;             // First logical block covered
+    uint16_t ee_len;               // Length; > 32768 means uninitialized
+    uint16_t ee_start_hi;          // High 16 bits of physical block
+    uint32_t ee_start_lo;          // Low 32 bits of physical block
+} __attribute__((packed));
+
+struct ext4_extent_idx {
+    uint32_t ei_block;             // First logical block of the subtree
+    uint32_t ei_leaf_lo;           // Physical block of the child node
+    uint16_t ei_leaf_hi;
+    uint16_t ei_unused;
+} __attribute__((packed));
+
 // Directory entry structure
 struct ext2_dir_entry {
     uint32_t inode;         // Inode number
@@ -172,6 +217,35 @@ struct ext2_dir_entry {
     char     name[255];     // File name (up to 255 bytes)
 } __attribute__((packed));
 
+// Hashed directory index (htree). Logical block 0 of an indexed directory
+// holds "." and "..", the root info and the first level of index entries;
+// each entry maps names hashing at or above `hash` to a block. Interior
+// nodes hide behind one empty directory entry spanning the block.
+#define EXT2_DX_HASH_LEGACY             0
+#define EXT2_DX_HASH_HALF_MD4           1
+#define EXT2_DX_HASH_TEA                2
+#define EXT2_DX_HASH_UNSIGNED_DELTA     3       // Unsigned variant of each of the above
+#define EXT2_DX_MAX_LEVELS              3       // Indirect levels, with largedir
+
+struct ext2_dx_root_info {
+    uint32_t reserved_zero;
+    uint8_t  hash_version;          // EXT2_DX_HASH_*
+    uint8_t  info_length;           // 8
+    uint8_t  indirect_levels;       // Index levels below the root
+    uint8_t  unused_flags;
+} __attribute__((packed));
+
+struct ext2_dx_entry {
+    uint32_t hash;                  // Lowest hash in the block; bit 0 marks a collision continuation
+    uint32_t block;                 // Logical block in the directory
+} __attribute__((packed));
+
+// Overlays the first entry's hash field
+struct ext2_dx_countlimit {
+    uint16_t limit;                 // Entries the node can hold
+    uint16_t count;                 // Entries in use
+} __attribute__((packed));
+
 // File types
 #define EXT2_FT_UNKNOWN     0
 #define EXT2_FT_REG_FILE    1
@@ -182,6 +256,16 @@ struct ext2_dir_entry {
 #define EXT2_FT_SOCK        6
 #define EXT2_FT_SYMLINK     7
 
+// Inode table blocks read recently, most often a directory's and its
+// entries' inodes sharing one block; evicted least recently used first
+#define EXT2_INODE_CACHE_BLOCKS     16
+
+typedef struct {
+    uint64_t block;                 // Inode table block number
+    uint32_t last_used;             // LRU stamp, 0 = empty
+    uint8_t *data;                  // block_size bytes
+} ext2_inode_cache_entry_t;
+
 // ext2 private data structure
 typedef struct {
     uint32_t lba;                       // Starting LBA of partition
@@ -193,7 +277,11 @@ typedef struct {
     uint32_t inodes_per_block;          // Inodes per block
     uint32_t desc_per_block;            // Descriptors per block
     uint32_t group_count;               // Total number of block groups
-    struct ext2_group_desc *gd;         // Block group descriptors
+    uint32_t desc_size;                 // On-disk size of one group descriptor
+    struct ext2_group_desc *gd;         // Block group descriptors (desc_size stride)
+    ext2_inode_cache_entry_t inode_cache[EXT2_INODE_CACHE_BLOCKS];
+    uint8_t *inode_cache_data;          // Backing store for inode_cache, NULL if none
+    uint32_t inode_cache_clock;         // Monotonic LRU counter
 } ext2_private_t;
 
 // ext2 filesystem operations
@@ -205,6 +293,7 @@ extern const filesystem_t ext2_fs;
 // Helper functions
 int ext2_read_inode(ext2_private_t *priv, uint32_t inode_num, struct ext2_inode *inode);
 int ext2_read_block(ext2_private_t *priv, uint32_t block_num, void *buffer);
-int ext2_find_file(ext2_private_t *priv, const char *path, uint32_t *inode_num, uint32_t *size);
+int ext2_find_file(ext2_private_t *priv, const char *path, uint32_t *inode_num);
+int ext2_read_inode_data(ext2_private_t *priv, const struct ext2_inode *inode, uint8_t *buf, uint32_t size, uint64_t offset);
 
 #endif // BLOODHORN_EXT2_H
@@ -11,19 +11,156 @@
 #include <stdlib.h>
 #include "compat.h"
 #include "fat32.h"
+#include "blockdev.h"
 
 // External disk I/O function
-extern void read_sector(uint32_t lba, uint8_t* buf);
 
-// FAT32 filesystem operations implementation
-static int fat32_read(mount_point_t *mp, const char *path, uint8_t *buf, uint32_t size, uint32_t offset) {
-    fat32_private_t *priv = (fat32_private_t *)mp->private_data;
-    uint32_t cluster, file_size;
+// Sector of the data area where a cluster starts
+static uint32_t fat32_cluster_lba(fat32_private_t *priv, uint32_t cluster) {
+    return priv->cluster_begin_lba + ((cluster - 2) << priv->spc_shift);
+}
+
+static uint8_t fat32_log2(uint32_t value) {
+    uint8_t shift = 0;
+    while ((1u << shift) < value) shift++;
+    return shift;
+}
+
+// Copy `length` bytes starting `offset` bytes into a run of contiguous
+// clusters. Whole sectors go straight into the caller's buffer with one
+// multi-sector read; only a partial first/last sector is bounced.
+static int fat32_read_run(fat32_private_t *priv, uint32_t first_cluster, uint32_t offset,
+                          uint8_t *buf, uint32_t length, uint8_t *bounce) {
+    uint32_t bps = priv->bs.bytes_per_sector;
+    uint32_t lba = fat32_cluster_lba(priv, first_cluster) + (offset >> priv->sector_shift);
+    uint32_t in_sector = offset & (bps - 1);
+    
+    // Leading partial sector
+    if (in_sector != 0) {
+        uint32_t chunk = bps - in_sector;
+        if (chunk > length) chunk = length;
+        if (fs_read_sectors(lba, 1, bps, bounce) != 0) return -1;
+        memcpy(buf, bounce + in_sector, chunk);
+        buf += chunk;
+        length -= chunk;
+        lba++;
+    }
     
-    if (fat32_find_file(priv, path, &cluster, &file_size) != 0) {
-        return -1; // File not found
+    // Whole sectors, read directly
+    uint32_t whole = length >> priv->sector_shift;
+    if (whole > 0) {
+        if (fs_read_sectors(lba, whole, bps, buf) != 0) return -1;
+        buf += (size_t)whole * bps;
+        length -= whole * bps;
+        lba += whole;
+    }
+    
+    // Trailing partial sector
+    if (length > 0) {
+        if (fs_read_sectors(lba, 1, bps, bounce) != 0) return -1;
+        memcpy(buf, bounce, length);
+    }
+    
+    return 0;
+}
+
+// Walk a chain of `cluster_count` clusters, optionally recording its extents.
+// Returns the number of extents, or -1 if the chain is shorter or corrupt.
+static int fat32_walk_extents(fat32_private_t *priv, uint32_t first_cluster, uint32_t cluster_count,
+                              fat32_extent_t *extents) {
+    uint32_t cluster = first_cluster;
+    uint32_t count = 0;
+    uint32_t index = 0;
+    
+    while (index < cluster_count) {
+        if (cluster < 2 || cluster >= priv->total_clusters + 2) {
+            return -1;
+        }
+        
+        uint32_t run_start = cluster;
+        uint32_t run_length = 1;
+        cluster = fat32_get_cluster(priv, cluster);
+        while (index + run_length < cluster_count && cluster == run_start + run_length) {
+            run_length++;
+            cluster = fat32_get_cluster(priv, cluster);
+        }
+        
+        if (extents) {
+            extents[count].file_cluster = index;
+            extents[count].disk_cluster = run_start;
+            extents[count].length = run_length;
+        }
+        count++;
+        index += run_length;
     }
     
+    return (int)count;
+}
+
+static void fat32_free_extent_maps(fat32_private_t *priv) {
+    for (uint32_t i = 0; i < FAT32_EXTENT_MAP_CACHE; i++) {
+        free(priv->extent_maps[i].extents);
+        priv->extent_maps[i].extents = NULL;
+        priv->extent_maps[i].first_cluster = 0;
+    }
+}
+
+// Find or build the extent map covering the first `cluster_count` clusters
+static const fat32_extent_map_t *fat32_get_extent_map(fat32_private_t *priv, uint32_t first_cluster,
+                                                      uint32_t cluster_count) {
+    fat32_extent_map_t *victim = &priv->extent_maps[0];
+    
+    for (uint32_t i = 0; i < FAT32_EXTENT_MAP_CACHE; i++) {
+        fat32_extent_map_t *map = &priv->extent_maps[i];
+        if (map->first_cluster == first_cluster && map->cluster_count >= cluster_count) {
+            map->last_used = ++priv->extent_clock;
+            return map;
+        }
+        if (map->last_used < victim->last_used) {
+            victim = map;
+        }
+    }
+    
+    // Count first so the array is sized exactly; the FAT cache makes the
+    // second walk cheap
+    int count = fat32_walk_extents(priv, first_cluster, cluster_count, NULL);
+    if (count <= 0) {
+        return NULL;
+    }
+    
+    fat32_extent_t *extents = (fat32_extent_t *)malloc((size_t)count * sizeof(fat32_extent_t));
+    if (!extents) {
+        return NULL;
+    }
+    fat32_walk_extents(priv, first_cluster, cluster_count, extents);
+    
+    free(victim->extents);
+    victim->first_cluster = first_cluster;
+    victim->cluster_count = cluster_count;
+    victim->extent_count = (uint32_t)count;
+    victim->extents = extents;
+    victim->last_used = ++priv->extent_clock;
+    return victim;
+}
+
+// Binary search for the extent holding a file-relative cluster index
+static uint32_t fat32_find_extent(const fat32_extent_map_t *map, uint32_t file_cluster) {
+    uint32_t lo = 0, hi = map->extent_count;
+    
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (map->extents[mid].file_cluster <= file_cluster) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Read from a file given its first cluster and size
+static int fat32_read_chain(fat32_private_t *priv, uint32_t cluster, uint32_t file_size,
+                            uint8_t *buf, uint32_t size, uint32_t offset) {
     if (offset >= file_size) {
         return 0; // Read past end of file
     }
@@ -32,58 +169,66 @@ static int fat32_read(mount_point_t *mp, const char *path, uint8_t *buf, uint32_
         size = file_size - offset; // Adjust size to not read past file end
     }
     
-    // Calculate starting position
-    uint32_t bytes_read = 0;
-    uint32_t cluster_offset = offset / priv->bytes_per_cluster;
-    uint32_t offset_in_cluster = offset % priv->bytes_per_cluster;
-    
-    // Skip to the starting cluster
-    for (uint32_t i = 0; i < cluster_offset; i++) {
-        cluster = fat32_get_cluster(priv, cluster);
-        if (cluster >= 0x0FFFFFF8) {
-            return -1; // Invalid cluster chain
-        }
+    // Map the whole file once; later reads at any offset reuse it
+    uint32_t file_clusters = (uint32_t)(((uint64_t)file_size + priv->bytes_per_cluster - 1) >> priv->cluster_shift);
+    const fat32_extent_map_t *map = fat32_get_extent_map(priv, cluster, file_clusters);
+    if (!map) {
+        return -1; // Invalid cluster chain or out of memory
     }
     
-    // Read data cluster by cluster
-    while (bytes_read < size && cluster < 0x0FFFFFF8) {
-        uint8_t *cluster_buf = (uint8_t *)malloc(priv->bytes_per_cluster);
-        if (!cluster_buf) return -1;
+    // Calculate starting position
+    uint32_t bytes_read = 0;
+    uint32_t cluster_offset = offset >> priv->cluster_shift;
+    uint32_t offset_in_cluster = offset & (priv->bytes_per_cluster - 1);
+    uint32_t e = fat32_find_extent(map, cluster_offset);
+    
+    uint8_t *bounce = (uint8_t *)malloc(priv->bs.bytes_per_sector);
+    if (!bounce) return -1;
+    
+    // Read one extent (contiguous run) at a time
+    while (bytes_read < size && e < map->extent_count) {
+        const fat32_extent_t *ext = &map->extents[e];
+        uint32_t skip = cluster_offset - ext->file_cluster;
+        uint32_t run_start = ext->disk_cluster + skip;
+        uint32_t run_length = ext->length - skip;
         
-        // Read the entire cluster
-        if (fat32_read_cluster(priv, cluster, cluster_buf) != 0) {
-            free(cluster_buf);
-            return -1;
-        }
+        // Calculate how much of the run to copy
+        uint32_t remaining = size - bytes_read;
+        uint64_t run_bytes = ((uint64_t)run_length << priv->cluster_shift) - offset_in_cluster;
+        uint32_t to_copy = run_bytes < remaining ? (uint32_t)run_bytes : remaining;
         
-        // Calculate how much to copy from this cluster
-        uint32_t to_copy = priv->bytes_per_cluster - offset_in_cluster;
-        if (bytes_read + to_copy > size) {
-            to_copy = size - bytes_read;
+        if (fat32_read_run(priv, run_start, offset_in_cluster, buf + bytes_read, to_copy, bounce) != 0) {
+            free(bounce);
+            return -1;
         }
-        
-        // Copy the data
-        memcpy(buf + bytes_read, cluster_buf + offset_in_cluster, to_copy);
         bytes_read += to_copy;
         
-        free(cluster_buf);
-        
-        // Move to next cluster
-        cluster = fat32_get_cluster(priv, cluster);
-        offset_in_cluster = 0; // For subsequent clusters
+        // Move to the next extent
+        e++;
+        if (e < map->extent_count) {
+            cluster_offset = map->extents[e].file_cluster;
+        }
+        offset_in_cluster = 0; // For subsequent runs
     }
     
+    free(bounce);
     return bytes_read;
 }
 
-static int fat32_read_dir(mount_point_t *mp, const char *path, char *buffer, uint32_t size) {
+// FAT32 filesystem operations implementation
+static int fat32_read(mount_point_t *mp, const char *path, uint8_t *buf, uint32_t size, uint32_t offset) {
     fat32_private_t *priv = (fat32_private_t *)mp->private_data;
-    uint32_t cluster, dir_size;
+    uint32_t cluster, file_size;
     
-    if (fat32_find_file(priv, path, &cluster, &dir_size) != 0) {
-        return -1; // Directory not found
+    if (fat32_find_file(priv, path, &cluster, &file_size) != 0) {
+        return -1; // File not found
     }
     
+    return fat32_read_chain(priv, cluster, file_size, buf, size, offset);
+}
+
+// List the directory whose chain starts at `cluster`
+static int fat32_list_chain(fat32_private_t *priv, uint32_t cluster, char *buffer, uint32_t size) {
     uint32_t offset = 0;
     uint8_t *cluster_buf = (uint8_t *)malloc(priv->bytes_per_cluster);
     if (!cluster_buf) return -1;
@@ -147,114 +292,239 @@ static int fat32_read_dir(mount_point_t *mp, const char *path, char *buffer, uin
     return offset;
 }
 
+static int fat32_read_dir(mount_point_t *mp, const char *path, char *buffer, uint32_t size) {
+    fat32_private_t *priv = (fat32_private_t *)mp->private_data;
+    uint32_t cluster, dir_size;
+    
+    if (fat32_find_file(priv, path, &cluster, &dir_size) != 0) {
+        return -1; // Directory not found
+    }
+    
+    return fat32_list_chain(priv, cluster, buffer, size);
+}
+
 static int fat32_get_info(mount_point_t *mp, const char *path, uint32_t *size, bool *is_dir) {
     fat32_private_t *priv = (fat32_private_t *)mp->private_data;
     uint32_t cluster;
+    uint8_t attr;
     
-    if (fat32_find_file(priv, path, &cluster, size) != 0) {
+    if (fat32_find_entry(priv, path, &cluster, size, &attr) != 0) {
         return -1; // File not found
     }
     
-    // For simplicity, we'll say it's a directory if it has the directory attribute
-    // In a real implementation, you'd need to check the actual directory entry
-    *is_dir = (cluster & ATTR_DIRECTORY) != 0;
+    *is_dir = (attr & ATTR_DIRECTORY) != 0;
+    return 0;
+}
+
+// Handle-based operations: resolve once, then read by first cluster
+static int fat32_lookup(mount_point_t *mp, const char *path, fs_node_t *node) {
+    fat32_private_t *priv = (fat32_private_t *)mp->private_data;
+    uint32_t cluster, size;
+    uint8_t attr;
+    
+    if (fat32_find_entry(priv, path, &cluster, &size, &attr) != 0) {
+        return -1; // File not found
+    }
     
+    node->id = cluster;
+    node->size = size;
+    node->is_dir = (attr & ATTR_DIRECTORY) != 0;
     return 0;
 }
 
+static int fat32_read_node(mount_point_t *mp, const fs_node_t *node, uint8_t *buf, uint32_t size, uint32_t offset) {
+    return fat32_read_chain((fat32_private_t *)mp->private_data, (uint32_t)node->id, node->size, buf, size, offset);
+}
+
+static int fat32_list_node(mount_point_t *mp, const fs_node_t *node, char *buffer, uint32_t size) {
+    if (!node->is_dir) {
+        return -1; // Not a directory
+    }
+    return fat32_list_chain((fat32_private_t *)mp->private_data, (uint32_t)node->id, buffer, size);
+}
+
+// Describe where a file's data sits on the disk, for loop mounts
+static int fat32_map_node(mount_point_t *mp, const fs_node_t *node, blockdev_extent_t *extents, uint32_t max_extents) {
+    fat32_private_t *priv = (fat32_private_t *)mp->private_data;
+    
+    if (node->is_dir || node->size == 0) {
+        return -1;
+    }
+    
+    uint32_t file_clusters = (uint32_t)(((uint64_t)node->size + priv->bytes_per_cluster - 1) >> priv->cluster_shift);
+    const fat32_extent_map_t *map = fat32_get_extent_map(priv, (uint32_t)node->id, file_clusters);
+    if (!map) {
+        return -1; // Invalid cluster chain or out of memory
+    }
+    
+    uint32_t scale = priv->bs.bytes_per_sector / BLOCKDEV_SECTOR_SIZE;
+    uint32_t cluster_sectors = priv->bytes_per_cluster / BLOCKDEV_SECTOR_SIZE;
+    for (uint32_t e = 0; extents && e < map->extent_count && e < max_extents; e++) {
+        const fat32_extent_t *ext = &map->extents[e];
+        extents[e].offset = (uint64_t)ext->file_cluster * cluster_sectors;
+        extents[e].sector = (uint64_t)fat32_cluster_lba(priv, ext->disk_cluster) * scale;
+        extents[e].sectors = ext->length * cluster_sectors;
+    }
+    
+    return (int)map->extent_count;
+}
+
 // FAT32 filesystem operations structure
 const fs_operations_t fat32_ops = {
     .read = fat32_read,
     .write = NULL, // Read-only for now
     .list_dir = fat32_read_dir,
     .get_info = fat32_get_info,
+    .lookup = fat32_lookup,
+    .read_node = fat32_read_node,
+    .list_node = fat32_list_node,
+    .map_node = fat32_map_node,
 };
 
-// Helper function to read a FAT entry
-uint32_t fat32_get_cluster(fat32_private_t *priv, uint32_t cluster) {
-    if (cluster >= 0x0FFFFFF8) {
-        return 0x0FFFFFFF; // End of cluster chain
+// Set up the FAT and extent-map caches for a freshly mounted volume
+static int fat32_fat_cache_init(fat32_private_t *priv) {
+    uint32_t bps = priv->bs.bytes_per_sector;
+    uint64_t fat_bytes = (uint64_t)priv->fat_sectors * bps;
+    
+    priv->fat_table = NULL;
+    priv->fat_table_valid = NULL;
+    priv->fat_cache_data = NULL;
+    priv->fat_cache_clock = 0;
+    memset(priv->fat_cache, 0, sizeof(priv->fat_cache));
+    memset(priv->extent_maps, 0, sizeof(priv->extent_maps));
+    priv->extent_clock = 0;
+    
+    // Small FAT: keep all of it, loading sectors as they are first touched
+    if (fat_bytes > 0 && fat_bytes <= FAT32_FAT_FULL_CACHE_MAX) {
+        priv->fat_table = (uint8_t *)malloc((size_t)fat_bytes);
+        priv->fat_table_valid = (uint8_t *)calloc((priv->fat_sectors + 7) / 8, 1);
+        if (priv->fat_table && priv->fat_table_valid) {
+            return 0;
+        }
+        free(priv->fat_table);
+        free(priv->fat_table_valid);
+        priv->fat_table = NULL;
+        priv->fat_table_valid = NULL;
     }
     
-    uint32_t fat_offset = cluster * 4; // 32-bit FAT entries
-    uint32_t fat_sector = priv->fat_begin_lba + (fat_offset / priv->bs.bytes_per_sector);
-    uint32_t entry_offset = fat_offset % priv->bs.bytes_per_sector;
-    
-    uint8_t sector[512];
-    read_sector(fat_sector, sector);
-    
-    // Get next cluster number (mask off high 4 bits)
-    return (*(uint32_t*)(sector + entry_offset)) & 0x0FFFFFFF;
+    // Large FAT (or not enough memory for the whole table): LRU of sectors
+    priv->fat_cache_data = (uint8_t *)malloc((size_t)FAT32_FAT_CACHE_ENTRIES * bps);
+    if (!priv->fat_cache_data) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < FAT32_FAT_CACHE_ENTRIES; i++) {
+        priv->fat_cache[i].data = priv->fat_cache_data + (i * bps);
+    }
+    return 0;
 }
 
-// Read an entire cluster
-int fat32_read_cluster(fat32_private_t *priv, uint32_t cluster, uint8_t *buffer) {
-    if (cluster < 2 || cluster >= priv->total_clusters + 2) {
-        return -1; // Invalid cluster number
+static void fat32_fat_cache_free(fat32_private_t *priv) {
+    free(priv->fat_table);
+    free(priv->fat_table_valid);
+    free(priv->fat_cache_data);
+    priv->fat_table = NULL;
+    priv->fat_table_valid = NULL;
+    priv->fat_cache_data = NULL;
+}
+
+// Return a cached copy of one FAT sector, reading it on a miss
+static const uint8_t *fat32_get_fat_sector(fat32_private_t *priv, uint32_t sector) {
+    uint32_t bps = priv->bs.bytes_per_sector;
+    
+    if (sector >= priv->fat_sectors) {
+        return NULL;
     }
     
-    // Calculate first sector of cluster
-    uint32_t first_sector = priv->cluster_begin_lba + 
-                           ((cluster - 2) * priv->bs.sectors_per_cluster);
+    if (priv->fat_table) {
+        uint8_t *data = priv->fat_table + ((size_t)sector * bps);
+        uint8_t bit = (uint8_t)(1u << (sector & 7));
+        if (!(priv->fat_table_valid[sector >> 3] & bit)) {
+            if (fs_read_sectors(priv->fat_begin_lba + sector, 1, bps, data) != 0) {
+                return NULL;
+            }
+            priv->fat_table_valid[sector >> 3] |= bit;
+        }
+        return data;
+    }
     
-    // Read all sectors in the cluster
-    for (uint32_t i = 0; i < priv->bs.sectors_per_cluster; i++) {
-        read_sector(first_sector + i, buffer + (i * priv->bs.bytes_per_sector));
+    if (!priv->fat_cache_data) {
+        return NULL;
     }
     
-    return 0;
+    fat32_fat_cache_entry_t *victim = &priv->fat_cache[0];
+    for (uint32_t i = 0; i < FAT32_FAT_CACHE_ENTRIES; i++) {
+        fat32_fat_cache_entry_t *e = &priv->fat_cache[i];
+        if (e->last_used != 0 && e->sector == sector) {
+            e->last_used = ++priv->fat_cache_clock;
+            return e->data;
+        }
+        if (e->last_used < victim->last_used) {
+            victim = e;
+        }
+    }
+    
+    if (fs_read_sectors(priv->fat_begin_lba + sector, 1, bps, victim->data) != 0) {
+        victim->last_used = 0;
+        return NULL;
+    }
+    victim->sector = sector;
+    victim->last_used = ++priv->fat_cache_clock;
+    return victim->data;
 }
 
-// Find a file in the filesystem
-int fat32_find_file(fat32_private_t *priv, const char *path, uint32_t *cluster, uint32_t *size) {
-    // Start at root directory
-    uint32_t current_cluster = priv->root_dir_first_cluster;
+// Helper function to read a FAT entry
+uint32_t fat32_get_cluster(fat32_private_t *priv, uint32_t cluster) {
+    if (cluster >= 0x0FFFFFF8) {
+        return 0x0FFFFFFF; // End of cluster chain
+    }
     
-    // Skip leading slashes
-    while (*path == '/') path++;
+    uint32_t fat_sector = cluster >> priv->fat_entry_shift;
+    uint32_t next;
     
-    // Handle root directory
-    if (*path == '\0') {
-        *cluster = current_cluster;
-        *size = 0; // Directories have size 0 in FAT32
-        return 0;
+    // Whole FAT in memory and this sector already loaded: the entry is
+    // read in place, which is what a chain walk hits almost every time
+    if (priv->fat_table && fat_sector < priv->fat_sectors &&
+        (priv->fat_table_valid[fat_sector >> 3] & (1u << (fat_sector & 7)))) {
+        memcpy(&next, priv->fat_table + (size_t)cluster * 4, sizeof(next));
+        return next & 0x0FFFFFFF;
     }
     
-    // Split path into components
-    char component[256];
-    const char *next = strchr(path, '/');
-    size_t len = next ? (size_t)(next - path) : strlen(path);
-    
-    if (len >= sizeof(component)) {
-        return -1; // Component too long
+    const uint8_t *sector = fat32_get_fat_sector(priv, fat_sector);
+    if (!sector) {
+        return 0x0FFFFFFF; // Outside the FAT; treat as end of chain
     }
     
-    strncpy(component, path, len);
-    component[len] = '\0';
+    // Get next cluster number (mask off high 4 bits); entries are 32 bits
+    uint32_t entry_offset = (cluster * 4) & (priv->bs.bytes_per_sector - 1);
+    memcpy(&next, sector + entry_offset, sizeof(next));
+    return next & 0x0FFFFFFF;
+}
+
+// Read an entire cluster
+int fat32_read_cluster(fat32_private_t *priv, uint32_t cluster, uint8_t *buffer) {
+    if (cluster < 2 || cluster >= priv->total_clusters + 2) {
+        return -1; // Invalid cluster number
+    }
     
-    // Convert component to 8.3 format
-    char fatname[12];
+    // Read all sectors in the cluster with a single request
+    return fs_read_sectors(fat32_cluster_lba(priv, cluster), priv->bs.sectors_per_cluster,
+                           priv->bs.bytes_per_sector, buffer);
+}
+
+// Convert one path component to a space-padded, upper-case 8.3 name
+static void fat32_make_83_name(const char *component, size_t len, char fatname[11]) {
     memset(fatname, ' ', 11);
-    fatname[11] = '\0';
     
-    const char *dot = strchr(component, '.');
+    const char *dot = memchr(component, '.', len);
+    size_t name_len = dot ? (size_t)(dot - component) : len;
+    if (name_len > 8) name_len = 8;
+    memcpy(fatname, component, name_len);
+    
     if (dot) {
         // Has extension
-        size_t name_len = dot - component;
-        if (name_len > 8) name_len = 8;
-        
-        memcpy(fatname, component, name_len);
-        
-        const char *ext = dot + 1;
-        size_t ext_len = strlen(ext);
+        size_t ext_len = len - (size_t)(dot - component) - 1;
         if (ext_len > 3) ext_len = 3;
-        
-        memcpy(fatname + 8, ext, ext_len);
-    } else {
-        // No extension
-        size_t name_len = strlen(component);
-        if (name_len > 8) name_len = 8;
-        memcpy(fatname, component, name_len);
+        memcpy(fatname + 8, dot + 1, ext_len);
     }
     
     // Make uppercase
@@ -263,14 +533,15 @@ int fat32_find_file(fat32_private_t *priv, const char *path, uint32_t *cluster,
             fatname[i] = fatname[i] - 'a' + 'A';
         }
     }
-    
-    // Search directory for the component
-    uint8_t *cluster_buf = (uint8_t *)malloc(priv->bytes_per_cluster);
-    if (!cluster_buf) return -1;
+}
+
+// Search one directory chain for an 8.3 name
+static int fat32_search_dir(fat32_private_t *priv, uint32_t dir_cluster, const char fatname[11],
+                            uint8_t *cluster_buf, struct fat32_dirent *out) {
+    uint32_t current_cluster = dir_cluster;
     
     while (current_cluster < 0x0FFFFFF8) {
         if (fat32_read_cluster(priv, current_cluster, cluster_buf) != 0) {
-            free(cluster_buf);
             return -1;
         }
         
@@ -278,7 +549,6 @@ int fat32_find_file(fat32_private_t *priv, const char *path, uint32_t *cluster,
         for (uint32_t i = 0; i < priv->bytes_per_cluster; i += sizeof(struct fat32_dirent), dent++) {
             // Check for end of directory
             if (dent->name[0] == 0x00) {
-                free(cluster_buf);
                 return -1; // Not found
             }
             
@@ -289,19 +559,8 @@ int fat32_find_file(fat32_private_t *priv, const char *path, uint32_t *cluster,
             
             // Compare names
             if (memcmp(dent->name, fatname, 11) == 0) {
-                // Found the entry
-                *cluster = (dent->first_cluster_hi << 16) | dent->first_cluster_lo;
-                *size = dent->file_size;
-                
-                // If this is the last component, return success
-                if (!next) {
-                    free(cluster_buf);
-                    return 0;
-                }
-                
-                // Otherwise, continue with next component
-                free(cluster_buf);
-                return fat32_find_file(priv, next + 1, cluster, size);
+                *out = *dent;
+                return 0;
             }
         }
         
@@ -309,10 +568,61 @@ int fat32_find_file(fat32_private_t *priv, const char *path, uint32_t *cluster,
         current_cluster = fat32_get_cluster(priv, current_cluster);
     }
     
-    free(cluster_buf);
     return -1; // Not found
 }
 
+// Resolve a path component by component, starting at the root directory
+int fat32_find_entry(fat32_private_t *priv, const char *path, uint32_t *cluster, uint32_t *size, uint8_t *attr) {
+    uint32_t current_cluster = priv->root_dir_first_cluster;
+    uint32_t current_size = 0; // Directories have size 0 in FAT32
+    uint8_t current_attr = ATTR_DIRECTORY;
+    uint8_t *cluster_buf = NULL;
+    fs_path_iter_t iter;
+    fs_path_component_t comp;
+    
+    fs_path_iter_init(&iter, path);
+    while (fs_path_next(&iter, &comp)) {
+        if (!(current_attr & ATTR_DIRECTORY)) {
+            free(cluster_buf);
+            return -1; // Path goes through a file
+        }
+        
+        char fatname[11];
+        fat32_make_83_name(comp.name, comp.len, fatname);
+        
+        if (!cluster_buf) {
+            cluster_buf = (uint8_t *)malloc(priv->bytes_per_cluster);
+            if (!cluster_buf) return -1;
+        }
+        
+        struct fat32_dirent dent;
+        if (fat32_search_dir(priv, current_cluster, fatname, cluster_buf, &dent) != 0) {
+            free(cluster_buf);
+            return -1; // Not found
+        }
+        
+        current_cluster = ((uint32_t)dent.first_cluster_hi << 16) | dent.first_cluster_lo;
+        current_size = dent.file_size;
+        current_attr = dent.attr;
+        
+        // ".." pointing at the root is stored as cluster 0
+        if (current_cluster == 0 && (current_attr & ATTR_DIRECTORY)) {
+            current_cluster = priv->root_dir_first_cluster;
+        }
+    }
+    
+    free(cluster_buf);
+    *cluster = current_cluster;
+    *size = current_size;
+    if (attr) *attr = current_attr;
+    return 0;
+}
+
+// Find a file in the filesystem
+int fat32_find_file(fat32_private_t *priv, const char *path, uint32_t *cluster, uint32_t *size) {
+    return fat32_find_entry(priv, path, cluster, size, NULL);
+}
+
 // Mount function for FAT32
 static void *fat32_mount(uint32_t lba, void *opts) {
     fat32_private_t *priv = (fat32_private_t *)malloc(sizeof(fat32_private_t));
@@ -327,10 +637,22 @@ static void *fat32_mount(uint32_t lba, void *opts) {
         return NULL;
     }
     
+    // The shifts below need power-of-two sizes, as fat32_detect checks
+    uint32_t bps = priv->bs.bytes_per_sector;
+    uint32_t spc = priv->bs.sectors_per_cluster;
+    if ((bps & (bps - 1)) != 0 || bps < 512 || bps > 4096 || spc == 0 || (spc & (spc - 1)) != 0) {
+        free(priv);
+        return NULL;
+    }
+    
     // Initialize private data
     priv->lba = lba;
     priv->fat_begin_lba = lba + priv->bs.reserved_sectors;
-    priv->bytes_per_cluster = priv->bs.bytes_per_sector * priv->bs.sectors_per_cluster;
+    priv->bytes_per_cluster = bps * spc;
+    priv->sector_shift = fat32_log2(bps);
+    priv->spc_shift = fat32_log2(spc);
+    priv->cluster_shift = (uint8_t)(priv->sector_shift + priv->spc_shift);
+    priv->fat_entry_shift = (uint8_t)(priv->sector_shift - 2);
     
     // Calculate data area start
     uint32_t fat_size = priv->bs.sectors_per_fat_32 ? 
@@ -339,6 +661,7 @@ static void *fat32_mount(uint32_t lba, void *opts) {
     
     priv->cluster_begin_lba = priv->fat_begin_lba + (priv->bs.num_fats * fat_size);
     priv->root_dir_first_cluster = priv->bs.root_cluster;
+    priv->fat_sectors = fat_size;
     
     // Calculate total clusters
     uint32_t data_sectors = priv->bs.total_sectors_32 ? 
@@ -346,7 +669,12 @@ static void *fat32_mount(uint32_t lba, void *opts) {
                            priv->bs.total_sectors_16;
     
     data_sectors -= (priv->cluster_begin_lba - lba);
-    priv->total_clusters = data_sectors / priv->bs.sectors_per_cluster;
+    priv->total_clusters = data_sectors >> priv->spc_shift;
+    
+    if (fat32_fat_cache_init(priv) != 0) {
+        free(priv);
+        return NULL;
+    }
     
     return priv;
 }
@@ -354,6 +682,8 @@ static void *fat32_mount(uint32_t lba, void *opts) {
 // Unmount function for FAT32
 static void fat32_unmount(void *private_data) {
     if (private_data) {
+        fat32_free_extent_maps((fat32_private_t *)private_data);
+        fat32_fat_cache_free((fat32_private_t *)private_data);
         free(private_data);
     }
 }
@@ -73,6 +73,36 @@ struct fat32_dirent {
     uint32_t    file_size;
 } __attribute__((packed));
 
+// FAT sector cache. Volumes whose FAT fits in FAT32_FAT_FULL_CACHE_MAX bytes
+// keep the whole table in memory (filled on demand); larger ones use a small
+// LRU of FAT sectors.
+#define FAT32_FAT_CACHE_ENTRIES     16
+#define FAT32_FAT_FULL_CACHE_MAX    (4 * 1024 * 1024)
+
+typedef struct {
+    uint32_t sector;                // FAT sector index (relative to fat_begin_lba)
+    uint32_t last_used;             // LRU stamp, 0 = empty
+    uint8_t *data;                  // bytes_per_sector of FAT data
+} fat32_fat_cache_entry_t;
+
+// One run of consecutive clusters in a file
+typedef struct {
+    uint32_t file_cluster;          // Index of the run's first cluster within the file
+    uint32_t disk_cluster;          // Cluster number on disk
+    uint32_t length;                // Number of clusters in the run
+} fat32_extent_t;
+
+// Cluster chain of a file flattened into extents, built on first read
+#define FAT32_EXTENT_MAP_CACHE      8
+
+typedef struct {
+    uint32_t first_cluster;         // Key: first cluster of the file, 0 = empty
+    uint32_t cluster_count;         // Clusters covered by the map
+    uint32_t extent_count;
+    fat32_extent_t *extents;
+    uint32_t last_used;             // LRU stamp
+} fat32_extent_map_t;
+
 // FAT32 private data structure
 typedef struct {
     uint32_t lba;                   // Starting LBA of partition
@@ -82,6 +112,25 @@ typedef struct {
     uint32_t root_dir_first_cluster; // First cluster of root directory
     uint32_t bytes_per_cluster;     // Bytes per cluster
     uint32_t total_clusters;        // Total number of data clusters
+    uint32_t fat_sectors;           // Sectors in one FAT copy
+
+    // Sector and cluster sizes are powers of two (checked at mount), so
+    // offsets are split with these instead of dividing
+    uint8_t sector_shift;           // log2(bytes_per_sector)
+    uint8_t cluster_shift;          // log2(bytes_per_cluster)
+    uint8_t spc_shift;              // log2(sectors_per_cluster)
+    uint8_t fat_entry_shift;        // log2(FAT entries per sector)
+
+    // FAT cache
+    uint8_t *fat_table;             // Whole FAT (small volumes), NULL otherwise
+    uint8_t *fat_table_valid;       // One bit per FAT sector loaded into fat_table
+    fat32_fat_cache_entry_t fat_cache[FAT32_FAT_CACHE_ENTRIES];
+    uint8_t *fat_cache_data;        // Backing store for fat_cache entries
+    uint32_t fat_cache_clock;       // Monotonic LRU counter
+
+    // Extent maps of recently read files
+    fat32_extent_map_t extent_maps[FAT32_EXTENT_MAP_CACHE];
+    uint32_t extent_clock;
 } fat32_private_t;
 
 // FAT32 filesystem operations
@@ -94,5 +143,6 @@ extern const filesystem_t fat32_fs;
 uint32_t fat32_get_cluster(fat32_private_t *priv, uint32_t cluster);
 int fat32_read_cluster(fat32_private_t *priv, uint32_t cluster, uint8_t *buffer);
 int fat32_find_file(fat32_private_t *priv, const char *path, uint32_t *cluster, uint32_t *size);
+int fat32_find_entry(fat32_private_t *priv, const char *path, uint32_t *cluster, uint32_t *size, uint8_t *attr);
 
 #endif // BLOODHORN_FAT32_H
\ No newline at end of file
@@ -10,6 +10,10 @@
 #include "fat32.h"
 #include "ext2.h"
 #include "iso9660.h"
+#include "squashfs.h"
+#include "blockdev.h"
+#include "../boot/libb/include/bloodhorn/trace.h"
+#include "../boot/libb/include/bloodhorn/hash.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -17,8 +21,27 @@
 static const filesystem_t *registered_fs[8] = {0};
 static int num_registered_fs = 0;
 
-// List of mount points
-static mount_point_t *mount_points = NULL;
+// Mount table, kept sorted by path. Resolving a path costs one binary
+// search per candidate prefix (deepest first) instead of a strcmp against
+// every mount.
+static mount_point_t *mount_table[FS_MAX_MOUNTS];
+static int num_mounts = 0;
+
+// Dentry cache: maps (mount, normalized path) to a driver node. Misses are
+// cached too, so probing for optional files (configs, fonts, locales) stays
+// cheap.
+typedef struct {
+    mount_point_t *mp;          // NULL = empty slot
+    uint32_t hash;
+    uint32_t last_used;
+    bool found;
+    fs_node_t node;
+    char path[FS_DCACHE_PATH_MAX];
+} fs_dentry_t;
+
+static fs_dentry_t dcache[FS_DCACHE_ENTRIES];
+static uint32_t dcache_clock = 0;
+static fs_file_t open_files[FS_MAX_OPEN_FILES];
 
 // Helper function to find a filesystem by name
 static const filesystem_t *find_filesystem(const char *name) {
@@ -30,24 +53,94 @@ static const filesystem_t *find_filesystem(const char *name) {
     return NULL;
 }
 
-// Helper function to find mount point for a path
+// Order of the mount table: mount path against the first `len` bytes of `path`
+static int mount_compare(const mount_point_t *mp, const char *path, size_t len) {
+    size_t n = mp->path_len < len ? mp->path_len : len;
+    int cmp = memcmp(mp->path, path, n);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return mp->path_len < len ? -1 : (mp->path_len > len ? 1 : 0);
+}
+
+// Binary search; returns the slot of the exact match, or where it would go
+static int mount_search(const char *path, size_t len, bool *found) {
+    int lo = 0, hi = num_mounts;
+    
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        int cmp = mount_compare(mount_table[mid], path, len);
+        if (cmp == 0) {
+            *found = true;
+            return mid;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *found = false;
+    return lo;
+}
+
+// Longest mounted prefix of `path` that ends on a component boundary
 static mount_point_t *find_mount_point(const char *path) {
-    mount_point_t *best_match = NULL;
-    size_t best_len = 0;
-    size_t path_len = strlen(path);
-    
-    for (mount_point_t *mp = mount_points; mp != NULL; mp = mp->next) {
-        size_t mp_len = strlen(mp->path);
-        if (path_len >= mp_len && 
-            strncmp(path, mp->path, mp_len) == 0 &&
-            (path[mp_len] == '/' || path[mp_len] == '\' || path[mp_len] == '\0') &&
-            mp_len > best_len) {
-            best_match = mp;
-            best_len = mp_len;
+    if (!path || path[0] != '/') {
+        return NULL;
+    }
+    
+    size_t len = strlen(path);
+    for (;;) {
+        bool found;
+        int slot = mount_search(path, len, &found);
+        if (found) {
+            return mount_table[slot];
+        }
+        if (len == 1) {
+            return NULL; // Nothing mounted at the root
         }
+        
+        // Drop the last component (and its separator, except for the root)
+        while (len > 1 && path[len - 1] != '/' && path[len - 1] != '\\') len--;
+        if (len > 1) len--;
+    }
+}
+
+// Drivers read through blockdev's current device; point it at the
+// mount's own device (loop mounts) for the duration of a driver call
+static block_device_t *vfs_enter(mount_point_t *mp) {
+    return blockdev_select(mp ? mp->dev : NULL);
+}
+
+static void vfs_leave(block_device_t *previous) {
+    blockdev_select(previous);
+}
+
+static void mount_get(mount_point_t *mp) {
+    mp->refs++;
+}
+
+// Drop a reference; the last one (table or open handle) tears the mount down
+static void mount_put(mount_point_t *mp) {
+    if (--mp->refs != 0) {
+        return;
     }
     
-    return best_match;
+    if (mp->fs->unmount) {
+        block_device_t *previous = vfs_enter(mp);
+        mp->fs->unmount(mp->private_data);
+        vfs_leave(previous);
+    }
+    if (mp->owns_dev) {
+        blockdev_destroy_loop(mp->dev);
+    }
+    if (mp->host) {
+        mount_put(mp->host); // Loop mounts pin the filesystem holding their image
+    }
+    
+    free((void *)mp->path);
+    free(mp);
 }
 
 // Register a filesystem type
@@ -57,12 +150,20 @@ void fs_register(const filesystem_t *fs) {
     }
 }
 
-// Mount a filesystem
-int fs_mount(const char *path, const char *fstype, uint32_t lba, void *opts) {
-    // Find the filesystem
-    const filesystem_t *fs = find_filesystem(fstype);
-    if (!fs) {
-        return -1; // Filesystem type not found
+static int vfs_normalize_path(const char *path, char *out, size_t out_size);
+
+static int vfs_mount(const char *path, const filesystem_t *fs, uint32_t lba, void *opts,
+                     block_device_t *dev, mount_point_t **mp_out) {
+    char norm[FS_DCACHE_PATH_MAX];
+    bool found;
+    
+    int norm_len = vfs_normalize_path(path, norm, sizeof(norm));
+    if (norm_len < 0) {
+        return -1; // Mount path too long
+    }
+    int slot = mount_search(norm, (size_t)norm_len, &found);
+    if (found || num_mounts >= FS_MAX_MOUNTS) {
+        return -4; // Already mounted, or table full
     }
     
     // Allocate and initialize mount point
@@ -71,51 +172,89 @@ int fs_mount(const char *path, const char *fstype, uint32_t lba, void *opts) {
         return -2; // Out of memory
     }
     
-    mp->path = strdup(path);
+    mp->path = strdup(norm);
+    mp->path_len = (size_t)norm_len;
     mp->fs = fs;
     mp->start_lba = lba;
-    mp->next = NULL;
+    mp->dev = dev;
+    mp->owns_dev = false;
+    mp->host = NULL;
+    mp->refs = 1; // The mount table's reference
     
     // Call filesystem-specific mount function
+    BH_TRACE_BEGIN(span, BH_TRACE_PHASE_FS_MOUNT);
+    block_device_t *previous = blockdev_select(dev);
     mp->private_data = fs->mount(lba, opts);
+    vfs_leave(previous);
+    BH_TRACE_END(span);
     if (!mp->private_data) {
         free((void *)mp->path);
         free(mp);
         return -3; // Mount failed
     }
     
-    // Add to mount points list
-    if (!mount_points) {
-        mount_points = mp;
-    } else {
-        mount_point_t *last = mount_points;
-        while (last->next) last = last->next;
-        last->next = mp;
-    }
+    memmove(&mount_table[slot + 1], &mount_table[slot], (size_t)(num_mounts - slot) * sizeof(mount_table[0]));
+    mount_table[slot] = mp;
+    num_mounts++;
     
+    if (mp_out) {
+        *mp_out = mp;
+    }
     return 0;
 }
 
-// Unmount a filesystem
-int fs_unmount(const char *path) {
-    mount_point_t **pmp = &mount_points;
-    while (*pmp) {
-        if (strcmp((*pmp)->path, path) == 0) {
-            mount_point_t *mp = *pmp;
-            *pmp = mp->next;
-            
-            // Call filesystem-specific unmount
-            if (mp->fs->unmount) {
-                mp->fs->unmount(mp->private_data);
-            }
-            
-            free((void *)mp->path);
-            free(mp);
-            return 0;
+// Mount a filesystem
+int fs_mount(const char *path, const char *fstype, uint32_t lba, void *opts) {
+    // Find the filesystem
+    const filesystem_t *fs = find_filesystem(fstype);
+    if (!fs) {
+        return -1; // Filesystem type not found
+    }
+    
+    return vfs_mount(path, fs, lba, opts, NULL, NULL);
+}
+
+int fs_mount_device(const char *path, const char *fstype, block_device_t *dev, uint32_t lba, void *opts) {
+    const filesystem_t *fs = find_filesystem(fstype);
+    if (!fs) {
+        return -1; // Filesystem type not found
+    }
+    
+    return vfs_mount(path, fs, lba, opts, dev, NULL);
+}
+
+const filesystem_t *fs_detect(uint32_t lba) {
+    for (int i = 0; i < num_registered_fs; i++) {
+        if (registered_fs[i]->detect && registered_fs[i]->detect(lba)) {
+            return registered_fs[i];
         }
-        pmp = &(*pmp)->next;
     }
-    return -1; // Not found
+    return NULL;
+}
+
+// Unmount a filesystem. Open handles keep their own reference, so the
+// driver is only torn down once the last of them is closed.
+int fs_unmount(const char *path) {
+    char norm[FS_DCACHE_PATH_MAX];
+    bool found;
+    
+    int norm_len = vfs_normalize_path(path, norm, sizeof(norm));
+    if (norm_len < 0) {
+        return -1;
+    }
+    int slot = mount_search(norm, (size_t)norm_len, &found);
+    if (!found) {
+        return -1; // Not found
+    }
+    
+    mount_point_t *mp = mount_table[slot];
+    num_mounts--;
+    memmove(&mount_table[slot], &mount_table[slot + 1], (size_t)(num_mounts - slot) * sizeof(mount_table[0]));
+    
+    // Forget cached lookups; new lookups can no longer reach this mount
+    fs_dcache_invalidate(mp);
+    mount_put(mp);
+    return 0;
 }
 
 // Get mount point for a path
@@ -123,20 +262,232 @@ mount_point_t *fs_get_mount_point(const char *path) {
     return find_mount_point(path);
 }
 
-// File operations
-int fs_read(const char *path, uint8_t *buf, uint32_t size, uint32_t offset) {
-    mount_point_t *mp = find_mount_point(path);
-    if (!mp || !mp->fs->ops->read) {
+// Canonical form used as the dentry cache key: '/'-separated, no empty,
+// "." or ".." components, no trailing separator. Returns its length, or -1
+// if it does not fit in out_size.
+static int vfs_normalize_path(const char *path, char *out, size_t out_size) {
+    fs_path_iter_t iter;
+    fs_path_component_t comp;
+    size_t len = 0;
+    
+    if (!path || out_size < 2) {
         return -1;
     }
     
-    // Skip mount point path
+    out[len++] = '/';
+    fs_path_iter_init(&iter, path);
+    while (fs_path_next(&iter, &comp)) {
+        if (comp.len == 2 && comp.name[0] == '.' && comp.name[1] == '.') {
+            // Parent directory: back up to the previous separator
+            while (len > 1 && out[len - 1] != '/') len--;
+            if (len > 1) len--;
+            continue;
+        }
+        if (len > 1) {
+            if (len + 1 >= out_size) return -1;
+            out[len++] = '/';
+        }
+        if (len + comp.len >= out_size) return -1;
+        memcpy(out + len, comp.name, comp.len);
+        len += comp.len;
+    }
+    
+    out[len] = '\0';
+    return (int)len;
+}
+
+// Path relative to its mount point, without leading separators
+static const char *vfs_relative_path(mount_point_t *mp, const char *path) {
     const char *rel_path = path + strlen(mp->path);
-    if (*rel_path == '/' || *rel_path == '\\') {
+    while (*rel_path == '/' || *rel_path == '\\') {
         rel_path++;
     }
+    return rel_path;
+}
+
+void fs_dcache_invalidate(mount_point_t *mp) {
+    for (int i = 0; i < FS_DCACHE_ENTRIES; i++) {
+        if (!mp || dcache[i].mp == mp) {
+            dcache[i].mp = NULL;
+        }
+    }
+}
+
+// Resolve a path to its mount point and node, consulting the dentry cache.
+// `norm` receives the normalized path (FS_DCACHE_PATH_MAX bytes).
+static int vfs_resolve(const char *path, char *norm, mount_point_t **mp_out, fs_node_t *node) {
+    int norm_len = vfs_normalize_path(path, norm, FS_DCACHE_PATH_MAX);
+    if (norm_len < 0) {
+        return -1; // Too long to cache; callers fall back to the path API
+    }
+    
+    mount_point_t *mp = find_mount_point(norm);
+    if (!mp) {
+        return -1;
+    }
+    *mp_out = mp;
+    
+    if (!mp->fs->ops->lookup) {
+        return -1;
+    }
+    
+    uint32_t hash = fs_path_hash(norm, (size_t)norm_len);
+    fs_dentry_t *victim = &dcache[0];
+    for (int i = 0; i < FS_DCACHE_ENTRIES; i++) {
+        fs_dentry_t *d = &dcache[i];
+        if (d->mp == mp && d->hash == hash && strcmp(d->path, norm) == 0) {
+            d->last_used = ++dcache_clock;
+            if (!d->found) {
+                return -2; // Cached miss
+            }
+            *node = d->node;
+            return 0;
+        }
+        if (!d->mp) {
+            victim = d;
+        } else if (victim->mp && d->last_used < victim->last_used) {
+            victim = d;
+        }
+    }
+    
+    block_device_t *previous = vfs_enter(mp);
+    int status = mp->fs->ops->lookup(mp, vfs_relative_path(mp, norm), node);
+    vfs_leave(previous);
+    
+    victim->mp = mp;
+    victim->hash = hash;
+    victim->last_used = ++dcache_clock;
+    victim->found = (status == 0);
+    if (status == 0) {
+        victim->node = *node;
+    }
+    strcpy(victim->path, norm);
     
-    return mp->fs->ops->read(mp, rel_path, buf, size, offset);
+    return status == 0 ? 0 : -2;
+}
+
+// Open a file handle
+fs_file_t *fs_open(const char *path) {
+    char norm[FS_DCACHE_PATH_MAX];
+    mount_point_t *mp = NULL;
+    fs_node_t node;
+    fs_file_t *file = NULL;
+    
+    for (int i = 0; i < FS_MAX_OPEN_FILES; i++) {
+        if (!open_files[i].in_use) {
+            file = &open_files[i];
+            break;
+        }
+    }
+    if (!file) {
+        return NULL; // Too many open files
+    }
+    
+    int status = vfs_resolve(path, norm, &mp, &node);
+    if (status == -2 || !mp) {
+        return NULL; // Not found
+    }
+    
+    file->rel_path[0] = '\0';
+    if (status != 0) {
+        // Driver without node operations: remember the path instead
+        const char *rel_path = vfs_relative_path(mp, norm);
+        bool is_dir = false;
+        if (strlen(rel_path) >= sizeof(file->rel_path) || !mp->fs->ops->get_info) {
+            return NULL;
+        }
+        block_device_t *previous = vfs_enter(mp);
+        status = mp->fs->ops->get_info(mp, rel_path, &node.size, &is_dir);
+        vfs_leave(previous);
+        if (status != 0) {
+            return NULL;
+        }
+        node.id = 0;
+        node.is_dir = is_dir;
+        strcpy(file->rel_path, rel_path);
+    }
+    
+    mount_get(mp);
+    file->mp = mp;
+    file->node = node;
+    file->pos = 0;
+    file->in_use = true;
+    return file;
+}
+
+int fs_file_pread(fs_file_t *file, uint8_t *buf, uint32_t size, uint32_t offset) {
+    if (!file || !file->in_use || !file->mp || file->node.is_dir) {
+        return -1;
+    }
+    
+    const fs_operations_t *ops = file->mp->fs->ops;
+    int ret = -1;
+    block_device_t *previous = vfs_enter(file->mp);
+    if (ops->read_node && file->rel_path[0] == '\0') {
+        ret = ops->read_node(file->mp, &file->node, buf, size, offset);
+    } else if (ops->read) {
+        ret = ops->read(file->mp, file->rel_path, buf, size, offset);
+    }
+    vfs_leave(previous);
+    return ret;
+}
+
+int fs_file_read(fs_file_t *file, uint8_t *buf, uint32_t size) {
+    int read = fs_file_pread(file, buf, size, file ? file->pos : 0);
+    if (read > 0) {
+        file->pos += (uint32_t)read;
+    }
+    return read;
+}
+
+int fs_file_seek(fs_file_t *file, uint32_t offset) {
+    if (!file || !file->in_use) {
+        return -1;
+    }
+    file->pos = offset;
+    return 0;
+}
+
+uint32_t fs_file_size(const fs_file_t *file) {
+    return (file && file->in_use) ? file->node.size : 0;
+}
+
+void fs_close(fs_file_t *file) {
+    if (file && file->in_use) {
+        file->in_use = false;
+        if (file->mp) {
+            mount_put(file->mp);
+            file->mp = NULL;
+        }
+    }
+}
+
+// File operations
+int fs_read(const char *path, uint8_t *buf, uint32_t size, uint32_t offset) {
+    char norm[FS_DCACHE_PATH_MAX];
+    mount_point_t *mp = NULL;
+    fs_node_t node;
+    
+    int status = vfs_resolve(path, norm, &mp, &node);
+    if (status == -2 || (status == 0 && node.is_dir)) {
+        return -1; // Known missing
+    }
+    if (status != 0) {
+        mp = find_mount_point(path);
+    }
+    if (!mp) {
+        return -1;
+    }
+    
+    int ret = -1;
+    block_device_t *previous = vfs_enter(mp);
+    if (status == 0 && mp->fs->ops->read_node) {
+        ret = mp->fs->ops->read_node(mp, &node, buf, size, offset);
+    } else if (mp->fs->ops->read) {
+        ret = mp->fs->ops->read(mp, vfs_relative_path(mp, status == 0 ? norm : path), buf, size, offset);
+    }
+    vfs_leave(previous);
+    return ret;
 }
 
 int fs_write(const char *path, const uint8_t *buf, uint32_t size, uint32_t offset) {
@@ -145,40 +496,206 @@ int fs_write(const char *path, const uint8_t *buf, uint32_t size, uint32_t offse
         return -1;
     }
     
-    const char *rel_path = path + strlen(mp->path);
-    if (*rel_path == '/' || *rel_path == '\\') {
-        rel_path++;
-    }
+    // Sizes and allocations may change under cached nodes
+    fs_dcache_invalidate(mp);
     
-    return mp->fs->ops->write(mp, rel_path, buf, size, offset);
+    block_device_t *previous = vfs_enter(mp);
+    int ret = mp->fs->ops->write(mp, vfs_relative_path(mp, path), buf, size, offset);
+    vfs_leave(previous);
+    blockdev_invalidate(); // Loop devices may sit on top of what changed
+    return ret;
 }
 
 int fs_list_dir(const char *path, char *buffer, uint32_t size) {
-    mount_point_t *mp = find_mount_point(path);
-    if (!mp || !mp->fs->ops->list_dir) {
+    char norm[FS_DCACHE_PATH_MAX];
+    mount_point_t *mp = NULL;
+    fs_node_t node;
+    
+    int status = vfs_resolve(path, norm, &mp, &node);
+    if (status == -2) {
+        return -1; // Known missing
+    }
+    if (status != 0) {
+        mp = find_mount_point(path);
+    }
+    if (!mp) {
         return -1;
     }
     
-    const char *rel_path = path + strlen(mp->path);
-    if (*rel_path == '/' || *rel_path == '\\') {
-        rel_path++;
+    int ret = -1;
+    block_device_t *previous = vfs_enter(mp);
+    if (status == 0 && mp->fs->ops->list_node) {
+        ret = mp->fs->ops->list_node(mp, &node, buffer, size);
+    } else if (mp->fs->ops->list_dir) {
+        ret = mp->fs->ops->list_dir(mp, vfs_relative_path(mp, status == 0 ? norm : path), buffer, size);
     }
-    
-    return mp->fs->ops->list_dir(mp, rel_path, buffer, size);
+    vfs_leave(previous);
+    return ret;
 }
 
 int fs_get_info(const char *path, uint32_t *size, bool *is_dir) {
-    mount_point_t *mp = find_mount_point(path);
+    char norm[FS_DCACHE_PATH_MAX];
+    mount_point_t *mp = NULL;
+    fs_node_t node;
+    
+    int status = vfs_resolve(path, norm, &mp, &node);
+    if (status == 0) {
+        if (size) *size = node.size;
+        if (is_dir) *is_dir = node.is_dir;
+        return 0;
+    }
+    if (status == -2) {
+        return -1; // Known missing
+    }
+    
+    mp = find_mount_point(path);
     if (!mp || !mp->fs->ops->get_info) {
         return -1;
     }
     
-    const char *rel_path = path + strlen(mp->path);
-    if (*rel_path == '/' || *rel_path == '\\') {
-        rel_path++;
+    block_device_t *previous = vfs_enter(mp);
+    int ret = mp->fs->ops->get_info(mp, vfs_relative_path(mp, path), size, is_dir);
+    vfs_leave(previous);
+    return ret;
+}
+
+// Build a loop device over the image's on-disk extents and mount it
+// Resolve a file and, when its filesystem can say where it lives, the
+// extent list behind it (allocated; NULL when there are none or out of
+// memory, with *count the total either way)
+static int map_file_extents(const char *path, mount_point_t **host, fs_node_t *node,
+                            blockdev_extent_t **extents, int *count) {
+    char norm[FS_DCACHE_PATH_MAX];
+    
+    *extents = NULL;
+    if (vfs_resolve(path, norm, host, node) != 0 || node->is_dir || !(*host)->fs->ops->map_node) {
+        return -1; // Missing file, or its filesystem cannot describe extents
     }
     
-    return mp->fs->ops->get_info(mp, rel_path, size, is_dir);
+    // Size the extent list, then fill it
+    block_device_t *previous = vfs_enter(*host);
+    *count = (*host)->fs->ops->map_node(*host, node, NULL, 0);
+    if (*count > 0) {
+        *extents = (blockdev_extent_t *)malloc((size_t)*count * sizeof(blockdev_extent_t));
+    }
+    if (*extents && (*host)->fs->ops->map_node(*host, node, *extents, (uint32_t)*count) != *count) {
+        free(*extents);
+        *extents = NULL;
+    }
+    vfs_leave(previous);
+    return 0;
+}
+
+int fs_map_file(const char *path, blockdev_extent_t *extents, uint32_t max_extents, uint32_t *size,
+                block_device_t **dev) {
+    mount_point_t *host = NULL;
+    fs_node_t node;
+    blockdev_extent_t *all;
+    int count = 0;
+    
+    if (map_file_extents(path, &host, &node, &all, &count) != 0) {
+        return -1;
+    }
+    if (size) *size = node.size;
+    if (dev) *dev = host->dev;
+    if (!all) {
+        return count == 0 ? 0 : -1; // Empty file, or out of memory
+    }
+    if (extents) {
+        memcpy(extents, all, (size_t)(count < (int)max_extents ? count : (int)max_extents) * sizeof(*all));
+    }
+    free(all);
+    return count;
+}
+
+int fs_mount_loop(const char *path, const char *fstype, const char *image_path, void *opts) {
+    mount_point_t *host = NULL;
+    fs_node_t node;
+    blockdev_extent_t *extents;
+    int count = 0;
+    
+    if (map_file_extents(image_path, &host, &node, &extents, &count) != 0) {
+        return -1;
+    }
+    if (!extents) {
+        return -2;
+    }
+    
+    block_device_t *loop = blockdev_create_loop(host->dev, extents, (uint32_t)count,
+                                                ((uint64_t)node.size + BLOCKDEV_SECTOR_SIZE - 1) / BLOCKDEV_SECTOR_SIZE);
+    free(extents);
+    if (!loop) {
+        return -2; // Out of memory
+    }
+    
+    const filesystem_t *fs = NULL;
+    if (fstype) {
+        fs = find_filesystem(fstype);
+    } else {
+        block_device_t *previous = blockdev_select(loop);
+        fs = fs_detect(0);
+        vfs_leave(previous);
+    }
+    
+    mount_point_t *mp = NULL;
+    int status = fs ? vfs_mount(path, fs, 0, opts, loop, &mp) : -1;
+    if (status != 0) {
+        blockdev_destroy_loop(loop);
+        return status;
+    }
+    
+    mp->owns_dev = true;
+    mp->host = host;
+    mount_get(host);
+    return 0;
+}
+
+// Path component iteration
+static bool path_is_separator(char c) {
+    return c == '/' || c == '\\';
+}
+
+// Step over separators and "." components
+static const char *path_skip(const char *p) {
+    for (;;) {
+        while (path_is_separator(*p)) p++;
+        if (p[0] == '.' && (p[1] == '\0' || path_is_separator(p[1]))) {
+            p++;
+            continue;
+        }
+        return p;
+    }
+}
+
+uint32_t fs_path_hash(const char *name, size_t len) {
+    uint32_t hash = BH_FNV1A_INIT;
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = (uint8_t)name[i];
+        if (c >= 'A' && c <= 'Z') c += 32;
+        hash = bh_fnv1a_step(hash, c);
+    }
+    return hash;
+}
+
+void fs_path_iter_init(fs_path_iter_t *iter, const char *path) {
+    iter->next = path ? path_skip(path) : "";
+}
+
+bool fs_path_next(fs_path_iter_t *iter, fs_path_component_t *comp) {
+    const char *name = iter->next;
+    if (*name == '\0') {
+        return false;
+    }
+    
+    const char *end = name;
+    while (*end && !path_is_separator(*end)) end++;
+    
+    comp->name = name;
+    comp->len = (uint32_t)(end - name);
+    comp->hash = fs_path_hash(name, comp->len);
+    iter->next = path_skip(end);
+    comp->last = (*iter->next == '\0');
+    return true;
 }
 
 // Path helper functions
@@ -247,24 +764,26 @@ char *fs_join_path(const char *dir, const char *file, char *buf, size_t size) {
     return buf;
 }
 
+// Read a run of sectors through the shared block cache. Drivers call this
+// for whole extents so small metadata reads and bulk data reads both end
+// up in one place.
+int fs_read_sectors(uint32_t lba, uint32_t count, uint32_t sector_size, uint8_t *buf) {
+    if (!buf || sector_size == 0 || sector_size % BLOCKDEV_SECTOR_SIZE != 0) {
+        return -1;
+    }
+    
+    uint32_t scale = sector_size / BLOCKDEV_SECTOR_SIZE;
+    return blockdev_read((uint64_t)lba * scale, count * scale, buf);
+}
+
 // Initialize filesystem layer
 void fs_init(void) {
     // Register built-in filesystems
     fs_register(&fat32_fs);
     fs_register(&ext2_fs);
     fs_register(&iso9660_fs);
+    fs_register(&squashfs_fs);
     
-    // Auto-detect and mount root filesystem
-    // This is just an example - in a real implementation, you'd want to
-    // scan available disks and partitions to find the root filesystem
-    uint32_t root_lba = 0; // This would be determined by partition scanning
-    
-    // Try to detect and mount the root filesystem
-    for (int i = 0; i < num_registered_fs; i++) {
-        if (registered_fs[i]->detect && registered_fs[i]->detect(root_lba)) {
-            if (fs_mount("/", registered_fs[i]->name, root_lba, NULL) == 0) {
-                break; // Successfully mounted root
-            }
-        }
-    }
+    // Partitions are detected and mounted by the probe scheduler
+    // (fs_probe.c), which batches the superblock reads of every disk
 }
\ No newline at end of file
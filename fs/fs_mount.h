@@ -11,11 +11,20 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "compat.h"
+#include "blockdev.h"
 
 // Forward declarations
-typeof struct fs_operations fs_operations_t;
-typeof struct filesystem filesystem_t;
-typeof struct mount_point mount_point_t;
+typedef struct fs_operations fs_operations_t;
+typedef struct filesystem filesystem_t;
+typedef struct mount_point mount_point_t;
+
+// A resolved file or directory. `id` is whatever the driver needs to reach
+// the data again without a path walk (first cluster, inode, extent LBA).
+typedef struct {
+    uint64_t id;
+    uint32_t size;
+    bool is_dir;
+} fs_node_t;
 
 // File operations structure
 typedef struct fs_operations {
@@ -23,6 +32,16 @@ typedef struct fs_operations {
     int (*write)(mount_point_t *mp, const char *path, const uint8_t *buf, uint32_t size, uint32_t offset);
     int (*list_dir)(mount_point_t *mp, const char *path, char *buffer, uint32_t size);
     int (*get_info)(mount_point_t *mp, const char *path, uint32_t *size, bool *is_dir);
+    
+    // Optional node-based operations used by handles and the dentry cache
+    int (*lookup)(mount_point_t *mp, const char *path, fs_node_t *node);
+    int (*read_node)(mount_point_t *mp, const fs_node_t *node, uint8_t *buf, uint32_t size, uint32_t offset);
+    int (*list_node)(mount_point_t *mp, const fs_node_t *node, char *buffer, uint32_t size);
+    
+    // Optional: describe where a file lives on the device. Fills up to
+    // max_extents and returns the total count (call with NULL to size);
+    // holes are simply not covered by any extent.
+    int (*map_node)(mount_point_t *mp, const fs_node_t *node, blockdev_extent_t *extents, uint32_t max_extents);
 } fs_operations_t;
 
 // Filesystem type structure
@@ -40,28 +59,102 @@ typedef struct mount_point {
     const filesystem_t *fs;     // Filesystem type
     void *private_data;         // Filesystem-specific data
     uint32_t start_lba;         // Starting LBA of the partition
-    struct mount_point *next;   // Next mount point in the list
+    block_device_t *dev;        // Device the driver reads (NULL = boot disk)
+    bool owns_dev;              // Loop device created for this mount
+    struct mount_point *host;   // Mount holding a loop mount's image
+    size_t path_len;
+    uint32_t refs;              // Mount table entry plus open handles
 } mount_point_t;
 
 // Filesystem registration
 void fs_register(const filesystem_t *fs);
 
-// Mount management
+// Mount management. Mount paths are normalized; mounting over an existing
+// mount point fails.
+#define FS_MAX_MOUNTS       32
+
 int fs_mount(const char *path, const char *fstype, uint32_t lba, void *opts);
 int fs_unmount(const char *path);
+
+// Mount a volume on a specific disk (NULL = boot disk)
+int fs_mount_device(const char *path, const char *fstype, block_device_t *dev, uint32_t lba, void *opts);
+
+// First registered filesystem recognising the volume at `lba` on the
+// currently selected device, or NULL
+const filesystem_t *fs_detect(uint32_t lba);
+
+// Mount a filesystem image file (e.g. a live ISO on the ESP) through a loop
+// device built from the image's extent map; the image is never loaded
+// into memory. fstype NULL probes every registered filesystem.
+int fs_mount_loop(const char *path, const char *fstype, const char *image_path, void *opts);
 mount_point_t *fs_get_mount_point(const char *path);
 
+// Where a file lies on its disk: fills up to max_extents (NULL to size)
+// and returns the total count, or -1 when it is missing or its filesystem
+// cannot tell. *dev is the disk the extents' sectors are on (NULL = boot
+// disk); for a file inside a loop mount that is the loop device.
+int fs_map_file(const char *path, blockdev_extent_t *extents, uint32_t max_extents, uint32_t *size,
+                block_device_t **dev);
+
+// Open file handles. Paths are resolved once through the dentry cache;
+// reads on the handle go straight to the driver's node.
+#define FS_MAX_OPEN_FILES   16
+#define FS_DCACHE_ENTRIES   64
+#define FS_DCACHE_PATH_MAX  128
+
+typedef struct fs_file {
+    mount_point_t *mp;          // Holds a mount reference until fs_close
+    fs_node_t node;
+    uint32_t pos;               // Position for fs_file_read
+    bool in_use;
+    char rel_path[FS_DCACHE_PATH_MAX]; // For drivers without read_node
+} fs_file_t;
+
+fs_file_t *fs_open(const char *path);
+int fs_file_read(fs_file_t *file, uint8_t *buf, uint32_t size);
+int fs_file_pread(fs_file_t *file, uint8_t *buf, uint32_t size, uint32_t offset);
+int fs_file_seek(fs_file_t *file, uint32_t offset);
+uint32_t fs_file_size(const fs_file_t *file);
+void fs_close(fs_file_t *file);
+
+// Drop cached path lookups (all mounts when mp is NULL)
+void fs_dcache_invalidate(mount_point_t *mp);
+
 // File operations
 int fs_read(const char *path, uint8_t *buf, uint32_t size, uint32_t offset);
 int fs_write(const char *path, const uint8_t *buf, uint32_t size, uint32_t offset);
 int fs_list_dir(const char *path, char *buffer, uint32_t size);
 int fs_get_info(const char *path, uint32_t *size, bool *is_dir);
 
+// Path components, as views into the caller's string: nothing is copied
+// or allocated. Separators are '/' or '\'; empty and "." components are
+// skipped and ".." is returned as is. `hash` is FNV-1a over the name with
+// ASCII letters folded to lower case, so case-insensitive drivers can key
+// their lookup tables on it directly (fs_path_hash gives the same value).
+typedef struct {
+    const char *name;           // Not NUL-terminated
+    uint32_t len;
+    uint32_t hash;
+    bool last;                  // No components follow
+} fs_path_component_t;
+
+typedef struct {
+    const char *next;
+} fs_path_iter_t;
+
+void fs_path_iter_init(fs_path_iter_t *iter, const char *path);
+bool fs_path_next(fs_path_iter_t *iter, fs_path_component_t *comp);
+uint32_t fs_path_hash(const char *name, size_t len);
+
 // Helper functions
 const char *fs_basename(const char *path);
 char *fs_dirname(const char *path, char *buf, size_t size);
 char *fs_join_path(const char *dir, const char *file, char *buf, size_t size);
 
+// Block I/O shared by the filesystem drivers: read `count` consecutive
+// sectors of `sector_size` bytes starting at `lba` into `buf` (0 on success)
+int fs_read_sectors(uint32_t lba, uint32_t count, uint32_t sector_size, uint8_t *buf);
+
 // Initialize filesystem layer
 void fs_init(void);
 
@@ -69,5 +162,6 @@ void fs_init(void);
 extern const filesystem_t fat32_fs;
 extern const filesystem_t ext2_fs;
 extern const filesystem_t iso9660_fs;
+extern const filesystem_t squashfs_fs;
 
 #endif // BLOODHORN_FS_MOUNT_H
\ No newline at end of file
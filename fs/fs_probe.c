@@ -0,0 +1,181 @@
+/*
+ * fs_probe.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include "fs_probe.h"
+#include "compat.h"
+#include "fs_mount.h"
+#include <string.h>
+#include <stdlib.h>
+
+static const uint8_t zero_guid[16] = {0};
+
+void fs_probe_cache_init(fs_probe_cache_t *cache) {
+    memset(cache, 0, sizeof(*cache));
+    cache->version = FS_PROBE_CACHE_VERSION;
+}
+
+bool fs_probe_cache_valid(const fs_probe_cache_t *cache) {
+    if (cache->version != FS_PROBE_CACHE_VERSION || cache->count > FS_PROBE_MAX_TARGETS) {
+        return false;
+    }
+    for (uint32_t i = 0; i < cache->count; i++) {
+        if (memchr(cache->records[i].fstype, '\0', FS_PROBE_TYPE_LEN) == NULL) {
+            return false; // Unterminated name
+        }
+    }
+    return true;
+}
+
+static bool probe_cacheable(const fs_probe_target_t *t) {
+    return memcmp(t->disk_guid, zero_guid, sizeof(zero_guid)) != 0;
+}
+
+static fs_probe_record_t *probe_find_record(fs_probe_cache_t *cache, const fs_probe_target_t *t) {
+    if (!cache || !probe_cacheable(t)) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < cache->count; i++) {
+        fs_probe_record_t *r = &cache->records[i];
+        if (r->start == t->start && r->sectors == t->sectors &&
+            memcmp(r->disk_guid, t->disk_guid, sizeof(r->disk_guid)) == 0) {
+            return r;
+        }
+    }
+    return NULL;
+}
+
+// Pull the detect window into the block cache with one read, then let the
+// drivers look at it
+static void probe_detect(fs_probe_target_t *t, uint8_t *window) {
+    t->fstype[0] = '\0';
+    t->cached = false;
+
+    if (t->start > UINT32_MAX - FS_PROBE_WINDOW_SECTORS) {
+        return; // Beyond what detect() can address
+    }
+
+    uint32_t count = FS_PROBE_WINDOW_SECTORS;
+    if (t->sectors != 0 && t->sectors < count) {
+        count = (uint32_t)t->sectors;
+    }
+
+    block_device_t *previous = blockdev_select(t->dev);
+    if (blockdev_read(t->start, count, window) == 0) {
+        const filesystem_t *fs = fs_detect((uint32_t)t->start);
+        if (fs && strlen(fs->name) < FS_PROBE_TYPE_LEN) {
+            strcpy(t->fstype, fs->name);
+        }
+    }
+    blockdev_select(previous);
+}
+
+// Rewrite the cache so it describes exactly the current targets; volumes
+// that went away drop out
+static void probe_update_cache(fs_probe_cache_t *cache, const fs_probe_target_t *targets, uint32_t count) {
+    uint32_t n = 0;
+
+    for (uint32_t i = 0; i < count && n < FS_PROBE_MAX_TARGETS; i++) {
+        const fs_probe_target_t *t = &targets[i];
+        if (!probe_cacheable(t)) {
+            continue;
+        }
+        fs_probe_record_t *r = &cache->records[n++];
+        memset(r, 0, sizeof(*r));
+        memcpy(r->disk_guid, t->disk_guid, sizeof(r->disk_guid));
+        r->start = t->start;
+        r->sectors = t->sectors;
+        strcpy(r->fstype, t->fstype);
+    }
+    cache->version = FS_PROBE_CACHE_VERSION;
+    cache->count = n;
+}
+
+int fs_probe(fs_probe_target_t *targets, uint32_t count, fs_probe_cache_t *cache) {
+    uint8_t order[FS_PROBE_MAX_TARGETS];
+    uint8_t *window = NULL;
+    int recognised = 0;
+
+    if (count > FS_PROBE_MAX_TARGETS) {
+        count = FS_PROBE_MAX_TARGETS;
+    }
+
+    // Visit each disk's volumes in ascending order so uncached probes
+    // sweep forward instead of seeking back and forth between disks
+    for (uint32_t i = 0; i < count; i++) {
+        targets[i].fstype[0] = '\0';
+        targets[i].cached = false;
+
+        uint32_t j = i;
+        while (j > 0) {
+            const fs_probe_target_t *a = &targets[order[j - 1]];
+            if ((uintptr_t)a->dev < (uintptr_t)targets[i].dev ||
+                (a->dev == targets[i].dev && a->start <= targets[i].start)) {
+                break;
+            }
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = (uint8_t)i;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        fs_probe_target_t *t = &targets[order[i]];
+        const fs_probe_record_t *r = probe_find_record(cache, t);
+
+        if (r) {
+            strcpy(t->fstype, r->fstype);
+            t->cached = true;
+        } else {
+            if (!window) {
+                window = (uint8_t *)malloc(FS_PROBE_WINDOW_SECTORS * BLOCKDEV_SECTOR_SIZE);
+                if (!window) {
+                    return -1; // Out of memory; leave the cache alone
+                }
+            }
+            probe_detect(t, window);
+        }
+
+        if (t->fstype[0] != '\0') {
+            recognised++;
+        }
+    }
+
+    free(window);
+    if (cache) {
+        probe_update_cache(cache, targets, count);
+    }
+    return recognised;
+}
+
+int fs_probe_mount(fs_probe_target_t *target, const char *path, fs_probe_cache_t *cache) {
+    if (target->fstype[0] == '\0' || target->start > UINT32_MAX) {
+        return -1; // Nothing to mount
+    }
+
+    int status = fs_mount_device(path, target->fstype, target->dev, (uint32_t)target->start, NULL);
+    if (status == 0 || !target->cached) {
+        return status;
+    }
+
+    // Stale cache entry (e.g. the partition was reformatted in place)
+    uint8_t *window = (uint8_t *)malloc(FS_PROBE_WINDOW_SECTORS * BLOCKDEV_SECTOR_SIZE);
+    if (!window) {
+        return status;
+    }
+    probe_detect(target, window);
+    free(window);
+
+    fs_probe_record_t *r = probe_find_record(cache, target);
+    if (r) {
+        strcpy(r->fstype, target->fstype);
+    }
+
+    if (target->fstype[0] == '\0') {
+        return status;
+    }
+    return fs_mount_device(path, target->fstype, target->dev, (uint32_t)target->start, NULL);
+}
@@ -0,0 +1,67 @@
+/*
+ * fs_probe.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_FS_PROBE_H
+#define BLOODHORN_FS_PROBE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "compat.h"
+#include "blockdev.h"
+
+// Every built-in detect() looks inside the first 34 KiB of a volume: the
+// FAT boot sector and SquashFS superblock (sector 0), the ext2 superblock
+// (byte 1024) and the ISO9660 volume descriptor (byte 32768). One read of this window puts
+// all of them in the block cache, so the drivers probe without device I/O.
+#define FS_PROBE_WINDOW_SECTORS     72
+
+#define FS_PROBE_MAX_TARGETS        32
+#define FS_PROBE_TYPE_LEN           8
+#define FS_PROBE_CACHE_VERSION      1
+
+// A volume to probe
+typedef struct {
+    block_device_t *dev;            // Disk holding the volume (NULL = boot disk)
+    uint8_t disk_guid[16];          // GPT disk GUID or MBR signature; zero = don't cache
+    uint64_t start;                 // First sector (512-byte sectors from disk start)
+    uint64_t sectors;               // Length (0 = unknown)
+    char fstype[FS_PROBE_TYPE_LEN]; // out: filesystem name, "" if none
+    bool cached;                    // out: fstype came from the probe cache
+} fs_probe_target_t;
+
+// One remembered result. A disk whose GUID and partition geometry are
+// unchanged is assumed to still hold the same filesystem.
+typedef struct {
+    uint8_t disk_guid[16];
+    uint64_t start;
+    uint64_t sectors;
+    char fstype[FS_PROBE_TYPE_LEN]; // "" = nothing recognised
+} fs_probe_record_t;
+
+// Results from earlier boots, persisted by the platform (an NV variable
+// on UEFI) as this exact layout
+typedef struct {
+    uint32_t version;               // FS_PROBE_CACHE_VERSION
+    uint32_t count;
+    fs_probe_record_t records[FS_PROBE_MAX_TARGETS];
+} fs_probe_cache_t;
+
+// Reset `cache` to empty, or validate one loaded from storage
+void fs_probe_cache_init(fs_probe_cache_t *cache);
+bool fs_probe_cache_valid(const fs_probe_cache_t *cache);
+
+// Identify every target. Cached volumes are not read at all; the rest are
+// visited in disk order with one window read each. The cache is updated
+// to describe exactly these targets. Returns the number of volumes with a
+// recognised filesystem, or -1 when out of memory.
+int fs_probe(fs_probe_target_t *targets, uint32_t count, fs_probe_cache_t *cache);
+
+// Mount a probed target. If a cached type fails to mount the volume is
+// probed again and the cache corrected.
+int fs_probe_mount(fs_probe_target_t *target, const char *path, fs_probe_cache_t *cache);
+
+#endif // BLOODHORN_FS_PROBE_H
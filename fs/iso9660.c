@@ -8,29 +8,16 @@
 #include "iso9660.h"
 #include "compat.h"
 #include "mm.h"
+#include "blockdev.h"
+#include "../boot/libb/include/bloodhorn/hash.h"
 #include <stdint.h>
 #include <string.h>
 #include <stdio.h>
 
-// External disk I/O function
-extern int disk_read(void *buf, uint32_t lba, uint32_t count);
-
-// Global filesystem instance
-static const filesystem_t iso9660_fs = {
-    .name = "iso9660",
-    .detect = iso9660_detect,
-    .mount = iso9660_mount,
-    .unmount = iso9660_unmount,
-    .ops = &iso9660_ops
-};
-
-// Filesystem operations
-static const fs_operations_t iso9660_ops = {
-    .read_file = iso9660_read_file,
-    .list_dir = iso9660_list_dir,
-    .get_info = iso9660_get_info,
-    .find_file = iso9660_find_file_fs
-};
+#define ISO9660_NAME_MAX        255
+#define ISO9660_VD_FIRST        16
+#define ISO9660_VD_LAST         48
+#define ISO9660_DIR_MAX         (16u << 20)     // Largest directory read into memory
 
 // Internal helper functions
 static int iso9660_read_blocks(iso9660_private_t *priv, uint32_t block, uint32_t count, void *buf) {
@@ -38,421 +25,792 @@ static int iso9660_read_blocks(iso9660_private_t *priv, uint32_t block, uint32_t
     return disk_read(buf, lba, count * (priv->block_size / 512));
 }
 
-static int iso9660_read_block(iso9660_private_t *priv, uint32_t block_num, void *buf) {
+int iso9660_read_block(iso9660_private_t *priv, uint32_t block_num, void *buf) {
     return iso9660_read_blocks(priv, block_num, 1, buf);
 }
 
-static int iso9660_stricmp(const char* a, const char* b, int n) {
-    for (int i = 0; i < n; ++i) {
-        char ca = a[i], cb = b[i];
-        if (ca >= 'a' && ca <= 'z') ca -= 32;
-        if (cb >= 'a' && cb <= 'z') cb -= 32;
-        if (ca != cb) return 1;
-        if (ca == 0) break;
+static uint32_t iso9660_hash(const char *name, uint32_t len, uint32_t seed) {
+    uint32_t hash = BH_FNV1A_INIT ^ seed;
+    for (uint32_t i = 0; i < len; i++) {
+        hash = bh_fnv1a_step(hash, (uint8_t)name[i]);
     }
-    return 0;
+    return hash ? hash : 1;
+}
+
+// Case-fold a name in place for comparison. Index hashes come from
+// fs_path_hash, which folds the same way, so a path component's hash
+// probes the index unchanged.
+static void iso9660_fold(char *name, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        if (name[i] >= 'A' && name[i] <= 'Z') name[i] += 32;
+    }
+}
+
+// Compare a folded index name against an unfolded path component
+static bool iso9660_name_equal(const char *folded, const char *name, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        char c = name[i];
+        if (c >= 'A' && c <= 'Z') c += 32;
+        if (folded[i] != c) return false;
+    }
+    return true;
+}
+
+// Drop the ";1" version suffix and the trailing dot of extension-less names
+static uint32_t iso9660_strip_version(const char *name, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        if (name[i] == ';') {
+            len = i;
+            break;
+        }
+    }
+    if (len > 1 && name[len - 1] == '.') len--;
+    return len;
+}
+
+// UCS-2 big-endian (Joliet) to UTF-8
+static uint32_t iso9660_ucs2_to_utf8(const uint8_t *in, uint32_t in_len, char *out, uint32_t cap) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i + 1 < in_len; i += 2) {
+        uint16_t c = (uint16_t)((in[i] << 8) | in[i + 1]);
+        if (c < 0x80) {
+            if (n + 1 > cap) break;
+            out[n++] = (char)c;
+        } else if (c < 0x800) {
+            if (n + 2 > cap) break;
+            out[n++] = (char)(0xC0 | (c >> 6));
+            out[n++] = (char)(0x80 | (c & 0x3F));
+        } else {
+            if (n + 3 > cap) break;
+            out[n++] = (char)(0xE0 | (c >> 12));
+            out[n++] = (char)(0x80 | ((c >> 6) & 0x3F));
+            out[n++] = (char)(0x80 | (c & 0x3F));
+        }
+    }
+    return n;
+}
+
+static bool iso9660_is_dot(const struct iso_directory_record *record) {
+    return record->name_len == 1 && (record->name[0] == 0 || record->name[0] == 1);
+}
+
+// Concatenate the Rock Ridge NM entries of a record. Returns 0 when the
+// record has none (continuation areas are not followed).
+static uint32_t iso9660_rr_name(iso9660_private_t *priv, const struct iso_directory_record *record, char *out, uint32_t cap) {
+    const uint8_t *base = (const uint8_t *)record;
+    uint32_t pos = 33 + record->name_len + ((record->name_len & 1) ? 0 : 1) + priv->susp_skip;
+    uint32_t n = 0;
+    bool found = false;
+
+    while (pos + 4 <= record->length) {
+        const uint8_t *su = base + pos;
+        uint8_t len = su[2];
+        if (len < 4 || pos + len > record->length) break;
+
+        if (su[0] == 'N' && su[1] == 'M' && len >= 5) {
+            uint8_t flags = su[4];
+            if (!(flags & 0x06)) { // Not "." or ".."
+                uint32_t part = len - 5;
+                if (n + part > cap) part = cap - n;
+                memcpy(out + n, su + 5, part);
+                n += part;
+                found = true;
+            }
+            if (!(flags & 0x01)) break; // No continuation
+        } else if (su[0] == 'S' && su[1] == 'T') {
+            break;
+        }
+        pos += len;
+    }
+
+    return found ? n : 0;
+}
+
+// Display name of a directory record (Rock Ridge, Joliet or plain ISO)
+static uint32_t iso9660_record_name(iso9660_private_t *priv, const struct iso_directory_record *record, char *out, uint32_t cap) {
+    uint32_t n;
+
+    if (priv->rock_ridge && (n = iso9660_rr_name(priv, record, out, cap)) > 0) {
+        return n;
+    }
+
+    if (priv->joliet) {
+        n = iso9660_ucs2_to_utf8((const uint8_t *)record->name, record->name_len, out, cap);
+    } else {
+        n = record->name_len < cap ? record->name_len : cap;
+        memcpy(out, record->name, n);
+    }
+    return iso9660_strip_version(out, n);
 }
 
 static int iso9660_read_volume_descriptor(iso9660_private_t *priv) {
-    // Read volume descriptor sequence starting at sector 16
-    uint8_t buffer[2048];
-    
-    // Try up to 32 volume descriptors (should be enough)
-    for (int i = 16; i < 48; i++) {
-        if (disk_read(buffer, priv->lba + i, 1) != 0) {
+    // Volume descriptors are 2048-byte sectors starting at byte 32768
+    uint8_t buffer[ISO9660_SECTOR_SIZE];
+    bool have_primary = false;
+    bool have_joliet = false;
+    struct iso_volume_descriptor joliet;
+
+    for (int i = ISO9660_VD_FIRST; i < ISO9660_VD_LAST; i++) {
+        if (disk_read(buffer, priv->lba + i * (ISO9660_SECTOR_SIZE / 512), ISO9660_SECTOR_SIZE / 512) != 0) {
             return -1; // Read error
         }
-        
-        // Check for primary volume descriptor (type 1)
-        if (buffer[0] == 0x01) {
-            // Found primary volume descriptor
-            memcpy(&priv->pvd, buffer, sizeof(struct iso_volume_descriptor));
-            priv->block_size = priv->pvd.logical_block_size;
-            return 0;
+        if (memcmp(buffer + 1, "CD001", 5) != 0) {
+            break;
         }
-        // Check for volume descriptor set terminator (type 255)
-        else if (buffer[0] == 0xFF) {
+
+        if (buffer[0] == ISO9660_VD_PRIMARY && !have_primary) {
+            memcpy(&priv->pvd, buffer, sizeof(struct iso_volume_descriptor));
+            have_primary = true;
+        } else if (buffer[0] == ISO9660_VD_SUPPLEMENTARY && !have_joliet) {
+            // Joliet is a supplementary descriptor with a UCS-2 escape sequence
+            const struct iso_volume_descriptor *svd = (const struct iso_volume_descriptor *)buffer;
+            if (svd->escape_sequences[0] == '%' && svd->escape_sequences[1] == '/' &&
+                (svd->escape_sequences[2] == '@' || svd->escape_sequences[2] == 'C' || svd->escape_sequences[2] == 'E')) {
+                memcpy(&joliet, buffer, sizeof(joliet));
+                have_joliet = true;
+            }
+        } else if (buffer[0] == ISO9660_VD_TERMINATOR) {
             break; // End of volume descriptors
         }
     }
-    
-    return -1; // Primary volume descriptor not found
+
+    if (!have_primary) {
+        return -1; // Primary volume descriptor not found
+    }
+
+    priv->block_size = priv->pvd.logical_block_size;
+    if (priv->block_size < 512 || (priv->block_size % 512) != 0) {
+        return -1;
+    }
+    memcpy(&priv->root_extent, priv->pvd.root_directory_record + 2, sizeof(uint32_t));
+    memcpy(&priv->root_size, priv->pvd.root_directory_record + 10, sizeof(uint32_t));
+
+    // Rock Ridge is announced by a SUSP "SP" entry in the root's "." record
+    uint8_t *root = (uint8_t *)kmalloc(priv->block_size);
+    if (root && iso9660_read_block(priv, priv->root_extent, root) == 0) {
+        const struct iso_directory_record *dot = (const struct iso_directory_record *)root;
+        const uint8_t *sp = root + 34;
+        if (dot->length >= 34 + 7 && sp[0] == 'S' && sp[1] == 'P' && sp[4] == 0xBE && sp[5] == 0xEF) {
+            priv->rock_ridge = true;
+            priv->susp_skip = sp[6];
+        }
+    }
+    if (root) kfree(root);
+
+    // Rock Ridge names beat Joliet's (case, length); otherwise switch to the
+    // Joliet tree so long names resolve
+    if (!priv->rock_ridge && have_joliet) {
+        memcpy(&priv->pvd, &joliet, sizeof(joliet));
+        memcpy(&priv->root_extent, priv->pvd.root_directory_record + 2, sizeof(uint32_t));
+        memcpy(&priv->root_size, priv->pvd.root_directory_record + 10, sizeof(uint32_t));
+        priv->joliet = true;
+    }
+
+    return 0;
+}
+
+// Mix the parent directory into a name hash
+static uint32_t iso9660_dir_key(uint32_t parent, uint32_t name_hash) {
+    return bh_fnv1a_step(name_hash, parent * 0x9E3779B1u);
+}
+
+// Parse the little-endian path table into the directory index
+static int iso9660_build_dir_index(iso9660_private_t *priv) {
+    const uint8_t *pt = priv->path_table;
+    uint32_t size = priv->path_table_size;
+    uint32_t count = 0;
+    uint32_t pool_size = 0;
+
+    for (uint32_t pos = 0; pos + 8 <= size; ) {
+        uint8_t len = pt[pos];
+        if (len == 0 || pos + 8 + len > size) break;
+        pool_size += len;
+        count++;
+        pos += 8 + len + (len & 1);
+    }
+    if (count == 0) {
+        return -1;
+    }
+
+    uint32_t slots = 1;
+    while (slots < count * 2) slots <<= 1;
+
+    priv->dirs = (iso9660_dir_t *)kmalloc(count * sizeof(iso9660_dir_t));
+    priv->dir_slots = (uint32_t *)kmalloc(slots * sizeof(uint32_t));
+    priv->extent_slots = (uint32_t *)kmalloc(slots * sizeof(uint32_t));
+    // UCS-2 names can grow by half as UTF-8
+    priv->dir_names = (char *)kmalloc(pool_size + pool_size / 2 + 1);
+    if (!priv->dirs || !priv->dir_slots || !priv->extent_slots || !priv->dir_names) {
+        return -1;
+    }
+    memset(priv->dir_slots, 0, slots * sizeof(uint32_t));
+    memset(priv->extent_slots, 0, slots * sizeof(uint32_t));
+    priv->dir_mask = slots - 1;
+
+    uint32_t name_pos = 0;
+    uint32_t index = 0;
+    for (uint32_t pos = 0; index < count; index++) {
+        const struct iso_path_table_entry *entry = (const struct iso_path_table_entry *)(pt + pos);
+        iso9660_dir_t *dir = &priv->dirs[index];
+        char *name = priv->dir_names + name_pos;
+        uint32_t len;
+
+        if (priv->joliet) {
+            len = iso9660_ucs2_to_utf8((const uint8_t *)entry->name, entry->name_len, name, ISO9660_NAME_MAX);
+        } else {
+            len = entry->name_len;
+            memcpy(name, entry->name, len);
+        }
+        iso9660_fold(name, len);
+
+        memcpy(&dir->extent, &entry->extent, sizeof(uint32_t));
+        uint16_t parent;
+        memcpy(&parent, &entry->parent_dir_num, sizeof(parent));
+        dir->parent = parent > 0 && parent <= count ? parent - 1u : 0;
+        dir->size = index == 0 ? priv->root_size : 0;
+        dir->name_off = name_pos;
+        dir->name_len = (uint8_t)len;
+        dir->hash = iso9660_dir_key(dir->parent, fs_path_hash(name, len));
+        name_pos += len;
+
+        if (index != 0) {
+            uint32_t slot = dir->hash & priv->dir_mask;
+            while (priv->dir_slots[slot]) slot = (slot + 1) & priv->dir_mask;
+            priv->dir_slots[slot] = index + 1;
+        }
+        uint32_t slot = iso9660_hash((const char *)&dir->extent, sizeof(uint32_t), 0) & priv->dir_mask;
+        while (priv->extent_slots[slot]) slot = (slot + 1) & priv->dir_mask;
+        priv->extent_slots[slot] = index + 1;
+
+        pos += 8 + entry->name_len + (entry->name_len & 1);
+    }
+
+    // The path table is fully indexed; the raw copy is no longer needed
+    priv->dir_count = count;
+    priv->dirs[0].extent = priv->root_extent;
+    kfree(priv->path_table);
+    priv->path_table = NULL;
+    return 0;
+}
+
+static void iso9660_free_dir_index(iso9660_private_t *priv) {
+    if (priv->dirs) kfree(priv->dirs);
+    if (priv->dir_slots) kfree(priv->dir_slots);
+    if (priv->extent_slots) kfree(priv->extent_slots);
+    if (priv->dir_names) kfree(priv->dir_names);
+    priv->dirs = NULL;
+    priv->dir_slots = NULL;
+    priv->extent_slots = NULL;
+    priv->dir_names = NULL;
+    priv->dir_count = 0;
 }
 
 static int iso9660_read_path_table(iso9660_private_t *priv) {
-    // Read the path table (simplified - just read the first one)
+    // Read the little-endian path table of the tree in use
     uint32_t path_table_lba = priv->pvd.path_table_l;
     priv->path_table_size = priv->pvd.path_table_size;
-    
+    if (priv->path_table_size == 0 || priv->path_table_size > ISO9660_DIR_MAX) {
+        return -1;
+    }
+
+    uint32_t blocks = (priv->path_table_size + priv->block_size - 1) / priv->block_size;
+
     // Allocate memory for path table
-    priv->path_table = (uint8_t *)kmalloc(priv->path_table_size);
+    priv->path_table = (uint8_t *)kmalloc(blocks * priv->block_size);
     if (!priv->path_table) {
         return -1; // Out of memory
     }
-    
+
     // Read path table
-    return iso9660_read_blocks(priv, path_table_lba, 
-                              (priv->path_table_size + priv->block_size - 1) / priv->block_size, 
-                              priv->path_table);
+    if (iso9660_read_blocks(priv, path_table_lba, blocks, priv->path_table) != 0) {
+        return -1;
+    }
+
+    return iso9660_build_dir_index(priv);
+}
+
+// Child directory `name` of dirs[parent] via the path table, -1 if not listed
+static int32_t iso9660_find_dir(iso9660_private_t *priv, uint32_t parent, const fs_path_component_t *comp) {
+    if (!priv->dirs) {
+        return -1;
+    }
+
+    uint32_t hash = iso9660_dir_key(parent, comp->hash);
+    for (uint32_t slot = hash & priv->dir_mask; priv->dir_slots[slot]; slot = (slot + 1) & priv->dir_mask) {
+        const iso9660_dir_t *dir = &priv->dirs[priv->dir_slots[slot] - 1];
+        if (dir->hash == hash && dir->parent == parent && dir->name_len == comp->len &&
+            iso9660_name_equal(priv->dir_names + dir->name_off, comp->name, comp->len)) {
+            return (int32_t)(priv->dir_slots[slot] - 1);
+        }
+    }
+    return -1;
+}
+
+static int32_t iso9660_find_dir_by_extent(iso9660_private_t *priv, uint32_t extent) {
+    if (!priv->dirs) {
+        return -1;
+    }
+
+    uint32_t slot = iso9660_hash((const char *)&extent, sizeof(uint32_t), 0) & priv->dir_mask;
+    for (; priv->extent_slots[slot]; slot = (slot + 1) & priv->dir_mask) {
+        if (priv->dirs[priv->extent_slots[slot] - 1].extent == extent) {
+            return (int32_t)(priv->extent_slots[slot] - 1);
+        }
+    }
+    return -1;
+}
+
+static void iso9660_free_name_table(iso9660_name_table_t *table) {
+    if (table->names) kfree(table->names);
+    if (table->slots) kfree(table->slots);
+    if (table->pool) kfree(table->pool);
+    memset(table, 0, sizeof(*table));
+}
+
+// Next live record of a directory image held in memory, skipping ".",
+// "..", associated files and the zero padding at the end of each block
+static const struct iso_directory_record *iso9660_next_record(iso9660_private_t *priv, const uint8_t *data, uint32_t size, uint32_t *off) {
+    while (*off < size) {
+        const struct iso_directory_record *record = (const struct iso_directory_record *)(data + *off);
+        uint32_t in_block = *off % priv->block_size;
+
+        // Records never cross a block; zero length means "next block"
+        if (record->length == 0 || in_block + record->length > priv->block_size ||
+            record->length < 33 + record->name_len) {
+            *off = (*off / priv->block_size + 1) * priv->block_size;
+            continue;
+        }
+
+        *off += record->length;
+        if (!iso9660_is_dot(record) && !(record->file_flags & ISO9660_FLAG_ASSOCIATED)) {
+            return record;
+        }
+    }
+    return NULL;
+}
+
+// Whole directory image for the directory at `extent`, `size` bytes
+// rounded up to blocks. The rounded length comes back in *len, and is
+// what the records are walked over.
+static uint8_t *iso9660_read_dir(iso9660_private_t *priv, uint32_t extent, uint32_t size, uint32_t *len) {
+    if (size == 0 || size > ISO9660_DIR_MAX) {
+        return NULL;
+    }
+    uint64_t blocks = ((uint64_t)size + priv->block_size - 1) / priv->block_size;
+    uint8_t *data = (uint8_t *)kmalloc((size_t)(blocks * priv->block_size));
+    if (!data) {
+        return NULL;
+    }
+    if (iso9660_read_blocks(priv, extent, (uint32_t)blocks, data) != 0) {
+        kfree(data);
+        return NULL;
+    }
+    *len = (uint32_t)(blocks * priv->block_size);
+    return data;
+}
+
+// Hashed name table for the directory at `extent`, read in one pass and
+// cached. Directories found through the path table have no size yet; it
+// comes from their "." record.
+static iso9660_name_table_t *iso9660_get_name_table(iso9660_private_t *priv, uint32_t extent, uint32_t size) {
+    iso9660_name_table_t *victim = &priv->name_cache[0];
+    for (uint32_t i = 0; i < ISO9660_NAME_CACHE; i++) {
+        iso9660_name_table_t *table = &priv->name_cache[i];
+        if (table->names && table->extent == extent) {
+            table->last_used = ++priv->name_clock;
+            return table;
+        }
+        if (table->last_used < victim->last_used) {
+            victim = table;
+        }
+    }
+
+    uint8_t *data = NULL;
+    if (size == 0) {
+        uint8_t *first = (uint8_t *)kmalloc(priv->block_size);
+        if (!first) return NULL;
+        if (iso9660_read_block(priv, extent, first) != 0) {
+            kfree(first);
+            return NULL;
+        }
+        memcpy(&size, first + 10, sizeof(uint32_t)); // "." data_length
+        kfree(first);
+        if (size == 0) return NULL;
+    }
+
+    data = iso9660_read_dir(priv, extent, size, &size);
+    if (!data) return NULL;
+
+    // Count and size first so every array is allocated exactly once
+    char name[ISO9660_NAME_MAX];
+    uint32_t count = 0;
+    uint32_t pool_size = 0;
+    const struct iso_directory_record *record;
+    uint32_t off = 0;
+    while ((record = iso9660_next_record(priv, data, size, &off)) != NULL) {
+        pool_size += iso9660_record_name(priv, record, name, sizeof(name));
+        count++;
+    }
+
+    iso9660_free_name_table(victim);
+    uint32_t slots = 1;
+    while (slots < count * 2 + 2) slots <<= 1;
+    victim->names = (iso9660_name_t *)kmalloc((count ? count : 1) * sizeof(iso9660_name_t));
+    victim->slots = (uint32_t *)kmalloc(slots * sizeof(uint32_t));
+    victim->pool = (char *)kmalloc(pool_size + 1);
+    if (!victim->names || !victim->slots || !victim->pool) {
+        iso9660_free_name_table(victim);
+        kfree(data);
+        return NULL;
+    }
+    memset(victim->slots, 0, slots * sizeof(uint32_t));
+    victim->mask = slots - 1;
+
+    uint32_t pos = 0;
+    off = 0;
+    while ((record = iso9660_next_record(priv, data, size, &off)) != NULL) {
+        iso9660_name_t *entry = &victim->names[victim->count];
+        char *dst = victim->pool + pos;
+        uint32_t len = iso9660_record_name(priv, record, dst, pool_size - pos);
+        iso9660_fold(dst, len);
+
+        entry->hash = fs_path_hash(dst, len);
+        entry->extent = record->extent_l;
+        entry->size = record->data_length_l;
+        entry->flags = record->file_flags;
+        entry->name_off = pos;
+        entry->name_len = (uint8_t)len;
+        pos += len;
+
+        // Keep the first record of a name (later parts of multi-extent files)
+        uint32_t slot = entry->hash & victim->mask;
+        bool duplicate = false;
+        while (victim->slots[slot]) {
+            const iso9660_name_t *other = &victim->names[victim->slots[slot] - 1];
+            if (other->hash == entry->hash && other->name_len == len &&
+                memcmp(victim->pool + other->name_off, dst, len) == 0) {
+                duplicate = true;
+                break;
+            }
+            slot = (slot + 1) & victim->mask;
+        }
+        if (!duplicate) {
+            victim->slots[slot] = ++victim->count;
+        }
+    }
+
+    kfree(data);
+    victim->extent = extent;
+    victim->last_used = ++priv->name_clock;
+    return victim;
+}
+
+static const iso9660_name_t *iso9660_find_name(const iso9660_name_table_t *table, const fs_path_component_t *comp) {
+    for (uint32_t slot = comp->hash & table->mask; table->slots[slot]; slot = (slot + 1) & table->mask) {
+        const iso9660_name_t *entry = &table->names[table->slots[slot] - 1];
+        if (entry->hash == comp->hash && entry->name_len == comp->len &&
+            iso9660_name_equal(table->pool + entry->name_off, comp->name, comp->len)) {
+            return entry;
+        }
+    }
+    return NULL;
 }
 
 // Public interface implementation
-int iso9660_detect(uint32_t lba) {
-    uint8_t buffer[2048];
-    
-    // Try to read the first sector of the volume descriptor
-    if (disk_read(buffer, lba + 16, 1) != 0) {
-        return 0; // Read error
-    }
-    
+static bool iso9660_detect(uint32_t lba) {
+    uint8_t buffer[ISO9660_SECTOR_SIZE];
+
+    // Try to read the first volume descriptor (byte 32768)
+    if (disk_read(buffer, lba + ISO9660_VD_FIRST * (ISO9660_SECTOR_SIZE / 512), ISO9660_SECTOR_SIZE / 512) != 0) {
+        return false; // Read error
+    }
+
     // Check for ISO9660 signature ("CD001" at offset 1)
-    if (buffer[0] == 0x01 && 
-        buffer[1] == 'C' && 
-        buffer[2] == 'D' && 
-        buffer[3] == '0' && 
-        buffer[4] == '0' && 
+    if (buffer[1] == 'C' &&
+        buffer[2] == 'D' &&
+        buffer[3] == '0' &&
+        buffer[4] == '0' &&
         buffer[5] == '1') {
-        return 1; // Valid ISO9660 filesystem
+        return true; // Valid ISO9660 filesystem
     }
-    
-    return 0; // Not an ISO9660 filesystem
+
+    return false; // Not an ISO9660 filesystem
 }
 
-void *iso9660_mount(uint32_t lba) {
+static void *iso9660_mount(uint32_t lba, void *opts) {
+    (void)opts;
+
     // Allocate and initialize private data
     iso9660_private_t *priv = (iso9660_private_t *)kmalloc(sizeof(iso9660_private_t));
     if (!priv) {
         return NULL; // Out of memory
     }
-    
+
     // Initialize private data
     memset(priv, 0, sizeof(iso9660_private_t));
-    priv->lba = lba + 16; // Skip the first 16 sectors (system area)
-    
+    priv->lba = lba;
+
     // Read volume descriptor
     if (iso9660_read_volume_descriptor(priv) != 0) {
         kfree(priv);
         return NULL; // Failed to read volume descriptor
     }
-    
-    // Read path table (optional, but useful for faster lookups)
+
+    // Index the path table (optional, but it turns every directory
+    // component of a lookup into a hash probe)
     if (iso9660_read_path_table(priv) != 0) {
-        // Not fatal, we can still work without the path table
+        // Not fatal, lookups fall back to directory name tables
         if (priv->path_table) {
             kfree(priv->path_table);
             priv->path_table = NULL;
         }
+        iso9660_free_dir_index(priv);
     }
-    
+
     return priv;
 }
 
-void iso9660_unmount(void *private_data) {
+static void iso9660_unmount(void *private_data) {
     if (!private_data) return;
-    
+
     iso9660_private_t *priv = (iso9660_private_t *)private_data;
-    
-    // Free path table if allocated
+
+    // Free path table and indexes if allocated
     if (priv->path_table) {
         kfree(priv->path_table);
     }
-    
+    iso9660_free_dir_index(priv);
+    for (uint32_t i = 0; i < ISO9660_NAME_CACHE; i++) {
+        iso9660_free_name_table(&priv->name_cache[i]);
+    }
+
     // Free private data
     kfree(priv);
 }
 
-int iso9660_find_entry(iso9660_private_t *priv, uint32_t extent, uint32_t size, const char* path, uint32_t* out_extent, uint32_t* out_size) {
-    char part[256];
-    const char* slash = strchr(path, '/');
-    int partlen = slash ? (slash - path) : strlen(path);
-    memcpy(part, path, partlen); 
-    part[partlen] = 0;
-    
-    uint8_t *dir = (uint8_t *)kmalloc(priv->block_size);
-    if (!dir) {
-        return -1; // Out of memory
-    }
-    
-    // Read directory entries
-    for (uint32_t off = 0; off < size; off += priv->block_size) {
-        uint32_t block = extent + (off / priv->block_size);
-        if (iso9660_read_block(priv, block, dir) != 0) {
-            kfree(dir);
-            return -1; // Read error
-        }
-        
-        uint32_t block_off = 0;
-        while (block_off < priv->block_size) {
-            struct iso_directory_record *record = (struct iso_directory_record *)(dir + block_off);
-            
-            // Check for end of directory
-            if (record->length == 0) {
-                block_off += (priv->block_size - block_off);
-                continue;
-            }
-            
-            // Skip current and parent directory entries
-            if (record->name_len == 1 && (record->name[0] == 0 || record->name[0] == 1)) {
-                block_off += record->length;
+// Resolve a path. Directory components are looked up in the path-table
+// index without touching the disk; only the last directory's name table
+// (and, on Rock Ridge volumes, any component whose Rock Ridge name differs
+// from its ISO name) needs directory reads, and those are cached.
+int iso9660_lookup(iso9660_private_t *priv, const char *path, iso9660_node_t *node) {
+    uint32_t extent = priv->root_extent;
+    uint32_t size = priv->root_size;
+    int32_t dir = priv->dirs ? 0 : -1;
+    fs_path_iter_t iter;
+    fs_path_component_t comp;
+
+    node->extent = extent;
+    node->size = size;
+    node->flags = ISO9660_FLAG_DIRECTORY;
+
+    fs_path_iter_init(&iter, path);
+    while (fs_path_next(&iter, &comp)) {
+        // Intermediate directory straight from the path table
+        if (!comp.last && dir >= 0) {
+            int32_t child = iso9660_find_dir(priv, (uint32_t)dir, &comp);
+            if (child >= 0) {
+                dir = child;
+                extent = priv->dirs[child].extent;
+                size = priv->dirs[child].size;
                 continue;
             }
-            
-            // Compare filename
-            if (record->name_len == partlen && 
-                iso9660_stricmp(record->name, part, partlen) == 0) {
-                
-                uint32_t e = record->extent_l;
-                uint32_t s = record->data_length_l;
-                uint8_t flags = record->file_flags;
-                
-                if (slash) {
-                    // Recurse into subdirectory
-                    if (flags & 0x02) { // Directory flag
-                        int result = iso9660_find_entry(priv, e, s, slash + 1, out_extent, out_size);
-                        kfree(dir);
-                        return result;
-                    }
-                } else {
-                    // Found the file
-                    *out_extent = e;
-                    *out_size = s;
-                    kfree(dir);
-                    return 0;
-                }
-            }
-            
-            block_off += record->length;
-            if (record->length == 0) break; // Prevent infinite loop
+        }
+
+        iso9660_name_table_t *table = iso9660_get_name_table(priv, extent, size);
+        if (!table) {
+            return -1; // Read error
+        }
+        const iso9660_name_t *entry = iso9660_find_name(table, &comp);
+        if (!entry) {
+            return -1; // Not found
+        }
+        if (!comp.last && !(entry->flags & ISO9660_FLAG_DIRECTORY)) {
+            return -1; // Not a directory
+        }
+
+        extent = entry->extent;
+        size = entry->size;
+        node->flags = entry->flags;
+        dir = iso9660_find_dir_by_extent(priv, extent);
+        if (dir >= 0 && priv->dirs[dir].size == 0) {
+            priv->dirs[dir].size = size;
         }
     }
-    
-    kfree(dir);
-    return -1; // Not found
+
+    node->extent = extent;
+    node->size = size;
+    return 0;
 }
 
-// Filesystem operation implementations
-static int iso9660_read_file(void *private_data, const char *path, void *buf, 
-                            uint32_t size, uint32_t offset) {
-    if (!private_data || !path || !buf) {
+int iso9660_find_file(iso9660_private_t *priv, const char *path, uint32_t *extent, uint32_t *size) {
+    iso9660_node_t node;
+    if (iso9660_lookup(priv, path, &node) != 0) {
         return -1;
     }
-    
-    iso9660_private_t *priv = (iso9660_private_t *)private_data;
-    uint32_t extent, file_size;
-    
-    // Find the file
-    if (iso9660_find_entry(priv, priv->pvd.root_directory_record[2], 
-                          *(uint32_t*)(priv->pvd.root_directory_record + 10),
-                          path, &extent, &file_size) != 0) {
-        return -1; // File not found
+    *extent = node.extent;
+    *size = node.size;
+    return 0;
+}
+
+// VFS operations: nodes carry the extent, which is all a read needs
+static int iso9660_lookup_node(mount_point_t *mp, const char *path, fs_node_t *node) {
+    iso9660_node_t found;
+
+    if (iso9660_lookup((iso9660_private_t *)mp->private_data, path, &found) != 0) {
+        return -1; // Not found
     }
-    
+
+    node->id = found.extent;
+    node->size = found.size;
+    node->is_dir = (found.flags & ISO9660_FLAG_DIRECTORY) != 0;
+    return 0;
+}
+
+static int iso9660_read_node(mount_point_t *mp, const fs_node_t *node, uint8_t *buf,
+                             uint32_t size, uint32_t offset) {
+    iso9660_private_t *priv = (iso9660_private_t *)mp->private_data;
+
     // Adjust read size if needed
-    if (offset >= file_size) {
+    if (offset >= node->size) {
         return 0; // Read nothing, offset beyond file size
     }
-    
-    if (offset + size > file_size) {
-        size = file_size - offset; // Adjust size to not read beyond file
-    }
-    
-    // Calculate blocks to read
-    uint32_t start_block = extent + (offset / priv->block_size);
-    uint32_t end_block = extent + ((offset + size - 1) / priv->block_size);
-    uint32_t blocks_to_read = end_block - start_block + 1;
-    
-    // Allocate buffer for reading
-    uint8_t *block_buf = (uint8_t *)kmalloc(blocks_to_read * priv->block_size);
-    if (!block_buf) {
-        return -1; // Out of memory
+
+    if (size > node->size - offset) {
+        size = node->size - offset; // Adjust size to not read beyond file
+    }
+
+    // Extents are contiguous: whole blocks go straight into the caller's
+    // buffer, only a partial first/last block is bounced
+    uint32_t bs = priv->block_size;
+    uint32_t block = (uint32_t)node->id + offset / bs;
+    uint32_t in_block = offset % bs;
+    uint8_t *dst = buf;
+    uint32_t left = size;
+    uint8_t *bounce = NULL;
+
+    if (in_block != 0 || left < bs) {
+        uint32_t part = bs - in_block < left ? bs - in_block : left;
+        if (!(bounce = (uint8_t *)kmalloc(bs)) || iso9660_read_block(priv, block, bounce) != 0) goto fail;
+        memcpy(dst, bounce + in_block, part);
+        dst += part;
+        left -= part;
+        block++;
+    }
+
+    if (left >= bs) {
+        uint32_t whole = left / bs;
+        if (iso9660_read_blocks(priv, block, whole, dst) != 0) goto fail;
+        dst += whole * bs;
+        left -= whole * bs;
+        block += whole;
+    }
+
+    if (left > 0) {
+        if (!bounce && !(bounce = (uint8_t *)kmalloc(bs))) goto fail;
+        if (iso9660_read_block(priv, block, bounce) != 0) goto fail;
+        memcpy(dst, bounce, left);
     }
-    
-    // Read the blocks
-    if (iso9660_read_blocks(priv, start_block, blocks_to_read, block_buf) != 0) {
-        kfree(block_buf);
-        return -1; // Read error
-    }
-    
-    // Copy the requested data to the output buffer
-    uint32_t block_offset = offset % priv->block_size;
-    memcpy(buf, block_buf + block_offset, size);
-    
-    kfree(block_buf);
+
+    if (bounce) kfree(bounce);
     return size;
+
+fail:
+    if (bounce) kfree(bounce);
+    return -1; // Read error
 }
 
-static int iso9660_list_dir(void *private_data, const char *path, 
-                           fs_dirent_t *entries, uint32_t max_entries) {
-    if (!private_data || !path) {
-        return -1;
-    }
-    
-    iso9660_private_t *priv = (iso9660_private_t *)private_data;
-    uint32_t extent, size;
-    
-    // Find the directory
-    if (iso9660_find_entry(priv, priv->pvd.root_directory_record[2], 
-                          *(uint32_t*)(priv->pvd.root_directory_record + 10),
-                          path, &extent, &size) != 0) {
-        return -1; // Directory not found
+static int iso9660_list_node(mount_point_t *mp, const fs_node_t *node, char *buffer, uint32_t size) {
+    iso9660_private_t *priv = (iso9660_private_t *)mp->private_data;
+
+    if (!node->is_dir) {
+        return -1; // Not a directory
     }
-    
-    uint8_t *dir = (uint8_t *)kmalloc(priv->block_size);
+
+    uint32_t dir_size;
+    uint8_t *dir = iso9660_read_dir(priv, (uint32_t)node->id, node->size, &dir_size);
     if (!dir) {
-        return -1; // Out of memory
+        return -1; // Too large, out of memory or read error
     }
-    
-    uint32_t count = 0;
-    
-    // Read directory entries
-    for (uint32_t off = 0; off < size && count < max_entries; off += priv->block_size) {
-        uint32_t block = extent + (off / priv->block_size);
-        if (iso9660_read_block(priv, block, dir) != 0) {
-            kfree(dir);
-            return -1; // Read error
-        }
-        
-        uint32_t block_off = 0;
-        while (block_off < priv->block_size && count < max_entries) {
-            struct iso_directory_record *record = (struct iso_directory_record *)(dir + block_off);
-            
-            // Check for end of directory
-            if (record->length == 0) {
-                block_off += (priv->block_size - block_off);
-                continue;
-            }
-            
-            // Skip current and parent directory entries
-            if (record->name_len == 1 && (record->name[0] == 0 || record->name[0] == 1)) {
-                block_off += record->length;
-                continue;
-            }
-            
-            // Add entry to the list
-            if (entries && count < max_entries) {
-                entries[count].inode = record->extent_l; // Use extent as inode number
-                
-                // Copy name (ensure null termination)
-                int name_len = record->name_len;
-                if (name_len >= FS_MAX_FILENAME) {
-                    name_len = FS_MAX_FILENAME - 1;
-                }
-                memcpy(entries[count].name, record->name, name_len);
-                entries[count].name[name_len] = '\0';
-                entries[count].name_len = name_len;
-                
-                // Set file type
-                if (record->file_flags & 0x02) {
-                    entries[count].file_type = FS_FILE_DIRECTORY;
-                } else {
-                    entries[count].file_type = FS_FILE_REGULAR;
-                }
-                
-                count++;
-            }
-            
-            block_off += record->length;
-            if (record->length == 0) break; // Prevent infinite loop
+
+    // One name per line, as far as the buffer goes
+    char name[ISO9660_NAME_MAX];
+    uint32_t used = 0;
+    uint32_t off = 0;
+    const struct iso_directory_record *record;
+    while ((record = iso9660_next_record(priv, dir, dir_size, &off)) != NULL) {
+        uint32_t name_len = iso9660_record_name(priv, record, name, sizeof(name));
+        if (used + name_len + 1 > size) {
+            break; // Out of buffer space
         }
+        memcpy(buffer + used, name, name_len);
+        used += name_len;
+        buffer[used++] = '\n';
     }
-    
+
     kfree(dir);
-    return count;
+    return (int)used;
 }
 
-static int iso9660_get_info(void *private_data, const char *path, fs_file_info_t *info) {
-    if (!private_data || !path || !info) {
+// A file is a single extent, so it maps to a single device run
+static int iso9660_map_node(mount_point_t *mp, const fs_node_t *node, blockdev_extent_t *extents, uint32_t max_extents) {
+    iso9660_private_t *priv = (iso9660_private_t *)mp->private_data;
+
+    if (node->is_dir || node->size == 0) {
         return -1;
     }
-    
-    iso9660_private_t *priv = (iso9660_private_t *)private_data;
-    uint32_t extent, size;
-    
-    // Find the file/directory
-    if (iso9660_find_entry(priv, priv->pvd.root_directory_record[2], 
-                          *(uint32_t*)(priv->pvd.root_directory_record + 10),
-                          path, &extent, &size) != 0) {
-        return -1; // Not found
-    }
-    
-    // Read the directory record for the file
-    uint8_t *dir = (uint8_t *)kmalloc(priv->block_size);
-    if (!dir) {
-        return -1; // Out of memory
+
+    if (extents && max_extents > 0) {
+        extents[0].offset = 0;
+        extents[0].sector = (uint64_t)priv->lba + (uint64_t)node->id * (priv->block_size / BLOCKDEV_SECTOR_SIZE);
+        extents[0].sectors = (node->size + BLOCKDEV_SECTOR_SIZE - 1) / BLOCKDEV_SECTOR_SIZE;
     }
-    
-    // Read the directory block containing the entry
-    uint32_t dir_block = extent / (priv->block_size / 256); // Approximate block
-    if (iso9660_read_block(priv, dir_block, dir) != 0) {
-        kfree(dir);
-        return -1; // Read error
-    }
-    
-    // Find the directory record (simplified)
-    struct iso_directory_record *record = NULL;
-    for (uint32_t i = 0; i < priv->block_size - sizeof(struct iso_directory_record); i++) {
-        struct iso_directory_record *r = (struct iso_directory_record *)(dir + i);
-        if (r->length == 0) break;
-        if (r->extent_l == extent && r->data_length_l == size) {
-            record = r;
-            break;
-        }
+    return 1;
+}
+
+// Path-based operations resolve a node first
+static int iso9660_read(mount_point_t *mp, const char *path, uint8_t *buf, uint32_t size, uint32_t offset) {
+    fs_node_t node;
+    if (iso9660_lookup_node(mp, path, &node) != 0 || node.is_dir) {
+        return -1; // File not found
     }
-    
-    if (!record) {
-        kfree(dir);
-        return -1; // Record not found
-    }
-    
-    // Fill in the file info
-    memset(info, 0, sizeof(fs_file_info_t));
-    info->size = size;
-    
-    // Set file type
-    if (record->file_flags & 0x02) {
-        info->type = FS_FILE_DIRECTORY;
-    } else {
-        info->type = FS_FILE_REGULAR;
-    }
-    
-    // Set mode (simplified)
-    info->mode = 0444; // Read-only by default
-    if (info->type == FS_FILE_DIRECTORY) {
-        info->mode |= 0111; // Add execute permission for directories
-    }
-    
-    // Set timestamps (simplified)
-    // ISO9660 stores dates in a custom format, this is a simplified conversion
-    // In a real implementation, you would properly parse the ISO9660 date format
-    info->atime = 0; // Not available
-    info->mtime = 0; // Would parse from record->date
-    info->ctime = 0; // Not available
-    
-    kfree(dir);
-    return 0;
+    return iso9660_read_node(mp, &node, buf, size, offset);
 }
 
-static int iso9660_find_file_fs(void *private_data, const char *path, uint32_t *inode_out) {
-    if (!private_data || !path || !inode_out) {
-        return -1;
+static int iso9660_list_dir(mount_point_t *mp, const char *path, char *buffer, uint32_t size) {
+    fs_node_t node;
+    if (iso9660_lookup_node(mp, path, &node) != 0) {
+        return -1; // Directory not found
     }
-    
-    iso9660_private_t *priv = (iso9660_private_t *)private_data;
-    uint32_t extent, size;
-    
-    // Find the file/directory
-    if (iso9660_find_entry(priv, priv->pvd.root_directory_record[2], 
-                          *(uint32_t*)(priv->pvd.root_directory_record + 10),
-                          path, &extent, &size) != 0) {
+    return iso9660_list_node(mp, &node, buffer, size);
+}
+
+static int iso9660_get_info(mount_point_t *mp, const char *path, uint32_t *size, bool *is_dir) {
+    fs_node_t node;
+    if (iso9660_lookup_node(mp, path, &node) != 0) {
         return -1; // Not found
     }
-    
-    // Use the extent as an inode number (simplified)
-    *inode_out = extent;
+    *size = node.size;
+    *is_dir = node.is_dir;
     return 0;
 }
 
-// Module initialization
-void iso9660_init(void) {
-    fs_register(&iso9660_fs);
-}
\ No newline at end of file
+// Filesystem operations
+const fs_operations_t iso9660_ops = {
+    .read = iso9660_read,
+    .write = NULL, // Read-only medium
+    .list_dir = iso9660_list_dir,
+    .get_info = iso9660_get_info,
+    .lookup = iso9660_lookup_node,
+    .read_node = iso9660_read_node,
+    .list_node = iso9660_list_node,
+    .map_node = iso9660_map_node,
+};
+
+// Global filesystem instance
+const filesystem_t iso9660_fs = {
+    .name = "iso9660",
+    .ops = &iso9660_ops,
+    .detect = iso9660_detect,
+    .mount = iso9660_mount,
+    .unmount = iso9660_unmount,
+};
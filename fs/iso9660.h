@@ -9,24 +9,42 @@
 #define BLOODHORN_ISO9660_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "compat.h"
-#include "fs_common.h"
+#include "fs_mount.h"
 
-// ISO9660 Primary Volume Descriptor
+#define ISO9660_SECTOR_SIZE         2048    // Volume descriptors live at 16 * 2048 bytes
+#define ISO9660_VD_PRIMARY          0x01
+#define ISO9660_VD_SUPPLEMENTARY    0x02    // Joliet when escape_sequences is %/@, %/C or %/E
+#define ISO9660_VD_TERMINATOR       0xFF
+
+// Directory record file_flags
+#define ISO9660_FLAG_HIDDEN         0x01
+#define ISO9660_FLAG_DIRECTORY      0x02
+#define ISO9660_FLAG_ASSOCIATED     0x04
+#define ISO9660_FLAG_MULTI_EXTENT   0x80
+
+// ISO9660 Primary/Supplementary Volume Descriptor. Numeric fields are
+// recorded both little- and big-endian (_l/_m).
 struct iso_volume_descriptor {
-    uint8_t type;                   // 0x01 for primary volume descriptor
+    uint8_t type;                   // ISO9660_VD_*
     char standard_id[5];            // "CD001"
     uint8_t version;                // 0x01
-    uint8_t unused1;
+    uint8_t flags;                  // Volume flags (supplementary only)
     char system_id[32];             // System identifier
     char volume_id[32];             // Volume identifier
     uint8_t unused2[8];
     uint32_t volume_space_size;     // Number of logical blocks in volume
-    uint8_t unused3[32];
+    uint32_t volume_space_size_m;
+    uint8_t escape_sequences[32];   // Character set (supplementary only)
     uint16_t volume_set_size;       // Volume set size
+    uint16_t volume_set_size_m;
     uint16_t volume_sequence_number; // Volume sequence number
-    uint16_t logical_block_size;    // Logical block size (usually 2048 or 4096)
+    uint16_t volume_sequence_number_m;
+    uint16_t logical_block_size;    // Logical block size (usually 2048)
+    uint16_t logical_block_size_m;
     uint32_t path_table_size;       // Path table size in bytes
+    uint32_t path_table_size_m;
     uint32_t path_table_l;          // LBA of first occurrence of path table
     uint32_t path_table_opt_l;      // LBA of optional path table
     uint32_t path_table_m;          // LBA of path table (big-endian)
@@ -76,15 +94,74 @@ struct iso_path_table_entry {
     char name[];                    // Directory name (variable length, not null-terminated)
 } __attribute__((packed));
 
+// Number of directories whose hashed name tables stay cached
+#define ISO9660_NAME_CACHE          8
+
+// A directory from the path table. Sizes are not recorded there, so
+// `size` stays 0 until the directory's "." record has been read.
+typedef struct {
+    uint32_t extent;
+    uint32_t size;
+    uint32_t parent;                // Index into dirs (root is its own parent)
+    uint32_t hash;                  // Of (parent, folded name)
+    uint32_t name_off;              // Folded name in dir_names
+    uint8_t name_len;
+} iso9660_dir_t;
+
+// One entry of a directory's name table
+typedef struct {
+    uint32_t hash;
+    uint32_t extent;
+    uint32_t size;
+    uint32_t name_off;              // Folded name in the table's pool
+    uint8_t name_len;
+    uint8_t flags;                  // ISO9660_FLAG_*
+} iso9660_name_t;
+
+// Hashed names of one directory (Rock Ridge, Joliet or plain ISO names)
+typedef struct {
+    uint32_t extent;                // Directory extent, 0 = empty slot
+    uint32_t last_used;
+    uint32_t count;
+    uint32_t mask;                  // slots is mask + 1 entries
+    iso9660_name_t *names;
+    uint32_t *slots;                // Index + 1 into names, 0 = empty
+    char *pool;
+} iso9660_name_table_t;
+
 // ISO9660 private data structure
 typedef struct {
-    uint32_t lba;                   // Starting LBA of the ISO9660 volume
+    uint32_t lba;                   // Starting LBA of the ISO9660 volume (512-byte sectors)
     uint32_t block_size;            // Logical block size (usually 2048)
-    struct iso_volume_descriptor pvd; // Primary Volume Descriptor
+    struct iso_volume_descriptor pvd; // Descriptor of the tree in use (Joliet SVD or PVD)
     uint8_t *path_table;            // Path table buffer
     uint32_t path_table_size;       // Size of path table in bytes
+    
+    bool joliet;                    // Names are UCS-2 (Joliet supplementary tree)
+    bool rock_ridge;                // Names come from Rock Ridge NM entries
+    uint8_t susp_skip;              // SUSP bytes to skip in each system use area
+    uint32_t root_extent;
+    uint32_t root_size;
+    
+    // Directory index built from the path table
+    iso9660_dir_t *dirs;
+    uint32_t dir_count;
+    uint32_t dir_mask;
+    uint32_t *dir_slots;            // (parent, name) -> index + 1
+    uint32_t *extent_slots;         // extent -> index + 1
+    char *dir_names;
+    
+    iso9660_name_table_t name_cache[ISO9660_NAME_CACHE];
+    uint32_t name_clock;
 } iso9660_private_t;
 
+// A resolved file or directory
+typedef struct {
+    uint32_t extent;
+    uint32_t size;
+    uint8_t flags;
+} iso9660_node_t;
+
 // ISO9660 filesystem operations
 extern const fs_operations_t iso9660_ops;
 
@@ -95,5 +172,6 @@ extern const filesystem_t iso9660_fs;
 int iso9660_read_inode(iso9660_private_t *priv, uint32_t inode_num, struct iso_directory_record *record);
 int iso9660_read_block(iso9660_private_t *priv, uint32_t block_num, void *buffer);
 int iso9660_find_file(iso9660_private_t *priv, const char *path, uint32_t *extent, uint32_t *size);
+int iso9660_lookup(iso9660_private_t *priv, const char *path, iso9660_node_t *node);
 
 #endif // BLOODHORN_ISO9660_H
\ No newline at end of file
@@ -0,0 +1,476 @@
+/*
+ * partition.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include "partition.h"
+#include "compat.h"
+#include "../compress/decompress.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+#define GPT_SIGNATURE       "EFI PART"
+#define GPT_HEADER_MIN      92
+#define GPT_ENTRY_MIN       128
+
+// Offsets in the GPT header and entries (all fields little-endian)
+#define GPT_HDR_SIZE        12
+#define GPT_HDR_CRC         16
+#define GPT_HDR_MY_LBA      24
+#define GPT_HDR_ALT_LBA     32
+#define GPT_HDR_DISK_GUID   56
+#define GPT_HDR_ENTRY_LBA   72
+#define GPT_HDR_ENTRIES     80
+#define GPT_HDR_ENTRY_SIZE  84
+#define GPT_HDR_ARRAY_CRC   88
+
+typedef struct {
+    bool used;
+    part_table_t table;
+} part_slot_t;
+
+static part_slot_t tables[PART_MAX_DISKS];
+static uint32_t next_victim = 0;
+
+static uint32_t get32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t get64(const uint8_t *p) {
+    return (uint64_t)get32(p) | (uint64_t)get32(p + 4) << 32;
+}
+
+static void table_free(part_table_t *t) {
+    free(t->entries);
+    memset(t, 0, sizeof(*t));
+}
+
+// A GPT header read from `lba` (in blocks of `block_size`) that is
+// self-consistent; the entry array is checked separately
+static bool gpt_header_valid(uint8_t *hdr, uint32_t block_size, uint64_t lba) {
+    uint32_t size = get32(hdr + GPT_HDR_SIZE);
+    uint32_t entries = get32(hdr + GPT_HDR_ENTRIES);
+    uint32_t entry_size = get32(hdr + GPT_HDR_ENTRY_SIZE);
+
+    if (memcmp(hdr, GPT_SIGNATURE, 8) != 0 || size < GPT_HEADER_MIN || size > block_size ||
+        get64(hdr + GPT_HDR_MY_LBA) != lba || entries == 0 ||
+        entry_size < GPT_ENTRY_MIN || (entry_size & 7) != 0 ||
+        (uint64_t)entries * entry_size > PART_MAX_ARRAY_BYTES) {
+        return false;
+    }
+
+    // The CRC covers the header with its own field zeroed
+    uint8_t stored[4];
+    memcpy(stored, hdr + GPT_HDR_CRC, 4);
+    memset(hdr + GPT_HDR_CRC, 0, 4);
+    uint32_t crc = decomp_crc32(0, hdr, size);
+    memcpy(hdr + GPT_HDR_CRC, stored, 4);
+    return crc == get32(stored);
+}
+
+// UTF-16LE partition name to NUL-terminated UTF-8
+static void gpt_label(const uint8_t *name, char *out) {
+    uint32_t pos = 0;
+    for (uint32_t i = 0; i < 36; i++) {
+        uint16_t c = (uint16_t)(name[2 * i] | name[2 * i + 1] << 8);
+        if (c == 0) {
+            break;
+        }
+        if (c >= 0xD800 && c < 0xE000) {
+            c = '?'; // Outside the BMP; labels are matched byte-wise anyway
+        }
+        if (c < 0x80) {
+            out[pos++] = (char)c;
+        } else if (c < 0x800) {
+            out[pos++] = (char)(0xC0 | c >> 6);
+            out[pos++] = (char)(0x80 | (c & 0x3F));
+        } else {
+            out[pos++] = (char)(0xE0 | c >> 12);
+            out[pos++] = (char)(0x80 | ((c >> 6) & 0x3F));
+            out[pos++] = (char)(0x80 | (c & 0x3F));
+        }
+    }
+    out[pos] = 0;
+}
+
+static int cmp_guid(const part_table_t *t, uint16_t a, uint16_t b) {
+    int c = memcmp(t->entries[a].part_guid, t->entries[b].part_guid, 16);
+    return c ? c : (int)a - (int)b;
+}
+
+static int cmp_type(const part_table_t *t, uint16_t a, uint16_t b) {
+    int c = memcmp(t->entries[a].type_guid, t->entries[b].type_guid, 16);
+    return c ? c : (int)a - (int)b;
+}
+
+static int cmp_label(const part_table_t *t, uint16_t a, uint16_t b) {
+    int c = strcmp(t->entries[a].label, t->entries[b].label);
+    return c ? c : (int)a - (int)b;
+}
+
+// Insertion sort: at most PART_MAX_ENTRIES, once per disk
+static void sort_index(const part_table_t *t, uint16_t *index, int (*cmp)(const part_table_t *, uint16_t, uint16_t)) {
+    for (uint32_t i = 0; i < t->count; i++) {
+        index[i] = (uint16_t)i;
+    }
+    for (uint32_t i = 1; i < t->count; i++) {
+        uint16_t v = index[i];
+        uint32_t j = i;
+        while (j > 0 && cmp(t, index[j - 1], v) > 0) {
+            index[j] = index[j - 1];
+            j--;
+        }
+        index[j] = v;
+    }
+}
+
+// Room for `count` entries and the three indexes in one allocation
+static bool table_alloc(part_table_t *t, uint32_t count) {
+    size_t entries = (size_t)(count ? count : 1) * sizeof(part_entry_t);
+    size_t index = (size_t)(count ? count : 1) * sizeof(uint16_t);
+    uint8_t *mem = (uint8_t *)malloc(entries + 3 * index);
+    if (!mem) {
+        return false;
+    }
+    memset(mem, 0, entries);
+    t->entries = (part_entry_t *)mem;
+    t->by_guid = (uint16_t *)(mem + entries);
+    t->by_type = t->by_guid + (count ? count : 1);
+    t->by_label = t->by_type + (count ? count : 1);
+    return true;
+}
+
+static void table_index(part_table_t *t) {
+    sort_index(t, t->by_guid, cmp_guid);
+    sort_index(t, t->by_type, cmp_type);
+    sort_index(t, t->by_label, cmp_label);
+}
+
+// Header and array at one location; 1 = loaded, 0 = not valid there,
+// -1 = read error or out of memory
+static int gpt_load_at(part_table_t *t, uint32_t block_size, uint64_t lba) {
+    uint32_t scale = block_size / BLOCKDEV_SECTOR_SIZE;
+    uint8_t *hdr = (uint8_t *)malloc(block_size);
+    if (!hdr) {
+        return -1;
+    }
+    if (lba > UINT64_MAX / scale || blockdev_read(lba * scale, scale, hdr) != 0) {
+        free(hdr);
+        return 0;
+    }
+    if (!gpt_header_valid(hdr, block_size, lba)) {
+        free(hdr);
+        return 0;
+    }
+
+    uint32_t entries = get32(hdr + GPT_HDR_ENTRIES);
+    uint32_t entry_size = get32(hdr + GPT_HDR_ENTRY_SIZE);
+    uint32_t bytes = entries * entry_size;
+    uint32_t sectors = (bytes + BLOCKDEV_SECTOR_SIZE - 1) / BLOCKDEV_SECTOR_SIZE;
+    uint64_t array_lba = get64(hdr + GPT_HDR_ENTRY_LBA);
+    uint8_t *array = (uint8_t *)malloc((size_t)sectors * BLOCKDEV_SECTOR_SIZE);
+    int result = 0;
+
+    // The whole array in one request, then checked against its CRC
+    if (!array) {
+        result = -1;
+    } else if (array_lba <= UINT64_MAX / scale && blockdev_read(array_lba * scale, sectors, array) == 0 &&
+               decomp_crc32(0, array, bytes) == get32(hdr + GPT_HDR_ARRAY_CRC)) {
+        static const uint8_t zero[16] = {0};
+        uint32_t used = 0;
+
+        for (uint32_t i = 0; i < entries; i++) {
+            const uint8_t *e = array + (size_t)i * entry_size;
+            if (memcmp(e, zero, 16) != 0 && get64(e + 40) >= get64(e + 32)) {
+                used++;
+            }
+        }
+        if (used > PART_MAX_ENTRIES) {
+            used = PART_MAX_ENTRIES;
+        }
+
+        if (!table_alloc(t, used)) {
+            result = -1;
+        } else {
+            for (uint32_t i = 0; i < entries && t->count < used; i++) {
+                const uint8_t *e = array + (size_t)i * entry_size;
+                uint64_t first = get64(e + 32);
+                uint64_t last = get64(e + 40);
+                if (memcmp(e, zero, 16) == 0 || last < first) {
+                    continue;
+                }
+                part_entry_t *p = &t->entries[t->count++];
+                p->slot = i;
+                memcpy(p->type_guid, e, 16);
+                memcpy(p->part_guid, e + 16, 16);
+                p->start = first * scale;
+                p->sectors = (last - first + 1) * scale;
+                p->attributes = get64(e + 48);
+                gpt_label(e + 56, p->label);
+            }
+            t->scheme = PART_SCHEME_GPT;
+            t->block_size = block_size;
+            memcpy(t->disk_guid, hdr + GPT_HDR_DISK_GUID, 16);
+            table_index(t);
+            result = 1;
+        }
+    }
+
+    free(array);
+    free(hdr);
+    return result;
+}
+
+// Primary header at LBA 1, else the backup in the disk's last block, for
+// each logical block size a disk is likely to have
+static int gpt_load(part_table_t *t) {
+    static const uint32_t block_sizes[] = { 512, 4096 };
+
+    for (uint32_t i = 0; i < sizeof(block_sizes) / sizeof(block_sizes[0]); i++) {
+        uint32_t bs = block_sizes[i];
+        int r = gpt_load_at(t, bs, 1);
+        if (r != 0) {
+            return r;
+        }
+        uint64_t blocks = t->dev->sector_count / (bs / BLOCKDEV_SECTOR_SIZE);
+        if (blocks > 2) {
+            r = gpt_load_at(t, bs, blocks - 1);
+            if (r != 0) {
+                t->backup = (r > 0);
+                return r;
+            }
+        }
+    }
+    return 0;
+}
+
+static int mbr_load(part_table_t *t) {
+    uint8_t mbr[BLOCKDEV_SECTOR_SIZE];
+    uint32_t used = 0;
+
+    if (blockdev_read(0, 1, mbr) != 0) {
+        return -1;
+    }
+    if (mbr[510] != 0x55 || mbr[511] != 0xAA) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < 4; i++) {
+        const uint8_t *e = mbr + 446 + 16 * i;
+        if (e[4] != 0 && get32(e + 12) != 0) {
+            used++;
+        }
+    }
+    if (!table_alloc(t, used)) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < 4; i++) {
+        const uint8_t *e = mbr + 446 + 16 * i;
+        if (e[4] == 0 || get32(e + 12) == 0) {
+            continue;
+        }
+        part_entry_t *p = &t->entries[t->count++];
+        p->slot = i;
+        p->mbr_status = e[0];
+        p->mbr_type = e[4];
+        p->start = get32(e + 8);
+        p->sectors = get32(e + 12);
+    }
+    t->scheme = PART_SCHEME_MBR;
+    memcpy(t->disk_guid, mbr + 440, 4);
+    table_index(t);
+    return 1;
+}
+
+const part_table_t *part_table_get(block_device_t *dev) {
+    block_device_t *previous = blockdev_select(dev);
+    block_device_t *disk = blockdev_current();
+    const part_table_t *found = NULL;
+
+    if (!disk) {
+        blockdev_select(previous);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < PART_MAX_DISKS; i++) {
+        if (tables[i].used && tables[i].table.dev == disk) {
+            found = &tables[i].table;
+            break;
+        }
+    }
+
+    if (!found) {
+        part_slot_t *slot = NULL;
+        for (uint32_t i = 0; i < PART_MAX_DISKS && !slot; i++) {
+            if (!tables[i].used) {
+                slot = &tables[i];
+            }
+        }
+        if (!slot) {
+            slot = &tables[next_victim];
+            next_victim = (next_victim + 1) % PART_MAX_DISKS;
+            table_free(&slot->table);
+            slot->used = false;
+        }
+
+        part_table_t *t = &slot->table;
+        memset(t, 0, sizeof(*t));
+        t->dev = disk;
+        int r = gpt_load(t);
+        if (r == 0) {
+            r = mbr_load(t);
+        }
+        if (r == 0) {
+            // Nothing recognisable: remember that too
+            r = table_alloc(t, 0) ? 1 : -1;
+        }
+        if (r > 0) {
+            slot->used = true;
+            found = t;
+        } else {
+            table_free(t);
+        }
+    }
+
+    blockdev_select(previous);
+    return found;
+}
+
+void part_table_invalidate(block_device_t *dev) {
+    block_device_t *disk = NULL;
+    if (dev) {
+        block_device_t *previous = blockdev_select(dev);
+        disk = blockdev_current();
+        blockdev_select(previous);
+    }
+
+    for (uint32_t i = 0; i < PART_MAX_DISKS; i++) {
+        if (tables[i].used && (!dev || tables[i].table.dev == disk)) {
+            table_free(&tables[i].table);
+            tables[i].used = false;
+        }
+    }
+}
+
+const part_entry_t *part_find_slot(const part_table_t *table, uint32_t slot) {
+    if (!table) {
+        return NULL;
+    }
+    uint32_t lo = 0, hi = table->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (table->entries[mid].slot < slot) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return (lo < table->count && table->entries[lo].slot == slot) ? &table->entries[lo] : NULL;
+}
+
+// First position in a 16-byte-key index whose key is not below `key`
+static uint32_t lower_bound_guid(const part_table_t *t, const uint16_t *index, size_t field, const uint8_t *key) {
+    uint32_t lo = 0, hi = t->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const uint8_t *g = (const uint8_t *)&t->entries[index[mid]] + field;
+        if (memcmp(g, key, 16) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+const part_entry_t *part_find_guid(const part_table_t *table, const uint8_t *guid) {
+    if (!table || !guid) {
+        return NULL;
+    }
+    uint32_t i = lower_bound_guid(table, table->by_guid, offsetof(part_entry_t, part_guid), guid);
+    if (i < table->count && memcmp(table->entries[table->by_guid[i]].part_guid, guid, 16) == 0) {
+        return &table->entries[table->by_guid[i]];
+    }
+    return NULL;
+}
+
+uint32_t part_find_type(const part_table_t *table, const uint8_t *type, const part_entry_t **out, uint32_t max) {
+    if (!table || !type) {
+        return 0;
+    }
+    uint32_t n = 0;
+    for (uint32_t i = lower_bound_guid(table, table->by_type, offsetof(part_entry_t, type_guid), type);
+         i < table->count && memcmp(table->entries[table->by_type[i]].type_guid, type, 16) == 0; i++) {
+        if (out && n < max) {
+            out[n] = &table->entries[table->by_type[i]];
+        }
+        n++;
+    }
+    return n;
+}
+
+const part_entry_t *part_find_label(const part_table_t *table, const char *label) {
+    if (!table || !label) {
+        return NULL;
+    }
+    uint32_t lo = 0, hi = table->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (strcmp(table->entries[table->by_label[mid]].label, label) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < table->count && strcmp(table->entries[table->by_label[lo]].label, label) == 0) {
+        return &table->entries[table->by_label[lo]];
+    }
+    return NULL;
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Byte order of the text form's 16 bytes on disk
+static const uint8_t guid_order[16] = { 3, 2, 1, 0, 5, 4, 7, 6, 8, 9, 10, 11, 12, 13, 14, 15 };
+
+int part_guid_parse(const char *text, uint8_t *guid) {
+    uint8_t bytes[16];
+    uint32_t n = 0;
+
+    for (uint32_t pos = 0; pos < 36; pos++) {
+        if (pos == 8 || pos == 13 || pos == 18 || pos == 23) {
+            if (text[pos] != '-') return -1;
+            continue;
+        }
+        int hi = hex_digit(text[pos]);
+        int lo = hi < 0 ? -1 : hex_digit(text[++pos]);
+        if (lo < 0) return -1;
+        bytes[n++] = (uint8_t)(hi << 4 | lo);
+    }
+    if (text[36] != 0) return -1;
+    for (uint32_t i = 0; i < 16; i++) {
+        guid[guid_order[i]] = bytes[i];
+    }
+    return 0;
+}
+
+void part_guid_format(const uint8_t *guid, char *out) {
+    static const char hex[] = "0123456789ABCDEF";
+    uint32_t pos = 0;
+    for (uint32_t i = 0; i < 16; i++) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) {
+            out[pos++] = '-';
+        }
+        uint8_t b = guid[guid_order[i]];
+        out[pos++] = hex[b >> 4];
+        out[pos++] = hex[b & 15];
+    }
+    out[pos] = 0;
+}
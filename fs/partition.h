@@ -0,0 +1,85 @@
+/*
+ * partition.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_PARTITION_H
+#define BLOODHORN_PARTITION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "compat.h"
+#include "blockdev.h"
+
+// Partition tables, read and validated once per disk and shared by the
+// chainloader, the filesystem probe and the recovery shell. A GPT is taken
+// from the primary header when its header and entry-array CRCs hold, else
+// from the backup; a disk without one falls back to its MBR. Entries are
+// kept in slot order with sorted indexes by unique GUID, type GUID and
+// label, so every lookup is a binary search in memory.
+
+#define PART_MAX_DISKS          8
+#define PART_MAX_ENTRIES        256         // Used slots kept per disk
+#define PART_MAX_ARRAY_BYTES    (1024 * 1024)
+#define PART_LABEL_LEN          112         // UTF-8 of the 36-unit GPT name, NUL-terminated
+
+#define PART_SCHEME_NONE        0
+#define PART_SCHEME_MBR         1
+#define PART_SCHEME_GPT         2
+
+// GUIDs are kept in on-disk byte order (first three fields little-endian)
+typedef struct {
+    uint32_t slot;                  // GPT array index, or MBR table index 0-3
+    uint8_t type_guid[16];          // Zero on MBR disks
+    uint8_t part_guid[16];          // Zero on MBR disks
+    uint64_t start;                 // First 512-byte sector from disk start
+    uint64_t sectors;
+    uint64_t attributes;            // GPT attribute bits
+    uint8_t mbr_type;               // MBR system ID, 0 on GPT disks
+    uint8_t mbr_status;             // 0x80 = active (MBR only)
+    char label[PART_LABEL_LEN];     // "" on MBR disks
+} part_entry_t;
+
+typedef struct {
+    block_device_t *dev;            // Disk the table was read from
+    int scheme;                     // PART_SCHEME_*
+    uint32_t block_size;            // Logical block size the GPT was found at
+    bool backup;                    // Primary GPT was damaged; backup in use
+    uint8_t disk_guid[16];          // GPT disk GUID, or MBR signature in the first 4 bytes
+    uint32_t count;
+    part_entry_t *entries;          // Sorted by slot
+    uint16_t *by_guid;              // Entry numbers sorted by part_guid
+    uint16_t *by_type;              // ... by type_guid, then slot
+    uint16_t *by_label;             // ... by label, then slot
+} part_table_t;
+
+// The table of `dev` (NULL = boot disk), read on first use and cached. A
+// disk with no recognisable table gets PART_SCHEME_NONE and no entries.
+// NULL only when the disk cannot be read or memory runs out.
+const part_table_t *part_table_get(block_device_t *dev);
+
+// Forget the cached table of `dev` (NULL = every disk), e.g. after the
+// partition table was rewritten or the disk went away
+void part_table_invalidate(block_device_t *dev);
+
+// The entry in `slot` (GPT array index or MBR table index); NULL if unused
+const part_entry_t *part_find_slot(const part_table_t *table, uint32_t slot);
+
+// The partition with unique GUID `guid`
+const part_entry_t *part_find_guid(const part_table_t *table, const uint8_t *guid);
+
+// The first partition (by slot) labelled exactly `label`
+const part_entry_t *part_find_label(const part_table_t *table, const char *label);
+
+// Partitions of type `type`, in slot order: fills up to `max` and returns
+// how many there are
+uint32_t part_find_type(const part_table_t *table, const uint8_t *type, const part_entry_t **out, uint32_t max);
+
+// Text GUID ("C12A7328-F81F-11D2-BA4B-00A0C93EC93B", as GPT_PARTITION_TYPE_*)
+// to on-disk bytes and back; parse returns 0 on success
+int part_guid_parse(const char *text, uint8_t *guid);
+void part_guid_format(const uint8_t *guid, char *out); // 37 bytes
+
+#endif // BLOODHORN_PARTITION_H
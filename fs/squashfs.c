@@ -0,0 +1,882 @@
+/*
+ * squashfs.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "compat.h"
+#include "squashfs.h"
+#include "blockdev.h"
+#include "mm.h"
+
+#define SQUASHFS_NAME_MAX       256
+#define SQUASHFS_DIR_COUNT      256     // Entries one listing header may cover
+#define SQUASHFS_MAX_DEPTH      32      // Directories a path can climb back out of
+
+// Read `len` bytes at byte offset `pos` of the volume. The sectors around
+// them are read into a buffer the caller frees; *data points at the bytes.
+static uint8_t *squashfs_read_stored(squashfs_private_t *priv, uint64_t pos, uint32_t len, const uint8_t **data) {
+    if (len == 0 || pos >= priv->sb.bytes_used || len > priv->sb.bytes_used - pos) {
+        return NULL; // Outside the volume
+    }
+
+    uint64_t first = pos / 512;
+    uint64_t last = (pos + len + 511) / 512;
+    uint8_t *buf = (uint8_t *)kmalloc((size_t)(last - first) * 512);
+    if (!buf) {
+        return NULL; // Out of memory
+    }
+    if (disk_read(buf, (uint32_t)(priv->lba + first), (uint32_t)(last - first)) != 0) {
+        kfree(buf);
+        return NULL; // Read error
+    }
+    *data = buf + pos % 512;
+    return buf;
+}
+
+static int squashfs_read_bytes(squashfs_private_t *priv, uint64_t pos, uint32_t len, void *dst) {
+    const uint8_t *data;
+    uint8_t *buf = squashfs_read_stored(priv, pos, len, &data);
+    if (!buf) {
+        return -1;
+    }
+    memcpy(dst, data, len);
+    kfree(buf);
+    return 0;
+}
+
+// Claim a free workspace. There is one per processor a batch runs on, so
+// normally the first free one is found at once; with fewer (allocation
+// failed) a processor waits for another's decode to finish.
+static uint32_t squashfs_claim_work(squashfs_private_t *priv) {
+    for (;;) {
+        for (uint32_t i = 0; i < priv->work_count; i++) {
+            if (!__atomic_exchange_n(&priv->work_busy[i], 1, __ATOMIC_ACQUIRE)) {
+                return i;
+            }
+        }
+    }
+}
+
+// Allocate workspaces up to `count` (BSP only: APs cannot allocate)
+static void squashfs_alloc_work(squashfs_private_t *priv, uint32_t count) {
+    if (count > BH_PARALLEL_MAX_WORKERS) {
+        count = BH_PARALLEL_MAX_WORKERS;
+    }
+    while (priv->work_count < count) {
+        uint8_t *work = (uint8_t *)kmalloc(priv->work_size);
+        if (!work) {
+            break;
+        }
+        priv->work[priv->work_count] = work;
+        priv->work_busy[priv->work_count] = 0;
+        priv->work_count++;
+    }
+}
+
+// Decode one stored data or metadata block. Safe on an AP: the input is
+// already in memory and the decoder runs in a claimed workspace.
+static int squashfs_decode(squashfs_private_t *priv, const uint8_t *src, uint32_t stored, bool compressed,
+                           uint8_t *dst, uint32_t capacity, uint32_t *out_len) {
+    if (!compressed) {
+        if (stored > capacity) {
+            return -1; // Larger than a block
+        }
+        memcpy(dst, src, stored);
+        *out_len = stored;
+        return 0;
+    }
+
+    uint32_t slot = squashfs_claim_work(priv);
+    size_t len;
+    int status = decomp_block(src, stored, priv->format, dst, capacity, priv->work[slot], priv->work_size, &len);
+    __atomic_store_n(&priv->work_busy[slot], 0, __ATOMIC_RELEASE);
+    if (status != DECOMP_OK) {
+        return -1; // Corrupt block
+    }
+    *out_len = (uint32_t)len;
+    return 0;
+}
+
+static squashfs_cache_entry_t *squashfs_cache_find(squashfs_private_t *priv, squashfs_cache_entry_t *cache,
+                                                   uint32_t count, uint64_t pos, squashfs_cache_entry_t **victim) {
+    *victim = &cache[0];
+    for (uint32_t i = 0; i < count; i++) {
+        if (cache[i].last_used && cache[i].pos == pos) {
+            cache[i].last_used = ++priv->cache_clock;
+            return &cache[i];
+        }
+        if (cache[i].last_used < (*victim)->last_used) {
+            *victim = &cache[i];
+        }
+    }
+    return NULL;
+}
+
+// A metadata block, decompressed, through the cache
+static const squashfs_cache_entry_t *squashfs_meta_block(squashfs_private_t *priv, uint64_t pos) {
+    squashfs_cache_entry_t *victim;
+    squashfs_cache_entry_t *entry = squashfs_cache_find(priv, priv->meta_cache, SQUASHFS_META_CACHE, pos, &victim);
+    if (entry) {
+        return entry;
+    }
+
+    // A 16-bit header gives the stored size and whether it is compressed
+    uint8_t header[2];
+    if (squashfs_read_bytes(priv, pos, 2, header) != 0) {
+        return NULL;
+    }
+    uint32_t stored = (header[0] | (header[1] << 8)) & ~SQUASHFS_METADATA_STORED;
+    bool compressed = !(header[1] & (SQUASHFS_METADATA_STORED >> 8));
+    if (stored == 0 || stored > SQUASHFS_METADATA_SIZE) {
+        return NULL; // Corrupt header
+    }
+
+    const uint8_t *data;
+    uint8_t *buf = squashfs_read_stored(priv, pos + 2, stored, &data);
+    if (!buf) {
+        return NULL;
+    }
+    victim->last_used = 0;
+    int result = squashfs_decode(priv, data, stored, compressed, victim->data, SQUASHFS_METADATA_SIZE, &victim->len);
+    kfree(buf);
+    if (result != 0 || victim->len == 0) {
+        return NULL;
+    }
+
+    victim->pos = pos;
+    victim->next = pos + 2 + stored;
+    victim->last_used = ++priv->cache_clock;
+    return victim;
+}
+
+// Copy `len` bytes of a metadata stream out (or skip them, dst NULL),
+// moving on through the blocks that follow as each one ends
+static int squashfs_meta_read(squashfs_private_t *priv, squashfs_cursor_t *cur, void *dst, uint32_t len) {
+    uint8_t *out = (uint8_t *)dst;
+
+    while (len > 0) {
+        const squashfs_cache_entry_t *block = squashfs_meta_block(priv, cur->block);
+        if (!block || cur->offset > block->len) {
+            return -1; // Read error or bad reference
+        }
+        if (cur->offset == block->len) {
+            cur->block = block->next;
+            cur->offset = 0;
+            continue;
+        }
+
+        uint32_t n = block->len - cur->offset;
+        if (n > len) {
+            n = len;
+        }
+        if (out) {
+            memcpy(out, block->data + cur->offset, n);
+            out += n;
+        }
+        cur->offset += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// What a lookup or read needs from an inode
+typedef struct {
+    uint16_t type;
+    uint64_t size;                  // File bytes; listing bytes + 3 for directories
+
+    // Directories
+    uint32_t dir_block;
+    uint32_t dir_offset;
+    uint32_t index_count;
+    squashfs_cursor_t index;        // Extended directories' name index
+
+    // Regular files
+    uint64_t blocks_start;
+    uint32_t fragment;
+    uint32_t frag_offset;
+    squashfs_cursor_t block_list;
+} squashfs_inode_t;
+
+static bool squashfs_is_dir(const squashfs_inode_t *inode) {
+    return inode->type == SQUASHFS_DIR_TYPE || inode->type == SQUASHFS_LDIR_TYPE;
+}
+
+static bool squashfs_is_file(const squashfs_inode_t *inode) {
+    return inode->type == SQUASHFS_REG_TYPE || inode->type == SQUASHFS_LREG_TYPE;
+}
+
+// Inode references are the inode's metadata block (from the inode table)
+// in the upper bits and its offset in that block in the low 16
+static int squashfs_read_inode(squashfs_private_t *priv, uint64_t ref, squashfs_inode_t *inode) {
+    squashfs_cursor_t cur = { priv->sb.inode_table_start + (ref >> 16), (uint32_t)(ref & 0xFFFF) };
+    union {
+        struct squashfs_base_inode base;
+        struct squashfs_dir_inode dir;
+        struct squashfs_ldir_inode ldir;
+        struct squashfs_reg_inode reg;
+        struct squashfs_lreg_inode lreg;
+    } raw;
+    const uint32_t base_size = sizeof(struct squashfs_base_inode);
+
+    if (squashfs_meta_read(priv, &cur, &raw.base, base_size) != 0) {
+        return -1;
+    }
+    memset(inode, 0, sizeof(*inode));
+    inode->type = raw.base.inode_type;
+
+    switch (inode->type) {
+    case SQUASHFS_DIR_TYPE:
+        if (squashfs_meta_read(priv, &cur, (uint8_t *)&raw + base_size, sizeof(raw.dir) - base_size) != 0) {
+            return -1;
+        }
+        inode->size = raw.dir.file_size;
+        inode->dir_block = raw.dir.start_block;
+        inode->dir_offset = raw.dir.offset;
+        break;
+    case SQUASHFS_LDIR_TYPE:
+        if (squashfs_meta_read(priv, &cur, (uint8_t *)&raw + base_size, sizeof(raw.ldir) - base_size) != 0) {
+            return -1;
+        }
+        inode->size = raw.ldir.file_size;
+        inode->dir_block = raw.ldir.start_block;
+        inode->dir_offset = raw.ldir.offset;
+        inode->index_count = raw.ldir.i_count;
+        inode->index = cur;
+        break;
+    case SQUASHFS_REG_TYPE:
+        if (squashfs_meta_read(priv, &cur, (uint8_t *)&raw + base_size, sizeof(raw.reg) - base_size) != 0) {
+            return -1;
+        }
+        inode->size = raw.reg.file_size;
+        inode->blocks_start = raw.reg.start_block;
+        inode->fragment = raw.reg.fragment;
+        inode->frag_offset = raw.reg.offset;
+        inode->block_list = cur;
+        break;
+    case SQUASHFS_LREG_TYPE:
+        if (squashfs_meta_read(priv, &cur, (uint8_t *)&raw + base_size, sizeof(raw.lreg) - base_size) != 0) {
+            return -1;
+        }
+        inode->size = raw.lreg.file_size;
+        inode->blocks_start = raw.lreg.start_block;
+        inode->fragment = raw.lreg.fragment;
+        inode->frag_offset = raw.lreg.offset;
+        inode->block_list = cur;
+        break;
+    default:
+        break; // Symlinks, devices, FIFOs and sockets: no data to read
+    }
+
+    if (squashfs_is_dir(inode) && inode->dir_offset >= SQUASHFS_METADATA_SIZE) {
+        return -1; // Corrupt inode
+    }
+    return 0;
+}
+
+// Names sort as strcmp would sort them
+static int squashfs_name_cmp(const char *a, uint32_t a_len, const char *b, uint32_t b_len) {
+    int c = memcmp(a, b, a_len < b_len ? a_len : b_len);
+    if (c != 0) {
+        return c;
+    }
+    return a_len < b_len ? -1 : a_len > b_len;
+}
+
+typedef struct {
+    squashfs_cursor_t cur;
+    uint32_t pos;                   // Listing bytes consumed, counted like the inode's size
+    uint32_t left;                  // Entries left under the current header
+    struct squashfs_dir_header header;
+} squashfs_dir_iter_t;
+
+static void squashfs_dir_begin(squashfs_private_t *priv, const squashfs_inode_t *dir, squashfs_dir_iter_t *iter) {
+    iter->cur.block = priv->sb.directory_table_start + dir->dir_block;
+    iter->cur.offset = dir->dir_offset;
+    iter->pos = 3;
+    iter->left = 0;
+}
+
+// Start an extended directory's listing at the block `name` would be in:
+// the index gives the first name of every listing metadata block
+static int squashfs_dir_seek(squashfs_private_t *priv, const squashfs_inode_t *dir, squashfs_dir_iter_t *iter,
+                             const char *name, uint32_t len) {
+    squashfs_cursor_t cur = dir->index;
+    char index_name[SQUASHFS_NAME_MAX];
+
+    for (uint32_t i = 0; i < dir->index_count; i++) {
+        struct squashfs_dir_index index;
+        if (squashfs_meta_read(priv, &cur, &index, sizeof(index)) != 0 || index.size >= SQUASHFS_NAME_MAX ||
+            squashfs_meta_read(priv, &cur, index_name, index.size + 1) != 0) {
+            return -1;
+        }
+        if (squashfs_name_cmp(index_name, index.size + 1, name, len) > 0) {
+            break;
+        }
+        if (index.index + 3 >= dir->size) {
+            return -1; // Corrupt index
+        }
+        iter->cur.block = priv->sb.directory_table_start + index.start_block;
+        iter->cur.offset = (index.index + dir->dir_offset) % SQUASHFS_METADATA_SIZE;
+        iter->pos = index.index + 3;
+        iter->left = 0;
+    }
+    return 0;
+}
+
+// Next entry: 1 with its name (not NUL-terminated) and inode reference,
+// 0 at the end of the listing, -1 on a read error or corrupt listing
+static int squashfs_dir_next(squashfs_private_t *priv, const squashfs_inode_t *dir, squashfs_dir_iter_t *iter,
+                             char *name, uint32_t *name_len, uint64_t *ref) {
+    if (iter->left == 0) {
+        if (iter->pos >= dir->size) {
+            return 0;
+        }
+        if (squashfs_meta_read(priv, &iter->cur, &iter->header, sizeof(iter->header)) != 0 ||
+            iter->header.count >= SQUASHFS_DIR_COUNT) {
+            return -1;
+        }
+        iter->pos += sizeof(iter->header);
+        iter->left = iter->header.count + 1;
+    }
+
+    struct squashfs_dir_entry entry;
+    if (squashfs_meta_read(priv, &iter->cur, &entry, sizeof(entry)) != 0 || entry.size >= SQUASHFS_NAME_MAX ||
+        squashfs_meta_read(priv, &iter->cur, name, entry.size + 1) != 0) {
+        return -1;
+    }
+    iter->pos += sizeof(entry) + entry.size + 1;
+    iter->left--;
+
+    *name_len = entry.size + 1;
+    *ref = ((uint64_t)iter->header.start_block << 16) | entry.offset;
+    return 1;
+}
+
+static int squashfs_dir_find(squashfs_private_t *priv, const squashfs_inode_t *dir, const fs_path_component_t *comp,
+                             uint64_t *ref) {
+    squashfs_dir_iter_t iter;
+    char name[SQUASHFS_NAME_MAX];
+    uint32_t name_len;
+    uint64_t entry_ref;
+    int found;
+
+    squashfs_dir_begin(priv, dir, &iter);
+    if (dir->index_count && squashfs_dir_seek(priv, dir, &iter, comp->name, comp->len) != 0) {
+        return -1;
+    }
+    while ((found = squashfs_dir_next(priv, dir, &iter, name, &name_len, &entry_ref)) > 0) {
+        if (name_len == comp->len && memcmp(name, comp->name, name_len) == 0) {
+            *ref = entry_ref;
+            return 0;
+        }
+    }
+    return -1; // Not found, or read error
+}
+
+// Resolve a path to an inode reference. Listings have no "." or ".."
+// entries, so ".." goes back to the directory the walk came from.
+static int squashfs_lookup(squashfs_private_t *priv, const char *path, uint64_t *ref, squashfs_inode_t *inode) {
+    uint64_t parents[SQUASHFS_MAX_DEPTH];
+    uint32_t depth = 0;
+    fs_path_iter_t iter;
+    fs_path_component_t comp;
+
+    *ref = priv->sb.root_inode;
+    if (squashfs_read_inode(priv, *ref, inode) != 0) {
+        return -1;
+    }
+
+    fs_path_iter_init(&iter, path);
+    while (fs_path_next(&iter, &comp)) {
+        if (!squashfs_is_dir(inode)) {
+            return -1; // Not a directory
+        }
+        if (comp.len == 2 && comp.name[0] == '.' && comp.name[1] == '.') {
+            if (depth > 0) {
+                *ref = parents[--depth];
+            }
+        } else {
+            if (depth == SQUASHFS_MAX_DEPTH) {
+                return -1; // Too deep
+            }
+            parents[depth++] = *ref;
+            if (squashfs_dir_find(priv, inode, &comp, ref) != 0) {
+                return -1; // Not found
+            }
+        }
+        if (squashfs_read_inode(priv, *ref, inode) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// A data or fragment block, decompressed, through the cache. `want` is the
+// length it must decompress to (0 = up to a block, for fragments).
+static const squashfs_cache_entry_t *squashfs_data_block(squashfs_private_t *priv, uint64_t pos, uint32_t size_field,
+                                                         uint32_t want) {
+    squashfs_cache_entry_t *victim;
+    squashfs_cache_entry_t *entry = squashfs_cache_find(priv, priv->data_cache, SQUASHFS_DATA_CACHE, pos, &victim);
+    if (entry) {
+        return want && entry->len != want ? NULL : entry;
+    }
+
+    if (!victim->data && !(victim->data = (uint8_t *)kmalloc(priv->block_size))) {
+        return NULL; // Out of memory
+    }
+    const uint8_t *data;
+    uint8_t *buf = squashfs_read_stored(priv, pos, size_field & SQUASHFS_BLOCK_SIZE_MASK, &data);
+    if (!buf) {
+        return NULL;
+    }
+    victim->last_used = 0;
+    int result = squashfs_decode(priv, data, size_field & SQUASHFS_BLOCK_SIZE_MASK,
+                                 !(size_field & SQUASHFS_BLOCK_STORED), victim->data, priv->block_size, &victim->len);
+    kfree(buf);
+    if (result != 0 || (want && victim->len != want)) {
+        return NULL;
+    }
+
+    victim->pos = pos;
+    victim->last_used = ++priv->cache_clock;
+    return victim;
+}
+
+// One whole data block of a batch, decoded straight into the caller's
+// buffer by whichever processor claims it
+typedef struct {
+    const uint8_t *src;
+    uint32_t size_field;
+    uint8_t *dst;
+    uint32_t len;                   // Bytes the block must decompress to
+    int status;
+} squashfs_task_t;
+
+typedef struct {
+    squashfs_private_t *priv;
+    squashfs_task_t *tasks;
+} squashfs_batch_t;
+
+static void squashfs_batch_body(bh_size_t begin, bh_size_t end, void *arg) {
+    squashfs_batch_t *batch = (squashfs_batch_t *)arg;
+
+    for (bh_size_t i = begin; i < end; i++) {
+        squashfs_task_t *task = &batch->tasks[i];
+        uint32_t len;
+        task->status = squashfs_decode(batch->priv, task->src, task->size_field & SQUASHFS_BLOCK_SIZE_MASK,
+                                       !(task->size_field & SQUASHFS_BLOCK_STORED), task->dst, task->len, &len);
+        if (task->status == 0 && len != task->len) {
+            task->status = -1; // Short block
+        }
+    }
+}
+
+// Decode `count` consecutive stored blocks starting at `pos`, each whole
+// into dst[i]: one device read, then the decodes spread over the APs
+static int squashfs_read_batch(squashfs_private_t *priv, uint64_t pos, squashfs_task_t *tasks, uint32_t count) {
+    uint64_t stored = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        stored += tasks[i].size_field & SQUASHFS_BLOCK_SIZE_MASK;
+    }
+    if (stored == 0) {
+        return 0;
+    }
+
+    const uint8_t *data;
+    uint8_t *buf = squashfs_read_stored(priv, pos, (uint32_t)stored, &data);
+    if (!buf) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        tasks[i].src = data;
+        data += tasks[i].size_field & SQUASHFS_BLOCK_SIZE_MASK;
+    }
+
+    squashfs_batch_t batch = { priv, tasks };
+    if (count > 1) {
+        squashfs_alloc_work(priv, bh_parallel_workers());
+        bh_parallel_for(count, 1, squashfs_batch_body, &batch);
+    } else {
+        squashfs_batch_body(0, 1, &batch);
+    }
+    kfree(buf);
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (tasks[i].status != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Copy part of one block out of the cache; sparse blocks (size 0) are zeros
+static int squashfs_read_partial(squashfs_private_t *priv, uint64_t pos, uint32_t size_field, uint32_t block_len,
+                                 uint8_t *dst, uint32_t from, uint32_t len) {
+    if ((size_field & SQUASHFS_BLOCK_SIZE_MASK) == 0) {
+        memset(dst, 0, len);
+        return 0;
+    }
+    const squashfs_cache_entry_t *block = squashfs_data_block(priv, pos, size_field, block_len);
+    if (!block) {
+        return -1;
+    }
+    memcpy(dst, block->data + from, len);
+    return 0;
+}
+
+// Read [offset, offset + size) of a regular file's data blocks (not its
+// fragment). Whole blocks are batched and decoded in parallel straight into
+// `buf`; the partial blocks at either end go through the cache.
+static int squashfs_read_blocks(squashfs_private_t *priv, uint64_t ref, const squashfs_inode_t *inode,
+                                uint8_t *buf, uint32_t size, uint32_t offset) {
+    uint32_t bs = priv->block_size;
+    uint64_t end = (uint64_t)offset + size;
+    uint32_t first = offset / bs;
+    uint32_t last = (uint32_t)((end - 1) / bs);
+
+    // Walk the block list to the first block, from where the previous read
+    // of this file stopped if that is not past it
+    squashfs_cursor_t list = inode->block_list;
+    uint64_t pos = inode->blocks_start;
+    uint32_t block = 0;
+    if (priv->seek_valid && priv->seek_ref == ref && priv->seek_block <= first) {
+        list = priv->seek_list;
+        pos = priv->seek_pos;
+        block = priv->seek_block;
+    }
+    for (; block < first; block++) {
+        uint32_t size_field;
+        if (squashfs_meta_read(priv, &list, &size_field, sizeof(size_field)) != 0) {
+            return -1;
+        }
+        pos += size_field & SQUASHFS_BLOCK_SIZE_MASK;
+    }
+
+    squashfs_task_t tasks[SQUASHFS_BATCH_BLOCKS];
+    uint32_t count = 0;
+    uint64_t batch_pos = pos;
+    uint64_t batch_stored = 0;
+    for (; block <= last; block++) {
+        uint32_t size_field;
+        if (squashfs_meta_read(priv, &list, &size_field, sizeof(size_field)) != 0) {
+            return -1;
+        }
+        uint32_t stored = size_field & SQUASHFS_BLOCK_SIZE_MASK;
+        uint64_t start = (uint64_t)block * bs;
+        uint32_t block_len = inode->size - start < bs ? (uint32_t)(inode->size - start) : bs;
+        if (stored > bs) {
+            return -1; // Corrupt size: blocks that do not shrink are stored
+        }
+
+        // Flush the batch when this block cannot join it
+        bool whole = start >= offset && start + block_len <= end && stored != 0;
+        if (count > 0 && (!whole || count == SQUASHFS_BATCH_BLOCKS || batch_stored + stored > SQUASHFS_BATCH_BYTES)) {
+            if (squashfs_read_batch(priv, batch_pos, tasks, count) != 0) {
+                return -1;
+            }
+            count = 0;
+        }
+
+        if (whole) {
+            if (count == 0) {
+                batch_pos = pos;
+                batch_stored = 0;
+            }
+            tasks[count].size_field = size_field;
+            tasks[count].dst = buf + (start - offset);
+            tasks[count].len = block_len;
+            tasks[count].status = 0;
+            count++;
+            batch_stored += stored;
+        } else {
+            uint32_t from = start < offset ? offset - (uint32_t)start : 0;
+            uint64_t stop = start + block_len < end ? start + block_len : end;
+            uint32_t len = (uint32_t)(stop - start) - from;
+            if (squashfs_read_partial(priv, pos, size_field, block_len, buf + (start + from - offset), from, len) != 0) {
+                return -1;
+            }
+        }
+        pos += stored;
+    }
+    if (count > 0 && squashfs_read_batch(priv, batch_pos, tasks, count) != 0) {
+        return -1;
+    }
+
+    priv->seek_valid = true;
+    priv->seek_ref = ref;
+    priv->seek_block = block;
+    priv->seek_pos = pos;
+    priv->seek_list = list;
+    return 0;
+}
+
+// The file's tail, from its fragment block
+static int squashfs_read_fragment(squashfs_private_t *priv, const squashfs_inode_t *inode, uint8_t *dst,
+                                  uint32_t from, uint32_t len) {
+    uint32_t index = inode->fragment;
+    if (index >= priv->sb.fragments || index / SQUASHFS_FRAGMENTS_PER_BLOCK >= priv->fragment_blocks) {
+        return -1; // Corrupt inode
+    }
+
+    squashfs_cursor_t cur = {
+        priv->fragment_index[index / SQUASHFS_FRAGMENTS_PER_BLOCK],
+        (uint32_t)(index % SQUASHFS_FRAGMENTS_PER_BLOCK * sizeof(struct squashfs_fragment_entry))
+    };
+    struct squashfs_fragment_entry entry;
+    if (squashfs_meta_read(priv, &cur, &entry, sizeof(entry)) != 0) {
+        return -1;
+    }
+
+    const squashfs_cache_entry_t *block = squashfs_data_block(priv, entry.start_block, entry.size, 0);
+    if (!block || inode->frag_offset > block->len || from + len > block->len - inode->frag_offset) {
+        return -1;
+    }
+    memcpy(dst, block->data + inode->frag_offset + from, len);
+    return 0;
+}
+
+static int squashfs_read_file(squashfs_private_t *priv, uint64_t ref, const squashfs_inode_t *inode,
+                              uint8_t *buf, uint32_t size, uint32_t offset) {
+    if (offset >= inode->size) {
+        return 0; // Read nothing, offset beyond file size
+    }
+    if (size > inode->size - offset) {
+        size = (uint32_t)(inode->size - offset);
+    }
+    if (size == 0) {
+        return 0;
+    }
+
+    // Bytes before `tail` are in data blocks; the rest (when the file has a
+    // fragment) is in the fragment block
+    uint64_t tail = inode->size;
+    if (inode->fragment != SQUASHFS_INVALID_FRAG) {
+        tail -= inode->size % priv->block_size;
+    }
+
+    uint64_t end = (uint64_t)offset + size;
+    if (offset < tail) {
+        uint32_t part = end <= tail ? size : (uint32_t)(tail - offset);
+        if (squashfs_read_blocks(priv, ref, inode, buf, part, offset) != 0) {
+            return -1;
+        }
+    }
+    if (end > tail) {
+        uint32_t from = offset > tail ? (uint32_t)(offset - tail) : 0;
+        uint32_t skip = offset > tail ? 0 : (uint32_t)(tail - offset);
+        if (squashfs_read_fragment(priv, inode, buf + skip, from, size - skip) != 0) {
+            return -1;
+        }
+    }
+    return (int)size;
+}
+
+// Public interface implementation
+static bool squashfs_detect(uint32_t lba) {
+    uint8_t buffer[512];
+
+    if (disk_read(buffer, lba, 1) != 0) {
+        return false; // Read error
+    }
+
+    const struct squashfs_super_block *sb = (const struct squashfs_super_block *)buffer;
+    return sb->s_magic == SQUASHFS_MAGIC && sb->s_major == SQUASHFS_MAJOR;
+}
+
+static void squashfs_unmount(void *private_data) {
+    if (!private_data) return;
+
+    squashfs_private_t *priv = (squashfs_private_t *)private_data;
+
+    if (priv->meta_cache[0].data) {
+        kfree(priv->meta_cache[0].data);
+    }
+    for (uint32_t i = 0; i < SQUASHFS_DATA_CACHE; i++) {
+        if (priv->data_cache[i].data) {
+            kfree(priv->data_cache[i].data);
+        }
+    }
+    for (uint32_t i = 0; i < priv->work_count; i++) {
+        kfree(priv->work[i]);
+    }
+    if (priv->fragment_index) {
+        kfree(priv->fragment_index);
+    }
+    kfree(priv);
+}
+
+static void *squashfs_mount(uint32_t lba, void *opts) {
+    (void)opts;
+
+    squashfs_private_t *priv = (squashfs_private_t *)kmalloc(sizeof(squashfs_private_t));
+    if (!priv) {
+        return NULL; // Out of memory
+    }
+    memset(priv, 0, sizeof(squashfs_private_t));
+    priv->lba = lba;
+
+    // The superblock itself is read before bytes_used is known
+    priv->sb.bytes_used = sizeof(priv->sb);
+    if (squashfs_read_bytes(priv, 0, sizeof(priv->sb), &priv->sb) != 0) {
+        goto fail;
+    }
+    const struct squashfs_super_block *sb = &priv->sb;
+    if (sb->s_magic != SQUASHFS_MAGIC || sb->s_major != SQUASHFS_MAJOR ||
+        sb->block_log < 12 || sb->block_log > 20 || sb->block_size != (1u << sb->block_log)) {
+        goto fail; // Not SquashFS 4.0
+    }
+    priv->block_size = sb->block_size;
+
+    // xz, lzma and lzo volumes are recognised but have no decoder here
+    switch (sb->compression) {
+    case SQUASHFS_ZLIB: priv->format = DECOMP_ZLIB; break;
+    case SQUASHFS_LZ4:  priv->format = DECOMP_LZ4_BLOCK; break;
+    case SQUASHFS_ZSTD: priv->format = DECOMP_ZSTD; break;
+    default:            goto fail;
+    }
+
+    // One workspace for decodes on this processor; the rest when a read
+    // first has blocks to spread over the others
+    priv->work_size = decomp_workspace_size(priv->format);
+    squashfs_alloc_work(priv, 1);
+    uint8_t *meta = (uint8_t *)kmalloc(SQUASHFS_META_CACHE * SQUASHFS_METADATA_SIZE);
+    if (priv->work_count == 0 || !meta) {
+        if (meta) kfree(meta);
+        goto fail; // Out of memory
+    }
+    for (uint32_t i = 0; i < SQUASHFS_META_CACHE; i++) {
+        priv->meta_cache[i].data = meta + i * SQUASHFS_METADATA_SIZE;
+    }
+
+    // The fragment table's own index: one pointer per metadata block of
+    // fragment entries
+    if (sb->fragments > 0) {
+        priv->fragment_blocks = (sb->fragments + SQUASHFS_FRAGMENTS_PER_BLOCK - 1) / SQUASHFS_FRAGMENTS_PER_BLOCK;
+        uint32_t len = priv->fragment_blocks * sizeof(uint64_t);
+        priv->fragment_index = (uint64_t *)kmalloc(len);
+        if (!priv->fragment_index ||
+            squashfs_read_bytes(priv, sb->fragment_table_start, len, priv->fragment_index) != 0) {
+            goto fail;
+        }
+    }
+
+    // The root must be a directory
+    squashfs_inode_t root;
+    if (squashfs_read_inode(priv, sb->root_inode, &root) != 0 || !squashfs_is_dir(&root)) {
+        goto fail;
+    }
+    return priv;
+
+fail:
+    squashfs_unmount(priv);
+    return NULL;
+}
+
+// VFS operations: nodes carry the inode reference
+static void squashfs_fill_node(uint64_t ref, const squashfs_inode_t *inode, fs_node_t *node) {
+    node->id = ref;
+    node->size = inode->size > UINT32_MAX ? UINT32_MAX : (uint32_t)inode->size;
+    node->is_dir = squashfs_is_dir(inode);
+}
+
+static int squashfs_lookup_node(mount_point_t *mp, const char *path, fs_node_t *node) {
+    squashfs_inode_t inode;
+    uint64_t ref;
+
+    if (squashfs_lookup((squashfs_private_t *)mp->private_data, path, &ref, &inode) != 0) {
+        return -1; // Not found
+    }
+    squashfs_fill_node(ref, &inode, node);
+    return 0;
+}
+
+static int squashfs_read_node(mount_point_t *mp, const fs_node_t *node, uint8_t *buf, uint32_t size, uint32_t offset) {
+    squashfs_private_t *priv = (squashfs_private_t *)mp->private_data;
+    squashfs_inode_t inode;
+
+    if (squashfs_read_inode(priv, node->id, &inode) != 0 || !squashfs_is_file(&inode)) {
+        return -1; // Not a regular file
+    }
+    return squashfs_read_file(priv, node->id, &inode, buf, size, offset);
+}
+
+static int squashfs_list_node(mount_point_t *mp, const fs_node_t *node, char *buffer, uint32_t size) {
+    squashfs_private_t *priv = (squashfs_private_t *)mp->private_data;
+    squashfs_inode_t inode;
+
+    if (squashfs_read_inode(priv, node->id, &inode) != 0 || !squashfs_is_dir(&inode)) {
+        return -1; // Not a directory
+    }
+
+    // One name per line, as far as the buffer goes
+    squashfs_dir_iter_t iter;
+    char name[SQUASHFS_NAME_MAX];
+    uint32_t name_len;
+    uint64_t ref;
+    uint32_t used = 0;
+    int found;
+    squashfs_dir_begin(priv, &inode, &iter);
+    while ((found = squashfs_dir_next(priv, &inode, &iter, name, &name_len, &ref)) > 0) {
+        if (used + name_len + 1 > size) {
+            break; // Out of buffer space
+        }
+        memcpy(buffer + used, name, name_len);
+        used += name_len;
+        buffer[used++] = '\n';
+    }
+    return found < 0 ? -1 : (int)used;
+}
+
+// Path-based operations resolve a node first
+static int squashfs_read(mount_point_t *mp, const char *path, uint8_t *buf, uint32_t size, uint32_t offset) {
+    fs_node_t node;
+    if (squashfs_lookup_node(mp, path, &node) != 0 || node.is_dir) {
+        return -1; // File not found
+    }
+    return squashfs_read_node(mp, &node, buf, size, offset);
+}
+
+static int squashfs_list_dir(mount_point_t *mp, const char *path, char *buffer, uint32_t size) {
+    fs_node_t node;
+    if (squashfs_lookup_node(mp, path, &node) != 0) {
+        return -1; // Directory not found
+    }
+    return squashfs_list_node(mp, &node, buffer, size);
+}
+
+static int squashfs_get_info(mount_point_t *mp, const char *path, uint32_t *size, bool *is_dir) {
+    fs_node_t node;
+    if (squashfs_lookup_node(mp, path, &node) != 0) {
+        return -1; // Not found
+    }
+    *size = node.size;
+    *is_dir = node.is_dir;
+    return 0;
+}
+
+// Filesystem operations. Data is compressed, so there is nothing for
+// map_node to describe.
+const fs_operations_t squashfs_ops = {
+    .read = squashfs_read,
+    .write = NULL, // Read-only
+    .list_dir = squashfs_list_dir,
+    .get_info = squashfs_get_info,
+    .lookup = squashfs_lookup_node,
+    .read_node = squashfs_read_node,
+    .list_node = squashfs_list_node,
+    .map_node = NULL,
+};
+
+// Global filesystem instance
+const filesystem_t squashfs_fs = {
+    .name = "squashfs",
+    .ops = &squashfs_ops,
+    .detect = squashfs_detect,
+    .mount = squashfs_mount,
+    .unmount = squashfs_unmount,
+};
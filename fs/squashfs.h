@@ -0,0 +1,209 @@
+/*
+ * squashfs.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_SQUASHFS_H
+#define BLOODHORN_SQUASHFS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "compat.h"
+#include "fs_mount.h"
+#include "../compress/decompress.h"
+#include "../boot/libb/include/bloodhorn/parallel.h"
+
+// Constants
+#define SQUASHFS_MAGIC              0x73717368  // "hsqs"
+#define SQUASHFS_MAJOR              4
+#define SQUASHFS_METADATA_SIZE      8192        // Inode, directory and table blocks, decompressed
+#define SQUASHFS_METADATA_STORED    0x8000      // Metadata header: block is not compressed
+#define SQUASHFS_BLOCK_STORED       0x1000000   // Data block size: block is not compressed
+#define SQUASHFS_BLOCK_SIZE_MASK    0xFFFFFF
+#define SQUASHFS_INVALID_FRAG       0xFFFFFFFF
+#define SQUASHFS_FRAGMENTS_PER_BLOCK (SQUASHFS_METADATA_SIZE / sizeof(struct squashfs_fragment_entry))
+
+// Compressors
+#define SQUASHFS_ZLIB               1
+#define SQUASHFS_LZMA               2
+#define SQUASHFS_LZO                3
+#define SQUASHFS_XZ                 4
+#define SQUASHFS_LZ4                5
+#define SQUASHFS_ZSTD               6
+
+// Superblock flags
+#define SQUASHFS_FLAG_COMPRESSOR_OPTIONS 0x0400 // An options metadata block follows the superblock
+
+// Inode types
+#define SQUASHFS_DIR_TYPE           1
+#define SQUASHFS_REG_TYPE           2
+#define SQUASHFS_SYMLINK_TYPE       3
+#define SQUASHFS_LDIR_TYPE          8
+#define SQUASHFS_LREG_TYPE          9
+
+// Superblock (byte 0, little-endian)
+struct squashfs_super_block {
+    uint32_t s_magic;
+    uint32_t inodes;
+    uint32_t mkfs_time;
+    uint32_t block_size;
+    uint32_t fragments;
+    uint16_t compression;           // SQUASHFS_ZLIB...
+    uint16_t block_log;
+    uint16_t flags;
+    uint16_t no_ids;
+    uint16_t s_major;
+    uint16_t s_minor;
+    uint64_t root_inode;            // Inode reference
+    uint64_t bytes_used;
+    uint64_t id_table_start;
+    uint64_t xattr_id_table_start;
+    uint64_t inode_table_start;
+    uint64_t directory_table_start;
+    uint64_t fragment_table_start;
+    uint64_t lookup_table_start;
+} __attribute__((packed));
+
+// Every inode opens with this
+struct squashfs_base_inode {
+    uint16_t inode_type;
+    uint16_t mode;
+    uint16_t uid;
+    uint16_t guid;
+    uint32_t mtime;
+    uint32_t inode_number;
+} __attribute__((packed));
+
+struct squashfs_dir_inode {
+    struct squashfs_base_inode base;
+    uint32_t start_block;           // Listing's metadata block, from the directory table
+    uint32_t nlink;
+    uint16_t file_size;             // Listing bytes + 3
+    uint16_t offset;                // Listing's offset in that block
+    uint32_t parent_inode;
+} __attribute__((packed));
+
+struct squashfs_ldir_inode {
+    struct squashfs_base_inode base;
+    uint32_t nlink;
+    uint32_t file_size;
+    uint32_t start_block;
+    uint32_t parent_inode;
+    uint16_t i_count;               // Index entries following the inode
+    uint16_t offset;
+    uint32_t xattr;
+} __attribute__((packed));
+
+// Followed by block_list: one size per full block (and the last partial
+// block unless it is in a fragment)
+struct squashfs_reg_inode {
+    struct squashfs_base_inode base;
+    uint32_t start_block;           // First data block, from the start of the volume
+    uint32_t fragment;
+    uint32_t offset;                // In the fragment block
+    uint32_t file_size;
+} __attribute__((packed));
+
+struct squashfs_lreg_inode {
+    struct squashfs_base_inode base;
+    uint64_t start_block;
+    uint64_t file_size;
+    uint64_t sparse;
+    uint32_t nlink;
+    uint32_t fragment;
+    uint32_t offset;
+    uint32_t xattr;
+} __attribute__((packed));
+
+// Extended directory index: the first name of each listing metadata block
+struct squashfs_dir_index {
+    uint32_t index;                 // Offset of that block's entries in the listing
+    uint32_t start_block;           // From the directory table
+    uint32_t size;                  // Name length - 1; the name follows
+} __attribute__((packed));
+
+// A directory listing is runs of entries sharing one inode metadata block
+struct squashfs_dir_header {
+    uint32_t count;                 // Entries - 1
+    uint32_t start_block;           // Their inodes' metadata block, from the inode table
+    uint32_t inode_number;
+} __attribute__((packed));
+
+struct squashfs_dir_entry {
+    uint16_t offset;                // Inode's offset in that block
+    int16_t  inode_number;          // Delta from the header's
+    uint16_t type;
+    uint16_t size;                  // Name length - 1; the name follows
+} __attribute__((packed));
+
+struct squashfs_fragment_entry {
+    uint64_t start_block;
+    uint32_t size;                  // As a data block size
+    uint32_t unused;
+} __attribute__((packed));
+
+// A position in a metadata stream: the stored block and an offset into
+// its decompressed bytes (which may run on into the following blocks)
+typedef struct {
+    uint64_t block;                 // Byte offset on the volume
+    uint32_t offset;
+} squashfs_cursor_t;
+
+// Decompressed blocks read recently: metadata blocks (with the position of
+// the block after, since their stored size varies), and data and fragment
+// blocks for reads that only take part of one. Evicted least recently
+// used first.
+#define SQUASHFS_META_CACHE         8
+#define SQUASHFS_DATA_CACHE         4
+
+typedef struct {
+    uint64_t pos;                   // Stored block's byte offset on the volume
+    uint64_t next;                  // Metadata only: the following block
+    uint32_t len;                   // Decompressed bytes
+    uint32_t last_used;             // LRU stamp, 0 = empty
+    uint8_t *data;
+} squashfs_cache_entry_t;
+
+// Data blocks are read and decompressed in batches: one device read for
+// the batch's stored blocks, then one decoder per processor. A batch is
+// at most this many blocks and stored bytes.
+#define SQUASHFS_BATCH_BLOCKS       32
+#define SQUASHFS_BATCH_BYTES        (4 * 1024 * 1024)
+
+// SquashFS private data structure
+typedef struct {
+    uint32_t lba;                       // Starting LBA of partition
+    struct squashfs_super_block sb;     // Superblock
+    uint32_t block_size;                // Data block size in bytes
+    decomp_format_t format;             // Decoder for every compressed block
+    uint64_t *fragment_index;           // Fragment table metadata blocks
+    uint32_t fragment_blocks;
+    squashfs_cache_entry_t meta_cache[SQUASHFS_META_CACHE];
+    squashfs_cache_entry_t data_cache[SQUASHFS_DATA_CACHE];
+    uint32_t cache_clock;               // Monotonic LRU counter
+
+    // Where the last read left a file's block list, so a file read in
+    // order does not sum its block sizes from the start every time
+    bool seek_valid;
+    uint64_t seek_ref;                  // Inode reference
+    uint32_t seek_block;                // Block the cursor is at
+    uint64_t seek_pos;                  // That block's stored offset
+    squashfs_cursor_t seek_list;        // Its size in the block list
+
+    // Decoder workspaces, one per processor a batch is spread over; a
+    // decode claims a free one
+    uint8_t *work[BH_PARALLEL_MAX_WORKERS];
+    volatile uint32_t work_busy[BH_PARALLEL_MAX_WORKERS];
+    uint32_t work_count;
+    size_t work_size;
+} squashfs_private_t;
+
+// SquashFS filesystem operations
+extern const fs_operations_t squashfs_ops;
+
+// SquashFS filesystem type
+extern const filesystem_t squashfs_fs;
+
+#endif // BLOODHORN_SQUASHFS_H
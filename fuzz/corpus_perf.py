@@ -0,0 +1,497 @@
+# corpus_perf.py
+#
+# This file is part of BloodHorn and is licensed under the BSD License.
+# See the root of the repository for license details.
+#
+
+"""
+Parser Corpus Timing
+
+Replays every input of each fuzz target's corpus a few times and reports
+how long the parser took on it, against a stored baseline, so a change
+that makes some input quadratic (a directory scan, a tag walk, deep
+recursion) shows up even though nothing crashes.
+
+Targets are the fuzz_* programs in the build directory, libFuzzer or
+standalone builds alike; each one's corpus is CORPUS/<target>, the same
+directory libFuzzer grows while fuzzing. The programs time every input
+themselves (fuzz/fuzz.c, in thread CPU time) and this script reads those
+timings back, matching them to files by content hash. An input's time is
+the median of its runs.
+
+An input is reported when it grew by more than --tolerance percent and
+--floor-us microseconds over the baseline, or when it takes longer than
+--budget-us outright. A crash fails the run like a regression does, and
+so does an input still running at ten times the budget, which the
+program stops there rather than let it stall the run; either way the
+input is named.
+
+Example:
+    python3 fuzz/corpus_perf.py --build Build/fuzz --corpus Build/fuzz/corpus
+    python3 fuzz/corpus_perf.py --build Build/fuzz --corpus Build/fuzz/corpus --update-baseline
+
+An empty corpus is seeded with a few valid inputs first. The ext2 seed
+needs mke2fs (e2fsprogs), the ISO 9660 one xorriso or genisoimage; a
+seed whose tool is missing is skipped.
+"""
+
+import argparse
+import json
+import os
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import zlib
+
+# Inputs per process; keeps command lines short
+CHUNK = 256
+
+
+def fail(message):
+    sys.exit("corpus_perf: " + message)
+
+
+def fnv1a64(data):
+    h = 0xCBF29CE484222325
+    for b in data:
+        h = ((h ^ b) * 0x100000001B3) & 0xFFFFFFFFFFFFFFFF
+    return h
+
+
+def median(values):
+    values = sorted(values)
+    mid = len(values) // 2
+    return values[mid] if len(values) % 2 else (values[mid - 1] + values[mid]) // 2
+
+
+# Seeds: small, valid inputs for each target to start mutating from
+
+def seed_config_json(work):
+    return {
+        "bloodhorn.json": json.dumps({
+            "boot": {"default": "linux", "menu_timeout": 5,
+                     "theme": {"background_color": "0x000080", "background_image": "background.bmp"}},
+            "entries": {"linux": {"kernel": "/boot/vmlinuz", "cmdline": "root=/dev/sda1 ro quiet"}},
+            "recovery": {"enabled": True, "timeout": 30},
+        }, indent=2).encode(),
+        "escapes.json": b'{"boot": {"title": "Boot \\"A\\" \\u00e9\\t\\\\", "language": "en"}}',
+    }
+
+
+def seed_tftp_oack(work):
+    return {
+        "options.bin": b"\x00\x06blksize\x001468\x00tsize\x0033554432\x00windowsize\x008\x00",
+        "blksize.bin": b"\x00\x06BLKSIZE\x00512\x00",
+    }
+
+
+def multiboot2_header(tags):
+    body = b"".join(tags) + struct.pack("<HHI", 0, 0, 8)
+    length = 16 + len(body)
+    magic = 0xE85250D6
+    return struct.pack("<IIII", magic, 0, length, (-(magic + length)) & 0xFFFFFFFF) + body
+
+
+def seed_multiboot2(work):
+    # Address tag: header_addr, load_addr, load_end_addr, bss_end_addr
+    address = struct.pack("<HHIIIII", 2, 0, 24, 0x100000, 0x100000, 0x101000, 0x102000) + b"\0" * 4
+    entry = struct.pack("<HHII", 3, 0, 12, 0x100040) + b"\0" * 4
+    flat = multiboot2_header([address, entry]).ljust(4096, b"\x90")
+
+    # ELF64 with one PT_LOAD, the header just after the program headers
+    ehdr = b"\x7fELF\x02\x01\x01" + b"\0" * 9 + struct.pack(
+        "<HHIQQQIHHHHHH", 2, 62, 1, 0x100080, 64, 0, 0, 64, 56, 1, 64, 0, 0)
+    phdr = struct.pack("<IIQQQQQQ", 1, 5, 0, 0x100000, 0x100000, 4096, 8192, 4096)
+    elf = (ehdr + phdr).ljust(128, b"\0") + multiboot2_header([])
+    return {"address.bin": flat, "elf64.bin": elf.ljust(4096, b"\0")}
+
+
+def seed_authenticode(work):
+    # PE32+ with two sections, listed out of file order, and a certificate
+    # table after them; the first byte of each seed picks the piece size
+    opt = 0x80 + 24
+    headers = bytearray(0x400)
+    headers[0:2] = b"MZ"
+    struct.pack_into("<I", headers, 0x3C, 0x80)
+    headers[0x80:0x84] = b"PE\0\0"
+    struct.pack_into("<HHIIIHH", headers, 0x84, 0x8664, 2, 0, 0, 0, 240, 0x22)
+    struct.pack_into("<H", headers, opt, 0x20B)
+    struct.pack_into("<I", headers, opt + 60, 0x400)
+    struct.pack_into("<I", headers, opt + 108, 16)
+    struct.pack_into("<II", headers, opt + 112 + 4 * 8, 0xA00, 0x100)
+    struct.pack_into("<8sIIII", headers, opt + 240, b".data", 0x400, 0x2000, 0x400, 0x600)
+    struct.pack_into("<8sIIII", headers, opt + 280, b".text", 0x200, 0x1000, 0x200, 0x400)
+    image = bytes(headers) + b"\xc3" * 0x200 + b"\x5a" * 0x400 + b"\x30" * 0x100
+    return {"pe32plus.bin": b"\x03" + image, "pe32plus-bytes.bin": b"\x00" + image}
+
+
+def make_tree(work):
+    tree = os.path.join(work, "tree")
+    if not os.path.isdir(tree):
+        for d in range(3):
+            os.makedirs(os.path.join(tree, "dir%d" % d, "sub"))
+            for f in range(4):
+                with open(os.path.join(tree, "dir%d" % d, "file%d.cfg" % f), "wb") as out:
+                    out.write(b"entry%d=%d\n" % (f, d) * (f * 40 + 1))
+        with open(os.path.join(tree, "dir0", "sub", "deep.txt"), "wb") as out:
+            out.write(b"deep\n")
+    return tree
+
+
+def seed_ext2(work):
+    if not shutil.which("mke2fs"):
+        print("corpus_perf: mke2fs not found, no ext2 seed", file=sys.stderr)
+        return {}
+    image = os.path.join(work, "ext2.img")
+    subprocess.run(["mke2fs", "-q", "-F", "-t", "ext2", "-b", "1024", "-N", "64", "-d", make_tree(work), image,
+                    "256K"], check=True, stdout=subprocess.DEVNULL)
+    with open(image, "rb") as f:
+        return {"small.img": f.read()}
+
+
+def seed_iso9660(work):
+    tool = shutil.which("xorriso") or shutil.which("genisoimage")
+    if not tool:
+        print("corpus_perf: xorriso/genisoimage not found, no iso9660 seed", file=sys.stderr)
+        return {}
+    seeds = {}
+    for name, flags in (("rockridge.iso", ["-R"]), ("joliet.iso", ["-J"])):
+        image = os.path.join(work, name)
+        cmd = [tool] + (["-as", "mkisofs"] if tool.endswith("xorriso") else [])
+        subprocess.run(cmd + ["-quiet"] + flags + ["-V", "SEED", "-o", image, make_tree(work)], check=True,
+                       stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        with open(image, "rb") as f:
+            seeds[name] = f.read()
+    return seeds
+
+
+# SquashFS 4.0, written here since squashfs-tools is rarely installed:
+# zlib blocks (or all stored, which is what the flag bits say), one
+# metadata block each of inodes and listings, and file tails packed into
+# fragments or left as short last blocks
+SQUASHFS_BLOCK_LOG = 12
+SQUASHFS_NONE = 0xFFFFFFFFFFFFFFFF
+
+
+def squashfs_block(data, compress, stored_flag):
+    """(bytes as stored, size field) for one block."""
+    if compress:
+        packed = zlib.compress(data, 9)
+        if len(packed) < len(data):
+            return packed, len(packed)
+    return data, len(data) | stored_flag
+
+
+def squashfs_image(tree, compress, fragments):
+    block_size = 1 << SQUASHFS_BLOCK_LOG
+    out = bytearray(96)
+
+    def metadata(stream):
+        """Metadata blocks at the end of `out`; returns where each starts."""
+        starts = []
+        for i in range(0, max(len(stream), 1), 8192):
+            data, size = squashfs_block(stream[i:i + 8192], compress, 0x8000)
+            starts.append(len(out))
+            out.extend(struct.pack("<H", size) + data)
+        return starts
+
+    # Every entry with its inode number, directories listing sorted names;
+    # a big file in the root so reads cross full blocks too
+    nodes = []
+
+    def walk(path, name, parent):
+        node = {"name": name, "number": len(nodes) + 1, "parent": parent}
+        nodes.append(node)
+        if os.path.isdir(path):
+            node["children"] = [walk(os.path.join(path, n), n, node) for n in sorted(os.listdir(path))]
+        else:
+            with open(path, "rb") as f:
+                node["data"] = f.read()
+        return node
+
+    root = walk(tree, "", None)
+    big = {"name": "big.bin", "number": len(nodes) + 1, "parent": root,
+           "data": bytes((i * 7 + i // 4096) & 0xFF for i in range(3 * block_size + 1000))}
+    nodes.append(big)
+    root["children"] = sorted(root["children"] + [big], key=lambda n: n["name"])
+
+    # File data: whole blocks, then the tail in a fragment or a short block
+    frag_entries = []
+    frag_data = bytearray()
+
+    def flush_fragment():
+        stored, size = squashfs_block(bytes(frag_data), compress, 0x1000000)
+        frag_entries.append(struct.pack("<QII", len(out), size, 0))
+        out.extend(stored)
+        del frag_data[:]
+
+    for node in nodes:
+        if "data" not in node:
+            continue
+        data = node["data"]
+        whole = len(data) // block_size * block_size if fragments else len(data)
+        node["start"] = len(out)
+        node["blocks"] = []
+        for i in range(0, whole, block_size):
+            stored, size = squashfs_block(data[i:i + block_size], compress, 0x1000000)
+            out.extend(stored)
+            node["blocks"].append(size)
+        node["fragment"] = (0xFFFFFFFF, 0)
+        if whole < len(data):
+            if len(frag_data) + len(data) - whole > block_size:
+                flush_fragment()
+            node["fragment"] = (len(frag_entries), len(frag_data))
+            frag_data += data[whole:]
+    if frag_data:
+        flush_fragment()
+
+    # Inode offsets first (their sizes are fixed), so listings can name them
+    offset = 0
+    for node in nodes:
+        node["inode"] = offset
+        offset += 32 if "children" in node else 32 + 4 * len(node["blocks"])
+    listings = bytearray()
+    for node in nodes:
+        if "children" not in node:
+            continue
+        node["listing"] = len(listings)
+        children = node["children"]
+        if children:
+            listings += struct.pack("<III", len(children) - 1, 0, children[0]["number"])
+            for child in children:
+                name = child["name"].encode()
+                listings += struct.pack("<HhHH", child["inode"], child["number"] - children[0]["number"],
+                                        1 if "children" in child else 2, len(name) - 1) + name
+        node["listing_size"] = len(listings) - node["listing"] + 3
+    inodes = bytearray()
+    for node in nodes:
+        parent = node["parent"]["number"] if node["parent"] else len(nodes) + 1
+        if "children" in node:
+            inodes += struct.pack("<HHHHII", 1, 0o755, 0, 0, 0, node["number"])
+            inodes += struct.pack("<IIHHI", 0, 2 + sum("children" in c for c in node["children"]),
+                                  node["listing_size"], node["listing"], parent)
+        else:
+            inodes += struct.pack("<HHHHII", 2, 0o644, 0, 0, 0, node["number"])
+            inodes += struct.pack("<IIII", node["start"], node["fragment"][0], node["fragment"][1],
+                                  len(node["data"]))
+            inodes += b"".join(struct.pack("<I", size) for size in node["blocks"])
+    if len(inodes) > 8192 or len(listings) > 8192:
+        fail("squashfs seed: tree too large for one metadata block")
+
+    inode_table = metadata(bytes(inodes))[0]
+    directory_table = metadata(bytes(listings))[0]
+    fragment_table = SQUASHFS_NONE
+    if frag_entries:
+        starts = metadata(b"".join(frag_entries))
+        fragment_table = len(out)
+        out.extend(b"".join(struct.pack("<Q", s) for s in starts))
+    starts = metadata(struct.pack("<I", 0))
+    id_table = len(out)
+    out.extend(b"".join(struct.pack("<Q", s) for s in starts))
+
+    flags = 0 if compress else 0x000B
+    if not fragments:
+        flags |= 0x0010
+    struct.pack_into("<IIIIIHHHHHHQQQQQQQQ", out, 0, 0x73717368, len(nodes), 0, block_size, len(frag_entries),
+                     1, SQUASHFS_BLOCK_LOG, flags, 1, 4, 0, root["inode"], len(out), id_table, SQUASHFS_NONE,
+                     inode_table, directory_table, fragment_table, SQUASHFS_NONE)
+    out.extend(b"\0" * (-len(out) % 4096))
+    return bytes(out)
+
+
+def seed_squashfs(work):
+    tree = make_tree(work)
+    seeds = {"zlib.sqsh": squashfs_image(tree, True, True), "stored.sqsh": squashfs_image(tree, False, False)}
+    if shutil.which("mksquashfs"):
+        image = os.path.join(work, "mksquashfs.sqsh")
+        subprocess.run(["mksquashfs", tree, image, "-noappend", "-quiet", "-comp", "gzip", "-b", "4096"],
+                       check=True, stdout=subprocess.DEVNULL)
+        with open(image, "rb") as f:
+            seeds["mksquashfs.sqsh"] = f.read() + b"\0" * (-os.path.getsize(image) % 4096)
+    return seeds
+
+
+SEEDS = {
+    "authenticode": seed_authenticode,
+    "config_json": seed_config_json,
+    "tftp_oack": seed_tftp_oack,
+    "multiboot2": seed_multiboot2,
+    "ext2": seed_ext2,
+    "iso9660": seed_iso9660,
+    "squashfs": seed_squashfs,
+}
+
+
+def seed(target, corpus, work):
+    make = SEEDS.get(target)
+    if not make:
+        return
+    os.makedirs(corpus, exist_ok=True)
+    for name, data in make(work).items():
+        with open(os.path.join(corpus, name), "wb") as f:
+            f.write(data)
+
+
+def time_target(binary, files, runs, hang_us, log):
+    """Run every file `runs` times. Returns {hash: [ns, ...]}, and on a crash
+    also the file it crashed on and the program's output."""
+    with tempfile.NamedTemporaryFile(prefix="corpus-perf-", suffix=".log", delete=False) as t:
+        path = t.name
+    try:
+        env = dict(os.environ, BH_FUZZ_TIMING=path)
+        env.pop("BH_FUZZ_BUDGET_US", None)
+        if hang_us:
+            env["BH_FUZZ_BUDGET_US"] = str(hang_us)
+        for i in range(0, len(files), CHUNK):
+            chunk = files[i:i + CHUNK]
+            proc = subprocess.run([binary, "-runs=%d" % runs] + chunk, env=env,
+                                  stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+            if log:
+                log.write(proc.stdout)
+            if proc.returncode != 0:
+                # Neither build says which input it died on: find it alone
+                for culprit in chunk:
+                    alone = subprocess.run([binary, "-runs=1", culprit], env=dict(env, BH_FUZZ_TIMING=""),
+                                           stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+                    if alone.returncode != 0:
+                        return read_timings(path), culprit, alone.stdout.decode(errors="replace")
+                return read_timings(path), "?", proc.stdout.decode(errors="replace")
+        return read_timings(path), None, None
+    finally:
+        os.unlink(path)
+
+
+def read_timings(path):
+    timings = {}
+    with open(path) as f:
+        for line in f:
+            parts = line.split()
+            if len(parts) == 3:
+                timings.setdefault(int(parts[0], 16), []).append(int(parts[2]))
+    return timings
+
+
+def report(target, result, sizes, baseline, tolerance, floor_us, budget_us, top):
+    """Print the target's slowest inputs and any that regressed; True when
+    some input got slower than allowed."""
+    regressed = False
+    ranked = sorted(result, key=lambda n: result[n], reverse=True)
+    total = sum(result.values())
+    print("%s: %d inputs, %.1f us in all, slowest %s (%.1f us)" % (
+        target, len(result), total, ranked[0] if ranked else "-", result[ranked[0]] if ranked else 0))
+    print("  %-44s %10s %10s %10s %9s" % ("input", "bytes", "median(us)", "baseline", "change"))
+    shown = set(ranked[:top])
+    for name in ranked:
+        now = result[name]
+        base = baseline.get(name)
+        flag = ""
+        if budget_us and now > budget_us:
+            flag = "  OVER BUDGET"
+        if base is not None:
+            change = (now - base) * 100.0 / base if base else 0.0
+            if now - base > floor_us and change > tolerance:
+                flag += "  REGRESSION"
+        if flag:
+            regressed = True
+        elif name not in shown:
+            continue
+        if base is None:
+            print("  %-44s %10d %10.1f %10s %9s%s" % (name[:44], sizes[name], now, "-", "new", flag))
+        else:
+            print("  %-44s %10d %10.1f %10.1f %+8.1f%%%s" % (name[:44], sizes[name], now, base, change, flag))
+    return regressed
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Time every corpus input of BloodHorn's parser fuzz targets")
+    parser.add_argument("--build", required=True, help="directory holding the fuzz_* programs")
+    parser.add_argument("--corpus", required=True, help="directory of per-target corpora")
+    parser.add_argument("--targets", help="comma-separated targets (default: every fuzz_* in --build)")
+    parser.add_argument("--runs", type=int, default=5, help="runs per input to take the median of")
+    parser.add_argument("--baseline", help="baseline file (default: CORPUS/perf-baseline.json)")
+    parser.add_argument("--update-baseline", action="store_true", help="store this result as the baseline")
+    parser.add_argument("--tolerance", type=float, default=50.0, help="percent an input may grow")
+    parser.add_argument("--floor-us", type=int, default=200, help="growth below this is never a regression")
+    parser.add_argument("--budget-us", type=int, default=100000, help="no input may take longer (0: no limit)")
+    parser.add_argument("--top", type=int, default=5, help="slowest inputs to list per target")
+    parser.add_argument("--log", help="append the programs' output here")
+    args = parser.parse_args()
+
+    if args.runs < 1:
+        fail("--runs must be at least 1")
+    if not os.path.isdir(args.build):
+        fail("%s not found; build the targets first (make fuzz)" % args.build)
+    if args.targets:
+        targets = args.targets.split(",")
+    else:
+        targets = sorted(name[len("fuzz_"):] for name in os.listdir(args.build)
+                         if name.startswith("fuzz_") and os.access(os.path.join(args.build, name), os.X_OK))
+    if not targets:
+        fail("no fuzz_* programs in %s" % args.build)
+    baseline_path = args.baseline or os.path.join(args.corpus, "perf-baseline.json")
+
+    stored = {}
+    if os.path.exists(baseline_path):
+        with open(baseline_path) as f:
+            stored = json.load(f)
+
+    failed = False
+    log = open(args.log, "ab") if args.log else None
+    with tempfile.TemporaryDirectory(prefix="corpus-perf-") as work:
+        for target in targets:
+            binary = os.path.join(args.build, "fuzz_" + target)
+            if not os.path.isfile(binary):
+                fail("%s not found" % binary)
+            corpus = os.path.join(args.corpus, target)
+            if not os.path.isdir(corpus) or not os.listdir(corpus):
+                seed(target, corpus, work)
+            names = sorted(n for n in os.listdir(corpus) if os.path.isfile(os.path.join(corpus, n))) \
+                if os.path.isdir(corpus) else []
+            if not names:
+                print("%s: empty corpus, skipped" % target)
+                continue
+
+            files = [os.path.join(corpus, n) for n in names]
+            by_hash = {}
+            sizes = {}
+            for name, path in zip(names, files):
+                with open(path, "rb") as f:
+                    data = f.read()
+                by_hash.setdefault(fnv1a64(data), []).append(name)
+                sizes[name] = len(data)
+
+            timings, culprit, output = time_target(binary, files, args.runs, args.budget_us * 10, log)
+            result = {}
+            for h, samples in timings.items():
+                for name in by_hash.get(h, []):
+                    result[name] = round(median(samples) / 1000.0, 1)
+            if culprit is not None:
+                print("%s: CRASHED on %s; output follows" % (target, culprit))
+                print(output[-4000:])
+                failed = True
+                continue
+
+            if args.update_baseline:
+                stored[target] = result
+            elif target not in stored:
+                print("no baseline for %s; store one with --update-baseline" % target, file=sys.stderr)
+            if report(target, result, sizes, {} if args.update_baseline else stored.get(target, {}),
+                      args.tolerance, args.floor_us, args.budget_us, args.top):
+                failed = True
+    if log:
+        log.close()
+
+    if args.update_baseline:
+        os.makedirs(os.path.dirname(os.path.abspath(baseline_path)), exist_ok=True)
+        with open(baseline_path, "w") as f:
+            json.dump(stored, f, indent=2, sort_keys=True)
+            f.write("\n")
+        print("baseline written to %s" % baseline_path, file=sys.stderr)
+    if failed:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
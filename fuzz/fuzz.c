@@ -0,0 +1,106 @@
+/*
+ * fuzz.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ *
+ * Per-input timing shared by every fuzz target.
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include "fuzz.h"
+
+static FILE *timing_log = NULL;
+static uint64_t budget_us = 0;
+static int configured = 0;
+
+// Written from the watchdog, so formatted before each run
+static char overrun_message[160];
+static size_t overrun_length = 0;
+
+// An input still running at the budget never returns to be checked: stop
+// it where it is, the way libFuzzer's -timeout would
+static void on_overrun(int sig) {
+    (void)sig;
+    ssize_t written = write(STDERR_FILENO, overrun_message, overrun_length);
+    (void)written;
+    abort();
+}
+
+static void configure(void) {
+    const char *path = getenv("BH_FUZZ_TIMING");
+    const char *budget = getenv("BH_FUZZ_BUDGET_US");
+
+    if (path && *path) {
+        timing_log = fopen(path, "a");
+        if (!timing_log) {
+            fprintf(stderr, "fuzz: cannot open %s\n", path);
+        }
+    }
+    if (budget && *budget) {
+        budget_us = strtoull(budget, NULL, 10);
+    }
+    if (budget_us) {
+        signal(SIGPROF, on_overrun);
+    }
+    configured = 1;
+}
+
+static uint64_t thread_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void arm_watchdog(uint64_t us) {
+    struct itimerval timer = { { 0, 0 }, { (time_t)(us / 1000000), (suseconds_t)(us % 1000000) } };
+    setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+uint64_t fuzz_hash(const uint8_t *data, size_t size) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ data[i]) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+void fuzz_timed(fuzz_fn_t fn, const uint8_t *data, size_t size) {
+    uint64_t hash = 0;
+
+    if (!configured) {
+        configure();
+    }
+    if (timing_log || budget_us) {
+        hash = fuzz_hash(data, size);
+    }
+    if (budget_us) {
+        int n = snprintf(overrun_message, sizeof(overrun_message),
+                         "fuzz: input %016llx (%zu bytes) still running at the %llu us budget\n",
+                         (unsigned long long)hash, size, (unsigned long long)budget_us);
+        overrun_length = n > 0 && (size_t)n < sizeof(overrun_message) ? (size_t)n : 0;
+        arm_watchdog(budget_us);
+    }
+
+    uint64_t start = thread_time_ns();
+    fn(data, size);
+    uint64_t ns = thread_time_ns() - start;
+
+    if (budget_us) {
+        arm_watchdog(0);
+    }
+    if (timing_log) {
+        fprintf(timing_log, "%016llx %zu %llu\n", (unsigned long long)hash, size, (unsigned long long)ns);
+        fflush(timing_log);
+    }
+    if (budget_us && ns / 1000 > budget_us) {
+        fprintf(stderr, "fuzz: input %016llx (%zu bytes) took %llu us, over the %llu us budget\n",
+                (unsigned long long)hash, size, (unsigned long long)(ns / 1000), (unsigned long long)budget_us);
+        abort();
+    }
+}
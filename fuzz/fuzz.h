@@ -0,0 +1,40 @@
+/*
+ * fuzz.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ *
+ * Parser fuzz targets. Each target is one parser fed untrusted bytes,
+ * built for libFuzzer (clang -fsanitize=fuzzer) or, with standalone.c,
+ * as a plain program that replays corpus files. Every input is timed as
+ * well as run, so an input that makes a parser slow is a finding just
+ * like one that makes it crash.
+ */
+
+#ifndef BLOODHORN_FUZZ_H
+#define BLOODHORN_FUZZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// One run of a target over one input
+typedef void (*fuzz_fn_t)(const uint8_t *data, size_t size);
+
+// Run `fn` over the input and time it in thread CPU time.
+//   BH_FUZZ_TIMING=FILE    append "<fnv1a-64 of input, hex> <size> <ns>"
+//                          per run
+//   BH_FUZZ_BUDGET_US=N    abort() on any run that takes longer than N us,
+//                          or is still running then, so libFuzzer keeps the
+//                          input as a crash-* reproducer
+void fuzz_timed(fuzz_fn_t fn, const uint8_t *data, size_t size);
+
+// FNV-1a 64 of the input; how timing lines name corpus files
+uint64_t fuzz_hash(const uint8_t *data, size_t size);
+
+#define BH_FUZZ_TARGET(fn)                                                  \
+    int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {          \
+        fuzz_timed((fn), data, size);                                       \
+        return 0;                                                           \
+    }
+
+#endif // BLOODHORN_FUZZ_H
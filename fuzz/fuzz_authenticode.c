@@ -0,0 +1,36 @@
+/*
+ * fuzz_authenticode.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ *
+ * The streaming Authenticode hasher over arbitrary images. The first byte
+ * picks the piece size the image is fed in, so header parsing is also
+ * exercised across every split a file stream could make.
+ */
+
+#include "fuzz.h"
+#include "../security/authenticode.h"
+
+static void fuzz_authenticode(const uint8_t *data, size_t size) {
+    static authenticode_ctx_t ctx;
+    uint8_t digest[CRYPTO_SHA256_DIGEST_LENGTH];
+
+    if (size < 1 || size > UINT32_MAX) {
+        return;
+    }
+    uint32_t piece = 1u << (data[0] % 16);
+    data++;
+    size--;
+
+    authenticode_init(&ctx);
+    while (size) {
+        uint32_t len = size < piece ? (uint32_t)size : piece;
+        authenticode_update(&ctx, data, len);
+        data += len;
+        size -= len;
+    }
+    authenticode_final(&ctx, digest);
+}
+
+BH_FUZZ_TARGET(fuzz_authenticode)
@@ -0,0 +1,37 @@
+/*
+ * fuzz_config_json.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ *
+ * config_json_parse over arbitrary text, then every value it hands back
+ * through config_sv_unescape, as the config loader does.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "fuzz.h"
+#include "../config/config_json.h"
+
+#define FUZZ_JSON_MAX_ENTRIES   256
+
+static void fuzz_config_json(const uint8_t *data, size_t size) {
+    static struct config_json entries[FUZZ_JSON_MAX_ENTRIES];
+    char value[512];
+
+    // The parser takes a C string: stop at the first NUL, as the loader would
+    char *json = (char *)malloc(size + 1);
+    if (!json) {
+        return;
+    }
+    memcpy(json, data, size);
+    json[size] = '\0';
+
+    int count = config_json_parse(json, entries, FUZZ_JSON_MAX_ENTRIES);
+    for (int i = 0; i < count; i++) {
+        config_sv_unescape(entries[i].value, entries[i].escaped, value, sizeof(value));
+    }
+    free(json);
+}
+
+BH_FUZZ_TARGET(fuzz_config_json)
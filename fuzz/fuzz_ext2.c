@@ -0,0 +1,18 @@
+/*
+ * fuzz_ext2.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ *
+ * ext2 images: the superblock and group descriptors at mount, then inodes,
+ * directory blocks and block maps through the walk.
+ */
+
+#include "fuzz.h"
+#include "fuzz_fs.h"
+
+static void fuzz_ext2(const uint8_t *data, size_t size) {
+    fuzz_fs_walk("ext2", data, size);
+}
+
+BH_FUZZ_TARGET(fuzz_ext2)
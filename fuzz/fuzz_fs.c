@@ -0,0 +1,123 @@
+/*
+ * fuzz_fs.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ *
+ * The input as a read-only block device, and the walk the filesystem
+ * targets share.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "fuzz_fs.h"
+#include "../fs/fs_mount.h"
+#include "bloodhorn/trace.h"
+#include "bloodhorn/parallel.h"
+
+#define FUZZ_FS_MOUNT       "/fuzz"
+#define FUZZ_FS_MAX_DEPTH   4
+#define FUZZ_FS_MAX_ENTRIES 256     // Entries visited per input
+#define FUZZ_FS_LIST_SIZE   (16 * 1024)
+#define FUZZ_FS_READ_SIZE   (64 * 1024)
+
+typedef struct {
+    block_device_t dev;
+    const uint8_t *data;
+    uint32_t visited;
+} fuzz_disk_t;
+
+// The timeline tracer lives in libb; nothing here is on a boot path
+bh_trace_span_t bh_trace_begin(const char* name) {
+    (void)name;
+    return BH_TRACE_INVALID_SPAN;
+}
+
+void bh_trace_end(bh_trace_span_t span) {
+    (void)span;
+}
+
+// So does the task pool; here parallel work runs on the caller
+bh_uint32_t bh_parallel_workers(void) {
+    return 1;
+}
+
+void bh_parallel_for(bh_size_t count, bh_size_t grain, bh_parallel_body_t body, void* arg) {
+    (void)grain;
+    if (count > 0) {
+        body(0, count, arg);
+    }
+}
+
+static int fuzz_disk_read(block_device_t *dev, uint64_t sector, uint32_t count, void *buf) {
+    fuzz_disk_t *disk = (fuzz_disk_t *)dev->context;
+
+    if (sector >= dev->sector_count || count > dev->sector_count - sector) {
+        return -1;
+    }
+    memcpy(buf, disk->data + sector * BLOCKDEV_SECTOR_SIZE, (size_t)count * BLOCKDEV_SECTOR_SIZE);
+    return 0;
+}
+
+static void walk_dir(fuzz_disk_t *disk, const char *path, uint32_t depth) {
+    static char lists[FUZZ_FS_MAX_DEPTH + 1][FUZZ_FS_LIST_SIZE];
+    static uint8_t read_buf[FUZZ_FS_READ_SIZE];
+    char *list = lists[depth];
+
+    int len = fs_list_dir(path, list, FUZZ_FS_LIST_SIZE - 1);
+    if (len <= 0) {
+        return;
+    }
+    list[len < FUZZ_FS_LIST_SIZE - 1 ? len : FUZZ_FS_LIST_SIZE - 1] = '\0';
+
+    for (char *name = list, *end; *name && disk->visited < FUZZ_FS_MAX_ENTRIES; name = end + 1) {
+        end = strchr(name, '\n');
+        if (!end) {
+            break;
+        }
+        *end = '\0';
+        if (!*name || !strcmp(name, ".") || !strcmp(name, "..")) {
+            continue;
+        }
+        disk->visited++;
+
+        char child[FS_DCACHE_PATH_MAX];
+        uint32_t size;
+        bool is_dir;
+        if ((size_t)snprintf(child, sizeof(child), "%s/%s", path, name) >= sizeof(child) ||
+            fs_get_info(child, &size, &is_dir) != 0) {
+            continue;
+        }
+        if (is_dir) {
+            if (depth < FUZZ_FS_MAX_DEPTH) {
+                walk_dir(disk, child, depth + 1);
+            }
+        } else {
+            fs_read(child, read_buf, size < FUZZ_FS_READ_SIZE ? size : FUZZ_FS_READ_SIZE, 0);
+        }
+    }
+}
+
+void fuzz_fs_walk(const char *fstype, const uint8_t *data, size_t size) {
+    static fuzz_disk_t disk;
+    static bool initialized = false;
+
+    if (!initialized) {
+        fs_init();
+        disk.dev.name = "fuzz";
+        disk.dev.read = fuzz_disk_read;
+        disk.dev.context = &disk;
+        initialized = true;
+    }
+    disk.data = data;
+    disk.dev.sector_count = size / BLOCKDEV_SECTOR_SIZE;
+    disk.visited = 0;
+
+    // Nothing cached may outlive the input it came from
+    blockdev_invalidate_device(&disk.dev);
+    if (disk.dev.sector_count && fs_mount_device(FUZZ_FS_MOUNT, fstype, &disk.dev, 0, NULL) == 0) {
+        walk_dir(&disk, FUZZ_FS_MOUNT, 0);
+        fs_unmount(FUZZ_FS_MOUNT);
+    }
+    blockdev_invalidate_device(&disk.dev);
+}
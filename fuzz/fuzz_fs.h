@@ -0,0 +1,21 @@
+/*
+ * fuzz_fs.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ *
+ * Filesystem fuzz targets: the input is a whole disk image.
+ */
+
+#ifndef BLOODHORN_FUZZ_FS_H
+#define BLOODHORN_FUZZ_FS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Mount the input as `fstype` through the VFS and do what a boot does
+// with a volume: list directories a few levels down, stat every entry
+// and read the start of every file. A trailing partial sector is dropped.
+void fuzz_fs_walk(const char *fstype, const uint8_t *data, size_t size);
+
+#endif // BLOODHORN_FUZZ_FS_H
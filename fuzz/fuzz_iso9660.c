@@ -0,0 +1,18 @@
+/*
+ * fuzz_iso9660.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ *
+ * ISO 9660 images: volume descriptors and the path table at mount, then
+ * directory records (Rock Ridge and Joliet included) through the walk.
+ */
+
+#include "fuzz.h"
+#include "fuzz_fs.h"
+
+static void fuzz_iso9660(const uint8_t *data, size_t size) {
+    fuzz_fs_walk("iso9660", data, size);
+}
+
+BH_FUZZ_TARGET(fuzz_iso9660)
@@ -0,0 +1,128 @@
+/*
+ * fuzz_multiboot2.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ *
+ * Multiboot 2 kernels: the header search, the header tag walk and the ELF
+ * program headers, through boot_multiboot2_kernel. The firmware side is
+ * stubbed: every copy the loader queues is checked against the input, and
+ * placing the boot information fails, so the boot stops short of the jump
+ * to the kernel.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "fuzz.h"
+#include "../boot/Arch32/multiboot2.h"
+#include "../boot/Arch32/loadseg.h"
+#include "../boot/Arch32/fwinfo.h"
+#include "bloodhorn/memory.h"
+
+static const uint8_t *input;
+static size_t input_size;
+
+void loadseg_queue(loadseg_batch_t* batch, uint64_t dest, const uint8_t* src, uint64_t len) {
+    (void)batch;
+    (void)dest;
+    // Touch both ends of the source, so ASan sees any range that strays
+    // outside the image
+    if (src && len) {
+        if (src < input || len > input_size || src - input > (ptrdiff_t)(input_size - len)) {
+            abort();
+        }
+        volatile uint8_t sink = src[0];
+        sink = src[len - 1];
+        (void)sink;
+    }
+}
+
+void loadseg_run(loadseg_batch_t* batch) {
+    batch->count = 0;
+}
+
+int loadseg_place(uint64_t size, uint64_t align, uint64_t min, uint64_t max, uint32_t flags, uint64_t* addr) {
+    (void)size;
+    (void)align;
+    (void)min;
+    (void)max;
+    (void)flags;
+    (void)addr;
+    return -1;
+}
+
+int loadseg_open(loadseg_t* ls, const char* path) {
+    (void)ls;
+    (void)path;
+    return -1;
+}
+
+int loadseg_load(loadseg_t* ls, uint64_t offset, uint64_t filesz, uint64_t dest, uint64_t memsz) {
+    (void)ls;
+    (void)offset;
+    (void)filesz;
+    (void)dest;
+    (void)memsz;
+    return -1;
+}
+
+uint32_t fwinfo_memory_map_to(void* table, uint32_t max, fwinfo_mmap_put_t put) {
+    (void)table;
+    (void)max;
+    (void)put;
+    return 0;
+}
+
+uint32_t fwinfo_memory_map_again(void* table, uint32_t max, fwinfo_mmap_put_t put) {
+    (void)table;
+    (void)max;
+    (void)put;
+    return 0;
+}
+
+int fwinfo_framebuffer(fwinfo_framebuffer_t* fb) {
+    (void)fb;
+    return -1;
+}
+
+const void* fwinfo_acpi_rsdp(uint32_t* size, int* is_v2) {
+    (void)size;
+    (void)is_v2;
+    return NULL;
+}
+
+const void* fwinfo_smbios(uint32_t* size, uint8_t* major, uint8_t* minor) {
+    (void)size;
+    (void)major;
+    (void)minor;
+    return NULL;
+}
+
+int load_image_file(const char* path, uint8_t** data, uint32_t* size) {
+    (void)path;
+    (void)data;
+    (void)size;
+    return -1;
+}
+
+int get_file_size(const char* path, uint32_t* size) {
+    (void)path;
+    (void)size;
+    return -1;
+}
+
+bh_status_t bh_memory_copy(void* dest, const void* src, bh_size_t size) {
+    memcpy(dest, src, size);
+    return BH_SUCCESS;
+}
+
+static void fuzz_multiboot2(const uint8_t *data, size_t size) {
+    if (size > UINT32_MAX) {
+        return;
+    }
+    input = data;
+    input_size = size;
+    boot_multiboot2_kernel((uint8_t *)data, (uint32_t)size, NULL, "");
+}
+
+BH_FUZZ_TARGET(fuzz_multiboot2)
@@ -0,0 +1,19 @@
+/*
+ * fuzz_squashfs.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ *
+ * SquashFS images: the superblock and fragment index at mount, then
+ * metadata blocks, inodes, directory listings and indexes, block lists
+ * and compressed data and fragment blocks through the walk.
+ */
+
+#include "fuzz.h"
+#include "fuzz_fs.h"
+
+static void fuzz_squashfs(const uint8_t *data, size_t size) {
+    fuzz_fs_walk("squashfs", data, size);
+}
+
+BH_FUZZ_TARGET(fuzz_squashfs)
@@ -0,0 +1,105 @@
+/*
+ * standalone.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ *
+ * main() for a fuzz target built without libFuzzer: every file named on
+ * the command line (or found directly inside a named directory) is run
+ * through LLVMFuzzerTestOneInput. Takes libFuzzer's -runs=N to run each
+ * input N times and ignores its other -flags, so corpus_perf.py drives
+ * both builds the same way.
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "fuzz.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static long runs = 1;
+
+static int run_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    uint8_t *data = NULL;
+    long size;
+
+    if (!f) {
+        fprintf(stderr, "standalone: cannot open %s\n", path);
+        return -1;
+    }
+    if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0 || fseek(f, 0, SEEK_SET) != 0) {
+        fclose(f);
+        fprintf(stderr, "standalone: cannot read %s\n", path);
+        return -1;
+    }
+    // An exact-size copy, so ASan sees reads past the end of the input
+    data = (uint8_t *)malloc(size ? (size_t)size : 1);
+    if (!data || fread(data, 1, (size_t)size, f) != (size_t)size) {
+        free(data);
+        fclose(f);
+        fprintf(stderr, "standalone: cannot read %s\n", path);
+        return -1;
+    }
+    fclose(f);
+
+    for (long i = 0; i < runs; i++) {
+        LLVMFuzzerTestOneInput(data, (size_t)size);
+    }
+    free(data);
+    return 0;
+}
+
+static int run_path(const char *path) {
+    struct stat st;
+
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "standalone: %s not found\n", path);
+        return -1;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        return run_file(path);
+    }
+
+    DIR *dir = opendir(path);
+    struct dirent *entry;
+    int status = 0;
+    if (!dir) {
+        fprintf(stderr, "standalone: cannot list %s\n", path);
+        return -1;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        char child[4096];
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        if (stat(child, &st) == 0 && S_ISREG(st.st_mode) && run_file(child) != 0) {
+            status = -1;
+        }
+    }
+    closedir(dir);
+    return status;
+}
+
+int main(int argc, char **argv) {
+    int status = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "-runs=", 6) == 0) {
+            runs = strtol(argv[i] + 6, NULL, 10);
+            if (runs < 1) {
+                runs = 1;
+            }
+        }
+    }
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-' && run_path(argv[i]) != 0) {
+            status = 1;
+        }
+    }
+    return status;
+}
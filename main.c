@@ -64,11 +64,14 @@
 #include <Library/UefiLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/UefiRuntimeServicesTableLib.h>
+#include <Library/BaseLib.h>
 #include <Library/BaseMemoryLib.h>
 #include <Library/MemoryAllocationLib.h>
 #include <Library/TimerLib.h>
 #include <Library/PerformanceLib.h>
+#include <Guid/Fdt.h>
 #include "uefi/graphics.h"
+#include "uefi/uefi.h"
 #include "boot/theme.h"
 #include "boot/localization.h"
 #include "boot/mouse.h"
@@ -89,14 +92,18 @@
 
 #include "boot/menu.h"                // The graphical boot menu - user's gateway to choices
 #include "boot/theme.h"               // Theme system - because bootloaders should look good
+#include "boot/assets.h"              // Prebuilt theme/font/locale bundle
+#include "boot/payload.h"             // Signed kernel/initrd/settings bundle for appliances
+#include "boot/image.h"               // Background image decoding (BMP, PNG, QOI)
 #include "boot/localization.h"        // Multi-language support - we speak your language!
 #include "boot/font.h"                // Font rendering system - for pretty text
 #include "boot/mouse.h"               // Mouse support - point and click booting!
 #include "boot/secure.h"              // Security features - keeping you safe
 #include "fs/fat32.h"                 // FAT32 filesystem support - most common format
+#include "fs/blockdev.h"               // Shared block cache under the filesystem drivers
 #include "security/crypto.h"          // Cryptographic functions - encryption, hashing
 #include "security/tpm2.h"            // TPM 2.0 integration - hardware security
-#include "recovery/shell.h"            // Recovery shell - when things go wrong
+#include "boot/plugin.h"              // Recovery shell, loaded when things go wrong
 #include "net/pxe.h"                  // PXE network boot - boot from the network
 #include "boot/Arch32/powerpc.h"     // PowerPC architecture support
 #include "boot/BootManagerProtocol/BootManagerProtocol.h"  // Boot Manager Protocol
@@ -131,9 +138,17 @@
 
 #include "config/config_ini.h"        // INI file configuration - simple and readable
 #include "config/config_json.h"       // JSON configuration - structured and modern
+#include "config/config_parse.h"      // Zero-copy INI/JSON tokenizers
+#include "rust/bhshim/bhshim.h"        // Rust config parser, page allocator
 #include "config/config_env.h"        // Environment variable configuration
 #include "boot/libb/include/bloodhorn/bloodhorn.h"  // BloodHorn library integration
+#include "boot/libb/include/bloodhorn/trace.h"      // Boot-phase timeline
+#include "boot/libb/include/bloodhorn/counters.h"   // Hot-path counters for GetPerformanceCounters
+#include "boot/libb/include/bloodhorn/hash.h"       // FNV-1a for the config and override tables
 #include "security/sha512.h"          // SHA-512 hashing - for kernel verification
+#include "security/hash_manifest.h"   // Signed allowlist of kernel hashes
+#include "security/secure_boot.h"     // Appended signature lengths
+#include "security/authenticode.h"    // PE image hashes for dbx
 
 // =============================================================================
 // COREBOOT INTEGRATION - Hybrid firmware support
@@ -151,13 +166,6 @@
 // Global variables maintaining bootloader state throughout execution.
 // Each variable tracks specific information required during the boot process.
 
-// File hash verification structure for security checking
-// Stores the expected SHA-512 hash of files to be verified
-typedef struct {
-    char path[256];                    // File path (relative to boot device)
-    uint8_t expected_hash[64];         // SHA-512 hash (64 bytes = 512 bits)
-} FILE_HASH;
-
 // Global TPM 2.0 protocol handle for hardware security operations
 // Points to the TPM protocol interface when TPM is available
 static EFI_TCG2_PROTOCOL* gTcg2Protocol = NULL;
@@ -179,8 +187,15 @@ STATIC BOOLEAN gCorebootAvailable = FALSE;
 static bh_font_t gDefaultFont = {0};    // Regular text font
 static bh_font_t gHeaderFont = {0};     // Header/title font
 
-// Global array of known hashes for kernel verification (when security is enabled)
-STATIC FILE_HASH g_known_hashes[1] = {0};
+// Allowlist of kernel and chainload SHA-512 or BLAKE3 hashes ([boot]
+// known_hashes), loaded once per boot; the entries point into
+// gKnownHashesFile
+STATIC hash_manifest_t gKnownHashes;
+STATIC LOADED_FILE gKnownHashesFile;
+
+// Set when [boot] known_hashes names a manifest: every image must then be
+// listed, and none is if the manifest could not be loaded
+STATIC BOOLEAN gKnownHashesRequired = FALSE;
 
 // Forward declaration for Coreboot main entry point
 // Entry point when running as a Coreboot payload
@@ -190,6 +205,40 @@ extern VOID EFIAPI CorebootMain(VOID* coreboot_table, VOID* payload);
 // Affects initialization process and service selection
 STATIC BOOLEAN gRunningAsCorebootPayload = FALSE;
 
+// Write the boot timeline to the ESP and the console before ExitBootServices
+// ([boot] boot_trace)
+STATIC BOOLEAN gBootTraceExport = FALSE;
+
+// Skip re-hashing kernels an earlier boot already verified ([boot] verify_cache)
+STATIC BOOLEAN gVerifyCache = FALSE;
+
+// Remember handed-over images for the warm-reboot fast path ([boot] fast_reboot)
+STATIC BOOLEAN gFastReboot = FALSE;
+
+// Vendor GUID of BloodHorn's own NV variables
+extern EFI_GUID gBloodHornVariableGuid;
+
+// Auto-boot countdown, also advanced from inside a kernel prefetch
+typedef struct {
+    EFI_EVENT       Second;         // Periodic one-second timer
+    INTN            Seconds;        // Left on the countdown
+    CONST CHAR8*    Entry;          // Name shown in the prompt
+    BOOLEAN         KeyPressed;     // The user asked for the menu
+} AUTOBOOT_COUNTDOWN;
+
+// Kernel loaded and verified while the countdown ran
+typedef struct {
+    LOADED_FILE     File;
+    EFI_STATUS      Status;         // EFI_NOT_STARTED until a prefetch ran
+} KERNEL_PREFETCH;
+
+STATIC VOID AutobootPrompt(IN CONST AUTOBOOT_COUNTDOWN* Countdown);
+STATIC VOID PrefetchKernel(IN BOOT_MANAGER_PROTOCOL* BootManager, IN OUT AUTOBOOT_COUNTDOWN* Countdown,
+                           OUT KERNEL_PREFETCH* Prefetch);
+STATIC VOID ReleaseKernelPrefetch(IN OUT KERNEL_PREFETCH* Prefetch);
+STATIC VOID TryFastReboot(VOID);
+STATIC EFI_STATUS TryPayloadBoot(VOID);
+
 // =============================================================================
 // BOOT CONFIGURATION STRUCTURE - bootloader settings
 // =============================================================================
@@ -200,7 +249,7 @@ typedef struct {
     char default_entry[64];           // Which boot option to select by default
     int menu_timeout;                  // How long to wait before auto-booting (seconds)
     char kernel[128];                  // Path to the default kernel to boot
-    char initrd[128];                  // Path to the initrd (initial RAM disk)
+    char initrd[512];                  // Initrd path, or several separated by ';' and concatenated in order
     char cmdline[256];                  // Kernel command line parameters
     bool tpm_enabled;                  // Should we use TPM 2.0 for security?
     bool secure_boot;                  // Should we enable secure boot features?
@@ -209,7 +258,24 @@ typedef struct {
     uint32_t font_size;                // Size of regular font in pixels
     uint32_t header_font_size;         // Size of header font in pixels
     char language[8];                  // Language code (e.g., "en", "fr", "de")
-    bool enable_networking;            // Should we initialize network interfaces?
+    char background_image[128];        // Theme background (BMP, PNG or QOI)
+    bool enable_networking;            // Bring the NICs up in the background from the start?
+    bool boot_trace;                   // Export the boot timeline to boottrace.json?
+    bool trace_memory;                 // Count allocations so the timeline shows what each phase holds?
+    bool profiler;                     // Sample the boot path into bootprofile.txt?
+    bool verify_cache;                 // Trust the verified-image cache on warm boots?
+    char known_hashes[128];            // Signed SHA-512 allowlist every kernel must be in (empty: off)
+    char net_cache[64];                // ESP directory keeping PXE images by SHA-256 (empty: off)
+    bool tftp_parallel;                // Fetch the PXE kernel and initrd over two TFTP sessions at once?
+    char nvme_tcp[256];                // NVMe/TCP disk "a.b.c.d[:port]/subsystem-nqn" to mount at /net (empty: off)
+    bool kaslr;                        // Place relocatable kernels at a random address?
+    bool lazy_initrd;                  // Leave the Linux initrd on disk for the kernel to fetch? (experimental)
+    bool efistub;                      // Start Linux kernels through their EFI stub when they have one?
+    bool fast_reboot;                  // Hand resident BloodChain images back after a warm reset?
+    char self_tests[8];                // Crypto self-tests: "off", "cached" or "always"
+    int self_test_interval;            // Hours after which cached self-tests run again (0: never)
+    char mb1_modules[512];             // Multiboot 1 modules, in the same form
+    char mb2_modules[512];             // Multiboot 2 modules: "path [cmdline]" entries separated by ';'
 } BOOT_CONFIG;
 
 // =============================================================================
@@ -249,6 +315,11 @@ typedef struct {
     // Kernel command line parameters
     // Specifies root filesystem, drivers to load, debug options, etc.
     CHAR8 cmdline[256];                 // Kernel command line (null-terminated ASCII)
+
+    // Memory map: sorted COREBOOT_MEM_ENTRY records (CB_MEM_* types) with
+    // adjacent ranges merged; 0 when there was no room to place one
+    UINT64 memory_map_addr;             // Physical address of the first entry
+    UINT32 memory_map_entries;          // Number of entries
 } COREBOOT_BOOT_PARAMS;
 
 // =============================================================================
@@ -273,6 +344,143 @@ EFI_STATUS EFIAPI BootAarch64Wrapper(VOID);           // ARM64 kernels
 EFI_STATUS EFIAPI BootRiscv64Wrapper(VOID);           // RISC-V 64 kernels
 EFI_STATUS EFIAPI BootLoongarch64Wrapper(VOID);       // LoongArch 64 kernels
 
+// =============================================================================
+// BOOT TRACE - Timeline clock and export
+// =============================================================================
+//
+// libb's tracer takes its timestamps from the TimerLib performance counter.
+// The timeline is saved as Chrome trace JSON (load it in chrome://tracing or
+// Perfetto) and stays readable from the recovery shell with "trace".
+
+#define BOOT_TRACE_FILE L"boottrace.json"
+#define BOOT_PROFILE_FILE L"bootprofile.txt"
+#define ALLOC_PROFILE_FILE L"allocprofile.txt"
+
+// Non-zero UINT8 under gBloodHornVariableGuid: count allocations per
+// call site from the first one on (no config file needed, so it works
+// on machines that fail before the config loads)
+#define ALLOC_PROFILE_VARIABLE L"BloodHornAllocProfile"
+#define BOOT_LOG_FILE   "bootlog.txt"
+
+STATIC UINT64 mPerfCounterStart = 0;
+STATIC UINT64 mPerfCounterEnd = 0;
+STATIC UINT64 mPerfCounterFrequency = 0;
+
+static bh_uint64_t bh_uefi_get_performance_frequency(void) {
+    if (mPerfCounterFrequency == 0) {
+        mPerfCounterFrequency = GetPerformanceCounterProperties(&mPerfCounterStart, &mPerfCounterEnd);
+    }
+    return mPerfCounterFrequency;
+}
+
+static bh_uint64_t bh_uefi_get_performance_counter(void) {
+    UINT64 Ticks;
+
+    bh_uefi_get_performance_frequency();
+    Ticks = GetPerformanceCounter();
+    // Some timers count down; present a monotonically increasing value
+    if (mPerfCounterStart > mPerfCounterEnd) {
+        return mPerfCounterStart - Ticks;
+    }
+    return Ticks - mPerfCounterStart;
+}
+
+// The boot trace's memory column, while the allocation profiler runs
+static bh_bool_t bh_uefi_get_memory_in_use(bh_uint64_t* bytes) {
+    if (!AllocProfilerRunning()) {
+        return BH_FALSE;
+    }
+    *bytes = AllocProfilerLive();
+    return BH_TRUE;
+}
+
+/**
+ * The device tree the firmware installed, for the RISC-V and LoongArch
+ * handoffs to scan and pass on; NULL on firmware that has none
+ */
+const void* get_firmware_fdt(void) {
+    VOID* Table = NULL;
+
+    if (EFI_ERROR(EfiGetSystemConfigurationTable(&gFdtTableGuid, &Table))) {
+        return NULL;
+    }
+    return Table;
+}
+
+/**
+ * Save the boot timeline to the ESP as Chrome trace JSON
+ *
+ * Called right before ExitBootServices, so the exit_boot_services span is
+ * still open in the exported file.
+ */
+STATIC VOID SaveBootTrace(VOID) {
+    bh_size_t Length = 0;
+    CHAR8* Json;
+    EFI_STATUS Status;
+
+    if (!gBootTraceExport) {
+        return;
+    }
+
+    // The same timeline as a table on the console, so it also reaches a
+    // serial log (bench/bootbench.py reads it from there)
+    Print(L"Boot timeline:\n");
+    bh_trace_print();
+    if (AllocProfilerPeak() != 0) {
+        Print(L"Peak memory: %lu KiB\n", AllocProfilerPeak() / 1024);
+    }
+
+    bh_trace_export_chrome_json(NULL, 0, &Length);
+    Json = AllocatePool(Length + 1);
+    if (!Json) {
+        return;
+    }
+
+    if (bh_trace_export_chrome_json((char*)Json, Length + 1, &Length) == BH_SUCCESS) {
+        Status = WriteBootFile(BOOT_TRACE_FILE, Json, Length);
+        if (EFI_ERROR(Status)) {
+            Print(L"Failed to save boot trace: %r\n", Status);
+        }
+    }
+    FreePool(Json);
+}
+
+/**
+ * Stop the sampling profiler ([boot] profiler) and save its histogram
+ *
+ * The timer has to be gone before ExitBootServices; the file is written
+ * only if the profiler was running.
+ */
+STATIC VOID SaveBootProfile(VOID) {
+    EFI_STATUS Status;
+
+    if (!BootProfilerRunning()) {
+        return;
+    }
+    InstallBootProfiler(FALSE);
+    Status = BootProfilerSave(BOOT_PROFILE_FILE);
+    if (EFI_ERROR(Status)) {
+        Print(L"Failed to save boot profile: %r\n", Status);
+    }
+}
+
+/**
+ * Unhook the allocation profiler (BloodHornAllocProfile) and save its
+ * per-site counters
+ */
+STATIC VOID SaveAllocProfile(VOID) {
+    EFI_STATUS Status;
+
+    if (!AllocProfilerRunning()) {
+        return;
+    }
+    InstallAllocProfiler(FALSE);
+    Status = AllocProfilerSave(ALLOC_PROFILE_FILE);
+    if (EFI_ERROR(Status)) {
+        Print(L"Failed to save allocation profile: %r\n", Status);
+    }
+}
+
 // =============================================================================
 // CONFIGURATION PARSING HELPERS - Configuration file utilities
 // =============================================================================
@@ -280,24 +488,185 @@ EFI_STATUS EFIAPI BootLoongarch64Wrapper(VOID);       // LoongArch 64 kernels
 // Helper functions for parsing configuration from different sources.
 // Each function handles a specific format or parsing task.
 
+// How a configuration key is stored in BOOT_CONFIG
+typedef enum { CONFIG_FIELD_STR, CONFIG_FIELD_INT, CONFIG_FIELD_BOOL } CONFIG_FIELD_TYPE;
+
+typedef struct {
+    CONST CHAR8* Section;
+    CONST CHAR8* Key;
+    CONFIG_FIELD_TYPE Type;
+    UINT16 Offset;
+    UINT16 Size;
+} CONFIG_FIELD;
+
+#define CONFIG_FIELD_ENTRY(Sec, Name, Type, Field) \
+    { Sec, Name, Type, (UINT16)OFFSET_OF(BOOT_CONFIG, Field), (UINT16)sizeof(((BOOT_CONFIG*)0)->Field) }
+
+// Perfect hash over the key names: FNV-1a of the lowercased key from
+// CONFIG_SCHEMA_SEED, top CONFIG_SCHEMA_BITS bits. The seed was searched
+// offline so that no two keys share a slot, and every key is stored in its
+// own slot, so a lookup is one hash and one compare. A new key must take a
+// free slot under this seed, or pick a new seed and re-slot the table.
+#define CONFIG_SCHEMA_SEED  0xCA
+#define CONFIG_SCHEMA_BITS  5
+
+STATIC CONST CONFIG_FIELD mConfigSchema[1 << CONFIG_SCHEMA_BITS] = {
+    [0]  = CONFIG_FIELD_ENTRY("boot",  "known_hashes",       CONFIG_FIELD_STR,  known_hashes),
+    [1]  = CONFIG_FIELD_ENTRY("boot",  "multiboot2_modules", CONFIG_FIELD_STR,  mb2_modules),
+    [2]  = CONFIG_FIELD_ENTRY("boot",  "profiler",           CONFIG_FIELD_BOOL, profiler),
+    [3]  = CONFIG_FIELD_ENTRY("linux", "kernel",             CONFIG_FIELD_STR,  kernel),
+    [5]  = CONFIG_FIELD_ENTRY("boot",  "kaslr",              CONFIG_FIELD_BOOL, kaslr),
+    [6]  = CONFIG_FIELD_ENTRY("boot",  "menu_timeout",       CONFIG_FIELD_INT,  menu_timeout),
+    [7]  = CONFIG_FIELD_ENTRY("boot",  "trace_memory",       CONFIG_FIELD_BOOL, trace_memory),
+    [8]  = CONFIG_FIELD_ENTRY("boot",  "self_test_interval", CONFIG_FIELD_INT,  self_test_interval),
+    [9]  = CONFIG_FIELD_ENTRY("boot",  "tftp_parallel",      CONFIG_FIELD_BOOL, tftp_parallel),
+    [10] = CONFIG_FIELD_ENTRY("linux", "cmdline",            CONFIG_FIELD_STR,  cmdline),
+    [11] = CONFIG_FIELD_ENTRY("boot",  "lazy_initrd",        CONFIG_FIELD_BOOL, lazy_initrd),
+    [12] = CONFIG_FIELD_ENTRY("boot",  "verify_cache",       CONFIG_FIELD_BOOL, verify_cache),
+    [14] = CONFIG_FIELD_ENTRY("boot",  "multiboot1_modules", CONFIG_FIELD_STR,  mb1_modules),
+    [15] = CONFIG_FIELD_ENTRY("boot",  "language",           CONFIG_FIELD_STR,  language),
+    [16] = CONFIG_FIELD_ENTRY("boot",  "net_cache",          CONFIG_FIELD_STR,  net_cache),
+    [18] = CONFIG_FIELD_ENTRY("boot",  "secure_boot",        CONFIG_FIELD_BOOL, secure_boot),
+    [19] = CONFIG_FIELD_ENTRY("boot",  "boot_trace",         CONFIG_FIELD_BOOL, boot_trace),
+    [21] = CONFIG_FIELD_ENTRY("boot",  "fast_reboot",        CONFIG_FIELD_BOOL, fast_reboot),
+    [22] = CONFIG_FIELD_ENTRY("boot",  "enable_networking",  CONFIG_FIELD_BOOL, enable_networking),
+    [23] = CONFIG_FIELD_ENTRY("boot",  "nvme_tcp",           CONFIG_FIELD_STR,  nvme_tcp),
+    [25] = CONFIG_FIELD_ENTRY("boot",  "tpm_enabled",        CONFIG_FIELD_BOOL, tpm_enabled),
+    [26] = CONFIG_FIELD_ENTRY("linux", "initrd",             CONFIG_FIELD_STR,  initrd),
+    [27] = CONFIG_FIELD_ENTRY("boot",  "default",            CONFIG_FIELD_STR,  default_entry),
+    [28] = CONFIG_FIELD_ENTRY("boot",  "use_gui",            CONFIG_FIELD_BOOL, use_gui),
+    [29] = CONFIG_FIELD_ENTRY("theme", "background_image",   CONFIG_FIELD_STR,  background_image),
+    [30] = CONFIG_FIELD_ENTRY("linux", "efistub",            CONFIG_FIELD_BOOL, efistub),
+    [31] = CONFIG_FIELD_ENTRY("boot",  "self_tests",         CONFIG_FIELD_STR,  self_tests),
+};
+
+// Largest string field, the bound of the unescape buffer
+#define CONFIG_FIELD_STR_MAX  sizeof(((BOOT_CONFIG*)0)->mb1_modules)
+
+STATIC UINT32 ConfigKeyHash(config_sv key) {
+    UINT32 h = CONFIG_SCHEMA_SEED;
+    for (UINTN i = 0; i < key.len; i++) {
+        CHAR8 c = key.ptr[i];
+        if (c >= 'A' && c <= 'Z') c = (CHAR8)(c - 'A' + 'a');
+        h = bh_fnv1a_step(h, (UINT8)c);
+    }
+    return h >> (32 - CONFIG_SCHEMA_BITS);
+}
+
 /**
- * Case-insensitive string comparison
- * 
- * Compares two strings without regard to case. Useful for configuration
- * parsing where "Linux", "linux", and "LINUX" should be equivalent.
- * 
- * @param a First string to compare
- * @param b Second string to compare
- * @return TRUE if strings match (case-insensitive), FALSE otherwise
+ * Parse "true/1/yes" or "false/0/no" (case-insensitive)
+ */
+STATIC BOOLEAN ParseConfigBool(config_sv v, bool* out) {
+    if (config_sv_ieq(v, "true") || config_sv_ieq(v, "1") || config_sv_ieq(v, "yes")) {
+        *out = TRUE;
+        return TRUE;
+    }
+    if (config_sv_ieq(v, "false") || config_sv_ieq(v, "0") || config_sv_ieq(v, "no")) {
+        *out = FALSE;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/**
+ * Parse an unsigned decimal that fits in an int
+ */
+STATIC BOOLEAN ParseConfigInt(config_sv v, int* out) {
+    UINT32 val = 0;
+    if (v.len == 0) return FALSE;
+    for (UINTN i = 0; i < v.len; i++) {
+        if (v.ptr[i] < '0' || v.ptr[i] > '9' || val > (0x7FFFFFFF - 9) / 10) return FALSE;
+        val = val * 10 + (UINT32)(v.ptr[i] - '0');
+    }
+    *out = (int)val;
+    return TRUE;
+}
+
+typedef struct {
+    BOOT_CONFIG* Config;
+    CONST CHAR16* Source;
+} CONFIG_APPLY;
+
+/**
+ * Store one entry through the schema. Unknown keys are skipped; a value
+ * that is malformed or too long for its field is reported and the field
+ * keeps its previous setting.
+ */
+STATIC int ApplyConfigEntry(void* ctx, const config_entry* e) {
+    CONFIG_APPLY* apply = (CONFIG_APPLY*)ctx;
+    CONST CONFIG_FIELD* field = &mConfigSchema[ConfigKeyHash(e->key)];
+    VOID* target;
+    BOOLEAN ok = FALSE;
+
+    if (!field->Key || !config_sv_ieq(e->key, field->Key)) {
+        return 0;
+    }
+    // Keys outside any section (flat JSON) go wherever the schema puts them
+    if (e->section.len != 0 && !config_sv_ieq(e->section, field->Section)) {
+        return 0;
+    }
+
+    target = (UINT8*)apply->Config + field->Offset;
+    switch (field->Type) {
+        case CONFIG_FIELD_STR: {
+            CHAR8 tmp[CONFIG_FIELD_STR_MAX];
+            if (config_sv_unescape(e->value, e->escaped, tmp, field->Size) >= 0) {
+                AsciiStrCpyS((CHAR8*)target, field->Size, tmp);
+                ok = TRUE;
+            }
+            break;
+        }
+        case CONFIG_FIELD_INT:
+            ok = ParseConfigInt(e->value, (int*)target);
+            break;
+        case CONFIG_FIELD_BOOL:
+            ok = ParseConfigBool(e->value, (bool*)target);
+            break;
+    }
+    if (!ok) {
+        Print(L"%s:%u: invalid value for %a.%a\n", apply->Source, e->line, field->Section, field->Key);
+    }
+    return 0;
+}
+
+/**
+ * Apply one configuration file in a single tokenizing pass
+ *
+ * @return FALSE if the file is malformed; settings before the error stay applied
  */
-STATIC BOOLEAN str_ieq(const CHAR8* a, const CHAR8* b) {
-    while (*a && *b) {
-        CHAR8 ca = (*a >= 'A' && *a <= 'Z') ? (*a - 'A' + 'a') : *a;
-        CHAR8 cb = (*b >= 'A' && *b <= 'Z') ? (*b - 'A' + 'a') : *b;
-        if (ca != cb) return FALSE;
-        a++; b++;
+STATIC BOOLEAN ApplyConfigText(
+    CONST CHAR8* Text,
+    UINTN Length,
+    BOOLEAN Json,
+    CONST CHAR16* Source,
+    BOOT_CONFIG* config
+) {
+    CONFIG_APPLY apply = { config, Source };
+    bhshim_cfg_iter_t iter;
+    bhshim_cfg_entry_t e;
+    bhshim_cfg_error_t err = { 0, "invalid parameter" };
+    int rc;
+
+    // bhcfg walks the file; its entries have config_entry's layout
+    if (bhshim_cfg_begin(&iter, Text, Length, Json) != BH_SUCCESS) {
+        rc = BHSHIM_CFG_ERROR;
+    } else {
+        while ((rc = bhshim_cfg_next(&iter, &e, &err)) == BHSHIM_CFG_ENTRY) {
+            config_entry entry = {
+                { e.section.ptr, e.section.len },
+                { e.key.ptr, e.key.len },
+                { e.value.ptr, e.value.len },
+                e.escaped,
+                e.line
+            };
+            ApplyConfigEntry(&apply, &entry);
+        }
+    }
+    if (rc == BHSHIM_CFG_ERROR) {
+        Print(L"%s:%u: %a\n", Source, err.line, err.what);
+        return FALSE;
     }
-    return *a == 0 && *b == 0;
+    return TRUE;
 }
 
 // =============================================================================
@@ -327,85 +696,7 @@ LoadFileRaw (
   OUT UINTN* Size
   )
 {
-    EFI_STATUS Status;
-    EFI_FILE_HANDLE root_dir;
-    EFI_FILE_HANDLE file;
-    VOID* buffer = NULL;
-    UINTN size = 0;
-
-    // First, we need to get the root directory of the filesystem
-    Status = get_root_dir(&root_dir);
-    if (EFI_ERROR(Status)) {
-        return Status;
-    }
-
-    // Open the file for reading
-    Status = root_dir->Open(root_dir, &file, Path, EFI_FILE_MODE_READ, 0);
-    if (EFI_ERROR(Status)) {
-        return Status;
-    }
-
-    // Get file information to determine the file size
-    EFI_FILE_INFO* info = NULL;
-    UINTN info_size = 0;
-    Status = file->GetInfo(file, &gEfiFileInfoGuid, &info_size, NULL);
-    if (Status == EFI_BUFFER_TOO_SMALL) {
-        info = AllocateZeroPool(info_size);
-        if (!info) { file->Close(file); return EFI_OUT_OF_RESOURCES; }
-        Status = file->GetInfo(file, &gEfiFileInfoGuid, &info_size, info);
-    }
-    if (EFI_ERROR(Status)) { if (info) FreePool(info); file->Close(file); return Status; }
-
-    // Allocate memory for the file contents
-    size = (UINTN)info->FileSize;
-    buffer = AllocateZeroPool(size);
-    if (!buffer) { FreePool(info); file->Close(file); return EFI_OUT_OF_RESOURCES; }
-
-    // Read the entire file into our buffer
-    Status = file->Read(file, &size, buffer);
-    file->Close(file);
-    FreePool(info);
-    if (EFI_ERROR(Status)) { FreePool(buffer); return Status; }
-
-    *Buffer = buffer;
-    *Size = size;
-    return EFI_SUCCESS;
-}
-
-/**
- * Parse a boolean value from an ASCII string
- * 
- * Parses boolean values from configuration files, supporting multiple
- * representations: "true/1/yes" and "false/0/no" (case-insensitive).
- * Returns default value if parsing fails.
- * 
- * @param v String value to parse
- * @param defv Default value if parsing fails
- * @return TRUE or FALSE based on the string content
- */
-STATIC BOOLEAN parse_bool_ascii(const CHAR8* v, BOOLEAN defv) {
-    if (!v) return defv;
-    if (str_ieq(v, "true") || str_ieq(v, "1") || str_ieq(v, "yes")) return TRUE;
-    if (str_ieq(v, "false") || str_ieq(v, "0") || str_ieq(v, "no")) return FALSE;
-    return defv;
-}
-
-/**
- * Trim whitespace from an ASCII string
- * 
- * Removes leading and trailing whitespace (spaces, tabs, line breaks)
- * from ASCII strings. Modifies the string in-place to conserve memory.
- * 
- * @param s String to trim (modified in-place)
- */
-STATIC VOID trim_ascii(CHAR8* s) {
-    if (!s) return;
-    // trim leading whitespace
-    CHAR8* p = s; while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
-    if (p != s) CopyMem(s, p, AsciiStrLen(p)+1);
-    // trim trailing whitespace
-    UINTN n = AsciiStrLen(s);
-    while (n > 0 && (s[n-1] == ' ' || s[n-1] == '\t' || s[n-1] == '\r' || s[n-1] == '\n')) { s[n-1] = 0; n--; }
+    return ReadFile(Path, Buffer, Size);
 }
 
 /**
@@ -425,21 +716,22 @@ STATIC EFI_STATUS LoadAndVerifyKernelEnhanced(
     UINTN Size = 0;
     
     // Begin performance measurement
-    BeginPerformanceMeasurement(L"fileload");
+    BH_TRACE_BEGIN(LoadSpan, BH_TRACE_PHASE_LOAD);
     
     Status = ReadFile(FileName, &Buffer, &Size);
     if (EFI_ERROR(Status)) {
-        EndPerformanceMeasurement(L"fileload");
+        BH_TRACE_END(LoadSpan);
         return Status;
     }
     
     // Verify kernel if secure boot is enabled
     if (IsSecureBootEnabled()) {
-        BeginPerformanceMeasurement(L"verification");
+        BH_TRACE_BEGIN(VerifySpan, BH_TRACE_PHASE_VERIFY);
         
         Status = VerifyImageSignature(Buffer, Size, NULL, 0);
-        EndPerformanceMeasurement(L"verification");
+        BH_TRACE_END(VerifySpan);
         if (EFI_ERROR(Status)) {
+            BH_TRACE_END(LoadSpan);
             FreePool(Buffer);
             return Status;
         }
@@ -448,181 +740,94 @@ STATIC EFI_STATUS LoadAndVerifyKernelEnhanced(
     *ImageBuffer = Buffer;
     *ImageSize = Size;
     
-    EndPerformanceMeasurement(L"fileload");
+    BH_TRACE_END(LoadSpan);
     return EFI_SUCCESS;
 }
 
-/**
- * Apply INI configuration to boot configuration structure
- * 
- * Parses INI file content and populates the configuration structure.
- * This is a minimal but functional INI parser that handles sections,
- * keys, and values required by BloodHorn.
- * 
- * @param ini INI file content as a string
- * @param config Configuration structure to populate
- */
-STATIC VOID ApplyIniToConfig(const CHAR8* ini, BOOT_CONFIG* config) {
-    CHAR8 section[64] = {0};
-    const CHAR8* cur = ini;
-    
-    // Process the INI file line by line
-    while (*cur) {
-        // read one line
-        const CHAR8* lineStart = cur;
-        while (*cur && *cur != '\n') cur++;
-        UINTN len = (UINTN)(cur - lineStart);
-        CHAR8* line = AllocateZeroPool(len + 1);
-        if (!line) return;
-        CopyMem(line, lineStart, len); line[len] = 0;
-        if (*cur == '\n') cur++;
-
-        trim_ascii(line);
-        
-        // Skip empty lines and comments
-        if (line[0] == '#' || line[0] == ';' || line[0] == 0) { FreePool(line); continue; }
-        
-        // Handle section headers like [boot] or [linux]
-        if (line[0] == '[') {
-            CHAR8* rb = AsciiStrStr(line, "]");
-            if (rb) {
-                *rb = 0;
-                UINTN section_len = AsciiStrLen(line + 1);
-                if (section_len < sizeof(section)) {
-                    AsciiStrCpyS(section, sizeof(section), line + 1);
-                }
-            }
-            FreePool(line); continue;
-        }
-        
-        // Handle key=value pairs
-        CHAR8* eq = AsciiStrStr(line, "=");
-        if (!eq) { FreePool(line); continue; }
-        *eq = 0; CHAR8* k = line; CHAR8* v = eq + 1; trim_ascii(k); trim_ascii(v);
-
-        // Apply the setting based on section and key
-        if (str_ieq(section, "boot")) {
-            if (str_ieq(k, "default")) {
-                UINTN vlen = AsciiStrLen(v);
-                if (vlen < sizeof(config->default_entry)) {
-                    AsciiStrCpyS(config->default_entry, sizeof(config->default_entry), v);
-                }
-            } else if (str_ieq(k, "language")) {
-                UINTN vlen = AsciiStrLen(v);
-                if (vlen < sizeof(config->language)) {
-                    AsciiStrCpyS(config->language, sizeof(config->language), v);
-                }
-            } else if (str_ieq(k, "secure_boot")) {
-                config->secure_boot = parse_bool_ascii(v, config->secure_boot);
-            } else if (str_ieq(k, "tpm_enabled")) {
-                config->tpm_enabled = parse_bool_ascii(v, config->tpm_enabled);
-            } else if (str_ieq(k, "use_gui")) {
-                config->use_gui = parse_bool_ascii(v, config->use_gui);
-            }
-        } else if (str_ieq(section, "linux")) {
-            if (str_ieq(k, "kernel")) {
-                UINTN vlen = AsciiStrLen(v);
-                if (vlen < sizeof(config->kernel)) {
-                    AsciiStrCpyS(config->kernel, sizeof(config->kernel), v);
-                }
-            } else if (str_ieq(k, "initrd")) {
-                UINTN vlen = AsciiStrLen(v);
-                if (vlen < sizeof(config->initrd)) {
-                    AsciiStrCpyS(config->initrd, sizeof(config->initrd), v);
-                }
-            } else if (str_ieq(k, "cmdline")) {
-                UINTN vlen = AsciiStrLen(v);
-                if (vlen < sizeof(config->cmdline)) {
-                    AsciiStrCpyS(config->cmdline, sizeof(config->cmdline), v);
-                }
-            }
+// Override variables found in the variable store, hashed by name. Sized
+// well above the number of overrides BloodHorn knows.
+#define ENV_OVERRIDE_SLOTS      64
+#define ENV_OVERRIDE_PREFIX     L"BLOODHORN_"
+#define ENV_OVERRIDE_VALUE_MAX  256     // First read's buffer; larger values are read again
+
+typedef struct {
+    CHAR16* name;       // NULL: free slot
+    VOID* data;         // Value, followed by a NUL CHAR16
+    UINTN size;
+    BOOLEAN vendor;     // Under gBloodHornVariableGuid, not the global GUID
+} ENV_OVERRIDE;
+
+STATIC ENV_OVERRIDE* FindEnvOverride(ENV_OVERRIDE* table, CONST CHAR16* name) {
+    UINT32 hash = bh_fnv1a_str16(name);
+    for (;; ++hash) {
+        ENV_OVERRIDE* slot = &table[hash & (ENV_OVERRIDE_SLOTS - 1)];
+        if (!slot->name || StrCmp(slot->name, name) == 0) {
+            return slot;
         }
-        FreePool(line);
     }
 }
 
-STATIC VOID ApplyJsonToConfig(const CHAR8* js, BOOT_CONFIG* config) {
-    if (!js || !config) return;
-    
-    // Safe JSON parsing functions
-    STATIC EFI_STATUS safe_extract_string(const CHAR8* json, const CHAR8* key, CHAR8* dst, UINTN dst_size) {
-        const CHAR8* p = AsciiStrStr(json, key);
-        if (!p) return EFI_NOT_FOUND;
-        
-        p = AsciiStrStr(p, ":");
-        if (!p) return EFI_NOT_FOUND;
-        p++;
-        
-        // Skip whitespace
-        while (*p == ' ' || *p == '\t' || *p == '\n') p++;
-        
-        if (*p != '\"') return EFI_NOT_FOUND;
-        p++;
-        
-        const CHAR8* q = p;
-        while (*q && *q != '\"' && (q - p) < 512) q++;
-        
-        UINTN len = (UINTN)(q - p);
-        if (len >= dst_size) len = dst_size - 1;
-        
-        CopyMem(tmp, p, len);
-        tmp[len] = 0;
-        AsciiStrCpyS(dst, dst_size, tmp);
-        return EFI_SUCCESS;
-    }
-    
-    STATIC EFI_STATUS safe_extract_int(const CHAR8* json, const CHAR8* key, int* dst) {
-        const CHAR8* p = AsciiStrStr(json, key);
-        if (!p) return EFI_NOT_FOUND;
-        
-        p = AsciiStrStr(p, ":");
-        if (!p) return EFI_NOT_FOUND;
-        p++;
-        
-        // Skip whitespace
-        while (*p == ' ' || *p == '\t' || *p == '\n') p++;
-        
-        // Parse integer
-        INTN val = 0;
-        while (*p >= '0' && *p <= '9') {
-            val = val * 10 + (*p - '0');
-            p++;
+/**
+ * Read every BLOODHORN_* variable into table in one GetNextVariableName
+ * pass instead of probing each known name with GetVariable. Each variable
+ * service call takes the store lock, and on some firmware costs
+ * milliseconds; this way only overrides that exist are read, normally
+ * with one call each. The BloodHorn vendor GUID takes precedence over
+ * the global GUID older setups used.
+ */
+STATIC VOID EnumerateUefiEnvOverrides(ENV_OVERRIDE* table, bh_arena_t* scratch) {
+    UINTN capacity = 128 * sizeof(CHAR16);
+    CHAR16* name = bh_arena_alloc(scratch, capacity);
+    UINTN count = 0;
+    EFI_GUID guid;
+
+    if (!name) return;
+    name[0] = 0;
+    for (;;) {
+        UINTN size = capacity;
+        EFI_STATUS st = gRT->GetNextVariableName(&size, name, &guid);
+        if (st == EFI_BUFFER_TOO_SMALL) {
+            // Continue from the same name in a larger buffer
+            CHAR16* grown = bh_arena_alloc(scratch, size);
+            if (!grown) break;
+            CopyMem(grown, name, capacity);
+            name = grown;
+            capacity = size;
+            continue;
         }
-        *dst = (int)val;
-        return EFI_SUCCESS;
-    }
-    
-    STATIC EFI_STATUS safe_extract_bool(const CHAR8* json, const CHAR8* key, BOOLEAN* dst) {
-        const CHAR8* p = AsciiStrStr(json, key);
-        if (!p) return EFI_NOT_FOUND;
-        
-        p = AsciiStrStr(p, ":");
-        if (!p) return EFI_NOT_FOUND;
-        p++;
-        
-        // Skip whitespace
-        while (*p == ' ' || *p == '\t' || *p == '\n') p++;
-        
-        if (AsciiStrnCmp(p, "true", 4) == 0) {
-            *dst = TRUE;
-        } else if (AsciiStrnCmp(p, "false", 5) == 0) {
-            *dst = FALSE;
-        } else {
-            return EFI_NOT_FOUND;
+        if (EFI_ERROR(st)) break;       // EFI_NOT_FOUND after the last one
+
+        BOOLEAN vendor = CompareGuid(&guid, &gBloodHornVariableGuid);
+        if (!vendor && !CompareGuid(&guid, &gEfiGlobalVariableGuid)) continue;
+        if (StrnCmp(name, ENV_OVERRIDE_PREFIX, ARRAY_SIZE(ENV_OVERRIDE_PREFIX) - 1) != 0) continue;
+        ENV_OVERRIDE* slot = FindEnvOverride(table, name);
+        if (slot->name ? (slot->vendor || !vendor) : count == ENV_OVERRIDE_SLOTS - 1) continue;
+
+        UINTN data_size = ENV_OVERRIDE_VALUE_MAX;
+        VOID* data = bh_arena_alloc(scratch, data_size + sizeof(CHAR16));
+        if (!data) continue;
+        st = gRT->GetVariable(name, &guid, NULL, &data_size, data);
+        if (st == EFI_BUFFER_TOO_SMALL) {
+            data = bh_arena_alloc(scratch, data_size + sizeof(CHAR16));
+            if (!data) continue;
+            st = gRT->GetVariable(name, &guid, NULL, &data_size, data);
         }
-        return EFI_SUCCESS;
+        if (EFI_ERROR(st)) continue;
+        ZeroMem((UINT8*)data + data_size, sizeof(CHAR16));
+
+        if (!slot->name) {
+            slot->name = bh_arena_alloc(scratch, StrSize(name));
+            if (!slot->name) continue;
+            CopyMem(slot->name, name, StrSize(name));
+            count++;
+        }
+        slot->data = data;
+        slot->size = data_size;
+        slot->vendor = vendor;
     }
-    
-    // Extract configuration values safely
-    safe_extract_string(js, "\"default\"", config->default_entry, sizeof(config->default_entry));
-    safe_extract_int(js, "\"menu_timeout\"", &config->menu_timeout);
-    safe_extract_string(js, "\"language\"", config->language, sizeof(config->language));
-    safe_extract_string(js, "\"kernel\"", config->kernel, sizeof(config->kernel));
-    safe_extract_string(js, "\"initrd\"", config->initrd, sizeof(config->initrd));
-    safe_extract_string(js, "\"cmdline\"", config->cmdline, sizeof(config->cmdline));
 }
 
-STATIC VOID ApplyUefiEnvOverrides(BOOT_CONFIG* config) {
+STATIC VOID ApplyUefiEnvOverrides(BOOT_CONFIG* config, bh_arena_t* scratch) {
     struct { CONST CHAR16* name; enum { T_STR, T_INT, T_BOOL } typ; VOID* target; UINTN tsize; } vars[] = {
         { L"BLOODHORN_DEFAULT", T_STR,  config->default_entry, sizeof(config->default_entry) },
         { L"BLOODHORN_MENU_TIMEOUT", T_INT, &config->menu_timeout, sizeof(config->menu_timeout) },
@@ -630,18 +835,38 @@ STATIC VOID ApplyUefiEnvOverrides(BOOT_CONFIG* config) {
         { L"BLOODHORN_LINUX_KERNEL", T_STR,  config->kernel, sizeof(config->kernel) },
         { L"BLOODHORN_LINUX_INITRD", T_STR,  config->initrd, sizeof(config->initrd) },
         { L"BLOODHORN_LINUX_CMDLINE", T_STR,  config->cmdline, sizeof(config->cmdline) },
+        { L"BLOODHORN_LINUX_EFISTUB", T_BOOL, &config->efistub, sizeof(config->efistub) },
+        { L"BLOODHORN_THEME_BACKGROUND_IMAGE", T_STR, config->background_image, sizeof(config->background_image) },
         { L"BLOODHORN_SECURE_BOOT", T_BOOL, &config->secure_boot, sizeof(config->secure_boot) },
         { L"BLOODHORN_TPM_ENABLED", T_BOOL, &config->tpm_enabled, sizeof(config->tpm_enabled) },
+        { L"BLOODHORN_BOOT_TRACE", T_BOOL, &config->boot_trace, sizeof(config->boot_trace) },
+        { L"BLOODHORN_TRACE_MEMORY", T_BOOL, &config->trace_memory, sizeof(config->trace_memory) },
+        { L"BLOODHORN_PROFILER", T_BOOL, &config->profiler, sizeof(config->profiler) },
+        { L"BLOODHORN_VERIFY_CACHE", T_BOOL, &config->verify_cache, sizeof(config->verify_cache) },
+        { L"BLOODHORN_KNOWN_HASHES", T_STR, config->known_hashes, sizeof(config->known_hashes) },
+        { L"BLOODHORN_NET_CACHE", T_STR, config->net_cache, sizeof(config->net_cache) },
+        { L"BLOODHORN_TFTP_PARALLEL", T_BOOL, &config->tftp_parallel, sizeof(config->tftp_parallel) },
+        { L"BLOODHORN_NVME_TCP", T_STR, config->nvme_tcp, sizeof(config->nvme_tcp) },
+        { L"BLOODHORN_KASLR", T_BOOL, &config->kaslr, sizeof(config->kaslr) },
+        { L"BLOODHORN_LAZY_INITRD", T_BOOL, &config->lazy_initrd, sizeof(config->lazy_initrd) },
+        { L"BLOODHORN_FAST_REBOOT", T_BOOL, &config->fast_reboot, sizeof(config->fast_reboot) },
+        { L"BLOODHORN_ENABLE_NETWORKING", T_BOOL, &config->enable_networking, sizeof(config->enable_networking) },
+        { L"BLOODHORN_SELF_TESTS", T_STR, config->self_tests, sizeof(config->self_tests) },
+        { L"BLOODHORN_SELF_TEST_INTERVAL", T_INT, &config->self_test_interval, sizeof(config->self_test_interval) },
+        { L"BLOODHORN_MULTIBOOT1_MODULES", T_STR, config->mb1_modules, sizeof(config->mb1_modules) },
+        { L"BLOODHORN_MULTIBOOT2_MODULES", T_STR, config->mb2_modules, sizeof(config->mb2_modules) },
     };
 
+    ENV_OVERRIDE* table = bh_arena_alloc(scratch, ENV_OVERRIDE_SLOTS * sizeof(ENV_OVERRIDE));
+    if (!table) return;
+    ZeroMem(table, ENV_OVERRIDE_SLOTS * sizeof(ENV_OVERRIDE));
+    EnumerateUefiEnvOverrides(table, scratch);
+
     for (UINTN i = 0; i < ARRAY_SIZE(vars); ++i) {
-        UINTN sz = 0; EFI_STATUS st;
-        st = gRT->GetVariable((CHAR16*)vars[i].name, &gEfiGlobalVariableGuid, NULL, &sz, NULL);
-        if (st != EFI_BUFFER_TOO_SMALL) continue;
-        VOID* buf = AllocateZeroPool(sz);
-        if (!buf) continue;
-        st = gRT->GetVariable((CHAR16*)vars[i].name, &gEfiGlobalVariableGuid, NULL, &sz, buf);
-        if (EFI_ERROR(st)) { FreePool(buf); continue; }
+        ENV_OVERRIDE* found = FindEnvOverride(table, vars[i].name);
+        if (!found->name) continue;
+        VOID* buf = found->data;
+        UINTN sz = found->size;
         if (vars[i].typ == T_STR) {
             // treat as UCS-2 string -> convert to ASCII
             CHAR16* w = (CHAR16*)buf; CHAR8 a[256] = {0};
@@ -652,10 +877,122 @@ STATIC VOID ApplyUefiEnvOverrides(BOOT_CONFIG* config) {
         } else if (vars[i].typ == T_BOOL) {
             if (sz >= sizeof(UINT8)) *(BOOLEAN*)vars[i].target = (*(UINT8*)buf) ? TRUE : FALSE;
         }
-        FreePool(buf);
     }
 }
 
+// Parsed bloodhorn.ini/bloodhorn.json, kept in a boot-services NV variable
+// so warm boots skip the text parsers. Bump the version whenever the
+// parsers change meaning; a BOOT_CONFIG layout change is caught by size.
+#define CONFIG_SNAPSHOT_VARIABLE    L"BloodHornConfigCache"
+#define CONFIG_SNAPSHOT_MAGIC       SIGNATURE_32('B', 'H', 'C', 'F')
+#define CONFIG_SNAPSHOT_VERSION     4
+
+STATIC CONST CHAR16* mConfigSources[] = { L"bloodhorn.ini", L"bloodhorn.json" };
+
+// What a source file looked like when the snapshot was taken
+typedef struct {
+    UINT64 Size;
+    EFI_TIME ModificationTime;
+    UINT32 Present;
+} CONFIG_SOURCE_STAMP;
+
+typedef struct {
+    UINT32 Magic;
+    UINT16 Version;
+    UINT16 ConfigSize;
+    CONFIG_SOURCE_STAMP Sources[ARRAY_SIZE(mConfigSources)];
+    BOOT_CONFIG Config;
+} BOOT_CONFIG_SNAPSHOT;
+
+/**
+ * Fill in the snapshot header and stamp the configuration files by size
+ * and modification time, from their directory entries alone. A missing
+ * file is a valid stamp; any other failure leaves the configuration
+ * uncacheable.
+ */
+STATIC EFI_STATUS StampConfigSources(BOOT_CONFIG_SNAPSHOT* snapshot) {
+    snapshot->Magic = CONFIG_SNAPSHOT_MAGIC;
+    snapshot->Version = CONFIG_SNAPSHOT_VERSION;
+    snapshot->ConfigSize = (UINT16)sizeof(BOOT_CONFIG);
+    for (UINTN i = 0; i < ARRAY_SIZE(mConfigSources); ++i) {
+        CONFIG_SOURCE_STAMP* stamp = &snapshot->Sources[i];
+        EFI_STATUS st = GetBootFileInfo(mConfigSources[i], &stamp->Size, &stamp->ModificationTime);
+        if (st == EFI_NOT_FOUND) {
+            ZeroMem(stamp, sizeof(*stamp));
+        } else if (EFI_ERROR(st)) {
+            return st;
+        } else {
+            stamp->Present = 1;
+        }
+    }
+    return EFI_SUCCESS;
+}
+
+/**
+ * Restore the file-derived configuration if the stored snapshot was taken
+ * from files with the same stamps
+ */
+STATIC BOOLEAN LoadConfigSnapshot(CONST BOOT_CONFIG_SNAPSHOT* current, BOOT_CONFIG* config, bh_arena_t* scratch) {
+    BOOT_CONFIG_SNAPSHOT* stored = bh_arena_alloc(scratch, sizeof(*stored));
+    UINTN size = sizeof(*stored);
+    BOOLEAN hit = FALSE;
+
+    if (!stored) return FALSE;
+    if (!EFI_ERROR(gRT->GetVariable(CONFIG_SNAPSHOT_VARIABLE, &gBloodHornVariableGuid, NULL, &size, stored)) &&
+        size == sizeof(*stored) &&
+        CompareMem(stored, current, OFFSET_OF(BOOT_CONFIG_SNAPSHOT, Config)) == 0) {
+        CopyMem(config, &stored->Config, sizeof(*config));
+        hit = TRUE;
+    }
+    return hit;
+}
+
+/**
+ * Store the file-derived configuration under the current stamps
+ */
+STATIC VOID SaveConfigSnapshot(BOOT_CONFIG_SNAPSHOT* snapshot, CONST BOOT_CONFIG* config) {
+    CopyMem(&snapshot->Config, config, sizeof(*config));
+    gRT->SetVariable(CONFIG_SNAPSHOT_VARIABLE, &gBloodHornVariableGuid,
+                     EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS,
+                     sizeof(*snapshot), snapshot);
+}
+
+/**
+ * Settings before any source is applied: the documented defaults
+ */
+STATIC VOID SetDefaultBootConfig(OUT BOOT_CONFIG* config) {
+    AsciiStrCpyS(config->default_entry, sizeof(config->default_entry), "linux");
+    config->menu_timeout = 10;
+    config->tpm_enabled = TRUE;
+    config->secure_boot = FALSE;
+    config->use_gui = TRUE;
+    AsciiStrCpyS(config->font_path, sizeof(config->font_path), "DejaVuSans.ttf");
+    config->font_size = 12;
+    config->header_font_size = 16;
+    AsciiStrCpyS(config->language, sizeof(config->language), "en");
+    config->background_image[0] = 0;
+    config->enable_networking = FALSE;
+    config->boot_trace = FALSE;
+    config->trace_memory = FALSE;
+    config->profiler = FALSE;
+    config->verify_cache = FALSE;
+    config->known_hashes[0] = 0;
+    config->net_cache[0] = 0;
+    config->tftp_parallel = FALSE;
+    config->nvme_tcp[0] = 0;
+    config->kaslr = FALSE;
+    config->lazy_initrd = FALSE;
+    config->efistub = TRUE;
+    config->fast_reboot = FALSE;
+    AsciiStrCpyS(config->self_tests, sizeof(config->self_tests), "off");
+    config->self_test_interval = 0;
+    config->mb1_modules[0] = 0;
+    config->mb2_modules[0] = 0;
+    config->kernel[0] = 0;
+    config->initrd[0] = 0;
+    config->cmdline[0] = 0;
+}
+
 /**
  * Load boot configuration from files
  * 
@@ -663,7 +1000,9 @@ STATIC VOID ApplyUefiEnvOverrides(BOOT_CONFIG* config) {
  * 1. bloodhorn.ini (INI format)
  * 2. bloodhorn.json (JSON format) 
  * 3. UEFI environment variables
- * Later sources override earlier ones.
+ * Later sources override earlier ones. The result of the two files is
+ * cached as a binary snapshot keyed by their size and modification time,
+ * so a warm boot with unchanged files reads neither of them.
  * 
  * @param config Output configuration structure
  * @return EFI_SUCCESS if successful, error code otherwise
@@ -677,58 +1016,48 @@ LoadBootConfig (
         return EFI_INVALID_PARAMETER;
     }
 
-    // Defaults
-    AsciiStrCpyS(config->default_entry, sizeof(config->default_entry), "linux");
-    config->menu_timeout = 10;
-    config->tpm_enabled = TRUE;
-    config->secure_boot = FALSE;
-    config->use_gui = TRUE;
-    AsciiStrCpyS(config->font_path, sizeof(config->font_path), "DejaVuSans.ttf");
-    config->font_size = 12;
-    config->header_font_size = 16;
-    AsciiStrCpyS(config->language, sizeof(config->language), "en");
-    config->enable_networking = FALSE;
-    config->kernel[0] = 0;
-    config->initrd[0] = 0;
-    config->cmdline[0] = 0;
+    SetDefaultBootConfig(config);
 
+    // Scratch memory of the config phase, released in one go at its end
     EFI_STATUS Status;
     EFI_FILE_HANDLE root_dir;
+    bh_arena_t* scratch = bh_arena_create(0);
+    BOOT_CONFIG_SNAPSHOT* snapshot = bh_arena_alloc(scratch, sizeof(*snapshot));
+    if (snapshot) {
+        ZeroMem(snapshot, sizeof(*snapshot));
+    }
+    BOOLEAN cacheable = snapshot && !EFI_ERROR(StampConfigSources(snapshot));
     Status = get_root_dir(&root_dir);
-    if (!EFI_ERROR(Status)) {
-        // 1) INI: bloodhorn.ini
-        CHAR8* buf = NULL;
-        UINTN blen = 0;
-        Status = ReadWholeFileAscii(root_dir, L"bloodhorn.ini", &buf, &blen);
-        if (!EFI_ERROR(Status) && buf && blen > 0) {
-            ApplyIniToConfig(buf, config);
-        }
-        if (buf) {
-            FreePool(buf);
-            buf = NULL;
-            blen = 0;
+    if (!EFI_ERROR(Status) && cacheable && LoadConfigSnapshot(snapshot, config, scratch)) {
+        // Files unchanged since the snapshot was taken
+    } else if (!EFI_ERROR(Status)) {
+        // 1) INI: bloodhorn.ini, 2) JSON: bloodhorn.json
+        BOOLEAN clean = TRUE;
+        for (UINTN i = 0; i < ARRAY_SIZE(mConfigSources); ++i) {
+            VOID* buf = NULL;
+            UINTN blen = 0;
+            if (!EFI_ERROR(ReadFile((CHAR16*)mConfigSources[i], &buf, &blen)) && buf) {
+                clean &= ApplyConfigText((CONST CHAR8*)buf, blen, i == 1, mConfigSources[i], config);
+            }
+            if (buf) {
+                FreePool(buf);
+            }
         }
 
-        // 2) JSON: bloodhorn.json
-        Status = ReadWholeFileAscii(root_dir, L"bloodhorn.json", &buf, &blen);
-        if (!EFI_ERROR(Status) && buf && blen > 0) {
-            ApplyJsonToConfig(buf, config);
-        }
-        if (buf) {
-            FreePool(buf);
-            buf = NULL;
+        // A file with errors is parsed again next boot, so its messages recur
+        if (cacheable && clean) {
+            SaveConfigSnapshot(snapshot, config);
         }
     } else {
         Print(L"Failed to open filesystem for config: %r\n", Status);
     }
 
     // 3) Environment variables (UEFI vars)
-    ApplyUefiEnvOverrides(config);
+    ApplyUefiEnvOverrides(config, scratch);
+    bh_arena_destroy(scratch);
 
-    // Clamp values according to docs
-    if (config->menu_timeout < 0) {
-        config->menu_timeout = 0;
-    }
+    // Clamp values according to docs; a negative timeout is kept and
+    // means the menu waits without a countdown
     if (config->menu_timeout > 300) {
         config->menu_timeout = 300;
     }
@@ -780,6 +1109,10 @@ InitializeBloodHorn (VOID)
             Print(L"Warning: Coreboot TPM initialization failed\n");
         }
 
+        // coreboot's own ACPI and SMBIOS pointers back the platform table
+        // index when the system table lists none
+        fwinfo_tables_fallback(CorebootGetAcpiRsdp(), CorebootGetSmbiosEntryPoint());
+
         // Use UEFI for higher-level services
         Print(L"Using UEFI services for boot menu and file operations\n");
     } else {
@@ -790,6 +1123,184 @@ InitializeBloodHorn (VOID)
     return EFI_SUCCESS;
 }
 
+// Queue a [boot] multiboot1_modules or multiboot2_modules list, "path
+// [cmdline]" entries separated by ';', with that loader's add function
+STATIC VOID RegisterMultibootModules(const CHAR8* list, int (*add)(const char*, const char*)) {
+    CHAR8 entry[MULTIBOOT2_PATH_MAX + MULTIBOOT2_CMDLINE_MAX];
+    while (*list) {
+        UINTN len = 0;
+        while (list[len] && list[len] != ';') len++;
+        if (len > 0 && len < sizeof(entry)) {
+            CopyMem(entry, list, len);
+            entry[len] = 0;
+            CHAR8* args = entry;
+            while (*args && *args != ' ') args++;
+            if (*args) *args++ = 0;
+            add(entry, args);
+        }
+        list += len;
+        if (*list == ';') list++;
+    }
+}
+
+/**
+ * Hash the text of an already verified manifest into the allowlist table.
+ * The entries point into Text, which stays loaded for the rest of the boot.
+ */
+STATIC VOID InstallKnownHashes(IN CONST CHAR8* Text, IN UINTN TextSize, IN CONST CHAR16* Name) {
+    hash_manifest_entry_t* Slots;
+    UINT32 SlotCount;
+
+    gKnownHashesRequired = TRUE;
+    SlotCount = hash_manifest_slots((CONST char*)Text, (uint32_t)TextSize);
+    Slots = AllocatePool(SlotCount * sizeof(*Slots));
+    if (!Slots ||
+        hash_manifest_parse(&gKnownHashes, (CONST char*)Text, (uint32_t)TextSize, Slots, SlotCount) <= 0) {
+        Print(L"Known-hash manifest %s lists no images\n", Name);
+    }
+}
+
+/**
+ * Load the [boot] known_hashes allowlist (security/hash_manifest.h) once.
+ * The manifest carries an appended signature under the platform key, like
+ * a signed kernel, and its entries are hashed into a table that every
+ * kernel and chainload is then looked up in. A missing, forged or empty
+ * manifest leaves the table empty, so nothing boots rather than anything.
+ */
+STATIC VOID LoadKnownHashes(IN CONST CHAR8* Path) {
+    EFI_STATUS Status;
+    CHAR16 Path16[128];
+    UINT8 PublicKey[4 + 2 * CRYPTO_RSA4096_KEY_LENGTH];
+    UINTN PublicKeySize = sizeof(PublicKey);
+    UINTN TextSize;
+    int SignatureSize = 0;
+
+    gKnownHashesRequired = TRUE;
+    if (EFI_ERROR(AsciiStrToUnicodeStrS(Path, Path16, ARRAY_SIZE(Path16)))) {
+        Print(L"Known-hash manifest path too long\n");
+        return;
+    }
+
+    Status = LoadBootFile(Path16, FILE_LOAD_POOL, NULL, NULL, &gKnownHashesFile);
+    if (EFI_ERROR(Status)) {
+        Print(L"Failed to load known-hash manifest %s: %r\n", Path16, Status);
+        return;
+    }
+
+    // The text ends where the signature starts
+    Status = gRT->GetVariable(L"PK", &gEfiGlobalVariableGuid, NULL, &PublicKeySize, PublicKey);
+    if (!EFI_ERROR(Status)) {
+        SignatureSize = secure_boot_signature_length(SECURE_BOOT_SIG_RSA_PKCS1_SHA256, PublicKey,
+                                                     (uint32_t)PublicKeySize);
+        Status = gKnownHashesFile.Size > HASH_MANIFEST_MAX ? EFI_BAD_BUFFER_SIZE :
+                 VerifyImageSignature(gKnownHashesFile.Buffer, gKnownHashesFile.Size, PublicKey, PublicKeySize);
+    }
+    crypto_memzero_secure(PublicKey, sizeof(PublicKey));
+    if (EFI_ERROR(Status)) {
+        Print(L"Known-hash manifest %s rejected: %r\n", Path16, Status);
+        FreeLoadedFile(&gKnownHashesFile);
+        return;
+    }
+
+    TextSize = gKnownHashesFile.Size - (UINTN)SignatureSize;
+    InstallKnownHashes((CONST CHAR8*)gKnownHashesFile.Buffer, TextSize, Path16);
+}
+
+// Whether the allowlist has Digest for Path; outside an allowlist every
+// image is allowed
+STATIC BOOLEAN KnownHashAllows(IN CONST CHAR16* Path, IN CONST UINT8* Digest) {
+    CHAR8 AsciiPath[256];
+
+    if (!gKnownHashesRequired) {
+        return TRUE;
+    }
+    if (EFI_ERROR(UnicodeStrToAsciiStrS(Path, AsciiPath, sizeof(AsciiPath)))) {
+        return FALSE;
+    }
+    return hash_manifest_allows(&gKnownHashes, AsciiPath, (uint32_t)AsciiStrLen(AsciiPath), Digest) != 0;
+}
+
+// Digest of an image in the allowlist's algorithm: SHA-512, or BLAKE3
+// with the large reads spread over the APs
+typedef struct {
+    BOOLEAN                 Blake3;
+    union {
+        crypto_sha512_ctx_t Sha512;
+        crypto_blake3_ctx_t Blake3;
+    } Ctx;
+} KNOWN_HASH_CTX;
+
+STATIC VOID KnownHashInit(OUT KNOWN_HASH_CTX* Hash) {
+    Hash->Blake3 = gKnownHashes.digest_length == CRYPTO_BLAKE3_DIGEST_LENGTH;
+    if (Hash->Blake3) {
+        crypto_blake3_init(&Hash->Ctx.Blake3);
+    } else {
+        crypto_sha512_init(&Hash->Ctx.Sha512);
+    }
+}
+
+STATIC VOID KnownHashUpdate(IN OUT KNOWN_HASH_CTX* Hash, IN CONST VOID* Data, IN UINTN Length) {
+    if (Hash->Blake3) {
+        Blake3UpdateParallel(&Hash->Ctx.Blake3, Data, Length);
+    } else {
+        UINT64 Start = bh_get_performance_counter();
+        crypto_sha512_update(&Hash->Ctx.Sha512, (CONST uint8_t*)Data, (uint32_t)Length);
+        bh_counters_add_hash(Length, bh_get_performance_counter() - Start);
+    }
+}
+
+// Digest is 64 bytes either way; a BLAKE3 value is zero-padded so cache
+// records keep one size
+STATIC VOID KnownHashFinal(IN OUT KNOWN_HASH_CTX* Hash, OUT UINT8* Digest) {
+    if (Hash->Blake3) {
+        ZeroMem(Digest, CRYPTO_SHA512_DIGEST_LENGTH);
+        crypto_blake3_final(&Hash->Ctx.Blake3, Digest);
+    } else {
+        crypto_sha512_final(&Hash->Ctx.Sha512, Digest);
+    }
+    crypto_zeroize_context(Hash, sizeof(*Hash));
+}
+
+/**
+ * Bring up everything the countdown and menu draw with: console mode,
+ * asset bundle, theme, language, font and mouse. Runs once, and only when
+ * something is about to be shown; a fast boot never pays for it.
+ */
+STATIC VOID InitBootUi(IN CONST BOOT_CONFIG* config) {
+    STATIC BOOLEAN Ready = FALSE;
+
+    if (Ready) {
+        return;
+    }
+    Ready = TRUE;
+
+    gST->ConOut->SetMode(gST->ConOut, 0);
+    gST->ConOut->ClearScreen(gST->ConOut);
+
+    // The asset bundle, when present, supplies theme, font and locales in
+    // one read; apply it before the language so a bundled locale wins
+    LoadAssetBundle(ASSET_BUNDLE_PATH);
+    if (GetBootMenuTheme()->background_image == NULL && config->background_image[0] != '\0') {
+        LoadThemeBackground(config->background_image);
+    }
+
+    // Apply language and font from configuration before any UI
+    SetLanguage(config->language);
+    if (GetAssetBundleFont() == NULL && config->font_path[0] != '\0') {
+        Font* user_font = LoadFontFile(config->font_path);
+        if (user_font) {
+            SetFontPixelSize(user_font, (uint16_t)config->font_size);
+            SetDefaultFont(user_font);
+        }
+    }
+
+    // Theme loading and language setup (language already applied from config)
+    LoadThemeAndLanguageFromConfig();
+
+    // Initialize mouse
+    InitMouse();
+}
+
 // =============================================================================
 // MAIN ENTRY POINT - Boot process initialization
 // =============================================================================
@@ -799,9 +1310,8 @@ InitializeBloodHorn (VOID)
 // hardware detection, configuration loading, and kernel execution.
 
 /**
- * Main entry point for BloodHorn bootloader
+ * Boot process proper, run by UefiMain
  * 
- * Called by UEFI firmware to orchestrate the entire boot process.
  * Sets up the system, detects hardware, loads configuration,
  * and boots the selected kernel.
  * 
@@ -809,9 +1319,9 @@ InitializeBloodHorn (VOID)
  * @param SystemTable Pointer to UEFI system table
  * @return EFI_SUCCESS if kernel boots successfully, error code otherwise
  */
+STATIC
 EFI_STATUS
-EFIAPI
-UefiMain (
+BloodHornMain (
   IN EFI_HANDLE ImageHandle,
   IN EFI_SYSTEM_TABLE *SystemTable
   )
@@ -831,13 +1341,21 @@ UefiMain (
     Status = gBS->HandleProtocol(ImageHandle, &gEfiLoadedImageProtocolGuid, (VOID **)&LoadedImage);
     if (EFI_ERROR(Status)) return Status;
 
+    // Let the RNG seed from the firmware as well as the CPU
+    InstallEntropySource(TRUE);
+
+    // The TPM event log goes in loader pages so the OS can map it in place
+    EFI_PHYSICAL_ADDRESS EventLogPages;
+    if (!EFI_ERROR(gBS->AllocatePages(AllocateAnyPages, EfiLoaderData,
+                                      EFI_SIZE_TO_PAGES(TPM2_EVENT_LOG_DEFAULT_SIZE), &EventLogPages))) {
+        tpm2_set_event_log_buffer((VOID*)(UINTN)EventLogPages, TPM2_EVENT_LOG_DEFAULT_SIZE);
+    }
+
     // Locate graphics output protocol for GUI support
     Status = gBS->LocateProtocol(&gEfiGraphicsOutputProtocolGuid, NULL, (VOID **)&GraphicsOutput);
 
-    // Set up the console - clear the screen and reset text output
+    // Reset text output; the mode switch and clear wait for InitBootUi
     gST->ConOut->Reset(gST->ConOut, FALSE);
-    gST->ConOut->SetMode(gST->ConOut, 0);
-    gST->ConOut->ClearScreen(gST->ConOut);
 
     // Detect and initialize PowerPC architecture if needed
     uint32_t pvr = mfspr(SPR_PVR);
@@ -893,10 +1411,15 @@ UefiMain (
         bh_size_t *DescriptorSize
     );
 
+    // Pages for Rust-side allocations, claimed only once something asks
+    bhshim_pages_init();
+
     bh_system_table_t bloodhorn_system_table = {
         // Memory management (use UEFI services)
         .alloc = (void* (*)(bh_size_t))AllocatePool,
         .free = (void (*)(void*))FreePool,
+        .alloc_pages = (void* (*)(bh_size_t))AllocatePages,
+        .free_pages = (void (*)(void*, bh_size_t))FreePages,
 
         // Console output (redirect to UEFI console)
         .putc = bh_uefi_putc,
@@ -910,7 +1433,7 @@ UefiMain (
         .get_graphics_info = NULL, // Graphics are handled outside libb
 
         // ACPI and firmware tables (use UEFI or Coreboot tables)
-        .get_rsdp = (void* (*)(void))GetRsdp,
+        .get_rsdp = bh_uefi_get_rsdp,
         .get_boot_device = NULL, // Platform specific
 
         // Power management (use UEFI runtime services)
@@ -918,85 +1441,219 @@ UefiMain (
         .shutdown = bh_uefi_shutdown,
 
         // Debugging
-        .debug_break = bh_uefi_debug_break
+        .debug_break = bh_uefi_debug_break,
+
+        // Timeline clock for the boot tracer and perf counters
+        .get_performance_counter = bh_uefi_get_performance_counter,
+        .get_performance_frequency = bh_uefi_get_performance_frequency,
+
+        // Debug log export
+        .write_file = bh_uefi_write_file,
+
+        // APs for the libb task pool
+        .get_ap_count = bh_uefi_get_ap_count,
+        .start_aps = bh_uefi_start_aps,
+        .aps_idle = bh_uefi_aps_idle,
+
+        // Memory column of the boot trace
+        .get_memory_in_use = bh_uefi_get_memory_in_use
     };
 
     // Initialize the BloodHorn library
     bh_status_t bh_status = bh_initialize(&bloodhorn_system_table);
+    bh_trace_reset();
+
+    // libb logging records into the binary ring down to verbose level;
+    // only errors are formatted on the spot
+    bh_debug_config_t DebugConfig = {
+        .min_level = BH_DEBUG_LEVEL_VERBOSE,
+        .category_mask = BH_DEBUG_CAT_ALL,
+        .flags = BH_DEBUG_FLAG_DEFAULT | BH_DEBUG_FLAG_BINARY,
+        .output = BH_DEBUG_OUTPUT_MEMORY,
+        .output_file = BOOT_LOG_FILE
+    };
+    bh_debug_initialize(&DebugConfig);
+
+    // Appliance builds boot their payload bundle before any disk is
+    // touched; the normal boot follows only if the bundle allows it
+    if (BH_PAYLOAD_BUNDLE != PAYLOAD_SOURCE_NONE) {
+        Status = TryPayloadBoot();
+        if (!BH_PAYLOAD_FALLBACK) {
+            Print(L"No bootable payload bundle, refusing to boot: %r\n", Status);
+            return Status;
+        }
+    }
+
+    // Raw disk reads (filesystem drivers, chainloading) share one cache
+    AttachBootBlockDevice();
+
+    // Mount every recognised partition; unchanged disks are answered from
+    // the probe cache without touching them
+    fs_init();
+    ProbeFileSystems();
     if (bh_status != BH_SUCCESS) {
         Print(L"Warning: BloodHorn library initialization failed: %a\n", bh_status_to_string(bh_status));
     } else {
         Print(L"BloodHorn library initialized successfully\n");
 
     BOOT_CONFIG config;
+    BH_TRACE_BEGIN(ConfigSpan, BH_TRACE_PHASE_CONFIG);
     Status = LoadBootConfig(&config);
+    BH_TRACE_END(ConfigSpan);
     if (EFI_ERROR(Status)) {
         Print(L"Failed to load boot configuration: %r\n", Status);
         return Status;
     }
-
-    // Apply language and font from configuration before any UI
-    SetLanguage(config.language);
-    if (config.font_path[0] != '\0') {
-        Font* user_font = LoadFontFile(config.font_path);
-        if (user_font) {
-            SetDefaultFont(user_font);
+    // Before anything is verified with the code under test
+    if (AsciiStrCmp(config.self_tests, "off") != 0) {
+        SELF_TEST_POLICY Policy = AsciiStrCmp(config.self_tests, "cached") == 0 ? SelfTestCached : SelfTestAlways;
+        Status = RunCryptoSelfTests(Policy, config.self_test_interval > 0 ? (UINT32)config.self_test_interval : 0);
+        if (EFI_ERROR(Status)) {
+            Print(L"Crypto self-tests failed, refusing to boot: %r\n", Status);
+            return Status;
+        }
+    }
+    gBootTraceExport = config.boot_trace;
+    // Without BloodHornAllocProfile set, allocations are counted from here
+    // on; the profile file is saved at handoff either way
+    if (config.trace_memory) {
+        Status = InstallAllocProfiler(TRUE);
+        if (EFI_ERROR(Status)) {
+            Print(L"Warning: allocation profiler unavailable: %r\n", Status);
+        }
+    }
+    if (config.profiler) {
+        Status = InstallBootProfiler(TRUE);
+        if (EFI_ERROR(Status)) {
+            Print(L"Warning: boot profiler unavailable: %r\n", Status);
+        }
+    }
+    gVerifyCache = config.verify_cache;
+    // A payload bundle's allowlist, if one was installed, stands in for the file
+    if (config.known_hashes[0] != '\0' && !gKnownHashesRequired) {
+        LoadKnownHashes(config.known_hashes);
+    }
+    if (config.net_cache[0] != '\0') {
+        pxe_set_image_cache(config.net_cache);
+    }
+    pxe_set_parallel_tftp(config.tftp_parallel);
+    MemPlaceSetRandomize(config.kaslr);
+    linux_set_lazy_initrd(config.lazy_initrd);
+    linux_set_efi_stub(config.efistub);
+    gFastReboot = config.fast_reboot;
+    InstallLoadProgressOverlay();
+    RegisterMultibootModules(config.mb1_modules, multiboot1_add_module);
+    RegisterMultibootModules(config.mb2_modules, multiboot2_add_module);
+
+    // DHCP on every NIC runs in the firmware's timer callbacks from here
+    // on, beside the countdown, the menu and any disk reads; only a PXE
+    // boot waits for the lease
+    BOOLEAN NetworkBoot = AsciiStrCmp(config.default_entry, "pxe") == 0;
+    if (config.enable_networking || NetworkBoot) {
+        pxe_network_start();
+    }
+
+    // The remote disk's volumes are mounted before the menu, so entries
+    // can name files on them like any other path
+    if (config.nvme_tcp[0] != '\0') {
+        block_device_t* RemoteDisk = NULL;
+        Status = AttachNvmeTcpDisk(config.nvme_tcp, &RemoteDisk);
+        if (!EFI_ERROR(Status)) {
+            Status = MountDiskVolumes(RemoteDisk, NVMETCP_MOUNT_PATH);
+        }
+        if (EFI_ERROR(Status)) {
+            Print(L"Warning: NVMe/TCP disk %a unavailable: %r\n", config.nvme_tcp, Status);
         }
     }
 
-    // Theme loading and language setup (language already applied from config)
-    LoadThemeAndLanguageFromConfig();
-
-    // Initialize mouse
-    InitMouse();
+    // A warm reset with the kernel still resident skips loading altogether;
+    // this only returns if the images cannot be used
+    if (gFastReboot) {
+        TryFastReboot();
+    }
 
     // Pre-menu autoboot based on configuration
     BOOLEAN showMenu = TRUE;
-    if (config.menu_timeout > 0) {
-        // Countdown; any key press cancels and shows menu
-        INTN secs = config.menu_timeout;
-        while (secs > 0) {
-            Print(L"Auto-boot '%a' in %d seconds... Press any key to open menu.\r\n", config.default_entry, secs);
-            
-            // Wait up to 1 second, polling key every 100ms
-            EFI_INPUT_KEY Key;
-            BOOLEAN keyPressed = FALSE;
-            for (int i = 0; i < 10; i++) {
-                Status = gST->ConIn->ReadKeyStroke(gST->ConIn, &Key);
-                if (!EFI_ERROR(Status) && (Key.ScanCode != 0)) {
-                    keyPressed = TRUE;
-                    break;
-                }
-                gBS->Stall(100000); // 100ms
+    KERNEL_PREFETCH Prefetch = { { 0 }, EFI_NOT_STARTED };
+    if (config.menu_timeout < 0) {
+        // No countdown: the menu waits for a choice
+        showMenu = TRUE;
+    } else if (config.menu_timeout == 0) {
+        // Fast boot: straight to the default entry, with the UI left
+        // uninitialised unless a key is already waiting
+        EFI_INPUT_KEY Key;
+        showMenu = !EFI_ERROR(gST->ConIn->ReadKeyStroke(gST->ConIn, &Key));
+    } else {
+        // First paint: the UI brought up and the countdown on screen
+        BH_TRACE_BEGIN(PaintSpan, BH_TRACE_PHASE_MENU_PAINT);
+        InitBootUi(&config);
+        // Countdown; any key press cancels and shows menu. The loop sleeps
+        // in WaitForEvent on the keyboard and a one-second timer, so the
+        // CPU idles between ticks instead of polling.
+        AUTOBOOT_COUNTDOWN Countdown = { NULL, config.menu_timeout, config.default_entry, FALSE };
+        Status = gBS->CreateEvent(EVT_TIMER, TPL_CALLBACK, NULL, NULL, &Countdown.Second);
+        if (!EFI_ERROR(Status)) {
+            Status = gBS->SetTimer(Countdown.Second, TimerPeriodic, 10000000); // 1s
+        }
+        if (!EFI_ERROR(Status)) {
+            AutobootPrompt(&Countdown);
+        }
+        BH_TRACE_END(PaintSpan);
+        if (!EFI_ERROR(Status)) {
+            // The kernel it will boot loads in the meantime, so the handoff
+            // follows the timeout at once. The linux default entry loads
+            // through its own protocol and is left alone.
+            if (!NetworkBoot && (AsciiStrCmp(config.default_entry, "linux") != 0 || config.kernel[0] == 0)) {
+                PrefetchKernel(BootManager, &Countdown, &Prefetch);
             }
-            
-            if (keyPressed) { showMenu = TRUE; break; }
-            secs--;
         }
-        
-        if (!showMenu) {
-            VOID* KernelBuffer = NULL;
-            UINTN KernelSize = 0;
-
-            if (AsciiStrCmp(config.default_entry, "linux") == 0 && config.kernel[0] != 0) {
-                const char* kernel_path = config.kernel;
-                const char* initrd_path = (config.initrd[0] != 0) ? config.initrd : NULL;
-                const char* cmdline = (config.cmdline[0] != 0) ? config.cmdline : "";
-
-                Status = linux_load_kernel(kernel_path, initrd_path, cmdline, &KernelBuffer, &KernelSize);
-                if (!EFI_ERROR(Status)) {
-                    Status = ExecuteKernelWithUefi(KernelBuffer, KernelSize, NULL);
-                }
+        while (!EFI_ERROR(Status) && Countdown.Seconds > 0 && !Countdown.KeyPressed) {
+            EFI_EVENT WaitList[2] = { gST->ConIn->WaitForKey, Countdown.Second };
+            UINTN WaitIndex;
+            Status = gBS->WaitForEvent(2, WaitList, &WaitIndex);
+            if (!EFI_ERROR(Status) && WaitIndex == 0) {
+                EFI_INPUT_KEY Key;
+                gST->ConIn->ReadKeyStroke(gST->ConIn, &Key);
+                Countdown.KeyPressed = TRUE;
+                break;
             }
+            if (--Countdown.Seconds > 0) {
+                AutobootPrompt(&Countdown);
+            }
+        }
+        if (Countdown.Second != NULL) {
+            gBS->CloseEvent(Countdown.Second);
+        }
+        showMenu = Countdown.KeyPressed || Countdown.Seconds > 0;
+    }
+
+    if (!showMenu) {
+        VOID* KernelBuffer = NULL;
+        UINTN KernelSize = 0;
 
-            if (EFI_ERROR(Status)) {
-                showMenu = TRUE;
+        Status = EFI_SUCCESS;
+        if (AsciiStrCmp(config.default_entry, "linux") == 0 && config.kernel[0] != 0) {
+            const char* kernel_path = config.kernel;
+            const char* initrd_path = (config.initrd[0] != 0) ? config.initrd : NULL;
+            const char* cmdline = (config.cmdline[0] != 0) ? config.cmdline : "";
+
+            Status = linux_load_kernel(kernel_path, initrd_path, cmdline, &KernelBuffer, &KernelSize);
+            if (!EFI_ERROR(Status)) {
+                Status = ExecuteKernelWithUefi(KernelBuffer, KernelSize, NULL);
             }
+        } else if (NetworkBoot) {
+            Status = BootPxeNetworkWrapper();
+        }
+
+        if (EFI_ERROR(Status)) {
+            showMenu = TRUE;
         }
     }
 
     // Populate boot menu entries once before presenting the menu
     if (showMenu) {
+        InitBootUi(&config);
+        ReleaseKernelPrefetch(&Prefetch);
         AddBootEntry(L"BloodChain Boot Protocol", BootBloodchainWrapper);
         AddBootEntry(L"Linux Kernel", BootLinuxKernelWrapper);
         AddBootEntry(L"Multiboot2 Kernel", BootMultiboot2KernelWrapper);
@@ -1012,7 +1669,9 @@ UefiMain (
         AddBootEntry(L"UEFI Shell", (EFI_STATUS (*)(void))BootUefiShellWrapper);
         AddBootEntry(L"Exit to UEFI Firmware", ExitToFirmwareWrapper);
 
+        BH_TRACE_BEGIN(MenuSpan, BH_TRACE_PHASE_MENU);
         Status = ShowBootMenu();
+        BH_TRACE_END(MenuSpan);
     }
 
     if (showMenu && EFI_ERROR(Status)) {
@@ -1022,8 +1681,16 @@ UefiMain (
     if (!showMenu || Status == EFI_SUCCESS) {
         VOID* KernelBuffer = NULL;
         UINTN KernelSize = 0;
-        Status = LoadAndVerifyKernel(L"kernel.efi", &KernelBuffer, &KernelSize);
+        if (Prefetch.Status == EFI_SUCCESS) {
+            // Loaded and verified while the countdown ran
+            KernelBuffer = Prefetch.File.Buffer;
+            KernelSize = Prefetch.File.Size;
+            Status = EFI_SUCCESS;
+        } else {
+            Status = LoadAndVerifyKernel(L"kernel.efi", &KernelBuffer, &KernelSize);
+        }
         if (!EFI_ERROR(Status)) {
+            pxe_network_cancel();
             Status = ExecuteKernel(KernelBuffer, KernelSize, NULL);
             if (!EFI_ERROR(Status)) return EFI_SUCCESS;
         }
@@ -1046,17 +1713,86 @@ UefiMain (
     return EFI_DEVICE_ERROR;
 }
 
+/**
+ * Main entry point for BloodHorn bootloader
+ * 
+ * Called by UEFI firmware. The allocation profiler goes in before
+ * anything allocates and comes out on every way back to the firmware,
+ * since its hooks in the boot services table die with this image.
+ * 
+ * @param ImageHandle EFI image handle for this bootloader
+ * @param SystemTable Pointer to UEFI system table
+ * @return EFI_SUCCESS if kernel boots successfully, error code otherwise
+ */
+EFI_STATUS
+EFIAPI
+UefiMain (
+  IN EFI_HANDLE ImageHandle,
+  IN EFI_SYSTEM_TABLE *SystemTable
+  )
+{
+    EFI_STATUS Status;
+    UINT8 Enabled = 0;
+    UINTN Size = sizeof(Enabled);
+
+    if (!EFI_ERROR(SystemTable->RuntimeServices->GetVariable(ALLOC_PROFILE_VARIABLE, &gBloodHornVariableGuid,
+                                                             NULL, &Size, &Enabled)) && Enabled) {
+        InstallAllocProfiler(TRUE);
+    }
+    Status = BloodHornMain(ImageHandle, SystemTable);
+    InstallAllocProfiler(FALSE);
+    return Status;
+}
+
 // Helper function to convert UEFI putc to bh_putc
 static void bh_uefi_putc(char c) {
     CHAR16 C[2] = {c, 0};
     gST->ConOut->OutputString(gST->ConOut, C);
 }
 
-// Helper function to convert UEFI puts to bh_puts
+// Helper function to convert UEFI puts to bh_puts; widened in chunks so a
+// line costs one OutputString call rather than one per character
 static void bh_uefi_puts(const char* s) {
+    CHAR16 Chunk[128];
+    UINTN n;
+
     while (*s) {
-        bh_uefi_putc(*s++);
+        for (n = 0; *s && n < ARRAY_SIZE(Chunk) - 1; n++) {
+            Chunk[n] = (CHAR16)(UINT8)*s++;
+        }
+        Chunk[n] = 0;
+        gST->ConOut->OutputString(gST->ConOut, Chunk);
+    }
+}
+
+// Backs bh_debug_save_log; the path is a file name on the boot device
+static bh_status_t bh_uefi_write_file(const char* path, const void* data, bh_size_t size) {
+    CHAR16 Name[64];
+
+    if (EFI_ERROR(AsciiStrToUnicodeStrS(path, Name, ARRAY_SIZE(Name)))) {
+        return BH_INVALID_ARGUMENT;
     }
+    return EFI_ERROR(WriteBootFile(Name, data, size)) ? BH_DEVICE_ERROR : BH_SUCCESS;
+}
+
+// Task pool hooks over MP Services
+static bh_uint32_t bh_uefi_get_ap_count(void) {
+    return MpTaskApCount();
+}
+
+static bh_uint32_t bh_uefi_start_aps(void (*worker)(void* context), void* context) {
+    return MpTaskStartAps(worker, context);
+}
+
+static bh_bool_t bh_uefi_aps_idle(void) {
+    return MpTaskApsIdle() ? BH_TRUE : BH_FALSE;
+}
+
+// RSDP from the platform table index (fwinfo.c)
+static void* bh_uefi_get_rsdp(void) {
+    uint32_t Size;
+    int IsV2;
+    return (void*)fwinfo_acpi_rsdp(&Size, &IsV2);
 }
 
 // Helper function for UEFI reboot
@@ -1126,7 +1862,7 @@ STATIC EFI_STATUS ShowBootMenu(VOID) {
 }
 
 EFI_STATUS EFIAPI BootRecoveryShellWrapper(VOID) {
-    return shell_start();
+    return StartPlugin(L"shell");
 }
 
 EFI_STATUS EFIAPI BootUefiShellWrapper(VOID) {
@@ -1159,6 +1895,161 @@ EFI_STATUS EFIAPI ExitToFirmwareWrapper(VOID) {
     return EFI_SUCCESS;
 }
 
+// Hash the BloodChain modules that have no digest yet, up to 16 images per
+// multi-buffer batch, and record the digests for the kernel. With a TPM the
+// hashing is the measurement's own, so each image is hashed only once.
+STATIC VOID DigestBloodchainModules(struct bcbp_header* hdr, BOOLEAN Measure) {
+    UINT64 Next = 0;
+
+    while (Next < hdr->module_count) {
+        TPM2_MEASUREMENT Measurements[16];
+        crypto_sha256_job_t Jobs[16];
+        struct bcbp_module* Mods[16];
+        UINT8 Digests[16][CRYPTO_SHA256_DIGEST_LENGTH];
+        UINT32 Count = 0;
+
+        ZeroMem(Measurements, sizeof(Measurements));
+        for (; Next < hdr->module_count && Count < ARRAY_SIZE(Mods); Next++) {
+            struct bcbp_module* Mod = bcbp_get_module(hdr, Next);
+            if ((Mod->flags & BCBP_MODFLAG_SHA256) || Mod->type == BCBP_MODTYPE_TPM_LOG ||
+                Mod->size == 0 || Mod->size > MAX_UINT32) continue;
+            Measurements[Count].pcr_index = Mod->type == BCBP_MODTYPE_KERNEL ? TPM2_PCR_KERNEL : TPM2_PCR_INITRD;
+            Measurements[Count].event_type = EV_IPL;
+            Measurements[Count].data = (CONST VOID*)(UINTN)Mod->start;
+            Measurements[Count].data_size = (UINT32)Mod->size;
+            Measurements[Count].description = bcbp_module_name(hdr, Mod);
+            Measurements[Count].digest = Digests[Count];
+            Jobs[Count].data = (CONST UINT8*)(UINTN)Mod->start;
+            Jobs[Count].len = (UINT32)Mod->size;
+            Jobs[Count].digest = Digests[Count];
+            Mods[Count++] = Mod;
+        }
+        if (Count == 0) {
+            break;
+        }
+
+        INT32 Result = Measure ? tpm2_measure_batch(Measurements, Count) : crypto_sha256_multi(Jobs, Count);
+        if (Result != 0) {
+            Print(L"Warning: failed to %a BloodChain modules\n", Measure ? "measure" : "hash");
+            continue;
+        }
+        for (UINT32 i = 0; i < Count; i++) {
+            bcbp_set_module_digest(Mods[i], Digests[i]);
+        }
+    }
+}
+
+/**
+ * Fill in the firmware tables, finish the TPM log, exit boot services and
+ * jump to hdr->entry_point. Only returns on failure.
+ */
+STATIC EFI_STATUS StartBloodchainKernel(struct bcbp_header* hdr) {
+    EFI_STATUS Status;
+
+    // Everything from here to ExitBootServices is handoff; the span is
+    // still open when the boot manager records it
+    BH_TRACE_BEGIN(HandoffSpan, BH_TRACE_PHASE_HANDOFF);
+
+    // ACPI and SMBIOS, from the platform table index
+    UINT32 RsdpSize;
+    int RsdpV2;
+    CONST VOID* Rsdp = fwinfo_acpi_rsdp(&RsdpSize, &RsdpV2);
+    if (Rsdp) {
+        bcbp_set_acpi_rsdp(hdr, (UINT64)(UINTN)Rsdp);
+    }
+    if (fwinfo_smbios_entry()) {
+        bcbp_set_smbios(hdr, (UINT64)(UINTN)fwinfo_smbios_entry());
+    }
+
+    // Set framebuffer information if available
+    EFI_GRAPHICS_OUTPUT_PROTOCOL* Gop = NULL;
+    Status = gBS->LocateProtocol(&gEfiGraphicsOutputProtocolGuid, NULL, (void**)&Gop);
+    if (!EFI_ERROR(Status) && Gop) {
+        bcbp_set_framebuffer(hdr, Gop->Mode->FrameBufferBase);
+    }
+
+    // Set secure boot status
+    UINT8 SecureBoot = 0;
+    UINTN DataSize = sizeof(SecureBoot);
+    if (EFI_ERROR(gRT->GetVariable(L"SecureBoot", &gEfiGlobalVariableGuid,
+                                 NULL, &DataSize, &SecureBoot)) == EFI_SUCCESS) {
+        hdr->secure_boot = SecureBoot;
+    }
+
+    // Set UEFI 64-bit flag
+    hdr->uefi_64bit = (sizeof(UINTN) == 8) ? 1 : 0;
+
+    // Validate BCBP structure
+    if (bcbp_validate(hdr) != 0) {
+        Print(L"Invalid BCBP structure\n");
+        BH_TRACE_END(HandoffSpan);
+        return EFI_LOAD_ERROR;
+    }
+
+    // Jump to kernel
+    typedef void (*KernelEntry)(struct bcbp_header*);
+    KernelEntry EntryPoint = (KernelEntry)(UINTN)hdr->entry_point;
+
+    pxe_network_cancel();
+
+    EFI_STATUS EStatus;
+
+    if (tpm2_is_available()) {
+        InstallTpmPoller(FALSE);
+        if (tpm2_measure_flush() != 0) {
+            Print(L"Warning: failed to extend measured PCRs\n");
+        }
+        // The log is complete now; the kernel finds it as a module
+        const TPM2_EVENT_LOG* EventLog = tpm2_get_event_log();
+        bcbp_add_module(hdr, (UINT64)(UINTN)EventLog->log_buffer, EventLog->log_size, "tpm-event-log",
+                        BCBP_MODTYPE_TPM_LOG, NULL);
+    }
+    // The binary debug ring is rendered to text once, for the kernel
+    CONST char* BootLog;
+    bh_size_t BootLogSize;
+    if (bh_debug_get_memory_buffer(&BootLog, &BootLogSize) == BH_SUCCESS && BootLogSize) {
+        bcbp_add_module(hdr, (UINT64)(UINTN)BootLog, BootLogSize, "boot-log",
+                        BCBP_MODTYPE_BOOT_LOG, NULL);
+    }
+    SaveBootTrace();
+    SaveBootProfile();
+    SaveAllocProfile();
+    PublishPerformanceCounters();
+    BootManagerFlushState();
+    blockdev_detach();
+    InstallEntropySource(FALSE);
+    BH_TRACE_BEGIN(ExitSpan, BH_TRACE_PHASE_EXIT_BS);
+
+    // The BloodChain header carries no memory map of its own
+    EStatus = ExitBootServicesWithMemoryMap(NULL, 0, NULL, NULL);
+
+    BH_TRACE_END(ExitSpan);
+    BH_TRACE_END(HandoffSpan);
+    if (EFI_ERROR(EStatus)) {
+        Print(L"Failed to exit boot services (status=%r)\n", EStatus);
+        return EFI_LOAD_ERROR;
+    }
+
+    EntryPoint(hdr);
+
+    return EFI_LOAD_ERROR;
+}
+
+// Remember the digests of the modules being handed over, so that a warm
+// reboot may hand the very same bytes back without loading them
+STATIC VOID RecordResidentModules(struct bcbp_header* hdr) {
+    UINT8 Digests[16][CRYPTO_SHA256_DIGEST_LENGTH];
+    UINTN Count = 0;
+
+    for (UINT64 i = 0; i < hdr->module_count && Count < ARRAY_SIZE(Digests); i++) {
+        struct bcbp_module* Mod = bcbp_get_module(hdr, i);
+        if (Mod->flags & BCBP_MODFLAG_SHA256) {
+            CopyMem(Digests[Count++], Mod->sha256, CRYPTO_SHA256_DIGEST_LENGTH);
+        }
+    }
+    ResidentImageRecord(&Digests[0][0], Count);
+}
+
 // BloodChain Boot Protocol implementation
 EFI_STATUS EFIAPI BootBloodchainWrapper(VOID) {
     EFI_STATUS Status;
@@ -1175,7 +2066,9 @@ EFI_STATUS EFIAPI BootBloodchainWrapper(VOID) {
 
     // Initialize BCBP header
     struct bcbp_header* hdr = (struct bcbp_header*)(UINTN)BcbpBase;
-    bcbp_init(hdr, KernelBase, 0);  // 0 for boot device (set by bootloader)
+    if (bcbp_init(hdr, 64 * 1024, KernelBase, 0) != 0) {  // 0 for boot device (set by bootloader)
+        return EFI_BUFFER_TOO_SMALL;
+    }
 
     // Load kernel
     const char* kernel_path = "kernel.elf";
@@ -1193,9 +2086,19 @@ EFI_STATUS EFIAPI BootBloodchainWrapper(VOID) {
     }
 
     // Add kernel module
+    hdr->entry_point = KernelLoadAddr;
     bcbp_add_module(hdr, KernelLoadAddr, KernelSize, "kernel",
                    BCBP_MODTYPE_KERNEL, cmdline);
 
+    // Hash and measure the kernel now: its extend runs on the TPM, driven
+    // by the poll timer, while the initrd is read
+    BOOLEAN Measure = tpm2_is_available();
+    if (Measure) {
+        tpm2_measure_defer();
+        InstallTpmPoller(TRUE);
+    }
+    DigestBloodchainModules(hdr, Measure);
+
     // Load initrd if it exists
     EFI_PHYSICAL_ADDRESS InitrdLoadAddr = KernelLoadAddr + ALIGN_UP(KernelSize, 0x1000);
     UINTN InitrdSize = 0;
@@ -1208,115 +2111,210 @@ EFI_STATUS EFIAPI BootBloodchainWrapper(VOID) {
         }
     }
 
-    // Set up ACPI and SMBIOS if available
-    EFI_ACPI_2_0_ROOT_SYSTEM_DESCRIPTION_POINTER* Rsdp = NULL;
-    EFI_CONFIGURATION_TABLE* ConfigTable = gST->ConfigurationTable;
-
-    for (UINTN i = 0; i < gST->NumberOfTableEntries; i++) {
-        if (CompareGuid(&ConfigTable[i].VendorGuid, &gEfiAcpi20TableGuid)) {
-            Rsdp = (EFI_ACPI_2_0_ROOT_SYSTEM_DESCRIPTION_POINTER*)ConfigTable[i].VendorTable;
-            break;
-        }
+    // The remaining modules share SIMD lanes in one batch; their extends
+    // follow the kernel's in the background
+    DigestBloodchainModules(hdr, Measure);
+    if (gFastReboot) {
+        RecordResidentModules(hdr);
     }
 
-    if (Rsdp) {
-        bcbp_set_acpi_rsdp(hdr, (UINT64)(UINTN)Rsdp);
+    // Print boot information
+    Print(L"Booting with BloodChain Boot Protocol\n");
+    Print(L"  Kernel: 0x%llx (%u bytes)\n", KernelLoadAddr, KernelSize);
+    if (InitrdSize > 0) {
+        Print(L"  Initrd: 0x%llx (%u bytes)\n", InitrdLoadAddr, InitrdSize);
     }
+    Print(L"  Command line: %a\n", cmdline);
 
-    // Find SMBIOS table
-    for (UINTN i = 0; i < gST->NumberOfTableEntries; i++) {
-        if (CompareGuid(&ConfigTable[i].VendorGuid, &gEfiSmbiosTableGuid)) {
-            bcbp_set_smbios(hdr, (UINT64)(UINTN)ConfigTable[i].VendorTable);
-            break;
-        }
-    }
+    return StartBloodchainKernel(hdr);
+}
 
-    // Set framebuffer information if available
-    EFI_GRAPHICS_OUTPUT_PROTOCOL* Gop = NULL;
-    Status = gBS->LocateProtocol(&gEfiGraphicsOutputProtocolGuid, NULL, (void**)&Gop);
-    if (!EFI_ERROR(Status) && Gop) {
-        bcbp_set_framebuffer(hdr, Gop->Mode->FrameBufferBase);
+// =============================================================================
+// WARM REBOOT FAST PATH
+// =============================================================================
+//
+// Before a warm reset the OS may keep a BloodChain block and the modules it
+// describes in memory and leave a FAST_REBOOT_REQUEST pointing at them. With
+// [boot] fast_reboot the next boot claims those pages, hashes the modules
+// and, if every one of them is an image an earlier full boot handed over,
+// jumps straight back in. Anything else falls through to a normal boot.
+
+#define FAST_REBOOT_VARIABLE    L"BloodHornFastReboot"
+#define FAST_REBOOT_MAGIC       SIGNATURE_32('B', 'H', 'F', 'R')
+
+// Set by the OS (non-volatile, runtime access) just before the reset
+typedef struct {
+    UINT32 Magic;           // FAST_REBOOT_MAGIC
+    UINT32 BlockSize;       // Bytes kept at Block
+    UINT64 Block;           // Physical address of the bcbp_header
+} FAST_REBOOT_REQUEST;
+
+/**
+ * Take [Start, Start + Size) out of the free memory, failing if the
+ * firmware has used any of it since the reset
+ */
+STATIC EFI_STATUS ClaimResidentRange(UINT64 Start, UINT64 Size) {
+    EFI_PHYSICAL_ADDRESS Address = Start;
+
+    if ((Start & EFI_PAGE_MASK) != 0 || Size == 0 || Start + Size < Start) {
+        return EFI_INVALID_PARAMETER;
     }
+    return gBS->AllocatePages(AllocateAddress, EfiLoaderData, EFI_SIZE_TO_PAGES(Size), &Address);
+}
 
-    // Set secure boot status
-    UINT8 SecureBoot = 0;
-    UINTN DataSize = sizeof(SecureBoot);
-    if (EFI_ERROR(gRT->GetVariable(L"SecureBoot", &gEfiGlobalVariableGuid,
-                                 NULL, &DataSize, &SecureBoot)) == EFI_SUCCESS) {
-        hdr->secure_boot = SecureBoot;
+/**
+ * Every module must be page-aligned in its own pages, hash to a digest
+ * the loader has handed over before, and the entry point must lie in a
+ * kernel module. Claimed counts the modules whose pages are held.
+ */
+STATIC BOOLEAN CheckResidentModules(struct bcbp_header* hdr, BOOLEAN Measure, OUT UINT64* Claimed) {
+    BOOLEAN EntryFound = FALSE;
+
+    for (*Claimed = 0; *Claimed < hdr->module_count; (*Claimed)++) {
+        struct bcbp_module* Mod = bcbp_get_module(hdr, *Claimed);
+        if (EFI_ERROR(ClaimResidentRange(Mod->start, Mod->size))) {
+            return FALSE;
+        }
+        // Digests are the loader's to vouch for, never the OS's
+        Mod->flags &= ~BCBP_MODFLAG_SHA256;
     }
 
-    // Set UEFI 64-bit flag
-    hdr->uefi_64bit = (sizeof(UINTN) == 8) ? 1 : 0;
+    DigestBloodchainModules(hdr, Measure);
 
-    // Validate BCBP structure
-    if (bcbp_validate(hdr) != 0) {
-        Print(L"Invalid BCBP structure\n");
-        return EFI_LOAD_ERROR;
+    for (UINT64 i = 0; i < hdr->module_count; i++) {
+        struct bcbp_module* Mod = bcbp_get_module(hdr, i);
+        if (!(Mod->flags & BCBP_MODFLAG_SHA256) || !ResidentImageKnown(Mod->sha256)) {
+            return FALSE;
+        }
+        if (Mod->type == BCBP_MODTYPE_KERNEL && hdr->entry_point >= Mod->start &&
+            hdr->entry_point - Mod->start < Mod->size) {
+            EntryFound = TRUE;
+        }
     }
+    return EntryFound;
+}
 
-    // Print boot information
-    Print(L"Booting with BloodChain Boot Protocol\n");
-    Print(L"  Kernel: 0x%llx (%u bytes)\n", KernelLoadAddr, KernelSize);
-    if (InitrdSize > 0) {
-        Print(L"  Initrd: 0x%llx (%u bytes)\n", InitrdLoadAddr, InitrdSize);
+/**
+ * Hand the resident images from before the reset back to their kernel.
+ * The request is consumed first, so a handoff that goes wrong is not
+ * retried on the next reset. Returns only if a normal boot has to follow.
+ */
+STATIC VOID TryFastReboot(VOID) {
+    FAST_REBOOT_REQUEST Request;
+    UINTN Size = sizeof(Request);
+    UINT64 Claimed = 0;
+
+    if (EFI_ERROR(gRT->GetVariable(FAST_REBOOT_VARIABLE, &gBloodHornVariableGuid, NULL, &Size, &Request))) {
+        return;
+    }
+    gRT->SetVariable(FAST_REBOOT_VARIABLE, &gBloodHornVariableGuid, 0, 0, NULL);
+    if (Size != sizeof(Request) || Request.Magic != FAST_REBOOT_MAGIC ||
+        Request.BlockSize < sizeof(struct bcbp_header) ||
+        EFI_ERROR(ClaimResidentRange(Request.Block, Request.BlockSize))) {
+        return;
+    }
+
+    struct bcbp_header* hdr = (struct bcbp_header*)(UINTN)Request.Block;
+    BOOLEAN Measure = tpm2_is_available();
+    if (Measure) {
+        tpm2_measure_defer();
+        InstallTpmPoller(TRUE);
+    }
+    BH_TRACE_BEGIN(VerifySpan, BH_TRACE_PHASE_VERIFY);
+    BOOLEAN Usable = hdr->block_size <= Request.BlockSize && bcbp_validate(hdr) == 0 &&
+                     CheckResidentModules(hdr, Measure, &Claimed);
+    BH_TRACE_END(VerifySpan);
+
+    if (Usable) {
+        Print(L"Fast reboot: %llu resident modules\n", hdr->module_count);
+        StartBloodchainKernel(hdr);
+    } else {
+        Print(L"Fast reboot: resident images do not match, loading from disk\n");
     }
-    Print(L"  Command line: %a\n", cmdline);
 
-    // Jump to kernel
-    typedef void (*KernelEntry)(struct bcbp_header*);
-    KernelEntry EntryPoint = (KernelEntry)(UINTN)KernelLoadAddr;
-
-    // Properly exit boot services (robustly handle map changes/races)
-    UINTN MapSize = 0, MapKey = 0, DescSize = 0;
-    UINT32 DescVer = 0;
-    EFI_MEMORY_DESCRIPTOR* MemMap = NULL;
-    EFI_STATUS EStatus = EFI_SUCCESS;
-
-    const int max_retries = 8;
-    int attempt = 0;
-    while (attempt++ < max_retries) {
-        MapSize = 0;
-        EStatus = gBS->GetMemoryMap(&MapSize, MemMap, &MapKey, &DescSize, &DescVer);
-        if (EStatus == EFI_BUFFER_TOO_SMALL) {
-            if (MemMap) { 
-                FreePool(MemMap); 
-                MemMap = NULL; 
-            }
-            MemMap = AllocatePool(MapSize);
-            if (!MemMap) { 
-                EStatus = EFI_OUT_OF_RESOURCES; 
-                break; 
-            }
-            EStatus = gBS->GetMemoryMap(&MapSize, MemMap, &MapKey, &DescSize, &DescVer);
-        }
+    // What was measured stays in the log; the normal boot follows it
+    if (Measure) {
+        InstallTpmPoller(FALSE);
+        tpm2_measure_flush();
+    }
+    for (UINT64 i = 0; i < Claimed; i++) {
+        struct bcbp_module* Mod = bcbp_get_module(hdr, i);
+        gBS->FreePages(Mod->start, EFI_SIZE_TO_PAGES(Mod->size));
+    }
+    gBS->FreePages(Request.Block, EFI_SIZE_TO_PAGES(Request.BlockSize));
+}
 
-        if (EFI_ERROR(EStatus)) {
-        // Unexpected error; retry a couple times
-            CpuPause();
-            continue;
-        }
+/**
+ * Boot the payload bundle this build carries (boot/payload.h). Its
+ * settings are applied from their pre-split records, its hash section
+ * becomes the allowlist, and its kernel and initrd go through the in-place
+ * loader straight from the bundle: no disk is probed and no configuration
+ * file is read or parsed. UEFI variable overrides are not applied, as the
+ * bundle's signature does not cover them. Returns only when there is no
+ * usable bundle or its kernel did not start.
+ */
+STATIC EFI_STATUS TryPayloadBoot(VOID) {
+    PAYLOAD_BUNDLE Bundle;
+    BOOT_CONFIG config;
+    CONFIG_APPLY Apply = { &config, L"payload bundle" };
+    EFI_STATUS Status;
 
-        // Try to exit boot services; if it fails with EFI_INVALID_PARAMETER the map changed -> retry
-        EStatus = gBS->ExitBootServices(gImageHandle, MapKey);
-        if (EStatus == EFI_INVALID_PARAMETER) {
-            // Map changed between GetMemoryMap and ExitBootServices; retry
-            CpuPause();
-            continue;
+    BH_TRACE_BEGIN(VerifySpan, BH_TRACE_PHASE_VERIFY);
+    Status = LoadPayloadBundle(&Bundle);
+    BH_TRACE_END(VerifySpan);
+    if (EFI_ERROR(Status)) {
+        if (Status != EFI_NOT_FOUND) {
+            Print(L"Payload bundle rejected: %r\n", Status);
         }
-
-        // On success or other error, break and handle below
-        break;
+        return Status;
     }
-
-    if (MemMap) { FreePool(MemMap); MemMap = NULL; }
-    if (EFI_ERROR(EStatus)) {
-        Print(L"Failed to exit boot services (status=%r)\n", EStatus);
-        return EFI_LOAD_ERROR;
+    if (Bundle.Kernel == NULL) {
+        Print(L"Payload bundle has no kernel\n");
+        return EFI_NOT_FOUND;
     }
 
-    EntryPoint(hdr);
+    BH_TRACE_BEGIN(ConfigSpan, BH_TRACE_PHASE_CONFIG);
+    SetDefaultBootConfig(&config);
+    Status = ForEachPayloadSetting(&Bundle, ApplyConfigEntry, &Apply);
+    BH_TRACE_END(ConfigSpan);
+    if (EFI_ERROR(Status)) {
+        Print(L"Payload bundle settings are malformed: %r\n", Status);
+        return Status;
+    }
+    // Also governs whatever a fallback boot loads after this one fails
+    if (Bundle.Hashes != NULL) {
+        InstallKnownHashes(Bundle.Hashes, Bundle.HashesSize, L"payload bundle");
+    }
+    MemPlaceSetRandomize(config.kaslr);
+
+    if (tpm2_is_available()) {
+        TPM2_MEASUREMENT Measurements[2];
+        UINT32 Count = 0;
+
+        ZeroMem(Measurements, sizeof(Measurements));
+        Measurements[Count].pcr_index = TPM2_PCR_KERNEL;
+        Measurements[Count].event_type = EV_IPL;
+        Measurements[Count].data = Bundle.Kernel;
+        Measurements[Count].data_size = Bundle.KernelSize;
+        Measurements[Count++].description = "payload kernel";
+        if (Bundle.Initrd != NULL) {
+            Measurements[Count].pcr_index = TPM2_PCR_INITRD;
+            Measurements[Count].event_type = EV_IPL;
+            Measurements[Count].data = Bundle.Initrd;
+            Measurements[Count].data_size = Bundle.InitrdSize;
+            Measurements[Count++].description = "payload initrd";
+        }
+        BH_TRACE_BEGIN(MeasureSpan, BH_TRACE_PHASE_TPM_MEASURE);
+        if (tpm2_measure_batch(Measurements, Count) != 0) {
+            Print(L"Warning: failed to measure the payload bundle\n");
+        }
+        BH_TRACE_END(MeasureSpan);
+    }
 
+    Print(L"Booting payload bundle: %u KiB kernel, %u KiB initrd\n",
+          Bundle.KernelSize / 1024, Bundle.InitrdSize / 1024);
+    linux_boot_image(Bundle.Kernel, Bundle.KernelSize, Bundle.Initrd, Bundle.InitrdSize, config.cmdline);
+    Print(L"Payload bundle kernel did not start\n");
     return EFI_LOAD_ERROR;
 }
 
@@ -1364,144 +2362,399 @@ EFI_STATUS BootFromNetwork(CONST CHAR16* kernel_path, CONST CHAR16* initrd_path,
     return (rc == 0) ? EFI_SUCCESS : EFI_LOAD_ERROR;
 }
 
-STATIC EFI_STATUS LoadAndStartImageFromPath(EFI_HANDLE ParentImage, EFI_HANDLE DeviceHandle, CONST CHAR16* Path) {
-    EFI_STATUS Status;
-    EFI_SIMPLE_FILE_SYSTEM_PROTOCOL* Fs = NULL;
-    EFI_FILE_PROTOCOL* Root = NULL;
-    EFI_FILE_PROTOCOL* File = NULL;
-    EFI_DEVICE_PATH_PROTOCOL* FilePath = NULL;
-    VOID* Buffer = NULL;
-    UINTN Size = 0;
+// Digests of a chainloaded image, fed from a file stream: the allowlist's
+// digest of the file, the Authenticode SHA-256 for dbx
+typedef struct {
+    BOOLEAN             Allowlist;
+    BOOLEAN             Revocation;
+    KNOWN_HASH_CTX      Hash;
+    authenticode_ctx_t  Pe;
+} CHAINLOAD_VERIFY;
 
-    Status = gBS->HandleProtocol(DeviceHandle, &gEfiSimpleFileSystemProtocolGuid, (VOID**)&Fs);
-    if (EFI_ERROR(Status)) return Status;
-    Status = Fs->OpenVolume(Fs, &Root);
-    if (EFI_ERROR(Status)) return Status;
+STATIC CHAINLOAD_VERIFY mChainloadVerify;
+
+STATIC EFI_STATUS ChainloadHashChunk(VOID* Context, CONST VOID* Data, UINTN Length) {
+    CHAINLOAD_VERIFY* Verify = (CHAINLOAD_VERIFY*)Context;
+    if (Verify->Allowlist) {
+        KnownHashUpdate(&Verify->Hash, Data, Length);
+    }
+    if (Verify->Revocation) {
+        // A failure sticks and is reported by authenticode_final
+        authenticode_update(&Verify->Pe, (CONST uint8_t*)Data, (uint32_t)Length);
+    }
+    return EFI_SUCCESS;
+}
 
-    Status = Root->Open(Root, &File, (CHAR16*)Path, EFI_FILE_MODE_READ, 0);
-    if (EFI_ERROR(Status)) { Root->Close(Root); return Status; }
-
-    EFI_FILE_INFO* Info = NULL;
-    UINTN InfoSize = 0;
-    Status = File->GetInfo(File, &gEfiFileInfoGuid, &InfoSize, NULL);
-    if (Status == EFI_BUFFER_TOO_SMALL) {
-        Info = AllocateZeroPool(InfoSize);
-        if (!Info) { File->Close(File); Root->Close(Root); return EFI_OUT_OF_RESOURCES; }
-        Status = File->GetInfo(File, &gEfiFileInfoGuid, &InfoSize, Info);
-    }
-    if (EFI_ERROR(Status)) { if (Info) FreePool(Info); File->Close(File); Root->Close(Root); return Status; }
-    Size = (UINTN)Info->FileSize;
-    Buffer = AllocateZeroPool(Size);
-    if (!Buffer) { FreePool(Info); File->Close(File); Root->Close(Root); return EFI_OUT_OF_RESOURCES; }
-    Status = File->Read(File, &Size, Buffer);
-    File->Close(File);
-    Root->Close(Root);
-    FreePool(Info);
-    if (EFI_ERROR(Status)) { FreePool(Buffer); return Status; }
+// Check both digests once the stream has delivered the whole file
+STATIC EFI_STATUS ChainloadVerifyFinal(CHAINLOAD_VERIFY* Verify, CONST CHAR16* Path) {
+    EFI_STATUS Status = EFI_SUCCESS;
 
-    FilePath = FileDevicePath(DeviceHandle, Path);
-    if (!FilePath) { FreePool(Buffer); return EFI_OUT_OF_RESOURCES; }
+    if (Verify->Allowlist) {
+        uint8_t actual_hash[64];
+        KnownHashFinal(&Verify->Hash, actual_hash);
+        if (!KnownHashAllows(Path, actual_hash)) {
+            Print(L"Image hash verification failed: %s\n", Path);
+            Status = EFI_SECURITY_VIOLATION;
+        }
+    }
+    if (Verify->Revocation && !EFI_ERROR(Status)) {
+        uint8_t pe_hash[CRYPTO_SHA256_DIGEST_LENGTH];
+        if (authenticode_final(&Verify->Pe, pe_hash) != CRYPTO_SUCCESS || ImageDigestRevoked(pe_hash)) {
+            Print(L"Image is revoked by dbx or not a valid PE image: %s\n", Path);
+            Status = EFI_SECURITY_VIOLATION;
+        }
+    }
+    return Status;
+}
+
+/**
+ * Load an EFI image straight from its volume and start it
+ *
+ * The firmware reads the image itself from the device path, so a multi-MB
+ * binary (bootmgfw.efi, shim, a shell) is not read and copied by us first.
+ * When the image has to be checked, the file is hashed by a background
+ * stream whose reads are serviced while LoadImage blocks, and the image is
+ * only started once the digests pass; otherwise it is unloaded again:
+ *  - with a [boot] known_hashes allowlist, the allowlist must have its path
+ *    and SHA-512 (or BLAKE3)
+ *  - when dbx lists image hashes, its Authenticode SHA-256, hashed in
+ *    section order as the file streams past, must not be among them
+ * The digests are of the file on the media, beside the firmware's own
+ * Secure Boot check of what it loaded.
+ */
+EFI_STATUS EFIAPI LoadAndStartImageFromPath(EFI_HANDLE ParentImage, EFI_HANDLE DeviceHandle, CONST CHAR16* Path) {
     EFI_HANDLE Child = NULL;
-    Status = gBS->LoadImage(FALSE, ParentImage, FilePath, Buffer, Size, &Child);
-    FreePool(FilePath);
-    FreePool(Buffer);
-    if (EFI_ERROR(Status)) return Status;
+    EFI_STATUS Status = LoadVerifiedImageFromPath(ParentImage, DeviceHandle, Path, &Child);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    // The image gets the NICs without our DHCP children on them
+    pxe_network_cancel();
     return gBS->StartImage(Child, NULL, NULL);
 }
 
+/**
+ * The loading half of LoadAndStartImageFromPath: the image is loaded and
+ * verified but not started, so the caller can set its load options or
+ * install protocols for it first. On failure nothing is left loaded.
+ */
+EFI_STATUS EFIAPI LoadVerifiedImageFromPath(EFI_HANDLE ParentImage, EFI_HANDLE DeviceHandle, CONST CHAR16* Path,
+                                            EFI_HANDLE* Image) {
+    EFI_STATUS Status;
+    EFI_STATUS VerifyStatus = EFI_SUCCESS;
+    EFI_DEVICE_PATH_PROTOCOL* FilePath = NULL;
+    CHAINLOAD_VERIFY* Verify = &mChainloadVerify;
+    FILE_STREAM* Stream = NULL;
+    EFI_HANDLE Child = NULL;
+
+    FilePath = FileDevicePath(DeviceHandle, Path);
+    if (!FilePath) return EFI_OUT_OF_RESOURCES;
+
+    Verify->Allowlist = gKnownHashesRequired;
+    Verify->Revocation = ImageRevocationsListed();
+    if (Verify->Allowlist || Verify->Revocation) {
+        if (Verify->Allowlist) KnownHashInit(&Verify->Hash);
+        if (Verify->Revocation) authenticode_init(&Verify->Pe);
+        Status = StartFileStream(DeviceHandle, Path, ChainloadHashChunk, Verify, &Stream);
+        if (EFI_ERROR(Status)) {
+            crypto_zeroize_context(Verify, sizeof(*Verify));
+            FreePool(FilePath);
+            return Status;
+        }
+    }
+
+    Status = gBS->LoadImage(FALSE, ParentImage, FilePath, NULL, 0, &Child);
+    FreePool(FilePath);
+
+    if (Stream) {
+        // Whatever the stream has not read yet is read now
+        VerifyStatus = FinishFileStream(Stream, !EFI_ERROR(Status));
+        if (!EFI_ERROR(Status) && !EFI_ERROR(VerifyStatus)) {
+            VerifyStatus = ChainloadVerifyFinal(Verify, Path);
+        }
+        crypto_zeroize_context(Verify, sizeof(*Verify));
+    }
+    if (EFI_ERROR(Status)) {
+        // A Secure Boot rejection still leaves a handle to unload
+        if (Status == EFI_SECURITY_VIOLATION && Child) gBS->UnloadImage(Child);
+        return Status;
+    }
+    if (EFI_ERROR(VerifyStatus)) {
+        gBS->UnloadImage(Child);
+        return VerifyStatus;
+    }
+    *Image = Child;
+    return EFI_SUCCESS;
+}
+
+// Per-load verification state: the allowlist digest of the image and,
+// with [boot] verify_cache, its identity for the verified-image cache
+typedef struct {
+    KNOWN_HASH_CTX      Digest;
+    BOOLEAN             Hash;       // Hash this load (cold or changed image)
+    BOOLEAN             Cache;      // Collect the file identity as well
+    IMAGE_CACHE_LOOKUP  Lookup;
+    EFI_STATUS          (*Poll)(VOID* Context);     // Optional, run per chunk; an error cancels the load
+    VOID*               PollContext;
+} KERNEL_VERIFY_STATE;
+
+// Too large for the stack next to the decompressor
+STATIC KERNEL_VERIFY_STATE mKernelVerify;
+
+/**
+ * Feed one freshly read chunk of the kernel into the digest and the cache
+ * identity
+ */
+STATIC EFI_STATUS KernelHashChunk(VOID* Context, CONST VOID* Data, UINTN Length) {
+    KERNEL_VERIFY_STATE* State = (KERNEL_VERIFY_STATE*)Context;
+    if (State->Hash) {
+        KnownHashUpdate(&State->Digest, Data, Length);
+    }
+    if (State->Cache) {
+        ImageCacheChunk(&State->Lookup, Data, Length);
+    }
+    return State->Poll ? State->Poll(State->PollContext) : EFI_SUCCESS;
+}
+
 /**
  * Load and verify kernel from filesystem
  * 
- * loads a kernel file into memory and verifies its hash if security is enabled.
- * returns an error if the file doesn't exist or hash verification fails.
+ * loads a kernel file into memory and, with a [boot] known_hashes allowlist,
+ * checks that the allowlist has its path and SHA-512 (or BLAKE3, whose
+ * 2 MiB reads are hashed on all processors). returns an error if the file
+ * doesn't exist or hash verification fails.
+ *
+ * The image is streamed by LoadBootFile into page-aligned memory that can be
+ * handed straight to the kernel, and each chunk is hashed as it lands, so the
+ * image is only touched once. gzip, lz4 and zstd kernels are decompressed on
+ * the way in; the hash covers the file as stored.
+ *
+ * With [boot] verify_cache a file that an earlier boot already hashed (same
+ * volume, path, size, time and first/last 4 KiB, in a MAC-sealed NV table)
+ * is not hashed again, as long as the allowlist still has the digest it was
+ * verified against. If its edges turn out to differ it is reloaded and
+ * hashed in full.
  */
 STATIC
 EFI_STATUS
-LoadAndVerifyKernel (
-  IN CHAR16* KernelPath,
-  OUT VOID** KernelBuffer,
-  OUT UINTN* KernelSize
+LoadVerifiedKernelFile (
+  IN CONST CHAR16* KernelPath,
+  OUT LOADED_FILE* Kernel
   )
 {
     EFI_STATUS Status;
-    EFI_FILE_HANDLE root_dir;
-    EFI_FILE_HANDLE file;
-    VOID* buffer = NULL;
-    UINTN size = 0;
+    BOOLEAN verify_hash = gKnownHashesRequired;
+    KERNEL_VERIFY_STATE* State = &mKernelVerify;
 
-    // Get root directory
-    Status = get_root_dir(&root_dir);
-    if (EFI_ERROR(Status)) {
-        Print(L"Failed to get root directory\n");
-        return Status;
+    if (!KernelPath || !Kernel) {
+        return EFI_INVALID_PARAMETER;
     }
 
-    // Open kernel file
-    Status = root_dir->Open(root_dir, &file, KernelPath, EFI_FILE_MODE_READ, 0);
-    if (EFI_ERROR(Status)) {
-        Print(L"Failed to open kernel file: %s\n", KernelPath);
-        return Status;
+    State->Cache = FALSE;
+    State->Hash = verify_hash;
+    if (verify_hash && gVerifyCache) {
+        State->Cache = TRUE;
+        // The record is only as good as the digest it was verified against
+        State->Hash = !(ImageCacheBegin(KernelPath, NULL, &State->Lookup) &&
+                        KnownHashAllows(KernelPath, State->Lookup.Record->digest));
     }
 
-    // Get file size
-    EFI_FILE_INFO* info = NULL;
-    UINTN info_size = 0;
-    Status = file->GetInfo(file, &gEfiFileInfoGuid, &info_size, NULL);
-    if (Status == EFI_BUFFER_TOO_SMALL) {
-        info = AllocateZeroPool(info_size);
-        if (!info) {
-            file->Close(file);
-            return EFI_OUT_OF_RESOURCES;
-        }
-        Status = file->GetInfo(file, &gEfiFileInfoGuid, &info_size, info);
+Reload:
+    if (State->Hash) {
+        KnownHashInit(&State->Digest);
     }
 
+    // Stream the kernel in, hashing each chunk as it arrives (the hash
+    // phase is folded into the load span)
+    BH_TRACE_BEGIN(LoadSpan, State->Hash ? BH_TRACE_PHASE_LOAD "+" BH_TRACE_PHASE_HASH : BH_TRACE_PHASE_LOAD);
+    Status = LoadBootFile(KernelPath, FILE_LOAD_PAGES | FILE_LOAD_DECOMPRESS,
+                          (verify_hash || State->Poll) ? KernelHashChunk : NULL, State, Kernel);
+    BH_TRACE_END(LoadSpan);
     if (EFI_ERROR(Status)) {
-        if (info) FreePool(info);
-        file->Close(file);
+        if (Status != EFI_ABORTED) {
+            Print(L"Failed to load kernel file: %s (%r)\n", KernelPath, Status);
+        }
+        if (State->Hash) crypto_zeroize_context(&State->Digest, sizeof(State->Digest));
         return Status;
     }
 
-    size = (UINTN)info->FileSize;
-    buffer = AllocateZeroPool(size);
-    if (!buffer) {
-        FreePool(info);
-        file->Close(file);
-        return EFI_OUT_OF_RESOURCES;
+    if (Kernel->Size == 0) {
+        FreeLoadedFile(Kernel);
+        if (State->Hash) crypto_zeroize_context(&State->Digest, sizeof(State->Digest));
+        return EFI_LOAD_ERROR;
     }
 
-    // Read kernel into memory
-    Status = file->Read(file, &size, buffer);
-    file->Close(file);
-    FreePool(info);
+    // Cached: the identity only has to hold up now that the edges are in
+    if (verify_hash && !State->Hash) {
+        BOOLEAN Confirmed;
 
-    if (EFI_ERROR(Status)) {
-        FreePool(buffer);
-        return Status;
+        BH_TRACE_BEGIN(VerifySpan, BH_TRACE_PHASE_VERIFY);
+        Confirmed = ImageCacheConfirm(&State->Lookup);
+        BH_TRACE_END(VerifySpan);
+        if (!Confirmed) {
+            // Changed behind an unchanged timestamp: hash it for real
+            FreeLoadedFile(Kernel);
+            ImageCacheBegin(KernelPath, NULL, &State->Lookup);
+            State->Hash = TRUE;
+            goto Reload;
+        }
     }
 
-    *KernelBuffer = buffer;
-    *KernelSize = size;
-
     // Verify kernel hash if security is enabled
-    if (g_known_hashes[0].expected_hash[0] != 0) {
-        crypto_sha512_ctx_t ctx;
+    if (State->Hash) {
         uint8_t actual_hash[64];
+        BOOLEAN Allowed;
 
-        crypto_sha512_init(&ctx);
-        crypto_sha512_update(&ctx, buffer, (uint32_t)size);
-        crypto_sha512_final(&ctx, actual_hash);
+        BH_TRACE_BEGIN(VerifySpan, BH_TRACE_PHASE_VERIFY);
+        KnownHashFinal(&State->Digest, actual_hash);
+        Allowed = KnownHashAllows(KernelPath, actual_hash);
+        BH_TRACE_END(VerifySpan);
 
-        if (CompareMem(actual_hash, g_known_hashes[0].expected_hash, 64) != 0) {
+        if (!Allowed) {
             Print(L"Kernel hash verification failed!\n");
-            FreePool(buffer);
+            FreeLoadedFile(Kernel);
             return EFI_SECURITY_VIOLATION;
         }
+        if (State->Cache) {
+            ImageCacheRecord(&State->Lookup, actual_hash);
+        }
+    }
+
+    return EFI_SUCCESS;
+}
+
+/**
+ * LoadVerifiedKernelFile for callers that only keep the buffer and size
+ */
+STATIC
+EFI_STATUS
+LoadAndVerifyKernel (
+  IN CHAR16* KernelPath,
+  OUT VOID** KernelBuffer,
+  OUT UINTN* KernelSize
+  )
+{
+    LOADED_FILE Kernel;
+    EFI_STATUS Status;
+
+    if (!KernelBuffer || !KernelSize) {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    Status = LoadVerifiedKernelFile(KernelPath, &Kernel);
+    if (!EFI_ERROR(Status)) {
+        *KernelBuffer = Kernel.Buffer;
+        *KernelSize = Kernel.Size;
     }
+    return Status;
+}
+
+STATIC VOID AutobootPrompt(IN CONST AUTOBOOT_COUNTDOWN* Countdown) {
+    Print(L"Auto-boot '%a' in %d seconds... Press any key to open menu.\r\n", Countdown->Entry, Countdown->Seconds);
+}
+
+/**
+ * Keep the countdown going from inside a prefetch: tick the timer, and
+ * cancel the load if a key was pressed before it ran out
+ */
+STATIC EFI_STATUS AutobootPoll(VOID* Context) {
+    AUTOBOOT_COUNTDOWN* Countdown = (AUTOBOOT_COUNTDOWN*)Context;
 
+    if (Countdown->Seconds <= 0) {
+        return EFI_SUCCESS;
+    }
+    if (gBS->CheckEvent(gST->ConIn->WaitForKey) == EFI_SUCCESS) {
+        EFI_INPUT_KEY Key;
+        gST->ConIn->ReadKeyStroke(gST->ConIn, &Key);
+        Countdown->KeyPressed = TRUE;
+        return EFI_ABORTED;
+    }
+    if (gBS->CheckEvent(Countdown->Second) == EFI_SUCCESS && --Countdown->Seconds > 0) {
+        AutobootPrompt(Countdown);
+    }
     return EFI_SUCCESS;
 }
 
+/**
+ * Kernel of the entry the countdown is most likely to boot: the boot
+ * manager's default entry, else the entry with the longest boot history
+ */
+STATIC BOOLEAN PrefetchKernelPath(
+    IN BOOT_MANAGER_PROTOCOL* BootManager,
+    OUT CHAR16* Path,
+    IN UINTN PathLength
+    )
+{
+    BOOT_MANAGER_STATISTICS Stats;
+    BOOT_MANAGER_ENTRY* Entry;
+    UINT32 EntryId = 0;
+    BOOLEAN Found = FALSE;
+
+    if (!BootManager) {
+        return FALSE;
+    }
+
+    if (EFI_ERROR(BootManager->GetDefaultEntry(BootManager, &EntryId))) {
+        EntryId = 0;
+        if (!EFI_ERROR(BootManager->GetStatistics(BootManager, &Stats))) {
+            UINT32 Samples = 0;
+            for (UINT32 i = 0; i < Stats.TimedEntries; i++) {
+                if (Stats.EntryTimings[i].EntryId && Stats.EntryTimings[i].Samples > Samples) {
+                    EntryId = Stats.EntryTimings[i].EntryId;
+                    Samples = Stats.EntryTimings[i].Samples;
+                }
+            }
+        }
+    }
+    if (EntryId == 0) {
+        return FALSE;
+    }
+
+    Entry = AllocatePool(sizeof(*Entry));
+    if (!Entry) {
+        return FALSE;
+    }
+    if (!EFI_ERROR(BootManager->GetEntry(BootManager, EntryId, Entry)) && Entry->KernelPath[0] != L'\0') {
+        Found = !EFI_ERROR(StrnCpyS(Path, PathLength, Entry->KernelPath, PathLength - 1));
+    }
+    FreePool(Entry);
+    return Found;
+}
+
+/**
+ * Load and verify the kernel the countdown will boot while it counts down.
+ * Each chunk read lets AutobootPoll tick the timer, and a key press
+ * cancels the load and releases its memory.
+ */
+STATIC VOID PrefetchKernel(
+    IN BOOT_MANAGER_PROTOCOL* BootManager,
+    IN OUT AUTOBOOT_COUNTDOWN* Countdown,
+    OUT KERNEL_PREFETCH* Prefetch
+    )
+{
+    CHAR16 Path[BOOT_MANAGER_MAX_PATH_LENGTH];
+
+    if (!PrefetchKernelPath(BootManager, Path, ARRAY_SIZE(Path))) {
+        StrCpyS(Path, ARRAY_SIZE(Path), L"kernel.efi");
+    }
+
+    mKernelVerify.Poll = AutobootPoll;
+    mKernelVerify.PollContext = Countdown;
+    Prefetch->Status = LoadVerifiedKernelFile(Path, &Prefetch->File);
+    mKernelVerify.Poll = NULL;
+    mKernelVerify.PollContext = NULL;
+}
+
+/**
+ * Drop a prefetched kernel that is not going to be booted
+ */
+STATIC VOID ReleaseKernelPrefetch(IN OUT KERNEL_PREFETCH* Prefetch) {
+    if (Prefetch->Status == EFI_SUCCESS) {
+        FreeLoadedFile(&Prefetch->File);
+    }
+    Prefetch->Status = EFI_NOT_STARTED;
+}
+
 /**
  * Execute loaded kernel in hybrid environment
  * 
@@ -1519,6 +2772,9 @@ LoadAndVerifyKernel (
     Print(L"Executing kernel at 0x%llx (%u bytes)\n",
           (UINT64)(UINTN)KernelBuffer, KernelSize);
 
+    // Only closed if the kernel never gets control
+    BH_TRACE_BEGIN(HandoffSpan, BH_TRACE_PHASE_HANDOFF);
+
     // Set up execution environment based on available firmware
     if (gCorebootAvailable) {
         // Use Coreboot memory management for kernel execution
@@ -1528,6 +2784,7 @@ LoadAndVerifyKernel (
         Status = ExecuteKernelWithUefi(KernelBuffer, KernelSize, InitrdBuffer);
     }
 
+    BH_TRACE_END(HandoffSpan);
     return Status;
 }
 STATIC
@@ -1540,27 +2797,11 @@ ExecuteKernelWithCoreboot (
 {
     EFI_STATUS Status;
 
-    // Get Coreboot memory map for proper kernel setup
-    UINT32 mem_map_count = 0;
-    CONST COREBOOT_MEM_ENTRY* mem_map = CorebootGetMemoryMap(&mem_map_count);
-
-    if (!mem_map || mem_map_count == 0) {
-        Print(L"Failed to get Coreboot memory map for kernel execution\n");
-        return EFI_DEVICE_ERROR;
-    }
-
-    // Find suitable memory region for kernel execution
+    // Largest RAM region, precomputed when the coreboot table was parsed
     UINT64 kernel_base = 0;
     UINT64 largest_size = 0;
 
-    for (UINT32 i = 0; i < mem_map_count; i++) {
-        if (mem_map[i].type == CB_MEM_RAM && mem_map[i].size > largest_size) {
-            kernel_base = mem_map[i].addr;
-            largest_size = mem_map[i].size;
-        }
-    }
-
-    if (kernel_base == 0) {
+    if (!CorebootFindLargestMemoryRegion(&kernel_base, &largest_size) || kernel_base == 0) {
         Print(L"No suitable RAM region found for kernel execution\n");
         return EFI_DEVICE_ERROR;
     }
@@ -1669,39 +2910,17 @@ ExecuteKernelWithUefi (
 {
     EFI_STATUS Status;
 
-    // Get UEFI memory map for kernel setup
-    UINTN MapSize = 0, MapKey = 0, DescSize = 0;
-    UINT32 DescVer = 0;
-    EFI_MEMORY_DESCRIPTOR* MemMap = NULL;
-
-    Status = gBS->GetMemoryMap(&MapSize, MemMap, &MapKey, &DescSize, &DescVer);
-    if (Status == EFI_BUFFER_TOO_SMALL) {
-        MemMap = AllocatePool(MapSize);
-        if (!MemMap) {
-            return EFI_OUT_OF_RESOURCES;
-        }
-        Status = gBS->GetMemoryMap(&MapSize, MemMap, &MapKey, &DescSize, &DescVer);
-    }
-
+    // Boot parameters get pages of their own from the placement engine,
+    // below 4GB for 32-bit kernels, instead of sitting in whatever the
+    // first large-enough conventional region happened to be
+    EFI_PHYSICAL_ADDRESS BootParamsAddr;
+    Status = MemPlaceAllocate(sizeof(COREBOOT_BOOT_PARAMS), EFI_PAGE_SIZE, 0x100000, SIZE_4GB,
+                              MEM_PLACE_TOP_DOWN, &BootParamsAddr);
     if (EFI_ERROR(Status)) {
-        Print(L"Failed to get UEFI memory map\n");
+        Print(L"No memory for boot parameters: %r\n", Status);
         return Status;
     }
 
-    // Find suitable memory region for kernel
-    EFI_PHYSICAL_ADDRESS KernelBase = 0x100000; // Default 1MB
-
-    // Look for conventional memory above 1MB
-    for (UINTN i = 0; i < MapSize / DescSize; i++) {
-        EFI_MEMORY_DESCRIPTOR* Desc = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + i * DescSize);
-        if (Desc->Type == EfiConventionalMemory &&
-            Desc->PhysicalStart >= 0x100000 &&
-            Desc->NumberOfPages * EFI_PAGE_SIZE >= KernelSize) {
-            KernelBase = Desc->PhysicalStart;
-            break;
-        }
-    }
-
     // Configure GOP framebuffer if available
     EFI_GRAPHICS_OUTPUT_PROTOCOL* Gop = NULL;
     Status = gBS->LocateProtocol(&gEfiGraphicsOutputProtocolGuid, NULL, (VOID**)&Gop);
@@ -1714,19 +2933,26 @@ ExecuteKernelWithUefi (
               Gop->Mode->Info->PixelFormat == PixelBlueGreenRedReserved8BitPerColor ? 32 : 24);
     }
 
-    // Set up boot parameters
-    EFI_PHYSICAL_ADDRESS BootParamsAddr = KernelBase + 0x1000;
-
     // Exit boot services and execute kernel
     Status = ExitBootServicesAndExecuteKernel(KernelBuffer, KernelSize, BootParamsAddr);
 
-    if (MemMap) {
-        FreePool(MemMap);
-    }
-
     return Status;
 }
 
+// Entries the exit path's memory map table has beyond the count of the
+// map as first read: its own placement and the exit path's last
+// allocations can split a few more ranges
+#define EXIT_MEMORY_MAP_SLACK   16
+
+// fwinfo_mmap_put_t for the boot parameters' table; CB_MEM_* share the
+// E820 numbering of the fwinfo types
+STATIC VOID PutCorebootMemEntry(VOID* Table, UINT32 Index, CONST fwinfo_mmap_entry_t* Entry) {
+    COREBOOT_MEM_ENTRY* Mem = (COREBOOT_MEM_ENTRY*)Table + Index;
+    Mem->addr = Entry->addr;
+    Mem->size = Entry->len;
+    Mem->type = Entry->type;
+}
+
 /**
  * Exit boot services and execute kernel
  * 
@@ -1739,45 +2965,49 @@ ExecuteKernelWithUefi (
  * @param BootParamsAddr Physical address of boot parameters structure
  * @return EFI_SUCCESS if successful (kernel execution), error code otherwise
  */
+STATIC
+EFI_STATUS
+ExitBootServicesAndExecuteKernel (
+  IN VOID* KernelBuffer,
+  IN UINTN KernelSize,
+  IN EFI_PHYSICAL_ADDRESS BootParamsAddr
+  )
 {
     EFI_STATUS Status;
-    UINTN MapSize = 0, MapKey = 0, DescSize = 0;
-    UINT32 DescVer = 0;
-    EFI_MEMORY_DESCRIPTOR* MemMap = NULL;
-
-    // Robustly get the memory map and exit boot services (handle concurrent map updates)
-    Status = EFI_SUCCESS;
-    const int max_retries = 8;
-    int attempt = 0;
-    while (attempt++ < max_retries) {
-        MapSize = 0;
-        Status = gBS->GetMemoryMap(&MapSize, MemMap, &MapKey, &DescSize, &DescVer);
-        if (Status == EFI_BUFFER_TOO_SMALL) {
-            if (MemMap) { FreePool(MemMap); MemMap = NULL; }
-            MemMap = AllocatePool(MapSize);
-            if (!MemMap) { Status = EFI_OUT_OF_RESOURCES; break; }
-            Status = gBS->GetMemoryMap(&MapSize, MemMap, &MapKey, &DescSize, &DescVer);
-        }
-
-        if (EFI_ERROR(Status)) {
-            CpuPause();
-            continue;
-        }
-
-        Status = gBS->ExitBootServices(gImageHandle, MapKey);
-        if (Status == EFI_INVALID_PARAMETER) {
-            // Map changed between GetMemoryMap and ExitBootServices; retry
-            CpuPause();
-            continue;
-        }
-
-        // Either succeeded or failed with a different error
-        break;
-    }
+    EFI_PHYSICAL_ADDRESS MapAddr = 0;
+    UINT32 MapCapacity;
+    UINT32 MapEntries = 0;
+
+    // The final map is converted straight into a table placed now, sized
+    // from a first snapshot with slack for what is still allocated before
+    // the exit; without room for one the kernel gets no map
+    MapCapacity = fwinfo_memory_map_to(NULL, 0, NULL) + EXIT_MEMORY_MAP_SLACK;
+    if (EFI_ERROR(MemPlaceAllocate(MapCapacity * sizeof(COREBOOT_MEM_ENTRY), EFI_PAGE_SIZE, 0x100000, SIZE_4GB,
+                                   MEM_PLACE_TOP_DOWN, &MapAddr))) {
+        MapAddr = 0;
+        MapCapacity = 0;
+    }
+
+    InstallTpmPoller(FALSE);
+    pxe_network_cancel();
+    if (tpm2_is_available() && tpm2_measure_flush() != 0) {
+        Print(L"Warning: failed to extend measured PCRs\n");
+    }
+    SaveBootTrace();
+    SaveBootProfile();
+    SaveAllocProfile();
+    PublishPerformanceCounters();
+    BootManagerFlushState();
+    blockdev_detach();
+    InstallEntropySource(FALSE);
+    BH_TRACE_BEGIN(ExitSpan, BH_TRACE_PHASE_EXIT_BS);
+
+    // A stale map key is retried with the same snapshot buffer and table
+    Status = ExitBootServicesWithMemoryMap((VOID*)(UINTN)MapAddr, MapCapacity, PutCorebootMemEntry, &MapEntries);
+    BH_TRACE_END(ExitSpan);
 
     if (EFI_ERROR(Status)) {
         Print(L"Failed to exit boot services: %r\n", Status);
-        if (MemMap) FreePool(MemMap);
         return Status;
     }
 
@@ -1794,6 +3024,10 @@ ExecuteKernelWithUefi (
     boot_params->kernel_base = (UINT64)(UINTN)KernelBuffer;
     boot_params->kernel_size = KernelSize;
     boot_params->boot_flags = COREBOOT_BOOT_FLAG_KERNEL;
+    if (MapAddr != 0) {
+        boot_params->memory_map_addr = MapAddr;
+        boot_params->memory_map_entries = MIN(MapEntries, MapCapacity);
+    }
 
     // Set up framebuffer information if available (Coreboot or UEFI)
     if (gCorebootAvailable) {
@@ -1824,32 +3058,12 @@ ExecuteKernelWithUefi (
         UINT64 total_memory = CorebootGetTotalMemory();
         boot_params->memory_size = total_memory;
     } else {
-        // Calculate total memory from UEFI memory map
+        // Usable memory out of the converted map
+        CONST COREBOOT_MEM_ENTRY* Mem = (CONST COREBOOT_MEM_ENTRY*)(UINTN)MapAddr;
         UINT64 total_memory = 0;
-        if (MemMap && DescSize > 0) {
-            UINTN descriptor_count = MapSize / DescSize;
-            for (UINTN i = 0; i < descriptor_count; i++) {
-                EFI_MEMORY_DESCRIPTOR* Desc = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + i * DescSize);
-                // Validate descriptor bounds
-                if ((UINT8*)Desc + sizeof(EFI_MEMORY_DESCRIPTOR) > (UINT8*)MemMap + MapSize) {
-                    continue;
-                }
-                
-                // Only count usable memory types
-                if (Desc->Type == EfiConventionalMemory || 
-                    Desc->Type == EfiLoaderCode ||
-                    Desc->Type == EfiLoaderData || 
-                    Desc->Type == EfiBootServicesCode ||
-                    Desc->Type == EfiBootServicesData) {
-                    
-                    // Check for overflow in memory calculation
-                    if (Desc->NumberOfPages > (UINT64_MAX - total_memory) / EFI_PAGE_SIZE) {
-                        Print(L"Memory descriptor overflow detected\n");
-                        continue;
-                    }
-                    
-                    total_memory += Desc->NumberOfPages * EFI_PAGE_SIZE;
-                }
+        for (UINT32 i = 0; i < boot_params->memory_map_entries; i++) {
+            if (Mem[i].type == CB_MEM_RAM) {
+                total_memory += Mem[i].size;
             }
         }
         boot_params->memory_size = total_memory;
@@ -1862,7 +3076,6 @@ ExecuteKernelWithUefi (
     // Validate boot parameters
     if (!ValidateBootParameters(boot_params)) {
         Print(L"Boot parameters validation failed\n");
-        if (MemMap) FreePool(MemMap);
         return EFI_INVALID_PARAMETER;
     }
 
@@ -1878,30 +3091,9 @@ ExecuteKernelWithUefi (
     // Validate kernel buffer before jumping
     if (!KernelBuffer || KernelSize < 1024) {
         Print(L"Invalid kernel buffer or size\n");
-        if (MemMap) FreePool(MemMap);
         return EFI_INVALID_PARAMETER;
     }
     
-    // Check if kernel buffer is executable memory
-    BOOLEAN is_executable = FALSE;
-    if (MemMap && DescSize > 0) {
-        UINTN descriptor_count = MapSize / DescSize;
-        for (UINTN i = 0; i < descriptor_count; i++) {
-            EFI_MEMORY_DESCRIPTOR* Desc = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + i * DescSize);
-            if ((UINT8*)KernelBuffer >= Desc->PhysicalStart && 
-                (UINT8*)KernelBuffer < Desc->PhysicalStart + Desc->NumberOfPages * EFI_PAGE_SIZE) {
-                if (Desc->Type == EfiLoaderCode || Desc->Type == EfiRuntimeServicesCode) {
-                    is_executable = TRUE;
-                    break;
-                }
-            }
-        }
-    }
-    
-    if (!is_executable) {
-        Print(L"Warning: Kernel is not in executable memory region\n");
-    }
-    
     KernelEntry EntryPoint = (KernelEntry)KernelBuffer;
 
     Print(L"Jumping to kernel entry point at 0x%llx\n", (UINT64)(UINTN)KernelBuffer);
@@ -1913,7 +3105,6 @@ ExecuteKernelWithUefi (
     EntryPoint(boot_params);
 
     // If we get here, kernel execution failed
-    if (MemMap) FreePool(MemMap);
     return EFI_LOAD_ERROR;
 }
 
@@ -2016,31 +3207,19 @@ ValidateBootParameters (
  * 
  * Returns a handle to the root directory of the filesystem
  * that contains the bootloader. Used for reading config files and kernels.
+ * The handle is cached by the shared file loader and must not be closed.
  * 
  * @param root_dir Output pointer for root directory handle
  * @return EFI_SUCCESS if successful, error code otherwise
  */
+EFI_STATUS
+get_root_dir (
+  OUT EFI_FILE_HANDLE* root_dir
+  )
 {
     EFI_STATUS Status;
-    EFI_SIMPLE_FILE_SYSTEM_PROTOCOL* Fs = NULL;
-    EFI_LOADED_IMAGE_PROTOCOL* LoadedImage = NULL;
-
-    // Get the loaded image protocol to find our device
-    Status = gBS->HandleProtocol(gImageHandle, &gEfiLoadedImageProtocolGuid, (VOID**)&LoadedImage);
-    if (EFI_ERROR(Status)) {
-        Print(L"Failed to get loaded image protocol: %r\n", Status);
-        return Status;
-    }
-
-    // Get the file system protocol for the device
-    Status = gBS->HandleProtocol(LoadedImage->DeviceHandle, &gEfiSimpleFileSystemProtocolGuid, (VOID**)&Fs);
-    if (EFI_ERROR(Status)) {
-        Print(L"Failed to get file system protocol: %r\n", Status);
-        return Status;
-    }
 
-    // Open the root directory
-    Status = Fs->OpenVolume(Fs, root_dir);
+    Status = GetRootFileSystem(root_dir);
     if (EFI_ERROR(Status)) {
         Print(L"Failed to open root volume: %r\n", Status);
         return Status;
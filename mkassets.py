@@ -0,0 +1,232 @@
+# mkassets.py
+#
+# This file is part of BloodHorn and is licensed under the BSD License.
+# See the root of the repository for license details.
+#
+
+"""
+Asset Bundle Builder
+
+Packs the boot menu's theme, background image, font and locale strings
+into a single bloodhorn.assets file (see boot/assets.h for the layout).
+The bootloader reads it with one file load and uses every section in
+place, instead of opening and parsing each asset on its own at boot.
+
+Example:
+    python3 mkassets.py -o bloodhorn.assets --theme bloodhorn.ini \\
+        --background wallpaper.bmp --font ter-116n.psf \\
+        --locale en=locales/en.ini --locale es=locales/es.ini
+"""
+
+import argparse
+import struct
+import sys
+
+BUNDLE_MAGIC = 0x42414842  # "BHAB"
+BUNDLE_VERSION = 1
+SECTION_ALIGN = 64
+NAME_LENGTH = 16
+
+TYPE_THEME = 1
+TYPE_IMAGE = 2
+TYPE_FONT = 3
+TYPE_LOCALE = 4
+
+HEADER = struct.Struct("<IHHII")
+TOC_ENTRY = struct.Struct("<IIIHH%ds" % NAME_LENGTH)
+THEME = struct.Struct("<7I%ds" % NAME_LENGTH)
+
+# Same defaults as boot/theme.c
+THEME_DEFAULTS = {
+    "background_color": 0x1A1A2E,
+    "header_color": 0x2D2D4F,
+    "highlight_color": 0x4A4A8A,
+    "text_color": 0xCCCCCC,
+    "selected_text_color": 0xFFFFFF,
+    "footer_color": 0x8888AA,
+    "glyph_cache_size": 256,
+}
+
+
+def fail(message):
+    sys.exit("mkassets: " + message)
+
+
+def encode_name(name):
+    raw = name.encode("ascii")
+    if len(raw) >= NAME_LENGTH:
+        fail("asset name '%s' must be shorter than %d bytes" % (name, NAME_LENGTH))
+    return raw
+
+
+def read_ini_section(path, section):
+    """key -> value for one [section] of an INI file (keys lowercased)."""
+    values = {}
+    current = None
+    with open(path, encoding="utf-8") as f:
+        for line in f:
+            line = line.strip()
+            if not line or line[0] in "#;":
+                continue
+            if line.startswith("[") and line.endswith("]"):
+                current = line[1:-1].strip().lower()
+            elif current == section and "=" in line:
+                key, value = line.split("=", 1)
+                values[key.strip().lower()] = value.strip()
+    return values
+
+
+def build_theme(path, background_name):
+    values = dict(THEME_DEFAULTS)
+    for key, value in read_ini_section(path, "theme").items():
+        if key in values:
+            values[key] = int(value, 0)
+    return THEME.pack(
+        values["background_color"], values["header_color"], values["highlight_color"],
+        values["text_color"], values["selected_text_color"], values["footer_color"],
+        values["glyph_cache_size"], encode_name(background_name) if background_name else b"")
+
+
+def decode_bmp(path):
+    """Uncompressed 24/32-bit BMP -> (width, height, 0x00RRGGBB rows, top first)."""
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:2] != b"BM" or len(data) < 54:
+        fail("%s: not a BMP file" % path)
+    pixel_offset = struct.unpack_from("<I", data, 10)[0]
+    width, height, planes, bpp, compression = struct.unpack_from("<iiHHI", data, 18)
+    if bpp not in (24, 32) or compression not in (0, 3):
+        fail("%s: only uncompressed 24/32-bit BMP images are supported" % path)
+    top_down = height < 0
+    height = abs(height)
+    stride = (width * (bpp // 8) + 3) & ~3
+    if pixel_offset + stride * height > len(data):
+        fail("%s: truncated pixel data" % path)
+
+    out = bytearray()
+    for y in range(height):
+        row = y if top_down else height - 1 - y
+        base = pixel_offset + row * stride
+        for x in range(width):
+            b, g, r = data[base + x * (bpp // 8):base + x * (bpp // 8) + 3]
+            out += struct.pack("<I", (r << 16) | (g << 8) | b)
+    return width, height, bytes(out)
+
+
+def decode_psf(path):
+    """PSF1/PSF2 -> (width, height, 256 glyphs of ceil(width/8) bytes per row)."""
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:2] == b"\x36\x04":
+        width, height = 8, data[3]
+        glyph_count = 512 if data[2] & 0x01 else 256
+        bytes_per_glyph = height
+        glyphs = data[4:4 + bytes_per_glyph * glyph_count]
+    elif data[:4] == b"\x72\xb5\x4a\x86":
+        (_, header_size, _, glyph_count, bytes_per_glyph,
+         height, width) = struct.unpack_from("<7I", data, 4)
+        glyphs = data[header_size:header_size + bytes_per_glyph * glyph_count]
+    else:
+        fail("%s: not a PSF1/PSF2 font" % path)
+    if len(glyphs) < bytes_per_glyph * glyph_count:
+        fail("%s: truncated glyph table" % path)
+    if width > 0xFFFF or height > 0xFFFF:
+        fail("%s: glyph cell too large" % path)
+
+    # The bootloader indexes exactly 256 glyphs of packed rows
+    table = glyphs[:bytes_per_glyph * min(glyph_count, 256)]
+    table += b"\x00" * (bytes_per_glyph * 256 - len(table))
+    return width, height, table
+
+
+def build_locale(path):
+    """Locale .ini (key=value lines) -> ASSET_LOCALE section."""
+    strings = []
+    with open(path, encoding="utf-8") as f:
+        for line in f:
+            line = line.strip()
+            if not line or line[0] in "#;" or "=" not in line:
+                continue
+            key, value = line.split("=", 1)
+            strings.append((key.strip(), value.strip()))
+
+    header_size = 4 + 8 * len(strings)
+    blob = bytearray()
+    pairs = []
+    for key, value in strings:
+        key_offset = header_size + len(blob)
+        blob += key.encode("ascii") + b"\x00"
+        if len(blob) % 2:
+            blob += b"\x00"
+        value_offset = header_size + len(blob)
+        encoded = value.encode("utf-16-le")
+        if len(encoded) != 2 * len(value):
+            fail("%s: '%s' needs characters outside UCS-2" % (path, key))
+        blob += encoded + b"\x00\x00"
+        pairs.append((key_offset, value_offset))
+
+    out = struct.pack("<I", len(strings))
+    for key_offset, value_offset in pairs:
+        out += struct.pack("<II", key_offset, value_offset)
+    return out + bytes(blob)
+
+
+def write_bundle(path, entries):
+    """entries: (type, name, width, height, payload)."""
+    toc_offset = HEADER.size
+    offset = toc_offset + TOC_ENTRY.size * len(entries)
+    toc = bytearray()
+    body = bytearray()
+    for kind, name, width, height, payload in entries:
+        offset = (offset + SECTION_ALIGN - 1) & ~(SECTION_ALIGN - 1)
+        start = offset - (toc_offset + TOC_ENTRY.size * len(entries))
+        body += b"\x00" * (start - len(body)) + payload
+        toc += TOC_ENTRY.pack(kind, offset, len(payload), width, height, encode_name(name))
+        offset += len(payload)
+
+    size = HEADER.size + len(toc) + len(body)
+    with open(path, "wb") as f:
+        f.write(HEADER.pack(BUNDLE_MAGIC, BUNDLE_VERSION, len(entries), toc_offset, size))
+        f.write(toc)
+        f.write(body)
+    return size
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Build a BloodHorn asset bundle")
+    parser.add_argument("-o", "--output", default="bloodhorn.assets", help="bundle to write")
+    parser.add_argument("--theme", help="INI file whose [theme] section sets the colors")
+    parser.add_argument("--background", help="background image (uncompressed BMP)")
+    parser.add_argument("--font", help="default font (PSF1 or PSF2)")
+    parser.add_argument("--locale", action="append", default=[], metavar="LANG=FILE",
+                        help="locale strings for LANG (repeatable)")
+    args = parser.parse_args()
+
+    entries = []
+    background_name = "background" if args.background else None
+    if args.theme or args.background:
+        theme = build_theme(args.theme, background_name) if args.theme else \
+            THEME.pack(*[THEME_DEFAULTS[k] for k in THEME_DEFAULTS], encode_name(background_name))
+        entries.append((TYPE_THEME, "theme", 0, 0, theme))
+    if args.background:
+        width, height, pixels = decode_bmp(args.background)
+        if width > 0xFFFF or height > 0xFFFF:
+            fail("%s: image too large" % args.background)
+        entries.append((TYPE_IMAGE, background_name, width, height, pixels))
+    if args.font:
+        width, height, glyphs = decode_psf(args.font)
+        entries.append((TYPE_FONT, "default", width, height, glyphs))
+    for spec in args.locale:
+        if "=" not in spec:
+            fail("--locale expects LANG=FILE, got '%s'" % spec)
+        lang, path = spec.split("=", 1)
+        entries.append((TYPE_LOCALE, lang, 0, 0, build_locale(path)))
+
+    if not entries:
+        fail("nothing to pack")
+    size = write_bundle(args.output, entries)
+    print("%s: %d sections, %d bytes" % (args.output, len(entries), size))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,200 @@
+#
+# mkpayload.py
+#
+# This file is part of BloodHorn and is licensed under the BSD License.
+# See the root of the repository for license details.
+#
+
+"""
+Payload Bundle Builder
+
+Packs an appliance's kernel, initrd, settings and known_hashes manifest
+into one signed bundle (see boot/payload.h for the layout). A build with
+PcdPayloadBundle set boots it without probing a disk or parsing a file:
+the bundle is compiled into BloodHorn.efi (--header) or stored in a
+firmware volume (BloodHorn.fdf, -D PAYLOAD_FILE=...), read once, checked
+against PK and used in place. The settings are split here, so the loader
+applies them without running the INI tokenizer.
+
+Example:
+    python3 mkpayload.py -o appliance.bundle --kernel bzImage \\
+        --initrd rootfs.cpio --config bloodhorn.ini --hashes known_hashes.txt \\
+        --key pk.key --header boot/payload_data.h
+"""
+
+import argparse
+import os
+import struct
+import subprocess
+import sys
+
+BUNDLE_MAGIC = 0x42504842  # "BHPB"
+BUNDLE_VERSION = 1
+SECTION_ALIGN = 4096
+NAME_LENGTH = 16
+INITRD_ALIGN = 4
+
+TYPE_KERNEL = 1
+TYPE_INITRD = 2
+TYPE_CONFIG = 3
+TYPE_HASHES = 4
+
+HEADER = struct.Struct("<IHHII")
+TOC_ENTRY = struct.Struct("<IIII%ds" % NAME_LENGTH)
+SETTING = struct.Struct("<BBH")
+
+# Whole-file compression boot/Arch32/loadseg.c cannot load in place
+COMPRESSED_MAGICS = [
+    (b"\x1f\x8b", "gzip"),
+    (b"\xfd7zXZ\x00", "xz"),
+    (b"\x28\xb5\x2f\xfd", "zstd"),
+    (b"\x04\x22\x4d\x18", "lz4"),
+    (b"BZh", "bzip2"),
+]
+
+
+def fail(message):
+    sys.exit("mkpayload: " + message)
+
+
+def read_file(path):
+    try:
+        with open(path, "rb") as f:
+            return f.read()
+    except OSError as e:
+        fail("%s: %s" % (path, e.strerror))
+
+
+def encode_name(path):
+    # The tail of the path, which is what identifies it in boot logs
+    raw = os.path.basename(path).encode("ascii", "replace")[:NAME_LENGTH - 1]
+    return raw
+
+
+def build_kernel(path):
+    data = read_file(path)
+    for magic, kind in COMPRESSED_MAGICS:
+        if data.startswith(magic):
+            fail("%s: %s compressed; the bundle holds the uncompressed bzImage" % (path, kind))
+    return data
+
+
+def build_initrd(paths):
+    """Concatenated cpio archives, each starting 4-byte aligned."""
+    out = bytearray()
+    for path in paths:
+        out += b"\x00" * (-len(out) % INITRD_ALIGN)
+        out += read_file(path)
+    return bytes(out)
+
+
+def build_config(path):
+    """PAYLOAD_SETTING records, split exactly as config_parse_ini would."""
+    out = bytearray()
+    section = b""
+    with open(path, "rb") as f:
+        lines = f.read().split(b"\n")
+    for number, line in enumerate(lines, 1):
+        if any((c < 0x20 and c not in (0x09, 0x0D)) or c == 0x7F for c in line):
+            fail("%s:%d: control character" % (path, number))
+        line = line.strip(b" \t\r")
+        if not line or line[:1] in (b"#", b";"):
+            continue
+        if line[:1] == b"[":
+            end = line.find(b"]")
+            if end < 0:
+                fail("%s:%d: unterminated section header" % (path, number))
+            section = line[1:end].strip(b" \t\r")
+            continue
+        if b"=" not in line:
+            continue
+        key, value = line.split(b"=", 1)
+        key = key.strip(b" \t\r")
+        value = value.strip(b" \t\r")
+        if not key:
+            fail("%s:%d: empty key" % (path, number))
+        if len(section) > 0xFF or len(key) > 0xFF or len(value) > 0xFFFF:
+            fail("%s:%d: setting too long" % (path, number))
+        out += SETTING.pack(len(section), len(key), len(value)) + section + key + value
+    return bytes(out)
+
+
+def pack_bundle(entries):
+    """entries: (type, name, payload); returns the signed part."""
+    toc_offset = HEADER.size
+    offset = toc_offset + TOC_ENTRY.size * len(entries)
+    toc = bytearray()
+    body = bytearray()
+    for kind, name, payload in entries:
+        offset = (offset + SECTION_ALIGN - 1) & ~(SECTION_ALIGN - 1)
+        start = offset - (toc_offset + TOC_ENTRY.size * len(entries))
+        body += b"\x00" * (start - len(body)) + payload
+        toc += TOC_ENTRY.pack(kind, offset, len(payload), 0, name)
+        offset += len(payload)
+
+    size = HEADER.size + len(toc) + len(body)
+    return HEADER.pack(BUNDLE_MAGIC, BUNDLE_VERSION, len(entries), toc_offset, size) + bytes(toc) + bytes(body)
+
+
+def sign(data, key):
+    """RSA PKCS#1 v1.5 SHA-256, as VerifyImageSignature checks it."""
+    try:
+        return subprocess.run(["openssl", "dgst", "-sha256", "-sign", key], input=data,
+                              stdout=subprocess.PIPE, check=True).stdout
+    except (OSError, subprocess.CalledProcessError) as e:
+        fail("signing with %s failed: %s" % (key, e))
+
+
+def write_header(path, bundle):
+    """The bundle as UINT64 words, so the header and sections stay aligned."""
+    padded = bundle + b"\x00" * (-len(bundle) % 8)
+    words = struct.unpack("<%dQ" % (len(padded) // 8), padded)
+    with open(path, "w") as f:
+        f.write("/*\n * %s\n *\n" % os.path.basename(path))
+        f.write(" * This file is part of BloodHorn and is licensed under the BSD License.\n"
+                " * See the root of the repository for license details.\n */\n\n")
+        f.write("// Generated by mkpayload.py; do not edit.\n"
+                "// Compiled in by boot/payload.c with PcdPayloadBundle = 1.\n\n")
+        f.write("static const UINTN mPayloadBundleSize = %d;\n" % len(bundle))
+        f.write("static const UINT64 mPayloadBundle[] = {\n")
+        for i in range(0, len(words), 4):
+            f.write("    " + ", ".join("0x%016XULL" % w for w in words[i:i + 4]) + ",\n")
+        f.write("};\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Build a signed BloodHorn payload bundle")
+    parser.add_argument("-o", "--output", default="payload.bundle", help="bundle to write")
+    parser.add_argument("--kernel", required=True, help="kernel image (a bzImage, not wrapped in gzip or xz)")
+    parser.add_argument("--initrd", action="append", default=[],
+                        help="cpio archive (repeatable, concatenated in order)")
+    parser.add_argument("--config", help="INI file whose settings the bundle boots with")
+    parser.add_argument("--hashes", help="known_hashes manifest for anything loaded after a fallback")
+    parser.add_argument("--key", help="PK private key (PEM) to sign with")
+    parser.add_argument("--header", help="also write the bundle as a C header (boot/payload_data.h)")
+    args = parser.parse_args()
+
+    entries = [(TYPE_KERNEL, encode_name(args.kernel), build_kernel(args.kernel))]
+    if args.initrd:
+        entries.append((TYPE_INITRD, encode_name(args.initrd[0]), build_initrd(args.initrd)))
+    if args.config:
+        entries.append((TYPE_CONFIG, encode_name(args.config), build_config(args.config)))
+    if args.hashes:
+        entries.append((TYPE_HASHES, encode_name(args.hashes), read_file(args.hashes)))
+
+    bundle = pack_bundle(entries)
+    signed = len(bundle)
+    if args.key:
+        bundle += sign(bundle, args.key)
+    else:
+        print("mkpayload: warning: unsigned; the loader rejects it until it is signed under PK")
+
+    with open(args.output, "wb") as f:
+        f.write(bundle)
+    if args.header:
+        write_header(args.header, bundle)
+    print("%s: %d sections, %d bytes signed, %d total" % (args.output, len(entries), signed, len(bundle)))
+
+
+if __name__ == "__main__":
+    main()
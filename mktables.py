@@ -0,0 +1,145 @@
+#
+# mktables.py
+#
+# This file is part of BloodHorn and is licensed under the BSD License.
+# See the root of the repository for license details.
+#
+
+"""
+Packed Table Generator
+
+Compresses the built-in bitmap fonts (boot/font_data.h, font_mono_8x8.h,
+font_bold_8x16.h) into LZ4 blocks and writes boot/font_packed.h. A build
+with BLOODHORN_PACKED_TABLES uses that header in place of the raw tables,
+so the image the firmware reads is smaller, and boot/font.c expands each
+font the first time it is asked for. Rerun this after editing a font.
+
+Example:
+    python3 mktables.py -o boot/font_packed.h
+"""
+
+import argparse
+import re
+import sys
+
+# (source header, array in it, name to emit)
+TABLES = [
+    ("boot/font_data.h", "complete_font_8x16", "packed_font_8x16"),
+    ("boot/font_mono_8x8.h", "complete_mono_font_8x8", "packed_mono_font_8x8"),
+    ("boot/font_bold_8x16.h", "complete_bold_font_8x16", "packed_bold_font_8x16"),
+]
+
+# LZ4 block rules: matches are at least 4 bytes, the last 5 bytes are
+# literals, and no match starts in the last 12
+MIN_MATCH = 4
+LAST_LITERALS = 5
+MATCH_LIMIT = 12
+MAX_OFFSET = 0xFFFF
+
+
+def fail(message):
+    sys.exit("mktables: " + message)
+
+
+def read_table(path, name):
+    try:
+        with open(path, "r") as f:
+            text = f.read()
+    except OSError as e:
+        fail("%s: %s" % (path, e.strerror))
+    match = re.search(r"\b%s\[\]\s*=\s*\{(.*?)\};" % re.escape(name), text, re.S)
+    if not match:
+        fail("%s: no array %s" % (path, name))
+    body = re.sub(r"//[^\n]*", "", match.group(1))
+    return bytes(int(v, 16) for v in re.findall(r"0x([0-9A-Fa-f]{1,2})\b", body))
+
+
+def lz4_length(out, n):
+    while n >= 255:
+        out.append(255)
+        n -= 255
+    out.append(n)
+
+
+def lz4_sequence(out, literals, match_len, offset):
+    lit = len(literals)
+    token = (min(lit, 15) << 4)
+    if match_len:
+        token |= min(match_len - MIN_MATCH, 15)
+    out.append(token)
+    if lit >= 15:
+        lz4_length(out, lit - 15)
+    out += literals
+    if match_len:
+        out += bytes((offset & 0xFF, offset >> 8))
+        if match_len - MIN_MATCH >= 15:
+            lz4_length(out, match_len - MIN_MATCH - 15)
+
+
+def lz4_compress(data):
+    """Greedy LZ4 block with a hash chain over 4-byte prefixes."""
+    out = bytearray()
+    n = len(data)
+    heads = {}
+    chain = [-1] * n
+    anchor = 0
+    pos = 0
+    limit = n - MATCH_LIMIT
+    while pos < limit:
+        key = data[pos:pos + MIN_MATCH]
+        best_len, best_off = 0, 0
+        cand = heads.get(key, -1)
+        while cand >= 0 and pos - cand <= MAX_OFFSET:
+            length = 0
+            end = n - LAST_LITERALS
+            while pos + length < end and data[cand + length] == data[pos + length]:
+                length += 1
+            if length > best_len:
+                best_len, best_off = length, pos - cand
+            cand = chain[cand]
+        chain[pos] = heads.get(key, -1)
+        heads[key] = pos
+        if best_len < MIN_MATCH:
+            pos += 1
+            continue
+        lz4_sequence(out, data[anchor:pos], best_len, best_off)
+        for i in range(pos + 1, min(pos + best_len, limit)):
+            k = data[i:i + MIN_MATCH]
+            chain[i] = heads.get(k, -1)
+            heads[k] = i
+        pos += best_len
+        anchor = pos
+    lz4_sequence(out, data[anchor:], 0, 0)
+    return bytes(out)
+
+
+def emit_array(f, name, data):
+    f.write("static const uint8_t %s[] = {\n" % name)
+    for i in range(0, len(data), 16):
+        f.write("    " + ", ".join("0x%02X" % b for b in data[i:i + 16]) + ",\n")
+    f.write("};\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Pack BloodHorn's built-in tables")
+    parser.add_argument("-o", "--output", default="boot/font_packed.h", help="header to write")
+    args = parser.parse_args()
+
+    with open(args.output, "w") as f:
+        f.write("/*\n * font_packed.h\n *\n"
+                " * This file is part of BloodHorn and is licensed under the BSD License.\n"
+                " * See the root of the repository for license details.\n */\n\n")
+        f.write("// Generated by mktables.py from the raw font headers; do not edit.\n"
+                "// LZ4 blocks, expanded by boot/font.c with BLOODHORN_PACKED_TABLES.\n\n")
+        for source, array, name in TABLES:
+            raw = read_table(source, array)
+            packed = lz4_compress(raw)
+            f.write("// %s: %d bytes packed to %d\n" % (source, len(raw), len(packed)))
+            f.write("static const uint32_t %s_size = %d;\n" % (name, len(raw)))
+            emit_array(f, name, packed)
+            f.write("\n")
+            print("%s: %d -> %d bytes" % (array, len(raw), len(packed)))
+
+
+if __name__ == "__main__":
+    main()
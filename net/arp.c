@@ -7,11 +7,81 @@
 
 #include "arp.h"
 #include "compat.h"
+#include "../rust/bhshim/bhshim.h"
 #include <stdint.h>
 #include <string.h>
-static uint8_t arp_cache_ip[4];
-static uint8_t arp_cache_mac[6];
-static int arp_cache_valid = 0;
+#include <time.h>
+
+// Free slots have expires == 0
+static arp_entry_t arp_cache[ARP_CACHE_SIZE];
+
+static uint64_t arp_now(void) {
+    return (uint64_t)time(NULL);
+}
+
+static arp_entry_t* arp_cache_find(const uint8_t* ip) {
+    uint64_t now = arp_now();
+    for (int i = 0; i < ARP_CACHE_SIZE; ++i) {
+        if (arp_cache[i].expires > now && memcmp(arp_cache[i].ip, ip, 4) == 0) return &arp_cache[i];
+    }
+    return NULL;
+}
+
+int arp_cache_lookup(const uint8_t* ip, uint8_t* mac) {
+    arp_entry_t* entry = arp_cache_find(ip);
+    if (!entry) return -1;
+    memcpy(mac, entry->mac, 6);
+    return 0;
+}
+
+// Refresh the entry for `ip` if there is one, else take the slot that
+// expires first, which is a free or dead one whenever the table has them
+static void arp_cache_store(const uint8_t* ip, const uint8_t* mac, uint64_t expires) {
+    arp_entry_t* slot = &arp_cache[0];
+    for (int i = 0; i < ARP_CACHE_SIZE; ++i) {
+        if (memcmp(arp_cache[i].ip, ip, 4) == 0) { slot = &arp_cache[i]; break; }
+        if (arp_cache[i].expires < slot->expires) slot = &arp_cache[i];
+    }
+    memcpy(slot->ip, ip, 4);
+    memcpy(slot->mac, mac, 6);
+    slot->expires = expires;
+}
+
+void arp_cache_insert(const uint8_t* ip, const uint8_t* mac) {
+    arp_cache_store(ip, mac, arp_now() + ARP_CACHE_TIMEOUT);
+}
+
+void arp_cache_flush(void) {
+    memset(arp_cache, 0, sizeof(arp_cache));
+}
+
+int arp_cache_export(arp_entry_t* entries, int max) {
+    uint64_t now = arp_now();
+    int count = 0;
+    // Insertion by expiry, newest first, keeping the `max` newest
+    for (int i = 0; i < ARP_CACHE_SIZE; ++i) {
+        if (arp_cache[i].expires <= now) continue;
+        int at = count < max ? count++ : max;
+        while (at > 0 && entries[at - 1].expires < arp_cache[i].expires) {
+            if (at < max) entries[at] = entries[at - 1];
+            at--;
+        }
+        if (at < max) entries[at] = arp_cache[i];
+    }
+    return count;
+}
+
+void arp_cache_import(const arp_entry_t* entries, int count) {
+    uint64_t now = arp_now();
+    for (int i = 0; i < count; ++i) {
+        if (entries[i].expires <= now) continue;
+        // A clock that moved backwards must not make an entry immortal
+        uint64_t expires = entries[i].expires;
+        if (expires > now + ARP_CACHE_TIMEOUT) expires = now + ARP_CACHE_TIMEOUT;
+        arp_cache_store(entries[i].ip, entries[i].mac, expires);
+    }
+}
+
 int arp_build_request(uint8_t* buf, const uint8_t* sender_mac, const uint8_t* sender_ip, const uint8_t* target_ip) {
     memset(buf, 0, 42);
     buf[0] = 0; buf[1] = 1; buf[2] = 8; buf[3] = 0; buf[4] = 6; buf[5] = 4; buf[6] = 0; buf[7] = 1;
@@ -20,8 +90,7 @@ int arp_build_request(uint8_t* buf, const uint8_t* sender_mac, const uint8_t* se
     return 28;
 }
 int arp_resolve(const uint8_t* sender_mac, const uint8_t* sender_ip, const uint8_t* target_ip, uint8_t* out_mac) {
-    if (arp_cache_valid && memcmp(target_ip, arp_cache_ip, 4) == 0) {
-        memcpy(out_mac, arp_cache_mac, 6);
+    if (arp_cache_lookup(target_ip, out_mac) == 0) {
         return 0;
     }
     uint8_t req[42];
@@ -30,15 +99,14 @@ int arp_resolve(const uint8_t* sender_mac, const uint8_t* sender_ip, const uint8
         send_ethernet(req, 42);
         for (int t = 0; t < 10000; ++t) {
             uint8_t resp[60];
+            uint8_t mac[6];
             int n = recv_ethernet(resp, 60);
-            if (n >= 42 && resp[12] == 0x08 && resp[13] == 0x06 && memcmp(resp+28, target_ip, 4) == 0) {
-                memcpy(arp_cache_ip, target_ip, 4);
-                memcpy(arp_cache_mac, resp+22, 6);
-                arp_cache_valid = 1;
-                memcpy(out_mac, resp+22, 6);
+            if (n > 0 && bhshim_arp_reply(resp, (size_t)n, target_ip, mac) == BH_SUCCESS) {
+                arp_cache_insert(target_ip, mac);
+                memcpy(out_mac, mac, 6);
                 return 0;
             }
         }
     }
     return -1;
-} 
\ No newline at end of file
+}
@@ -9,5 +9,27 @@
 #define BLOODHORN_ARP_H
 #include <stdint.h>
 #include "compat.h"
+
+#define ARP_CACHE_SIZE      16
+#define ARP_CACHE_TIMEOUT   300     // Seconds a neighbor is used without asking again
+
+// A neighbor and the wall-clock second (time()) it stops being trusted
+typedef struct {
+    uint8_t ip[4];
+    uint8_t mac[6];
+    uint8_t reserved[6];
+    uint64_t expires;
+} arp_entry_t;
+
 int arp_build_request(uint8_t* buf, const uint8_t* sender_mac, const uint8_t* sender_ip, const uint8_t* target_ip);
-#endif 
\ No newline at end of file
+// Answer from the cache while the entry is live, otherwise ask on the wire
+int arp_resolve(const uint8_t* sender_mac, const uint8_t* sender_ip, const uint8_t* target_ip, uint8_t* out_mac);
+
+int arp_cache_lookup(const uint8_t* ip, uint8_t* mac);
+void arp_cache_insert(const uint8_t* ip, const uint8_t* mac);
+void arp_cache_flush(void);
+// Copy out up to `max` live entries, most recently confirmed first, and
+// restore them on a later boot; restored entries never outlive the timeout
+int arp_cache_export(arp_entry_t* entries, int max);
+void arp_cache_import(const arp_entry_t* entries, int count);
+#endif
@@ -7,12 +7,19 @@
 
 #include "dhcp.h"
 #include "compat.h"
+#include "../rust/bhshim/bhshim.h"
 #include <stdint.h>
 #include <string.h>
-static uint8_t dhcp_options[312];
+#include <stdio.h>
 static uint32_t dhcp_lease_time;
 static uint32_t dhcp_renew_time;
 static uint32_t dhcp_rebind_time;
+static uint8_t dhcp_vendor[255];
+static int dhcp_vendor_len;
+// Option values are in network byte order
+static uint32_t get_be32(const uint8_t* v) {
+    return ((uint32_t)v[0] << 24) | ((uint32_t)v[1] << 16) | ((uint32_t)v[2] << 8) | v[3];
+}
 int dhcp_build_discover(uint8_t* buf, int xid) {
     memset(buf, 0, 300);
     buf[0] = 1; buf[1] = 1; buf[2] = 6; buf[3] = 0;
@@ -24,30 +31,112 @@ int dhcp_build_discover(uint8_t* buf, int xid) {
     buf[opt++] = 255;
     return opt;
 }
-int dhcp_parse_offer(const uint8_t* buf, uint32_t* offered_ip) {
-    *offered_ip = *(uint32_t*)&buf[16];
-    memcpy(dhcp_options, buf+240, 312);
-    for (int i = 0; i < 312;) {
-        uint8_t code = dhcp_options[i++];
-        if (code == 0xFF) break;
-        uint8_t len = dhcp_options[i++];
-        if (code == 51) dhcp_lease_time = *(uint32_t*)&dhcp_options[i];
-        if (code == 58) dhcp_renew_time = *(uint32_t*)&dhcp_options[i];
-        if (code == 59) dhcp_rebind_time = *(uint32_t*)&dhcp_options[i];
-        i += len;
+int dhcp_parse_offer(const uint8_t* buf, int len, uint32_t* offered_ip) {
+    bhshim_dhcp_iter_t it;
+    bhshim_dhcp_option_t o;
+    if (len < 0 || bhshim_dhcp_begin(&it, buf, (size_t)len) != BH_SUCCESS) return -1;
+    memcpy(offered_ip, &buf[16], 4);
+    dhcp_vendor_len = 0;
+    while (bhshim_dhcp_next(&it, &o) == BHSHIM_DHCP_OPTION) {
+        if (o.code == 51 && o.len == 4) dhcp_lease_time = get_be32(o.value);
+        if (o.code == 58 && o.len == 4) dhcp_renew_time = get_be32(o.value);
+        if (o.code == 59 && o.len == 4) dhcp_rebind_time = get_be32(o.value);
+        if (o.code == 43) {
+            memcpy(dhcp_vendor, o.value, o.len);
+            dhcp_vendor_len = o.len;
+        }
     }
     return 0;
 }
-int dhcp_renew(uint8_t* buf, int xid) {
+int dhcp_get_mtftp(mtftp_params_t* params) {
+    bhshim_dhcp_iter_t it;
+    bhshim_dhcp_option_t o;
+    memset(params, 0, sizeof(*params));
+    bhshim_dhcp_options_begin(&it, dhcp_vendor, (size_t)dhcp_vendor_len);
+    while (bhshim_dhcp_next(&it, &o) == BHSHIM_DHCP_OPTION) {
+        const uint8_t* v = o.value;
+        if (o.code == 1 && o.len == 4) memcpy(&params->ip, v, 4);
+        if (o.code == 2 && o.len == 2) params->client_port = (uint16_t)((v[0] << 8) | v[1]);
+        if (o.code == 3 && o.len == 2) params->server_port = (uint16_t)((v[0] << 8) | v[1]);
+        if (o.code == 4 && o.len == 1) params->timeout = v[0];
+        if (o.code == 5 && o.len == 1) params->delay = v[0];
+    }
+    if (!params->ip || !params->client_port || !params->server_port) {
+        memset(params, 0, sizeof(*params));
+        return -1;
+    }
+    return 0;
+}
+uint32_t dhcp_get_lease_time(void) {
+    return dhcp_lease_time;
+}
+int dhcp_renew(uint8_t* buf, int xid, const uint8_t* mac, uint32_t requested_ip) {
     memset(buf, 0, 300);
     buf[0] = 1; buf[1] = 1; buf[2] = 6; buf[3] = 0;
     *(uint32_t*)&buf[4] = xid;
+    buf[10] = 0x80; // Broadcast the reply: the address is not configured yet
+    memcpy(&buf[28], mac, 6);
     buf[236] = 99; buf[237] = 130; buf[238] = 83; buf[239] = 99;
     int opt = 240;
-    buf[opt++] = 53; buf[opt++] = 1; buf[opt++] = 5;
+    buf[opt++] = 53; buf[opt++] = 1; buf[opt++] = 3;
+    buf[opt++] = 50; buf[opt++] = 4; memcpy(&buf[opt], &requested_ip, 4); opt += 4;
+    buf[opt++] = 55; buf[opt++] = 6; buf[opt++] = 1; buf[opt++] = 3; buf[opt++] = 6; buf[opt++] = 15; buf[opt++] = 66; buf[opt++] = 67;
     buf[opt++] = 255;
     return opt;
 }
+static void copy_field(char* dst, int cap, const uint8_t* src, int len) {
+    int n = 0;
+    while (n < len && n < cap - 1 && src[n]) { dst[n] = (char)src[n]; n++; }
+    dst[n] = 0;
+}
+int dhcp_parse_ack(const uint8_t* buf, int len, int xid, dhcp_lease_t* lease) {
+    bhshim_dhcp_iter_t it;
+    bhshim_dhcp_option_t o;
+    if (len < 0 || bhshim_dhcp_begin(&it, buf, (size_t)len) != BH_SUCCESS) return -1;
+    if (buf[0] != 2 || *(const uint32_t*)&buf[4] != (uint32_t)xid) return -1;
+    int type = 0;
+    const uint8_t* name = NULL;
+    const uint8_t* file = NULL;
+    const uint8_t* vendor = NULL;
+    int name_len = 0, file_len = 0, vendor_len = 0;
+    dhcp_lease_t reply = *lease;
+    while (bhshim_dhcp_next(&it, &o) == BHSHIM_DHCP_OPTION) {
+        const uint8_t* v = o.value;
+        uint8_t olen = o.len;
+        uint8_t code = o.code;
+        if (code == 53 && olen == 1) type = v[0];
+        if (code == 1 && olen == 4) memcpy(&reply.subnet_mask, v, 4);
+        if (code == 3 && olen >= 4) memcpy(&reply.router_ip, v, 4);
+        if (code == 6 && olen >= 4) memcpy(&reply.dns_server, v, 4);
+        if (code == 54 && olen == 4) memcpy(&reply.server_ip, v, 4);
+        if (code == 51 && olen == 4) reply.lease_seconds = get_be32(v);
+        if (code == 66) { name = v; name_len = olen; }
+        if (code == 67) { file = v; file_len = olen; }
+        if (code == 43) { vendor = v; vendor_len = olen; }
+    }
+    if (type == 6) return 1;
+    if (type != 5) return -1;
+    memcpy(&reply.client_ip, &buf[16], 4);
+    // Boot server: option 66, else siaddr; boot file: option 67, else the file field
+    if (name) {
+        copy_field(reply.tftp_server, sizeof(reply.tftp_server), name, name_len);
+    } else if (buf[20] | buf[21] | buf[22] | buf[23]) {
+        snprintf(reply.tftp_server, sizeof(reply.tftp_server), "%u.%u.%u.%u", buf[20], buf[21], buf[22], buf[23]);
+    }
+    if (file) {
+        copy_field(reply.boot_file, sizeof(reply.boot_file), file, file_len);
+    } else if (buf[108]) {
+        copy_field(reply.boot_file, sizeof(reply.boot_file), &buf[108], 128);
+    }
+    // The ACK's vendor options replace the offer's for dhcp_get_mtftp
+    dhcp_vendor_len = 0;
+    if (vendor) {
+        memcpy(dhcp_vendor, vendor, vendor_len);
+        dhcp_vendor_len = vendor_len;
+    }
+    *lease = reply;
+    return 0;
+}
 int dhcp_release(uint8_t* buf, int xid) {
     memset(buf, 0, 300);
     buf[0] = 1; buf[1] = 1; buf[2] = 6; buf[3] = 0;
@@ -9,6 +9,39 @@
 #define BLOODHORN_DHCP_H
 #include <stdint.h>
 #include "compat.h"
+#include "mtftp.h"
+#define DHCP_SERVER_PORT        67
+#define DHCP_CLIENT_PORT        68
+#define DHCP_REBOOT_TIMEOUT_MS  1000    // Wait for the ACK to a reused lease
+#define DHCP_REBOOT_TRIES       2
+#define DHCP_LEASE_MARGIN       60      // Seconds a saved lease must have left to be reused
+
+// A lease as the last ACK described it. Addresses are in network byte
+// order like pxe_network_info; expires is a wall-clock second (time()).
+typedef struct {
+    uint32_t client_ip;
+    uint32_t server_ip;
+    uint32_t subnet_mask;
+    uint32_t router_ip;
+    uint32_t dns_server;
+    uint32_t lease_seconds;
+    uint64_t expires;
+    char tftp_server[64];
+    char boot_file[128];
+} dhcp_lease_t;
+
 int dhcp_build_discover(uint8_t* buf, int xid);
-int dhcp_parse_offer(const uint8_t* buf, uint32_t* offered_ip);
+// Take the offered address and lease timers of an OFFER of len bytes, and
+// keep its vendor options for dhcp_get_mtftp; -1 if it is not DHCP
+int dhcp_parse_offer(const uint8_t* buf, int len, uint32_t* offered_ip);
+// PXE multicast TFTP parameters from the last offer's vendor options
+// (option 43, suboptions 1-5); returns -1 and zeroes them if it had none
+int dhcp_get_mtftp(mtftp_params_t* params);
+// Lease time (option 51) of the last offer parsed, 0 if it had none
+uint32_t dhcp_get_lease_time(void);
+// INIT-REBOOT DHCPREQUEST for the address held before (RFC 2131 4.3.2)
+int dhcp_renew(uint8_t* buf, int xid, const uint8_t* mac, uint32_t requested_ip);
+// Apply a reply to `lease`. Fields the reply leaves out keep their value.
+// Returns 0 for an ACK, 1 for a NAK and -1 for anything else.
+int dhcp_parse_ack(const uint8_t* buf, int len, int xid, dhcp_lease_t* lease);
 #endif 
\ No newline at end of file
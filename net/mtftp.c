@@ -0,0 +1,146 @@
+/*
+ * mtftp.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include "mtftp.h"
+#include "compat.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define TFTP_OP_ACK     4
+#define TFTP_OP_ERROR   5
+
+// What a listening pass ended on, besides errors and completion
+#define MTFTP_SILENT    0       // Nothing (more) heard for the timeout
+#define MTFTP_ENDED     2       // The transfer being overheard sent its last block
+
+static int have_block(const mtftp_session_t* s, uint16_t block) {
+    return (s->have[block >> 3] >> (block & 7)) & 1;
+}
+
+// Keep a DATA block from any transfer of the file. Returns 1 once every
+// block is in, 0 to carry on, or an error.
+static int store_block(mtftp_session_t* s, uint16_t block, const uint8_t* data, int datalen,
+                       uint8_t* dst, uint64_t capacity) {
+    if (block == 0 || datalen > MTFTP_BLKSIZE) return 0;
+    if (s->blocks && block > s->blocks) return 0;
+    uint64_t offset = (uint64_t)(block - 1) * MTFTP_BLKSIZE;
+    if (datalen < MTFTP_BLKSIZE) {
+        if (s->blocks && s->blocks != block) return TFTP_ERR_PROTOCOL;
+        s->blocks = block;
+        s->length = offset + (uint64_t)datalen;
+    }
+    if (offset + (uint64_t)datalen > capacity) return TFTP_ERR_TOO_LARGE;
+    if (!have_block(s, block)) {
+        memcpy(dst + offset, data, datalen);
+        s->have[block >> 3] |= (uint8_t)(1 << (block & 7));
+        s->received++;
+    }
+    return s->blocks && s->received == s->blocks;
+}
+
+static int ack_block(mtftp_session_t* s, uint16_t port, uint16_t block) {
+    uint8_t ack[4] = { 0, TFTP_OP_ACK, (uint8_t)(block >> 8), (uint8_t)block };
+    return s->io.send(s->io.context, port, ack, sizeof(ack)) < 0 ? TFTP_ERR_IO : TFTP_OK;
+}
+
+// Store whatever the group carries without ACKing it. The first wait is
+// the open delay; once a transfer is heard it lasts until that transfer
+// ends or goes quiet for the timeout.
+static int listen_group(mtftp_session_t* s, int first_wait_ms, uint8_t* dst, uint64_t capacity) {
+    int wait_ms = first_wait_ms;
+    for (;;) {
+        uint16_t port;
+        const uint8_t* pkt;
+        int n = tftp_receive(&s->io, s->packet, sizeof(s->packet), &port, &pkt, wait_ms);
+        if (n < 0) return TFTP_ERR_IO;
+        if (n == 0) return MTFTP_SILENT;
+        uint16_t block;
+        const uint8_t* data;
+        int datalen;
+        if (port == 0 || tftp_parse_data(pkt, n, &block, &data, &datalen) != 0) continue;
+        int rc = store_block(s, block, data, datalen, dst, capacity);
+        if (rc != 0) return rc;
+        if (datalen < MTFTP_BLKSIZE) return MTFTP_ENDED;
+        wait_ms = s->params.timeout * 1000;
+    }
+}
+
+// Request the file and ACK the stream the server starts for us, in TFTP
+// lock-step. Listeners depend on the stream running to its end, so it is
+// acknowledged through the last block even when ours are all in by then.
+static int open_transfer(mtftp_session_t* s, const char* filename, uint8_t* dst, uint64_t capacity) {
+    uint8_t rrq[512];
+    int rrq_len = tftp_build_rrq(filename, rrq);
+    if (s->io.send(s->io.context, s->params.server_port, rrq, rrq_len) < 0) return TFTP_ERR_IO;
+
+    uint16_t tid = 0;           // Source port of our stream, once its first block arrives
+    uint16_t acked = 0;
+    int retries = 0;
+    for (;;) {
+        uint16_t port;
+        const uint8_t* pkt;
+        int n = tftp_receive(&s->io, s->packet, sizeof(s->packet), &port, &pkt, TFTP_TIMEOUT_MS);
+        if (n < 0) return TFTP_ERR_IO;
+        if (n == 0) {
+            // Lost request or lost ACK: repeat it, then leave the server
+            // to time out and try another round
+            if (++retries > TFTP_RETRIES) return MTFTP_SILENT;
+            int rc = tid ? ack_block(s, tid, acked)
+                         : (s->io.send(s->io.context, s->params.server_port, rrq, rrq_len) < 0 ? TFTP_ERR_IO : TFTP_OK);
+            if (rc != TFTP_OK) return rc;
+            continue;
+        }
+        if (port == 0) continue;
+        if (n >= 4 && pkt[1] == TFTP_OP_ERROR && (tid == 0 || port == tid)) return TFTP_ERR_REMOTE;
+
+        uint16_t block;
+        const uint8_t* data;
+        int datalen;
+        if (tftp_parse_data(pkt, n, &block, &data, &datalen) != 0) continue;
+        int rc = store_block(s, block, data, datalen, dst, capacity);
+        if (rc < 0) return rc;
+        if (tid == 0 && block == 1) tid = port;
+        if (port != tid) {
+            // Another client's transfer took the group first; ours will
+            // not start until it is done
+            if (datalen < MTFTP_BLKSIZE) return rc == 1 ? 1 : MTFTP_ENDED;
+            continue;
+        }
+
+        retries = 0;
+        if (block == (uint16_t)(acked + 1) || block == acked) {
+            if (ack_block(s, tid, block) != TFTP_OK) return TFTP_ERR_IO;
+            acked = block;
+        }
+        if (datalen < MTFTP_BLKSIZE && block == acked) return rc;
+    }
+}
+
+int mtftp_read(mtftp_session_t* s, const tftp_transport_t* io, const mtftp_params_t* params,
+               const char* filename, uint8_t* dst, uint64_t capacity, uint64_t* len) {
+    if (!s || !io || !params || !filename || !dst || strlen(filename) > 500) return TFTP_ERR_PROTOCOL;
+    memset(s, 0, offsetof(mtftp_session_t, packet));
+    s->io = *io;
+    s->params = *params;
+    if (!s->params.timeout) s->params.timeout = MTFTP_DEFAULT_TIMEOUT;
+    if (!s->params.delay) s->params.delay = MTFTP_DEFAULT_DELAY;
+    if (capacity > MTFTP_MAX_SIZE) capacity = MTFTP_MAX_SIZE;
+
+    for (int round = 0; round < MTFTP_ROUNDS; round++) {
+        // Join what is on the group first; open a transfer only when it
+        // stays quiet, so one stream serves every client booting together
+        int rc = listen_group(s, s->params.delay * 1000 + s->params.stagger_ms, dst, capacity);
+        if (rc == MTFTP_SILENT) rc = open_transfer(s, filename, dst, capacity);
+        if (rc < 0) return rc;
+        if (rc == 1) {
+            *len = s->length;
+            return TFTP_OK;
+        }
+    }
+    return TFTP_ERR_TIMEOUT;
+}
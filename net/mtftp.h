@@ -0,0 +1,54 @@
+/*
+ * mtftp.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_MTFTP_H
+#define BLOODHORN_MTFTP_H
+#include <stdint.h>
+#include "compat.h"
+#include "tftp.h"
+
+// PXE multicast TFTP (PXE 2.1 specification, MTFTP). The server sends one
+// stream of 512-byte blocks to a multicast group; the client that opened
+// the transfer ACKs it and every other client listening on the group
+// stores the same blocks. Block numbers do not roll over.
+#define MTFTP_BLKSIZE           512
+#define MTFTP_MAX_BLOCKS        65535
+#define MTFTP_MAX_SIZE          ((uint64_t)MTFTP_MAX_BLOCKS * MTFTP_BLKSIZE - 1)
+#define MTFTP_DEFAULT_TIMEOUT   2       // Seconds of silence that end a transfer
+#define MTFTP_DEFAULT_DELAY     2       // Seconds to listen before opening one
+#define MTFTP_ROUNDS            8       // Transfers to join or open before giving up
+
+// Group parameters, as handed out in DHCP vendor option 43 suboptions 1-5.
+// ip is in network byte order like the other addresses; ports are host order.
+typedef struct {
+    uint32_t ip;
+    uint16_t client_port;
+    uint16_t server_port;
+    uint8_t timeout;            // PXE_MTFTP_TMOUT, seconds
+    uint8_t delay;              // PXE_MTFTP_DELAY, seconds
+    uint16_t stagger_ms;        // Added to delay so clients booted together don't all open
+} mtftp_params_t;
+
+// The transport's recv delivers datagrams arriving on the group's client
+// port; send goes to the server, from that same port.
+typedef struct {
+    tftp_transport_t io;
+    mtftp_params_t params;
+    uint32_t blocks;            // Blocks in the file, 0 until its last block is seen
+    uint32_t received;          // Distinct blocks stored so far
+    uint64_t length;
+    uint8_t have[MTFTP_MAX_BLOCKS / 8 + 1];
+    uint8_t packet[MTFTP_BLKSIZE + 4];
+} mtftp_session_t;
+
+// Receive `filename` into `dst`. Blocks from a transfer already running on
+// the group are kept; the client opens a transfer of its own only when the
+// group has been silent for the delay, and afterwards only for the blocks
+// it is still missing. Returns TFTP_OK or a TFTP_ERR_* code.
+int mtftp_read(mtftp_session_t* s, const tftp_transport_t* io, const mtftp_params_t* params,
+               const char* filename, uint8_t* dst, uint64_t capacity, uint64_t* len);
+#endif
@@ -8,17 +8,120 @@
 #include "net_utils.h"
 #include "compat.h"
 #include <stdint.h>
-uint16_t net_checksum(const uint8_t* data, int len) {
-    uint32_t sum = 0;
-    for (int i = 0; i < len; i += 2) {
-        sum += (data[i]<<8) | data[i+1];
-        if (sum > 0xFFFF) sum -= 0xFFFF;
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__GNUC__)
+#include <arm_neon.h>
+#endif
+
+// The one's-complement sum is byte-order independent (RFC 1071 section
+// 2), so data is summed as native 32-bit words into 64-bit lanes, which
+// cannot overflow below 16 GiB, and only the folded result is put into
+// network order.
+
+// Add with end-around carry
+static uint64_t csum_add64(uint64_t a, uint64_t b) {
+    uint64_t s = a + b;
+    return s + (s < a);
+}
+
+static uint16_t csum_fold(uint64_t sum) {
+    sum = (sum & 0xFFFFFFFFu) + (sum >> 32);
+    sum = (sum & 0xFFFFFFFFu) + (sum >> 32);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)sum;
+}
+
+// Sum 16-byte blocks; returns the bytes consumed
+#if defined(__x86_64__) && defined(__GNUC__)
+static uint32_t csum_blocks(const uint8_t* p, uint32_t len, uint64_t* sum) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    uint32_t blocks = len / 16;
+    for (uint32_t i = 0; i < blocks; i++) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i * 16));
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(v, zero));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    *sum = csum_add64(*sum, csum_add64(lanes[0], lanes[1]));
+    return blocks * 16;
+}
+#elif defined(__aarch64__) && defined(__GNUC__)
+static uint32_t csum_blocks(const uint8_t* p, uint32_t len, uint64_t* sum) {
+    uint64x2_t acc = vdupq_n_u64(0);
+    uint32_t blocks = len / 16;
+    for (uint32_t i = 0; i < blocks; i++) {
+        acc = vpadalq_u32(acc, vreinterpretq_u32_u8(vld1q_u8(p + i * 16)));
+    }
+    *sum = csum_add64(*sum, csum_add64(vgetq_lane_u64(acc, 0), vgetq_lane_u64(acc, 1)));
+    return blocks * 16;
+}
+#else
+static uint32_t csum_blocks(const uint8_t* p, uint32_t len, uint64_t* sum) {
+    uint64_t acc = 0;
+    uint32_t blocks = len / 16;
+    for (uint32_t i = 0; i < blocks * 4; i++) {
+        uint32_t w;
+        memcpy(&w, p + i * 4, 4);
+        acc += w;
     }
-    return ~sum;
+    *sum = csum_add64(*sum, acc);
+    return blocks * 16;
+}
+#endif
+
+void net_csum_init(net_csum_t* csum) {
+    csum->sum = 0;
+    csum->length = 0;
+}
+
+void net_csum_add(net_csum_t* csum, const void* data, uint32_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    uint64_t sum = 0;
+    uint32_t done = csum_blocks(p, len, &sum);
+    uint64_t tail = 0;
+    for (; done + 4 <= len; done += 4) {
+        uint32_t w;
+        memcpy(&w, p + done, 4);
+        tail += w;
+    }
+    // Zero-pad the last 1-3 bytes to a whole word: position is what counts
+    if (done < len) {
+        uint8_t last[4] = { 0, 0, 0, 0 };
+        uint32_t w;
+        memcpy(last, p + done, len - done);
+        memcpy(&w, last, 4);
+        tail += w;
+    }
+    uint16_t folded = csum_fold(csum_add64(sum, tail));
+    // A piece starting at an odd offset has every byte in the other half
+    // of its 16-bit word
+    if (csum->length & 1) folded = (uint16_t)((folded << 8) | (folded >> 8));
+    csum->sum = csum_add64(csum->sum, folded);
+    csum->length += len;
+}
+
+uint16_t net_csum_finish(const net_csum_t* csum) {
+    uint16_t folded = (uint16_t)~csum_fold(csum->sum);
+    uint8_t bytes[2];
+    memcpy(bytes, &folded, 2);
+    return (uint16_t)((bytes[0] << 8) | bytes[1]);
+}
+
+uint16_t net_checksum(const uint8_t* data, int len) {
+    net_csum_t csum;
+    net_csum_init(&csum);
+    net_csum_add(&csum, data, len > 0 ? (uint32_t)len : 0);
+    return net_csum_finish(&csum);
 }
 void net_mac_copy(uint8_t* dst, const uint8_t* src) {
     for (int i = 0; i < 6; ++i) dst[i] = src[i];
 }
 void net_ip_copy(uint8_t* dst, const uint8_t* src) {
     for (int i = 0; i < 4; ++i) dst[i] = src[i];
-} 
\ No newline at end of file
+}
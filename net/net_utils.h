@@ -9,7 +9,23 @@
 #define BLOODHORN_NET_UTILS_H
 #include <stdint.h>
 #include "compat.h"
+
+// Running RFC 1071 one's-complement sum. Feed the pieces of a packet
+// (headers, pseudo-header, payload fragments) in order with net_csum_add;
+// the result does not depend on how the bytes are split, odd-length
+// pieces included.
+typedef struct {
+    uint64_t sum;
+    uint64_t length;            // Bytes added so far; its parity places the next piece
+} net_csum_t;
+
+void net_csum_init(net_csum_t* csum);
+void net_csum_add(net_csum_t* csum, const void* data, uint32_t len);
+// The checksum field value, as a number in host order: store it with htons
+uint16_t net_csum_finish(const net_csum_t* csum);
+
+// One-shot net_csum_* over a single buffer
 uint16_t net_checksum(const uint8_t* data, int len);
 void net_mac_copy(uint8_t* dst, const uint8_t* src);
 void net_ip_copy(uint8_t* dst, const uint8_t* src);
-#endif 
\ No newline at end of file
+#endif
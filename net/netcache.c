@@ -0,0 +1,84 @@
+/*
+ * netcache.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include "netcache.h"
+#include "compat.h"
+#include <stdint.h>
+#include <string.h>
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Requests name files as "/vmlinuz", "./vmlinuz" or "vmlinuz" alike
+static const char* skip_root(const char* path, uint32_t* len) {
+    for (;;) {
+        if (*len >= 1 && path[0] == '/') { path++; (*len)--; continue; }
+        if (*len >= 2 && path[0] == '.' && path[1] == '/') { path += 2; *len -= 2; continue; }
+        return path;
+    }
+}
+
+static int parse_line(netcache_entry_t* entry, const char* line, uint32_t len) {
+    if (len < NETCACHE_DIGEST_LENGTH * 2 + 2) return -1;
+    for (int i = 0; i < NETCACHE_DIGEST_LENGTH; i++) {
+        int hi = hex_value(line[2 * i]), lo = hex_value(line[2 * i + 1]);
+        if (hi < 0 || lo < 0) return -1;
+        entry->digest[i] = (uint8_t)(hi << 4 | lo);
+    }
+    uint32_t at = NETCACHE_DIGEST_LENGTH * 2;
+    if (line[at] != ' ' && line[at] != '\t') return -1;
+    while (at < len && (line[at] == ' ' || line[at] == '\t')) at++;
+    // sha256sum marks files hashed in binary mode with '*'
+    if (at < len && line[at] == '*') at++;
+    while (len > at && (line[len - 1] == '\r' || line[len - 1] == ' ' || line[len - 1] == '\t')) len--;
+
+    uint32_t path_len = len - at;
+    const char* path = skip_root(line + at, &path_len);
+    if (path_len == 0 || path_len >= NETCACHE_PATH_LEN) return -1;
+    memcpy(entry->path, path, path_len);
+    entry->path[path_len] = 0;
+    return 0;
+}
+
+int netcache_parse(netcache_manifest_t* manifest, const char* text, uint32_t len) {
+    manifest->count = 0;
+    manifest->blake3 = 0;
+    uint32_t at = 0;
+    while (at < len && manifest->count < NETCACHE_MAX_ENTRIES) {
+        uint32_t end = at;
+        while (end < len && text[end] != '\n' && text[end] != 0) end++;
+        if (parse_line(&manifest->entries[manifest->count], text + at, end - at) == 0) {
+            manifest->count++;
+        }
+        if (end < len && text[end] == 0) break;
+        at = end + 1;
+    }
+    return (int)manifest->count;
+}
+
+const uint8_t* netcache_lookup(const netcache_manifest_t* manifest, const char* path) {
+    uint32_t len = (uint32_t)strlen(path);
+    path = skip_root(path, &len);
+    for (uint32_t i = 0; i < manifest->count; i++) {
+        const netcache_entry_t* entry = &manifest->entries[i];
+        if (strlen(entry->path) == len && memcmp(entry->path, path, len) == 0) return entry->digest;
+    }
+    return NULL;
+}
+
+void netcache_name(const uint8_t* digest, char* name) {
+    static const char hex[] = "0123456789abcdef";
+    for (int i = 0; i < NETCACHE_DIGEST_LENGTH; i++) {
+        name[2 * i] = hex[digest[i] >> 4];
+        name[2 * i + 1] = hex[digest[i] & 15];
+    }
+    name[NETCACHE_DIGEST_LENGTH * 2] = 0;
+}
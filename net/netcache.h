@@ -0,0 +1,44 @@
+/*
+ * netcache.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_NETCACHE_H
+#define BLOODHORN_NETCACHE_H
+#include <stdint.h>
+#include "compat.h"
+
+// Local content-addressed store for network boot images. The boot server
+// publishes a manifest in sha256sum(1) or b3sum format ("<hex digest>
+// <path>" per line, paths relative to the TFTP root); an image it lists is
+// kept on the local disk as <cache dir>\<hex digest> and only downloaded on
+// a miss. Both digests are 32 bytes, so the file name says which it is.
+#define NETCACHE_MANIFEST       "SHA256SUMS"
+#define NETCACHE_MANIFEST_BLAKE3 "B3SUMS"      // Tried first
+#define NETCACHE_MANIFEST_MAX   8192    // Bytes of manifest read
+#define NETCACHE_MAX_ENTRIES    32
+#define NETCACHE_PATH_LEN       128
+#define NETCACHE_DIGEST_LENGTH  32
+#define NETCACHE_NAME_LEN       (NETCACHE_DIGEST_LENGTH * 2 + 1)
+
+typedef struct {
+    char path[NETCACHE_PATH_LEN];       // Without leading '/' or "./"
+    uint8_t digest[NETCACHE_DIGEST_LENGTH];
+} netcache_entry_t;
+
+typedef struct {
+    uint32_t count;
+    int blake3;                         // Read from NETCACHE_MANIFEST_BLAKE3
+    netcache_entry_t entries[NETCACHE_MAX_ENTRIES];
+} netcache_manifest_t;
+
+// Read a manifest; malformed lines and paths too long to keep are skipped.
+// Returns the number of entries.
+int netcache_parse(netcache_manifest_t* manifest, const char* text, uint32_t len);
+// Digest the manifest lists for `path`, or NULL
+const uint8_t* netcache_lookup(const netcache_manifest_t* manifest, const char* path);
+// Lower-case hex name of a digest, NUL terminated
+void netcache_name(const uint8_t* digest, char* name);
+#endif
@@ -90,6 +90,69 @@ struct NetworkConfig {
     std::string domain_name;
 };
 
+/**
+ * @brief Destination a download is written into
+ *
+ * reserve() is called with the size the server announced (TFTP tsize or
+ * HTTP Content-Length) before any data arrives and returns a buffer of at
+ * least that many bytes, or nullptr. Each block is written once at its
+ * final offset, so nothing is grown or copied afterwards. It may be called
+ * a second time, larger, if a first transfer attempt failed.
+ */
+class DownloadSink {
+public:
+    virtual ~DownloadSink() = default;
+    
+    virtual uint8_t* reserve(uint64_t size) = 0;
+    // Called once the transfer completes with the number of bytes written
+    virtual void commit(uint64_t length) = 0;
+};
+
+/**
+ * @brief Sink backed by boot services pages, page-aligned so the image can
+ * be handed to the kernel loaders where it landed
+ */
+class PageSink : public DownloadSink {
+public:
+    PageSink() = default;
+    ~PageSink() override;
+    
+    PageSink(const PageSink&) = delete;
+    PageSink& operator=(const PageSink&) = delete;
+    
+    uint8_t* reserve(uint64_t size) override;
+    void commit(uint64_t length) override { length_ = length; }
+    
+    uint8_t* data() const { return data_; }
+    uint64_t size() const { return length_; }
+    
+    // Give up ownership of the pages, e.g. once a kernel has been started
+    uint8_t* release();
+    
+private:
+    uint8_t* data_ = nullptr;
+    size_t pages_ = 0;
+    uint64_t length_ = 0;
+};
+
+/**
+ * @brief Sink over a buffer the caller already owns
+ */
+class BufferSink : public DownloadSink {
+public:
+    BufferSink(uint8_t* buffer, uint64_t capacity) : buffer_(buffer), capacity_(capacity) {}
+    
+    uint8_t* reserve(uint64_t size) override { return size <= capacity_ ? buffer_ : nullptr; }
+    void commit(uint64_t length) override { length_ = length; }
+    
+    uint64_t size() const { return length_; }
+    
+private:
+    uint8_t* buffer_;
+    uint64_t capacity_;
+    uint64_t length_ = 0;
+};
+
 /**
  * @brief Network interface class
  */
@@ -107,7 +170,7 @@ public:
     // PXE operations
     virtual std::error_code pxeDiscover(NetworkConfig& config) = 0;
     virtual std::error_code tftpDownload(const std::string& server, const std::string& remote_path,
-                                       std::vector<uint8_t>& data) = 0;
+                                       DownloadSink& sink) = 0;
     
     // Create appropriate network interface based on system
     static std::unique_ptr<NetworkInterface> create();
@@ -123,7 +186,7 @@ public:
     
     // Network boot operations
     std::error_code discoverNetwork();
-    std::error_code downloadFile(const std::string& path, std::vector<uint8_t>& data);
+    std::error_code downloadFile(const std::string& path, DownloadSink& sink);
     std::error_code bootKernel(const std::string& kernel_path, 
                               const std::string& initrd_path = "",
                               const std::string& cmdline = "");
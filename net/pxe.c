@@ -8,7 +8,17 @@
 #include <stdint.h>
 #include "compat.h"
 #include <string.h>
+#include <stdio.h>
 #include "pxe.h"
+#include "tftp.h"
+#include "mtftp.h"
+#include "dhcp.h"
+#include "net_utils.h"
+#include "netcache.h"
+#include "security/crypto.h"
+#include "boot/libb/include/bloodhorn/counters.h"
+#include "boot/libb/include/bloodhorn/time.h"
+#include "boot/libb/include/bloodhorn/trace.h"
 #include "boot/Arch32/linux.h"
 #include "boot/Arch32/limine.h"
 #include "boot/Arch32/multiboot1.h"
@@ -24,44 +34,219 @@ extern int pxe_get_file_size(const char* filename);
 extern int pxe_cleanup(void);
 extern int pxe_udp_send(const char* dest_ip, uint16_t dest_port, const void* data, int len);
 extern int pxe_udp_recv(char* src_ip, uint16_t* src_port, void* buf, int maxlen, int timeout_ms);
-
-struct pxe_network_info {
-    uint32_t client_ip;
-    uint32_t server_ip;
-    uint32_t subnet_mask;
-    uint32_t router_ip;
-    uint32_t dns_server;
-    char tftp_server[64];
-    char boot_file[128];
-    char domain_name[64];
-    uint32_t broadcast_ip;
-    uint32_t ntp_server;
-    uint32_t time_offset;
-};
+// Receive datagrams sent to group_ip:port on the pxe_udp_peek ring, until
+// pxe_udp_leave (uefi/netrx.c)
+extern int pxe_udp_join(const char* group_ip, uint16_t port);
+extern void pxe_udp_leave(void);
+// Like pxe_udp_recv, but pointing *data at the datagram in the receive
+// ring instead of copying it out; valid until the next call
+extern int pxe_udp_peek(char* src_ip, uint16_t* src_port, const uint8_t** data, int timeout_ms);
+extern void pxe_udp_peek_stop(void);
+extern void* allocate_memory(uint32_t size);
+// Milliseconds from an arbitrary start, wrapping; for TFTP round trips
+extern uint32_t pxe_time_ms(void);
+// Local files for the image cache; 0 on success
+extern int get_file_size(const char* path, uint32_t* size);
+extern int read_file_into(const char* path, uint8_t* buffer, uint32_t size,
+                          void (*chunk)(void* context, const uint8_t* data, uint32_t len), void* context);
+extern int save_file(const char* path, const void* data, uint32_t size);
+// Load progress display (uefi/progress.c)
+extern void load_progress_begin(const char* name, uint64_t total);
+extern void load_progress_total(uint64_t total);
+extern void load_progress_add(uint64_t bytes);
+extern void load_progress_end(void);
+extern int pxe_get_mac(uint8_t* mac);
+// Run DHCP on every NIC with a carrier at once. The first to be bound is
+// selected, becoming the NIC all other pxe_* calls use, and its lease is
+// stored in *lease. Fills nics[0..*count). Returns the selected index or -1.
+extern int pxe_nic_discover(pxe_nic_t* nics, int max, int* count, dhcp_lease_t* lease, int timeout_ms);
+// The same in two halves: start sends the DISCOVERs and returns (0, or -1
+// without NICs), finish waits for the first lease as pxe_nic_discover
+// does. Exchanges move on in the firmware's timer callbacks in between,
+// and pxe_nic_discover itself joins a discovery already started.
+extern int pxe_nic_discover_start(pxe_nic_t* nics, int max, int* count, int timeout_ms);
+extern int pxe_nic_discover_finish(dhcp_lease_t* lease);
+extern void pxe_nic_discover_cancel(void);
+// Make the NIC with this MAC the one pxe_* calls use; -1 if there is none
+extern int pxe_nic_select(const uint8_t* mac);
+// Configure the stack with an address it did not get from its own DHCP
+extern int pxe_set_station(const struct pxe_network_info* info);
+// NV storage for pxe_saved_state_t; load returns 0 only for a copy of
+// exactly `size` bytes
+extern int pxe_state_load(void* state, uint32_t size);
+extern int pxe_state_save(const void* state, uint32_t size);
 
 static struct pxe_network_info network_info;
 static int pxe_initialized = 0;
+static int pxe_discovery_started = 0;
+static pxe_nic_t pxe_nics[PXE_MAX_NICS];
+static int pxe_nic_count = 0;
+// Fetch the kernel and initrd over two TFTP sessions at once
+static int pxe_parallel_tftp = 0;
+
+// Image cache directory, empty when the cache is off, and the boot
+// server's manifest (fetched once per boot: 0 not yet, 1 have it, -1 none)
+static char pxe_cache_dir[128];
+static int pxe_manifest_state = 0;
+static netcache_manifest_t pxe_manifest;
+static char pxe_manifest_text[NETCACHE_MANIFEST_MAX];
+
+// The state in use and the copy NV storage holds
+static pxe_saved_state_t pxe_state;
+static pxe_saved_state_t pxe_state_stored;
 
-struct icmp_echo {
-    uint8_t type;
-    uint8_t code;
-    uint16_t checksum;
-    uint16_t id;
-    uint16_t seq;
-    uint8_t payload[32];
-};
+static void pxe_apply_lease(const dhcp_lease_t* lease) {
+    network_info.client_ip = lease->client_ip;
+    network_info.server_ip = lease->server_ip;
+    network_info.subnet_mask = lease->subnet_mask;
+    network_info.router_ip = lease->router_ip;
+    network_info.dns_server = lease->dns_server;
+    memcpy(network_info.tftp_server, lease->tftp_server, sizeof(network_info.tftp_server));
+    memcpy(network_info.boot_file, lease->boot_file, sizeof(network_info.boot_file));
+}
 
-static uint16_t icmp_checksum(const void* data, int len) {
-    uint32_t sum = 0;
-    const uint16_t* ptr = (const uint16_t*)data;
-    while (len > 1) {
-        sum += *ptr++;
-        len -= 2;
+// Expiry and ARP lifetimes move on every boot; anything else changing
+// needs a write
+static int pxe_state_differs(const pxe_saved_state_t* a, const pxe_saved_state_t* b) {
+    pxe_saved_state_t x = *a, y = *b;
+    x.lease.expires = y.lease.expires = 0;
+    for (int i = 0; i < PXE_SAVED_NEIGHBORS; i++) {
+        x.neighbors[i].expires = y.neighbors[i].expires = 0;
+    }
+    return memcmp(&x, &y, sizeof(x)) != 0;
+}
+
+// Store the lease and the live neighbors for the next boot. NV writes wear
+// flash, so an unchanged state is only rewritten once the stored expiry
+// is within half a lease of running out, as a client would renew at T1.
+static void pxe_save_state(void) {
+    if (pxe_state.version != PXE_STATE_VERSION) return;
+    memset(pxe_state.neighbors, 0, sizeof(pxe_state.neighbors));
+    arp_cache_export(pxe_state.neighbors, PXE_SAVED_NEIGHBORS);
+
+    uint64_t now = (uint64_t)time(NULL);
+    if (!pxe_state_differs(&pxe_state, &pxe_state_stored) &&
+        pxe_state_stored.lease.expires >= now + pxe_state.lease.lease_seconds / 2) {
+        return;
+    }
+    if (pxe_state_save(&pxe_state, sizeof(pxe_state)) == 0) {
+        pxe_state_stored = pxe_state;
+    }
+}
+
+// Load the state of the last boot; 0 if its lease is still good
+static int pxe_load_saved_lease(void) {
+    if (pxe_state_load(&pxe_state_stored, sizeof(pxe_state_stored)) != 0 ||
+        pxe_state_stored.version != PXE_STATE_VERSION) {
+        memset(&pxe_state_stored, 0, sizeof(pxe_state_stored));
+        return -1;
+    }
+    uint64_t now = (uint64_t)time(NULL);
+    if (pxe_state_stored.lease.client_ip == 0 || pxe_state_stored.lease.expires < now + DHCP_LEASE_MARGIN) {
+        return -1;
+    }
+    return 0;
+}
+
+// INIT-REBOOT: confirm the lease from the last boot with one DHCPREQUEST
+// instead of a DISCOVER/OFFER/REQUEST/ACK exchange
+static int pxe_reuse_lease(void) {
+    uint8_t mac[6];
+    if (pxe_load_saved_lease() != 0) return -1;
+    // The lease belongs to the NIC that won last time, whichever it is now
+    if (pxe_nic_select(pxe_state_stored.mac) != 0) return -1;
+    if (pxe_get_mac(mac) != 0 || memcmp(mac, pxe_state_stored.mac, 6) != 0) return -1;
+    uint64_t now = (uint64_t)time(NULL);
+
+    dhcp_lease_t lease = pxe_state_stored.lease;
+    uint8_t request[300];
+    uint8_t reply[576];
+    int xid = (int)(now ^ ((uint32_t)mac[2] << 24 | (uint32_t)mac[3] << 16 | (uint32_t)mac[4] << 8 | mac[5]));
+    int len = dhcp_renew(request, xid, mac, lease.client_ip);
+    for (int tries = 0; tries < DHCP_REBOOT_TRIES; tries++) {
+        if (pxe_udp_send("255.255.255.255", DHCP_SERVER_PORT, request, len) < 0) return -1;
+        char src_ip[16];
+        uint16_t src_port;
+        int n = pxe_udp_recv(src_ip, &src_port, reply, sizeof(reply), DHCP_REBOOT_TIMEOUT_MS);
+        if (n <= 0 || src_port != DHCP_SERVER_PORT) continue;
+        int rc = dhcp_parse_ack(reply, n, xid, &lease);
+        if (rc == 1) return -1;     // NAK: the address is gone or the network changed
+        if (rc != 0) continue;
+
+        lease.expires = now + lease.lease_seconds;
+        pxe_apply_lease(&lease);
+        if (pxe_set_station(&network_info) != 0) return -1;
+        pxe_state = pxe_state_stored;
+        pxe_state.lease = lease;
+        arp_cache_import(pxe_state_stored.neighbors, PXE_SAVED_NEIGHBORS);
+        return 0;
+    }
+    return -1;
+}
+
+// Start tracking the lease the full DHCP exchange produced
+static void pxe_record_lease(void) {
+    uint32_t seconds = dhcp_get_lease_time();
+    if (network_info.client_ip == 0 || seconds == 0 || pxe_get_mac(pxe_state.mac) != 0) return;
+    pxe_state.version = PXE_STATE_VERSION;
+    pxe_state.lease.client_ip = network_info.client_ip;
+    pxe_state.lease.server_ip = network_info.server_ip;
+    pxe_state.lease.subnet_mask = network_info.subnet_mask;
+    pxe_state.lease.router_ip = network_info.router_ip;
+    pxe_state.lease.dns_server = network_info.dns_server;
+    pxe_state.lease.lease_seconds = seconds;
+    pxe_state.lease.expires = (uint64_t)time(NULL) + seconds;
+    memcpy(pxe_state.lease.tftp_server, network_info.tftp_server, sizeof(pxe_state.lease.tftp_server));
+    memcpy(pxe_state.lease.boot_file, network_info.boot_file, sizeof(pxe_state.lease.boot_file));
+}
+
+// Discover on all NICs together, so unplugged or unserved ports cost no
+// more than the one that answers, and boot from the first to get a lease.
+// Returns 0 once bound, 1 if nothing answered, -1 if no NIC could try.
+static int pxe_discover_nics(void) {
+    dhcp_lease_t lease;
+    memset(&lease, 0, sizeof(lease));
+    int selected = pxe_nic_discover(pxe_nics, PXE_MAX_NICS, &pxe_nic_count, &lease, PXE_DISCOVER_TIMEOUT_MS);
+    pxe_discovery_started = 0;
+    if (selected < 0 || selected >= pxe_nic_count) {
+        // Timed out on a NIC with a carrier: the network did not answer,
+        // and asking again on one NIC would only wait as long once more
+        for (int i = 0; i < pxe_nic_count; i++) {
+            if (pxe_nics[i].state == PXE_NIC_TIMEOUT) return 1;
+        }
+        return -1;
+    }
+    pxe_apply_lease(&lease);
+    if (pxe_set_station(&network_info) != 0) return -1;
+    if (lease.lease_seconds) {
+        pxe_state.version = PXE_STATE_VERSION;
+        memcpy(pxe_state.mac, pxe_nics[selected].mac, 6);
+        pxe_state.lease = lease;
+        pxe_state.lease.expires = (uint64_t)time(NULL) + lease.lease_seconds;
+    }
+    return 0;
+}
+
+int pxe_network_start(void) {
+    if (pxe_initialized || pxe_discovery_started) {
+        return 0;
+    }
+    // A saved lease is confirmed by pxe_network_init in one round trip
+    if (pxe_load_saved_lease() == 0) {
+        return 0;
+    }
+    if (pxe_nic_discover_start(pxe_nics, PXE_MAX_NICS, &pxe_nic_count, PXE_DISCOVER_TIMEOUT_MS) != 0) {
+        return -1;
+    }
+    pxe_discovery_started = 1;
+    return 0;
+}
+
+void pxe_network_cancel(void) {
+    if (pxe_discovery_started) {
+        pxe_nic_discover_cancel();
+        pxe_discovery_started = 0;
     }
-    if (len == 1) sum += *(const uint8_t*)ptr;
-    sum = (sum >> 16) + (sum & 0xFFFF);
-    sum += (sum >> 16);
-    return ~sum;
 }
 
 int pxe_network_init(void) {
@@ -71,62 +256,393 @@ int pxe_network_init(void) {
     
     int result = pxe_init();
     if (result != 0) {
+        pxe_network_cancel();
         return -1;
     }
     
-    result = pxe_dhcp_discover();
-    if (result != 0) {
-        pxe_cleanup();
-        return -1;
+    // The DHCP4 children of a started discovery hold the NICs
+    if (pxe_discovery_started || pxe_reuse_lease() != 0) {
+        result = pxe_discover_nics();
+        if (result < 0) {
+            // No NIC could run DHCP itself: let the stack discover on its own
+            result = pxe_dhcp_discover();
+            if (result == 0) pxe_record_lease();
+        }
+        if (result != 0) {
+            pxe_cleanup();
+            return -1;
+        }
     }
+    pxe_save_state();
+    // Multicast TFTP is only used when the offer named a group
+    dhcp_get_mtftp(&network_info.mtftp);
     
     pxe_initialized = 1;
     return 0;
 }
 
-int pxe_load_kernel(const char* kernel_path, uint8_t** kernel_data, uint32_t* kernel_size) {
-    if (!pxe_initialized) {
+// TFTP over the PXE UDP calls, talking to network_info.tftp_server
+static int pxe_tftp_send(void* context, uint16_t port, const uint8_t* data, int len) {
+    return pxe_udp_send((const char*)context, port, data, len) < 0 ? -1 : 0;
+}
+
+// Payload of a DATA datagram (opcode 3) from the server counts toward the
+// progress display; a retransmitted block counts again, which a display
+// clamped to the file size does not show
+static void pxe_tftp_progress(const uint8_t* packet, int n, uint16_t port) {
+    if (port != 0 && n > 4 && packet[0] == 0 && packet[1] == 3) load_progress_add((uint64_t)(n - 4));
+}
+
+static int pxe_tftp_recv(void* context, uint16_t* port, uint8_t* buf, int cap, int timeout_ms) {
+    char src_ip[16];
+    int n = pxe_udp_recv(src_ip, port, buf, cap, timeout_ms);
+    if (n <= 0) return 0;
+    if (strcmp(src_ip, (const char*)context) != 0) *port = 0;
+    pxe_tftp_progress(buf, n, *port);
+    return n;
+}
+
+static uint32_t pxe_tftp_now(void* context) {
+    (void)context;
+    return pxe_time_ms();
+}
+
+// Without a receive ring (no Managed Network on the NIC) peek falls back
+// to copying into a packet buffer of our own
+static uint8_t pxe_rx_packet[TFTP_MAX_BLKSIZE + 4];
+
+static int pxe_tftp_peek(void* context, uint16_t* port, const uint8_t** data, int timeout_ms) {
+    char src_ip[16];
+    int n = pxe_udp_peek(src_ip, port, data, timeout_ms);
+    if (n < 0) {
+        n = pxe_udp_recv(src_ip, port, pxe_rx_packet, sizeof(pxe_rx_packet), timeout_ms);
+        *data = pxe_rx_packet;
+    }
+    if (n <= 0) return 0;
+    if (strcmp(src_ip, (const char*)context) != 0) *port = 0;
+    pxe_tftp_progress(*data, n, *port);
+    return n;
+}
+
+// The sessions hold full-sized packet buffers; keep them off the stack
+static tftp_session_t tftp_session;
+static tftp_session_t tftp_pair_session;
+static mtftp_session_t mtftp_session;
+
+// Hand a finished session's retransmits to the boot's counters; zeroed so
+// that a later open refused before the session is reset adds nothing
+static void pxe_count_retransmits(tftp_session_t* s) {
+    bh_counters.tftp_retransmits += s->retransmits;
+    s->retransmits = 0;
+}
+
+static uint8_t* pxe_allocate(void* context, uint32_t size) {
+    (void)context;
+    return allocate_memory(size);
+}
+
+static const pxe_sink_t pxe_default_sink = { pxe_allocate, NULL };
+
+// Fetch a file over the DHCP-provided multicast group, so that one stream
+// from the server serves every node booting it at the same time. The
+// buffer is sized from pxe_get_file_size, as MTFTP has no tsize, unless
+// *data already holds one as large. *data and *capacity are set even on
+// failure so that the buffer can be reused.
+static int pxe_fetch_multicast(const char* server, const char* path, const pxe_sink_t* sink,
+                               uint8_t** data, uint32_t* capacity, uint32_t* size) {
+    const mtftp_params_t* group = &network_info.mtftp;
+    if (group->ip == 0) return -1;
+    int hint = pxe_get_file_size(path);
+    if (hint <= 0 || hint == 0xFFFF || (uint64_t)hint > MTFTP_MAX_SIZE) return -1;
+
+    if (!*data || (uint32_t)hint > *capacity) {
+        *data = sink->reserve(sink->context, (uint32_t)hint);
+        if (!*data) return -1;
+        *capacity = (uint32_t)hint;
+    }
+    load_progress_total((uint32_t)hint);
+
+    const uint8_t* ip = (const uint8_t*)&group->ip;
+    char group_ip[16];
+    snprintf(group_ip, sizeof(group_ip), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+    if (pxe_udp_join(group_ip, group->client_port) != 0) return -1;
+
+    // Spread the first opens of a rack powered on together over ~1 s
+    mtftp_params_t params = *group;
+    params.stagger_ms = (uint16_t)(((const uint8_t*)&network_info.client_ip)[3] * 4);
+    tftp_transport_t io = { pxe_tftp_send, pxe_tftp_recv, pxe_tftp_peek, (void*)server, pxe_tftp_now };
+    uint64_t len = 0;
+    int rc = mtftp_read(&mtftp_session, &io, &params, path, *data, *capacity, &len);
+    pxe_udp_leave();
+    if (rc != TFTP_OK) return -1;
+    *size = (uint32_t)len;
+    return 0;
+}
+
+static int pxe_fetch_unicast(const char* server, const char* path, const pxe_sink_t* sink, uint32_t default_size,
+                             uint8_t* buffer, uint32_t buffer_size, uint8_t** data, uint32_t* size) {
+    tftp_transport_t io = { pxe_tftp_send, pxe_tftp_recv, pxe_tftp_peek, (void*)server, pxe_tftp_now };
+    if (tftp_open(&tftp_session, &io, path, TFTP_DEFAULT_MTU, TFTP_DEFAULT_WINDOWSIZE) != TFTP_OK) {
         return -1;
     }
-    
-    *kernel_size = pxe_get_file_size(kernel_path);
-    if (*kernel_size == 0xFFFF) {
-        *kernel_size = 1024 * 1024; // Default 1MB if size unknown
+    uint64_t capacity = tftp_session.tsize;
+    if (capacity == 0) {
+        uint32_t hint = (uint32_t)pxe_get_file_size(path);
+        capacity = (hint != 0 && hint != 0xFFFF) ? hint : default_size;
     }
-    
-    *kernel_data = allocate_memory(*kernel_size);
-    if (!*kernel_data) {
+    if (capacity == 0 || capacity > 0xFFFFFFFFu) return -1;
+    // default_size is only a guess at the buffer, not the file's size
+    if (capacity != default_size) load_progress_total(capacity);
+
+    // A failed cache read or multicast attempt leaves a buffer that usually fits
+    *data = (buffer && capacity <= buffer_size) ? buffer : sink->reserve(sink->context, (uint32_t)capacity);
+    if (!*data) return -1;
+    uint64_t len = 0;
+    if (tftp_read(&tftp_session, *data, capacity, &len) != TFTP_OK) {
         return -1;
     }
-    
-    int result = pxe_tftp_read(kernel_path, *kernel_data, *kernel_size);
-    if (result != 0) {
+    *size = (uint32_t)len;
+    return 0;
+}
+
+// Fetch two files from the DHCP server over TFTP sessions that run at
+// once, so that each one's stalls on a lossy link are filled by the
+// other's blocks. Shown as one load, named after the first file.
+static int pxe_fetch_pair(const char* server, const char* const* paths, const uint32_t* default_size,
+                          uint8_t** data, uint32_t* size) {
+    tftp_session_t* sessions[2] = { &tftp_session, &tftp_pair_session };
+    tftp_transport_t io = { pxe_tftp_send, pxe_tftp_recv, pxe_tftp_peek, (void*)server, pxe_tftp_now };
+    uint64_t capacity[2], len[2] = { 0, 0 };
+    if (tftp_open_many(sessions, 2, &io, paths, TFTP_DEFAULT_MTU, TFTP_DEFAULT_WINDOWSIZE) != TFTP_OK) {
         return -1;
     }
-    
+    for (int i = 0; i < 2; i++) {
+        capacity[i] = sessions[i]->tsize;
+        if (capacity[i] == 0) {
+            uint32_t hint = (uint32_t)pxe_get_file_size(paths[i]);
+            capacity[i] = (hint != 0 && hint != 0xFFFF) ? hint : default_size[i];
+        }
+        if (capacity[i] == 0 || capacity[i] > 0xFFFFFFFFu) return -1;
+        data[i] = allocate_memory((uint32_t)capacity[i]);
+        if (!data[i]) return -1;
+    }
+
+    load_progress_begin(paths[0], capacity[0] + capacity[1]);
+    int rc = tftp_read_many(sessions, 2, data, capacity, len);
+    load_progress_end();
+    if (rc != TFTP_OK) return -1;
+    size[0] = (uint32_t)len[0];
+    size[1] = (uint32_t)len[1];
     return 0;
 }
 
-int pxe_load_initrd(const char* initrd_path, uint8_t** initrd_data, uint32_t* initrd_size) {
+int pxe_set_parallel_tftp(int enabled) {
+    pxe_parallel_tftp = enabled != 0;
+    return 0;
+}
+
+int pxe_set_image_cache(const char* dir) {
+    if (!dir || strlen(dir) >= sizeof(pxe_cache_dir) - NETCACHE_NAME_LEN - 1) return -1;
+    strcpy(pxe_cache_dir, dir);
+    pxe_manifest_state = 0;
+    return 0;
+}
+
+static uint8_t* pxe_reserve_manifest(void* context, uint32_t size) {
+    (void)context;
+    return size <= sizeof(pxe_manifest_text) ? (uint8_t*)pxe_manifest_text : NULL;
+}
+
+// Digest the boot server's manifest gives `path`, or NULL when the cache
+// is off, the server publishes no manifest or the file is not listed
+static const uint8_t* pxe_cache_digest(const char* server, const char* path) {
+    if (pxe_cache_dir[0] == 0 || strcmp(server, network_info.tftp_server) != 0) return NULL;
+    if (pxe_manifest_state == 0) {
+        static const char* const names[] = { NETCACHE_MANIFEST_BLAKE3, NETCACHE_MANIFEST };
+        pxe_sink_t sink = { pxe_reserve_manifest, NULL };
+        pxe_manifest_state = -1;    // Also keeps the manifest's own download out of the cache
+        for (int i = 0; i < 2 && pxe_manifest_state != 1; i++) {
+            uint8_t* text = NULL;
+            uint32_t len = 0;
+            if (pxe_download(server, names[i], &sink, sizeof(pxe_manifest_text), &text, &len) == 0 &&
+                netcache_parse(&pxe_manifest, (const char*)text, len) > 0) {
+                pxe_manifest.blake3 = i == 0;
+                pxe_manifest_state = 1;
+            }
+        }
+    }
+    return pxe_manifest_state == 1 ? netcache_lookup(&pxe_manifest, path) : NULL;
+}
+
+static void pxe_cache_path(const uint8_t* digest, char* path) {
+    char name[NETCACHE_NAME_LEN];
+    netcache_name(digest, name);
+    snprintf(path, sizeof(pxe_cache_dir), "%s\\%s", pxe_cache_dir, name);
+}
+
+// The manifest's digest, SHA-256 or BLAKE3
+typedef struct {
+    int blake3;
+    union {
+        crypto_sha256_ctx_t sha256;
+        crypto_blake3_ctx_t blake3;
+    } ctx;
+} pxe_hash_t;
+
+static void pxe_hash_init(pxe_hash_t* hash) {
+    hash->blake3 = pxe_manifest.blake3;
+    if (hash->blake3) {
+        crypto_blake3_init(&hash->ctx.blake3);
+    } else {
+        crypto_sha256_init(&hash->ctx.sha256);
+    }
+}
+
+static void pxe_cache_hash(void* context, const uint8_t* data, uint32_t len) {
+    pxe_hash_t* hash = (pxe_hash_t*)context;
+    uint64_t start = bh_get_performance_counter();
+    if (hash->blake3) {
+        crypto_blake3_update(&hash->ctx.blake3, data, len);
+    } else {
+        crypto_sha256_update(&hash->ctx.sha256, data, len);
+    }
+    bh_counters_add_hash(len, bh_get_performance_counter() - start);
+}
+
+static void pxe_hash_final(pxe_hash_t* hash, uint8_t* digest) {
+    if (hash->blake3) {
+        crypto_blake3_final(&hash->ctx.blake3, digest);
+    } else {
+        crypto_sha256_final(&hash->ctx.sha256, digest);
+    }
+}
+
+// Load a cached copy into the sink, hashing it as it is read: a file that
+// no longer matches its name (a torn write, a bad sector) is a miss. The
+// buffer reserved is handed back for the download to reuse.
+static int pxe_cache_fetch(const uint8_t* digest, const pxe_sink_t* sink,
+                           uint8_t** buffer, uint32_t* buffer_size, uint32_t* size) {
+    char path[sizeof(pxe_cache_dir)];
+    uint32_t len = 0;
+    pxe_cache_path(digest, path);
+    if (get_file_size(path, &len) != 0 || len == 0) return -1;
+    *buffer = sink->reserve(sink->context, len);
+    if (!*buffer) return -1;
+    *buffer_size = len;
+
+    pxe_hash_t ctx;
+    uint8_t hash[NETCACHE_DIGEST_LENGTH];
+    pxe_hash_init(&ctx);
+    if (read_file_into(path, *buffer, len, pxe_cache_hash, &ctx) != 0) return -1;
+    pxe_hash_final(&ctx, hash);
+    if (memcmp(hash, digest, sizeof(hash)) != 0) return -1;
+    *size = len;
+    return 0;
+}
+
+// Keep a download that matches the manifest; one that does not (the
+// manifest is stale) is still booted, as it would be without the cache
+static void pxe_cache_store(const uint8_t* digest, const uint8_t* data, uint32_t size) {
+    char path[sizeof(pxe_cache_dir)];
+    pxe_hash_t ctx;
+    uint8_t hash[NETCACHE_DIGEST_LENGTH];
+    pxe_hash_init(&ctx);
+    pxe_cache_hash(&ctx, data, size);
+    pxe_hash_final(&ctx, hash);
+    if (memcmp(hash, digest, sizeof(hash)) != 0) return;
+    pxe_cache_path(digest, path);
+    save_file(path, data, size);
+}
+
+int pxe_download(const char* server, const char* path, const pxe_sink_t* sink, uint32_t default_size,
+                 uint8_t** data, uint32_t* size) {
+    if (!sink) sink = &pxe_default_sink;
+    if (!server) server = network_info.tftp_server;
+    if (server[0] == 0) {
+        // No server address from DHCP: let the PXE stack run the transfer
+        *size = pxe_get_file_size(path);
+        if (*size == 0xFFFF) {
+            if (default_size == 0) return -1;
+            *size = default_size;
+        }
+        *data = sink->reserve(sink->context, *size);
+        if (!*data) return -1;
+        return pxe_tftp_read(path, *data, *size) == 0 ? 0 : -1;
+    }
+
+    uint8_t* buffer = NULL;
+    uint32_t buffer_size = 0;
+    const uint8_t* digest = pxe_cache_digest(server, path);
+    // After the manifest, which is a load of its own
+    load_progress_begin(path, 0);
+    if (digest && pxe_cache_fetch(digest, sink, &buffer, &buffer_size, size) == 0) {
+        load_progress_end();
+        *data = buffer;
+        return 0;
+    }
+
+    int rc = pxe_fetch_multicast(server, path, sink, &buffer, &buffer_size, size);
+    if (rc == 0) {
+        *data = buffer;
+    } else {
+        rc = pxe_fetch_unicast(server, path, sink, default_size, buffer, buffer_size, data, size);
+        pxe_count_retransmits(&tftp_session);
+    }
+    load_progress_end();
+    if (rc == 0 && digest) {
+        pxe_cache_store(digest, *data, *size);
+    }
+    return rc;
+}
+
+int pxe_load_kernel(const char* kernel_path, uint8_t** kernel_data, uint32_t* kernel_size) {
     if (!pxe_initialized) {
         return -1;
     }
-    
-    *initrd_size = pxe_get_file_size(initrd_path);
-    if (*initrd_size == 0xFFFF) {
+    // Default 1MB if size unknown
+    return pxe_download(NULL, kernel_path, NULL, 1024 * 1024, kernel_data, kernel_size);
+}
+
+int pxe_load_initrd(const char* initrd_path, uint8_t** initrd_data, uint32_t* initrd_size) {
+    if (!pxe_initialized) {
         return -1;
     }
-    
-    *initrd_data = allocate_memory(*initrd_size);
-    if (!*initrd_data) {
-        return -1;
+    return pxe_download(NULL, initrd_path, NULL, 0, initrd_data, initrd_size);
+}
+
+// The kernel and initrd of a network boot, fetched as one traced phase
+static int pxe_fetch_boot_files(const char* kernel_path, const char* initrd_path, uint8_t** kernel_data,
+                                uint32_t* kernel_size, uint8_t** initrd_data, uint32_t* initrd_size) {
+    // Both at once only for a plain unicast pair: images the cache holds
+    // and files the multicast group would serve take pxe_download's path
+    const char* server = network_info.tftp_server;
+    if (pxe_parallel_tftp && initrd_path && initrd_path[0] && server[0] && network_info.mtftp.ip == 0 &&
+        !pxe_cache_digest(server, kernel_path) && !pxe_cache_digest(server, initrd_path)) {
+        const char* paths[2] = { kernel_path, initrd_path };
+        const uint32_t default_size[2] = { 1024 * 1024, 0 };
+        uint8_t* data[2];
+        uint32_t size[2];
+        int rc = pxe_fetch_pair(server, paths, default_size, data, size);
+        pxe_count_retransmits(&tftp_session);
+        pxe_count_retransmits(&tftp_pair_session);
+        if (rc == 0) {
+            *kernel_data = data[0];
+            *kernel_size = size[0];
+            *initrd_data = data[1];
+            *initrd_size = size[1];
+            return 0;
+        }
     }
-    
-    int result = pxe_tftp_read(initrd_path, *initrd_data, *initrd_size);
-    if (result != 0) {
+
+    if (pxe_load_kernel(kernel_path, kernel_data, kernel_size) != 0) {
         return -1;
     }
     
+    if (initrd_path && strlen(initrd_path) > 0) {
+        if (pxe_load_initrd(initrd_path, initrd_data, initrd_size) != 0) {
+            return -1;
+        }
+    }
     return 0;
 }
 
@@ -140,32 +656,44 @@ int pxe_boot_kernel(const char* kernel_path, const char* initrd_path, const char
         return -1;
     }
     
-    if (pxe_load_kernel(kernel_path, &kernel_data, &kernel_size) != 0) {
+    BH_TRACE_BEGIN(span, BH_TRACE_PHASE_NET_FETCH);
+    int rc = pxe_fetch_boot_files(kernel_path, initrd_path, &kernel_data, &kernel_size, &initrd_data, &initrd_size);
+    BH_TRACE_END(span);
+    if (rc != 0) {
         return -1;
     }
     
-    if (initrd_path && strlen(initrd_path) > 0) {
-        if (pxe_load_initrd(initrd_path, &initrd_data, &initrd_size) != 0) {
-            return -1;
-        }
+    return pxe_boot_image(kernel_data, kernel_size, initrd_data, initrd_size, cmdline);
+}
+
+int pxe_boot_image(uint8_t* kernel_data, uint32_t kernel_size, uint8_t* initrd_data, uint32_t initrd_size, const char* cmdline) {
+    if (kernel_size < 4) {
+        return -1;
     }
-    
+    // The loaders do not return on success; keep the neighbors learned
+    // while downloading for the next boot
+    pxe_save_state();
     uint32_t* kernel_header = (uint32_t*)kernel_data;
     
     if (kernel_header[0] == 0x53726448) {
         return boot_linux_kernel(kernel_data, kernel_size, initrd_data, initrd_size, cmdline);
     }
     
-    if (kernel_header[0] == 0x1BADB002) {
-        return boot_multiboot1_kernel(kernel_data, kernel_size, cmdline);
+    // One pass finds every protocol's marker where its specification puts
+    // it; the loader chosen reuses the hits instead of searching again
+    static magicscan_t scan;
+    magicscan_image(kernel_data, kernel_size, MAGICSCAN_ALL, &scan);
+    
+    if (scan.found & MAGICSCAN_MB2) {
+        return boot_multiboot2_kernel(kernel_data, kernel_size, &scan, cmdline);
     }
     
-    if (kernel_header[0] == 0xE85250D6) {
-        return boot_multiboot2_kernel(kernel_data, kernel_size, cmdline);
+    if (scan.found & MAGICSCAN_MB1) {
+        return boot_multiboot1_kernel(kernel_data, kernel_size, &scan, cmdline);
     }
     
-    if (kernel_header[0] == 0x67cf3d9d) {
-        return boot_limine_kernel(kernel_data, kernel_size, cmdline);
+    if (scan.found & MAGICSCAN_LIMINE) {
+        return boot_limine_kernel(kernel_data, kernel_size, &scan, cmdline);
     }
     
     return -1;
@@ -173,6 +701,8 @@ int pxe_boot_kernel(const char* kernel_path, const char* initrd_path, const char
 
 int pxe_cleanup_network(void) {
     if (pxe_initialized) {
+        pxe_save_state();
+        pxe_udp_peek_stop();
         pxe_cleanup();
         pxe_initialized = 0;
     }
@@ -181,32 +711,9 @@ int pxe_cleanup_network(void) {
 
 struct pxe_network_info* pxe_get_network_info(void) {
     return &network_info;
-} 
-
-// ICMP echo (ping) using PXE stack
-// Returns 0 on success, -1 on failure
-int pxe_icmp_echo(const char* host, int* rtt_ms) {
-    struct icmp_echo req = {0};
-    req.type = 8; // Echo request
-    req.code = 0;
-    req.id = htons(0x1234);
-    req.seq = htons(1);
-    memset(req.payload, 0xAA, sizeof(req.payload));
-    req.checksum = 0;
-    req.checksum = icmp_checksum(&req, sizeof(req));
-
-    uint16_t dest_port = 33434; // Arbitrary unused port
-    uint32_t start = (uint32_t)clock();
-    if (pxe_udp_send(host, dest_port, &req, sizeof(req)) < 0) return -1;
+}
 
-    char src_ip[16];
-    uint16_t src_port;
-    struct icmp_echo resp;
-    int timeout = 1000; // 1s
-    int n = pxe_udp_recv(src_ip, &src_port, &resp, sizeof(resp), timeout);
-    if (n < (int)sizeof(resp)) return -1;
-    if (resp.type != 0 || resp.id != req.id || resp.seq != req.seq) return -1;
-    uint32_t end = (uint32_t)clock();
-    *rtt_ms = (int)(((end - start) * 1000) / CLOCKS_PER_SEC);
-    return 0;
-} 
\ No newline at end of file
+int pxe_get_nics(const pxe_nic_t** nics) {
+    *nics = pxe_nics;
+    return pxe_nic_count;
+}
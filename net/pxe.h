@@ -9,6 +9,9 @@
 #define BLOODHORN_PXE_H
 #include <stdint.h>
 #include "compat.h"
+#include "mtftp.h"
+#include "dhcp.h"
+#include "arp.h"
 
 struct pxe_network_info {
     uint32_t client_ip;
@@ -22,13 +25,79 @@ struct pxe_network_info {
     uint32_t broadcast_ip;
     uint32_t ntp_server;
     uint32_t time_offset;
+    mtftp_params_t mtftp;       // Multicast group from the offer; ip 0 if none
 };
 
+#define PXE_STATE_VERSION       1
+#define PXE_SAVED_NEIGHBORS     4
+
+// Kept in NV storage between boots: the lease, and the ARP entries for
+// the hosts talked to last (normally the boot server and the router)
+typedef struct {
+    uint32_t version;
+    uint8_t mac[6];             // NIC the lease belongs to
+    uint8_t reserved[6];
+    dhcp_lease_t lease;
+    arp_entry_t neighbors[PXE_SAVED_NEIGHBORS];
+} pxe_saved_state_t;
+
+// Destination of a download. reserve is called with the size the server
+// announced before any data arrives and returns a buffer of at least that
+// many bytes, or NULL. After a failed cache read or multicast attempt it
+// may be called again if the next source needs a larger buffer.
+typedef struct {
+    uint8_t* (*reserve)(void* context, uint32_t size);
+    void* context;
+} pxe_sink_t;
+
+#define PXE_MAX_NICS                8
+#define PXE_DISCOVER_TIMEOUT_MS     16000   // Longest a DHCP discovery on any NIC may take
+
+// What DHCP discovery found on each NIC
+#define PXE_NIC_NO_LINK     0       // No carrier: not tried
+#define PXE_NIC_PENDING     1
+#define PXE_NIC_TIMEOUT     2       // Nothing answered within PXE_DISCOVER_TIMEOUT_MS
+#define PXE_NIC_FAILED      3       // No DHCP service on the NIC, or the exchange failed
+#define PXE_NIC_CANCELLED   4       // Still discovering when another NIC won
+#define PXE_NIC_SELECTED    5       // Answered first; the NIC PXE boots from
+
+typedef struct {
+    uint8_t mac[6];
+    uint8_t link;               // 1 when the NIC reported a carrier
+    uint8_t state;              // PXE_NIC_*
+    uint32_t elapsed_ms;        // From the start of discovery until the NIC finished
+    uint32_t client_ip;         // Address it was given, network order, or 0
+} pxe_nic_t;
+
 int pxe_network_init(void);
+// Start DHCP on every NIC in the background, so that link-up and the
+// exchange overlap whatever the loader does until pxe_network_init takes
+// the lease. Nothing starts when the last boot's lease can be confirmed.
+int pxe_network_start(void);
+// Stop a started discovery nobody is going to wait for (before a handoff)
+void pxe_network_cancel(void);
+// Fetch `path` from `server` (the DHCP TFTP server when NULL) straight into
+// the sink's buffer; NULL sink uses allocate_memory. default_size is used
+// when neither the server nor the PXE stack reports a size.
+int pxe_download(const char* server, const char* path, const pxe_sink_t* sink, uint32_t default_size,
+                 uint8_t** data, uint32_t* size);
+// Keep images the boot server's manifest (NETCACHE_MANIFEST) lists in
+// `dir` on the boot volume, named by SHA-256, and download them only when
+// the local copy is missing or no longer matches; -1 if dir is too long
+int pxe_set_image_cache(const char* dir);
+// Let pxe_boot_kernel fetch the kernel and initrd over two TFTP sessions
+// to the server at once rather than one after the other. Falls back to
+// one at a time if the pair fails, and for images served from the cache
+// or by multicast.
+int pxe_set_parallel_tftp(int enabled);
 int pxe_load_kernel(const char* kernel_path, uint8_t** kernel_data, uint32_t* kernel_size);
 int pxe_load_initrd(const char* initrd_path, uint8_t** initrd_data, uint32_t* initrd_size);
 int pxe_boot_kernel(const char* kernel_path, const char* initrd_path, const char* cmdline);
+// Boot a kernel (and initrd) that is already in memory
+int pxe_boot_image(uint8_t* kernel_data, uint32_t kernel_size, uint8_t* initrd_data, uint32_t initrd_size, const char* cmdline);
 int pxe_cleanup_network(void);
 struct pxe_network_info* pxe_get_network_info(void);
+// The NICs the last discovery looked at; returns how many
+int pxe_get_nics(const pxe_nic_t** nics);
 
 #endif 
\ No newline at end of file
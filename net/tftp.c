@@ -7,43 +7,451 @@
 
 #include "tftp.h"
 #include "compat.h"
+#include "../rust/bhshim/bhshim.h"
 #include <stdint.h>
+#include <stddef.h>
 #include <string.h>
-static int tftp_send_rrq(const char* filename, uint8_t* buf, int blksize) {
-    buf[0] = 0; buf[1] = 1;
-    int len = strlen(filename);
-    memcpy(buf+2, filename, len); buf[2+len] = 0;
-    memcpy(buf+3+len, "octet", 5); buf[8+len] = 0;
-    int opt = 9+len;
-    if (blksize > 512) {
-        memcpy(buf+opt, "blksize", 7); buf[opt+7] = 0;
-        char blkstr[8];
-        int n = sprintf(blkstr, "%d", blksize);
-        memcpy(buf+opt+8, blkstr, n); buf[opt+8+n] = 0;
-        opt += 9+n;
-    }
-    buf[opt++] = 0;
-    return opt;
+
+#define TFTP_OP_RRQ     1
+#define TFTP_OP_DATA    3
+#define TFTP_OP_ACK     4
+#define TFTP_OP_ERROR   5
+#define TFTP_OP_OACK    6
+
+#define TFTP_ERROR_DISK_FULL    3
+#define TFTP_ERROR_OPTION       8   // RFC 2347 option negotiation refused
+
+// IPv4 and UDP headers plus the TFTP opcode and block number
+#define TFTP_OVERHEAD   (20 + 8 + 4)
+
+static int put_string(uint8_t* buf, int at, const char* str) {
+    int len = (int)strlen(str);
+    memcpy(buf + at, str, len + 1);
+    return at + len + 1;
+}
+
+static int put_number(uint8_t* buf, int at, uint32_t value) {
+    char digits[12];
+    int n = 0;
+    do { digits[n++] = (char)('0' + value % 10); value /= 10; } while (value);
+    while (n) buf[at++] = digits[--n];
+    buf[at++] = 0;
+    return at;
+}
+
+// Parse a decimal option value, rejecting anything that is not all digits
+static int get_number(const char* str, uint64_t* value) {
+    uint64_t v = 0;
+    if (!*str) return -1;
+    for (; *str; str++) {
+        if (*str < '0' || *str > '9' || v > (UINT64_MAX - 9) / 10) return -1;
+        v = v * 10 + (uint64_t)(*str - '0');
+    }
+    *value = v;
+    return 0;
+}
+
+// Option names are case-insensitive (RFC 2347)
+static int option_is(const char* name, const char* option) {
+    for (; *name && *option; name++, option++) {
+        char c = *name;
+        if (c >= 'A' && c <= 'Z') c = (char)(c - 'A' + 'a');
+        if (c != *option) return 0;
+    }
+    return *name == *option;
 }
+
+static int build_rrq(const char* filename, uint8_t* buf, uint16_t blksize, uint16_t windowsize) {
+    buf[0] = 0; buf[1] = TFTP_OP_RRQ;
+    int at = put_string(buf, 2, filename);
+    at = put_string(buf, at, "octet");
+    if (blksize > TFTP_DEFAULT_BLKSIZE) {
+        at = put_string(buf, at, "blksize");
+        at = put_number(buf, at, blksize);
+    }
+    if (windowsize > 1) {
+        at = put_string(buf, at, "windowsize");
+        at = put_number(buf, at, windowsize);
+    }
+    if (blksize || windowsize) {
+        // Asking for tsize 0 makes the server report the file size
+        at = put_string(buf, at, "tsize");
+        at = put_number(buf, at, 0);
+    }
+    return at;
+}
+
+int tftp_receive(const tftp_transport_t* io, uint8_t* packet, int cap, uint16_t* port, const uint8_t** data, int timeout_ms) {
+    if (io->peek) return io->peek(io->context, port, data, timeout_ms);
+    *data = packet;
+    return io->recv(io->context, port, packet, cap, timeout_ms);
+}
+
 int tftp_build_rrq(const char* filename, uint8_t* buf) {
-    return tftp_send_rrq(filename, buf, 512);
+    return build_rrq(filename, buf, 0, 0);
 }
-int tftp_parse_data(const uint8_t* buf, uint16_t* block, uint8_t* data, int* datalen) {
-    if (buf[1] != 3) return -1;
-    *block = (buf[2]<<8) | buf[3];
-    *datalen = (buf[4] == 0 && buf[5] == 0) ? 0 : 512;
-    memcpy(data, buf+4, *datalen);
+
+int tftp_parse_data(const uint8_t* buf, int len, uint16_t* block, const uint8_t** data, int* datalen) {
+    size_t n;
+    if (len < 0 || bhshim_tftp_data(buf, (size_t)len, block, data, &n) != BH_SUCCESS) return -1;
+    *datalen = (int)n;
     return 0;
 }
-int tftp_parse_oack(const uint8_t* buf, int* blksize) {
+
+// Apply an OACK to a session whose blksize and windowsize hold what was
+// requested. The server may only lower them; options it leaves out take
+// their RFC 1350 defaults.
+int tftp_parse_oack(const uint8_t* buf, int len, tftp_session_t* s) {
+    uint16_t blksize = TFTP_DEFAULT_BLKSIZE, windowsize = 1;
+    uint64_t tsize = 0;
+    if (len < 2 || buf[0] != 0 || buf[1] != TFTP_OP_OACK || buf[len - 1] != 0) return -1;
     int i = 2;
-    while (buf[i]) {
-        if (strcmp((char*)buf+i, "blksize") == 0) {
-            i += 8;
-            *blksize = atoi((char*)buf+i);
+    while (i < len) {
+        const char* name = (const char*)buf + i;
+        i += (int)strlen(name) + 1;
+        if (i >= len) return -1;
+        const char* value = (const char*)buf + i;
+        i += (int)strlen(value) + 1;
+        uint64_t v;
+        if (get_number(value, &v) != 0) return -1;
+        if (option_is(name, "blksize")) {
+            if (v < 8 || v > s->blksize) return -1;
+            blksize = (uint16_t)v;
+        } else if (option_is(name, "windowsize")) {
+            if (v < 1 || v > s->windowsize) return -1;
+            windowsize = (uint16_t)v;
+        } else if (option_is(name, "tsize")) {
+            tsize = v;
+        }
+    }
+    s->blksize = blksize;
+    s->windowsize = windowsize;
+    s->tsize = tsize;
+    return 0;
+}
+
+static uint32_t clock_ms(const tftp_session_t* s) {
+    return s->io.now_ms ? s->io.now_ms(s->io.context) : 0;
+}
+
+// Fold one round trip into the estimate and derive the timeout from it
+// (RFC 6298 section 2, with Jacobson's scaled integers)
+static void rtt_sample(tftp_session_t* s, uint32_t rtt) {
+    if (rtt > TFTP_MAX_RTO_MS) rtt = TFTP_MAX_RTO_MS;
+    if (!s->measured) {
+        s->srtt = rtt << 3;
+        s->rttvar = rtt << 1;
+        s->measured = 1;
+    } else {
+        uint32_t srtt = s->srtt >> 3;
+        s->rttvar += (rtt > srtt ? rtt - srtt : srtt - rtt) - (s->rttvar >> 2);
+        s->srtt += rtt - (s->srtt >> 3);
+    }
+    // SRTT + max(G, 4 * RTTVAR), with a 1 ms clock granularity
+    uint32_t rto = (s->srtt >> 3) + (s->rttvar > 1 ? s->rttvar : 1);
+    if (rto < TFTP_MIN_RTO_MS) rto = TFTP_MIN_RTO_MS;
+    if (rto > TFTP_MAX_RTO_MS) rto = TFTP_MAX_RTO_MS;
+    s->rto = rto;
+}
+
+// A timeout doubles the wait until the next sample (section 5.5), so a
+// link that is dropping packets is not flooded with more
+static void rtt_backoff(tftp_session_t* s) {
+    s->timing = 0;
+    if (!s->io.now_ms) return;
+    s->rto = s->rto * 2 > TFTP_MAX_RTO_MS ? TFTP_MAX_RTO_MS : s->rto * 2;
+}
+
+static int send_ack(tftp_session_t* s, uint16_t block) {
+    uint8_t ack[4] = { 0, TFTP_OP_ACK, (uint8_t)(block >> 8), (uint8_t)block };
+    return s->io.send(s->io.context, s->server_port, ack, sizeof(ack)) < 0 ? TFTP_ERR_IO : TFTP_OK;
+}
+
+// An ACK asking for blocks the server has not sent yet, whose answer
+// is therefore a clean round trip sample
+static int send_timed_ack(tftp_session_t* s, uint16_t block) {
+    s->sent_at = clock_ms(s);
+    s->timing = s->io.now_ms != NULL;
+    return send_ack(s, block);
+}
+
+static void send_error(tftp_session_t* s, uint16_t code, const char* message) {
+    uint8_t pkt[64];
+    pkt[0] = 0; pkt[1] = TFTP_OP_ERROR;
+    pkt[2] = (uint8_t)(code >> 8); pkt[3] = (uint8_t)code;
+    int at = put_string(pkt, 4, message);
+    s->io.send(s->io.context, s->server_port, pkt, at);
+}
+
+// A reply from the TID of an earlier session still waiting for its
+// transfer to start (a resent OACK) is not an answer to this RRQ
+static int port_taken(tftp_session_t* const* before, int count, uint16_t port) {
+    for (int i = 0; i < count; i++) {
+        if (before[i]->server_port == port) return 1;
+    }
+    return 0;
+}
+
+static int open_session(tftp_session_t* s, const tftp_transport_t* io, const char* filename, uint16_t mtu,
+                        uint16_t windowsize, tftp_session_t* const* before, int before_count) {
+    // RRQ: opcode, name, mode and three options with their values
+    uint8_t rrq[512];
+    if (!s || !io || !filename || strlen(filename) > sizeof(rrq) - 64) return TFTP_ERR_PROTOCOL;
+    memset(s, 0, offsetof(tftp_session_t, packet));
+    s->io = *io;
+    s->rto = TFTP_TIMEOUT_MS;
+
+    uint16_t blksize = mtu > TFTP_OVERHEAD + TFTP_DEFAULT_BLKSIZE ? (uint16_t)(mtu - TFTP_OVERHEAD) : TFTP_DEFAULT_BLKSIZE;
+    if (blksize > TFTP_MAX_BLKSIZE) blksize = TFTP_MAX_BLKSIZE;
+    if (windowsize < 1) windowsize = 1;
+    if (windowsize > TFTP_MAX_WINDOWSIZE) windowsize = TFTP_MAX_WINDOWSIZE;
+
+    // A server that refuses the options (error 8) gets one plain request
+    for (int with_options = 1; with_options >= 0; with_options--) {
+        int rrq_len = with_options ? build_rrq(filename, rrq, blksize, windowsize) : tftp_build_rrq(filename, rrq);
+        s->server_port = TFTP_PORT;
+        s->blksize = with_options ? blksize : TFTP_DEFAULT_BLKSIZE;
+        s->windowsize = with_options ? windowsize : 1;
+        s->tsize = 0;
+
+        // The RRQ is repeated at the initial timeout rather than backed
+        // off, so a server that is not there is given up on as quickly as
+        // ever; the first answer to the first copy is the first sample
+        for (int tries = 0; tries <= TFTP_RETRIES; tries++) {
+            if (tries > 0) s->retransmits++;
+            if (s->io.send(s->io.context, TFTP_PORT, rrq, rrq_len) < 0) return TFTP_ERR_IO;
+            uint32_t sent_at = clock_ms(s);
+            uint16_t port;
+            const uint8_t* pkt;
+            int n;
+            do {
+                n = tftp_receive(&s->io, s->packet, sizeof(s->packet), &port, &pkt, TFTP_TIMEOUT_MS);
+            } while (n > 0 && port != 0 && port_taken(before, before_count, port));
+            if (n < 0) return TFTP_ERR_IO;
+            if (n < 4 || port == 0) continue;
+            if (tries == 0 && s->io.now_ms) rtt_sample(s, clock_ms(s) - sent_at);
+            // The reply's source port is the server's TID for the rest of the transfer
+            s->server_port = port;
+            switch (pkt[1]) {
+            case TFTP_OP_OACK:
+                if (tftp_parse_oack(pkt, n, s) != 0) {
+                    send_error(s, TFTP_ERROR_OPTION, "bad option");
+                    return TFTP_ERR_PROTOCOL;
+                }
+                return TFTP_OK;
+            case TFTP_OP_DATA:
+                // No option support: RFC 1350 lock-step, first block already
+                // here. Keep our own copy: a borrowed buffer may be reused
+                // before tftp_read runs.
+                if (n > (int)sizeof(s->packet)) return TFTP_ERR_PROTOCOL;
+                if (pkt != s->packet) memcpy(s->packet, pkt, n);
+                s->blksize = TFTP_DEFAULT_BLKSIZE;
+                s->windowsize = 1;
+                s->pending_len = n;
+                return TFTP_OK;
+            case TFTP_OP_ERROR:
+                if (with_options && ((pkt[2] << 8) | pkt[3]) == TFTP_ERROR_OPTION) break;
+                return TFTP_ERR_REMOTE;
+            default:
+                return TFTP_ERR_PROTOCOL;
+            }
             break;
         }
-        while (buf[i++]);
+        if (s->server_port == TFTP_PORT) return TFTP_ERR_TIMEOUT;
+    }
+    return TFTP_ERR_REMOTE;
+}
+
+int tftp_open(tftp_session_t* s, const tftp_transport_t* io, const char* filename, uint16_t mtu, uint16_t windowsize) {
+    return open_session(s, io, filename, mtu, windowsize, NULL, 0);
+}
+
+int tftp_open_many(tftp_session_t* const* s, int count, const tftp_transport_t* io,
+                   const char* const* filenames, uint16_t mtu, uint16_t windowsize) {
+    if (!s || !filenames || count < 1 || count > TFTP_MAX_SESSIONS) return TFTP_ERR_PROTOCOL;
+    for (int i = 0; i < count; i++) {
+        int rc = open_session(s[i], io, filenames[i], mtu, windowsize, s, i);
+        if (rc != TFTP_OK) return rc;
+    }
+    return TFTP_OK;
+}
+
+// Handle one datagram from the session's server. Returns 1 once the last
+// block is in, 0 to carry on, or an error.
+static int read_packet(tftp_session_t* s, const uint8_t* pkt, int n) {
+    if (n >= 4 && pkt[1] == TFTP_OP_ERROR) return TFTP_ERR_REMOTE;
+    uint16_t block;
+    const uint8_t* data;
+    int datalen;
+    if (tftp_parse_data(pkt, n, &block, &data, &datalen) != 0) return 0;
+    if (datalen > s->blksize) return TFTP_ERR_PROTOCOL;
+
+    if (block != (uint16_t)s->expected) {
+        if ((uint16_t)(block - (uint16_t)s->expected) < 0x8000) {
+            // A block past a lost one: the rest of this window is useless,
+            // so ACK once what arrived in order and let the server restart
+            // there (RFC 7440 section 4)
+            if (s->gap_acked) return 0;
+            s->gap_acked = 1;
+            s->in_window = 0;
+            // Nothing has asked for `expected` since it went missing, so
+            // its arrival times this ACK as cleanly as a window's
+            return send_timed_ack(s, (uint16_t)(s->expected - 1));
+        } else {
+            // A block we already have: the server timed out on an ACK that
+            // was lost and is resending the window. Answer its first copy
+            // right away instead of waiting out our own timer; the rest of
+            // the copies get nothing, so a resend costs at most one ACK.
+            if (s->dup_acked) return 0;
+            s->dup_acked = 1;
+            s->timing = 0;
+            s->in_window = 0;
+            return send_ack(s, (uint16_t)(s->expected - 1));
+        }
+    }
+    if (s->timing) {
+        rtt_sample(s, clock_ms(s) - s->sent_at);
+        s->timing = 0;
+    }
+    s->retries = 0;
+    s->progress_at = clock_ms(s);
+    s->gap_acked = 0;
+
+    uint64_t offset = (s->expected - 1) * s->blksize;
+    if (offset + (uint64_t)datalen > s->capacity) {
+        send_error(s, TFTP_ERROR_DISK_FULL, "file too large");
+        return TFTP_ERR_TOO_LARGE;
+    }
+    memcpy(s->dst + offset, data, datalen);
+    s->expected++;
+
+    if (datalen < s->blksize) {
+        s->length = offset + (uint64_t)datalen;
+        return send_ack(s, block) != TFTP_OK ? TFTP_ERR_IO : 1;
+    }
+    if (++s->in_window == s->windowsize) {
+        s->in_window = 0;
+        s->dup_acked = 0;
+        if (send_timed_ack(s, block) != TFTP_OK) return TFTP_ERR_IO;
     }
     return 0;
-} 
\ No newline at end of file
+}
+
+// Nothing from the server for the timeout: ACK the last block received in
+// order, which makes the server resend the window from the block after it
+static int read_timeout(tftp_session_t* s) {
+    // With a clock the timer can be far shorter than TFTP_TIMEOUT_MS, so
+    // the server gets as long to be heard from again as it always had
+    if (s->io.now_ms) {
+        if (clock_ms(s) - s->progress_at >= (TFTP_RETRIES + 1) * TFTP_TIMEOUT_MS) return TFTP_ERR_TIMEOUT;
+    } else if (++s->retries > TFTP_RETRIES) {
+        return TFTP_ERR_TIMEOUT;
+    }
+    rtt_backoff(s);
+    s->in_window = 0;
+    s->gap_acked = 0;
+    s->retransmits++;
+    return send_ack(s, (uint16_t)(s->expected - 1));
+}
+
+// Acknowledging the OACK (block 0) starts the transfer; without options
+// the first block is already in the session
+static int read_begin(tftp_session_t* s, uint8_t* dst, uint64_t capacity) {
+    s->dst = dst;
+    s->capacity = capacity;
+    s->expected = 1;
+    s->in_window = 0;
+    s->gap_acked = 0;
+    s->dup_acked = 0;
+    s->retries = 0;
+    s->progress_at = clock_ms(s);
+    if (s->pending_len) {
+        int n = s->pending_len;
+        s->pending_len = 0;
+        return read_packet(s, s->packet, n);
+    }
+    return send_timed_ack(s, 0);
+}
+
+int tftp_read(tftp_session_t* s, uint8_t* dst, uint64_t capacity, uint64_t* len) {
+    int rc = read_begin(s, dst, capacity);
+    while (rc == 0) {
+        uint16_t port;
+        const uint8_t* pkt;
+        int n = tftp_receive(&s->io, s->packet, sizeof(s->packet), &port, &pkt, (int)s->rto);
+        if (n < 0) return TFTP_ERR_IO;
+        if (n == 0) {
+            rc = read_timeout(s);
+        } else if (port == s->server_port) {
+            rc = read_packet(s, pkt, n);
+        }
+    }
+    if (rc < 0) return rc;
+    *len = s->length;
+    return TFTP_OK;
+}
+
+int tftp_read_many(tftp_session_t* const* s, int count, uint8_t* const* dst,
+                   const uint64_t* capacity, uint64_t* len) {
+    uint32_t heard[TFTP_MAX_SESSIONS];     // Last datagram from each server, or its last timeout
+    int active[TFTP_MAX_SESSIONS];
+    if (!s || count < 1 || count > TFTP_MAX_SESSIONS || !s[0]->io.now_ms) return TFTP_ERR_PROTOCOL;
+    const tftp_transport_t* io = &s[0]->io;
+
+    int left = 0;
+    for (int i = 0; i < count; i++) {
+        int rc = read_begin(s[i], dst[i], capacity[i]);
+        if (rc < 0) return rc;
+        active[i] = rc == 0;
+        heard[i] = io->now_ms(io->context);
+        if (rc == 1) len[i] = s[i]->length;
+        left += active[i];
+    }
+
+    while (left) {
+        // Wait no longer than the first timer to run out
+        uint32_t now = io->now_ms(io->context);
+        uint32_t wait = TFTP_MAX_RTO_MS;
+        for (int i = 0; i < count; i++) {
+            if (!active[i]) continue;
+            uint32_t elapsed = now - heard[i];
+            uint32_t remaining = elapsed >= s[i]->rto ? 0 : s[i]->rto - elapsed;
+            if (remaining < wait) wait = remaining;
+        }
+
+        int n = 0;
+        uint16_t port = 0;
+        const uint8_t* pkt = NULL;
+        if (wait) {
+            n = tftp_receive(io, s[0]->packet, sizeof(s[0]->packet), &port, &pkt, (int)wait);
+            if (n < 0) return TFTP_ERR_IO;
+        }
+        now = io->now_ms(io->context);
+
+        for (int i = 0; i < count; i++) {
+            if (!active[i]) continue;
+            int rc = 0;
+            if (n > 0 && port != 0 && port == s[i]->server_port) {
+                heard[i] = now;
+                rc = read_packet(s[i], pkt, n);
+            } else if (now - heard[i] >= s[i]->rto) {
+                heard[i] = now;
+                rc = read_timeout(s[i]);
+            }
+            if (rc < 0) {
+                // Tell the other servers, so none keeps resending into a
+                // transfer that is being given up
+                for (int j = 0; j < count; j++) {
+                    if (j != i && active[j]) send_error(s[j], 0, "transfer aborted");
+                }
+                return rc;
+            }
+            if (rc == 1) {
+                len[i] = s[i]->length;
+                active[i] = 0;
+                left--;
+            }
+        }
+    }
+    return TFTP_OK;
+}
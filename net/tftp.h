@@ -9,6 +9,108 @@
 #define BLOODHORN_TFTP_H
 #include <stdint.h>
 #include "compat.h"
+
+#define TFTP_PORT               69
+#define TFTP_DEFAULT_BLKSIZE    512
+#define TFTP_MAX_BLKSIZE        8192    // Jumbo frames; the MTU normally caps it lower
+#define TFTP_DEFAULT_MTU        1500
+#define TFTP_DEFAULT_WINDOWSIZE 16      // RFC 7440 blocks per ACK we ask for
+#define TFTP_MAX_WINDOWSIZE     64
+#define TFTP_TIMEOUT_MS         1000    // Until a round trip has been measured
+#define TFTP_MIN_RTO_MS         20      // Floor for a measured retransmission timeout
+#define TFTP_MAX_RTO_MS         4000    // Ceiling for one that backed off
+#define TFTP_RETRIES            5
+#define TFTP_MAX_SESSIONS       4       // Transfers tftp_read_many interleaves
+
+// Error codes
+#define TFTP_OK                 0
+#define TFTP_ERR_TIMEOUT        -1
+#define TFTP_ERR_PROTOCOL       -2      // Malformed or unexpected packet
+#define TFTP_ERR_REMOTE         -3      // The server sent an ERROR packet
+#define TFTP_ERR_TOO_LARGE      -4      // File larger than the destination
+#define TFTP_ERR_IO             -5      // The transport failed
+
+// Datagram transport a transfer runs over. The client keeps one local
+// port for the whole transfer; `port` is always the server's.
+typedef struct {
+    // Send one datagram; returns 0 or a negative value on error
+    int (*send)(void* context, uint16_t port, const uint8_t* data, int len);
+    // Receive one datagram within timeout_ms; returns its length, 0 on
+    // timeout or a negative value on error. Datagrams from hosts other
+    // than the server should be reported with *port = 0.
+    int (*recv)(void* context, uint16_t* port, uint8_t* buf, int cap, int timeout_ms);
+    // Optional: like recv, but point *data at the datagram in the
+    // transport's own receive buffer, valid until the next call, so
+    // headers are parsed in place and only the payload is copied
+    int (*peek)(void* context, uint16_t* port, const uint8_t** data, int timeout_ms);
+    void* context;
+    // Optional: a millisecond clock (wrapping). With it the retransmission
+    // timeout follows the round trips measured (RFC 6298) and backs off
+    // on loss; without it every wait is TFTP_TIMEOUT_MS.
+    uint32_t (*now_ms)(void* context);
+} tftp_transport_t;
+
+// One read transfer: tftp_open sends the RRQ and settles the options,
+// after which tsize tells the caller how large a buffer to hand to
+// tftp_read (0 when the server did not say).
+typedef struct {
+    tftp_transport_t io;
+    uint16_t server_port;       // TFTP_PORT until the server picks its TID
+    uint16_t blksize;
+    uint16_t windowsize;
+    uint64_t tsize;
+    int pending_len;            // DATA that answered the RRQ in place of an OACK
+
+    // Round trip estimate, from a window ACK to the first block it asks
+    // for; srtt is kept in 1/8 ms and rttvar in 1/4 ms
+    uint32_t srtt;
+    uint32_t rttvar;
+    uint32_t rto;               // Current wait, in ms
+    uint32_t sent_at;           // When the ACK being timed went out
+    uint8_t timing;             // An ACK is being timed; never a resent one (Karn)
+    uint8_t measured;           // srtt holds a sample
+
+    // Receive state, kept here so that transfers can be interleaved
+    uint8_t* dst;
+    uint64_t capacity;
+    uint64_t expected;          // Next block in order; never wraps, unlike the wire number
+    uint64_t length;            // File length, once the last block is in
+    uint16_t in_window;         // Blocks received since the last ACK
+    uint8_t gap_acked;          // Already asked the server to resend from `expected`
+    uint8_t dup_acked;          // Already answered a resent window since the last ACK
+    int retries;                // Timeouts in a row, without a clock
+    uint32_t retransmits;       // RRQs and ACKs sent again after a timeout
+    uint32_t progress_at;       // Last block in order, with one
+    uint8_t packet[TFTP_MAX_BLKSIZE + 4];
+} tftp_session_t;
+
+// Request `filename`, asking for the largest block that fits in `mtu`,
+// the transfer size and an RFC 7440 window of `windowsize` blocks.
+// Servers without option support fall back to RFC 1350 lock-step.
+int tftp_open(tftp_session_t* s, const tftp_transport_t* io, const char* filename, uint16_t mtu, uint16_t windowsize);
+
+// Receive the file straight into `dst` (each block is copied once, to
+// its final offset) and store its length in *len
+int tftp_read(tftp_session_t* s, uint8_t* dst, uint64_t capacity, uint64_t* len);
+
+// Several files from one server over one transport. The RRQs go out one
+// after another, each session settling its server's TID before the next
+// asks, so that a reply is never taken for another session's; the
+// transfers then run at once, demultiplexed by server port, each with
+// its own window and timer. tftp_read_many needs the transport's clock.
+// All sessions share the first one's transport, and fail together.
+int tftp_open_many(tftp_session_t* const* s, int count, const tftp_transport_t* io,
+                   const char* const* filenames, uint16_t mtu, uint16_t windowsize);
+int tftp_read_many(tftp_session_t* const* s, int count, uint8_t* const* dst,
+                   const uint64_t* capacity, uint64_t* len);
+
+// Receive through peek when the transport has it, else copy into `packet`;
+// *data points at the datagram either way
+int tftp_receive(const tftp_transport_t* io, uint8_t* packet, int cap, uint16_t* port, const uint8_t** data, int timeout_ms);
+
+// Packet helpers. tftp_build_rrq adds no options; tftp_parse_data points
+// *data into `buf` and takes the payload length from the packet length.
 int tftp_build_rrq(const char* filename, uint8_t* buf);
-int tftp_parse_data(const uint8_t* buf, uint16_t* block, uint8_t* data, int* datalen);
-#endif 
\ No newline at end of file
+int tftp_parse_data(const uint8_t* buf, int len, uint16_t* block, const uint8_t** data, int* datalen);
+int tftp_parse_oack(const uint8_t* buf, int len, tftp_session_t* s);
+#endif
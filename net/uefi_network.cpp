@@ -24,15 +24,21 @@ public:
     std::error_code initialize() override {
         EFI_STATUS status = EFI_SUCCESS;
         
-        // Initialize network protocols
-        status = gBS->LocateProtocol(&gEfiSimpleNetworkProtocolGuid, nullptr, (void**)&snp_);
-        if (EFI_ERROR(status)) {
-            return std::make_error_code(std::errc::io_error);
+        // DHCP runs on every NIC at once; use the one that answered first
+        if (pxe_network_init() != 0) {
+            return std::make_error_code(std::errc::network_unreachable);
+        }
+        snp_ = findSelectedNic();
+        if (!snp_) {
+            status = gBS->LocateProtocol(&gEfiSimpleNetworkProtocolGuid, nullptr, (void**)&snp_);
+            if (EFI_ERROR(status)) {
+                return std::make_error_code(std::errc::io_error);
+            }
         }
         
-        // Start the network interface
+        // Start the network interface; discovery has usually done so already
         status = snp_->Start(snp_);
-        if (EFI_ERROR(status)) {
+        if (EFI_ERROR(status) && status != EFI_ALREADY_STARTED) {
             return std::make_error_code(std::errc::io_error);
         }
         
@@ -84,23 +90,58 @@ public:
     }
     
     std::error_code tftpDownload(const std::string& server, const std::string& remote_path,
-                               std::vector<uint8_t>& data) override {
+                               DownloadSink& sink) override {
+        pxe_sink_t target = { reserveInSink, &sink };
         uint8_t* file_data = nullptr;
         uint32_t file_size = 0;
         
-        int result = tftp_get_file(server.c_str(), remote_path.c_str(), &file_data, &file_size);
+        // Blocks are received straight into the sink's buffer
+        int result = pxe_download(server.c_str(), remote_path.c_str(), &target, 0, &file_data, &file_size);
         if (result != 0) {
             return std::make_error_code(std::errc::io_error);
         }
         
-        // Transfer ownership of the data to the vector
-        data.assign(file_data, file_data + file_size);
-        free(file_data);
-        
+        sink.commit(file_size);
         return {};
     }
     
 private:
+    // The SNP of the NIC discovery selected, if there was one
+    static EFI_SIMPLE_NETWORK* findSelectedNic() {
+        const pxe_nic_t* nics = nullptr;
+        int count = pxe_get_nics(&nics);
+        const pxe_nic_t* selected = nullptr;
+        for (int i = 0; i < count; i++) {
+            if (nics[i].state == PXE_NIC_SELECTED) {
+                selected = &nics[i];
+            }
+        }
+        if (!selected) {
+            return nullptr;
+        }
+        
+        EFI_HANDLE* handles = nullptr;
+        UINTN handle_count = 0;
+        if (EFI_ERROR(gBS->LocateHandleBuffer(ByProtocol, &gEfiSimpleNetworkProtocolGuid, nullptr,
+                                              &handle_count, &handles))) {
+            return nullptr;
+        }
+        EFI_SIMPLE_NETWORK* found = nullptr;
+        for (UINTN i = 0; i < handle_count && !found; i++) {
+            EFI_SIMPLE_NETWORK* snp = nullptr;
+            if (!EFI_ERROR(gBS->HandleProtocol(handles[i], &gEfiSimpleNetworkProtocolGuid, (void**)&snp)) &&
+                memcmp(snp->Mode->CurrentAddress.Addr, selected->mac, sizeof(selected->mac)) == 0) {
+                found = snp;
+            }
+        }
+        gBS->FreePool(handles);
+        return found;
+    }
+    
+    static uint8_t* reserveInSink(void* context, uint32_t size) {
+        return static_cast<DownloadSink*>(context)->reserve(size);
+    }
+    
     EFI_SIMPLE_NETWORK* snp_ = nullptr;
     MacAddress mac_;
 };
@@ -146,6 +187,41 @@ std::string MacAddress::toString() const {
     return std::string(buf);
 }
 
+// PageSink implementation
+PageSink::~PageSink() {
+    if (data_) {
+        gBS->FreePages(static_cast<EFI_PHYSICAL_ADDRESS>(reinterpret_cast<uintptr_t>(data_)), pages_);
+    }
+}
+
+uint8_t* PageSink::reserve(uint64_t size) {
+    size_t pages = EFI_SIZE_TO_PAGES(size ? size : 1);
+    if (data_ && pages <= pages_) {
+        return data_;
+    }
+    
+    // Anything already here is from a failed attempt and can be dropped
+    if (data_) {
+        gBS->FreePages(static_cast<EFI_PHYSICAL_ADDRESS>(reinterpret_cast<uintptr_t>(data_)), pages_);
+        data_ = nullptr;
+        pages_ = 0;
+    }
+    EFI_PHYSICAL_ADDRESS address = 0;
+    if (EFI_ERROR(gBS->AllocatePages(AllocateAnyPages, EfiLoaderData, pages, &address))) {
+        return nullptr;
+    }
+    data_ = reinterpret_cast<uint8_t*>(static_cast<uintptr_t>(address));
+    pages_ = pages;
+    return data_;
+}
+
+uint8_t* PageSink::release() {
+    uint8_t* data = data_;
+    data_ = nullptr;
+    pages_ = 0;
+    return data;
+}
+
 // PXEClient implementation
 PXEClient::PXEClient(std::unique_ptr<NetworkInterface> iface)
     : iface_(std::move(iface)) {}
@@ -172,40 +248,42 @@ std::error_code PXEClient::discoverNetwork() {
     return ec;
 }
 
-std::error_code PXEClient::downloadFile(const std::string& path, std::vector<uint8_t>& data) {
+std::error_code PXEClient::downloadFile(const std::string& path, DownloadSink& sink) {
     if (!initialized_) {
         auto ec = discoverNetwork();
         if (ec) return ec;
     }
     
-    return iface_->tftpDownload(config_.tftp_server, path, data);
+    return iface_->tftpDownload(config_.tftp_server, path, sink);
 }
 
 std::error_code PXEClient::bootKernel(const std::string& kernel_path, 
                                     const std::string& initrd_path,
                                     const std::string& cmdline) {
-    std::vector<uint8_t> kernel_data;
-    std::vector<uint8_t> initrd_data;
+    PageSink kernel;
+    PageSink initrd;
     
     // Download kernel
-    auto ec = downloadFile(kernel_path, kernel_data);
+    auto ec = downloadFile(kernel_path, kernel);
     if (ec) return ec;
     
     // Download initrd if specified
     if (!initrd_path.empty()) {
-        ec = downloadFile(initrd_path, initrd_data);
+        ec = downloadFile(initrd_path, initrd);
         if (ec) return ec;
     }
     
-    // Boot the kernel
-    int result = pxe_boot_kernel(kernel_path.c_str(), 
-                                initrd_path.empty() ? nullptr : initrd_path.c_str(),
+    // Boot the kernel from the pages it was downloaded into
+    int result = pxe_boot_image(kernel.data(), static_cast<uint32_t>(kernel.size()),
+                                initrd.data(), static_cast<uint32_t>(initrd.size()),
                                 cmdline.c_str());
     
     if (result != 0) {
         return std::make_error_code(std::errc::io_error);
     }
     
+    kernel.release();
+    initrd.release();
     return {};
 }
 
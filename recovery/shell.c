@@ -6,84 +6,554 @@
  */
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "compat.h"
 #include <string.h>
+#include <stdlib.h>
 #include "shell.h"
+#include "shell_fs.h"
+#include "shell_bench.h"
+#include "shell_net.h"
+#include "shell_history.h"
+#include "../fs/fs_mount.h"
+#include "../uefi/uefi.h"
+#include "../boot/libb/include/bloodhorn/debug.h"
+#include "../boot/libb/include/bloodhorn/trace.h"
+#include "../boot/libb/include/bloodhorn/time.h"
+#include "../boot/libb/include/bloodhorn/hash.h"
+#include "../security/crypto.h"
+#include "../fs/blockdev.h"
+#include "../fs/partition.h"
 
 #define MAX_CMD_LEN 256
 #define MAX_ARGS 16
 
-static char cmd_buffer[MAX_CMD_LEN];
-static char* args[MAX_ARGS];
-static int arg_count;
+// Command lookup: open addressing on the name's FNV-1a hash, sized for a
+// load factor of at most one half
+#define SHELL_MAX_COMMANDS      64
+#define SHELL_COMMAND_BUCKETS   128
+
+// Scripts are read whole; nested `source` stops at this depth
+#define SHELL_SCRIPT_MAX        (64 * 1024)
+#define SHELL_SCRIPT_DEPTH      4
+
+static const shell_command_t* shell_commands[SHELL_MAX_COMMANDS];
+static uint32_t shell_command_count;
+static uint8_t shell_command_index[SHELL_COMMAND_BUCKETS];     // Command number + 1, 0 = empty
+static bool shell_builtins_registered;
+static bool shell_exit_requested;
+static int shell_script_depth;
+
+static void shell_register_builtins(void);
+
+int shell_register_command(const shell_command_t* cmd) {
+    if (!cmd || !cmd->name || !cmd->run || shell_command_count == SHELL_MAX_COMMANDS) {
+        return -1;
+    }
+    uint32_t slot = bh_fnv1a_str(cmd->name) & (SHELL_COMMAND_BUCKETS - 1);
+    while (shell_command_index[slot] != 0) {
+        if (strcmp(shell_commands[shell_command_index[slot] - 1]->name, cmd->name) == 0) {
+            return -1; // Already registered
+        }
+        slot = (slot + 1) & (SHELL_COMMAND_BUCKETS - 1);
+    }
+    shell_commands[shell_command_count++] = cmd;
+    shell_command_index[slot] = (uint8_t)shell_command_count;
+    return 0;
+}
+
+const shell_command_t* shell_find_command(const char* name) {
+    if (!shell_builtins_registered) {
+        shell_register_builtins();
+    }
+    uint32_t slot = bh_fnv1a_str(name) & (SHELL_COMMAND_BUCKETS - 1);
+    while (shell_command_index[slot] != 0) {
+        const shell_command_t* cmd = shell_commands[shell_command_index[slot] - 1];
+        if (strcmp(cmd->name, name) == 0) {
+            return cmd;
+        }
+        slot = (slot + 1) & (SHELL_COMMAND_BUCKETS - 1);
+    }
+    return NULL;
+}
+
+int shell_tokenize(const char* line, char* storage, uint32_t size, char** argv, int max_args) {
+    uint32_t used = 0;
+    int argc = 0;
+
+    if (!line || !storage || size == 0) {
+        return -1;
+    }
+    for (;;) {
+        while (*line == ' ' || *line == '\t') {
+            line++;
+        }
+        if (*line == 0 || *line == '#') {
+            break;
+        }
+        if (argc == max_args) {
+            return -1;
+        }
+
+        argv[argc++] = storage + used;
+        char quote = 0;
+        for (; *line && (quote || (*line != ' ' && *line != '\t')); line++) {
+            char c = *line;
+            if (quote && c == quote) {
+                quote = 0;
+                continue;
+            }
+            if (!quote && (c == '"' || c == '\'')) {
+                quote = c;
+                continue;
+            }
+            // Backslash escapes the next character, except inside '...'
+            if (c == '\\' && quote != '\'' && line[1]) {
+                c = *++line;
+            }
+            if (used + 1 >= size) {
+                return -1;
+            }
+            storage[used++] = c;
+        }
+        if (quote) {
+            return -1; // Unterminated quote
+        }
+        if (used + 1 > size) {
+            return -1;
+        }
+        storage[used++] = 0;
+    }
+    return argc;
+}
 
 void shell_init(void) {
+    if (!shell_builtins_registered) {
+        shell_register_builtins();
+    }
     printf("BloodHorn Rescue Shell v1.0\n");
     printf("Type 'help' for available commands\n");
 }
 
-void shell_parse_command(const char* input) {
-    if (!input) return;
-    
-    UINTN input_len = strlen(input);
-    if (input_len >= sizeof(cmd_buffer)) {
-        input_len = sizeof(cmd_buffer) - 1;
-    }
-    
-    CopyMem(cmd_buffer, input, input_len);
-    cmd_buffer[input_len] = 0;
-    
-    arg_count = 0;
-    char* token = strtok(cmd_buffer, " ");
-    while (token && arg_count < MAX_ARGS) {
-        args[arg_count++] = token;
-        token = strtok(NULL, " ");
-    }
-}
-
-void shell_execute_command(void) {
-    if (arg_count == 0) return;
-    
-    if (strcmp(args[0], "help") == 0) {
-        printf("Available commands:\n");
-        printf("  help     - Show this help\n");
-        printf("  ls       - List files\n");
-        printf("  cat <file> - Show file contents\n");
-        printf("  reboot   - Reboot system\n");
-        printf("  clear    - Clear screen\n");
-    } else if (strcmp(args[0], "ls") == 0) {
-        printf("Filesystem not mounted\n");
-    } else if (strcmp(args[0], "cat") == 0) {
-        if (arg_count > 1 && args[1] != NULL) {
-            printf("File '%s' not found\n", args[1]);
+// Show, save or reset the boot-phase timeline recorded by libb
+static int shell_cmd_trace(int argc, char** argv) {
+    const char* sub = argc > 1 ? argv[1] : NULL;
+    if (!sub) {
+        bh_trace_print();
+    } else if (strcmp(sub, "perf") == 0) {
+        bh_perf_print_counters();
+    } else if (strcmp(sub, "io") == 0) {
+        blockdev_print_stats();
+    } else if (strcmp(sub, "reset") == 0) {
+        bh_trace_reset();
+        printf("Trace buffer cleared\n");
+    } else if (strcmp(sub, "save") == 0) {
+        bh_size_t len = 0;
+        bh_trace_export_chrome_json(NULL, 0, &len);
+        char* json = (char*)AllocatePool(len + 1);
+        if (!json) {
+            printf("Out of memory\n");
+            return -1;
+        }
+        bh_trace_export_chrome_json(json, len + 1, &len);
+        EFI_STATUS status = WriteBootFile(L"boottrace.json", json, len);
+        FreePool(json);
+        if (EFI_ERROR(status)) {
+            printf("Failed to write boottrace.json\n");
+            return -1;
         } else {
-            printf("Usage: cat <filename>\n");
+            printf("Wrote %u bytes to boottrace.json\n", (unsigned)len);
         }
-    } else if (strcmp(args[0], "reboot") == 0) {
-        printf("Rebooting...\n");
-        // Call reboot function
-    } else if (strcmp(args[0], "clear") == 0) {
-        printf("\033[2J\033[H");
     } else {
-        printf("Unknown command: %s\n", args[0] ? args[0] : "(null)");
+        printf("Usage: trace [perf|io|save|reset]\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Start, stop, show, save or reset the sampling profiler
+static int shell_cmd_profile(int argc, char** argv) {
+    const char* sub = argc > 1 ? argv[1] : NULL;
+    if (!sub) {
+        BootProfilerPrint(20);
+    } else if (strcmp(sub, "start") == 0) {
+        EFI_STATUS status = InstallBootProfiler(TRUE);
+        if (EFI_ERROR(status)) {
+            printf("Cannot start the profiler\n");
+            return -1;
+        }
+    } else if (strcmp(sub, "stop") == 0) {
+        InstallBootProfiler(FALSE);
+    } else if (strcmp(sub, "reset") == 0) {
+        BootProfilerReset();
+        printf("Profile cleared\n");
+    } else if (strcmp(sub, "save") == 0) {
+        EFI_STATUS status = BootProfilerSave(L"bootprofile.txt");
+        if (EFI_ERROR(status)) {
+            printf("Failed to write bootprofile.txt\n");
+            return -1;
+        } else {
+            printf("Wrote bootprofile.txt\n");
+        }
+    } else {
+        printf("Usage: profile [start|stop|save|reset]\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Show or save the per-call-site allocation counters
+static int shell_cmd_allocs(int argc, char** argv) {
+    const char* sub = argc > 1 ? argv[1] : NULL;
+    if (!sub) {
+        AllocProfilerPrint(20);
+    } else if (strcmp(sub, "save") == 0) {
+        EFI_STATUS status = AllocProfilerSave(L"allocprofile.txt");
+        if (EFI_ERROR(status)) {
+            printf("Failed to write allocprofile.txt\n");
+            return -1;
+        } else {
+            printf("Wrote allocprofile.txt\n");
+        }
+    } else {
+        printf("Usage: allocs [save]\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Time SHA-512 (the kernel-hash algorithm) over a large buffer
+static int shell_cmd_hashbench(int argc, char** argv) {
+    const char* size_arg = argc > 1 ? argv[1] : NULL;
+    uint32_t mib = size_arg ? (uint32_t)atoi(size_arg) : 64;
+    if (mib == 0 || mib > 1024) {
+        printf("Usage: hashbench [MiB, 1-1024]\n");
+        return -1;
+    }
+
+    uint32_t len = mib * 1024 * 1024;
+    uint8_t* data = (uint8_t*)AllocatePool(len);
+    if (!data) {
+        printf("Out of memory\n");
+        return -1;
+    }
+    for (uint32_t i = 0; i < len; i++) {
+        data[i] = (uint8_t)(i * 167 + 13);
+    }
+
+    uint64_t ticks = crypto_sha512_benchmark(data, len, bh_get_performance_counter);
+    uint64_t hz = bh_get_performance_frequency();
+    FreePool(data);
+
+    if (ticks == 0 || hz == 0) {
+        printf("No performance counter\n");
+        return -1;
+    }
+    uint64_t us = ticks * 1000000 / hz;
+    uint64_t mib_per_s = us ? (uint64_t)mib * 1000000 / us : 0;
+    printf("sha512 (%s): %u MiB in %u.%03u ms, %u MiB/s\n", crypto_sha512_backend_name(),
+           (unsigned)mib, (unsigned)(us / 1000), (unsigned)(us % 1000), (unsigned)mib_per_s);
+    return 0;
+}
+
+// List the boot disk's partitions from the shared partition table
+static int shell_cmd_parts(int argc, char** argv) {
+    const part_table_t* table = part_table_get(NULL);
+    char guid[37];
+
+    (void)argc;
+    (void)argv;
+
+    if (!table) {
+        printf("Cannot read the boot disk\n");
+        return -1;
+    }
+    if (table->scheme == PART_SCHEME_NONE) {
+        printf("No partition table\n");
+        return -1;
+    }
+
+    if (table->scheme == PART_SCHEME_GPT) {
+        part_guid_format(table->disk_guid, guid);
+        printf("GPT disk %s%s, %u partitions\n", guid, table->backup ? " (backup header)" : "",
+               (unsigned)table->count);
+    } else {
+        printf("MBR disk %02X%02X%02X%02X, %u partitions\n", table->disk_guid[3], table->disk_guid[2],
+               table->disk_guid[1], table->disk_guid[0], (unsigned)table->count);
+    }
+    for (uint32_t i = 0; i < table->count; i++) {
+        const part_entry_t* e = &table->entries[i];
+        if (table->scheme == PART_SCHEME_GPT) {
+            part_guid_format(e->type_guid, guid);
+            printf("  %3u  %12llu  %12llu  %s  %s\n", (unsigned)e->slot, (unsigned long long)e->start,
+                   (unsigned long long)e->sectors, guid, e->label);
+        } else {
+            printf("  %3u  %12llu  %12llu  type %02X%s\n", (unsigned)e->slot, (unsigned long long)e->start,
+                   (unsigned long long)e->sectors, e->mbr_type, e->mbr_status == 0x80 ? " active" : "");
+        }
+    }
+    return 0;
+}
+
+static int shell_cmd_help(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+
+    printf("Available commands:\n");
+    for (uint32_t i = 0; i < shell_command_count; i++) {
+        const shell_command_t* cmd = shell_commands[i];
+        printf("  %s%s%s - %s\n", cmd->name, cmd->usage ? " " : "", cmd->usage ? cmd->usage : "", cmd->help);
     }
+    printf("  !prefix  - Run the last command starting with prefix\n");
+    return 0;
+}
+
+static int shell_cmd_ls(int argc, char** argv) {
+    return shell_fs_ls(argc > 1 ? argv[1] : "/");
+}
+
+static int shell_cmd_cat(int argc, char** argv) {
+    if (argc < 2) {
+        printf("Usage: cat <filename>\n");
+        return -1;
+    }
+    return shell_fs_cat(argv[1]);
+}
+
+static int shell_cmd_hexdump(int argc, char** argv) {
+    if (argc < 2) {
+        printf("Usage: hexdump <filename> [offset [length]]\n");
+        return -1;
+    }
+    uint32_t offset = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 0) : 0;
+    uint32_t length = argc > 3 ? (uint32_t)strtoul(argv[3], NULL, 0) : 0;
+    return shell_fs_hexdump(argv[1], offset, length);
+}
+
+static int shell_cmd_sha256sum(int argc, char** argv) {
+    if (argc < 2) {
+        printf("Usage: sha256sum <filename>\n");
+        return -1;
+    }
+    return shell_fs_sha256sum(argv[1]);
+}
+
+static int shell_cmd_sha512sum(int argc, char** argv) {
+    if (argc < 2) {
+        printf("Usage: sha512sum <filename>\n");
+        return -1;
+    }
+    return shell_fs_sha512sum(argv[1]);
+}
+
+static int shell_cmd_cp(int argc, char** argv) {
+    if (argc < 3) {
+        printf("Usage: cp <filename> <boot volume file>\n");
+        return -1;
+    }
+    return shell_fs_cp(argv[1], argv[2]);
+}
+
+static int shell_cmd_reboot(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    printf("Rebooting...\n");
+    // Call reboot function
+    return 0;
+}
+
+static int shell_cmd_clear(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    printf("\033[2J\033[H");
+    return 0;
+}
+
+// List the history, or only the lines starting with a prefix
+static int shell_cmd_history(int argc, char** argv) {
+    const char* prefix = argc > 1 ? argv[1] : "";
+    size_t len = strlen(prefix);
+    int count = shell_history_count();
+
+    for (int i = 0; i < count; i++) {
+        const char* line = shell_history_get(i);
+        if (strncmp(line, prefix, len) == 0) {
+            printf("  %3d  %s\n", i, line);
+        }
+    }
+    return 0;
+}
+
+static int shell_cmd_source(int argc, char** argv) {
+    if (argc < 2) {
+        printf("Usage: source <script>\n");
+        return -1;
+    }
+    return shell_run_script(argv[1]);
+}
+
+static int shell_cmd_exit(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    shell_exit_requested = true;
+    return 0;
+}
+
+static const shell_command_t shell_builtins[] = {
+    { "help",      NULL,                                     "Show this help",                           shell_cmd_help },
+    { "ls",        "[dir]",                                  "List files",                               shell_cmd_ls },
+    { "cat",       "<file>",                                 "Show file contents",                       shell_cmd_cat },
+    { "hexdump",   "<file> [offset [length]]",               "Dump file bytes",                          shell_cmd_hexdump },
+    { "sha256sum", "<file>",                                 "Hash a file with SHA-256",                 shell_cmd_sha256sum },
+    { "sha512sum", "<file>",                                 "Hash a file with SHA-512",                 shell_cmd_sha512sum },
+    { "cp",        "<file> <dest>",                          "Copy a file to the boot volume",           shell_cmd_cp },
+    { "reboot",    NULL,                                     "Reboot system",                            shell_cmd_reboot },
+    { "clear",     NULL,                                     "Clear screen",                             shell_cmd_clear },
+    { "trace",     "[perf|io|save|reset]",                   "Show boot timeline",                       shell_cmd_trace },
+    { "profile",   "[start|stop|save|reset]",                "Show sampled hotspots",                    shell_cmd_profile },
+    { "allocs",    "[save]",                                 "Show allocation call sites by peak usage", shell_cmd_allocs },
+    { "hashbench", "[MiB]",                                  "Measure kernel-hash throughput",           shell_cmd_hashbench },
+    { "parts",     NULL,                                     "List boot disk partitions",                shell_cmd_parts },
+    { "bench",     "disk [N] | tftp <file> [runs] | crypto", "Measure throughput",                       shell_cmd_bench },
+    { "ping",      "[-c N] <a.b.c.d>",                       "Ping a host, with round-trip statistics",  shell_cmd_ping },
+    { "sweep",     "<a.b.c.d/prefix>",                       "Ping every host of a subnet at once",      shell_cmd_sweep },
+    { "ifconfig",  NULL,                                     "Show the network configuration",           shell_cmd_ifconfig },
+    { "fetch",     "<url> <dest>",                           "Download a file to the boot volume",       shell_cmd_fetch },
+    { "history",   "[prefix]",                               "List earlier commands",                    shell_cmd_history },
+    { "source",    "<script>",                               "Run the commands in a file",               shell_cmd_source },
+    { "exit",      NULL,                                     "Leave the shell",                          shell_cmd_exit },
+};
+
+static void shell_register_builtins(void) {
+    shell_builtins_registered = true;
+    for (uint32_t i = 0; i < sizeof(shell_builtins) / sizeof(shell_builtins[0]); i++) {
+        shell_register_command(&shell_builtins[i]);
+    }
+}
+
+int shell_execute(const char* line) {
+    char storage[MAX_CMD_LEN];
+    char* argv[MAX_ARGS];
+
+    // !prefix runs the newest history line starting with prefix
+    if (line[0] == '!') {
+        int idx = shell_history_find(line + 1, shell_history_count());
+        if (idx < 0) {
+            printf("%s: event not found\n", line);
+            return -1;
+        }
+        line = shell_history_get(idx);
+        printf("%s\n", line);
+    }
+
+    int argc = shell_tokenize(line, storage, sizeof(storage), argv, MAX_ARGS);
+    if (argc < 0) {
+        printf("Cannot parse: unterminated quote or line too long\n");
+        return -1;
+    }
+    if (argc == 0) {
+        return 0;
+    }
+
+    const shell_command_t* cmd = shell_find_command(argv[0]);
+    if (!cmd) {
+        printf("Unknown command: %s\n", argv[0]);
+        return -1;
+    }
+    return cmd->run(argc, argv);
+}
+
+int shell_run_script(const char* path) {
+    if (shell_script_depth == SHELL_SCRIPT_DEPTH) {
+        printf("%s: scripts nested too deep\n", path);
+        return -1;
+    }
+
+    fs_file_t* file = fs_open(path);
+    if (!file) {
+        printf("%s: not found\n", path);
+        return -1;
+    }
+    uint32_t size = fs_file_size(file);
+    if (size > SHELL_SCRIPT_MAX) {
+        printf("%s: larger than %u bytes\n", path, (unsigned)SHELL_SCRIPT_MAX);
+        fs_close(file);
+        return -1;
+    }
+    char* text = (char*)AllocatePool(size + 1);
+    if (!text) {
+        printf("Out of memory\n");
+        fs_close(file);
+        return -1;
+    }
+    int got = fs_file_read(file, (uint8_t*)text, size);
+    fs_close(file);
+    if (got < 0 || (uint32_t)got != size) {
+        printf("%s: read error\n", path);
+        FreePool(text);
+        return -1;
+    }
+    text[size] = 0;
+
+    // Every line runs even after a failure, so one missing device does not
+    // cut a diagnostics run short; an `exit` ends it
+    int failures = 0;
+    uint32_t number = 0;
+    shell_script_depth++;
+    for (char* line = text; *line && !shell_exit_requested; ) {
+        char* end = line;
+        while (*end && *end != '\n') {
+            end++;
+        }
+        char* next = *end ? end + 1 : end;
+        if (end > line && end[-1] == '\r') {
+            end--;
+        }
+        *end = 0;
+        number++;
+        if (shell_execute(line) != 0) {
+            printf("%s:%u: failed\n", path, (unsigned)number);
+            failures++;
+        }
+        line = next;
+    }
+    shell_script_depth--;
+
+    FreePool(text);
+    return failures ? -1 : 0;
 }
 
 void shell_run(void) {
     char input[MAX_CMD_LEN];
-    while (1) {
+    while (!shell_exit_requested) {
         printf("bloodhorn> ");
-        fgets(input, MAX_CMD_LEN, stdin);
-        input[strlen(input) - 1] = 0;
-        if (strlen(input) > 0) {
-            shell_parse_command(input);
-            shell_execute_command();
+        if (!fgets(input, MAX_CMD_LEN, stdin)) {
+            break;
+        }
+        size_t len = strlen(input);
+        if (len > 0 && input[len - 1] == '\n') {
+            input[--len] = 0;
+        }
+        if (len > 0) {
+            shell_execute(input);
+            if (input[0] != '!') {
+                shell_history_add(input);
+            }
         }
     }
 } 
 
 EFI_STATUS shell_start(void) {
+    fs_file_t* startup;
+
+    shell_exit_requested = false;
     shell_init();
+    // Batch diagnostics: run the startup script if the boot volume has one
+    startup = fs_open(SHELL_STARTUP_SCRIPT);
+    if (startup) {
+        fs_close(startup);
+        shell_run_script(SHELL_STARTUP_SCRIPT);
+    }
     shell_run();
     return EFI_SUCCESS;
-} 
\ No newline at end of file
+}
@@ -8,10 +8,40 @@
 #ifndef BLOODHORN_SHELL_H
 #define BLOODHORN_SHELL_H
 
+#include <stdint.h>
+
+// Run by shell_start before the prompt when the boot volume has it
+#define SHELL_STARTUP_SCRIPT "/shellrc"
+
+// A command gets its name in argv[0] and returns 0 on success
+typedef int (*shell_command_fn_t)(int argc, char** argv);
+
+typedef struct {
+    const char* name;
+    const char* usage;          // Arguments for help, or NULL
+    const char* help;
+    shell_command_fn_t run;
+} shell_command_t;
+
+// Add a command; cmd must stay valid. -1 when the name is taken or the
+// table is full.
+int shell_register_command(const shell_command_t* cmd);
+const shell_command_t* shell_find_command(const char* name);
+
+// Split a line into arguments without modifying it: the arguments are
+// copied into storage. Blanks separate arguments, '...' and "..." quote,
+// a backslash escapes the next character outside '...', and an unquoted
+// '#' starting an argument ends the line. Returns the argument count, or
+// -1 for an unterminated quote or too little room.
+int shell_tokenize(const char* line, char* storage, uint32_t size, char** argv, int max_args);
+
+// Run one command line; returns the command's result
+int shell_execute(const char* line);
+// Run every line of a file on a mounted filesystem; -1 if any failed
+int shell_run_script(const char* path);
+
 void shell_init(void);
-void shell_parse_command(const char* input);
-void shell_execute_command(void);
 void shell_run(void);
 EFI_STATUS shell_start(void);
 
-#endif // BLOODHORN_SHELL_H 
\ No newline at end of file
+#endif // BLOODHORN_SHELL_H
@@ -0,0 +1,400 @@
+/*
+ * shell_bench.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include "shell_bench.h"
+#include "compat.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../uefi/uefi.h"
+#include "../fs/blockdev.h"
+#include "../net/pxe.h"
+#include "../security/crypto.h"
+#include "../boot/libb/include/bloodhorn/time.h"
+
+// Disk: each request size reads until it has moved SEQ_BYTES (sequential)
+// or done RANDOM_OPS requests (random), or TIME_US has passed
+#define SHELL_BENCH_DISK_MAX_REQUEST    (1024 * 1024)
+#define SHELL_BENCH_DISK_SEQ_BYTES      (64 * 1024 * 1024)
+#define SHELL_BENCH_DISK_RANDOM_OPS     2000
+#define SHELL_BENCH_DISK_TIME_US        2000000
+
+// Crypto: every input size is repeated up to CRYPTO_BYTES in total
+#define SHELL_BENCH_CRYPTO_MAX_SIZE     (1024 * 1024)
+#define SHELL_BENCH_CRYPTO_BYTES        (16 * 1024 * 1024)
+
+#define SHELL_BENCH_TFTP_MAX_RUNS       16
+#define SHELL_BENCH_URL_MAX             512
+
+// The whole JSON report is built here before it is written out
+#define SHELL_BENCH_JSON_MAX            8192
+
+static const uint32_t shell_bench_seq_sizes[] = { 4 * 1024, 64 * 1024, 1024 * 1024 };
+static const uint32_t shell_bench_random_sizes[] = { 4 * 1024, 64 * 1024 };
+static const uint32_t shell_bench_crypto_sizes[] = { 4 * 1024, 1024 * 1024 };
+
+static char shell_bench_json[SHELL_BENCH_JSON_MAX];
+static uint32_t shell_bench_json_len;
+static uint32_t shell_bench_results;
+
+static void shell_bench_json_append(const char* fmt, ...) {
+    va_list args;
+    int n;
+
+    if (shell_bench_json_len >= SHELL_BENCH_JSON_MAX - 1) {
+        return;
+    }
+    va_start(args, fmt);
+    n = vsnprintf(shell_bench_json + shell_bench_json_len, SHELL_BENCH_JSON_MAX - shell_bench_json_len,
+                  fmt, args);
+    va_end(args);
+    if (n > 0) {
+        shell_bench_json_len += (uint32_t)n;
+        if (shell_bench_json_len > SHELL_BENCH_JSON_MAX - 1) {
+            shell_bench_json_len = SHELL_BENCH_JSON_MAX - 1;    // Truncated; still written
+        }
+    }
+}
+
+// A quoted JSON string: quotes, backslashes and control bytes escaped
+static void shell_bench_json_string(const char* text) {
+    shell_bench_json_append("\"");
+    for (const unsigned char* c = (const unsigned char*)text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            shell_bench_json_append("\\%c", *c);
+        } else if (*c < 0x20) {
+            shell_bench_json_append("\\u%04x", *c);
+        } else {
+            shell_bench_json_append("%c", *c);
+        }
+    }
+    shell_bench_json_append("\"");
+}
+
+static void shell_bench_json_begin(const char* family) {
+    shell_bench_json_len = 0;
+    shell_bench_results = 0;
+    shell_bench_json_append("{\"bench\":\"%s\",\"counter_hz\":%llu", family,
+                            (unsigned long long)bh_get_performance_frequency());
+}
+
+static void shell_bench_json_save(const char* family) {
+    CHAR16 name[32];
+    char ascii[32];
+    uint32_t i;
+
+    shell_bench_json_append("%s]}\n", shell_bench_results ? "" : ",\"results\":[");
+    snprintf(ascii, sizeof(ascii), "bench%s.json", family);
+    for (i = 0; ascii[i]; i++) {
+        name[i] = (CHAR16)ascii[i];
+    }
+    name[i] = 0;
+    if (EFI_ERROR(WriteBootFile(name, shell_bench_json, shell_bench_json_len))) {
+        printf("Failed to write %s\n", ascii);
+    } else {
+        printf("Wrote %s\n", ascii);
+    }
+}
+
+static uint64_t shell_bench_us(uint64_t ticks) {
+    return bh_ticks_to_nanoseconds(ticks) / 1000;
+}
+
+// One measurement: printed as a line and added to the report's results
+static void shell_bench_result(const char* test, uint32_t size, uint64_t ops, uint64_t bytes, uint64_t ticks) {
+    uint64_t us = shell_bench_us(ticks);
+    uint64_t rate = us ? bytes * 10 / us : 0;       // Tenths of MB/s (10^6 bytes)
+    uint64_t iops = us ? ops * 1000000 / us : 0;
+
+    printf("  %-14s %8u B  %6u.%u MB/s  %8u ops/s\n", test, (unsigned)size, (unsigned)(rate / 10),
+           (unsigned)(rate % 10), (unsigned)iops);
+    shell_bench_json_append("%s{\"test\":\"%s\",\"size\":%u,\"ops\":%llu,\"bytes\":%llu,\"us\":%llu,"
+                            "\"mb_per_s\":%u.%u,\"ops_per_s\":%llu}",
+                            shell_bench_results ? "," : ",\"results\":[", test, (unsigned)size,
+                            (unsigned long long)ops, (unsigned long long)bytes, (unsigned long long)us,
+                            (unsigned)(rate / 10), (unsigned)(rate % 10), (unsigned long long)iops);
+    shell_bench_results++;
+}
+
+// xorshift64: random sectors without touching the crypto DRBG
+static uint64_t shell_bench_next(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+static int shell_bench_disk(const char* arg) {
+    uint32_t index = arg ? (uint32_t)atoi(arg) : 0;
+    block_device_t* dev = NULL;
+
+    if (EFI_ERROR(GetOpenBlockDevice(index, &dev))) {
+        printf("No disk %u; open disks:", (unsigned)index);
+        for (UINTN i = 0;; i++) {
+            EFI_STATUS slot = GetOpenBlockDevice(i, &dev);
+            if (slot == EFI_INVALID_PARAMETER) {
+                break;
+            }
+            if (!EFI_ERROR(slot)) {
+                printf(" %u (%llu MiB)", (unsigned)i, (unsigned long long)(dev->sector_count >> 11));
+            }
+        }
+        printf("\n");
+        return -1;
+    }
+
+    uint64_t request_sectors = SHELL_BENCH_DISK_MAX_REQUEST / BLOCKDEV_SECTOR_SIZE;
+    if (dev->sector_count < request_sectors) {
+        printf("Disk %u is too small to measure\n", (unsigned)index);
+        return -1;
+    }
+    uint8_t* buf = (uint8_t*)AllocatePages(EFI_SIZE_TO_PAGES(SHELL_BENCH_DISK_MAX_REQUEST));
+    if (!buf) {
+        printf("Out of memory\n");
+        return -1;
+    }
+
+    printf("Disk %u: %llu MiB, %s\n", (unsigned)index, (unsigned long long)(dev->sector_count >> 11), dev->name);
+    shell_bench_json_begin("disk");
+    shell_bench_json_append(",\"device\":%u,\"sectors\":%llu,\"backend\":\"%s\"", (unsigned)index,
+                            (unsigned long long)dev->sector_count, dev->name);
+
+    // Reads go straight to the device: the block cache would measure memory
+    uint64_t limit = bh_nanoseconds_to_ticks((uint64_t)SHELL_BENCH_DISK_TIME_US * 1000);
+    int status = 0;
+
+    for (uint32_t t = 0; t < sizeof(shell_bench_seq_sizes) / sizeof(shell_bench_seq_sizes[0]) && status == 0; t++) {
+        uint32_t count = shell_bench_seq_sizes[t] / BLOCKDEV_SECTOR_SIZE;
+        uint64_t span = dev->sector_count - dev->sector_count % count;
+        // Each size starts on its own stretch so it does not read what the
+        // drive's own cache kept from the previous one
+        uint64_t sector = ((uint64_t)t * (SHELL_BENCH_DISK_SEQ_BYTES / BLOCKDEV_SECTOR_SIZE)) % span;
+        uint64_t ops = 0, bytes = 0, ticks = 0;
+        uint64_t start = bh_get_performance_counter();
+
+        while (bytes < SHELL_BENCH_DISK_SEQ_BYTES && ticks < limit) {
+            if (blockdev_read_raw(dev, sector, count, buf) != 0) {
+                printf("Read error at sector %llu\n", (unsigned long long)sector);
+                status = -1;
+                break;
+            }
+            sector = (sector + count) % span;
+            ops++;
+            bytes += shell_bench_seq_sizes[t];
+            ticks = bh_get_performance_counter() - start;
+        }
+        if (status == 0) {
+            shell_bench_result("seq_read", shell_bench_seq_sizes[t], ops, bytes, ticks);
+        }
+    }
+
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    for (uint32_t t = 0; t < sizeof(shell_bench_random_sizes) / sizeof(shell_bench_random_sizes[0]) && status == 0; t++) {
+        uint32_t count = shell_bench_random_sizes[t] / BLOCKDEV_SECTOR_SIZE;
+        uint64_t slots = dev->sector_count / count;
+        uint64_t ops = 0, ticks = 0;
+        uint64_t start = bh_get_performance_counter();
+
+        while (ops < SHELL_BENCH_DISK_RANDOM_OPS && ticks < limit) {
+            uint64_t sector = (shell_bench_next(&seed) % slots) * count;
+            if (blockdev_read_raw(dev, sector, count, buf) != 0) {
+                printf("Read error at sector %llu\n", (unsigned long long)sector);
+                status = -1;
+                break;
+            }
+            ops++;
+            ticks = bh_get_performance_counter() - start;
+        }
+        if (status == 0) {
+            shell_bench_result("random_read", shell_bench_random_sizes[t], ops,
+                               ops * shell_bench_random_sizes[t], ticks);
+        }
+    }
+
+    FreePages(buf, EFI_SIZE_TO_PAGES(SHELL_BENCH_DISK_MAX_REQUEST));
+    if (status == 0) {
+        shell_bench_json_save("disk");
+    }
+    return status;
+}
+
+// pxe_download sink: the buffer is kept across runs and grown when needed
+typedef struct {
+    uint8_t* buf;
+    uint32_t size;
+} shell_bench_tftp_buffer_t;
+
+static uint8_t* shell_bench_tftp_reserve(void* context, uint32_t size) {
+    shell_bench_tftp_buffer_t* b = (shell_bench_tftp_buffer_t*)context;
+    if (size > b->size) {
+        if (b->buf) {
+            FreePool(b->buf);
+        }
+        b->buf = (uint8_t*)AllocatePool(size);
+        b->size = b->buf ? size : 0;
+    }
+    return b->buf;
+}
+
+// One timed download: over HTTP(S) with LoadHttpFile, the way a URL boot
+// entry is fetched, otherwise with pxe_download from the boot server
+static int shell_bench_download(const char* path, pxe_sink_t* sink, uint32_t* size) {
+    if (strncmp(path, "http://", 7) == 0 || strncmp(path, "https://", 8) == 0) {
+        CHAR16 wide[SHELL_BENCH_URL_MAX];
+        LOADED_FILE file;
+        size_t i;
+
+        for (i = 0; path[i] && i < SHELL_BENCH_URL_MAX - 1; i++) {
+            wide[i] = (CHAR16)path[i];
+        }
+        wide[i] = 0;
+        if (path[i] || EFI_ERROR(LoadHttpFile(wide, FILE_LOAD_POOL, NULL, NULL, &file))) {
+            return -1;
+        }
+        *size = (uint32_t)file.Size;
+        FreeLoadedFile(&file);
+        return 0;
+    }
+
+    uint8_t* data = NULL;
+    return pxe_download(NULL, path, sink, 0, &data, size);
+}
+
+static int shell_bench_net(const char* family, const char* path, const char* runs_arg) {
+    uint32_t runs = runs_arg ? (uint32_t)atoi(runs_arg) : 3;
+    shell_bench_tftp_buffer_t buffer = { NULL, 0 };
+    pxe_sink_t sink = { shell_bench_tftp_reserve, &buffer };
+    int http = strcmp(family, "http") == 0;
+    const char* server = "";
+    int status = 0;
+
+    if (runs == 0 || runs > SHELL_BENCH_TFTP_MAX_RUNS) {
+        printf("Usage: bench %s <%s> [runs, 1-%u]\n", family, http ? "url" : "file", SHELL_BENCH_TFTP_MAX_RUNS);
+        return -1;
+    }
+    if (http && strncmp(path, "http://", 7) != 0 && strncmp(path, "https://", 8) != 0) {
+        printf("Usage: bench http <http:// or https:// url> [runs]\n");
+        return -1;
+    }
+    if (!http) {
+        if (pxe_network_init() != 0) {
+            printf("Network unavailable\n");
+            return -1;
+        }
+        struct pxe_network_info* info = pxe_get_network_info();
+        if (info) {
+            server = info->tftp_server;
+        }
+        printf("%s from %s\n", path, server[0] ? server : "the PXE stack");
+    } else {
+        printf("%s\n", path);
+    }
+    shell_bench_json_begin(family);
+    shell_bench_json_append(",\"file\":");
+    shell_bench_json_string(path);
+    shell_bench_json_append(",\"server\":");
+    shell_bench_json_string(server);
+
+    for (uint32_t r = 0; r < runs; r++) {
+        uint32_t size = 0;
+        uint64_t start = bh_get_performance_counter();
+        if (shell_bench_download(path, &sink, &size) != 0) {
+            printf("Download failed\n");
+            status = -1;
+            break;
+        }
+        shell_bench_result("download", size, 1, size, bh_get_performance_counter() - start);
+    }
+
+    if (buffer.buf) {
+        FreePool(buffer.buf);
+    }
+    if (status == 0) {
+        shell_bench_json_save(family);
+    }
+    return status;
+}
+
+static int shell_bench_crypto(void) {
+    static const uint8_t key[32] = {
+        0x60, 0x3d, 0xeb, 0x10, 0x15, 0xca, 0x71, 0xbe, 0x2b, 0x73, 0xae, 0xf0, 0x85, 0x7d, 0x77, 0x81,
+        0x1f, 0x35, 0x2c, 0x07, 0x3b, 0x61, 0x08, 0xd7, 0x2d, 0x98, 0x10, 0xa3, 0x09, 0x14, 0xdf, 0xf4
+    };
+    static const uint8_t iv[12] = { 0 };
+    static const char* const names[] = { "sha256", "sha512", "aes256_gcm", "hmac_sha256" };
+    uint8_t digest[CRYPTO_SHA512_DIGEST_LENGTH];
+    uint8_t tag[16];
+    crypto_aes_ctx_t aes;
+
+    uint8_t* data = (uint8_t*)AllocatePool(SHELL_BENCH_CRYPTO_MAX_SIZE);
+    uint8_t* out = (uint8_t*)AllocatePool(SHELL_BENCH_CRYPTO_MAX_SIZE);
+    if (!data || !out) {
+        printf("Out of memory\n");
+        if (data) FreePool(data);
+        if (out) FreePool(out);
+        return -1;
+    }
+    for (uint32_t i = 0; i < SHELL_BENCH_CRYPTO_MAX_SIZE; i++) {
+        data[i] = (uint8_t)(i * 167 + 13);
+    }
+    crypto_aes_init(&aes, key, 256);
+
+    printf("sha256 %s, sha512 %s, aes %s\n", crypto_sha256_backend_name(), crypto_sha512_backend_name(),
+           crypto_aes_backend_name());
+    shell_bench_json_begin("crypto");
+    shell_bench_json_append(",\"sha256\":\"%s\",\"sha512\":\"%s\",\"aes\":\"%s\"", crypto_sha256_backend_name(),
+                            crypto_sha512_backend_name(), crypto_aes_backend_name());
+
+    for (uint32_t p = 0; p < sizeof(names) / sizeof(names[0]); p++) {
+        for (uint32_t s = 0; s < sizeof(shell_bench_crypto_sizes) / sizeof(shell_bench_crypto_sizes[0]); s++) {
+            uint32_t len = shell_bench_crypto_sizes[s];
+            uint32_t repeats = SHELL_BENCH_CRYPTO_BYTES / len;
+            // The first pass warms caches and picks up the backend
+            uint64_t start = 0;
+            for (uint32_t r = 0; r <= repeats; r++) {
+                if (r == 1) {
+                    start = bh_get_performance_counter();
+                }
+                switch (p) {
+                case 0: sha256_hash(data, len, digest); break;
+                case 1: sha512_hash(data, len, digest); break;
+                case 2: crypto_aes_gcm_encrypt(&aes, iv, sizeof(iv), NULL, 0, data, len, out, tag); break;
+                default: crypto_hmac_sha256(key, sizeof(key), data, len, digest); break;
+                }
+            }
+            shell_bench_result(names[p], len, repeats, (uint64_t)len * repeats,
+                               bh_get_performance_counter() - start);
+        }
+    }
+
+    crypto_zeroize_context(&aes, sizeof(aes));
+    FreePool(data);
+    FreePool(out);
+    shell_bench_json_save("crypto");
+    return 0;
+}
+
+int shell_cmd_bench(int argc, char** argv) {
+    if (bh_get_performance_frequency() == 0) {
+        printf("No performance counter\n");
+        return -1;
+    }
+    if (argc > 1 && strcmp(argv[1], "disk") == 0) {
+        return shell_bench_disk(argc > 2 ? argv[2] : NULL);
+    }
+    if (argc > 2 && (strcmp(argv[1], "tftp") == 0 || strcmp(argv[1], "http") == 0)) {
+        return shell_bench_net(argv[1], argv[2], argc > 3 ? argv[3] : NULL);
+    }
+    if (argc > 1 && strcmp(argv[1], "crypto") == 0) {
+        return shell_bench_crypto();
+    }
+    printf("Usage: bench disk [N] | bench tftp <file> [runs] | bench http <url> [runs] | bench crypto\n");
+    return -1;
+}
@@ -0,0 +1,19 @@
+/*
+ * shell_bench.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_SHELL_BENCH_H
+#define BLOODHORN_SHELL_BENCH_H
+
+// bench disk [N] | bench tftp <file> [runs] | bench crypto
+//
+// Throughput of what the firmware stack delivers: raw block reads on open
+// disk N (0 = boot disk), a file from the boot server, and the boot-path
+// crypto primitives on the selected backends. Each family prints its
+// results and writes them to bench<family>.json on the boot volume.
+// Returns 0 on success.
+int shell_cmd_bench(int argc, char** argv);
+#endif
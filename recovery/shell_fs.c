@@ -7,80 +7,269 @@
 
 #include "shell_fs.h"
 #include "compat.h"
-#include "../fs/fat32.h"
-#include "../fs/ext2.h"
+#include "../fs/fs_mount.h"
+#include "../uefi/uefi.h"
+#include "../security/crypto.h"
+#include "../boot/libb/include/bloodhorn/time.h"
 #include <string.h>
 #include <stdio.h>
 
-int shell_cmd_ls_fat32(uint32_t lba, char* out, int maxlen) {
-    struct fat32_bootsector bs;
-    fat32_read_bootsector(lba, &bs);
-    uint32_t fat_offset = bs.reserved_sectors;
-    uint32_t root_dir_sectors = ((bs.root_entries * 32) + (bs.bytes_per_sector - 1)) / bs.bytes_per_sector;
-    uint32_t root_dir_start = lba + fat_offset + (bs.num_fats * bs.sectors_per_fat);
-    uint8_t dir[512];
-    read_sector(root_dir_start, dir);
-    int pos = 0;
-    for (int i = 0; i < 512; i += 32) {
-        if (dir[i] == 0) break;
-        if (dir[i] == 0xE5) continue;
-        if ((dir[i+11] & 0x10) != 0) continue;
-        char name[12];
-        memcpy(name, &dir[i], 11);
-        name[11] = 0;
-        int n = snprintf(out + pos, maxlen - pos, "%s ", name);
-        pos += n;
-        if (pos >= maxlen - 1) break;
-    }
-    out[pos] = 0;
+// Listing buffer for ls; drivers stop at its end
+#define SHELL_FS_LIST_MAX   4096
+
+typedef struct {
+    uint64_t bytes;
+    uint64_t read_ticks;        // Spent in the filesystem driver
+    uint64_t total_ticks;       // Reads plus whatever the command did with them
+} shell_fs_stats_t;
+
+// Takes each chunk in file order; data has one spare byte past len.
+// Nonzero stops the stream.
+typedef int (*shell_fs_sink_t)(uint8_t* data, uint32_t len, uint32_t offset, void* ctx);
+
+// Feed [offset, offset + length) of a file to sink (length 0 = to the end)
+static int shell_fs_stream(const char* path, uint32_t offset, uint32_t length,
+                           shell_fs_sink_t sink, void* ctx, shell_fs_stats_t* stats) {
+    fs_file_t* file = fs_open(path);
+    if (!file) {
+        printf("%s: not found\n", path);
+        return -1;
+    }
+    if (file->node.is_dir) {
+        printf("%s: is a directory\n", path);
+        fs_close(file);
+        return -1;
+    }
+
+    uint8_t* buf = (uint8_t*)AllocatePool(SHELL_FS_CHUNK + 1);
+    if (!buf) {
+        printf("Out of memory\n");
+        fs_close(file);
+        return -1;
+    }
+
+    uint32_t size = fs_file_size(file);
+    if (offset > size) {
+        offset = size;
+    }
+    uint32_t end = (length == 0 || length > size - offset) ? size : offset + length;
+
+    int status = 0;
+    memset(stats, 0, sizeof(*stats));
+    uint64_t start = bh_get_performance_counter();
+    for (uint32_t pos = offset; pos < end; ) {
+        uint32_t want = end - pos < SHELL_FS_CHUNK ? end - pos : SHELL_FS_CHUNK;
+        uint64_t t0 = bh_get_performance_counter();
+        int got = fs_file_pread(file, buf, want, pos);
+        stats->read_ticks += bh_get_performance_counter() - t0;
+        if (got <= 0) {
+            printf("%s: read error at offset %u\n", path, (unsigned)pos);
+            status = -1;
+            break;
+        }
+        if (sink(buf, (uint32_t)got, pos, ctx) != 0) {
+            status = -1;
+            break;
+        }
+        pos += (uint32_t)got;
+        stats->bytes += (uint32_t)got;
+    }
+    stats->total_ticks = bh_get_performance_counter() - start;
+
+    FreePool(buf);
+    fs_close(file);
+    return status;
+}
+
+// Tenths of MB/s (10^6 bytes), to print with one decimal
+static uint64_t shell_fs_rate(uint64_t bytes, uint64_t ticks) {
+    uint64_t us = bh_ticks_to_nanoseconds(ticks) / 1000;
+    return us ? bytes * 10 / us : 0;
+}
+
+static void shell_fs_print_stats(const shell_fs_stats_t* stats) {
+    if (bh_get_performance_frequency() == 0) {
+        printf("%llu bytes\n", (unsigned long long)stats->bytes);
+        return;
+    }
+    uint64_t us = bh_ticks_to_nanoseconds(stats->total_ticks) / 1000;
+    uint64_t read_rate = shell_fs_rate(stats->bytes, stats->read_ticks);
+    uint64_t total_rate = shell_fs_rate(stats->bytes, stats->total_ticks);
+    printf("%llu bytes in %u.%03u ms: read %u.%u MB/s, overall %u.%u MB/s\n",
+           (unsigned long long)stats->bytes, (unsigned)(us / 1000), (unsigned)(us % 1000),
+           (unsigned)(read_rate / 10), (unsigned)(read_rate % 10),
+           (unsigned)(total_rate / 10), (unsigned)(total_rate % 10));
+}
+
+static void shell_fs_print_digest(const uint8_t* digest, uint32_t len, const char* path) {
+    char hex[2 * CRYPTO_SHA512_DIGEST_LENGTH + 1];
+    static const char digits[] = "0123456789abcdef";
+
+    for (uint32_t i = 0; i < len; i++) {
+        hex[2 * i] = digits[digest[i] >> 4];
+        hex[2 * i + 1] = digits[digest[i] & 0xF];
+    }
+    hex[2 * len] = 0;
+    printf("%s  %s\n", hex, path);
+}
+
+int shell_fs_ls(const char* path) {
+    char* list = (char*)AllocatePool(SHELL_FS_LIST_MAX);
+    if (!list) {
+        printf("Out of memory\n");
+        return -1;
+    }
+    int len = fs_list_dir(path, list, SHELL_FS_LIST_MAX);
+    if (len < 0) {
+        printf("%s: cannot list\n", path);
+        FreePool(list);
+        return -1;
+    }
+    list[len < SHELL_FS_LIST_MAX ? len : SHELL_FS_LIST_MAX - 1] = 0;
+    printf("%s\n", list);
+    FreePool(list);
+    return 0;
+}
+
+static int shell_fs_cat_sink(uint8_t* data, uint32_t len, uint32_t offset, void* ctx) {
+    (void)offset;
+    (void)ctx;
+    data[len] = 0;
+    printf("%s", (char*)data);
     return 0;
 }
 
-int shell_cmd_cat_fat32(uint32_t lba, const char* filename, char* out, int maxlen) {
-    uint32_t cluster;
-    if (fat32_find_file(lba, filename, &cluster) != 0) return -1;
-    fat32_read_file(lba, cluster, (uint8_t*)out, maxlen);
-    out[maxlen-1] = 0;
+int shell_fs_cat(const char* path) {
+    shell_fs_stats_t stats;
+    if (shell_fs_stream(path, 0, 0, shell_fs_cat_sink, NULL, &stats) != 0) {
+        return -1;
+    }
+    printf("\n");
+    shell_fs_print_stats(&stats);
     return 0;
 }
 
-int shell_cmd_ls_ext2(uint32_t lba, char* out, int maxlen) {
-    struct ext2_super_block sb;
-    ext2_read_superblock(lba, &sb);
-    uint32_t block_size = 1024 << sb.s_log_block_size;
-    uint8_t group_desc[32];
-    read_sector(lba + 2 + (block_size / 512), group_desc);
-    uint32_t inode_table = *(uint32_t*)&group_desc[8];
-    uint8_t inode[128];
-    read_sector(lba + inode_table * (block_size / 512), inode);
-    uint32_t dir_block = *(uint32_t*)&inode[40];
-    uint8_t dir[1024];
-    read_sector(lba + dir_block * (block_size / 512), dir);
-    int pos = 0;
-    uint32_t offset = 0;
-    while (offset < 1024) {
-        uint32_t inode_num = *(uint32_t*)&dir[offset];
-        uint16_t rec_len = *(uint16_t*)&dir[offset+4];
-        uint8_t name_len = dir[offset+6];
-        char name[256];
-        for (int i = 0; i < name_len; ++i) name[i] = dir[offset+8+i];
-        name[name_len] = 0;
-        if (inode_num) {
-            int n = snprintf(out + pos, maxlen - pos, "%s ", name);
-            pos += n;
-            if (pos >= maxlen - 1) break;
+// 16 bytes a line: offset, hex, then the printable characters
+static int shell_fs_hex_sink(uint8_t* data, uint32_t len, uint32_t offset, void* ctx) {
+    static const char digits[] = "0123456789abcdef";
+    char line[80];
+
+    (void)ctx;
+    for (uint32_t i = 0; i < len; i += 16) {
+        uint32_t n = len - i < 16 ? len - i : 16;
+        int pos = snprintf(line, sizeof(line), "%08x  ", (unsigned)(offset + i));
+        for (uint32_t j = 0; j < 16; j++) {
+            if (j < n) {
+                line[pos++] = digits[data[i + j] >> 4];
+                line[pos++] = digits[data[i + j] & 0xF];
+            } else {
+                line[pos++] = ' ';
+                line[pos++] = ' ';
+            }
+            line[pos++] = ' ';
+            if (j == 7) {
+                line[pos++] = ' ';
+            }
         }
-        offset += rec_len;
-        if (rec_len == 0) break;
+        line[pos++] = '|';
+        for (uint32_t j = 0; j < n; j++) {
+            uint8_t c = data[i + j];
+            line[pos++] = (c >= 0x20 && c < 0x7F) ? (char)c : '.';
+        }
+        line[pos++] = '|';
+        line[pos] = 0;
+        printf("%s\n", line);
+    }
+    return 0;
+}
+
+int shell_fs_hexdump(const char* path, uint32_t offset, uint32_t length) {
+    shell_fs_stats_t stats;
+    if (shell_fs_stream(path, offset, length, shell_fs_hex_sink, NULL, &stats) != 0) {
+        return -1;
+    }
+    shell_fs_print_stats(&stats);
+    return 0;
+}
+
+static int shell_fs_sha256_sink(uint8_t* data, uint32_t len, uint32_t offset, void* ctx) {
+    (void)offset;
+    return crypto_sha256_update((crypto_sha256_ctx_t*)ctx, data, len) == 0 ? 0 : -1;
+}
+
+int shell_fs_sha256sum(const char* path) {
+    crypto_sha256_ctx_t ctx;
+    shell_fs_stats_t stats;
+    uint8_t digest[CRYPTO_SHA256_DIGEST_LENGTH];
+
+    crypto_sha256_init(&ctx);
+    if (shell_fs_stream(path, 0, 0, shell_fs_sha256_sink, &ctx, &stats) != 0) {
+        return -1;
     }
-    out[pos] = 0;
+    crypto_sha256_final(&ctx, digest);
+    shell_fs_print_digest(digest, sizeof(digest), path);
+    shell_fs_print_stats(&stats);
     return 0;
 }
 
-int shell_cmd_cat_ext2(uint32_t lba, const char* filename, char* out, int maxlen) {
-    uint32_t inode_num;
-    if (ext2_find_file_in_root(lba, filename, &inode_num) != 0) return -1;
-    ext2_read_file(lba, inode_num, (uint8_t*)out, maxlen);
-    out[maxlen-1] = 0;
+static int shell_fs_sha512_sink(uint8_t* data, uint32_t len, uint32_t offset, void* ctx) {
+    (void)offset;
+    return crypto_sha512_update((crypto_sha512_ctx_t*)ctx, data, len) == 0 ? 0 : -1;
+}
+
+int shell_fs_sha512sum(const char* path) {
+    crypto_sha512_ctx_t ctx;
+    shell_fs_stats_t stats;
+    uint8_t digest[CRYPTO_SHA512_DIGEST_LENGTH];
+
+    crypto_sha512_init(&ctx);
+    if (shell_fs_stream(path, 0, 0, shell_fs_sha512_sink, &ctx, &stats) != 0) {
+        return -1;
+    }
+    crypto_sha512_final(&ctx, digest);
+    shell_fs_print_digest(digest, sizeof(digest), path);
+    shell_fs_print_stats(&stats);
     return 0;
-} 
\ No newline at end of file
+}
+
+static int shell_fs_cp_sink(uint8_t* data, uint32_t len, uint32_t offset, void* ctx) {
+    EFI_FILE_PROTOCOL* handle = (EFI_FILE_PROTOCOL*)ctx;
+    UINTN written = len;
+
+    if (EFI_ERROR(handle->Write(handle, &written, data)) || written != len) {
+        printf("Write failed at offset %u\n", (unsigned)offset);
+        return -1;
+    }
+    return 0;
+}
+
+int shell_fs_cp(const char* path, const char* dest) {
+    CHAR16 name[FS_DCACHE_PATH_MAX];
+    EFI_FILE_PROTOCOL* handle = NULL;
+    shell_fs_stats_t stats;
+    size_t i;
+
+    // The boot volume takes backslashes
+    for (i = 0; dest[i] && i < FS_DCACHE_PATH_MAX - 1; i++) {
+        name[i] = dest[i] == '/' ? L'\\' : (CHAR16)dest[i];
+    }
+    if (dest[i]) {
+        printf("%s: name too long\n", dest);
+        return -1;
+    }
+    name[i] = 0;
+
+    if (EFI_ERROR(CreateBootFile(name, &handle))) {
+        printf("%s: cannot create on the boot volume\n", dest);
+        return -1;
+    }
+    if (shell_fs_stream(path, 0, 0, shell_fs_cp_sink, handle, &stats) != 0 ||
+        EFI_ERROR(handle->Flush(handle))) {
+        // No partial copy left behind; Delete also closes the handle
+        handle->Delete(handle);
+        return -1;
+    }
+    handle->Close(handle);
+    shell_fs_print_stats(&stats);
+    return 0;
+}
@@ -7,8 +7,21 @@
 
 #ifndef BLOODHORN_SHELL_FS_H
 #define BLOODHORN_SHELL_FS_H
-int shell_cmd_ls_fat32(uint32_t lba, char* out, int maxlen);
-int shell_cmd_cat_fat32(uint32_t lba, const char* filename, char* out, int maxlen);
-int shell_cmd_ls_ext2(uint32_t lba, char* out, int maxlen);
-int shell_cmd_cat_ext2(uint32_t lba, const char* filename, char* out, int maxlen);
-#endif 
\ No newline at end of file
+
+#include <stdint.h>
+
+// File commands over the mounted filesystems. Files are streamed through
+// one open handle a chunk at a time, so any size works in a fixed buffer,
+// and each command ends with the rate it read at. Return 0 on success;
+// the commands print their own errors.
+#define SHELL_FS_CHUNK  (64 * 1024)
+
+int shell_fs_ls(const char* path);
+int shell_fs_cat(const char* path);
+// length 0 dumps to the end of the file
+int shell_fs_hexdump(const char* path, uint32_t offset, uint32_t length);
+int shell_fs_sha256sum(const char* path);
+int shell_fs_sha512sum(const char* path);
+// Copy a mounted file to the boot volume (the mounts are read-only)
+int shell_fs_cp(const char* path, const char* dest);
+#endif
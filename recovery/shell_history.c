@@ -8,16 +8,39 @@
 #include "shell_history.h"
 #include "compat.h"
 #include <string.h>
-static char history[16][128];
+
+// Ring of lines: hist_next is where the next one goes
+static char history[SHELL_HISTORY_SIZE][SHELL_HISTORY_LINE];
+static int hist_next = 0;
 static int hist_count = 0;
+
 int shell_history_add(const char* cmd) {
-    if (hist_count < 16) {
-        strncpy(history[hist_count++], cmd, 127);
-        history[hist_count-1][127] = 0;
+    if (!cmd || !cmd[0]) return -1;
+    // Repeating the last line does not push older ones out
+    if (hist_count > 0 && strncmp(shell_history_get(hist_count - 1), cmd, SHELL_HISTORY_LINE - 1) == 0) {
+        return 0;
     }
+    strncpy(history[hist_next], cmd, SHELL_HISTORY_LINE - 1);
+    history[hist_next][SHELL_HISTORY_LINE - 1] = 0;
+    hist_next = (hist_next + 1) % SHELL_HISTORY_SIZE;
+    if (hist_count < SHELL_HISTORY_SIZE) hist_count++;
     return 0;
 }
+
 const char* shell_history_get(int idx) {
     if (idx < 0 || idx >= hist_count) return 0;
-    return history[idx];
-} 
\ No newline at end of file
+    return history[(hist_next - hist_count + idx + SHELL_HISTORY_SIZE) % SHELL_HISTORY_SIZE];
+}
+
+int shell_history_count(void) {
+    return hist_count;
+}
+
+int shell_history_find(const char* prefix, int before) {
+    size_t len = strlen(prefix);
+    if (before > hist_count) before = hist_count;
+    for (int idx = before - 1; idx >= 0; idx--) {
+        if (strncmp(shell_history_get(idx), prefix, len) == 0) return idx;
+    }
+    return -1;
+}
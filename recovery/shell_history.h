@@ -7,6 +7,15 @@
 
 #ifndef BLOODHORN_SHELL_HISTORY_H
 #define BLOODHORN_SHELL_HISTORY_H
+
+// The newest SHELL_HISTORY_SIZE lines are kept; older ones are overwritten
+#define SHELL_HISTORY_SIZE  64
+#define SHELL_HISTORY_LINE  128
+
 int shell_history_add(const char* cmd);
+// idx 0 is the oldest line still held
 const char* shell_history_get(int idx);
-#endif 
\ No newline at end of file
+int shell_history_count(void);
+// Newest line before idx `before` that starts with prefix, or -1
+int shell_history_find(const char* prefix, int before);
+#endif
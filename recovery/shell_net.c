@@ -9,44 +9,374 @@
 #include "compat.h"
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
-#include "net/pxe.h"
+#include <stdbool.h>
+#include "../net/pxe.h"
+#include "../uefi/uefi.h"
+#include "../boot/libb/include/bloodhorn/time.h"
 
-// Minimal ICMP echo implementation using PXE stack (if supported)
-// Returns 0 on success, -1 on failure
-int shell_cmd_ping(const char* host, char* out, int maxlen) {
-    // This assumes PXE stack provides a function for ICMP echo (not standard, but can be extended)
-    extern int pxe_icmp_echo(const char* host, int* rtt_ms);
-    int rtt = 0;
-    int result = pxe_icmp_echo(host, &rtt);
-    if (result == 0) {
-        snprintf(out, maxlen, "Reply from %s: time=%dms\n", host, rtt);
-        return 0;
-    } else {
-        snprintf(out, maxlen, "No reply from %s\n", host);
+#define SHELL_NET_PING_MAX      1000
+#define SHELL_NET_PING_INTERVAL 1000000     // Between echo requests, in microseconds
+#define SHELL_NET_REPLY_MS      1000        // How long to wait for the last reply
+#define SHELL_NET_URL_MAX       512
+#define SHELL_NET_WRITE_CHUNK   (1024 * 1024)
+
+// "a.b.c.d" to an address in network order; -1 if it is not one
+static int shell_net_parse_ip(const char* text, const char** end, uint32_t* ip) {
+    uint8_t* octets = (uint8_t*)ip;
+
+    for (int i = 0; i < 4; i++) {
+        if (*text < '0' || *text > '9') return -1;
+        unsigned value = 0;
+        while (*text >= '0' && *text <= '9') {
+            value = value * 10 + (unsigned)(*text++ - '0');
+            if (value > 255) return -1;
+        }
+        octets[i] = (uint8_t)value;
+        if (i < 3 && *text++ != '.') return -1;
+    }
+    if (end) {
+        *end = text;
+    } else if (*text) {
+        return -1;
+    }
+    return 0;
+}
+
+static void shell_net_print_ip(uint32_t ip) {
+    const uint8_t* a = (const uint8_t*)&ip;
+    printf("%u.%u.%u.%u", a[0], a[1], a[2], a[3]);
+}
+
+static void shell_net_print_ms(const char* label, uint64_t us) {
+    printf("%s%u.%03u", label, (unsigned)(us / 1000), (unsigned)(us % 1000));
+}
+
+int shell_cmd_ping(int argc, char** argv) {
+    uint32_t count = 4, target;
+    const char* host = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            count = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else {
+            host = argv[i];
+        }
+    }
+    if (!host || count == 0 || count > SHELL_NET_PING_MAX || shell_net_parse_ip(host, NULL, &target) != 0) {
+        printf("Usage: ping [-c 1-%u] <a.b.c.d>\n", SHELL_NET_PING_MAX);
+        return -1;
+    }
+
+    uint32_t received = 0;
+    uint64_t sum = 0, min = UINT64_MAX, max = 0, jitter = 0, last = 0;
+    for (uint32_t seq = 0; seq < count; seq++) {
+        uint32_t rtt;
+        uint64_t start = bh_get_performance_counter();
+        if (EFI_ERROR(IcmpEchoSweep(&target, 1, (uint16_t)seq, SHELL_NET_REPLY_MS, &rtt))) {
+            printf("Network unavailable\n");
+            return -1;
+        }
+        if (rtt == ICMP_NO_REPLY) {
+            printf("No reply from %s: seq=%u\n", host, seq);
+        } else {
+            printf("Reply from %s: seq=%u", host, seq);
+            shell_net_print_ms(" time=", rtt);
+            printf(" ms\n");
+            // Mean difference between consecutive round trips (RFC 3550's,
+            // without the smoothing)
+            if (received > 0) {
+                jitter += rtt > last ? rtt - last : last - rtt;
+            }
+            last = rtt;
+            sum += rtt;
+            if (rtt < min) min = rtt;
+            if (rtt > max) max = rtt;
+            received++;
+        }
+        if (seq + 1 < count) {
+            uint64_t us = bh_ticks_to_nanoseconds(bh_get_performance_counter() - start) / 1000;
+            if (us < SHELL_NET_PING_INTERVAL) {
+                bh_sleep_microseconds(SHELL_NET_PING_INTERVAL - us);
+            }
+        }
+    }
+
+    printf("%u sent, %u received, %u%% loss\n", count, received, (count - received) * 100 / count);
+    if (received == 0) {
         return -1;
     }
+    shell_net_print_ms("rtt min/avg/max/jitter = ", min);
+    shell_net_print_ms("/", sum / received);
+    shell_net_print_ms("/", max);
+    shell_net_print_ms("/", received > 1 ? jitter / (received - 1) : 0);
+    printf(" ms\n");
+    return 0;
 }
 
-// Print real network interface info from PXE stack
-int shell_cmd_ifconfig(char* out, int maxlen) {
+int shell_cmd_sweep(int argc, char** argv) {
+    const char* end;
+    uint32_t base;
+    unsigned prefix;
+
+    if (argc < 2 || shell_net_parse_ip(argv[1], &end, &base) != 0 || *end != '/' ||
+        (prefix = (unsigned)strtoul(end + 1, NULL, 10)) < SHELL_NET_SWEEP_MIN_PREFIX || prefix > 32) {
+        printf("Usage: sweep <a.b.c.d/%u-32>\n", SHELL_NET_SWEEP_MIN_PREFIX);
+        return -1;
+    }
+
+    // Work in host order; the network and broadcast addresses of a subnet
+    // with room for them are left out
+    const uint8_t* b = (const uint8_t*)&base;
+    uint32_t host_mask = prefix == 32 ? 0 : (0xFFFFFFFFu >> prefix);
+    uint32_t first = (((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3]) & ~host_mask;
+    uint32_t count = host_mask + 1;
+    if (prefix < 31) {
+        first++;
+        count -= 2;
+    }
+
+    uint32_t* targets = (uint32_t*)AllocatePool(count * sizeof(*targets));
+    uint32_t* rtt = (uint32_t*)AllocatePool(count * sizeof(*rtt));
+    if (!targets || !rtt) {
+        printf("Out of memory\n");
+        if (targets) FreePool(targets);
+        if (rtt) FreePool(rtt);
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t ip = first + i;
+        uint8_t* t = (uint8_t*)&targets[i];
+        t[0] = (uint8_t)(ip >> 24);
+        t[1] = (uint8_t)(ip >> 16);
+        t[2] = (uint8_t)(ip >> 8);
+        t[3] = (uint8_t)ip;
+    }
+
+    uint64_t start = bh_get_performance_counter();
+    EFI_STATUS status = IcmpEchoSweep(targets, count, 0, SHELL_NET_REPLY_MS, rtt);
+    uint64_t us = bh_ticks_to_nanoseconds(bh_get_performance_counter() - start) / 1000;
+    if (EFI_ERROR(status)) {
+        printf("Network unavailable\n");
+        FreePool(targets);
+        FreePool(rtt);
+        return -1;
+    }
+
+    uint32_t up = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (rtt[i] == ICMP_NO_REPLY) continue;
+        printf("  ");
+        shell_net_print_ip(targets[i]);
+        shell_net_print_ms("  ", rtt[i]);
+        printf(" ms\n");
+        up++;
+    }
+    printf("%u of %u hosts up", up, count);
+    shell_net_print_ms(" in ", us);
+    printf(" ms\n");
+
+    FreePool(targets);
+    FreePool(rtt);
+    return 0;
+}
+
+int shell_cmd_ifconfig(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+
     struct pxe_network_info* info = pxe_get_network_info();
     if (!info) {
-        snprintf(out, maxlen, "No network info available\n");
-        return -1;
-    }
-    uint8_t* ip = (uint8_t*)&info->client_ip;
-    uint8_t* mask = (uint8_t*)&info->subnet_mask;
-    uint8_t* gw = (uint8_t*)&info->router_ip;
-    uint8_t* dns = (uint8_t*)&info->dns_server;
-    snprintf(out, maxlen,
-        "eth0: %u.%u.%u.%u\n  netmask: %u.%u.%u.%u\n  gateway: %u.%u.%u.%u\n  dns: %u.%u.%u.%u\n  tftp: %s\n  bootfile: %s\n  domain: %s\n",
-        ip[0], ip[1], ip[2], ip[3],
-        mask[0], mask[1], mask[2], mask[3],
-        gw[0], gw[1], gw[2], gw[3],
-        dns[0], dns[1], dns[2], dns[3],
-        info->tftp_server,
-        info->boot_file,
-        info->domain_name);
+        printf("No network info available\n");
+        return -1;
+    }
+    printf("eth0: ");
+    shell_net_print_ip(info->client_ip);
+    printf("\n  netmask: ");
+    shell_net_print_ip(info->subnet_mask);
+    printf("\n  gateway: ");
+    shell_net_print_ip(info->router_ip);
+    printf("\n  dns: ");
+    shell_net_print_ip(info->dns_server);
+    printf("\n  tftp: %s\n  bootfile: %s\n  domain: %s\n", info->tftp_server, info->boot_file, info->domain_name);
+
+    // Every NIC discovery ran on, with its link and how long it took
+    static const char* const states[] = { "no link", "discovering", "timed out", "failed", "cancelled", "selected" };
+    const pxe_nic_t* nics;
+    int count = pxe_get_nics(&nics);
+    for (int i = 0; i < count; i++) {
+        const uint8_t* m = nics[i].mac;
+        printf("nic%d: %02x:%02x:%02x:%02x:%02x:%02x link %s, %s",
+            i, m[0], m[1], m[2], m[3], m[4], m[5],
+            nics[i].link ? "up" : "down",
+            nics[i].state < sizeof(states) / sizeof(states[0]) ? states[nics[i].state] : "?");
+        if (nics[i].state != PXE_NIC_NO_LINK) {
+            printf(" after %u ms", nics[i].elapsed_ms);
+        }
+        if (nics[i].client_ip) {
+            printf(" (");
+            shell_net_print_ip(nics[i].client_ip);
+            printf(")");
+        }
+        printf("\n");
+    }
     return 0;
-} 
\ No newline at end of file
+}
+
+static void shell_net_print_rate(const char* label, uint64_t bytes, uint64_t ticks) {
+    uint64_t us = bh_ticks_to_nanoseconds(ticks) / 1000;
+    uint64_t rate = us ? bytes * 10 / us : 0;
+    shell_net_print_ms(label, us);
+    printf(" ms, %u.%u MB/s", (unsigned)(rate / 10), (unsigned)(rate % 10));
+}
+
+static int shell_net_write(EFI_FILE_PROTOCOL* handle, const void* data, uint64_t len) {
+    UINTN written = (UINTN)len;
+    return EFI_ERROR(handle->Write(handle, &written, (VOID*)data)) || written != len ? -1 : 0;
+}
+
+typedef struct {
+    EFI_FILE_PROTOCOL* handle;
+    uint64_t bytes;
+    uint64_t write_ticks;
+} shell_net_fetch_t;
+
+// LoadHttpFile hands over each stretch of the file once it and everything
+// before it has arrived, so the write overlaps the rest of the download
+static EFI_STATUS shell_net_http_chunk(VOID* context, CONST VOID* data, UINTN length) {
+    shell_net_fetch_t* fetch = (shell_net_fetch_t*)context;
+    uint64_t start = bh_get_performance_counter();
+
+    if (shell_net_write(fetch->handle, data, length) != 0) {
+        printf("Write failed at offset %llu\n", (unsigned long long)fetch->bytes);
+        return EFI_DEVICE_ERROR;
+    }
+    fetch->bytes += length;
+    fetch->write_ticks += bh_get_performance_counter() - start;
+    return EFI_SUCCESS;
+}
+
+static int shell_net_fetch_http(const char* url, shell_net_fetch_t* fetch) {
+    CHAR16 wide[SHELL_NET_URL_MAX];
+    LOADED_FILE file;
+    size_t i;
+
+    for (i = 0; url[i] && i < SHELL_NET_URL_MAX - 1; i++) {
+        wide[i] = (CHAR16)url[i];
+    }
+    if (url[i]) {
+        printf("URL too long\n");
+        return -1;
+    }
+    wide[i] = 0;
+
+    if (EFI_ERROR(LoadHttpFile(wide, FILE_LOAD_POOL, shell_net_http_chunk, fetch, &file))) {
+        printf("%s: download failed\n", url);
+        return -1;
+    }
+    FreeLoadedFile(&file);
+    return 0;
+}
+
+static uint8_t* shell_net_tftp_reserve(void* context, uint32_t size) {
+    uint8_t** buf = (uint8_t**)context;
+    if (*buf) {
+        FreePool(*buf);
+    }
+    *buf = (uint8_t*)AllocatePool(size ? size : 1);
+    return *buf;
+}
+
+// TFTP has no per-block hook: the file is downloaded whole, then written
+static int shell_net_fetch_tftp(const char* url, shell_net_fetch_t* fetch) {
+    char server[64];
+    const char* path = url;
+    const char* server_arg = NULL;
+    uint8_t* buf = NULL;
+    pxe_sink_t sink = { shell_net_tftp_reserve, &buf };
+    uint8_t* data = NULL;
+    uint32_t size = 0;
+    int status = 0;
+
+    if (strncmp(url, "tftp://", 7) == 0) {
+        const char* slash = strchr(url + 7, '/');
+        size_t len = slash ? (size_t)(slash - (url + 7)) : 0;
+        if (!slash || len == 0 || len >= sizeof(server)) {
+            printf("Usage: fetch tftp://server/path <dest>\n");
+            return -1;
+        }
+        memcpy(server, url + 7, len);
+        server[len] = 0;
+        server_arg = server;
+        path = slash + 1;
+    }
+    if (pxe_network_init() != 0) {
+        printf("Network unavailable\n");
+        return -1;
+    }
+    if (pxe_download(server_arg, path, &sink, 0, &data, &size) != 0) {
+        printf("%s: download failed\n", url);
+        status = -1;
+    }
+
+    uint64_t start = bh_get_performance_counter();
+    for (uint32_t pos = 0; status == 0 && pos < size; pos += SHELL_NET_WRITE_CHUNK) {
+        uint32_t len = size - pos < SHELL_NET_WRITE_CHUNK ? size - pos : SHELL_NET_WRITE_CHUNK;
+        if (shell_net_write(fetch->handle, data + pos, len) != 0) {
+            printf("Write failed at offset %u\n", (unsigned)pos);
+            status = -1;
+        }
+        fetch->bytes = pos + len;
+    }
+    fetch->write_ticks = bh_get_performance_counter() - start;
+
+    if (buf) {
+        FreePool(buf);
+    }
+    return status;
+}
+
+int shell_cmd_fetch(int argc, char** argv) {
+    CHAR16 name[128];
+    shell_net_fetch_t fetch = { NULL, 0, 0 };
+    size_t i;
+
+    if (argc < 3) {
+        printf("Usage: fetch <http(s)://... | tftp://server/path | path> <dest>\n");
+        return -1;
+    }
+    const char* dest = argv[2];
+    // The boot volume takes backslashes
+    for (i = 0; dest[i] && i < sizeof(name) / sizeof(name[0]) - 1; i++) {
+        name[i] = dest[i] == '/' ? L'\\' : (CHAR16)dest[i];
+    }
+    if (dest[i]) {
+        printf("%s: name too long\n", dest);
+        return -1;
+    }
+    name[i] = 0;
+
+    if (EFI_ERROR(CreateBootFile(name, &fetch.handle))) {
+        printf("%s: cannot create on the boot volume\n", dest);
+        return -1;
+    }
+
+    const char* url = argv[1];
+    bool http = strncmp(url, "http://", 7) == 0 || strncmp(url, "https://", 8) == 0;
+    uint64_t start = bh_get_performance_counter();
+    int status = http ? shell_net_fetch_http(url, &fetch) : shell_net_fetch_tftp(url, &fetch);
+    if (status != 0 || EFI_ERROR(fetch.handle->Flush(fetch.handle))) {
+        // No partial file left behind; Delete also closes the handle
+        fetch.handle->Delete(fetch.handle);
+        return -1;
+    }
+    fetch.handle->Close(fetch.handle);
+    uint64_t total = bh_get_performance_counter() - start;
+
+    printf("%llu bytes", (unsigned long long)fetch.bytes);
+    shell_net_print_rate(" in ", fetch.bytes, total);
+    shell_net_print_rate(" (writing ", fetch.bytes, fetch.write_ticks);
+    printf(")\n");
+    return 0;
+}
@@ -7,6 +7,19 @@
 
 #ifndef BLOODHORN_SHELL_NET_H
 #define BLOODHORN_SHELL_NET_H
-int shell_cmd_ping(const char* host, char* out, int maxlen);
-int shell_cmd_ifconfig(char* out, int maxlen);
-#endif 
\ No newline at end of file
+
+// Largest subnet sweep takes, as a prefix length (/22 = 1022 hosts)
+#define SHELL_NET_SWEEP_MIN_PREFIX  22
+
+// ping [-c N] <a.b.c.d>: N echo requests a second apart, then loss and
+// min/avg/max/jitter of the round trips
+int shell_cmd_ping(int argc, char** argv);
+// sweep <a.b.c.d/prefix>: one echo request to every host of the subnet,
+// all in flight together, and the hosts that answered
+int shell_cmd_sweep(int argc, char** argv);
+// ifconfig: the DHCP lease and every NIC discovery ran on
+int shell_cmd_ifconfig(int argc, char** argv);
+// fetch <url> <dest>: download http://, https:// or tftp://server/path
+// (a bare path comes from the boot server) to a boot volume file
+int shell_cmd_fetch(int argc, char** argv);
+#endif
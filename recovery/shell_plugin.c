@@ -0,0 +1,198 @@
+/*
+ * shell_plugin.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <Uefi.h>
+#include "compat.h"
+#include <Library/UefiLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiRuntimeServicesTableLib.h>
+#include <Protocol/LoadedImage.h>
+#include "../boot/plugin.h"
+#include "shell.h"
+
+// Entry point of BloodHornShell.efi (plugins\shell.efi). The shell sources
+// are the same as when they were linked into the loader: every loader
+// service they call is defined here under its own name and forwarded
+// through the core protocol of the image that started us.
+EFI_GUID gBloodHornCoreProtocolGuid = BLOODHORN_CORE_PROTOCOL_GUID;
+STATIC BLOODHORN_CORE_PROTOCOL *mCore;
+
+EFI_STATUS CreateBootFile(IN CONST CHAR16 *FileName, OUT EFI_FILE_PROTOCOL **Handle) {
+    return mCore->CreateBootFile(FileName, Handle);
+}
+
+EFI_STATUS WriteBootFile(IN CONST CHAR16 *FileName, IN CONST VOID *Buffer, IN UINTN Size) {
+    return mCore->WriteBootFile(FileName, Buffer, Size);
+}
+
+EFI_STATUS LoadHttpFile(IN CONST CHAR16 *Url, IN UINT32 Flags, IN FILE_LOAD_CHUNK_CALLBACK Callback OPTIONAL,
+                        IN VOID *Context OPTIONAL, OUT LOADED_FILE *File) {
+    return mCore->LoadHttpFile(Url, Flags, Callback, Context, File);
+}
+
+VOID FreeLoadedFile(IN OUT LOADED_FILE *File) {
+    mCore->FreeLoadedFile(File);
+}
+
+EFI_STATUS GetOpenBlockDevice(IN UINTN Index, OUT struct block_device **Device) {
+    return mCore->GetOpenBlockDevice(Index, Device);
+}
+
+EFI_STATUS IcmpEchoSweep(IN CONST UINT32 *Targets, IN UINTN Count, IN UINT16 Sequence, IN UINT32 TimeoutMs,
+                         OUT UINT32 *RttUs) {
+    return mCore->IcmpEchoSweep(Targets, Count, Sequence, TimeoutMs, RttUs);
+}
+
+EFI_STATUS InstallBootProfiler(IN BOOLEAN Enable) {
+    return mCore->InstallBootProfiler(Enable);
+}
+
+VOID BootProfilerReset(VOID) {
+    mCore->BootProfilerReset();
+}
+
+VOID BootProfilerPrint(IN UINTN Top) {
+    mCore->BootProfilerPrint(Top);
+}
+
+EFI_STATUS BootProfilerSave(IN CONST CHAR16 *FileName) {
+    return mCore->BootProfilerSave(FileName);
+}
+
+VOID AllocProfilerPrint(IN UINTN Top) {
+    mCore->AllocProfilerPrint(Top);
+}
+
+EFI_STATUS AllocProfilerSave(IN CONST CHAR16 *FileName) {
+    return mCore->AllocProfilerSave(FileName);
+}
+
+fs_file_t *fs_open(const char *path) {
+    return mCore->fs_open(path);
+}
+
+int fs_file_read(fs_file_t *file, uint8_t *buf, uint32_t size) {
+    return mCore->fs_file_read(file, buf, size);
+}
+
+int fs_file_pread(fs_file_t *file, uint8_t *buf, uint32_t size, uint32_t offset) {
+    return mCore->fs_file_pread(file, buf, size, offset);
+}
+
+uint32_t fs_file_size(const fs_file_t *file) {
+    return mCore->fs_file_size(file);
+}
+
+void fs_close(fs_file_t *file) {
+    mCore->fs_close(file);
+}
+
+int fs_list_dir(const char *path, char *buffer, uint32_t size) {
+    return mCore->fs_list_dir(path, buffer, size);
+}
+
+int blockdev_read_raw(block_device_t *dev, uint64_t sector, uint32_t count, void *buf) {
+    return mCore->blockdev_read_raw(dev, sector, count, buf);
+}
+
+void blockdev_print_stats(void) {
+    mCore->blockdev_print_stats();
+}
+
+const part_table_t *part_table_get(block_device_t *dev) {
+    return mCore->part_table_get(dev);
+}
+
+void part_guid_format(const uint8_t *guid, char *out) {
+    mCore->part_guid_format(guid, out);
+}
+
+int pxe_network_init(void) {
+    return mCore->pxe_network_init();
+}
+
+struct pxe_network_info *pxe_get_network_info(void) {
+    return mCore->pxe_get_network_info();
+}
+
+int pxe_get_nics(const pxe_nic_t **nics) {
+    return mCore->pxe_get_nics(nics);
+}
+
+int pxe_download(const char *server, const char *path, const pxe_sink_t *sink, uint32_t default_size,
+                 uint8_t **data, uint32_t *size) {
+    return mCore->pxe_download(server, path, sink, default_size, data, size);
+}
+
+bh_uint64_t bh_get_performance_frequency(void) {
+    return mCore->bh_get_performance_frequency();
+}
+
+bh_uint64_t bh_get_performance_counter(void) {
+    return mCore->bh_get_performance_counter();
+}
+
+bh_uint64_t bh_ticks_to_nanoseconds(bh_uint64_t ticks) {
+    return mCore->bh_ticks_to_nanoseconds(ticks);
+}
+
+bh_uint64_t bh_nanoseconds_to_ticks(bh_uint64_t nanoseconds) {
+    return mCore->bh_nanoseconds_to_ticks(nanoseconds);
+}
+
+bh_status_t bh_sleep_microseconds(bh_uint64_t microseconds) {
+    return mCore->bh_sleep_microseconds(microseconds);
+}
+
+void bh_perf_print_counters(void) {
+    mCore->bh_perf_print_counters();
+}
+
+void bh_trace_reset(void) {
+    mCore->bh_trace_reset();
+}
+
+void bh_trace_print(void) {
+    mCore->bh_trace_print();
+}
+
+bh_status_t bh_trace_export_chrome_json(char *buffer, bh_size_t buffer_size, bh_size_t *written) {
+    return mCore->bh_trace_export_chrome_json(buffer, buffer_size, written);
+}
+
+// The shell's "reboot"
+void system_reboot(void) {
+    gRT->ResetSystem(EfiResetCold, EFI_SUCCESS, 0, NULL);
+}
+
+EFI_STATUS
+EFIAPI
+ShellPluginMain(
+    IN EFI_HANDLE        ImageHandle,
+    IN EFI_SYSTEM_TABLE  *SystemTable
+) {
+    EFI_LOADED_IMAGE_PROTOCOL *LoadedImage = NULL;
+    EFI_STATUS Status;
+
+    // Only from the loader that started us: started from the firmware shell
+    // or a boot option, there are no mounts or disks to work on
+    Status = gBS->HandleProtocol(ImageHandle, &gEfiLoadedImageProtocolGuid, (VOID **)&LoadedImage);
+    if (!EFI_ERROR(Status)) {
+        Status = gBS->HandleProtocol(LoadedImage->ParentHandle, &gBloodHornCoreProtocolGuid, (VOID **)&mCore);
+    }
+    if (EFI_ERROR(Status)) {
+        Print(L"The recovery shell is started by BloodHorn.\n");
+        return EFI_UNSUPPORTED;
+    }
+    if (mCore->Revision != BLOODHORN_CORE_PROTOCOL_REVISION) {
+        Print(L"Recovery shell built for core revision %u, loader has %u.\n",
+              BLOODHORN_CORE_PROTOCOL_REVISION, mCore->Revision);
+        return EFI_INCOMPATIBLE_VERSION;
+    }
+
+    return shell_start();
+}
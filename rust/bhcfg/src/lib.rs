@@ -1,7 +1,14 @@
 #![no_std]
 
+use core::ffi::CStr;
+
 /// Tiny no_std key=value parser for boot config-style files.
 /// Lines like `key = value` or `key=value`. Comments starting with `#`.
+///
+/// `Parser` walks a whole INI or JSON file the same way: one pass, each
+/// key/value pair handed out as slices of the original buffer, no
+/// allocations. It follows config/config_parse.c, so C and Rust accept
+/// exactly the same files.
 
 pub struct Line<'a> {
     pub key: &'a str,
@@ -42,3 +49,404 @@ fn trim_ws(s: &str) -> &str {
 fn is_ws(b: u8) -> bool {
     matches!(b, b' ' | b'\t' | b'\n' | b'\r')
 }
+
+/// Nested JSON objects and arrays beyond this depth are an error.
+pub const MAX_DEPTH: usize = 32;
+
+#[derive(Clone, Copy, PartialEq, Eq)]
+pub enum Format {
+    Ini,
+    Json,
+}
+
+/// One key/value pair. JSON string values exclude their quotes and keep
+/// any escapes (`escaped` is set then).
+#[derive(Clone, Copy)]
+pub struct Entry<'a> {
+    /// INI `[section]` or the key of the enclosing JSON object; empty at
+    /// top level
+    pub section: &'a [u8],
+    pub key: &'a [u8],
+    pub value: &'a [u8],
+    pub escaped: bool,
+    pub line: u32,
+}
+
+#[derive(Clone, Copy, PartialEq, Eq, Debug)]
+pub enum ErrorKind {
+    ControlCharacter,
+    ControlCharacterInString,
+    UnterminatedSection,
+    EmptyKey,
+    ExpectedObject,
+    ExpectedString,
+    ExpectedColon,
+    ExpectedValue,
+    ExpectedCommaOrBrace,
+    ExpectedCommaOrBracket,
+    InvalidEscape,
+    UnterminatedString,
+    TooDeep,
+    TrailingData,
+    TooLarge,
+}
+
+impl ErrorKind {
+    /// The wording config_parse.c reports for the same fault, terminated so
+    /// it can be handed to C as is
+    pub fn message(self) -> &'static CStr {
+        match self {
+            ErrorKind::ControlCharacter => c"control character",
+            ErrorKind::ControlCharacterInString => c"control character in string",
+            ErrorKind::UnterminatedSection => c"unterminated section header",
+            ErrorKind::EmptyKey => c"empty key",
+            ErrorKind::ExpectedObject => c"expected '{'",
+            ErrorKind::ExpectedString => c"expected string",
+            ErrorKind::ExpectedColon => c"expected ':'",
+            ErrorKind::ExpectedValue => c"expected value",
+            ErrorKind::ExpectedCommaOrBrace => c"expected ',' or '}'",
+            ErrorKind::ExpectedCommaOrBracket => c"expected ',' or ']'",
+            ErrorKind::InvalidEscape => c"invalid escape",
+            ErrorKind::UnterminatedString => c"unterminated string",
+            ErrorKind::TooDeep => c"nesting too deep",
+            ErrorKind::TrailingData => c"trailing data",
+            ErrorKind::TooLarge => c"file too large",
+        }
+    }
+}
+
+#[derive(Clone, Copy, Debug)]
+pub struct Error {
+    pub line: u32,
+    pub kind: ErrorKind,
+}
+
+// A byte range of the buffer, kept small so the parser state stays a fixed
+// few hundred bytes that C can hold without knowing its layout
+#[derive(Clone, Copy)]
+struct Span {
+    start: u32,
+    len: u32,
+}
+
+const NO_SPAN: Span = Span { start: 0, len: 0 };
+
+#[derive(Clone, Copy)]
+struct Frame {
+    section: Span,      // Key that named this object
+    array: bool,
+    emit: bool,         // Members are entries (not inside an array)
+}
+
+#[derive(Clone, Copy, PartialEq, Eq)]
+enum State {
+    Start,
+    ObjectFirst,        // After '{'
+    ObjectKey,          // After ','
+    ArrayFirst,         // After '['
+    ArrayValue,
+    AfterValue,
+    Done,
+}
+
+/// Iterator over the entries of a file. It stops after the first error,
+/// which it yields as `Err`.
+pub struct Parser<'a> {
+    buf: &'a [u8],
+    pos: usize,
+    line: u32,
+    format: Format,
+    state: State,
+    section: Span,      // Current INI section
+    depth: usize,
+    stack: [Frame; MAX_DEPTH],
+}
+
+impl<'a> Parser<'a> {
+    pub fn new(buf: &'a [u8], format: Format) -> Self {
+        Parser {
+            buf,
+            pos: 0,
+            line: 1,
+            format,
+            state: State::Start,
+            section: NO_SPAN,
+            depth: 0,
+            stack: [Frame { section: NO_SPAN, array: false, emit: false }; MAX_DEPTH],
+        }
+    }
+
+    fn view(&self, span: Span) -> &'a [u8] {
+        &self.buf[span.start as usize..(span.start + span.len) as usize]
+    }
+
+    fn span(start: usize, end: usize) -> Span {
+        Span { start: start as u32, len: (end - start) as u32 }
+    }
+
+    fn fail(&mut self, kind: ErrorKind) -> Option<Result<Entry<'a>, Error>> {
+        self.state = State::Done;
+        Some(Err(Error { line: self.line, kind }))
+    }
+
+    fn entry(&self, section: Span, key: Span, value: Span, escaped: bool) -> Option<Result<Entry<'a>, Error>> {
+        Some(Ok(Entry {
+            section: self.view(section),
+            key: self.view(key),
+            value: self.view(value),
+            escaped,
+            line: self.line,
+        }))
+    }
+
+    fn next_ini(&mut self) -> Option<Result<Entry<'a>, Error>> {
+        while self.pos < self.buf.len() {
+            let start = self.pos;
+            let mut eq = None;
+            while self.pos < self.buf.len() && self.buf[self.pos] != b'\n' {
+                let c = self.buf[self.pos];
+                if (c < 0x20 && c != b'\t' && c != b'\r') || c == 0x7F {
+                    return self.fail(ErrorKind::ControlCharacter);
+                }
+                if c == b'=' && eq.is_none() {
+                    eq = Some(self.pos);
+                }
+                self.pos += 1;
+            }
+            let (ls, le) = trim(self.buf, start, self.pos);
+            let mut found = None;
+
+            if ls == le || self.buf[ls] == b'#' || self.buf[ls] == b';' {
+                // Blank or comment
+            } else if self.buf[ls] == b'[' {
+                match self.buf[ls..le].iter().position(|&b| b == b']') {
+                    Some(rb) => {
+                        let (ss, se) = trim(self.buf, ls + 1, ls + rb);
+                        self.section = Self::span(ss, se);
+                    }
+                    None => return self.fail(ErrorKind::UnterminatedSection),
+                }
+            } else if let Some(eq) = eq {
+                let (ks, ke) = trim(self.buf, ls, eq);
+                let (vs, ve) = trim(self.buf, eq + 1, le);
+                if ks == ke {
+                    return self.fail(ErrorKind::EmptyKey);
+                }
+                found = self.entry(self.section, Self::span(ks, ke), Self::span(vs, ve), false);
+            }
+
+            if self.pos < self.buf.len() {
+                self.pos += 1;
+                self.line += 1;
+            }
+            if found.is_some() {
+                return found;
+            }
+        }
+        self.state = State::Done;
+        None
+    }
+
+    fn skip_space(&mut self) {
+        while self.pos < self.buf.len() {
+            match self.buf[self.pos] {
+                b'\n' => self.line += 1,
+                b' ' | b'\t' | b'\r' => {}
+                _ => break,
+            }
+            self.pos += 1;
+        }
+    }
+
+    fn peek(&self) -> Option<u8> {
+        self.buf.get(self.pos).copied()
+    }
+
+    // A string token; the span excludes the quotes
+    fn string(&mut self) -> Result<(Span, bool), ErrorKind> {
+        if self.peek() != Some(b'"') {
+            return Err(ErrorKind::ExpectedString);
+        }
+        self.pos += 1;
+        let start = self.pos;
+        let mut escaped = false;
+        while self.pos < self.buf.len() && self.buf[self.pos] != b'"' {
+            let c = self.buf[self.pos];
+            if c < 0x20 {
+                return Err(ErrorKind::ControlCharacterInString);
+            }
+            if c == b'\\' {
+                match self.buf.get(self.pos + 1) {
+                    Some(b'"' | b'\\' | b'/' | b'b' | b'f' | b'n' | b'r' | b't' | b'u') => {}
+                    _ => return Err(ErrorKind::InvalidEscape),
+                }
+                escaped = true;
+                self.pos += 1;
+            }
+            self.pos += 1;
+        }
+        if self.pos >= self.buf.len() {
+            return Err(ErrorKind::UnterminatedString);
+        }
+        let span = Self::span(start, self.pos);
+        self.pos += 1;
+        Ok((span, escaped))
+    }
+
+    fn push(&mut self, section: Span, array: bool, emit: bool) -> Result<(), ErrorKind> {
+        if self.depth >= MAX_DEPTH {
+            return Err(ErrorKind::TooDeep);
+        }
+        self.stack[self.depth] = Frame { section, array, emit };
+        self.depth += 1;
+        self.state = if array { State::ArrayFirst } else { State::ObjectFirst };
+        Ok(())
+    }
+
+    // A value under `key` in the innermost container; Some for an entry
+    fn value(&mut self, key: Span) -> Result<Option<(Span, Span, bool)>, ErrorKind> {
+        let top = self.stack[self.depth - 1];
+        let emit = top.emit && !top.array;
+        match self.peek() {
+            None => Err(ErrorKind::ExpectedValue),
+            // A nested object's members belong to the section named by its key
+            Some(b'{') => {
+                self.pos += 1;
+                self.push(key, false, emit).map(|_| None)
+            }
+            // Arrays are checked but their elements are not entries
+            Some(b'[') => {
+                self.pos += 1;
+                self.push(NO_SPAN, true, false).map(|_| None)
+            }
+            Some(b'"') => {
+                let (value, escaped) = self.string()?;
+                self.state = State::AfterValue;
+                Ok(if emit { Some((top.section, value, escaped)) } else { None })
+            }
+            Some(_) => {
+                // Numbers and the true/false/null literals
+                let start = self.pos;
+                while let Some(c) = self.peek() {
+                    if !(c.is_ascii_digit() || c.is_ascii_lowercase() || matches!(c, b'-' | b'+' | b'.' | b'E')) {
+                        break;
+                    }
+                    self.pos += 1;
+                }
+                if self.pos == start {
+                    return Err(ErrorKind::ExpectedValue);
+                }
+                self.state = State::AfterValue;
+                Ok(if emit { Some((top.section, Self::span(start, self.pos), false)) } else { None })
+            }
+        }
+    }
+
+    fn step_json(&mut self) -> Result<Option<Entry<'a>>, ErrorKind> {
+        self.skip_space();
+        match self.state {
+            State::Start => {
+                if self.peek() != Some(b'{') {
+                    return Err(ErrorKind::ExpectedObject);
+                }
+                self.pos += 1;
+                self.push(NO_SPAN, false, true)?;
+            }
+            State::ObjectFirst if self.peek() == Some(b'}') => {
+                self.pos += 1;
+                self.depth -= 1;
+                self.state = State::AfterValue;
+            }
+            State::ObjectFirst | State::ObjectKey => {
+                let (key, _) = self.string()?;
+                self.skip_space();
+                if self.peek() != Some(b':') {
+                    return Err(ErrorKind::ExpectedColon);
+                }
+                self.pos += 1;
+                self.skip_space();
+                if let Some((section, value, escaped)) = self.value(key)? {
+                    return Ok(Some(Entry {
+                        section: self.view(section),
+                        key: self.view(key),
+                        value: self.view(value),
+                        escaped,
+                        line: self.line,
+                    }));
+                }
+            }
+            State::ArrayFirst if self.peek() == Some(b']') => {
+                self.pos += 1;
+                self.depth -= 1;
+                self.state = State::AfterValue;
+            }
+            State::ArrayFirst | State::ArrayValue => {
+                self.value(NO_SPAN)?;
+            }
+            State::AfterValue if self.depth == 0 => {
+                // Tolerate a trailing NUL from text loaded into a terminated buffer
+                if self.pos < self.buf.len() && self.buf[self.pos] != 0 {
+                    return Err(ErrorKind::TrailingData);
+                }
+                self.state = State::Done;
+            }
+            State::AfterValue => {
+                let array = self.stack[self.depth - 1].array;
+                match self.peek() {
+                    Some(b',') => {
+                        self.pos += 1;
+                        self.state = if array { State::ArrayValue } else { State::ObjectKey };
+                    }
+                    Some(b'}') if !array => {
+                        self.pos += 1;
+                        self.depth -= 1;
+                    }
+                    Some(b']') if array => {
+                        self.pos += 1;
+                        self.depth -= 1;
+                    }
+                    _ if array => return Err(ErrorKind::ExpectedCommaOrBracket),
+                    _ => return Err(ErrorKind::ExpectedCommaOrBrace),
+                }
+            }
+            State::Done => {}
+        }
+        Ok(None)
+    }
+
+    fn next_json(&mut self) -> Option<Result<Entry<'a>, Error>> {
+        while self.state != State::Done {
+            match self.step_json() {
+                Ok(Some(entry)) => return Some(Ok(entry)),
+                Ok(None) => {}
+                Err(kind) => return self.fail(kind),
+            }
+        }
+        None
+    }
+}
+
+impl<'a> Iterator for Parser<'a> {
+    type Item = Result<Entry<'a>, Error>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        if self.state == State::Done {
+            return None;
+        }
+        // Spans are 32-bit
+        if self.buf.len() > u32::MAX as usize {
+            return self.fail(ErrorKind::TooLarge);
+        }
+        match self.format {
+            Format::Ini => self.next_ini(),
+            Format::Json => self.next_json(),
+        }
+    }
+}
+
+// Blanks around [start, end) are spaces, tabs and carriage returns
+fn trim(buf: &[u8], mut start: usize, mut end: usize) -> (usize, usize) {
+    while start < end && matches!(buf[start], b' ' | b'\t' | b'\r') { start += 1; }
+    while end > start && matches!(buf[end - 1], b' ' | b'\t' | b'\r') { end -= 1; }
+    (start, end)
+}
@@ -13,6 +13,17 @@ pub enum Level {
 }
 
 impl Level {
+    /// The matching `bh_debug_level_t`; debug is BH_DEBUG_LEVEL_VERBOSE.
+    pub fn as_c(self) -> u32 {
+        match self {
+            Level::Error => 1,
+            Level::Warn  => 2,
+            Level::Info  => 3,
+            Level::Debug => 4,
+            Level::Trace => 5,
+        }
+    }
+
     fn as_str(self) -> &'static str {
         match self {
             Level::Trace => "TRACE",
@@ -93,3 +104,62 @@ impl<const N: usize> Logger for BufferLogger<N> {
         let _ = write!(self, "[{}] {}\n", level.as_str(), msg);
     }
 }
+
+/// `bh_debug_category_t` bits, for `RingLogger`.
+pub mod category {
+    pub const GENERAL: u32     = 0x0000_0001;
+    pub const MEMORY: u32      = 0x0000_0002;
+    pub const FILESYSTEM: u32  = 0x0000_0010;
+    pub const BOOT: u32        = 0x0000_0080;
+    pub const NETWORK: u32     = 0x0000_0200;
+    pub const SECURITY: u32    = 0x0000_0400;
+}
+
+extern "C" {
+    // boot/libb/debug.c
+    fn bh_debug_write(level: u32, category: u32, text: *const u8, length: usize);
+}
+
+// Longest formatted message; more is cut off
+const RING_LINE: usize = 256;
+
+struct LineBuf {
+    buf: [u8; RING_LINE],
+    len: usize,
+}
+
+impl Write for LineBuf {
+    fn write_str(&mut self, s: &str) -> fmt::Result {
+        let take = s.len().min(RING_LINE - self.len);
+        self.buf[self.len..self.len + take].copy_from_slice(&s.as_bytes()[..take]);
+        self.len += take;
+        Ok(())
+    }
+}
+
+/// Logger that writes into the C debug ring (`bh_debug_write`), so Rust and
+/// C messages share one timeline, the same filters, and the boot log handed
+/// to the OS. Only usable where `boot/libb/debug.c` is linked in.
+#[derive(Copy, Clone)]
+pub struct RingLogger {
+    category: u32,
+}
+
+impl RingLogger {
+    pub const fn new(category: u32) -> Self {
+        Self { category }
+    }
+
+    /// Format `args` on the stack and log it as one message.
+    pub fn log_fmt(&self, level: Level, args: fmt::Arguments) {
+        let mut line = LineBuf { buf: [0; RING_LINE], len: 0 };
+        let _ = line.write_fmt(args);
+        unsafe { bh_debug_write(level.as_c(), self.category, line.buf.as_ptr(), line.len) };
+    }
+}
+
+impl Logger for RingLogger {
+    fn log(&mut self, level: Level, msg: &str) {
+        unsafe { bh_debug_write(level.as_c(), self.category, msg.as_ptr(), msg.len()) };
+    }
+}
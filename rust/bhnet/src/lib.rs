@@ -8,20 +8,77 @@ pub struct Mac(pub [u8; 6]);
 #[derive(Copy, Clone, Debug, Eq, PartialEq)]
 pub struct Ipv4(pub [u8; 4]);
 
-/// RFC 1071 style 16-bit checksum.
-pub fn checksum16(mut sum: u32, bytes: &[u8]) -> u16 {
-    let mut i = 0;
-    while i + 1 < bytes.len() {
-        let word = ((bytes[i] as u32) << 8) | (bytes[i + 1] as u32);
-        sum = sum.wrapping_add(word);
-        i += 2;
+pub mod view;
+
+/// Running RFC 1071 one's-complement sum over any number of pieces, the
+/// same algorithm as `net_csum_*` in net/net_utils.c. The sum does not
+/// depend on byte order (RFC 1071 section 2), so data is added as native
+/// 32-bit words into four independent 64-bit lanes, which the compiler
+/// turns into vector adds; only the folded result is put into network
+/// order. Odd-length pieces are fine.
+#[derive(Copy, Clone, Debug, Default)]
+pub struct Checksum {
+    sum: u64,
+    len: u64,
+}
+
+impl Checksum {
+    pub const fn new() -> Self {
+        Self { sum: 0, len: 0 }
     }
-    if i < bytes.len() {
-        let word = (bytes[i] as u32) << 8;
-        sum = sum.wrapping_add(word);
+
+    pub fn add(&mut self, bytes: &[u8]) {
+        // Each lane takes one word per 16 bytes: no overflow below 64 GiB
+        let mut lanes = [0u64; 4];
+        let mut blocks = bytes.chunks_exact(16);
+        for b in &mut blocks {
+            for (i, lane) in lanes.iter_mut().enumerate() {
+                *lane += u32::from_ne_bytes([b[4 * i], b[4 * i + 1], b[4 * i + 2], b[4 * i + 3]]) as u64;
+            }
+        }
+        let mut acc = add_carry(add_carry(lanes[0], lanes[1]), add_carry(lanes[2], lanes[3]));
+
+        let mut words = blocks.remainder().chunks_exact(4);
+        for w in &mut words {
+            acc = add_carry(acc, u32::from_ne_bytes([w[0], w[1], w[2], w[3]]) as u64);
+        }
+        let rest = words.remainder();
+        let mut last = [0u8; 4];
+        last[..rest.len()].copy_from_slice(rest);
+        acc = add_carry(acc, u32::from_ne_bytes(last) as u64);
+
+        // A piece starting at an odd offset has every byte in the other
+        // half of its 16-bit word
+        let mut folded = u16::from_be(fold(acc));
+        if self.len & 1 == 1 {
+            folded = folded.swap_bytes();
+        }
+        self.sum = add_carry(self.sum, folded as u64);
+        self.len += bytes.len() as u64;
     }
-    while (sum >> 16) != 0 {
-        sum = (sum & 0xFFFF) + (sum >> 16);
+
+    /// The checksum field value, in host order.
+    pub fn finish(&self) -> u16 {
+        !fold(self.sum)
     }
-    !(sum as u16)
+}
+
+fn add_carry(a: u64, b: u64) -> u64 {
+    let (s, carry) = a.overflowing_add(b);
+    s + carry as u64
+}
+
+fn fold(mut sum: u64) -> u16 {
+    sum = (sum & 0xFFFF_FFFF) + (sum >> 32);
+    sum = (sum & 0xFFFF_FFFF) + (sum >> 32);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum as u16
+}
+
+/// RFC 1071 style 16-bit checksum of `bytes`, starting from `sum`.
+pub fn checksum16(sum: u32, bytes: &[u8]) -> u16 {
+    let mut csum = Checksum { sum: sum as u64, len: 0 };
+    csum.add(bytes);
+    csum.finish()
 }
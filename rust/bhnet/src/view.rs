@@ -0,0 +1,304 @@
+//! Zero-copy header views over receive buffers. `parse` checks everything
+//! the accessors rely on (lengths, versions, and the IPv4 and ICMP
+//! checksums), so the accessors index without further checks and a view
+//! never reads outside the packet. Payloads are trimmed to the length the
+//! header states, which drops Ethernet padding.
+
+use crate::{Checksum, Ipv4, Mac};
+
+pub const ETHERTYPE_IPV4: u16 = 0x0800;
+pub const ETHERTYPE_ARP: u16 = 0x0806;
+
+pub const IP_PROTO_ICMP: u8 = 1;
+pub const IP_PROTO_UDP: u8 = 17;
+
+fn be16(b: &[u8], at: usize) -> u16 {
+    u16::from_be_bytes([b[at], b[at + 1]])
+}
+
+fn mac(b: &[u8], at: usize) -> Mac {
+    let mut m = [0u8; 6];
+    m.copy_from_slice(&b[at..at + 6]);
+    Mac(m)
+}
+
+fn ipv4(b: &[u8], at: usize) -> Ipv4 {
+    Ipv4([b[at], b[at + 1], b[at + 2], b[at + 3]])
+}
+
+/// Ethernet II frame without a VLAN tag.
+#[derive(Copy, Clone)]
+pub struct Ethernet<'a> {
+    buf: &'a [u8],
+}
+
+impl<'a> Ethernet<'a> {
+    pub const HEADER: usize = 14;
+
+    pub fn parse(buf: &'a [u8]) -> Option<Self> {
+        (buf.len() >= Self::HEADER).then_some(Self { buf })
+    }
+
+    pub fn destination(&self) -> Mac { mac(self.buf, 0) }
+    pub fn source(&self) -> Mac { mac(self.buf, 6) }
+    pub fn ethertype(&self) -> u16 { be16(self.buf, 12) }
+    pub fn payload(&self) -> &'a [u8] { &self.buf[Self::HEADER..] }
+}
+
+/// ARP for IPv4 over Ethernet (RFC 826).
+#[derive(Copy, Clone)]
+pub struct Arp<'a> {
+    buf: &'a [u8],
+}
+
+impl<'a> Arp<'a> {
+    pub const LEN: usize = 28;
+    pub const OP_REQUEST: u16 = 1;
+    pub const OP_REPLY: u16 = 2;
+
+    pub fn parse(buf: &'a [u8]) -> Option<Self> {
+        if buf.len() < Self::LEN || be16(buf, 0) != 1 || be16(buf, 2) != ETHERTYPE_IPV4 || buf[4] != 6 || buf[5] != 4 {
+            return None;
+        }
+        Some(Self { buf })
+    }
+
+    pub fn op(&self) -> u16 { be16(self.buf, 6) }
+    pub fn sender_mac(&self) -> Mac { mac(self.buf, 8) }
+    pub fn sender_ip(&self) -> Ipv4 { ipv4(self.buf, 14) }
+    pub fn target_mac(&self) -> Mac { mac(self.buf, 18) }
+    pub fn target_ip(&self) -> Ipv4 { ipv4(self.buf, 24) }
+}
+
+/// IPv4 header and payload; the header checksum is verified.
+#[derive(Copy, Clone)]
+pub struct Ipv4Packet<'a> {
+    buf: &'a [u8],
+    header: usize,
+}
+
+impl<'a> Ipv4Packet<'a> {
+    pub fn parse(buf: &'a [u8]) -> Option<Self> {
+        if buf.len() < 20 || buf[0] >> 4 != 4 {
+            return None;
+        }
+        let header = (buf[0] & 0x0F) as usize * 4;
+        let total = be16(buf, 2) as usize;
+        if header < 20 || total < header || total > buf.len() {
+            return None;
+        }
+        let mut csum = Checksum::new();
+        csum.add(&buf[..header]);
+        if csum.finish() != 0 {
+            return None;
+        }
+        Some(Self { buf: &buf[..total], header })
+    }
+
+    pub fn ttl(&self) -> u8 { self.buf[8] }
+    pub fn protocol(&self) -> u8 { self.buf[9] }
+    pub fn source(&self) -> Ipv4 { ipv4(self.buf, 12) }
+    pub fn destination(&self) -> Ipv4 { ipv4(self.buf, 16) }
+    pub fn options(&self) -> &'a [u8] { &self.buf[20..self.header] }
+    pub fn payload(&self) -> &'a [u8] { &self.buf[self.header..] }
+
+    /// More fragments follow, or this is not the first one: the payload
+    /// is not the whole datagram.
+    pub fn is_fragment(&self) -> bool {
+        be16(self.buf, 6) & 0x3FFF != 0
+    }
+}
+
+/// UDP header and payload.
+#[derive(Copy, Clone)]
+pub struct Udp<'a> {
+    buf: &'a [u8],
+}
+
+impl<'a> Udp<'a> {
+    pub const HEADER: usize = 8;
+
+    pub fn parse(buf: &'a [u8]) -> Option<Self> {
+        if buf.len() < Self::HEADER {
+            return None;
+        }
+        let len = be16(buf, 4) as usize;
+        if len < Self::HEADER || len > buf.len() {
+            return None;
+        }
+        Some(Self { buf: &buf[..len] })
+    }
+
+    pub fn source_port(&self) -> u16 { be16(self.buf, 0) }
+    pub fn destination_port(&self) -> u16 { be16(self.buf, 2) }
+    pub fn payload(&self) -> &'a [u8] { &self.buf[Self::HEADER..] }
+
+    /// Check the checksum against the IPv4 pseudo-header. A zero field
+    /// means the sender did not compute one.
+    pub fn checksum_ok(&self, source: Ipv4, destination: Ipv4) -> bool {
+        if be16(self.buf, 6) == 0 {
+            return true;
+        }
+        let len = (self.buf.len() as u16).to_be_bytes();
+        let mut csum = Checksum::new();
+        csum.add(&source.0);
+        csum.add(&destination.0);
+        csum.add(&[0, IP_PROTO_UDP, len[0], len[1]]);
+        csum.add(self.buf);
+        csum.finish() == 0
+    }
+}
+
+/// ICMP message; the checksum is verified.
+#[derive(Copy, Clone)]
+pub struct Icmp<'a> {
+    buf: &'a [u8],
+}
+
+impl<'a> Icmp<'a> {
+    pub const HEADER: usize = 8;
+    pub const ECHO_REPLY: u8 = 0;
+    pub const ECHO_REQUEST: u8 = 8;
+
+    pub fn parse(buf: &'a [u8]) -> Option<Self> {
+        if buf.len() < Self::HEADER {
+            return None;
+        }
+        let mut csum = Checksum::new();
+        csum.add(buf);
+        (csum.finish() == 0).then_some(Self { buf })
+    }
+
+    pub fn typ(&self) -> u8 { self.buf[0] }
+    pub fn code(&self) -> u8 { self.buf[1] }
+    /// Echo identifier and sequence number.
+    pub fn identifier(&self) -> u16 { be16(self.buf, 4) }
+    pub fn sequence(&self) -> u16 { be16(self.buf, 6) }
+    pub fn payload(&self) -> &'a [u8] { &self.buf[Self::HEADER..] }
+}
+
+/// The TFTP packets a client receives (RFC 1350, RFC 2347).
+#[derive(Copy, Clone)]
+pub enum Tftp<'a> {
+    Data { block: u16, data: &'a [u8] },
+    Ack { block: u16 },
+    /// The message runs up to its NUL, or the end of the packet.
+    Error { code: u16, message: &'a [u8] },
+    /// NUL-terminated name/value pairs.
+    Oack { options: &'a [u8] },
+}
+
+impl<'a> Tftp<'a> {
+    pub const OP_DATA: u16 = 3;
+    pub const OP_ACK: u16 = 4;
+    pub const OP_ERROR: u16 = 5;
+    pub const OP_OACK: u16 = 6;
+
+    pub fn parse(buf: &'a [u8]) -> Option<Self> {
+        if buf.len() < 2 {
+            return None;
+        }
+        match be16(buf, 0) {
+            Self::OP_DATA if buf.len() >= 4 => Some(Tftp::Data { block: be16(buf, 2), data: &buf[4..] }),
+            Self::OP_ACK if buf.len() >= 4 => Some(Tftp::Ack { block: be16(buf, 2) }),
+            Self::OP_ERROR if buf.len() >= 4 => {
+                let text = &buf[4..];
+                let end = text.iter().position(|&c| c == 0).unwrap_or(text.len());
+                Some(Tftp::Error { code: be16(buf, 2), message: &text[..end] })
+            }
+            Self::OP_OACK if buf[buf.len() - 1] == 0 => Some(Tftp::Oack { options: &buf[2..] }),
+            _ => None,
+        }
+    }
+}
+
+/// BOOTP/DHCP message (RFC 2131) with the options magic cookie checked.
+#[derive(Copy, Clone)]
+pub struct Dhcp<'a> {
+    buf: &'a [u8],
+}
+
+impl<'a> Dhcp<'a> {
+    pub const HEADER: usize = 240;
+    pub const BOOTREQUEST: u8 = 1;
+    pub const BOOTREPLY: u8 = 2;
+    const MAGIC: [u8; 4] = [99, 130, 83, 99];
+
+    pub fn parse(buf: &'a [u8]) -> Option<Self> {
+        (buf.len() >= Self::HEADER && buf[236..240] == Self::MAGIC).then_some(Self { buf })
+    }
+
+    pub fn op(&self) -> u8 { self.buf[0] }
+    /// Transaction ID as sent, in network order.
+    pub fn xid(&self) -> [u8; 4] { [self.buf[4], self.buf[5], self.buf[6], self.buf[7]] }
+    pub fn yiaddr(&self) -> Ipv4 { ipv4(self.buf, 16) }
+    pub fn siaddr(&self) -> Ipv4 { ipv4(self.buf, 20) }
+    pub fn chaddr(&self) -> Mac { mac(self.buf, 28) }
+    pub fn sname(&self) -> &'a [u8] { &self.buf[44..108] }
+    pub fn file(&self) -> &'a [u8] { &self.buf[108..236] }
+    /// The option area, up to the end of the packet.
+    pub fn option_bytes(&self) -> &'a [u8] { &self.buf[Self::HEADER..] }
+    pub fn options(&self) -> DhcpOptions<'a> { DhcpOptions::new(self.option_bytes()) }
+}
+
+/// One option: code and value.
+#[derive(Copy, Clone)]
+pub struct DhcpOption<'a> {
+    pub code: u8,
+    pub value: &'a [u8],
+}
+
+/// Iterator over code/length/value options, as in a DHCP message or the
+/// PXE vendor option (43). Pad (0) is skipped; it ends at End (255) or at
+/// an option running past the buffer.
+#[derive(Copy, Clone)]
+pub struct DhcpOptions<'a> {
+    buf: &'a [u8],
+    at: usize,
+}
+
+impl<'a> DhcpOptions<'a> {
+    pub const PAD: u8 = 0;
+    pub const END: u8 = 255;
+
+    pub fn new(buf: &'a [u8]) -> Self {
+        Self { buf, at: 0 }
+    }
+
+    /// Bytes consumed so far, to resume with `resume`.
+    pub fn offset(&self) -> usize {
+        self.at
+    }
+
+    pub fn resume(buf: &'a [u8], at: usize) -> Self {
+        Self { buf, at: at.min(buf.len()) }
+    }
+}
+
+impl<'a> Iterator for DhcpOptions<'a> {
+    type Item = DhcpOption<'a>;
+
+    fn next(&mut self) -> Option<DhcpOption<'a>> {
+        loop {
+            let code = *self.buf.get(self.at)?;
+            if code == Self::END {
+                self.at = self.buf.len();
+                return None;
+            }
+            if code == Self::PAD {
+                self.at += 1;
+                continue;
+            }
+            let len = match self.buf.get(self.at + 1) {
+                Some(&len) if self.at + 2 + len as usize <= self.buf.len() => len as usize,
+                _ => {
+                    self.at = self.buf.len();
+                    return None;
+                }
+            };
+            let value = &self.buf[self.at + 2..self.at + 2 + len];
+            self.at += 2 + len;
+            return Some(DhcpOption { code, value });
+        }
+    }
+}
@@ -1,6 +1,7 @@
 #ifndef BHSHIM_H
 #define BHSHIM_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <bloodhorn/bloodhorn.h>
 
@@ -37,6 +38,157 @@ bhshim_get_memory_map_adapter(
     BHSHIM_FREE FreeFn
 );
 
+// Page allocator (rust/bhshim/src/pages.rs). Regions are claimed as
+// EfiLoaderData from the largest conventional descriptor on first use, 8 MiB
+// at a time, and pages come out of a bitmap. Rust crates in the shim use it
+// as their global allocator.
+
+// Claim Pages pages at Address from the firmware; 0 on success
+typedef INT32 (*BHSHIM_CLAIM_PAGES)(UINT64 Address, UINTN Pages);
+
+// Record the services regions are claimed with; reserves nothing yet
+int32_t
+bhshim_pages_setup(
+    BHSHIM_UEFI_GET_MEMORY_MAP GetMemoryMap,
+    BHSHIM_ALLOC Alloc,
+    BHSHIM_FREE FreeFn,
+    BHSHIM_CLAIM_PAGES Claim
+);
+
+// Pages pages aligned to Align bytes (a power of two; below a page means a
+// page), or 0 when nothing fits
+uint64_t
+bhshim_pages_alloc(
+    size_t Pages,
+    uint64_t Align
+);
+
+// BH_SUCCESS, or BH_INVALID_PARAMETER for pages not from bhshim_pages_alloc
+int32_t
+bhshim_pages_free(
+    uint64_t Address,
+    size_t Pages
+);
+
+// Set up the page allocator on boot services (rust/bhshim_glue.c)
+VOID
+bhshim_pages_init(VOID);
+
+// Zero-copy INI/JSON parser (rust/bhcfg), iterated from C. It accepts the
+// same files as config_parse.c and reports the same errors; entries are
+// views into the caller's buffer and nothing is allocated.
+
+#define BHSHIM_CFG_END      0
+#define BHSHIM_CFG_ENTRY    1
+#define BHSHIM_CFG_ERROR    (-1)
+
+// Same layouts as config_sv and config_entry
+typedef struct {
+    const char *ptr;
+    size_t len;
+} bhshim_cfg_view_t;
+
+typedef struct {
+    bhshim_cfg_view_t section;  // INI [section] or enclosing JSON object key; empty at top level
+    bhshim_cfg_view_t key;
+    bhshim_cfg_view_t value;    // JSON strings without quotes, escapes kept
+    int escaped;
+    uint32_t line;
+} bhshim_cfg_entry_t;
+
+// Parser state, opaque to C; declare it on the stack
+typedef struct {
+    uint64_t opaque[64];
+} bhshim_cfg_iter_t;
+
+typedef struct {
+    uint32_t line;
+    const char *what;
+} bhshim_cfg_error_t;
+
+// Start on Len bytes of Buf, as JSON when Json is nonzero, else INI. Buf
+// must outlive the iterator. Returns BH_SUCCESS or BH_INVALID_PARAMETER.
+int32_t
+bhshim_cfg_begin(
+    bhshim_cfg_iter_t *Iter,
+    const void *Buf,
+    size_t Len,
+    int32_t Json
+);
+
+// BHSHIM_CFG_ENTRY with *Entry filled, BHSHIM_CFG_END after the last entry,
+// or BHSHIM_CFG_ERROR with *Err (optional) set; it then stays ended
+int32_t
+bhshim_cfg_next(
+    bhshim_cfg_iter_t *Iter,
+    bhshim_cfg_entry_t *Entry,
+    bhshim_cfg_error_t *Err
+);
+
+// Packet parsing (rust/bhnet views) for net/. Results point into the
+// caller's buffer.
+
+#define BHSHIM_DHCP_END     0
+#define BHSHIM_DHCP_OPTION  1
+
+typedef struct {
+    const uint8_t *buf;
+    size_t len;
+    size_t at;
+} bhshim_dhcp_iter_t;
+
+typedef struct {
+    uint8_t code;
+    uint8_t len;
+    const uint8_t *value;
+} bhshim_dhcp_option_t;
+
+// Options of the DHCP message in Buf; BH_INVALID_PARAMETER when it is
+// shorter than the BOOTP header or lacks the magic cookie
+int32_t
+bhshim_dhcp_begin(
+    bhshim_dhcp_iter_t *Iter,
+    const uint8_t *Buf,
+    size_t Len
+);
+
+// Options of a bare option area, such as the PXE vendor option (43)
+int32_t
+bhshim_dhcp_options_begin(
+    bhshim_dhcp_iter_t *Iter,
+    const uint8_t *Buf,
+    size_t Len
+);
+
+// BHSHIM_DHCP_OPTION with *Option set, or BHSHIM_DHCP_END at End (255),
+// the end of the buffer or an option running past it. Pad is skipped.
+int32_t
+bhshim_dhcp_next(
+    bhshim_dhcp_iter_t *Iter,
+    bhshim_dhcp_option_t *Option
+);
+
+// Block number and data of a TFTP DATA packet; BH_INVALID_PARAMETER for
+// any other packet
+int32_t
+bhshim_tftp_data(
+    const uint8_t *Buf,
+    size_t Len,
+    uint16_t *Block,
+    const uint8_t **Data,
+    size_t *DataLen
+);
+
+// BH_SUCCESS with the sender's MAC in Mac (6 bytes) when the Ethernet
+// frame is an ARP reply from Ip (4 bytes, network order)
+int32_t
+bhshim_arp_reply(
+    const uint8_t *Frame,
+    size_t Len,
+    const uint8_t *Ip,
+    uint8_t *Mac
+);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,100 @@
+//! C iterator over bhcfg's INI/JSON parser. The parser state lives in a
+//! caller-provided, fixed-size `BhCfgIter`, and entries are views into the
+//! caller's buffer, so nothing is allocated on either side.
+
+use core::ffi::c_char;
+use core::mem::{align_of, size_of};
+
+use bhcfg::{Format, Parser};
+
+pub const BHSHIM_CFG_END: i32 = 0;
+pub const BHSHIM_CFG_ENTRY: i32 = 1;
+pub const BHSHIM_CFG_ERROR: i32 = -1;
+
+// Mirrors bhshim_cfg_view_t; same layout as config_sv
+#[repr(C)]
+pub struct BhCfgView {
+    pub ptr: *const u8,
+    pub len: usize,
+}
+
+// Mirrors bhshim_cfg_entry_t; same layout as config_entry
+#[repr(C)]
+pub struct BhCfgEntry {
+    pub section: BhCfgView,
+    pub key: BhCfgView,
+    pub value: BhCfgView,
+    pub escaped: i32,
+    pub line: u32,
+}
+
+// Mirrors bhshim_cfg_iter_t: opaque storage for a Parser
+#[repr(C)]
+pub struct BhCfgIter {
+    opaque: [u64; 64],
+}
+
+// Mirrors bhshim_cfg_error_t
+#[repr(C)]
+pub struct BhCfgError {
+    pub line: u32,
+    pub what: *const c_char,
+}
+
+const _: () = assert!(size_of::<Parser<'static>>() <= size_of::<BhCfgIter>());
+const _: () = assert!(align_of::<Parser<'static>>() <= align_of::<BhCfgIter>());
+
+fn view(bytes: &[u8]) -> BhCfgView {
+    BhCfgView { ptr: bytes.as_ptr(), len: bytes.len() }
+}
+
+/// Start iterating over `len` bytes at `buf` as JSON (`json` nonzero) or
+/// INI. The buffer must stay valid and unchanged while the iterator is used.
+#[no_mangle]
+pub extern "C" fn bhshim_cfg_begin(iter: *mut BhCfgIter, buf: *const u8, len: usize, json: i32) -> i32 {
+    if iter.is_null() || (buf.is_null() && len != 0) {
+        return crate::status::BH_INVALID_PARAMETER;
+    }
+    let bytes: &'static [u8] = if len == 0 {
+        &[]
+    } else {
+        unsafe { core::slice::from_raw_parts(buf, len) }
+    };
+    let format = if json != 0 { Format::Json } else { Format::Ini };
+    unsafe { (iter as *mut Parser<'static>).write(Parser::new(bytes, format)) };
+    crate::status::BH_SUCCESS
+}
+
+/// Next entry of the file: BHSHIM_CFG_ENTRY with `entry` filled in,
+/// BHSHIM_CFG_END after the last one, or BHSHIM_CFG_ERROR with `err` (if
+/// not NULL) naming the fault. An iterator that ended or failed stays so.
+#[no_mangle]
+pub extern "C" fn bhshim_cfg_next(iter: *mut BhCfgIter, entry: *mut BhCfgEntry, err: *mut BhCfgError) -> i32 {
+    if iter.is_null() || entry.is_null() {
+        return BHSHIM_CFG_ERROR;
+    }
+    let parser = unsafe { &mut *(iter as *mut Parser<'static>) };
+    match parser.next() {
+        None => BHSHIM_CFG_END,
+        Some(Ok(e)) => {
+            unsafe {
+                *entry = BhCfgEntry {
+                    section: view(e.section),
+                    key: view(e.key),
+                    value: view(e.value),
+                    escaped: e.escaped as i32,
+                    line: e.line,
+                };
+            }
+            BHSHIM_CFG_ENTRY
+        }
+        Some(Err(e)) => {
+            if !err.is_null() {
+                unsafe {
+                    *err = BhCfgError { line: e.line, what: e.kind.message().as_ptr() };
+                }
+            }
+            BHSHIM_CFG_ERROR
+        }
+    }
+}
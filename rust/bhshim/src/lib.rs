@@ -3,14 +3,22 @@
 mod status;
 mod uefi;
 mod mem;
+mod cfg;
+mod pages;
+mod net;
 
 use core::ffi::c_void;
+use core::panic::PanicInfo;
 use core::ptr::null_mut;
 
 use crate::status::{EFI_SUCCESS, EFI_BUFFER_TOO_SMALL};
 use crate::uefi::{EfiMemoryDescriptor, UefiGetMemoryMapFn};
 use crate::mem::{AllocFn as BhAllocFn, FreeFn as BhFreeFn, PAGE_SIZE_4K};
 
+use bhlog::{category, Level, RingLogger};
+
+const LOG: RingLogger = RingLogger::new(category::MEMORY);
+
 // These layouts mirror BloodHorn's bh_memory_descriptor_t from bloodhorn.h.
 
 #[repr(C)]
@@ -58,6 +66,7 @@ pub extern "C" fn bhshim_get_memory_map_adapter(
     };
 
     if status != EFI_BUFFER_TOO_SMALL {
+        LOG.log_fmt(Level::Error, format_args!("memory map: size query failed ({:#x})", status));
         return status;
     }
 
@@ -66,6 +75,7 @@ pub extern "C" fn bhshim_get_memory_map_adapter(
 
     let buffer = alloc(map_size);
     if buffer.is_null() {
+        LOG.log_fmt(Level::Error, format_args!("memory map: no memory for {} bytes", map_size));
         // BH_OUT_OF_RESOURCES (-4)
         return -4;
     }
@@ -81,6 +91,7 @@ pub extern "C" fn bhshim_get_memory_map_adapter(
     };
 
     if status != EFI_SUCCESS {
+        LOG.log_fmt(Level::Error, format_args!("memory map: GetMemoryMap failed ({:#x})", status));
         unsafe { free_fn(buffer); }
         return status;
     }
@@ -142,3 +153,14 @@ pub extern "C" fn bhshim_get_memory_map_adapter(
 
     EFI_SUCCESS
 }
+
+// Rust crates linked into the shim allocate whole pages from its regions
+#[global_allocator]
+static ALLOCATOR: pages::PageAllocator = pages::PageAllocator;
+
+// The shim is the one staticlib linked into the firmware, so it provides
+// the handler for itself and the crates it pulls in (bhcfg, bhlog, bhnet)
+#[panic_handler]
+fn panic(_info: &PanicInfo) -> ! {
+    loop {}
+}
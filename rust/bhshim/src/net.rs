@@ -0,0 +1,127 @@
+//! C entry points to bhnet's packet views for the parsers in net/: DHCP
+//! options, TFTP DATA and ARP replies. Values are views into the caller's
+//! buffer.
+
+use bhnet::view::{Arp, Dhcp, DhcpOptions, Ethernet, Tftp, ETHERTYPE_ARP};
+
+use crate::status::{BhStatus, BH_INVALID_PARAMETER, BH_SUCCESS};
+
+pub const BHSHIM_DHCP_END: i32 = 0;
+pub const BHSHIM_DHCP_OPTION: i32 = 1;
+
+// Mirrors bhshim_dhcp_iter_t
+#[repr(C)]
+pub struct BhDhcpIter {
+    buf: *const u8,
+    len: usize,
+    at: usize,
+}
+
+// Mirrors bhshim_dhcp_option_t
+#[repr(C)]
+pub struct BhDhcpOption {
+    pub code: u8,
+    pub len: u8,
+    pub value: *const u8,
+}
+
+unsafe fn bytes<'a>(buf: *const u8, len: usize) -> Option<&'a [u8]> {
+    match (buf.is_null(), len) {
+        (_, 0) => Some(&[]),
+        (true, _) => None,
+        (false, _) => Some(core::slice::from_raw_parts(buf, len)),
+    }
+}
+
+fn begin(iter: *mut BhDhcpIter, options: &[u8]) -> BhStatus {
+    unsafe { *iter = BhDhcpIter { buf: options.as_ptr(), len: options.len(), at: 0 } };
+    BH_SUCCESS
+}
+
+/// Iterate over the options of the DHCP message in `buf`, once its length
+/// and magic cookie check out.
+#[no_mangle]
+pub extern "C" fn bhshim_dhcp_begin(iter: *mut BhDhcpIter, buf: *const u8, len: usize) -> BhStatus {
+    match unsafe { bytes(buf, len) }.and_then(Dhcp::parse) {
+        Some(msg) if !iter.is_null() => begin(iter, msg.option_bytes()),
+        _ => BH_INVALID_PARAMETER,
+    }
+}
+
+/// Iterate over a bare option area, such as the PXE vendor option.
+#[no_mangle]
+pub extern "C" fn bhshim_dhcp_options_begin(iter: *mut BhDhcpIter, buf: *const u8, len: usize) -> BhStatus {
+    match unsafe { bytes(buf, len) } {
+        Some(options) if !iter.is_null() => begin(iter, options),
+        _ => BH_INVALID_PARAMETER,
+    }
+}
+
+/// BHSHIM_DHCP_OPTION with `option` filled in, or BHSHIM_DHCP_END.
+#[no_mangle]
+pub extern "C" fn bhshim_dhcp_next(iter: *mut BhDhcpIter, option: *mut BhDhcpOption) -> i32 {
+    if iter.is_null() || option.is_null() {
+        return BHSHIM_DHCP_END;
+    }
+    let it = unsafe { &mut *iter };
+    let Some(buf) = (unsafe { bytes(it.buf, it.len) }) else {
+        return BHSHIM_DHCP_END;
+    };
+    let mut options = DhcpOptions::resume(buf, it.at);
+    let next = options.next();
+    it.at = options.offset();
+    match next {
+        Some(o) => {
+            unsafe { *option = BhDhcpOption { code: o.code, len: o.value.len() as u8, value: o.value.as_ptr() } };
+            BHSHIM_DHCP_OPTION
+        }
+        None => BHSHIM_DHCP_END,
+    }
+}
+
+/// Block number and data of a TFTP DATA packet.
+#[no_mangle]
+pub extern "C" fn bhshim_tftp_data(
+    buf: *const u8,
+    len: usize,
+    block: *mut u16,
+    data: *mut *const u8,
+    data_len: *mut usize,
+) -> BhStatus {
+    if block.is_null() || data.is_null() || data_len.is_null() {
+        return BH_INVALID_PARAMETER;
+    }
+    match unsafe { bytes(buf, len) }.and_then(Tftp::parse) {
+        Some(Tftp::Data { block: b, data: d }) => {
+            unsafe {
+                *block = b;
+                *data = d.as_ptr();
+                *data_len = d.len();
+            }
+            BH_SUCCESS
+        }
+        _ => BH_INVALID_PARAMETER,
+    }
+}
+
+/// BH_SUCCESS with the sender's MAC in `mac` when the Ethernet frame is an
+/// ARP reply from `ip` (4 bytes).
+#[no_mangle]
+pub extern "C" fn bhshim_arp_reply(frame: *const u8, len: usize, ip: *const u8, mac: *mut u8) -> BhStatus {
+    if ip.is_null() || mac.is_null() {
+        return BH_INVALID_PARAMETER;
+    }
+    let ip = unsafe { core::slice::from_raw_parts(ip, 4) };
+    let reply = unsafe { bytes(frame, len) }
+        .and_then(Ethernet::parse)
+        .filter(|eth| eth.ethertype() == ETHERTYPE_ARP)
+        .and_then(|eth| Arp::parse(eth.payload()))
+        .filter(|arp| arp.op() == Arp::OP_REPLY && arp.sender_ip().0 == ip);
+    match reply {
+        Some(arp) => {
+            unsafe { core::ptr::copy_nonoverlapping(arp.sender_mac().0.as_ptr(), mac, 6) };
+            BH_SUCCESS
+        }
+        None => BH_INVALID_PARAMETER,
+    }
+}
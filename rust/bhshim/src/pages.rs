@@ -0,0 +1,331 @@
+//! Page allocator over regions claimed from the firmware memory map. A
+//! region is reserved from the largest conventional descriptor the first
+//! time it is needed (and again only when every region is full), and its
+//! pages are handed out from a bitmap kept in the region's own head pages.
+//! A set bit is a free page; runs are found by scanning whole words.
+
+use core::alloc::{GlobalAlloc, Layout};
+use core::cell::UnsafeCell;
+use core::ffi::c_void;
+use core::ptr::null_mut;
+use core::sync::atomic::{AtomicBool, Ordering};
+
+use crate::mem::{AllocFn, FreeFn, PAGE_SIZE_4K};
+use crate::status::{BhStatus, BH_INVALID_PARAMETER, BH_SUCCESS, EFI_SUCCESS};
+use crate::uefi::UefiGetMemoryMapFn;
+use crate::BhMemoryDescriptor;
+
+/// Claims `pages` pages at a fixed address from the firmware; 0 on success.
+pub type ClaimFn = extern "C" fn(u64, usize) -> i32;
+
+const MAX_REGIONS: usize = 8;
+// Pages per region unless one request needs more (8 MiB)
+const REGION_PAGES: usize = 2048;
+const EFI_CONVENTIONAL_MEMORY: u32 = 7;
+// Low memory stays for real-mode trampolines and the like
+const REGION_MIN_ADDRESS: u64 = 0x10_0000;
+
+#[derive(Copy, Clone)]
+struct Region {
+    base: u64,
+    pages: usize,
+    map: *mut u64,
+    free: usize,
+}
+
+struct Pages {
+    regions: [Region; MAX_REGIONS],
+    count: usize,
+    get_memory_map: Option<UefiGetMemoryMapFn>,
+    alloc: Option<AllocFn>,
+    free: Option<FreeFn>,
+    claim: Option<ClaimFn>,
+}
+
+struct Locked {
+    busy: AtomicBool,
+    pages: UnsafeCell<Pages>,
+}
+
+// Boot services run on one CPU; the flag only guards against reentry
+unsafe impl Sync for Locked {}
+
+static PAGES: Locked = Locked {
+    busy: AtomicBool::new(false),
+    pages: UnsafeCell::new(Pages {
+        regions: [Region { base: 0, pages: 0, map: null_mut(), free: 0 }; MAX_REGIONS],
+        count: 0,
+        get_memory_map: None,
+        alloc: None,
+        free: None,
+        claim: None,
+    }),
+};
+
+fn with_pages<R>(f: impl FnOnce(&mut Pages) -> R) -> R {
+    while PAGES.busy.swap(true, Ordering::Acquire) {
+        core::hint::spin_loop();
+    }
+    let r = f(unsafe { &mut *PAGES.pages.get() });
+    PAGES.busy.store(false, Ordering::Release);
+    r
+}
+
+fn words(pages: usize) -> usize {
+    (pages + 63) / 64
+}
+
+fn map_pages(pages: usize) -> usize {
+    (words(pages) * 8 + PAGE_SIZE_4K - 1) / PAGE_SIZE_4K
+}
+
+// Bit i of the result is set where bits i..i+n of v are all set (n >= 1)
+fn runs(v: u128, n: usize) -> u128 {
+    let mut r = v;
+    let mut len = 1;
+    while len < n {
+        let s = (n - len).min(len);
+        r &= r >> s;
+        len += s;
+    }
+    r
+}
+
+impl Region {
+    fn map(&self) -> &[u64] {
+        unsafe { core::slice::from_raw_parts(self.map, words(self.pages)) }
+    }
+
+    fn map_mut(&mut self) -> &mut [u64] {
+        unsafe { core::slice::from_raw_parts_mut(self.map, words(self.pages)) }
+    }
+
+    // Runs of up to 64 pages aligned to at most 64: each word is taken with
+    // the next, so a run may cross into it, and every start in the word is
+    // tested at once
+    fn find_short(&self, n: usize, align: usize) -> Option<usize> {
+        let map = self.map();
+        let first = (self.base / PAGE_SIZE_4K as u64) as usize;
+        let pattern = if align == 64 { 1 } else { u64::MAX / ((1u64 << align) - 1) };
+
+        for w in 0..map.len() {
+            if map[w] == 0 {
+                continue;
+            }
+            let next = if w + 1 < map.len() { map[w + 1] } else { 0 };
+            let starts = runs(map[w] as u128 | (next as u128) << 64, n) as u64;
+            let skew = (align - (first + w * 64) % align) % align;
+            let hits = starts & (pattern << skew);
+            if hits != 0 {
+                return Some(w * 64 + hits.trailing_zeros() as usize);
+            }
+        }
+        None
+    }
+
+    // Anything else: one pass over the free runs, word by word
+    fn find_long(&self, n: usize, align: usize) -> Option<usize> {
+        let first = (self.base / PAGE_SIZE_4K as u64) as usize;
+        let fit = |start: usize, len: usize| {
+            let at = (first + start + align - 1) / align * align - first;
+            if at + n <= start + len { Some(at) } else { None }
+        };
+        let (mut start, mut len) = (0, 0);
+
+        for (w, &word) in self.map().iter().enumerate() {
+            let mut bit = 0;
+            while bit < 64 {
+                let rest = word >> bit;
+                if rest & 1 == 0 {
+                    len = 0;
+                    if rest == 0 {
+                        break;
+                    }
+                    bit += rest.trailing_zeros() as usize;
+                    continue;
+                }
+                let ones = rest.trailing_ones() as usize;
+                if len == 0 {
+                    start = w * 64 + bit;
+                }
+                len += ones;
+                if let Some(at) = fit(start, len) {
+                    return Some(at);
+                }
+                bit += ones;
+            }
+        }
+        None
+    }
+
+    fn set(&mut self, index: usize, n: usize, free: bool) {
+        let map = self.map_mut();
+        let (mut i, end) = (index, index + n);
+        while i < end {
+            let take = (64 - i % 64).min(end - i);
+            let mask = if take == 64 { u64::MAX } else { ((1u64 << take) - 1) << (i % 64) };
+            if free {
+                map[i / 64] |= mask;
+            } else {
+                map[i / 64] &= !mask;
+            }
+            i += take;
+        }
+    }
+
+    fn take(&mut self, n: usize, align: usize) -> Option<u64> {
+        if self.free < n {
+            return None;
+        }
+        let index = if n <= 64 && align <= 64 {
+            self.find_short(n, align)
+        } else {
+            self.find_long(n, align)
+        }?;
+        self.set(index, n, false);
+        self.free -= n;
+        Some(self.base + (index * PAGE_SIZE_4K) as u64)
+    }
+}
+
+impl Pages {
+    // Claim a new region big enough for n pages at the given alignment,
+    // from the largest conventional descriptor of a fresh memory map
+    fn grow(&mut self, n: usize, align: usize) -> Option<usize> {
+        let (get_memory_map, alloc, free, claim) = (self.get_memory_map?, self.alloc?, self.free?, self.claim?);
+        if self.count == MAX_REGIONS {
+            return None;
+        }
+        let want = REGION_PAGES.max(n + align + map_pages(n + align) + 1);
+
+        let mut map: *mut BhMemoryDescriptor = null_mut();
+        let (mut count, mut size) = (0u32, 0u32);
+        if crate::bhshim_get_memory_map_adapter(&mut map, &mut count, &mut size, get_memory_map, alloc, free) != EFI_SUCCESS {
+            return None;
+        }
+        let mut best: Option<(u64, u64)> = None;
+        for i in 0..count as usize {
+            let d = unsafe { &*map.add(i) };
+            let start = d.base_address.max(REGION_MIN_ADDRESS);
+            let end = d.base_address + d.length as u64;
+            if d.typ == EFI_CONVENTIONAL_MEMORY && end > start && best.map_or(true, |(s, e)| end - start > e - s) {
+                best = Some((start, end));
+            }
+        }
+        if !map.is_null() {
+            free(map as *mut c_void);
+        }
+
+        let (start, end) = best?;
+        let bytes = (want * PAGE_SIZE_4K) as u64;
+        if end - start < bytes {
+            return None;
+        }
+        // The top of the descriptor, leaving its low end to the loaders
+        let base = (end - bytes) & !(PAGE_SIZE_4K as u64 - 1);
+        if base < start || claim(base, want) != 0 {
+            return None;
+        }
+
+        let mut region = Region { base, pages: want, map: base as *mut u64, free: 0 };
+        let head = map_pages(want);
+        region.map_mut().fill(0);
+        region.set(head, want - head, true);
+        region.free = want - head;
+        self.regions[self.count] = region;
+        self.count += 1;
+        Some(self.count - 1)
+    }
+
+    fn alloc(&mut self, n: usize, align: usize) -> Option<u64> {
+        for r in self.regions[..self.count].iter_mut() {
+            if let Some(address) = r.take(n, align) {
+                return Some(address);
+            }
+        }
+        let i = self.grow(n, align)?;
+        self.regions[i].take(n, align)
+    }
+
+    fn release(&mut self, address: u64, n: usize) -> bool {
+        for r in self.regions[..self.count].iter_mut() {
+            let end = r.base + (r.pages * PAGE_SIZE_4K) as u64;
+            if address >= r.base && address < end {
+                let index = ((address - r.base) / PAGE_SIZE_4K as u64) as usize;
+                if address % PAGE_SIZE_4K as u64 != 0 || index < map_pages(r.pages) || n > r.pages - index {
+                    return false;
+                }
+                r.set(index, n, true);
+                r.free += n;
+                return true;
+            }
+        }
+        false
+    }
+}
+
+// Pages and page alignment of a byte request; None for bad alignment
+fn page_request(bytes: usize, align: usize) -> Option<(usize, usize)> {
+    if bytes == 0 || !align.is_power_of_two() {
+        return None;
+    }
+    let n = bytes.checked_add(PAGE_SIZE_4K - 1)? / PAGE_SIZE_4K;
+    Some((n, (align / PAGE_SIZE_4K).max(1)))
+}
+
+/// `GlobalAlloc` for the Rust crates linked into the shim; every
+/// allocation takes whole pages.
+pub struct PageAllocator;
+
+unsafe impl GlobalAlloc for PageAllocator {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        match page_request(layout.size(), layout.align()) {
+            Some((n, align)) => with_pages(|p| p.alloc(n, align)).map_or(null_mut(), |a| a as *mut u8),
+            None => null_mut(),
+        }
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        if let Some((n, _)) = page_request(layout.size(), layout.align()) {
+            with_pages(|p| p.release(ptr as u64, n));
+        }
+    }
+}
+
+/// Hand the allocator the firmware services it reserves regions with.
+/// Nothing is reserved until the first allocation.
+#[no_mangle]
+pub extern "C" fn bhshim_pages_setup(
+    uefi_get_memory_map: UefiGetMemoryMapFn,
+    alloc: AllocFn,
+    free_fn: FreeFn,
+    claim: ClaimFn,
+) -> BhStatus {
+    with_pages(|p| {
+        p.get_memory_map = Some(uefi_get_memory_map);
+        p.alloc = Some(alloc);
+        p.free = Some(free_fn);
+        p.claim = Some(claim);
+    });
+    BH_SUCCESS
+}
+
+/// `pages` pages aligned to `align` bytes (a power of two; 0 or less than
+/// a page means a page), or 0 when nothing fits.
+#[no_mangle]
+pub extern "C" fn bhshim_pages_alloc(pages: usize, align: u64) -> u64 {
+    let align = (align as usize).max(PAGE_SIZE_4K);
+    match pages.checked_mul(PAGE_SIZE_4K).and_then(|bytes| page_request(bytes, align)) {
+        Some((n, align)) => with_pages(|p| p.alloc(n, align)).unwrap_or(0),
+        None => 0,
+    }
+}
+
+/// Return pages from bhshim_pages_alloc.
+#[no_mangle]
+pub extern "C" fn bhshim_pages_free(address: u64, pages: usize) -> BhStatus {
+    if pages == 0 {
+        return BH_SUCCESS;
+    }
+    if with_pages(|p| p.release(address, pages)) { BH_SUCCESS } else { BH_INVALID_PARAMETER }
+}
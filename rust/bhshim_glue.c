@@ -51,3 +51,31 @@ bhshim_get_memory_map(
 
     return BH_SUCCESS;
 }
+
+STATIC
+INT32
+bhshim_claim_pages(
+    UINT64 Address,
+    UINTN Pages
+)
+{
+    EFI_PHYSICAL_ADDRESS Base = Address;
+
+    return EFI_ERROR(gBS->AllocatePages(AllocateAddress, EfiLoaderData, Pages, &Base)) ? -1 : 0;
+}
+
+// The allocator claims its regions through the firmware on first use;
+// setting it up costs nothing when no one allocates.
+VOID
+bhshim_pages_init(VOID)
+{
+    if (gBS == NULL) {
+        return;
+    }
+    bhshim_pages_setup(
+        (BHSHIM_UEFI_GET_MEMORY_MAP)gBS->GetMemoryMap,
+        (BHSHIM_ALLOC)AllocatePool,
+        (BHSHIM_FREE)FreePool,
+        bhshim_claim_pages
+    );
+}
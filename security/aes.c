@@ -56,10 +56,98 @@ static const uint8_t aes_rcon[11] = {
     0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36
 };
 
+
+// Encryption T-table: S-box output times the MixColumns column
+// {02, 01, 01, 03}. The other three tables are byte rotations of it.
+static const uint32_t aes_te0[256] = {
+    0xc66363a5, 0xf87c7c84, 0xee777799, 0xf67b7b8d, 0xfff2f20d, 0xd66b6bbd, 0xde6f6fb1, 0x91c5c554,
+    0x60303050, 0x02010103, 0xce6767a9, 0x562b2b7d, 0xe7fefe19, 0xb5d7d762, 0x4dababe6, 0xec76769a,
+    0x8fcaca45, 0x1f82829d, 0x89c9c940, 0xfa7d7d87, 0xeffafa15, 0xb25959eb, 0x8e4747c9, 0xfbf0f00b,
+    0x41adadec, 0xb3d4d467, 0x5fa2a2fd, 0x45afafea, 0x239c9cbf, 0x53a4a4f7, 0xe4727296, 0x9bc0c05b,
+    0x75b7b7c2, 0xe1fdfd1c, 0x3d9393ae, 0x4c26266a, 0x6c36365a, 0x7e3f3f41, 0xf5f7f702, 0x83cccc4f,
+    0x6834345c, 0x51a5a5f4, 0xd1e5e534, 0xf9f1f108, 0xe2717193, 0xabd8d873, 0x62313153, 0x2a15153f,
+    0x0804040c, 0x95c7c752, 0x46232365, 0x9dc3c35e, 0x30181828, 0x379696a1, 0x0a05050f, 0x2f9a9ab5,
+    0x0e070709, 0x24121236, 0x1b80809b, 0xdfe2e23d, 0xcdebeb26, 0x4e272769, 0x7fb2b2cd, 0xea75759f,
+    0x1209091b, 0x1d83839e, 0x582c2c74, 0x341a1a2e, 0x361b1b2d, 0xdc6e6eb2, 0xb45a5aee, 0x5ba0a0fb,
+    0xa45252f6, 0x763b3b4d, 0xb7d6d661, 0x7db3b3ce, 0x5229297b, 0xdde3e33e, 0x5e2f2f71, 0x13848497,
+    0xa65353f5, 0xb9d1d168, 0x00000000, 0xc1eded2c, 0x40202060, 0xe3fcfc1f, 0x79b1b1c8, 0xb65b5bed,
+    0xd46a6abe, 0x8dcbcb46, 0x67bebed9, 0x7239394b, 0x944a4ade, 0x984c4cd4, 0xb05858e8, 0x85cfcf4a,
+    0xbbd0d06b, 0xc5efef2a, 0x4faaaae5, 0xedfbfb16, 0x864343c5, 0x9a4d4dd7, 0x66333355, 0x11858594,
+    0x8a4545cf, 0xe9f9f910, 0x04020206, 0xfe7f7f81, 0xa05050f0, 0x783c3c44, 0x259f9fba, 0x4ba8a8e3,
+    0xa25151f3, 0x5da3a3fe, 0x804040c0, 0x058f8f8a, 0x3f9292ad, 0x219d9dbc, 0x70383848, 0xf1f5f504,
+    0x63bcbcdf, 0x77b6b6c1, 0xafdada75, 0x42212163, 0x20101030, 0xe5ffff1a, 0xfdf3f30e, 0xbfd2d26d,
+    0x81cdcd4c, 0x180c0c14, 0x26131335, 0xc3ecec2f, 0xbe5f5fe1, 0x359797a2, 0x884444cc, 0x2e171739,
+    0x93c4c457, 0x55a7a7f2, 0xfc7e7e82, 0x7a3d3d47, 0xc86464ac, 0xba5d5de7, 0x3219192b, 0xe6737395,
+    0xc06060a0, 0x19818198, 0x9e4f4fd1, 0xa3dcdc7f, 0x44222266, 0x542a2a7e, 0x3b9090ab, 0x0b888883,
+    0x8c4646ca, 0xc7eeee29, 0x6bb8b8d3, 0x2814143c, 0xa7dede79, 0xbc5e5ee2, 0x160b0b1d, 0xaddbdb76,
+    0xdbe0e03b, 0x64323256, 0x743a3a4e, 0x140a0a1e, 0x924949db, 0x0c06060a, 0x4824246c, 0xb85c5ce4,
+    0x9fc2c25d, 0xbdd3d36e, 0x43acacef, 0xc46262a6, 0x399191a8, 0x319595a4, 0xd3e4e437, 0xf279798b,
+    0xd5e7e732, 0x8bc8c843, 0x6e373759, 0xda6d6db7, 0x018d8d8c, 0xb1d5d564, 0x9c4e4ed2, 0x49a9a9e0,
+    0xd86c6cb4, 0xac5656fa, 0xf3f4f407, 0xcfeaea25, 0xca6565af, 0xf47a7a8e, 0x47aeaee9, 0x10080818,
+    0x6fbabad5, 0xf0787888, 0x4a25256f, 0x5c2e2e72, 0x381c1c24, 0x57a6a6f1, 0x73b4b4c7, 0x97c6c651,
+    0xcbe8e823, 0xa1dddd7c, 0xe874749c, 0x3e1f1f21, 0x964b4bdd, 0x61bdbddc, 0x0d8b8b86, 0x0f8a8a85,
+    0xe0707090, 0x7c3e3e42, 0x71b5b5c4, 0xcc6666aa, 0x904848d8, 0x06030305, 0xf7f6f601, 0x1c0e0e12,
+    0xc26161a3, 0x6a35355f, 0xae5757f9, 0x69b9b9d0, 0x17868691, 0x99c1c158, 0x3a1d1d27, 0x279e9eb9,
+    0xd9e1e138, 0xebf8f813, 0x2b9898b3, 0x22111133, 0xd26969bb, 0xa9d9d970, 0x078e8e89, 0x339494a7,
+    0x2d9b9bb6, 0x3c1e1e22, 0x15878792, 0xc9e9e920, 0x87cece49, 0xaa5555ff, 0x50282878, 0xa5dfdf7a,
+    0x038c8c8f, 0x59a1a1f8, 0x09898980, 0x1a0d0d17, 0x65bfbfda, 0xd7e6e631, 0x844242c6, 0xd06868b8,
+    0x824141c3, 0x299999b0, 0x5a2d2d77, 0x1e0f0f11, 0x7bb0b0cb, 0xa85454fc, 0x6dbbbbd6, 0x2c16163a
+};
+
+// Decryption T-table: inverse S-box output times {0e, 09, 0d, 0b}
+static const uint32_t aes_td0[256] = {
+    0x51f4a750, 0x7e416553, 0x1a17a4c3, 0x3a275e96, 0x3bab6bcb, 0x1f9d45f1, 0xacfa58ab, 0x4be30393,
+    0x2030fa55, 0xad766df6, 0x88cc7691, 0xf5024c25, 0x4fe5d7fc, 0xc52acbd7, 0x26354480, 0xb562a38f,
+    0xdeb15a49, 0x25ba1b67, 0x45ea0e98, 0x5dfec0e1, 0xc32f7502, 0x814cf012, 0x8d4697a3, 0x6bd3f9c6,
+    0x038f5fe7, 0x15929c95, 0xbf6d7aeb, 0x955259da, 0xd4be832d, 0x587421d3, 0x49e06929, 0x8ec9c844,
+    0x75c2896a, 0xf48e7978, 0x99583e6b, 0x27b971dd, 0xbee14fb6, 0xf088ad17, 0xc920ac66, 0x7dce3ab4,
+    0x63df4a18, 0xe51a3182, 0x97513360, 0x62537f45, 0xb16477e0, 0xbb6bae84, 0xfe81a01c, 0xf9082b94,
+    0x70486858, 0x8f45fd19, 0x94de6c87, 0x527bf8b7, 0xab73d323, 0x724b02e2, 0xe31f8f57, 0x6655ab2a,
+    0xb2eb2807, 0x2fb5c203, 0x86c57b9a, 0xd33708a5, 0x302887f2, 0x23bfa5b2, 0x02036aba, 0xed16825c,
+    0x8acf1c2b, 0xa779b492, 0xf307f2f0, 0x4e69e2a1, 0x65daf4cd, 0x0605bed5, 0xd134621f, 0xc4a6fe8a,
+    0x342e539d, 0xa2f355a0, 0x058ae132, 0xa4f6eb75, 0x0b83ec39, 0x4060efaa, 0x5e719f06, 0xbd6e1051,
+    0x3e218af9, 0x96dd063d, 0xdd3e05ae, 0x4de6bd46, 0x91548db5, 0x71c45d05, 0x0406d46f, 0x605015ff,
+    0x1998fb24, 0xd6bde997, 0x894043cc, 0x67d99e77, 0xb0e842bd, 0x07898b88, 0xe7195b38, 0x79c8eedb,
+    0xa17c0a47, 0x7c420fe9, 0xf8841ec9, 0x00000000, 0x09808683, 0x322bed48, 0x1e1170ac, 0x6c5a724e,
+    0xfd0efffb, 0x0f853856, 0x3daed51e, 0x362d3927, 0x0a0fd964, 0x685ca621, 0x9b5b54d1, 0x24362e3a,
+    0x0c0a67b1, 0x9357e70f, 0xb4ee96d2, 0x1b9b919e, 0x80c0c54f, 0x61dc20a2, 0x5a774b69, 0x1c121a16,
+    0xe293ba0a, 0xc0a02ae5, 0x3c22e043, 0x121b171d, 0x0e090d0b, 0xf28bc7ad, 0x2db6a8b9, 0x141ea9c8,
+    0x57f11985, 0xaf75074c, 0xee99ddbb, 0xa37f60fd, 0xf701269f, 0x5c72f5bc, 0x44663bc5, 0x5bfb7e34,
+    0x8b432976, 0xcb23c6dc, 0xb6edfc68, 0xb8e4f163, 0xd731dcca, 0x42638510, 0x13972240, 0x84c61120,
+    0x854a247d, 0xd2bb3df8, 0xaef93211, 0xc729a16d, 0x1d9e2f4b, 0xdcb230f3, 0x0d8652ec, 0x77c1e3d0,
+    0x2bb3166c, 0xa970b999, 0x119448fa, 0x47e96422, 0xa8fc8cc4, 0xa0f03f1a, 0x567d2cd8, 0x223390ef,
+    0x87494ec7, 0xd938d1c1, 0x8ccaa2fe, 0x98d40b36, 0xa6f581cf, 0xa57ade28, 0xdab78e26, 0x3fadbfa4,
+    0x2c3a9de4, 0x5078920d, 0x6a5fcc9b, 0x547e4662, 0xf68d13c2, 0x90d8b8e8, 0x2e39f75e, 0x82c3aff5,
+    0x9f5d80be, 0x69d0937c, 0x6fd52da9, 0xcf2512b3, 0xc8ac993b, 0x10187da7, 0xe89c636e, 0xdb3bbb7b,
+    0xcd267809, 0x6e5918f4, 0xec9ab701, 0x834f9aa8, 0xe6956e65, 0xaaffe67e, 0x21bccf08, 0xef15e8e6,
+    0xbae79bd9, 0x4a6f36ce, 0xea9f09d4, 0x29b07cd6, 0x31a4b2af, 0x2a3f2331, 0xc6a59430, 0x35a266c0,
+    0x744ebc37, 0xfc82caa6, 0xe090d0b0, 0x33a7d815, 0xf104984a, 0x41ecdaf7, 0x7fcd500e, 0x1791f62f,
+    0x764dd68d, 0x43efb04d, 0xccaa4d54, 0xe49604df, 0x9ed1b5e3, 0x4c6a881b, 0xc12c1fb8, 0x4665517f,
+    0x9d5eea04, 0x018c355d, 0xfa877473, 0xfb0b412e, 0xb3671d5a, 0x92dbd252, 0xe9105633, 0x6dd64713,
+    0x9ad7618c, 0x37a10c7a, 0x59f8148e, 0xeb133c89, 0xcea927ee, 0xb761c935, 0xe11ce5ed, 0x7a47b13c,
+    0x9cd2df59, 0x55f2733f, 0x1814ce79, 0x73c737bf, 0x53f7cdea, 0x5ffdaa5b, 0xdf3d6f14, 0x7844db86,
+    0xcaaff381, 0xb968c43e, 0x3824342c, 0xc2a3405f, 0x161dc372, 0xbce2250c, 0x283c498b, 0xff0d9541,
+    0x39a80171, 0x080cb3de, 0xd8b4e49c, 0x6456c190, 0x7bcb8461, 0xd532b670, 0x486c5c74, 0xd0b85742
+};
+static inline uint32_t aes_ror8(uint32_t x) { return (x >> 8) | (x << 24); }
+static inline uint32_t aes_ror16(uint32_t x) { return (x >> 16) | (x << 16); }
+static inline uint32_t aes_ror24(uint32_t x) { return (x >> 24) | (x << 8); }
+
+static inline uint32_t aes_load_be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void aes_store_be32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
 static uint32_t aes_sub_word(uint32_t word) {
-    return (aes_sbox[(word >> 24) & 0xFF] << 24) |
-           (aes_sbox[(word >> 16) & 0xFF] << 16) |
-           (aes_sbox[(word >> 8) & 0xFF] << 8) |
+    return ((uint32_t)aes_sbox[(word >> 24) & 0xFF] << 24) |
+           ((uint32_t)aes_sbox[(word >> 16) & 0xFF] << 16) |
+           ((uint32_t)aes_sbox[(word >> 8) & 0xFF] << 8) |
            aes_sbox[word & 0xFF];
 }
 
@@ -71,176 +159,590 @@ int aes_key_expansion(const uint8_t* key, uint32_t key_bits, uint32_t* round_key
     uint32_t key_words = key_bits / 32;
     uint32_t rounds = (key_bits == 128) ? 10 : (key_bits == 192) ? 12 : 14;
     uint32_t total_words = 4 * (rounds + 1);
-    
+
     // Copy original key
     for (uint32_t i = 0; i < key_words; i++) {
-        round_keys[i] = (key[i*4] << 24) | (key[i*4+1] << 16) | (key[i*4+2] << 8) | key[i*4+3];
+        round_keys[i] = aes_load_be32(key + i * 4);
     }
-    
+
     // Generate remaining round keys
     for (uint32_t i = key_words; i < total_words; i++) {
         uint32_t temp = round_keys[i-1];
-        
+
         if (i % key_words == 0) {
-            temp = aes_sub_word(aes_rot_word(temp)) ^ (aes_rcon[i/key_words] << 24);
+            temp = aes_sub_word(aes_rot_word(temp)) ^ ((uint32_t)aes_rcon[i/key_words] << 24);
         } else if (key_words > 6 && i % key_words == 4) {
             temp = aes_sub_word(temp);
         }
-        
+
         round_keys[i] = round_keys[i - key_words] ^ temp;
     }
-    
+
     return rounds;
 }
 
-static void aes_add_round_key(uint8_t* state, const uint32_t* round_key) {
-    for (int i = 0; i < 4; i++) {
-        uint32_t key_word = round_key[i];
-        state[i*4] ^= (key_word >> 24) & 0xFF;
-        state[i*4+1] ^= (key_word >> 16) & 0xFF;
-        state[i*4+2] ^= (key_word >> 8) & 0xFF;
-        state[i*4+3] ^= key_word & 0xFF;
+// InvMixColumns of one round key word. aes_td0[S[b]] is b times
+// {0e, 09, 0d, 0b}, so the decryption table does the work.
+static uint32_t aes_inv_mix_word(uint32_t w) {
+    return aes_td0[aes_sbox[w >> 24]] ^
+           aes_ror8(aes_td0[aes_sbox[(w >> 16) & 0xFF]]) ^
+           aes_ror16(aes_td0[aes_sbox[(w >> 8) & 0xFF]]) ^
+           aes_ror24(aes_td0[aes_sbox[w & 0xFF]]);
+}
+
+// Round keys for the equivalent inverse cipher (FIPS 197 section 5.3.5):
+// the encryption keys in reverse order, with InvMixColumns applied to all
+// but the first and last. AES-NI and ARMv8 use the same layout.
+static void aes_invert_key_schedule(const uint32_t* enc, uint32_t rounds, uint32_t* dec) {
+    for (uint32_t j = 0; j < 4; j++) {
+        dec[j] = enc[rounds * 4 + j];
+        dec[rounds * 4 + j] = enc[j];
+    }
+    for (uint32_t r = 1; r < rounds; r++) {
+        for (uint32_t j = 0; j < 4; j++) {
+            dec[r * 4 + j] = aes_inv_mix_word(enc[(rounds - r) * 4 + j]);
+        }
     }
 }
 
-static void aes_sub_bytes(uint8_t* state) {
-    for (int i = 0; i < 16; i++) {
-        state[i] = aes_sbox[state[i]];
+// Portable T-table rounds. Table lookups are indexed by secret data, so
+// unlike the hardware paths this is not constant-time against an attacker
+// who can observe cache timing.
+static void aes_encrypt_block_ttable(const uint32_t* rk, uint32_t rounds, const uint8_t* in, uint8_t* out) {
+    uint32_t s0 = aes_load_be32(in) ^ rk[0];
+    uint32_t s1 = aes_load_be32(in + 4) ^ rk[1];
+    uint32_t s2 = aes_load_be32(in + 8) ^ rk[2];
+    uint32_t s3 = aes_load_be32(in + 12) ^ rk[3];
+    uint32_t t0, t1, t2, t3;
+
+    for (uint32_t round = 1; round < rounds; round++) {
+        rk += 4;
+        t0 = aes_te0[s0 >> 24] ^ aes_ror8(aes_te0[(s1 >> 16) & 0xFF]) ^
+             aes_ror16(aes_te0[(s2 >> 8) & 0xFF]) ^ aes_ror24(aes_te0[s3 & 0xFF]) ^ rk[0];
+        t1 = aes_te0[s1 >> 24] ^ aes_ror8(aes_te0[(s2 >> 16) & 0xFF]) ^
+             aes_ror16(aes_te0[(s3 >> 8) & 0xFF]) ^ aes_ror24(aes_te0[s0 & 0xFF]) ^ rk[1];
+        t2 = aes_te0[s2 >> 24] ^ aes_ror8(aes_te0[(s3 >> 16) & 0xFF]) ^
+             aes_ror16(aes_te0[(s0 >> 8) & 0xFF]) ^ aes_ror24(aes_te0[s1 & 0xFF]) ^ rk[2];
+        t3 = aes_te0[s3 >> 24] ^ aes_ror8(aes_te0[(s0 >> 16) & 0xFF]) ^
+             aes_ror16(aes_te0[(s1 >> 8) & 0xFF]) ^ aes_ror24(aes_te0[s2 & 0xFF]) ^ rk[3];
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+
+    // Final round (no MixColumns)
+    rk += 4;
+    t0 = ((uint32_t)aes_sbox[s0 >> 24] << 24) ^ ((uint32_t)aes_sbox[(s1 >> 16) & 0xFF] << 16) ^
+         ((uint32_t)aes_sbox[(s2 >> 8) & 0xFF] << 8) ^ aes_sbox[s3 & 0xFF] ^ rk[0];
+    t1 = ((uint32_t)aes_sbox[s1 >> 24] << 24) ^ ((uint32_t)aes_sbox[(s2 >> 16) & 0xFF] << 16) ^
+         ((uint32_t)aes_sbox[(s3 >> 8) & 0xFF] << 8) ^ aes_sbox[s0 & 0xFF] ^ rk[1];
+    t2 = ((uint32_t)aes_sbox[s2 >> 24] << 24) ^ ((uint32_t)aes_sbox[(s3 >> 16) & 0xFF] << 16) ^
+         ((uint32_t)aes_sbox[(s0 >> 8) & 0xFF] << 8) ^ aes_sbox[s1 & 0xFF] ^ rk[2];
+    t3 = ((uint32_t)aes_sbox[s3 >> 24] << 24) ^ ((uint32_t)aes_sbox[(s0 >> 16) & 0xFF] << 16) ^
+         ((uint32_t)aes_sbox[(s1 >> 8) & 0xFF] << 8) ^ aes_sbox[s2 & 0xFF] ^ rk[3];
+
+    aes_store_be32(out, t0);
+    aes_store_be32(out + 4, t1);
+    aes_store_be32(out + 8, t2);
+    aes_store_be32(out + 12, t3);
+}
+
+// `rk` is an inverted schedule from aes_invert_key_schedule
+static void aes_decrypt_block_ttable(const uint32_t* rk, uint32_t rounds, const uint8_t* in, uint8_t* out) {
+    uint32_t s0 = aes_load_be32(in) ^ rk[0];
+    uint32_t s1 = aes_load_be32(in + 4) ^ rk[1];
+    uint32_t s2 = aes_load_be32(in + 8) ^ rk[2];
+    uint32_t s3 = aes_load_be32(in + 12) ^ rk[3];
+    uint32_t t0, t1, t2, t3;
+
+    for (uint32_t round = 1; round < rounds; round++) {
+        rk += 4;
+        t0 = aes_td0[s0 >> 24] ^ aes_ror8(aes_td0[(s3 >> 16) & 0xFF]) ^
+             aes_ror16(aes_td0[(s2 >> 8) & 0xFF]) ^ aes_ror24(aes_td0[s1 & 0xFF]) ^ rk[0];
+        t1 = aes_td0[s1 >> 24] ^ aes_ror8(aes_td0[(s0 >> 16) & 0xFF]) ^
+             aes_ror16(aes_td0[(s3 >> 8) & 0xFF]) ^ aes_ror24(aes_td0[s2 & 0xFF]) ^ rk[1];
+        t2 = aes_td0[s2 >> 24] ^ aes_ror8(aes_td0[(s1 >> 16) & 0xFF]) ^
+             aes_ror16(aes_td0[(s0 >> 8) & 0xFF]) ^ aes_ror24(aes_td0[s3 & 0xFF]) ^ rk[2];
+        t3 = aes_td0[s3 >> 24] ^ aes_ror8(aes_td0[(s2 >> 16) & 0xFF]) ^
+             aes_ror16(aes_td0[(s1 >> 8) & 0xFF]) ^ aes_ror24(aes_td0[s0 & 0xFF]) ^ rk[3];
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
     }
+
+    // Final round (no InvMixColumns)
+    rk += 4;
+    t0 = ((uint32_t)aes_inv_sbox[s0 >> 24] << 24) ^ ((uint32_t)aes_inv_sbox[(s3 >> 16) & 0xFF] << 16) ^
+         ((uint32_t)aes_inv_sbox[(s2 >> 8) & 0xFF] << 8) ^ aes_inv_sbox[s1 & 0xFF] ^ rk[0];
+    t1 = ((uint32_t)aes_inv_sbox[s1 >> 24] << 24) ^ ((uint32_t)aes_inv_sbox[(s0 >> 16) & 0xFF] << 16) ^
+         ((uint32_t)aes_inv_sbox[(s3 >> 8) & 0xFF] << 8) ^ aes_inv_sbox[s2 & 0xFF] ^ rk[1];
+    t2 = ((uint32_t)aes_inv_sbox[s2 >> 24] << 24) ^ ((uint32_t)aes_inv_sbox[(s1 >> 16) & 0xFF] << 16) ^
+         ((uint32_t)aes_inv_sbox[(s0 >> 8) & 0xFF] << 8) ^ aes_inv_sbox[s3 & 0xFF] ^ rk[2];
+    t3 = ((uint32_t)aes_inv_sbox[s3 >> 24] << 24) ^ ((uint32_t)aes_inv_sbox[(s2 >> 16) & 0xFF] << 16) ^
+         ((uint32_t)aes_inv_sbox[(s1 >> 8) & 0xFF] << 8) ^ aes_inv_sbox[s0 & 0xFF] ^ rk[3];
+
+    aes_store_be32(out, t0);
+    aes_store_be32(out + 4, t1);
+    aes_store_be32(out + 8, t2);
+    aes_store_be32(out + 12, t3);
 }
 
-static void aes_inv_sub_bytes(uint8_t* state) {
+void aes_encrypt_block_ex(const uint32_t* round_keys, uint32_t rounds, const uint8_t* plaintext, uint8_t* ciphertext) {
+    aes_encrypt_block_ttable(round_keys, rounds, plaintext, ciphertext);
+}
+
+void aes_decrypt_block_ex(const uint32_t* round_keys, uint32_t rounds, const uint8_t* ciphertext, uint8_t* plaintext) {
+    // Takes the encryption schedule; contexts keep the inverted one ready
+    uint32_t dec[60];
+    aes_invert_key_schedule(round_keys, rounds, dec);
+    aes_decrypt_block_ttable(dec, rounds, ciphertext, plaintext);
+    crypto_memzero_secure(dec, sizeof(dec));
+}
+
+static inline void aes_xor16(uint8_t* dst, const uint8_t* a, const uint8_t* b) {
     for (int i = 0; i < 16; i++) {
-        state[i] = aes_inv_sbox[state[i]];
-    }
-}
-
-static void aes_shift_rows(uint8_t* state) {
-    uint8_t temp;
-    
-    // Row 1: shift left by 1
-    temp = state[1]; state[1] = state[5]; state[5] = state[9]; state[9] = state[13]; state[13] = temp;
-    
-    // Row 2: shift left by 2
-    temp = state[2]; state[2] = state[10]; state[10] = temp;
-    temp = state[6]; state[6] = state[14]; state[14] = temp;
-    
-    // Row 3: shift left by 3 (or right by 1)
-    temp = state[3]; state[3] = state[15]; state[15] = state[11]; state[11] = state[7]; state[7] = temp;
-}
-
-static void aes_inv_shift_rows(uint8_t* state) {
-    uint8_t temp;
-    
-    // Row 1: shift right by 1
-    temp = state[13]; state[13] = state[9]; state[9] = state[5]; state[5] = state[1]; state[1] = temp;
-    
-    // Row 2: shift right by 2
-    temp = state[2]; state[2] = state[10]; state[10] = temp;
-    temp = state[6]; state[6] = state[14]; state[14] = temp;
-    
-    // Row 3: shift right by 3 (or left by 1)
-    temp = state[3]; state[3] = state[7]; state[7] = state[11]; state[11] = state[15]; state[15] = temp;
-}
-
-static uint8_t aes_gf_mult(uint8_t a, uint8_t b) {
-    uint8_t result = 0;
-    uint8_t hi_bit_set;
-    
-    for (int i = 0; i < 8; i++) {
-        if (b & 1) result ^= a;
-        hi_bit_set = a & 0x80;
-        a <<= 1;
-        if (hi_bit_set) a ^= 0x1b; // AES irreducible polynomial
-        b >>= 1;
-    }
-    
-    return result;
+        dst[i] = a[i] ^ b[i];
+    }
+}
+
+// Bump the big-endian block counter in the last four bytes
+static inline void aes_ctr32_add(uint8_t counter[16], uint32_t n) {
+    aes_store_be32(counter + 12, aes_load_be32(counter + 12) + n);
 }
 
-static void aes_mix_columns(uint8_t* state) {
-    for (int c = 0; c < 4; c++) {
-        uint8_t s0 = state[c*4], s1 = state[c*4+1], s2 = state[c*4+2], s3 = state[c*4+3];
-        state[c*4] = aes_gf_mult(0x02, s0) ^ aes_gf_mult(0x03, s1) ^ s2 ^ s3;
-        state[c*4+1] = s0 ^ aes_gf_mult(0x02, s1) ^ aes_gf_mult(0x03, s2) ^ s3;
-        state[c*4+2] = s0 ^ s1 ^ aes_gf_mult(0x02, s2) ^ aes_gf_mult(0x03, s3);
-        state[c*4+3] = aes_gf_mult(0x03, s0) ^ s1 ^ s2 ^ aes_gf_mult(0x02, s3);
+// Bulk operations on whole blocks. Each backend implements all of them so
+// the hardware paths can keep the round keys in registers across a call
+// and overlap independent blocks (ECB, CBC decryption, CTR). `iv` and
+// `counter` are updated for the next call; `in` may equal `out`.
+typedef struct {
+    const char* name;
+    void (*encrypt_blocks)(const crypto_aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, size_t blocks);
+    void (*decrypt_blocks)(const crypto_aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, size_t blocks);
+    void (*cbc_encrypt)(const crypto_aes_ctx_t* ctx, uint8_t iv[16], const uint8_t* in, uint8_t* out, size_t blocks);
+    void (*cbc_decrypt)(const crypto_aes_ctx_t* ctx, uint8_t iv[16], const uint8_t* in, uint8_t* out, size_t blocks);
+    void (*ctr32)(const crypto_aes_ctx_t* ctx, uint8_t counter[16], const uint8_t* in, uint8_t* out, size_t blocks);
+} aes_backend_t;
+
+static void aes_generic_encrypt_blocks(const crypto_aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    for (size_t i = 0; i < blocks; i++) {
+        aes_encrypt_block_ttable(ctx->key_schedule, ctx->rounds, in + i * 16, out + i * 16);
     }
 }
 
-static void aes_inv_mix_columns(uint8_t* state) {
-    for (int c = 0; c < 4; c++) {
-        uint8_t s0 = state[c*4], s1 = state[c*4+1], s2 = state[c*4+2], s3 = state[c*4+3];
-        state[c*4] = aes_gf_mult(0x0e, s0) ^ aes_gf_mult(0x0b, s1) ^ aes_gf_mult(0x0d, s2) ^ aes_gf_mult(0x09, s3);
-        state[c*4+1] = aes_gf_mult(0x09, s0) ^ aes_gf_mult(0x0e, s1) ^ aes_gf_mult(0x0b, s2) ^ aes_gf_mult(0x0d, s3);
-        state[c*4+2] = aes_gf_mult(0x0d, s0) ^ aes_gf_mult(0x09, s1) ^ aes_gf_mult(0x0e, s2) ^ aes_gf_mult(0x0b, s3);
-        state[c*4+3] = aes_gf_mult(0x0b, s0) ^ aes_gf_mult(0x0d, s1) ^ aes_gf_mult(0x09, s2) ^ aes_gf_mult(0x0e, s3);
+static void aes_generic_decrypt_blocks(const crypto_aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    for (size_t i = 0; i < blocks; i++) {
+        aes_decrypt_block_ttable(ctx->dec_schedule, ctx->rounds, in + i * 16, out + i * 16);
     }
 }
 
-void aes_encrypt_block_ex(const uint32_t* round_keys, uint32_t rounds, const uint8_t* plaintext, uint8_t* ciphertext) {
-    uint8_t state[16];
-    memcpy(state, plaintext, 16);
-    
-    // Initial round
-    aes_add_round_key(state, round_keys);
-    
-    // Main rounds
-    for (uint32_t round = 1; round < rounds; round++) {
-        aes_sub_bytes(state);
-        aes_shift_rows(state);
-        aes_mix_columns(state);
-        aes_add_round_key(state, round_keys + round * 4);
+static void aes_generic_cbc_encrypt(const crypto_aes_ctx_t* ctx, uint8_t iv[16], const uint8_t* in, uint8_t* out, size_t blocks) {
+    uint8_t block[16];
+    for (size_t i = 0; i < blocks; i++) {
+        aes_xor16(block, in + i * 16, iv);
+        aes_encrypt_block_ttable(ctx->key_schedule, ctx->rounds, block, iv);
+        memcpy(out + i * 16, iv, 16);
     }
-    
-    // Final round (no MixColumns)
-    aes_sub_bytes(state);
-    aes_shift_rows(state);
-    aes_add_round_key(state, round_keys + rounds * 4);
-    
-    memcpy(ciphertext, state, 16);
-    crypto_memzero_secure(state, sizeof(state));
+    crypto_memzero_secure(block, sizeof(block));
 }
 
-void aes_decrypt_block_ex(const uint32_t* round_keys, uint32_t rounds, const uint8_t* ciphertext, uint8_t* plaintext) {
-    uint8_t state[16];
-    memcpy(state, ciphertext, 16);
-    
-    // Initial round
-    aes_add_round_key(state, round_keys + rounds * 4);
-    
-    // Main rounds
-    for (uint32_t round = rounds - 1; round > 0; round--) {
-        aes_inv_shift_rows(state);
-        aes_inv_sub_bytes(state);
-        aes_add_round_key(state, round_keys + round * 4);
-        aes_inv_mix_columns(state);
-    }
-    
-    // Final round (no InvMixColumns)
-    aes_inv_shift_rows(state);
-    aes_inv_sub_bytes(state);
-    aes_add_round_key(state, round_keys);
-    
-    memcpy(plaintext, state, 16);
-    crypto_memzero_secure(state, sizeof(state));
+static void aes_generic_cbc_decrypt(const crypto_aes_ctx_t* ctx, uint8_t iv[16], const uint8_t* in, uint8_t* out, size_t blocks) {
+    uint8_t cipher[16], block[16];
+    for (size_t i = 0; i < blocks; i++) {
+        memcpy(cipher, in + i * 16, 16);
+        aes_decrypt_block_ttable(ctx->dec_schedule, ctx->rounds, cipher, block);
+        aes_xor16(out + i * 16, block, iv);
+        memcpy(iv, cipher, 16);
+    }
+    crypto_memzero_secure(block, sizeof(block));
+}
+
+static void aes_generic_ctr32(const crypto_aes_ctx_t* ctx, uint8_t counter[16], const uint8_t* in, uint8_t* out, size_t blocks) {
+    uint8_t keystream[16];
+    for (size_t i = 0; i < blocks; i++) {
+        aes_encrypt_block_ttable(ctx->key_schedule, ctx->rounds, counter, keystream);
+        aes_xor16(out + i * 16, in + i * 16, keystream);
+        aes_ctr32_add(counter, 1);
+    }
+    crypto_memzero_secure(keystream, sizeof(keystream));
+}
+
+static const aes_backend_t aes_backend_generic = {
+    "t-table",
+    aes_generic_encrypt_blocks,
+    aes_generic_decrypt_blocks,
+    aes_generic_cbc_encrypt,
+    aes_generic_cbc_decrypt,
+    aes_generic_ctr32
+};
+
+// Blocks in flight at once on the hardware paths: AESENC/AESE have a
+// latency of several cycles but issue every cycle, and eight states plus
+// a round key fit the register file on both architectures
+#define AES_HW_LANES 8
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+
+#define AESNI_TARGET __attribute__((target("aes,sse4.1")))
+#define AESNI_INLINE static inline __attribute__((always_inline)) AESNI_TARGET
+
+// Round key words are stored most significant byte first; AES-NI wants
+// the bytes in FIPS order
+AESNI_INLINE void aesni_load_keys(const uint32_t* rk, uint32_t rounds, __m128i k[15]) {
+    const __m128i bswap32 = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    for (uint32_t i = 0; i <= rounds; i++) {
+        k[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(rk + i * 4)), bswap32);
+    }
+}
+
+AESNI_INLINE __m128i aesni_encrypt1(const __m128i* k, uint32_t rounds, __m128i b) {
+    b = _mm_xor_si128(b, k[0]);
+    for (uint32_t r = 1; r < rounds; r++) {
+        b = _mm_aesenc_si128(b, k[r]);
+    }
+    return _mm_aesenclast_si128(b, k[rounds]);
+}
+
+AESNI_INLINE __m128i aesni_decrypt1(const __m128i* k, uint32_t rounds, __m128i b) {
+    b = _mm_xor_si128(b, k[0]);
+    for (uint32_t r = 1; r < rounds; r++) {
+        b = _mm_aesdec_si128(b, k[r]);
+    }
+    return _mm_aesdeclast_si128(b, k[rounds]);
+}
+
+AESNI_INLINE void aesni_encrypt8(const __m128i* k, uint32_t rounds, __m128i b[AES_HW_LANES]) {
+    for (int i = 0; i < AES_HW_LANES; i++) b[i] = _mm_xor_si128(b[i], k[0]);
+    for (uint32_t r = 1; r < rounds; r++) {
+        __m128i key = k[r];
+        for (int i = 0; i < AES_HW_LANES; i++) b[i] = _mm_aesenc_si128(b[i], key);
+    }
+    for (int i = 0; i < AES_HW_LANES; i++) b[i] = _mm_aesenclast_si128(b[i], k[rounds]);
+}
+
+AESNI_INLINE void aesni_decrypt8(const __m128i* k, uint32_t rounds, __m128i b[AES_HW_LANES]) {
+    for (int i = 0; i < AES_HW_LANES; i++) b[i] = _mm_xor_si128(b[i], k[0]);
+    for (uint32_t r = 1; r < rounds; r++) {
+        __m128i key = k[r];
+        for (int i = 0; i < AES_HW_LANES; i++) b[i] = _mm_aesdec_si128(b[i], key);
+    }
+    for (int i = 0; i < AES_HW_LANES; i++) b[i] = _mm_aesdeclast_si128(b[i], k[rounds]);
+}
+
+AESNI_TARGET static void aesni_encrypt_blocks(const crypto_aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    __m128i k[15], b[AES_HW_LANES];
+    aesni_load_keys(ctx->key_schedule, ctx->rounds, k);
+
+    for (; blocks >= AES_HW_LANES; blocks -= AES_HW_LANES) {
+        for (int i = 0; i < AES_HW_LANES; i++) b[i] = _mm_loadu_si128((const __m128i*)in + i);
+        aesni_encrypt8(k, ctx->rounds, b);
+        for (int i = 0; i < AES_HW_LANES; i++) _mm_storeu_si128((__m128i*)out + i, b[i]);
+        in += AES_HW_LANES * 16;
+        out += AES_HW_LANES * 16;
+    }
+    for (; blocks > 0; blocks--) {
+        _mm_storeu_si128((__m128i*)out, aesni_encrypt1(k, ctx->rounds, _mm_loadu_si128((const __m128i*)in)));
+        in += 16;
+        out += 16;
+    }
+}
+
+AESNI_TARGET static void aesni_decrypt_blocks(const crypto_aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    __m128i k[15], b[AES_HW_LANES];
+    aesni_load_keys(ctx->dec_schedule, ctx->rounds, k);
+
+    for (; blocks >= AES_HW_LANES; blocks -= AES_HW_LANES) {
+        for (int i = 0; i < AES_HW_LANES; i++) b[i] = _mm_loadu_si128((const __m128i*)in + i);
+        aesni_decrypt8(k, ctx->rounds, b);
+        for (int i = 0; i < AES_HW_LANES; i++) _mm_storeu_si128((__m128i*)out + i, b[i]);
+        in += AES_HW_LANES * 16;
+        out += AES_HW_LANES * 16;
+    }
+    for (; blocks > 0; blocks--) {
+        _mm_storeu_si128((__m128i*)out, aesni_decrypt1(k, ctx->rounds, _mm_loadu_si128((const __m128i*)in)));
+        in += 16;
+        out += 16;
+    }
+}
+
+// CBC encryption is inherently serial; it still gains from the keys
+// staying in registers
+AESNI_TARGET static void aesni_cbc_encrypt(const crypto_aes_ctx_t* ctx, uint8_t iv[16], const uint8_t* in, uint8_t* out, size_t blocks) {
+    __m128i k[15];
+    aesni_load_keys(ctx->key_schedule, ctx->rounds, k);
+
+    __m128i chain = _mm_loadu_si128((const __m128i*)iv);
+    for (; blocks > 0; blocks--) {
+        chain = aesni_encrypt1(k, ctx->rounds, _mm_xor_si128(chain, _mm_loadu_si128((const __m128i*)in)));
+        _mm_storeu_si128((__m128i*)out, chain);
+        in += 16;
+        out += 16;
+    }
+    _mm_storeu_si128((__m128i*)iv, chain);
+}
+
+AESNI_TARGET static void aesni_cbc_decrypt(const crypto_aes_ctx_t* ctx, uint8_t iv[16], const uint8_t* in, uint8_t* out, size_t blocks) {
+    __m128i k[15], b[AES_HW_LANES], c[AES_HW_LANES];
+    aesni_load_keys(ctx->dec_schedule, ctx->rounds, k);
+
+    __m128i chain = _mm_loadu_si128((const __m128i*)iv);
+    for (; blocks >= AES_HW_LANES; blocks -= AES_HW_LANES) {
+        // Keep the ciphertext: `out` may overwrite it
+        for (int i = 0; i < AES_HW_LANES; i++) b[i] = c[i] = _mm_loadu_si128((const __m128i*)in + i);
+        aesni_decrypt8(k, ctx->rounds, b);
+        _mm_storeu_si128((__m128i*)out, _mm_xor_si128(b[0], chain));
+        for (int i = 1; i < AES_HW_LANES; i++) _mm_storeu_si128((__m128i*)out + i, _mm_xor_si128(b[i], c[i - 1]));
+        chain = c[AES_HW_LANES - 1];
+        in += AES_HW_LANES * 16;
+        out += AES_HW_LANES * 16;
+    }
+    for (; blocks > 0; blocks--) {
+        __m128i cipher = _mm_loadu_si128((const __m128i*)in);
+        _mm_storeu_si128((__m128i*)out, _mm_xor_si128(aesni_decrypt1(k, ctx->rounds, cipher), chain));
+        chain = cipher;
+        in += 16;
+        out += 16;
+    }
+    _mm_storeu_si128((__m128i*)iv, chain);
+}
+
+AESNI_TARGET static void aesni_ctr32(const crypto_aes_ctx_t* ctx, uint8_t counter[16], const uint8_t* in, uint8_t* out, size_t blocks) {
+    __m128i k[15], b[AES_HW_LANES];
+    aesni_load_keys(ctx->key_schedule, ctx->rounds, k);
+
+    __m128i base = _mm_loadu_si128((const __m128i*)counter);
+    uint32_t ctr = aes_load_be32(counter + 12);
+    for (; blocks >= AES_HW_LANES; blocks -= AES_HW_LANES) {
+        for (int i = 0; i < AES_HW_LANES; i++) {
+            b[i] = _mm_insert_epi32(base, (int)__builtin_bswap32(ctr + (uint32_t)i), 3);
+        }
+        aesni_encrypt8(k, ctx->rounds, b);
+        for (int i = 0; i < AES_HW_LANES; i++) {
+            _mm_storeu_si128((__m128i*)out + i, _mm_xor_si128(b[i], _mm_loadu_si128((const __m128i*)in + i)));
+        }
+        ctr += AES_HW_LANES;
+        in += AES_HW_LANES * 16;
+        out += AES_HW_LANES * 16;
+    }
+    for (; blocks > 0; blocks--) {
+        __m128i ks = aesni_encrypt1(k, ctx->rounds, _mm_insert_epi32(base, (int)__builtin_bswap32(ctr), 3));
+        _mm_storeu_si128((__m128i*)out, _mm_xor_si128(ks, _mm_loadu_si128((const __m128i*)in)));
+        ctr++;
+        in += 16;
+        out += 16;
+    }
+    aes_store_be32(counter + 12, ctr);
+}
+
+static const aes_backend_t aes_backend_aesni = {
+    "aes-ni",
+    aesni_encrypt_blocks,
+    aesni_decrypt_blocks,
+    aesni_cbc_encrypt,
+    aesni_cbc_decrypt,
+    aesni_ctr32
+};
+#endif
+
+#if defined(__aarch64__) && defined(__GNUC__)
+#include <arm_neon.h>
+
+#if defined(__clang__)
+#define ARMV8_AES_TARGET __attribute__((target("aes")))
+#else
+#define ARMV8_AES_TARGET __attribute__((target("+crypto")))
+#endif
+#define ARMV8_AES_INLINE static inline __attribute__((always_inline)) ARMV8_AES_TARGET
+
+ARMV8_AES_INLINE void armv8_aes_load_keys(const uint32_t* rk, uint32_t rounds, uint8x16_t k[15]) {
+    for (uint32_t i = 0; i <= rounds; i++) {
+        k[i] = vrev32q_u8(vreinterpretq_u8_u32(vld1q_u32(rk + i * 4)));
+    }
+}
+
+// AESE/AESD fold AddRoundKey in before the S-box, so the last key is a
+// plain XOR
+ARMV8_AES_INLINE uint8x16_t armv8_aes_encrypt1(const uint8x16_t* k, uint32_t rounds, uint8x16_t b) {
+    for (uint32_t r = 0; r < rounds - 1; r++) {
+        b = vaesmcq_u8(vaeseq_u8(b, k[r]));
+    }
+    return veorq_u8(vaeseq_u8(b, k[rounds - 1]), k[rounds]);
+}
+
+ARMV8_AES_INLINE uint8x16_t armv8_aes_decrypt1(const uint8x16_t* k, uint32_t rounds, uint8x16_t b) {
+    for (uint32_t r = 0; r < rounds - 1; r++) {
+        b = vaesimcq_u8(vaesdq_u8(b, k[r]));
+    }
+    return veorq_u8(vaesdq_u8(b, k[rounds - 1]), k[rounds]);
+}
+
+ARMV8_AES_INLINE void armv8_aes_encrypt8(const uint8x16_t* k, uint32_t rounds, uint8x16_t b[AES_HW_LANES]) {
+    for (uint32_t r = 0; r < rounds - 1; r++) {
+        uint8x16_t key = k[r];
+        for (int i = 0; i < AES_HW_LANES; i++) b[i] = vaesmcq_u8(vaeseq_u8(b[i], key));
+    }
+    for (int i = 0; i < AES_HW_LANES; i++) b[i] = veorq_u8(vaeseq_u8(b[i], k[rounds - 1]), k[rounds]);
+}
+
+ARMV8_AES_INLINE void armv8_aes_decrypt8(const uint8x16_t* k, uint32_t rounds, uint8x16_t b[AES_HW_LANES]) {
+    for (uint32_t r = 0; r < rounds - 1; r++) {
+        uint8x16_t key = k[r];
+        for (int i = 0; i < AES_HW_LANES; i++) b[i] = vaesimcq_u8(vaesdq_u8(b[i], key));
+    }
+    for (int i = 0; i < AES_HW_LANES; i++) b[i] = veorq_u8(vaesdq_u8(b[i], k[rounds - 1]), k[rounds]);
+}
+
+ARMV8_AES_TARGET static void armv8_aes_encrypt_blocks(const crypto_aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    uint8x16_t k[15], b[AES_HW_LANES];
+    armv8_aes_load_keys(ctx->key_schedule, ctx->rounds, k);
+
+    for (; blocks >= AES_HW_LANES; blocks -= AES_HW_LANES) {
+        for (int i = 0; i < AES_HW_LANES; i++) b[i] = vld1q_u8(in + i * 16);
+        armv8_aes_encrypt8(k, ctx->rounds, b);
+        for (int i = 0; i < AES_HW_LANES; i++) vst1q_u8(out + i * 16, b[i]);
+        in += AES_HW_LANES * 16;
+        out += AES_HW_LANES * 16;
+    }
+    for (; blocks > 0; blocks--) {
+        vst1q_u8(out, armv8_aes_encrypt1(k, ctx->rounds, vld1q_u8(in)));
+        in += 16;
+        out += 16;
+    }
+}
+
+ARMV8_AES_TARGET static void armv8_aes_decrypt_blocks(const crypto_aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, size_t blocks) {
+    uint8x16_t k[15], b[AES_HW_LANES];
+    armv8_aes_load_keys(ctx->dec_schedule, ctx->rounds, k);
+
+    for (; blocks >= AES_HW_LANES; blocks -= AES_HW_LANES) {
+        for (int i = 0; i < AES_HW_LANES; i++) b[i] = vld1q_u8(in + i * 16);
+        armv8_aes_decrypt8(k, ctx->rounds, b);
+        for (int i = 0; i < AES_HW_LANES; i++) vst1q_u8(out + i * 16, b[i]);
+        in += AES_HW_LANES * 16;
+        out += AES_HW_LANES * 16;
+    }
+    for (; blocks > 0; blocks--) {
+        vst1q_u8(out, armv8_aes_decrypt1(k, ctx->rounds, vld1q_u8(in)));
+        in += 16;
+        out += 16;
+    }
+}
+
+ARMV8_AES_TARGET static void armv8_aes_cbc_encrypt(const crypto_aes_ctx_t* ctx, uint8_t iv[16], const uint8_t* in, uint8_t* out, size_t blocks) {
+    uint8x16_t k[15];
+    armv8_aes_load_keys(ctx->key_schedule, ctx->rounds, k);
+
+    uint8x16_t chain = vld1q_u8(iv);
+    for (; blocks > 0; blocks--) {
+        chain = armv8_aes_encrypt1(k, ctx->rounds, veorq_u8(chain, vld1q_u8(in)));
+        vst1q_u8(out, chain);
+        in += 16;
+        out += 16;
+    }
+    vst1q_u8(iv, chain);
+}
+
+ARMV8_AES_TARGET static void armv8_aes_cbc_decrypt(const crypto_aes_ctx_t* ctx, uint8_t iv[16], const uint8_t* in, uint8_t* out, size_t blocks) {
+    uint8x16_t k[15], b[AES_HW_LANES], c[AES_HW_LANES];
+    armv8_aes_load_keys(ctx->dec_schedule, ctx->rounds, k);
+
+    uint8x16_t chain = vld1q_u8(iv);
+    for (; blocks >= AES_HW_LANES; blocks -= AES_HW_LANES) {
+        for (int i = 0; i < AES_HW_LANES; i++) b[i] = c[i] = vld1q_u8(in + i * 16);
+        armv8_aes_decrypt8(k, ctx->rounds, b);
+        vst1q_u8(out, veorq_u8(b[0], chain));
+        for (int i = 1; i < AES_HW_LANES; i++) vst1q_u8(out + i * 16, veorq_u8(b[i], c[i - 1]));
+        chain = c[AES_HW_LANES - 1];
+        in += AES_HW_LANES * 16;
+        out += AES_HW_LANES * 16;
+    }
+    for (; blocks > 0; blocks--) {
+        uint8x16_t cipher = vld1q_u8(in);
+        vst1q_u8(out, veorq_u8(armv8_aes_decrypt1(k, ctx->rounds, cipher), chain));
+        chain = cipher;
+        in += 16;
+        out += 16;
+    }
+    vst1q_u8(iv, chain);
+}
+
+ARMV8_AES_TARGET static void armv8_aes_ctr32(const crypto_aes_ctx_t* ctx, uint8_t counter[16], const uint8_t* in, uint8_t* out, size_t blocks) {
+    uint8x16_t k[15], b[AES_HW_LANES];
+    armv8_aes_load_keys(ctx->key_schedule, ctx->rounds, k);
+
+    uint32x4_t base = vreinterpretq_u32_u8(vld1q_u8(counter));
+    uint32_t ctr = aes_load_be32(counter + 12);
+    for (; blocks >= AES_HW_LANES; blocks -= AES_HW_LANES) {
+        for (int i = 0; i < AES_HW_LANES; i++) {
+            b[i] = vreinterpretq_u8_u32(vsetq_lane_u32(__builtin_bswap32(ctr + (uint32_t)i), base, 3));
+        }
+        armv8_aes_encrypt8(k, ctx->rounds, b);
+        for (int i = 0; i < AES_HW_LANES; i++) vst1q_u8(out + i * 16, veorq_u8(b[i], vld1q_u8(in + i * 16)));
+        ctr += AES_HW_LANES;
+        in += AES_HW_LANES * 16;
+        out += AES_HW_LANES * 16;
+    }
+    for (; blocks > 0; blocks--) {
+        uint8x16_t ks = armv8_aes_encrypt1(k, ctx->rounds, vreinterpretq_u8_u32(vsetq_lane_u32(__builtin_bswap32(ctr), base, 3)));
+        vst1q_u8(out, veorq_u8(ks, vld1q_u8(in)));
+        ctr++;
+        in += 16;
+        out += 16;
+    }
+    aes_store_be32(counter + 12, ctr);
+}
+
+static const aes_backend_t aes_backend_armv8 = {
+    "armv8-aes",
+    armv8_aes_encrypt_blocks,
+    armv8_aes_decrypt_blocks,
+    armv8_aes_cbc_encrypt,
+    armv8_aes_cbc_decrypt,
+    armv8_aes_ctr32
+};
+#endif
+
+static const aes_backend_t* g_aes_backend = NULL;
+
+static void ghash_select_backend(crypto_hw_support_t support);
+
+// Pick the AES and GHASH backends for the enabled hardware features
+void crypto_aes_select_backend(crypto_hw_support_t support) {
+    ghash_select_backend(support);
+    g_aes_backend = &aes_backend_generic;
+#if defined(__x86_64__) && defined(__GNUC__)
+    if (support & CRYPTO_HW_INTEL_AESNI) g_aes_backend = &aes_backend_aesni;
+#endif
+#if defined(__aarch64__) && defined(__GNUC__)
+    if (support & CRYPTO_HW_ARM_CRYPTO) g_aes_backend = &aes_backend_armv8;
+#endif
+    (void)support;
+}
+
+static const aes_backend_t* aes_backend(void) {
+    if (!g_aes_backend) {
+        // Nobody called crypto_init_hardware_acceleration: use all we have
+        crypto_aes_select_backend(crypto_detect_hardware_support());
+    }
+    return g_aes_backend;
+}
+
+const char* crypto_aes_backend_name(void) {
+    return aes_backend()->name;
 }
 
 int crypto_aes_init(crypto_aes_ctx_t* ctx, const uint8_t* key, uint32_t key_bits) {
     if (!ctx || !key || (key_bits != 128 && key_bits != 192 && key_bits != 256)) {
         return CRYPTO_ERROR_INVALID_PARAM;
     }
-    
+
     ctx->rounds = aes_key_expansion(key, key_bits, ctx->key_schedule);
+    aes_invert_key_schedule(ctx->key_schedule, ctx->rounds, ctx->dec_schedule);
     return CRYPTO_SUCCESS;
 }
 
 void crypto_aes_encrypt_block(const crypto_aes_ctx_t* ctx, const uint8_t* plaintext, uint8_t* ciphertext) {
-    aes_encrypt_block_ex(ctx->key_schedule, ctx->rounds, plaintext, ciphertext);
+    aes_backend()->encrypt_blocks(ctx, plaintext, ciphertext, 1);
 }
 
 void crypto_aes_decrypt_block(const crypto_aes_ctx_t* ctx, const uint8_t* ciphertext, uint8_t* plaintext) {
-    aes_decrypt_block_ex(ctx->key_schedule, ctx->rounds, ciphertext, plaintext);
+    aes_backend()->decrypt_blocks(ctx, ciphertext, plaintext, 1);
 }
 
 // CBC mode implementation
@@ -248,26 +750,11 @@ int crypto_aes_cbc_encrypt(const crypto_aes_ctx_t* ctx, const uint8_t* iv, const
     if (!ctx || !iv || !plaintext || !ciphertext || len % AES_BLOCK_SIZE != 0) {
         return CRYPTO_ERROR_INVALID_PARAM;
     }
-    
-    uint8_t prev_block[AES_BLOCK_SIZE];
-    memcpy(prev_block, iv, AES_BLOCK_SIZE);
-    
-    for (uint32_t i = 0; i < len; i += AES_BLOCK_SIZE) {
-        uint8_t temp_block[AES_BLOCK_SIZE];
-        
-        // XOR with previous ciphertext block (or IV for first block)
-        for (int j = 0; j < AES_BLOCK_SIZE; j++) {
-            temp_block[j] = plaintext[i + j] ^ prev_block[j];
-        }
-        
-        // Encrypt
-        crypto_aes_encrypt_block(ctx, temp_block, ciphertext + i);
-        
-        // Update previous block
-        memcpy(prev_block, ciphertext + i, AES_BLOCK_SIZE);
-    }
-    
-    crypto_memzero_secure(prev_block, sizeof(prev_block));
+
+    uint8_t chain[AES_BLOCK_SIZE];
+    memcpy(chain, iv, AES_BLOCK_SIZE);
+    aes_backend()->cbc_encrypt(ctx, chain, plaintext, ciphertext, len / AES_BLOCK_SIZE);
+    crypto_memzero_secure(chain, sizeof(chain));
     return CRYPTO_SUCCESS;
 }
 
@@ -275,29 +762,47 @@ int crypto_aes_cbc_decrypt(const crypto_aes_ctx_t* ctx, const uint8_t* iv, const
     if (!ctx || !iv || !ciphertext || !plaintext || len % AES_BLOCK_SIZE != 0) {
         return CRYPTO_ERROR_INVALID_PARAM;
     }
-    
-    uint8_t prev_block[AES_BLOCK_SIZE];
-    memcpy(prev_block, iv, AES_BLOCK_SIZE);
-    
-    for (uint32_t i = 0; i < len; i += AES_BLOCK_SIZE) {
-        uint8_t temp_block[AES_BLOCK_SIZE];
-        
-        // Decrypt
-        crypto_aes_decrypt_block(ctx, ciphertext + i, temp_block);
-        
-        // XOR with previous ciphertext block (or IV for first block)
-        for (int j = 0; j < AES_BLOCK_SIZE; j++) {
-            plaintext[i + j] = temp_block[j] ^ prev_block[j];
+
+    uint8_t chain[AES_BLOCK_SIZE];
+    memcpy(chain, iv, AES_BLOCK_SIZE);
+    aes_backend()->cbc_decrypt(ctx, chain, ciphertext, plaintext, len / AES_BLOCK_SIZE);
+    crypto_memzero_secure(chain, sizeof(chain));
+    return CRYPTO_SUCCESS;
+}
+
+// Counter mode over whole blocks, then one keystream block for the tail
+static void aes_ctr32_xor(const crypto_aes_ctx_t* ctx, uint8_t counter[16], const uint8_t* in, uint32_t len, uint8_t* out) {
+    const aes_backend_t* backend = aes_backend();
+    uint32_t full = len / AES_BLOCK_SIZE;
+
+    backend->ctr32(ctx, counter, in, out, full);
+    if (len % AES_BLOCK_SIZE) {
+        uint8_t keystream[AES_BLOCK_SIZE];
+        backend->encrypt_blocks(ctx, counter, keystream, 1);
+        for (uint32_t j = 0; j < len % AES_BLOCK_SIZE; j++) {
+            out[full * AES_BLOCK_SIZE + j] = in[full * AES_BLOCK_SIZE + j] ^ keystream[j];
         }
-        
-        // Update previous block
-        memcpy(prev_block, ciphertext + i, AES_BLOCK_SIZE);
+        aes_ctr32_add(counter, 1);
+        crypto_memzero_secure(keystream, sizeof(keystream));
+    }
+}
+
+int crypto_aes_ctr_crypt(const crypto_aes_ctx_t* ctx, const uint8_t* iv, const uint8_t* input, uint32_t len, uint8_t* output) {
+    if (!ctx || !iv || !input || !output) {
+        return CRYPTO_ERROR_INVALID_PARAM;
     }
-    
-    crypto_memzero_secure(prev_block, sizeof(prev_block));
+
+    uint8_t counter[AES_BLOCK_SIZE];
+    memcpy(counter, iv, AES_BLOCK_SIZE);
+    aes_ctr32_xor(ctx, counter, input, len, output);
+    crypto_memzero_secure(counter, sizeof(counter));
     return CRYPTO_SUCCESS;
 }
 
+/* =========================
+   GHASH
+   ========================= */
+
 // GCM mode helper functions
 static void xor_block(uint8_t* dst, const uint8_t* a, const uint8_t* b) {
     for (int i = 0; i < 16; i++) {
@@ -305,11 +810,13 @@ static void xor_block(uint8_t* dst, const uint8_t* a, const uint8_t* b) {
     }
 }
 
+// Bit-serial reference multiply; GCM itself goes through the GHASH
+// backends below
 void aes_gcm_gf_mult(const uint8_t* a, const uint8_t* b, uint8_t* result) {
     uint8_t z[16] = {0};
     uint8_t v[16];
     memcpy(v, b, 16);
-    
+
     for (int i = 0; i < 16; i++) {
         for (int j = 0; j < 8; j++) {
             if (a[i] & (1 << (7-j))) {
@@ -317,7 +824,7 @@ void aes_gcm_gf_mult(const uint8_t* a, const uint8_t* b, uint8_t* result) {
                     z[k] ^= v[k];
                 }
             }
-            
+
             int lsb = v[15] & 1;
             for (int k = 15; k > 0; k--) {
                 v[k] = (v[k] >> 1) | ((v[k-1] & 1) << 7);
@@ -326,43 +833,500 @@ void aes_gcm_gf_mult(const uint8_t* a, const uint8_t* b, uint8_t* result) {
             if (lsb) v[0] ^= 0xe1;
         }
     }
-    
+
     memcpy(result, z, 16);
 }
 
-void aes_gcm_ghash(const uint8_t* h, const uint8_t* data, uint32_t len, uint8_t* result) {
-    uint8_t y[16] = {0};
-    
-    for (uint32_t i = 0; i < len; i += 16) {
-        uint8_t block[16] = {0};
-        uint32_t block_len = (len - i < 16) ? (len - i) : 16;
-        memcpy(block, data + i, block_len);
-        
-        for (int j = 0; j < 16; j++) {
-            y[j] ^= block[j];
+void aes_gcm_inc32(uint8_t* block) {
+    aes_ctr32_add(block, 1);
+}
+
+// Blocks folded into one reduction by the carry-less multiply paths: the
+// accumulator is multiplied by H^8, the next block by H^7 and so on, so
+// eight multiplies share a single reduction. It matches AES_HW_LANES so
+// the fused GCM loops hash one keystream batch at a time.
+#define GHASH_LANES 8
+
+// Hash key expanded for whichever backend is active. Built per GCM call;
+// H is one block encryption away, so nothing is cached across calls.
+typedef struct {
+    uint64_t hl[16], hh[16];            // 4-bit Shoup tables
+    uint8_t powers[GHASH_LANES][16];    // H^1..H^8, byte-reversed
+} ghash_key_t;
+
+// `blocks` whole 16-byte blocks into the running hash `y`
+typedef struct {
+    const char* name;
+    void (*init)(ghash_key_t* key, const uint8_t h[16]);
+    void (*blocks)(const ghash_key_t* key, uint8_t y[16], const uint8_t* data, size_t blocks);
+} ghash_backend_t;
+
+// CTR and GHASH over whole blocks in one pass, for a backend that has
+// both AES and carry-less multiply instructions. Decryption hashes `in`,
+// encryption hashes `out`.
+typedef void (*gcm_crypt_fn)(const crypto_aes_ctx_t* ctx, const ghash_key_t* key, uint8_t counter[16], uint8_t y[16],
+                             const uint8_t* in, uint8_t* out, size_t blocks, int decrypt);
+
+static inline uint64_t ghash_load_be64(const uint8_t* p) {
+    return ((uint64_t)aes_load_be32(p) << 32) | aes_load_be32(p + 4);
+}
+
+static inline void ghash_store_be64(uint8_t* p, uint64_t v) {
+    aes_store_be32(p, (uint32_t)(v >> 32));
+    aes_store_be32(p + 4, (uint32_t)v);
+}
+
+// Shoup's 4-bit tables: H times every 4-bit value, with the bits that
+// drop off reduced through a 16-entry remainder table
+static const uint64_t ghash_last4[16] = {
+    0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+    0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0
+};
+
+static void ghash_generic_init(ghash_key_t* key, const uint8_t h[16]) {
+    uint64_t vh = ghash_load_be64(h);
+    uint64_t vl = ghash_load_be64(h + 8);
+
+    key->hl[0] = 0;
+    key->hh[0] = 0;
+    key->hl[8] = vl;
+    key->hh[8] = vh;
+
+    for (int i = 4; i > 0; i >>= 1) {
+        uint64_t t = (vl & 1) * 0xe100000000000000ULL;
+        vl = (vh << 63) | (vl >> 1);
+        vh = (vh >> 1) ^ t;
+        key->hl[i] = vl;
+        key->hh[i] = vh;
+    }
+    for (int i = 2; i <= 8; i *= 2) {
+        for (int j = 1; j < i; j++) {
+            key->hh[i + j] = key->hh[i] ^ key->hh[j];
+            key->hl[i + j] = key->hl[i] ^ key->hl[j];
         }
-        
-        aes_gcm_gf_mult(y, h, y);
     }
-    
-    memcpy(result, y, 16);
 }
 
-void aes_gcm_inc32(uint8_t* block) {
-    uint32_t counter = (block[12] << 24) | (block[13] << 16) | (block[14] << 8) | block[15];
-    counter++;
-    block[12] = (counter >> 24) & 0xFF;
-    block[13] = (counter >> 16) & 0xFF;
-    block[14] = (counter >> 8) & 0xFF;
-    block[15] = counter & 0xFF;
+static void ghash_generic_blocks(const ghash_key_t* key, uint8_t y[16], const uint8_t* data, size_t blocks) {
+    for (; blocks > 0; blocks--, data += 16) {
+        uint8_t x[16];
+        aes_xor16(x, y, data);
+
+        uint32_t lo = x[15] & 0xF;
+        uint64_t zh = key->hh[lo];
+        uint64_t zl = key->hl[lo];
+
+        for (int i = 15; i >= 0; i--) {
+            uint32_t hi = x[i] >> 4;
+            uint32_t rem;
+            lo = x[i] & 0xF;
+
+            if (i != 15) {
+                rem = (uint32_t)zl & 0xF;
+                zl = (zh << 60) | (zl >> 4);
+                zh = (zh >> 4) ^ (ghash_last4[rem] << 48);
+                zh ^= key->hh[lo];
+                zl ^= key->hl[lo];
+            }
+            rem = (uint32_t)zl & 0xF;
+            zl = (zh << 60) | (zl >> 4);
+            zh = (zh >> 4) ^ (ghash_last4[rem] << 48);
+            zh ^= key->hh[hi];
+            zl ^= key->hl[hi];
+        }
+
+        ghash_store_be64(y, zh);
+        ghash_store_be64(y + 8, zl);
+    }
+}
+
+static const ghash_backend_t ghash_backend_generic = {
+    "4-bit",
+    ghash_generic_init,
+    ghash_generic_blocks
+};
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <wmmintrin.h>
+
+// Carry-less multiply on byte-reversed blocks, after Gueron and Kounavis,
+// "Intel Carry-Less Multiplication Instruction and its Usage for
+// Computing the GCM Mode": the 256-bit product is shifted left by one to
+// account for GCM's reflected bit order, then reduced modulo
+// x^128 + x^7 + x^2 + x + 1
+#define CLMUL_TARGET __attribute__((target("aes,pclmul,sse4.1")))
+#define CLMUL_INLINE static inline __attribute__((always_inline)) CLMUL_TARGET
+
+CLMUL_INLINE __m128i clmul_bswap(__m128i x) {
+    return _mm_shuffle_epi8(x, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+}
+
+// Accumulate the unreduced product a * b into lo, mid and hi
+CLMUL_INLINE void clmul_acc(__m128i a, __m128i b, __m128i* lo, __m128i* mid, __m128i* hi) {
+    *lo = _mm_xor_si128(*lo, _mm_clmulepi64_si128(a, b, 0x00));
+    *hi = _mm_xor_si128(*hi, _mm_clmulepi64_si128(a, b, 0x11));
+    *mid = _mm_xor_si128(*mid, _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10), _mm_clmulepi64_si128(a, b, 0x01)));
+}
+
+CLMUL_INLINE __m128i clmul_reduce(__m128i lo, __m128i mid, __m128i hi) {
+    __m128i t3 = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+    __m128i t6 = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+    // Shift the 256-bit product t6:t3 left by one
+    __m128i t7 = _mm_srli_epi32(t3, 31);
+    __m128i t8 = _mm_srli_epi32(t6, 31);
+    t3 = _mm_slli_epi32(t3, 1);
+    t6 = _mm_slli_epi32(t6, 1);
+    __m128i t9 = _mm_srli_si128(t7, 12);
+    t8 = _mm_slli_si128(t8, 4);
+    t7 = _mm_slli_si128(t7, 4);
+    t3 = _mm_or_si128(t3, t7);
+    t6 = _mm_or_si128(_mm_or_si128(t6, t8), t9);
+
+    // Reduce
+    t7 = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(t3, 31), _mm_slli_epi32(t3, 30)), _mm_slli_epi32(t3, 25));
+    t8 = _mm_srli_si128(t7, 4);
+    t7 = _mm_slli_si128(t7, 12);
+    t3 = _mm_xor_si128(t3, t7);
+    __m128i t2 = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(t3, 1), _mm_srli_epi32(t3, 2)), _mm_srli_epi32(t3, 7));
+    t2 = _mm_xor_si128(t2, t8);
+    t3 = _mm_xor_si128(t3, t2);
+    return _mm_xor_si128(t6, t3);
+}
+
+CLMUL_INLINE __m128i clmul_mul(__m128i a, __m128i b) {
+    __m128i lo = _mm_setzero_si128(), mid = _mm_setzero_si128(), hi = _mm_setzero_si128();
+    clmul_acc(a, b, &lo, &mid, &hi);
+    return clmul_reduce(lo, mid, hi);
+}
+
+CLMUL_TARGET static void ghash_clmul_init(ghash_key_t* key, const uint8_t h[16]) {
+    __m128i h1 = clmul_bswap(_mm_loadu_si128((const __m128i*)h));
+    __m128i hn = h1;
+    for (int i = 0; i < GHASH_LANES; i++) {
+        _mm_storeu_si128((__m128i*)key->powers[i], hn);
+        hn = clmul_mul(hn, h1);
+    }
+}
+
+// y = (y ^ x0) * H^8 ^ x1 * H^7 ^ ... ^ x7 * H, on byte-reversed values
+CLMUL_INLINE __m128i clmul_ghash8(const ghash_key_t* key, __m128i y, const __m128i x[GHASH_LANES]) {
+    __m128i lo = _mm_setzero_si128(), mid = _mm_setzero_si128(), hi = _mm_setzero_si128();
+    for (int i = 0; i < GHASH_LANES; i++) {
+        __m128i b = clmul_bswap(x[i]);
+        if (i == 0) b = _mm_xor_si128(b, y);
+        clmul_acc(b, _mm_loadu_si128((const __m128i*)key->powers[GHASH_LANES - 1 - i]), &lo, &mid, &hi);
+    }
+    return clmul_reduce(lo, mid, hi);
+}
+
+CLMUL_TARGET static void ghash_clmul_blocks(const ghash_key_t* key, uint8_t y[16], const uint8_t* data, size_t blocks) {
+    __m128i acc = clmul_bswap(_mm_loadu_si128((const __m128i*)y));
+    __m128i h1 = _mm_loadu_si128((const __m128i*)key->powers[0]);
+    __m128i x[GHASH_LANES];
+
+    for (; blocks >= GHASH_LANES; blocks -= GHASH_LANES, data += GHASH_LANES * 16) {
+        for (int i = 0; i < GHASH_LANES; i++) x[i] = _mm_loadu_si128((const __m128i*)data + i);
+        acc = clmul_ghash8(key, acc, x);
+    }
+    for (; blocks > 0; blocks--, data += 16) {
+        acc = clmul_mul(_mm_xor_si128(acc, clmul_bswap(_mm_loadu_si128((const __m128i*)data))), h1);
+    }
+    _mm_storeu_si128((__m128i*)y, clmul_bswap(acc));
+}
+
+static const ghash_backend_t ghash_backend_clmul = {
+    "pclmulqdq",
+    ghash_clmul_init,
+    ghash_clmul_blocks
+};
+
+// AES-NI CTR with the GHASH multiplies issued between the AES rounds.
+// Decryption hashes the batch it is decrypting; encryption hashes the
+// previous batch's ciphertext, already in `out`, and the last batch
+// afterwards. Every AES key has at least nine middle rounds, enough for
+// one multiply each.
+CLMUL_TARGET static void gcm_crypt_aesni(const crypto_aes_ctx_t* ctx, const ghash_key_t* key, uint8_t counter[16], uint8_t y[16],
+                                         const uint8_t* in, uint8_t* out, size_t blocks, int decrypt) {
+    __m128i k[15], b[AES_HW_LANES];
+    aesni_load_keys(ctx->key_schedule, ctx->rounds, k);
+
+    __m128i acc = clmul_bswap(_mm_loadu_si128((const __m128i*)y));
+    __m128i base = _mm_loadu_si128((const __m128i*)counter);
+    uint32_t ctr = aes_load_be32(counter + 12);
+    const uint8_t* pending = NULL;
+
+    for (; blocks >= AES_HW_LANES; blocks -= AES_HW_LANES) {
+        __m128i lo = _mm_setzero_si128(), mid = _mm_setzero_si128(), hi = _mm_setzero_si128();
+        if (decrypt) pending = in;
+
+        for (int i = 0; i < AES_HW_LANES; i++) {
+            b[i] = _mm_xor_si128(_mm_insert_epi32(base, (int)__builtin_bswap32(ctr + (uint32_t)i), 3), k[0]);
+        }
+        for (uint32_t r = 1; r < ctx->rounds; r++) {
+            __m128i round_key = k[r];
+            for (int i = 0; i < AES_HW_LANES; i++) b[i] = _mm_aesenc_si128(b[i], round_key);
+            if (pending && r <= GHASH_LANES) {
+                __m128i x = clmul_bswap(_mm_loadu_si128((const __m128i*)pending + (r - 1)));
+                if (r == 1) x = _mm_xor_si128(x, acc);
+                clmul_acc(x, _mm_loadu_si128((const __m128i*)key->powers[GHASH_LANES - r]), &lo, &mid, &hi);
+            }
+        }
+        if (pending) acc = clmul_reduce(lo, mid, hi);
+
+        for (int i = 0; i < AES_HW_LANES; i++) {
+            b[i] = _mm_aesenclast_si128(b[i], k[ctx->rounds]);
+            _mm_storeu_si128((__m128i*)out + i, _mm_xor_si128(b[i], _mm_loadu_si128((const __m128i*)in + i)));
+        }
+        if (!decrypt) pending = out;
+
+        ctr += AES_HW_LANES;
+        in += AES_HW_LANES * 16;
+        out += AES_HW_LANES * 16;
+    }
+
+    __m128i x[GHASH_LANES];
+    if (!decrypt && pending) {
+        for (int i = 0; i < GHASH_LANES; i++) x[i] = _mm_loadu_si128((const __m128i*)pending + i);
+        acc = clmul_ghash8(key, acc, x);
+    }
+
+    // Fewer than a batch left
+    __m128i h1 = _mm_loadu_si128((const __m128i*)key->powers[0]);
+    for (; blocks > 0; blocks--) {
+        __m128i data = _mm_loadu_si128((const __m128i*)in);
+        __m128i ks = aesni_encrypt1(k, ctx->rounds, _mm_insert_epi32(base, (int)__builtin_bswap32(ctr), 3));
+        __m128i result = _mm_xor_si128(ks, data);
+        _mm_storeu_si128((__m128i*)out, result);
+        acc = clmul_mul(_mm_xor_si128(acc, clmul_bswap(decrypt ? data : result)), h1);
+        ctr++;
+        in += 16;
+        out += 16;
+    }
+
+    aes_store_be32(counter + 12, ctr);
+    _mm_storeu_si128((__m128i*)y, clmul_bswap(acc));
+}
+#endif
+
+#if defined(__aarch64__) && defined(__GNUC__)
+// The same algorithm with PMULL, which is part of the ARMv8 AES extension
+#define PMULL_INLINE static inline __attribute__((always_inline)) ARMV8_AES_TARGET
+
+PMULL_INLINE uint8x16_t pmull_bswap(uint8x16_t x) {
+    x = vrev64q_u8(x);
+    return vextq_u8(x, x, 8);
+}
+
+PMULL_INLINE uint8x16_t pmull_lo_lo(uint8x16_t a, uint8x16_t b) {
+    return vreinterpretq_u8_p128(vmull_p64((poly64_t)vgetq_lane_u64(vreinterpretq_u64_u8(a), 0),
+                                           (poly64_t)vgetq_lane_u64(vreinterpretq_u64_u8(b), 0)));
+}
+
+PMULL_INLINE uint8x16_t pmull_hi_hi(uint8x16_t a, uint8x16_t b) {
+    return vreinterpretq_u8_p128(vmull_high_p64(vreinterpretq_p64_u8(a), vreinterpretq_p64_u8(b)));
+}
+
+PMULL_INLINE void pmull_acc(uint8x16_t a, uint8x16_t b, uint8x16_t* lo, uint8x16_t* mid, uint8x16_t* hi) {
+    uint8x16_t a_swap = vextq_u8(a, a, 8);
+    *lo = veorq_u8(*lo, pmull_lo_lo(a, b));
+    *hi = veorq_u8(*hi, pmull_hi_hi(a, b));
+    // a.hi * b.lo and a.lo * b.hi
+    *mid = veorq_u8(*mid, veorq_u8(pmull_lo_lo(a_swap, b), pmull_hi_hi(a_swap, b)));
+}
+
+#define PMULL_SHL_BYTES(x, n) vextq_u8(vdupq_n_u8(0), (x), 16 - (n))
+#define PMULL_SHR_BYTES(x, n) vextq_u8((x), vdupq_n_u8(0), (n))
+#define PMULL_SHL32(x, n) vreinterpretq_u8_u32(vshlq_n_u32(vreinterpretq_u32_u8(x), (n)))
+#define PMULL_SHR32(x, n) vreinterpretq_u8_u32(vshrq_n_u32(vreinterpretq_u32_u8(x), (n)))
+
+PMULL_INLINE uint8x16_t pmull_reduce(uint8x16_t lo, uint8x16_t mid, uint8x16_t hi) {
+    uint8x16_t t3 = veorq_u8(lo, PMULL_SHL_BYTES(mid, 8));
+    uint8x16_t t6 = veorq_u8(hi, PMULL_SHR_BYTES(mid, 8));
+
+    uint8x16_t t7 = PMULL_SHR32(t3, 31);
+    uint8x16_t t8 = PMULL_SHR32(t6, 31);
+    t3 = PMULL_SHL32(t3, 1);
+    t6 = PMULL_SHL32(t6, 1);
+    uint8x16_t t9 = PMULL_SHR_BYTES(t7, 12);
+    t8 = PMULL_SHL_BYTES(t8, 4);
+    t7 = PMULL_SHL_BYTES(t7, 4);
+    t3 = vorrq_u8(t3, t7);
+    t6 = vorrq_u8(vorrq_u8(t6, t8), t9);
+
+    t7 = veorq_u8(veorq_u8(PMULL_SHL32(t3, 31), PMULL_SHL32(t3, 30)), PMULL_SHL32(t3, 25));
+    t8 = PMULL_SHR_BYTES(t7, 4);
+    t7 = PMULL_SHL_BYTES(t7, 12);
+    t3 = veorq_u8(t3, t7);
+    uint8x16_t t2 = veorq_u8(veorq_u8(PMULL_SHR32(t3, 1), PMULL_SHR32(t3, 2)), PMULL_SHR32(t3, 7));
+    t2 = veorq_u8(t2, t8);
+    t3 = veorq_u8(t3, t2);
+    return veorq_u8(t6, t3);
+}
+
+PMULL_INLINE uint8x16_t pmull_mul(uint8x16_t a, uint8x16_t b) {
+    uint8x16_t lo = vdupq_n_u8(0), mid = vdupq_n_u8(0), hi = vdupq_n_u8(0);
+    pmull_acc(a, b, &lo, &mid, &hi);
+    return pmull_reduce(lo, mid, hi);
+}
+
+ARMV8_AES_TARGET static void ghash_pmull_init(ghash_key_t* key, const uint8_t h[16]) {
+    uint8x16_t h1 = pmull_bswap(vld1q_u8(h));
+    uint8x16_t hn = h1;
+    for (int i = 0; i < GHASH_LANES; i++) {
+        vst1q_u8(key->powers[i], hn);
+        hn = pmull_mul(hn, h1);
+    }
+}
+
+PMULL_INLINE uint8x16_t pmull_ghash8(const ghash_key_t* key, uint8x16_t y, const uint8_t* data) {
+    uint8x16_t lo = vdupq_n_u8(0), mid = vdupq_n_u8(0), hi = vdupq_n_u8(0);
+    for (int i = 0; i < GHASH_LANES; i++) {
+        uint8x16_t b = pmull_bswap(vld1q_u8(data + i * 16));
+        if (i == 0) b = veorq_u8(b, y);
+        pmull_acc(b, vld1q_u8(key->powers[GHASH_LANES - 1 - i]), &lo, &mid, &hi);
+    }
+    return pmull_reduce(lo, mid, hi);
+}
+
+ARMV8_AES_TARGET static void ghash_pmull_blocks(const ghash_key_t* key, uint8_t y[16], const uint8_t* data, size_t blocks) {
+    uint8x16_t acc = pmull_bswap(vld1q_u8(y));
+    uint8x16_t h1 = vld1q_u8(key->powers[0]);
+
+    for (; blocks >= GHASH_LANES; blocks -= GHASH_LANES, data += GHASH_LANES * 16) {
+        acc = pmull_ghash8(key, acc, data);
+    }
+    for (; blocks > 0; blocks--, data += 16) {
+        acc = pmull_mul(veorq_u8(acc, pmull_bswap(vld1q_u8(data))), h1);
+    }
+    vst1q_u8(y, pmull_bswap(acc));
+}
+
+static const ghash_backend_t ghash_backend_pmull = {
+    "pmull",
+    ghash_pmull_init,
+    ghash_pmull_blocks
+};
+
+// ARMv8 AES CTR with the GHASH multiplies between rounds, as on x86
+ARMV8_AES_TARGET static void gcm_crypt_armv8(const crypto_aes_ctx_t* ctx, const ghash_key_t* key, uint8_t counter[16], uint8_t y[16],
+                                             const uint8_t* in, uint8_t* out, size_t blocks, int decrypt) {
+    uint8x16_t k[15], b[AES_HW_LANES];
+    armv8_aes_load_keys(ctx->key_schedule, ctx->rounds, k);
+
+    uint8x16_t acc = pmull_bswap(vld1q_u8(y));
+    uint32x4_t base = vreinterpretq_u32_u8(vld1q_u8(counter));
+    uint32_t ctr = aes_load_be32(counter + 12);
+    const uint8_t* pending = NULL;
+
+    for (; blocks >= AES_HW_LANES; blocks -= AES_HW_LANES) {
+        uint8x16_t lo = vdupq_n_u8(0), mid = vdupq_n_u8(0), hi = vdupq_n_u8(0);
+        if (decrypt) pending = in;
+
+        for (int i = 0; i < AES_HW_LANES; i++) {
+            b[i] = vreinterpretq_u8_u32(vsetq_lane_u32(__builtin_bswap32(ctr + (uint32_t)i), base, 3));
+        }
+        for (uint32_t r = 0; r < ctx->rounds - 1; r++) {
+            uint8x16_t round_key = k[r];
+            for (int i = 0; i < AES_HW_LANES; i++) b[i] = vaesmcq_u8(vaeseq_u8(b[i], round_key));
+            if (pending && r < GHASH_LANES) {
+                uint8x16_t x = pmull_bswap(vld1q_u8(pending + r * 16));
+                if (r == 0) x = veorq_u8(x, acc);
+                pmull_acc(x, vld1q_u8(key->powers[GHASH_LANES - 1 - r]), &lo, &mid, &hi);
+            }
+        }
+        if (pending) acc = pmull_reduce(lo, mid, hi);
+
+        for (int i = 0; i < AES_HW_LANES; i++) {
+            b[i] = veorq_u8(vaeseq_u8(b[i], k[ctx->rounds - 1]), k[ctx->rounds]);
+            vst1q_u8(out + i * 16, veorq_u8(b[i], vld1q_u8(in + i * 16)));
+        }
+        if (!decrypt) pending = out;
+
+        ctr += AES_HW_LANES;
+        in += AES_HW_LANES * 16;
+        out += AES_HW_LANES * 16;
+    }
+
+    if (!decrypt && pending) {
+        acc = pmull_ghash8(key, acc, pending);
+    }
+
+    uint8x16_t h1 = vld1q_u8(key->powers[0]);
+    for (; blocks > 0; blocks--) {
+        uint8x16_t data = vld1q_u8(in);
+        uint8x16_t ks = armv8_aes_encrypt1(k, ctx->rounds, vreinterpretq_u8_u32(vsetq_lane_u32(__builtin_bswap32(ctr), base, 3)));
+        uint8x16_t result = veorq_u8(ks, data);
+        vst1q_u8(out, result);
+        acc = pmull_mul(veorq_u8(acc, pmull_bswap(decrypt ? data : result)), h1);
+        ctr++;
+        in += 16;
+        out += 16;
+    }
+
+    aes_store_be32(counter + 12, ctr);
+    vst1q_u8(y, pmull_bswap(acc));
+}
+#endif
+
+static const ghash_backend_t* g_ghash_backend = &ghash_backend_generic;
+static gcm_crypt_fn g_gcm_crypt = NULL;
+
+static void ghash_select_backend(crypto_hw_support_t support) {
+    g_ghash_backend = &ghash_backend_generic;
+    g_gcm_crypt = NULL;
+#if defined(__x86_64__) && defined(__GNUC__)
+    if (support & CRYPTO_HW_INTEL_PCLMUL) {
+        g_ghash_backend = &ghash_backend_clmul;
+        if (support & CRYPTO_HW_INTEL_AESNI) g_gcm_crypt = gcm_crypt_aesni;
+    }
+#endif
+#if defined(__aarch64__) && defined(__GNUC__)
+    if ((support & CRYPTO_HW_ARM_PMULL) && (support & CRYPTO_HW_ARM_CRYPTO)) {
+        g_ghash_backend = &ghash_backend_pmull;
+        g_gcm_crypt = gcm_crypt_armv8;
+    }
+#endif
+    (void)support;
+}
+
+static const ghash_backend_t* ghash_backend(void) {
+    aes_backend(); // Selects the GHASH backend too on first use
+    return g_ghash_backend;
+}
+
+const char* crypto_ghash_backend_name(void) {
+    return ghash_backend()->name;
+}
+
+// Hash `len` bytes, zero-padding the last block
+static void ghash_update(const ghash_key_t* key, uint8_t y[16], const uint8_t* data, uint32_t len) {
+    const ghash_backend_t* backend = ghash_backend();
+
+    backend->blocks(key, y, data, len / 16);
+    if (len % 16) {
+        uint8_t block[16] = {0};
+        memcpy(block, data + (len & ~15u), len % 16);
+        backend->blocks(key, y, block, 1);
+    }
+}
+
+void aes_gcm_ghash(const uint8_t* h, const uint8_t* data, uint32_t len, uint8_t* result) {
+    ghash_key_t key;
+    uint8_t y[16] = {0};
+
+    ghash_backend()->init(&key, h);
+    ghash_update(&key, y, data, len);
+    memcpy(result, y, 16);
+    crypto_memzero_secure(&key, sizeof(key));
 }
 
 /* =========================
-   GCM – FIXED IMPLEMENTATION
+   GCM
    ========================= */
 
 static void gcm_build_j0(
-    const uint8_t *h,
+    const ghash_key_t *key,
     const uint8_t *iv, uint32_t iv_len,
     uint8_t j0[16]
 ) {
@@ -374,65 +1338,86 @@ static void gcm_build_j0(
         return;
     }
 
-    aes_gcm_ghash(h, iv, iv_len, j0);
-
     uint8_t len_block[16] = {0};
-    uint64_t iv_bits = (uint64_t)iv_len * 8;
+    ghash_store_be64(len_block + 8, (uint64_t)iv_len * 8);
 
-    for (int i = 0; i < 8; i++)
-        len_block[15 - i] = (iv_bits >> (i * 8)) & 0xFF;
-
-    xor_block(j0, j0, len_block);
-    aes_gcm_gf_mult(j0, h, j0);
+    ghash_update(key, j0, iv, iv_len);
+    ghash_backend()->blocks(key, j0, len_block, 1);
 }
 
-static void gcm_compute_tag(
+// Encrypt or decrypt and leave the tag in `tag`. The tag hashes the
+// ciphertext, so it is the output when encrypting and the input when
+// decrypting.
+static void gcm_crypt(
     const crypto_aes_ctx_t *ctx,
     const uint8_t *iv, uint32_t iv_len,
     const uint8_t *aad, uint32_t aad_len,
-    const uint8_t *ciphertext, uint32_t len,
-    uint8_t tag[16]
+    const uint8_t *in, uint32_t len,
+    uint8_t *out, uint8_t tag[16], int decrypt
 ) {
-    uint8_t h[16] = {0};
-    uint8_t j0[16];
-    uint8_t s[16] = {0};
-    uint8_t tmp[16];
+    const aes_backend_t *aes = aes_backend();
+    const ghash_backend_t *ghash = ghash_backend();
+    ghash_key_t key;
+    uint8_t h[16] = {0}, j0[16], counter[16], y[16] = {0};
 
-    crypto_aes_encrypt_block(ctx, h, h);
-    gcm_build_j0(h, iv, iv_len, j0);
+    aes->encrypt_blocks(ctx, h, h, 1);
+    ghash->init(&key, h);
+    gcm_build_j0(&key, iv, iv_len, j0);
 
     if (aad && aad_len)
-        aes_gcm_ghash(h, aad, aad_len, s);
+        ghash_update(&key, y, aad, aad_len);
+
+    memcpy(counter, j0, 16);
+    aes_gcm_inc32(counter);
 
-    if (len) {
-        aes_gcm_ghash(h, ciphertext, len, tmp);
-        xor_block(s, s, tmp);
-        aes_gcm_gf_mult(s, h, s);
+    uint32_t full = len / AES_BLOCK_SIZE;
+    if (g_gcm_crypt) {
+        g_gcm_crypt(ctx, &key, counter, y, in, out, full, decrypt);
+    } else {
+        // Keep each piece in cache between its CTR and GHASH passes
+        for (uint32_t done = 0; done < full; ) {
+            uint32_t n = (full - done < 64) ? full - done : 64;
+            const uint8_t *src = in + done * AES_BLOCK_SIZE;
+            uint8_t *dst = out + done * AES_BLOCK_SIZE;
+            if (decrypt) ghash->blocks(&key, y, src, n);
+            aes->ctr32(ctx, counter, src, dst, n);
+            if (!decrypt) ghash->blocks(&key, y, dst, n);
+            done += n;
+        }
     }
 
-    uint8_t len_block[16] = {0};
-    uint64_t a_bits = (uint64_t)aad_len * 8;
-    uint64_t c_bits = (uint64_t)len * 8;
+    uint32_t tail = len % AES_BLOCK_SIZE;
+    if (tail) {
+        uint8_t keystream[16], block[16] = {0};
+        const uint8_t *src = in + full * AES_BLOCK_SIZE;
+        uint8_t *dst = out + full * AES_BLOCK_SIZE;
 
-    for (int i = 0; i < 8; i++) {
-        len_block[7 - i]  = (a_bits >> (i * 8)) & 0xFF;
-        len_block[15 - i] = (c_bits >> (i * 8)) & 0xFF;
+        aes->encrypt_blocks(ctx, counter, keystream, 1);
+        for (uint32_t j = 0; j < tail; j++) {
+            block[j] = decrypt ? src[j] : (uint8_t)(src[j] ^ keystream[j]);
+            dst[j] = src[j] ^ keystream[j];
+        }
+        ghash->blocks(&key, y, block, 1);
+        crypto_memzero_secure(keystream, sizeof(keystream));
     }
 
-    xor_block(s, s, len_block);
-    aes_gcm_gf_mult(s, h, s);
+    uint8_t len_block[16];
+    ghash_store_be64(len_block, (uint64_t)aad_len * 8);
+    ghash_store_be64(len_block + 8, (uint64_t)len * 8);
+    ghash->blocks(&key, y, len_block, 1);
 
-    crypto_aes_encrypt_block(ctx, j0, tmp);
-    xor_block(tag, s, tmp);
+    aes->encrypt_blocks(ctx, j0, tag, 1);
+    xor_block(tag, tag, y);
 
+    crypto_memzero_secure(&key, sizeof(key));
     crypto_memzero_secure(h, sizeof(h));
     crypto_memzero_secure(j0, sizeof(j0));
-    crypto_memzero_secure(s, sizeof(s));
-    crypto_memzero_secure(tmp, sizeof(tmp));
+    crypto_memzero_secure(counter, sizeof(counter));
+    crypto_memzero_secure(y, sizeof(y));
 }
 
 /* =========================
-   GCM ENCRYPT (FIXED)
+   GCM ENCRYPT
    ========================= */
 
 int crypto_aes_gcm_encrypt(
@@ -442,35 +1427,19 @@ int crypto_aes_gcm_encrypt(
     const uint8_t* plaintext, uint32_t len,
     uint8_t* ciphertext, uint8_t* tag
 ) {
-    if (!ctx || !iv || !ciphertext || !tag)
+    if (!ctx || !iv || !iv_len || !tag || (len && (!plaintext || !ciphertext)))
         return CRYPTO_ERROR_INVALID_PARAM;
 
-    uint8_t counter[16];
-    uint8_t keystream[16];
-    uint8_t h[16] = {0};
-
-    crypto_aes_encrypt_block(ctx, h, h);
-    gcm_build_j0(h, iv, iv_len, counter);
-    aes_gcm_inc32(counter);
-
-    for (uint32_t i = 0; i < len; i += 16) {
-        crypto_aes_encrypt_block(ctx, counter, keystream);
-        uint32_t bl = (len - i < 16) ? len - i : 16;
-        for (uint32_t j = 0; j < bl; j++)
-            ciphertext[i + j] = plaintext[i + j] ^ keystream[j];
-        aes_gcm_inc32(counter);
-    }
-
-    gcm_compute_tag(ctx, iv, iv_len, aad, aad_len, ciphertext, len, tag);
-    crypto_memzero_secure(counter, sizeof(counter));
-    crypto_memzero_secure(keystream, sizeof(keystream));
+    gcm_crypt(ctx, iv, iv_len, aad, aad_len, plaintext, len, ciphertext, tag, 0);
     return CRYPTO_SUCCESS;
 }
 
 /* =========================
-   GCM DECRYPT (FIXED)
+   GCM DECRYPT
    ========================= */
 
+// One pass: the plaintext is written while the tag is computed, and wiped
+// again if the tag does not match
 int crypto_aes_gcm_decrypt(
     const crypto_aes_ctx_t* ctx,
     const uint8_t* iv, uint32_t iv_len,
@@ -479,45 +1448,126 @@ int crypto_aes_gcm_decrypt(
     const uint8_t* tag,
     uint8_t* plaintext
 ) {
-    if (!ctx || !iv || !ciphertext || !tag || !plaintext)
+    if (!ctx || !iv || !iv_len || !tag || (len && (!ciphertext || !plaintext)))
         return CRYPTO_ERROR_INVALID_PARAM;
 
     uint8_t expected_tag[16];
-    gcm_compute_tag(ctx, iv, iv_len, aad, aad_len, ciphertext, len, expected_tag);
+    gcm_crypt(ctx, iv, iv_len, aad, aad_len, ciphertext, len, plaintext, expected_tag, 1);
 
-    if (crypto_memcmp_constant_time(tag, expected_tag, 16) != 0)
-        return CRYPTO_ERROR_VERIFICATION_FAILED;
+    int result = CRYPTO_SUCCESS;
+    if (crypto_memcmp_constant_time(tag, expected_tag, 16) != 0) {
+        crypto_memzero_secure(plaintext, len);
+        result = CRYPTO_ERROR_VERIFICATION_FAILED;
+    }
 
-    uint8_t counter[16], keystream[16], h[16] = {0};
+    crypto_memzero_secure(expected_tag, sizeof(expected_tag));
+    return result;
+}
 
-    crypto_aes_encrypt_block(ctx, h, h);
-    gcm_build_j0(h, iv, iv_len, counter);
-    aes_gcm_inc32(counter);
+/* =========================
+   XTS (IEEE 1619)
+   ========================= */
 
-    for (uint32_t i = 0; i < len; i += 16) {
-        crypto_aes_encrypt_block(ctx, counter, keystream);
-        uint32_t bl = (len - i < 16) ? len - i : 16;
-        for (uint32_t j = 0; j < bl; j++)
-            plaintext[i + j] = ciphertext[i + j] ^ keystream[j];
-        aes_gcm_inc32(counter);
+// Multiply the tweak by x in GF(2^128), little-endian byte order
+static void xts_mul_alpha(uint8_t t[16]) {
+    uint8_t carry = t[15] >> 7;
+    for (int i = 15; i > 0; i--) {
+        t[i] = (uint8_t)((t[i] << 1) | (t[i - 1] >> 7));
     }
+    t[0] = (uint8_t)((t[0] << 1) ^ (carry ? 0x87 : 0));
+}
 
-    crypto_memzero_secure(expected_tag, sizeof(expected_tag));
-    crypto_memzero_secure(counter, sizeof(counter));
-    crypto_memzero_secure(keystream, sizeof(keystream));
+// Whole blocks, AES_HW_LANES at a time so the backend can overlap them
+static void xts_blocks(const crypto_aes_ctx_t* ctx, int decrypt, uint8_t t[16], const uint8_t* in, uint8_t* out, uint32_t blocks) {
+    const aes_backend_t* backend = aes_backend();
+    uint8_t tweaks[AES_HW_LANES * 16], buf[AES_HW_LANES * 16];
+
+    while (blocks > 0) {
+        uint32_t n = blocks < AES_HW_LANES ? blocks : AES_HW_LANES;
+        for (uint32_t i = 0; i < n; i++) {
+            memcpy(tweaks + i * 16, t, 16);
+            aes_xor16(buf + i * 16, in + i * 16, t);
+            xts_mul_alpha(t);
+        }
+        if (decrypt) {
+            backend->decrypt_blocks(ctx, buf, buf, n);
+        } else {
+            backend->encrypt_blocks(ctx, buf, buf, n);
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            aes_xor16(out + i * 16, buf + i * 16, tweaks + i * 16);
+        }
+        in += n * 16;
+        out += n * 16;
+        blocks -= n;
+    }
+
+    crypto_memzero_secure(tweaks, sizeof(tweaks));
+    crypto_memzero_secure(buf, sizeof(buf));
+}
+
+// One block with tweak `t`, through a bounce buffer so in == out works
+static void xts_block(const crypto_aes_ctx_t* ctx, int decrypt, const uint8_t t[16], const uint8_t* in, uint8_t* out) {
+    uint8_t tweak[16];
+    memcpy(tweak, t, 16);
+    xts_blocks(ctx, decrypt, tweak, in, out, 1);
+    crypto_memzero_secure(tweak, sizeof(tweak));
+}
+
+// `ctx1` holds the data key and `ctx2` the tweak key. A trailing partial
+// block uses ciphertext stealing.
+static int xts_crypt(const crypto_aes_ctx_t* ctx1, const crypto_aes_ctx_t* ctx2, const uint8_t* tweak, const uint8_t* in, uint32_t len, uint8_t* out, int decrypt) {
+    if (!ctx1 || !ctx2 || !tweak || !in || !out || len < AES_BLOCK_SIZE) {
+        return CRYPTO_ERROR_INVALID_PARAM;
+    }
+
+    uint8_t t[16], next[16], last[16], steal[16];
+    uint32_t tail = len % AES_BLOCK_SIZE;
+    uint32_t full = len / AES_BLOCK_SIZE;
+
+    crypto_aes_encrypt_block(ctx2, tweak, t);
+    xts_blocks(ctx1, decrypt, t, in, out, tail ? full - 1 : full);
+
+    if (tail) {
+        const uint8_t* in_last = in + (full - 1) * AES_BLOCK_SIZE;
+        uint8_t* out_last = out + (full - 1) * AES_BLOCK_SIZE;
+
+        // Decryption takes the blocks' tweaks in the opposite order
+        memcpy(next, t, 16);
+        xts_mul_alpha(next);
+        xts_block(ctx1, decrypt, decrypt ? next : t, in_last, last);
+
+        memcpy(steal, in_last + AES_BLOCK_SIZE, tail);
+        memcpy(steal + tail, last + tail, AES_BLOCK_SIZE - tail);
+        memcpy(out_last + AES_BLOCK_SIZE, last, tail);
+        xts_block(ctx1, decrypt, decrypt ? t : next, steal, out_last);
+    }
+
+    crypto_memzero_secure(t, sizeof(t));
+    crypto_memzero_secure(next, sizeof(next));
+    crypto_memzero_secure(last, sizeof(last));
+    crypto_memzero_secure(steal, sizeof(steal));
     return CRYPTO_SUCCESS;
 }
 
+int crypto_aes_xts_encrypt(const crypto_aes_ctx_t* ctx1, const crypto_aes_ctx_t* ctx2, const uint8_t* tweak, const uint8_t* plaintext, uint32_t len, uint8_t* ciphertext) {
+    return xts_crypt(ctx1, ctx2, tweak, plaintext, len, ciphertext, 0);
+}
+
+int crypto_aes_xts_decrypt(const crypto_aes_ctx_t* ctx1, const crypto_aes_ctx_t* ctx2, const uint8_t* tweak, const uint8_t* ciphertext, uint32_t len, uint8_t* plaintext) {
+    return xts_crypt(ctx1, ctx2, tweak, ciphertext, len, plaintext, 1);
+}
+
 /* =========================
-   AES-NI (SAFE DISABLED)
+   HARDWARE ACCELERATION
    ========================= */
 
 int aes_hw_available(void) {
-    return 0; /* Disabled: unsafe implementation removed */
+    return aes_backend() != &aes_backend_generic;
 }
 
 void aes_hw_encrypt_block(const uint8_t* key, uint32_t key_bits, const uint8_t* plaintext, uint8_t* ciphertext) {
-    // Fall back to software implementation
+    // Runs on whichever backend is active
     crypto_aes_ctx_t ctx;
     crypto_aes_init(&ctx, key, key_bits);
     crypto_aes_encrypt_block(&ctx, plaintext, ciphertext);
@@ -525,13 +1575,194 @@ void aes_hw_encrypt_block(const uint8_t* key, uint32_t key_bits, const uint8_t*
 }
 
 void aes_hw_decrypt_block(const uint8_t* key, uint32_t key_bits, const uint8_t* ciphertext, uint8_t* plaintext) {
-    // Fall back to software implementation
+    // Runs on whichever backend is active
     crypto_aes_ctx_t ctx;
     crypto_aes_init(&ctx, key, key_bits);
     crypto_aes_decrypt_block(&ctx, ciphertext, plaintext);
     crypto_zeroize_context(&ctx, sizeof(ctx));
 }
 
+int crypto_aes_hw_encrypt_block(const uint8_t* key, uint32_t key_bits, const uint8_t* plaintext, uint8_t* ciphertext) {
+    if (!key || !plaintext || !ciphertext || (key_bits != 128 && key_bits != 192 && key_bits != 256)) {
+        return CRYPTO_ERROR_INVALID_PARAM;
+    }
+    if (!aes_hw_available()) return CRYPTO_ERROR_HARDWARE_UNAVAILABLE;
+    aes_hw_encrypt_block(key, key_bits, plaintext, ciphertext);
+    return CRYPTO_SUCCESS;
+}
+
+int crypto_aes_hw_decrypt_block(const uint8_t* key, uint32_t key_bits, const uint8_t* ciphertext, uint8_t* plaintext) {
+    if (!key || !ciphertext || !plaintext || (key_bits != 128 && key_bits != 192 && key_bits != 256)) {
+        return CRYPTO_ERROR_INVALID_PARAM;
+    }
+    if (!aes_hw_available()) return CRYPTO_ERROR_HARDWARE_UNAVAILABLE;
+    aes_hw_decrypt_block(key, key_bits, ciphertext, plaintext);
+    return CRYPTO_SUCCESS;
+}
+
+// Bulk operation `op` of a backend, for the self-test cross-check
+static void aes_backend_run(const aes_backend_t* backend, int op, const crypto_aes_ctx_t* ctx, uint8_t iv[16], const uint8_t* in, uint8_t* out, size_t blocks) {
+    switch (op) {
+    case 0: backend->ctr32(ctx, iv, in, out, blocks); break;
+    case 1: backend->encrypt_blocks(ctx, in, out, blocks); break;
+    case 2: backend->decrypt_blocks(ctx, in, out, blocks); break;
+    case 3: backend->cbc_encrypt(ctx, iv, in, out, blocks); break;
+    default: backend->cbc_decrypt(ctx, iv, in, out, blocks); break;
+    }
+}
+
+// GCM test case 4 from McGrew and Viega, then the carry-less multiply
+// GHASH and the fused CTR+GHASH loop against the portable code
+static int aes_self_test_gcm(void) {
+    const uint8_t key[16] = {
+        0xfe, 0xff, 0xe9, 0x92, 0x86, 0x65, 0x73, 0x1c, 0x6d, 0x6a, 0x8f, 0x94, 0x67, 0x30, 0x83, 0x08
+    };
+    const uint8_t iv[12] = {
+        0xca, 0xfe, 0xba, 0xbe, 0xfa, 0xce, 0xdb, 0xad, 0xde, 0xca, 0xf8, 0x88
+    };
+    const uint8_t aad[20] = {
+        0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef, 0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef,
+        0xab, 0xad, 0xda, 0xd2
+    };
+    const uint8_t plaintext[60] = {
+        0xd9, 0x31, 0x32, 0x25, 0xf8, 0x84, 0x06, 0xe5, 0xa5, 0x59, 0x09, 0xc5, 0xaf, 0xf5, 0x26, 0x9a,
+        0x86, 0xa7, 0xa9, 0x53, 0x15, 0x34, 0xf7, 0xda, 0x2e, 0x4c, 0x30, 0x3d, 0x8a, 0x31, 0x8a, 0x72,
+        0x1c, 0x3c, 0x0c, 0x95, 0x95, 0x68, 0x09, 0x53, 0x2f, 0xcf, 0x0e, 0x24, 0x49, 0xa6, 0xb5, 0x25,
+        0xb1, 0x6a, 0xed, 0xf5, 0xaa, 0x0d, 0xe6, 0x57, 0xba, 0x63, 0x7b, 0x39
+    };
+    const uint8_t expected[60] = {
+        0x42, 0x83, 0x1e, 0xc2, 0x21, 0x77, 0x74, 0x24, 0x4b, 0x72, 0x21, 0xb7, 0x84, 0xd0, 0xd4, 0x9c,
+        0xe3, 0xaa, 0x21, 0x2f, 0x2c, 0x02, 0xa4, 0xe0, 0x35, 0xc1, 0x7e, 0x23, 0x29, 0xac, 0xa1, 0x2e,
+        0x21, 0xd5, 0x14, 0xb2, 0x54, 0x66, 0x93, 0x1c, 0x7d, 0x8f, 0x6a, 0x5a, 0xac, 0x84, 0xaa, 0x05,
+        0x1b, 0xa3, 0x0b, 0x39, 0x6a, 0x0a, 0xac, 0x97, 0x3d, 0x58, 0xe0, 0x91
+    };
+    const uint8_t expected_tag[16] = {
+        0x5b, 0xc9, 0x4f, 0xbc, 0x32, 0x21, 0xa5, 0xdb, 0x94, 0xfa, 0xe9, 0x5a, 0xe7, 0x12, 0x1a, 0x47
+    };
+
+    crypto_aes_ctx_t ctx;
+    uint8_t out[60], tag[16];
+    int result = CRYPTO_SUCCESS;
+
+    crypto_aes_init(&ctx, key, 128);
+    crypto_aes_gcm_encrypt(&ctx, iv, sizeof(iv), aad, sizeof(aad), plaintext, sizeof(plaintext), out, tag);
+    if (crypto_memcmp_constant_time(out, expected, sizeof(out)) != 0 ||
+        crypto_memcmp_constant_time(tag, expected_tag, sizeof(tag)) != 0 ||
+        crypto_aes_gcm_decrypt(&ctx, iv, sizeof(iv), aad, sizeof(aad), expected, sizeof(expected), expected_tag, out) != CRYPTO_SUCCESS ||
+        crypto_memcmp_constant_time(out, plaintext, sizeof(out)) != 0) {
+        result = CRYPTO_ERROR_VERIFICATION_FAILED;
+    }
+
+    // Two full batches and a partial one
+    if (result == CRYPTO_SUCCESS && g_ghash_backend != &ghash_backend_generic) {
+        enum { BLOCKS = 2 * GHASH_LANES + 3 };
+        uint8_t data[BLOCKS * 16], hw[BLOCKS * 16], sw[BLOCKS * 16];
+        uint8_t hw_y[16] = {0}, sw_y[16] = {0}, hw_ctr[16], sw_ctr[16];
+        ghash_key_t hw_key, sw_key;
+
+        for (uint32_t i = 0; i < sizeof(data); i++) {
+            data[i] = (uint8_t)(i * 97 + 41);
+        }
+        g_ghash_backend->init(&hw_key, data);
+        ghash_generic_init(&sw_key, data);
+        g_ghash_backend->blocks(&hw_key, hw_y, data, BLOCKS);
+        ghash_generic_blocks(&sw_key, sw_y, data, BLOCKS);
+        if (crypto_memcmp_constant_time(hw_y, sw_y, 16) != 0) result = CRYPTO_ERROR_VERIFICATION_FAILED;
+
+        for (int decrypt = 0; decrypt < 2 && g_gcm_crypt && result == CRYPTO_SUCCESS; decrypt++) {
+            memcpy(hw_ctr, data + 16, 16);
+            memcpy(sw_ctr, data + 16, 16);
+            g_gcm_crypt(&ctx, &hw_key, hw_ctr, hw_y, data, hw, BLOCKS, decrypt);
+            aes_generic_ctr32(&ctx, sw_ctr, data, sw, BLOCKS);
+            ghash_generic_blocks(&sw_key, sw_y, decrypt ? data : sw, BLOCKS);
+            if (crypto_memcmp_constant_time(hw, sw, sizeof(hw)) != 0 ||
+                crypto_memcmp_constant_time(hw_y, sw_y, 16) != 0 ||
+                crypto_memcmp_constant_time(hw_ctr, sw_ctr, 16) != 0) {
+                result = CRYPTO_ERROR_VERIFICATION_FAILED;
+            }
+        }
+
+        if (result != CRYPTO_SUCCESS) {
+            crypto_aes_select_backend(CRYPTO_HW_NONE);
+        }
+        crypto_memzero_secure(&hw_key, sizeof(hw_key));
+        crypto_memzero_secure(&sw_key, sizeof(sw_key));
+    }
+
+    crypto_zeroize_context(&ctx, sizeof(ctx));
+    return result;
+}
+
+int crypto_self_test_aes(void) {
+    // FIPS 197 appendix C.1 and C.3: the same plaintext under a 128-bit
+    // and a 256-bit key
+    const uint8_t key[32] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+        0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f
+    };
+    const uint8_t plaintext[16] = {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+    };
+    const uint8_t expected[2][16] = {
+        { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a },
+        { 0x8e, 0xa2, 0xb7, 0xca, 0x51, 0x67, 0x45, 0xbf, 0xea, 0xfc, 0x49, 0x90, 0x4b, 0x49, 0x60, 0x89 }
+    };
+    const uint32_t key_bits[2] = { 128, 256 };
+
+    crypto_aes_ctx_t ctx;
+    uint8_t block[16];
+    int result = CRYPTO_SUCCESS;
+
+    for (int i = 0; i < 2 && result == CRYPTO_SUCCESS; i++) {
+        if (crypto_aes_init(&ctx, key, key_bits[i]) != CRYPTO_SUCCESS) return CRYPTO_ERROR_VERIFICATION_FAILED;
+        crypto_aes_encrypt_block(&ctx, plaintext, block);
+        if (crypto_memcmp_constant_time(block, expected[i], 16) != 0) result = CRYPTO_ERROR_VERIFICATION_FAILED;
+        crypto_aes_decrypt_block(&ctx, expected[i], block);
+        if (crypto_memcmp_constant_time(block, plaintext, 16) != 0) result = CRYPTO_ERROR_VERIFICATION_FAILED;
+    }
+
+    // The accelerated backend must agree with the portable one on each
+    // bulk operation, over more blocks than it keeps in flight; if it does
+    // not, drop back to the portable code
+    const aes_backend_t* backend = aes_backend();
+    if (result == CRYPTO_SUCCESS && backend != &aes_backend_generic) {
+        enum { BLOCKS = AES_HW_LANES + 3 };
+        uint8_t data[BLOCKS * 16], hw[BLOCKS * 16], sw[BLOCKS * 16];
+        uint8_t start_iv[16], hw_iv[16], sw_iv[16];
+
+        for (uint32_t i = 0; i < sizeof(data); i++) {
+            data[i] = (uint8_t)(i * 151 + 7);
+        }
+        // 192-bit key, and a counter that wraps within the run
+        crypto_aes_init(&ctx, data, 192);
+        memset(start_iv, 0xFF, sizeof(start_iv));
+        start_iv[15] = 0xFA;
+
+        for (int op = 0; op < 5 && result == CRYPTO_SUCCESS; op++) {
+            memcpy(hw_iv, start_iv, 16);
+            memcpy(sw_iv, start_iv, 16);
+            aes_backend_run(backend, op, &ctx, hw_iv, data, hw, BLOCKS);
+            aes_backend_run(&aes_backend_generic, op, &ctx, sw_iv, data, sw, BLOCKS);
+            if (crypto_memcmp_constant_time(hw, sw, sizeof(hw)) != 0 ||
+                crypto_memcmp_constant_time(hw_iv, sw_iv, sizeof(hw_iv)) != 0) {
+                result = CRYPTO_ERROR_VERIFICATION_FAILED;
+            }
+        }
+
+        if (result != CRYPTO_SUCCESS) {
+            crypto_aes_select_backend(CRYPTO_HW_NONE);
+        }
+        crypto_memzero_secure(hw, sizeof(hw));
+        crypto_memzero_secure(sw, sizeof(sw));
+    }
+
+    crypto_zeroize_context(&ctx, sizeof(ctx));
+    if (result == CRYPTO_SUCCESS) {
+        result = aes_self_test_gcm();
+    }
+    return result;
+}
+
 // Legacy function (for backward compatibility)
 void aes_encrypt_block(const uint8_t* in, uint8_t* out, const uint8_t* key) {
     // Simple XOR implementation
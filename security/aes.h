@@ -18,12 +18,14 @@
 // Legacy function (for backward compatibility)
 void aes_encrypt_block(const uint8_t* in, uint8_t* out, const uint8_t* key);
 
-// Extended AES functionality
+// Extended AES functionality; both block functions take the encryption
+// schedule from aes_key_expansion
 int aes_key_expansion(const uint8_t* key, uint32_t key_bits, uint32_t* round_keys);
 void aes_encrypt_block_ex(const uint32_t* round_keys, uint32_t rounds, const uint8_t* plaintext, uint8_t* ciphertext);
 void aes_decrypt_block_ex(const uint32_t* round_keys, uint32_t rounds, const uint8_t* ciphertext, uint8_t* plaintext);
 
-// Hardware acceleration detection and usage
+// Hardware acceleration detection and usage: nonzero when AES-NI or
+// ARMv8 AES is the active backend
 int aes_hw_available(void);
 void aes_hw_encrypt_block(const uint8_t* key, uint32_t key_bits, const uint8_t* plaintext, uint8_t* ciphertext);
 void aes_hw_decrypt_block(const uint8_t* key, uint32_t key_bits, const uint8_t* ciphertext, uint8_t* plaintext);
@@ -33,9 +35,4 @@ void aes_gcm_gf_mult(const uint8_t* a, const uint8_t* b, uint8_t* result);
 void aes_gcm_ghash(const uint8_t* h, const uint8_t* data, uint32_t len, uint8_t* result);
 void aes_gcm_inc32(uint8_t* block);
 
-// Internal GCM helper functions
-static void xor_block(uint8_t* dst, const uint8_t* a, const uint8_t* b);
-static void gcm_build_j0(const uint8_t* h, const uint8_t* iv, uint32_t iv_len, uint8_t j0[16]);
-static void gcm_compute_tag(const crypto_aes_ctx_t* ctx, const uint8_t* iv, uint32_t iv_len, const uint8_t* aad, uint32_t aad_len, const uint8_t* ciphertext, uint32_t len, uint8_t tag[16]);
-
 #endif
@@ -0,0 +1,193 @@
+/*
+ * authenticode.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include "authenticode.h"
+#include "compat.h"
+#include "crypto.h"
+#include <stdint.h>
+#include <string.h>
+
+#define PE32_MAGIC              0x10b
+#define PE32PLUS_MAGIC          0x20b
+#define PE_SECTION_SIZE         40
+#define PE_DIRECTORY_SECURITY   4
+
+static uint32_t load16(const uint8_t* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8;
+}
+
+static uint32_t load32(const uint8_t* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static int add_range(authenticode_ctx_t* ctx, uint64_t start, uint64_t end) {
+    if (end <= start) return 0;
+    if (ctx->range_count == AUTHENTICODE_MAX_RANGES) return CRYPTO_ERROR_NOT_SUPPORTED;
+    // One pass in file order: every range has to start where the last ended or later
+    if (ctx->range_count && start < ctx->ranges[ctx->range_count - 1].end) return CRYPTO_ERROR_NOT_SUPPORTED;
+    ctx->ranges[ctx->range_count].start = start;
+    ctx->ranges[ctx->range_count].end = end;
+    ctx->range_count++;
+    return 0;
+}
+
+// 1 once the headers are in and the ranges are laid out, 0 while more
+// header bytes are needed, negative for an image that is not PE
+static int parse_headers(authenticode_ctx_t* ctx) {
+    const uint8_t* h = ctx->header;
+    uint32_t have = ctx->header_len;
+
+    if (have < 0x40) return 0;
+    if (h[0] != 'M' || h[1] != 'Z') return CRYPTO_ERROR_INVALID_PARAM;
+    uint32_t pe = load32(h + 0x3c);
+    if (pe > AUTHENTICODE_HEADER_MAX - 24 - 96) return CRYPTO_ERROR_INVALID_PARAM;
+    if (have < pe + 24 + 64) return 0;
+    if (memcmp(h + pe, "PE\0\0", 4) != 0) return CRYPTO_ERROR_INVALID_PARAM;
+
+    uint32_t sections = load16(h + pe + 6);
+    uint32_t opt_size = load16(h + pe + 20);
+    uint32_t opt = pe + 24;
+    uint32_t magic = load16(h + opt);
+    uint32_t count_off = magic == PE32_MAGIC ? 92 : magic == PE32PLUS_MAGIC ? 108 : 0;
+    if (!count_off || opt_size < count_off + 4 || sections > AUTHENTICODE_MAX_SECTIONS) {
+        return CRYPTO_ERROR_INVALID_PARAM;
+    }
+
+    uint32_t size_of_headers = load32(h + opt + 60);
+    uint32_t table = opt + opt_size;
+    if (size_of_headers > AUTHENTICODE_HEADER_MAX || table + sections * PE_SECTION_SIZE > size_of_headers) {
+        return CRYPTO_ERROR_NOT_SUPPORTED;
+    }
+    if (have < size_of_headers) return 0;
+
+    uint32_t checksum = opt + 64;
+    uint32_t dir_count = load32(h + opt + count_off);
+    uint32_t cert_dir = opt + count_off + 4 + PE_DIRECTORY_SECURITY * 8;
+    int has_cert_dir = dir_count > PE_DIRECTORY_SECURITY && cert_dir + 8 <= table;
+    uint64_t cert_offset = has_cert_dir ? load32(h + cert_dir) : 0;
+    uint64_t cert_size = has_cert_dir ? load32(h + cert_dir + 4) : 0;
+
+    int rc = add_range(ctx, 0, checksum);
+    if (rc == 0 && has_cert_dir) {
+        rc = add_range(ctx, checksum + 4, cert_dir);
+        if (rc == 0) rc = add_range(ctx, cert_dir + 8, size_of_headers);
+    } else if (rc == 0) {
+        rc = add_range(ctx, checksum + 4, size_of_headers);
+    }
+    if (rc) return rc;
+
+    // Sections by PointerToRawData (insertion sort; there are few)
+    uint32_t order[AUTHENTICODE_MAX_SECTIONS];
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < sections; i++) {
+        const uint8_t* s = h + table + i * PE_SECTION_SIZE;
+        if (load32(s + 16) == 0) continue;
+        uint32_t j = n++;
+        while (j > 0 && load32(h + table + order[j - 1] * PE_SECTION_SIZE + 20) > load32(s + 20)) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    uint64_t hashed = size_of_headers;
+    for (uint32_t i = 0; i < n; i++) {
+        const uint8_t* s = h + table + order[i] * PE_SECTION_SIZE;
+        uint64_t raw = load32(s + 20), raw_size = load32(s + 16);
+        rc = add_range(ctx, raw, raw + raw_size);
+        if (rc) return rc;
+        hashed += raw_size;
+    }
+
+    // Whatever follows the sections, short of the certificate table
+    if (cert_size) {
+        rc = add_range(ctx, hashed, cert_offset);
+    } else {
+        rc = add_range(ctx, hashed, UINT64_MAX);
+    }
+    return rc ? rc : 1;
+}
+
+// Hash the parts of [offset, offset + len) that fall in a range
+static void feed(authenticode_ctx_t* ctx, const uint8_t* data, uint32_t len) {
+    while (len && ctx->range < ctx->range_count) {
+        const authenticode_range_t* r = &ctx->ranges[ctx->range];
+        uint32_t step;
+        if (ctx->offset < r->start) {
+            uint64_t gap = r->start - ctx->offset;
+            step = gap < len ? (uint32_t)gap : len;
+        } else if (ctx->offset < r->end) {
+            uint64_t rest = r->end - ctx->offset;
+            step = rest < len ? (uint32_t)rest : len;
+            crypto_sha256_update(&ctx->ctx, data, step);
+        } else {
+            ctx->range++;
+            continue;
+        }
+        data += step;
+        len -= step;
+        ctx->offset += step;
+    }
+    ctx->offset += len;
+}
+
+void authenticode_init(authenticode_ctx_t* ctx) {
+    crypto_sha256_init(&ctx->ctx);
+    ctx->offset = 0;
+    ctx->header_len = 0;
+    ctx->range_count = 0;
+    ctx->range = 0;
+    ctx->status = CRYPTO_SUCCESS;
+    ctx->parsed = 0;
+}
+
+int authenticode_update(authenticode_ctx_t* ctx, const uint8_t* data, uint32_t len) {
+    if (!ctx || (!data && len)) return CRYPTO_ERROR_INVALID_PARAM;
+    if (ctx->status != CRYPTO_SUCCESS) return ctx->status;
+
+    if (!ctx->parsed) {
+        uint32_t take = AUTHENTICODE_HEADER_MAX - ctx->header_len;
+        if (take > len) take = len;
+        memcpy(ctx->header + ctx->header_len, data, take);
+        ctx->header_len += take;
+        data += take;
+        len -= take;
+
+        int rc = parse_headers(ctx);
+        if (rc == 0) {
+            // Still short of SizeOfHeaders, which fits the buffer
+            if (ctx->header_len == AUTHENTICODE_HEADER_MAX) ctx->status = CRYPTO_ERROR_NOT_SUPPORTED;
+            return ctx->status;
+        }
+        if (rc < 0) {
+            ctx->status = rc;
+            return rc;
+        }
+        ctx->parsed = 1;
+        feed(ctx, ctx->header, ctx->header_len);
+    }
+
+    feed(ctx, data, len);
+    return CRYPTO_SUCCESS;
+}
+
+int authenticode_final(authenticode_ctx_t* ctx, uint8_t* digest) {
+    if (!ctx || !digest) return CRYPTO_ERROR_INVALID_PARAM;
+    if (ctx->status == CRYPTO_SUCCESS && !ctx->parsed) ctx->status = CRYPTO_ERROR_INVALID_PARAM;
+    // A file cut short of a range it names
+    for (uint32_t i = ctx->range; ctx->status == CRYPTO_SUCCESS && i < ctx->range_count; i++) {
+        if (ctx->ranges[i].end != UINT64_MAX && ctx->offset < ctx->ranges[i].end) {
+            ctx->status = CRYPTO_ERROR_VERIFICATION_FAILED;
+        }
+    }
+
+    crypto_sha256_final(&ctx->ctx, digest);
+    if (ctx->status != CRYPTO_SUCCESS) {
+        crypto_memzero_secure(digest, CRYPTO_SHA256_DIGEST_LENGTH);
+    }
+    return ctx->status;
+}
@@ -0,0 +1,48 @@
+/*
+ * authenticode.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_AUTHENTICODE_H
+#define BLOODHORN_AUTHENTICODE_H
+#include <stdint.h>
+#include "compat.h"
+#include "crypto.h"
+
+// Authenticode SHA-256 of a PE/COFF image fed in file order, in pieces of
+// any size, so it can run beside the read instead of after it. The headers
+// are kept until SizeOfHeaders bytes are in; from then on nothing is
+// buffered. What is hashed follows the Authenticode spec (and the UEFI
+// DxeImageVerificationLib): the headers without the CheckSum field and
+// the certificate directory entry, the sections in PointerToRawData order,
+// then anything after them up to the certificate table. An image whose
+// sections overlap each other or the headers cannot be hashed in one pass
+// and fails with CRYPTO_ERROR_NOT_SUPPORTED.
+#define AUTHENTICODE_HEADER_MAX     (16 * 1024)
+#define AUTHENTICODE_MAX_SECTIONS   96
+#define AUTHENTICODE_MAX_RANGES     (AUTHENTICODE_MAX_SECTIONS + 4)
+
+typedef struct {
+    uint64_t start;
+    uint64_t end;                       // UINT64_MAX: to the end of the file
+} authenticode_range_t;
+
+typedef struct {
+    crypto_sha256_ctx_t ctx;
+    uint64_t offset;                    // File bytes consumed so far
+    uint32_t header_len;                // Bytes in header before parsing
+    uint32_t range_count;
+    uint32_t range;                     // Range being hashed
+    int status;                         // Sticky: first failure wins
+    int parsed;
+    authenticode_range_t ranges[AUTHENTICODE_MAX_RANGES];
+    uint8_t header[AUTHENTICODE_HEADER_MAX];
+} authenticode_ctx_t;
+
+void authenticode_init(authenticode_ctx_t* ctx);
+int authenticode_update(authenticode_ctx_t* ctx, const uint8_t* data, uint32_t len);
+// Fails unless the image parsed and every range it names was seen
+int authenticode_final(authenticode_ctx_t* ctx, uint8_t* digest);
+#endif
@@ -0,0 +1,43 @@
+/*
+ * bignum.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_BIGNUM_H
+#define BLOODHORN_BIGNUM_H
+#include <stdint.h>
+#include "compat.h"
+
+// Limb arithmetic shared by the RSA and elliptic-curve code. Numbers are
+// little-endian arrays of 64-bit limbs.
+typedef uint64_t bn_limb_t;
+
+// 64x64 -> 128 multiply-accumulate: returns the low half of a * b + c + d
+// and stores the high half in *hi. The sum cannot overflow 128 bits.
+#if defined(__SIZEOF_INT128__)
+static inline bn_limb_t bn_mac(bn_limb_t a, bn_limb_t b, bn_limb_t c, bn_limb_t d, bn_limb_t* hi) {
+    unsigned __int128 t = (unsigned __int128)a * b + c + d;
+    *hi = (bn_limb_t)(t >> 64);
+    return (bn_limb_t)t;
+}
+#else
+static inline bn_limb_t bn_mac(bn_limb_t a, bn_limb_t b, bn_limb_t c, bn_limb_t d, bn_limb_t* hi) {
+    uint64_t a0 = (uint32_t)a, a1 = a >> 32;
+    uint64_t b0 = (uint32_t)b, b1 = b >> 32;
+    uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+    uint64_t mid = (p00 >> 32) + (uint32_t)p01 + (uint32_t)p10;
+    uint64_t lo = (mid << 32) | (uint32_t)p00;
+    uint64_t h = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+
+    lo += c;
+    h += (lo < c);
+    lo += d;
+    h += (lo < d);
+    *hi = h;
+    return lo;
+}
+#endif
+
+#endif
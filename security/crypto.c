@@ -10,6 +10,7 @@
 #include <string.h>
 #include "crypto.h"
 #include "entropy.h"
+#include "drbg.h"
 
 // Global hardware support flags
 static crypto_hw_support_t g_hw_support = CRYPTO_HW_NONE;
@@ -66,44 +67,408 @@ static uint32_t gamma1(uint32_t x) {
     return rotr(x, 17) ^ rotr(x, 19) ^ (x >> 10);
 }
 
+// SHA-256 compression backends. Each one processes `blocks` consecutive
+// 64-byte blocks; crypto_sha256_compress dispatches to the fastest one the
+// CPU supports.
+typedef void (*sha256_blocks_fn)(uint32_t state[8], const uint8_t* data, size_t blocks);
+
+static void sha256_blocks_generic(uint32_t state[8], const uint8_t* data, size_t blocks) {
+    uint32_t w[64];
+
+    while (blocks--) {
+        for (int j = 0; j < 16; j++) {
+            w[j] = ((uint32_t)data[j*4] << 24) | ((uint32_t)data[j*4 + 1] << 16) |
+                   ((uint32_t)data[j*4 + 2] << 8) | data[j*4 + 3];
+        }
+        for (int j = 16; j < 64; j++) {
+            w[j] = gamma1(w[j-2]) + w[j-7] + gamma0(w[j-15]) + w[j-16];
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h_val = state[7];
+
+        for (int j = 0; j < 64; j++) {
+            uint32_t temp1 = h_val + sigma1(e) + ch(e, f, g) + sha256_k[j] + w[j];
+            uint32_t temp2 = sigma0(a) + maj(a, b, c);
+            h_val = g; g = f; f = e; e = d + temp1;
+            d = c; c = b; b = a; a = temp1 + temp2;
+        }
+
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h_val;
+        data += 64;
+    }
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+
+#define SHA_NI_TARGET __attribute__((target("sha,sse4.1")))
+
+// Next four message words from the previous sixteen
+static inline SHA_NI_TARGET __m128i sha256_ni_schedule(__m128i w0, __m128i w1, __m128i w2, __m128i w3) {
+    __m128i t = _mm_add_epi32(_mm_sha256msg1_epu32(w0, w1), _mm_alignr_epi8(w3, w2, 4));
+    return _mm_sha256msg2_epu32(t, w3);
+}
+
+// Four rounds; the state is kept as ABEF/CDGH as SHA256RNDS2 expects
+#define SHA_NI_ROUNDS(msg, i) do {                                                      \
+        __m128i wk = _mm_add_epi32(msg, _mm_loadu_si128((const __m128i*)&sha256_k[(i) * 4])); \
+        state1 = _mm_sha256rnds2_epu32(state1, state0, wk);                             \
+        state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(wk, 0x0E));     \
+    } while (0)
+
+static SHA_NI_TARGET void sha256_blocks_shani(uint32_t state[8], const uint8_t* data, size_t blocks) {
+    const __m128i byteswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xB1);     // CDAB
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1B);  // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);                                      // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);                                           // CDGH
+
+    while (blocks--) {
+        __m128i abef = state0, cdgh = state1;
+        __m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 0)), byteswap);
+        __m128i m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), byteswap);
+        __m128i m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), byteswap);
+        __m128i m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), byteswap);
+
+        for (int i = 0; i < 12; i += 4) {
+            SHA_NI_ROUNDS(m0, i);
+            m0 = sha256_ni_schedule(m0, m1, m2, m3);
+            SHA_NI_ROUNDS(m1, i + 1);
+            m1 = sha256_ni_schedule(m1, m2, m3, m0);
+            SHA_NI_ROUNDS(m2, i + 2);
+            m2 = sha256_ni_schedule(m2, m3, m0, m1);
+            SHA_NI_ROUNDS(m3, i + 3);
+            m3 = sha256_ni_schedule(m3, m0, m1, m2);
+        }
+        SHA_NI_ROUNDS(m0, 12);
+        SHA_NI_ROUNDS(m1, 13);
+        SHA_NI_ROUNDS(m2, 14);
+        SHA_NI_ROUNDS(m3, 15);
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+        data += 64;
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);                                   // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1);                                // DCHG
+    _mm_storeu_si128((__m128i*)&state[0], _mm_blend_epi16(tmp, state1, 0xF0));    // DCBA
+    _mm_storeu_si128((__m128i*)&state[4], _mm_alignr_epi8(state1, tmp, 8));       // HGFE
+}
+#endif
+
+#if defined(__aarch64__) && defined(__GNUC__)
+#include <arm_neon.h>
+
+#if defined(__clang__)
+#define ARMV8_SHA2_TARGET __attribute__((target("sha2")))
+#else
+#define ARMV8_SHA2_TARGET __attribute__((target("+crypto")))
+#endif
+
+static ARMV8_SHA2_TARGET void sha256_blocks_armv8(uint32_t state[8], const uint8_t* data, size_t blocks) {
+    uint32x4_t abcd = vld1q_u32(&state[0]);
+    uint32x4_t efgh = vld1q_u32(&state[4]);
+
+    while (blocks--) {
+        uint32x4_t abcd_saved = abcd, efgh_saved = efgh;
+        uint32x4_t m[4];
+
+        for (int i = 0; i < 4; i++) {
+            m[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + i * 16)));
+        }
+        for (int i = 0; i < 16; i++) {
+            uint32x4_t wk = vaddq_u32(m[i & 3], vld1q_u32(&sha256_k[i * 4]));
+            uint32x4_t abcd_prev = abcd;
+            if (i < 12) {
+                m[i & 3] = vsha256su1q_u32(vsha256su0q_u32(m[i & 3], m[(i + 1) & 3]),
+                                           m[(i + 2) & 3], m[(i + 3) & 3]);
+            }
+            abcd = vsha256hq_u32(abcd, efgh, wk);
+            efgh = vsha256h2q_u32(efgh, abcd_prev, wk);
+        }
+
+        abcd = vaddq_u32(abcd, abcd_saved);
+        efgh = vaddq_u32(efgh, efgh_saved);
+        data += 64;
+    }
+
+    vst1q_u32(&state[0], abcd);
+    vst1q_u32(&state[4], efgh);
+}
+#endif
+
+// Multi-buffer SHA-256: one independent message per 32-bit SIMD lane.
+// state[j][lane] holds word j of every lane so a row is one vector, and
+// blocks[lane] is the next 64-byte block of that lane's message.
+typedef void (*sha256_lanes_fn)(uint32_t state[8][8], const uint8_t* const blocks[8]);
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+#define SHA256_X8_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+
+// Eight rows of eight words become eight columns
+static inline AVX2_TARGET void sha256_x8_transpose(__m256i r[8]) {
+    __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]), t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+    __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]), t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+    __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]), t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+    __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]), t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+    __m256i u0 = _mm256_unpacklo_epi64(t0, t2), u1 = _mm256_unpackhi_epi64(t0, t2);
+    __m256i u2 = _mm256_unpacklo_epi64(t1, t3), u3 = _mm256_unpackhi_epi64(t1, t3);
+    __m256i u4 = _mm256_unpacklo_epi64(t4, t6), u5 = _mm256_unpackhi_epi64(t4, t6);
+    __m256i u6 = _mm256_unpacklo_epi64(t5, t7), u7 = _mm256_unpackhi_epi64(t5, t7);
+    r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+    r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+    r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+    r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+    r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+    r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+    r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+    r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+static AVX2_TARGET void sha256_lanes_avx2(uint32_t state[8][8], const uint8_t* const blocks[8]) {
+    const __m256i byteswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                              3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    __m256i w[16], v[8], saved[8];
+
+    for (int half = 0; half < 2; half++) {
+        __m256i* r = &w[half * 8];
+        for (int lane = 0; lane < 8; lane++) {
+            r[lane] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(blocks[lane] + half * 32)), byteswap);
+        }
+        sha256_x8_transpose(r);
+    }
+
+    for (int j = 0; j < 8; j++) {
+        saved[j] = v[j] = _mm256_loadu_si256((const __m256i*)state[j]);
+    }
+
+    for (int t = 0; t < 64; t++) {
+        if (t >= 16) {
+            __m256i w15 = w[(t - 15) & 15], w2 = w[(t - 2) & 15];
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(SHA256_X8_ROTR(w15, 7), SHA256_X8_ROTR(w15, 18)),
+                                          _mm256_srli_epi32(w15, 3));
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(SHA256_X8_ROTR(w2, 17), SHA256_X8_ROTR(w2, 19)),
+                                          _mm256_srli_epi32(w2, 10));
+            w[t & 15] = _mm256_add_epi32(_mm256_add_epi32(w[t & 15], s0),
+                                         _mm256_add_epi32(w[(t - 7) & 15], s1));
+        }
+
+        __m256i a = v[0], b = v[1], c = v[2], e = v[4], f = v[5], g = v[6];
+        __m256i S1 = _mm256_xor_si256(_mm256_xor_si256(SHA256_X8_ROTR(e, 6), SHA256_X8_ROTR(e, 11)),
+                                      SHA256_X8_ROTR(e, 25));
+        __m256i ch = _mm256_xor_si256(g, _mm256_and_si256(e, _mm256_xor_si256(f, g)));
+        __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(v[7], S1),
+                                      _mm256_add_epi32(_mm256_add_epi32(ch, w[t & 15]),
+                                                       _mm256_set1_epi32((int)sha256_k[t])));
+        __m256i S0 = _mm256_xor_si256(_mm256_xor_si256(SHA256_X8_ROTR(a, 2), SHA256_X8_ROTR(a, 13)),
+                                      SHA256_X8_ROTR(a, 22));
+        __m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+
+        v[7] = g; v[6] = f; v[5] = e;
+        v[4] = _mm256_add_epi32(v[3], t1);
+        v[3] = c; v[2] = b; v[1] = a;
+        v[0] = _mm256_add_epi32(t1, _mm256_add_epi32(S0, maj));
+    }
+
+    for (int j = 0; j < 8; j++) {
+        _mm256_storeu_si256((__m256i*)state[j], _mm256_add_epi32(v[j], saved[j]));
+    }
+}
+#endif
+
+#if defined(__aarch64__) && defined(__GNUC__)
+#define SHA256_X4_ROTR(x, n) vorrq_u32(vshrq_n_u32(x, n), vshlq_n_u32(x, 32 - (n)))
+
+// Plain NEON, for cores without the SHA-256 instructions; four lanes
+static void sha256_lanes_neon(uint32_t state[8][8], const uint8_t* const blocks[8]) {
+    uint32x4_t w[16], v[8], saved[8];
+
+    for (int q = 0; q < 4; q++) {
+        uint32x4_t r[4];
+        for (int lane = 0; lane < 4; lane++) {
+            r[lane] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks[lane] + q * 16)));
+        }
+        uint32x4x2_t t01 = vtrnq_u32(r[0], r[1]);
+        uint32x4x2_t t23 = vtrnq_u32(r[2], r[3]);
+        w[q * 4 + 0] = vcombine_u32(vget_low_u32(t01.val[0]), vget_low_u32(t23.val[0]));
+        w[q * 4 + 1] = vcombine_u32(vget_low_u32(t01.val[1]), vget_low_u32(t23.val[1]));
+        w[q * 4 + 2] = vcombine_u32(vget_high_u32(t01.val[0]), vget_high_u32(t23.val[0]));
+        w[q * 4 + 3] = vcombine_u32(vget_high_u32(t01.val[1]), vget_high_u32(t23.val[1]));
+    }
+
+    for (int j = 0; j < 8; j++) {
+        saved[j] = v[j] = vld1q_u32(state[j]);
+    }
+
+    for (int t = 0; t < 64; t++) {
+        if (t >= 16) {
+            uint32x4_t w15 = w[(t - 15) & 15], w2 = w[(t - 2) & 15];
+            uint32x4_t s0 = veorq_u32(veorq_u32(SHA256_X4_ROTR(w15, 7), SHA256_X4_ROTR(w15, 18)),
+                                      vshrq_n_u32(w15, 3));
+            uint32x4_t s1 = veorq_u32(veorq_u32(SHA256_X4_ROTR(w2, 17), SHA256_X4_ROTR(w2, 19)),
+                                      vshrq_n_u32(w2, 10));
+            w[t & 15] = vaddq_u32(vaddq_u32(w[t & 15], s0), vaddq_u32(w[(t - 7) & 15], s1));
+        }
+
+        uint32x4_t a = v[0], b = v[1], c = v[2], e = v[4], f = v[5], g = v[6];
+        uint32x4_t S1 = veorq_u32(veorq_u32(SHA256_X4_ROTR(e, 6), SHA256_X4_ROTR(e, 11)), SHA256_X4_ROTR(e, 25));
+        uint32x4_t ch = veorq_u32(g, vandq_u32(e, veorq_u32(f, g)));
+        uint32x4_t t1 = vaddq_u32(vaddq_u32(v[7], S1),
+                                  vaddq_u32(vaddq_u32(ch, w[t & 15]), vdupq_n_u32(sha256_k[t])));
+        uint32x4_t S0 = veorq_u32(veorq_u32(SHA256_X4_ROTR(a, 2), SHA256_X4_ROTR(a, 13)), SHA256_X4_ROTR(a, 22));
+        uint32x4_t maj = vorrq_u32(vandq_u32(a, b), vandq_u32(c, vorrq_u32(a, b)));
+
+        v[7] = g; v[6] = f; v[5] = e;
+        v[4] = vaddq_u32(v[3], t1);
+        v[3] = c; v[2] = b; v[1] = a;
+        v[0] = vaddq_u32(t1, vaddq_u32(S0, maj));
+    }
+
+    for (int j = 0; j < 8; j++) {
+        vst1q_u32(state[j], vaddq_u32(v[j], saved[j]));
+    }
+}
+#endif
+
+static sha256_blocks_fn g_sha256_blocks = NULL;
+static sha256_lanes_fn g_sha256_lanes = NULL;
+static uint32_t g_sha256_lane_count = 0;
+static const char* g_sha256_backend = "generic";
+
+// Pick the SHA-256 backend for the enabled hardware features. Lanes are
+// only used without SHA instructions: one SHA-NI or ARMv8 stream already
+// outruns eight AVX2 lanes.
+static void sha256_select_backend(crypto_hw_support_t support) {
+    g_sha256_blocks = sha256_blocks_generic;
+    g_sha256_backend = "generic";
+    g_sha256_lanes = NULL;
+    g_sha256_lane_count = 0;
+#if defined(__x86_64__) && defined(__GNUC__)
+    if (support & CRYPTO_HW_INTEL_SHA) {
+        g_sha256_blocks = sha256_blocks_shani;
+        g_sha256_backend = "sha-ni";
+    } else if (support & CRYPTO_HW_INTEL_AVX2) {
+        g_sha256_lanes = sha256_lanes_avx2;
+        g_sha256_lane_count = 8;
+    }
+#endif
+#if defined(__aarch64__) && defined(__GNUC__)
+    if (support & CRYPTO_HW_ARM_SHA2) {
+        g_sha256_blocks = sha256_blocks_armv8;
+        g_sha256_backend = "armv8-sha2";
+    } else {
+        g_sha256_lanes = sha256_lanes_neon;
+        g_sha256_lane_count = 4;
+    }
+#endif
+}
+
 // Hardware detection
 crypto_hw_support_t crypto_detect_hardware_support(void) {
     crypto_hw_support_t support = CRYPTO_HW_NONE;
+#if defined(__x86_64__) || defined(__i386__)
     uint32_t eax, ebx, ecx, edx;
-    
-    // Check for AES-NI support (CPUID.01H:ECX.AES[bit 25])
+    uint32_t max_leaf;
+
     __asm__ volatile (
-        "movl $1, %%eax\n\t"
         "cpuid\n\t"
-        : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
-        :
+        : "=a" (max_leaf), "=b" (ebx), "=c" (ecx), "=d" (edx)
+        : "a" (0)
         : "memory"
     );
-    
-    if (ecx & (1 << 25)) support |= CRYPTO_HW_INTEL_AESNI;
-    
-    // Check for SHA extensions (CPUID.07H:EBX.SHA[bit 29])
+
+    // Check for AES-NI support (CPUID.01H:ECX.AES[bit 25])
     __asm__ volatile (
-        "movl $7, %%eax\n\t"
-        "movl $0, %%ecx\n\t"
         "cpuid\n\t"
         : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
-        :
+        : "a" (1)
         : "memory"
     );
-    
-    if (ebx & (1 << 29)) support |= CRYPTO_HW_INTEL_SHA;
-    
+
+    // The SHA-NI path also shuffles with SSSE3 and blends with SSE4.1, and
+    // the AES-NI path builds counter blocks with SSE4.1
+    uint32_t has_sse41 = (ecx & (1 << 9)) && (ecx & (1 << 19));
+
+    if ((ecx & (1 << 25)) && has_sse41) support |= CRYPTO_HW_INTEL_AESNI;
+    // PCLMULQDQ (bit 1); GHASH byte-swaps with SSSE3 as well
+    if ((ecx & (1 << 1)) && has_sse41) support |= CRYPTO_HW_INTEL_PCLMUL;
+
+    // AVX state must be enabled in XCR0 (SSE and YMM bits), which firmware
+    // does not always do
+    uint32_t has_avx_state = 0, has_avx512_state = 0;
+    if ((ecx & (1 << 27)) && (ecx & (1 << 28))) {
+        uint32_t xcr0_lo, xcr0_hi;
+        __asm__ volatile ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+        has_avx_state = (xcr0_lo & 0x6) == 0x6;
+        has_avx512_state = (xcr0_lo & 0xE6) == 0xE6;
+    }
+
+    // Check for SHA extensions (CPUID.07H:EBX.SHA[bit 29])
+    if (max_leaf >= 7) {
+        __asm__ volatile (
+            "cpuid\n\t"
+            : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+            : "a" (7), "c" (0)
+            : "memory"
+        );
+
+        if ((ebx & (1 << 29)) && has_sse41) support |= CRYPTO_HW_INTEL_SHA;
+        // AVX2 (bit 5) together with BMI2 (bit 8) for RORX in the rounds
+        if ((ebx & (1 << 5)) && (ebx & (1 << 8)) && has_avx_state) support |= CRYPTO_HW_INTEL_AVX2;
+        // AVX-512F (bit 16), with the opmask and ZMM state enabled as well
+        if ((ebx & (1 << 16)) && has_avx512_state) support |= CRYPTO_HW_INTEL_AVX512;
+    }
+#elif defined(__aarch64__)
+    uint64_t isar0;
+
+    // ID_AA64ISAR0_EL1: AES in bits [7:4] (1 = AES, 2 = AES and PMULL),
+    // SHA2 in bits [15:12] (1 = SHA-256, 2 = SHA-256 and SHA-512)
+    __asm__ volatile ("mrs %0, ID_AA64ISAR0_EL1" : "=r" (isar0));
+
+    if ((isar0 >> 4) & 0xF) support |= CRYPTO_HW_ARM_CRYPTO;
+    if (((isar0 >> 4) & 0xF) >= 2) support |= CRYPTO_HW_ARM_PMULL;
+    if ((isar0 >> 12) & 0xF) support |= CRYPTO_HW_ARM_SHA2;
+    if (((isar0 >> 12) & 0xF) >= 2) support |= CRYPTO_HW_ARM_SHA512;
+#endif
+
     return support;
 }
 
 int crypto_init_hardware_acceleration(crypto_hw_support_t hw_mask) {
     g_hw_support = crypto_detect_hardware_support() & hw_mask;
+    sha256_select_backend(g_hw_support);
+    crypto_sha512_select_backend(g_hw_support);
+    crypto_blake3_select_backend(g_hw_support);
+    crypto_aes_select_backend(g_hw_support);
     return CRYPTO_SUCCESS;
 }
 
 void crypto_cleanup_hardware(void) {
     g_hw_support = CRYPTO_HW_NONE;
+    sha256_select_backend(CRYPTO_HW_NONE);
+    crypto_sha512_select_backend(CRYPTO_HW_NONE);
+    crypto_blake3_select_backend(CRYPTO_HW_NONE);
+    crypto_aes_select_backend(CRYPTO_HW_NONE);
+}
+
+const char* crypto_sha256_backend_name(void) {
+    if (!g_sha256_blocks) {
+        sha256_select_backend(crypto_detect_hardware_support());
+    }
+    return g_sha256_backend;
+}
+
+void crypto_sha256_compress(uint32_t state[8], const uint8_t* blocks, size_t count) {
+    if (!g_sha256_blocks) {
+        // Nobody called crypto_init_hardware_acceleration: use all we have
+        sha256_select_backend(crypto_detect_hardware_support());
+    }
+    g_sha256_blocks(state, blocks, count);
 }
 
 // Enhanced SHA-256 with streaming support
@@ -122,42 +487,31 @@ int crypto_sha256_update(crypto_sha256_ctx_t* ctx, const uint8_t* data, uint32_t
     if (!ctx || !data) return CRYPTO_ERROR_INVALID_PARAM;
     
     ctx->len += len;
-    
-    while (len > 0) {
-        uint32_t chunk_size = (ctx->buf_len + len > 64) ? (64 - ctx->buf_len) : len;
+
+    // Top up a partial block first
+    if (ctx->buf_len > 0) {
+        uint32_t chunk_size = (len < 64 - ctx->buf_len) ? len : (64 - ctx->buf_len);
         memcpy(ctx->buf + ctx->buf_len, data, chunk_size);
         ctx->buf_len += chunk_size;
         data += chunk_size;
         len -= chunk_size;
-        
-        if (ctx->buf_len == 64) {
-            // Process block
-            uint32_t w[64];
-            
-            for (int j = 0; j < 16; j++) {
-                w[j] = (ctx->buf[j*4] << 24) | (ctx->buf[j*4 + 1] << 16) |
-                       (ctx->buf[j*4 + 2] << 8) | ctx->buf[j*4 + 3];
-            }
-            for (int j = 16; j < 64; j++) {
-                w[j] = gamma1(w[j-2]) + w[j-7] + gamma0(w[j-15]) + w[j-16];
-            }
-            
-            uint32_t a = ctx->h[0], b = ctx->h[1], c = ctx->h[2], d = ctx->h[3];
-            uint32_t e = ctx->h[4], f = ctx->h[5], g = ctx->h[6], h_val = ctx->h[7];
-            
-            for (int j = 0; j < 64; j++) {
-                uint32_t temp1 = h_val + sigma1(e) + ch(e, f, g) + sha256_k[j] + w[j];
-                uint32_t temp2 = sigma0(a) + maj(a, b, c);
-                h_val = g; g = f; f = e; e = d + temp1;
-                d = c; c = b; b = a; a = temp1 + temp2;
-            }
-            
-            ctx->h[0] += a; ctx->h[1] += b; ctx->h[2] += c; ctx->h[3] += d;
-            ctx->h[4] += e; ctx->h[5] += f; ctx->h[6] += g; ctx->h[7] += h_val;
-            
-            ctx->buf_len = 0;
+
+        if (ctx->buf_len < 64) {
+            return CRYPTO_SUCCESS;
         }
+        crypto_sha256_compress(ctx->h, ctx->buf, 1);
+        ctx->buf_len = 0;
     }
+
+    // Whole blocks go straight from the caller's buffer in one call
+    if (len >= 64) {
+        crypto_sha256_compress(ctx->h, data, len / 64);
+        data += len & ~63u;
+        len &= 63;
+    }
+
+    memcpy(ctx->buf, data, len);
+    ctx->buf_len = len;
     
     return CRYPTO_SUCCESS;
 }
@@ -166,28 +520,28 @@ int crypto_sha256_final(crypto_sha256_ctx_t* ctx, uint8_t* hash) {
     if (!ctx || !hash) return CRYPTO_ERROR_INVALID_PARAM;
     
     // Pre-processing: adding padding bits
-    uint64_t msg_len = ctx->len;
-    uint64_t bit_len = msg_len * 8;
+    uint64_t bit_len = ctx->len * 8;
     
     // Append '1' bit
     ctx->buf[ctx->buf_len++] = 0x80;
     
-    // Append '0' bits until message length ≡ 448 (mod 512)
-    while (ctx->buf_len % 64 != 56) {
-        if (ctx->buf_len == 64) {
-            crypto_sha256_update(ctx, ctx->buf, 64);
-            ctx->buf_len = 0;
-        }
-        ctx->buf[ctx->buf_len++] = 0x00;
+    // Append '0' bits until message length ≡ 448 (mod 512), spilling into
+    // a second block when the length field no longer fits
+    if (ctx->buf_len > 56) {
+        memset(ctx->buf + ctx->buf_len, 0, 64 - ctx->buf_len);
+        crypto_sha256_compress(ctx->h, ctx->buf, 1);
+        ctx->buf_len = 0;
     }
+    memset(ctx->buf + ctx->buf_len, 0, 56 - ctx->buf_len);
     
     // Append original length in bits as 64-bit big-endian integer
-    for (int i = 7; i >= 0; i--) {
-        ctx->buf[ctx->buf_len++] = (bit_len >> (i * 8)) & 0xFF;
+    for (int i = 0; i < 8; i++) {
+        ctx->buf[56 + i] = (bit_len >> ((7 - i) * 8)) & 0xFF;
     }
     
     // Process final block
-    crypto_sha256_update(ctx, ctx->buf, ctx->buf_len);
+    crypto_sha256_compress(ctx->h, ctx->buf, 1);
+    ctx->buf_len = 0;
     
     // Produce final hash value
     for (int i = 0; i < 8; i++) {
@@ -208,136 +562,345 @@ void sha256_hash(const uint8_t* data, uint32_t len, uint8_t* hash) {
     crypto_zeroize_context(&ctx, sizeof(ctx));
 }
 
-// HMAC-SHA256 implementation (needed for encrypted filesystems)
-void crypto_hmac_sha256(const uint8_t* key, uint32_t key_len, const uint8_t* data, uint32_t data_len, uint8_t* mac) {
+// SHA-256 that refuses to run without a hardware backend
+int crypto_sha256_hw_hash(const uint8_t* data, uint32_t len, uint8_t* hash) {
+    if (!data || !hash) return CRYPTO_ERROR_INVALID_PARAM;
+
+    if (!g_sha256_blocks) {
+        sha256_select_backend(crypto_detect_hardware_support());
+    }
+    if (g_sha256_blocks == sha256_blocks_generic) {
+        return CRYPTO_ERROR_HARDWARE_UNAVAILABLE;
+    }
+
+    sha256_hash(data, len, hash);
+    return CRYPTO_SUCCESS;
+}
+
+// One multi-buffer lane: the message body still to go, then its padding
+typedef struct {
+    crypto_sha256_job_t* job;
+    const uint8_t* body;
+    size_t body_blocks;
+    uint32_t tail_blocks;
+    uint32_t tail_next;
+    uint8_t tail[128];
+} sha256_lane_t;
+
+static void sha256_lane_load(sha256_lane_t* lane, crypto_sha256_job_t* job) {
+    uint32_t rem = job->len % 64;
+    uint64_t bits = (uint64_t)job->len * 8;
+
+    lane->job = job;
+    lane->body = job->data;
+    lane->body_blocks = job->len / 64;
+    lane->tail_blocks = rem < 56 ? 1 : 2;
+    lane->tail_next = 0;
+
+    memset(lane->tail, 0, sizeof(lane->tail));
+    if (rem) memcpy(lane->tail, job->data + job->len - rem, rem);
+    lane->tail[rem] = 0x80;
+    for (int i = 0; i < 8; i++) {
+        lane->tail[lane->tail_blocks * 64 - 1 - i] = (uint8_t)(bits >> (8 * i));
+    }
+}
+
+static const uint8_t* sha256_lane_next(sha256_lane_t* lane) {
+    const uint8_t* block;
+    if (lane->body_blocks) {
+        block = lane->body;
+        lane->body += 64;
+        lane->body_blocks--;
+    } else {
+        block = lane->tail + 64 * lane->tail_next++;
+    }
+    return block;
+}
+
+static void sha256_store_digest(const uint32_t state[8], uint8_t* digest) {
+    for (int i = 0; i < 8; i++) {
+        digest[i*4] = (uint8_t)(state[i] >> 24);
+        digest[i*4 + 1] = (uint8_t)(state[i] >> 16);
+        digest[i*4 + 2] = (uint8_t)(state[i] >> 8);
+        digest[i*4 + 3] = (uint8_t)state[i];
+    }
+}
+
+// SHA-256 of several independent messages at once. Without SHA
+// instructions the messages are interleaved across SIMD lanes, each lane
+// picking up the next job as soon as its current one is done; with them,
+// or for a single job, they are simply hashed one after another.
+int crypto_sha256_multi(crypto_sha256_job_t* jobs, uint32_t count) {
+    static const uint8_t idle_block[64];
+    sha256_lane_t lanes[CRYPTO_SHA256_MB_MAX_LANES];
+    uint32_t state[8][8];
+    const uint8_t* blocks[8];
+    uint32_t next = 0, active = 0, width;
+
+    if (!jobs && count) return CRYPTO_ERROR_INVALID_PARAM;
+    for (uint32_t i = 0; i < count; i++) {
+        if (!jobs[i].digest || (!jobs[i].data && jobs[i].len)) return CRYPTO_ERROR_INVALID_PARAM;
+    }
+
+    if (!g_sha256_blocks) {
+        sha256_select_backend(crypto_detect_hardware_support());
+    }
+    if (!g_sha256_lanes || count < 2) {
+        for (uint32_t i = 0; i < count; i++) {
+            sha256_hash(jobs[i].data, jobs[i].len, jobs[i].digest);
+        }
+        return CRYPTO_SUCCESS;
+    }
+
+    width = g_sha256_lane_count;
+    memset(lanes, 0, sizeof(lanes));
+    for (;;) {
+        for (uint32_t l = 0; l < width; l++) {
+            if (!lanes[l].job && next < count) {
+                sha256_lane_load(&lanes[l], &jobs[next++]);
+                for (int j = 0; j < 8; j++) state[j][l] = sha256_h[j];
+                active++;
+            }
+        }
+        if (!active) break;
+
+        // The last straggler is cheaper to finish on its own than to keep
+        // driving every lane for it
+        if (active == 1 && next == count) {
+            for (uint32_t l = 0; l < width; l++) {
+                if (!lanes[l].job) continue;
+                uint32_t column[8];
+                for (int j = 0; j < 8; j++) column[j] = state[j][l];
+                if (lanes[l].body_blocks) g_sha256_blocks(column, lanes[l].body, lanes[l].body_blocks);
+                g_sha256_blocks(column, lanes[l].tail + 64 * lanes[l].tail_next,
+                                lanes[l].tail_blocks - lanes[l].tail_next);
+                sha256_store_digest(column, lanes[l].job->digest);
+                crypto_memzero_secure(&lanes[l], sizeof(lanes[l]));
+            }
+            break;
+        }
+
+        for (uint32_t l = 0; l < width; l++) {
+            blocks[l] = lanes[l].job ? sha256_lane_next(&lanes[l]) : idle_block;
+        }
+        g_sha256_lanes(state, blocks);
+
+        for (uint32_t l = 0; l < width; l++) {
+            if (lanes[l].job && !lanes[l].body_blocks && lanes[l].tail_next == lanes[l].tail_blocks) {
+                uint32_t column[8];
+                for (int j = 0; j < 8; j++) column[j] = state[j][l];
+                sha256_store_digest(column, lanes[l].job->digest);
+                crypto_memzero_secure(&lanes[l], sizeof(lanes[l]));
+                active--;
+            }
+        }
+    }
+
+    crypto_memzero_secure(state, sizeof(state));
+    return CRYPTO_SUCCESS;
+}
+
+int crypto_hmac_sha256_init(crypto_hmac_sha256_ctx_t* ctx, const uint8_t* key, uint32_t key_len) {
     uint8_t k_pad[64];
-    uint8_t inner_hash[32];
-    
-    // Prepare key
-    memset(k_pad, 0, 64);
+
+    if (!ctx || (!key && key_len)) return CRYPTO_ERROR_INVALID_PARAM;
+
+    memset(k_pad, 0, sizeof(k_pad));
     if (key_len > 64) {
         sha256_hash(key, key_len, k_pad);
-    } else {
+    } else if (key_len) {
         memcpy(k_pad, key, key_len);
     }
-    
-    // Inner hash: SHA256(k_pad XOR 0x36 || data)
+
     for (int i = 0; i < 64; i++) k_pad[i] ^= 0x36;
-    
-    crypto_sha256_ctx_t ctx;
-    crypto_sha256_init(&ctx);
-    crypto_sha256_update(&ctx, k_pad, 64);
-    crypto_sha256_update(&ctx, data, data_len);
-    crypto_sha256_final(&ctx, inner_hash);
-    
-    // Outer hash: SHA256(k_pad XOR 0x5c || inner_hash)
+    crypto_sha256_init(&ctx->inner_ctx);
+    crypto_sha256_update(&ctx->inner_ctx, k_pad, 64);
+
     for (int i = 0; i < 64; i++) k_pad[i] ^= 0x36 ^ 0x5c; // Undo 0x36, apply 0x5c
-    
-    crypto_sha256_init(&ctx);
-    crypto_sha256_update(&ctx, k_pad, 64);
-    crypto_sha256_update(&ctx, inner_hash, 32);
-    crypto_sha256_final(&ctx, mac);
-    
+    crypto_sha256_init(&ctx->outer_ctx);
+    crypto_sha256_update(&ctx->outer_ctx, k_pad, 64);
+
+    ctx->ctx = ctx->inner_ctx;
     crypto_memzero_secure(k_pad, sizeof(k_pad));
+    return CRYPTO_SUCCESS;
+}
+
+int crypto_hmac_sha256_update(crypto_hmac_sha256_ctx_t* ctx, const uint8_t* data, uint32_t len) {
+    if (!ctx) return CRYPTO_ERROR_INVALID_PARAM;
+    return crypto_sha256_update(&ctx->ctx, data, len);
+}
+
+int crypto_hmac_sha256_final(crypto_hmac_sha256_ctx_t* ctx, uint8_t* mac) {
+    uint8_t inner_hash[32];
+
+    if (!ctx || !mac) return CRYPTO_ERROR_INVALID_PARAM;
+
+    crypto_sha256_final(&ctx->ctx, inner_hash);
+    ctx->ctx = ctx->outer_ctx;
+    crypto_sha256_update(&ctx->ctx, inner_hash, 32);
+    crypto_sha256_final(&ctx->ctx, mac);
+
+    ctx->ctx = ctx->inner_ctx;
     crypto_memzero_secure(inner_hash, sizeof(inner_hash));
+    return CRYPTO_SUCCESS;
+}
+
+// HMAC-SHA256 implementation (needed for encrypted filesystems)
+void crypto_hmac_sha256(const uint8_t* key, uint32_t key_len, const uint8_t* data, uint32_t data_len, uint8_t* mac) {
+    crypto_hmac_sha256_ctx_t ctx;
+
+    crypto_hmac_sha256_init(&ctx, key, key_len);
+    crypto_hmac_sha256_update(&ctx, data, data_len);
+    crypto_hmac_sha256_final(&ctx, mac);
     crypto_zeroize_context(&ctx, sizeof(ctx));
 }
 
-// PBKDF2-SHA256 for key derivation (needed for encrypted filesystems)
+// PBKDF2-SHA256 for key derivation (needed for encrypted filesystems).
+// Every U_i after the first is the HMAC of a 32-byte value, which fits one
+// padded block, so each iteration is exactly two compressions from the
+// precomputed pad states with no buffering in between.
 int crypto_pbkdf2_sha256(const uint8_t* password, uint32_t password_len, const uint8_t* salt, uint32_t salt_len, uint32_t iterations, uint8_t* derived_key, uint32_t key_len) {
     if (!password || !salt || !derived_key || iterations == 0 || key_len == 0) {
         return CRYPTO_ERROR_INVALID_PARAM;
     }
-    
+
+    crypto_hmac_sha256_ctx_t hmac;
+    uint8_t block[64];
+    uint32_t state[8];
     uint32_t blocks_needed = (key_len + 31) / 32;
+
+    crypto_hmac_sha256_init(&hmac, password, password_len);
+
+    // [U 32][0x80][zeros][bit length of ipad/opad block + 32 bytes = 768]
+    memset(block, 0, sizeof(block));
+    block[32] = 0x80;
+    block[62] = 0x03;
     
-    for (uint32_t block = 1; block <= blocks_needed; block++) {
-        uint8_t u[32], f[32];
+    for (uint32_t n = 1; n <= blocks_needed; n++) {
+        uint8_t f[32];
+        uint8_t index[4] = { (uint8_t)(n >> 24), (uint8_t)(n >> 16), (uint8_t)(n >> 8), (uint8_t)n };
         
         // First iteration: U1 = HMAC(password, salt || block_number)
-        uint8_t salt_block[salt_len + 4];
-        memcpy(salt_block, salt, salt_len);
-        salt_block[salt_len] = (block >> 24) & 0xFF;
-        salt_block[salt_len + 1] = (block >> 16) & 0xFF;
-        salt_block[salt_len + 2] = (block >> 8) & 0xFF;
-        salt_block[salt_len + 3] = block & 0xFF;
-        
-        crypto_hmac_sha256(password, password_len, salt_block, salt_len + 4, u);
-        memcpy(f, u, 32);
+        crypto_hmac_sha256_update(&hmac, salt, salt_len);
+        crypto_hmac_sha256_update(&hmac, index, sizeof(index));
+        crypto_hmac_sha256_final(&hmac, block);
+        memcpy(f, block, 32);
         
         // Remaining iterations: Ui = HMAC(password, Ui-1), F = F XOR Ui
         for (uint32_t i = 2; i <= iterations; i++) {
-            crypto_hmac_sha256(password, password_len, u, 32, u);
+            memcpy(state, hmac.inner_ctx.h, sizeof(state));
+            crypto_sha256_compress(state, block, 1);
+            sha256_store_digest(state, block);
+            memcpy(state, hmac.outer_ctx.h, sizeof(state));
+            crypto_sha256_compress(state, block, 1);
+            sha256_store_digest(state, block);
             for (int j = 0; j < 32; j++) {
-                f[j] ^= u[j];
+                f[j] ^= block[j];
             }
         }
         
         // Copy result to output
-        uint32_t copy_len = (key_len < 32) ? key_len : 32;
-        if (block == blocks_needed && key_len % 32 != 0) {
-            copy_len = key_len % 32;
-        }
-        memcpy(derived_key + (block - 1) * 32, f, copy_len);
+        uint32_t copy_len = key_len < 32 ? key_len : 32;
+        memcpy(derived_key + (n - 1) * 32, f, copy_len);
         key_len -= copy_len;
         
-        crypto_memzero_secure(u, sizeof(u));
         crypto_memzero_secure(f, sizeof(f));
     }
-    
+
+    crypto_memzero_secure(block, sizeof(block));
+    crypto_memzero_secure(state, sizeof(state));
+    crypto_zeroize_context(&hmac, sizeof(hmac));
     return CRYPTO_SUCCESS;
 }
 
-// Secure random number generation
-static uint32_t g_rng_state[4] = {0};
+// Secure random number generation: one HMAC_DRBG, seeded from
+// entropy_gather and reseeded from it whenever the DRBG's interval runs
+// out. Large requests are generated in bulk; small ones (xids, ports,
+// IVs) come out of a buffered block so each does not pay for a generate.
+#define CRYPTO_RNG_ENTROPY_LENGTH   32
+#define CRYPTO_RNG_NONCE_LENGTH     16
+#define CRYPTO_RNG_BUFFER_SIZE      64
+
+static hmac_drbg_t g_rng;
+static uint8_t g_rng_buffer[CRYPTO_RNG_BUFFER_SIZE];
+static uint32_t g_rng_buffered = 0;     // unread bytes at the end of the buffer
 static int g_rng_initialized = 0;
 
 int crypto_random_init(void) {
-    // Seed from hardware entropy and current time
-    g_rng_state[0] = entropy_get();
-    g_rng_state[1] = entropy_get() ^ 0xDEADBEEF;
-    g_rng_state[2] = entropy_get() ^ 0xCAFEBABE;
-    g_rng_state[3] = entropy_get() ^ 0xFEEDFACE;
-    
-    g_rng_initialized = 1;
-    return CRYPTO_SUCCESS;
+    static const char personalization[] = "BloodHorn RNG";
+    uint8_t seed[CRYPTO_RNG_ENTROPY_LENGTH + CRYPTO_RNG_NONCE_LENGTH];
+    int result;
+
+    if (entropy_gather(seed, sizeof(seed)) != CRYPTO_SUCCESS) return CRYPTO_ERROR_HARDWARE_UNAVAILABLE;
+    result = hmac_drbg_instantiate(&g_rng, seed, CRYPTO_RNG_ENTROPY_LENGTH,
+                                   seed + CRYPTO_RNG_ENTROPY_LENGTH, CRYPTO_RNG_NONCE_LENGTH,
+                                   (const uint8_t*)personalization, sizeof(personalization) - 1);
+    crypto_memzero_secure(seed, sizeof(seed));
+    crypto_memzero_secure(g_rng_buffer, sizeof(g_rng_buffer));
+    g_rng_buffered = 0;
+
+    g_rng_initialized = result == CRYPTO_SUCCESS;
+    return result;
 }
 
-int crypto_random_uint32(uint32_t* value) {
-    if (!g_rng_initialized || !value) return CRYPTO_ERROR_INVALID_PARAM;
-    
-    // XORShift128 PRNG
-    uint32_t t = g_rng_state[3];
-    uint32_t s = g_rng_state[0];
-    g_rng_state[3] = g_rng_state[2];
-    g_rng_state[2] = g_rng_state[1];
-    g_rng_state[1] = s;
-    
-    t ^= t << 11;
-    t ^= t >> 8;
-    g_rng_state[0] = t ^ s ^ (s >> 19);
-    
-    *value = g_rng_state[0];
+static int crypto_random_generate(uint8_t* buf, uint32_t len) {
+    while (len) {
+        uint32_t chunk = len < HMAC_DRBG_MAX_REQUEST ? len : HMAC_DRBG_MAX_REQUEST;
+        int result = hmac_drbg_generate(&g_rng, buf, chunk, NULL, 0);
+
+        if (result == HMAC_DRBG_RESEED_REQUIRED) {
+            uint8_t entropy[CRYPTO_RNG_ENTROPY_LENGTH];
+            result = entropy_gather(entropy, sizeof(entropy));
+            if (result == CRYPTO_SUCCESS) result = hmac_drbg_reseed(&g_rng, entropy, sizeof(entropy), NULL, 0);
+            crypto_memzero_secure(entropy, sizeof(entropy));
+            if (result != CRYPTO_SUCCESS) return result;
+            continue;
+        }
+        if (result != CRYPTO_SUCCESS) return result;
+
+        buf += chunk;
+        len -= chunk;
+    }
     return CRYPTO_SUCCESS;
 }
 
 int crypto_random_bytes(uint8_t* buf, uint32_t len) {
     if (!buf || len == 0) return CRYPTO_ERROR_INVALID_PARAM;
-    
-    for (uint32_t i = 0; i < len; i += 4) {
-        uint32_t rand_val;
-        int result = crypto_random_uint32(&rand_val);
+
+    if (!g_rng_initialized) {
+        int result = crypto_random_init();
         if (result != CRYPTO_SUCCESS) return result;
-        
-        uint32_t copy_len = (len - i < 4) ? (len - i) : 4;
-        memcpy(buf + i, &rand_val, copy_len);
     }
-    
+    if (len >= CRYPTO_RNG_BUFFER_SIZE) return crypto_random_generate(buf, len);
+
+    if (g_rng_buffered < len) {
+        int result = crypto_random_generate(g_rng_buffer, sizeof(g_rng_buffer));
+        if (result != CRYPTO_SUCCESS) return result;
+        g_rng_buffered = sizeof(g_rng_buffer);
+    }
+
+    // Hand out bytes from the front of what is left and wipe them
+    uint8_t* p = g_rng_buffer + sizeof(g_rng_buffer) - g_rng_buffered;
+    memcpy(buf, p, len);
+    crypto_memzero_secure(p, len);
+    g_rng_buffered -= len;
     return CRYPTO_SUCCESS;
 }
 
+int crypto_random_uint32(uint32_t* value) {
+    if (!value) return CRYPTO_ERROR_INVALID_PARAM;
+    return crypto_random_bytes((uint8_t*)value, sizeof(*value));
+}
+
+int crypto_random_uint64(uint64_t* value) {
+    if (!value) return CRYPTO_ERROR_INVALID_PARAM;
+    return crypto_random_bytes((uint8_t*)value, sizeof(*value));
+}
+
 void crypto_random_cleanup(void) {
-    crypto_memzero_secure(g_rng_state, sizeof(g_rng_state));
+    hmac_drbg_uninstantiate(&g_rng);
+    crypto_memzero_secure(g_rng_buffer, sizeof(g_rng_buffer));
+    g_rng_buffered = 0;
     g_rng_initialized = 0;
 }
 
@@ -373,157 +936,101 @@ int crypto_self_test_sha256(void) {
         0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
         0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad
     };
+    // Two-block vector (the padding spills into a second block):
+    // "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"
+    const char* two_block_input = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    const uint8_t two_block_hash[32] = {
+        0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8, 0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+        0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67, 0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1
+    };
     
     uint8_t computed_hash[32];
     sha256_hash(test_input, 3, computed_hash);
-    
-    return crypto_memcmp_constant_time(computed_hash, expected_hash, 32) == 0 ? CRYPTO_SUCCESS : CRYPTO_ERROR_VERIFICATION_FAILED;
-}
+    if (crypto_memcmp_constant_time(computed_hash, expected_hash, 32) != 0) {
+        return CRYPTO_ERROR_VERIFICATION_FAILED;
+    }
+    sha256_hash((const uint8_t*)two_block_input, 56, computed_hash);
+    if (crypto_memcmp_constant_time(computed_hash, two_block_hash, 32) != 0) {
+        return CRYPTO_ERROR_VERIFICATION_FAILED;
+    }
 
-int crypto_self_test_aes(void) {
-    // AES-128 test vector
-    const uint8_t key[16] = {
-        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
-    };
-    const uint8_t plaintext[16] = {
-        0x32, 0x43, 0xf6, 0xa8, 0x88, 0x5a, 0x30, 0x8d, 0x31, 0x31, 0x98, 0xa2, 0xe0, 0x37, 0x07, 0x34
-    };
-    const uint8_t expected_ciphertext[16] = {
-        0x39, 0x25, 0x84, 0x1d, 0x02, 0xdc, 0x09, 0xfb, 0xdc, 0x11, 0x85, 0x97, 0x19, 0x6a, 0x0b, 0x32
-    };
-    
-    crypto_aes_ctx_t ctx;
-    uint8_t computed_ciphertext[16];
-    
-    if (crypto_aes_init(&ctx, key, 128) != CRYPTO_SUCCESS) return CRYPTO_ERROR_VERIFICATION_FAILED;
-    crypto_aes_encrypt_block(&ctx, plaintext, computed_ciphertext);
-    
-    int result = crypto_memcmp_constant_time(computed_ciphertext, expected_ciphertext, 16) == 0 ? CRYPTO_SUCCESS : CRYPTO_ERROR_VERIFICATION_FAILED;
-    crypto_zeroize_context(&ctx, sizeof(ctx));
-    
-    return result;
-}
+    // The accelerated backend must agree with the portable one over a
+    // multi-block run; if it does not, drop back to the portable code
+    if (g_sha256_blocks && g_sha256_blocks != sha256_blocks_generic) {
+        uint8_t blocks[64 * 5];
+        uint32_t generic_state[8], hw_state[8];
 
-int crypto_run_all_self_tests(void) {
-    if (crypto_self_test_sha256() != CRYPTO_SUCCESS) return CRYPTO_ERROR_VERIFICATION_FAILED;
-    if (crypto_self_test_aes() != CRYPTO_SUCCESS) return CRYPTO_ERROR_VERIFICATION_FAILED;
-    return CRYPTO_SUCCESS;
-}
+        for (uint32_t i = 0; i < sizeof(blocks); i++) {
+            blocks[i] = (uint8_t)(i * 167 + 13);
+        }
+        memcpy(generic_state, sha256_h, sizeof(sha256_h));
+        memcpy(hw_state, sha256_h, sizeof(sha256_h));
+        sha256_blocks_generic(generic_state, blocks, 5);
+        g_sha256_blocks(hw_state, blocks, 5);
 
-// RSA implementation (basic, for signature verification only)
-static int mod_exp(const uint8_t* base, const uint8_t* exp, int exp_len, const uint8_t* mod, int mod_len, uint8_t* out, int out_len) {
-    if (!base || !exp || !mod || !out || mod_len > 512 || out_len > 512) {
-        return CRYPTO_ERROR_INVALID_PARAMETER;
-    }
-    
-    uint8_t result[512] = {0};
-    if (out_len > sizeof(result)) {
-        return CRYPTO_ERROR_INVALID_PARAMETER;
+        if (crypto_memcmp_constant_time(generic_state, hw_state, sizeof(hw_state)) != 0) {
+            sha256_select_backend(CRYPTO_HW_NONE);
+            return CRYPTO_ERROR_VERIFICATION_FAILED;
+        }
     }
-    
-    result[out_len - 1] = 1;
-    
-    // Optimized modular exponentiation with proper bounds checking
-    for (int i = 0; i < exp_len * 8; i++) {
-        int bit = (exp[i / 8] >> (7 - (i % 8))) & 1;
-        
-        // Square operation: result = (result * result) % mod
-        uint32_t carry = 0;
-        for (int j = 0; j < out_len; j++) {
-            uint64_t temp = (uint64_t)result[j] * result[j] + carry;
-            result[j] = (uint8_t)(temp % 256);
-            carry = (uint8_t)(temp / 256);
+
+    // Likewise for the multi-buffer lanes: lengths either side of the
+    // padding boundaries, more jobs than lanes, and one long straggler
+    {
+        static const uint32_t lengths[] = { 0, 3, 55, 56, 63, 64, 119, 120, 200, 1000, 4 };
+        uint8_t message[1004];
+        uint8_t multi[11][32], single[32];
+        crypto_sha256_job_t jobs[11];
+
+        for (uint32_t i = 0; i < sizeof(message); i++) {
+            message[i] = (uint8_t)(i * 31 + 7);
         }
-        
-        // Apply modulo
-        carry = 0;
-        for (int j = 0; j < mod_len; j++) {
-            uint64_t temp = (uint64_t)result[j] + carry * 256;
-            result[j] = (uint8_t)(temp % mod[j]);
-            carry = (uint8_t)(temp / mod[j]);
+        for (uint32_t i = 0; i < 11; i++) {
+            jobs[i].data = message + (i % 4);
+            jobs[i].len = lengths[i];
+            jobs[i].digest = multi[i];
         }
-        
-        if (bit) {
-            // Multiply operation: result = (result * base) % mod
-            carry = 0;
-            for (int j = 0; j < out_len; j++) {
-                uint64_t temp = (uint64_t)result[j] * base[j] + carry;
-                result[j] = (uint8_t)(temp % 256);
-                carry = (uint8_t)(temp / 256);
-            }
-            
-            // Apply modulo again
-            carry = 0;
-            for (int j = 0; j < mod_len; j++) {
-                uint64_t temp = (uint64_t)result[j] + carry * 256;
-                result[j] = (uint8_t)(temp % mod[j]);
-                carry = (uint8_t)(temp / mod[j]);
+        if (crypto_sha256_multi(jobs, 11) != CRYPTO_SUCCESS) {
+            return CRYPTO_ERROR_VERIFICATION_FAILED;
+        }
+        for (uint32_t i = 0; i < 11; i++) {
+            sha256_hash(jobs[i].data, jobs[i].len, single);
+            if (crypto_memcmp_constant_time(multi[i], single, 32) != 0) {
+                g_sha256_lanes = NULL;
+                g_sha256_lane_count = 0;
+                return CRYPTO_ERROR_VERIFICATION_FAILED;
             }
         }
     }
+
+    // PBKDF2 runs its iterations straight off the pad states; check it
+    // against the usual ("password", "salt", 4096) vector
+    {
+        const uint8_t pbkdf2_expected[32] = {
+            0xc5, 0xe4, 0x78, 0xd5, 0x92, 0x88, 0xc8, 0x41, 0xaa, 0x53, 0x0d, 0xb6, 0x84, 0x5c, 0x4c, 0x8d,
+            0x96, 0x28, 0x93, 0xa0, 0x01, 0xce, 0x4e, 0x11, 0xa4, 0x96, 0x38, 0x73, 0xaa, 0x98, 0x13, 0x4a
+        };
+        uint8_t derived[32];
+
+        crypto_pbkdf2_sha256((const uint8_t*)"password", 8, (const uint8_t*)"salt", 4, 4096, derived, 32);
+        if (crypto_memcmp_constant_time(derived, pbkdf2_expected, 32) != 0) {
+            return CRYPTO_ERROR_VERIFICATION_FAILED;
+        }
+    }
     
-    memcpy(out, result, out_len);
-    crypto_zeroize(result, sizeof(result));
     return CRYPTO_SUCCESS;
 }
 
-int verify_signature(const uint8_t* data, uint32_t len, const uint8_t* signature, const uint8_t* public_key) {
-    if (!data || !signature || !public_key || len == 0) {
-        return CRYPTO_ERROR_INVALID_PARAMETER;
-    }
-    
-    uint8_t hash[32];
-    if (sha256_hash(data, len, hash) != CRYPTO_SUCCESS) {
-        return CRYPTO_ERROR_HASH_FAILED;
-    }
-    
-    // Validate public key structure
-    uint32_t key_len = (public_key[0] << 24) | (public_key[1] << 16) | (public_key[2] << 8) | public_key[3];
-    if (key_len < 512 || key_len > 4096) {
-        return CRYPTO_ERROR_INVALID_KEY;
-    }
-    
-    int mod_len = 256;
-    uint8_t decrypted[256];
-    
-    // Decrypt signature using RSA
-    if (mod_exp(signature, public_key + 4, 256, public_key + 260, 256, decrypted, 256) != CRYPTO_SUCCESS) {
-        return CRYPTO_ERROR_DECRYPTION_FAILED;
-    }
-    
-    // Validate PKCS#1 v1.5 padding
-    if (decrypted[0] != 0x00 || decrypted[1] != 0x01) {
-        return CRYPTO_ERROR_INVALID_PADDING;
-    }
-    
-    int i = 2;
-    while (i < 256 && decrypted[i] == 0xFF) i++;
-    if (i >= 256 || decrypted[i++] != 0x00) {
-        return CRYPTO_ERROR_INVALID_PADDING;
-    }
-    
-    // SHA-256 ASN.1 prefix for PKCS#1 v1.5
-    static const uint8_t sha256_prefix[] = {
-        0x30,0x31,0x30,0x0d,0x06,0x09,0x60,0x86,0x48,0x01,0x65,0x03,0x04,0x02,0x01,0x05,0x00,0x04,0x20
-    };
-    
-    if (i + sizeof(sha256_prefix) + 32 > 256) {
-        return CRYPTO_ERROR_INVALID_FORMAT;
-    }
-    
-    if (crypto_memcmp_constant_time(decrypted + i, sha256_prefix, sizeof(sha256_prefix)) != 0) {
-        return CRYPTO_ERROR_INVALID_ALGORITHM;
-    }
-    
-    i += sizeof(sha256_prefix);
-    if (crypto_memcmp_constant_time(decrypted + i, hash, 32) != 0) {
-        return CRYPTO_ERROR_SIGNATURE_MISMATCH;
-    }
-    
-    // Zero out sensitive data
-    crypto_zeroize(decrypted, sizeof(decrypted));
-    crypto_zeroize(hash, sizeof(hash));
-    
+int crypto_run_all_self_tests(void) {
+    if (crypto_self_test_sha256() != CRYPTO_SUCCESS) return CRYPTO_ERROR_VERIFICATION_FAILED;
+    if (crypto_self_test_sha512() != CRYPTO_SUCCESS) return CRYPTO_ERROR_VERIFICATION_FAILED;
+    if (crypto_self_test_blake3() != CRYPTO_SUCCESS) return CRYPTO_ERROR_VERIFICATION_FAILED;
+    if (crypto_self_test_aes() != CRYPTO_SUCCESS) return CRYPTO_ERROR_VERIFICATION_FAILED;
+    if (crypto_self_test_rsa() != CRYPTO_SUCCESS) return CRYPTO_ERROR_VERIFICATION_FAILED;
+    if (crypto_self_test_ecdsa() != CRYPTO_SUCCESS) return CRYPTO_ERROR_VERIFICATION_FAILED;
+    if (crypto_self_test_ed25519() != CRYPTO_SUCCESS) return CRYPTO_ERROR_VERIFICATION_FAILED;
+    if (crypto_self_test_merkle() != CRYPTO_SUCCESS) return CRYPTO_ERROR_VERIFICATION_FAILED;
+    if (crypto_self_test_drbg() != CRYPTO_SUCCESS) return CRYPTO_ERROR_VERIFICATION_FAILED;
     return CRYPTO_SUCCESS;
 }
 
@@ -14,6 +14,8 @@
 // Cryptographic Constants
 #define CRYPTO_SHA256_DIGEST_LENGTH     32
 #define CRYPTO_SHA512_DIGEST_LENGTH     64
+#define CRYPTO_BLAKE3_DIGEST_LENGTH     32
+#define CRYPTO_BLAKE3_CHUNK_LENGTH      1024
 #define CRYPTO_AES128_KEY_LENGTH        16
 #define CRYPTO_AES256_KEY_LENGTH        32
 #define CRYPTO_RSA2048_KEY_LENGTH       256
@@ -21,6 +23,9 @@
 #define CRYPTO_ECDSA_P256_KEY_LENGTH    32
 #define CRYPTO_ECDSA_P384_KEY_LENGTH    48
 #define CRYPTO_ECDSA_P521_KEY_LENGTH    66
+#define CRYPTO_ECDSA_P256_SIGNATURE_LENGTH 64
+#define CRYPTO_ED25519_PUBLIC_KEY_LENGTH 32
+#define CRYPTO_ED25519_SIGNATURE_LENGTH 64
 #define CRYPTO_CHACHA20_KEY_LENGTH      32
 #define CRYPTO_POLY1305_KEY_LENGTH      32
 #define CRYPTO_HMAC_MAX_KEY_LENGTH      128
@@ -39,7 +44,13 @@ typedef enum {
     CRYPTO_HW_INTEL_AESNI = 1,
     CRYPTO_HW_ARM_CRYPTO = 2,
     CRYPTO_HW_AMD_SVM = 4,
-    CRYPTO_HW_INTEL_SHA = 8
+    CRYPTO_HW_INTEL_SHA = 8,
+    CRYPTO_HW_ARM_SHA2 = 16,
+    CRYPTO_HW_INTEL_AVX2 = 32,
+    CRYPTO_HW_ARM_SHA512 = 64,
+    CRYPTO_HW_INTEL_PCLMUL = 128,
+    CRYPTO_HW_ARM_PMULL = 256,
+    CRYPTO_HW_INTEL_AVX512 = 512
 } crypto_hw_support_t;
 
 // Cryptographic context structures
@@ -57,8 +68,23 @@ typedef struct {
     uint32_t buf_len;
 } crypto_sha512_ctx_t;
 
+// BLAKE3: the chunk being hashed plus a stack of subtree CVs, one per
+// level of the tree (54 levels cover 2^64 bytes)
+typedef struct {
+    uint32_t key[8];
+    uint32_t cv[8];
+    uint64_t chunk_counter;
+    uint8_t buf[64];
+    uint8_t buf_len;
+    uint8_t blocks_compressed;
+    uint8_t flags;
+    uint8_t cv_stack_len;
+    uint8_t cv_stack[55 * CRYPTO_BLAKE3_DIGEST_LENGTH];
+} crypto_blake3_ctx_t;
+
 typedef struct {
     uint32_t key_schedule[60];
+    uint32_t dec_schedule[60]; // Equivalent inverse cipher round keys
     uint32_t rounds;
 } crypto_aes_ctx_t;
 
@@ -75,14 +101,16 @@ typedef struct {
     uint32_t buf_len;
 } crypto_poly1305_ctx_t;
 
+// HMAC-SHA256 with the key pads hashed once: inner_ctx and outer_ctx hold
+// the state after the ipad and opad blocks and ctx the running message
 typedef struct {
-    uint8_t key[CRYPTO_HMAC_MAX_KEY_LENGTH];
-    uint32_t key_len;
     crypto_sha256_ctx_t inner_ctx;
     crypto_sha256_ctx_t outer_ctx;
+    crypto_sha256_ctx_t ctx;
 } crypto_hmac_sha256_ctx_t;
 
-// RSA key structures
+// RSA key structures; n and e are big-endian, n filling the first
+// key_bits / 8 bytes of the array
 typedef struct {
     uint8_t n[CRYPTO_RSA4096_KEY_LENGTH];  // Modulus
     uint8_t e[4];                          // Public exponent (usually 65537)
@@ -127,6 +155,7 @@ void crypto_cleanup_hardware(void);
 // Hash functions
 void sha256_hash(const uint8_t* data, uint32_t len, uint8_t* hash);
 void sha512_hash(const uint8_t* data, uint32_t len, uint8_t* hash);
+void blake3_hash(const uint8_t* data, uint32_t len, uint8_t* hash);
 void sha3_256_hash(const uint8_t* data, uint32_t len, uint8_t* hash);
 void blake2b_hash(const uint8_t* data, uint32_t len, uint8_t* hash, uint32_t hash_len);
 
@@ -134,12 +163,44 @@ void blake2b_hash(const uint8_t* data, uint32_t len, uint8_t* hash, uint32_t has
 int crypto_sha256_init(crypto_sha256_ctx_t* ctx);
 int crypto_sha256_update(crypto_sha256_ctx_t* ctx, const uint8_t* data, uint32_t len);
 int crypto_sha256_final(crypto_sha256_ctx_t* ctx, uint8_t* hash);
+// Run `count` 64-byte blocks through the SHA-256 compression function on
+// the fastest backend available (SHA-NI, ARMv8 SHA2 or portable C)
+void crypto_sha256_compress(uint32_t state[8], const uint8_t* blocks, size_t count);
+const char* crypto_sha256_backend_name(void);
 
 int crypto_sha512_init(crypto_sha512_ctx_t* ctx);
 int crypto_sha512_update(crypto_sha512_ctx_t* ctx, const uint8_t* data, uint32_t len);
 int crypto_sha512_final(crypto_sha512_ctx_t* ctx, uint8_t* hash);
-
-// HMAC functions
+// Run `count` 128-byte blocks through the SHA-512 compression function on
+// the fastest backend available (ARMv8.2 SHA512, AVX2 schedule or portable C)
+void crypto_sha512_compress(uint64_t state[8], const uint8_t* blocks, size_t count);
+void crypto_sha512_select_backend(crypto_hw_support_t support);
+const char* crypto_sha512_backend_name(void);
+// Time one SHA-512 pass over `len` bytes with the caller's clock; returns
+// the elapsed ticks
+uint64_t crypto_sha512_benchmark(const uint8_t* data, uint32_t len, uint64_t (*now)(void));
+
+// BLAKE3, 32-byte output. Whole 1 KiB chunks are hashed side by side on
+// AVX-512 (16 lanes), AVX2 (8) or NEON (4), so long inputs run several
+// times faster than SHA-512 on one core.
+int crypto_blake3_init(crypto_blake3_ctx_t* ctx);
+int crypto_blake3_update(crypto_blake3_ctx_t* ctx, const uint8_t* data, uint32_t len);
+// Fails only for a context that got nothing but one appended subtree
+int crypto_blake3_final(crypto_blake3_ctx_t* ctx, uint8_t* hash);
+void crypto_blake3_select_backend(crypto_hw_support_t support);
+const char* crypto_blake3_backend_name(void);
+// Bytes hashed so far
+uint64_t crypto_blake3_position(const crypto_blake3_ctx_t* ctx);
+// Tree-parallel hashing: several processors each take a subtree of `len`
+// bytes (a power-of-two number of chunks) starting at chunk
+// `chunk_counter` (a multiple of that number), and the 32-byte CVs are
+// appended in order to a context sitting at that chunk. More input has to
+// follow the last subtree before final.
+int crypto_blake3_subtree(const uint8_t* data, uint32_t len, uint64_t chunk_counter, uint8_t* cv);
+int crypto_blake3_append_subtree(crypto_blake3_ctx_t* ctx, const uint8_t* cv, uint32_t len);
+
+// HMAC functions. final leaves the context keyed and ready for the next
+// message, so one init serves any number of MACs under the same key
 int crypto_hmac_sha256_init(crypto_hmac_sha256_ctx_t* ctx, const uint8_t* key, uint32_t key_len);
 int crypto_hmac_sha256_update(crypto_hmac_sha256_ctx_t* ctx, const uint8_t* data, uint32_t len);
 int crypto_hmac_sha256_final(crypto_hmac_sha256_ctx_t* ctx, uint8_t* mac);
@@ -154,10 +215,20 @@ void crypto_aes_decrypt_block(const crypto_aes_ctx_t* ctx, const uint8_t* cipher
 // AES modes of operation
 int crypto_aes_cbc_encrypt(const crypto_aes_ctx_t* ctx, const uint8_t* iv, const uint8_t* plaintext, uint32_t len, uint8_t* ciphertext);
 int crypto_aes_cbc_decrypt(const crypto_aes_ctx_t* ctx, const uint8_t* iv, const uint8_t* ciphertext, uint32_t len, uint8_t* plaintext);
+// CTR with a 32-bit big-endian block counter in the last four bytes of `iv`
+int crypto_aes_ctr_crypt(const crypto_aes_ctx_t* ctx, const uint8_t* iv, const uint8_t* input, uint32_t len, uint8_t* output);
 int crypto_aes_gcm_encrypt(const crypto_aes_ctx_t* ctx, const uint8_t* iv, uint32_t iv_len, const uint8_t* aad, uint32_t aad_len, const uint8_t* plaintext, uint32_t len, uint8_t* ciphertext, uint8_t* tag);
 int crypto_aes_gcm_decrypt(const crypto_aes_ctx_t* ctx, const uint8_t* iv, uint32_t iv_len, const uint8_t* aad, uint32_t aad_len, const uint8_t* ciphertext, uint32_t len, const uint8_t* tag, uint8_t* plaintext);
 int crypto_aes_xts_encrypt(const crypto_aes_ctx_t* ctx1, const crypto_aes_ctx_t* ctx2, const uint8_t* tweak, const uint8_t* plaintext, uint32_t len, uint8_t* ciphertext);
 int crypto_aes_xts_decrypt(const crypto_aes_ctx_t* ctx1, const crypto_aes_ctx_t* ctx2, const uint8_t* tweak, const uint8_t* ciphertext, uint32_t len, uint8_t* plaintext);
+// All modes run on AES-NI, ARMv8 AES or portable T-tables, picked at
+// runtime; the hardware paths keep several blocks in flight for ECB, CBC
+// decryption, CTR, GCM and XTS. GCM hashes with PCLMULQDQ or PMULL, eight
+// blocks per reduction and interleaved with the CTR rounds, or with 4-bit
+// tables.
+void crypto_aes_select_backend(crypto_hw_support_t support);
+const char* crypto_aes_backend_name(void);
+const char* crypto_ghash_backend_name(void);
 
 // ChaCha20-Poly1305 AEAD
 int crypto_chacha20_init(crypto_chacha20_ctx_t* ctx, const uint8_t* key, const uint8_t* nonce);
@@ -186,6 +257,13 @@ int crypto_ecdsa_sign(const crypto_ecdsa_private_key_t* private_key, const uint8
 int crypto_ecdsa_verify(const crypto_ecdsa_public_key_t* public_key, const uint8_t* hash, uint32_t hash_len, const crypto_ecdsa_signature_t* signature);
 int crypto_ecdsa_compress_public_key(const crypto_ecdsa_public_key_t* public_key, uint8_t* compressed, uint32_t* compressed_len);
 int crypto_ecdsa_decompress_public_key(const uint8_t* compressed, uint32_t compressed_len, crypto_ecdsa_public_key_t* public_key);
+// Raw P-256 verification: public_key is x || y and signature r || s, all
+// 32-byte big-endian values; the hash is truncated to its leftmost 256 bits
+int crypto_ecdsa_p256_verify(const uint8_t* public_key, const uint8_t* hash, uint32_t hash_len, const uint8_t* signature);
+
+// Ed25519 (RFC 8032): 32-byte public key, 64-byte signature over the
+// message itself
+int crypto_ed25519_verify(const uint8_t* public_key, const uint8_t* message, uint32_t message_len, const uint8_t* signature);
 
 // Key derivation functions
 int crypto_pbkdf2_sha256(const uint8_t* password, uint32_t password_len, const uint8_t* salt, uint32_t salt_len, uint32_t iterations, uint8_t* derived_key, uint32_t key_len);
@@ -215,7 +293,20 @@ int crypto_aes_hw_encrypt_block(const uint8_t* key, uint32_t key_bits, const uin
 int crypto_aes_hw_decrypt_block(const uint8_t* key, uint32_t key_bits, const uint8_t* ciphertext, uint8_t* plaintext);
 int crypto_sha256_hw_hash(const uint8_t* data, uint32_t len, uint8_t* hash);
 
-// Secure random number generation
+// Batched SHA-256 over independent messages, interleaved across SIMD lanes
+// (eight with AVX2, four with NEON) when the CPU has no SHA instructions
+#define CRYPTO_SHA256_MB_MAX_LANES 8
+
+typedef struct {
+    const uint8_t* data;
+    uint32_t len;
+    uint8_t* digest;    // CRYPTO_SHA256_DIGEST_LENGTH bytes
+} crypto_sha256_job_t;
+
+int crypto_sha256_multi(crypto_sha256_job_t* jobs, uint32_t count);
+
+// Secure random number generation (HMAC_DRBG over entropy_gather; the
+// first call seeds it if crypto_random_init has not run)
 int crypto_random_init(void);
 int crypto_random_bytes(uint8_t* buf, uint32_t len);
 int crypto_random_uint32(uint32_t* value);
@@ -226,14 +317,21 @@ void crypto_random_cleanup(void);
 int crypto_memcmp_constant_time(const void* a, const void* b, size_t len);
 void crypto_memzero_secure(void* ptr, size_t len);
 
-// Legacy functions (for backward compatibility)
+// Legacy functions (for backward compatibility). verify_signature takes a
+// key blob of [key_bits, big-endian u32][e][n], e and n key_bits/8 bytes
+// each, and a PKCS#1 v1.5 SHA-256 signature of the same length
 int verify_signature(const uint8_t* data, uint32_t len, const uint8_t* signature, const uint8_t* public_key);
 
 // Cryptographic self-tests
 int crypto_self_test_sha256(void);
+int crypto_self_test_sha512(void);
+int crypto_self_test_blake3(void);
 int crypto_self_test_aes(void);
 int crypto_self_test_rsa(void);
 int crypto_self_test_ecdsa(void);
+int crypto_self_test_ed25519(void);
+int crypto_self_test_merkle(void);
+int crypto_self_test_drbg(void);
 int crypto_self_test_chacha20_poly1305(void);
 int crypto_run_all_self_tests(void);
 
@@ -0,0 +1,122 @@
+/*
+ * drbg.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include "drbg.h"
+#include "compat.h"
+#include "crypto.h"
+#include <string.h>
+
+// V = HMAC(K, V) with the key pads already hashed
+static void hmac_drbg_step(hmac_drbg_t* drbg) {
+    crypto_hmac_sha256_update(&drbg->k, drbg->v, sizeof(drbg->v));
+    crypto_hmac_sha256_final(&drbg->k, drbg->v);
+}
+
+// HMAC_DRBG_Update over provided_data = a || b || c
+static void hmac_drbg_update(hmac_drbg_t* drbg, const uint8_t* a, uint32_t a_len,
+                             const uint8_t* b, uint32_t b_len, const uint8_t* c, uint32_t c_len) {
+    uint8_t key[CRYPTO_SHA256_DIGEST_LENGTH];
+    int provided = a_len || b_len || c_len;
+
+    for (uint8_t round = 0; round < 2; round++) {
+        crypto_hmac_sha256_update(&drbg->k, drbg->v, sizeof(drbg->v));
+        crypto_hmac_sha256_update(&drbg->k, &round, 1);
+        if (a_len) crypto_hmac_sha256_update(&drbg->k, a, a_len);
+        if (b_len) crypto_hmac_sha256_update(&drbg->k, b, b_len);
+        if (c_len) crypto_hmac_sha256_update(&drbg->k, c, c_len);
+        crypto_hmac_sha256_final(&drbg->k, key);
+        crypto_hmac_sha256_init(&drbg->k, key, sizeof(key));
+        hmac_drbg_step(drbg);
+        if (!provided) break;
+    }
+    crypto_memzero_secure(key, sizeof(key));
+}
+
+int hmac_drbg_instantiate(hmac_drbg_t* drbg, const uint8_t* entropy, uint32_t entropy_len,
+                          const uint8_t* nonce, uint32_t nonce_len,
+                          const uint8_t* personalization, uint32_t personalization_len) {
+    uint8_t key[CRYPTO_SHA256_DIGEST_LENGTH];
+
+    if (!drbg || !entropy || entropy_len < HMAC_DRBG_MIN_ENTROPY) return CRYPTO_ERROR_INVALID_PARAM;
+    if ((!nonce && nonce_len) || (!personalization && personalization_len)) return CRYPTO_ERROR_INVALID_PARAM;
+
+    memset(key, 0x00, sizeof(key));
+    memset(drbg->v, 0x01, sizeof(drbg->v));
+    crypto_hmac_sha256_init(&drbg->k, key, sizeof(key));
+    hmac_drbg_update(drbg, entropy, entropy_len, nonce, nonce_len, personalization, personalization_len);
+    drbg->reseed_counter = 1;
+    drbg->instantiated = 1;
+    return CRYPTO_SUCCESS;
+}
+
+int hmac_drbg_reseed(hmac_drbg_t* drbg, const uint8_t* entropy, uint32_t entropy_len,
+                     const uint8_t* additional, uint32_t additional_len) {
+    if (!drbg || !drbg->instantiated) return CRYPTO_ERROR_INVALID_PARAM;
+    if (!entropy || entropy_len < HMAC_DRBG_MIN_ENTROPY || (!additional && additional_len)) {
+        return CRYPTO_ERROR_INVALID_PARAM;
+    }
+
+    hmac_drbg_update(drbg, entropy, entropy_len, additional, additional_len, NULL, 0);
+    drbg->reseed_counter = 1;
+    return CRYPTO_SUCCESS;
+}
+
+int hmac_drbg_generate(hmac_drbg_t* drbg, uint8_t* out, uint32_t len,
+                       const uint8_t* additional, uint32_t additional_len) {
+    if (!drbg || !drbg->instantiated || (!out && len) || (!additional && additional_len)) {
+        return CRYPTO_ERROR_INVALID_PARAM;
+    }
+    if (len > HMAC_DRBG_MAX_REQUEST) return CRYPTO_ERROR_INVALID_PARAM;
+    if (drbg->reseed_counter > HMAC_DRBG_RESEED_INTERVAL) return HMAC_DRBG_RESEED_REQUIRED;
+
+    if (additional_len) hmac_drbg_update(drbg, additional, additional_len, NULL, 0, NULL, 0);
+
+    while (len) {
+        uint32_t take = len < sizeof(drbg->v) ? len : (uint32_t)sizeof(drbg->v);
+        hmac_drbg_step(drbg);
+        memcpy(out, drbg->v, take);
+        out += take;
+        len -= take;
+    }
+
+    // Backtracking resistance: the K and V that produced this output are gone
+    hmac_drbg_update(drbg, additional, additional_len, NULL, 0, NULL, 0);
+    drbg->reseed_counter++;
+    return CRYPTO_SUCCESS;
+}
+
+void hmac_drbg_uninstantiate(hmac_drbg_t* drbg) {
+    if (!drbg) return;
+    crypto_memzero_secure(drbg, sizeof(*drbg));
+}
+
+int crypto_self_test_drbg(void) {
+    // NIST CAVP HMAC_DRBG SHA-256, no prediction resistance, count 0:
+    // instantiate, generate 1024 bits twice, check the second output
+    static const uint8_t entropy[32] = {
+        0xca, 0x85, 0x19, 0x11, 0x34, 0x93, 0x84, 0xbf, 0xfe, 0x89, 0xde, 0x1c, 0xbd, 0xc4, 0x6e, 0x68,
+        0x31, 0xe4, 0x4d, 0x34, 0xa4, 0xfb, 0x93, 0x5e, 0xe2, 0x85, 0xdd, 0x14, 0xb7, 0x1a, 0x74, 0x88
+    };
+    static const uint8_t nonce[16] = {
+        0x65, 0x9b, 0xa9, 0x6c, 0x60, 0x1d, 0xc6, 0x9f, 0xc9, 0x02, 0x94, 0x08, 0x05, 0xec, 0x0c, 0xa8
+    };
+    static const uint8_t expected[32] = {
+        0xe5, 0x28, 0xe9, 0xab, 0xf2, 0xde, 0xce, 0x54, 0xd4, 0x7c, 0x7e, 0x75, 0xe5, 0xfe, 0x30, 0x21,
+        0x49, 0xf8, 0x17, 0xea, 0x9f, 0xb4, 0xbe, 0xe6, 0xf4, 0x19, 0x96, 0x97, 0xd0, 0x4d, 0x5b, 0x89
+    };
+    uint8_t out[128];
+    hmac_drbg_t drbg;
+    int ok;
+
+    ok = hmac_drbg_instantiate(&drbg, entropy, sizeof(entropy), nonce, sizeof(nonce), NULL, 0) == CRYPTO_SUCCESS &&
+         hmac_drbg_generate(&drbg, out, sizeof(out), NULL, 0) == CRYPTO_SUCCESS &&
+         hmac_drbg_generate(&drbg, out, sizeof(out), NULL, 0) == CRYPTO_SUCCESS &&
+         memcmp(out, expected, sizeof(expected)) == 0;
+
+    hmac_drbg_uninstantiate(&drbg);
+    return ok ? CRYPTO_SUCCESS : CRYPTO_ERROR_VERIFICATION_FAILED;
+}
@@ -0,0 +1,38 @@
+/*
+ * drbg.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_DRBG_H
+#define BLOODHORN_DRBG_H
+#include <stdint.h>
+#include "compat.h"
+#include "crypto.h"
+
+// HMAC_DRBG with SHA-256 (NIST SP 800-90A, section 10.1.2). The caller
+// supplies the entropy; generate refuses to run once the reseed interval
+// has passed, and a single request is capped at HMAC_DRBG_MAX_REQUEST.
+#define HMAC_DRBG_MIN_ENTROPY       32
+#define HMAC_DRBG_MAX_REQUEST       65536
+#define HMAC_DRBG_RESEED_INTERVAL   4096        // generate calls per seed
+#define HMAC_DRBG_RESEED_REQUIRED   1           // generate's "reseed first"
+
+typedef struct {
+    uint8_t v[CRYPTO_SHA256_DIGEST_LENGTH];
+    crypto_hmac_sha256_ctx_t k;     // HMAC keyed with the current K
+    uint32_t reseed_counter;
+    int instantiated;
+} hmac_drbg_t;
+
+int hmac_drbg_instantiate(hmac_drbg_t* drbg, const uint8_t* entropy, uint32_t entropy_len,
+                          const uint8_t* nonce, uint32_t nonce_len,
+                          const uint8_t* personalization, uint32_t personalization_len);
+int hmac_drbg_reseed(hmac_drbg_t* drbg, const uint8_t* entropy, uint32_t entropy_len,
+                     const uint8_t* additional, uint32_t additional_len);
+int hmac_drbg_generate(hmac_drbg_t* drbg, uint8_t* out, uint32_t len,
+                       const uint8_t* additional, uint32_t additional_len);
+void hmac_drbg_uninstantiate(hmac_drbg_t* drbg);
+
+#endif
@@ -0,0 +1,631 @@
+/*
+ * ed25519.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include "crypto.h"
+#include <string.h>
+
+// Ed25519 signature verification (RFC 8032). Field elements mod
+// p = 2^255 - 19 are ten signed limbs of alternately 26 and 25 bits, so
+// every product fits a 64-bit integer on any target, and none of the
+// field code branches on or indexes by its operands. Points use extended
+// twisted Edwards coordinates. The inputs to a verification are all
+// public, so the scalar loop itself is variable-time: [S]B - [h]A is one
+// interleaved pass over signed sliding windows, with the odd multiples of
+// B computed once and kept in a table.
+
+typedef int64_t fe25519[10];
+
+typedef struct { fe25519 X, Y, Z; } ge25519_p2;
+typedef struct { fe25519 X, Y, Z, T; } ge25519_p3;
+typedef struct { fe25519 X, Y, Z, T; } ge25519_p1p1;
+typedef struct { fe25519 YplusX, YminusX, Z, T2d; } ge25519_cached;
+typedef struct { fe25519 yplusx, yminusx, xy2d; } ge25519_precomp;
+
+#define ED25519_BASE_WINDOW 7
+#define ED25519_POINT_WINDOW 5
+
+// -121665 / 121666 and sqrt(-1), little-endian
+static const uint8_t ed25519_d_bytes[32] = {
+    0xa3, 0x78, 0x59, 0x13, 0xca, 0x4d, 0xeb, 0x75, 0xab, 0xd8, 0x41, 0x41, 0x4d, 0x0a, 0x70, 0x00,
+    0x98, 0xe8, 0x79, 0x77, 0x79, 0x40, 0xc7, 0x8c, 0x73, 0xfe, 0x6f, 0x2b, 0xee, 0x6c, 0x03, 0x52
+};
+static const uint8_t ed25519_sqrtm1_bytes[32] = {
+    0xb0, 0xa0, 0x0e, 0x4a, 0x27, 0x1b, 0xee, 0xc4, 0x78, 0xe4, 0x2f, 0xad, 0x06, 0x18, 0x43, 0x2f,
+    0xa7, 0xd7, 0xfb, 0x3d, 0x99, 0x00, 0x4d, 0x2b, 0x0b, 0xdf, 0xc1, 0x4f, 0x80, 0x24, 0x83, 0x2b
+};
+// Base point: y = 4/5 with x positive
+static const uint8_t ed25519_base_bytes[32] = {
+    0x58, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66,
+    0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66
+};
+// Group order L = 2^252 + 27742317777372353535851937790883648493, little-endian
+static const uint8_t ed25519_order[32] = {
+    0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10
+};
+
+static fe25519 ed25519_d, ed25519_d2, ed25519_sqrtm1;
+static ge25519_precomp ed25519_base_table[1 << (ED25519_BASE_WINDOW - 2)];
+static int ed25519_tables_ready = 0;
+
+// Limb i starts at bit fe_offset[i] and is fe_width[i] bits wide
+static const uint8_t fe_offset[10] = { 0, 26, 51, 77, 102, 128, 153, 179, 204, 230 };
+static const uint8_t fe_width[10] = { 26, 25, 26, 25, 26, 25, 26, 25, 26, 25 };
+
+static void fe_copy(fe25519 h, const fe25519 f) {
+    memcpy(h, f, sizeof(fe25519));
+}
+
+static void fe_0(fe25519 h) {
+    memset(h, 0, sizeof(fe25519));
+}
+
+static void fe_1(fe25519 h) {
+    fe_0(h);
+    h[0] = 1;
+}
+
+static void fe_add(fe25519 h, const fe25519 f, const fe25519 g) {
+    for (int i = 0; i < 10; i++) h[i] = f[i] + g[i];
+}
+
+static void fe_sub(fe25519 h, const fe25519 f, const fe25519 g) {
+    for (int i = 0; i < 10; i++) h[i] = f[i] - g[i];
+}
+
+static void fe_neg(fe25519 h, const fe25519 f) {
+    for (int i = 0; i < 10; i++) h[i] = -f[i];
+}
+
+// Moves limb i's overflow into limb i + 1, leaving it centred around zero
+static inline void fe_carry_at(int64_t* h, int i) {
+    int w = fe_width[i];
+    int64_t c = (h[i] + ((int64_t)1 << (w - 1))) >> w;
+    h[i] -= c * ((int64_t)1 << w);
+    if (i == 9) {
+        h[0] += c * 19;
+    } else {
+        h[i + 1] += c;
+    }
+}
+
+// Same interleaved order as the reference implementation, which keeps
+// each chain short enough that no limb can overflow before it is carried
+static void fe_carry(int64_t* h) {
+    fe_carry_at(h, 0);
+    fe_carry_at(h, 4);
+    fe_carry_at(h, 1);
+    fe_carry_at(h, 5);
+    fe_carry_at(h, 2);
+    fe_carry_at(h, 6);
+    fe_carry_at(h, 3);
+    fe_carry_at(h, 7);
+    fe_carry_at(h, 4);
+    fe_carry_at(h, 8);
+    fe_carry_at(h, 9);
+    fe_carry_at(h, 0);
+}
+
+// Schoolbook product with the 2^255 = 19 wraparound, written out so it
+// stays in registers. An odd limb times an odd limb lands half a bit high
+// and is doubled.
+static void fe_mul_wide(int64_t t[10], const fe25519 f, const fe25519 g) {
+    int64_t f0 = f[0], f1 = f[1], f2 = f[2], f3 = f[3], f4 = f[4];
+    int64_t f5 = f[5], f6 = f[6], f7 = f[7], f8 = f[8], f9 = f[9];
+    int64_t g0 = g[0], g1 = g[1], g2 = g[2], g3 = g[3], g4 = g[4];
+    int64_t g5 = g[5], g6 = g[6], g7 = g[7], g8 = g[8], g9 = g[9];
+    int64_t f1_2 = 2 * f1, f3_2 = 2 * f3, f5_2 = 2 * f5, f7_2 = 2 * f7, f9_2 = 2 * f9;
+    int64_t g1_19 = 19 * g1, g2_19 = 19 * g2, g3_19 = 19 * g3, g4_19 = 19 * g4, g5_19 = 19 * g5;
+    int64_t g6_19 = 19 * g6, g7_19 = 19 * g7, g8_19 = 19 * g8, g9_19 = 19 * g9;
+
+    t[0] = f0 * g0 + f1_2 * g9_19 + f2 * g8_19 + f3_2 * g7_19 + f4 * g6_19
+           + f5_2 * g5_19 + f6 * g4_19 + f7_2 * g3_19 + f8 * g2_19 + f9_2 * g1_19;
+    t[1] = f0 * g1 + f1 * g0 + f2 * g9_19 + f3 * g8_19 + f4 * g7_19
+           + f5 * g6_19 + f6 * g5_19 + f7 * g4_19 + f8 * g3_19 + f9 * g2_19;
+    t[2] = f0 * g2 + f1_2 * g1 + f2 * g0 + f3_2 * g9_19 + f4 * g8_19
+           + f5_2 * g7_19 + f6 * g6_19 + f7_2 * g5_19 + f8 * g4_19 + f9_2 * g3_19;
+    t[3] = f0 * g3 + f1 * g2 + f2 * g1 + f3 * g0 + f4 * g9_19
+           + f5 * g8_19 + f6 * g7_19 + f7 * g6_19 + f8 * g5_19 + f9 * g4_19;
+    t[4] = f0 * g4 + f1_2 * g3 + f2 * g2 + f3_2 * g1 + f4 * g0
+           + f5_2 * g9_19 + f6 * g8_19 + f7_2 * g7_19 + f8 * g6_19 + f9_2 * g5_19;
+    t[5] = f0 * g5 + f1 * g4 + f2 * g3 + f3 * g2 + f4 * g1
+           + f5 * g0 + f6 * g9_19 + f7 * g8_19 + f8 * g7_19 + f9 * g6_19;
+    t[6] = f0 * g6 + f1_2 * g5 + f2 * g4 + f3_2 * g3 + f4 * g2
+           + f5_2 * g1 + f6 * g0 + f7_2 * g9_19 + f8 * g8_19 + f9_2 * g7_19;
+    t[7] = f0 * g7 + f1 * g6 + f2 * g5 + f3 * g4 + f4 * g3
+           + f5 * g2 + f6 * g1 + f7 * g0 + f8 * g9_19 + f9 * g8_19;
+    t[8] = f0 * g8 + f1_2 * g7 + f2 * g6 + f3_2 * g5 + f4 * g4
+           + f5_2 * g3 + f6 * g2 + f7_2 * g1 + f8 * g0 + f9_2 * g9_19;
+    t[9] = f0 * g9 + f1 * g8 + f2 * g7 + f3 * g6 + f4 * g5
+           + f5 * g4 + f6 * g3 + f7 * g2 + f8 * g1 + f9 * g0;
+}
+
+static void fe_mul(fe25519 h, const fe25519 f, const fe25519 g) {
+    int64_t t[10];
+    fe_mul_wide(t, f, g);
+    fe_carry(t);
+    fe_copy(h, t);
+}
+
+static void fe_sq(fe25519 h, const fe25519 f) {
+    fe_mul(h, f, f);
+}
+
+// h = 2 * f^2, doubled before the carry so the result stays reduced
+static void fe_sq2(fe25519 h, const fe25519 f) {
+    int64_t t[10];
+    fe_mul_wide(t, f, f);
+    for (int i = 0; i < 10; i++) t[i] += t[i];
+    fe_carry(t);
+    fe_copy(h, t);
+}
+
+static void fe_sqn(fe25519 h, const fe25519 f, int n) {
+    fe_sq(h, f);
+    while (--n > 0) fe_sq(h, h);
+}
+
+static void fe_frombytes(fe25519 h, const uint8_t s[32]) {
+    uint8_t buf[40];
+    int64_t t[10];
+
+    memcpy(buf, s, 32);
+    memset(buf + 32, 0, sizeof(buf) - 32);
+    buf[31] &= 0x7f;
+    for (int i = 0; i < 10; i++) {
+        uint64_t v = 0;
+        int o = fe_offset[i];
+        for (int b = 7; b >= 0; b--) v = (v << 8) | buf[o / 8 + b];
+        t[i] = (int64_t)((v >> (o % 8)) & (((uint64_t)1 << fe_width[i]) - 1));
+    }
+    fe_carry(t);
+    fe_copy(h, t);
+}
+
+// Fully reduced little-endian encoding
+static void fe_tobytes(uint8_t s[32], const fe25519 f) {
+    int64_t h[10];
+    int64_t q;
+    uint64_t acc = 0;
+    int bits = 0, pos = 0;
+
+    memcpy(h, f, sizeof(h));
+    fe_carry(h);
+    // q is 1 exactly when h >= p
+    q = (19 * h[9] + ((int64_t)1 << 24)) >> 25;
+    for (int i = 0; i < 10; i++) q = (h[i] + q) >> fe_width[i];
+    h[0] += 19 * q;
+    for (int i = 0; i < 9; i++) {
+        int64_t c = h[i] >> fe_width[i];
+        h[i + 1] += c;
+        h[i] -= c * ((int64_t)1 << fe_width[i]);
+    }
+    h[9] &= ((int64_t)1 << 25) - 1;
+
+    for (int i = 0; i < 10; i++) {
+        acc |= (uint64_t)h[i] << bits;
+        bits += fe_width[i];
+        while (bits >= 8) {
+            s[pos++] = (uint8_t)acc;
+            acc >>= 8;
+            bits -= 8;
+        }
+    }
+    if (pos < 32) s[pos] = (uint8_t)acc;
+}
+
+static int fe_isnegative(const fe25519 f) {
+    uint8_t s[32];
+    fe_tobytes(s, f);
+    return s[0] & 1;
+}
+
+static int fe_isnonzero(const fe25519 f) {
+    uint8_t s[32];
+    uint8_t r = 0;
+    fe_tobytes(s, f);
+    for (int i = 0; i < 32; i++) r |= s[i];
+    return r != 0;
+}
+
+// z^(2^250 - 1), shared by inversion and the square root
+static void fe_pow2_250_1(fe25519 out, fe25519 z11, const fe25519 z) {
+    fe25519 t, z2, z9, z_5_0, z_10_0, z_20_0, z_50_0, z_100_0;
+
+    fe_sq(z2, z);
+    fe_sqn(t, z2, 2);
+    fe_mul(z9, t, z);
+    fe_mul(z11, z9, z2);
+    fe_sq(t, z11);
+    fe_mul(z_5_0, t, z9);
+    fe_sqn(t, z_5_0, 5);
+    fe_mul(z_10_0, t, z_5_0);
+    fe_sqn(t, z_10_0, 10);
+    fe_mul(z_20_0, t, z_10_0);
+    fe_sqn(t, z_20_0, 20);
+    fe_mul(t, t, z_20_0);
+    fe_sqn(t, t, 10);
+    fe_mul(z_50_0, t, z_10_0);
+    fe_sqn(t, z_50_0, 50);
+    fe_mul(z_100_0, t, z_50_0);
+    fe_sqn(t, z_100_0, 100);
+    fe_mul(t, t, z_100_0);
+    fe_sqn(t, t, 50);
+    fe_mul(out, t, z_50_0);
+}
+
+// z^(p - 2)
+static void fe_invert(fe25519 out, const fe25519 z) {
+    fe25519 t, z11;
+    fe_pow2_250_1(t, z11, z);
+    fe_sqn(t, t, 5);
+    fe_mul(out, t, z11);
+}
+
+// z^((p - 5) / 8)
+static void fe_pow22523(fe25519 out, const fe25519 z) {
+    fe25519 t, z11;
+    fe_pow2_250_1(t, z11, z);
+    fe_sqn(t, t, 2);
+    fe_mul(out, t, z);
+}
+
+// r = 2p
+static void ge_p2_dbl(ge25519_p1p1* r, const ge25519_p2* p) {
+    fe25519 t0;
+    fe_sq(r->X, p->X);
+    fe_sq(r->Z, p->Y);
+    fe_sq2(r->T, p->Z);
+    fe_add(r->Y, p->X, p->Y);
+    fe_sq(t0, r->Y);
+    fe_add(r->Y, r->Z, r->X);
+    fe_sub(r->Z, r->Z, r->X);
+    fe_sub(r->X, t0, r->Y);
+    fe_sub(r->T, r->T, r->Z);
+}
+
+static void ge_p3_dbl(ge25519_p1p1* r, const ge25519_p3* p) {
+    ge25519_p2 q;
+    fe_copy(q.X, p->X);
+    fe_copy(q.Y, p->Y);
+    fe_copy(q.Z, p->Z);
+    ge_p2_dbl(r, &q);
+}
+
+static void ge_p1p1_to_p2(ge25519_p2* r, const ge25519_p1p1* p) {
+    fe_mul(r->X, p->X, p->T);
+    fe_mul(r->Y, p->Y, p->Z);
+    fe_mul(r->Z, p->Z, p->T);
+}
+
+static void ge_p1p1_to_p3(ge25519_p3* r, const ge25519_p1p1* p) {
+    fe_mul(r->X, p->X, p->T);
+    fe_mul(r->Y, p->Y, p->Z);
+    fe_mul(r->Z, p->Z, p->T);
+    fe_mul(r->T, p->X, p->Y);
+}
+
+static void ge_p3_to_cached(ge25519_cached* r, const ge25519_p3* p) {
+    fe_add(r->YplusX, p->Y, p->X);
+    fe_sub(r->YminusX, p->Y, p->X);
+    fe_copy(r->Z, p->Z);
+    fe_mul(r->T2d, p->T, ed25519_d2);
+}
+
+// r = p + q, or p - q when negate is set
+static void ge_add_cached(ge25519_p1p1* r, const ge25519_p3* p, const ge25519_cached* q, int negate) {
+    fe25519 t0;
+    fe_add(r->X, p->Y, p->X);
+    fe_sub(r->Y, p->Y, p->X);
+    fe_mul(r->Z, r->X, negate ? q->YminusX : q->YplusX);
+    fe_mul(r->Y, r->Y, negate ? q->YplusX : q->YminusX);
+    fe_mul(r->T, q->T2d, p->T);
+    fe_mul(r->X, p->Z, q->Z);
+    fe_add(t0, r->X, r->X);
+    fe_sub(r->X, r->Z, r->Y);
+    fe_add(r->Y, r->Z, r->Y);
+    if (negate) {
+        fe_sub(r->Z, t0, r->T);
+        fe_add(r->T, t0, r->T);
+    } else {
+        fe_add(r->Z, t0, r->T);
+        fe_sub(r->T, t0, r->T);
+    }
+}
+
+// Mixed addition with an affine table point
+static void ge_add_precomp(ge25519_p1p1* r, const ge25519_p3* p, const ge25519_precomp* q, int negate) {
+    fe25519 t0;
+    fe_add(r->X, p->Y, p->X);
+    fe_sub(r->Y, p->Y, p->X);
+    fe_mul(r->Z, r->X, negate ? q->yminusx : q->yplusx);
+    fe_mul(r->Y, r->Y, negate ? q->yplusx : q->yminusx);
+    fe_mul(r->T, q->xy2d, p->T);
+    fe_add(t0, p->Z, p->Z);
+    fe_sub(r->X, r->Z, r->Y);
+    fe_add(r->Y, r->Z, r->Y);
+    if (negate) {
+        fe_sub(r->Z, t0, r->T);
+        fe_add(r->T, t0, r->T);
+    } else {
+        fe_add(r->Z, t0, r->T);
+        fe_sub(r->T, t0, r->T);
+    }
+}
+
+static void ge_tobytes(uint8_t s[32], const ge25519_p2* h) {
+    fe25519 recip, x, y;
+    fe_invert(recip, h->Z);
+    fe_mul(x, h->X, recip);
+    fe_mul(y, h->Y, recip);
+    fe_tobytes(s, y);
+    s[31] ^= (uint8_t)(fe_isnegative(x) << 7);
+}
+
+// Decodes a point, rejecting non-canonical y and points off the curve.
+// With negate set the result is the point's negation, which is what the
+// verification equation needs for A.
+static int ge_frombytes(ge25519_p3* h, const uint8_t s[32], int negate) {
+    fe25519 u, v, v3, vxx, check;
+    uint8_t canonical[32];
+
+    fe_frombytes(h->Y, s);
+    fe_tobytes(canonical, h->Y);
+    canonical[31] |= s[31] & 0x80;
+    if (memcmp(canonical, s, 32) != 0) return -1;
+
+    fe_1(h->Z);
+    fe_sq(u, h->Y);
+    fe_mul(v, u, ed25519_d);
+    fe_sub(u, u, h->Z);        // u = y^2 - 1
+    fe_add(v, v, h->Z);        // v = d y^2 + 1
+
+    // x = u v^3 (u v^7)^((p - 5) / 8)
+    fe_sq(v3, v);
+    fe_mul(v3, v3, v);
+    fe_sq(h->X, v3);
+    fe_mul(h->X, h->X, v);
+    fe_mul(h->X, h->X, u);
+    fe_pow22523(h->X, h->X);
+    fe_mul(h->X, h->X, v3);
+    fe_mul(h->X, h->X, u);
+
+    fe_sq(vxx, h->X);
+    fe_mul(vxx, vxx, v);
+    fe_sub(check, vxx, u);
+    if (fe_isnonzero(check)) {
+        fe_add(check, vxx, u);
+        if (fe_isnonzero(check)) return -1;
+        fe_mul(h->X, h->X, ed25519_sqrtm1);
+    }
+
+    if (!fe_isnonzero(h->X) && (s[31] >> 7)) return -1;
+    if (fe_isnegative(h->X) != (s[31] >> 7)) fe_neg(h->X, h->X);
+    if (negate) fe_neg(h->X, h->X);
+
+    fe_mul(h->T, h->X, h->Y);
+    return 0;
+}
+
+// Builds d, 2d, sqrt(-1) and the odd multiples B, 3B, ..., stored affine
+static void ed25519_init_tables(void) {
+    ge25519_p3 base, b2, acc;
+    ge25519_p1p1 t;
+    ge25519_cached b2_cached;
+
+    if (ed25519_tables_ready) return;
+
+    fe_frombytes(ed25519_d, ed25519_d_bytes);
+    fe_add(ed25519_d2, ed25519_d, ed25519_d);
+    fe_carry(ed25519_d2);
+    fe_frombytes(ed25519_sqrtm1, ed25519_sqrtm1_bytes);
+
+    ge_frombytes(&base, ed25519_base_bytes, 0);
+    ge_p3_dbl(&t, &base);
+    ge_p1p1_to_p3(&b2, &t);
+    ge_p3_to_cached(&b2_cached, &b2);
+
+    acc = base;
+    for (uint32_t i = 0; i < (1u << (ED25519_BASE_WINDOW - 2)); i++) {
+        fe25519 recip, x, y;
+
+        fe_invert(recip, acc.Z);
+        fe_mul(x, acc.X, recip);
+        fe_mul(y, acc.Y, recip);
+        fe_add(ed25519_base_table[i].yplusx, y, x);
+        fe_sub(ed25519_base_table[i].yminusx, y, x);
+        fe_mul(x, x, y);
+        fe_mul(ed25519_base_table[i].xy2d, x, ed25519_d2);
+        fe_carry(ed25519_base_table[i].yplusx);
+        fe_carry(ed25519_base_table[i].yminusx);
+
+        ge_add_cached(&t, &acc, &b2_cached, 0);
+        ge_p1p1_to_p3(&acc, &t);
+    }
+
+    ed25519_tables_ready = 1;
+}
+
+// Signed sliding-window digits of a little-endian scalar below 2^255:
+// every nonzero digit is odd with magnitude below 2^(window - 1)
+static void ed25519_slide(int8_t r[256], const uint8_t a[32], int window) {
+    int limit = (1 << (window - 1)) - 1;
+
+    for (int i = 0; i < 256; i++) {
+        r[i] = (int8_t)(1 & (a[i >> 3] >> (i & 7)));
+    }
+    for (int i = 0; i < 256; i++) {
+        if (!r[i]) continue;
+        for (int b = 1; b <= window && i + b < 256; b++) {
+            if (!r[i + b]) continue;
+            if (r[i] + (r[i + b] << b) <= limit) {
+                r[i] = (int8_t)(r[i] + (r[i + b] << b));
+                r[i + b] = 0;
+            } else if (r[i] - (r[i + b] << b) >= -limit) {
+                r[i] = (int8_t)(r[i] - (r[i + b] << b));
+                for (int k = i + b; k < 256; k++) {
+                    if (!r[k]) {
+                        r[k] = 1;
+                        break;
+                    }
+                    r[k] = 0;
+                }
+            } else {
+                break;
+            }
+        }
+    }
+}
+
+// r = [a]A + [b]B
+static void ge_double_scalarmult_vartime(ge25519_p2* r, const uint8_t a[32], const ge25519_p3* A, const uint8_t b[32]) {
+    int8_t aslide[256], bslide[256];
+    ge25519_cached Ai[1 << (ED25519_POINT_WINDOW - 2)];
+    ge25519_p1p1 t;
+    ge25519_p3 u, A2;
+    int i;
+
+    ed25519_slide(aslide, a, ED25519_POINT_WINDOW);
+    ed25519_slide(bslide, b, ED25519_BASE_WINDOW);
+
+    ge_p3_to_cached(&Ai[0], A);
+    ge_p3_dbl(&t, A);
+    ge_p1p1_to_p3(&A2, &t);
+    for (i = 1; i < (1 << (ED25519_POINT_WINDOW - 2)); i++) {
+        ge_add_cached(&t, &A2, &Ai[i - 1], 0);
+        ge_p1p1_to_p3(&u, &t);
+        ge_p3_to_cached(&Ai[i], &u);
+    }
+
+    fe_0(r->X);
+    fe_1(r->Y);
+    fe_1(r->Z);
+
+    for (i = 255; i >= 0; i--) {
+        if (aslide[i] || bslide[i]) break;
+    }
+    for (; i >= 0; i--) {
+        ge_p2_dbl(&t, r);
+        if (aslide[i]) {
+            ge_p1p1_to_p3(&u, &t);
+            ge_add_cached(&t, &u, &Ai[(aslide[i] < 0 ? -aslide[i] : aslide[i]) / 2], aslide[i] < 0);
+        }
+        if (bslide[i]) {
+            ge_p1p1_to_p3(&u, &t);
+            ge_add_precomp(&t, &u, &ed25519_base_table[(bslide[i] < 0 ? -bslide[i] : bslide[i]) / 2], bslide[i] < 0);
+        }
+        ge_p1p1_to_p2(r, &t);
+    }
+}
+
+// r = x mod L for a 64-byte little-endian x. One bit at a time is plenty
+// next to the point arithmetic, and the input is public.
+static void sc_reduce(uint8_t r[32], const uint8_t x[64]) {
+    uint32_t acc[9], l[9];
+
+    memset(acc, 0, sizeof(acc));
+    memset(l, 0, sizeof(l));
+    for (int i = 0; i < 32; i++) l[i / 4] |= (uint32_t)ed25519_order[i] << (8 * (i % 4));
+
+    for (int bit = 511; bit >= 0; bit--) {
+        // acc = 2 acc + bit, then subtract L if acc >= L
+        for (int i = 8; i > 0; i--) acc[i] = (acc[i] << 1) | (acc[i - 1] >> 31);
+        acc[0] = (acc[0] << 1) | ((x[bit >> 3] >> (bit & 7)) & 1);
+
+        int ge = 1;
+        for (int i = 8; i >= 0; i--) {
+            if (acc[i] != l[i]) {
+                ge = acc[i] > l[i];
+                break;
+            }
+        }
+        if (ge) {
+            uint32_t borrow = 0;
+            for (int i = 0; i < 9; i++) {
+                uint64_t d = (uint64_t)acc[i] - l[i] - borrow;
+                acc[i] = (uint32_t)d;
+                borrow = (uint32_t)(d >> 63);
+            }
+        }
+    }
+    for (int i = 0; i < 32; i++) r[i] = (uint8_t)(acc[i / 4] >> (8 * (i % 4)));
+}
+
+// S must be canonical, i.e. below L (RFC 8032 section 5.1.7)
+static int sc_is_canonical(const uint8_t s[32]) {
+    for (int i = 31; i >= 0; i--) {
+        if (s[i] != ed25519_order[i]) return s[i] < ed25519_order[i];
+    }
+    return 0;
+}
+
+int crypto_ed25519_verify(const uint8_t* public_key, const uint8_t* message, uint32_t message_len, const uint8_t* signature) {
+    crypto_sha512_ctx_t sha;
+    ge25519_p3 A;
+    ge25519_p2 R;
+    uint8_t h[64], k[32], check[32];
+
+    if (!public_key || !signature || (!message && message_len)) {
+        return CRYPTO_ERROR_INVALID_PARAM;
+    }
+
+    ed25519_init_tables();
+
+    if (!sc_is_canonical(signature + 32)) return CRYPTO_ERROR_VERIFICATION_FAILED;
+    if (ge_frombytes(&A, public_key, 1) != 0) return CRYPTO_ERROR_VERIFICATION_FAILED;
+
+    // k = SHA-512(R || A || M) mod L
+    crypto_sha512_init(&sha);
+    crypto_sha512_update(&sha, signature, 32);
+    crypto_sha512_update(&sha, public_key, 32);
+    if (message_len) crypto_sha512_update(&sha, message, message_len);
+    crypto_sha512_final(&sha, h);
+    sc_reduce(k, h);
+
+    // R must equal [S]B - [k]A
+    ge_double_scalarmult_vartime(&R, k, &A, signature + 32);
+    ge_tobytes(check, &R);
+
+    return crypto_memcmp_constant_time(check, signature, 32) == 0
+               ? CRYPTO_SUCCESS : CRYPTO_ERROR_VERIFICATION_FAILED;
+}
+
+// RFC 8032 section 7.1, tests 1 and 2
+int crypto_self_test_ed25519(void) {
+    static const uint8_t pk1[32] = {
+        0xd7, 0x5a, 0x98, 0x01, 0x82, 0xb1, 0x0a, 0xb7, 0xd5, 0x4b, 0xfe, 0xd3, 0xc9, 0x64, 0x07, 0x3a,
+        0x0e, 0xe1, 0x72, 0xf3, 0xda, 0xa6, 0x23, 0x25, 0xaf, 0x02, 0x1a, 0x68, 0xf7, 0x07, 0x51, 0x1a
+    };
+    static const uint8_t sig1[64] = {
+        0xe5, 0x56, 0x43, 0x00, 0xc3, 0x60, 0xac, 0x72, 0x90, 0x86, 0xe2, 0xcc, 0x80, 0x6e, 0x82, 0x8a,
+        0x84, 0x87, 0x7f, 0x1e, 0xb8, 0xe5, 0xd9, 0x74, 0xd8, 0x73, 0xe0, 0x65, 0x22, 0x49, 0x01, 0x55,
+        0x5f, 0xb8, 0x82, 0x15, 0x90, 0xa3, 0x3b, 0xac, 0xc6, 0x1e, 0x39, 0x70, 0x1c, 0xf9, 0xb4, 0x6b,
+        0xd2, 0x5b, 0xf5, 0xf0, 0x59, 0x5b, 0xbe, 0x24, 0x65, 0x51, 0x41, 0x43, 0x8e, 0x7a, 0x10, 0x0b
+    };
+    static const uint8_t pk2[32] = {
+        0x3d, 0x40, 0x17, 0xc3, 0xe8, 0x43, 0x89, 0x5a, 0x92, 0xb7, 0x0a, 0xa7, 0x4d, 0x1b, 0x7e, 0xbc,
+        0x9c, 0x98, 0x2c, 0xcf, 0x2e, 0xc4, 0x96, 0x8c, 0xc0, 0xcd, 0x55, 0xf1, 0x2a, 0xf4, 0x66, 0x0c
+    };
+    static const uint8_t msg2[1] = { 0x72 };
+    static const uint8_t sig2[64] = {
+        0x92, 0xa0, 0x09, 0xa9, 0xf0, 0xd4, 0xca, 0xb8, 0x72, 0x0e, 0x82, 0x0b, 0x5f, 0x64, 0x25, 0x40,
+        0xa2, 0xb2, 0x7b, 0x54, 0x16, 0x50, 0x3f, 0x8f, 0xb3, 0x76, 0x22, 0x23, 0xeb, 0xdb, 0x69, 0xda,
+        0x08, 0x5a, 0xc1, 0xe4, 0x3e, 0x15, 0x99, 0x6e, 0x45, 0x8f, 0x36, 0x13, 0xd0, 0xf1, 0x1d, 0x8c,
+        0x38, 0x7b, 0x2e, 0xae, 0xb4, 0x30, 0x2a, 0xee, 0xb0, 0x0d, 0x29, 0x16, 0x12, 0xbb, 0x0c, 0x00
+    };
+    uint8_t bad[64];
+
+    if (crypto_ed25519_verify(pk1, NULL, 0, sig1) != CRYPTO_SUCCESS) return CRYPTO_ERROR_VERIFICATION_FAILED;
+    if (crypto_ed25519_verify(pk2, msg2, sizeof(msg2), sig2) != CRYPTO_SUCCESS) return CRYPTO_ERROR_VERIFICATION_FAILED;
+
+    memcpy(bad, sig2, sizeof(bad));
+    bad[5] ^= 0x01;
+    if (crypto_ed25519_verify(pk2, msg2, sizeof(msg2), bad) == CRYPTO_SUCCESS) return CRYPTO_ERROR_VERIFICATION_FAILED;
+    if (crypto_ed25519_verify(pk1, msg2, sizeof(msg2), sig2) == CRYPTO_SUCCESS) return CRYPTO_ERROR_VERIFICATION_FAILED;
+
+    return CRYPTO_SUCCESS;
+}
@@ -9,41 +9,155 @@
 #include "compat.h"
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
 #include "crypto.h"
+
+// RDSEED draws straight from the conditioner and may run dry for a while;
+// these bound how long one sample may spin before RDRAND stands in
+#define ENTROPY_RDSEED_RETRIES  64
+#define ENTROPY_RDRAND_RETRIES  10
+#define ENTROPY_JITTER_SAMPLES  64
+
+static entropy_source_fn g_platform_source = NULL;
+
+#if defined(__x86_64__) || defined(__i386__)
+static int g_cpu_probed = 0;
+static int g_has_rdrand = 0;
+static int g_has_rdseed = 0;
+
+static void entropy_probe_cpu(void) {
+    uint32_t eax, ebx, ecx, edx, max_leaf;
+
+    __asm__ volatile ("cpuid" : "=a"(max_leaf), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0));
+    __asm__ volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+    g_has_rdrand = (ecx >> 30) & 1;
+    if (max_leaf >= 7) {
+        __asm__ volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(7), "c"(0));
+        g_has_rdseed = (ebx >> 18) & 1;
+    }
+    g_cpu_probed = 1;
+}
+
 static int rdrand(uint32_t* out) {
-    int ok;
+    uint8_t ok;
     asm volatile ("rdrand %0; setc %1" : "=r"(*out), "=qm"(ok));
     return ok;
 }
 static int rdseed(uint32_t* out) {
-    int ok;
+    uint8_t ok;
     asm volatile ("rdseed %0; setc %1" : "=r"(*out), "=qm"(ok));
     return ok;
 }
-static uint32_t uefi_random(void) {
-    uint32_t v = 0;
-    if (*(volatile uint32_t*)0x80000000) v = *(volatile uint32_t*)0x80000000;
-    return v;
+
+// One 32-bit hardware sample, RDSEED first; 0 when the CPU has neither
+static int entropy_hw_sample(uint32_t* out) {
+    if (!g_cpu_probed) entropy_probe_cpu();
+    if (g_has_rdseed) {
+        for (int i = 0; i < ENTROPY_RDSEED_RETRIES; i++) {
+            if (rdseed(out)) return 1;
+        }
+    }
+    if (g_has_rdrand) {
+        for (int i = 0; i < ENTROPY_RDRAND_RETRIES; i++) {
+            if (rdrand(out)) return 1;
+        }
+    }
+    return 0;
+}
+
+static uint64_t entropy_timestamp(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+#elif defined(__aarch64__)
+static int entropy_hw_sample(uint32_t* out) {
+    (void)out;
+    return 0;
+}
+
+static uint64_t entropy_timestamp(void) {
+    uint64_t t;
+    asm volatile ("mrs %0, cntvct_el0" : "=r"(t));
+    return t;
+}
+#else
+static int entropy_hw_sample(uint32_t* out) {
+    (void)out;
+    return 0;
+}
+
+static uint64_t entropy_timestamp(void) {
+    return 0;
 }
-static uint32_t timing_jitter(void) {
+#endif
+
+void entropy_set_platform_source(entropy_source_fn source) {
+    g_platform_source = source;
+}
+
+// Timestamp deltas across a loop whose running time depends on cache and
+// pipeline state; low grade, so it is only ever mixed in with the rest
+static void entropy_jitter(crypto_sha256_ctx_t* ctx, uint32_t samples) {
     volatile uint32_t t = 0;
-    for (int i = 0; i < 1000; ++i) t += i * (uintptr_t)&t;
-    return t ^ (uintptr_t)&t;
+    uint64_t last = entropy_timestamp();
+
+    for (uint32_t s = 0; s < samples; s++) {
+        for (int i = 0; i < 64; ++i) t += i * (uint32_t)(uintptr_t)&t;
+        uint64_t now = entropy_timestamp();
+        uint32_t delta = (uint32_t)(now - last) ^ t;
+        crypto_sha256_update(ctx, (const uint8_t*)&delta, sizeof(delta));
+        last = now;
+    }
+}
+
+int entropy_gather(uint8_t* seed, uint32_t len) {
+    uint8_t block[CRYPTO_SHA256_DIGEST_LENGTH];
+    uint32_t counter = 0;
+
+    if (!seed || !len) return CRYPTO_ERROR_INVALID_PARAM;
+
+    while (len) {
+        crypto_sha256_ctx_t ctx;
+        uint8_t platform[32];
+        uint32_t hw[8];
+        int strong = 0;
+
+        crypto_sha256_init(&ctx);
+        crypto_sha256_update(&ctx, (const uint8_t*)&counter, sizeof(counter));
+
+        // Each output block conditions 256 bits from every source present
+        for (int i = 0; i < 8; i++) {
+            if (entropy_hw_sample(&hw[i])) strong = 1;
+            else hw[i] = 0;
+        }
+        crypto_sha256_update(&ctx, (const uint8_t*)hw, sizeof(hw));
+        if (g_platform_source && g_platform_source(platform, sizeof(platform))) {
+            crypto_sha256_update(&ctx, platform, sizeof(platform));
+            strong = 1;
+        }
+
+        // With neither hardware nor firmware randomness, lean on jitter
+        entropy_jitter(&ctx, strong ? ENTROPY_JITTER_SAMPLES : ENTROPY_JITTER_SAMPLES * 8);
+        crypto_sha256_final(&ctx, block);
+
+        uint32_t take = len < sizeof(block) ? len : (uint32_t)sizeof(block);
+        memcpy(seed, block, take);
+        seed += take;
+        len -= take;
+        counter++;
+
+        crypto_memzero_secure(platform, sizeof(platform));
+        crypto_memzero_secure(hw, sizeof(hw));
+        crypto_zeroize_context(&ctx, sizeof(ctx));
+    }
+
+    crypto_memzero_secure(block, sizeof(block));
+    return CRYPTO_SUCCESS;
 }
+
 uint32_t entropy_get(void) {
-    uint8_t pool[32];
-    uint32_t v = 0, ok = 0;
-    if (rdrand(&v)) ok = 1;
-    else if (rdseed(&v)) ok = 1;
-    else v = 0;
-    *(uint32_t*)pool = v;
-    *(uint32_t*)(pool+4) = uefi_random();
-    *(uint32_t*)(pool+8) = timing_jitter();
-    uint32_t t;
-    asm volatile ("rdtsc" : "=a"(t));
-    *(uint32_t*)(pool+12) = t;
-    for (int i = 16; i < 32; i += 4) *(uint32_t*)(pool+i) = (uintptr_t)&pool[i];
-    uint8_t hash[32];
-    sha256_hash(pool, 32, hash);
-    return *(uint32_t*)hash;
-} 
\ No newline at end of file
+    uint32_t v = 0;
+    entropy_gather((uint8_t*)&v, sizeof(v));
+    return v;
+}
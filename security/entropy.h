@@ -9,5 +9,15 @@
 #define BLOODHORN_ENTROPY_H
 #include <stdint.h>
 #include "compat.h"
+
+// Firmware randomness (the UEFI RNG protocol); fills `len` bytes and
+// returns nonzero on success
+typedef int (*entropy_source_fn)(uint8_t* buf, uint32_t len);
+void entropy_set_platform_source(entropy_source_fn source);
+
+// Seed material: RDSEED (RDRAND as fallback), the platform source and
+// timing jitter, conditioned through SHA-256. Slow; feed it to a DRBG
+// rather than calling it for every random number.
+int entropy_gather(uint8_t* seed, uint32_t len);
 uint32_t entropy_get(void);
-#endif 
\ No newline at end of file
+#endif
@@ -0,0 +1,149 @@
+/*
+ * hash_manifest.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include "hash_manifest.h"
+#include "compat.h"
+#include "../boot/libb/include/bloodhorn/hash.h"
+#include <stdint.h>
+#include <string.h>
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static int is_separator(char c) {
+    return c == '/' || c == '\\';
+}
+
+// Loads name files as "\EFI\vmlinuz", while manifests say "EFI/vmlinuz" or
+// "./EFI/vmlinuz"
+static const char* skip_root(const char* path, uint32_t* len) {
+    for (;;) {
+        if (*len >= 1 && is_separator(path[0])) { path++; (*len)--; continue; }
+        if (*len >= 2 && path[0] == '.' && is_separator(path[1])) { path += 2; *len -= 2; continue; }
+        return path;
+    }
+}
+
+static int same_path(const char* a, const char* b, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        if (a[i] != b[i] && !(is_separator(a[i]) && is_separator(b[i]))) return 0;
+    }
+    return 1;
+}
+
+// FNV-1a of the path, folded with the digest: the digest is uniform
+// already, so a word of it spreads builds of one path over the table
+static uint32_t entry_hash(const char* path, uint32_t len, const uint8_t* digest) {
+    uint32_t h = BH_FNV1A_INIT;
+    for (uint32_t i = 0; i < len; i++) {
+        uint8_t c = is_separator(path[i]) ? '/' : (uint8_t)path[i];
+        h = bh_fnv1a_step(h, c);
+    }
+    return bh_fnv1a_step(h, (uint32_t)digest[0] | (uint32_t)digest[1] << 8 | (uint32_t)digest[2] << 16 |
+                                (uint32_t)digest[3] << 24);
+}
+
+static const hash_manifest_entry_t* find(const hash_manifest_t* manifest, const char* path, uint32_t len,
+                                         const uint8_t* digest, uint32_t hash, uint32_t* free_slot) {
+    for (uint32_t i = hash & manifest->mask;; i = (i + 1) & manifest->mask) {
+        const hash_manifest_entry_t* entry = &manifest->slots[i];
+        if (!entry->path) {
+            if (free_slot) *free_slot = i;
+            return NULL;
+        }
+        if (entry->hash == hash && entry->path_len == len && same_path(entry->path, path, len) &&
+            memcmp(entry->digest, digest, manifest->digest_length) == 0) {
+            return entry;
+        }
+    }
+}
+
+// Digest length of a line by its run of hex digits, 0 if neither kind
+static uint32_t line_digest_length(const char* line, uint32_t len) {
+    uint32_t digits = 0;
+    while (digits < len && hex_value(line[digits]) >= 0) digits++;
+    if (digits == CRYPTO_SHA512_DIGEST_LENGTH * 2) return CRYPTO_SHA512_DIGEST_LENGTH;
+    if (digits == CRYPTO_BLAKE3_DIGEST_LENGTH * 2) return CRYPTO_BLAKE3_DIGEST_LENGTH;
+    return 0;
+}
+
+static int parse_line(hash_manifest_entry_t* entry, const char* line, uint32_t len, uint32_t digest_length) {
+    if (len < digest_length * 2 + 2) return -1;
+    memset(entry->digest, 0, sizeof(entry->digest));
+    for (uint32_t i = 0; i < digest_length; i++) {
+        int hi = hex_value(line[2 * i]), lo = hex_value(line[2 * i + 1]);
+        if (hi < 0 || lo < 0) return -1;
+        entry->digest[i] = (uint8_t)(hi << 4 | lo);
+    }
+    uint32_t at = digest_length * 2;
+    if (line[at] != ' ' && line[at] != '\t') return -1;
+    while (at < len && (line[at] == ' ' || line[at] == '\t')) at++;
+    // sha512sum marks files hashed in binary mode with '*'
+    if (at < len && line[at] == '*') at++;
+    while (len > at && (line[len - 1] == '\r' || line[len - 1] == ' ' || line[len - 1] == '\t')) len--;
+
+    uint32_t path_len = len - at;
+    entry->path = skip_root(line + at, &path_len);
+    entry->path_len = path_len;
+    return path_len == 0 ? -1 : 0;
+}
+
+uint32_t hash_manifest_slots(const char* text, uint32_t len) {
+    uint32_t lines = 1;
+    for (uint32_t i = 0; i < len && text[i] != 0; i++) {
+        if (text[i] == '\n') lines++;
+    }
+    uint32_t slots = 2;
+    while (slots < 2 * lines) slots <<= 1;
+    return slots;
+}
+
+int hash_manifest_parse(hash_manifest_t* manifest, const char* text, uint32_t len,
+                        hash_manifest_entry_t* slots, uint32_t slot_count) {
+    manifest->count = 0;
+    manifest->mask = 0;
+    manifest->digest_length = 0;
+    manifest->slots = NULL;
+    if (!slots || slot_count < hash_manifest_slots(text, len) || (slot_count & (slot_count - 1)) != 0) {
+        return -1;
+    }
+    memset(slots, 0, (size_t)slot_count * sizeof(*slots));
+    manifest->mask = slot_count - 1;
+    manifest->slots = slots;
+
+    uint32_t at = 0;
+    while (at < len) {
+        hash_manifest_entry_t entry;
+        uint32_t end = at;
+        while (end < len && text[end] != '\n' && text[end] != 0) end++;
+        uint32_t digest_length = line_digest_length(text + at, end - at);
+        if (digest_length && !manifest->digest_length) manifest->digest_length = digest_length;
+        if (digest_length && digest_length == manifest->digest_length &&
+            parse_line(&entry, text + at, end - at, digest_length) == 0) {
+            uint32_t slot;
+            entry.hash = entry_hash(entry.path, entry.path_len, entry.digest);
+            if (!find(manifest, entry.path, entry.path_len, entry.digest, entry.hash, &slot)) {
+                slots[slot] = entry;
+                manifest->count++;
+            }
+        }
+        if (end < len && text[end] == 0) break;
+        at = end + 1;
+    }
+    return (int)manifest->count;
+}
+
+int hash_manifest_allows(const hash_manifest_t* manifest, const char* path, uint32_t path_len,
+                         const uint8_t* digest) {
+    if (!manifest || !manifest->slots || !manifest->digest_length || !path || !digest) return 0;
+    path = skip_root(path, &path_len);
+    return find(manifest, path, path_len, digest, entry_hash(path, path_len, digest), NULL) != NULL;
+}
@@ -0,0 +1,52 @@
+/*
+ * hash_manifest.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_HASH_MANIFEST_H
+#define BLOODHORN_HASH_MANIFEST_H
+#include <stdint.h>
+#include "compat.h"
+#include "crypto.h"
+
+// Allowlist of the images the loader may boot, in sha512sum(1) or b3sum
+// format ("<hex digest>  <path>" per line). The first entry fixes the
+// algorithm by its length, SHA-512 or BLAKE3, and lines in the other one
+// are skipped. A path may be listed any number of times, once per build
+// allowed under it. The entries go into an open-addressing table keyed by
+// path and digest, at most half full, so checking one load is a hash and,
+// as a rule, a single compare.
+#define HASH_MANIFEST_MAX           (1024 * 1024)   // Bytes of manifest read
+#define HASH_MANIFEST_DIGEST_LENGTH CRYPTO_SHA512_DIGEST_LENGTH     // Largest
+
+typedef struct {
+    const char* path;                   // Into the manifest text; NULL: free slot
+    uint32_t path_len;
+    uint32_t hash;
+    uint8_t digest[HASH_MANIFEST_DIGEST_LENGTH];
+} hash_manifest_entry_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t mask;                      // Slots - 1
+    uint32_t digest_length;             // SHA-512 or BLAKE3; 0 while empty
+    hash_manifest_entry_t* slots;
+} hash_manifest_t;
+
+// Slots a table for this text needs (a power of two, at least twice the
+// number of lines)
+uint32_t hash_manifest_slots(const char* text, uint32_t len);
+// Read a manifest into `slots`, which must hold hash_manifest_slots() of
+// them; the entries point into `text`, which has to outlive the table.
+// Malformed lines and repeated entries are skipped. Returns the number of
+// entries, or -1 if `slots` is too small.
+int hash_manifest_parse(hash_manifest_t* manifest, const char* text, uint32_t len,
+                        hash_manifest_entry_t* slots, uint32_t slot_count);
+// Nonzero if the manifest lists `digest` (digest_length bytes) for
+// `path`. Paths compare with '\' and '/' alike and without a leading
+// separator or "./".
+int hash_manifest_allows(const hash_manifest_t* manifest, const char* path, uint32_t path_len,
+                         const uint8_t* digest);
+#endif
@@ -0,0 +1,132 @@
+/*
+ * image_cache.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include "image_cache.h"
+#include "compat.h"
+#include "crypto.h"
+#include <string.h>
+#include <stddef.h>
+
+// Everything in front of the MAC is authenticated, unused records included
+#define IMAGE_CACHE_SEALED_SIZE offsetof(image_cache_t, mac)
+
+void image_cache_init(image_cache_t* cache) {
+    memset(cache, 0, sizeof(*cache));
+    cache->version = IMAGE_CACHE_VERSION;
+}
+
+int image_cache_open(image_cache_t* cache, const uint8_t* key, uint32_t key_len) {
+    uint8_t mac[CRYPTO_SHA256_DIGEST_LENGTH];
+    int ok;
+
+    if (!cache || !key) return 0;
+
+    ok = cache->version == IMAGE_CACHE_VERSION && cache->count <= IMAGE_CACHE_MAX_RECORDS;
+    if (ok) {
+        crypto_hmac_sha256(key, key_len, (const uint8_t*)cache, (uint32_t)IMAGE_CACHE_SEALED_SIZE, mac);
+        ok = crypto_memcmp_constant_time(mac, cache->mac, sizeof(mac)) == 0;
+        crypto_memzero_secure(mac, sizeof(mac));
+    }
+    if (!ok) image_cache_init(cache);
+    return ok;
+}
+
+void image_cache_seal(image_cache_t* cache, const uint8_t* key, uint32_t key_len) {
+    if (!cache || !key) return;
+    crypto_hmac_sha256(key, key_len, (const uint8_t*)cache, (uint32_t)IMAGE_CACHE_SEALED_SIZE, cache->mac);
+}
+
+void image_cache_edges_init(image_cache_edges_t* edges) {
+    edges->total = 0;
+    edges->head_len = 0;
+    edges->tail_len = 0;
+}
+
+void image_cache_edges_update(image_cache_edges_t* edges, const uint8_t* data, uint32_t len) {
+    if (!edges || !data || !len) return;
+
+    if (edges->head_len < IMAGE_CACHE_EDGE_SIZE) {
+        uint32_t take = IMAGE_CACHE_EDGE_SIZE - edges->head_len;
+        if (take > len) take = len;
+        memcpy(edges->head + edges->head_len, data, take);
+        edges->head_len += take;
+    }
+
+    // The tail is a sliding window over the last IMAGE_CACHE_EDGE_SIZE bytes
+    if (len >= IMAGE_CACHE_EDGE_SIZE) {
+        memcpy(edges->tail, data + len - IMAGE_CACHE_EDGE_SIZE, IMAGE_CACHE_EDGE_SIZE);
+        edges->tail_len = IMAGE_CACHE_EDGE_SIZE;
+    } else if (edges->tail_len + len <= IMAGE_CACHE_EDGE_SIZE) {
+        memcpy(edges->tail + edges->tail_len, data, len);
+        edges->tail_len += len;
+    } else {
+        uint32_t keep = IMAGE_CACHE_EDGE_SIZE - len;
+        memmove(edges->tail, edges->tail + edges->tail_len - keep, keep);
+        memcpy(edges->tail + keep, data, len);
+        edges->tail_len = IMAGE_CACHE_EDGE_SIZE;
+    }
+
+    edges->total += len;
+}
+
+void image_cache_edges_final(const image_cache_edges_t* edges, uint8_t* edge_hash) {
+    crypto_sha256_ctx_t ctx;
+    uint8_t size[8];
+
+    for (int i = 0; i < 8; i++) size[i] = (uint8_t)(edges->total >> (56 - 8 * i));
+
+    crypto_sha256_init(&ctx);
+    crypto_sha256_update(&ctx, size, sizeof(size));
+    if (edges->head_len) crypto_sha256_update(&ctx, edges->head, edges->head_len);
+    if (edges->tail_len) crypto_sha256_update(&ctx, edges->tail, edges->tail_len);
+    crypto_sha256_final(&ctx, edge_hash);
+}
+
+// Same volume and path: the slot a new verification replaces
+static int image_cache_same_file(const image_cache_key_t* a, const image_cache_key_t* b) {
+    return memcmp(a->volume_guid, b->volume_guid, sizeof(a->volume_guid)) == 0 &&
+           memcmp(a->path, b->path, sizeof(a->path)) == 0;
+}
+
+const image_cache_record_t* image_cache_find(const image_cache_t* cache, const image_cache_key_t* key,
+                                             const uint8_t* digest) {
+    if (!cache || !key) return NULL;
+
+    for (uint32_t i = 0; i < cache->count && i < IMAGE_CACHE_MAX_RECORDS; i++) {
+        const image_cache_record_t* r = &cache->records[i];
+        if (image_cache_same_file(&r->key, key) &&
+            r->key.size == key->size && r->key.mtime == key->mtime && r->key.mtime_ns == key->mtime_ns &&
+            (!digest || crypto_memcmp_constant_time(r->digest, digest, IMAGE_CACHE_DIGEST_LENGTH) == 0)) {
+            return r;
+        }
+    }
+    return NULL;
+}
+
+int image_cache_match(const image_cache_record_t* record, const image_cache_key_t* key) {
+    if (!record || !key) return 0;
+    return crypto_memcmp_constant_time(record->key.edge_hash, key->edge_hash, sizeof(key->edge_hash)) == 0;
+}
+
+void image_cache_store(image_cache_t* cache, const image_cache_key_t* key, const uint8_t* digest) {
+    uint32_t slot;
+
+    if (!cache || !key || !digest) return;
+
+    // Reuse this file's slot, or the last one once the table is full
+    for (slot = 0; slot < cache->count; slot++) {
+        if (image_cache_same_file(&cache->records[slot].key, key)) break;
+    }
+    if (slot == cache->count) {
+        if (cache->count < IMAGE_CACHE_MAX_RECORDS) cache->count++;
+        slot = cache->count - 1;
+    }
+
+    memmove(&cache->records[1], &cache->records[0], slot * sizeof(cache->records[0]));
+    memcpy(&cache->records[0].key, key, sizeof(*key));
+    memcpy(cache->records[0].digest, digest, IMAGE_CACHE_DIGEST_LENGTH);
+}
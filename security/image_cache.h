@@ -0,0 +1,77 @@
+/*
+ * image_cache.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_IMAGE_CACHE_H
+#define BLOODHORN_IMAGE_CACHE_H
+#include <stdint.h>
+#include "compat.h"
+#include "crypto.h"
+
+// Remembers images whose full SHA-512 already matched, so a warm boot of an
+// unchanged file can skip hashing it again. A file is identified by its
+// volume, path, size, modification time and a hash of its first and last
+// IMAGE_CACHE_EDGE_SIZE bytes; the whole table is sealed with an
+// HMAC-SHA256 under a platform key and persisted as this exact layout.
+#define IMAGE_CACHE_VERSION         1
+#define IMAGE_CACHE_MAX_RECORDS     8
+#define IMAGE_CACHE_PATH_LEN        96
+#define IMAGE_CACHE_EDGE_SIZE       4096
+#define IMAGE_CACHE_DIGEST_LENGTH   CRYPTO_SHA512_DIGEST_LENGTH
+
+typedef struct {
+    uint8_t volume_guid[16];            // Partition GUID of the volume
+    uint16_t path[IMAGE_CACHE_PATH_LEN]; // UCS-2 path, NUL padded
+    uint64_t size;
+    uint64_t mtime;                     // Packed modification time
+    uint32_t mtime_ns;
+    uint32_t reserved;
+    uint8_t edge_hash[CRYPTO_SHA256_DIGEST_LENGTH];
+} image_cache_key_t;
+
+typedef struct {
+    image_cache_key_t key;
+    uint8_t digest[IMAGE_CACHE_DIGEST_LENGTH]; // SHA-512 the image verified against
+} image_cache_record_t;
+
+typedef struct {
+    uint32_t version;                   // IMAGE_CACHE_VERSION
+    uint32_t count;                     // Records in use, most recent first
+    image_cache_record_t records[IMAGE_CACHE_MAX_RECORDS];
+    uint8_t mac[CRYPTO_SHA256_DIGEST_LENGTH];
+} image_cache_t;
+
+// First and last bytes of an image, collected as it streams past
+typedef struct {
+    uint64_t total;
+    uint32_t head_len;
+    uint32_t tail_len;
+    uint8_t head[IMAGE_CACHE_EDGE_SIZE];
+    uint8_t tail[IMAGE_CACHE_EDGE_SIZE];
+} image_cache_edges_t;
+
+// Reset `cache` to empty, or accept one loaded from storage (resetting it
+// when the version or MAC is wrong); returns nonzero if it was accepted
+void image_cache_init(image_cache_t* cache);
+int image_cache_open(image_cache_t* cache, const uint8_t* key, uint32_t key_len);
+void image_cache_seal(image_cache_t* cache, const uint8_t* key, uint32_t key_len);
+
+void image_cache_edges_init(image_cache_edges_t* edges);
+void image_cache_edges_update(image_cache_edges_t* edges, const uint8_t* data, uint32_t len);
+void image_cache_edges_final(const image_cache_edges_t* edges, uint8_t* edge_hash);
+
+// Record for the same volume, path, size and time whose digest is
+// `digest` (any digest if NULL), or NULL; the edge hash is left for the
+// caller to compare once the image is in
+const image_cache_record_t* image_cache_find(const image_cache_t* cache, const image_cache_key_t* key,
+                                             const uint8_t* digest);
+int image_cache_match(const image_cache_record_t* record, const image_cache_key_t* key);
+
+// Remember a fully verified image, replacing any older record for the
+// same volume and path and evicting the least recently stored one
+void image_cache_store(image_cache_t* cache, const image_cache_key_t* key, const uint8_t* digest);
+
+#endif
@@ -0,0 +1,280 @@
+/*
+ * merkle.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include "merkle.h"
+#include "compat.h"
+#include "crypto.h"
+#include "secure_boot.h"
+#include <string.h>
+
+#define MERKLE_LEAF_PREFIX  0x00
+#define MERKLE_NODE_PREFIX  0x01
+
+static uint16_t merkle_be16(const uint8_t* p) {
+    return (uint16_t)(((uint16_t)p[0] << 8) | p[1]);
+}
+
+static uint32_t merkle_be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t merkle_be64(const uint8_t* p) {
+    return ((uint64_t)merkle_be32(p) << 32) | merkle_be32(p + 4);
+}
+
+static void merkle_node_hash(const uint8_t* left, const uint8_t* right, uint8_t* node) {
+    crypto_sha256_ctx_t ctx;
+    uint8_t prefix = MERKLE_NODE_PREFIX;
+
+    crypto_sha256_init(&ctx);
+    crypto_sha256_update(&ctx, &prefix, 1);
+    crypto_sha256_update(&ctx, left, MERKLE_HASH_LENGTH);
+    crypto_sha256_update(&ctx, right, MERKLE_HASH_LENGTH);
+    crypto_sha256_final(&ctx, node);
+}
+
+static void merkle_leaf_begin(crypto_sha256_ctx_t* ctx) {
+    uint8_t prefix = MERKLE_LEAF_PREFIX;
+
+    crypto_sha256_init(ctx);
+    crypto_sha256_update(ctx, &prefix, 1);
+}
+
+void merkle_leaf_hash(const uint8_t* chunk, uint32_t len, uint8_t* leaf) {
+    crypto_sha256_ctx_t ctx;
+
+    merkle_leaf_begin(&ctx);
+    if (len) crypto_sha256_update(&ctx, chunk, len);
+    crypto_sha256_final(&ctx, leaf);
+}
+
+// RFC 6962 tree hash, computed left to right with one pending subtree per
+// height: a subtree is merged as soon as its sibling completes, and the
+// leftovers fold right to left, which is where the odd nodes would sit in
+// the split-at-the-largest-power-of-two definition
+void merkle_tree_root(const uint8_t* leaves, uint32_t count, uint8_t* root) {
+    uint8_t stack[33][MERKLE_HASH_LENGTH];
+    uint8_t height[33];
+    uint32_t depth = 0;
+
+    if (count == 0) {
+        merkle_leaf_hash(NULL, 0, root);
+        return;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        memcpy(stack[depth], leaves + (size_t)i * MERKLE_HASH_LENGTH, MERKLE_HASH_LENGTH);
+        height[depth++] = 0;
+        while (depth >= 2 && height[depth - 1] == height[depth - 2]) {
+            merkle_node_hash(stack[depth - 2], stack[depth - 1], stack[depth - 2]);
+            height[depth - 2]++;
+            depth--;
+        }
+    }
+    while (depth >= 2) {
+        merkle_node_hash(stack[depth - 2], stack[depth - 1], stack[depth - 2]);
+        depth--;
+    }
+    memcpy(root, stack[0], MERKLE_HASH_LENGTH);
+}
+
+int merkle_manifest_verify(const uint8_t* data, uint32_t len, uint8_t algorithm,
+                           const uint8_t* pubkey, uint32_t pubkey_len,
+                           merkle_manifest_t* manifest) {
+    uint8_t root[MERKLE_HASH_LENGTH];
+    uint32_t chunk_size, chunk_count;
+    uint64_t image_size, leaves_len;
+    int sig_len;
+
+    if (!data || !pubkey || !manifest) return CRYPTO_ERROR_INVALID_PARAM;
+    if (len < MERKLE_MANIFEST_HEADER_SIZE) return CRYPTO_ERROR_VERIFICATION_FAILED;
+
+    if (merkle_be32(data) != MERKLE_MANIFEST_MAGIC ||
+        merkle_be16(data + 4) != MERKLE_MANIFEST_VERSION ||
+        merkle_be16(data + 6) != 0) {
+        return CRYPTO_ERROR_NOT_SUPPORTED;
+    }
+
+    chunk_size = merkle_be32(data + 8);
+    chunk_count = merkle_be32(data + 12);
+    image_size = merkle_be64(data + 16);
+    if (chunk_size < MERKLE_MIN_CHUNK_SIZE || chunk_size > MERKLE_MAX_CHUNK_SIZE ||
+        (chunk_size & (chunk_size - 1)) != 0) {
+        return CRYPTO_ERROR_VERIFICATION_FAILED;
+    }
+    // Every chunk but the last is full and the last is not empty
+    if (image_size == 0 || chunk_count == 0 ||
+        (image_size + chunk_size - 1) / chunk_size != chunk_count) {
+        return CRYPTO_ERROR_VERIFICATION_FAILED;
+    }
+
+    sig_len = secure_boot_signature_length(algorithm, pubkey, pubkey_len);
+    if (sig_len <= 0) return CRYPTO_ERROR_INVALID_PARAM;
+    leaves_len = (uint64_t)chunk_count * MERKLE_HASH_LENGTH;
+    if ((uint64_t)len != MERKLE_MANIFEST_HEADER_SIZE + leaves_len + (uint64_t)sig_len) {
+        return CRYPTO_ERROR_VERIFICATION_FAILED;
+    }
+
+    if (secure_boot_verify_ex(algorithm, data, MERKLE_MANIFEST_HEADER_SIZE,
+                              data + MERKLE_MANIFEST_HEADER_SIZE + leaves_len, (uint32_t)sig_len,
+                              pubkey, pubkey_len) != CRYPTO_SUCCESS) {
+        return CRYPTO_ERROR_VERIFICATION_FAILED;
+    }
+
+    // The signature covers only the root; the leaves must hash to it
+    merkle_tree_root(data + MERKLE_MANIFEST_HEADER_SIZE, chunk_count, root);
+    if (crypto_memcmp_constant_time(root, data + 24, MERKLE_HASH_LENGTH) != 0) {
+        return CRYPTO_ERROR_VERIFICATION_FAILED;
+    }
+
+    manifest->chunk_size = chunk_size;
+    manifest->chunk_count = chunk_count;
+    manifest->image_size = image_size;
+    memcpy(manifest->root, root, MERKLE_HASH_LENGTH);
+    manifest->leaves = data + MERKLE_MANIFEST_HEADER_SIZE;
+    return CRYPTO_SUCCESS;
+}
+
+uint64_t merkle_chunk_offset(const merkle_manifest_t* manifest, uint32_t index) {
+    if (!manifest || index >= manifest->chunk_count) return 0;
+    return (uint64_t)index * manifest->chunk_size;
+}
+
+uint32_t merkle_chunk_length(const merkle_manifest_t* manifest, uint32_t index) {
+    uint64_t offset;
+
+    if (!manifest || index >= manifest->chunk_count) return 0;
+    offset = (uint64_t)index * manifest->chunk_size;
+    if (manifest->image_size - offset < manifest->chunk_size) {
+        return (uint32_t)(manifest->image_size - offset);
+    }
+    return manifest->chunk_size;
+}
+
+int merkle_verify_chunk(const merkle_manifest_t* manifest, uint32_t index,
+                        const uint8_t* data, uint32_t len) {
+    uint8_t leaf[MERKLE_HASH_LENGTH];
+
+    if (!manifest || !data) return CRYPTO_ERROR_INVALID_PARAM;
+    if (index >= manifest->chunk_count || len != merkle_chunk_length(manifest, index)) {
+        return CRYPTO_ERROR_VERIFICATION_FAILED;
+    }
+
+    merkle_leaf_hash(data, len, leaf);
+    if (crypto_memcmp_constant_time(leaf, manifest->leaves + (size_t)index * MERKLE_HASH_LENGTH,
+                                    MERKLE_HASH_LENGTH) != 0) {
+        return CRYPTO_ERROR_VERIFICATION_FAILED;
+    }
+    return CRYPTO_SUCCESS;
+}
+
+int merkle_stream_init(merkle_stream_t* stream, const merkle_manifest_t* manifest) {
+    if (!stream || !manifest) return CRYPTO_ERROR_INVALID_PARAM;
+
+    stream->manifest = manifest;
+    stream->offset = 0;
+    stream->index = 0;
+    stream->filled = 0;
+    stream->status = CRYPTO_SUCCESS;
+    merkle_leaf_begin(&stream->ctx);
+    return CRYPTO_SUCCESS;
+}
+
+int merkle_stream_update(merkle_stream_t* stream, const uint8_t* data, uint32_t len) {
+    const merkle_manifest_t* m;
+    uint8_t leaf[MERKLE_HASH_LENGTH];
+
+    if (!stream || !stream->manifest || (!data && len)) return CRYPTO_ERROR_INVALID_PARAM;
+    if (stream->status != CRYPTO_SUCCESS) return stream->status;
+
+    m = stream->manifest;
+    if (len > m->image_size - stream->offset) {
+        stream->status = CRYPTO_ERROR_VERIFICATION_FAILED;
+        return stream->status;
+    }
+
+    while (len) {
+        uint32_t chunk_len = merkle_chunk_length(m, stream->index);
+        uint32_t take = chunk_len - stream->filled;
+        if (take > len) take = len;
+
+        crypto_sha256_update(&stream->ctx, data, take);
+        stream->filled += take;
+        stream->offset += take;
+        data += take;
+        len -= take;
+
+        if (stream->filled == chunk_len) {
+            crypto_sha256_final(&stream->ctx, leaf);
+            if (crypto_memcmp_constant_time(leaf, m->leaves + (size_t)stream->index * MERKLE_HASH_LENGTH,
+                                            MERKLE_HASH_LENGTH) != 0) {
+                stream->status = CRYPTO_ERROR_VERIFICATION_FAILED;
+                return stream->status;
+            }
+            stream->index++;
+            stream->filled = 0;
+            merkle_leaf_begin(&stream->ctx);
+        }
+    }
+    return CRYPTO_SUCCESS;
+}
+
+int merkle_stream_final(merkle_stream_t* stream) {
+    int status;
+
+    if (!stream || !stream->manifest) return CRYPTO_ERROR_INVALID_PARAM;
+
+    status = stream->status;
+    if (status == CRYPTO_SUCCESS && stream->offset != stream->manifest->image_size) {
+        status = CRYPTO_ERROR_VERIFICATION_FAILED;
+    }
+    crypto_zeroize_context(&stream->ctx, sizeof(stream->ctx));
+    stream->status = status != CRYPTO_SUCCESS ? status : CRYPTO_ERROR_INVALID_PARAM;
+    return status;
+}
+
+int crypto_self_test_merkle(void) {
+    // RFC 6962 root over "abcd" | "efgh" | "ij"
+    static const uint8_t expected_root[32] = {
+        0x2a, 0x5b, 0x33, 0xd5, 0x4d, 0x89, 0xd0, 0x57, 0x37, 0xa7, 0xdd, 0x79, 0x8d, 0x98, 0x62, 0xd5,
+        0x59, 0x51, 0x56, 0x4a, 0xaf, 0xb5, 0x46, 0x06, 0x91, 0xad, 0x8a, 0x7a, 0x9a, 0xb6, 0xc6, 0x78
+    };
+    uint8_t image[10];
+    uint8_t leaves[3 * MERKLE_HASH_LENGTH];
+    merkle_manifest_t m;
+    merkle_stream_t s;
+
+    memcpy(image, "abcdefghij", sizeof(image));
+    m.chunk_size = 4;
+    m.chunk_count = 3;
+    m.image_size = sizeof(image);
+    m.leaves = leaves;
+    for (uint32_t i = 0; i < m.chunk_count; i++) {
+        merkle_leaf_hash(image + merkle_chunk_offset(&m, i), merkle_chunk_length(&m, i),
+                         leaves + i * MERKLE_HASH_LENGTH);
+    }
+    merkle_tree_root(leaves, m.chunk_count, m.root);
+    if (memcmp(m.root, expected_root, sizeof(expected_root)) != 0) return CRYPTO_ERROR_VERIFICATION_FAILED;
+
+    // Pieces that straddle chunk boundaries
+    merkle_stream_init(&s, &m);
+    if (merkle_stream_update(&s, image, 3) != CRYPTO_SUCCESS ||
+        merkle_stream_update(&s, image + 3, 6) != CRYPTO_SUCCESS ||
+        merkle_stream_update(&s, image + 9, 1) != CRYPTO_SUCCESS ||
+        merkle_stream_final(&s) != CRYPTO_SUCCESS) {
+        return CRYPTO_ERROR_VERIFICATION_FAILED;
+    }
+
+    // A bad middle chunk is caught as soon as it completes
+    image[5] ^= 0x01;
+    if (merkle_verify_chunk(&m, 1, image + 4, 4) == CRYPTO_SUCCESS) return CRYPTO_ERROR_VERIFICATION_FAILED;
+    merkle_stream_init(&s, &m);
+    if (merkle_stream_update(&s, image, 8) == CRYPTO_SUCCESS) return CRYPTO_ERROR_VERIFICATION_FAILED;
+    if (merkle_stream_final(&s) == CRYPTO_SUCCESS) return CRYPTO_ERROR_VERIFICATION_FAILED;
+
+    return CRYPTO_SUCCESS;
+}
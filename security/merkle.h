@@ -0,0 +1,74 @@
+/*
+ * merkle.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_MERKLE_H
+#define BLOODHORN_MERKLE_H
+#include <stdint.h>
+#include "compat.h"
+#include "crypto.h"
+
+// Detached chunk manifest for large images. All integers are big-endian:
+//
+//   [magic "BHMT"][version u16][reserved u16][chunk_size u32]
+//   [chunk_count u32][image_size u64][root 32]          (the header)
+//   [leaf 32] * chunk_count
+//   [signature over the header, secure_boot_verify_ex scheme]
+//
+// Leaf i is SHA-256(0x00 || chunk i) and the root is the RFC 6962 tree hash
+// over the leaves (inner nodes SHA-256(0x01 || left || right)), so only the
+// 56-byte header is signed and each chunk can be checked on its own.
+#define MERKLE_MANIFEST_MAGIC       0x42484D54  // "BHMT"
+#define MERKLE_MANIFEST_VERSION     1
+#define MERKLE_MANIFEST_HEADER_SIZE 56
+#define MERKLE_HASH_LENGTH          CRYPTO_SHA256_DIGEST_LENGTH
+#define MERKLE_MIN_CHUNK_SIZE       (4 * 1024)
+#define MERKLE_MAX_CHUNK_SIZE       (16 * 1024 * 1024)
+
+// A manifest accepted by merkle_manifest_verify; leaves points into the
+// caller's manifest buffer, which must outlive it
+typedef struct {
+    uint32_t chunk_size;
+    uint32_t chunk_count;
+    uint64_t image_size;
+    uint8_t root[MERKLE_HASH_LENGTH];
+    const uint8_t* leaves;
+} merkle_manifest_t;
+
+// Incremental check of an image streamed in order, in pieces of any size
+typedef struct {
+    const merkle_manifest_t* manifest;
+    crypto_sha256_ctx_t ctx;
+    uint64_t offset;    // image bytes consumed so far
+    uint32_t index;     // chunk being hashed
+    uint32_t filled;    // bytes of that chunk seen
+    int status;         // sticky: first failure wins
+} merkle_stream_t;
+
+// Check the header signature and that the leaves hash to the signed root
+int merkle_manifest_verify(const uint8_t* data, uint32_t len, uint8_t algorithm,
+                           const uint8_t* pubkey, uint32_t pubkey_len,
+                           merkle_manifest_t* manifest);
+
+void merkle_leaf_hash(const uint8_t* chunk, uint32_t len, uint8_t* leaf);
+void merkle_tree_root(const uint8_t* leaves, uint32_t count, uint8_t* root);
+
+// Chunk geometry (the last chunk may be short); 0 for an index past the end
+uint64_t merkle_chunk_offset(const merkle_manifest_t* manifest, uint32_t index);
+uint32_t merkle_chunk_length(const merkle_manifest_t* manifest, uint32_t index);
+
+// Check one resident chunk against its leaf; safe to call from several
+// processors at once
+int merkle_verify_chunk(const merkle_manifest_t* manifest, uint32_t index,
+                        const uint8_t* data, uint32_t len);
+
+// Streaming check: update fails at the first chunk that does not match,
+// final fails unless exactly image_size bytes were seen
+int merkle_stream_init(merkle_stream_t* stream, const merkle_manifest_t* manifest);
+int merkle_stream_update(merkle_stream_t* stream, const uint8_t* data, uint32_t len);
+int merkle_stream_final(merkle_stream_t* stream);
+
+#endif
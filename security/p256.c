@@ -0,0 +1,573 @@
+/*
+ * p256.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include "crypto.h"
+#include "bignum.h"
+#include <string.h>
+
+// ECDSA verification over NIST P-256. Field elements and scalars are four
+// 64-bit limbs kept in Montgomery form; multiplication, addition and
+// subtraction run in constant time and finish with masked rather than
+// branching reductions. Points are Jacobian with a = -3. The inputs to a
+// verification are all public, so u1 G + u2 Q is a single interleaved
+// variable-time pass over width-w NAF digits, with the odd multiples of G
+// computed once and kept in affine form.
+
+#define P256_LIMBS 4
+#define P256_BASE_WINDOW 7
+#define P256_POINT_WINDOW 5
+#define P256_NAF_DIGITS 257
+
+typedef bn_limb_t p256_elem[P256_LIMBS];
+
+typedef struct {
+    p256_elem m;       // Modulus
+    p256_elem rr;      // R^2 mod m, R = 2^256
+    bn_limb_t n0inv;   // -m^-1 mod 2^64
+} p256_modulus_t;
+
+typedef struct { p256_elem X, Y, Z; } p256_jacobian;
+typedef struct { p256_elem x, y; } p256_affine;
+
+static const p256_modulus_t p256_field = {
+    { 0xffffffffffffffffULL, 0x00000000ffffffffULL, 0x0000000000000000ULL, 0xffffffff00000001ULL },
+    { 0x0000000000000003ULL, 0xfffffffbffffffffULL, 0xfffffffffffffffeULL, 0x00000004fffffffdULL },
+    0x0000000000000001ULL
+};
+
+static const p256_modulus_t p256_order = {
+    { 0xf3b9cac2fc632551ULL, 0xbce6faada7179e84ULL, 0xffffffffffffffffULL, 0xffffffff00000000ULL },
+    { 0x83244c95be79eea2ULL, 0x4699799c49bd6fa6ULL, 0x2845b2392b6bec59ULL, 0x66e12d94f3d95620ULL },
+    0xccd1c8aaee00bc4fULL
+};
+
+static const p256_elem p256_b = {
+    0x3bce3c3e27d2604bULL, 0x651d06b0cc53b0f6ULL, 0xb3ebbd55769886bcULL, 0x5ac635d8aa3a93e7ULL
+};
+static const p256_elem p256_gx = {
+    0xf4a13945d898c296ULL, 0x77037d812deb33a0ULL, 0xf8bce6e563a440f2ULL, 0x6b17d1f2e12c4247ULL
+};
+static const p256_elem p256_gy = {
+    0xcbb6406837bf51f5ULL, 0x2bce33576b315eceULL, 0x8ee7eb4a7c0f9e16ULL, 0x4fe342e2fe1a7f9bULL
+};
+static const p256_elem p256_zero = { 0, 0, 0, 0 };
+static const p256_elem p256_one = { 1, 0, 0, 0 };
+
+static p256_elem p256_b_mont;
+static p256_affine p256_base_table[1 << (P256_BASE_WINDOW - 2)];
+static int p256_tables_ready = 0;
+
+static void p256_from_bytes(p256_elem r, const uint8_t in[32]) {
+    for (int i = 0; i < P256_LIMBS; i++) {
+        bn_limb_t v = 0;
+        for (int j = 0; j < 8; j++) v = (v << 8) | in[(3 - i) * 8 + j];
+        r[i] = v;
+    }
+}
+
+// Returns 1 when a < b; variable-time, for range checks on public values
+static int p256_less(const p256_elem a, const p256_elem b) {
+    for (int i = P256_LIMBS - 1; i >= 0; i--) {
+        if (a[i] != b[i]) return a[i] < b[i];
+    }
+    return 0;
+}
+
+static int p256_is_zero(const p256_elem a) {
+    return (a[0] | a[1] | a[2] | a[3]) == 0;
+}
+
+static int p256_equal(const p256_elem a, const p256_elem b) {
+    return ((a[0] ^ b[0]) | (a[1] ^ b[1]) | (a[2] ^ b[2]) | (a[3] ^ b[3])) == 0;
+}
+
+// r = a - b over four limbs, returning the borrow
+static bn_limb_t p256_sub_raw(p256_elem r, const p256_elem a, const p256_elem b) {
+    bn_limb_t borrow = 0;
+    for (int i = 0; i < P256_LIMBS; i++) {
+        bn_limb_t t = a[i] - b[i];
+        bn_limb_t out = t - borrow;
+        borrow = (a[i] < b[i]) | (t < borrow);
+        r[i] = out;
+    }
+    return borrow;
+}
+
+// r = mask ? a : b
+static void p256_select(p256_elem r, bn_limb_t mask, const p256_elem a, const p256_elem b) {
+    for (int i = 0; i < P256_LIMBS; i++) r[i] = (a[i] & mask) | (b[i] & ~mask);
+}
+
+// Reduces a value below 2m, given as four limbs plus a carry
+static void p256_reduce_once(p256_elem r, const p256_elem t, bn_limb_t carry, const p256_modulus_t* m) {
+    p256_elem u;
+    bn_limb_t borrow = p256_sub_raw(u, t, m->m);
+    // Keep t only when it neither overflowed nor reached m
+    bn_limb_t keep = (bn_limb_t)0 - ((carry ^ 1) & borrow);
+    p256_select(r, keep, t, u);
+}
+
+static void p256_add(p256_elem r, const p256_elem a, const p256_elem b, const p256_modulus_t* m) {
+    p256_elem t;
+    bn_limb_t carry = 0;
+    for (int i = 0; i < P256_LIMBS; i++) {
+        bn_limb_t s = a[i] + carry;
+        carry = (s < carry);
+        t[i] = s + b[i];
+        carry |= (t[i] < s);
+    }
+    p256_reduce_once(r, t, carry, m);
+}
+
+static void p256_sub(p256_elem r, const p256_elem a, const p256_elem b, const p256_modulus_t* m) {
+    p256_elem t, u;
+    bn_limb_t borrow = p256_sub_raw(t, a, b);
+    bn_limb_t carry = 0;
+    for (int i = 0; i < P256_LIMBS; i++) {
+        bn_limb_t s = t[i] + carry;
+        carry = (s < carry);
+        u[i] = s + m->m[i];
+        carry |= (u[i] < s);
+    }
+    p256_select(r, (bn_limb_t)0 - borrow, u, t);
+}
+
+// r = a * b * R^-1 mod m (CIOS); r may alias either input
+static void p256_mul(p256_elem r, const p256_elem a, const p256_elem b, const p256_modulus_t* m) {
+    bn_limb_t t[P256_LIMBS + 2];
+
+    memset(t, 0, sizeof(t));
+    for (int i = 0; i < P256_LIMBS; i++) {
+        bn_limb_t c = 0;
+        for (int j = 0; j < P256_LIMBS; j++) {
+            t[j] = bn_mac(a[j], b[i], t[j], c, &c);
+        }
+        t[P256_LIMBS] += c;
+        t[P256_LIMBS + 1] = (t[P256_LIMBS] < c);
+
+        bn_limb_t q = t[0] * m->n0inv;
+        bn_mac(q, m->m[0], t[0], 0, &c);
+        for (int j = 1; j < P256_LIMBS; j++) {
+            t[j - 1] = bn_mac(q, m->m[j], t[j], c, &c);
+        }
+        t[P256_LIMBS - 1] = t[P256_LIMBS] + c;
+        t[P256_LIMBS] = t[P256_LIMBS + 1] + (t[P256_LIMBS - 1] < c);
+    }
+    p256_reduce_once(r, t, t[P256_LIMBS], m);
+}
+
+static void p256_sqr(p256_elem r, const p256_elem a, const p256_modulus_t* m) {
+    p256_mul(r, a, a, m);
+}
+
+// r = a^(m - 2) = a^-1 in Montgomery form. The exponent is a public
+// constant, so walking its bits leaks nothing about a.
+static void p256_inv(p256_elem r, const p256_elem a, const p256_modulus_t* m) {
+    p256_elem e, acc;
+    memcpy(e, m->m, sizeof(e));
+    e[0] -= 2;
+
+    p256_mul(acc, p256_one, m->rr, m);
+    for (int bit = 255; bit >= 0; bit--) {
+        p256_sqr(acc, acc, m);
+        if ((e[bit / 64] >> (bit % 64)) & 1) p256_mul(acc, acc, a, m);
+    }
+    memcpy(r, acc, sizeof(acc));
+}
+
+static void p256_to_mont(p256_elem r, const p256_elem a, const p256_modulus_t* m) {
+    p256_mul(r, a, m->rr, m);
+}
+
+static void p256_from_mont(p256_elem r, const p256_elem a, const p256_modulus_t* m) {
+    p256_mul(r, a, p256_one, m);
+}
+
+#define FP_ADD(r, a, b) p256_add(r, a, b, &p256_field)
+#define FP_SUB(r, a, b) p256_sub(r, a, b, &p256_field)
+#define FP_MUL(r, a, b) p256_mul(r, a, b, &p256_field)
+#define FP_SQR(r, a)    p256_sqr(r, a, &p256_field)
+
+static int p256_is_infinity(const p256_jacobian* p) {
+    return p256_is_zero(p->Z);
+}
+
+// r = 2p (dbl-2001-b); r may alias p
+static void p256_double(p256_jacobian* r, const p256_jacobian* p) {
+    p256_elem delta, gamma, beta, alpha, t0, t1;
+
+    FP_SQR(delta, p->Z);
+    FP_SQR(gamma, p->Y);
+    FP_MUL(beta, p->X, gamma);
+    FP_SUB(t0, p->X, delta);
+    FP_ADD(t1, p->X, delta);
+    FP_MUL(alpha, t0, t1);
+    FP_ADD(t0, alpha, alpha);
+    FP_ADD(alpha, t0, alpha);
+
+    // Z3 = (Y + Z)^2 - gamma - delta
+    FP_ADD(t0, p->Y, p->Z);
+    FP_SQR(t0, t0);
+    FP_SUB(t0, t0, gamma);
+    FP_SUB(r->Z, t0, delta);
+
+    // X3 = alpha^2 - 8 beta
+    FP_ADD(beta, beta, beta);
+    FP_ADD(beta, beta, beta);
+    FP_ADD(t1, beta, beta);
+    FP_SQR(t0, alpha);
+    FP_SUB(r->X, t0, t1);
+
+    // Y3 = alpha (4 beta - X3) - 8 gamma^2
+    FP_SUB(t0, beta, r->X);
+    FP_MUL(t0, alpha, t0);
+    FP_SQR(gamma, gamma);
+    FP_ADD(gamma, gamma, gamma);
+    FP_ADD(gamma, gamma, gamma);
+    FP_ADD(gamma, gamma, gamma);
+    FP_SUB(r->Y, t0, gamma);
+}
+
+// r = p + q (add-2007-bl); r may alias p
+static void p256_add_jacobian(p256_jacobian* r, const p256_jacobian* p, const p256_jacobian* q) {
+    p256_elem z1z1, z2z2, u1, u2, s1, s2, h, i, j, rr, v, t0;
+
+    if (p256_is_infinity(q)) {
+        if (r != p) *r = *p;
+        return;
+    }
+    if (p256_is_infinity(p)) {
+        *r = *q;
+        return;
+    }
+
+    FP_SQR(z1z1, p->Z);
+    FP_SQR(z2z2, q->Z);
+    FP_MUL(u1, p->X, z2z2);
+    FP_MUL(u2, q->X, z1z1);
+    FP_MUL(s1, p->Y, q->Z);
+    FP_MUL(s1, s1, z2z2);
+    FP_MUL(s2, q->Y, p->Z);
+    FP_MUL(s2, s2, z1z1);
+    FP_SUB(h, u2, u1);
+    FP_SUB(rr, s2, s1);
+
+    if (p256_is_zero(h)) {
+        if (p256_is_zero(rr)) {
+            p256_double(r, p);
+        } else {
+            memset(r, 0, sizeof(*r));
+        }
+        return;
+    }
+
+    FP_ADD(rr, rr, rr);
+    FP_ADD(i, h, h);
+    FP_SQR(i, i);
+    FP_MUL(j, h, i);
+    FP_MUL(v, u1, i);
+
+    // Z3 = ((Z1 + Z2)^2 - Z1Z1 - Z2Z2) H
+    FP_ADD(t0, p->Z, q->Z);
+    FP_SQR(t0, t0);
+    FP_SUB(t0, t0, z1z1);
+    FP_SUB(t0, t0, z2z2);
+    FP_MUL(r->Z, t0, h);
+
+    // X3 = r^2 - J - 2V
+    FP_SQR(t0, rr);
+    FP_SUB(t0, t0, j);
+    FP_SUB(t0, t0, v);
+    FP_SUB(r->X, t0, v);
+
+    // Y3 = r (V - X3) - 2 S1 J
+    FP_SUB(t0, v, r->X);
+    FP_MUL(t0, rr, t0);
+    FP_MUL(s1, s1, j);
+    FP_ADD(s1, s1, s1);
+    FP_SUB(r->Y, t0, s1);
+}
+
+// r = p + q with q affine (madd-2007-bl); r may alias p
+static void p256_add_affine(p256_jacobian* r, const p256_jacobian* p, const p256_affine* q) {
+    p256_elem z1z1, u2, s2, h, hh, i, j, rr, v, t0;
+
+    if (p256_is_infinity(p)) {
+        memcpy(r->X, q->x, sizeof(p256_elem));
+        memcpy(r->Y, q->y, sizeof(p256_elem));
+        p256_to_mont(r->Z, p256_one, &p256_field);
+        return;
+    }
+
+    FP_SQR(z1z1, p->Z);
+    FP_MUL(u2, q->x, z1z1);
+    FP_MUL(s2, q->y, p->Z);
+    FP_MUL(s2, s2, z1z1);
+    FP_SUB(h, u2, p->X);
+    FP_SUB(rr, s2, p->Y);
+
+    if (p256_is_zero(h)) {
+        if (p256_is_zero(rr)) {
+            p256_double(r, p);
+        } else {
+            memset(r, 0, sizeof(*r));
+        }
+        return;
+    }
+
+    FP_ADD(rr, rr, rr);
+    FP_SQR(hh, h);
+    FP_ADD(i, hh, hh);
+    FP_ADD(i, i, i);
+    FP_MUL(j, h, i);
+    FP_MUL(v, p->X, i);
+
+    // Y1 J is needed before Y1 may be overwritten
+    FP_MUL(s2, p->Y, j);
+    FP_ADD(s2, s2, s2);
+
+    // Z3 = (Z1 + H)^2 - Z1Z1 - HH
+    FP_ADD(t0, p->Z, h);
+    FP_SQR(t0, t0);
+    FP_SUB(t0, t0, z1z1);
+    FP_SUB(r->Z, t0, hh);
+
+    // X3 = r^2 - J - 2V
+    FP_SQR(t0, rr);
+    FP_SUB(t0, t0, j);
+    FP_SUB(t0, t0, v);
+    FP_SUB(r->X, t0, v);
+
+    // Y3 = r (V - X3) - 2 Y1 J
+    FP_SUB(t0, v, r->X);
+    FP_MUL(t0, rr, t0);
+    FP_SUB(r->Y, t0, s2);
+}
+
+static void p256_to_affine(p256_affine* r, const p256_jacobian* p) {
+    p256_elem zinv, zinv2;
+    p256_inv(zinv, p->Z, &p256_field);
+    FP_SQR(zinv2, zinv);
+    FP_MUL(r->x, p->X, zinv2);
+    FP_MUL(zinv2, zinv2, zinv);
+    FP_MUL(r->y, p->Y, zinv2);
+}
+
+// y^2 == x^3 - 3x + b, all in Montgomery form
+static int p256_on_curve(const p256_elem x, const p256_elem y) {
+    p256_elem lhs, rhs, t;
+    FP_SQR(lhs, y);
+    FP_SQR(rhs, x);
+    FP_MUL(rhs, rhs, x);
+    FP_ADD(t, x, x);
+    FP_ADD(t, t, x);
+    FP_SUB(rhs, rhs, t);
+    FP_ADD(rhs, rhs, p256_b_mont);
+    return p256_equal(lhs, rhs);
+}
+
+// b in Montgomery form and the affine odd multiples G, 3G, 5G, ...
+static void p256_init_tables(void) {
+    p256_jacobian g, g2, acc;
+
+    if (p256_tables_ready) return;
+
+    p256_to_mont(p256_b_mont, p256_b, &p256_field);
+    p256_to_mont(g.X, p256_gx, &p256_field);
+    p256_to_mont(g.Y, p256_gy, &p256_field);
+    p256_to_mont(g.Z, p256_one, &p256_field);
+    p256_double(&g2, &g);
+
+    acc = g;
+    for (uint32_t i = 0; i < (1u << (P256_BASE_WINDOW - 2)); i++) {
+        p256_to_affine(&p256_base_table[i], &acc);
+        p256_add_jacobian(&acc, &acc, &g2);
+    }
+
+    p256_tables_ready = 1;
+}
+
+// Width-w NAF of a 256-bit scalar; every nonzero digit is odd with
+// magnitude below 2^(w - 1). Returns the number of digits.
+static int p256_wnaf(int8_t out[P256_NAF_DIGITS], const p256_elem k, int window) {
+    bn_limb_t v[P256_LIMBS + 1];
+    int len = 0;
+
+    memcpy(v, k, sizeof(p256_elem));
+    v[P256_LIMBS] = 0;
+    memset(out, 0, P256_NAF_DIGITS);
+
+    while (v[0] | v[1] | v[2] | v[3] | v[4]) {
+        int digit = 0;
+        if (v[0] & 1) {
+            digit = (int)(v[0] & ((1u << window) - 1));
+            if (digit >= (1 << (window - 1))) digit -= 1 << window;
+
+            // v -= digit
+            if (digit > 0) {
+                bn_limb_t borrow = (bn_limb_t)digit;
+                for (int i = 0; i <= P256_LIMBS && borrow; i++) {
+                    bn_limb_t t = v[i];
+                    v[i] = t - borrow;
+                    borrow = t < borrow;
+                }
+            } else {
+                bn_limb_t carry = (bn_limb_t)(-digit);
+                for (int i = 0; i <= P256_LIMBS && carry; i++) {
+                    v[i] += carry;
+                    carry = v[i] < carry;
+                }
+            }
+        }
+        out[len++] = (int8_t)digit;
+
+        for (int i = 0; i < P256_LIMBS; i++) v[i] = (v[i] >> 1) | (v[i + 1] << 63);
+        v[P256_LIMBS] >>= 1;
+    }
+    return len;
+}
+
+// r = [a]G + [b]Q
+static void p256_double_scalarmult_vartime(p256_jacobian* r, const p256_elem a, const p256_elem b, const p256_jacobian* q) {
+    int8_t anaf[P256_NAF_DIGITS], bnaf[P256_NAF_DIGITS];
+    p256_jacobian qi[1 << (P256_POINT_WINDOW - 2)], q2;
+    int alen = p256_wnaf(anaf, a, P256_BASE_WINDOW);
+    int blen = p256_wnaf(bnaf, b, P256_POINT_WINDOW);
+
+    qi[0] = *q;
+    p256_double(&q2, q);
+    for (int i = 1; i < (1 << (P256_POINT_WINDOW - 2)); i++) {
+        p256_add_jacobian(&qi[i], &qi[i - 1], &q2);
+    }
+
+    memset(r, 0, sizeof(*r));
+    for (int i = (alen > blen ? alen : blen) - 1; i >= 0; i--) {
+        p256_double(r, r);
+        if (anaf[i]) {
+            p256_affine t = p256_base_table[(anaf[i] < 0 ? -anaf[i] : anaf[i]) / 2];
+            if (anaf[i] < 0) FP_SUB(t.y, p256_zero, t.y);
+            p256_add_affine(r, r, &t);
+        }
+        if (bnaf[i]) {
+            p256_jacobian t = qi[(bnaf[i] < 0 ? -bnaf[i] : bnaf[i]) / 2];
+            if (bnaf[i] < 0) FP_SUB(t.Y, p256_zero, t.Y);
+            p256_add_jacobian(r, r, &t);
+        }
+    }
+}
+
+int crypto_ecdsa_p256_verify(const uint8_t* public_key, const uint8_t* hash, uint32_t hash_len, const uint8_t* signature) {
+    p256_elem r, s, e, w, u1, u2, x;
+    p256_jacobian q, sum;
+    p256_affine affine;
+    uint8_t digest[32];
+
+    if (!public_key || !hash || !signature || hash_len == 0) {
+        return CRYPTO_ERROR_INVALID_PARAM;
+    }
+
+    p256_init_tables();
+
+    // 1 <= r, s < n
+    p256_from_bytes(r, signature);
+    p256_from_bytes(s, signature + 32);
+    if (p256_is_zero(r) || p256_is_zero(s) ||
+        !p256_less(r, p256_order.m) || !p256_less(s, p256_order.m)) {
+        return CRYPTO_ERROR_VERIFICATION_FAILED;
+    }
+
+    // Q must be a point on the curve with coordinates below p
+    p256_from_bytes(q.X, public_key);
+    p256_from_bytes(q.Y, public_key + 32);
+    if (!p256_less(q.X, p256_field.m) || !p256_less(q.Y, p256_field.m)) {
+        return CRYPTO_ERROR_INVALID_PARAM;
+    }
+    p256_to_mont(q.X, q.X, &p256_field);
+    p256_to_mont(q.Y, q.Y, &p256_field);
+    p256_to_mont(q.Z, p256_one, &p256_field);
+    if (!p256_on_curve(q.X, q.Y)) {
+        return CRYPTO_ERROR_INVALID_PARAM;
+    }
+
+    // e = leftmost 256 bits of the hash, reduced mod n
+    memset(digest, 0, sizeof(digest));
+    if (hash_len >= 32) {
+        memcpy(digest, hash, 32);
+    } else {
+        memcpy(digest + 32 - hash_len, hash, hash_len);
+    }
+    p256_from_bytes(e, digest);
+    p256_reduce_once(e, e, 0, &p256_order);
+
+    // w = s^-1, u1 = e w, u2 = r w. With w in Montgomery form a single
+    // Montgomery multiply by a plain value gives a plain product.
+    p256_to_mont(w, s, &p256_order);
+    p256_inv(w, w, &p256_order);
+    p256_mul(u1, e, w, &p256_order);
+    p256_mul(u2, r, w, &p256_order);
+
+    p256_double_scalarmult_vartime(&sum, u1, u2, &q);
+    if (p256_is_infinity(&sum)) {
+        return CRYPTO_ERROR_VERIFICATION_FAILED;
+    }
+
+    // x(sum) mod n must equal r
+    p256_to_affine(&affine, &sum);
+    p256_from_mont(x, affine.x, &p256_field);
+    p256_reduce_once(x, x, 0, &p256_order);
+    return p256_equal(x, r) ? CRYPTO_SUCCESS : CRYPTO_ERROR_VERIFICATION_FAILED;
+}
+
+int crypto_ecdsa_verify(const crypto_ecdsa_public_key_t* public_key, const uint8_t* hash, uint32_t hash_len, const crypto_ecdsa_signature_t* signature) {
+    uint8_t point[64], sig[64];
+
+    if (!public_key || !signature) {
+        return CRYPTO_ERROR_INVALID_PARAM;
+    }
+    if (public_key->curve_type != 256) {
+        return CRYPTO_ERROR_NOT_SUPPORTED;
+    }
+
+    memcpy(point, public_key->x, 32);
+    memcpy(point + 32, public_key->y, 32);
+    memcpy(sig, signature->r, 32);
+    memcpy(sig + 32, signature->s, 32);
+    return crypto_ecdsa_p256_verify(point, hash, hash_len, sig);
+}
+
+// P-256 key and signature over SHA-256("abc")
+int crypto_self_test_ecdsa(void) {
+    static const uint8_t sha256_abc[32] = {
+        0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+        0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad
+    };
+    static const uint8_t public_key[64] = {
+        0x75, 0x22, 0xbc, 0xc2, 0xad, 0x21, 0x7d, 0x04, 0x97, 0x8c, 0x24, 0x76, 0x3b, 0x24, 0x4d, 0xd9,
+        0xb1, 0x32, 0xcc, 0x6b, 0x42, 0xb8, 0x96, 0xdc, 0xae, 0x97, 0x0f, 0x79, 0x67, 0xf3, 0x87, 0x3c,
+        0x6b, 0x01, 0x11, 0xf1, 0xf0, 0xd5, 0x10, 0x9c, 0x46, 0xd5, 0x91, 0x07, 0xdb, 0x61, 0xf2, 0x57,
+        0xd5, 0xd6, 0xcc, 0x32, 0x34, 0x91, 0xb4, 0x96, 0x25, 0xdf, 0x55, 0x27, 0xfb, 0xef, 0xbd, 0xf7
+    };
+    static const uint8_t signature[64] = {
+        0xd6, 0x6f, 0xdf, 0x3d, 0x85, 0x9e, 0xc4, 0xcc, 0x3b, 0x0e, 0x24, 0xaf, 0x3d, 0x96, 0xd6, 0x4a,
+        0xde, 0x76, 0xe3, 0xda, 0xa9, 0x1e, 0xf0, 0x21, 0xf1, 0x82, 0xc3, 0x3d, 0x04, 0x12, 0xa4, 0x97,
+        0xec, 0xab, 0xc0, 0x58, 0x26, 0xf2, 0x0c, 0x06, 0x6f, 0xd2, 0x40, 0xc8, 0x2f, 0x64, 0xb7, 0xd4,
+        0x8f, 0x1b, 0x4e, 0xf7, 0xdb, 0x53, 0xf1, 0x7b, 0xe8, 0xe0, 0x65, 0x81, 0x62, 0x45, 0x77, 0xf6
+    };
+    uint8_t bad[64];
+
+    if (crypto_ecdsa_p256_verify(public_key, sha256_abc, sizeof(sha256_abc), signature) != CRYPTO_SUCCESS) {
+        return CRYPTO_ERROR_VERIFICATION_FAILED;
+    }
+
+    memcpy(bad, signature, sizeof(bad));
+    bad[40] ^= 0x04;
+    if (crypto_ecdsa_p256_verify(public_key, sha256_abc, sizeof(sha256_abc), bad) == CRYPTO_SUCCESS) {
+        return CRYPTO_ERROR_VERIFICATION_FAILED;
+    }
+
+    return CRYPTO_SUCCESS;
+}
@@ -0,0 +1,430 @@
+/*
+ * rsa.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include "crypto.h"
+#include "bignum.h"
+#include <string.h>
+
+// RSA public-key operations for signature verification. Numbers are held
+// as little-endian arrays of 64-bit limbs and all arithmetic modulo n is
+// done in Montgomery form, so a modular multiply costs two passes over the
+// limbs and no division. Everything here works on public data (modulus,
+// exponent, signature), so none of it needs to be constant-time.
+
+#define RSA_MAX_LIMBS  (CRYPTO_RSA4096_KEY_LENGTH / 8)
+#define RSA_MIN_BITS   512
+#define RSA_MAX_BITS   4096
+#define RSA_WINDOW_MAX 5
+
+typedef struct {
+    bn_limb_t n[RSA_MAX_LIMBS];   // Modulus
+    bn_limb_t rr[RSA_MAX_LIMBS];  // R^2 mod n, R = 2^(64 * limbs)
+    bn_limb_t n0inv;              // -n^-1 mod 2^64
+    uint32_t limbs;
+} rsa_mont_ctx_t;
+
+// Big-endian bytes -> limbs; len must not exceed limbs * 8
+static void bn_from_bytes(bn_limb_t* r, uint32_t limbs, const uint8_t* in, uint32_t len) {
+    memset(r, 0, limbs * sizeof(bn_limb_t));
+    for (uint32_t i = 0; i < len; i++) {
+        uint32_t pos = len - 1 - i;
+        r[pos / 8] |= (bn_limb_t)in[i] << (8 * (pos % 8));
+    }
+}
+
+static void bn_to_bytes(uint8_t* out, uint32_t len, const bn_limb_t* a) {
+    for (uint32_t i = 0; i < len; i++) {
+        uint32_t pos = len - 1 - i;
+        out[i] = (uint8_t)(a[pos / 8] >> (8 * (pos % 8)));
+    }
+}
+
+// Returns -1, 0 or 1 as a is below, equal to or above b
+static int bn_cmp(const bn_limb_t* a, const bn_limb_t* b, uint32_t limbs) {
+    for (uint32_t i = limbs; i-- > 0;) {
+        if (a[i] != b[i]) return a[i] > b[i] ? 1 : -1;
+    }
+    return 0;
+}
+
+// r = a - b, returning the borrow
+static bn_limb_t bn_sub(bn_limb_t* r, const bn_limb_t* a, const bn_limb_t* b, uint32_t limbs) {
+    bn_limb_t borrow = 0;
+    for (uint32_t i = 0; i < limbs; i++) {
+        bn_limb_t t = a[i] - b[i];
+        bn_limb_t out = t - borrow;
+        borrow = (a[i] < b[i]) | (t < borrow);
+        r[i] = out;
+    }
+    return borrow;
+}
+
+// a = 2a mod n for a below n
+static void bn_mod_double(bn_limb_t* a, const bn_limb_t* n, uint32_t limbs) {
+    bn_limb_t carry = a[limbs - 1] >> 63;
+    for (uint32_t j = limbs - 1; j > 0; j--) {
+        a[j] = (a[j] << 1) | (a[j - 1] >> 63);
+    }
+    a[0] <<= 1;
+    if (carry || bn_cmp(a, n, limbs) >= 0) {
+        bn_sub(a, a, n, limbs);
+    }
+}
+
+// r = a * b * R^-1 mod n (CIOS). r may alias a or b; the result is fully
+// reduced as long as a and b are below n.
+static void bn_mont_mul(bn_limb_t* r, const bn_limb_t* a, const bn_limb_t* b, const rsa_mont_ctx_t* m) {
+    bn_limb_t t[RSA_MAX_LIMBS + 2];
+    uint32_t k = m->limbs;
+
+    memset(t, 0, (k + 2) * sizeof(bn_limb_t));
+    for (uint32_t i = 0; i < k; i++) {
+        bn_limb_t c = 0, hi;
+        bn_limb_t bi = b[i];
+
+        for (uint32_t j = 0; j < k; j++) {
+            t[j] = bn_mac(a[j], bi, t[j], c, &c);
+        }
+        t[k] += c;
+        t[k + 1] = (t[k] < c);
+
+        bn_limb_t q = t[0] * m->n0inv;
+        bn_mac(q, m->n[0], t[0], 0, &c);
+        for (uint32_t j = 1; j < k; j++) {
+            t[j - 1] = bn_mac(q, m->n[j], t[j], c, &c);
+        }
+        t[k - 1] = t[k] + c;
+        hi = (t[k - 1] < c);
+        t[k] = t[k + 1] + hi;
+    }
+
+    if (t[k] || bn_cmp(t, m->n, k) >= 0) {
+        bn_sub(r, t, m->n, k);
+    } else {
+        memcpy(r, t, k * sizeof(bn_limb_t));
+    }
+}
+
+// Loads the modulus and derives the Montgomery constants. The modulus must
+// be odd; its length in bytes must fit RSA_MAX_LIMBS.
+static int rsa_mont_init(rsa_mont_ctx_t* m, const uint8_t* modulus, uint32_t mod_len) {
+    uint32_t k = (mod_len + 7) / 8;
+
+    if (mod_len == 0 || k > RSA_MAX_LIMBS || !(modulus[mod_len - 1] & 1)) {
+        return CRYPTO_ERROR_INVALID_PARAM;
+    }
+    m->limbs = k;
+    bn_from_bytes(m->n, k, modulus, mod_len);
+
+    // Newton iteration for n^-1 mod 2^64: n is its own inverse mod 8 and
+    // every step doubles the number of correct low bits
+    bn_limb_t inv = m->n[0];
+    for (int i = 0; i < 5; i++) {
+        inv *= 2 - m->n[0] * inv;
+    }
+    m->n0inv = (bn_limb_t)0 - inv;
+
+    // R mod n: when the modulus fills its top limb R - n is already below
+    // n, otherwise double 1 up to R
+    if (m->n[k - 1] >> 63) {
+        bn_limb_t zero[RSA_MAX_LIMBS];
+        memset(zero, 0, k * sizeof(bn_limb_t));
+        bn_sub(m->rr, zero, m->n, k);
+    } else {
+        memset(m->rr, 0, k * sizeof(bn_limb_t));
+        m->rr[0] = 1;
+        for (uint32_t i = 0; i < 64 * k; i++) {
+            bn_mod_double(m->rr, m->n, k);
+        }
+    }
+
+    // R mod n is 1 in Montgomery form. A Montgomery squaring doubles the
+    // power of two it represents and a modular doubling adds one, so
+    // walking the bits of 64k reaches 2^(64k) * R = R^2 mod n
+    uint32_t e = 64 * k;
+    int top = 31;
+    while (!((e >> top) & 1)) top--;
+    for (int bit = top; bit >= 0; bit--) {
+        bn_mont_mul(m->rr, m->rr, m->rr, m);
+        if ((e >> bit) & 1) bn_mod_double(m->rr, m->n, k);
+    }
+    return CRYPTO_SUCCESS;
+}
+
+// r = base^65537 mod n: sixteen squarings and one multiply. 65537 is by far
+// the most common public exponent, so it skips the window tables.
+static void rsa_mont_exp_f4(bn_limb_t* r, const bn_limb_t* base, const rsa_mont_ctx_t* m) {
+    bn_limb_t x[RSA_MAX_LIMBS], acc[RSA_MAX_LIMBS];
+    static const bn_limb_t one[RSA_MAX_LIMBS] = { 1 };
+
+    bn_mont_mul(x, base, m->rr, m);
+    memcpy(acc, x, m->limbs * sizeof(bn_limb_t));
+    for (int i = 0; i < 16; i++) {
+        bn_mont_mul(acc, acc, acc, m);
+    }
+    bn_mont_mul(acc, acc, x, m);
+    bn_mont_mul(r, acc, one, m);
+}
+
+#define RSA_EXP_BIT(e, e_len, i) (((e)[(e_len) - 1 - (i) / 8] >> ((i) % 8)) & 1)
+
+// r = base^e mod n by a left-to-right sliding window over the odd powers
+// x, x^3, ..., x^(2^window - 1); window ranges from 1 (plain square and
+// multiply) to RSA_WINDOW_MAX.
+static void rsa_mont_exp_window(bn_limb_t* r, const bn_limb_t* base, const uint8_t* e, uint32_t e_len,
+                                uint32_t window, const rsa_mont_ctx_t* m) {
+    bn_limb_t table[1 << (RSA_WINDOW_MAX - 1)][RSA_MAX_LIMBS];
+    bn_limb_t acc[RSA_MAX_LIMBS];
+    static const bn_limb_t one[RSA_MAX_LIMBS] = { 1 };
+    uint32_t k = m->limbs;
+    int32_t i = (int32_t)(e_len * 8) - 1;
+    int started = 0;
+
+    // table[j] = x^(2j + 1) in Montgomery form
+    bn_mont_mul(table[0], base, m->rr, m);
+    if (window > 1) {
+        bn_mont_mul(acc, table[0], table[0], m);
+        for (uint32_t j = 1; j < (1u << (window - 1)); j++) {
+            bn_mont_mul(table[j], table[j - 1], acc, m);
+        }
+    }
+
+    // 1 in Montgomery form, in case e is zero
+    bn_mont_mul(acc, one, m->rr, m);
+
+    while (i >= 0) {
+        if (!RSA_EXP_BIT(e, e_len, i)) {
+            if (started) bn_mont_mul(acc, acc, acc, m);
+            i--;
+            continue;
+        }
+
+        // Longest run of at most `window` bits that ends in a one
+        int32_t low = i - (int32_t)window + 1;
+        if (low < 0) low = 0;
+        while (!RSA_EXP_BIT(e, e_len, low)) low++;
+
+        uint32_t value = 0;
+        for (int32_t j = i; j >= low; j--) {
+            value = (value << 1) | RSA_EXP_BIT(e, e_len, j);
+            if (started) bn_mont_mul(acc, acc, acc, m);
+        }
+        if (started) {
+            bn_mont_mul(acc, acc, table[value >> 1], m);
+        } else {
+            memcpy(acc, table[value >> 1], k * sizeof(bn_limb_t));
+            started = 1;
+        }
+        i = low - 1;
+    }
+
+    bn_mont_mul(r, acc, one, m);
+}
+
+// r = base^e mod n with base already reduced below n
+static void rsa_mont_exp(bn_limb_t* r, const bn_limb_t* base, const uint8_t* e, uint32_t e_len, const rsa_mont_ctx_t* m) {
+    uint32_t bits;
+
+    while (e_len > 0 && e[0] == 0) {
+        e++;
+        e_len--;
+    }
+    if (e_len == 3 && e[0] == 0x01 && e[1] == 0x00 && e[2] == 0x01) {
+        rsa_mont_exp_f4(r, base, m);
+        return;
+    }
+
+    bits = e_len * 8;
+    while (bits > 0 && !RSA_EXP_BIT(e, e_len, bits - 1)) bits--;
+    rsa_mont_exp_window(r, base, e, e_len, bits > 512 ? 5 : bits > 128 ? 4 : bits > 24 ? 3 : 1, m);
+}
+
+// DigestInfo prefixes (RFC 8017 section 9.2, note 1)
+static const uint8_t rsa_sha256_prefix[] = {
+    0x30, 0x31, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x01, 0x05, 0x00, 0x04, 0x20
+};
+static const uint8_t rsa_sha512_prefix[] = {
+    0x30, 0x51, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x03, 0x05, 0x00, 0x04, 0x40
+};
+
+// Raw RSA verification of a PKCS#1 v1.5 signature: s^e mod n is compared
+// against the encoding EMSA-PKCS1-v1_5 would produce for the hash. Both
+// big-endian, mod_len bytes for n and the signature, e_len bytes for e.
+static int rsa_verify_pkcs1v15_raw(const uint8_t* modulus, uint32_t mod_len,
+                                   const uint8_t* exponent, uint32_t e_len,
+                                   const uint8_t* hash, uint32_t hash_len,
+                                   const uint8_t* signature, uint32_t sig_len) {
+    rsa_mont_ctx_t m;
+    bn_limb_t s[RSA_MAX_LIMBS];
+    uint8_t em[CRYPTO_RSA4096_KEY_LENGTH];
+    uint8_t expected[CRYPTO_RSA4096_KEY_LENGTH];
+    const uint8_t* prefix;
+    uint32_t prefix_len;
+    uint32_t e_bits = 0;
+
+    if (!modulus || !exponent || !hash || !signature) {
+        return CRYPTO_ERROR_INVALID_PARAM;
+    }
+    if (mod_len < RSA_MIN_BITS / 8 || mod_len > RSA_MAX_BITS / 8 || modulus[0] == 0 || sig_len != mod_len) {
+        return CRYPTO_ERROR_INVALID_PARAM;
+    }
+    if (hash_len == 32) {
+        prefix = rsa_sha256_prefix;
+        prefix_len = sizeof(rsa_sha256_prefix);
+    } else if (hash_len == 64) {
+        prefix = rsa_sha512_prefix;
+        prefix_len = sizeof(rsa_sha512_prefix);
+    } else {
+        return CRYPTO_ERROR_NOT_SUPPORTED;
+    }
+    // At least eight bytes of 0xFF padding
+    if (mod_len < 3 + 8 + prefix_len + hash_len) {
+        return CRYPTO_ERROR_INVALID_PARAM;
+    }
+
+    // Public exponent must be odd and greater than one
+    for (uint32_t i = 0; i < e_len; i++) {
+        if (exponent[i]) {
+            e_bits = (e_len - i) * 8;
+            break;
+        }
+    }
+    if (e_bits == 0 || !(exponent[e_len - 1] & 1) || (e_bits == 8 && exponent[e_len - 1] == 1)) {
+        return CRYPTO_ERROR_INVALID_PARAM;
+    }
+
+    if (rsa_mont_init(&m, modulus, mod_len) != CRYPTO_SUCCESS) {
+        return CRYPTO_ERROR_INVALID_PARAM;
+    }
+
+    // The signature representative must be below n (RFC 8017 5.2.2)
+    bn_from_bytes(s, m.limbs, signature, sig_len);
+    if (bn_cmp(s, m.n, m.limbs) >= 0) {
+        return CRYPTO_ERROR_VERIFICATION_FAILED;
+    }
+
+    rsa_mont_exp(s, s, exponent, e_len, &m);
+    bn_to_bytes(em, mod_len, s);
+
+    // EM = 00 01 FF..FF 00 DigestInfo || H
+    uint32_t ps_len = mod_len - 3 - prefix_len - hash_len;
+    expected[0] = 0x00;
+    expected[1] = 0x01;
+    memset(expected + 2, 0xFF, ps_len);
+    expected[2 + ps_len] = 0x00;
+    memcpy(expected + 3 + ps_len, prefix, prefix_len);
+    memcpy(expected + 3 + ps_len + prefix_len, hash, hash_len);
+
+    int result = crypto_memcmp_constant_time(em, expected, mod_len) == 0
+                     ? CRYPTO_SUCCESS : CRYPTO_ERROR_VERIFICATION_FAILED;
+    crypto_memzero_secure(em, sizeof(em));
+    return result;
+}
+
+int crypto_rsa_verify_pkcs1v15(const crypto_rsa_public_key_t* public_key, const uint8_t* hash, uint32_t hash_len, const uint8_t* signature, uint32_t sig_len) {
+    if (!public_key || (public_key->key_bits % 8) != 0 ||
+        public_key->key_bits < RSA_MIN_BITS || public_key->key_bits > RSA_MAX_BITS) {
+        return CRYPTO_ERROR_INVALID_PARAM;
+    }
+    return rsa_verify_pkcs1v15_raw(public_key->n, public_key->key_bits / 8,
+                                   public_key->e, sizeof(public_key->e),
+                                   hash, hash_len, signature, sig_len);
+}
+
+// Legacy key blob: [key_bits, big-endian u32][e, key_bits/8 bytes][n,
+// key_bits/8 bytes]. The signature is key_bits/8 bytes over SHA-256.
+int verify_signature(const uint8_t* data, uint32_t len, const uint8_t* signature, const uint8_t* public_key) {
+    uint8_t hash[CRYPTO_SHA256_DIGEST_LENGTH];
+
+    if (!data || !signature || !public_key || len == 0) {
+        return CRYPTO_ERROR_INVALID_PARAM;
+    }
+
+    uint32_t key_bits = ((uint32_t)public_key[0] << 24) | ((uint32_t)public_key[1] << 16) |
+                        ((uint32_t)public_key[2] << 8) | public_key[3];
+    if (key_bits < RSA_MIN_BITS || key_bits > RSA_MAX_BITS || (key_bits % 8) != 0) {
+        return CRYPTO_ERROR_INVALID_PARAM;
+    }
+    uint32_t mod_len = key_bits / 8;
+
+    sha256_hash(data, len, hash);
+    int result = rsa_verify_pkcs1v15_raw(public_key + 4 + mod_len, mod_len,
+                                         public_key + 4, mod_len,
+                                         hash, sizeof(hash), signature, mod_len);
+    crypto_memzero_secure(hash, sizeof(hash));
+    return result;
+}
+
+// RSA-1024, e = 65537; signature is PKCS#1 v1.5 over SHA-256("abc")
+static const uint8_t rsa_kat_n[128] = {
+    0x97, 0x35, 0x93, 0x8e, 0x73, 0x9e, 0x75, 0xb6, 0x54, 0xc6, 0x74, 0x29, 0x01, 0x18, 0x7c, 0xa4,
+    0x82, 0x3b, 0x45, 0x8c, 0x9e, 0xba, 0x03, 0xa8, 0x62, 0x41, 0x68, 0xed, 0x16, 0xfb, 0x82, 0x85,
+    0x24, 0x2e, 0x27, 0xdf, 0x4d, 0x02, 0x07, 0xc7, 0xa7, 0x6e, 0x69, 0x12, 0x6c, 0x5d, 0x3c, 0x2a,
+    0x70, 0xc3, 0xe5, 0xe4, 0xad, 0x9f, 0xaa, 0x64, 0xea, 0x4e, 0x30, 0x06, 0x62, 0x8b, 0xd2, 0xf0,
+    0x3c, 0x0d, 0x8f, 0x97, 0x95, 0x44, 0xaf, 0xde, 0x83, 0xcc, 0x4b, 0x2f, 0x23, 0xb1, 0xbc, 0x3f,
+    0x7f, 0x3e, 0x3d, 0xa1, 0xf0, 0xe9, 0x4e, 0x45, 0xcb, 0x9c, 0x48, 0x4e, 0xb9, 0x8d, 0xd1, 0xe2,
+    0xec, 0x7c, 0x03, 0xd7, 0x54, 0xe4, 0xc7, 0xc8, 0x7a, 0xa2, 0x72, 0xdb, 0x4c, 0xac, 0xa0, 0x85,
+    0x21, 0x68, 0x05, 0x6a, 0xe3, 0xa9, 0xf2, 0x40, 0x16, 0x7b, 0x36, 0x3d, 0xfc, 0xd9, 0x9e, 0x0b
+};
+static const uint8_t rsa_kat_e[4] = { 0x00, 0x01, 0x00, 0x01 };
+static const uint8_t rsa_kat_sig[128] = {
+    0x0c, 0x9b, 0x27, 0x94, 0x6d, 0xd0, 0x65, 0xd7, 0x32, 0x19, 0xc5, 0xed, 0x71, 0x69, 0xfd, 0x6d,
+    0xa3, 0xe4, 0x46, 0xda, 0x54, 0x99, 0x43, 0x48, 0xd0, 0x20, 0x5e, 0x48, 0x44, 0x57, 0x0b, 0x23,
+    0x28, 0x71, 0xbc, 0xe1, 0xf7, 0xc1, 0x89, 0x78, 0xf8, 0x45, 0x1a, 0xba, 0x98, 0x1e, 0x2e, 0x44,
+    0xa8, 0xa0, 0x13, 0x49, 0x92, 0x14, 0xe5, 0x68, 0x0e, 0x8e, 0x70, 0xbb, 0xf2, 0x80, 0x0b, 0xb7,
+    0x83, 0x21, 0x6f, 0x12, 0x72, 0x53, 0x4e, 0xa7, 0x0f, 0x4b, 0x22, 0x1d, 0x4f, 0x8e, 0x2c, 0x49,
+    0x10, 0x22, 0x0e, 0x1e, 0xe7, 0xa3, 0x7c, 0x56, 0xe6, 0x6e, 0x14, 0xa8, 0xda, 0x47, 0xdb, 0x4f,
+    0x07, 0xf3, 0x4f, 0xaa, 0x1d, 0x9a, 0xc9, 0xb1, 0xef, 0x56, 0xe2, 0xa7, 0xb6, 0x06, 0xa8, 0x98,
+    0xf9, 0xa3, 0xf7, 0x8f, 0xd7, 0x95, 0x3b, 0x87, 0x3d, 0x71, 0x9f, 0x7e, 0x42, 0x87, 0x80, 0xe3
+};
+
+int crypto_self_test_rsa(void) {
+    static const uint8_t sha256_abc[32] = {
+        0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+        0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad
+    };
+    static const uint8_t f4[3] = { 0x01, 0x00, 0x01 };
+    uint8_t sig[sizeof(rsa_kat_sig)];
+    uint8_t e[64];
+    rsa_mont_ctx_t m;
+    bn_limb_t x[RSA_MAX_LIMBS], a[RSA_MAX_LIMBS], b[RSA_MAX_LIMBS];
+
+    if (rsa_verify_pkcs1v15_raw(rsa_kat_n, sizeof(rsa_kat_n), rsa_kat_e, sizeof(rsa_kat_e),
+                                sha256_abc, sizeof(sha256_abc), rsa_kat_sig, sizeof(rsa_kat_sig)) != CRYPTO_SUCCESS) {
+        return CRYPTO_ERROR_VERIFICATION_FAILED;
+    }
+
+    // A single flipped bit must be rejected
+    memcpy(sig, rsa_kat_sig, sizeof(sig));
+    sig[sizeof(sig) / 2] ^= 0x10;
+    if (rsa_verify_pkcs1v15_raw(rsa_kat_n, sizeof(rsa_kat_n), rsa_kat_e, sizeof(rsa_kat_e),
+                                sha256_abc, sizeof(sha256_abc), sig, sizeof(sig)) == CRYPTO_SUCCESS) {
+        return CRYPTO_ERROR_VERIFICATION_FAILED;
+    }
+
+    // Every window width must agree with plain square and multiply, and the
+    // e = 65537 shortcut with the general code
+    rsa_mont_init(&m, rsa_kat_n, sizeof(rsa_kat_n));
+    bn_from_bytes(x, m.limbs, rsa_kat_sig, sizeof(rsa_kat_sig));
+    rsa_mont_exp_f4(a, x, &m);
+    rsa_mont_exp_window(b, x, f4, sizeof(f4), 1, &m);
+    if (bn_cmp(a, b, m.limbs) != 0) {
+        return CRYPTO_ERROR_VERIFICATION_FAILED;
+    }
+    for (uint32_t i = 0; i < sizeof(e); i++) {
+        e[i] = (uint8_t)(i * 73 + 41);
+    }
+    rsa_mont_exp_window(a, x, e, sizeof(e), 1, &m);
+    for (uint32_t window = 2; window <= RSA_WINDOW_MAX; window++) {
+        rsa_mont_exp_window(b, x, e, sizeof(e), window, &m);
+        if (bn_cmp(a, b, m.limbs) != 0) {
+            return CRYPTO_ERROR_VERIFICATION_FAILED;
+        }
+    }
+
+    return CRYPTO_SUCCESS;
+}
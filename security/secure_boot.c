@@ -10,4 +10,59 @@
 #include "crypto.h"
 int secure_boot_verify(const uint8_t* kernel, int ksize, const uint8_t* sig, const uint8_t* pubkey) {
     return verify_signature(kernel, ksize, sig, pubkey);
-} 
\ No newline at end of file
+}
+
+int secure_boot_signature_length(uint8_t algorithm, const uint8_t* pubkey, uint32_t pubkey_len) {
+    if (!pubkey) return CRYPTO_ERROR_INVALID_PARAM;
+
+    switch (algorithm) {
+    case SECURE_BOOT_SIG_RSA_PKCS1_SHA256: {
+        if (pubkey_len < 4) return CRYPTO_ERROR_INVALID_PARAM;
+        uint32_t key_bits = ((uint32_t)pubkey[0] << 24) | ((uint32_t)pubkey[1] << 16) |
+                            ((uint32_t)pubkey[2] << 8) | pubkey[3];
+        uint32_t mod_len = key_bits / 8;
+        if (mod_len == 0 || mod_len > CRYPTO_RSA4096_KEY_LENGTH || pubkey_len < 4 + 2 * mod_len) {
+            return CRYPTO_ERROR_INVALID_PARAM;
+        }
+        return (int)mod_len;
+    }
+    case SECURE_BOOT_SIG_ECDSA_P256_SHA256:
+        return CRYPTO_ECDSA_P256_SIGNATURE_LENGTH;
+    case SECURE_BOOT_SIG_ED25519:
+        return CRYPTO_ED25519_SIGNATURE_LENGTH;
+    default:
+        return CRYPTO_ERROR_NOT_SUPPORTED;
+    }
+}
+
+int secure_boot_verify_ex(uint8_t algorithm, const uint8_t* kernel, uint32_t ksize,
+                          const uint8_t* sig, uint32_t sig_len,
+                          const uint8_t* pubkey, uint32_t pubkey_len) {
+    int expected = secure_boot_signature_length(algorithm, pubkey, pubkey_len);
+
+    if (expected < 0) return expected;
+    if (!kernel || !sig || sig_len != (uint32_t)expected) return CRYPTO_ERROR_INVALID_PARAM;
+
+    switch (algorithm) {
+    case SECURE_BOOT_SIG_RSA_PKCS1_SHA256:
+        return verify_signature(kernel, ksize, sig, pubkey);
+
+    case SECURE_BOOT_SIG_ECDSA_P256_SHA256: {
+        uint8_t hash[CRYPTO_SHA256_DIGEST_LENGTH];
+        if (pubkey_len == 65 && pubkey[0] == 0x04) {
+            pubkey++;
+            pubkey_len--;
+        }
+        if (pubkey_len != 2 * CRYPTO_ECDSA_P256_KEY_LENGTH) return CRYPTO_ERROR_INVALID_PARAM;
+        sha256_hash(kernel, ksize, hash);
+        return crypto_ecdsa_p256_verify(pubkey, hash, sizeof(hash), sig);
+    }
+
+    case SECURE_BOOT_SIG_ED25519:
+        if (pubkey_len != CRYPTO_ED25519_PUBLIC_KEY_LENGTH) return CRYPTO_ERROR_INVALID_PARAM;
+        return crypto_ed25519_verify(pubkey, kernel, ksize, sig);
+
+    default:
+        return CRYPTO_ERROR_NOT_SUPPORTED;
+    }
+}
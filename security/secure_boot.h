@@ -7,5 +7,20 @@
 
 #ifndef BLOODHORN_SECURE_BOOT_H
 #define BLOODHORN_SECURE_BOOT_H
+#include <stdint.h>
+
+// Image signature schemes. RSA keys use the verify_signature blob, P-256
+// keys are x || y (optionally prefixed with 0x04) and Ed25519 keys are the
+// 32-byte RFC 8032 encoding.
+#define SECURE_BOOT_SIG_RSA_PKCS1_SHA256   0
+#define SECURE_BOOT_SIG_ECDSA_P256_SHA256  1
+#define SECURE_BOOT_SIG_ED25519            2
+
 int secure_boot_verify(const uint8_t* kernel, int ksize, const uint8_t* sig, const uint8_t* pubkey);
-#endif 
\ No newline at end of file
+
+// Signature length for the scheme and key, or a negative CRYPTO_ERROR_*
+int secure_boot_signature_length(uint8_t algorithm, const uint8_t* pubkey, uint32_t pubkey_len);
+int secure_boot_verify_ex(uint8_t algorithm, const uint8_t* kernel, uint32_t ksize,
+                          const uint8_t* sig, uint32_t sig_len,
+                          const uint8_t* pubkey, uint32_t pubkey_len);
+#endif
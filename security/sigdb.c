@@ -0,0 +1,296 @@
+/*
+ * sigdb.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include "sigdb.h"
+#include "compat.h"
+#include "crypto.h"
+#include "secure_boot.h"
+#include <stdint.h>
+#include <string.h>
+
+// EFI_SIGNATURE_LIST: SignatureType, SignatureListSize, SignatureHeaderSize,
+// SignatureSize, then the header and the entries. Each entry starts with
+// its 16-byte SignatureOwner.
+#define SIGDB_LIST_HEADER   28
+#define SIGDB_OWNER_SIZE    16
+
+// Signature types as they are stored (the first three GUID fields are
+// little-endian)
+static const uint8_t cert_sha256_guid[16] = {
+    0x26, 0x16, 0xc4, 0xc1, 0x4c, 0x50, 0x92, 0x40, 0xac, 0xa9, 0x41, 0xf9, 0x36, 0x93, 0x43, 0x28
+};
+static const uint8_t cert_x509_guid[16] = {
+    0xa1, 0x59, 0xc0, 0xa5, 0xe4, 0x94, 0xa7, 0x4a, 0x87, 0xb5, 0xab, 0x15, 0x5c, 0x2b, 0xf0, 0x72
+};
+static const uint8_t cert_rsa2048_guid[16] = {
+    0xe8, 0x66, 0x57, 0x3c, 0x9c, 0x26, 0x34, 0x4e, 0xaa, 0x14, 0xed, 0x77, 0x6e, 0x85, 0xb3, 0xb6
+};
+
+static const uint8_t oid_rsa_encryption[] = { 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x01, 0x01 };
+static const uint8_t oid_ec_public_key[] = { 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x02, 0x01 };
+static const uint8_t oid_prime256v1[] = { 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x03, 0x01, 0x07 };
+
+static const uint8_t rsa_exponent_65537[] = { 0x01, 0x00, 0x01 };
+
+static uint32_t load32(const uint8_t* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// Walk the signature lists, handing each entry to `entry`; stops at the
+// first malformed list
+typedef int (*sigdb_entry_fn)(void* ctx, const uint8_t* type, const uint8_t* data, uint32_t len);
+
+static int walk_lists(const uint8_t* data, uint32_t len, sigdb_entry_fn entry, void* ctx) {
+    uint32_t at = 0;
+
+    while (len - at >= SIGDB_LIST_HEADER) {
+        const uint8_t* list = data + at;
+        uint32_t list_size = load32(list + 16);
+        uint32_t header_size = load32(list + 20);
+        uint32_t sig_size = load32(list + 24);
+
+        if (list_size < SIGDB_LIST_HEADER || list_size > len - at ||
+            header_size > list_size - SIGDB_LIST_HEADER || sig_size <= SIGDB_OWNER_SIZE ||
+            (list_size - SIGDB_LIST_HEADER - header_size) % sig_size != 0) {
+            return CRYPTO_ERROR_INVALID_PARAM;
+        }
+        for (uint32_t off = SIGDB_LIST_HEADER + header_size; off < list_size; off += sig_size) {
+            int rc = entry(ctx, list, list + off + SIGDB_OWNER_SIZE, sig_size - SIGDB_OWNER_SIZE);
+            if (rc < 0) return rc;
+        }
+        at += list_size;
+    }
+    return at == len ? CRYPTO_SUCCESS : CRYPTO_ERROR_INVALID_PARAM;
+}
+
+static int count_digest(void* ctx, const uint8_t* type, const uint8_t* data, uint32_t len) {
+    (void)data;
+    if (memcmp(type, cert_sha256_guid, 16) == 0 && len == SIGDB_DIGEST_LENGTH) (*(uint32_t*)ctx)++;
+    return 0;
+}
+
+uint32_t sigdb_slots(const uint8_t* data, uint32_t len) {
+    uint32_t digests = 0;
+    uint32_t slots = 2;
+
+    if (data) walk_lists(data, len, count_digest, &digests);
+    while (slots < 2 * digests) slots <<= 1;
+    return slots;
+}
+
+static int is_zero(const uint8_t* digest) {
+    uint8_t acc = 0;
+    for (int i = 0; i < SIGDB_DIGEST_LENGTH; i++) acc |= digest[i];
+    return acc == 0;
+}
+
+// SHA-256 output is uniform, so its first word is the slot
+static uint8_t* find_slot(const sigdb_t* db, const uint8_t* digest) {
+    for (uint32_t i = load32(digest) & db->mask;; i = (i + 1) & db->mask) {
+        uint8_t* slot = db->digests[i];
+        if (is_zero(slot) || memcmp(slot, digest, SIGDB_DIGEST_LENGTH) == 0) return slot;
+    }
+}
+
+// Tag and length of the DER element at *p; *p moves past the element and
+// `body` gets its contents
+static int der_next(const uint8_t** p, const uint8_t* end, uint8_t tag, const uint8_t** body, uint32_t* len) {
+    const uint8_t* at = *p;
+    uint32_t n;
+
+    if (end - at < 2 || at[0] != tag) return -1;
+    n = at[1];
+    at += 2;
+    if (n & 0x80) {
+        uint32_t bytes = n & 0x7f;
+        if (bytes == 0 || bytes > 4 || (uint32_t)(end - at) < bytes) return -1;
+        n = 0;
+        while (bytes--) n = n << 8 | *at++;
+    }
+    if ((uint32_t)(end - at) < n) return -1;
+    *body = at;
+    *len = n;
+    *p = at + n;
+    return 0;
+}
+
+static int der_skip(const uint8_t** p, const uint8_t* end, uint8_t tag) {
+    const uint8_t* body;
+    uint32_t len;
+    return der_next(p, end, tag, &body, &len);
+}
+
+static int same_oid(const uint8_t* oid, uint32_t len, const uint8_t* want, uint32_t want_len) {
+    return len == want_len && memcmp(oid, want, len) == 0;
+}
+
+// [key_bits][e][n], e left-padded to the modulus length
+static int rsa_key(sigdb_key_t* key, const uint8_t* n, uint32_t n_len, const uint8_t* e, uint32_t e_len) {
+    while (n_len > 0 && n[0] == 0) { n++; n_len--; }
+    while (e_len > 0 && e[0] == 0) { e++; e_len--; }
+    if (n_len < 64 || n_len > CRYPTO_RSA4096_KEY_LENGTH || e_len == 0 || e_len > n_len) {
+        return CRYPTO_ERROR_NOT_SUPPORTED;
+    }
+
+    uint32_t bits = n_len * 8;
+    key->data[0] = (uint8_t)(bits >> 24);
+    key->data[1] = (uint8_t)(bits >> 16);
+    key->data[2] = (uint8_t)(bits >> 8);
+    key->data[3] = (uint8_t)bits;
+    memset(key->data + 4, 0, n_len - e_len);
+    memcpy(key->data + 4 + n_len - e_len, e, e_len);
+    memcpy(key->data + 4 + n_len, n, n_len);
+    key->algorithm = SECURE_BOOT_SIG_RSA_PKCS1_SHA256;
+    key->length = 4 + 2 * n_len;
+    return CRYPTO_SUCCESS;
+}
+
+int sigdb_key_from_x509(const uint8_t* der, uint32_t len, sigdb_key_t* key) {
+    const uint8_t *p = der, *end = der + len;
+    const uint8_t *cert, *tbs, *spki, *alg, *oid, *bits;
+    uint32_t cert_len, tbs_len, spki_len, alg_len, oid_len, bits_len;
+
+    if (!der || !key) return CRYPTO_ERROR_INVALID_PARAM;
+    key->length = 0;
+
+    // Certificate -> TBSCertificate -> SubjectPublicKeyInfo, skipping the
+    // optional version, then serial, signature, issuer, validity, subject
+    if (der_next(&p, end, 0x30, &cert, &cert_len) != 0) return CRYPTO_ERROR_INVALID_PARAM;
+    p = cert;
+    end = cert + cert_len;
+    if (der_next(&p, end, 0x30, &tbs, &tbs_len) != 0) return CRYPTO_ERROR_INVALID_PARAM;
+    p = tbs;
+    end = tbs + tbs_len;
+    if (end - p >= 1 && p[0] == 0xa0 && der_skip(&p, end, 0xa0) != 0) return CRYPTO_ERROR_INVALID_PARAM;
+    if (der_skip(&p, end, 0x02) != 0 || der_skip(&p, end, 0x30) != 0 || der_skip(&p, end, 0x30) != 0 ||
+        der_skip(&p, end, 0x30) != 0 || der_skip(&p, end, 0x30) != 0 ||
+        der_next(&p, end, 0x30, &spki, &spki_len) != 0) {
+        return CRYPTO_ERROR_INVALID_PARAM;
+    }
+
+    p = spki;
+    end = spki + spki_len;
+    if (der_next(&p, end, 0x30, &alg, &alg_len) != 0 || der_next(&p, end, 0x03, &bits, &bits_len) != 0 ||
+        bits_len < 1 || bits[0] != 0) {
+        return CRYPTO_ERROR_INVALID_PARAM;
+    }
+    bits++;
+    bits_len--;
+
+    const uint8_t *ap = alg, *aend = alg + alg_len;
+    if (der_next(&ap, aend, 0x06, &oid, &oid_len) != 0) return CRYPTO_ERROR_INVALID_PARAM;
+
+    if (same_oid(oid, oid_len, oid_rsa_encryption, sizeof(oid_rsa_encryption))) {
+        const uint8_t *rsa, *n, *e;
+        uint32_t rsa_len, n_len, e_len;
+        const uint8_t* kp = bits;
+        if (der_next(&kp, bits + bits_len, 0x30, &rsa, &rsa_len) != 0) return CRYPTO_ERROR_INVALID_PARAM;
+        kp = rsa;
+        if (der_next(&kp, rsa + rsa_len, 0x02, &n, &n_len) != 0 ||
+            der_next(&kp, rsa + rsa_len, 0x02, &e, &e_len) != 0) {
+            return CRYPTO_ERROR_INVALID_PARAM;
+        }
+        return rsa_key(key, n, n_len, e, e_len);
+    }
+
+    if (same_oid(oid, oid_len, oid_ec_public_key, sizeof(oid_ec_public_key))) {
+        const uint8_t* curve;
+        uint32_t curve_len;
+        if (der_next(&ap, aend, 0x06, &curve, &curve_len) != 0 ||
+            !same_oid(curve, curve_len, oid_prime256v1, sizeof(oid_prime256v1))) {
+            return CRYPTO_ERROR_NOT_SUPPORTED;
+        }
+        // Uncompressed point only
+        if (bits_len != 1 + 2 * CRYPTO_ECDSA_P256_KEY_LENGTH || bits[0] != 0x04) return CRYPTO_ERROR_NOT_SUPPORTED;
+        memcpy(key->data, bits + 1, 2 * CRYPTO_ECDSA_P256_KEY_LENGTH);
+        key->algorithm = SECURE_BOOT_SIG_ECDSA_P256_SHA256;
+        key->length = 2 * CRYPTO_ECDSA_P256_KEY_LENGTH;
+        return CRYPTO_SUCCESS;
+    }
+
+    return CRYPTO_ERROR_NOT_SUPPORTED;
+}
+
+static int add_entry(void* ctx, const uint8_t* type, const uint8_t* data, uint32_t len) {
+    sigdb_t* db = (sigdb_t*)ctx;
+
+    if (memcmp(type, cert_sha256_guid, 16) == 0) {
+        if (len != SIGDB_DIGEST_LENGTH) return 0;
+        if (is_zero(data)) {
+            db->has_zero_digest = 1;
+            return 0;
+        }
+        uint8_t* slot = find_slot(db, data);
+        if (is_zero(slot)) {
+            memcpy(slot, data, SIGDB_DIGEST_LENGTH);
+            db->digest_count++;
+        }
+        return 0;
+    }
+
+    int x509 = memcmp(type, cert_x509_guid, 16) == 0;
+    if (!x509 && memcmp(type, cert_rsa2048_guid, 16) != 0) return 0;
+    if (db->cert_count == SIGDB_MAX_CERTS) return CRYPTO_ERROR_BUFFER_TOO_SMALL;
+
+    // A certificate whose key is not supported is kept all the same; it
+    // just never matches
+    sigdb_cert_t* cert = &db->certs[db->cert_count++];
+    cert->der = data;
+    cert->der_len = len;
+    cert->key.length = 0;
+    if (x509) {
+        sigdb_key_from_x509(data, len, &cert->key);
+    } else if (len == 256) {
+        rsa_key(&cert->key, data, len, rsa_exponent_65537, sizeof(rsa_exponent_65537));
+    }
+    return 0;
+}
+
+int sigdb_parse(sigdb_t* db, const uint8_t* data, uint32_t len,
+                uint8_t (*slots)[SIGDB_DIGEST_LENGTH], uint32_t slot_count) {
+    int rc;
+
+    if (!db) return CRYPTO_ERROR_INVALID_PARAM;
+    memset(db, 0, sizeof(*db));
+    if (!data || !slots || (slot_count & (slot_count - 1)) != 0 || slot_count < sigdb_slots(data, len)) {
+        return CRYPTO_ERROR_INVALID_PARAM;
+    }
+    memset(slots, 0, (size_t)slot_count * SIGDB_DIGEST_LENGTH);
+    db->digests = slots;
+    db->mask = slot_count - 1;
+
+    rc = walk_lists(data, len, add_entry, db);
+    if (rc != CRYPTO_SUCCESS) return rc;
+    return (int)(db->digest_count + (uint32_t)db->has_zero_digest + db->cert_count);
+}
+
+int sigdb_has_digest(const sigdb_t* db, const uint8_t* digest) {
+    if (!db || !digest || !db->digests) return 0;
+    if (is_zero(digest)) return db->has_zero_digest;
+    return !is_zero(find_slot(db, digest));
+}
+
+int sigdb_has_key(const sigdb_t* db, uint8_t algorithm, const uint8_t* key, uint32_t key_len) {
+    if (!db || !key) return 0;
+
+    // A P-256 key may come with its 0x04 prefix
+    if (algorithm == SECURE_BOOT_SIG_ECDSA_P256_SHA256 && key_len == 65 && key[0] == 0x04) {
+        key++;
+        key_len--;
+    }
+    // An RSA blob may sit in a larger buffer; only its own length counts
+    if (algorithm == SECURE_BOOT_SIG_RSA_PKCS1_SHA256) {
+        int mod_len = secure_boot_signature_length(algorithm, key, key_len);
+        if (mod_len < 0) return 0;
+        key_len = 4 + 2 * (uint32_t)mod_len;
+    }
+    for (uint32_t i = 0; i < db->cert_count; i++) {
+        const sigdb_key_t* k = &db->certs[i].key;
+        if (k->length == key_len && k->algorithm == algorithm && memcmp(k->data, key, key_len) == 0) return 1;
+    }
+    return 0;
+}
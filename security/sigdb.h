@@ -0,0 +1,62 @@
+/*
+ * sigdb.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef BLOODHORN_SIGDB_H
+#define BLOODHORN_SIGDB_H
+#include <stdint.h>
+#include "compat.h"
+#include "crypto.h"
+
+// The UEFI signature databases (db, dbx) as read from their variables: a
+// run of EFI_SIGNATURE_LISTs. Each is parsed once. SHA-256 entries go into
+// an open-addressing set at most half full, so a revocation check is one
+// probe however long dbx grows. X.509 entries are kept apart, with the
+// public key of each pulled out of its SubjectPublicKeyInfo up front.
+#define SIGDB_DIGEST_LENGTH     CRYPTO_SHA256_DIGEST_LENGTH
+#define SIGDB_MAX_CERTS         32
+#define SIGDB_KEY_MAX           (4 + 2 * CRYPTO_RSA4096_KEY_LENGTH)
+
+// A certificate's key in the form secure_boot_verify_ex takes: an RSA
+// verify_signature blob, or P-256 x || y
+typedef struct {
+    uint8_t algorithm;                  // SECURE_BOOT_SIG_*
+    uint32_t length;                    // 0: no usable key
+    uint8_t data[SIGDB_KEY_MAX];
+} sigdb_key_t;
+
+typedef struct {
+    const uint8_t* der;                 // Into the variable data
+    uint32_t der_len;
+    sigdb_key_t key;
+} sigdb_cert_t;
+
+typedef struct {
+    uint32_t digest_count;
+    uint32_t mask;                      // Slots - 1
+    uint8_t (*digests)[SIGDB_DIGEST_LENGTH];    // All-zero: free slot
+    int has_zero_digest;                // The all-zero digest itself is listed
+    uint32_t cert_count;
+    sigdb_cert_t certs[SIGDB_MAX_CERTS];
+} sigdb_t;
+
+// Slots the digest set for this data needs (a power of two, at least
+// twice the SHA-256 entries)
+uint32_t sigdb_slots(const uint8_t* data, uint32_t len);
+// Parse signature lists into `db`; certificates point into `data`, which
+// has to outlive it. Entry types other than SHA-256, X.509 and RSA-2048
+// are skipped. Returns the number of entries kept, or a negative
+// CRYPTO_ERROR_* if a list is malformed or there are more than
+// SIGDB_MAX_CERTS certificates.
+int sigdb_parse(sigdb_t* db, const uint8_t* data, uint32_t len,
+                uint8_t (*slots)[SIGDB_DIGEST_LENGTH], uint32_t slot_count);
+// Nonzero if the SHA-256 is listed
+int sigdb_has_digest(const sigdb_t* db, const uint8_t* digest);
+// Nonzero if a certificate in the database carries this key
+int sigdb_has_key(const sigdb_t* db, uint8_t algorithm, const uint8_t* key, uint32_t key_len);
+// Public key of a DER X.509 certificate (RSA up to 4096 bits, or P-256)
+int sigdb_key_from_x509(const uint8_t* der, uint32_t len, sigdb_key_t* key);
+#endif
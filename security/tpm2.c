@@ -8,6 +8,9 @@
 #include "tpm2.h"
 #include "crypto.h"
 #include "compat.h"
+#include "../boot/libb/include/bloodhorn/trace.h"
+#include "../boot/libb/include/bloodhorn/time.h"
+#include "../boot/libb/include/bloodhorn/counters.h"
 #include <string.h>
 
 // TPM Interface Registers (for TIS)
@@ -18,6 +21,7 @@
 #define TPM_INTF_CAPS_REG       0x0014
 #define TPM_STS_REG             0x0018
 #define TPM_DATA_FIFO_REG       0x0024
+#define TPM_INTERFACE_ID_REG    0x0030
 #define TPM_DID_VID_REG         0x0F00
 #define TPM_RID_REG             0x0F04
 
@@ -35,28 +39,135 @@
 #define TPM_STS_DATA_AVAIL          (1 << 4)
 #define TPM_STS_EXPECT              (1 << 3)
 #define TPM_STS_RESPONSE_RETRY      (1 << 1)
+#define TPM_STS_BURST_COUNT(sts)    (((sts) >> 8) & 0xFFFF)
+
+// Interface capability: FIFO accepts more than one byte per access (TIS 1.3)
+#define TPM_INTF_CAPS_TRANSFER_SIZE(caps) (((caps) >> 9) & 0x3)
+
+// TPM_INTERFACE_ID, shared by the PTP FIFO and CRB register layouts
+#define TPM_INTERFACE_ID_TYPE(id)   ((id) & 0xF)
+#define TPM_INTERFACE_ID_TYPE_CRB   0x1
+
+// CRB (Command Response Buffer) registers, PC Client PTP section 6.5
+#define TPM_LOC_STATE_REG           0x0000
+#define TPM_LOC_CTRL_REG            0x0008
+#define TPM_LOC_STS_REG             0x000C
+#define TPM_CRB_CTRL_REQ_REG        0x0040
+#define TPM_CRB_CTRL_STS_REG        0x0044
+#define TPM_CRB_CTRL_CANCEL_REG     0x0048
+#define TPM_CRB_CTRL_START_REG      0x004C
+#define TPM_CRB_CTRL_CMD_SIZE_REG   0x0058
+#define TPM_CRB_CTRL_CMD_LADDR_REG  0x005C
+#define TPM_CRB_CTRL_CMD_HADDR_REG  0x0060
+#define TPM_CRB_CTRL_RSP_SIZE_REG   0x0064
+#define TPM_CRB_CTRL_RSP_ADDR_REG   0x0068
+
+#define TPM_LOC_CTRL_REQUEST_ACCESS (1 << 0)
+#define TPM_LOC_STS_GRANTED         (1 << 0)
+#define TPM_CRB_CTRL_REQ_CMD_READY  (1 << 0)
+#define TPM_CRB_CTRL_REQ_GO_IDLE    (1 << 1)
+#define TPM_CRB_CTRL_STS_ERROR      (1 << 0)
+#define TPM_CRB_CTRL_STS_IDLE       (1 << 1)
+#define TPM_CRB_CTRL_START          (1 << 0)
+#define TPM_CRB_CTRL_CANCEL         (1 << 0)
+
+// Interface timeouts in microseconds (TIS TIMEOUT_A..D); commands get the
+// "long" duration, which covers a full self test
+#define TPM_TIMEOUT_A_US            750000
+#define TPM_TIMEOUT_B_US            2000000
+#define TPM_TIMEOUT_C_US            750000
+#define TPM_TIMEOUT_D_US            750000
+#define TPM_TIMEOUT_COMMAND_US      2000000
+#define TPM_POLL_INTERVAL_US        10
+
+#define TPM2_HEADER_SIZE            10
 
 // Global TPM state
 static TPM2_INTERFACE_TYPE g_tpm_interface = TPM2_INTERFACE_NONE;
 static uint32_t g_tpm_base_address = 0;
 static int g_tpm_initialized = 0;
 static TPM2_EVENT_LOG g_global_event_log;
+static void* g_event_log_storage = NULL;   // Platform-provided log pages
+static uint32_t g_event_log_storage_size = 0;
+static void* g_event_log_allocated = NULL; // Fallback allocation, ours to free
+
+// TIS: FIFO takes 32-bit accesses; CRB: where the buffers live
+static int g_tis_wide_fifo = 0;
+static uintptr_t g_crb_cmd_buffer = 0;
+static uint32_t g_crb_cmd_size = 0;
+static uintptr_t g_crb_rsp_buffer = 0;
+static uint32_t g_crb_rsp_size = 0;
+
+// One command may be on the TPM between submit and its completing poll.
+// g_tpm_busy is nonzero while loader code is inside the driver, so that
+// tpm2_measure_poll, which may interrupt it (a UEFI timer notification, for
+// one), leaves the TPM and the extend queue alone until it has returned.
+static int g_command_pending = 0;
+static uint64_t g_command_started = 0;   // Counter at submit, for bh_counters
+static volatile int g_tpm_busy = 0;
+
+static void tpm2_complete_extends(void);
 
 // Hardware interface functions
 static uint8_t tpm_read8(uint32_t offset) {
-    return *(volatile uint8_t*)(g_tpm_base_address + offset);
+    return *(volatile uint8_t*)(uintptr_t)(g_tpm_base_address + offset);
 }
 
 static void tpm_write8(uint32_t offset, uint8_t value) {
-    *(volatile uint8_t*)(g_tmp_base_address + offset) = value;
+    *(volatile uint8_t*)(uintptr_t)(g_tpm_base_address + offset) = value;
 }
 
 static uint32_t tpm_read32(uint32_t offset) {
-    return *(volatile uint32_t*)(g_tpm_base_address + offset);
+    return *(volatile uint32_t*)(uintptr_t)(g_tpm_base_address + offset);
 }
 
 static void tpm_write32(uint32_t offset, uint32_t value) {
-    *(volatile uint32_t*)(g_tpm_base_address + offset) = value;
+    *(volatile uint32_t*)(uintptr_t)(g_tpm_base_address + offset) = value;
+}
+
+// One polling step against `timeout_us`: returns 0 once it has run out.
+// `*mark` starts at 0 and belongs to this function between steps.
+// With a clock the deadline is measured from the first step, so register
+// reads count toward it; without one, sleeps are counted instead, which a
+// missing timer still ends.
+static int tpm_poll(uint64_t* mark, uint64_t timeout_us) {
+    uint64_t frequency = bh_get_performance_frequency();
+
+    if (frequency) {
+        uint64_t now = bh_get_performance_counter();
+        if (*mark == 0) {
+            *mark = now ? now : 1;     // Start of the wait; 0 means unset
+        } else if (bh_ticks_to_nanoseconds(now - *mark) >= timeout_us * 1000ULL) {
+            return 0;
+        }
+        bh_sleep_microseconds(TPM_POLL_INTERVAL_US);
+        return 1;
+    }
+
+    if (*mark >= timeout_us) return 0;
+    bh_sleep_microseconds(TPM_POLL_INTERVAL_US);
+    *mark += TPM_POLL_INTERVAL_US;
+    return 1;
+}
+
+static int tpm_wait8(uint32_t offset, uint8_t mask, uint8_t value, uint64_t timeout_us) {
+    uint64_t waited = 0;
+    do {
+        if ((tpm_read8(offset) & mask) == value) return 0;
+    } while (tpm_poll(&waited, timeout_us));
+    return -1;
+}
+
+static int tpm_wait32(uint32_t offset, uint32_t mask, uint32_t value, uint64_t timeout_us) {
+    uint64_t waited = 0;
+    do {
+        if ((tpm_read32(offset) & mask) == value) return 0;
+    } while (tpm_poll(&waited, timeout_us));
+    return -1;
+}
+
+static uint32_t tpm2_header_size(const uint8_t* header) {
+    return ((uint32_t)header[2] << 24) | ((uint32_t)header[3] << 16) | ((uint32_t)header[4] << 8) | header[5];
 }
 
 TPM2_INTERFACE_TYPE tpm2_detect_interface(void) {
@@ -66,110 +177,323 @@ TPM2_INTERFACE_TYPE tpm2_detect_interface(void) {
     for (int i = 0; tpm_addresses[i] != 0; i++) {
         g_tpm_base_address = tpm_addresses[i];
         
+        // CRB has no DID/VID register at 0xF00; its INTERFACE_ID says so
+        uint32_t intf_id = tpm_read32(TPM_INTERFACE_ID_REG);
+        if (intf_id != 0xFFFFFFFF && TPM_INTERFACE_ID_TYPE(intf_id) == TPM_INTERFACE_ID_TYPE_CRB) {
+            return TPM2_INTERFACE_CRB;  // Command Response Buffer
+        }
+        
         // Try to read DID/VID register
         uint32_t did_vid = tpm_read32(TPM_DID_VID_REG);
         if (did_vid != 0xFFFFFFFF && did_vid != 0x00000000) {
-            // Found a TPM, check interface type
-            uint32_t intf_caps = tpm_read32(TPM_INTF_CAPS_REG);
-            
-            if (intf_caps & (1 << 2)) {
-                return TPM2_INTERFACE_CRB;  // Command Response Buffer
-            } else {
-                return TPM2_INTERFACE_TIS;  // TPM Interface Specification
-            }
+            return TPM2_INTERFACE_TIS;  // TPM Interface Specification
         }
     }
     
     return TPM2_INTERFACE_NONE;
 }
 
+static int tis_init(void) {
+    // Request locality 0
+    tpm_write8(TPM_ACCESS_REG, TPM_ACCESS_REQUEST_USE);
+    if (tpm_wait8(TPM_ACCESS_REG, TPM_ACCESS_VALID | TPM_ACCESS_ACTIVE_LOCALITY,
+                  TPM_ACCESS_VALID | TPM_ACCESS_ACTIVE_LOCALITY, TPM_TIMEOUT_A_US) != 0) {
+        return -1; // Failed to acquire locality
+    }
+    
+    g_tis_wide_fifo = TPM_INTF_CAPS_TRANSFER_SIZE(tpm_read32(TPM_INTF_CAPS_REG)) != 0;
+    return 0;
+}
+
+static int crb_init(void) {
+    tpm_write32(TPM_LOC_CTRL_REG, TPM_LOC_CTRL_REQUEST_ACCESS);
+    if (tpm_wait32(TPM_LOC_STS_REG, TPM_LOC_STS_GRANTED, TPM_LOC_STS_GRANTED, TPM_TIMEOUT_A_US) != 0) {
+        return -1;
+    }
+    
+    g_crb_cmd_size = tpm_read32(TPM_CRB_CTRL_CMD_SIZE_REG);
+    g_crb_cmd_buffer = (uintptr_t)(((uint64_t)tpm_read32(TPM_CRB_CTRL_CMD_HADDR_REG) << 32) |
+                                   tpm_read32(TPM_CRB_CTRL_CMD_LADDR_REG));
+    g_crb_rsp_size = tpm_read32(TPM_CRB_CTRL_RSP_SIZE_REG);
+    g_crb_rsp_buffer = (uintptr_t)(((uint64_t)tpm_read32(TPM_CRB_CTRL_RSP_ADDR_REG + 4) << 32) |
+                                   tpm_read32(TPM_CRB_CTRL_RSP_ADDR_REG));
+    
+    if (!g_crb_cmd_buffer || !g_crb_rsp_buffer || g_crb_cmd_size < TPM2_HEADER_SIZE ||
+        g_crb_rsp_size < TPM2_HEADER_SIZE) {
+        return -1;
+    }
+    return 0;
+}
+
 int tpm2_init_interface(TPM2_INTERFACE_TYPE interface_type) {
     g_tpm_interface = interface_type;
     
-    if (interface_type == TPM2_INTERFACE_NONE) {
+    switch (interface_type) {
+    case TPM2_INTERFACE_TIS:
+        return tis_init();
+    case TPM2_INTERFACE_CRB:
+    case TPM2_INTERFACE_FTPM:   // Firmware TPMs expose the CRB interface
+        return crb_init();
+    default:
         return -1;
     }
-    
-    // Request locality 0
-    if (interface_type == TPM2_INTERFACE_TIS) {
-        tpm_write8(TPM_ACCESS_REG, TPM_ACCESS_REQUEST_USE);
+}
+
+// Nonzero burstCount, or 0 if the TPM kept it at zero past TIMEOUT_D
+static uint32_t tis_burst_count(void) {
+    uint64_t waited = 0;
+    do {
+        uint32_t burst = TPM_STS_BURST_COUNT(tpm_read32(TPM_STS_REG));
+        if (burst) return burst;
+    } while (tpm_poll(&waited, TPM_TIMEOUT_D_US));
+    return 0;
+}
+
+static int tis_fifo_write(const uint8_t* data, uint32_t len) {
+    while (len) {
+        uint32_t burst = tis_burst_count();
+        if (!burst) return -1;
+        if (burst > len) burst = len;
+        len -= burst;
         
-        // Wait for locality to be granted
-        int timeout = 1000;
-        while (timeout-- > 0) {
-            uint8_t access = tmp_read8(TPM_ACCESS_REG);
-            if (access & TPM_ACCESS_ACTIVE_LOCALITY) {
-                break;
+        if (g_tis_wide_fifo) {
+            for (; burst >= 4; burst -= 4, data += 4) {
+                tpm_write32(TPM_DATA_FIFO_REG, (uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+                                               ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
             }
-            // Simple delay
-            for (volatile int i = 0; i < 1000; i++);
         }
+        for (; burst; burst--) tpm_write8(TPM_DATA_FIFO_REG, *data++);
+    }
+    return 0;
+}
+
+static int tis_fifo_read(uint8_t* data, uint32_t len) {
+    while (len) {
+        if (tpm_wait8(TPM_STS_REG, TPM_STS_VALID | TPM_STS_DATA_AVAIL,
+                      TPM_STS_VALID | TPM_STS_DATA_AVAIL, TPM_TIMEOUT_C_US) != 0) {
+            return -1;
+        }
+        uint32_t burst = tis_burst_count();
+        if (!burst) return -1;
+        if (burst > len) burst = len;
+        len -= burst;
         
-        if (timeout <= 0) {
-            return -1; // Failed to acquire locality
+        if (g_tis_wide_fifo) {
+            for (; burst >= 4; burst -= 4, data += 4) {
+                uint32_t word = tpm_read32(TPM_DATA_FIFO_REG);
+                data[0] = (uint8_t)word;
+                data[1] = (uint8_t)(word >> 8);
+                data[2] = (uint8_t)(word >> 16);
+                data[3] = (uint8_t)(word >> 24);
+            }
+        }
+        for (; burst; burst--) *data++ = tpm_read8(TPM_DATA_FIFO_REG);
+    }
+    return 0;
+}
+
+static int tis_submit(const uint8_t* command, uint32_t command_size) {
+    if (command_size < TPM2_HEADER_SIZE) return -1;
+    
+    // Wait for TPM to be ready
+    if (!(tpm_read8(TPM_STS_REG) & TPM_STS_COMMAND_READY)) {
+        tpm_write8(TPM_STS_REG, TPM_STS_COMMAND_READY);
+        if (tpm_wait8(TPM_STS_REG, TPM_STS_COMMAND_READY, TPM_STS_COMMAND_READY, TPM_TIMEOUT_B_US) != 0) {
+            return -1;
         }
     }
     
+    // Send all but the last byte in bursts; the TPM must still be expecting
+    // more before the last one and must have stopped after it
+    if (tis_fifo_write(command, command_size - 1) != 0 ||
+        tpm_wait8(TPM_STS_REG, TPM_STS_VALID, TPM_STS_VALID, TPM_TIMEOUT_C_US) != 0 ||
+        !(tpm_read8(TPM_STS_REG) & TPM_STS_EXPECT)) {
+        goto abort;
+    }
+    if (tis_fifo_write(command + command_size - 1, 1) != 0 ||
+        tpm_wait8(TPM_STS_REG, TPM_STS_VALID, TPM_STS_VALID, TPM_TIMEOUT_C_US) != 0 ||
+        (tpm_read8(TPM_STS_REG) & TPM_STS_EXPECT)) {
+        goto abort;
+    }
+    
+    // Execute command
+    tpm_write8(TPM_STS_REG, TPM_STS_GO);
     return 0;
+    
+abort:
+    tpm_write8(TPM_STS_REG, TPM_STS_COMMAND_READY);
+    return -1;
 }
 
-int tpm2_send_command(const void* command, uint32_t command_size, void* response, uint32_t* response_size) {
-    if (!command || !response || !response_size || g_tpm_interface == TPM2_INTERFACE_NONE) {
-        return -1;
+static int tis_response_ready(void) {
+    return (tpm_read8(TPM_STS_REG) & (TPM_STS_VALID | TPM_STS_DATA_AVAIL)) == (TPM_STS_VALID | TPM_STS_DATA_AVAIL);
+}
+
+static int tis_read_response(uint8_t* response, uint32_t* response_size) {
+    uint32_t total;
+    
+    if (*response_size < TPM2_HEADER_SIZE) goto abort;
+    
+    // Header first for the response size, then the rest in bursts
+    if (tis_fifo_read(response, TPM2_HEADER_SIZE) != 0) goto abort;
+    total = tpm2_header_size(response);
+    if (total < TPM2_HEADER_SIZE || total > *response_size) goto abort;
+    if (tis_fifo_read(response + TPM2_HEADER_SIZE, total - TPM2_HEADER_SIZE) != 0) goto abort;
+    
+    // The FIFO must be empty once the advertised size is consumed
+    if (tpm_wait8(TPM_STS_REG, TPM_STS_VALID, TPM_STS_VALID, TPM_TIMEOUT_C_US) != 0 ||
+        (tpm_read8(TPM_STS_REG) & TPM_STS_DATA_AVAIL)) {
+        goto abort;
     }
     
-    if (g_tpm_interface == TPM2_INTERFACE_TIS) {
-        const uint8_t* cmd_bytes = (const uint8_t*)command;
-        
-        // Wait for TPM to be ready
-        int timeout = 1000;
-        while (timeout-- > 0) {
-            uint32_t status = tpm_read32(TPM_STS_REG);
-            if (status & TPM_STS_COMMAND_READY) {
-                break;
-            }
-            for (volatile int i = 0; i < 1000; i++);
-        }
-        
-        if (timeout <= 0) return -1;
-        
-        // Send command
-        for (uint32_t i = 0; i < command_size; i++) {
-            tpm_write8(TPM_DATA_FIFO_REG, cmd_bytes[i]);
-        }
-        
-        // Execute command
-        tpm_write32(TPM_STS_REG, TPM_STS_GO);
-        
-        // Wait for response
-        timeout = 5000;
-        while (timeout-- > 0) {
-            uint32_t status = tpm_read32(TPM_STS_REG);
-            if (status & TPM_STS_DATA_AVAIL) {
-                break;
-            }
-            for (volatile int i = 0; i < 1000; i++);
+    tpm_write8(TPM_STS_REG, TPM_STS_COMMAND_READY);
+    *response_size = total;
+    return 0;
+    
+abort:
+    tpm_write8(TPM_STS_REG, TPM_STS_COMMAND_READY);
+    return -1;
+}
+
+// commandReady aborts whatever the TPM is executing
+static void tis_cancel(void) {
+    tpm_write8(TPM_STS_REG, TPM_STS_COMMAND_READY);
+}
+
+static void crb_copy_out(uintptr_t buffer, const uint8_t* data, uint32_t len) {
+    volatile uint8_t* dst = (volatile uint8_t*)buffer;
+    for (uint32_t i = 0; i < len; i++) dst[i] = data[i];
+}
+
+static void crb_copy_in(uint8_t* data, uintptr_t buffer, uint32_t len) {
+    const volatile uint8_t* src = (const volatile uint8_t*)buffer;
+    for (uint32_t i = 0; i < len; i++) data[i] = src[i];
+}
+
+static int crb_submit(const uint8_t* command, uint32_t command_size) {
+    if (command_size < TPM2_HEADER_SIZE || command_size > g_crb_cmd_size) return -1;
+    
+    // Leave idle once; the TPM then stays ready between commands
+    if (tpm_read32(TPM_CRB_CTRL_STS_REG) & TPM_CRB_CTRL_STS_IDLE) {
+        tpm_write32(TPM_CRB_CTRL_REQ_REG, TPM_CRB_CTRL_REQ_CMD_READY);
+        if (tpm_wait32(TPM_CRB_CTRL_REQ_REG, TPM_CRB_CTRL_REQ_CMD_READY, 0, TPM_TIMEOUT_C_US) != 0 ||
+            tpm_wait32(TPM_CRB_CTRL_STS_REG, TPM_CRB_CTRL_STS_IDLE, 0, TPM_TIMEOUT_C_US) != 0) {
+            return -1;
         }
-        
-        if (timeout <= 0) return -1;
-        
-        // Read response
-        uint8_t* resp_bytes = (uint8_t*)response;
-        uint32_t bytes_read = 0;
-        
-        while (bytes_read < *response_size) {
-            uint32_t status = tpm_read32(TPM_STS_REG);
-            if (!(status & TPM_STS_DATA_AVAIL)) {
-                break;
-            }
-            resp_bytes[bytes_read++] = tpm_read8(TPM_DATA_FIFO_REG);
+    }
+    
+    crb_copy_out(g_crb_cmd_buffer, command, command_size);
+    tpm_write32(TPM_CRB_CTRL_START_REG, TPM_CRB_CTRL_START);
+    return 0;
+}
+
+// The TPM clears Start when the response is in the buffer
+static int crb_response_ready(void) {
+    return !(tpm_read32(TPM_CRB_CTRL_START_REG) & TPM_CRB_CTRL_START);
+}
+
+static int crb_read_response(uint8_t* response, uint32_t* response_size) {
+    uint32_t total;
+    
+    if (*response_size < TPM2_HEADER_SIZE) return -1;
+    if (tpm_read32(TPM_CRB_CTRL_STS_REG) & TPM_CRB_CTRL_STS_ERROR) return -1;
+    
+    crb_copy_in(response, g_crb_rsp_buffer, TPM2_HEADER_SIZE);
+    total = tpm2_header_size(response);
+    if (total < TPM2_HEADER_SIZE || total > g_crb_rsp_size || total > *response_size) return -1;
+    crb_copy_in(response + TPM2_HEADER_SIZE, g_crb_rsp_buffer + TPM2_HEADER_SIZE, total - TPM2_HEADER_SIZE);
+    
+    *response_size = total;
+    return 0;
+}
+
+static void crb_cancel(void) {
+    tpm_write32(TPM_CRB_CTRL_CANCEL_REG, TPM_CRB_CTRL_CANCEL);
+    tpm_wait32(TPM_CRB_CTRL_START_REG, TPM_CRB_CTRL_START, 0, TPM_TIMEOUT_B_US);
+    tpm_write32(TPM_CRB_CTRL_CANCEL_REG, 0);
+}
+
+static int tpm2_is_crb(void) {
+    return g_tpm_interface == TPM2_INTERFACE_CRB || g_tpm_interface == TPM2_INTERFACE_FTPM;
+}
+
+int tpm2_submit_command(const void* command, uint32_t command_size) {
+    int result;
+    
+    if (!command || g_command_pending) return -1;
+    
+    if (g_tpm_interface == TPM2_INTERFACE_TIS) {
+        result = tis_submit((const uint8_t*)command, command_size);
+    } else if (tpm2_is_crb()) {
+        result = crb_submit((const uint8_t*)command, command_size);
+    } else {
+        return -1; // Unsupported interface
+    }
+    
+    if (result == 0) {
+        g_command_pending = 1;
+        g_command_started = bh_get_performance_counter();
+    }
+    return result;
+}
+
+int tpm2_poll_command(void* response, uint32_t* response_size) {
+    int result;
+    
+    if (!response || !response_size || !g_command_pending) return -1;
+    
+    if (g_tpm_interface == TPM2_INTERFACE_TIS) {
+        if (!tis_response_ready()) return TPM2_COMMAND_PENDING;
+        result = tis_read_response((uint8_t*)response, response_size);
+    } else {
+        if (!crb_response_ready()) return TPM2_COMMAND_PENDING;
+        result = crb_read_response((uint8_t*)response, response_size);
+    }
+    
+    g_command_pending = 0;
+    bh_counters_add_tpm(bh_get_performance_counter() - g_command_started);
+    return result;
+}
+
+void tpm2_cancel_command(void) {
+    if (!g_command_pending) return;
+    
+    if (g_tpm_interface == TPM2_INTERFACE_TIS) {
+        tis_cancel();
+    } else {
+        crb_cancel();
+    }
+    g_command_pending = 0;
+}
+
+// Block on the command in flight for up to the command duration
+static int tpm2_wait_command(void* response, uint32_t* response_size) {
+    uint64_t waited = 0;
+    int result;
+    
+    while ((result = tpm2_poll_command(response, response_size)) == TPM2_COMMAND_PENDING) {
+        if (!tpm_poll(&waited, TPM_TIMEOUT_COMMAND_US)) {
+            tpm2_cancel_command();
+            return -1;
         }
-        
-        *response_size = bytes_read;
-        return 0;
     }
+    return result;
+}
+
+int tpm2_send_command(const void* command, uint32_t command_size, void* response, uint32_t* response_size) {
+    int result;
     
-    return -1; // Unsupported interface
+    if (!command || !response || !response_size || g_tpm_interface == TPM2_INTERFACE_NONE) {
+        return -1;
+    }
+    
+    // Queued extends go first, so commands reach the TPM in program order
+    g_tpm_busy++;
+    tpm2_complete_extends();
+    result = tpm2_submit_command(command, command_size);
+    if (result == 0) result = tpm2_wait_command(response, response_size);
+    g_tpm_busy--;
+    return result;
 }
 
 int tpm2_initialize(void) {
@@ -184,8 +508,15 @@ int tpm2_initialize(void) {
         return -1;
     }
     
-    // Initialize event log
-    if (tpm2_event_log_init(&g_global_event_log, 1000, 64 * 1024) != 0) {
+    // Initialize event log, in the platform's pages when it provided some
+    void* storage = g_event_log_storage;
+    uint32_t storage_size = g_event_log_storage_size;
+    if (!storage) {
+        storage_size = TPM2_EVENT_LOG_DEFAULT_SIZE;
+        storage = g_event_log_allocated = malloc(storage_size);
+        if (!storage) return -1;
+    }
+    if (tpm2_event_log_init(&g_global_event_log, storage, storage_size) != 0) {
         return -1;
     }
     
@@ -242,16 +573,14 @@ int tpm2_self_test(void) {
     return -1;
 }
 
-int tpm2_pcr_extend(uint32_t pcr_index, uint16_t hash_alg, const uint8_t* digest) {
-    if (!g_tpm_initialized || !digest || pcr_index > 23) return -1;
-    
+// TPM2_PCR_Extend for one bank, authorized with an empty password session
+// (the platform hierarchy has no PCR auth during boot)
+static uint32_t tpm2_build_extend(uint8_t* command, uint32_t pcr_index, uint16_t hash_alg, const uint8_t* digest) {
     uint32_t digest_size = (hash_alg == TPM2_ALG_SHA256) ? 32 : 20;
-    
-    uint8_t command[1024];
     uint32_t cmd_size = 0;
     
     // Command header
-    command[cmd_size++] = 0x80; command[cmd_size++] = 0x01; // TPM_ST_NO_SESSIONS
+    command[cmd_size++] = 0x80; command[cmd_size++] = 0x02; // TPM_ST_SESSIONS
     cmd_size += 4; // Length (filled later)
     command[cmd_size++] = 0x00; command[cmd_size++] = 0x00;
     command[cmd_size++] = 0x01; command[cmd_size++] = 0x82; // TPM2_CC_PCR_Extend
@@ -262,8 +591,13 @@ int tpm2_pcr_extend(uint32_t pcr_index, uint16_t hash_alg, const uint8_t* digest
     command[cmd_size++] = (pcr_index >> 8) & 0xFF;
     command[cmd_size++] = pcr_index & 0xFF;
     
-    // Authorization area size (0 for no auth)
+    // Authorization area: TPM_RS_PW, empty nonce, no attributes, empty HMAC
+    command[cmd_size++] = 0x00; command[cmd_size++] = 0x00;
+    command[cmd_size++] = 0x00; command[cmd_size++] = 0x09;
+    command[cmd_size++] = 0x40; command[cmd_size++] = 0x00;
+    command[cmd_size++] = 0x00; command[cmd_size++] = 0x09;
     command[cmd_size++] = 0x00; command[cmd_size++] = 0x00;
+    command[cmd_size++] = 0x00;
     command[cmd_size++] = 0x00; command[cmd_size++] = 0x00;
     
     // Digest count (1)
@@ -284,8 +618,14 @@ int tpm2_pcr_extend(uint32_t pcr_index, uint16_t hash_alg, const uint8_t* digest
     command[4] = (cmd_size >> 8) & 0xFF;
     command[5] = cmd_size & 0xFF;
     
+    return cmd_size;
+}
+
+static int tpm2_send_extend(uint32_t pcr_index, uint16_t hash_alg, const uint8_t* digest) {
+    uint8_t command[96];
     uint8_t response[64];
     uint32_t response_size = sizeof(response);
+    uint32_t cmd_size = tpm2_build_extend(command, pcr_index, hash_alg, digest);
     
     int result = tpm2_send_command(command, cmd_size, response, &response_size);
     if (result != 0) return result;
@@ -298,19 +638,202 @@ int tpm2_pcr_extend(uint32_t pcr_index, uint16_t hash_alg, const uint8_t* digest
     return -1;
 }
 
+int tpm2_pcr_extend(uint32_t pcr_index, uint16_t hash_alg, const uint8_t* digest) {
+    if (!g_tpm_initialized || !digest || pcr_index > 23) return -1;
+    return tpm2_send_extend(pcr_index, hash_alg, digest);
+}
+
+// Deferred SHA-256 extends, held in measurement order until
+// tpm2_measure_flush; the digests are computed when an item is queued, so
+// the measured buffers need not outlive the call. Entries before
+// g_pending_done are on the TPM already and the one at g_pending_done may
+// be in flight; tpm2_measure_poll works through the rest in the background.
+typedef struct {
+    uint32_t pcr_index;
+    uint8_t digest[32];
+} TPM2_PENDING_EXTEND;
+
+static TPM2_PENDING_EXTEND g_pending_extends[TPM2_MEASURE_QUEUE_MAX];
+static uint32_t g_pending_count = 0;
+static uint32_t g_pending_done = 0;
+static int g_extend_in_flight = 0;
+static int g_extend_failed = 0;
+static int g_measure_deferred = 0;
+
+static void tpm2_finish_extend(const uint8_t* response, uint32_t response_size, int result) {
+    if (result != 0 || response_size < 10 ||
+        ((response[6] << 24) | (response[7] << 16) | (response[8] << 8) | response[9]) != TPM2_RC_SUCCESS) {
+        g_extend_failed = 1;
+    }
+    g_extend_in_flight = 0;
+    g_pending_done++;
+}
+
+// Put the next queued extend on the TPM if it is free
+static void tpm2_start_extend(void) {
+    uint8_t command[96];
+    
+    if (g_extend_in_flight || g_command_pending || g_pending_done == g_pending_count) return;
+    
+    uint32_t cmd_size = tpm2_build_extend(command, g_pending_extends[g_pending_done].pcr_index, TPM2_ALG_SHA256,
+                                          g_pending_extends[g_pending_done].digest);
+    if (tpm2_submit_command(command, cmd_size) != 0) {
+        g_extend_failed = 1;
+        g_pending_done++;
+        return;
+    }
+    g_extend_in_flight = 1;
+}
+
+// Wait out the extend in flight, if any
+static void tpm2_retire_extend(void) {
+    uint8_t response[64];
+    uint32_t response_size = sizeof(response);
+    
+    if (!g_extend_in_flight) return;
+    tpm2_finish_extend(response, response_size, tpm2_wait_command(response, &response_size));
+}
+
+// Everything still queued, synchronously
+static void tpm2_complete_extends(void) {
+    if (g_pending_done == g_pending_count) return;
+    
+    BH_TRACE_BEGIN(span, BH_TRACE_PHASE_TPM_MEASURE);
+    tpm2_retire_extend();
+    while (g_pending_done < g_pending_count) {
+        tpm2_start_extend();
+        tpm2_retire_extend();
+    }
+    BH_TRACE_END(span);
+}
+
+// As above, then empty the queue and report whether every extend landed
+static int tpm2_drain_extends(void) {
+    int result;
+    
+    g_tpm_busy++;
+    tpm2_complete_extends();
+    
+    result = g_extend_failed ? -1 : 0;
+    g_pending_count = 0;
+    g_pending_done = 0;
+    g_extend_failed = 0;
+    g_tpm_busy--;
+    return result;
+}
+
+int tpm2_measure_defer(void) {
+    if (!g_tpm_initialized) return -1;
+    g_measure_deferred = 1;
+    return 0;
+}
+
+void tpm2_measure_poll(void) {
+    uint8_t response[64];
+    uint32_t response_size = sizeof(response);
+    
+    if (g_tpm_busy || !g_tpm_initialized) return;
+    
+    g_tpm_busy++;
+    if (g_extend_in_flight) {
+        int result = tpm2_poll_command(response, &response_size);
+        if (result != TPM2_COMMAND_PENDING) tpm2_finish_extend(response, response_size, result);
+    }
+    tpm2_start_extend();
+    g_tpm_busy--;
+}
+
+int tpm2_measure_flush(void) {
+    g_measure_deferred = 0;
+    return tpm2_drain_extends();
+}
+
+// Extend now, or queue the extend while measurements are deferred
+static int tpm2_commit_extend(uint32_t pcr_index, const uint8_t* digest) {
+    int result = 0;
+    
+    if (!g_measure_deferred) return tpm2_pcr_extend(pcr_index, TPM2_ALG_SHA256, digest);
+    if (!g_tpm_initialized || pcr_index > 23) return -1;
+    
+    g_tpm_busy++;
+    
+    // Make room by dropping finished entries; only a queue the TPM has not
+    // started on has to go out synchronously. Order is what matters, not timing
+    if (g_pending_count == TPM2_MEASURE_QUEUE_MAX) {
+        if (g_pending_done) {
+            g_pending_count -= g_pending_done;
+            memmove(g_pending_extends, g_pending_extends + g_pending_done, g_pending_count * sizeof(g_pending_extends[0]));
+            g_pending_done = 0;
+        } else {
+            result = tpm2_drain_extends();
+        }
+    }
+    
+    if (result == 0) {
+        g_pending_extends[g_pending_count].pcr_index = pcr_index;
+        memcpy(g_pending_extends[g_pending_count].digest, digest, 32);
+        g_pending_count++;
+        
+        // Let the TPM start on it while the caller carries on
+        tpm2_start_extend();
+    }
+    
+    g_tpm_busy--;
+    return result;
+}
+
 int tpm2_measure_data(uint32_t pcr_index, uint32_t event_type, const void* data, uint32_t data_size, const char* description) {
     if (!data || data_size == 0) return -1;
     
+    BH_TRACE_BEGIN(span, BH_TRACE_PHASE_TPM_MEASURE);
+    
     // Calculate digest
     uint8_t digest[32];
     sha256_hash((const uint8_t*)data, data_size, digest);
     
     // Extend PCR
-    int result = tpm2_pcr_extend(pcr_index, TPM2_ALG_SHA256, digest);
+    int result = tpm2_commit_extend(pcr_index, digest);
+    BH_TRACE_END(span);
     if (result != 0) return result;
     
     // Add to event log
-    return tpm2_event_log_add(&g_global_event_log, pcr_index, event_type, data, data_size, description);
+    return tpm2_event_log_add(&g_global_event_log, pcr_index, event_type, digest, data, data_size, description);
+}
+
+// Several images hashed together through the multi-buffer SHA-256, then
+// extended and logged in order
+int tpm2_measure_batch(const TPM2_MEASUREMENT* items, uint32_t count) {
+    crypto_sha256_job_t jobs[16];
+    uint8_t digests[16][32];
+
+    if (!items && count) return -1;
+
+    for (uint32_t base = 0; base < count; base += 16) {
+        uint32_t n = count - base < 16 ? count - base : 16;
+
+        for (uint32_t i = 0; i < n; i++) {
+            if (!items[base + i].data || items[base + i].data_size == 0) return -1;
+            jobs[i].data = (const uint8_t*)items[base + i].data;
+            jobs[i].len = items[base + i].data_size;
+            jobs[i].digest = digests[i];
+        }
+
+        BH_TRACE_BEGIN(span, BH_TRACE_PHASE_TPM_MEASURE);
+        int result = crypto_sha256_multi(jobs, n);
+        BH_TRACE_END(span);
+        if (result != 0) return result;
+
+        for (uint32_t i = 0; i < n; i++) {
+            const TPM2_MEASUREMENT* item = &items[base + i];
+            if (item->digest) memcpy(item->digest, digests[i], sizeof(digests[i]));
+            result = tpm2_commit_extend(item->pcr_index, digests[i]);
+            if (result != 0) return result;
+            result = tpm2_event_log_add(&g_global_event_log, item->pcr_index, item->event_type, digests[i],
+                                        digests[i], sizeof(digests[i]), item->description);
+            if (result != 0) return result;
+        }
+    }
+    return 0;
 }
 
 int tpm2_measure_string(uint32_t pcr_index, uint32_t event_type, const char* string) {
@@ -318,65 +841,94 @@ int tpm2_measure_string(uint32_t pcr_index, uint32_t event_type, const char* str
     return tpm2_measure_data(pcr_index, event_type, string, strlen(string), string);
 }
 
-int tpm2_event_log_init(TPM2_EVENT_LOG* log, uint32_t max_events, uint32_t max_log_size) {
-    if (!log) return -1;
-    
-    log->events = (TCG_PCR_EVENT*)malloc(max_events * sizeof(TCG_PCR_EVENT));
-    if (!log->events) return -1;
-    
-    log->log_buffer = (uint8_t*)malloc(max_log_size);
-    if (!log->log_buffer) {
-        free(log->events);
-        return -1;
-    }
-    
+static void tpm2_put_le16(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void tpm2_put_le32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+int tpm2_event_log_init(TPM2_EVENT_LOG* log, void* buffer, uint32_t size) {
+    if (!log || !buffer || size < TPM2_EVENT_LOG_HEADER_SIZE) return -1;
+    
+    uint8_t* p = (uint8_t*)buffer;
+    
+    // TCG_PCClientPCREvent in the SHA-1 layout, carrying the Spec ID event
+    // that tells parsers the rest of the log is TCG_PCR_EVENT2
+    memset(p, 0, TPM2_EVENT_LOG_HEADER_SIZE);
+    tpm2_put_le32(p + 0, 0);                            // PCR 0
+    tpm2_put_le32(p + 4, EV_NO_ACTION);
+    tpm2_put_le32(p + 28, TPM2_EVENT_LOG_HEADER_SIZE - 32);
+    
+    uint8_t* spec = p + 32;
+    memcpy(spec, "Spec ID Event03", 16);                // Signature, NUL included
+    tpm2_put_le32(spec + 16, 0);                        // platformClass: client
+    spec[20] = 0;                                       // specVersionMinor
+    spec[21] = 2;                                       // specVersionMajor
+    spec[22] = 0;                                       // specErrata
+    spec[23] = sizeof(uintptr_t) == 8 ? 2 : 1;          // uintnSize
+    tpm2_put_le32(spec + 24, 1);                        // numberOfAlgorithms
+    tpm2_put_le16(spec + 28, TPM2_ALG_SHA256);
+    tpm2_put_le16(spec + 30, 32);
+    spec[32] = 0;                                       // vendorInfoSize
+    
+    log->log_buffer = p;
+    log->log_size = TPM2_EVENT_LOG_HEADER_SIZE;
+    log->max_log_size = size;
     log->event_count = 0;
-    log->max_events = max_events;
-    log->log_size = 0;
-    log->max_log_size = max_log_size;
+    log->last_event = 0;
     
     return 0;
 }
 
-int tpm2_event_log_add(TPM2_EVENT_LOG* log, uint32_t pcr_index, uint32_t event_type, const void* data, uint32_t data_size, const char* description) {
-    if (!log || !data || log->event_count >= log->max_events) return -1;
+int tpm2_event_log_add(TPM2_EVENT_LOG* log, uint32_t pcr_index, uint32_t event_type, const uint8_t* digest,
+                       const void* data, uint32_t data_size, const char* description) {
+    if (!log || !log->log_buffer || !digest || (!data && data_size)) return -1;
     
     // Calculate required space
     uint32_t desc_len = description ? strlen(description) + 1 : 0;
-    uint32_t total_event_size = sizeof(TCG_PCR_EVENT) + data_size + desc_len;
+    uint32_t event_size = data_size + desc_len;
+    if (event_size < data_size) return -1;
     
-    if (log->log_size + total_event_size > log->max_log_size) {
+    uint32_t room = log->max_log_size - log->log_size;
+    if (room < TPM2_EVENT2_HEADER_SIZE || room - TPM2_EVENT2_HEADER_SIZE < event_size) {
         return -1; // Not enough space
     }
     
-    // Create event entry
-    TCG_PCR_EVENT* event = &log->events[log->event_count];
-    event->pcr_index = pcr_index;
-    event->event_type = event_type;
-    event->event_data_size = data_size + desc_len;
-    
-    // Calculate SHA-1 digest for legacy compatibility
-    uint8_t combined_data[data_size + desc_len];
-    memcpy(combined_data, data, data_size);
-    if (description) {
-        memcpy(combined_data + data_size, description, desc_len);
-    }
-    
-    // For now, use SHA-256 and truncate to 20 bytes (proper implementation would use SHA-1)
-    uint8_t sha256_digest[32];
-    sha256_hash(combined_data, data_size + desc_len, sha256_digest);
-    memcpy(event->digest, sha256_digest, 20);
-    
-    // Copy event data to log buffer
-    uint8_t* event_data_ptr = log->log_buffer + log->log_size;
-    memcpy(event_data_ptr, combined_data, data_size + desc_len);
-    
-    log->log_size += total_event_size;
+    // TCG_PCR_EVENT2 with its one SHA-256 TPMT_HA, written in place
+    uint8_t* event = log->log_buffer + log->log_size;
+    tpm2_put_le32(event + 0, pcr_index);
+    tpm2_put_le32(event + 4, event_type);
+    tpm2_put_le32(event + 8, 1);                        // digests.count
+    tpm2_put_le16(event + 12, TPM2_ALG_SHA256);
+    memcpy(event + 14, digest, 32);
+    tpm2_put_le32(event + 46, event_size);
+    if (data_size) memcpy(event + TPM2_EVENT2_HEADER_SIZE, data, data_size);
+    if (desc_len) memcpy(event + TPM2_EVENT2_HEADER_SIZE + data_size, description, desc_len);
+    
+    log->last_event = log->log_size;
+    log->log_size += TPM2_EVENT2_HEADER_SIZE + event_size;
     log->event_count++;
     
     return 0;
 }
 
+int tpm2_set_event_log_buffer(void* buffer, uint32_t size) {
+    if (g_tpm_initialized || !buffer || size < TPM2_EVENT_LOG_HEADER_SIZE) return -1;
+    g_event_log_storage = buffer;
+    g_event_log_storage_size = size;
+    return 0;
+}
+
+const TPM2_EVENT_LOG* tpm2_get_event_log(void) {
+    return g_tpm_initialized ? &g_global_event_log : NULL;
+}
+
 int measured_boot_init(MeasuredBootContext* context) {
     if (!context) return -1;
     
@@ -399,10 +951,8 @@ int measured_boot_init(MeasuredBootContext* context) {
         }
     }
     
-    // Initialize event log
-    if (tpm2_event_log_init(&context->event_log, 500, 32 * 1024) != 0) {
-        return -1;
-    }
+    // Every measurement lands in the one global log
+    context->event_log = &g_global_event_log;
     
     // Measure separator in PCR 0-7 (standard practice)
     for (int pcr = 0; pcr <= 7; pcr++) {
@@ -508,8 +1058,12 @@ int tpm2_run_diagnostics(void) {
 }
 
 void tpm2_cleanup(void) {
-    if (g_tmp_initialized) {
+    if (g_tpm_initialized) {
         tpm2_event_log_cleanup(&g_global_event_log);
+        if (g_event_log_allocated) {
+            free(g_event_log_allocated);
+            g_event_log_allocated = NULL;
+        }
         g_tpm_initialized = 0;
     }
 }
@@ -517,15 +1071,6 @@ void tpm2_cleanup(void) {
 void tpm2_event_log_cleanup(TPM2_EVENT_LOG* log) {
     if (!log) return;
     
-    if (log->events) {
-        free(log->events);
-        log->events = NULL;
-    }
-    
-    if (log->log_buffer) {
-        free(log->log_buffer);
-        log->log_buffer = NULL;
-    }
-    
+    // The storage belongs to whoever passed it to tpm2_event_log_init
     memset(log, 0, sizeof(TPM2_EVENT_LOG));
 }
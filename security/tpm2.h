@@ -157,14 +157,20 @@ typedef struct {
     uint8_t digest[];           // Variable-length digest
 } __attribute__((packed)) TPMT_HA;
 
-// TPM Event Log
+// TPM Event Log: one contiguous buffer in TCG2 crypto-agile format, a
+// TCG_PCClientPCREvent carrying the Spec ID event followed by
+// TCG_PCR_EVENT2 records with a single SHA-256 digest each. Events are
+// appended in place, so the buffer can be handed to the OS as it stands.
+#define TPM2_EVENT_LOG_HEADER_SIZE  65      // Spec ID event, one algorithm
+#define TPM2_EVENT2_HEADER_SIZE     50      // Up to and including eventSize
+#define TPM2_EVENT_LOG_DEFAULT_SIZE (64 * 1024)
+
 typedef struct {
-    TCG_PCR_EVENT* events;      // Array of events
-    uint32_t event_count;       // Number of events
-    uint32_t max_events;        // Maximum events capacity
-    uint8_t* log_buffer;        // Raw log buffer
-    uint32_t log_size;          // Current log size
-    uint32_t max_log_size;      // Maximum log size
+    uint8_t* log_buffer;        // Start of the log (the Spec ID event)
+    uint32_t log_size;          // Bytes in use
+    uint32_t max_log_size;      // Bytes available at log_buffer
+    uint32_t event_count;       // Events after the Spec ID event
+    uint32_t last_event;        // Offset of the newest event
 } TPM2_EVENT_LOG;
 
 // TPM Interface Functions
@@ -193,9 +199,45 @@ int tpm2_measure_data(uint32_t pcr_index, uint32_t event_type, const void* data,
 int tpm2_measure_file(uint32_t pcr_index, uint32_t event_type, const char* filename, const void* file_data, uint32_t file_size);
 int tpm2_measure_string(uint32_t pcr_index, uint32_t event_type, const char* string);
 
+// One image in a batch measurement; the event logs its SHA-256 digest
+// followed by the description, not the image itself
+typedef struct {
+    uint32_t pcr_index;
+    uint32_t event_type;
+    const void* data;
+    uint32_t data_size;
+    const char* description;
+    uint8_t* digest;            // Optional: receives the SHA-256, for callers that pass it on
+} TPM2_MEASUREMENT;
+
+int tpm2_measure_batch(const TPM2_MEASUREMENT* items, uint32_t count);
+
+// Between tpm2_measure_defer and tpm2_measure_flush, measurements are
+// hashed and logged right away but their PCR extends are queued: they are
+// started as the TPM frees up and whatever remains is sent at the flush,
+// which must come before ExitBootServices (or before starting anything the
+// measurements cover)
+#define TPM2_MEASURE_QUEUE_MAX      64
+
+int tpm2_measure_defer(void);
+int tpm2_measure_flush(void);
+
+// Advance the queued extends without blocking: collect a finished one and
+// start the next. Meant to run periodically (from a timer, say) while the
+// loader reads files, so the flush finds little left to do. It is safe to
+// call at any point; it backs off while the driver is already in use.
+void tpm2_measure_poll(void);
+
 // Event Log Management
-int tpm2_event_log_init(TPM2_EVENT_LOG* log, uint32_t max_events, uint32_t max_log_size);
-int tpm2_event_log_add(TPM2_EVENT_LOG* log, uint32_t pcr_index, uint32_t event_type, const void* data, uint32_t data_size, const char* description);
+int tpm2_event_log_init(TPM2_EVENT_LOG* log, void* buffer, uint32_t size);
+int tpm2_event_log_add(TPM2_EVENT_LOG* log, uint32_t pcr_index, uint32_t event_type, const uint8_t* digest,
+                       const void* data, uint32_t data_size, const char* description);
+
+// Pages for the global log, set before tpm2_initialize so the OS can take
+// the log over where it is; otherwise a TPM2_EVENT_LOG_DEFAULT_SIZE pool
+// buffer is used
+int tpm2_set_event_log_buffer(void* buffer, uint32_t size);
+const TPM2_EVENT_LOG* tpm2_get_event_log(void);
 int tpm2_event_log_finalize(TPM2_EVENT_LOG* log);
 void tpm2_event_log_cleanup(TPM2_EVENT_LOG* log);
 
@@ -214,6 +256,16 @@ int tpm2_unseal_data(const uint8_t* sealed_blob, uint32_t blob_size, uint8_t* da
 int tpm2_send_command(const void* command, uint32_t command_size, void* response, uint32_t* response_size);
 int tpm2_wait_for_response(void);
 
+// Non-blocking form of tpm2_send_command: submit starts one command, poll
+// returns TPM2_COMMAND_PENDING until the response has been read (0) or the
+// command failed (-1). Only one command may be outstanding; poll has no
+// timeout of its own, so callers that give up use tpm2_cancel_command.
+#define TPM2_COMMAND_PENDING        1
+
+int tpm2_submit_command(const void* command, uint32_t command_size);
+int tpm2_poll_command(void* response, uint32_t* response_size);
+void tpm2_cancel_command(void);
+
 // Hardware Interface Detection
 typedef enum {
     TPM2_INTERFACE_TIS = 0,     // TPM Interface Specification
@@ -230,7 +282,7 @@ typedef struct {
     uint32_t measurement_count;
     uint32_t pcr_mask;          // Bitmask of used PCRs
     char boot_path[256];        // Boot path being measured
-    TPM2_EVENT_LOG event_log;   // Event log
+    const TPM2_EVENT_LOG* event_log; // The global event log
 } MeasuredBootContext;
 
 // Measured Boot Functions
@@ -0,0 +1,519 @@
+/*
+ * allocprof.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <Uefi.h>
+#include "compat.h"
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/PrintLib.h>
+#include "uefi.h"
+
+// Call sites tracked; later ones are pooled under "other"
+#define ALLOC_SITES             256
+#define ALLOC_SITE_OTHER        ALLOC_SITES
+
+// Live blocks remembered for attributing frees (power of two); the table
+// is kept under three quarters full and blocks past that go uncounted
+#define ALLOC_LIVE_SLOTS        8192
+#define ALLOC_LIVE_MASK         (ALLOC_LIVE_SLOTS - 1)
+#define ALLOC_LIVE_LIMIT        (ALLOC_LIVE_SLOTS / 4 * 3)
+
+// How far above the hook's frame to look for the loader's call site
+#define ALLOC_STACK_SCAN        4096
+
+// Return addresses inside MemoryAllocationLib and the hooks themselves,
+// learnt once by calibration, that are never a call site
+#define ALLOC_SKIP_MAX          32
+
+// Upper bound on the size of AllocProfileProbe's code
+#define ALLOC_PROBE_SPAN        256
+
+// Longest line AllocProfilerSave writes per site
+#define ALLOC_LINE_MAX          96
+
+typedef struct {
+    UINTN   Site;       // Loader return address; 0 for a free slot
+    UINT64  Calls;
+    UINT64  Bytes;      // Requested over the whole run
+    UINT64  Live;       // Still allocated
+    UINT64  Peak;       // Highest Live
+    UINT64  AtPeak;     // Live when the total last peaked
+} ALLOC_SITE;
+
+typedef struct {
+    UINTN   Address;    // 0 for a free slot
+    UINT64  Size;
+    UINTN   Site;       // Index into mAllocSites
+} ALLOC_LIVE;
+
+STATIC EFI_ALLOCATE_POOL    mOrigAllocatePool;
+STATIC EFI_FREE_POOL        mOrigFreePool;
+STATIC EFI_ALLOCATE_PAGES   mOrigAllocatePages;
+STATIC EFI_FREE_PAGES       mOrigFreePages;
+
+STATIC ALLOC_SITE*  mAllocSites;        // ALLOC_SITES + 1 entries, hashed on Site
+STATIC ALLOC_LIVE*  mAllocLive;
+STATIC UINTN        mAllocLiveCount;
+STATIC UINTN        mAllocUsed[ALLOC_SITES + 1];   // Occupied site indices, for the peak snapshot
+STATIC UINTN        mAllocUsedCount;
+STATIC UINT64       mAllocTotalLive;
+STATIC UINT64       mAllocTotalPeak;
+STATIC UINT64       mAllocUntracked;    // Blocks the live table had no room for
+
+STATIC UINTN        mAllocImageBase;
+STATIC UINTN        mAllocCodeStart;
+STATIC UINTN        mAllocCodeEnd;
+STATIC UINTN        mAllocSkip[ALLOC_SKIP_MAX];
+STATIC UINTN        mAllocSkipCount;
+STATIC BOOLEAN      mAllocCalibrating;
+
+STATIC VOID AllocProfileProbe(VOID);
+
+STATIC
+UINTN
+AllocHash(
+    IN UINTN Value
+) {
+    UINT64 h = (UINT64)Value * 0x9E3779B97F4A7C15ULL;
+    return (UINTN)(h >> 32);
+}
+
+STATIC
+BOOLEAN
+AllocIsSkipped(
+    IN UINTN Value
+) {
+    for (UINTN i = 0; i < mAllocSkipCount; i++) {
+        if (mAllocSkip[i] == Value) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/**
+  The loader address that asked for this allocation: the first return
+  address into loader code above the hook that is not one of the
+  MemoryAllocationLib or hook frames. When firmware allocates on the
+  loader's behalf, that is the loader call that entered the firmware.
+  During calibration, every address found below the probe is learnt as
+  one to skip instead.
+**/
+STATIC
+UINTN
+AllocCallSite(VOID) {
+    volatile UINTN Anchor = 0;
+    UINTN* Slot = (UINTN*)&Anchor;
+    UINTN* Limit = (UINTN*)((UINT8*)Slot + ALLOC_STACK_SCAN);
+
+    for (; Slot < Limit; Slot++) {
+        UINTN Value = *Slot;
+        if (Value < mAllocCodeStart || Value >= mAllocCodeEnd || AllocIsSkipped(Value)) {
+            continue;
+        }
+        if (!mAllocCalibrating) {
+            return Value;
+        }
+        if (Value - (UINTN)AllocProfileProbe < ALLOC_PROBE_SPAN) {
+            break;
+        }
+        if (mAllocSkipCount < ALLOC_SKIP_MAX) {
+            mAllocSkip[mAllocSkipCount++] = Value;
+        }
+    }
+    return 0;
+}
+
+STATIC
+UINTN
+AllocSiteIndex(
+    IN UINTN Site
+) {
+    if (Site == 0) {
+        return ALLOC_SITE_OTHER;
+    }
+    for (UINTN n = 0, i = AllocHash(Site) % ALLOC_SITES; n < ALLOC_SITES; n++, i = (i + 1) % ALLOC_SITES) {
+        if (mAllocSites[i].Site == Site) {
+            return i;
+        }
+        if (mAllocSites[i].Site == 0) {
+            mAllocSites[i].Site = Site;
+            mAllocUsed[mAllocUsedCount++] = i;
+            return i;
+        }
+    }
+    return ALLOC_SITE_OTHER;
+}
+
+STATIC
+VOID
+AllocRecord(
+    IN UINTN  Address,
+    IN UINT64 Size
+) {
+    UINTN Site = AllocCallSite();
+    EFI_TPL OldTpl;
+
+    if (mAllocCalibrating) {
+        return;
+    }
+
+    // A timer notification may allocate while this runs
+    OldTpl = gBS->RaiseTPL(TPL_HIGH_LEVEL);
+    UINTN Index = AllocSiteIndex(Site);
+    ALLOC_SITE* Entry = &mAllocSites[Index];
+    Entry->Calls++;
+    Entry->Bytes += Size;
+
+    if (mAllocLiveCount >= ALLOC_LIVE_LIMIT) {
+        mAllocUntracked++;
+        gBS->RestoreTPL(OldTpl);
+        return;
+    }
+    UINTN i = AllocHash(Address) & ALLOC_LIVE_MASK;
+    while (mAllocLive[i].Address != 0) {
+        i = (i + 1) & ALLOC_LIVE_MASK;
+    }
+    mAllocLive[i].Address = Address;
+    mAllocLive[i].Size = Size;
+    mAllocLive[i].Site = Index;
+    mAllocLiveCount++;
+
+    Entry->Live += Size;
+    Entry->Peak = MAX(Entry->Peak, Entry->Live);
+    mAllocTotalLive += Size;
+    if (mAllocTotalLive > mAllocTotalPeak) {
+        mAllocTotalPeak = mAllocTotalLive;
+        for (UINTN u = 0; u < mAllocUsedCount; u++) {
+            mAllocSites[mAllocUsed[u]].AtPeak = mAllocSites[mAllocUsed[u]].Live;
+        }
+    }
+    gBS->RestoreTPL(OldTpl);
+}
+
+STATIC
+VOID
+AllocForget(
+    IN UINTN Address
+) {
+    EFI_TPL OldTpl = gBS->RaiseTPL(TPL_HIGH_LEVEL);
+    UINTN Hole = AllocHash(Address) & ALLOC_LIVE_MASK;
+
+    while (mAllocLive[Hole].Address != Address) {
+        if (mAllocLive[Hole].Address == 0) {
+            // Allocated before the hooks went in, or never tracked
+            gBS->RestoreTPL(OldTpl);
+            return;
+        }
+        Hole = (Hole + 1) & ALLOC_LIVE_MASK;
+    }
+
+    ALLOC_SITE* Entry = &mAllocSites[mAllocLive[Hole].Site];
+    Entry->Live -= mAllocLive[Hole].Size;
+    mAllocTotalLive -= mAllocLive[Hole].Size;
+    mAllocLiveCount--;
+
+    // Backward-shift deletion keeps every probe run unbroken
+    for (UINTN i = (Hole + 1) & ALLOC_LIVE_MASK; mAllocLive[i].Address != 0; i = (i + 1) & ALLOC_LIVE_MASK) {
+        UINTN Home = AllocHash(mAllocLive[i].Address) & ALLOC_LIVE_MASK;
+        if (((i - Home) & ALLOC_LIVE_MASK) >= ((i - Hole) & ALLOC_LIVE_MASK)) {
+            mAllocLive[Hole] = mAllocLive[i];
+            Hole = i;
+        }
+    }
+    mAllocLive[Hole].Address = 0;
+    gBS->RestoreTPL(OldTpl);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+AllocProfileAllocatePool(
+    IN  EFI_MEMORY_TYPE PoolType,
+    IN  UINTN           Size,
+    OUT VOID            **Buffer
+) {
+    EFI_STATUS Status = mOrigAllocatePool(PoolType, Size, Buffer);
+    if (!EFI_ERROR(Status)) {
+        AllocRecord((UINTN)*Buffer, Size);
+    }
+    return Status;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+AllocProfileFreePool(
+    IN VOID *Buffer
+) {
+    // Forgotten first: once freed, the address may be handed out again
+    AllocForget((UINTN)Buffer);
+    return mOrigFreePool(Buffer);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+AllocProfileAllocatePages(
+    IN     EFI_ALLOCATE_TYPE     Type,
+    IN     EFI_MEMORY_TYPE       MemoryType,
+    IN     UINTN                 Pages,
+    IN OUT EFI_PHYSICAL_ADDRESS  *Memory
+) {
+    EFI_STATUS Status = mOrigAllocatePages(Type, MemoryType, Pages, Memory);
+    if (!EFI_ERROR(Status)) {
+        AllocRecord((UINTN)*Memory, EFI_PAGES_TO_SIZE(Pages));
+    }
+    return Status;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+AllocProfileFreePages(
+    IN EFI_PHYSICAL_ADDRESS Memory,
+    IN UINTN                Pages
+) {
+    AllocForget((UINTN)Memory);
+    return mOrigFreePages(Memory, Pages);
+}
+
+STATIC
+VOID
+AllocPatchBootServices(
+    IN BOOLEAN Install
+) {
+    EFI_TPL OldTpl = gBS->RaiseTPL(TPL_HIGH_LEVEL);
+    UINT32 Crc = 0;
+
+    if (Install) {
+        mOrigAllocatePool = gBS->AllocatePool;
+        mOrigFreePool = gBS->FreePool;
+        mOrigAllocatePages = gBS->AllocatePages;
+        mOrigFreePages = gBS->FreePages;
+        gBS->AllocatePool = AllocProfileAllocatePool;
+        gBS->FreePool = AllocProfileFreePool;
+        gBS->AllocatePages = AllocProfileAllocatePages;
+        gBS->FreePages = AllocProfileFreePages;
+    } else {
+        gBS->AllocatePool = mOrigAllocatePool;
+        gBS->FreePool = mOrigFreePool;
+        gBS->AllocatePages = mOrigAllocatePages;
+        gBS->FreePages = mOrigFreePages;
+    }
+    gBS->Hdr.CRC32 = 0;
+    gBS->CalculateCrc32(gBS, gBS->Hdr.HeaderSize, &Crc);
+    gBS->Hdr.CRC32 = Crc;
+    gBS->RestoreTPL(OldTpl);
+}
+
+/**
+  Allocate and free once through each MemoryAllocationLib entry the
+  loader uses, so AllocCallSite learns the frames between a caller and
+  the hooks. Always called through a pointer, so it is never inlined.
+**/
+STATIC
+VOID
+AllocProfileProbe(VOID) {
+    VOID* Pool;
+    VOID* Pages;
+
+    Pool = AllocatePool(1);
+    Pool = ReallocatePool(1, 2, Pool);
+    if (Pool != NULL) {
+        FreePool(Pool);
+    }
+    Pool = AllocateZeroPool(1);
+    if (Pool != NULL) {
+        FreePool(Pool);
+    }
+    Pages = AllocatePages(1);
+    if (Pages != NULL) {
+        FreePages(Pages, 1);
+    }
+}
+
+/**
+  Count pool and page allocations per loader call site: calls, bytes,
+  the live and peak footprint of each site, and what each held when the
+  total footprint peaked. The boot services table is hooked while this
+  runs, so allocations the firmware makes inside a loader call count
+  against that call. Passing FALSE unhooks it, which has to happen
+  before ExitBootServices; the counters stay readable.
+**/
+EFI_STATUS
+InstallAllocProfiler(
+    IN BOOLEAN Enable
+) {
+    VOID (*volatile Probe)(VOID) = AllocProfileProbe;
+    EFI_STATUS Status;
+
+    if (!Enable) {
+        if (mOrigAllocatePool != NULL) {
+            AllocPatchBootServices(FALSE);
+            mOrigAllocatePool = NULL;
+        }
+        return EFI_SUCCESS;
+    }
+    if (mOrigAllocatePool != NULL) {
+        return EFI_SUCCESS;
+    }
+
+    if (mAllocSites == NULL) {
+        Status = GetLoaderCodeRange(&mAllocImageBase, &mAllocCodeStart, &mAllocCodeEnd);
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+        mAllocSites = AllocateZeroPool((ALLOC_SITES + 1) * sizeof(ALLOC_SITE));
+        mAllocLive = AllocateZeroPool(ALLOC_LIVE_SLOTS * sizeof(ALLOC_LIVE));
+        if (mAllocSites == NULL || mAllocLive == NULL) {
+            if (mAllocSites != NULL) {
+                FreePool(mAllocSites);
+                mAllocSites = NULL;
+            }
+            if (mAllocLive != NULL) {
+                FreePool(mAllocLive);
+                mAllocLive = NULL;
+            }
+            return EFI_OUT_OF_RESOURCES;
+        }
+        mAllocUsed[mAllocUsedCount++] = ALLOC_SITE_OTHER;
+    }
+
+    AllocPatchBootServices(TRUE);
+    if (mAllocSkipCount == 0) {
+        mAllocCalibrating = TRUE;
+        Probe();
+        mAllocCalibrating = FALSE;
+    }
+    return EFI_SUCCESS;
+}
+
+BOOLEAN
+AllocProfilerRunning(VOID) {
+    return mOrigAllocatePool != NULL;
+}
+
+UINT64
+AllocProfilerPeak(VOID) {
+    return mAllocTotalPeak;
+}
+
+UINT64
+AllocProfilerLive(VOID) {
+    return mAllocTotalLive;
+}
+
+STATIC
+UINTN
+AllocSiteOffset(
+    IN CONST ALLOC_SITE* Entry
+) {
+    return Entry->Site ? Entry->Site - mAllocImageBase : 0;
+}
+
+/**
+  Pick the sites in order of what they held at the footprint peak, then
+  their own peak; Rank is filled with up to Count site indices.
+**/
+STATIC
+UINTN
+AllocRankSites(
+    OUT UINTN *Rank,
+    IN  UINTN Count
+) {
+    UINTN Ranked = 0;
+    BOOLEAN Taken[ALLOC_SITES + 1];
+
+    ZeroMem(Taken, sizeof(Taken));
+    while (Ranked < Count) {
+        UINTN Best = MAX_UINTN;
+        for (UINTN u = 0; u < mAllocUsedCount; u++) {
+            UINTN i = mAllocUsed[u];
+            if (Taken[i] || mAllocSites[i].Calls == 0) {
+                continue;
+            }
+            if (Best == MAX_UINTN || mAllocSites[i].AtPeak > mAllocSites[Best].AtPeak ||
+                (mAllocSites[i].AtPeak == mAllocSites[Best].AtPeak && mAllocSites[i].Peak > mAllocSites[Best].Peak)) {
+                Best = i;
+            }
+        }
+        if (Best == MAX_UINTN) {
+            break;
+        }
+        Taken[Best] = TRUE;
+        Rank[Ranked++] = Best;
+    }
+    return Ranked;
+}
+
+VOID
+AllocProfilerPrint(
+    IN UINTN Top
+) {
+    UINTN Rank[ALLOC_SITES + 1];
+    UINTN Count;
+
+    if (mAllocSites == NULL) {
+        Print(L"No allocations recorded\n");
+        return;
+    }
+
+    Print(L"Peak %lu KiB, live %lu KiB, %lu blocks untracked; image base 0x%lx\n",
+          mAllocTotalPeak / 1024, mAllocTotalLive / 1024, mAllocUntracked, (UINT64)mAllocImageBase);
+    Print(L"  site          calls   at peak KiB   site peak KiB   live KiB\n");
+    Count = AllocRankSites(Rank, MIN(Top, (UINTN)ARRAY_SIZE(Rank)));
+    for (UINTN n = 0; n < Count; n++) {
+        CONST ALLOC_SITE* Entry = &mAllocSites[Rank[n]];
+        if (Entry->Site) {
+            Print(L"  +0x%06lx", (UINT64)AllocSiteOffset(Entry));
+        } else {
+            Print(L"  other    ");
+        }
+        Print(L"  %8lu  %12lu  %14lu  %9lu\n", Entry->Calls, Entry->AtPeak / 1024,
+              Entry->Peak / 1024, Entry->Live / 1024);
+    }
+}
+
+/**
+  Write every site, heaviest at the peak first, as "offset calls bytes
+  at-peak peak live" lines for symbolizing against BloodHorn.map.
+**/
+EFI_STATUS
+AllocProfilerSave(
+    IN CONST CHAR16* FileName
+) {
+    UINTN Rank[ALLOC_SITES + 1];
+    UINTN Count, Size, Length;
+    CHAR8* Text;
+    EFI_STATUS Status;
+
+    if (mAllocSites == NULL) {
+        return EFI_NOT_STARTED;
+    }
+
+    Count = AllocRankSites(Rank, ARRAY_SIZE(Rank));
+    Size = (Count + 2) * ALLOC_LINE_MAX;
+    Text = AllocatePool(Size);
+    if (Text == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    Length = AsciiSPrint(Text, Size, "# peak %lu live %lu untracked %lu base 0x%lx\n",
+                         mAllocTotalPeak, mAllocTotalLive, mAllocUntracked, (UINT64)mAllocImageBase);
+    for (UINTN n = 0; n < Count; n++) {
+        CONST ALLOC_SITE* Entry = &mAllocSites[Rank[n]];
+        Length += AsciiSPrint(Text + Length, Size - Length, "0x%06lx %lu %lu %lu %lu %lu\n",
+                              (UINT64)AllocSiteOffset(Entry), Entry->Calls, Entry->Bytes,
+                              Entry->AtPeak, Entry->Peak, Entry->Live);
+    }
+
+    Status = WriteBootFile(FileName, Text, Length);
+    FreePool(Text);
+    return Status;
+}
@@ -0,0 +1,263 @@
+/*
+ * blockdev.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <Uefi.h>
+#include "compat.h"
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/BaseLib.h>
+#include <Library/DevicePathLib.h>
+#include <Protocol/LoadedImage.h>
+#include <Protocol/DevicePath.h>
+#include <Protocol/BlockIo.h>
+#include <Protocol/BlockIo2.h>
+#include <Protocol/DiskIo.h>
+#include "uefi.h"
+#include "../fs/blockdev.h"
+
+// Firmware protocols behind the filesystem block cache
+typedef struct {
+    EFI_HANDLE              Handle;      // Whole-disk handle, NULL = free slot
+    EFI_BLOCK_IO_PROTOCOL   *BlockIo;
+    EFI_BLOCK_IO2_PROTOCOL  *BlockIo2;   // Optional
+    EFI_DISK_IO_PROTOCOL    *DiskIo;     // Optional, used for unaligned requests
+    UINT32                  MediaId;
+    UINT32                  BlockSize;
+    UINT32                  IoAlign;
+    block_device_t          Device;
+} UEFI_BLOCK_DEVICE;
+
+// Slot 0 is the boot disk; the others are opened on demand (e.g. by the
+// partition probe) and live for the rest of the boot
+#define UEFI_MAX_DISKS 16
+
+STATIC UEFI_BLOCK_DEVICE mDisks[UEFI_MAX_DISKS];
+
+/**
+  Read whole media blocks with BLOCK_IO2 (blocking token) or BLOCK_IO.
+**/
+STATIC
+EFI_STATUS
+ReadMediaBlocks(
+    IN  UEFI_BLOCK_DEVICE   *Disk,
+    IN  EFI_LBA             Lba,
+    IN  UINTN               Size,
+    OUT VOID                *Buffer
+) {
+    EFI_STATUS Status;
+
+    if (Disk->BlockIo2 != NULL) {
+        // A token without an event makes ReadBlocksEx complete synchronously
+        EFI_BLOCK_IO2_TOKEN Token;
+        ZeroMem(&Token, sizeof(Token));
+        Status = Disk->BlockIo2->ReadBlocksEx(Disk->BlockIo2, Disk->MediaId, Lba, &Token, Size, Buffer);
+        if (!EFI_ERROR(Status)) {
+            Status = Token.TransactionStatus;
+        }
+        return Status;
+    }
+
+    return Disk->BlockIo->ReadBlocks(Disk->BlockIo, Disk->MediaId, Lba, Size, Buffer);
+}
+
+STATIC
+int
+UefiBlockRead(
+    block_device_t  *dev,
+    uint64_t        sector,
+    uint32_t        count,
+    void            *buf
+) {
+    UEFI_BLOCK_DEVICE *Disk = (UEFI_BLOCK_DEVICE *)dev->context;
+    UINT64 Offset = MultU64x32(sector, BLOCKDEV_SECTOR_SIZE);
+    UINTN Size = (UINTN)count * BLOCKDEV_SECTOR_SIZE;
+    EFI_STATUS Status = EFI_UNSUPPORTED;
+
+    for (int Attempt = 0; Attempt < 2; Attempt++) {
+        // Block I/O needs block-granular, IoAlign-aligned transfers; anything
+        // else goes through Disk I/O, which handles arbitrary byte ranges
+        UINT32 Remainder = 0;
+        EFI_LBA Lba = DivU64x32Remainder(Offset, Disk->BlockSize, &Remainder);
+        BOOLEAN Direct = Remainder == 0 &&
+                         (Size % Disk->BlockSize) == 0 &&
+                         (Disk->IoAlign <= 1 || ((UINTN)buf % Disk->IoAlign) == 0);
+
+        if (Direct) {
+            Status = ReadMediaBlocks(Disk, Lba, Size, buf);
+        } else if (Disk->DiskIo != NULL) {
+            Status = Disk->DiskIo->ReadDisk(Disk->DiskIo, Disk->MediaId, Offset, Size, buf);
+        }
+
+        if (Status != EFI_MEDIA_CHANGED) {
+            break;
+        }
+
+        // Media was swapped (e.g. optical); pick up the new id and retry once
+        blockdev_invalidate();
+        Disk->MediaId = Disk->BlockIo->Media->MediaId;
+    }
+
+    return EFI_ERROR(Status) ? -1 : 0;
+}
+
+/**
+  Find the whole-disk handle under a partition (or the disk itself), by
+  cutting the partition node off its device path.
+**/
+STATIC
+EFI_STATUS
+FindDiskHandle(
+    IN  EFI_HANDLE  PartitionHandle,
+    OUT EFI_HANDLE  *DiskHandle
+) {
+    EFI_DEVICE_PATH_PROTOCOL *PartitionPath = DevicePathFromHandle(PartitionHandle);
+    if (PartitionPath == NULL) {
+        return EFI_NOT_FOUND;
+    }
+
+    EFI_DEVICE_PATH_PROTOCOL *DiskPath = DuplicateDevicePath(PartitionPath);
+    if (DiskPath == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    for (EFI_DEVICE_PATH_PROTOCOL *Node = DiskPath; !IsDevicePathEnd(Node); Node = NextDevicePathNode(Node)) {
+        if (DevicePathType(Node) == MEDIA_DEVICE_PATH &&
+            (DevicePathSubType(Node) == MEDIA_HARDDRIVE_DP || DevicePathSubType(Node) == MEDIA_CDROM_DP)) {
+            SetDevicePathEndNode(Node);
+            break;
+        }
+    }
+
+    EFI_DEVICE_PATH_PROTOCOL *Remaining = DiskPath;
+    EFI_STATUS Status = gBS->LocateDevicePath(&gEfiBlockIoProtocolGuid, &Remaining, DiskHandle);
+    if (!EFI_ERROR(Status) && !IsDevicePathEnd(Remaining)) {
+        Status = EFI_NOT_FOUND; // Only matched a parent controller
+    }
+
+    FreePool(DiskPath);
+    return Status;
+}
+
+/**
+  Bind a whole-disk handle's protocols to a block device slot.
+**/
+STATIC
+EFI_STATUS
+OpenUefiDisk(
+    IN  EFI_HANDLE          DiskHandle,
+    OUT UEFI_BLOCK_DEVICE   *Disk
+) {
+    EFI_STATUS Status;
+
+    ZeroMem(Disk, sizeof(*Disk));
+    Status = gBS->HandleProtocol(DiskHandle, &gEfiBlockIoProtocolGuid, (VOID **)&Disk->BlockIo);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    EFI_BLOCK_IO_MEDIA *Media = Disk->BlockIo->Media;
+    if (!Media->MediaPresent || Media->BlockSize == 0) {
+        return EFI_NO_MEDIA;
+    }
+
+    // Both are optional; BLOCK_IO alone is enough for aligned reads
+    if (EFI_ERROR(gBS->HandleProtocol(DiskHandle, &gEfiBlockIo2ProtocolGuid, (VOID **)&Disk->BlockIo2))) {
+        Disk->BlockIo2 = NULL;
+    }
+    if (EFI_ERROR(gBS->HandleProtocol(DiskHandle, &gEfiDiskIoProtocolGuid, (VOID **)&Disk->DiskIo))) {
+        Disk->DiskIo = NULL;
+    }
+
+    // Sub-sector or non-multiple block sizes can only be served by Disk I/O
+    if ((Media->BlockSize % BLOCKDEV_SECTOR_SIZE) != 0 && Disk->DiskIo == NULL) {
+        return EFI_UNSUPPORTED;
+    }
+
+    Disk->MediaId = Media->MediaId;
+    Disk->BlockSize = Media->BlockSize;
+    Disk->IoAlign = Media->IoAlign;
+
+    Disk->Device.name = Disk->BlockIo2 != NULL ? "uefi-blockio2" : "uefi-blockio";
+    Disk->Device.sector_count = DivU64x32(MultU64x32(Media->LastBlock + 1, Media->BlockSize), BLOCKDEV_SECTOR_SIZE);
+    Disk->Device.read = UefiBlockRead;
+    Disk->Device.context = Disk;
+    Disk->Handle = DiskHandle;
+    return EFI_SUCCESS;
+}
+
+EFI_STATUS
+AttachBootBlockDevice(VOID) {
+    EFI_STATUS Status;
+    EFI_LOADED_IMAGE_PROTOCOL *LoadedImage = NULL;
+    EFI_HANDLE DiskHandle = NULL;
+
+    Status = gBS->HandleProtocol(gImageHandle, &gEfiLoadedImageProtocolGuid, (VOID **)&LoadedImage);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    Status = FindDiskHandle(LoadedImage->DeviceHandle, &DiskHandle);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    Status = OpenUefiDisk(DiskHandle, &mDisks[0]);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    return blockdev_attach(&mDisks[0].Device) == 0 ? EFI_SUCCESS : EFI_DEVICE_ERROR;
+}
+
+EFI_STATUS
+GetDiskBlockDevice(
+    IN  EFI_HANDLE      Handle,
+    OUT block_device_t  **Device
+) {
+    EFI_HANDLE DiskHandle = NULL;
+    EFI_STATUS Status = FindDiskHandle(Handle, &DiskHandle);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    UEFI_BLOCK_DEVICE *Free = NULL;
+    for (UINTN Index = 0; Index < UEFI_MAX_DISKS; Index++) {
+        if (mDisks[Index].Handle == DiskHandle) {
+            *Device = &mDisks[Index].Device;
+            return EFI_SUCCESS;
+        }
+        if (Index > 0 && Free == NULL && mDisks[Index].Handle == NULL) {
+            Free = &mDisks[Index]; // Slot 0 stays reserved for the boot disk
+        }
+    }
+    if (Free == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    Status = OpenUefiDisk(DiskHandle, Free);
+    if (EFI_ERROR(Status)) {
+        return Status; // The slot was left zeroed, i.e. still free
+    }
+    *Device = &Free->Device;
+    return EFI_SUCCESS;
+}
+
+EFI_STATUS
+GetOpenBlockDevice(
+    IN  UINTN           Index,
+    OUT block_device_t  **Device
+) {
+    if (Index >= UEFI_MAX_DISKS) {
+        return EFI_INVALID_PARAMETER;
+    }
+    if (mDisks[Index].Handle == NULL) {
+        return EFI_NOT_FOUND;
+    }
+    *Device = &mDisks[Index].Device;
+    return EFI_SUCCESS;
+}
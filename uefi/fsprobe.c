@@ -0,0 +1,299 @@
+/*
+ * fsprobe.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <Uefi.h>
+#include "compat.h"
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiRuntimeServicesTableLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/BaseLib.h>
+#include <Library/DevicePathLib.h>
+#include <Library/PrintLib.h>
+#include <Protocol/LoadedImage.h>
+#include <Protocol/DevicePath.h>
+#include <Protocol/BlockIo.h>
+#include "uefi.h"
+#include "../fs/blockdev.h"
+#include "../fs/fs_mount.h"
+#include "../fs/fs_probe.h"
+#include "../fs/partition.h"
+#include "../boot/libb/include/bloodhorn/trace.h"
+
+extern EFI_GUID gBloodHornVariableGuid;
+
+#define FS_PROBE_VARIABLE   L"BloodHornFsProbe"
+
+// Probe results from the previous boot, and the state they were loaded in
+STATIC fs_probe_cache_t mProbeCache;
+STATIC fs_probe_cache_t mProbeCacheLoaded;
+
+typedef struct {
+    fs_probe_target_t   Targets[FS_PROBE_MAX_TARGETS];
+    EFI_HANDLE          Handles[FS_PROBE_MAX_TARGETS];  // Partition (or disk) handle per target
+    UINT32              Count;
+} PROBE_LIST;
+
+STATIC
+HARDDRIVE_DEVICE_PATH *
+FindHardDriveNode(
+    IN EFI_HANDLE Handle
+) {
+    for (EFI_DEVICE_PATH_PROTOCOL *Node = DevicePathFromHandle(Handle);
+         Node != NULL && !IsDevicePathEnd(Node);
+         Node = NextDevicePathNode(Node)) {
+        if (DevicePathType(Node) == MEDIA_DEVICE_PATH && DevicePathSubType(Node) == MEDIA_HARDDRIVE_DP) {
+            return (HARDDRIVE_DEVICE_PATH *)Node;
+        }
+    }
+    return NULL;
+}
+
+/**
+  Identify the disk a partition belongs to: the MBR signature is in the
+  partition's device path, the GPT disk GUID comes from the shared
+  partition table (read once per disk, not once per partition).
+**/
+STATIC
+VOID
+GetDiskIdentity(
+    IN  block_device_t          *Device,
+    IN  HARDDRIVE_DEVICE_PATH   *Hd,
+    OUT UINT8                   *Guid
+) {
+    ZeroMem(Guid, 16);
+
+    if (Hd->SignatureType == SIGNATURE_TYPE_MBR) {
+        CopyMem(Guid, Hd->Signature, 4);
+        return;
+    }
+    if (Hd->SignatureType != SIGNATURE_TYPE_GUID) {
+        return;
+    }
+
+    CONST part_table_t *Table = part_table_get(Device);
+    if (Table != NULL && Table->scheme == PART_SCHEME_GPT) {
+        CopyMem(Guid, Table->disk_guid, 16);
+    }
+}
+
+STATIC
+VOID
+AddTarget(
+    IN OUT PROBE_LIST   *List,
+    IN     EFI_HANDLE   Handle,
+    IN     block_device_t *Device,
+    IN     UINT64       Start,
+    IN     UINT64       Sectors,
+    IN     CONST UINT8  *Guid OPTIONAL
+) {
+    if (List->Count >= FS_PROBE_MAX_TARGETS) {
+        return;
+    }
+
+    fs_probe_target_t *Target = &List->Targets[List->Count];
+    ZeroMem(Target, sizeof(*Target));
+    Target->dev = Device;
+    Target->start = Start;
+    Target->sectors = Sectors;
+    if (Guid != NULL) {
+        CopyMem(Target->disk_guid, Guid, sizeof(Target->disk_guid));
+    }
+    List->Handles[List->Count++] = Handle;
+}
+
+/**
+  One target per partition on every disk, plus one for each unpartitioned
+  disk (e.g. a superfloppy). Only device paths are consulted here, apart
+  from the partition table of each GPT disk, which is read once.
+  Unpartitioned disks get no identity and are always probed, since their
+  media is the likeliest to have been swapped.
+**/
+STATIC
+VOID
+CollectTargets(
+    OUT PROBE_LIST *List
+) {
+    EFI_HANDLE *Handles = NULL;
+    UINTN HandleCount = 0;
+
+    List->Count = 0;
+    if (EFI_ERROR(gBS->LocateHandleBuffer(ByProtocol, &gEfiBlockIoProtocolGuid, NULL, &HandleCount, &Handles))) {
+        return;
+    }
+
+    for (UINTN Pass = 0; Pass < 2; Pass++) {
+        for (UINTN Index = 0; Index < HandleCount; Index++) {
+            EFI_BLOCK_IO_PROTOCOL *BlockIo = NULL;
+            block_device_t *Device = NULL;
+
+            if (EFI_ERROR(gBS->HandleProtocol(Handles[Index], &gEfiBlockIoProtocolGuid, (VOID **)&BlockIo)) ||
+                !BlockIo->Media->MediaPresent ||
+                (BOOLEAN)(Pass == 0) != BlockIo->Media->LogicalPartition ||
+                EFI_ERROR(GetDiskBlockDevice(Handles[Index], &Device))) {
+                continue;
+            }
+
+            if (Pass == 0) {
+                HARDDRIVE_DEVICE_PATH *Hd = FindHardDriveNode(Handles[Index]);
+                if (Hd == NULL) {
+                    continue; // El Torito images and the like
+                }
+
+                UINT32 BlockSize = BlockIo->Media->BlockSize;
+                UINT8 Guid[16];
+                GetDiskIdentity(Device, Hd, Guid);
+                AddTarget(List, Handles[Index], Device,
+                          DivU64x32(MultU64x32(Hd->PartitionStart, BlockSize), BLOCKDEV_SECTOR_SIZE),
+                          DivU64x32(MultU64x32(Hd->PartitionSize, BlockSize), BLOCKDEV_SECTOR_SIZE),
+                          Guid);
+                continue;
+            }
+
+            // Whole disk: only interesting if none of its partitions showed up
+            BOOLEAN Partitioned = FALSE;
+            for (UINT32 T = 0; T < List->Count; T++) {
+                if (List->Targets[T].dev == Device) {
+                    Partitioned = TRUE;
+                    break;
+                }
+            }
+            if (!Partitioned) {
+                AddTarget(List, Handles[Index], Device, 0, Device->sector_count, NULL);
+            }
+        }
+    }
+
+    FreePool(Handles);
+}
+
+STATIC
+VOID
+LoadProbeCache(VOID) {
+    UINTN Size = sizeof(mProbeCache);
+    EFI_STATUS Status = gRT->GetVariable(FS_PROBE_VARIABLE, &gBloodHornVariableGuid, NULL, &Size, &mProbeCache);
+
+    if (EFI_ERROR(Status) || Size != sizeof(mProbeCache) || !fs_probe_cache_valid(&mProbeCache)) {
+        fs_probe_cache_init(&mProbeCache);
+    }
+    CopyMem(&mProbeCacheLoaded, &mProbeCache, sizeof(mProbeCache));
+}
+
+STATIC
+VOID
+SaveProbeCache(VOID) {
+    // Only touch NV storage when the disk layout actually changed
+    if (CompareMem(&mProbeCacheLoaded, &mProbeCache, sizeof(mProbeCache)) == 0) {
+        return;
+    }
+
+    gRT->SetVariable(
+        FS_PROBE_VARIABLE,
+        &gBloodHornVariableGuid,
+        EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS,
+        sizeof(mProbeCache),
+        &mProbeCache
+    );
+    CopyMem(&mProbeCacheLoaded, &mProbeCache, sizeof(mProbeCache));
+}
+
+EFI_STATUS
+ProbeFileSystems(VOID) {
+    EFI_LOADED_IMAGE_PROTOCOL *LoadedImage = NULL;
+    EFI_HANDLE BootHandle = NULL;
+    PROBE_LIST *List;
+
+    if (!EFI_ERROR(gBS->HandleProtocol(gImageHandle, &gEfiLoadedImageProtocolGuid, (VOID **)&LoadedImage))) {
+        BootHandle = LoadedImage->DeviceHandle;
+    }
+
+    List = AllocateZeroPool(sizeof(*List));
+    if (List == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    BH_TRACE_BEGIN(ProbeSpan, BH_TRACE_PHASE_FS_PROBE);
+    CollectTargets(List);
+    LoadProbeCache();
+    int Recognised = fs_probe(List->Targets, List->Count, &mProbeCache);
+    BH_TRACE_END(ProbeSpan);
+
+    if (Recognised < 0) {
+        FreePool(List);
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    UINT32 Volume = 0;
+    for (UINT32 Index = 0; Index < List->Count; Index++) {
+        fs_probe_target_t *Target = &List->Targets[Index];
+        CHAR8 Path[16];
+
+        if (Target->fstype[0] == '\0') {
+            continue;
+        }
+        if (List->Handles[Index] == BootHandle) {
+            AsciiStrCpyS(Path, sizeof(Path), "/");
+        } else {
+            AsciiSPrint(Path, sizeof(Path), "/vol%u", Volume++);
+        }
+        fs_probe_mount(Target, Path, &mProbeCache);
+    }
+
+    SaveProbeCache();
+    FreePool(List);
+    return Recognised > 0 ? EFI_SUCCESS : EFI_NOT_FOUND;
+}
+
+EFI_STATUS
+MountDiskVolumes(
+    IN struct block_device  *Device,
+    IN CONST CHAR8          *Prefix
+) {
+    CONST part_table_t *Table = part_table_get(Device);
+    PROBE_LIST *List;
+
+    if (Table == NULL) {
+        return EFI_DEVICE_ERROR;
+    }
+    List = AllocateZeroPool(sizeof(*List));
+    if (List == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    for (UINT32 Index = 0; Index < Table->count; Index++) {
+        AddTarget(List, NULL, Device, Table->entries[Index].start, Table->entries[Index].sectors, NULL);
+    }
+    if (List->Count == 0) {
+        AddTarget(List, NULL, Device, 0, Device->sector_count, NULL);
+    }
+
+    int Recognised = fs_probe(List->Targets, List->Count, NULL);
+    if (Recognised < 0) {
+        FreePool(List);
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    UINT32 Volume = 0;
+    for (UINT32 Index = 0; Index < List->Count; Index++) {
+        fs_probe_target_t *Target = &List->Targets[Index];
+        CHAR8 Path[32];
+
+        if (Target->fstype[0] == '\0') {
+            continue;
+        }
+        if (Volume == 0) {
+            AsciiStrCpyS(Path, sizeof(Path), Prefix);
+        } else {
+            AsciiSPrint(Path, sizeof(Path), "%a%u", Prefix, Volume);
+        }
+        Volume++;
+        fs_probe_mount(Target, Path, NULL);
+    }
+
+    FreePool(List);
+    return Recognised > 0 ? EFI_SUCCESS : EFI_NOT_FOUND;
+}
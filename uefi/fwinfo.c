@@ -0,0 +1,652 @@
+/*
+ * fwinfo.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <Uefi.h>
+#include "compat.h"
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/BaseLib.h>
+#include <Protocol/GraphicsOutput.h>
+#include <Guid/Acpi.h>
+#include <Guid/SmBios.h>
+#include "../boot/Arch32/fwinfo.h"
+#include "uefi.h"
+
+// Spare descriptors allocated beyond the size GetMemoryMap asks for
+#define FWINFO_MAP_SLACK        16
+
+// ExitBootServices calls before a map that keeps changing is given up on
+#define FWINFO_EXIT_ATTEMPTS    8
+
+STATIC
+UINT32
+MemoryTypeOf(
+    IN UINT32 EfiType
+) {
+    switch (EfiType) {
+    case EfiLoaderCode:
+    case EfiLoaderData:
+    case EfiBootServicesCode:
+    case EfiBootServicesData:
+    case EfiConventionalMemory:
+        return FWINFO_MEM_AVAILABLE;
+    case EfiACPIReclaimMemory:
+        return FWINFO_MEM_ACPI_RECLAIMABLE;
+    case EfiACPIMemoryNVS:
+        return FWINFO_MEM_ACPI_NVS;
+    case EfiUnusableMemory:
+        return FWINFO_MEM_BAD;
+    default:
+        return FWINFO_MEM_RESERVED;
+    }
+}
+
+// One buffer serves every snapshot, the final one before ExitBootServices
+// included. It is sized with room for the map to grow by a few
+// descriptors (the allocation itself splits one), so later snapshots
+// usually fit without freeing and allocating again.
+STATIC EFI_MEMORY_DESCRIPTOR *mMap;
+STATIC UINTN mMapCapacity;              // Bytes allocated
+STATIC UINTN mMapSize;                  // Bytes of the last snapshot, 0 if it failed
+STATIC UINTN mMapDescSize;
+STATIC UINTN mMapKey;
+
+/**
+  Reads the memory map into the shared buffer. With MayGrow FALSE the
+  buffer is never reallocated, for use after a failed ExitBootServices,
+  when only GetMemoryMap and ExitBootServices may be called.
+**/
+STATIC
+EFI_STATUS
+TakeMemoryMapSnapshot(
+    IN BOOLEAN MayGrow
+) {
+    EFI_STATUS Status;
+    UINT32 DescVer = 0;
+
+    for (;;) {
+        mMapSize = mMapCapacity;
+        Status = gBS->GetMemoryMap(&mMapSize, mMap, &mMapKey, &mMapDescSize, &DescVer);
+        if (Status != EFI_BUFFER_TOO_SMALL || !MayGrow) {
+            break;
+        }
+        if (mMap != NULL) {
+            FreePool(mMap);
+        }
+        mMapCapacity = mMapSize + FWINFO_MAP_SLACK * mMapDescSize;
+        mMap = AllocatePool(mMapCapacity);
+        if (mMap == NULL) {
+            mMapCapacity = 0;
+            Status = EFI_OUT_OF_RESOURCES;
+            break;
+        }
+    }
+    if (EFI_ERROR(Status)) {
+        mMapSize = 0;
+    }
+    return Status;
+}
+
+/**
+  Converts the last snapshot in one pass: adjacent descriptors of one
+  type merge into the entry being built, which is stored through Put
+  again as it grows, so the target table is the only copy.
+**/
+STATIC
+UINT32
+ConvertMemoryMap(
+    IN VOID                 *Table,
+    IN UINT32               Max,
+    IN fwinfo_mmap_put_t    Put OPTIONAL
+) {
+    UINT32 Count = 0;
+    fwinfo_mmap_entry_t Last = { 0, 0, 0 };
+
+    // Firmware maps are sorted in practice, so merging runs in one pass;
+    // an out-of-order descriptor just starts a new entry
+    for (UINTN i = 0; mMapSize != 0 && i < mMapSize / mMapDescSize; i++) {
+        EFI_MEMORY_DESCRIPTOR *Desc = (EFI_MEMORY_DESCRIPTOR *)((UINT8 *)mMap + i * mMapDescSize);
+        UINT64 Length = EFI_PAGES_TO_SIZE((UINTN)Desc->NumberOfPages);
+        UINT32 Type = MemoryTypeOf(Desc->Type);
+        if (Length == 0) {
+            continue;
+        }
+        if (Count > 0 && Last.type == Type && Last.addr + Last.len == Desc->PhysicalStart) {
+            Last.len += Length;
+        } else {
+            Count++;
+            Last.addr = Desc->PhysicalStart;
+            Last.len = Length;
+            Last.type = Type;
+        }
+        if (Put != NULL && Count <= Max) {
+            Put(Table, Count - 1, &Last);
+        }
+    }
+    return Count;
+}
+
+uint32_t
+fwinfo_memory_map_to(
+    void                *table,
+    uint32_t            max,
+    fwinfo_mmap_put_t   put
+) {
+    if (EFI_ERROR(TakeMemoryMapSnapshot(TRUE))) {
+        return 0;
+    }
+    return ConvertMemoryMap(table, max, put);
+}
+
+uint32_t
+fwinfo_memory_map_again(
+    void                *table,
+    uint32_t            max,
+    fwinfo_mmap_put_t   put
+) {
+    return ConvertMemoryMap(table, max, put);
+}
+
+/**
+  Takes the final memory map and exits boot services. A stale map key is
+  retried with a fresh snapshot into the same buffer: nothing is
+  allocated or freed between attempts. Once out, the map is converted
+  into Table (preallocated by the caller for Max entries).
+
+  @param[in]  Table   Target table for Put, or NULL.
+  @param[in]  Max     Entries Table has room for.
+  @param[in]  Put     Stores one entry in the target format, or NULL.
+  @param[out] Count   Entries the map needed, which may exceed Max.
+
+  @retval EFI_SUCCESS   Boot services are gone.
+  @retval Other         The map could not be read or the exit failed;
+                        boot services are still available only if no
+                        exit was attempted.
+**/
+EFI_STATUS
+ExitBootServicesWithMemoryMap(
+    IN  VOID                *Table OPTIONAL,
+    IN  UINT32              Max,
+    IN  fwinfo_mmap_put_t   Put OPTIONAL,
+    OUT UINT32              *Count OPTIONAL
+) {
+    EFI_STATUS Status;
+
+    Status = TakeMemoryMapSnapshot(TRUE);
+    for (UINTN Attempt = 1; !EFI_ERROR(Status); Attempt++) {
+        Status = gBS->ExitBootServices(gImageHandle, mMapKey);
+        if (Status != EFI_INVALID_PARAMETER || Attempt == FWINFO_EXIT_ATTEMPTS) {
+            break;
+        }
+        // The map changed under us (a timer event allocated); read it again
+        Status = TakeMemoryMapSnapshot(FALSE);
+    }
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    UINT32 Total = ConvertMemoryMap(Table, Max, Put);
+    if (Count != NULL) {
+        *Count = Total;
+    }
+    return EFI_SUCCESS;
+}
+
+STATIC
+VOID
+MaskField(
+    IN  UINT32  Mask,
+    OUT UINT8   *Position,
+    OUT UINT8   *Size
+) {
+    *Position = 0;
+    *Size = 0;
+    if (Mask == 0) {
+        return;
+    }
+    while (!(Mask & 1)) {
+        Mask >>= 1;
+        (*Position)++;
+    }
+    while (Mask & 1) {
+        Mask >>= 1;
+        (*Size)++;
+    }
+}
+
+int
+fwinfo_framebuffer(
+    fwinfo_framebuffer_t *fb
+) {
+    EFI_GRAPHICS_OUTPUT_PROTOCOL *Gop = NULL;
+
+    if (EFI_ERROR(gBS->LocateProtocol(&gEfiGraphicsOutputProtocolGuid, NULL, (VOID **)&Gop)) || Gop == NULL) {
+        return -1;
+    }
+    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *Info = Gop->Mode->Info;
+    ZeroMem(fb, sizeof(*fb));
+    fb->addr = Gop->Mode->FrameBufferBase;
+    fb->width = Info->HorizontalResolution;
+    fb->height = Info->VerticalResolution;
+    fb->pitch = Info->PixelsPerScanLine * 4;
+    fb->bpp = 32;
+    switch (Info->PixelFormat) {
+    case PixelRedGreenBlueReserved8BitPerColor:
+        fb->red_pos = 0;
+        fb->green_pos = 8;
+        fb->blue_pos = 16;
+        fb->red_size = fb->green_size = fb->blue_size = 8;
+        return 0;
+    case PixelBlueGreenRedReserved8BitPerColor:
+        fb->red_pos = 16;
+        fb->green_pos = 8;
+        fb->blue_pos = 0;
+        fb->red_size = fb->green_size = fb->blue_size = 8;
+        return 0;
+    case PixelBitMask:
+        MaskField(Info->PixelInformation.RedMask, &fb->red_pos, &fb->red_size);
+        MaskField(Info->PixelInformation.GreenMask, &fb->green_pos, &fb->green_size);
+        MaskField(Info->PixelInformation.BlueMask, &fb->blue_pos, &fb->blue_size);
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+STATIC
+VOID *
+FindConfigTable(
+    IN EFI_GUID *Guid
+) {
+    for (UINTN i = 0; gST != NULL && i < gST->NumberOfTableEntries; i++) {
+        if (CompareGuid(&gST->ConfigurationTable[i].VendorGuid, Guid)) {
+            return gST->ConfigurationTable[i].VendorTable;
+        }
+    }
+    return NULL;
+}
+
+// The ACPI and SMBIOS tables, located on first use and indexed so that a
+// lookup by signature or structure type costs a search of the index, not
+// a walk of the tables. On a large server SMBIOS alone runs to thousands
+// of structures, and the menu, the boot parameters and each loader ask.
+typedef struct {
+    UINT32          Signature;
+    CONST UINT8     *Table;
+} ACPI_INDEX_ENTRY;
+
+STATIC BOOLEAN mTablesIndexed;
+STATIC CONST VOID *mFallbackRsdp;           // Entry points from coreboot's own tables
+STATIC CONST VOID *mFallbackSmbiosEntry;
+
+STATIC CONST UINT8 *mRsdp;
+STATIC UINT32 mRsdpSize;
+STATIC BOOLEAN mRsdpV2;
+STATIC ACPI_INDEX_ENTRY *mAcpiIndex;        // Sorted by signature, table order kept within one
+STATIC UINTN mAcpiCount;
+
+STATIC CONST UINT8 *mSmbiosEntry;           // _SM3_ or _SM_ entry point
+STATIC CONST UINT8 *mSmbios;                // Structure table
+STATIC UINT32 mSmbiosSize;
+STATIC UINT8 mSmbiosMajor;
+STATIC UINT8 mSmbiosMinor;
+STATIC CONST UINT8 **mSmbiosIndex;          // Grouped by type, table order kept within one
+STATIC UINT32 mSmbiosFirst[FWINFO_SMBIOS_TYPES + 1]; // mSmbiosIndex slice of each type
+
+// An RSDP of either revision, with the length it claims
+STATIC
+BOOLEAN
+CheckRsdp(
+    IN CONST UINT8 *Rsdp
+) {
+    if (Rsdp == NULL || CompareMem(Rsdp, "RSD PTR ", 8) != 0) {
+        return FALSE;
+    }
+    mRsdp = Rsdp;
+    mRsdpV2 = Rsdp[15] >= 2;
+    mRsdpSize = 20;
+    if (mRsdpV2) {
+        UINT32 Length;
+        CopyMem(&Length, Rsdp + 20, sizeof(Length));
+        mRsdpSize = Length >= 36 ? Length : 36;
+    }
+    return TRUE;
+}
+
+// An SMBIOS 3 or 2.x entry point and the structure table it describes
+STATIC
+BOOLEAN
+CheckSmbiosEntry(
+    IN CONST UINT8 *Eps
+) {
+    if (Eps != NULL && CompareMem(Eps, "_SM3_", 5) == 0) {
+        UINT32 Length;
+        UINT64 Address;
+        CopyMem(&Length, Eps + 0x0C, sizeof(Length));
+        CopyMem(&Address, Eps + 0x10, sizeof(Address));
+        mSmbiosMajor = Eps[7];
+        mSmbiosMinor = Eps[8];
+        mSmbiosSize = Length;
+        mSmbios = (CONST UINT8 *)(UINTN)Address;
+        mSmbiosEntry = Eps;
+        return TRUE;
+    }
+    if (Eps != NULL && CompareMem(Eps, "_SM_", 4) == 0) {
+        UINT16 Length;
+        UINT32 Address;
+        CopyMem(&Length, Eps + 0x16, sizeof(Length));
+        CopyMem(&Address, Eps + 0x18, sizeof(Address));
+        mSmbiosMajor = Eps[6];
+        mSmbiosMinor = Eps[7];
+        mSmbiosSize = Length;
+        mSmbios = (CONST UINT8 *)(UINTN)Address;
+        mSmbiosEntry = Eps;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+// Insert into the signature-sorted index, after tables of the same
+// signature so SSDTs keep their XSDT order; a table already listed (the
+// DSDT of both FADT fields) is skipped
+STATIC
+VOID
+AddAcpiTable(
+    IN UINTN        Capacity,
+    IN CONST UINT8  *Table
+) {
+    UINT32 Signature;
+    UINTN i;
+
+    if (Table == NULL || mAcpiCount == Capacity) {
+        return;
+    }
+    CopyMem(&Signature, Table, sizeof(Signature));
+    for (i = 0; i < mAcpiCount; i++) {
+        if (mAcpiIndex[i].Table == Table) {
+            return;
+        }
+    }
+    for (i = mAcpiCount; i > 0 && mAcpiIndex[i - 1].Signature > Signature; i--) {
+        mAcpiIndex[i] = mAcpiIndex[i - 1];
+    }
+    mAcpiIndex[i].Signature = Signature;
+    mAcpiIndex[i].Table = Table;
+    mAcpiCount++;
+}
+
+/**
+  Indexes the tables the RSDT or XSDT lists, plus the root itself and the
+  DSDT and FACS, which only the FADT points at.
+**/
+STATIC
+VOID
+IndexAcpiTables(VOID) {
+    CONST UINT8 *Root = NULL;
+    UINT32 RootLength = 0;
+    UINTN EntrySize = 4;
+    UINTN Entries;
+
+    if (mRsdpV2) {
+        UINT64 Xsdt;
+        CopyMem(&Xsdt, mRsdp + 24, sizeof(Xsdt));
+        Root = (CONST UINT8 *)(UINTN)Xsdt;
+        EntrySize = 8;
+    }
+    if (Root == NULL) {
+        UINT32 Rsdt;
+        CopyMem(&Rsdt, mRsdp + 16, sizeof(Rsdt));
+        Root = (CONST UINT8 *)(UINTN)Rsdt;
+        EntrySize = 4;
+    }
+    if (Root == NULL) {
+        return;
+    }
+    CopyMem(&RootLength, Root + 4, sizeof(RootLength));
+    Entries = RootLength >= 36 ? (RootLength - 36) / EntrySize : 0;
+
+    // Root, its entries, then DSDT and FACS
+    mAcpiIndex = AllocatePool((Entries + 3) * sizeof(ACPI_INDEX_ENTRY));
+    if (mAcpiIndex == NULL) {
+        return;
+    }
+    AddAcpiTable(Entries + 3, Root);
+    for (UINTN i = 0; i < Entries; i++) {
+        UINT64 Address = 0;
+        CopyMem(&Address, Root + 36 + i * EntrySize, EntrySize);
+        AddAcpiTable(Entries + 3, (CONST UINT8 *)(UINTN)Address);
+    }
+
+    CONST UINT8 *Fadt = fwinfo_acpi_table("FACP", 0);
+    if (Fadt != NULL) {
+        UINT32 Length;
+        UINT32 Address32;
+        UINT64 Address64 = 0;
+        CopyMem(&Length, Fadt + 4, sizeof(Length));
+        CopyMem(&Address32, Fadt + 36, sizeof(Address32));        // FIRMWARE_CTRL
+        if (Length >= 140) {
+            CopyMem(&Address64, Fadt + 132, sizeof(Address64));   // X_FIRMWARE_CTRL
+        }
+        AddAcpiTable(Entries + 3, (CONST UINT8 *)(UINTN)(Address64 != 0 ? Address64 : Address32));
+        Address64 = 0;
+        CopyMem(&Address32, Fadt + 40, sizeof(Address32));        // DSDT
+        if (Length >= 148) {
+            CopyMem(&Address64, Fadt + 140, sizeof(Address64));   // X_DSDT
+        }
+        AddAcpiTable(Entries + 3, (CONST UINT8 *)(UINTN)(Address64 != 0 ? Address64 : Address32));
+    }
+}
+
+// Size of the structure at Offset, strings and double-NUL terminator
+// included; 0 if it runs past the table
+STATIC
+UINT32
+SmbiosStructureSize(
+    IN UINT32 Offset
+) {
+    UINT32 End;
+
+    if (Offset + 4 > mSmbiosSize || mSmbios[Offset + 1] < 4) {
+        return 0;
+    }
+    End = Offset + mSmbios[Offset + 1];
+    while (End + 1 < mSmbiosSize && (mSmbios[End] != 0 || mSmbios[End + 1] != 0)) {
+        End++;
+    }
+    return End + 1 < mSmbiosSize ? End + 2 - Offset : 0;
+}
+
+/**
+  Indexes the SMBIOS structures by type in two passes over the table: the
+  first counts each type, the second files every structure in its type's
+  slice, so a type's structures are found without a walk.
+**/
+STATIC
+VOID
+IndexSmbiosStructures(VOID) {
+    UINT32 Count[FWINFO_SMBIOS_TYPES];
+    UINT32 Offset;
+    UINT32 Size;
+    UINT32 Total = 0;
+
+    ZeroMem(Count, sizeof(Count));
+    for (Offset = 0; (Size = SmbiosStructureSize(Offset)) != 0; Offset += Size) {
+        Count[mSmbios[Offset]]++;
+        Total++;
+        if (mSmbios[Offset] == 127) {
+            break;                      // End-of-table
+        }
+    }
+    mSmbiosIndex = AllocatePool(MAX(Total, 1) * sizeof(*mSmbiosIndex));
+    if (mSmbiosIndex == NULL) {
+        return;
+    }
+    for (UINTN Type = 0; Type < FWINFO_SMBIOS_TYPES; Type++) {
+        mSmbiosFirst[Type + 1] = mSmbiosFirst[Type] + Count[Type];
+        Count[Type] = mSmbiosFirst[Type];       // Next free slot of the type
+    }
+    for (Offset = 0; (Size = SmbiosStructureSize(Offset)) != 0; Offset += Size) {
+        mSmbiosIndex[Count[mSmbios[Offset]]++] = mSmbios + Offset;
+        if (mSmbios[Offset] == 127) {
+            break;
+        }
+    }
+}
+
+// Locate and index both on first use
+STATIC
+VOID
+IndexPlatformTables(VOID) {
+    if (mTablesIndexed) {
+        return;
+    }
+    mTablesIndexed = TRUE;
+
+    if (CheckRsdp(FindConfigTable(&gEfiAcpi20TableGuid)) ||
+        CheckRsdp(FindConfigTable(&gEfiAcpi10TableGuid)) ||
+        CheckRsdp(mFallbackRsdp)) {
+        IndexAcpiTables();
+    }
+    if (CheckSmbiosEntry(FindConfigTable(&gEfiSmbios3TableGuid)) ||
+        CheckSmbiosEntry(FindConfigTable(&gEfiSmbiosTableGuid)) ||
+        CheckSmbiosEntry(mFallbackSmbiosEntry)) {
+        if (mSmbios != NULL) {
+            IndexSmbiosStructures();
+        }
+    }
+}
+
+void
+fwinfo_tables_fallback(
+    const void  *rsdp,
+    const void  *smbios_entry
+) {
+    mFallbackRsdp = rsdp;
+    mFallbackSmbiosEntry = smbios_entry;
+    fwinfo_tables_changed();
+}
+
+void
+fwinfo_tables_changed(void) {
+    if (mAcpiIndex != NULL) {
+        FreePool(mAcpiIndex);
+    }
+    if (mSmbiosIndex != NULL) {
+        FreePool((VOID *)mSmbiosIndex);
+    }
+    mAcpiIndex = NULL;
+    mAcpiCount = 0;
+    mSmbiosIndex = NULL;
+    ZeroMem(mSmbiosFirst, sizeof(mSmbiosFirst));
+    mRsdp = NULL;
+    mSmbios = NULL;
+    mSmbiosEntry = NULL;
+    mTablesIndexed = FALSE;
+}
+
+const void *
+fwinfo_acpi_rsdp(
+    uint32_t    *size,
+    int         *is_v2
+) {
+    IndexPlatformTables();
+    if (mRsdp == NULL) {
+        return NULL;
+    }
+    *size = mRsdpSize;
+    *is_v2 = mRsdpV2;
+    return mRsdp;
+}
+
+const void *
+fwinfo_acpi_table(
+    const char  *signature,
+    uint32_t    index
+) {
+    UINT32 Signature;
+    UINTN Low = 0;
+    UINTN High;
+
+    IndexPlatformTables();
+    CopyMem(&Signature, signature, sizeof(Signature));
+    High = mAcpiCount;
+    while (Low < High) {
+        UINTN Mid = (Low + High) / 2;
+        if (mAcpiIndex[Mid].Signature < Signature) {
+            Low = Mid + 1;
+        } else {
+            High = Mid;
+        }
+    }
+    if (Low + index < mAcpiCount && mAcpiIndex[Low + index].Signature == Signature) {
+        return mAcpiIndex[Low + index].Table;
+    }
+    return NULL;
+}
+
+const void *
+fwinfo_smbios(
+    uint32_t    *size,
+    uint8_t     *major,
+    uint8_t     *minor
+) {
+    IndexPlatformTables();
+    if (mSmbios == NULL) {
+        return NULL;
+    }
+    *major = mSmbiosMajor;
+    *minor = mSmbiosMinor;
+    *size = mSmbiosSize;
+    return mSmbios;
+}
+
+const void *
+fwinfo_smbios_entry(void) {
+    IndexPlatformTables();
+    return mSmbiosEntry;
+}
+
+uint32_t
+fwinfo_smbios_count(
+    uint8_t type
+) {
+    IndexPlatformTables();
+    return mSmbiosFirst[type + 1] - mSmbiosFirst[type];
+}
+
+const void *
+fwinfo_smbios_structure(
+    uint8_t     type,
+    uint32_t    index
+) {
+    IndexPlatformTables();
+    if (index >= mSmbiosFirst[type + 1] - mSmbiosFirst[type]) {
+        return NULL;
+    }
+    return mSmbiosIndex[mSmbiosFirst[type] + index];
+}
+
+const char *
+fwinfo_smbios_string(
+    const void  *structure,
+    uint8_t     number
+) {
+    CONST CHAR8 *String;
+
+    if (structure == NULL || number == 0) {
+        return "";
+    }
+    String = (CONST CHAR8 *)structure + ((CONST UINT8 *)structure)[1];
+    while (--number != 0) {
+        if (*String == '\0') {
+            return "";              // Past the last string
+        }
+        String += AsciiStrLen(String) + 1;
+    }
+    return String;
+}
@@ -5,44 +5,360 @@
  * See the root of the repository for license details.
  */
 
+#include "graphics.h"
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiRuntimeServicesTableLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DevicePathLib.h>
+#include <Protocol/EdidActive.h>
+#include <Protocol/EdidDiscovered.h>
+#include "../security/crypto.h"
+
+// Spans shorter than this are filled with plain stores; streaming only
+// pays off once a row spans several cache lines
+#define GRAPHICS_STREAM_MIN_PIXELS 64
+
+// Fills larger than this bypass the cache when they target RAM: a full
+// 4K back buffer is ~32 MiB and would only evict everything else
+#define GRAPHICS_STREAM_MIN_BYTES (1024 * 1024)
+
+// Mode picked on an earlier boot. QueryMode over every mode and SetMode
+// are slow in some option ROMs, and SetMode may blank and retrain the
+// display, so both are skipped while the adapter and monitor stay the same.
+#define GOP_MODE_VARIABLE   L"BloodHornGopMode"
+#define GOP_MODE_VERSION    1
+
+typedef struct {
+    UINT32  Version;
+    UINT32  Mode;
+    UINT32  Width;
+    UINT32  Height;
+    UINT8   Key[CRYPTO_SHA256_DIGEST_LENGTH];   // SHA-256 of device path and EDID
+} GOP_MODE_RECORD;
+
+extern EFI_GUID gBloodHornVariableGuid;
+
+EFI_GRAPHICS_OUTPUT_PROTOCOL *GraphicsOutput = NULL;
+
+// Frames are composed in ordinary cached RAM and only the regions that
+// changed are pushed to the (uncached or write-combined) framebuffer
+static UINT32 *BackBuffer = NULL;
+static UINT32 BackBufferWidth = 0;
+static UINT32 BackBufferHeight = 0;
+
+// Half-open pixel rectangle [X0, X1) x [Y0, Y1)
+typedef struct {
+    UINT32 X0, Y0, X1, Y1;
+} DIRTY_RECT;
+
+static DIRTY_RECT DirtyRects[GRAPHICS_MAX_DIRTY_RECTS];
+static UINTN DirtyRectCount = 0;
+
+// The theme background scaled to the current mode and converted to the
+// format it is drawn in, so redrawing it is one copy
+typedef struct {
+    CONST GRAPHICS_IMAGE    *Source;
+    CONST UINT32            *SourcePixels;  // Catches the image being replaced in place
+    UINT32                  Width;          // Mode it was prepared for
+    UINT32                  Height;
+    UINT32                  Stride;         // Pixels per row
+    BOOLEAN                 Native;         // Framebuffer format rather than 0x00RRGGBB
+    UINT32                  *Pixels;
+} BACKGROUND_CACHE;
+
+static BACKGROUND_CACHE Background = { NULL, NULL, 0, 0, 0, FALSE, NULL };
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+
+#define AVX_TARGET __attribute__((target("avx")))
+
+static INTN FillUseAvx = -1;
+
+// Plain fill: rep stosd, which modern cores turn into wide stores anyway
+static VOID
+FillPlain32(UINT32 *Dst, UINTN Count, UINT32 Color) {
+    __asm__ volatile ("cld; rep stosl"
+                      : "+D" (Dst), "+c" (Count)
+                      : "a" (Color)
+                      : "memory", "cc");
+}
+
+static AVX_TARGET VOID
+FillStream256(UINT32 *Dst, UINTN Blocks, UINT32 Color) {
+    __m256i Value = _mm256_set1_epi32((INT32)Color);
+    for (UINTN i = 0; i < Blocks; i++) {
+        _mm256_stream_si256((__m256i *)Dst + i, Value);
+    }
+}
+
+#if defined(__SSE2__)
+static VOID
+FillStream128(UINT32 *Dst, UINTN Blocks, UINT32 Color) {
+    __m128i Value = _mm_set1_epi32((INT32)Color);
+    for (UINTN i = 0; i < Blocks; i++) {
+        _mm_stream_si128((__m128i *)Dst + i, Value);
+    }
+}
+#endif
+
+// Non-temporal fill: plain stores up to a vector boundary, 256-bit
+// streaming stores when AVX state is enabled (128-bit SSE2 otherwise),
+// plain stores for the tail
+static VOID
+FillStream32(UINT32 *Dst, UINTN Count, UINT32 Color) {
+    if (FillUseAvx < 0) {
+        // AVX2 is only reported when the OS (firmware) has enabled YMM state
+        FillUseAvx = (crypto_detect_hardware_support() & CRYPTO_HW_INTEL_AVX2) != 0;
+    }
+    UINTN Align = FillUseAvx ? 32 : 16;
+    UINTN Head = (Align - ((UINTN)Dst & (Align - 1))) / sizeof(UINT32) % (Align / sizeof(UINT32));
+    if (((UINTN)Dst & 3) != 0 || Head > Count) {
+        FillPlain32(Dst, Count, Color);
+        return;
+    }
+    FillPlain32(Dst, Head, Color);
+    Dst += Head;
+    Count -= Head;
+
+    UINTN PerBlock = Align / sizeof(UINT32);
+    UINTN Blocks = Count / PerBlock;
+    if (FillUseAvx) {
+        FillStream256(Dst, Blocks, Color);
+#if defined(__SSE2__)
+    } else {
+        FillStream128(Dst, Blocks, Color);
+#else
+    } else {
+        Blocks = 0;
+#endif
+    }
+    Dst += Blocks * PerBlock;
+    FillPlain32(Dst, Count - Blocks * PerBlock, Color);
+}
+
+// Streaming stores are weakly ordered; make them visible before anyone
+// (the Blt, or the display engine) reads the pixels
+static VOID
+FillFence(VOID) {
+    __asm__ volatile ("sfence" ::: "memory");
+}
+#elif defined(__aarch64__) && defined(__GNUC__)
+#include <arm_neon.h>
+
+static VOID
+FillPlain32(UINT32 *Dst, UINTN Count, UINT32 Color) {
+    SetMem32(Dst, Count * sizeof(UINT32), Color);
+}
+
+// Non-temporal fill with STNP: 32 bytes per store pair from one NEON
+// register, plain stores outside the 16-byte aligned middle
+static VOID
+FillStream32(UINT32 *Dst, UINTN Count, UINT32 Color) {
+    uint32x4_t Value = vdupq_n_u32(Color);
+    UINTN Head = ((16 - ((UINTN)Dst & 15)) & 15) / sizeof(UINT32);
+    if (((UINTN)Dst & 3) != 0 || Head > Count) {
+        FillPlain32(Dst, Count, Color);
+        return;
+    }
+    FillPlain32(Dst, Head, Color);
+    Dst += Head;
+    Count -= Head;
+
+    UINTN Blocks = Count / 8;
+    for (UINTN i = 0; i < Blocks; i++) {
+        __asm__ volatile ("stnp %q1, %q1, [%0]" :: "r" (Dst + i * 8), "w" (Value) : "memory");
+    }
+    Dst += Blocks * 8;
+    FillPlain32(Dst, Count - Blocks * 8, Color);
+}
+
+static VOID
+FillFence(VOID) {
+    __asm__ volatile ("dmb ishst" ::: "memory");
+}
+#else
+static VOID
+FillPlain32(UINT32 *Dst, UINTN Count, UINT32 Color) {
+    SetMem32(Dst, Count * sizeof(UINT32), Color);
+}
+
+static VOID
+FillStream32(UINT32 *Dst, UINTN Count, UINT32 Color) {
+    FillPlain32(Dst, Count, Color);
+}
+
+static VOID
+FillFence(VOID) {
+}
+#endif
+
+// Fills Height rows of Width pixels starting at Dst, Stride pixels apart.
+// Rows that are contiguous (a fill spanning the whole buffer width) are
+// filled as one span. Stream selects non-temporal stores for targets that
+// are not worth caching.
+static VOID
+FillRect32(UINT32 *Dst, UINTN Stride, UINTN Width, UINTN Height, UINT32 Color, BOOLEAN Stream) {
+    if (Width == Stride) {
+        Width *= Height;
+        Height = 1;
+    }
+    if (!Stream || Width < GRAPHICS_STREAM_MIN_PIXELS) {
+        for (UINTN y = 0; y < Height; y++, Dst += Stride) {
+            FillPlain32(Dst, Width, Color);
+        }
+        return;
+    }
+    for (UINTN y = 0; y < Height; y++, Dst += Stride) {
+        FillStream32(Dst, Width, Color);
+    }
+    FillFence();
+}
+
+// (Re)allocate the back buffer for the current mode; on failure the
+// primitives keep drawing straight into the framebuffer
+static VOID
+AllocateBackBuffer(VOID) {
+    UINT32 Width = GraphicsOutput->Mode->Info->HorizontalResolution;
+    UINT32 Height = GraphicsOutput->Mode->Info->VerticalResolution;
+
+    if (BackBuffer && BackBufferWidth == Width && BackBufferHeight == Height) {
+        return;
+    }
+    ReleaseBackBuffer();
+    BackBuffer = AllocatePool((UINTN)Width * Height * sizeof(UINT32));
+    if (BackBuffer == NULL) {
+        return;
+    }
+    BackBufferWidth = Width;
+    BackBufferHeight = Height;
+}
+
+/**
+  Key for the mode cache: the adapter's device path and the monitor's
+  EDID (the active one, else what was discovered). FALSE when the handle
+  has neither, e.g. a console splitter, so nothing tells displays apart.
+**/
+STATIC
+BOOLEAN
+GopModeKey(
+    IN  EFI_HANDLE  Handle,
+    OUT UINT8       *Key
+) {
+    EFI_DEVICE_PATH_PROTOCOL *Path = DevicePathFromHandle(Handle);
+    EFI_EDID_ACTIVE_PROTOCOL *Edid = NULL;
+    crypto_sha256_ctx_t Ctx;
+
+    // Both EDID protocols have the same layout
+    if (EFI_ERROR(gBS->HandleProtocol(Handle, &gEfiEdidActiveProtocolGuid, (VOID **)&Edid)) &&
+        EFI_ERROR(gBS->HandleProtocol(Handle, &gEfiEdidDiscoveredProtocolGuid, (VOID **)&Edid))) {
+        Edid = NULL;
+    }
+    if (Edid != NULL && (Edid->SizeOfEdid == 0 || Edid->Edid == NULL)) {
+        Edid = NULL;
+    }
+    if (Path == NULL && Edid == NULL) {
+        return FALSE;
+    }
+
+    crypto_sha256_init(&Ctx);
+    if (Path != NULL) {
+        crypto_sha256_update(&Ctx, (CONST UINT8 *)Path, (UINT32)GetDevicePathSize(Path));
+    }
+    if (Edid != NULL) {
+        crypto_sha256_update(&Ctx, Edid->Edid, Edid->SizeOfEdid);
+    }
+    crypto_sha256_final(&Ctx, Key);
+    return TRUE;
+}
+
+// The mode chosen for this adapter and monitor on an earlier boot
+STATIC
+BOOLEAN
+LoadGopMode(
+    IN OUT GOP_MODE_RECORD *Record
+) {
+    GOP_MODE_RECORD Stored;
+    UINTN Size = sizeof(Stored);
+    EFI_STATUS Status = gRT->GetVariable(GOP_MODE_VARIABLE, &gBloodHornVariableGuid, NULL, &Size, &Stored);
+
+    if (EFI_ERROR(Status) || Size != sizeof(Stored) || Stored.Version != Record->Version ||
+        CompareMem(Stored.Key, Record->Key, sizeof(Stored.Key)) != 0) {
+        return FALSE;
+    }
+    CopyMem(Record, &Stored, sizeof(Stored));
+    return TRUE;
+}
+
+/**
+  Switch to a cached mode. Mode numbers belong to the driver, so unless it
+  is the current mode it is queried once to check it still has the saved
+  resolution. Nothing is called when the display already runs it.
+**/
+STATIC
+BOOLEAN
+UseGopMode(
+    IN CONST GOP_MODE_RECORD *Record
+) {
+    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *Info = NULL;
+    UINTN SizeOfInfo = 0;
+    BOOLEAN Match;
+
+    if (Record->Mode >= GraphicsOutput->Mode->MaxMode) {
+        return FALSE;
+    }
+    if (Record->Mode == GraphicsOutput->Mode->Mode) {
+        Info = GraphicsOutput->Mode->Info;
+        return Info->HorizontalResolution == Record->Width && Info->VerticalResolution == Record->Height;
+    }
+    if (EFI_ERROR(GraphicsOutput->QueryMode(GraphicsOutput, Record->Mode, &SizeOfInfo, &Info))) {
+        return FALSE;
+    }
+    Match = Info->HorizontalResolution == Record->Width && Info->VerticalResolution == Record->Height;
+    FreePool(Info);
+    return Match && !EFI_ERROR(GraphicsOutput->SetMode(GraphicsOutput, Record->Mode));
+}
+
 EFI_STATUS
 InitializeGraphics() {
     EFI_STATUS Status;
-    
-    // Locate the graphics output protocol
-    Status = gBS->LocateProtocol(
-        &gEfiGraphicsOutputProtocolGuid,
-        NULL,
-        (VOID **)&GraphicsOutput
-    );
-    
+    EFI_HANDLE *Handles = NULL;
+    UINTN HandleCount = 0;
+    EFI_HANDLE Handle;
+    GOP_MODE_RECORD Record;
+    BOOLEAN Keyed;
+
+    // The first adapter, as LocateProtocol would pick; its handle keys the
+    // mode cache
+    Status = gBS->LocateHandleBuffer(ByProtocol, &gEfiGraphicsOutputProtocolGuid, NULL, &HandleCount, &Handles);
     if (EFI_ERROR(Status)) {
         return Status;
     }
-    
-    // Query current video mode
-    UINT32 CurrentMode = GraphicsOutput->Mode->Mode;
-    UINTN SizeOfInfo = 0;
-    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *Info = NULL;
-    
-    // Get current mode information
-    Status = GraphicsOutput->QueryMode(
-        GraphicsOutput,
-        CurrentMode,
-        &SizeOfInfo,
-        &Info
-    );
-    
+    Handle = Handles[0];
+    FreePool(Handles);
+
+    Status = gBS->HandleProtocol(Handle, &gEfiGraphicsOutputProtocolGuid, (VOID **)&GraphicsOutput);
     if (EFI_ERROR(Status)) {
         return Status;
     }
-    
-    // Set a suitable video mode (preferably 1024x768 if available)
-    UINT32 BestMode = 0;
+
+    ZeroMem(&Record, sizeof(Record));
+    Record.Version = GOP_MODE_VERSION;
+    Keyed = GopModeKey(Handle, Record.Key);
+    if (Keyed && LoadGopMode(&Record) && UseGopMode(&Record)) {
+        AllocateBackBuffer();
+        return EFI_SUCCESS;
+    }
+
+    UINT32 CurrentMode = GraphicsOutput->Mode->Mode;
+    UINTN SizeOfInfo = 0;
+    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *Info = NULL;
+    UINT32 BestMode = CurrentMode;
     UINT32 BestWidth = 0;
     UINT32 BestHeight = 0;
-    
-    // Find the best available mode
+
+    // Take the highest resolution available
     for (UINT32 i = 0; i < GraphicsOutput->Mode->MaxMode; i++) {
         Status = GraphicsOutput->QueryMode(
             GraphicsOutput,
@@ -50,19 +366,19 @@ InitializeGraphics() {
             &SizeOfInfo,
             &Info
         );
-        
+
         if (EFI_ERROR(Status)) {
             continue;
         }
-        
-        // Prefer 1024x768, but take the highest resolution available
+
         if (Info->HorizontalResolution * Info->VerticalResolution > BestWidth * BestHeight) {
             BestWidth = Info->HorizontalResolution;
             BestHeight = Info->VerticalResolution;
             BestMode = i;
         }
+        FreePool(Info);
     }
-    
+
     // Set the best mode
     if (BestMode != CurrentMode) {
         Status = GraphicsOutput->SetMode(GraphicsOutput, BestMode);
@@ -70,10 +386,150 @@ InitializeGraphics() {
             return Status;
         }
     }
-    
+
+    if (Keyed && BestWidth != 0) {
+        Record.Version = GOP_MODE_VERSION;
+        Record.Mode = BestMode;
+        Record.Width = BestWidth;
+        Record.Height = BestHeight;
+        gRT->SetVariable(GOP_MODE_VARIABLE, &gBloodHornVariableGuid,
+                         EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS,
+                         sizeof(Record), &Record);
+    }
+
+    AllocateBackBuffer();
     return EFI_SUCCESS;
 }
 
+/**
+  Frees the back buffer and the prepared background, e.g. before handing
+  the screen to an OS. Any regions not yet flushed are dropped.
+**/
+VOID
+ReleaseBackBuffer(VOID) {
+    if (BackBuffer) {
+        FreePool(BackBuffer);
+        BackBuffer = NULL;
+    }
+    if (Background.Pixels) {
+        FreePool(Background.Pixels);
+    }
+    ZeroMem(&Background, sizeof(Background));
+    BackBufferWidth = 0;
+    BackBufferHeight = 0;
+    DirtyRectCount = 0;
+}
+
+/**
+  Returns the back buffer the drawing primitives compose into, or NULL if
+  there is none and they draw to the framebuffer directly.
+  
+  @param[out] Width     Width of the buffer in pixels (optional).
+  @param[out] Height    Height of the buffer in pixels (optional).
+**/
+UINT32 *
+GetBackBuffer(
+    OUT UINT32 *Width OPTIONAL,
+    OUT UINT32 *Height OPTIONAL
+) {
+    if (Width) {
+        *Width = BackBufferWidth;
+    }
+    if (Height) {
+        *Height = BackBufferHeight;
+    }
+    return BackBuffer;
+}
+
+/**
+  Records that a region of the back buffer changed and has to reach the
+  screen on the next FlushGraphics. The region is clipped to the screen;
+  overlapping or touching regions are merged, and once the list is full
+  new regions are folded into the last one.
+**/
+VOID
+MarkDirtyRect(
+    IN UINT32 X,
+    IN UINT32 Y,
+    IN UINT32 Width,
+    IN UINT32 Height
+) {
+    DIRTY_RECT Rect;
+    UINTN i;
+
+    if (BackBuffer == NULL || X >= BackBufferWidth || Y >= BackBufferHeight || Width == 0 || Height == 0) {
+        return;
+    }
+    Rect.X0 = X;
+    Rect.Y0 = Y;
+    Rect.X1 = (Width > BackBufferWidth - X) ? BackBufferWidth : X + Width;
+    Rect.Y1 = (Height > BackBufferHeight - Y) ? BackBufferHeight : Y + Height;
+
+    // Absorb every region the new one overlaps or touches; the union can
+    // reach regions the original did not, so rescan until nothing merges
+    i = 0;
+    while (i < DirtyRectCount) {
+        DIRTY_RECT *Other = &DirtyRects[i];
+        if (Other->X0 <= Rect.X1 && Rect.X0 <= Other->X1 &&
+            Other->Y0 <= Rect.Y1 && Rect.Y0 <= Other->Y1) {
+            Rect.X0 = MIN(Rect.X0, Other->X0);
+            Rect.Y0 = MIN(Rect.Y0, Other->Y0);
+            Rect.X1 = MAX(Rect.X1, Other->X1);
+            Rect.Y1 = MAX(Rect.Y1, Other->Y1);
+            DirtyRects[i] = DirtyRects[--DirtyRectCount];
+            i = 0;
+            continue;
+        }
+        i++;
+    }
+
+    if (DirtyRectCount == GRAPHICS_MAX_DIRTY_RECTS) {
+        DIRTY_RECT *Last = &DirtyRects[DirtyRectCount - 1];
+        Last->X0 = MIN(Last->X0, Rect.X0);
+        Last->Y0 = MIN(Last->Y0, Rect.Y0);
+        Last->X1 = MAX(Last->X1, Rect.X1);
+        Last->Y1 = MAX(Last->Y1, Rect.Y1);
+        return;
+    }
+    DirtyRects[DirtyRectCount++] = Rect;
+}
+
+/**
+  Copies every dirty region of the back buffer to the screen with one
+  GraphicsOutput->Blt each, then clears the dirty list.
+  
+  @retval EFI_SUCCESS   All regions were copied, or there is no back buffer.
+  @retval Other         The first Blt error; the remaining regions are still copied.
+**/
+EFI_STATUS
+FlushGraphics(VOID) {
+    EFI_STATUS Result = EFI_SUCCESS;
+
+    if (GraphicsOutput == NULL || BackBuffer == NULL) {
+        DirtyRectCount = 0;
+        return EFI_SUCCESS;
+    }
+
+    for (UINTN i = 0; i < DirtyRectCount; i++) {
+        DIRTY_RECT *Rect = &DirtyRects[i];
+        // The back buffer is 0x00RRGGBB, i.e. EFI_GRAPHICS_OUTPUT_BLT_PIXEL
+        EFI_STATUS Status = GraphicsOutput->Blt(
+            GraphicsOutput,
+            (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *)BackBuffer,
+            EfiBltBufferToVideo,
+            Rect->X0, Rect->Y0,
+            Rect->X0, Rect->Y0,
+            Rect->X1 - Rect->X0, Rect->Y1 - Rect->Y0,
+            (UINTN)BackBufferWidth * sizeof(UINT32)
+        );
+        if (EFI_ERROR(Status) && !EFI_ERROR(Result)) {
+            Result = Status;
+        }
+    }
+    DirtyRectCount = 0;
+    return Result;
+}
+
 /**
   Draws a rectangle on the screen.
   
@@ -98,9 +554,10 @@ DrawRect(
         return EFI_NOT_READY;
     }
     
-    // Get the framebuffer information
-    UINT32 *Framebuffer = (UINT32 *)GraphicsOutput->Mode->FrameBufferBase;
-    UINT32 PixelsPerScanline = GraphicsOutput->Mode->Info->PixelsPerScanLine;
+    // Compose into the back buffer when there is one, otherwise straight
+    // into the framebuffer
+    UINT32 *Framebuffer = BackBuffer ? BackBuffer : (UINT32 *)GraphicsOutput->Mode->FrameBufferBase;
+    UINT32 PixelsPerScanline = BackBuffer ? BackBufferWidth : GraphicsOutput->Mode->Info->PixelsPerScanLine;
     
     // Ensure the rectangle is within bounds
     if (X >= GraphicsOutput->Mode->Info->HorizontalResolution ||
@@ -116,16 +573,297 @@ DrawRect(
         Height = GraphicsOutput->Mode->Info->VerticalResolution - Y;
     }
     
-    // Draw the rectangle
-    for (UINT32 y = Y; y < Y + Height; y++) {
-        for (UINT32 x = X; x < X + Width; x++) {
-            Framebuffer[y * PixelsPerScanline + x] = Color;
-        }
+    // Draw the rectangle. The framebuffer is uncached or write-combined,
+    // so it always gets streaming stores; the back buffer only for fills
+    // too large to be worth keeping in the cache.
+    FillRect32(
+        &Framebuffer[(UINTN)Y * PixelsPerScanline + X],
+        PixelsPerScanline,
+        Width,
+        Height,
+        Color,
+        BackBuffer == NULL || (UINTN)Width * Height * sizeof(UINT32) >= GRAPHICS_STREAM_MIN_BYTES
+    );
+    if (BackBuffer) {
+        MarkDirtyRect(X, Y, Width, Height);
+    }
+    
+    return EFI_SUCCESS;
+}
+
+/**
+  Draws a pre-decoded image, clipped to the screen.
+  
+  @param[in] Image      The image to draw.
+  @param[in] X          The X coordinate of its top-left corner.
+  @param[in] Y          The Y coordinate of its top-left corner.
+  
+  @retval EFI_SUCCESS   The image was drawn successfully.
+  @retval Other         An error occurred.
+**/
+EFI_STATUS
+DrawImage(
+    IN CONST GRAPHICS_IMAGE *Image,
+    IN UINT32 X,
+    IN UINT32 Y
+) {
+    if (GraphicsOutput == NULL) {
+        return EFI_NOT_READY;
+    }
+    if (Image == NULL || Image->Pixels == NULL) {
+        return EFI_INVALID_PARAMETER;
+    }
+    
+    UINT32 ScreenWidth = GraphicsOutput->Mode->Info->HorizontalResolution;
+    UINT32 ScreenHeight = GraphicsOutput->Mode->Info->VerticalResolution;
+    if (X >= ScreenWidth || Y >= ScreenHeight) {
+        return EFI_INVALID_PARAMETER;
+    }
+    UINT32 Width = MIN(Image->Width, ScreenWidth - X);
+    UINT32 Height = MIN(Image->Height, ScreenHeight - Y);
+    
+    // Without a back buffer the firmware can copy the rows for us
+    if (BackBuffer == NULL) {
+        return GraphicsOutput->Blt(
+            GraphicsOutput,
+            (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *)Image->Pixels,
+            EfiBltBufferToVideo,
+            0, 0,
+            X, Y,
+            Width, Height,
+            (UINTN)Image->Width * sizeof(UINT32)
+        );
     }
     
+    // Rows spanning the whole buffer are contiguous in both: one copy
+    if (X == 0 && Width == BackBufferWidth && Image->Width == BackBufferWidth) {
+        CopyMem(&BackBuffer[(UINTN)Y * BackBufferWidth], Image->Pixels, (UINTN)Width * Height * sizeof(UINT32));
+    } else {
+        for (UINT32 Row = 0; Row < Height; Row++) {
+            CopyMem(
+                &BackBuffer[(UINTN)(Y + Row) * BackBufferWidth + X],
+                &Image->Pixels[(UINTN)Row * Image->Width],
+                (UINTN)Width * sizeof(UINT32)
+            );
+        }
+    }
+    MarkDirtyRect(X, Y, Width, Height);
+    return EFI_SUCCESS;
+}
+
+// Scale Source to cover Width x Height (preserving its aspect ratio and
+// cropping the overflow evenly), bilinear, into 0x00RRGGBB rows Stride
+// pixels apart. Coordinates are 16.16 fixed point, with the per-column
+// taps computed once rather than per pixel.
+static EFI_STATUS
+ScaleImageCover(CONST GRAPHICS_IMAGE *Source, UINT32 *Dst, UINT32 Width, UINT32 Height, UINT32 Stride) {
+    UINT64 CropX = 0, CropY = 0;
+    UINT64 CropW = (UINT64)Source->Width << 16;
+    UINT64 CropH = (UINT64)Source->Height << 16;
+    UINT32 *Columns;
+
+    if ((UINT64)Source->Width * Height > (UINT64)Source->Height * Width) {
+        CropW = ((UINT64)Source->Height * Width << 16) / Height;
+        CropX = (((UINT64)Source->Width << 16) - CropW) / 2;
+    } else {
+        CropH = ((UINT64)Source->Width * Height << 16) / Width;
+        CropY = (((UINT64)Source->Height << 16) - CropH) / 2;
+    }
+    UINT64 StepX = CropW / Width;
+    UINT64 StepY = CropH / Height;
+
+    // Per column: left tap in the low 24 bits, right-tap weight (0..255) above
+    Columns = AllocatePool((UINTN)Width * sizeof(UINT32));
+    if (Columns == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    UINT64 MaxX = (UINT64)(Source->Width - 1) << 16;
+    for (UINT32 x = 0; x < Width; x++) {
+        INT64 U = (INT64)(CropX + StepX * x + StepX / 2) - 0x8000;
+        UINT64 Clamped = (U < 0) ? 0 : MIN((UINT64)U, MaxX);
+        Columns[x] = (UINT32)(Clamped >> 16) | ((UINT32)((Clamped >> 8) & 0xFF) << 24);
+    }
+
+    UINT64 MaxY = (UINT64)(Source->Height - 1) << 16;
+    for (UINT32 y = 0; y < Height; y++) {
+        INT64 V = (INT64)(CropY + StepY * y + StepY / 2) - 0x8000;
+        UINT64 Clamped = (V < 0) ? 0 : MIN((UINT64)V, MaxY);
+        UINT32 Y0 = (UINT32)(Clamped >> 16);
+        UINT32 Y1 = MIN(Y0 + 1, Source->Height - 1);
+        UINT32 Fy = (UINT32)(Clamped >> 8) & 0xFF;
+        CONST UINT32 *Top = &Source->Pixels[(UINTN)Y0 * Source->Width];
+        CONST UINT32 *Bottom = &Source->Pixels[(UINTN)Y1 * Source->Width];
+        UINT32 *Row = &Dst[(UINTN)y * Stride];
+
+        for (UINT32 x = 0; x < Width; x++) {
+            UINT32 X0 = Columns[x] & 0xFFFFFF;
+            UINT32 X1 = MIN(X0 + 1, Source->Width - 1);
+            UINT32 Fx = Columns[x] >> 24;
+            UINT32 Pixel = 0;
+            for (UINT32 Shift = 0; Shift < 24; Shift += 8) {
+                UINT32 A = (Top[X0] >> Shift) & 0xFF, B = (Top[X1] >> Shift) & 0xFF;
+                UINT32 C = (Bottom[X0] >> Shift) & 0xFF, D = (Bottom[X1] >> Shift) & 0xFF;
+                UINT32 Upper = A * (256 - Fx) + B * Fx;
+                UINT32 Lower = C * (256 - Fx) + D * Fx;
+                Pixel |= (((Upper * (256 - Fy) + Lower * Fy) + 0x8000) >> 16) << Shift;
+            }
+            Row[x] = Pixel;
+        }
+    }
+
+    FreePool(Columns);
     return EFI_SUCCESS;
 }
 
+// Position and width of a PixelBitMask channel
+static VOID
+ChannelMask(UINT32 Mask, UINT32 *Shift, UINT32 *Bits) {
+    *Shift = 0;
+    *Bits = 0;
+    if (Mask == 0) {
+        return;
+    }
+    while ((Mask & 1) == 0) {
+        Mask >>= 1;
+        (*Shift)++;
+    }
+    while (Mask & 1) {
+        Mask >>= 1;
+        (*Bits)++;
+    }
+}
+
+static UINT32
+PackChannel(UINT32 Value, UINT32 Shift, UINT32 Bits) {
+    if (Bits == 0) {
+        return 0;
+    }
+    Value = (Bits >= 8) ? Value << (Bits - 8) : Value >> (8 - Bits);
+    return Value << Shift;
+}
+
+// Rewrite 0x00RRGGBB rows in the framebuffer's own pixel format
+static VOID
+ConvertToNative(UINT32 *Pixels, UINT32 Width, UINT32 Height, UINT32 Stride,
+                CONST EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *Info) {
+    if (Info->PixelFormat == PixelRedGreenBlueReserved8BitPerColor) {
+        for (UINT32 y = 0; y < Height; y++) {
+            UINT32 *Row = &Pixels[(UINTN)y * Stride];
+            for (UINT32 x = 0; x < Width; x++) {
+                UINT32 P = Row[x];
+                Row[x] = ((P & 0xFF) << 16) | (P & 0xFF00) | ((P >> 16) & 0xFF);
+            }
+        }
+    } else if (Info->PixelFormat == PixelBitMask) {
+        UINT32 Shift[3], Bits[3];
+        ChannelMask(Info->PixelInformation.RedMask, &Shift[0], &Bits[0]);
+        ChannelMask(Info->PixelInformation.GreenMask, &Shift[1], &Bits[1]);
+        ChannelMask(Info->PixelInformation.BlueMask, &Shift[2], &Bits[2]);
+        for (UINT32 y = 0; y < Height; y++) {
+            UINT32 *Row = &Pixels[(UINTN)y * Stride];
+            for (UINT32 x = 0; x < Width; x++) {
+                UINT32 P = Row[x];
+                Row[x] = PackChannel((P >> 16) & 0xFF, Shift[0], Bits[0]) |
+                         PackChannel((P >> 8) & 0xFF, Shift[1], Bits[1]) |
+                         PackChannel(P & 0xFF, Shift[2], Bits[2]);
+            }
+        }
+    }
+    // PixelBlueGreenRedReserved8BitPerColor already is 0x00RRGGBB
+}
+
+/**
+  Draws an image scaled to cover the whole screen. The scaled image is
+  prepared once per image and mode: in the back buffer's format when
+  there is one, otherwise in the framebuffer's own pixel format and
+  pitch, so that every redraw is a single copy.
+  
+  @param[in] Image      The background image.
+  
+  @retval EFI_SUCCESS           The background was drawn.
+  @retval EFI_OUT_OF_RESOURCES  The scaled copy could not be allocated.
+  @retval Other                 An error occurred.
+**/
+EFI_STATUS
+DrawBackground(
+    IN CONST GRAPHICS_IMAGE *Image
+) {
+    if (GraphicsOutput == NULL) {
+        return EFI_NOT_READY;
+    }
+    if (Image == NULL || Image->Pixels == NULL || Image->Width == 0 || Image->Height == 0) {
+        return EFI_INVALID_PARAMETER;
+    }
+    
+    CONST EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *Info = GraphicsOutput->Mode->Info;
+    UINT32 Width = Info->HorizontalResolution;
+    UINT32 Height = Info->VerticalResolution;
+    
+    // Already screen-sized and in the back buffer's format: nothing to prepare
+    if (BackBuffer && Image->Width == Width && Image->Height == Height) {
+        return DrawImage(Image, 0, 0);
+    }
+    
+    // Without a back buffer, write straight into a linear framebuffer
+    // laid out exactly like the prepared copy
+    UINT32 Stride = Width;
+    BOOLEAN Native = FALSE;
+    if (BackBuffer == NULL && Info->PixelFormat != PixelBltOnly && GraphicsOutput->Mode->FrameBufferBase != 0 &&
+        (UINT64)Info->PixelsPerScanLine * Height * sizeof(UINT32) <= GraphicsOutput->Mode->FrameBufferSize) {
+        Stride = Info->PixelsPerScanLine;
+        Native = TRUE;
+    }
+    
+    if (Background.Pixels == NULL || Background.Source != Image || Background.SourcePixels != Image->Pixels ||
+        Background.Width != Width || Background.Height != Height ||
+        Background.Stride != Stride || Background.Native != Native) {
+        if (Background.Pixels) {
+            FreePool(Background.Pixels);
+        }
+        ZeroMem(&Background, sizeof(Background));
+        
+        UINT32 *Pixels = AllocateZeroPool((UINTN)Stride * Height * sizeof(UINT32));
+        if (Pixels == NULL) {
+            return EFI_OUT_OF_RESOURCES;
+        }
+        EFI_STATUS Status = ScaleImageCover(Image, Pixels, Width, Height, Stride);
+        if (EFI_ERROR(Status)) {
+            FreePool(Pixels);
+            return Status;
+        }
+        if (Native) {
+            ConvertToNative(Pixels, Width, Height, Stride, Info);
+        }
+        Background.Source = Image;
+        Background.SourcePixels = Image->Pixels;
+        Background.Width = Width;
+        Background.Height = Height;
+        Background.Stride = Stride;
+        Background.Native = Native;
+        Background.Pixels = Pixels;
+    }
+    
+    if (BackBuffer) {
+        CopyMem(BackBuffer, Background.Pixels, (UINTN)Width * Height * sizeof(UINT32));
+        MarkDirtyRect(0, 0, Width, Height);
+        return EFI_SUCCESS;
+    }
+    if (Native) {
+        CopyMem((VOID *)(UINTN)GraphicsOutput->Mode->FrameBufferBase, Background.Pixels,
+                (UINTN)Stride * Height * sizeof(UINT32));
+        return EFI_SUCCESS;
+    }
+    return GraphicsOutput->Blt(
+        GraphicsOutput,
+        (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *)Background.Pixels,
+        EfiBltBufferToVideo,
+        0, 0,
+        0, 0,
+        Width, Height,
+        (UINTN)Stride * sizeof(UINT32)
+    );
+}
+
 /**
   Clears the screen with the specified color.
   
@@ -10,11 +10,39 @@
 
 #include <Uefi.h>
 #include "compat.h"
+#include <Protocol/GraphicsOutput.h>
 
-// Function to initialize graphics
+// Most regions FlushGraphics tracks separately before merging them
+#define GRAPHICS_MAX_DIRTY_RECTS 16
+
+extern EFI_GRAPHICS_OUTPUT_PROTOCOL *GraphicsOutput;
+
+// Function to initialize graphics (also sets up the back buffer)
 EFI_STATUS
 InitializeGraphics(VOID);
 
+// Back buffer: DrawRect, ClearScreen and the font renderer compose into
+// it and FlushGraphics copies the changed regions to the screen
+UINT32 *
+GetBackBuffer(
+    OUT UINT32 *Width OPTIONAL,
+    OUT UINT32 *Height OPTIONAL
+);
+
+VOID
+MarkDirtyRect(
+    IN UINT32 X,
+    IN UINT32 Y,
+    IN UINT32 Width,
+    IN UINT32 Height
+);
+
+EFI_STATUS
+FlushGraphics(VOID);
+
+VOID
+ReleaseBackBuffer(VOID);
+
 // Function to draw a rectangle
 EFI_STATUS
 DrawRect(
@@ -25,6 +53,28 @@ DrawRect(
     IN UINT32 Color
 );
 
+// Pre-decoded image: Width x Height 0x00RRGGBB pixels, rows packed
+typedef struct {
+    UINT32          Width;
+    UINT32          Height;
+    CONST UINT32    *Pixels;
+} GRAPHICS_IMAGE;
+
+// Function to draw an image with its top-left corner at (X, Y)
+EFI_STATUS
+DrawImage(
+    IN CONST GRAPHICS_IMAGE *Image,
+    IN UINT32 X,
+    IN UINT32 Y
+);
+
+// Function to draw an image scaled to cover the screen; the scaled copy
+// is cached until the image or the video mode changes
+EFI_STATUS
+DrawBackground(
+    IN CONST GRAPHICS_IMAGE *Image
+);
+
 // Function to clear the screen with a color
 EFI_STATUS
 ClearScreen(
@@ -0,0 +1,1743 @@
+/*
+ * http.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <Uefi.h>
+#include "compat.h"
+#include <Library/UefiLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/BaseLib.h>
+#include <Library/PrintLib.h>
+#include <Library/HttpLib.h>
+#include <Protocol/Http.h>
+#include <Protocol/Tcp4.h>
+#include <Protocol/Dns4.h>
+#include <Protocol/Ip4Config2.h>
+#include <Protocol/LoadedImage.h>
+#include <Protocol/ServiceBinding.h>
+#include "uefi.h"
+#include "../net/pxe.h"
+#include "../boot/libb/include/bloodhorn/counters.h"
+#include "../boot/libb/include/bloodhorn/trace.h"
+
+// A file is fetched as byte ranges of this size, spread over up to
+// HTTP_MAX_CONNECTIONS keep-alive connections
+#define HTTP_PIECE_SIZE             (1024 * 1024)
+#define HTTP_MAX_CONNECTIONS        4
+
+// Drops or stalls in a row, with no body bytes arriving in between,
+// tolerated before the download is abandoned
+#define HTTP_MAX_RETRIES            8
+
+// A token that makes no progress for this long counts as a dropped
+// connection (100 ns units)
+#define HTTP_STALL_TIMEOUT          (10 * 10000000ULL)
+
+// Body bytes that a server which ignored Range resends before the point
+// we resume at are read into this scratch buffer and dropped
+#define HTTP_SKIP_BUFFER_SIZE       (64 * 1024)
+
+// Plain http:// runs on our own HTTP/1.1 client over TCP4, which HttpDxe
+// would configure with a 64 KiB window and no window scaling. Each
+// connection gets a socket buffer this large, so one connection can keep
+// 4 MiB in flight across a high-latency link, and keeps
+// HTTP_TCP_RX_TOKENS receives posted at once, so the stack always has
+// somewhere to put what arrives between two polls.
+#define HTTP_TCP_RECEIVE_BUFFER     (4 * 1024 * 1024)
+#define HTTP_TCP_RX_TOKENS          4
+#define HTTP_TCP_RX_SIZE            (64 * 1024)
+#define HTTP_TCP_DEFAULT_PORT       80
+#define HTTP_HEADER_MAX             8192        // Status line and headers of one response
+#define HTTP_REQUEST_MAX            1024        // GET line and headers we send
+#define HTTP_HEADER_FIELDS_MAX      32
+
+// Host names resolved for plain http:// are kept for their DNS TTL, so the
+// manifest, kernel and initrd of one boot cost one lookup between them
+#define HTTP_DNS_CACHE_SIZE         8
+#define HTTP_DNS_NAME_MAX           256
+#define HTTP_DNS_DEFAULT_TTL        60          // Seconds, when the stack does not say
+#define HTTP_DNS_MAX_TTL            86400       // Keeps expiry times well inside pxe_time_ms's range
+#define HTTP_DNS_TIMEOUT            (10 * 10000000ULL)
+#define HTTP_DNS_TYPE_A             1
+#define HTTP_DNS_TYPE_CNAME         5
+#define HTTP_DNS_CLASS_IN           1
+#define HTTP_DNS_PROTO_UDP          17
+
+typedef enum {
+    HttpPiecePending = 0,
+    HttpPieceActive,
+    HttpPieceDone
+} HTTP_PIECE_STATE;
+
+typedef struct {
+    UINT64  Filled;     // Bytes of the piece already in the buffer
+    UINT8   State;      // HTTP_PIECE_STATE
+} HTTP_PIECE;
+
+typedef enum {
+    HttpConnIdle = 0,
+    HttpConnConnecting, // TCP4 handshake under way, request waiting to go out
+    HttpConnSending,    // Request token outstanding
+    HttpConnHeaders,    // Response token for the status line and headers
+    HttpConnBody        // Response token for body bytes
+} HTTP_CONN_STATE;
+
+// One of a TCP connection's posted receives
+typedef struct {
+    EFI_TCP4_IO_TOKEN       Token;
+    EFI_TCP4_RECEIVE_DATA   Data;
+    UINT8                   *Buffer;    // HTTP_TCP_RX_SIZE bytes
+    BOOLEAN                 Posted;
+} HTTP_TCP_RX;
+
+typedef struct {
+    EFI_HANDLE              Child;
+    EFI_HTTP_PROTOCOL       *Http;
+    EFI_HTTP_TOKEN          Token;
+    EFI_HTTP_MESSAGE        Message;
+    EFI_HTTP_REQUEST_DATA   RequestData;
+    EFI_HTTP_RESPONSE_DATA  ResponseData;
+    EFI_HTTP_HEADER         Headers[4];
+    CHAR8                   Range[48];
+    EFI_EVENT               Timeout;
+    volatile BOOLEAN        Done;       // Set by the token's notify function
+    HTTP_CONN_STATE         State;
+    UINTN                   Piece;
+    UINT64                  Cursor;     // Next file offset the body delivers
+    UINT64                  End;        // One past the last offset requested
+    UINT64                  Skip;       // Body bytes to discard first
+
+    // Our own client (plain http://); Http is NULL then
+    EFI_TCP4_PROTOCOL           *Tcp;
+    EFI_TCP4_CONNECTION_TOKEN   ConnToken;
+    EFI_TCP4_IO_TOKEN           TxToken;
+    EFI_TCP4_TRANSMIT_DATA      TxData;
+    BOOLEAN                     TxPending;
+    BOOLEAN                     Connected;
+    BOOLEAN                     CloseAfter; // The server ends the connection after this response
+    HTTP_TCP_RX                 Rx[HTTP_TCP_RX_TOKENS];
+    UINTN                       RxNext;     // Oldest posted receive: TCP4 completes them in order
+    UINT8                       *RxBuffers;
+    CHAR8                       Request[HTTP_REQUEST_MAX];
+    CHAR8                       Header[HTTP_HEADER_MAX + 1];
+    UINTN                       HeaderLength;
+} HTTP_CONNECTION;
+
+typedef struct {
+    EFI_SERVICE_BINDING_PROTOCOL    *Binding;
+    EFI_HANDLE                      Nic;
+    EFI_HTTP_CONFIG_DATA            Config;
+    EFI_HTTPv4_ACCESS_POINT         Ipv4;
+    CHAR16                          *Url;
+    CHAR8                           *Host;
+
+    BOOLEAN                         UseTcp;     // Our own client rather than HttpDxe
+    CHAR8                           *HostName;  // Without the port, for DNS
+    CHAR8                           *Path;      // Request target, with any query
+    UINT16                          Port;
+    EFI_TCP4_CONFIG_DATA            TcpConfig;
+    EFI_TCP4_OPTION                 TcpOption;
+    HTTP_CONNECTION                 Conn[HTTP_MAX_CONNECTIONS];
+    UINTN                           ConnCount;
+
+    BOOLEAN                         Sized;      // Total is known and Buffer allocated
+    BOOLEAN                         Ranges;     // The server honours Range
+    UINT64                          Total;
+    UINT64                          PieceSize;
+    UINTN                           PieceCount;
+    HTTP_PIECE                      *Pieces;
+    UINT32                          Flags;
+    LOADED_FILE                     *File;
+
+    UINT64                          Delivered;  // Bytes handed to Callback
+    FILE_LOAD_CHUNK_CALLBACK        Callback;
+    VOID                            *Context;
+    UINTN                           Retries;    // Drops since data last arrived
+} HTTP_DOWNLOAD;
+
+typedef struct {
+    CHAR8               Name[HTTP_DNS_NAME_MAX];
+    EFI_IPv4_ADDRESS    Address;
+    UINT32              Expires;    // pxe_time_ms() value
+} HTTP_DNS_ENTRY;
+
+STATIC UINT8 mHttpSkipBuffer[HTTP_SKIP_BUFFER_SIZE];
+STATIC HTTP_DNS_ENTRY mHttpDnsCache[HTTP_DNS_CACHE_SIZE];
+
+extern EFI_HANDLE gBloodHornNicHandle;
+
+// Milliseconds from an arbitrary start, wrapping (netrx.c)
+uint32_t pxe_time_ms(void);
+
+STATIC
+VOID
+EFIAPI
+HttpTokenNotify(
+    IN EFI_EVENT    Event,
+    IN VOID         *Context
+) {
+    *(volatile BOOLEAN *)Context = TRUE;
+}
+
+// TCP4 and DNS4 tokens are polled through their Status instead
+STATIC
+VOID
+EFIAPI
+HttpPollNotify(
+    IN EFI_EVENT    Event,
+    IN VOID         *Context
+) {
+}
+
+BOOLEAN
+IsHttpUrl(
+    IN CONST CHAR16 *Name
+) {
+    STATIC CONST CHAR16 *Schemes[] = { L"http://", L"https://" };
+
+    if (Name == NULL) {
+        return FALSE;
+    }
+    for (UINTN s = 0; s < ARRAY_SIZE(Schemes); s++) {
+        UINTN i = 0;
+        while (Schemes[s][i] != L'\0' && (Name[i] | 0x20) == Schemes[s][i]) {
+            i++;
+        }
+        if (Schemes[s][i] == L'\0') {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// The NIC has no address yet: put it on DHCP (the caller retries its
+// Configure while the lease comes in)
+STATIC
+VOID
+RequestNicDhcp(
+    IN EFI_HANDLE Nic
+) {
+    EFI_IP4_CONFIG2_PROTOCOL *Ip4Config2;
+
+    if (!EFI_ERROR(gBS->HandleProtocol(Nic, &gEfiIp4Config2ProtocolGuid, (VOID **)&Ip4Config2))) {
+        EFI_IP4_CONFIG2_POLICY Policy = Ip4Config2PolicyDhcp;
+        Ip4Config2->SetData(Ip4Config2, Ip4Config2DataTypePolicy, sizeof(Policy), &Policy);
+    }
+}
+
+EFI_STATUS
+ConfigureNicChild(
+    IN EFI_HANDLE           Nic,
+    IN NIC_CHILD_CONFIGURE  Configure,
+    IN VOID                 *Child,
+    IN VOID                 *Config
+) {
+    EFI_STATUS Status = Configure(Child, Config);
+
+    if (Status == EFI_NO_MAPPING) {
+        RequestNicDhcp(Nic);
+        for (UINTN Waited = 0; Status == EFI_NO_MAPPING && Waited < NIC_MAPPING_TIMEOUT_MS; Waited += 100) {
+            gBS->Stall(100 * 1000);
+            Status = Configure(Child, Config);
+        }
+    }
+    return Status;
+}
+
+STATIC
+EFI_STATUS
+HttpConfigure(
+    IN VOID *Child,
+    IN VOID *Config
+) {
+    return ((EFI_HTTP_PROTOCOL *)Child)->Configure((EFI_HTTP_PROTOCOL *)Child, (EFI_HTTP_CONFIG_DATA *)Config);
+}
+
+STATIC
+EFI_STATUS
+HttpTcpConfigure(
+    IN VOID *Child,
+    IN VOID *Config
+) {
+    return ((EFI_TCP4_PROTOCOL *)Child)->Configure((EFI_TCP4_PROTOCOL *)Child, (EFI_TCP4_CONFIG_DATA *)Config);
+}
+
+// One DNS4 query, started by HttpDnsStart
+typedef struct {
+    CONST CHAR8                 *HostName;
+    CHAR16                      Name[HTTP_DNS_NAME_MAX];
+    BOOLEAN                     General;
+    EFI_DNS4_COMPLETION_TOKEN   *Token;
+} HTTP_DNS_QUERY;
+
+STATIC
+EFI_STATUS
+HttpDnsStart(
+    IN VOID *Child,
+    IN VOID *Config
+) {
+    EFI_DNS4_PROTOCOL *Dns = (EFI_DNS4_PROTOCOL *)Child;
+    HTTP_DNS_QUERY *Query = (HTTP_DNS_QUERY *)Config;
+
+    Query->Token->Status = EFI_NOT_READY;
+    Query->Token->RspData.GLookupData = NULL;
+    return Query->General ? Dns->GeneralLookUp(Dns, (CHAR8 *)Query->HostName, HTTP_DNS_TYPE_A, HTTP_DNS_CLASS_IN,
+                                               Query->Token)
+                          : Dns->HostNameToIp(Dns, Query->Name, Query->Token);
+}
+
+/**
+  Configures an HTTP child, asking the NIC for a DHCP address first if it
+  has none yet (HttpDxe reports EFI_NO_MAPPING until one is bound).
+**/
+STATIC
+EFI_STATUS
+ConfigureHttp(
+    IN HTTP_DOWNLOAD       *Dl,
+    IN EFI_HTTP_PROTOCOL   *Http
+) {
+    return ConfigureNicChild(Dl->Nic, HttpConfigure, Http, &Dl->Config);
+}
+
+// The same for a TCP4 child of our own client
+STATIC
+EFI_STATUS
+ConfigureHttpTcp(
+    IN HTTP_DOWNLOAD       *Dl,
+    IN EFI_TCP4_PROTOCOL   *Tcp
+) {
+    return ConfigureNicChild(Dl->Nic, HttpTcpConfigure, Tcp, &Dl->TcpConfig);
+}
+
+/**
+  Resets a TCP connection, which aborts every token queued on it, and
+  configures it again; the next request connects afresh.
+**/
+STATIC
+EFI_STATUS
+ReopenHttpTcp(
+    IN HTTP_DOWNLOAD       *Dl,
+    IN HTTP_CONNECTION     *Conn
+) {
+    Conn->Tcp->Configure(Conn->Tcp, NULL);
+    Conn->Connected = FALSE;
+    Conn->CloseAfter = FALSE;
+    Conn->TxPending = FALSE;
+    for (UINTN i = 0; i < HTTP_TCP_RX_TOKENS; i++) {
+        Conn->Rx[i].Posted = FALSE;
+    }
+    Conn->RxNext = 0;
+    return ConfigureHttpTcp(Dl, Conn->Tcp);
+}
+
+STATIC
+EFI_STATUS
+PostHttpTcpReceive(
+    IN HTTP_CONNECTION *Conn,
+    IN HTTP_TCP_RX     *Rx
+) {
+    EFI_STATUS Status;
+
+    Rx->Data.UrgentFlag = FALSE;
+    Rx->Data.DataLength = HTTP_TCP_RX_SIZE;
+    Rx->Data.FragmentCount = 1;
+    Rx->Data.FragmentTable[0].FragmentLength = HTTP_TCP_RX_SIZE;
+    Rx->Data.FragmentTable[0].FragmentBuffer = Rx->Buffer;
+    Rx->Token.Packet.RxData = &Rx->Data;
+    Rx->Token.CompletionToken.Status = EFI_NOT_READY;
+    Status = Conn->Tcp->Receive(Conn->Tcp, &Rx->Token);
+    if (!EFI_ERROR(Status)) {
+        Rx->Posted = TRUE;
+    }
+    return Status;
+}
+
+STATIC
+EFI_STATUS
+TransmitHttpRequest(
+    IN HTTP_CONNECTION *Conn
+) {
+    EFI_STATUS Status;
+    UINT32 Length = (UINT32)AsciiStrLen(Conn->Request);
+
+    Conn->TxData.Push = TRUE;
+    Conn->TxData.Urgent = FALSE;
+    Conn->TxData.DataLength = Length;
+    Conn->TxData.FragmentCount = 1;
+    Conn->TxData.FragmentTable[0].FragmentLength = Length;
+    Conn->TxData.FragmentTable[0].FragmentBuffer = Conn->Request;
+    Conn->TxToken.Packet.TxData = &Conn->TxData;
+    Conn->TxToken.CompletionToken.Status = EFI_NOT_READY;
+    Status = Conn->Tcp->Transmit(Conn->Tcp, &Conn->TxToken);
+    if (!EFI_ERROR(Status)) {
+        Conn->TxPending = TRUE;
+        Conn->HeaderLength = 0;
+        Conn->State = HttpConnHeaders;
+    }
+    return Status;
+}
+
+STATIC
+VOID
+CloseHttpConnection(
+    IN HTTP_DOWNLOAD       *Dl,
+    IN HTTP_CONNECTION     *Conn
+) {
+    if (Conn->Http != NULL) {
+        if (Conn->State != HttpConnIdle && !Conn->Done) {
+            Conn->Http->Cancel(Conn->Http, NULL);
+        }
+        Conn->Http->Configure(Conn->Http, NULL);
+    }
+    if (Conn->Tcp != NULL) {
+        Conn->Tcp->Configure(Conn->Tcp, NULL);
+    }
+    if (Conn->Child != NULL) {
+        Dl->Binding->DestroyChild(Dl->Binding, Conn->Child);
+    }
+    if (Conn->Token.Event != NULL) {
+        gBS->CloseEvent(Conn->Token.Event);
+    }
+    if (Conn->ConnToken.CompletionToken.Event != NULL) {
+        gBS->CloseEvent(Conn->ConnToken.CompletionToken.Event);
+    }
+    if (Conn->TxToken.CompletionToken.Event != NULL) {
+        gBS->CloseEvent(Conn->TxToken.CompletionToken.Event);
+    }
+    for (UINTN i = 0; i < HTTP_TCP_RX_TOKENS; i++) {
+        if (Conn->Rx[i].Token.CompletionToken.Event != NULL) {
+            gBS->CloseEvent(Conn->Rx[i].Token.CompletionToken.Event);
+        }
+    }
+    if (Conn->RxBuffers != NULL) {
+        FreePool(Conn->RxBuffers);
+    }
+    if (Conn->Timeout != NULL) {
+        gBS->CloseEvent(Conn->Timeout);
+    }
+    ZeroMem(Conn, sizeof(*Conn));
+}
+
+STATIC
+EFI_STATUS
+OpenHttpConnection(
+    IN  HTTP_DOWNLOAD      *Dl,
+    OUT HTTP_CONNECTION    *Conn
+) {
+    EFI_STATUS Status;
+
+    ZeroMem(Conn, sizeof(*Conn));
+    Status = Dl->Binding->CreateChild(Dl->Binding, &Conn->Child);
+    if (Dl->UseTcp) {
+        if (!EFI_ERROR(Status)) {
+            Status = gBS->HandleProtocol(Conn->Child, &gEfiTcp4ProtocolGuid, (VOID **)&Conn->Tcp);
+        }
+        if (!EFI_ERROR(Status)) {
+            Status = ConfigureHttpTcp(Dl, Conn->Tcp);
+        }
+        if (!EFI_ERROR(Status)) {
+            Conn->RxBuffers = AllocatePool(HTTP_TCP_RX_TOKENS * HTTP_TCP_RX_SIZE);
+            Status = Conn->RxBuffers != NULL ? EFI_SUCCESS : EFI_OUT_OF_RESOURCES;
+        }
+        if (!EFI_ERROR(Status)) {
+            Status = gBS->CreateEvent(EVT_NOTIFY_SIGNAL, TPL_CALLBACK, HttpPollNotify, NULL,
+                                      &Conn->ConnToken.CompletionToken.Event);
+        }
+        if (!EFI_ERROR(Status)) {
+            Status = gBS->CreateEvent(EVT_NOTIFY_SIGNAL, TPL_CALLBACK, HttpPollNotify, NULL,
+                                      &Conn->TxToken.CompletionToken.Event);
+        }
+        for (UINTN i = 0; i < HTTP_TCP_RX_TOKENS && !EFI_ERROR(Status); i++) {
+            Conn->Rx[i].Buffer = Conn->RxBuffers + i * HTTP_TCP_RX_SIZE;
+            Status = gBS->CreateEvent(EVT_NOTIFY_SIGNAL, TPL_CALLBACK, HttpPollNotify, NULL,
+                                      &Conn->Rx[i].Token.CompletionToken.Event);
+        }
+    } else {
+        if (!EFI_ERROR(Status)) {
+            Status = gBS->HandleProtocol(Conn->Child, &gEfiHttpProtocolGuid, (VOID **)&Conn->Http);
+        }
+        if (!EFI_ERROR(Status)) {
+            Status = ConfigureHttp(Dl, Conn->Http);
+        }
+        if (!EFI_ERROR(Status)) {
+            Status = gBS->CreateEvent(EVT_NOTIFY_SIGNAL, TPL_CALLBACK, HttpTokenNotify,
+                                      (VOID *)&Conn->Done, &Conn->Token.Event);
+        }
+    }
+    if (!EFI_ERROR(Status)) {
+        Status = gBS->CreateEvent(EVT_TIMER, 0, NULL, NULL, &Conn->Timeout);
+    }
+    if (EFI_ERROR(Status)) {
+        CloseHttpConnection(Dl, Conn);
+    }
+    return Status;
+}
+
+// Restart the stall timer; a pending signal from the last one is cleared
+STATIC
+VOID
+ArmHttpTimeout(
+    IN HTTP_CONNECTION *Conn
+) {
+    gBS->CheckEvent(Conn->Timeout);
+    gBS->SetTimer(Conn->Timeout, TimerRelative, HTTP_STALL_TIMEOUT);
+}
+
+/**
+  Sends GET for the unfilled part of piece Conn->Piece. Before the file is
+  sized this is the probe, which asks for the first piece.
+**/
+STATIC
+EFI_STATUS
+StartHttpRequest(
+    IN HTTP_DOWNLOAD       *Dl,
+    IN HTTP_CONNECTION     *Conn,
+    IN UINTN               Piece
+) {
+    EFI_STATUS Status;
+    UINT64 Start = (UINT64)Piece * Dl->PieceSize;
+
+    Conn->Piece = Piece;
+    Conn->Cursor = Start;
+    Conn->End = Start + Dl->PieceSize;
+    Conn->Skip = 0;
+    if (Dl->Sized) {
+        Conn->Cursor += Dl->Pieces[Piece].Filled;
+        Conn->End = MIN(Conn->End, Dl->Total);
+        Dl->Pieces[Piece].State = HttpPieceActive;
+    }
+
+    AsciiSPrint(Conn->Range, sizeof(Conn->Range), "bytes=%lu-%lu", Conn->Cursor, Conn->End - 1);
+    if (Conn->Tcp != NULL) {
+        // The last request's ACK normally rides on its response; one still
+        // outstanding means the connection is not sound
+        Conn->Tcp->Poll(Conn->Tcp);
+        if (Conn->TxPending && Conn->TxToken.CompletionToken.Status == EFI_NOT_READY) {
+            return EFI_NOT_READY;
+        }
+        Conn->TxPending = FALSE;
+        AsciiSPrint(Conn->Request, sizeof(Conn->Request),
+                    "GET %a HTTP/1.1\r\nHost: %a\r\nRange: %a\r\nAccept: */*\r\nUser-Agent: BloodHorn\r\n\r\n",
+                    Dl->Path, Dl->Host, Conn->Range);
+        if (Conn->Connected) {
+            Status = TransmitHttpRequest(Conn);
+        } else {
+            Conn->ConnToken.CompletionToken.Status = EFI_NOT_READY;
+            Status = Conn->Tcp->Connect(Conn->Tcp, &Conn->ConnToken);
+            if (!EFI_ERROR(Status)) {
+                Conn->State = HttpConnConnecting;
+            }
+        }
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+        ArmHttpTimeout(Conn);
+        return EFI_SUCCESS;
+    }
+
+    Conn->Headers[0].FieldName = "Host";
+    Conn->Headers[0].FieldValue = Dl->Host;
+    Conn->Headers[1].FieldName = "Range";
+    Conn->Headers[1].FieldValue = Conn->Range;
+    Conn->Headers[2].FieldName = "Accept";
+    Conn->Headers[2].FieldValue = "*/*";
+    Conn->Headers[3].FieldName = "User-Agent";
+    Conn->Headers[3].FieldValue = "BloodHorn";
+
+    Conn->RequestData.Method = HttpMethodGet;
+    Conn->RequestData.Url = Dl->Url;
+    ZeroMem(&Conn->Message, sizeof(Conn->Message));
+    Conn->Message.Data.Request = &Conn->RequestData;
+    Conn->Message.HeaderCount = ARRAY_SIZE(Conn->Headers);
+    Conn->Message.Headers = Conn->Headers;
+    Conn->Token.Message = &Conn->Message;
+    Conn->Token.Status = EFI_NOT_READY;
+    Conn->Done = FALSE;
+
+    Status = Conn->Http->Request(Conn->Http, &Conn->Token);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    Conn->State = HttpConnSending;
+    ArmHttpTimeout(Conn);
+    return EFI_SUCCESS;
+}
+
+// Ask for the next stretch of body (or the headers, when Headers is set)
+STATIC
+EFI_STATUS
+ReceiveHttp(
+    IN HTTP_CONNECTION *Conn,
+    IN BOOLEAN         Headers,
+    IN UINT8           *Buffer
+) {
+    EFI_STATUS Status;
+
+    ZeroMem(&Conn->Message, sizeof(Conn->Message));
+    if (Headers) {
+        Conn->Message.Data.Response = &Conn->ResponseData;
+    } else if (Conn->Skip != 0) {
+        Conn->Message.Body = mHttpSkipBuffer;
+        Conn->Message.BodyLength = (UINTN)MIN(Conn->Skip, (UINT64)sizeof(mHttpSkipBuffer));
+    } else {
+        Conn->Message.Body = Buffer + Conn->Cursor;
+        Conn->Message.BodyLength = (UINTN)(Conn->End - Conn->Cursor);
+    }
+    Conn->Token.Message = &Conn->Message;
+    Conn->Token.Status = EFI_NOT_READY;
+    Conn->Done = FALSE;
+
+    Status = Conn->Http->Response(Conn->Http, &Conn->Token);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    Conn->State = Headers ? HttpConnHeaders : HttpConnBody;
+    ArmHttpTimeout(Conn);
+    return EFI_SUCCESS;
+}
+
+// "bytes <first>-<last>/<total>"
+STATIC
+BOOLEAN
+ParseContentRange(
+    IN  CONST CHAR8    *Value,
+    OUT UINT64         *First,
+    OUT UINT64         *Total
+) {
+    UINT64 Numbers[3] = { 0, 0, 0 };
+    CONST CHAR8 Separators[3] = { '-', '/', '\0' };
+
+    if (AsciiStrnCmp(Value, "bytes ", 6) != 0) {
+        return FALSE;
+    }
+    Value += 6;
+    for (UINTN i = 0; i < 3; i++) {
+        if (*Value < '0' || *Value > '9') {
+            return FALSE;   // Includes the "*" of an unknown total
+        }
+        while (*Value >= '0' && *Value <= '9') {
+            if (Numbers[i] > (MAX_UINT64 - 9) / 10) {
+                return FALSE;
+            }
+            Numbers[i] = Numbers[i] * 10 + (UINT64)(*Value++ - '0');
+        }
+        if (*Value++ != Separators[i]) {
+            return FALSE;
+        }
+    }
+    *First = Numbers[0];
+    *Total = Numbers[2];
+    return Numbers[0] <= Numbers[1] && Numbers[1] < Numbers[2];
+}
+
+/**
+  Learns the file size from the probe's response and sets up the piece
+  table and the destination buffer.
+**/
+STATIC
+EFI_STATUS
+SizeHttpDownload(
+    IN HTTP_DOWNLOAD   *Dl,
+    IN UINT64          Total,
+    IN BOOLEAN         Ranges
+) {
+    EFI_STATUS Status;
+
+    if (Total > MAX_UINTN - 1) {
+        return EFI_BAD_BUFFER_SIZE;
+    }
+    Dl->Total = Total;
+    Dl->Ranges = Ranges;
+    if (!Ranges) {
+        // One piece, one connection: the whole body in order
+        Dl->PieceSize = MAX(Total, 1);
+    }
+    Dl->PieceCount = (UINTN)((Total + Dl->PieceSize - 1) / Dl->PieceSize);
+    Dl->Pieces = AllocateZeroPool(MAX(Dl->PieceCount, 1) * sizeof(HTTP_PIECE));
+    if (Dl->Pieces == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    Status = AllocateFileBuffer(Dl->Flags, (UINTN)Total, Dl->File);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    Dl->Sized = TRUE;
+    LoadProgressTotal(Total);
+    return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+HttpStatusToEfi(
+    IN EFI_HTTP_STATUS_CODE Code
+) {
+    switch (Code) {
+    case HTTP_STATUS_404_NOT_FOUND:
+    case HTTP_STATUS_410_GONE:
+        return EFI_NOT_FOUND;
+    case HTTP_STATUS_401_UNAUTHORIZED:
+    case HTTP_STATUS_403_FORBIDDEN:
+        return EFI_ACCESS_DENIED;
+    default:
+        return EFI_PROTOCOL_ERROR;
+    }
+}
+
+/**
+  Checks a response's status line and headers against the range that was
+  requested, sizing the download on the probe.
+
+  @retval EFI_SUCCESS     Ready for the body.
+  @retval EFI_END_OF_FILE The probe found an empty file.
+  @retval Other           The download cannot continue.
+**/
+STATIC
+EFI_STATUS
+AcceptHttpHeaders(
+    IN HTTP_DOWNLOAD       *Dl,
+    IN HTTP_CONNECTION     *Conn
+) {
+    EFI_HTTP_STATUS_CODE Code = Conn->ResponseData.StatusCode;
+    EFI_HTTP_HEADER *Header;
+    UINT64 First = 0;
+    UINT64 Total = 0;
+
+    if (Code == HTTP_STATUS_206_PARTIAL_CONTENT) {
+        Header = HttpFindHeader(Conn->Message.HeaderCount, Conn->Message.Headers, "Content-Range");
+        if (Header == NULL || !ParseContentRange(Header->FieldValue, &First, &Total)) {
+            return EFI_PROTOCOL_ERROR;
+        }
+        if (!Dl->Sized) {
+            EFI_STATUS Status = SizeHttpDownload(Dl, Total, TRUE);
+            if (EFI_ERROR(Status)) {
+                return Status;
+            }
+            Conn->End = MIN(Conn->End, Total);
+            Dl->Pieces[0].State = HttpPieceActive;
+        } else if (Total != Dl->Total) {
+            return EFI_VOLUME_CHANGED;  // The file changed under us
+        }
+        return (First == Conn->Cursor) ? EFI_SUCCESS : EFI_PROTOCOL_ERROR;
+    }
+
+    if (Code == HTTP_STATUS_200_OK) {
+        Header = HttpFindHeader(Conn->Message.HeaderCount, Conn->Message.Headers, "Content-Length");
+        if (Header == NULL) {
+            return EFI_UNSUPPORTED;     // Need the size up front
+        }
+        Total = AsciiStrDecimalToUint64(Header->FieldValue);
+        if (!Dl->Sized) {
+            EFI_STATUS Status = SizeHttpDownload(Dl, Total, FALSE);
+            if (EFI_ERROR(Status)) {
+                return Status;
+            }
+            if (Total == 0) {
+                return EFI_END_OF_FILE;
+            }
+            Conn->End = Total;
+            Dl->Pieces[0].State = HttpPieceActive;
+            return EFI_SUCCESS;
+        }
+        // A server that stopped honouring Range: acceptable only while
+        // the whole file is one piece, skipping what we already have
+        if (Dl->PieceCount != 1 || Total != Dl->Total) {
+            return EFI_PROTOCOL_ERROR;
+        }
+        Conn->Skip = Conn->Cursor;
+        return EFI_SUCCESS;
+    }
+
+    if (Code == HTTP_STATUS_416_REQUESTED_RANGE_NOT_SATISFIED && !Dl->Sized) {
+        // Even bytes=0-... is out of range: the file is empty
+        EFI_STATUS Status = SizeHttpDownload(Dl, 0, FALSE);
+        return EFI_ERROR(Status) ? Status : EFI_END_OF_FILE;
+    }
+
+    return HttpStatusToEfi(Code);
+}
+
+/**
+  Handles a dropped or stalled connection: the piece it was receiving
+  keeps what arrived and goes back in the queue, and the connection is
+  reset so its next request opens a fresh TCP session.
+**/
+STATIC
+EFI_STATUS
+DropHttpConnection(
+    IN HTTP_DOWNLOAD       *Dl,
+    IN HTTP_CONNECTION     *Conn
+) {
+    if (Conn->Http != NULL && !Conn->Done) {
+        Conn->Http->Cancel(Conn->Http, NULL);
+    }
+    if (Dl->Sized && Dl->Pieces[Conn->Piece].State == HttpPieceActive) {
+        Dl->Pieces[Conn->Piece].State = HttpPiecePending;
+    }
+    Conn->State = HttpConnIdle;
+    Conn->Done = FALSE;
+    gBS->SetTimer(Conn->Timeout, TimerCancel, 0);
+
+    if (++Dl->Retries > HTTP_MAX_RETRIES) {
+        return EFI_TIMEOUT;
+    }
+    if (Conn->Tcp != NULL) {
+        return ReopenHttpTcp(Dl, Conn);
+    }
+    Conn->Http->Configure(Conn->Http, NULL);
+    return ConfigureHttp(Dl, Conn->Http);
+}
+
+/**
+  Collects a response's status line and headers from received bytes and,
+  once the blank line is in, checks them as AcceptHttpHeaders does for
+  HttpDxe's responses. *Used is how many bytes of Data the headers took;
+  the rest are body.
+
+  @retval EFI_NOT_READY   The headers continue in the next receive.
+  @retval EFI_UNSUPPORTED A response our client does not read (a chunked
+                          body, oversized headers); HttpDxe can.
+  @retval Other           As AcceptHttpHeaders.
+**/
+STATIC
+EFI_STATUS
+TakeHttpTcpHeaders(
+    IN  HTTP_DOWNLOAD      *Dl,
+    IN  HTTP_CONNECTION    *Conn,
+    IN  CONST UINT8        *Data,
+    IN  UINTN              Length,
+    OUT UINTN              *Used
+) {
+    EFI_STATUS Status;
+    EFI_HTTP_HEADER Fields[HTTP_HEADER_FIELDS_MAX];
+    EFI_HTTP_HEADER *Header;
+    CHAR8 *Next;
+    UINTN Count = 0;
+    UINTN Code = 0;
+
+    *Used = 0;
+    for (;;) {
+        if (*Used == Length) {
+            return EFI_NOT_READY;
+        }
+        if (Conn->HeaderLength == HTTP_HEADER_MAX) {
+            return EFI_UNSUPPORTED;
+        }
+        Conn->Header[Conn->HeaderLength++] = (CHAR8)Data[(*Used)++];
+        if (Conn->HeaderLength >= 4 && CompareMem(Conn->Header + Conn->HeaderLength - 4, "\r\n\r\n", 4) == 0) {
+            break;
+        }
+    }
+    Conn->Header[Conn->HeaderLength] = '\0';
+
+    // "HTTP/1.x NNN reason"
+    if (Conn->HeaderLength < 16 || AsciiStrnCmp(Conn->Header, "HTTP/1.", 7) != 0 || Conn->Header[8] != ' ') {
+        return EFI_PROTOCOL_ERROR;
+    }
+    for (UINTN i = 9; i < 12; i++) {
+        if (Conn->Header[i] < '0' || Conn->Header[i] > '9') {
+            return EFI_PROTOCOL_ERROR;
+        }
+        Code = Code * 10 + (UINTN)(Conn->Header[i] - '0');
+    }
+
+    // The fields are split in place and point into Conn->Header
+    Next = AsciiStrStr(Conn->Header, "\r\n") + 2;
+    while (*Next != '\r') {
+        if (Count == HTTP_HEADER_FIELDS_MAX) {
+            return EFI_UNSUPPORTED;
+        }
+        Next = HttpGetFieldNameAndValue(Next, &Fields[Count].FieldName, &Fields[Count].FieldValue);
+        if (Next == NULL || Fields[Count].FieldName == NULL) {
+            return EFI_PROTOCOL_ERROR;
+        }
+        Count++;
+    }
+
+    ZeroMem(&Conn->Message, sizeof(Conn->Message));
+    Conn->Message.Headers = Fields;
+    Conn->Message.HeaderCount = Count;
+    Conn->ResponseData.StatusCode = HttpMappingToStatusCode(Code);
+    Status = EFI_SUCCESS;
+
+    Header = HttpFindHeader(Conn->Message.HeaderCount, Conn->Message.Headers, "Transfer-Encoding");
+    if (Header != NULL && AsciiStriCmp(Header->FieldValue, "identity") != 0) {
+        Status = EFI_UNSUPPORTED;
+    }
+    // HTTP/1.0 closes unless told otherwise, HTTP/1.1 only when it says so
+    Header = HttpFindHeader(Conn->Message.HeaderCount, Conn->Message.Headers, "Connection");
+    Conn->CloseAfter = Conn->Header[7] == '0';
+    if (Header != NULL) {
+        Conn->CloseAfter = AsciiStriCmp(Header->FieldValue, "close") == 0 ||
+                           (Conn->CloseAfter && AsciiStriCmp(Header->FieldValue, "keep-alive") != 0);
+    }
+    if (!EFI_ERROR(Status)) {
+        Status = AcceptHttpHeaders(Dl, Conn);
+    }
+    Conn->Message.Headers = NULL;
+    return Status;
+}
+
+/**
+  Feeds bytes a TCP connection received through the response: headers
+  first, then body straight to its offset in the file (or, for a server
+  that ignored Range, to the bit bucket up to where we resume).
+**/
+STATIC
+EFI_STATUS
+ConsumeHttpTcpData(
+    IN HTTP_DOWNLOAD   *Dl,
+    IN HTTP_CONNECTION *Conn,
+    IN CONST UINT8     *Data,
+    IN UINTN           Length
+) {
+    EFI_STATUS Status;
+
+    while (Length != 0) {
+        if (Conn->State == HttpConnHeaders) {
+            UINTN Used;
+            Status = TakeHttpTcpHeaders(Dl, Conn, Data, Length, &Used);
+            if (Status == EFI_NOT_READY) {
+                return EFI_SUCCESS;
+            }
+            if (EFI_ERROR(Status)) {
+                Conn->State = HttpConnIdle;
+                return Status;
+            }
+            Conn->State = HttpConnBody;
+            Data += Used;
+            Length -= Used;
+            continue;
+        }
+        if (Conn->State != HttpConnBody) {
+            return EFI_PROTOCOL_ERROR;      // More than the response held
+        }
+
+        UINTN Take = (UINTN)MIN((UINT64)Length, Conn->Skip != 0 ? Conn->Skip : Conn->End - Conn->Cursor);
+        Dl->Retries = 0;
+        if (Conn->Skip != 0) {
+            Conn->Skip -= Take;
+        } else {
+            CopyMem((UINT8 *)Dl->File->Buffer + Conn->Cursor, Data, Take);
+            Conn->Cursor += Take;
+            Dl->Pieces[Conn->Piece].Filled += Take;
+        }
+        Data += Take;
+        Length -= Take;
+        if (Conn->Skip == 0 && Conn->Cursor >= Conn->End) {
+            // Piece complete; the connection stays open for the next one
+            // unless the server said it would not
+            Dl->Pieces[Conn->Piece].State = HttpPieceDone;
+            Conn->State = HttpConnIdle;
+            gBS->SetTimer(Conn->Timeout, TimerCancel, 0);
+            if (Conn->CloseAfter) {
+                return Length == 0 ? ReopenHttpTcp(Dl, Conn) : EFI_PROTOCOL_ERROR;
+            }
+        }
+    }
+    return EFI_SUCCESS;
+}
+
+/**
+  Advances a TCP connection: the handshake, then the request, then every
+  receive that completed, oldest first, each re-posted once consumed.
+**/
+STATIC
+EFI_STATUS
+PumpHttpTcp(
+    IN HTTP_DOWNLOAD   *Dl,
+    IN HTTP_CONNECTION *Conn
+) {
+    EFI_STATUS Status;
+
+    Conn->Tcp->Poll(Conn->Tcp);
+    if (Conn->State == HttpConnConnecting) {
+        Status = Conn->ConnToken.CompletionToken.Status;
+        if (Status == EFI_NOT_READY) {
+            return EFI_SUCCESS;
+        }
+        if (EFI_ERROR(Status)) {
+            return DropHttpConnection(Dl, Conn);
+        }
+        Conn->Connected = TRUE;
+        Conn->RxNext = 0;
+        for (UINTN i = 0; i < HTTP_TCP_RX_TOKENS && !EFI_ERROR(Status); i++) {
+            Status = PostHttpTcpReceive(Conn, &Conn->Rx[i]);
+        }
+        if (!EFI_ERROR(Status)) {
+            Status = TransmitHttpRequest(Conn);
+        }
+        if (EFI_ERROR(Status)) {
+            return DropHttpConnection(Dl, Conn);
+        }
+        ArmHttpTimeout(Conn);
+    }
+
+    if (Conn->TxPending && Conn->TxToken.CompletionToken.Status != EFI_NOT_READY) {
+        Conn->TxPending = FALSE;
+        if (EFI_ERROR(Conn->TxToken.CompletionToken.Status)) {
+            return DropHttpConnection(Dl, Conn);
+        }
+    }
+
+    while (Conn->Connected) {
+        HTTP_TCP_RX *Rx = &Conn->Rx[Conn->RxNext];
+        if (!Rx->Posted || Rx->Token.CompletionToken.Status == EFI_NOT_READY) {
+            break;
+        }
+        Rx->Posted = FALSE;
+        if (EFI_ERROR(Rx->Token.CompletionToken.Status) || Rx->Data.DataLength == 0) {
+            return DropHttpConnection(Dl, Conn);
+        }
+        Conn->RxNext = (Conn->RxNext + 1) % HTTP_TCP_RX_TOKENS;
+        if (Conn->State != HttpConnIdle) {
+            ArmHttpTimeout(Conn);
+        }
+        Status = ConsumeHttpTcpData(Dl, Conn, Rx->Buffer, Rx->Data.DataLength);
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+        if (Conn->Connected && EFI_ERROR(PostHttpTcpReceive(Conn, Rx))) {
+            return DropHttpConnection(Dl, Conn);
+        }
+    }
+    return EFI_SUCCESS;
+}
+
+/**
+  Advances a connection whose token has completed.
+
+  @retval EFI_SUCCESS         Progress was made (possibly a drop that was
+                              recovered from).
+  @retval EFI_END_OF_FILE     The probe found an empty file.
+  @retval Other               The download must be abandoned.
+**/
+STATIC
+EFI_STATUS
+PumpHttpConnection(
+    IN HTTP_DOWNLOAD       *Dl,
+    IN HTTP_CONNECTION     *Conn
+) {
+    EFI_STATUS Status = Conn->Token.Status;
+    UINT8 *Buffer = Dl->Sized ? (UINT8 *)Dl->File->Buffer : NULL;
+
+    Conn->Done = FALSE;
+    if (EFI_ERROR(Status)) {
+        if (Conn->State == HttpConnHeaders && Conn->Message.Headers != NULL) {
+            HttpFreeHeaderFields(Conn->Message.Headers, Conn->Message.HeaderCount);
+        }
+        return DropHttpConnection(Dl, Conn);
+    }
+
+    switch (Conn->State) {
+    case HttpConnSending:
+        Status = ReceiveHttp(Conn, TRUE, Buffer);
+        break;
+
+    case HttpConnHeaders:
+        Status = AcceptHttpHeaders(Dl, Conn);
+        if (Conn->Message.Headers != NULL) {
+            HttpFreeHeaderFields(Conn->Message.Headers, Conn->Message.HeaderCount);
+            Conn->Message.Headers = NULL;
+        }
+        if (EFI_ERROR(Status)) {
+            Conn->State = HttpConnIdle;
+            return Status;
+        }
+        Status = ReceiveHttp(Conn, FALSE, (UINT8 *)Dl->File->Buffer);
+        break;
+
+    case HttpConnBody:
+        if (Conn->Message.BodyLength == 0) {
+            return DropHttpConnection(Dl, Conn);
+        }
+        Dl->Retries = 0;
+        if (Conn->Skip != 0) {
+            Conn->Skip -= MIN(Conn->Skip, (UINT64)Conn->Message.BodyLength);
+        } else {
+            Conn->Cursor += Conn->Message.BodyLength;
+            Dl->Pieces[Conn->Piece].Filled += Conn->Message.BodyLength;
+        }
+        if (Conn->Cursor >= Conn->End) {
+            // Piece complete; the connection stays open for the next one
+            Dl->Pieces[Conn->Piece].State = HttpPieceDone;
+            Conn->State = HttpConnIdle;
+            gBS->SetTimer(Conn->Timeout, TimerCancel, 0);
+            return EFI_SUCCESS;
+        }
+        Status = ReceiveHttp(Conn, FALSE, Buffer);
+        break;
+
+    default:
+        return EFI_SUCCESS;
+    }
+
+    return EFI_ERROR(Status) ? DropHttpConnection(Dl, Conn) : EFI_SUCCESS;
+}
+
+/**
+  Hands Callback every byte that is now contiguous from the start of the
+  file, so hashing keeps pace with the download instead of waiting for it.
+**/
+STATIC
+EFI_STATUS
+DeliverHttpData(
+    IN HTTP_DOWNLOAD *Dl
+) {
+    UINTN Piece = (UINTN)(Dl->Delivered / Dl->PieceSize);
+    UINT64 Available = Dl->Delivered;
+
+    while (Piece < Dl->PieceCount) {
+        UINT64 Start = (UINT64)Piece * Dl->PieceSize;
+        Available = Start + Dl->Pieces[Piece].Filled;
+        if (Dl->Pieces[Piece].State != HttpPieceDone) {
+            break;
+        }
+        Piece++;
+    }
+    if (Available <= Dl->Delivered) {
+        return EFI_SUCCESS;
+    }
+
+    EFI_STATUS Status = EFI_SUCCESS;
+    if (Dl->Callback != NULL) {
+        Status = Dl->Callback(Dl->Context, (UINT8 *)Dl->File->Buffer + Dl->Delivered,
+                              (UINTN)(Available - Dl->Delivered));
+    }
+    LoadProgressAdd(Available - Dl->Delivered);
+    bh_counters_add_read(BH_COUNTER_SOURCE_HTTP, Available - Dl->Delivered);
+    Dl->Delivered = Available;
+    return Status;
+}
+
+// Lowest-numbered piece nobody is fetching, so the delivered prefix grows
+STATIC
+BOOLEAN
+NextHttpPiece(
+    IN  HTTP_DOWNLOAD  *Dl,
+    OUT UINTN          *Piece
+) {
+    for (UINTN i = 0; i < Dl->PieceCount; i++) {
+        if (Dl->Pieces[i].State == HttpPiecePending) {
+            *Piece = i;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// A fresh cached address for Name
+STATIC
+BOOLEAN
+FindHttpDnsEntry(
+    IN  CONST CHAR8        *Name,
+    OUT EFI_IPv4_ADDRESS   *Address
+) {
+    UINT32 Now = pxe_time_ms();
+
+    for (UINTN i = 0; i < HTTP_DNS_CACHE_SIZE; i++) {
+        HTTP_DNS_ENTRY *Entry = &mHttpDnsCache[i];
+        if (Entry->Name[0] != '\0' && (INT32)(Entry->Expires - Now) > 0 &&
+            AsciiStriCmp(Entry->Name, Name) == 0) {
+            CopyMem(Address, &Entry->Address, sizeof(*Address));
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// Keep an answer for Ttl seconds, in an empty or expired slot if there is
+// one and otherwise in place of the entry that would expire first
+STATIC
+VOID
+AddHttpDnsEntry(
+    IN CONST CHAR8             *Name,
+    IN CONST EFI_IPv4_ADDRESS  *Address,
+    IN UINT32                  Ttl
+) {
+    UINT32 Now = pxe_time_ms();
+    HTTP_DNS_ENTRY *Slot = &mHttpDnsCache[0];
+
+    if (Ttl == 0 || AsciiStrLen(Name) >= HTTP_DNS_NAME_MAX) {
+        return;
+    }
+    for (UINTN i = 0; i < HTTP_DNS_CACHE_SIZE; i++) {
+        HTTP_DNS_ENTRY *Entry = &mHttpDnsCache[i];
+        if (Entry->Name[0] == '\0' || (INT32)(Entry->Expires - Now) <= 0) {
+            Slot = Entry;
+            break;
+        }
+        if ((INT32)(Entry->Expires - Slot->Expires) < 0) {
+            Slot = Entry;
+        }
+    }
+    AsciiStrCpyS(Slot->Name, sizeof(Slot->Name), Name);
+    CopyMem(&Slot->Address, Address, sizeof(*Address));
+    Slot->Expires = Now + MIN(Ttl, (UINT32)HTTP_DNS_MAX_TTL) * 1000;
+}
+
+// Frees what DNS4 hands back from a completed lookup
+STATIC
+VOID
+FreeHttpDnsAnswer(
+    IN EFI_DNS4_COMPLETION_TOKEN   *Token,
+    IN BOOLEAN                     General
+) {
+    if (General && Token->RspData.GLookupData != NULL) {
+        DNS_GENERAL_LOOKUP_DATA *Data = Token->RspData.GLookupData;
+        for (UINTN i = 0; i < Data->RRCount && Data->RRList != NULL; i++) {
+            if (Data->RRList[i].QName != NULL) {
+                FreePool(Data->RRList[i].QName);
+            }
+            if (Data->RRList[i].RData != NULL) {
+                FreePool(Data->RRList[i].RData);
+            }
+        }
+        if (Data->RRList != NULL) {
+            FreePool(Data->RRList);
+        }
+        FreePool(Data);
+    } else if (!General && Token->RspData.H2AData != NULL) {
+        if (Token->RspData.H2AData->IpList != NULL) {
+            FreePool(Token->RspData.H2AData->IpList);
+        }
+        FreePool(Token->RspData.H2AData);
+    }
+    Token->RspData.GLookupData = NULL;
+}
+
+/**
+  Runs one DNS4 lookup to completion: a general A query when General is
+  set, whose records carry the TTL, or else HostNameToIp. Asks the NIC for
+  a DHCP address first if it has none yet.
+**/
+STATIC
+EFI_STATUS
+RunHttpDnsLookup(
+    IN     HTTP_DOWNLOAD               *Dl,
+    IN     EFI_DNS4_PROTOCOL           *Dns,
+    IN     BOOLEAN                     General,
+    IN OUT EFI_DNS4_COMPLETION_TOKEN   *Token,
+    IN     EFI_EVENT                   Timer
+) {
+    HTTP_DNS_QUERY Query;
+    EFI_STATUS Status;
+
+    Query.HostName = Dl->HostName;
+    Query.General = General;
+    Query.Token = Token;
+    AsciiStrToUnicodeStrS(Dl->HostName, Query.Name, ARRAY_SIZE(Query.Name));
+    // DnsDxe reports EFI_NO_MAPPING like Configure does until the NIC has an address
+    Status = ConfigureNicChild(Dl->Nic, HttpDnsStart, Dns, &Query);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    gBS->SetTimer(Timer, TimerRelative, HTTP_DNS_TIMEOUT);
+    while (Token->Status == EFI_NOT_READY) {
+        if (gBS->CheckEvent(Timer) == EFI_SUCCESS) {
+            Dns->Cancel(Dns, Token);
+            FreeHttpDnsAnswer(Token, General);
+            return EFI_TIMEOUT;
+        }
+        Dns->Poll(Dns);
+    }
+    gBS->SetTimer(Timer, TimerCancel, 0);
+    if (EFI_ERROR(Token->Status)) {
+        FreeHttpDnsAnswer(Token, General);
+    }
+    return Token->Status;
+}
+
+/**
+  Resolves Dl->HostName to the server's address.
+
+  An IPv4 literal needs no lookup, and a name answered within its TTL
+  comes from the cache, so the files of one boot cost one query. Otherwise
+  the NIC's DNS4 service asks the DNS server DHCP handed out (what
+  NetworkConfig::dns_server holds on the C++ side), or the DNS driver's
+  own servers when there was none. A firmware DNS4 without general
+  lookups is asked with HostNameToIp and the answer cached for
+  HTTP_DNS_DEFAULT_TTL.
+**/
+STATIC
+EFI_STATUS
+ResolveHttpHost(
+    IN  HTTP_DOWNLOAD      *Dl,
+    OUT EFI_IPv4_ADDRESS   *Address
+) {
+    EFI_STATUS Status;
+    EFI_SERVICE_BINDING_PROTOCOL *Binding;
+    EFI_DNS4_PROTOCOL *Dns = NULL;
+    EFI_HANDLE Child = NULL;
+    EFI_DNS4_CONFIG_DATA Config;
+    EFI_DNS4_COMPLETION_TOKEN Token;
+    EFI_IPv4_ADDRESS Server;
+    EFI_EVENT Timer = NULL;
+    CHAR8 *End;
+    UINT32 DnsServer = pxe_get_network_info()->dns_server;
+    UINT32 Ttl = MAX_UINT32;
+    BOOLEAN Found = FALSE;
+
+    if (!RETURN_ERROR(AsciiStrToIpv4Address(Dl->HostName, &End, Address, NULL)) && *End == '\0') {
+        return EFI_SUCCESS;
+    }
+    if (FindHttpDnsEntry(Dl->HostName, Address)) {
+        return EFI_SUCCESS;
+    }
+
+    Status = gBS->HandleProtocol(Dl->Nic, &gEfiDns4ServiceBindingProtocolGuid, (VOID **)&Binding);
+    if (!EFI_ERROR(Status)) {
+        Status = Binding->CreateChild(Binding, &Child);
+    }
+    if (!EFI_ERROR(Status)) {
+        Status = gBS->HandleProtocol(Child, &gEfiDns4ProtocolGuid, (VOID **)&Dns);
+    }
+    if (!EFI_ERROR(Status)) {
+        ZeroMem(&Config, sizeof(Config));
+        if (DnsServer != 0) {
+            CopyMem(&Server, &DnsServer, sizeof(Server));  // Already in network order
+            Config.DnsServerListCount = 1;
+            Config.DnsServerList = &Server;
+        }
+        Config.UseDefaultSetting = TRUE;
+        Config.EnableDnsCache = TRUE;
+        Config.Protocol = HTTP_DNS_PROTO_UDP;
+        Status = Dns->Configure(Dns, &Config);
+    }
+    ZeroMem(&Token, sizeof(Token));
+    if (!EFI_ERROR(Status)) {
+        Status = gBS->CreateEvent(EVT_NOTIFY_SIGNAL, TPL_CALLBACK, HttpPollNotify, NULL, &Token.Event);
+    }
+    if (!EFI_ERROR(Status)) {
+        Status = gBS->CreateEvent(EVT_TIMER, 0, NULL, NULL, &Timer);
+    }
+
+    if (!EFI_ERROR(Status)) {
+        Status = RunHttpDnsLookup(Dl, Dns, TRUE, &Token, Timer);
+        if (!EFI_ERROR(Status)) {
+            // The first address, cached for as long as every record that
+            // led to it (a CNAME chain included) stays valid
+            DNS_GENERAL_LOOKUP_DATA *Data = Token.RspData.GLookupData;
+            for (UINTN i = 0; Data != NULL && i < Data->RRCount && !Found; i++) {
+                DNS_RESOURCE_RECORD *Record = &Data->RRList[i];
+                if (Record->QType == HTTP_DNS_TYPE_CNAME ||
+                    (Record->QType == HTTP_DNS_TYPE_A && Record->DataLength == sizeof(*Address))) {
+                    Ttl = MIN(Ttl, Record->TTL);
+                }
+                if (Record->QType == HTTP_DNS_TYPE_A && Record->DataLength == sizeof(*Address)) {
+                    CopyMem(Address, Record->RData, sizeof(*Address));
+                    Found = TRUE;
+                }
+            }
+            FreeHttpDnsAnswer(&Token, TRUE);
+            Status = Found ? EFI_SUCCESS : EFI_NOT_FOUND;
+        } else if (Status == EFI_UNSUPPORTED) {
+            Status = RunHttpDnsLookup(Dl, Dns, FALSE, &Token, Timer);
+            if (!EFI_ERROR(Status)) {
+                DNS_HOST_TO_ADDR_DATA *Data = Token.RspData.H2AData;
+                Found = Data != NULL && Data->IpCount != 0;
+                if (Found) {
+                    CopyMem(Address, &Data->IpList[0], sizeof(*Address));
+                    Ttl = HTTP_DNS_DEFAULT_TTL;
+                }
+                FreeHttpDnsAnswer(&Token, FALSE);
+                Status = Found ? EFI_SUCCESS : EFI_NOT_FOUND;
+            }
+        }
+    }
+    if (Found) {
+        AddHttpDnsEntry(Dl->HostName, Address, Ttl);
+    }
+
+    if (Timer != NULL) {
+        gBS->CloseEvent(Timer);
+    }
+    if (Token.Event != NULL) {
+        gBS->CloseEvent(Token.Event);
+    }
+    if (Dns != NULL) {
+        Dns->Configure(Dns, NULL);
+    }
+    if (Child != NULL) {
+        Binding->DestroyChild(Binding, Child);
+    }
+    return Status;
+}
+
+/**
+  Sets up our own client for a plain http:// URL: the NIC BloodHorn was
+  loaded from (as NVMe/TCP picks it), the server's address and the TCP4
+  options for a long fat link.
+**/
+STATIC
+EFI_STATUS
+OpenHttpTcpService(
+    IN OUT HTTP_DOWNLOAD *Dl
+) {
+    EFI_STATUS Status;
+    EFI_LOADED_IMAGE_PROTOCOL *LoadedImage = NULL;
+    EFI_HANDLE *Handles = NULL;
+    UINTN HandleCount = 0;
+
+    if (gBloodHornNicHandle != NULL &&
+        !EFI_ERROR(gBS->HandleProtocol(gBloodHornNicHandle, &gEfiTcp4ServiceBindingProtocolGuid,
+                                       (VOID **)&Dl->Binding))) {
+        Dl->Nic = gBloodHornNicHandle;
+    } else if (!EFI_ERROR(gBS->HandleProtocol(gImageHandle, &gEfiLoadedImageProtocolGuid, (VOID **)&LoadedImage)) &&
+               !EFI_ERROR(gBS->HandleProtocol(LoadedImage->DeviceHandle, &gEfiTcp4ServiceBindingProtocolGuid,
+                                              (VOID **)&Dl->Binding))) {
+        Dl->Nic = LoadedImage->DeviceHandle;
+    } else {
+        Status = gBS->LocateHandleBuffer(ByProtocol, &gEfiTcp4ServiceBindingProtocolGuid, NULL,
+                                         &HandleCount, &Handles);
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+        Dl->Nic = Handles[0];
+        FreePool(Handles);
+        Status = gBS->HandleProtocol(Dl->Nic, &gEfiTcp4ServiceBindingProtocolGuid, (VOID **)&Dl->Binding);
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+    }
+
+    ZeroMem(&Dl->TcpConfig, sizeof(Dl->TcpConfig));
+    ZeroMem(&Dl->TcpOption, sizeof(Dl->TcpOption));
+    Status = ResolveHttpHost(Dl, &Dl->TcpConfig.AccessPoint.RemoteAddress);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    Dl->TcpOption.ReceiveBufferSize = HTTP_TCP_RECEIVE_BUFFER;
+    Dl->TcpOption.EnableNagle = FALSE;
+    Dl->TcpOption.EnableTimeStamp = TRUE;
+    Dl->TcpOption.EnableWindowScaling = TRUE;
+    Dl->TcpConfig.TimeToLive = 64;
+    Dl->TcpConfig.AccessPoint.UseDefaultAddress = TRUE;
+    Dl->TcpConfig.AccessPoint.ActiveFlag = TRUE;
+    Dl->TcpConfig.AccessPoint.RemotePort = Dl->Port;
+    Dl->TcpConfig.ControlOption = &Dl->TcpOption;
+
+    Dl->UseTcp = TRUE;
+    Status = OpenHttpConnection(Dl, &Dl->Conn[0]);
+    if (EFI_ERROR(Status)) {
+        Dl->UseTcp = FALSE;
+    } else {
+        Dl->ConnCount = 1;
+    }
+    return Status;
+}
+
+/**
+  Finds an HTTP-capable NIC and opens the first connection on it.
+**/
+STATIC
+EFI_STATUS
+OpenHttpService(
+    IN OUT HTTP_DOWNLOAD *Dl
+) {
+    EFI_STATUS Status;
+    EFI_HANDLE *Handles = NULL;
+    UINTN HandleCount = 0;
+
+    // Plain http:// goes over our own client when the NIC has TCP4, and
+    // through HttpDxe otherwise
+    if (Dl->Path != NULL && !EFI_ERROR(OpenHttpTcpService(Dl))) {
+        return EFI_SUCCESS;
+    }
+
+    Status = gBS->LocateHandleBuffer(ByProtocol, &gEfiHttpServiceBindingProtocolGuid, NULL,
+                                     &HandleCount, &Handles);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    Status = EFI_NOT_FOUND;
+    for (UINTN i = 0; i < HandleCount && EFI_ERROR(Status); i++) {
+        Dl->Nic = Handles[i];
+        Status = gBS->HandleProtocol(Handles[i], &gEfiHttpServiceBindingProtocolGuid, (VOID **)&Dl->Binding);
+        if (!EFI_ERROR(Status)) {
+            Status = OpenHttpConnection(Dl, &Dl->Conn[0]);
+        }
+    }
+    FreePool(Handles);
+    if (!EFI_ERROR(Status)) {
+        Dl->ConnCount = 1;
+    }
+    return Status;
+}
+
+/**
+  Starts a download over again through HttpDxe, for a response our own
+  client does not read (oversized headers, a chunked body).
+**/
+STATIC
+EFI_STATUS
+RestartHttpDownload(
+    IN OUT HTTP_DOWNLOAD *Dl
+) {
+    EFI_STATUS Status;
+
+    for (UINTN i = 0; i < Dl->ConnCount; i++) {
+        CloseHttpConnection(Dl, &Dl->Conn[i]);
+    }
+    if (Dl->Pieces != NULL) {
+        FreePool(Dl->Pieces);
+    }
+    FreeLoadedFile(Dl->File);
+    FreePool(Dl->Path);
+    Dl->Path = NULL;
+    Dl->UseTcp = FALSE;
+    Dl->ConnCount = 0;
+    Dl->Pieces = NULL;
+    Dl->Sized = FALSE;
+    Dl->Ranges = FALSE;
+    Dl->Total = 0;
+    Dl->PieceSize = HTTP_PIECE_SIZE;
+    Dl->PieceCount = 0;
+    Dl->Retries = 0;
+
+    Status = OpenHttpService(Dl);
+    if (!EFI_ERROR(Status)) {
+        Status = StartHttpRequest(Dl, &Dl->Conn[0], 0);
+    }
+    return Status;
+}
+
+/**
+  Splits Url for the request: the Host header value (the host name, plus
+  the port if one is given) and, for plain http:// that our own client can
+  send, the bare host name, port and request target. Path stays NULL when
+  the URL needs HttpDxe.
+**/
+STATIC
+EFI_STATUS
+GetHttpHost(
+    IN OUT HTTP_DOWNLOAD *Dl
+) {
+    EFI_STATUS Status;
+    CHAR8 *AsciiUrl;
+    UINTN Length = StrLen(Dl->Url) + 1;
+    VOID *Parser = NULL;
+    CHAR8 *Name = NULL;
+    UINT16 Port = HTTP_TCP_DEFAULT_PORT;
+    BOOLEAN HasPort = FALSE;
+
+    AsciiUrl = AllocatePool(Length);
+    if (AsciiUrl == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    Status = UnicodeStrToAsciiStrS(Dl->Url, AsciiUrl, Length);
+    if (!EFI_ERROR(Status)) {
+        Status = HttpParseUrl(AsciiUrl, (UINT32)AsciiStrLen(AsciiUrl), FALSE, &Parser);
+    }
+    if (!EFI_ERROR(Status)) {
+        Status = HttpUrlGetHostName(AsciiUrl, Parser, &Name);
+    }
+    if (!EFI_ERROR(Status)) {
+        HasPort = !EFI_ERROR(HttpUrlGetPort(AsciiUrl, Parser, &Port));
+        if (!HasPort) {
+            Dl->Host = AllocateCopyPool(AsciiStrSize(Name), Name);
+        } else {
+            UINTN Size = AsciiStrLen(Name) + 8;
+            Dl->Host = AllocatePool(Size);
+            if (Dl->Host != NULL) {
+                AsciiSPrint(Dl->Host, Size, "%a:%d", Name, Port);
+            }
+        }
+        Status = Dl->Host != NULL ? EFI_SUCCESS : EFI_OUT_OF_RESOURCES;
+    }
+
+    // The target is everything after the authority but the fragment. An
+    // IPv6 literal or a target too long for our request goes to HttpDxe.
+    if (!EFI_ERROR(Status) && AsciiStrnCmp(AsciiUrl, "http://", 7) == 0 &&
+        AsciiStrStr(Name, ":") == NULL && AsciiStrLen(Name) < HTTP_DNS_NAME_MAX) {
+        CHAR8 *Target = AsciiUrl + 7;
+        CHAR8 *Fragment;
+        while (*Target != '\0' && *Target != '/' && *Target != '?' && *Target != '#') {
+            Target++;
+        }
+        Fragment = AsciiStrStr(Target, "#");
+        if (Fragment != NULL) {
+            *Fragment = '\0';
+        }
+        Length = AsciiStrLen(Target);
+        if (Length + AsciiStrLen(Dl->Host) + 128 < HTTP_REQUEST_MAX) {
+            Dl->Path = AllocatePool(Length + 2);
+            if (Dl->Path != NULL) {
+                AsciiSPrint(Dl->Path, Length + 2, "%a%a", *Target == '/' ? "" : "/", Target);
+                Dl->HostName = Name;
+                Dl->Port = Port;
+                Name = NULL;
+            }
+        }
+    }
+
+    if (Name != NULL) {
+        FreePool(Name);
+    }
+    if (Parser != NULL) {
+        HttpUrlFreeParser(Parser);
+    }
+    FreePool(AsciiUrl);
+    return Status;
+}
+
+/**
+  Downloads a file over HTTP or HTTPS.
+
+  The file is fetched as HTTP_PIECE_SIZE byte ranges over up to
+  HTTP_MAX_CONNECTIONS keep-alive connections, each range landing at its
+  final offset in the destination buffer. Callback sees the file in order,
+  as the completed prefix grows, so the image is hashed while later ranges
+  are still arriving. A connection that drops or stalls is reset and its
+  range re-requested from the last byte received. Servers that ignore
+  Range are read over one connection. HTTPS uses the firmware's TLS stack
+  and its configured CA certificates.
+
+  @param[in]  Url         http:// or https:// URL of the file.
+  @param[in]  Flags       FILE_LOAD_POOL, FILE_LOAD_PAGES and FILE_LOAD_TEXT
+                          (LoadBootFile adds FILE_LOAD_DECOMPRESS on top).
+  @param[in]  Callback    Optional in-order per-chunk callback.
+  @param[in]  Context     Opaque pointer passed to Callback.
+  @param[out] File        Receives the buffer and its size.
+
+  @retval EFI_SUCCESS     The file was downloaded.
+  @retval EFI_NOT_FOUND   No HTTP-capable NIC, or the server has no such file.
+  @retval EFI_TIMEOUT     Connections kept dropping without progress.
+  @retval Other           An error occurred; File is left empty.
+**/
+EFI_STATUS
+LoadHttpFile(
+    IN  CONST CHAR16                *Url,
+    IN  UINT32                      Flags,
+    IN  FILE_LOAD_CHUNK_CALLBACK    Callback OPTIONAL,
+    IN  VOID                        *Context OPTIONAL,
+    OUT LOADED_FILE                 *File
+) {
+    EFI_STATUS Status;
+    HTTP_DOWNLOAD *Dl;
+
+    if (Url == NULL || File == NULL) {
+        return EFI_INVALID_PARAMETER;
+    }
+    ZeroMem(File, sizeof(*File));
+
+    Dl = AllocateZeroPool(sizeof(*Dl));
+    if (Dl == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    Dl->Url = (CHAR16 *)Url;
+    Dl->Flags = Flags & (FILE_LOAD_PAGES | FILE_LOAD_TEXT);
+    Dl->File = File;
+    Dl->Callback = Callback;
+    Dl->Context = Context;
+    Dl->PieceSize = HTTP_PIECE_SIZE;
+    Dl->Ipv4.UseDefaultAddress = TRUE;
+    Dl->Config.HttpVersion = HttpVersion11;
+    Dl->Config.TimeOutMillisec = (UINT32)(HTTP_STALL_TIMEOUT / 10000);
+    Dl->Config.LocalAddressIsIPv6 = FALSE;
+    Dl->Config.AccessPoint.IPv4Node = &Dl->Ipv4;
+
+    BH_TRACE_BEGIN(FetchSpan, BH_TRACE_PHASE_NET_FETCH);
+    LoadProgressBegin(Url, 0);
+    Status = GetHttpHost(Dl);
+    if (!EFI_ERROR(Status)) {
+        Status = OpenHttpService(Dl);
+    }
+    if (!EFI_ERROR(Status)) {
+        // The probe: the first piece's range also tells us the size and
+        // whether the server does ranges at all
+        Status = StartHttpRequest(Dl, &Dl->Conn[0], 0);
+    }
+
+    while (!EFI_ERROR(Status) && !(Dl->Sized && Dl->Delivered == Dl->Total)) {
+        // Once sized, a ranged download gets its other connections
+        while (Dl->Sized && Dl->Ranges && Dl->ConnCount < MIN((UINTN)HTTP_MAX_CONNECTIONS, Dl->PieceCount)) {
+            if (EFI_ERROR(OpenHttpConnection(Dl, &Dl->Conn[Dl->ConnCount]))) {
+                break;
+            }
+            Dl->ConnCount++;
+        }
+
+        BOOLEAN Busy = FALSE;
+        for (UINTN i = 0; i < Dl->ConnCount && !EFI_ERROR(Status); i++) {
+            HTTP_CONNECTION *Conn = &Dl->Conn[i];
+            UINTN Piece = 0;
+
+            if (Conn->State == HttpConnIdle) {
+                if (Dl->Sized ? !NextHttpPiece(Dl, &Piece) : i != 0) {
+                    continue;
+                }
+                if (EFI_ERROR(StartHttpRequest(Dl, Conn, Piece))) {
+                    Status = DropHttpConnection(Dl, Conn);
+                    continue;
+                }
+            }
+
+            Busy = TRUE;
+            if (Conn->Tcp != NULL) {
+                Status = PumpHttpTcp(Dl, Conn);
+                if (!EFI_ERROR(Status) && Conn->State != HttpConnIdle &&
+                    gBS->CheckEvent(Conn->Timeout) == EFI_SUCCESS) {
+                    Status = DropHttpConnection(Dl, Conn);
+                }
+                continue;
+            }
+            Conn->Http->Poll(Conn->Http);
+            if (Conn->Done) {
+                Status = PumpHttpConnection(Dl, Conn);
+            } else if (gBS->CheckEvent(Conn->Timeout) == EFI_SUCCESS) {
+                Status = DropHttpConnection(Dl, Conn);
+            }
+        }
+
+        if (Status == EFI_UNSUPPORTED && Dl->UseTcp && Dl->Delivered == 0) {
+            Status = RestartHttpDownload(Dl);
+        }
+        if (Status == EFI_END_OF_FILE) {
+            Status = EFI_SUCCESS;   // Empty file: the loop condition now holds
+        }
+        if (!EFI_ERROR(Status) && Dl->Sized) {
+            Status = DeliverHttpData(Dl);
+        }
+        if (!EFI_ERROR(Status) && !Busy && Dl->Sized && Dl->Delivered != Dl->Total) {
+            Status = EFI_DEVICE_ERROR;  // Nothing in flight and nothing left to ask for
+        }
+    }
+
+
+    LoadProgressEnd();
+
+    for (UINTN i = 0; i < Dl->ConnCount; i++) {
+        CloseHttpConnection(Dl, &Dl->Conn[i]);
+    }
+    if (Dl->Pieces != NULL) {
+        FreePool(Dl->Pieces);
+    }
+    if (Dl->Host != NULL) {
+        FreePool(Dl->Host);
+    }
+    if (Dl->HostName != NULL) {
+        FreePool(Dl->HostName);
+    }
+    if (Dl->Path != NULL) {
+        FreePool(Dl->Path);
+    }
+    BH_TRACE_END(FetchSpan);
+
+    if (!EFI_ERROR(Status)) {
+        if (Flags & FILE_LOAD_TEXT) {
+            ((UINT8 *)File->Buffer)[Dl->Total] = 0;
+        }
+        File->Size = (UINTN)Dl->Total;
+        File->Flags = Flags;
+    } else {
+        FreeLoadedFile(File);
+    }
+    FreePool(Dl);
+    return Status;
+}
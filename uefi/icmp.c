@@ -0,0 +1,375 @@
+/*
+ * icmp.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <Uefi.h>
+#include "compat.h"
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/BaseLib.h>
+#include <Library/TimerLib.h>
+#include <Protocol/LoadedImage.h>
+#include <Protocol/Ip4.h>
+#include <Protocol/Ip4Config2.h>
+#include <Protocol/ServiceBinding.h>
+#include "uefi.h"
+#include "../net/net_utils.h"
+
+#define IPV4_PROTO_ICMP         1
+#define ICMP_TYPE_ECHO_REPLY    0
+#define ICMP_TYPE_ECHO_REQUEST  8
+#define ICMP_ECHO_ID            0xB10D
+#define ICMP_PAYLOAD_SIZE       56
+
+// Echo requests handed to IP4 at once. IP4 parks a request in ARP until
+// the neighbour answers, so a window this size resolves a subnet's worth
+// of neighbours in parallel instead of one ARP timeout per silent host.
+#define ICMP_TX_WINDOW          32
+
+#pragma pack(1)
+typedef struct {
+    UINT8   Type;
+    UINT8   Code;
+    UINT16  Checksum;
+    UINT16  Id;
+    UINT16  Sequence;
+    UINT8   Payload[ICMP_PAYLOAD_SIZE];
+} ICMP_ECHO;
+#pragma pack()
+
+typedef struct {
+    EFI_IP4_COMPLETION_TOKEN    Token;
+    EFI_IP4_TRANSMIT_DATA       TxData;
+    ICMP_ECHO                   Echo;
+    UINTN                       Target;     // Index into the sweep's targets
+    BOOLEAN                     Busy;
+} ICMP_TX_SLOT;
+
+typedef struct {
+    EFI_HANDLE                      Nic;
+    EFI_SERVICE_BINDING_PROTOCOL    *Binding;
+    EFI_HANDLE                      Child;
+    EFI_IP4_PROTOCOL                *Ip4;
+    EFI_IP4_COMPLETION_TOKEN        Rx;
+    ICMP_TX_SLOT                    Tx[ICMP_TX_WINDOW];
+} ICMP_SESSION;
+
+extern EFI_HANDLE gBloodHornNicHandle;
+
+STATIC
+VOID
+EFIAPI
+IcmpTokenNotify(
+    IN EFI_EVENT    Event,
+    IN VOID         *Context
+) {
+}
+
+STATIC
+UINT64
+ElapsedUs(
+    IN UINT64 Start,
+    IN UINT64 Now
+) {
+    UINT64 StartValue, EndValue;
+    GetPerformanceCounterProperties(&StartValue, &EndValue);
+    return GetTimeInNanoSecond(EndValue >= StartValue ? Now - Start : Start - Now) / 1000;
+}
+
+/**
+  Find the IP4 service binding on the NIC discovery selected, else on the
+  one BloodHorn was loaded from, else on the first NIC that has one.
+**/
+STATIC
+EFI_STATUS
+FindIp4Binding(
+    OUT ICMP_SESSION *Session
+) {
+    EFI_LOADED_IMAGE_PROTOCOL *LoadedImage = NULL;
+    EFI_HANDLE *Handles = NULL;
+    UINTN HandleCount = 0;
+    EFI_STATUS Status;
+
+    if (gBloodHornNicHandle != NULL &&
+        !EFI_ERROR(gBS->HandleProtocol(gBloodHornNicHandle, &gEfiIp4ServiceBindingProtocolGuid,
+                                       (VOID **)&Session->Binding))) {
+        Session->Nic = gBloodHornNicHandle;
+        return EFI_SUCCESS;
+    }
+    if (!EFI_ERROR(gBS->HandleProtocol(gImageHandle, &gEfiLoadedImageProtocolGuid, (VOID **)&LoadedImage)) &&
+        !EFI_ERROR(gBS->HandleProtocol(LoadedImage->DeviceHandle, &gEfiIp4ServiceBindingProtocolGuid,
+                                       (VOID **)&Session->Binding))) {
+        Session->Nic = LoadedImage->DeviceHandle;
+        return EFI_SUCCESS;
+    }
+    Status = gBS->LocateHandleBuffer(ByProtocol, &gEfiIp4ServiceBindingProtocolGuid, NULL, &HandleCount, &Handles);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    Session->Nic = Handles[0];
+    FreePool(Handles);
+    return gBS->HandleProtocol(Session->Nic, &gEfiIp4ServiceBindingProtocolGuid, (VOID **)&Session->Binding);
+}
+
+STATIC
+EFI_STATUS
+IcmpConfigure(
+    IN VOID *Child,
+    IN VOID *Config
+) {
+    return ((EFI_IP4_PROTOCOL *)Child)->Configure((EFI_IP4_PROTOCOL *)Child, (EFI_IP4_CONFIG_DATA *)Config);
+}
+
+/**
+  Configure the IP4 child for ICMP on the NIC's default address, asking for
+  a DHCP address first if it has none yet.
+**/
+STATIC
+EFI_STATUS
+ConfigureIcmp(
+    IN ICMP_SESSION *Session
+) {
+    EFI_IP4_CONFIG_DATA Config;
+
+    ZeroMem(&Config, sizeof(Config));
+    Config.DefaultProtocol = IPV4_PROTO_ICMP;
+    Config.UseDefaultAddress = TRUE;
+    Config.TimeToLive = 64;
+
+    return ConfigureNicChild(Session->Nic, IcmpConfigure, Session->Ip4, &Config);
+}
+
+STATIC
+EFI_STATUS
+PostIcmpReceive(
+    IN ICMP_SESSION *Session
+) {
+    Session->Rx.Status = EFI_NOT_READY;
+    Session->Rx.Packet.RxData = NULL;
+    return Session->Ip4->Receive(Session->Ip4, &Session->Rx);
+}
+
+STATIC
+VOID
+CloseIcmpSession(
+    IN ICMP_SESSION *Session
+) {
+    if (Session->Ip4 != NULL) {
+        Session->Ip4->Cancel(Session->Ip4, NULL);
+        if (Session->Rx.Status == EFI_SUCCESS && Session->Rx.Packet.RxData != NULL) {
+            gBS->SignalEvent(Session->Rx.Packet.RxData->RecycleSignal);
+        }
+        Session->Ip4->Configure(Session->Ip4, NULL);
+    }
+    if (Session->Rx.Event != NULL) {
+        gBS->CloseEvent(Session->Rx.Event);
+    }
+    for (UINTN i = 0; i < ICMP_TX_WINDOW; i++) {
+        if (Session->Tx[i].Token.Event != NULL) {
+            gBS->CloseEvent(Session->Tx[i].Token.Event);
+        }
+    }
+    if (Session->Child != NULL) {
+        Session->Binding->DestroyChild(Session->Binding, Session->Child);
+    }
+}
+
+STATIC
+EFI_STATUS
+OpenIcmpSession(
+    OUT ICMP_SESSION *Session
+) {
+    EFI_STATUS Status;
+
+    ZeroMem(Session, sizeof(*Session));
+    Status = FindIp4Binding(Session);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    Status = Session->Binding->CreateChild(Session->Binding, &Session->Child);
+    if (EFI_ERROR(Status)) {
+        Session->Child = NULL;
+        return Status;
+    }
+    Status = gBS->HandleProtocol(Session->Child, &gEfiIp4ProtocolGuid, (VOID **)&Session->Ip4);
+    if (!EFI_ERROR(Status)) {
+        Status = ConfigureIcmp(Session);
+    }
+    if (EFI_ERROR(Status)) {
+        Session->Ip4 = NULL;
+        CloseIcmpSession(Session);
+        return Status;
+    }
+
+    Status = gBS->CreateEvent(EVT_NOTIFY_SIGNAL, TPL_CALLBACK, IcmpTokenNotify, NULL, &Session->Rx.Event);
+    for (UINTN i = 0; i < ICMP_TX_WINDOW && !EFI_ERROR(Status); i++) {
+        Status = gBS->CreateEvent(EVT_NOTIFY_SIGNAL, TPL_CALLBACK, IcmpTokenNotify, NULL,
+                                  &Session->Tx[i].Token.Event);
+    }
+    // IP4 queues what arrives for the child until a token is posted, so one
+    // receive token reposted after each packet loses nothing
+    if (!EFI_ERROR(Status)) {
+        Status = PostIcmpReceive(Session);
+    }
+    if (EFI_ERROR(Status)) {
+        CloseIcmpSession(Session);
+    }
+    return Status;
+}
+
+/**
+  Take the packet on the receive token, if one arrived, and repost it.
+
+  @retval TRUE   A packet was consumed; Index is the target an echo reply in
+                 it answers, or Count if it is something else.
+  @retval FALSE  Nothing has arrived.
+**/
+STATIC
+BOOLEAN
+TakeIcmpReply(
+    IN  ICMP_SESSION    *Session,
+    IN  CONST UINT32    *Targets,
+    IN  UINTN           Count,
+    IN  UINT16          Sequence,
+    OUT UINTN           *Index
+) {
+    EFI_IP4_RECEIVE_DATA *RxData;
+    ICMP_ECHO Reply;
+    UINT32 Source;
+    UINTN Copied = 0;
+
+    if (Session->Rx.Status == EFI_NOT_READY) {
+        return FALSE;
+    }
+    *Index = Count;
+    RxData = Session->Rx.Packet.RxData;
+    if (Session->Rx.Status == EFI_SUCCESS && RxData != NULL) {
+        // The ICMP header may be split across fragments
+        for (UINT32 f = 0; f < RxData->FragmentCount && Copied < OFFSET_OF(ICMP_ECHO, Payload); f++) {
+            UINTN Take = MIN((UINTN)RxData->FragmentTable[f].FragmentLength, sizeof(Reply) - Copied);
+            CopyMem((UINT8 *)&Reply + Copied, RxData->FragmentTable[f].FragmentBuffer, Take);
+            Copied += Take;
+        }
+        CopyMem(&Source, &RxData->Header->SourceAddress, sizeof(Source));
+        if (Copied >= OFFSET_OF(ICMP_ECHO, Payload) && Reply.Type == ICMP_TYPE_ECHO_REPLY &&
+            Reply.Id == SwapBytes16(ICMP_ECHO_ID)) {
+            UINTN Slot = (UINT16)(SwapBytes16(Reply.Sequence) - Sequence);
+            if (Slot < Count && Targets[Slot] == Source) {
+                *Index = Slot;
+            }
+        }
+        gBS->SignalEvent(RxData->RecycleSignal);
+    }
+    PostIcmpReceive(Session);
+    return TRUE;
+}
+
+EFI_STATUS
+IcmpEchoSweep(
+    IN  CONST UINT32    *Targets,
+    IN  UINTN           Count,
+    IN  UINT16          Sequence,
+    IN  UINT32          TimeoutMs,
+    OUT UINT32          *RttUs
+) {
+    ICMP_SESSION *Session;
+    UINT64 *SentAt;
+    UINTN Next = 0, Answered = 0, Index;
+    UINT64 LastSent = 0;
+    EFI_STATUS Status;
+
+    if (Targets == NULL || RttUs == NULL || Count == 0 || Count > MAX_UINT16) {
+        return EFI_INVALID_PARAMETER;
+    }
+    Session = AllocatePool(sizeof(*Session));
+    SentAt = AllocatePool(Count * sizeof(*SentAt));
+    if (Session == NULL || SentAt == NULL) {
+        if (Session != NULL) {
+            FreePool(Session);
+        }
+        if (SentAt != NULL) {
+            FreePool(SentAt);
+        }
+        return EFI_OUT_OF_RESOURCES;
+    }
+    for (UINTN i = 0; i < Count; i++) {
+        RttUs[i] = ICMP_NO_REPLY;
+    }
+    Status = OpenIcmpSession(Session);
+    if (EFI_ERROR(Status)) {
+        FreePool(Session);
+        FreePool(SentAt);
+        return Status;
+    }
+
+    for (;;) {
+        // Refill the window from completed transmit tokens
+        for (UINTN s = 0; s < ICMP_TX_WINDOW; s++) {
+            ICMP_TX_SLOT *Slot = &Session->Tx[s];
+            if (Slot->Busy) {
+                if (Slot->Token.Status == EFI_NOT_READY) {
+                    continue;
+                }
+                // Unroutable, or ARP gave up: nothing will answer
+                if (EFI_ERROR(Slot->Token.Status) && RttUs[Slot->Target] == ICMP_NO_REPLY) {
+                    Answered++;
+                }
+                Slot->Busy = FALSE;
+            }
+            if (Next == Count) {
+                continue;
+            }
+
+            ZeroMem(&Slot->Echo, sizeof(Slot->Echo));
+            Slot->Echo.Type = ICMP_TYPE_ECHO_REQUEST;
+            Slot->Echo.Id = SwapBytes16(ICMP_ECHO_ID);
+            Slot->Echo.Sequence = SwapBytes16((UINT16)(Sequence + Next));
+            SetMem(Slot->Echo.Payload, sizeof(Slot->Echo.Payload), 0xA5);
+            Slot->Echo.Checksum = SwapBytes16(net_checksum((CONST UINT8 *)&Slot->Echo, sizeof(Slot->Echo)));
+
+            ZeroMem(&Slot->TxData, sizeof(Slot->TxData));
+            CopyMem(&Slot->TxData.DestinationAddress, &Targets[Next], sizeof(EFI_IPv4_ADDRESS));
+            Slot->TxData.TotalDataLength = sizeof(Slot->Echo);
+            Slot->TxData.FragmentCount = 1;
+            Slot->TxData.FragmentTable[0].FragmentLength = sizeof(Slot->Echo);
+            Slot->TxData.FragmentTable[0].FragmentBuffer = &Slot->Echo;
+            Slot->Token.Status = EFI_NOT_READY;
+            Slot->Token.Packet.TxData = &Slot->TxData;
+            Slot->Target = Next;
+
+            SentAt[Next] = GetPerformanceCounter();
+            LastSent = SentAt[Next];
+            if (EFI_ERROR(Session->Ip4->Transmit(Session->Ip4, &Slot->Token))) {
+                Answered++;
+            } else {
+                Slot->Busy = TRUE;
+            }
+            Next++;
+        }
+
+        Session->Ip4->Poll(Session->Ip4);
+        while (TakeIcmpReply(Session, Targets, Count, Sequence, &Index)) {
+            if (Index < Count && Index < Next && RttUs[Index] == ICMP_NO_REPLY) {
+                RttUs[Index] = (UINT32)MIN(ElapsedUs(SentAt[Index], GetPerformanceCounter()), MAX_UINT32 - 1);
+                Answered++;
+            }
+        }
+
+        if (Answered >= Count) {
+            break;
+        }
+        // The timeout runs from the last request sent
+        if (Next == Count && ElapsedUs(LastSent, GetPerformanceCounter()) >= (UINT64)TimeoutMs * 1000) {
+            break;
+        }
+    }
+
+    CloseIcmpSession(Session);
+    FreePool(Session);
+    FreePool(SentAt);
+    return EFI_SUCCESS;
+}
@@ -0,0 +1,316 @@
+/*
+ * linuxefi.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <Uefi.h>
+#include "compat.h"
+#include <Library/UefiLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/DevicePathLib.h>
+#include <Protocol/LoadedImage.h>
+#include <Protocol/LoadFile2.h>
+#include "../boot/BootManagerProtocol/BootManagerProtocol.h"
+#include "../net/pxe.h"
+#include "uefi.h"
+
+// Vendor media node under which an EFI-stub kernel (5.8+) looks for a
+// LoadFile2 protocol that hands it the initrd
+#define LINUX_EFI_INITRD_MEDIA_GUID \
+    { 0x5568e427, 0x68fc, 0x4f3d, { 0xac, 0x74, 0xca, 0x55, 0x52, 0x31, 0xcc, 0x68 } }
+
+#pragma pack(1)
+typedef struct {
+    VENDOR_DEVICE_PATH          Vendor;
+    EFI_DEVICE_PATH_PROTOCOL    End;
+} INITRD_DEVICE_PATH;
+#pragma pack()
+
+STATIC INITRD_DEVICE_PATH mInitrdDevicePath = {
+    {
+        { MEDIA_DEVICE_PATH, MEDIA_VENDOR_DP, { sizeof(VENDOR_DEVICE_PATH), 0 } },
+        LINUX_EFI_INITRD_MEDIA_GUID
+    },
+    { END_DEVICE_PATH_TYPE, END_ENTIRE_DEVICE_PATH_SUBTYPE, { sizeof(EFI_DEVICE_PATH_PROTOCOL), 0 } }
+};
+
+// Parts of an initrd list ("a;b;c") are handed over as one buffer, each
+// 4-byte aligned as the kernel's cpio unpacker expects; their reads are
+// in flight together, so this is also LoadBootFiles' batch limit
+#define LINUX_EFI_MAX_INITRDS   FILE_LOAD_MAX_CONCURRENT
+
+// One part of the initrd on offer. A file on the boot volume is read only
+// when the kernel asks for it, straight into the buffer the kernel
+// allocated; a download has no size until it is in, so it is fetched up
+// front.
+typedef struct {
+    CONST CHAR16    *Path;
+    UINT64          Size;       // As stored: the kernel unpacks compressed initramfs itself
+    UINT64          Offset;     // Within the kernel's buffer
+    LOADED_FILE     Staged;     // Downloaded copy, empty for files on the volume
+} LINUX_EFI_INITRD_PART;
+
+typedef struct {
+    CHAR16                  Paths[512];     // The list, split in place
+    LINUX_EFI_INITRD_PART   Part[LINUX_EFI_MAX_INITRDS];
+    UINTN                   Count;
+    UINT64                  Size;           // Whole buffer, padding included
+    EFI_HANDLE              Handle;         // Handle carrying the device path and LoadFile2
+} LINUX_EFI_INITRD;
+
+STATIC LINUX_EFI_INITRD mInitrd;
+
+/**
+  LoadFile2 for the initrd media path. The kernel calls it once without a
+  buffer to learn the size, then with a buffer of its own placement, into
+  which every part is read at its offset with the padding zeroed.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+InitrdLoadFile(
+    IN     EFI_LOAD_FILE2_PROTOCOL  *This,
+    IN     EFI_DEVICE_PATH_PROTOCOL *FilePath,
+    IN     BOOLEAN                  BootPolicy,
+    IN OUT UINTN                    *BufferSize,
+    IN     VOID                     *Buffer OPTIONAL
+) {
+    FILE_LOAD_REQUEST Requests[LINUX_EFI_MAX_INITRDS];
+    UINTN Queued = 0;
+
+    if (BootPolicy) {
+        return EFI_UNSUPPORTED;
+    }
+    if (BufferSize == NULL || FilePath == NULL || !IsDevicePathEnd(FilePath)) {
+        return EFI_INVALID_PARAMETER;
+    }
+    if (Buffer == NULL || *BufferSize < mInitrd.Size) {
+        *BufferSize = (UINTN)mInitrd.Size;
+        return EFI_BUFFER_TOO_SMALL;
+    }
+
+    *BufferSize = (UINTN)mInitrd.Size;
+    ZeroMem(Requests, sizeof(Requests));
+    for (UINTN i = 0; i < mInitrd.Count; i++) {
+        LINUX_EFI_INITRD_PART *Part = &mInitrd.Part[i];
+        UINT8 *Destination = (UINT8 *)Buffer + Part->Offset;
+        UINT64 End = (i + 1 < mInitrd.Count) ? mInitrd.Part[i + 1].Offset : mInitrd.Size;
+
+        ZeroMem(Destination + Part->Size, (UINTN)(End - Part->Offset - Part->Size));
+        if (Part->Staged.Buffer != NULL) {
+            CopyMem(Destination, Part->Staged.Buffer, Part->Staged.Size);
+            continue;
+        }
+        Requests[Queued].FileName = Part->Path;
+        Requests[Queued].Flags = FILE_LOAD_POOL;
+        Requests[Queued].Destination = Destination;
+        Requests[Queued].Capacity = (UINTN)Part->Size;
+        Queued++;
+    }
+    return Queued > 0 ? LoadBootFiles(Requests, Queued) : EFI_SUCCESS;
+}
+
+STATIC EFI_LOAD_FILE2_PROTOCOL mInitrdLoadFile = { InitrdLoadFile };
+
+STATIC
+VOID
+UninstallInitrdLoadFile(VOID) {
+    if (mInitrd.Handle != NULL) {
+        gBS->UninstallMultipleProtocolInterfaces(mInitrd.Handle,
+                                                 &gEfiDevicePathProtocolGuid, &mInitrdDevicePath,
+                                                 &gEfiLoadFile2ProtocolGuid, &mInitrdLoadFile,
+                                                 NULL);
+    }
+    for (UINTN i = 0; i < mInitrd.Count; i++) {
+        FreeLoadedFile(&mInitrd.Part[i].Staged);
+    }
+    ZeroMem(&mInitrd, sizeof(mInitrd));
+}
+
+/**
+  Offers InitrdPath, a file or a ';'-separated list of them, on the
+  initrd media path. Refused with EFI_ALREADY_STARTED if something (a
+  shim, an earlier loader) already offers one, since the kernel would take
+  whichever it finds first.
+**/
+STATIC
+EFI_STATUS
+InstallInitrdLoadFile(
+    IN CONST CHAR16 *InitrdPath
+) {
+    EFI_DEVICE_PATH_PROTOCOL *DevicePath = (EFI_DEVICE_PATH_PROTOCOL *)&mInitrdDevicePath;
+    EFI_HANDLE Existing;
+    EFI_STATUS Status;
+
+    if (!EFI_ERROR(gBS->LocateDevicePath(&gEfiLoadFile2ProtocolGuid, &DevicePath, &Existing)) &&
+        IsDevicePathEnd(DevicePath)) {
+        return EFI_ALREADY_STARTED;
+    }
+
+    ZeroMem(&mInitrd, sizeof(mInitrd));
+    Status = StrCpyS(mInitrd.Paths, ARRAY_SIZE(mInitrd.Paths), InitrdPath);
+    for (CHAR16 *Path = mInitrd.Paths; !EFI_ERROR(Status) && *Path != L'\0'; ) {
+        CHAR16 *End = Path;
+        while (*End != L'\0' && *End != L';') {
+            End++;
+        }
+        BOOLEAN Last = (*End == L'\0');
+        *End = L'\0';
+        while (*Path == L' ') {
+            Path++;
+        }
+        for (CHAR16 *Tail = End; Tail > Path && Tail[-1] == L' '; Tail--) {
+            Tail[-1] = L'\0';
+        }
+
+        if (*Path != L'\0') {
+            LINUX_EFI_INITRD_PART *Part = &mInitrd.Part[mInitrd.Count];
+            if (mInitrd.Count == LINUX_EFI_MAX_INITRDS) {
+                Status = EFI_BUFFER_TOO_SMALL;
+                break;
+            }
+            Part->Path = Path;
+            if (IsHttpUrl(Path) || IsRemoteDiskPath(Path)) {
+                Status = LoadBootFile(Path, FILE_LOAD_PAGES, NULL, NULL, &Part->Staged);
+                Part->Size = Part->Staged.Size;
+            } else {
+                Status = GetBootFileInfo(Path, &Part->Size, NULL);
+            }
+            mInitrd.Count++;
+            Part->Offset = mInitrd.Size;
+            mInitrd.Size = ALIGN_VALUE(mInitrd.Size + Part->Size, 4);
+        }
+        Path = Last ? End : End + 1;
+    }
+    if (!EFI_ERROR(Status) && mInitrd.Count == 0) {
+        Status = EFI_NOT_FOUND;
+    }
+    if (EFI_ERROR(Status)) {
+        UninstallInitrdLoadFile();
+        return Status;
+    }
+
+    Status = gBS->InstallMultipleProtocolInterfaces(&mInitrd.Handle,
+                                                    &gEfiDevicePathProtocolGuid, &mInitrdDevicePath,
+                                                    &gEfiLoadFile2ProtocolGuid, &mInitrdLoadFile,
+                                                    NULL);
+    if (EFI_ERROR(Status)) {
+        mInitrd.Handle = NULL;
+        UninstallInitrdLoadFile();
+    }
+    return Status;
+}
+
+/**
+  Boots a Linux kernel through its own EFI stub: the firmware loads the
+  bzImage as a PE image (with the same allowlist, dbx and Secure Boot
+  checks as a chainload), the command line goes in its load options, and
+  the initrd is offered over LoadFile2. The kernel decompresses itself and
+  places the initrd where it prefers, so nothing is copied to fixed
+  addresses here.
+
+  Only returns if the kernel could not be started (the load's status)
+  or exited again (EFI_ABORTED).
+**/
+EFI_STATUS
+BootLinuxEfiStub(
+    IN CONST CHAR16 *KernelPath,
+    IN CONST CHAR16 *InitrdPath OPTIONAL,
+    IN CONST CHAR16 *CommandLine OPTIONAL
+) {
+    EFI_LOADED_IMAGE_PROTOCOL *LoadedImage = NULL;
+    EFI_LOADED_IMAGE_PROTOCOL *KernelImage = NULL;
+    EFI_HANDLE Kernel = NULL;
+    EFI_STATUS Status;
+
+    Status = gBS->HandleProtocol(gImageHandle, &gEfiLoadedImageProtocolGuid, (VOID **)&LoadedImage);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    Status = LoadVerifiedImageFromPath(gImageHandle, LoadedImage->DeviceHandle, KernelPath, &Kernel);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    Status = gBS->HandleProtocol(Kernel, &gEfiLoadedImageProtocolGuid, (VOID **)&KernelImage);
+    if (!EFI_ERROR(Status) && CommandLine != NULL && CommandLine[0] != L'\0') {
+        KernelImage->LoadOptions = (VOID *)CommandLine;
+        KernelImage->LoadOptionsSize = (UINT32)StrSize(CommandLine);
+    }
+    if (!EFI_ERROR(Status) && InitrdPath != NULL && InitrdPath[0] != L'\0') {
+        Status = InstallInitrdLoadFile(InitrdPath);
+        if (EFI_ERROR(Status)) {
+            Print(L"Initrd %s unavailable: %r\n", InitrdPath, Status);
+            Status = EFI_ABORTED;
+        }
+    }
+    if (EFI_ERROR(Status)) {
+        gBS->UnloadImage(Kernel);
+        return Status;
+    }
+
+    // The kernel gets the NICs without our DHCP children on them
+    pxe_network_cancel();
+    Status = gBS->StartImage(Kernel, NULL, NULL);
+    UninstallInitrdLoadFile();
+    Print(L"Kernel returned: %r\n", Status);
+    return EFI_ABORTED;
+}
+
+/**
+  C wrapper for boot/Arch32/linux.c. Returns -2 when the kernel is not an
+  EFI-stub image on the boot volume, so the caller can load it by the
+  legacy boot protocol instead, -1 on any other failure.
+**/
+int
+linux_efi_boot(
+    const char  *kernel_path,
+    const char  *initrd_path,
+    const char  *cmdline
+) {
+    CHAR16 KernelPath[256];
+    CHAR16 InitrdPath[512];
+    CHAR16 *CommandLine = NULL;
+    BOOLEAN HaveInitrd = (initrd_path != NULL && initrd_path[0] != '\0');
+    EFI_STATUS Status;
+
+    if (kernel_path == NULL ||
+        EFI_ERROR(AsciiStrToUnicodeStrS(kernel_path, KernelPath, ARRAY_SIZE(KernelPath))) ||
+        (HaveInitrd && EFI_ERROR(AsciiStrToUnicodeStrS(initrd_path, InitrdPath, ARRAY_SIZE(InitrdPath))))) {
+        return -1;
+    }
+    if (IsHttpUrl(KernelPath) || IsRemoteDiskPath(KernelPath)) {
+        return -2;
+    }
+    // A file path node takes backslashes only
+    for (UINTN i = 0; KernelPath[i] != L'\0'; i++) {
+        if (KernelPath[i] == L'/') {
+            KernelPath[i] = L'\\';
+        }
+    }
+
+    if (cmdline != NULL && cmdline[0] != '\0') {
+        UINTN Length = AsciiStrLen(cmdline) + 1;
+        CommandLine = AllocatePool(Length * sizeof(CHAR16));
+        if (CommandLine == NULL) {
+            return -1;
+        }
+        AsciiStrToUnicodeStrS(cmdline, CommandLine, Length);
+    }
+
+    Status = BootLinuxEfiStub(KernelPath, HaveInitrd ? InitrdPath : NULL, CommandLine);
+    if (CommandLine != NULL) {
+        FreePool(CommandLine);
+    }
+    // Not a PE image (no stub, or compressed as a whole), or not on the
+    // boot volume at all
+    if (Status == EFI_UNSUPPORTED || Status == EFI_LOAD_ERROR || Status == EFI_NOT_FOUND) {
+        return -2;
+    }
+    return -1;
+}
@@ -0,0 +1,481 @@
+/*
+ * memplace.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <Uefi.h>
+#include "compat.h"
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/BaseMemoryLib.h>
+#include "uefi.h"
+#include "../security/entropy.h"
+
+// Placement engine. The conventional memory of one GetMemoryMap snapshot
+// is kept as sorted, disjoint [Start, End) ranges, with a max-length tree
+// over them, so a fit is found in O(log n) instead of by walking the raw
+// descriptors. Every placement is claimed with AllocatePages at its
+// address and carved out of the index; when the firmware took the memory
+// since the snapshot, the claim fails and the snapshot is retaken.
+#define MEM_PLACE_MAX_RANGES    256     // Power of two: the tree's leaf count
+
+typedef struct {
+    UINT64  Start;
+    UINT64  End;
+} MEM_PLACE_RANGE;
+
+STATIC MEM_PLACE_RANGE mFree[MEM_PLACE_MAX_RANGES];
+STATIC UINTN mFreeCount;
+STATIC UINT64 mTop;             // End of the highest descriptor of any type
+STATIC UINT64 mTree[2 * MEM_PLACE_MAX_RANGES];  // Longest range under each node; leaves from index MAX_RANGES
+STATIC BOOLEAN mSnapshotTaken;
+STATIC BOOLEAN mRandomize;
+
+STATIC
+VOID
+TreeUpdate(
+    IN UINTN Index
+) {
+    UINTN Node = MEM_PLACE_MAX_RANGES + Index;
+    mTree[Node] = Index < mFreeCount ? mFree[Index].End - mFree[Index].Start : 0;
+    for (Node /= 2; Node >= 1; Node /= 2) {
+        mTree[Node] = MAX(mTree[2 * Node], mTree[2 * Node + 1]);
+    }
+}
+
+STATIC
+VOID
+TreeBuild(VOID) {
+    for (UINTN i = 0; i < MEM_PLACE_MAX_RANGES; i++) {
+        mTree[MEM_PLACE_MAX_RANGES + i] = i < mFreeCount ? mFree[i].End - mFree[i].Start : 0;
+    }
+    for (UINTN Node = MEM_PLACE_MAX_RANGES - 1; Node >= 1; Node--) {
+        mTree[Node] = MAX(mTree[2 * Node], mTree[2 * Node + 1]);
+    }
+}
+
+// Lowest range index >= From at least Size long, or -1
+STATIC
+INTN
+TreeFirst(
+    IN UINTN    Node,
+    IN UINTN    Lo,
+    IN UINTN    Hi,
+    IN UINTN    From,
+    IN UINT64   Size
+) {
+    if (Hi <= From || mTree[Node] < Size) {
+        return -1;
+    }
+    if (Hi - Lo == 1) {
+        return (INTN)Lo;
+    }
+    UINTN Mid = (Lo + Hi) / 2;
+    INTN Found = TreeFirst(2 * Node, Lo, Mid, From, Size);
+    return Found >= 0 ? Found : TreeFirst(2 * Node + 1, Mid, Hi, From, Size);
+}
+
+// Highest range index < To at least Size long, or -1
+STATIC
+INTN
+TreeLast(
+    IN UINTN    Node,
+    IN UINTN    Lo,
+    IN UINTN    Hi,
+    IN UINTN    To,
+    IN UINT64   Size
+) {
+    if (Lo >= To || mTree[Node] < Size) {
+        return -1;
+    }
+    if (Hi - Lo == 1) {
+        return (INTN)Lo;
+    }
+    UINTN Mid = (Lo + Hi) / 2;
+    INTN Found = TreeLast(2 * Node + 1, Mid, Hi, To, Size);
+    return Found >= 0 ? Found : TreeLast(2 * Node, Lo, Mid, To, Size);
+}
+
+// First range index whose End is above Address
+STATIC
+UINTN
+FirstEndingAbove(
+    IN UINT64 Address
+) {
+    UINTN Lo = 0, Hi = mFreeCount;
+    while (Lo < Hi) {
+        UINTN Mid = (Lo + Hi) / 2;
+        if (mFree[Mid].End <= Address) {
+            Lo = Mid + 1;
+        } else {
+            Hi = Mid;
+        }
+    }
+    return Lo;
+}
+
+// First range index starting at or above Address
+STATIC
+UINTN
+FirstStartingAt(
+    IN UINT64 Address
+) {
+    UINTN Lo = 0, Hi = mFreeCount;
+    while (Lo < Hi) {
+        UINTN Mid = (Lo + Hi) / 2;
+        if (mFree[Mid].Start < Address) {
+            Lo = Mid + 1;
+        } else {
+            Hi = Mid;
+        }
+    }
+    return Lo;
+}
+
+/**
+  Take a fresh memory map snapshot into the free-range index. Page zero
+  is left out: AllocateAddress cannot hand it back distinguishably.
+**/
+EFI_STATUS
+MemPlaceSnapshot(VOID) {
+    EFI_STATUS Status;
+    EFI_MEMORY_DESCRIPTOR *Map = NULL;
+    UINTN MapSize = 0, MapKey = 0, DescSize = 0;
+    UINT32 DescVer = 0;
+
+    Status = gBS->GetMemoryMap(&MapSize, NULL, &MapKey, &DescSize, &DescVer);
+    while (Status == EFI_BUFFER_TOO_SMALL) {
+        if (Map != NULL) {
+            FreePool(Map);
+        }
+        // The pool allocation itself can add a descriptor or two
+        MapSize += 4 * DescSize;
+        Map = AllocatePool(MapSize);
+        if (Map == NULL) {
+            return EFI_OUT_OF_RESOURCES;
+        }
+        Status = gBS->GetMemoryMap(&MapSize, Map, &MapKey, &DescSize, &DescVer);
+    }
+    if (EFI_ERROR(Status)) {
+        if (Map != NULL) {
+            FreePool(Map);
+        }
+        return Status;
+    }
+
+    mFreeCount = 0;
+    mTop = 0;
+    for (UINTN i = 0; i < MapSize / DescSize; i++) {
+        EFI_MEMORY_DESCRIPTOR *Desc = (EFI_MEMORY_DESCRIPTOR *)((UINT8 *)Map + i * DescSize);
+        mTop = MAX(mTop, Desc->PhysicalStart + EFI_PAGES_TO_SIZE((UINTN)Desc->NumberOfPages));
+        if (Desc->Type != EfiConventionalMemory || Desc->NumberOfPages == 0) {
+            continue;
+        }
+        UINT64 Start = MAX(Desc->PhysicalStart, EFI_PAGE_SIZE);
+        UINT64 End = Desc->PhysicalStart + EFI_PAGES_TO_SIZE((UINTN)Desc->NumberOfPages);
+        if (End <= Start) {
+            continue;
+        }
+
+        // Maps are sorted on nearly all firmware; insert in order anyway
+        UINTN At = mFreeCount;
+        while (At > 0 && mFree[At - 1].Start > Start) {
+            At--;
+        }
+        if (At > 0 && mFree[At - 1].End == Start) {
+            mFree[At - 1].End = End;
+        } else if (At < mFreeCount && mFree[At].Start == End) {
+            mFree[At].Start = Start;
+        } else if (mFreeCount < MEM_PLACE_MAX_RANGES) {
+            CopyMem(&mFree[At + 1], &mFree[At], (mFreeCount - At) * sizeof(mFree[0]));
+            mFree[At].Start = Start;
+            mFree[At].End = End;
+            mFreeCount++;
+        }
+    }
+    FreePool(Map);
+
+    TreeBuild();
+    mSnapshotTaken = TRUE;
+    return EFI_SUCCESS;
+}
+
+/**
+  Pick KASLR-style random placements for MEM_PLACE_RELOCATABLE requests
+  instead of the lowest fit.
+**/
+VOID
+MemPlaceSetRandomize(
+    IN BOOLEAN Enable
+) {
+    mRandomize = Enable;
+}
+
+// Remove [Start, End) from the index wherever it overlaps free ranges
+STATIC
+VOID
+CarveRange(
+    IN UINT64 Start,
+    IN UINT64 End
+) {
+    BOOLEAN Rebuild = FALSE;
+
+    for (UINTN i = FirstEndingAbove(Start); i < mFreeCount && mFree[i].Start < End; ) {
+        MEM_PLACE_RANGE *R = &mFree[i];
+        if (Start <= R->Start && End >= R->End) {
+            CopyMem(R, R + 1, (mFreeCount - i - 1) * sizeof(*R));
+            mFreeCount--;
+            Rebuild = TRUE;
+            continue;
+        }
+        if (Start > R->Start && End < R->End) {
+            // Split; with the index full the upper part is dropped, which
+            // only makes it more conservative
+            if (mFreeCount < MEM_PLACE_MAX_RANGES) {
+                CopyMem(R + 2, R + 1, (mFreeCount - i - 1) * sizeof(*R));
+                R[1].Start = End;
+                R[1].End = R->End;
+                mFreeCount++;
+            }
+            R->End = Start;
+            Rebuild = TRUE;
+            break;
+        }
+        if (Start <= R->Start) {
+            R->Start = End;
+        } else {
+            R->End = Start;
+        }
+        TreeUpdate(i);
+        i++;
+    }
+    if (Rebuild) {
+        TreeBuild();
+    }
+}
+
+// Where an aligned block fits in range i between Min and Max, lowest or
+// highest address first
+STATIC
+BOOLEAN
+FitInRange(
+    IN  UINTN                   Index,
+    IN  UINT64                  Size,
+    IN  UINT64                  Align,
+    IN  UINT64                  Min,
+    IN  UINT64                  Max,
+    IN  BOOLEAN                 TopDown,
+    OUT EFI_PHYSICAL_ADDRESS    *Base
+) {
+    UINT64 Lo = MAX(mFree[Index].Start, Min);
+    UINT64 Hi = MIN(mFree[Index].End, Max);
+
+    if (Hi <= Lo || Hi - Lo < Size) {
+        return FALSE;
+    }
+    if (TopDown) {
+        *Base = (Hi - Size) & ~(Align - 1);
+        return *Base >= Lo;
+    }
+    *Base = (Lo + Align - 1) & ~(Align - 1);
+    return *Base >= Lo && *Base <= Hi - Size;
+}
+
+// Aligned start addresses for a block of Size in range i
+STATIC
+UINT64
+SlotsInRange(
+    IN UINTN    Index,
+    IN UINT64   Size,
+    IN UINT64   Align,
+    IN UINT64   Min,
+    IN UINT64   Max
+) {
+    EFI_PHYSICAL_ADDRESS Low, High;
+    if (!FitInRange(Index, Size, Align, Min, Max, FALSE, &Low) ||
+        !FitInRange(Index, Size, Align, Min, Max, TRUE, &High)) {
+        return 0;
+    }
+    return (High - Low) / Align + 1;
+}
+
+STATIC
+BOOLEAN
+PickPlacement(
+    IN  UINT64                  Size,
+    IN  UINT64                  Align,
+    IN  UINT64                  Min,
+    IN  UINT64                  Max,
+    IN  UINT32                  Flags,
+    OUT EFI_PHYSICAL_ADDRESS    *Base
+) {
+    if ((Flags & MEM_PLACE_RELOCATABLE) && mRandomize) {
+        // Uniform over every aligned slot, so big ranges are not
+        // under-weighted; a linear pass, but only once per kernel
+        UINT64 Total = 0;
+        for (UINTN i = FirstEndingAbove(Min); i < mFreeCount && mFree[i].Start < Max; i++) {
+            Total += SlotsInRange(i, Size, Align, Min, Max);
+        }
+        if (Total > 0) {
+            UINT64 Pick = (((UINT64)entropy_get() << 32) | entropy_get()) % Total;
+            for (UINTN i = FirstEndingAbove(Min); i < mFreeCount && mFree[i].Start < Max; i++) {
+                UINT64 Slots = SlotsInRange(i, Size, Align, Min, Max);
+                if (Pick < Slots) {
+                    FitInRange(i, Size, Align, Min, Max, FALSE, Base);
+                    *Base += Pick * Align;
+                    return TRUE;
+                }
+                Pick -= Slots;
+            }
+        }
+        return FALSE;
+    }
+
+    if (Flags & MEM_PLACE_TOP_DOWN) {
+        UINTN To = FirstStartingAt(Max);
+        for (;;) {
+            INTN i = TreeLast(1, 0, MEM_PLACE_MAX_RANGES, To, Size);
+            if (i < 0 || mFree[i].End <= Min) {
+                return FALSE;
+            }
+            if (FitInRange((UINTN)i, Size, Align, Min, Max, TRUE, Base)) {
+                return TRUE;
+            }
+            To = (UINTN)i;
+        }
+    }
+
+    UINTN From = FirstEndingAbove(Min);
+    for (;;) {
+        INTN i = TreeFirst(1, 0, MEM_PLACE_MAX_RANGES, From, Size);
+        if (i < 0 || mFree[i].Start >= Max) {
+            return FALSE;
+        }
+        if (FitInRange((UINTN)i, Size, Align, Min, Max, FALSE, Base)) {
+            return TRUE;
+        }
+        From = (UINTN)i + 1;
+    }
+}
+
+/**
+  Find, claim and return Size bytes of free memory aligned to Align (a
+  power of two, at least a page) within [Min, Max). Max of 0 means no
+  limit. MEM_PLACE_TOP_DOWN takes the highest fit, as initrds want;
+  MEM_PLACE_RELOCATABLE marks images that may go anywhere, placed at
+  random when randomization is on.
+
+  @retval EFI_SUCCESS        *Address is claimed as EfiLoaderData.
+  @retval EFI_NOT_FOUND      Nothing free fits the constraints.
+**/
+EFI_STATUS
+MemPlaceAllocate(
+    IN  UINT64                  Size,
+    IN  UINT64                  Align,
+    IN  UINT64                  Min,
+    IN  UINT64                  Max,
+    IN  UINT32                  Flags,
+    OUT EFI_PHYSICAL_ADDRESS    *Address
+) {
+    EFI_PHYSICAL_ADDRESS Base;
+
+    if (Address == NULL || Size == 0 || (Align & (Align - 1)) != 0) {
+        return EFI_INVALID_PARAMETER;
+    }
+    Size = EFI_PAGES_TO_SIZE(EFI_SIZE_TO_PAGES((UINTN)Size));
+    Align = MAX(Align, EFI_PAGE_SIZE);
+    if (Max == 0) {
+        Max = MAX_UINT64;
+    }
+
+    // A second pass only after the firmware turned out to own a pick
+    for (UINTN Pass = 0; Pass < 2; Pass++) {
+        if ((!mSnapshotTaken || Pass > 0) && EFI_ERROR(MemPlaceSnapshot())) {
+            return EFI_OUT_OF_RESOURCES;
+        }
+        if (!PickPlacement(Size, Align, Min, Max, Flags, &Base)) {
+            if (Pass > 0) {
+                return EFI_NOT_FOUND;
+            }
+            continue;
+        }
+        if (!EFI_ERROR(gBS->AllocatePages(AllocateAddress, EfiLoaderData, EFI_SIZE_TO_PAGES((UINTN)Size), &Base))) {
+            CarveRange(Base, Base + Size);
+            *Address = Base;
+            return EFI_SUCCESS;
+        }
+    }
+    return EFI_NOT_FOUND;
+}
+
+/**
+  Claim a fixed range, for images that must sit at their link address.
+
+  @retval EFI_SUCCESS        The pages are ours.
+  @retval EFI_NOT_FOUND      Some of them are not free.
+**/
+EFI_STATUS
+MemPlaceReserve(
+    IN EFI_PHYSICAL_ADDRESS Address,
+    IN UINT64               Size
+) {
+    EFI_PHYSICAL_ADDRESS Base = Address & ~(UINT64)EFI_PAGE_MASK;
+    UINT64 End = Address + Size;
+
+    if (Size == 0) {
+        return EFI_SUCCESS;
+    }
+    End = (End + EFI_PAGE_MASK) & ~(UINT64)EFI_PAGE_MASK;
+    if (EFI_ERROR(gBS->AllocatePages(AllocateAddress, EfiLoaderData, EFI_SIZE_TO_PAGES((UINTN)(End - Base)), &Base))) {
+        return EFI_NOT_FOUND;
+    }
+    if (mSnapshotTaken) {
+        CarveRange(Base, End);
+    }
+    return EFI_SUCCESS;
+}
+
+/**
+  C wrappers for the protocol loaders: place_memory for images that can
+  go anywhere their constraints allow, reserve_memory for fixed ones.
+  Both return 0 on success, -1 on failure.
+**/
+int
+place_memory(
+    uint64_t    size,
+    uint64_t    align,
+    uint64_t    min,
+    uint64_t    max,
+    uint32_t    flags,
+    uint64_t    *addr
+) {
+    EFI_PHYSICAL_ADDRESS Address;
+    if (EFI_ERROR(MemPlaceAllocate(size, align, min, max, flags, &Address))) {
+        return -1;
+    }
+    *addr = Address;
+    return 0;
+}
+
+int
+reserve_memory(
+    uint64_t    addr,
+    uint64_t    size
+) {
+    return EFI_ERROR(MemPlaceReserve(addr, size)) ? -1 : 0;
+}
+
+/**
+  End of the physical address space the memory map describes, MMIO
+  included, for page tables that must cover all of it. 0 when the map
+  cannot be read.
+**/
+uint64_t
+memory_top(void) {
+    if (!mSnapshotTaken && EFI_ERROR(MemPlaceSnapshot())) {
+        return 0;
+    }
+    return mTop;
+}
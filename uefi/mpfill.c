@@ -0,0 +1,186 @@
+/*
+ * mpfill.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <Uefi.h>
+#include "compat.h"
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/SynchronizationLib.h>
+#include <Protocol/MpService.h>
+#include "../boot/Arch32/loadseg.h"
+#include "../boot/libb/include/bloodhorn/memory.h"
+
+// Jobs are cut into pieces of this size for the processors to claim; big
+// enough that claiming costs nothing, small enough to balance a few jobs
+// of very different sizes
+#define MEMORY_JOB_PIECE    (2 * 1024 * 1024)
+
+// Below this the BSP alone is about as quick as waking the APs
+#define MEMORY_JOB_MP_MIN   (16 * 1024 * 1024)
+
+typedef struct {
+    CONST loadseg_job_t *Jobs;
+    UINT32              Count;
+    UINT32              FirstPiece[LOADSEG_MAX_JOBS + 1];  // Piece numbering, per job
+    volatile UINT32     Next;           // Pieces claimed so far
+} MEMORY_JOB_SET;
+
+// Runs on every processor: claim pieces until none are left. Only touches
+// the set and the memory it describes, so it is AP-safe.
+STATIC VOID EFIAPI MemoryJobWorker(IN OUT VOID *Buffer) {
+    MEMORY_JOB_SET *Set = (MEMORY_JOB_SET *)Buffer;
+    UINT32 Job = 0;
+
+    for (;;) {
+        UINT32 Piece = InterlockedIncrement(&Set->Next) - 1;
+        if (Piece >= Set->FirstPiece[Set->Count]) {
+            break;
+        }
+        // Each processor's claims only go up, so the job search does too
+        while (Piece >= Set->FirstPiece[Job + 1]) {
+            Job++;
+        }
+
+        CONST loadseg_job_t *J = &Set->Jobs[Job];
+        UINT64 Offset = (UINT64)(Piece - Set->FirstPiece[Job]) * MEMORY_JOB_PIECE;
+        UINT64 Length = J->len - Offset < MEMORY_JOB_PIECE ? J->len - Offset : MEMORY_JOB_PIECE;
+        if (J->src != NULL) {
+            bh_memory_copy_part((VOID *)(UINTN)(J->dest + Offset), J->src + Offset, (UINTN)Length, (UINTN)J->len);
+        } else {
+            loadseg_zero((VOID *)(UINTN)(J->dest + Offset), Length);
+        }
+    }
+}
+
+/**
+  Runs a batch of copy and zero jobs (segments and BSS of a kernel load),
+  shared out between the BSP and every enabled AP through MP Services.
+  Jobs are independent of one another. Without MP Services, with one
+  processor or for a small batch the BSP does all of it.
+**/
+void
+parallel_memory_jobs(
+    const loadseg_job_t *jobs,
+    uint32_t            count
+) {
+    EFI_MP_SERVICES_PROTOCOL *Mp = NULL;
+    EFI_EVENT Done = NULL;
+    UINTN Processors = 0;
+    UINTN Enabled = 0;
+    UINT64 Total = 0;
+    MEMORY_JOB_SET Set;
+
+    if (count > LOADSEG_MAX_JOBS) {
+        parallel_memory_jobs(jobs + LOADSEG_MAX_JOBS, count - LOADSEG_MAX_JOBS);
+        count = LOADSEG_MAX_JOBS;
+    }
+
+    ZeroMem(&Set, sizeof(Set));
+    Set.Jobs = jobs;
+    Set.Count = count;
+    for (UINT32 i = 0; i < count; i++) {
+        Set.FirstPiece[i + 1] = Set.FirstPiece[i] + (UINT32)((jobs[i].len + MEMORY_JOB_PIECE - 1) / MEMORY_JOB_PIECE);
+        Total += jobs[i].len;
+    }
+
+    if (Total >= MEMORY_JOB_MP_MIN && Set.FirstPiece[count] > 1 &&
+        !EFI_ERROR(gBS->LocateProtocol(&gEfiMpServiceProtocolGuid, NULL, (VOID **)&Mp)) &&
+        !EFI_ERROR(Mp->GetNumberOfProcessors(Mp, &Processors, &Enabled)) && Enabled > 1 &&
+        !EFI_ERROR(gBS->CreateEvent(0, 0, NULL, NULL, &Done))) {
+        if (EFI_ERROR(Mp->StartupAllAPs(Mp, MemoryJobWorker, FALSE, Done, 0, &Set, NULL))) {
+            gBS->CloseEvent(Done);
+            Done = NULL;
+        }
+    }
+
+    // The BSP takes its share either way, and all of it without APs
+    MemoryJobWorker(&Set);
+
+    if (Done != NULL) {
+        UINTN Index;
+        gBS->WaitForEvent(1, &Done, &Index);
+        gBS->CloseEvent(Done);
+    }
+}
+
+// Task pool workers (libb parallel.c) started on the APs
+typedef struct {
+    VOID    (*Worker)(VOID *Context);
+    VOID    *Context;
+} MP_TASK_START;
+
+STATIC EFI_MP_SERVICES_PROTOCOL *mTaskMp;
+STATIC EFI_EVENT                mTaskDone;
+STATIC MP_TASK_START            mTaskStart;
+
+// The pool's worker uses the native calling convention, not EFIAPI
+STATIC VOID EFIAPI MpTaskTrampoline(IN OUT VOID *Buffer) {
+    MP_TASK_START *Start = (MP_TASK_START *)Buffer;
+    Start->Worker(Start->Context);
+}
+
+/**
+  Number of enabled APs the task pool can use; 0 without MP Services.
+**/
+UINT32
+MpTaskApCount(VOID) {
+    UINTN Processors = 0;
+    UINTN Enabled = 0;
+
+    if (mTaskMp == NULL &&
+        EFI_ERROR(gBS->LocateProtocol(&gEfiMpServiceProtocolGuid, NULL, (VOID **)&mTaskMp))) {
+        mTaskMp = NULL;
+        return 0;
+    }
+    if (EFI_ERROR(mTaskMp->GetNumberOfProcessors(mTaskMp, &Processors, &Enabled)) || Enabled < 2) {
+        return 0;
+    }
+    return (UINT32)(Enabled - 1);
+}
+
+/**
+  Start Worker(Context) on every AP without waiting for it; the number
+  started, or 0 if the APs are still busy (with an earlier start, or with
+  parallel_memory_jobs) or cannot be started. MpTaskApsIdle reports when
+  they are done.
+**/
+UINT32
+MpTaskStartAps(
+    IN VOID (*Worker)(VOID *Context),
+    IN VOID *Context
+) {
+    UINT32 Count = MpTaskApCount();
+
+    if (Count == 0 || mTaskDone != NULL) {
+        return 0;
+    }
+    if (EFI_ERROR(gBS->CreateEvent(0, 0, NULL, NULL, &mTaskDone))) {
+        mTaskDone = NULL;
+        return 0;
+    }
+    mTaskStart.Worker = Worker;
+    mTaskStart.Context = Context;
+    if (EFI_ERROR(mTaskMp->StartupAllAPs(mTaskMp, MpTaskTrampoline, FALSE, mTaskDone, 0, &mTaskStart, NULL))) {
+        gBS->CloseEvent(mTaskDone);
+        mTaskDone = NULL;
+        return 0;
+    }
+    return Count;
+}
+
+BOOLEAN
+MpTaskApsIdle(VOID) {
+    if (mTaskDone == NULL) {
+        return TRUE;
+    }
+    if (gBS->CheckEvent(mTaskDone) != EFI_SUCCESS) {
+        return FALSE;
+    }
+    gBS->CloseEvent(mTaskDone);
+    mTaskDone = NULL;
+    return TRUE;
+}
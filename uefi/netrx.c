@@ -0,0 +1,366 @@
+/*
+ * netrx.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <Uefi.h>
+#include "compat.h"
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/PrintLib.h>
+#include <Library/TimerLib.h>
+#include <Library/BaseLib.h>
+#include <Protocol/LoadedImage.h>
+#include <Protocol/ManagedNetwork.h>
+#include <Protocol/ServiceBinding.h>
+#include "../net/pxe.h"
+#include "../net/net_utils.h"
+
+// Receive tokens kept posted with MNP. A TFTP window of 16-64 blocks
+// arrives back to back, so the ring has to hold a burst without MNP
+// dropping frames for want of a token.
+#define NET_RX_RING_SIZE    32
+
+#define IPV4_ETHERTYPE      0x0800
+#define IPV4_PROTO_UDP      17
+
+STATIC EFI_SERVICE_BINDING_PROTOCOL *mRxBinding;
+STATIC EFI_HANDLE mRxChild;
+STATIC EFI_MANAGED_NETWORK_PROTOCOL *mRxMnp;
+STATIC EFI_MANAGED_NETWORK_COMPLETION_TOKEN mRxRing[NET_RX_RING_SIZE];
+STATIC UINTN mRxNext;       // Oldest posted token: MNP fills them in queue order
+STATIC BOOLEAN mRxLent;     // mRxRing[mRxNext]'s packet is with the caller
+
+// Multicast group joined with pxe_udp_join; the only multicast let through
+STATIC BOOLEAN mRxGroupJoined;
+STATIC EFI_IPv4_ADDRESS mRxGroup;
+STATIC EFI_MAC_ADDRESS mRxGroupMac;
+STATIC UINT16 mRxGroupPort;
+
+extern EFI_HANDLE gBloodHornNicHandle;
+
+void pxe_udp_peek_stop(void);
+void pxe_udp_leave(void);
+
+STATIC
+VOID
+EFIAPI
+RxTokenNotify(
+    IN EFI_EVENT    Event,
+    IN VOID         *Context
+) {
+}
+
+STATIC
+EFI_STATUS
+PostRxToken(
+    IN EFI_MANAGED_NETWORK_COMPLETION_TOKEN *Token
+) {
+    Token->Status = EFI_NOT_READY;
+    Token->Packet.RxData = NULL;
+    return mRxMnp->Receive(mRxMnp, Token);
+}
+
+// Give MNP its buffer back and queue the token again, at the ring's end
+STATIC
+VOID
+RecycleRxToken(
+    IN EFI_MANAGED_NETWORK_COMPLETION_TOKEN *Token
+) {
+    if (Token->Packet.RxData != NULL) {
+        gBS->SignalEvent(Token->Packet.RxData->RecycleEvent);
+    }
+    PostRxToken(Token);
+}
+
+/**
+  Open a Managed Network child that receives IPv4 frames alongside the
+  firmware's own stack, and post the receive ring. The NIC is the one
+  discovery selected, else the one BloodHorn was loaded from, else the
+  first.
+**/
+STATIC
+EFI_STATUS
+StartRxRing(VOID) {
+    EFI_STATUS Status;
+    EFI_HANDLE Nic = NULL;
+    EFI_LOADED_IMAGE_PROTOCOL *LoadedImage = NULL;
+    EFI_MANAGED_NETWORK_CONFIG_DATA Config;
+
+    if (gBloodHornNicHandle != NULL &&
+        !EFI_ERROR(gBS->HandleProtocol(gBloodHornNicHandle, &gEfiManagedNetworkServiceBindingProtocolGuid,
+                                       (VOID **)&mRxBinding))) {
+        Nic = gBloodHornNicHandle;
+    } else if (!EFI_ERROR(gBS->HandleProtocol(gImageHandle, &gEfiLoadedImageProtocolGuid, (VOID **)&LoadedImage)) &&
+               !EFI_ERROR(gBS->HandleProtocol(LoadedImage->DeviceHandle, &gEfiManagedNetworkServiceBindingProtocolGuid,
+                                              (VOID **)&mRxBinding))) {
+        Nic = LoadedImage->DeviceHandle;
+    } else {
+        EFI_HANDLE *Handles = NULL;
+        UINTN HandleCount = 0;
+        Status = gBS->LocateHandleBuffer(ByProtocol, &gEfiManagedNetworkServiceBindingProtocolGuid, NULL,
+                                         &HandleCount, &Handles);
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+        Nic = Handles[0];
+        FreePool(Handles);
+        Status = gBS->HandleProtocol(Nic, &gEfiManagedNetworkServiceBindingProtocolGuid, (VOID **)&mRxBinding);
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+    }
+
+    mRxChild = NULL;
+    Status = mRxBinding->CreateChild(mRxBinding, &mRxChild);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    Status = gBS->HandleProtocol(mRxChild, &gEfiManagedNetworkProtocolGuid, (VOID **)&mRxMnp);
+    if (EFI_ERROR(Status)) {
+        mRxBinding->DestroyChild(mRxBinding, mRxChild);
+        return Status;
+    }
+
+    ZeroMem(&Config, sizeof(Config));
+    Config.ProtocolTypeFilter = IPV4_ETHERTYPE;
+    Config.EnableUnicastReceive = TRUE;
+    Config.EnableMulticastReceive = TRUE;
+    Config.EnableBroadcastReceive = TRUE;
+    Config.FlushQueuesOnReset = TRUE;
+    Status = mRxMnp->Configure(mRxMnp, &Config);
+
+    for (UINTN i = 0; i < NET_RX_RING_SIZE && !EFI_ERROR(Status); i++) {
+        Status = gBS->CreateEvent(EVT_NOTIFY_SIGNAL, TPL_CALLBACK, RxTokenNotify, NULL, &mRxRing[i].Event);
+        if (!EFI_ERROR(Status)) {
+            Status = PostRxToken(&mRxRing[i]);
+        }
+    }
+    mRxNext = 0;
+    mRxLent = FALSE;
+    if (EFI_ERROR(Status)) {
+        pxe_udp_peek_stop();
+    }
+    return Status;
+}
+
+void
+pxe_udp_peek_stop(void) {
+    if (mRxMnp != NULL) {
+        mRxMnp->Cancel(mRxMnp, NULL);
+        for (UINTN i = 0; i < NET_RX_RING_SIZE; i++) {
+            if (mRxRing[i].Status == EFI_SUCCESS && mRxRing[i].Packet.RxData != NULL) {
+                gBS->SignalEvent(mRxRing[i].Packet.RxData->RecycleEvent);
+            }
+        }
+        mRxMnp->Configure(mRxMnp, NULL);
+    }
+    for (UINTN i = 0; i < NET_RX_RING_SIZE; i++) {
+        if (mRxRing[i].Event != NULL) {
+            gBS->CloseEvent(mRxRing[i].Event);
+        }
+    }
+    ZeroMem(mRxRing, sizeof(mRxRing));
+    if (mRxChild != NULL) {
+        mRxBinding->DestroyChild(mRxBinding, mRxChild);
+    }
+    mRxChild = NULL;
+    mRxMnp = NULL;
+    mRxLent = FALSE;
+    mRxGroupJoined = FALSE;
+}
+
+/**
+  Receive datagrams sent to group_ip:port on the receive ring, until
+  pxe_udp_leave: the group's MAC is added to the MNP child's filter, and
+  ParseUdp lets that group and port through.
+
+  @retval 0   Joined.
+  @retval -1  Not a multicast address, or no network to receive from.
+**/
+int
+pxe_udp_join(
+    const char  *group_ip,
+    uint16_t    port
+) {
+    EFI_IP_ADDRESS Group;
+
+    ZeroMem(&Group, sizeof(Group));
+    if (RETURN_ERROR(AsciiStrToIpv4Address(group_ip, NULL, &Group.v4, NULL)) || (Group.v4.Addr[0] & 0xF0) != 0xE0) {
+        return -1;
+    }
+    if (mRxMnp == NULL && EFI_ERROR(StartRxRing())) {
+        return -1;
+    }
+    pxe_udp_leave();
+    if (EFI_ERROR(mRxMnp->McastIpToMac(mRxMnp, FALSE, &Group, &mRxGroupMac)) ||
+        EFI_ERROR(mRxMnp->Groups(mRxMnp, TRUE, &mRxGroupMac))) {
+        return -1;
+    }
+    CopyMem(&mRxGroup, &Group.v4, sizeof(mRxGroup));
+    mRxGroupPort = port;
+    mRxGroupJoined = TRUE;
+    return 0;
+}
+
+void
+pxe_udp_leave(void) {
+    if (mRxGroupJoined && mRxMnp != NULL) {
+        mRxMnp->Groups(mRxMnp, FALSE, &mRxGroupMac);
+    }
+    mRxGroupJoined = FALSE;
+}
+
+/**
+  Find the UDP payload of an IPv4 packet, in place. Fragments, packets
+  for other hosts and packets whose IP or UDP checksum fails are refused.
+
+  @retval >=0  Payload length; *Payload points into Ip.
+  @retval -1   Not a datagram for us.
+**/
+STATIC
+INTN
+ParseUdp(
+    IN  CONST UINT8 *Ip,
+    IN  UINT32      Length,
+    OUT CHAR8       *SrcIp,
+    OUT UINT16      *SrcPort,
+    OUT CONST UINT8 **Payload
+) {
+    if (Length < 20 || (Ip[0] >> 4) != 4) {
+        return -1;
+    }
+    UINT32 HeaderLength = (Ip[0] & 0xF) * 4;
+    UINT32 Total = ((UINT32)Ip[2] << 8) | Ip[3];
+    if (HeaderLength < 20 || Total < HeaderLength + 8 || Total > Length || Ip[9] != IPV4_PROTO_UDP) {
+        return -1;
+    }
+    // More-fragments flag or a fragment offset
+    if ((Ip[6] & 0x3F) != 0 || Ip[7] != 0) {
+        return -1;
+    }
+    if (net_checksum(Ip, (int)HeaderLength) != 0) {
+        return -1;
+    }
+
+    // Ours, broadcast, or the group and port pxe_udp_join named
+    struct pxe_network_info *Info = pxe_get_network_info();
+    CONST UINT8 *Dst = Ip + 16;
+    CONST UINT8 *Udp = Ip + HeaderLength;
+    if ((Dst[0] & 0xF0) == 0xE0) {
+        if (!mRxGroupJoined || CompareMem(Dst, &mRxGroup, 4) != 0 ||
+            (((UINT16)Udp[2] << 8) | Udp[3]) != mRxGroupPort) {
+            return -1;
+        }
+    } else if (CompareMem(Dst, &Info->client_ip, 4) != 0 &&
+               !(Dst[0] == 0xFF && Dst[1] == 0xFF && Dst[2] == 0xFF && Dst[3] == 0xFF)) {
+        return -1;
+    }
+
+    UINT32 UdpLength = ((UINT32)Udp[4] << 8) | Udp[5];
+    if (UdpLength < 8 || UdpLength > Total - HeaderLength) {
+        return -1;
+    }
+    if (Udp[6] != 0 || Udp[7] != 0) {
+        UINT8 Pseudo[12];
+        net_csum_t Csum;
+        CopyMem(Pseudo, Ip + 12, 8);
+        Pseudo[8] = 0;
+        Pseudo[9] = IPV4_PROTO_UDP;
+        Pseudo[10] = Udp[4];
+        Pseudo[11] = Udp[5];
+        net_csum_init(&Csum);
+        net_csum_add(&Csum, Pseudo, sizeof(Pseudo));
+        net_csum_add(&Csum, Udp, UdpLength);
+        if (net_csum_finish(&Csum) != 0) {
+            return -1;
+        }
+    }
+
+    AsciiSPrint(SrcIp, 16, "%d.%d.%d.%d", Ip[12], Ip[13], Ip[14], Ip[15]);
+    *SrcPort = (UINT16)(((UINT16)Udp[0] << 8) | Udp[1]);
+    *Payload = Udp + 8;
+    return (INTN)(UdpLength - 8);
+}
+
+/**
+  Receive the next UDP datagram straight out of MNP's receive buffer.
+  Headers are parsed where the frame landed and *data points at the
+  payload, so the caller's copy to the destination is the only one. The
+  packet is handed back to MNP, and its token re-posted, on the next call.
+
+  @retval >0  Payload length.
+  @retval 0   Nothing arrived within timeout_ms.
+  @retval -1  No network to receive from.
+**/
+int
+pxe_udp_peek(
+    char            *src_ip,
+    uint16_t        *src_port,
+    const uint8_t   **data,
+    int             timeout_ms
+) {
+    EFI_EVENT Timer = NULL;
+    int Result = 0;
+
+    if (mRxMnp == NULL && EFI_ERROR(StartRxRing())) {
+        return -1;
+    }
+    if (mRxLent) {
+        RecycleRxToken(&mRxRing[mRxNext]);
+        mRxNext = (mRxNext + 1) % NET_RX_RING_SIZE;
+        mRxLent = FALSE;
+    }
+    if (EFI_ERROR(gBS->CreateEvent(EVT_TIMER, 0, NULL, NULL, &Timer)) ||
+        EFI_ERROR(gBS->SetTimer(Timer, TimerRelative, (UINT64)(timeout_ms > 0 ? timeout_ms : 0) * 10000))) {
+        if (Timer != NULL) {
+            gBS->CloseEvent(Timer);
+        }
+        return -1;
+    }
+
+    for (;;) {
+        EFI_MANAGED_NETWORK_COMPLETION_TOKEN *Token = &mRxRing[mRxNext];
+        if (Token->Status == EFI_NOT_READY) {
+            if (gBS->CheckEvent(Timer) == EFI_SUCCESS) {
+                break;
+            }
+            mRxMnp->Poll(mRxMnp);
+            continue;
+        }
+
+        EFI_MANAGED_NETWORK_RECEIVE_DATA *Rx = Token->Packet.RxData;
+        if (!EFI_ERROR(Token->Status) && Rx != NULL) {
+            INTN Length = ParseUdp((CONST UINT8 *)Rx->PacketData, Rx->PacketLength, src_ip, src_port, data);
+            if (Length >= 0) {
+                mRxLent = TRUE;
+                Result = (int)Length;
+                break;
+            }
+        }
+        RecycleRxToken(Token);
+        mRxNext = (mRxNext + 1) % NET_RX_RING_SIZE;
+    }
+
+    gBS->CloseEvent(Timer);
+    return Result;
+}
+
+/**
+  Milliseconds from an arbitrary start, for timing TFTP round trips. The
+  value wraps; callers only ever take differences.
+**/
+uint32_t
+pxe_time_ms(void) {
+    UINT64 Start;
+    UINT64 End;
+    UINT64 Ticks = GetPerformanceCounter();
+
+    GetPerformanceCounterProperties(&Start, &End);
+    // Some timers count down
+    Ticks = Start > End ? Start - Ticks : Ticks - Start;
+    return (uint32_t)DivU64x32(GetTimeInNanoSecond(Ticks), 1000000);
+}
@@ -0,0 +1,441 @@
+/*
+ * nicprobe.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <Uefi.h>
+#include "compat.h"
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/TimerLib.h>
+#include <Protocol/SimpleNetwork.h>
+#include <Protocol/Dhcp4.h>
+#include <Protocol/Ip4Config2.h>
+#include <Protocol/LoadedImage.h>
+#include <Protocol/ServiceBinding.h>
+#include "../net/pxe.h"
+
+// The NIC PXE runs on, once discovery or a saved lease picked one
+EFI_HANDLE gBloodHornNicHandle = NULL;
+
+// Per-NIC retries: three DISCOVERs and two REQUESTs, about 20 s worst
+// case; the overall PXE_DISCOVER_TIMEOUT_MS usually ends a silent NIC first
+STATIC UINT32 mDiscoverTimeouts[] = { 2, 4, 8 };
+STATIC UINT32 mRequestTimeouts[] = { 2, 4 };
+
+// Parameter request list: subnet, router, DNS, domain name, vendor
+// (MTFTP), TFTP server name and boot file name
+STATIC UINT8 mParameterRequest[] = { 55, 7, 1, 3, 6, 15, 43, 66, 67 };
+STATIC EFI_DHCP4_PACKET_OPTION *mDhcpOptions[] = { (EFI_DHCP4_PACKET_OPTION *)mParameterRequest };
+
+typedef struct {
+    EFI_HANDLE                      Nic;
+    EFI_SERVICE_BINDING_PROTOCOL    *Binding;
+    EFI_HANDLE                      Child;
+    EFI_DHCP4_PROTOCOL              *Dhcp4;
+    EFI_EVENT                       Done;
+    BOOLEAN                         Running;
+} NIC_PROBE;
+
+STATIC
+UINT32
+ElapsedMs(
+    IN UINT64 Start
+) {
+    UINT64 StartValue, EndValue;
+    UINT64 Now = GetPerformanceCounter();
+    GetPerformanceCounterProperties(&StartValue, &EndValue);
+    return (UINT32)(GetTimeInNanoSecond(EndValue >= StartValue ? Now - Start : Start - Now) / 1000000);
+}
+
+STATIC
+VOID
+StopProbe(
+    IN NIC_PROBE *Probe
+) {
+    if (Probe->Dhcp4 != NULL) {
+        Probe->Dhcp4->Stop(Probe->Dhcp4);
+        Probe->Dhcp4->Configure(Probe->Dhcp4, NULL);
+    }
+    if (Probe->Child != NULL) {
+        Probe->Binding->DestroyChild(Probe->Binding, Probe->Child);
+    }
+    if (Probe->Done != NULL) {
+        gBS->CloseEvent(Probe->Done);
+    }
+    Probe->Dhcp4 = NULL;
+    Probe->Child = NULL;
+    Probe->Done = NULL;
+    Probe->Running = FALSE;
+}
+
+/**
+  Start an asynchronous DHCP exchange on one NIC through its own DHCP4
+  child; Probe->Done is signalled when it completes, bound or not.
+**/
+STATIC
+EFI_STATUS
+StartProbe(
+    IN NIC_PROBE *Probe
+) {
+    EFI_STATUS Status;
+    EFI_DHCP4_CONFIG_DATA Config;
+
+    Status = gBS->HandleProtocol(Probe->Nic, &gEfiDhcp4ServiceBindingProtocolGuid, (VOID **)&Probe->Binding);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    Status = Probe->Binding->CreateChild(Probe->Binding, &Probe->Child);
+    if (EFI_ERROR(Status)) {
+        Probe->Child = NULL;
+        return Status;
+    }
+    Status = gBS->HandleProtocol(Probe->Child, &gEfiDhcp4ProtocolGuid, (VOID **)&Probe->Dhcp4);
+    if (EFI_ERROR(Status)) {
+        Probe->Dhcp4 = NULL;
+        StopProbe(Probe);
+        return Status;
+    }
+
+    ZeroMem(&Config, sizeof(Config));
+    Config.DiscoverTryCount = ARRAY_SIZE(mDiscoverTimeouts);
+    Config.DiscoverTimeout = mDiscoverTimeouts;
+    Config.RequestTryCount = ARRAY_SIZE(mRequestTimeouts);
+    Config.RequestTimeout = mRequestTimeouts;
+    Config.OptionCount = ARRAY_SIZE(mDhcpOptions);
+    Config.OptionList = mDhcpOptions;
+    Status = Probe->Dhcp4->Configure(Probe->Dhcp4, &Config);
+    if (!EFI_ERROR(Status)) {
+        // A plain event, so WaitForEvent can wait on all the NICs at once
+        Status = gBS->CreateEvent(0, 0, NULL, NULL, &Probe->Done);
+    }
+    if (!EFI_ERROR(Status)) {
+        Status = Probe->Dhcp4->Start(Probe->Dhcp4, Probe->Done);
+    }
+    if (EFI_ERROR(Status)) {
+        StopProbe(Probe);
+        return Status;
+    }
+    Probe->Running = TRUE;
+    return EFI_SUCCESS;
+}
+
+// A NIC with a carrier, or one that cannot tell
+STATIC
+BOOLEAN
+HasLink(
+    IN EFI_SIMPLE_NETWORK_PROTOCOL *Snp
+) {
+    if (!Snp->Mode->MediaPresentSupported) {
+        return TRUE;
+    }
+    // Drivers refresh MediaPresent on GetStatus
+    if (Snp->Mode->State == EfiSimpleNetworkInitialized) {
+        Snp->GetStatus(Snp, NULL, NULL);
+    }
+    return Snp->Mode->MediaPresent;
+}
+
+// Take the winner's lease from the ACK the DHCP4 driver kept
+STATIC
+INTN
+ReadLease(
+    IN  EFI_DHCP4_PROTOCOL  *Dhcp4,
+    OUT dhcp_lease_t        *Lease
+) {
+    EFI_DHCP4_MODE_DATA Mode;
+    UINT32 Xid;
+
+    if (EFI_ERROR(Dhcp4->GetModeData(Dhcp4, &Mode)) || Mode.State != Dhcp4Bound || Mode.ReplyPacket == NULL) {
+        return -1;
+    }
+    UINT8 *Reply = (UINT8 *)&Mode.ReplyPacket->Dhcp4;
+    CopyMem(&Xid, Reply + 4, sizeof(Xid));
+    ZeroMem(Lease, sizeof(*Lease));
+    if (dhcp_parse_ack(Reply, (int)Mode.ReplyPacket->Length, (int)Xid, Lease) != 0) {
+        return -1;
+    }
+    if (Lease->lease_seconds == 0) {
+        Lease->lease_seconds = Mode.LeaseTime;
+    }
+    return 0;
+}
+
+// A discovery left running by pxe_nic_discover_start
+typedef struct {
+    pxe_nic_t   *Nics;
+    EFI_HANDLE  *Handles;
+    UINTN       Count;
+    NIC_PROBE   *Probes;
+    EFI_EVENT   *Events;
+    UINTN       *Owner;
+    EFI_EVENT   Timer;
+    UINT64      Start;
+} NIC_DISCOVERY;
+
+STATIC NIC_DISCOVERY mDiscovery;
+
+// Stop the discovery, marking NICs still at it as Unfinished (PXE_NIC_*)
+STATIC
+VOID
+EndDiscovery(
+    IN UINT8 Unfinished
+) {
+    // The lease is ours whether or not the DHCP4 child stays; stop them all
+    for (UINTN i = 0; i < mDiscovery.Count; i++) {
+        if (mDiscovery.Probes[i].Running) {
+            mDiscovery.Nics[i].state = Unfinished;
+            mDiscovery.Nics[i].elapsed_ms = ElapsedMs(mDiscovery.Start);
+        }
+        StopProbe(&mDiscovery.Probes[i]);
+    }
+
+    if (mDiscovery.Timer != NULL) {
+        gBS->CloseEvent(mDiscovery.Timer);
+    }
+    if (mDiscovery.Probes != NULL) {
+        FreePool(mDiscovery.Probes);
+    }
+    if (mDiscovery.Events != NULL) {
+        FreePool(mDiscovery.Events);
+    }
+    if (mDiscovery.Owner != NULL) {
+        FreePool(mDiscovery.Owner);
+    }
+    FreePool(mDiscovery.Handles);
+    ZeroMem(&mDiscovery, sizeof(mDiscovery));
+}
+
+int
+pxe_nic_discover_start(
+    pxe_nic_t       *nics,
+    int             max,
+    int             *count,
+    int             timeout_ms
+) {
+    if (mDiscovery.Handles != NULL) {
+        *count = (int)mDiscovery.Count;
+        return 0;
+    }
+
+    *count = 0;
+    if (EFI_ERROR(gBS->LocateHandleBuffer(ByProtocol, &gEfiSimpleNetworkProtocolGuid, NULL,
+                                          &mDiscovery.Count, &mDiscovery.Handles))) {
+        ZeroMem(&mDiscovery, sizeof(mDiscovery));
+        return -1;
+    }
+    if (mDiscovery.Count > (UINTN)max) {
+        mDiscovery.Count = (UINTN)max;
+    }
+    mDiscovery.Nics = nics;
+    mDiscovery.Probes = AllocateZeroPool(mDiscovery.Count * sizeof(*mDiscovery.Probes));
+    mDiscovery.Events = AllocatePool((mDiscovery.Count + 1) * sizeof(*mDiscovery.Events));
+    mDiscovery.Owner = AllocatePool((mDiscovery.Count + 1) * sizeof(*mDiscovery.Owner));
+    if (mDiscovery.Probes == NULL || mDiscovery.Events == NULL || mDiscovery.Owner == NULL ||
+        EFI_ERROR(gBS->CreateEvent(EVT_TIMER, 0, NULL, NULL, &mDiscovery.Timer)) ||
+        EFI_ERROR(gBS->SetTimer(mDiscovery.Timer, TimerRelative, (UINT64)timeout_ms * 10000))) {
+        mDiscovery.Count = 0;
+    }
+
+    // Start every NIC that has a link before waiting on any of them
+    mDiscovery.Start = GetPerformanceCounter();
+    for (UINTN i = 0; i < mDiscovery.Count; i++) {
+        EFI_SIMPLE_NETWORK_PROTOCOL *Snp;
+        NIC_PROBE *Probe = &mDiscovery.Probes[i];
+        ZeroMem(&nics[i], sizeof(nics[i]));
+        nics[i].state = PXE_NIC_FAILED;
+        Probe->Nic = mDiscovery.Handles[i];
+        if (EFI_ERROR(gBS->HandleProtocol(Probe->Nic, &gEfiSimpleNetworkProtocolGuid, (VOID **)&Snp))) {
+            continue;
+        }
+        CopyMem(nics[i].mac, Snp->Mode->CurrentAddress.Addr, sizeof(nics[i].mac));
+        nics[i].link = HasLink(Snp) ? 1 : 0;
+        if (!nics[i].link) {
+            nics[i].state = PXE_NIC_NO_LINK;
+        } else if (!EFI_ERROR(StartProbe(Probe))) {
+            nics[i].state = PXE_NIC_PENDING;
+        }
+    }
+    *count = (int)mDiscovery.Count;
+    return 0;
+}
+
+int
+pxe_nic_discover_finish(
+    dhcp_lease_t    *lease
+) {
+    INTN Selected = -1;
+
+    if (mDiscovery.Handles == NULL) {
+        return -1;
+    }
+
+    // First NIC to be bound wins. Exchanges that ended while the loader
+    // was busy elsewhere left their events signalled and are taken at once.
+    while (Selected < 0) {
+        UINTN Waiting = 0;
+        UINTN Index;
+        for (UINTN i = 0; i < mDiscovery.Count; i++) {
+            if (mDiscovery.Probes[i].Running) {
+                mDiscovery.Owner[Waiting] = i;
+                mDiscovery.Events[Waiting++] = mDiscovery.Probes[i].Done;
+            }
+        }
+        if (Waiting == 0) {
+            break;
+        }
+        mDiscovery.Events[Waiting] = mDiscovery.Timer;
+        if (EFI_ERROR(gBS->WaitForEvent(Waiting + 1, mDiscovery.Events, &Index)) || Index == Waiting) {
+            break;
+        }
+
+        UINTN i = mDiscovery.Owner[Index];
+        NIC_PROBE *Probe = &mDiscovery.Probes[i];
+        pxe_nic_t *Nic = &mDiscovery.Nics[i];
+        Probe->Running = FALSE;
+        Nic->elapsed_ms = ElapsedMs(mDiscovery.Start);
+        if (ReadLease(Probe->Dhcp4, lease) == 0) {
+            Nic->state = PXE_NIC_SELECTED;
+            Nic->client_ip = lease->client_ip;
+            gBloodHornNicHandle = Probe->Nic;
+            Selected = (INTN)i;
+        } else {
+            Nic->state = PXE_NIC_FAILED;
+        }
+    }
+
+    EndDiscovery(Selected >= 0 ? PXE_NIC_CANCELLED : PXE_NIC_TIMEOUT);
+    return (int)Selected;
+}
+
+void
+pxe_nic_discover_cancel(
+    void
+) {
+    if (mDiscovery.Handles != NULL) {
+        EndDiscovery(PXE_NIC_CANCELLED);
+    }
+}
+
+int
+pxe_nic_discover(
+    pxe_nic_t       *nics,
+    int             max,
+    int             *count,
+    dhcp_lease_t    *lease,
+    int             timeout_ms
+) {
+    if (pxe_nic_discover_start(nics, max, count, timeout_ms) != 0) {
+        return -1;
+    }
+    return pxe_nic_discover_finish(lease);
+}
+
+int
+pxe_nic_select(
+    const uint8_t   *mac
+) {
+    EFI_HANDLE *Handles = NULL;
+    UINTN HandleCount = 0;
+    int Result = -1;
+
+    if (EFI_ERROR(gBS->LocateHandleBuffer(ByProtocol, &gEfiSimpleNetworkProtocolGuid, NULL, &HandleCount, &Handles))) {
+        return -1;
+    }
+    for (UINTN i = 0; i < HandleCount && Result != 0; i++) {
+        EFI_SIMPLE_NETWORK_PROTOCOL *Snp;
+        if (!EFI_ERROR(gBS->HandleProtocol(Handles[i], &gEfiSimpleNetworkProtocolGuid, (VOID **)&Snp)) &&
+            CompareMem(Snp->Mode->CurrentAddress.Addr, mac, 6) == 0) {
+            gBloodHornNicHandle = Handles[i];
+            Result = 0;
+        }
+    }
+    FreePool(Handles);
+    return Result;
+}
+
+// The NIC pxe_* calls use: the one discovery or pxe_nic_select picked,
+// else the one BloodHorn was loaded from, else the first
+STATIC
+EFI_HANDLE
+CurrentNic(VOID) {
+    EFI_LOADED_IMAGE_PROTOCOL *LoadedImage;
+    EFI_SIMPLE_NETWORK_PROTOCOL *Snp;
+    EFI_HANDLE *Handles = NULL;
+    UINTN HandleCount = 0;
+    EFI_HANDLE Nic = NULL;
+
+    if (gBloodHornNicHandle != NULL) {
+        return gBloodHornNicHandle;
+    }
+    if (!EFI_ERROR(gBS->HandleProtocol(gImageHandle, &gEfiLoadedImageProtocolGuid, (VOID **)&LoadedImage)) &&
+        !EFI_ERROR(gBS->HandleProtocol(LoadedImage->DeviceHandle, &gEfiSimpleNetworkProtocolGuid, (VOID **)&Snp))) {
+        return LoadedImage->DeviceHandle;
+    }
+    if (!EFI_ERROR(gBS->LocateHandleBuffer(ByProtocol, &gEfiSimpleNetworkProtocolGuid, NULL, &HandleCount, &Handles))) {
+        Nic = Handles[0];
+        FreePool(Handles);
+    }
+    return Nic;
+}
+
+int
+pxe_get_mac(
+    uint8_t     *mac
+) {
+    EFI_SIMPLE_NETWORK_PROTOCOL *Snp;
+    EFI_HANDLE Nic = CurrentNic();
+
+    if (Nic == NULL || EFI_ERROR(gBS->HandleProtocol(Nic, &gEfiSimpleNetworkProtocolGuid, (VOID **)&Snp))) {
+        return -1;
+    }
+    CopyMem(mac, Snp->Mode->CurrentAddress.Addr, 6);
+    return 0;
+}
+
+/**
+  Give the NIC an address that did not come from the firmware's own DHCP
+  (a reused or discovered lease) as a static IP4 configuration, so the
+  IP4, TCP and HTTP children find it mapped instead of starting DHCP.
+
+  @retval 0   Configured; duplicate address detection may still be running.
+  @retval -1  No NIC or no Ip4Config2 on it, or the firmware refused it.
+**/
+int
+pxe_set_station(
+    const struct pxe_network_info   *info
+) {
+    EFI_IP4_CONFIG2_PROTOCOL *Ip4Config2;
+    EFI_IP4_CONFIG2_POLICY Policy = Ip4Config2PolicyStatic;
+    EFI_IP4_CONFIG2_MANUAL_ADDRESS Address;
+    EFI_IPv4_ADDRESS Server;
+    EFI_HANDLE Nic = CurrentNic();
+    EFI_STATUS Status;
+
+    if (info->client_ip == 0 || Nic == NULL ||
+        EFI_ERROR(gBS->HandleProtocol(Nic, &gEfiIp4Config2ProtocolGuid, (VOID **)&Ip4Config2))) {
+        return -1;
+    }
+    if (EFI_ERROR(Ip4Config2->SetData(Ip4Config2, Ip4Config2DataTypePolicy, sizeof(Policy), &Policy))) {
+        return -1;
+    }
+    CopyMem(&Address.Address, &info->client_ip, sizeof(Address.Address));
+    CopyMem(&Address.SubnetMask, &info->subnet_mask, sizeof(Address.SubnetMask));
+    Status = Ip4Config2->SetData(Ip4Config2, Ip4Config2DataTypeManualAddress, sizeof(Address), &Address);
+    // EFI_NOT_READY: accepted, and bound once duplicate address detection ends
+    if (EFI_ERROR(Status) && Status != EFI_NOT_READY) {
+        return -1;
+    }
+    if (info->router_ip != 0) {
+        CopyMem(&Server, &info->router_ip, sizeof(Server));
+        Ip4Config2->SetData(Ip4Config2, Ip4Config2DataTypeGateway, sizeof(Server), &Server);
+    }
+    if (info->dns_server != 0) {
+        CopyMem(&Server, &info->dns_server, sizeof(Server));
+        Ip4Config2->SetData(Ip4Config2, Ip4Config2DataTypeDnsServer, sizeof(Server), &Server);
+    }
+    return 0;
+}
@@ -0,0 +1,1237 @@
+/*
+ * nvmetcp.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <Uefi.h>
+#include "compat.h"
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/BaseLib.h>
+#include <Library/PrintLib.h>
+#include <Protocol/LoadedImage.h>
+#include <Protocol/Tcp4.h>
+#include <Protocol/Ip4Config2.h>
+#include <Protocol/SimpleNetwork.h>
+#include <Protocol/ServiceBinding.h>
+#include "uefi.h"
+#include "../fs/blockdev.h"
+
+// NVMe/TCP host (NVMe over Fabrics, TCP transport) on the firmware TCP4
+// stack. One connection carries the admin queue; up to
+// NVMETCP_MAX_IO_QUEUES more carry I/O queues. Reads are split into
+// commands of at most NVMETCP_MAX_TRANSFER and spread round-robin over the
+// I/O connections, each keeping up to NVMETCP_QUEUE_DEPTH outstanding, so
+// a large read keeps several TCP windows full. The target sends the data
+// as C2HData PDUs, which are received straight into the caller's buffer.
+// No digests, no in-capsule data apart from Connect, read only.
+
+#define NVMETCP_DEFAULT_PORT        4420
+#define NVMETCP_MAX_IO_QUEUES       4
+#define NVMETCP_QUEUE_DEPTH         32              // Commands in flight per I/O connection
+#define NVMETCP_ADMIN_DEPTH         2
+#define NVMETCP_ADMIN_SQSIZE        31              // Fabrics minimum for the admin queue (0-based)
+#define NVMETCP_MAX_TRANSFER        (128 * 1024)    // Per read command, below any MDTS
+
+// A token that makes no progress for this long fails the connection (100 ns units)
+#define NVMETCP_TIMEOUT             (10 * 10000000ULL)
+
+// Socket receive buffer asked of TCP4; its window bounds what one
+// connection can have in flight
+#define NVMETCP_RECEIVE_BUFFER      (2 * 1024 * 1024)
+
+// PDU types
+#define NVMETCP_ICREQ               0x00
+#define NVMETCP_ICRESP              0x01
+#define NVMETCP_H2C_TERM            0x02
+#define NVMETCP_C2H_TERM            0x03
+#define NVMETCP_CAPSULE_CMD         0x04
+#define NVMETCP_CAPSULE_RESP        0x05
+#define NVMETCP_C2H_DATA            0x07
+
+// C2HData flags
+#define NVMETCP_C2H_LAST_PDU        0x04
+#define NVMETCP_C2H_SUCCESS         0x08
+
+#define NVMETCP_IC_LENGTH           128
+#define NVMETCP_CMD_HLEN            72
+#define NVMETCP_RX_HEADER_MAX       128             // Largest PDU header (ICResp)
+#define NVMETCP_CONNECT_DATA        1024
+
+// NVMe opcodes, fabrics command types and properties
+#define NVME_ADMIN_IDENTIFY         0x06
+#define NVME_ADMIN_SET_FEATURES     0x09
+#define NVME_IO_READ                0x02
+#define NVME_FABRICS                0x7F
+#define NVME_FCTYPE_PROPERTY_SET    0x00
+#define NVME_FCTYPE_CONNECT         0x01
+#define NVME_FCTYPE_PROPERTY_GET    0x04
+#define NVME_FEATURE_QUEUES         0x07
+#define NVME_CNS_NAMESPACE          0x00
+#define NVME_CNS_CONTROLLER         0x01
+#define NVME_CNS_ACTIVE_NS_LIST     0x02
+#define NVME_CMD_SGL_METABUF        0x40            // PSDT: SGLs, contiguous metadata
+#define NVME_SGL_INLINE             0x01            // Data block, offset into the capsule
+#define NVME_SGL_TRANSPORT          0x5A            // Transport data block: data follows in C2HData PDUs
+#define NVME_PROP_CAP               0x00
+#define NVME_PROP_CC                0x14
+#define NVME_PROP_CSTS              0x1C
+#define NVME_CC_ENABLE              (BIT0 | (6 << 16) | (4 << 20))  // EN, 64-byte SQEs, 16-byte CQEs
+#define NVME_CSTS_RDY               BIT0
+#define NVME_CSTS_CFS               BIT1
+#define NVME_STATUS_TRUNCATED       0xFFFF          // Success reported before all data arrived
+
+#pragma pack(1)
+typedef struct {
+    UINT8   Type;
+    UINT8   Flags;
+    UINT8   Hlen;
+    UINT8   Pdo;
+    UINT32  Plen;
+} NVMETCP_PDU_HEADER;
+
+typedef struct {
+    UINT8   Opcode;
+    UINT8   Flags;
+    UINT16  Cid;
+    UINT32  Nsid;           // FCTYPE in the low byte for fabrics commands
+    UINT64  Reserved;
+    UINT64  Mptr;
+    UINT64  SglAddress;
+    UINT32  SglLength;
+    UINT8   SglReserved[3];
+    UINT8   SglType;
+    UINT32  Cdw10;
+    UINT32  Cdw11;
+    UINT32  Cdw12;
+    UINT32  Cdw13;
+    UINT32  Cdw14;
+    UINT32  Cdw15;
+} NVMETCP_SQE;
+
+typedef struct {
+    NVMETCP_PDU_HEADER  Header;
+    NVMETCP_SQE         Sqe;
+} NVMETCP_CAPSULE;
+
+typedef struct {
+    NVMETCP_PDU_HEADER  Header;
+    UINT32  Dw0;
+    UINT32  Dw1;
+    UINT16  SqHead;
+    UINT16  SqId;
+    UINT16  Cid;
+    UINT16  Status;         // Bit 0 is the (unused) phase tag
+} NVMETCP_RESPONSE;
+
+typedef struct {
+    NVMETCP_PDU_HEADER  Header;
+    UINT16  Cid;
+    UINT16  Reserved;
+    UINT32  Offset;
+    UINT32  Length;
+    UINT32  Reserved2;
+} NVMETCP_C2H_DATA_HEADER;
+
+typedef struct {
+    NVMETCP_PDU_HEADER  Header;
+    UINT16  Pfv;
+    UINT8   Pda;            // HPDA in ICReq, CPDA in ICResp
+    UINT8   Digest;
+    UINT32  MaxData;        // MAXR2T in ICReq, MAXH2CDATA in ICResp
+    UINT8   Reserved[112];
+} NVMETCP_IC;
+
+typedef struct {
+    UINT8   HostId[16];
+    UINT16  ControllerId;
+    UINT8   Reserved[238];
+    CHAR8   SubNqn[256];
+    CHAR8   HostNqn[256];
+    UINT8   Reserved2[256];
+} NVMETCP_CONNECT;
+#pragma pack()
+
+typedef enum {
+    NvmeTcpCmdFree = 0,
+    NvmeTcpCmdIssued,       // Waiting for its response
+    NvmeTcpCmdDone          // Response in, not yet reaped
+} NVMETCP_CMD_STATE;
+
+// One command slot; the slot index is the CID
+typedef struct {
+    NVMETCP_CAPSULE         Pdu;
+    EFI_TCP4_IO_TOKEN       TxToken;
+    EFI_TCP4_TRANSMIT_DATA  TxData;
+    BOOLEAN                 TxPending;      // TxToken handed to TCP4 and not yet reaped
+    UINT8                   State;          // NVMETCP_CMD_STATE
+    UINT8                   *Data;          // C2H destination
+    UINT32                  Length;
+    UINT32                  Received;       // C2H bytes landed so far
+    UINT16                  Status;         // NVMe status, without the phase tag
+    UINT64                  Result;         // CQE DW0, DW1
+} NVMETCP_COMMAND;
+
+typedef struct {
+    EFI_HANDLE                  Child;
+    EFI_TCP4_PROTOCOL           *Tcp;
+    EFI_TCP4_CONNECTION_TOKEN   ConnToken;
+    BOOLEAN                     Failed;     // Connection dropped or the target broke protocol
+    UINT16                      Depth;
+    UINT16                      NextCid;
+    UINT16                      Inflight;
+    NVMETCP_COMMAND             *Commands;
+    BOOLEAN                     IcDone;
+    // Receive side: PDU headers go to Rx, C2H data straight to RxTo
+    EFI_TCP4_IO_TOKEN           RxToken;
+    EFI_TCP4_RECEIVE_DATA       RxData;
+    BOOLEAN                     RxPosted;
+    UINT8                       Rx[NVMETCP_RX_HEADER_MAX];
+    UINT32                      RxHave;
+    UINT32                      RxWant;
+    NVMETCP_COMMAND             *RxCommand;
+    UINT8                       *RxTo;
+    UINT32                      RxLeft;
+    UINT32                      RxLength;   // Data bytes of the current C2HData PDU
+    BOOLEAN                     RxSuccess;  // ... which also completes the command
+    // ICReq and the Connect capsule with its data
+    UINT8                       Capsule[sizeof(NVMETCP_CAPSULE) + NVMETCP_CONNECT_DATA];
+} NVMETCP_QUEUE;
+
+typedef struct {
+    block_device_t                  Device;
+    EFI_HANDLE                      Nic;
+    EFI_SERVICE_BINDING_PROTOCOL    *Binding;
+    EFI_TCP4_CONFIG_DATA            Config;
+    EFI_TCP4_OPTION                 Option;
+    EFI_EVENT                       Timeout;
+    NVMETCP_CONNECT                 Connect;
+    NVMETCP_QUEUE                   Admin;
+    NVMETCP_QUEUE                   Io[NVMETCP_MAX_IO_QUEUES];
+    UINTN                           IoCount;
+    UINTN                           NextQueue;
+    UINT64                          Cap;
+    UINT32                          Nsid;
+    UINT32                          BlockShift;
+    UINT64                          Blocks;
+    UINT32                          MaxTransfer;
+    UINT8                           *Identify;      // 4 KiB scratch for Identify data
+    UINT8                           *Bounce;        // One namespace block
+    CHAR8                           Name[32];
+} NVMETCP_DISK;
+
+extern EFI_HANDLE gBloodHornNicHandle;
+
+STATIC
+VOID
+EFIAPI
+NvmeTcpTokenNotify(
+    IN EFI_EVENT    Event,
+    IN VOID         *Context
+) {
+}
+
+BOOLEAN
+IsRemoteDiskPath(
+    IN CONST CHAR16 *Name
+) {
+    CONST CHAR8 *Prefix = NVMETCP_MOUNT_PATH;
+    UINTN i = 0;
+
+    if (Name == NULL) {
+        return FALSE;
+    }
+    for (; Prefix[i] != '\0'; i++) {
+        if (Name[i] != (CHAR16)Prefix[i]) {
+            return FALSE;
+        }
+    }
+    while (Name[i] >= L'0' && Name[i] <= L'9') {
+        i++;
+    }
+    return Name[i] == L'/' || Name[i] == L'\\';
+}
+
+/**
+  Parse "a.b.c.d[:port]/subsystem-nqn".
+**/
+STATIC
+EFI_STATUS
+ParseNvmeTcpTarget(
+    IN  CONST CHAR8     *Target,
+    OUT EFI_IPv4_ADDRESS *Address,
+    OUT UINT16          *Port,
+    OUT CHAR8           *SubNqn,
+    IN  UINTN           SubNqnSize
+) {
+    CONST CHAR8 *p = Target;
+
+    for (UINTN i = 0; i < 4; i++) {
+        UINTN Value = 0, Digits = 0;
+        if (i > 0 && *p++ != '.') {
+            return EFI_INVALID_PARAMETER;
+        }
+        while (*p >= '0' && *p <= '9' && Digits < 3) {
+            Value = Value * 10 + (UINTN)(*p++ - '0');
+            Digits++;
+        }
+        if (Digits == 0 || Value > 255) {
+            return EFI_INVALID_PARAMETER;
+        }
+        Address->Addr[i] = (UINT8)Value;
+    }
+
+    *Port = NVMETCP_DEFAULT_PORT;
+    if (*p == ':') {
+        UINTN Value = 0;
+        for (p++; *p >= '0' && *p <= '9' && Value <= MAX_UINT16; p++) {
+            Value = Value * 10 + (UINTN)(*p - '0');
+        }
+        if (Value == 0 || Value > MAX_UINT16) {
+            return EFI_INVALID_PARAMETER;
+        }
+        *Port = (UINT16)Value;
+    }
+
+    if (*p != '/' || p[1] == '\0' || AsciiStrLen(p + 1) >= SubNqnSize) {
+        return EFI_INVALID_PARAMETER;
+    }
+    AsciiStrCpyS(SubNqn, SubNqnSize, p + 1);
+    return EFI_SUCCESS;
+}
+
+/**
+  Host ID and NQN: a UUID made of a fixed prefix and the NIC's MAC, so a
+  machine presents the same identity on every boot (targets that restrict
+  hosts can list it), or the prefix alone if the MAC cannot be read.
+**/
+STATIC
+VOID
+SetNvmeTcpHostIdentity(
+    IN OUT NVMETCP_DISK *Disk
+) {
+    STATIC CONST UINT8 Prefix[10] = { 'B', 'H', 'N', 'T', 0x00, 0x00, 0x80, 0x00, 0x80, 0x00 };
+    EFI_SIMPLE_NETWORK_PROTOCOL *Snp;
+    UINT8 *Id = Disk->Connect.HostId;
+    CHAR8 *Nqn = Disk->Connect.HostNqn;
+    UINTN Length;
+
+    ZeroMem(Id, sizeof(Disk->Connect.HostId));
+    CopyMem(Id, Prefix, sizeof(Prefix));
+    if (!EFI_ERROR(gBS->HandleProtocol(Disk->Nic, &gEfiSimpleNetworkProtocolGuid, (VOID **)&Snp)) &&
+        Snp->Mode != NULL) {
+        CopyMem(Id + sizeof(Prefix), &Snp->Mode->CurrentAddress, 6);
+    }
+
+    AsciiStrCpyS(Nqn, sizeof(Disk->Connect.HostNqn), "nqn.2014-08.org.nvmexpress:uuid:");
+    Length = AsciiStrLen(Nqn);
+    for (UINTN i = 0; i < 16; i++) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) {
+            Nqn[Length++] = '-';
+        }
+        AsciiSPrint(Nqn + Length, 3, "%02x", Id[i]);
+        Length += 2;
+    }
+}
+
+/**
+  Find the TCP4 service binding on the NIC discovery selected, else on the
+  one BloodHorn was loaded from, else on the first NIC that has one.
+**/
+STATIC
+EFI_STATUS
+FindTcp4Binding(
+    IN OUT NVMETCP_DISK *Disk
+) {
+    EFI_LOADED_IMAGE_PROTOCOL *LoadedImage = NULL;
+    EFI_HANDLE *Handles = NULL;
+    UINTN HandleCount = 0;
+    EFI_STATUS Status;
+
+    if (gBloodHornNicHandle != NULL &&
+        !EFI_ERROR(gBS->HandleProtocol(gBloodHornNicHandle, &gEfiTcp4ServiceBindingProtocolGuid,
+                                       (VOID **)&Disk->Binding))) {
+        Disk->Nic = gBloodHornNicHandle;
+        return EFI_SUCCESS;
+    }
+    if (!EFI_ERROR(gBS->HandleProtocol(gImageHandle, &gEfiLoadedImageProtocolGuid, (VOID **)&LoadedImage)) &&
+        !EFI_ERROR(gBS->HandleProtocol(LoadedImage->DeviceHandle, &gEfiTcp4ServiceBindingProtocolGuid,
+                                       (VOID **)&Disk->Binding))) {
+        Disk->Nic = LoadedImage->DeviceHandle;
+        return EFI_SUCCESS;
+    }
+    Status = gBS->LocateHandleBuffer(ByProtocol, &gEfiTcp4ServiceBindingProtocolGuid, NULL, &HandleCount, &Handles);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    Disk->Nic = Handles[0];
+    FreePool(Handles);
+    return gBS->HandleProtocol(Disk->Nic, &gEfiTcp4ServiceBindingProtocolGuid, (VOID **)&Disk->Binding);
+}
+
+STATIC
+EFI_STATUS
+NvmeTcpConfigure(
+    IN VOID *Child,
+    IN VOID *Config
+) {
+    return ((EFI_TCP4_PROTOCOL *)Child)->Configure((EFI_TCP4_PROTOCOL *)Child, (EFI_TCP4_CONFIG_DATA *)Config);
+}
+
+/**
+  Configures a TCP4 child, asking the NIC for a DHCP address first if it
+  has none yet.
+**/
+STATIC
+EFI_STATUS
+ConfigureNvmeTcp(
+    IN NVMETCP_DISK        *Disk,
+    IN EFI_TCP4_PROTOCOL   *Tcp
+) {
+    return ConfigureNicChild(Disk->Nic, NvmeTcpConfigure, Tcp, &Disk->Config);
+}
+
+// Restart the stall timer; a pending signal from the last one is cleared
+STATIC
+VOID
+ArmNvmeTcpTimeout(
+    IN NVMETCP_DISK *Disk
+) {
+    gBS->CheckEvent(Disk->Timeout);
+    gBS->SetTimer(Disk->Timeout, TimerRelative, NVMETCP_TIMEOUT);
+}
+
+/**
+  Reset the connection, which aborts every token still queued on it, and
+  release the child. The queue stays Failed so nothing is sent on it again.
+**/
+STATIC
+VOID
+CloseNvmeTcpQueue(
+    IN NVMETCP_DISK    *Disk,
+    IN NVMETCP_QUEUE   *Queue
+) {
+    if (Queue->Tcp != NULL) {
+        Queue->Tcp->Configure(Queue->Tcp, NULL);
+    }
+    if (Queue->Child != NULL) {
+        Disk->Binding->DestroyChild(Disk->Binding, Queue->Child);
+    }
+    if (Queue->ConnToken.CompletionToken.Event != NULL) {
+        gBS->CloseEvent(Queue->ConnToken.CompletionToken.Event);
+    }
+    if (Queue->RxToken.CompletionToken.Event != NULL) {
+        gBS->CloseEvent(Queue->RxToken.CompletionToken.Event);
+    }
+    if (Queue->Commands != NULL) {
+        for (UINTN i = 0; i < Queue->Depth; i++) {
+            if (Queue->Commands[i].TxToken.CompletionToken.Event != NULL) {
+                gBS->CloseEvent(Queue->Commands[i].TxToken.CompletionToken.Event);
+            }
+        }
+        FreePool(Queue->Commands);
+    }
+    ZeroMem(Queue, sizeof(*Queue));
+    Queue->Failed = TRUE;
+}
+
+/**
+  Hand TCP4 a receive for the rest of the current PDU header or C2H data.
+**/
+STATIC
+VOID
+PostNvmeTcpReceive(
+    IN NVMETCP_QUEUE *Queue
+) {
+    UINT8 *To;
+    UINT32 Length;
+
+    if (Queue->RxPosted || Queue->Failed) {
+        return;
+    }
+    if (Queue->RxLeft != 0) {
+        To = Queue->RxTo;
+        Length = Queue->RxLeft;
+    } else {
+        To = Queue->Rx + Queue->RxHave;
+        Length = Queue->RxWant - Queue->RxHave;
+    }
+
+    Queue->RxData.UrgentFlag = FALSE;
+    Queue->RxData.DataLength = Length;
+    Queue->RxData.FragmentCount = 1;
+    Queue->RxData.FragmentTable[0].FragmentLength = Length;
+    Queue->RxData.FragmentTable[0].FragmentBuffer = To;
+    Queue->RxToken.Packet.RxData = &Queue->RxData;
+    Queue->RxToken.CompletionToken.Status = EFI_NOT_READY;
+    if (EFI_ERROR(Queue->Tcp->Receive(Queue->Tcp, &Queue->RxToken))) {
+        Queue->Failed = TRUE;
+        return;
+    }
+    Queue->RxPosted = TRUE;
+}
+
+STATIC
+VOID
+CompleteNvmeTcpCommand(
+    IN NVMETCP_COMMAND *Cmd,
+    IN UINT16          Status,
+    IN UINT64          Result
+) {
+    if (Status == 0 && Cmd->Received != Cmd->Length) {
+        Status = NVME_STATUS_TRUNCATED;
+    }
+    Cmd->Status = Status;
+    Cmd->Result = Result;
+    Cmd->State = NvmeTcpCmdDone;
+}
+
+// The command a PDU names, if it is one we are waiting on
+STATIC
+NVMETCP_COMMAND *
+FindNvmeTcpCommand(
+    IN NVMETCP_QUEUE   *Queue,
+    IN UINT16          Cid
+) {
+    if (Cid >= Queue->Depth || Queue->Commands[Cid].State != NvmeTcpCmdIssued) {
+        return NULL;
+    }
+    return &Queue->Commands[Cid];
+}
+
+/**
+  Act on the complete PDU header in Queue->Rx and set up the receive for
+  whatever comes next.
+**/
+STATIC
+VOID
+HandleNvmeTcpPdu(
+    IN NVMETCP_QUEUE *Queue
+) {
+    NVMETCP_PDU_HEADER *Header = (NVMETCP_PDU_HEADER *)Queue->Rx;
+    NVMETCP_COMMAND *Cmd;
+
+    Queue->RxHave = 0;
+    Queue->RxWant = sizeof(NVMETCP_PDU_HEADER);
+
+    switch (Header->Type) {
+    case NVMETCP_ICRESP: {
+        NVMETCP_IC *Ic = (NVMETCP_IC *)Queue->Rx;
+        if (Header->Plen != NVMETCP_IC_LENGTH || Ic->Pfv != 0 || Ic->Digest != 0) {
+            Queue->Failed = TRUE;
+        }
+        Queue->IcDone = TRUE;
+        break;
+    }
+
+    case NVMETCP_CAPSULE_RESP: {
+        NVMETCP_RESPONSE *Resp = (NVMETCP_RESPONSE *)Queue->Rx;
+        Cmd = FindNvmeTcpCommand(Queue, Resp->Cid);
+        if (Header->Plen != sizeof(*Resp) || Cmd == NULL) {
+            Queue->Failed = TRUE;
+            break;
+        }
+        CompleteNvmeTcpCommand(Cmd, Resp->Status >> 1, Resp->Dw0 | LShiftU64(Resp->Dw1, 32));
+        break;
+    }
+
+    case NVMETCP_C2H_DATA: {
+        NVMETCP_C2H_DATA_HEADER *Data = (NVMETCP_C2H_DATA_HEADER *)Queue->Rx;
+        UINT32 Start = Header->Pdo != 0 ? Header->Pdo : Header->Hlen;
+        Cmd = FindNvmeTcpCommand(Queue, Data->Cid);
+        if (Cmd == NULL || Header->Plen != Start + Data->Length ||
+            Data->Offset > Cmd->Length || Data->Length > Cmd->Length - Data->Offset) {
+            Queue->Failed = TRUE;
+            break;
+        }
+        Queue->RxCommand = Cmd;
+        Queue->RxTo = Cmd->Data + Data->Offset;
+        Queue->RxLeft = Data->Length;
+        Queue->RxLength = Data->Length;
+        Queue->RxSuccess = (Header->Flags & (NVMETCP_C2H_LAST_PDU | NVMETCP_C2H_SUCCESS)) ==
+                           (NVMETCP_C2H_LAST_PDU | NVMETCP_C2H_SUCCESS);
+        if (Data->Length == 0 && Queue->RxSuccess) {
+            CompleteNvmeTcpCommand(Cmd, 0, 0);
+        }
+        break;
+    }
+
+    default:
+        // C2HTermReq, or anything a host should never see
+        Queue->Failed = TRUE;
+        break;
+    }
+}
+
+/**
+  Account for Got bytes that a completed receive delivered.
+**/
+STATIC
+VOID
+NvmeTcpReceived(
+    IN NVMETCP_QUEUE   *Queue,
+    IN UINT32          Got
+) {
+    if (Queue->RxLeft != 0) {
+        Queue->RxTo += Got;
+        Queue->RxLeft -= Got;
+        if (Queue->RxLeft == 0) {
+            Queue->RxCommand->Received += Queue->RxLength;
+            if (Queue->RxSuccess) {
+                CompleteNvmeTcpCommand(Queue->RxCommand, 0, 0);
+            }
+        }
+        return;
+    }
+
+    Queue->RxHave += Got;
+    if (Queue->RxHave < Queue->RxWant) {
+        return;
+    }
+    if (Queue->RxWant == sizeof(NVMETCP_PDU_HEADER)) {
+        // Common header in: now the rest of this PDU's header
+        NVMETCP_PDU_HEADER *Header = (NVMETCP_PDU_HEADER *)Queue->Rx;
+        UINT32 Want = Header->Plen;
+        if (Header->Type == NVMETCP_C2H_DATA) {
+            Want = Header->Pdo != 0 ? Header->Pdo : Header->Hlen;
+        }
+        if (Header->Hlen < sizeof(*Header) || Want < Header->Hlen || Want > sizeof(Queue->Rx)) {
+            Queue->Failed = TRUE;
+            return;
+        }
+        Queue->RxWant = Want;
+        if (Queue->RxHave < Want) {
+            return;
+        }
+    }
+    HandleNvmeTcpPdu(Queue);
+}
+
+/**
+  Let TCP4 run, then consume every receive that completed and reap
+  finished transmits.
+**/
+STATIC
+VOID
+PumpNvmeTcpQueue(
+    IN NVMETCP_QUEUE *Queue
+) {
+    if (Queue->Tcp == NULL || Queue->Failed) {
+        return;
+    }
+    Queue->Tcp->Poll(Queue->Tcp);
+
+    while (!Queue->Failed && Queue->RxPosted && Queue->RxToken.CompletionToken.Status != EFI_NOT_READY) {
+        Queue->RxPosted = FALSE;
+        if (EFI_ERROR(Queue->RxToken.CompletionToken.Status) || Queue->RxData.DataLength == 0) {
+            Queue->Failed = TRUE;
+            break;
+        }
+        NvmeTcpReceived(Queue, Queue->RxData.DataLength);
+        PostNvmeTcpReceive(Queue);
+    }
+
+    for (UINTN i = 0; i < Queue->Depth; i++) {
+        NVMETCP_COMMAND *Cmd = &Queue->Commands[i];
+        if (Cmd->TxPending && Cmd->TxToken.CompletionToken.Status != EFI_NOT_READY) {
+            Cmd->TxPending = FALSE;
+            if (EFI_ERROR(Cmd->TxToken.CompletionToken.Status)) {
+                Queue->Failed = TRUE;
+            }
+        }
+    }
+}
+
+STATIC
+VOID
+TransmitNvmeTcp(
+    IN NVMETCP_QUEUE   *Queue,
+    IN NVMETCP_COMMAND *Cmd,
+    IN VOID            *Buffer,
+    IN UINT32          Length
+) {
+    Cmd->TxData.Push = TRUE;
+    Cmd->TxData.Urgent = FALSE;
+    Cmd->TxData.DataLength = Length;
+    Cmd->TxData.FragmentCount = 1;
+    Cmd->TxData.FragmentTable[0].FragmentLength = Length;
+    Cmd->TxData.FragmentTable[0].FragmentBuffer = Buffer;
+    Cmd->TxToken.Packet.TxData = &Cmd->TxData;
+    Cmd->TxToken.CompletionToken.Status = EFI_NOT_READY;
+    if (EFI_ERROR(Queue->Tcp->Transmit(Queue->Tcp, &Cmd->TxToken))) {
+        Queue->Failed = TRUE;
+        return;
+    }
+    Cmd->TxPending = TRUE;
+}
+
+/**
+  Send Sqe as a command capsule in a free slot. InCapsule data, if any,
+  travels in the capsule; otherwise Length bytes of C2H data are expected
+  into Data. NULL when the queue is full or broken.
+**/
+STATIC
+NVMETCP_COMMAND *
+SubmitNvmeTcp(
+    IN NVMETCP_QUEUE   *Queue,
+    IN NVMETCP_SQE     *Sqe,
+    IN CONST VOID      *InCapsule OPTIONAL,
+    IN UINT32          InLength,
+    IN VOID            *Data OPTIONAL,
+    IN UINT32          Length
+) {
+    NVMETCP_COMMAND *Cmd = NULL;
+    UINT16 Cid = 0;
+
+    if (Queue->Failed) {
+        return NULL;
+    }
+    for (UINT16 n = 0; n < Queue->Depth; n++) {
+        Cid = (UINT16)((Queue->NextCid + n) % Queue->Depth);
+        if (Queue->Commands[Cid].State == NvmeTcpCmdFree && !Queue->Commands[Cid].TxPending) {
+            Cmd = &Queue->Commands[Cid];
+            break;
+        }
+    }
+    if (Cmd == NULL) {
+        return NULL;
+    }
+    Queue->NextCid = (UINT16)((Cid + 1) % Queue->Depth);
+
+    Sqe->Cid = Cid;
+    Sqe->Flags = NVME_CMD_SGL_METABUF;
+    Sqe->SglAddress = 0;
+    Sqe->SglLength = InCapsule != NULL ? InLength : Length;
+    Sqe->SglType = InCapsule != NULL ? NVME_SGL_INLINE : NVME_SGL_TRANSPORT;
+
+    Cmd->Pdu.Header.Type = NVMETCP_CAPSULE_CMD;
+    Cmd->Pdu.Header.Flags = 0;
+    Cmd->Pdu.Header.Hlen = sizeof(NVMETCP_CAPSULE);
+    Cmd->Pdu.Header.Pdo = 0;
+    Cmd->Pdu.Header.Plen = sizeof(NVMETCP_CAPSULE);
+    CopyMem(&Cmd->Pdu.Sqe, Sqe, sizeof(*Sqe));
+
+    Cmd->Data = Data;
+    Cmd->Length = InCapsule != NULL ? 0 : Length;
+    Cmd->Received = 0;
+    Cmd->State = NvmeTcpCmdIssued;
+    Queue->Inflight++;
+
+    if (InCapsule != NULL) {
+        NVMETCP_CAPSULE *Capsule = (NVMETCP_CAPSULE *)Queue->Capsule;
+        CopyMem(Capsule, &Cmd->Pdu, sizeof(*Capsule));
+        Capsule->Header.Pdo = sizeof(NVMETCP_CAPSULE);
+        Capsule->Header.Plen = sizeof(NVMETCP_CAPSULE) + InLength;
+        CopyMem(Capsule + 1, InCapsule, InLength);
+        TransmitNvmeTcp(Queue, Cmd, Capsule, Capsule->Header.Plen);
+    } else {
+        TransmitNvmeTcp(Queue, Cmd, &Cmd->Pdu, sizeof(Cmd->Pdu));
+    }
+    return Cmd;
+}
+
+/**
+  Run one command to completion on Queue. A timeout or broken connection
+  fails the queue, since the target may still write into Data later.
+**/
+STATIC
+EFI_STATUS
+ExecuteNvmeTcp(
+    IN  NVMETCP_DISK       *Disk,
+    IN  NVMETCP_QUEUE      *Queue,
+    IN  NVMETCP_SQE        *Sqe,
+    IN  CONST VOID         *InCapsule OPTIONAL,
+    IN  UINT32             InLength,
+    IN  VOID               *Data OPTIONAL,
+    IN  UINT32             Length,
+    OUT UINT64             *Result OPTIONAL
+) {
+    NVMETCP_COMMAND *Cmd = SubmitNvmeTcp(Queue, Sqe, InCapsule, InLength, Data, Length);
+
+    if (Cmd == NULL) {
+        return EFI_DEVICE_ERROR;
+    }
+    ArmNvmeTcpTimeout(Disk);
+    while (Cmd->State != NvmeTcpCmdDone) {
+        PumpNvmeTcpQueue(Queue);
+        if (Queue->Failed) {
+            return EFI_DEVICE_ERROR;
+        }
+        if (gBS->CheckEvent(Disk->Timeout) == EFI_SUCCESS) {
+            Queue->Failed = TRUE;
+            return EFI_TIMEOUT;
+        }
+    }
+    Cmd->State = NvmeTcpCmdFree;
+    Queue->Inflight--;
+    if (Result != NULL) {
+        *Result = Cmd->Result;
+    }
+    return Cmd->Status == 0 ? EFI_SUCCESS : EFI_DEVICE_ERROR;
+}
+
+STATIC
+EFI_STATUS
+WaitNvmeTcpToken(
+    IN NVMETCP_DISK                *Disk,
+    IN NVMETCP_QUEUE               *Queue,
+    IN EFI_TCP4_COMPLETION_TOKEN   *Token
+) {
+    ArmNvmeTcpTimeout(Disk);
+    while (Token->Status == EFI_NOT_READY) {
+        Queue->Tcp->Poll(Queue->Tcp);
+        if (gBS->CheckEvent(Disk->Timeout) == EFI_SUCCESS) {
+            return EFI_TIMEOUT;
+        }
+    }
+    return Token->Status;
+}
+
+/**
+  Connect a TCP stream to the target, exchange ICReq/ICResp and send the
+  fabrics Connect for queue Qid (0 = admin) with SqSize entries (0-based).
+**/
+STATIC
+EFI_STATUS
+OpenNvmeTcpQueue(
+    IN NVMETCP_DISK    *Disk,
+    IN NVMETCP_QUEUE   *Queue,
+    IN UINT16          Qid,
+    IN UINT16          Depth,
+    IN UINT16          SqSize
+) {
+    EFI_STATUS Status;
+    NVMETCP_SQE Sqe;
+    UINT64 Result = 0;
+
+    ZeroMem(Queue, sizeof(*Queue));
+    Queue->Depth = Depth;
+    Queue->RxWant = sizeof(NVMETCP_PDU_HEADER);
+    Queue->Commands = AllocateZeroPool(Depth * sizeof(NVMETCP_COMMAND));
+    if (Queue->Commands == NULL) {
+        CloseNvmeTcpQueue(Disk, Queue);
+        return EFI_OUT_OF_RESOURCES;
+    }
+
+    Status = Disk->Binding->CreateChild(Disk->Binding, &Queue->Child);
+    if (!EFI_ERROR(Status)) {
+        Status = gBS->HandleProtocol(Queue->Child, &gEfiTcp4ProtocolGuid, (VOID **)&Queue->Tcp);
+    }
+    if (!EFI_ERROR(Status)) {
+        Status = ConfigureNvmeTcp(Disk, Queue->Tcp);
+    }
+    if (!EFI_ERROR(Status)) {
+        Status = gBS->CreateEvent(EVT_NOTIFY_SIGNAL, TPL_CALLBACK, NvmeTcpTokenNotify, NULL,
+                                  &Queue->ConnToken.CompletionToken.Event);
+    }
+    if (!EFI_ERROR(Status)) {
+        Status = gBS->CreateEvent(EVT_NOTIFY_SIGNAL, TPL_CALLBACK, NvmeTcpTokenNotify, NULL,
+                                  &Queue->RxToken.CompletionToken.Event);
+    }
+    for (UINTN i = 0; i < Depth && !EFI_ERROR(Status); i++) {
+        Status = gBS->CreateEvent(EVT_NOTIFY_SIGNAL, TPL_CALLBACK, NvmeTcpTokenNotify, NULL,
+                                  &Queue->Commands[i].TxToken.CompletionToken.Event);
+    }
+
+    if (!EFI_ERROR(Status)) {
+        Queue->ConnToken.CompletionToken.Status = EFI_NOT_READY;
+        Status = Queue->Tcp->Connect(Queue->Tcp, &Queue->ConnToken);
+        if (!EFI_ERROR(Status)) {
+            Status = WaitNvmeTcpToken(Disk, Queue, &Queue->ConnToken.CompletionToken);
+        }
+    }
+
+    if (!EFI_ERROR(Status)) {
+        NVMETCP_IC *Ic = (NVMETCP_IC *)Queue->Capsule;
+        ZeroMem(Ic, sizeof(*Ic));
+        Ic->Header.Type = NVMETCP_ICREQ;
+        Ic->Header.Hlen = NVMETCP_IC_LENGTH;
+        Ic->Header.Plen = NVMETCP_IC_LENGTH;
+        PostNvmeTcpReceive(Queue);
+        TransmitNvmeTcp(Queue, &Queue->Commands[0], Ic, sizeof(*Ic));
+        ArmNvmeTcpTimeout(Disk);
+        while ((!Queue->IcDone || Queue->Commands[0].TxPending) && !Queue->Failed) {
+            PumpNvmeTcpQueue(Queue);
+            if (gBS->CheckEvent(Disk->Timeout) == EFI_SUCCESS) {
+                Queue->Failed = TRUE;
+            }
+        }
+        Status = Queue->Failed ? EFI_PROTOCOL_ERROR : EFI_SUCCESS;
+    }
+
+    if (!EFI_ERROR(Status)) {
+        Disk->Connect.ControllerId = Qid == 0 ? 0xFFFF : Disk->Connect.ControllerId;
+        ZeroMem(&Sqe, sizeof(Sqe));
+        Sqe.Opcode = NVME_FABRICS;
+        Sqe.Nsid = NVME_FCTYPE_CONNECT;
+        Sqe.Cdw10 = (UINT32)Qid << 16;
+        Sqe.Cdw11 = SqSize;
+        Status = ExecuteNvmeTcp(Disk, Queue, &Sqe, &Disk->Connect, sizeof(Disk->Connect), NULL, 0, &Result);
+        if (!EFI_ERROR(Status) && Qid == 0) {
+            Disk->Connect.ControllerId = (UINT16)Result;
+        }
+    }
+
+    if (EFI_ERROR(Status)) {
+        CloseNvmeTcpQueue(Disk, Queue);
+    }
+    return Status;
+}
+
+STATIC
+EFI_STATUS
+NvmeTcpProperty(
+    IN  NVMETCP_DISK   *Disk,
+    IN  UINT8          FcType,
+    IN  UINT32         Offset,
+    IN  BOOLEAN        Wide,
+    IN  UINT64         Value,
+    OUT UINT64         *Result OPTIONAL
+) {
+    NVMETCP_SQE Sqe;
+
+    ZeroMem(&Sqe, sizeof(Sqe));
+    Sqe.Opcode = NVME_FABRICS;
+    Sqe.Nsid = FcType;
+    Sqe.Cdw10 = Wide ? 1 : 0;
+    Sqe.Cdw11 = Offset;
+    Sqe.Cdw12 = (UINT32)Value;
+    Sqe.Cdw13 = (UINT32)RShiftU64(Value, 32);
+    return ExecuteNvmeTcp(Disk, &Disk->Admin, &Sqe, NULL, 0, NULL, 0, Result);
+}
+
+STATIC
+EFI_STATUS
+NvmeTcpIdentify(
+    IN NVMETCP_DISK    *Disk,
+    IN UINT32          Nsid,
+    IN UINT32          Cns
+) {
+    NVMETCP_SQE Sqe;
+
+    ZeroMem(&Sqe, sizeof(Sqe));
+    Sqe.Opcode = NVME_ADMIN_IDENTIFY;
+    Sqe.Nsid = Nsid;
+    Sqe.Cdw10 = Cns;
+    return ExecuteNvmeTcp(Disk, &Disk->Admin, &Sqe, NULL, 0, Disk->Identify, SIZE_4KB, NULL);
+}
+
+/**
+  Enable the controller through the property interface, then read the
+  transfer limit, pick the first active namespace and ask for I/O queues.
+  Returns how many I/O queues the controller granted.
+**/
+STATIC
+EFI_STATUS
+StartNvmeTcpController(
+    IN  NVMETCP_DISK   *Disk,
+    OUT UINTN          *IoQueues
+) {
+    EFI_STATUS Status;
+    UINT64 Value = 0;
+    UINTN Waited = 0, Limit;
+
+    Status = NvmeTcpProperty(Disk, NVME_FCTYPE_PROPERTY_GET, NVME_PROP_CAP, TRUE, 0, &Disk->Cap);
+    if (!EFI_ERROR(Status)) {
+        Status = NvmeTcpProperty(Disk, NVME_FCTYPE_PROPERTY_SET, NVME_PROP_CC, FALSE, NVME_CC_ENABLE, NULL);
+    }
+    Limit = MAX(1, (UINTN)RShiftU64(Disk->Cap, 24) & 0xFF) * 500;    // CAP.TO, 500 ms units
+    while (!EFI_ERROR(Status)) {
+        Status = NvmeTcpProperty(Disk, NVME_FCTYPE_PROPERTY_GET, NVME_PROP_CSTS, FALSE, 0, &Value);
+        if (EFI_ERROR(Status) || (Value & NVME_CSTS_RDY) != 0) {
+            break;
+        }
+        if ((Value & NVME_CSTS_CFS) != 0 || Waited >= Limit) {
+            Status = EFI_DEVICE_ERROR;
+            break;
+        }
+        gBS->Stall(10 * 1000);
+        Waited += 10;
+    }
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    // MDTS is in units of the minimum page size (CAP.MPSMIN)
+    Status = NvmeTcpIdentify(Disk, 0, NVME_CNS_CONTROLLER);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    Disk->MaxTransfer = NVMETCP_MAX_TRANSFER;
+    if (Disk->Identify[77] != 0) {
+        UINT32 Shift = 12 + ((UINT32)RShiftU64(Disk->Cap, 48) & 0xF) + Disk->Identify[77];
+        if (Shift < 31) {
+            Disk->MaxTransfer = MIN(Disk->MaxTransfer, 1U << Shift);
+        }
+    }
+
+    Status = NvmeTcpIdentify(Disk, 0, NVME_CNS_ACTIVE_NS_LIST);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    Disk->Nsid = *(UINT32 *)Disk->Identify;
+    if (Disk->Nsid == 0) {
+        return EFI_NOT_FOUND;
+    }
+
+    Status = NvmeTcpIdentify(Disk, Disk->Nsid, NVME_CNS_NAMESPACE);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    UINT8 Format = Disk->Identify[26] & 0xF;
+    UINT8 BlockShift = Disk->Identify[128 + Format * 4 + 2];
+    if (BlockShift < 9 || BlockShift > 12 || (UINT32)(1 << BlockShift) > Disk->MaxTransfer) {
+        return EFI_UNSUPPORTED;
+    }
+    Disk->BlockShift = BlockShift;
+    Disk->Blocks = *(UINT64 *)Disk->Identify;
+
+    // Number of Queues: both counts are 0-based; a target that refuses
+    // the feature still gives us one
+    NVMETCP_SQE Sqe;
+    ZeroMem(&Sqe, sizeof(Sqe));
+    Sqe.Opcode = NVME_ADMIN_SET_FEATURES;
+    Sqe.Cdw10 = NVME_FEATURE_QUEUES;
+    Sqe.Cdw11 = ((NVMETCP_MAX_IO_QUEUES - 1) << 16) | (NVMETCP_MAX_IO_QUEUES - 1);
+    *IoQueues = 1;
+    if (!EFI_ERROR(ExecuteNvmeTcp(Disk, &Disk->Admin, &Sqe, NULL, 0, NULL, 0, &Value))) {
+        UINTN Granted = (UINTN)MIN(Value & 0xFFFF, RShiftU64(Value, 16) & 0xFFFF) + 1;
+        *IoQueues = MIN(NVMETCP_MAX_IO_QUEUES, Granted);
+    }
+    return Disk->Admin.Failed ? EFI_DEVICE_ERROR : EFI_SUCCESS;
+}
+
+/**
+  Read Blocks namespace blocks from Lba into Buffer, Disk->MaxTransfer per
+  command. Commands are issued round-robin over the live I/O queues as
+  slots free up, so every connection stays busy until the last one is
+  issued. On a stall or a dropped connection the queues with commands
+  outstanding are reset, so nothing lands in Buffer after we return.
+**/
+STATIC
+EFI_STATUS
+NvmeTcpReadBlocks(
+    IN  NVMETCP_DISK   *Disk,
+    IN  UINT64         Lba,
+    IN  UINT64         Blocks,
+    OUT UINT8          *Buffer
+) {
+    UINT32 PerCommand = Disk->MaxTransfer >> Disk->BlockShift;
+    UINT64 Next = 0;
+    UINTN Outstanding = 0;
+    BOOLEAN Error = FALSE;
+
+    ArmNvmeTcpTimeout(Disk);
+    while ((Next < Blocks && !Error) || Outstanding > 0) {
+        BOOLEAN Progress = FALSE;
+
+        // Fill every free slot, rotating over the queues
+        for (UINTN Tries = 0; Next < Blocks && !Error && Tries < Disk->IoCount; ) {
+            NVMETCP_QUEUE *Queue = &Disk->Io[Disk->NextQueue];
+            UINT32 Count = (UINT32)MIN((UINT64)PerCommand, Blocks - Next);
+            NVMETCP_SQE Sqe;
+
+            ZeroMem(&Sqe, sizeof(Sqe));
+            Sqe.Opcode = NVME_IO_READ;
+            Sqe.Nsid = Disk->Nsid;
+            Sqe.Cdw10 = (UINT32)(Lba + Next);
+            Sqe.Cdw11 = (UINT32)RShiftU64(Lba + Next, 32);
+            Sqe.Cdw12 = Count - 1;
+            if (Queue->Inflight < Queue->Depth &&
+                SubmitNvmeTcp(Queue, &Sqe, NULL, 0, Buffer + LShiftU64(Next, Disk->BlockShift),
+                              Count << Disk->BlockShift) != NULL) {
+                Next += Count;
+                Outstanding++;
+                Progress = TRUE;
+                Tries = 0;
+            } else {
+                Tries++;
+            }
+            Disk->NextQueue = (Disk->NextQueue + 1) % Disk->IoCount;
+        }
+
+        // Reap completions; a dead queue takes its commands with it
+        for (UINTN q = 0; q < Disk->IoCount; q++) {
+            NVMETCP_QUEUE *Queue = &Disk->Io[q];
+            PumpNvmeTcpQueue(Queue);
+            for (UINTN i = 0; i < Queue->Depth && Queue->Inflight > 0; i++) {
+                NVMETCP_COMMAND *Cmd = &Queue->Commands[i];
+                if (Cmd->State == NvmeTcpCmdFree || (Cmd->State == NvmeTcpCmdIssued && !Queue->Failed)) {
+                    continue;
+                }
+                if (Cmd->State != NvmeTcpCmdDone || Cmd->Status != 0) {
+                    Error = TRUE;
+                }
+                Cmd->State = NvmeTcpCmdFree;
+                Queue->Inflight--;
+                Outstanding--;
+                Progress = TRUE;
+            }
+            if (Queue->Failed && Queue->Tcp != NULL) {
+                CloseNvmeTcpQueue(Disk, Queue);
+            }
+        }
+
+        if (Progress) {
+            ArmNvmeTcpTimeout(Disk);
+        } else if (gBS->CheckEvent(Disk->Timeout) == EFI_SUCCESS) {
+            for (UINTN q = 0; q < Disk->IoCount; q++) {
+                if (Disk->Io[q].Inflight > 0) {
+                    Outstanding -= Disk->Io[q].Inflight;
+                    CloseNvmeTcpQueue(Disk, &Disk->Io[q]);
+                }
+            }
+            Error = TRUE;
+        }
+
+        // With every connection gone nothing more can be issued
+        BOOLEAN Alive = FALSE;
+        for (UINTN q = 0; q < Disk->IoCount; q++) {
+            Alive |= !Disk->Io[q].Failed;
+        }
+        Error |= !Alive;
+    }
+    return Error ? EFI_DEVICE_ERROR : EFI_SUCCESS;
+}
+
+STATIC
+int
+NvmeTcpRead(
+    block_device_t  *dev,
+    uint64_t        sector,
+    uint32_t        count,
+    void            *buf
+) {
+    NVMETCP_DISK *Disk = (NVMETCP_DISK *)dev->context;
+    UINT32 Shift = Disk->BlockShift - 9;
+    UINT64 PerBlock = 1ULL << Shift;
+    UINT8 *Out = (UINT8 *)buf;
+
+    if (sector >= dev->sector_count || count > dev->sector_count - sector) {
+        return -1;
+    }
+
+    while (count > 0) {
+        UINT64 Skip = sector & (PerBlock - 1);
+        UINT64 Lba = RShiftU64(sector, Shift);
+        UINT64 Done;
+
+        if (Skip != 0 || count < PerBlock) {
+            // Part of one block
+            Done = MIN(PerBlock - Skip, (UINT64)count);
+            if (EFI_ERROR(NvmeTcpReadBlocks(Disk, Lba, 1, Disk->Bounce))) {
+                return -1;
+            }
+            CopyMem(Out, Disk->Bounce + Skip * BLOCKDEV_SECTOR_SIZE, (UINTN)Done * BLOCKDEV_SECTOR_SIZE);
+        } else {
+            UINT64 Blocks = RShiftU64(count, Shift);
+            if (EFI_ERROR(NvmeTcpReadBlocks(Disk, Lba, Blocks, Out))) {
+                return -1;
+            }
+            Done = LShiftU64(Blocks, Shift);
+        }
+        sector += Done;
+        count -= (uint32_t)Done;
+        Out += Done * BLOCKDEV_SECTOR_SIZE;
+    }
+    return 0;
+}
+
+STATIC
+VOID
+FreeNvmeTcpDisk(
+    IN NVMETCP_DISK *Disk
+) {
+    for (UINTN q = 0; q < Disk->IoCount; q++) {
+        CloseNvmeTcpQueue(Disk, &Disk->Io[q]);
+    }
+    CloseNvmeTcpQueue(Disk, &Disk->Admin);
+    if (Disk->Timeout != NULL) {
+        gBS->CloseEvent(Disk->Timeout);
+    }
+    if (Disk->Identify != NULL) {
+        FreePool(Disk->Identify);
+    }
+    if (Disk->Bounce != NULL) {
+        FreePool(Disk->Bounce);
+    }
+    FreePool(Disk);
+}
+
+EFI_STATUS
+AttachNvmeTcpDisk(
+    IN  CONST CHAR8             *Target,
+    OUT struct block_device     **Device
+) {
+    EFI_IPv4_ADDRESS Address;
+    UINT16 Port;
+    UINTN IoQueues = 0;
+    EFI_STATUS Status;
+    NVMETCP_DISK *Disk = AllocateZeroPool(sizeof(*Disk));
+
+    if (Disk == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    Status = ParseNvmeTcpTarget(Target, &Address, &Port, Disk->Connect.SubNqn, sizeof(Disk->Connect.SubNqn));
+    if (!EFI_ERROR(Status)) {
+        Status = FindTcp4Binding(Disk);
+    }
+    if (!EFI_ERROR(Status)) {
+        Status = gBS->CreateEvent(EVT_TIMER, 0, NULL, NULL, &Disk->Timeout);
+    }
+    if (!EFI_ERROR(Status)) {
+        Disk->Identify = AllocatePool(SIZE_4KB);
+        Disk->Bounce = AllocatePool(SIZE_4KB);
+        Status = (Disk->Identify == NULL || Disk->Bounce == NULL) ? EFI_OUT_OF_RESOURCES : EFI_SUCCESS;
+    }
+    if (EFI_ERROR(Status)) {
+        FreeNvmeTcpDisk(Disk);
+        return Status;
+    }
+    SetNvmeTcpHostIdentity(Disk);
+
+    // Nagle would hold each command capsule back until the last was acked
+    Disk->Option.ReceiveBufferSize = NVMETCP_RECEIVE_BUFFER;
+    Disk->Option.EnableNagle = FALSE;
+    Disk->Option.EnableTimeStamp = TRUE;
+    Disk->Option.EnableWindowScaling = TRUE;
+    Disk->Config.TimeToLive = 64;
+    Disk->Config.AccessPoint.UseDefaultAddress = TRUE;
+    Disk->Config.AccessPoint.ActiveFlag = TRUE;
+    Disk->Config.AccessPoint.RemotePort = Port;
+    CopyMem(&Disk->Config.AccessPoint.RemoteAddress, &Address, sizeof(Address));
+    Disk->Config.ControlOption = &Disk->Option;
+
+    Status = OpenNvmeTcpQueue(Disk, &Disk->Admin, 0, NVMETCP_ADMIN_DEPTH, NVMETCP_ADMIN_SQSIZE);
+    if (!EFI_ERROR(Status)) {
+        Status = StartNvmeTcpController(Disk, &IoQueues);
+    }
+
+    // As many I/O connections as the target grants and accepts; one will do
+    if (!EFI_ERROR(Status)) {
+        UINT16 Depth = (UINT16)MIN(NVMETCP_QUEUE_DEPTH, ((UINT32)Disk->Cap & 0xFFFF));
+        Depth = MAX(Depth, 1);
+        while (Disk->IoCount < IoQueues &&
+               !EFI_ERROR(OpenNvmeTcpQueue(Disk, &Disk->Io[Disk->IoCount], (UINT16)(Disk->IoCount + 1),
+                                           Depth, Depth))) {
+            Disk->IoCount++;
+        }
+        Status = Disk->IoCount > 0 ? EFI_SUCCESS : EFI_DEVICE_ERROR;
+    }
+    if (EFI_ERROR(Status)) {
+        FreeNvmeTcpDisk(Disk);
+        return Status;
+    }
+
+    AsciiSPrint(Disk->Name, sizeof(Disk->Name), "nvme-tcp:%d.%d.%d.%d",
+                Address.Addr[0], Address.Addr[1], Address.Addr[2], Address.Addr[3]);
+    Disk->Device.name = Disk->Name;
+    Disk->Device.sector_count = LShiftU64(Disk->Blocks, Disk->BlockShift - 9);
+    Disk->Device.read = NvmeTcpRead;
+    Disk->Device.context = Disk;
+    *Device = &Disk->Device;
+    return EFI_SUCCESS;
+}
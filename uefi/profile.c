@@ -0,0 +1,290 @@
+/*
+ * profile.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <Uefi.h>
+#include "compat.h"
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/PrintLib.h>
+#include <Protocol/LoadedImage.h>
+#include <IndustryStandard/PeImage.h>
+#include "uefi.h"
+
+// 1 ms in 100 ns units; the firmware rounds it up to its timer tick
+#define PROFILE_PERIOD          10000
+
+// One histogram bucket per 16 bytes of loader code
+#define PROFILE_BUCKET_SHIFT    4
+
+// How far above the notification's frame to look for a loader address:
+// the timer interrupt and event dispatch frames sit in between
+#define PROFILE_STACK_SCAN      4096
+
+// Longest line BootProfilerSave writes per bucket
+#define PROFILE_LINE_MAX        32
+
+STATIC EFI_EVENT mProfileEvent;
+STATIC UINTN     mProfileImageBase;
+STATIC UINTN     mProfileCodeStart;     // [Start, End) spans the image's code sections; cached
+STATIC UINTN     mProfileCodeEnd;
+STATIC UINT32*   mProfileBuckets;
+STATIC UINTN     mProfileBucketCount;
+STATIC UINT64    mProfileSamples;
+STATIC UINT64    mProfileMissed;        // Samples with no loader address on the stack
+
+/**
+  Find the code sections of the running image from its PE/COFF headers,
+  so that data pointers into the image are not taken for return addresses.
+**/
+STATIC
+EFI_STATUS
+ProfileFindCode(VOID) {
+    EFI_LOADED_IMAGE_PROTOCOL* LoadedImage = NULL;
+    EFI_IMAGE_DOS_HEADER* Dos;
+    EFI_IMAGE_OPTIONAL_HEADER_PTR_UNION Hdr;
+    EFI_IMAGE_SECTION_HEADER* Section;
+    UINTN Base, CodeStart = MAX_UINTN, CodeEnd = 0;
+    EFI_STATUS Status;
+
+    Status = gBS->HandleProtocol(gImageHandle, &gEfiLoadedImageProtocolGuid, (VOID**)&LoadedImage);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    Base = (UINTN)LoadedImage->ImageBase;
+
+    Dos = (EFI_IMAGE_DOS_HEADER*)Base;
+    if (Dos->e_magic != EFI_IMAGE_DOS_SIGNATURE) {
+        return EFI_UNSUPPORTED;
+    }
+    Hdr.Pe32 = (EFI_IMAGE_NT_HEADERS32*)(Base + Dos->e_lfanew);
+    if (Hdr.Pe32->Signature != EFI_IMAGE_NT_SIGNATURE) {
+        return EFI_UNSUPPORTED;
+    }
+
+    // The file header sits at the same place in PE32 and PE32+
+    Section = (EFI_IMAGE_SECTION_HEADER*)((UINT8*)&Hdr.Pe32->OptionalHeader +
+                                          Hdr.Pe32->FileHeader.SizeOfOptionalHeader);
+    for (UINTN i = 0; i < Hdr.Pe32->FileHeader.NumberOfSections; i++, Section++) {
+        if (!(Section->Characteristics & EFI_IMAGE_SCN_CNT_CODE)) {
+            continue;
+        }
+        CodeStart = MIN(CodeStart, Base + Section->VirtualAddress);
+        CodeEnd = MAX(CodeEnd, Base + Section->VirtualAddress + Section->Misc.VirtualSize);
+    }
+    if (CodeEnd <= CodeStart || CodeEnd > Base + LoadedImage->ImageSize) {
+        return EFI_UNSUPPORTED;
+    }
+
+    mProfileImageBase = Base;
+    mProfileCodeStart = CodeStart;
+    mProfileCodeEnd = CodeEnd;
+    return EFI_SUCCESS;
+}
+
+EFI_STATUS
+GetLoaderCodeRange(
+    OUT UINTN *ImageBase OPTIONAL,
+    OUT UINTN *Start,
+    OUT UINTN *End
+) {
+    if (mProfileCodeEnd == 0) {
+        EFI_STATUS Status = ProfileFindCode();
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+    }
+    if (ImageBase != NULL) {
+        *ImageBase = mProfileImageBase;
+    }
+    *Start = mProfileCodeStart;
+    *End = mProfileCodeEnd;
+    return EFI_SUCCESS;
+}
+
+/**
+  One sample. The notification has no access to the interrupted context,
+  so it takes the first loader code address above its own frame: the
+  interrupted instruction when the loader was running, or the loader's
+  call site when a firmware routine was. Running at TPL_NOTIFY, it sees
+  everything except code that itself holds TPL_NOTIFY or above.
+**/
+STATIC
+VOID
+EFIAPI
+ProfileNotify(
+    IN EFI_EVENT  Event,
+    IN VOID       *Context
+) {
+    volatile UINTN Anchor = 0;
+    UINTN* Slot = (UINTN*)&Anchor;
+    UINTN* Limit = (UINTN*)((UINT8*)Slot + PROFILE_STACK_SCAN);
+
+    mProfileSamples++;
+    for (; Slot < Limit; Slot++) {
+        UINTN Value = *Slot;
+        // The dispatcher may still hold this function's own address
+        if (Value >= mProfileCodeStart && Value < mProfileCodeEnd && Value != (UINTN)ProfileNotify) {
+            mProfileBuckets[(Value - mProfileCodeStart) >> PROFILE_BUCKET_SHIFT]++;
+            return;
+        }
+    }
+    mProfileMissed++;
+}
+
+/**
+  Start (TRUE) or stop (FALSE) the sampling profiler. Samples accumulate
+  across restarts until BootProfilerReset; the histogram stays readable
+  after a stop. Stop it before ExitBootServices.
+**/
+EFI_STATUS
+InstallBootProfiler(
+    IN BOOLEAN Enable
+) {
+    EFI_STATUS Status;
+
+    if (!Enable) {
+        if (mProfileEvent != NULL) {
+            gBS->CloseEvent(mProfileEvent);
+            mProfileEvent = NULL;
+        }
+        return EFI_SUCCESS;
+    }
+    if (mProfileEvent != NULL) {
+        return EFI_SUCCESS;
+    }
+
+    if (mProfileBuckets == NULL) {
+        Status = mProfileCodeEnd ? EFI_SUCCESS : ProfileFindCode();
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+        mProfileBucketCount = ((mProfileCodeEnd - mProfileCodeStart) >> PROFILE_BUCKET_SHIFT) + 1;
+        mProfileBuckets = AllocateZeroPool(mProfileBucketCount * sizeof(UINT32));
+        if (mProfileBuckets == NULL) {
+            return EFI_OUT_OF_RESOURCES;
+        }
+    }
+
+    Status = gBS->CreateEvent(EVT_TIMER | EVT_NOTIFY_SIGNAL, TPL_NOTIFY, ProfileNotify, NULL, &mProfileEvent);
+    if (EFI_ERROR(Status)) {
+        mProfileEvent = NULL;
+        return Status;
+    }
+    Status = gBS->SetTimer(mProfileEvent, TimerPeriodic, PROFILE_PERIOD);
+    if (EFI_ERROR(Status)) {
+        gBS->CloseEvent(mProfileEvent);
+        mProfileEvent = NULL;
+    }
+    return Status;
+}
+
+BOOLEAN
+BootProfilerRunning(VOID) {
+    return mProfileEvent != NULL;
+}
+
+VOID
+BootProfilerReset(VOID) {
+    EFI_TPL OldTpl;
+
+    if (mProfileBuckets == NULL) {
+        return;
+    }
+    OldTpl = gBS->RaiseTPL(TPL_NOTIFY);
+    ZeroMem(mProfileBuckets, mProfileBucketCount * sizeof(UINT32));
+    mProfileSamples = 0;
+    mProfileMissed = 0;
+    gBS->RestoreTPL(OldTpl);
+}
+
+/**
+  Print the Top hottest buckets as offsets from the image base, the form
+  the linker map uses, with their share of all samples.
+**/
+VOID
+BootProfilerPrint(
+    IN UINTN Top
+) {
+    UINT32 LastCount = MAX_UINT32;
+    UINTN LastIndex = 0;
+
+    if (mProfileBuckets == NULL || mProfileSamples == 0) {
+        Print(L"No profile samples\n");
+        return;
+    }
+
+    Print(L"%lu samples, %lu outside the loader; image base 0x%lx, %u-byte buckets\n",
+          mProfileSamples, mProfileMissed, (UINT64)mProfileImageBase, 1u << PROFILE_BUCKET_SHIFT);
+
+    // Selection by (count descending, offset ascending), Top passes; the
+    // histogram is too large to copy for a sort
+    for (UINTN n = 0; n < Top; n++) {
+        UINT32 BestCount = 0;
+        UINTN BestIndex = 0;
+        for (UINTN i = 0; i < mProfileBucketCount; i++) {
+            UINT32 Count = mProfileBuckets[i];
+            if (Count == 0 || Count > LastCount || (Count == LastCount && i <= LastIndex)) {
+                continue;
+            }
+            if (Count > BestCount) {
+                BestCount = Count;
+                BestIndex = i;
+            }
+        }
+        if (BestCount == 0) {
+            break;
+        }
+        Print(L"  +0x%06lx  %8u  %3lu%%\n",
+              (UINT64)(mProfileCodeStart - mProfileImageBase + (BestIndex << PROFILE_BUCKET_SHIFT)),
+              BestCount, (UINT64)BestCount * 100 / mProfileSamples);
+        LastCount = BestCount;
+        LastIndex = BestIndex;
+    }
+}
+
+/**
+  Write every non-empty bucket to a text file on the boot volume, one
+  "offset count" line each, for symbolizing against BloodHorn.map.
+**/
+EFI_STATUS
+BootProfilerSave(
+    IN CONST CHAR16* FileName
+) {
+    CHAR8* Text;
+    UINTN Lines = 0, Size, Length;
+    EFI_STATUS Status;
+
+    if (mProfileBuckets == NULL) {
+        return EFI_NOT_STARTED;
+    }
+    for (UINTN i = 0; i < mProfileBucketCount; i++) {
+        Lines += mProfileBuckets[i] != 0;
+    }
+
+    Size = (Lines + 2) * PROFILE_LINE_MAX + 64;
+    Text = AllocatePool(Size);
+    if (Text == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    Length = AsciiSPrint(Text, Size, "# samples %lu missed %lu base 0x%lx bucket %u\n",
+                         mProfileSamples, mProfileMissed, (UINT64)mProfileImageBase,
+                         1u << PROFILE_BUCKET_SHIFT);
+    // Buckets can fill in while this runs; they are left for the next save
+    for (UINTN i = 0; i < mProfileBucketCount && Size - Length > PROFILE_LINE_MAX; i++) {
+        if (mProfileBuckets[i] != 0) {
+            Length += AsciiSPrint(Text + Length, Size - Length, "0x%06lx %u\n",
+                                  (UINT64)(mProfileCodeStart - mProfileImageBase + (i << PROFILE_BUCKET_SHIFT)),
+                                  mProfileBuckets[i]);
+        }
+    }
+
+    Status = WriteBootFile(FileName, Text, Length);
+    FreePool(Text);
+    return Status;
+}
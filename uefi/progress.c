@@ -0,0 +1,201 @@
+/*
+ * progress.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <Uefi.h>
+#include "compat.h"
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/TimerLib.h>
+#include "uefi.h"
+#include "../boot/libb/include/bloodhorn/counters.h"
+
+// Loads that finish sooner never reach the hook, so configuration files
+// and small images do not flash an overlay (fraction of a second: 1/4 s)
+#define LOAD_PROGRESS_DELAY_DIV     4
+
+// Shortest interval between two hook calls (fraction of a second: ~10 Hz)
+#define LOAD_PROGRESS_INTERVAL_DIV  10
+
+STATIC LOAD_PROGRESS_HOOK mProgressHook;
+STATIC LOAD_PROGRESS      mProgress;
+STATIC CHAR16             mProgressName[LOAD_PROGRESS_NAME_MAX];
+STATIC UINTN              mProgressDepth;       // Begin calls not yet ended
+STATIC BOOLEAN            mProgressShown;       // The hook has seen this load
+STATIC BOOLEAN            mProgressCountsUp;    // Direction of the performance counter
+STATIC UINT64             mProgressStart;       // Counter at the outermost Begin
+STATIC UINT64             mProgressLast;        // Counter at the last hook call
+STATIC UINT64             mProgressDelay;       // The two thresholds above, in counter ticks
+STATIC UINT64             mProgressInterval;
+
+STATIC
+UINT64
+ProgressTicks(
+    IN UINT64 Since,
+    IN UINT64 Now
+) {
+    return mProgressCountsUp ? Now - Since : Since - Now;
+}
+
+/**
+  Fills in the derived figures and hands the current state to the hook.
+  The rate is the average since Begin, which is steadier than the last
+  interval's and is what an operator comparing machines wants.
+**/
+STATIC
+VOID
+ReportLoadProgress(
+    IN UINT64 Now
+) {
+    UINT64 ElapsedUs = GetTimeInNanoSecond(ProgressTicks(mProgressStart, Now)) / 1000;
+
+    mProgress.ElapsedUs = ElapsedUs;
+    mProgress.BytesPerSecond = ElapsedUs ? mProgress.Done * 1000000 / ElapsedUs : 0;
+    mProgress.EtaSeconds = 0;
+    if (mProgress.BytesPerSecond && mProgress.Total > mProgress.Done) {
+        mProgress.EtaSeconds = (mProgress.Total - mProgress.Done + mProgress.BytesPerSecond - 1) /
+                               mProgress.BytesPerSecond;
+    }
+    mProgressLast = Now;
+    mProgressShown = TRUE;
+    mProgressHook(&mProgress);
+}
+
+/**
+  Installs the display for load progress, or removes it (NULL). Only one
+  hook is kept; the last one set wins.
+**/
+VOID
+SetLoadProgressHook(
+    IN LOAD_PROGRESS_HOOK Hook OPTIONAL
+) {
+    mProgressHook = Hook;
+}
+
+/**
+  Starts reporting a load of Total bytes (0 if not known yet). A Begin
+  inside another load folds into it: its bytes count toward the outer
+  load, and its size is only used if the outer one had none.
+**/
+VOID
+LoadProgressBegin(
+    IN CONST CHAR16 *Name,
+    IN UINT64       Total
+) {
+    if (mProgressDepth++ != 0) {
+        if (mProgress.Total == 0) {
+            mProgress.Total = Total;
+        }
+        return;
+    }
+
+    UINT64 StartValue, EndValue;
+    UINT64 Frequency = GetPerformanceCounterProperties(&StartValue, &EndValue);
+    mProgressCountsUp = (EndValue >= StartValue);
+    mProgressDelay = Frequency / LOAD_PROGRESS_DELAY_DIV;
+    mProgressInterval = Frequency / LOAD_PROGRESS_INTERVAL_DIV;
+    mProgressStart = GetPerformanceCounter();
+    mProgressShown = FALSE;
+
+    mProgressName[0] = L'\0';
+    if (Name != NULL) {
+        StrnCpyS(mProgressName, ARRAY_SIZE(mProgressName), Name, ARRAY_SIZE(mProgressName) - 1);
+    }
+    ZeroMem(&mProgress, sizeof(mProgress));
+    mProgress.Name = mProgressName;
+    mProgress.Total = Total;
+}
+
+/**
+  Sets the size of the load in progress once it is learned (e.g. from a
+  server's response), unless a size is already known.
+**/
+VOID
+LoadProgressTotal(
+    IN UINT64 Total
+) {
+    if (mProgressDepth != 0 && mProgress.Total == 0) {
+        mProgress.Total = Total;
+    }
+}
+
+/**
+  Counts Bytes that just arrived. Called per chunk or per datagram, so the
+  common case is a counter read and a compare; the hook runs only after
+  the load has taken a quarter of a second, then at most ten times a
+  second.
+**/
+VOID
+LoadProgressAdd(
+    IN UINT64 Bytes
+) {
+    if (mProgressDepth == 0) {
+        return;
+    }
+    mProgress.Done += Bytes;
+    if (mProgressHook == NULL) {
+        return;
+    }
+
+    UINT64 Now = GetPerformanceCounter();
+    if (mProgressShown ? ProgressTicks(mProgressLast, Now) >= mProgressInterval
+                       : ProgressTicks(mProgressStart, Now) >= mProgressDelay) {
+        ReportLoadProgress(Now);
+    }
+}
+
+/**
+  Ends the load Begin started. The hook sees the final state (Finished
+  set) only if it saw the load at all.
+**/
+VOID
+LoadProgressEnd(VOID) {
+    if (mProgressDepth == 0 || --mProgressDepth != 0) {
+        return;
+    }
+    if (mProgressShown && mProgressHook != NULL) {
+        mProgress.Finished = TRUE;
+        ReportLoadProgress(GetPerformanceCounter());
+    }
+    mProgressShown = FALSE;
+}
+
+void
+load_progress_begin(
+    const char  *name,
+    uint64_t    total
+) {
+    CHAR16 WideName[LOAD_PROGRESS_NAME_MAX];
+    UINTN i = 0;
+
+    // Truncated rather than refused: the name is only for display
+    for (; name != NULL && name[i] != '\0' && i < ARRAY_SIZE(WideName) - 1; i++) {
+        WideName[i] = (CHAR16)(UINT8)name[i];
+    }
+    WideName[i] = L'\0';
+    LoadProgressBegin(WideName, total);
+}
+
+void
+load_progress_total(
+    uint64_t total
+) {
+    LoadProgressTotal(total);
+}
+
+void
+load_progress_add(
+    uint64_t bytes
+) {
+    // Only PXE downloads come through here
+    LoadProgressAdd(bytes);
+    bh_counters_add_read(BH_COUNTER_SOURCE_TFTP, bytes);
+}
+
+void
+load_progress_end(void) {
+    LoadProgressEnd();
+}
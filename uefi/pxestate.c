@@ -0,0 +1,54 @@
+/*
+ * pxestate.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <Uefi.h>
+#include "compat.h"
+#include <Library/UefiRuntimeServicesTableLib.h>
+#include <Library/BaseMemoryLib.h>
+#include "../net/pxe.h"
+
+extern EFI_GUID gBloodHornVariableGuid;
+
+#define PXE_STATE_VARIABLE  L"BloodHornPxeState"
+
+/**
+  NV storage behind the PXE lease and neighbor cache (pxe_saved_state_t).
+  The variable is boot-services only: nothing after ExitBootServices has
+  a use for it.
+
+  @retval 0   A saved state of exactly Size bytes was copied to State.
+  @retval -1  There is none, or it has another size.
+**/
+int
+pxe_state_load(
+    void        *state,
+    uint32_t    size
+) {
+    UINTN DataSize = size;
+    EFI_STATUS Status = gRT->GetVariable(PXE_STATE_VARIABLE, &gBloodHornVariableGuid, NULL, &DataSize, state);
+
+    if (EFI_ERROR(Status) || DataSize != size) {
+        ZeroMem(state, size);
+        return -1;
+    }
+    return 0;
+}
+
+int
+pxe_state_save(
+    const void  *state,
+    uint32_t    size
+) {
+    EFI_STATUS Status = gRT->SetVariable(
+        PXE_STATE_VARIABLE,
+        &gBloodHornVariableGuid,
+        EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS,
+        size,
+        (VOID *)state
+    );
+    return EFI_ERROR(Status) ? -1 : 0;
+}
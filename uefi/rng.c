@@ -0,0 +1,46 @@
+/*
+ * rng.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <Uefi.h>
+#include "compat.h"
+#include <Library/UefiBootServicesTableLib.h>
+#include <Protocol/Rng.h>
+#include "uefi.h"
+#include "../security/entropy.h"
+
+STATIC EFI_RNG_PROTOCOL *mRng;
+
+STATIC
+int
+UefiRngSource(
+    OUT uint8_t   *Buffer,
+    IN  uint32_t  Length
+) {
+    // The default algorithm: whatever the firmware considers its best
+    return mRng != NULL && !EFI_ERROR(mRng->GetRNG(mRng, NULL, Length, Buffer));
+}
+
+/**
+  Offer the firmware RNG to entropy_gather as one more seed source. Only
+  boot services provide it, so it is withdrawn again by passing FALSE
+  before ExitBootServices.
+**/
+VOID
+InstallEntropySource(
+    IN BOOLEAN Enable
+) {
+    if (!Enable) {
+        entropy_set_platform_source(NULL);
+        mRng = NULL;
+        return;
+    }
+    if (mRng == NULL && EFI_ERROR(gBS->LocateProtocol(&gEfiRngProtocolGuid, NULL, (VOID **)&mRng))) {
+        mRng = NULL;
+        return;
+    }
+    entropy_set_platform_source(UefiRngSource);
+}
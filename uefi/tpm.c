@@ -0,0 +1,60 @@
+/*
+ * tpm.c
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#include <Uefi.h>
+#include "compat.h"
+#include <Library/UefiBootServicesTableLib.h>
+#include "uefi.h"
+#include "../security/tpm2.h"
+
+// 1 ms in 100 ns units: well under one PCR extend on a discrete TPM
+#define TPM_POLL_PERIOD  10000
+
+STATIC EFI_EVENT mTpmPollEvent;
+
+STATIC
+VOID
+EFIAPI
+TpmPollNotify(
+    IN EFI_EVENT  Event,
+    IN VOID       *Context
+) {
+    tpm2_measure_poll();
+}
+
+/**
+  Drive the deferred PCR extends from a periodic timer, so the TPM works
+  through them while the loader is busy reading files. The notification
+  runs at TPL_CALLBACK, between firmware calls that hold that level, and
+  tpm2_measure_poll stays off the TPM while the loader itself is inside
+  the driver. Passing FALSE closes the timer; the flush before
+  ExitBootServices sends whatever is left.
+**/
+VOID
+InstallTpmPoller(
+    IN BOOLEAN Enable
+) {
+    if (!Enable) {
+        if (mTpmPollEvent != NULL) {
+            gBS->CloseEvent(mTpmPollEvent);
+            mTpmPollEvent = NULL;
+        }
+        return;
+    }
+    if (mTpmPollEvent != NULL) {
+        return;
+    }
+    if (EFI_ERROR(gBS->CreateEvent(EVT_TIMER | EVT_NOTIFY_SIGNAL, TPL_CALLBACK, TpmPollNotify, NULL,
+                                   &mTpmPollEvent))) {
+        mTpmPollEvent = NULL;
+        return;
+    }
+    if (EFI_ERROR(gBS->SetTimer(mTpmPollEvent, TimerPeriodic, TPM_POLL_PERIOD))) {
+        gBS->CloseEvent(mTpmPollEvent);
+        mTpmPollEvent = NULL;
+    }
+}
@@ -5,17 +5,47 @@
  * See the root of the repository for license details.
  */
 
+#include <Uefi.h>
+#include "compat.h"
+#include <Library/UefiLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/BaseLib.h>
+#include <Guid/FileInfo.h>
+#include <Protocol/LoadedImage.h>
+#include <Protocol/SimpleFileSystem.h>
+#include "uefi.h"
+#include "../compress/decompress.h"
+#include "../boot/Arch32/loadseg.h"
+#include "../fs/fs_mount.h"
+#include "../boot/libb/include/bloodhorn/counters.h"
+
+extern EFI_HANDLE gImageHandle;
+
+// Largest file (or decompressed image) the loaders will allocate for
+#define FILE_LOAD_MAX_SIZE      (1024 * 1024 * 1024)
+
+// Root directory of the boot volume, opened once and shared by every loader
+STATIC EFI_FILE_PROTOCOL *mRootFs = NULL;
+
 EFI_STATUS
 GetRootFileSystem(
     OUT EFI_FILE_PROTOCOL **RootFs
 ) {
     EFI_STATUS Status;
     EFI_LOADED_IMAGE_PROTOCOL *LoadedImage = NULL;
-    EFI_DEVICE_PATH *DevicePath = NULL;
-    EFI_DEVICE_PATH *FileDevicePath = NULL;
-    EFI_HANDLE DeviceHandle = NULL;
     EFI_SIMPLE_FILE_SYSTEM_PROTOCOL *FileSystem = NULL;
 
+    if (RootFs == NULL) {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    if (mRootFs != NULL) {
+        *RootFs = mRootFs;
+        return EFI_SUCCESS;
+    }
+
     // Get the loaded image protocol
     Status = gBS->HandleProtocol(
         gImageHandle,
@@ -26,65 +56,57 @@ GetRootFileSystem(
         return Status;
     }
 
-    // Get the device path protocol
+    // Get the file system protocol
     Status = gBS->HandleProtocol(
         LoadedImage->DeviceHandle,
-        &gEfiDevicePathProtocolGuid,
-        (VOID **)&DevicePath
+        &gEfiSimpleFileSystemProtocolGuid,
+        (VOID **)&FileSystem
     );
     if (EFI_ERROR(Status)) {
         return Status;
     }
 
-    // Get the file system protocol
-    Status = gBS->HandleProtocol(
-        LoadedImage->DeviceHandle,
-        &gEfiSimpleFileSystemProtocolGuid,
-        (VOID **)&FileSystem
-    );
+    // Open the root directory and keep it for later callers
+    Status = FileSystem->OpenVolume(FileSystem, &mRootFs);
     if (EFI_ERROR(Status)) {
+        mRootFs = NULL;
         return Status;
     }
 
-    // Open the root directory
-    return FileSystem->OpenVolume(FileSystem, RootFs);
+    *RootFs = mRootFs;
+    return EFI_SUCCESS;
+}
+
+VOID
+ReleaseRootFileSystem(VOID) {
+    if (mRootFs != NULL) {
+        mRootFs->Close(mRootFs);
+        mRootFs = NULL;
+    }
 }
 
 /**
-  Reads a file from the boot device.
-  
-  @param[in]  FileName    The name of the file to read.
-  @param[out] Buffer      Pointer to store the allocated buffer containing file contents.
-  @param[out] FileSize    Pointer to store the size of the file.
-  
-  @retval EFI_SUCCESS     The file was read successfully.
-  @retval Other           An error occurred.
+  Opens a file on the boot volume and returns its size and, optionally,
+  its modification time.
 **/
+STATIC
 EFI_STATUS
-ReadFile(
-    IN  CHAR16            *FileName,
-    OUT VOID              **Buffer,
-    OUT UINTN             *FileSize
+OpenBootFile(
+    IN  EFI_FILE_PROTOCOL   *RootFs,
+    IN  CONST CHAR16        *FileName,
+    OUT EFI_FILE_PROTOCOL   **FileHandle,
+    OUT UINTN               *DataSize,
+    OUT EFI_TIME            *ModificationTime OPTIONAL
 ) {
     EFI_STATUS Status;
-    EFI_FILE_PROTOCOL *RootFs = NULL;
-    EFI_FILE_PROTOCOL *FileHandle = NULL;
     EFI_FILE_INFO *FileInfo = NULL;
-    UINTN InfoSize;
-    UINTN ReadSize;
-    VOID *FileBuffer = NULL;
-
-    // Get the root file system
-    Status = GetRootFileSystem(&RootFs);
-    if (EFI_ERROR(Status)) {
-        return Status;
-    }
+    UINTN InfoSize = 0;
 
     // Open the file
     Status = RootFs->Open(
         RootFs,
-        &FileHandle,
-        FileName,
+        FileHandle,
+        (CHAR16 *)FileName,
         EFI_FILE_MODE_READ,
         0
     );
@@ -93,71 +115,1746 @@ ReadFile(
     }
 
     // Get file info size
-    Status = FileHandle->GetInfo(
-        FileHandle,
+    Status = (*FileHandle)->GetInfo(
+        *FileHandle,
         &gEfiFileInfoGuid,
         &InfoSize,
         NULL
     );
     if (Status != EFI_BUFFER_TOO_SMALL) {
-        FileHandle->Close(FileHandle);
-        return Status;
+        (*FileHandle)->Close(*FileHandle);
+        return EFI_ERROR(Status) ? Status : EFI_DEVICE_ERROR;
     }
 
     // Allocate buffer for file info
     FileInfo = AllocatePool(InfoSize);
     if (FileInfo == NULL) {
-        FileHandle->Close(FileHandle);
+        (*FileHandle)->Close(*FileHandle);
         return EFI_OUT_OF_RESOURCES;
     }
 
     // Get file info
-    Status = FileHandle->GetInfo(
-        FileHandle,
+    Status = (*FileHandle)->GetInfo(
+        *FileHandle,
         &gEfiFileInfoGuid,
         &InfoSize,
         FileInfo
     );
     if (EFI_ERROR(Status)) {
         FreePool(FileInfo);
-        FileHandle->Close(FileHandle);
+        (*FileHandle)->Close(*FileHandle);
         return Status;
     }
 
-    // Allocate buffer for file contents
-    if (FileInfo->FileSize > 1024*1024*1024) { // 1GB limit
+    if (FileInfo->FileSize > FILE_LOAD_MAX_SIZE) {
         FreePool(FileInfo);
-        FileHandle->Close(FileHandle);
+        (*FileHandle)->Close(*FileHandle);
         return EFI_OUT_OF_RESOURCES;
     }
-    
-    FileBuffer = AllocatePool((UINTN)FileInfo->FileSize);
-    if (FileBuffer == NULL) {
-        FreePool(FileInfo);
-        FileHandle->Close(FileHandle);
+
+    *DataSize = (UINTN)FileInfo->FileSize;
+    if (ModificationTime != NULL) {
+        CopyMem(ModificationTime, &FileInfo->ModificationTime, sizeof(*ModificationTime));
+    }
+    FreePool(FileInfo);
+    return EFI_SUCCESS;
+}
+
+/**
+  Allocates the destination buffer for a file of DataSize bytes.
+  Every data byte is overwritten by the read, so no zero-fill is done.
+**/
+EFI_STATUS
+AllocateFileBuffer(
+    IN  UINT32          Flags,
+    IN  UINTN           DataSize,
+    OUT LOADED_FILE     *File
+) {
+    UINTN AllocSize = DataSize + ((Flags & FILE_LOAD_TEXT) ? 1 : 0);
+
+    ZeroMem(File, sizeof(*File));
+    if (Flags & FILE_LOAD_PAGES) {
+        EFI_PHYSICAL_ADDRESS Address = 0;
+        UINTN Pages = EFI_SIZE_TO_PAGES(AllocSize ? AllocSize : 1);
+        if (EFI_ERROR(gBS->AllocatePages(AllocateAnyPages, EfiLoaderData, Pages, &Address))) {
+            return EFI_OUT_OF_RESOURCES;
+        }
+        File->Buffer = (VOID *)(UINTN)Address;
+        File->Pages = Pages;
+    } else {
+        File->Buffer = AllocatePool(AllocSize ? AllocSize : 1);
+        if (File->Buffer == NULL) {
+            return EFI_OUT_OF_RESOURCES;
+        }
+    }
+    File->Flags = Flags;
+    return EFI_SUCCESS;
+}
+
+/**
+  Reads a file from Offset up to DataSize bytes into Buffer in
+  FILE_LOAD_CHUNK_SIZE pieces, handing each chunk to Callback as it lands.
+  Fails with EFI_END_OF_FILE if the file turns out shorter than DataSize,
+  so a truncated image is never hashed or booted as if complete, and with
+  the callback's status if it rejects a chunk.
+**/
+STATIC
+EFI_STATUS
+StreamFileData(
+    IN  EFI_FILE_PROTOCOL           *FileHandle,
+    IN  UINT8                       *Buffer,
+    IN  UINTN                       Offset,
+    IN  UINTN                       DataSize,
+    IN  FILE_LOAD_CHUNK_CALLBACK    Callback OPTIONAL,
+    IN  VOID                        *Context OPTIONAL,
+    OUT UINTN                       *Length
+) {
+    EFI_STATUS Status = EFI_SUCCESS;
+
+    while (Offset < DataSize) {
+        UINTN Chunk = DataSize - Offset;
+        if (Chunk > FILE_LOAD_CHUNK_SIZE) {
+            Chunk = FILE_LOAD_CHUNK_SIZE;
+        }
+
+        Status = FileHandle->Read(FileHandle, &Chunk, Buffer + Offset);
+        if (EFI_ERROR(Status)) {
+            break;
+        }
+        if (Chunk == 0) {
+            // File shrank since GetInfo
+            Status = EFI_END_OF_FILE;
+            break;
+        }
+        LoadProgressAdd(Chunk);
+        bh_counters_add_read(BH_COUNTER_SOURCE_FIRMWARE, Chunk);
+
+        if (Callback != NULL) {
+            Status = Callback(Context, Buffer + Offset, Chunk);
+            if (EFI_ERROR(Status)) {
+                break;
+            }
+        }
+        Offset += Chunk;
+    }
+
+    *Length = Offset;
+    return Status;
+}
+
+// State shared by the decompressor's read and grow callbacks
+typedef struct {
+    EFI_FILE_PROTOCOL           *Handle;    // NULL when decompressing from memory
+    FILE_LOAD_CHUNK_CALLBACK    Callback;
+    VOID                        *Context;
+    EFI_STATUS                  ReadStatus;
+    UINT32                      Flags;
+    LOADED_FILE                 *File;      // Output buffer, replaced as it grows
+} FILE_DECOMPRESS_CONTEXT;
+
+// Compressed input for the decompressor; every byte passes the chunk callback
+STATIC
+int
+DecompressRead(
+    void        *context,
+    uint8_t     *buf,
+    uint32_t    len
+) {
+    FILE_DECOMPRESS_CONTEXT *Ctx = (FILE_DECOMPRESS_CONTEXT *)context;
+    UINTN Chunk = len;
+
+    Ctx->ReadStatus = Ctx->Handle->Read(Ctx->Handle, &Chunk, buf);
+    if (EFI_ERROR(Ctx->ReadStatus)) {
+        return DECOMP_ERR_IO;
+    }
+    LoadProgressAdd(Chunk);
+    bh_counters_add_read(BH_COUNTER_SOURCE_FIRMWARE, Chunk);
+    if (Chunk != 0 && Ctx->Callback != NULL) {
+        // A rejected chunk ends the decode like a read error would
+        Ctx->ReadStatus = Ctx->Callback(Ctx->Context, buf, Chunk);
+        if (EFI_ERROR(Ctx->ReadStatus)) {
+            return DECOMP_ERR_IO;
+        }
+    }
+    return (int)Chunk;
+}
+
+// Move the output into a larger allocation of the same kind (pool or pages)
+STATIC
+int
+DecompressGrow(
+    void        *context,
+    size_t      need,
+    uint8_t     **buf,
+    size_t      *capacity
+) {
+    FILE_DECOMPRESS_CONTEXT *Ctx = (FILE_DECOMPRESS_CONTEXT *)context;
+    LOADED_FILE Larger;
+
+    if (need > FILE_LOAD_MAX_SIZE ||
+        EFI_ERROR(AllocateFileBuffer(Ctx->Flags, need, &Larger))) {
+        return -1;
+    }
+    CopyMem(Larger.Buffer, *buf, *capacity);
+    FreeLoadedFile(Ctx->File);
+    *Ctx->File = Larger;
+
+    *buf = (uint8_t *)Larger.Buffer;
+    *capacity = need;
+    return 0;
+}
+
+STATIC
+EFI_STATUS
+DecompressStatus(
+    IN int          Result,
+    IN EFI_STATUS   ReadStatus
+) {
+    switch (Result) {
+    case DECOMP_OK:
+        return EFI_SUCCESS;
+    case DECOMP_ERR_IO:
+        return EFI_ERROR(ReadStatus) ? ReadStatus : EFI_DEVICE_ERROR;
+    case DECOMP_ERR_NO_MEMORY:
+    case DECOMP_ERR_TOO_LARGE:
         return EFI_OUT_OF_RESOURCES;
+    case DECOMP_ERR_CHECKSUM:
+        return EFI_CRC_ERROR;
+    case DECOMP_ERR_UNSUPPORTED:
+        return EFI_UNSUPPORTED;
+    default:
+        return EFI_LOAD_ERROR;
     }
+}
+
+/**
+  Picks the initial output size for a compressed image: the size recorded
+  in the stream when there is one, otherwise a guess that DecompressGrow
+  corrects.
+**/
+STATIC
+UINTN
+DecompressCapacity(
+    IN UINT64   Hint,
+    IN UINTN    CompressedSize
+) {
+    if (Hint == 0 || Hint > FILE_LOAD_MAX_SIZE) {
+        Hint = (UINT64)CompressedSize * 4;
+    }
+    return Hint > FILE_LOAD_MAX_SIZE ? FILE_LOAD_MAX_SIZE : (UINTN)Hint;
+}
+
+/**
+  Loads a file that may be compressed. The first DECOMP_INPUT_SIZE bytes
+  decide: gzip, lz4 and zstd images are decoded chunk by chunk straight into
+  the destination buffer, anything else is read as-is. Either way Callback
+  sees every byte of the file as stored, so a hash covers the compressed
+  image.
+**/
+STATIC
+EFI_STATUS
+LoadCompressedFile(
+    IN  EFI_FILE_PROTOCOL           *FileHandle,
+    IN  UINTN                       DataSize,
+    IN  UINT32                      Flags,
+    IN  FILE_LOAD_CHUNK_CALLBACK    Callback OPTIONAL,
+    IN  VOID                        *Context OPTIONAL,
+    OUT LOADED_FILE                 *File,
+    OUT UINTN                       *Length
+) {
+    EFI_STATUS Status;
+    FILE_DECOMPRESS_CONTEXT Ctx;
+    decomp_stream_t Stream;
+    decomp_format_t Format;
+    UINT64 Hint;
+    int Result;
+
+    ZeroMem(&Ctx, sizeof(Ctx));
+    Ctx.Handle = FileHandle;
+    Ctx.Callback = Callback;
+    Ctx.Context = Context;
+    Ctx.Flags = Flags;
+    Ctx.File = File;
+
+    Result = decomp_open(&Stream, DecompressRead, &Ctx);
+    if (Result != DECOMP_OK) {
+        decomp_close(&Stream);
+        return DecompressStatus(Result, Ctx.ReadStatus);
+    }
+
+    Format = decomp_detect(Stream.in, Stream.in_len);
+    if (Format == DECOMP_NONE) {
+        // Plain image: keep what was read and stream in the rest
+        UINTN Buffered = MIN((UINTN)Stream.in_len, DataSize);
+        Status = AllocateFileBuffer(Flags, DataSize, File);
+        if (!EFI_ERROR(Status)) {
+            CopyMem(File->Buffer, Stream.in, Buffered);
+            Status = StreamFileData(FileHandle, (UINT8 *)File->Buffer, Buffered, DataSize,
+                                    Callback, Context, Length);
+        }
+        decomp_close(&Stream);
+        return Status;
+    }
+
+    Hint = decomp_size_hint(&Stream, Format);
+    if (Format == DECOMP_GZIP && DataSize >= 18) {
+        // ISIZE (size mod 4 GiB of the last member) closes the file
+        UINT8 Trailer[4];
+        UINTN TrailerSize = sizeof(Trailer);
+        if (!EFI_ERROR(FileHandle->SetPosition(FileHandle, DataSize - sizeof(Trailer))) &&
+            !EFI_ERROR(FileHandle->Read(FileHandle, &TrailerSize, Trailer)) &&
+            TrailerSize == sizeof(Trailer)) {
+            Hint = (UINT64)Trailer[0] | ((UINT64)Trailer[1] << 8) |
+                   ((UINT64)Trailer[2] << 16) | ((UINT64)Trailer[3] << 24);
+        }
+        Status = FileHandle->SetPosition(FileHandle, Stream.in_len);
+        if (EFI_ERROR(Status)) {
+            decomp_close(&Stream);
+            return Status;
+        }
+    }
+
+    UINTN Capacity = DecompressCapacity(Hint, DataSize);
+    Status = AllocateFileBuffer(Flags, Capacity, File);
+    if (EFI_ERROR(Status)) {
+        decomp_close(&Stream);
+        return Status;
+    }
+
+    Result = decomp_run(&Stream, Format, (uint8_t *)File->Buffer, Capacity, DecompressGrow, &Ctx);
+    if (Result == DECOMP_OK) {
+        // Read (and hash) whatever follows the last frame
+        int Remaining;
+        do {
+            Remaining = decomp_refill(&Stream);
+        } while (Remaining > 0);
+        Result = Remaining;
+    }
+    *Length = Stream.out_len;
+    decomp_close(&Stream);
+    return DecompressStatus(Result, Ctx.ReadStatus);
+}
+
+/**
+  Replaces a compressed image that is already in memory with its
+  decompressed contents. Anything that is not gzip, lz4 or zstd is left
+  alone.
+**/
+STATIC
+EFI_STATUS
+DecompressLoadedFile(
+    IN     UINT32       Flags,
+    IN OUT LOADED_FILE  *File,
+    IN OUT UINTN        *Length
+) {
+    EFI_STATUS Status;
+    FILE_DECOMPRESS_CONTEXT Ctx;
+    LOADED_FILE Compressed;
+    decomp_stream_t Header;
+    decomp_format_t Format;
+    UINT8 *Data = (UINT8 *)File->Buffer;
+    UINT64 Hint;
+    size_t OutLen = 0;
+    int Result;
+
+    Format = decomp_detect(Data, *Length);
+    if (Format == DECOMP_NONE) {
+        return EFI_SUCCESS;
+    }
+
+    ZeroMem(&Header, sizeof(Header));
+    Header.in = Data;
+    Header.in_len = (uint32_t)MIN(*Length, (UINTN)DECOMP_INPUT_SIZE);
+    Hint = decomp_size_hint(&Header, Format);
+    if (Format == DECOMP_GZIP && *Length >= 18) {
+        UINT8 *Trailer = Data + *Length - 4;
+        Hint = (UINT64)Trailer[0] | ((UINT64)Trailer[1] << 8) |
+               ((UINT64)Trailer[2] << 16) | ((UINT64)Trailer[3] << 24);
+    }
+
+    Compressed = *File;
+    UINTN Capacity = DecompressCapacity(Hint, *Length);
+    Status = AllocateFileBuffer(Flags, Capacity, File);
+    if (EFI_ERROR(Status)) {
+        *File = Compressed;
+        return Status;
+    }
+
+    ZeroMem(&Ctx, sizeof(Ctx));
+    Ctx.Flags = Flags;
+    Ctx.File = File;
+    Result = decomp_buffer(Data, *Length, Format, (uint8_t *)File->Buffer, Capacity,
+                           DecompressGrow, &Ctx, &OutLen);
+    FreeLoadedFile(&Compressed);
+    if (Result != DECOMP_OK) {
+        FreeLoadedFile(File);
+        return DecompressStatus(Result, EFI_SUCCESS);
+    }
+
+    *Length = OutLen;
+    return EFI_SUCCESS;
+}
+
+/**
+  Reads a file from a volume mounted through the filesystem layer (the
+  NVMe/TCP disk) in FILE_LOAD_CHUNK_SIZE pieces, as LoadBootFile reads
+  the boot volume. Decompression is left to the caller.
+**/
+STATIC
+EFI_STATUS
+LoadMountedFile(
+    IN  CONST CHAR16                *FileName,
+    IN  UINT32                      Flags,
+    IN  FILE_LOAD_CHUNK_CALLBACK    Callback OPTIONAL,
+    IN  VOID                        *Context OPTIONAL,
+    OUT LOADED_FILE                 *File
+) {
+    EFI_STATUS Status;
+    CHAR8 Path[FS_DCACHE_PATH_MAX];
+    fs_file_t *Handle;
+    bh_counter_source_t Source;
+    UINTN DataSize;
+    UINTN Offset = 0;
+
+    if (EFI_ERROR(UnicodeStrToAsciiStrS(FileName, Path, sizeof(Path)))) {
+        return EFI_INVALID_PARAMETER;
+    }
+    for (UINTN i = 0; Path[i] != '\0'; i++) {
+        if (Path[i] == '\\') {
+            Path[i] = '/';
+        }
+    }
+    Handle = fs_open(Path);
+    if (Handle == NULL) {
+        return EFI_NOT_FOUND;
+    }
+
+    DataSize = fs_file_size(Handle);
+    Source = bh_counters_source_for_fs(Handle->mp->fs->name);
+    LoadProgressBegin(FileName, DataSize);
+    Status = AllocateFileBuffer(Flags, DataSize, File);
+    while (!EFI_ERROR(Status) && Offset < DataSize) {
+        UINT32 Chunk = (UINT32)MIN((UINTN)FILE_LOAD_CHUNK_SIZE, DataSize - Offset);
+        int Read = fs_file_read(Handle, (UINT8 *)File->Buffer + Offset, Chunk);
+        if (Read < 0) {
+            Status = EFI_DEVICE_ERROR;
+            break;
+        }
+        if (Read == 0) {
+            break;
+        }
+        LoadProgressAdd((UINTN)Read);
+        bh_counters_add_read(Source, (UINTN)Read);
+        if (Callback != NULL) {
+            Status = Callback(Context, (UINT8 *)File->Buffer + Offset, (UINTN)Read);
+        }
+        Offset += (UINTN)Read;
+    }
+    LoadProgressEnd();
+    fs_close(Handle);
+
+    if (EFI_ERROR(Status)) {
+        FreeLoadedFile(File);
+        return Status;
+    }
+    if (Flags & FILE_LOAD_TEXT) {
+        ((UINT8 *)File->Buffer)[Offset] = 0;
+    }
+    File->Size = Offset;
+    return EFI_SUCCESS;
+}
+
+/**
+  Loads a file from the boot volume.
+
+  The file is read in FILE_LOAD_CHUNK_SIZE pieces straight into its final
+  allocation; the buffer is never zero-filled. With FILE_LOAD_PAGES the
+  data lands in page-aligned EfiLoaderData pages that can be handed to a
+  kernel without another copy. If Callback is supplied it is invoked for
+  every chunk right after it is read, which lets callers hash or measure
+  the image in the same pass; an error from Callback aborts the load and
+  is returned. With FILE_LOAD_DECOMPRESS a gzip, lz4 or
+  zstd image is decompressed on the way in; Callback still sees the
+  compressed bytes. An http:// or https:// FileName is downloaded with
+  LoadHttpFile, and a FileName under NVMETCP_MOUNT_PATH is read from the
+  NVMe/TCP disk, with the same flags and callback semantics.
+
+  @param[in]  FileName    The name of the file to read.
+  @param[in]  Flags       Combination of FILE_LOAD_* flags.
+  @param[in]  Callback    Optional per-chunk callback.
+  @param[in]  Context     Opaque pointer passed to Callback.
+  @param[out] File        Receives the buffer and its size.
+
+  @retval EFI_SUCCESS     The file was loaded successfully.
+  @retval EFI_END_OF_FILE The file got shorter while it was being read.
+  @retval Other           An error occurred; File is left empty.
+**/
+EFI_STATUS
+LoadBootFile(
+    IN  CONST CHAR16                *FileName,
+    IN  UINT32                      Flags,
+    IN  FILE_LOAD_CHUNK_CALLBACK    Callback OPTIONAL,
+    IN  VOID                        *Context OPTIONAL,
+    OUT LOADED_FILE                 *File
+) {
+    EFI_STATUS Status;
+    EFI_FILE_PROTOCOL *RootFs = NULL;
+    EFI_FILE_PROTOCOL *FileHandle = NULL;
+    UINTN DataSize = 0;
+    UINTN Length = 0;
+
+    if (FileName == NULL || File == NULL) {
+        return EFI_INVALID_PARAMETER;
+    }
+    ZeroMem(File, sizeof(*File));
+
+    if (IsHttpUrl(FileName) || IsRemoteDiskPath(FileName)) {
+        if (IsHttpUrl(FileName)) {
+            Status = LoadHttpFile(FileName, Flags, Callback, Context, File);
+        } else {
+            Status = LoadMountedFile(FileName, Flags, Callback, Context, File);
+        }
+        if (EFI_ERROR(Status) || !(Flags & FILE_LOAD_DECOMPRESS)) {
+            return Status;
+        }
+        Length = File->Size;
+        Status = DecompressLoadedFile(Flags, File, &Length);
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+        if (Flags & FILE_LOAD_TEXT) {
+            ((UINT8 *)File->Buffer)[Length] = 0;
+        }
+        File->Size = Length;
+        return EFI_SUCCESS;
+    }
+
+    // Get the root file system
+    Status = GetRootFileSystem(&RootFs);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    Status = OpenBootFile(RootFs, FileName, &FileHandle, &DataSize, NULL);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    LoadProgressBegin(FileName, DataSize);
+    if (Flags & FILE_LOAD_DECOMPRESS) {
+        Status = LoadCompressedFile(FileHandle, DataSize, Flags, Callback, Context, File, &Length);
+    } else {
+        Status = AllocateFileBuffer(Flags, DataSize, File);
+        if (!EFI_ERROR(Status)) {
+            Status = StreamFileData(FileHandle, (UINT8 *)File->Buffer, 0, DataSize,
+                                    Callback, Context, &Length);
+        }
+    }
+    LoadProgressEnd();
 
-    // Read the file
-    ReadSize = (UINTN)FileInfo->FileSize;
-    Status = FileHandle->Read(
-        FileHandle,
-        &ReadSize,
-        FileBuffer
-    );
-    
     // Clean up
-    FreePool(FileInfo);
     FileHandle->Close(FileHandle);
-    
+
     if (EFI_ERROR(Status)) {
-        FreePool(FileBuffer);
+        FreeLoadedFile(File);
         return Status;
     }
-    
-    // Return the buffer and size
-    *Buffer = FileBuffer;
-    *FileSize = ReadSize;
-    
+
+    if (Flags & FILE_LOAD_TEXT) {
+        ((UINT8 *)File->Buffer)[Length] = 0;
+    }
+    File->Size = Length;
+
     return EFI_SUCCESS;
 }
+
+/**
+  Loads Length bytes of a file starting at byte Offset, so a caller that
+  needs only part of a large image (one verified chunk range of an
+  initramfs, say) does not pay for reading the rest. The range is clamped
+  to the end of the file; File->Size says how much was read.
+
+  @param[in]  FileName    The name of the file to read.
+  @param[in]  Offset      First byte to read.
+  @param[in]  Length      Number of bytes to read.
+  @param[in]  Flags       FILE_LOAD_POOL, FILE_LOAD_PAGES and FILE_LOAD_TEXT;
+                          a range of a compressed image is meaningless.
+  @param[in]  Callback    Optional per-chunk callback.
+  @param[in]  Context     Opaque pointer passed to Callback.
+  @param[out] File        Receives the buffer and its size.
+
+  @retval EFI_SUCCESS     The range was loaded successfully.
+  @retval EFI_END_OF_FILE Offset is past the end of the file, or the file
+                          got shorter while the range was being read.
+  @retval Other           An error occurred; File is left empty.
+**/
+EFI_STATUS
+LoadBootFileRange(
+    IN  CONST CHAR16                *FileName,
+    IN  UINT64                      Offset,
+    IN  UINTN                       Length,
+    IN  UINT32                      Flags,
+    IN  FILE_LOAD_CHUNK_CALLBACK    Callback OPTIONAL,
+    IN  VOID                        *Context OPTIONAL,
+    OUT LOADED_FILE                 *File
+) {
+    EFI_STATUS Status;
+    EFI_FILE_PROTOCOL *RootFs = NULL;
+    EFI_FILE_PROTOCOL *FileHandle = NULL;
+    UINTN DataSize = 0;
+    UINTN Read = 0;
+
+    if (FileName == NULL || File == NULL || (Flags & FILE_LOAD_DECOMPRESS)) {
+        return EFI_INVALID_PARAMETER;
+    }
+    ZeroMem(File, sizeof(*File));
+
+    Status = GetRootFileSystem(&RootFs);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    Status = OpenBootFile(RootFs, FileName, &FileHandle, &DataSize, NULL);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    if (Offset > DataSize) {
+        FileHandle->Close(FileHandle);
+        return EFI_END_OF_FILE;
+    }
+    if (Length > DataSize - (UINTN)Offset) {
+        Length = DataSize - (UINTN)Offset;
+    }
+
+    Status = FileHandle->SetPosition(FileHandle, Offset);
+    if (!EFI_ERROR(Status)) {
+        Status = AllocateFileBuffer(Flags, Length, File);
+    }
+    if (!EFI_ERROR(Status)) {
+        LoadProgressBegin(FileName, Length);
+        Status = StreamFileData(FileHandle, (UINT8 *)File->Buffer, 0, Length,
+                                Callback, Context, &Read);
+        LoadProgressEnd();
+    }
+
+    FileHandle->Close(FileHandle);
+
+    if (EFI_ERROR(Status)) {
+        FreeLoadedFile(File);
+        return Status;
+    }
+
+    if (Flags & FILE_LOAD_TEXT) {
+        ((UINT8 *)File->Buffer)[Read] = 0;
+    }
+    File->Size = Read;
+
+    return EFI_SUCCESS;
+}
+
+/**
+  Returns the size and modification time of a file on the boot volume
+  without reading it.
+**/
+EFI_STATUS
+GetBootFileInfo(
+    IN  CONST CHAR16    *FileName,
+    OUT UINT64          *FileSize,
+    OUT EFI_TIME        *ModificationTime
+) {
+    EFI_STATUS Status;
+    EFI_FILE_PROTOCOL *RootFs = NULL;
+    EFI_FILE_PROTOCOL *FileHandle = NULL;
+    UINTN DataSize = 0;
+
+    if (FileName == NULL || FileSize == NULL || ModificationTime == NULL) {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    Status = GetRootFileSystem(&RootFs);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    Status = OpenBootFile(RootFs, FileName, &FileHandle, &DataSize, ModificationTime);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+    FileHandle->Close(FileHandle);
+
+    *FileSize = DataSize;
+    return EFI_SUCCESS;
+}
+
+VOID
+FreeLoadedFile(
+    IN OUT LOADED_FILE *File
+) {
+    if (File == NULL || File->Buffer == NULL) {
+        return;
+    }
+
+    if (File->Flags & FILE_LOAD_LOANED) {
+        // The caller's buffer
+    } else if (File->Pages != 0) {
+        gBS->FreePages((EFI_PHYSICAL_ADDRESS)(UINTN)File->Buffer, File->Pages);
+    } else {
+        FreePool(File->Buffer);
+    }
+    ZeroMem(File, sizeof(*File));
+}
+
+/**
+  Reads a file from the boot device.
+
+  @param[in]  FileName    The name of the file to read.
+  @param[out] Buffer      Pointer to store the allocated buffer containing file contents.
+  @param[out] FileSize    Pointer to store the size of the file.
+
+  @retval EFI_SUCCESS     The file was read successfully.
+  @retval Other           An error occurred.
+**/
+EFI_STATUS
+ReadFile(
+    IN  CHAR16            *FileName,
+    OUT VOID              **Buffer,
+    OUT UINTN             *FileSize
+) {
+    EFI_STATUS Status;
+    LOADED_FILE File;
+
+    if (Buffer == NULL || FileSize == NULL) {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    Status = LoadBootFile(FileName, FILE_LOAD_POOL, NULL, NULL, &File);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    // Return the buffer and size
+    *Buffer = File.Buffer;
+    *FileSize = File.Size;
+
+    return EFI_SUCCESS;
+}
+
+/**
+  Creates a file on the boot device for writing, dropping any previous
+  copy first so that a shorter write does not leave its tail behind.
+
+  @param[in]  FileName    The name of the file to create.
+  @param[out] Handle      Open handle; the caller writes and closes it.
+
+  @retval EFI_SUCCESS     The file was created.
+  @retval Other           An error occurred.
+**/
+EFI_STATUS
+CreateBootFile(
+    IN  CONST CHAR16        *FileName,
+    OUT EFI_FILE_PROTOCOL   **Handle
+) {
+    EFI_STATUS Status;
+    EFI_FILE_PROTOCOL *RootFs = NULL;
+    EFI_FILE_PROTOCOL *Stale = NULL;
+
+    if (FileName == NULL || Handle == NULL) {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    Status = GetRootFileSystem(&RootFs);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    Status = RootFs->Open(RootFs, &Stale, (CHAR16*)FileName,
+                          EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE, 0);
+    if (!EFI_ERROR(Status)) {
+        Stale->Delete(Stale);
+    }
+
+    return RootFs->Open(RootFs, Handle, (CHAR16*)FileName,
+                        EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE, 0);
+}
+
+/**
+  Writes a buffer to a file on the boot device, replacing any previous contents.
+
+  @param[in]  FileName    The name of the file to write.
+  @param[in]  Buffer      Data to write.
+  @param[in]  Size        Number of bytes to write.
+
+  @retval EFI_SUCCESS     The file was written successfully.
+  @retval Other           An error occurred.
+**/
+EFI_STATUS
+WriteBootFile(
+    IN CONST CHAR16   *FileName,
+    IN CONST VOID     *Buffer,
+    IN UINTN          Size
+) {
+    EFI_STATUS Status;
+    EFI_FILE_PROTOCOL *Handle = NULL;
+    UINTN Written = Size;
+
+    if (FileName == NULL || (Buffer == NULL && Size != 0)) {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    Status = CreateBootFile(FileName, &Handle);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    Status = Handle->Write(Handle, &Written, (VOID*)Buffer);
+    if (!EFI_ERROR(Status) && Written != Size) {
+        Status = EFI_DEVICE_ERROR;
+    }
+    if (!EFI_ERROR(Status)) {
+        Status = Handle->Flush(Handle);
+    }
+
+    Handle->Close(Handle);
+    return Status;
+}
+
+// Per-file state while a batch of asynchronous reads is in flight
+typedef struct {
+    FILE_LOAD_REQUEST   *Request;
+    EFI_FILE_PROTOCOL   *Handle;
+    EFI_FILE_IO_TOKEN   Token;
+    UINTN               DataSize;
+    UINTN               Offset;
+    BOOLEAN             Active;
+} FILE_LOAD_SLOT;
+
+/**
+  Sets up the buffer a batch request is read into: the caller's
+  Destination, which the file must fill exactly, or a fresh allocation.
+**/
+STATIC
+EFI_STATUS
+PrepareRequestBuffer(
+    IN OUT FILE_LOAD_REQUEST   *Request,
+    IN     UINTN               DataSize
+) {
+    if (Request->Destination == NULL) {
+        return AllocateFileBuffer(Request->Flags, DataSize, &Request->File);
+    }
+
+    ZeroMem(&Request->File, sizeof(Request->File));
+    if (DataSize != Request->Capacity || (Request->Flags & (FILE_LOAD_DECOMPRESS | FILE_LOAD_TEXT))) {
+        return EFI_BAD_BUFFER_SIZE;
+    }
+    Request->File.Buffer = Request->Destination;
+    Request->File.Flags = Request->Flags | FILE_LOAD_LOANED;
+    return EFI_SUCCESS;
+}
+
+/**
+  Finishes one request: decompresses it if asked to, terminates text files,
+  records the final size and runs the request's completion hook.
+**/
+STATIC
+VOID
+CompleteFileLoad(
+    IN OUT FILE_LOAD_REQUEST   *Request,
+    IN     UINTN               Length
+) {
+    if ((Request->File.Flags & FILE_LOAD_LOANED) && Length != Request->Capacity) {
+        // The file shrank since GetInfo and left part of the buffer stale
+        Request->Status = EFI_END_OF_FILE;
+        return;
+    }
+    if (Request->Flags & FILE_LOAD_DECOMPRESS) {
+        Request->Status = DecompressLoadedFile(Request->Flags, &Request->File, &Length);
+        if (EFI_ERROR(Request->Status)) {
+            return;
+        }
+    }
+    if (Request->Flags & FILE_LOAD_TEXT) {
+        ((UINT8 *)Request->File.Buffer)[Length] = 0;
+    }
+    Request->File.Size = Length;
+    Request->Status = EFI_SUCCESS;
+
+    if (Request->Complete != NULL) {
+        Request->Status = Request->Complete(Request->Context, &Request->File);
+        if (EFI_ERROR(Request->Status)) {
+            FreeLoadedFile(&Request->File);
+        }
+    }
+}
+
+/**
+  Issues the next ReadEx for a slot (or completes it if all data is in).
+**/
+STATIC
+EFI_STATUS
+IssueNextRead(
+    IN OUT FILE_LOAD_SLOT  *Slot
+) {
+    UINTN Chunk = Slot->DataSize - Slot->Offset;
+
+    if (Chunk == 0) {
+        return EFI_END_OF_FILE;
+    }
+    if (Chunk > FILE_LOAD_CHUNK_SIZE) {
+        Chunk = FILE_LOAD_CHUNK_SIZE;
+    }
+
+    Slot->Token.Status = EFI_SUCCESS;
+    Slot->Token.BufferSize = Chunk;
+    Slot->Token.Buffer = (UINT8 *)Slot->Request->File.Buffer + Slot->Offset;
+    return Slot->Handle->ReadEx(Slot->Handle, &Slot->Token);
+}
+
+STATIC
+VOID
+CloseFileLoadSlot(
+    IN OUT FILE_LOAD_SLOT  *Slot
+) {
+    if (Slot->Token.Event != NULL) {
+        gBS->CloseEvent(Slot->Token.Event);
+        Slot->Token.Event = NULL;
+    }
+    if (Slot->Handle != NULL) {
+        Slot->Handle->Close(Slot->Handle);
+        Slot->Handle = NULL;
+    }
+    Slot->Active = FALSE;
+}
+
+/**
+  Reads a request with a Destination synchronously, for the serial path.
+  Downloads and NVMe/TCP files cannot be read into a caller buffer.
+**/
+STATIC
+EFI_STATUS
+LoadBootFileInto(
+    IN OUT FILE_LOAD_REQUEST   *Request
+) {
+    EFI_STATUS Status;
+    EFI_FILE_PROTOCOL *RootFs = NULL;
+    EFI_FILE_PROTOCOL *FileHandle = NULL;
+    UINTN DataSize = 0;
+    UINTN Length = 0;
+
+    if (IsHttpUrl(Request->FileName) || IsRemoteDiskPath(Request->FileName)) {
+        return EFI_UNSUPPORTED;
+    }
+    Status = GetRootFileSystem(&RootFs);
+    if (!EFI_ERROR(Status)) {
+        Status = OpenBootFile(RootFs, Request->FileName, &FileHandle, &DataSize, NULL);
+    }
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    Status = PrepareRequestBuffer(Request, DataSize);
+    if (!EFI_ERROR(Status)) {
+        LoadProgressBegin(Request->FileName, DataSize);
+        Status = StreamFileData(FileHandle, (UINT8 *)Request->File.Buffer, 0, DataSize,
+                                Request->Callback, Request->Context, &Length);
+        LoadProgressEnd();
+    }
+    FileHandle->Close(FileHandle);
+    if (EFI_ERROR(Status)) {
+        FreeLoadedFile(&Request->File);
+        return Status;
+    }
+    Request->File.Size = Length;
+    return EFI_SUCCESS;
+}
+
+/**
+  Loads a batch one file after the other with LoadBootFile, for volumes
+  without ReadEx and for batches that include downloads.
+**/
+STATIC
+EFI_STATUS
+LoadBootFilesSerially(
+    IN OUT FILE_LOAD_REQUEST   *Requests,
+    IN     UINTN               Count
+) {
+    EFI_STATUS Result = EFI_SUCCESS;
+
+    for (UINTN i = 0; i < Count; i++) {
+        if (Requests[i].Destination != NULL) {
+            Requests[i].Status = LoadBootFileInto(&Requests[i]);
+        } else {
+            Requests[i].Status = LoadBootFile(Requests[i].FileName, Requests[i].Flags,
+                                              Requests[i].Callback, Requests[i].Context,
+                                              &Requests[i].File);
+        }
+        if (!EFI_ERROR(Requests[i].Status) && Requests[i].Complete != NULL) {
+            Requests[i].Status = Requests[i].Complete(Requests[i].Context, &Requests[i].File);
+            if (EFI_ERROR(Requests[i].Status)) {
+                FreeLoadedFile(&Requests[i].File);
+            }
+        }
+        if (EFI_ERROR(Requests[i].Status) && !EFI_ERROR(Result)) {
+            Result = Requests[i].Status;
+        }
+    }
+    return Result;
+}
+
+/**
+  Loads several files from the boot volume with their reads overlapped.
+
+  On volumes that implement EFI_FILE_PROTOCOL revision 2 every file gets its
+  own ReadEx token, so the firmware keeps one chunk per file in flight while
+  the per-chunk callbacks (hashing) and completion hooks (signature checks)
+  of the others run on the CPU. The kernel can therefore be hashed and
+  verified while the initrd is still arriving. Volumes without ReadEx fall
+  back to loading the files one after the other with LoadBootFile.
+  Requests with a Destination are read straight into it, e.g. modules
+  going to slots already placed for them.
+
+  @param[in,out] Requests   Files to load; results are returned in place.
+  @param[in]     Count      Number of entries in Requests.
+
+  @retval EFI_SUCCESS       Every file was loaded.
+  @retval Other             Status of the first request that failed. Other
+                            requests may still have succeeded.
+**/
+EFI_STATUS
+LoadBootFiles(
+    IN OUT FILE_LOAD_REQUEST   *Requests,
+    IN     UINTN               Count
+) {
+    EFI_STATUS Status;
+    EFI_STATUS Result = EFI_SUCCESS;
+    EFI_FILE_PROTOCOL *RootFs = NULL;
+    FILE_LOAD_SLOT Slots[FILE_LOAD_MAX_CONCURRENT];
+    EFI_EVENT Events[FILE_LOAD_MAX_CONCURRENT];
+    UINTN Map[FILE_LOAD_MAX_CONCURRENT];
+    UINTN Active = 0;
+    BOOLEAN Async;
+
+    if (Requests == NULL || Count == 0 || Count > FILE_LOAD_MAX_CONCURRENT) {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    for (UINTN i = 0; i < Count; i++) {
+        ZeroMem(&Requests[i].File, sizeof(Requests[i].File));
+        Requests[i].Status = EFI_NOT_STARTED;
+    }
+
+    // Downloads and the NVMe/TCP disk bring their own parallelism, and may
+    // not need the boot volume
+    for (UINTN i = 0; i < Count; i++) {
+        if (IsHttpUrl(Requests[i].FileName) || IsRemoteDiskPath(Requests[i].FileName)) {
+            return LoadBootFilesSerially(Requests, Count);
+        }
+    }
+
+    Status = GetRootFileSystem(&RootFs);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
+    Async = (RootFs->Revision >= EFI_FILE_PROTOCOL_REVISION2);
+    ZeroMem(Slots, sizeof(Slots));
+
+    // Open every file and start its first read
+    for (UINTN i = 0; Async && i < Count; i++) {
+        FILE_LOAD_SLOT *Slot = &Slots[i];
+        FILE_LOAD_REQUEST *Request = &Requests[i];
+
+        Slot->Request = Request;
+        Request->Status = OpenBootFile(RootFs, Request->FileName, &Slot->Handle, &Slot->DataSize, NULL);
+        if (EFI_ERROR(Request->Status)) {
+            Slot->Handle = NULL;
+            continue;
+        }
+
+        if (Slot->Handle->Revision < EFI_FILE_PROTOCOL_REVISION2) {
+            Async = FALSE;
+            break;
+        }
+
+        Request->Status = PrepareRequestBuffer(Request, Slot->DataSize);
+        if (EFI_ERROR(Request->Status)) {
+            CloseFileLoadSlot(Slot);
+            continue;
+        }
+
+        if (Slot->DataSize == 0) {
+            CompleteFileLoad(Request, 0);
+            CloseFileLoadSlot(Slot);
+            continue;
+        }
+
+        Request->Status = gBS->CreateEvent(0, TPL_APPLICATION, NULL, NULL, &Slot->Token.Event);
+        if (EFI_ERROR(Request->Status)) {
+            FreeLoadedFile(&Request->File);
+            CloseFileLoadSlot(Slot);
+            continue;
+        }
+
+        Status = IssueNextRead(Slot);
+        if (Status == EFI_UNSUPPORTED) {
+            Async = FALSE;
+            break;
+        }
+        if (EFI_ERROR(Status)) {
+            Request->Status = Status;
+            FreeLoadedFile(&Request->File);
+            CloseFileLoadSlot(Slot);
+            continue;
+        }
+
+        Request->Status = EFI_NOT_READY;
+        Slot->Active = TRUE;
+        Active++;
+    }
+
+    if (!Async) {
+        // Firmware without ReadEx: undo any partial setup and go synchronous
+        for (UINTN i = 0; i < Count; i++) {
+            if (Slots[i].Active && Slots[i].Token.Event != NULL) {
+                UINTN Index;
+                gBS->WaitForEvent(1, &Slots[i].Token.Event, &Index);
+            }
+            FreeLoadedFile(&Requests[i].File);
+            CloseFileLoadSlot(&Slots[i]);
+        }
+        return LoadBootFilesSerially(Requests, Count);
+    }
+
+    // The batch is one load as far as the progress display goes
+    UINT64 BatchSize = 0;
+    for (UINTN i = 0; i < Count; i++) {
+        if (Slots[i].Active) {
+            BatchSize += Slots[i].DataSize;
+        }
+    }
+    LoadProgressBegin(Requests[0].FileName, BatchSize);
+
+    // Service completions in whatever order the firmware delivers them
+    while (Active > 0) {
+        UINTN Waiting = 0;
+        UINTN Index = 0;
+
+        for (UINTN i = 0; i < Count; i++) {
+            if (Slots[i].Active) {
+                Events[Waiting] = Slots[i].Token.Event;
+                Map[Waiting] = i;
+                Waiting++;
+            }
+        }
+
+        Status = gBS->WaitForEvent(Waiting, Events, &Index);
+        if (EFI_ERROR(Status) || Index >= Waiting) {
+            break;
+        }
+
+        FILE_LOAD_SLOT *Slot = &Slots[Map[Index]];
+        FILE_LOAD_REQUEST *Request = Slot->Request;
+
+        Status = Slot->Token.Status;
+        if (!EFI_ERROR(Status) && Slot->Token.BufferSize != 0) {
+            LoadProgressAdd(Slot->Token.BufferSize);
+            bh_counters_add_read(BH_COUNTER_SOURCE_FIRMWARE, Slot->Token.BufferSize);
+            if (Request->Callback != NULL) {
+                Status = Request->Callback(Request->Context, Slot->Token.Buffer, Slot->Token.BufferSize);
+            }
+            if (!EFI_ERROR(Status)) {
+                Slot->Offset += Slot->Token.BufferSize;
+                Status = IssueNextRead(Slot);
+            }
+        } else if (!EFI_ERROR(Status)) {
+            // Short read: the file shrank since GetInfo
+            Status = EFI_END_OF_FILE;
+        }
+
+        if (Status == EFI_END_OF_FILE) {
+            CompleteFileLoad(Request, Slot->Offset);
+            CloseFileLoadSlot(Slot);
+            Active--;
+        } else if (EFI_ERROR(Status)) {
+            Request->Status = Status;
+            FreeLoadedFile(&Request->File);
+            CloseFileLoadSlot(Slot);
+            Active--;
+        }
+    }
+    LoadProgressEnd();
+
+    for (UINTN i = 0; i < Count; i++) {
+        if (Slots[i].Active) {
+            // WaitForEvent failed underneath us; drain and abandon
+            UINTN Index;
+            gBS->WaitForEvent(1, &Slots[i].Token.Event, &Index);
+            Requests[i].Status = EFI_ABORTED;
+            FreeLoadedFile(&Requests[i].File);
+            CloseFileLoadSlot(&Slots[i]);
+        }
+        if (EFI_ERROR(Requests[i].Status) && !EFI_ERROR(Result)) {
+            Result = Requests[i].Status;
+        }
+    }
+
+    return Result;
+}
+
+// Chunk size for file streams; small enough that a completion handler
+// never holds TPL_CALLBACK long while the firmware is reading too
+#define FILE_STREAM_CHUNK_SIZE  (256 * 1024)
+
+struct FILE_STREAM {
+    EFI_FILE_PROTOCOL           *Root;
+    EFI_FILE_PROTOCOL           *Handle;
+    EFI_FILE_IO_TOKEN           Token;
+    UINT8                       *Buffer;
+    UINTN                       DataSize;
+    UINTN                       Offset;
+    FILE_LOAD_CHUNK_CALLBACK    Callback;
+    VOID                        *Context;
+    BOOLEAN                     Async;      // Reads are chained by FileStreamNotify
+    volatile BOOLEAN            Stop;       // Issue no further reads
+    volatile EFI_STATUS         Status;     // EFI_NOT_READY until the stream ends
+};
+
+/**
+  Issues the next ReadEx of a stream into its chunk buffer, or returns
+  EFI_END_OF_FILE when the whole file has been delivered.
+**/
+STATIC
+EFI_STATUS
+IssueStreamRead(
+    IN OUT FILE_STREAM *Stream
+) {
+    UINTN Chunk = Stream->DataSize - Stream->Offset;
+
+    if (Chunk == 0) {
+        return EFI_END_OF_FILE;
+    }
+    if (Chunk > FILE_STREAM_CHUNK_SIZE) {
+        Chunk = FILE_STREAM_CHUNK_SIZE;
+    }
+
+    Stream->Token.Status = EFI_SUCCESS;
+    Stream->Token.BufferSize = Chunk;
+    Stream->Token.Buffer = Stream->Buffer;
+    return Stream->Handle->ReadEx(Stream->Handle, &Stream->Token);
+}
+
+/**
+  Completion of one stream read: hands the chunk to the callback and
+  chains the next read from the same handler, so the stream advances
+  whenever the caller is blocked in firmware below TPL_CALLBACK.
+**/
+STATIC
+VOID
+EFIAPI
+FileStreamNotify(
+    IN EFI_EVENT   Event,
+    IN VOID        *Context
+) {
+    FILE_STREAM *Stream = (FILE_STREAM *)Context;
+    EFI_STATUS Status = Stream->Token.Status;
+
+    if (!EFI_ERROR(Status) && Stream->Token.BufferSize == 0) {
+        // Short read: the file shrank since GetInfo
+        Status = EFI_END_OF_FILE;
+    }
+    if (!EFI_ERROR(Status)) {
+        Status = Stream->Callback(Stream->Context, Stream->Token.Buffer, Stream->Token.BufferSize);
+        Stream->Offset += Stream->Token.BufferSize;
+    }
+    if (!EFI_ERROR(Status)) {
+        Status = (Stream->Stop && Stream->Offset < Stream->DataSize) ? EFI_ABORTED : IssueStreamRead(Stream);
+    }
+    if (Status == EFI_END_OF_FILE) {
+        Stream->Status = (Stream->Offset == Stream->DataSize) ? EFI_SUCCESS : EFI_END_OF_FILE;
+    } else if (EFI_ERROR(Status)) {
+        Stream->Status = Status;
+    }
+}
+
+/**
+  Starts reading a file from any volume in the background, one chunk at a
+  time through a single buffer, handing each chunk to Callback. Reads are
+  chained by ReadEx completions, so they make progress while the caller
+  waits on other firmware work (e.g. LoadImage of the same file). On
+  volumes without ReadEx nothing is read until FinishFileStream.
+
+  @param[in]  DeviceHandle  Handle with the volume's SimpleFileSystem.
+  @param[in]  FileName      File on that volume.
+  @param[in]  Callback      Receives the file in order.
+  @param[in]  Context       Passed to Callback.
+  @param[out] Stream        Stream to pass to FinishFileStream.
+**/
+EFI_STATUS
+StartFileStream(
+    IN  EFI_HANDLE                  DeviceHandle,
+    IN  CONST CHAR16                *FileName,
+    IN  FILE_LOAD_CHUNK_CALLBACK    Callback,
+    IN  VOID                        *Context OPTIONAL,
+    OUT FILE_STREAM                 **Stream
+) {
+    EFI_STATUS Status;
+    EFI_SIMPLE_FILE_SYSTEM_PROTOCOL *Fs = NULL;
+    FILE_STREAM *S;
+
+    if (FileName == NULL || Callback == NULL || Stream == NULL) {
+        return EFI_INVALID_PARAMETER;
+    }
+    *Stream = NULL;
+
+    S = AllocateZeroPool(sizeof(*S));
+    if (S == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    S->Callback = Callback;
+    S->Context = Context;
+    S->Status = EFI_NOT_READY;
+
+    Status = gBS->HandleProtocol(DeviceHandle, &gEfiSimpleFileSystemProtocolGuid, (VOID **)&Fs);
+    if (!EFI_ERROR(Status)) {
+        Status = Fs->OpenVolume(Fs, &S->Root);
+    }
+    if (!EFI_ERROR(Status)) {
+        Status = OpenBootFile(S->Root, FileName, &S->Handle, &S->DataSize, NULL);
+        if (EFI_ERROR(Status)) {
+            S->Handle = NULL;
+        }
+    }
+    if (!EFI_ERROR(Status)) {
+        S->Buffer = AllocatePool(FILE_STREAM_CHUNK_SIZE);
+        if (S->Buffer == NULL) {
+            Status = EFI_OUT_OF_RESOURCES;
+        }
+    }
+    if (EFI_ERROR(Status)) {
+        if (S->Handle != NULL) {
+            S->Handle->Close(S->Handle);
+        }
+        if (S->Root != NULL) {
+            S->Root->Close(S->Root);
+        }
+        FreePool(S);
+        return Status;
+    }
+
+    if (S->DataSize == 0) {
+        S->Status = EFI_SUCCESS;
+    } else if (S->Handle->Revision >= EFI_FILE_PROTOCOL_REVISION2 &&
+               !EFI_ERROR(gBS->CreateEvent(EVT_NOTIFY_SIGNAL, TPL_CALLBACK, FileStreamNotify,
+                                           S, &S->Token.Event))) {
+        Status = IssueStreamRead(S);
+        if (Status == EFI_SUCCESS) {
+            S->Async = TRUE;
+        } else if (Status != EFI_UNSUPPORTED) {
+            S->Status = Status;
+        }
+    }
+
+    *Stream = S;
+    return EFI_SUCCESS;
+}
+
+/**
+  Ends a stream and frees it. With Drain the rest of the file is delivered
+  first (synchronously on volumes without ReadEx); without it the read in
+  flight is allowed to land and nothing more is read.
+
+  @retval EFI_SUCCESS       Drain was set and every byte reached the callback.
+  @retval EFI_ABORTED       The stream was stopped before the end of the file.
+  @retval Other             Read error, short read or callback status.
+**/
+EFI_STATUS
+FinishFileStream(
+    IN FILE_STREAM     *Stream,
+    IN BOOLEAN         Drain
+) {
+    EFI_STATUS Status;
+
+    if (Stream == NULL) {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    if (Stream->Async) {
+        // The handler ends the stream; it runs as soon as the read lands
+        Stream->Stop = !Drain;
+        while (Stream->Status == EFI_NOT_READY) {
+            gBS->Stall(10);
+        }
+    } else if (Stream->Status == EFI_NOT_READY) {
+        UINTN Length;
+
+        if (Drain) {
+            Status = EFI_SUCCESS;
+            while (!EFI_ERROR(Status) && Stream->Offset < Stream->DataSize) {
+                Length = Stream->DataSize - Stream->Offset;
+                if (Length > FILE_STREAM_CHUNK_SIZE) {
+                    Length = FILE_STREAM_CHUNK_SIZE;
+                }
+                Status = Stream->Handle->Read(Stream->Handle, &Length, Stream->Buffer);
+                if (!EFI_ERROR(Status) && Length == 0) {
+                    Status = EFI_END_OF_FILE;
+                }
+                if (!EFI_ERROR(Status)) {
+                    Status = Stream->Callback(Stream->Context, Stream->Buffer, Length);
+                    Stream->Offset += Length;
+                }
+            }
+            Stream->Status = Status;
+        } else {
+            Stream->Status = EFI_ABORTED;
+        }
+    }
+
+    Status = Stream->Status;
+    if (Stream->Token.Event != NULL) {
+        gBS->CloseEvent(Stream->Token.Event);
+    }
+    Stream->Handle->Close(Stream->Handle);
+    Stream->Root->Close(Stream->Root);
+    FreePool(Stream->Buffer);
+    FreePool(Stream);
+    return Status;
+}
+
+STATIC
+int
+LoadFileWithFlags(
+    const char  *path,
+    UINT32      flags,
+    uint8_t     **data,
+    uint32_t    *size
+) {
+    CHAR16 WidePath[256];
+    LOADED_FILE File;
+
+    if (path == NULL || data == NULL || size == NULL) {
+        return -1;
+    }
+    if (EFI_ERROR(AsciiStrToUnicodeStrS(path, WidePath, ARRAY_SIZE(WidePath)))) {
+        return -1;
+    }
+    if (EFI_ERROR(LoadBootFile(WidePath, flags, NULL, NULL, &File))) {
+        return -1;
+    }
+
+    *data = (uint8_t *)File.Buffer;
+    *size = (uint32_t)File.Size;
+    return 0;
+}
+
+STATIC
+int
+LoadFilePairWithFlags(
+    const char  *first_path,
+    uint8_t     **first_data,
+    uint32_t    *first_size,
+    const char  *second_path,
+    uint8_t     **second_data,
+    uint32_t    *second_size,
+    UINT32      flags
+) {
+    CHAR16 FirstWide[256];
+    CHAR16 SecondWide[256];
+    FILE_LOAD_REQUEST Requests[2];
+
+    if (first_path == NULL || first_data == NULL || first_size == NULL ||
+        second_path == NULL || second_data == NULL || second_size == NULL) {
+        return -1;
+    }
+    if (EFI_ERROR(AsciiStrToUnicodeStrS(first_path, FirstWide, ARRAY_SIZE(FirstWide))) ||
+        EFI_ERROR(AsciiStrToUnicodeStrS(second_path, SecondWide, ARRAY_SIZE(SecondWide)))) {
+        return -1;
+    }
+
+    ZeroMem(Requests, sizeof(Requests));
+    Requests[0].FileName = FirstWide;
+    Requests[0].Flags = flags;
+    Requests[1].FileName = SecondWide;
+    Requests[1].Flags = flags;
+    LoadBootFiles(Requests, 2);
+
+    if (EFI_ERROR(Requests[0].Status)) {
+        FreeLoadedFile(&Requests[1].File);
+        return -1;
+    }
+
+    *first_data = (uint8_t *)Requests[0].File.Buffer;
+    *first_size = (uint32_t)Requests[0].File.Size;
+    if (EFI_ERROR(Requests[1].Status)) {
+        *second_data = NULL;
+        *second_size = 0;
+        return -2;
+    }
+
+    *second_data = (uint8_t *)Requests[1].File.Buffer;
+    *second_size = (uint32_t)Requests[1].File.Size;
+    return 0;
+}
+
+/**
+  C-string convenience wrapper used by the protocol loaders in boot/Arch32.
+  Returns 0 on success, -1 on failure.
+**/
+int
+load_file(
+    const char  *path,
+    uint8_t     **data,
+    uint32_t    *size
+) {
+    return LoadFileWithFlags(path, FILE_LOAD_POOL, data, size);
+}
+
+/**
+  Loads two files (typically kernel and initrd) with overlapped I/O.
+  Returns 0 on success, -1 if the first file failed, -2 if only the second
+  file failed (the first is still returned).
+**/
+int
+load_file_pair(
+    const char  *first_path,
+    uint8_t     **first_data,
+    uint32_t    *first_size,
+    const char  *second_path,
+    uint8_t     **second_data,
+    uint32_t    *second_size
+) {
+    return LoadFilePairWithFlags(first_path, first_data, first_size,
+                                 second_path, second_data, second_size, FILE_LOAD_POOL);
+}
+
+/**
+  load_file for kernel and initrd images: gzip, lz4 and zstd files are
+  returned decompressed, anything else as stored.
+**/
+int
+load_image_file(
+    const char  *path,
+    uint8_t     **data,
+    uint32_t    *size
+) {
+    return LoadFileWithFlags(path, FILE_LOAD_DECOMPRESS, data, size);
+}
+
+/**
+  load_file_pair with both images decompressed as by load_image_file.
+**/
+int
+load_image_file_pair(
+    const char  *first_path,
+    uint8_t     **first_data,
+    uint32_t    *first_size,
+    const char  *second_path,
+    uint8_t     **second_data,
+    uint32_t    *second_size
+) {
+    return LoadFilePairWithFlags(first_path, first_data, first_size,
+                                 second_path, second_data, second_size, FILE_LOAD_DECOMPRESS);
+}
+
+// C callback behind the FILE_LOAD_CHUNK_CALLBACK read_file_into streams through
+typedef struct {
+    void    (*Chunk)(void *context, const uint8_t *data, uint32_t len);
+    void    *Context;
+} FILE_CHUNK_ADAPTER;
+
+STATIC
+EFI_STATUS
+ForwardFileChunk(
+    IN VOID         *Context,
+    IN CONST VOID   *Data,
+    IN UINTN        Length
+) {
+    FILE_CHUNK_ADAPTER *Adapter = (FILE_CHUNK_ADAPTER *)Context;
+    Adapter->Chunk(Adapter->Context, (const uint8_t *)Data, (uint32_t)Length);
+    return EFI_SUCCESS;
+}
+
+/**
+  Size of a file on the boot volume. Returns 0 on success, -1 if it is
+  missing or larger than 4 GiB.
+**/
+int
+get_file_size(
+    const char  *path,
+    uint32_t    *size
+) {
+    CHAR16 WidePath[256];
+    UINT64 FileSize = 0;
+    EFI_TIME ModificationTime;
+
+    if (path == NULL || size == NULL ||
+        EFI_ERROR(AsciiStrToUnicodeStrS(path, WidePath, ARRAY_SIZE(WidePath))) ||
+        EFI_ERROR(GetBootFileInfo(WidePath, &FileSize, &ModificationTime)) ||
+        FileSize > 0xFFFFFFFFu) {
+        return -1;
+    }
+    *size = (uint32_t)FileSize;
+    return 0;
+}
+
+/**
+  Reads a file of exactly `size` bytes into a buffer the caller owns,
+  passing each chunk to `chunk` (if given) as it lands, e.g. to hash it.
+  Returns 0 on success, -1 if the file is missing, another size or
+  unreadable.
+**/
+int
+read_file_into(
+    const char  *path,
+    uint8_t     *buffer,
+    uint32_t    size,
+    void        (*chunk)(void *context, const uint8_t *data, uint32_t len),
+    void        *context
+) {
+    CHAR16 WidePath[256];
+    EFI_FILE_PROTOCOL *RootFs = NULL;
+    EFI_FILE_PROTOCOL *FileHandle = NULL;
+    FILE_CHUNK_ADAPTER Adapter = { chunk, context };
+    UINTN DataSize = 0;
+    UINTN Length = 0;
+    EFI_STATUS Status;
+
+    if (path == NULL || buffer == NULL ||
+        EFI_ERROR(AsciiStrToUnicodeStrS(path, WidePath, ARRAY_SIZE(WidePath))) ||
+        EFI_ERROR(GetRootFileSystem(&RootFs)) ||
+        EFI_ERROR(OpenBootFile(RootFs, WidePath, &FileHandle, &DataSize, NULL))) {
+        return -1;
+    }
+    Status = EFI_BAD_BUFFER_SIZE;
+    if (DataSize == size) {
+        LoadProgressBegin(WidePath, DataSize);
+        Status = StreamFileData(FileHandle, buffer, 0, DataSize,
+                                chunk != NULL ? ForwardFileChunk : NULL, &Adapter, &Length);
+        LoadProgressEnd();
+    }
+    FileHandle->Close(FileHandle);
+    return (!EFI_ERROR(Status) && Length == size) ? 0 : -1;
+}
+
+/**
+  Reads whole files straight to the destinations the loader placed for
+  them, up to FILE_LOAD_MAX_CONCURRENT at a time through LoadBootFiles so
+  their reads overlap. Each entry's status is set to 0 or -1; returns the
+  number that failed.
+**/
+uint32_t
+read_files_into(
+    loadseg_read_t  *reads,
+    uint32_t        count
+) {
+    CHAR16 WidePaths[FILE_LOAD_MAX_CONCURRENT][256];
+    FILE_LOAD_REQUEST Requests[FILE_LOAD_MAX_CONCURRENT];
+    uint32_t Failed = 0;
+
+    for (uint32_t Base = 0; Base < count; Base += FILE_LOAD_MAX_CONCURRENT) {
+        UINTN Batch = MIN(count - Base, FILE_LOAD_MAX_CONCURRENT);
+        UINTN Queued = 0;
+        UINTN Index[FILE_LOAD_MAX_CONCURRENT];
+
+        ZeroMem(Requests, sizeof(Requests));
+        for (UINTN i = 0; i < Batch; i++) {
+            loadseg_read_t *Read = &reads[Base + i];
+            Read->status = -1;
+            if (Read->path == NULL ||
+                EFI_ERROR(AsciiStrToUnicodeStrS(Read->path, WidePaths[Queued], ARRAY_SIZE(WidePaths[Queued])))) {
+                continue;
+            }
+            Requests[Queued].FileName = WidePaths[Queued];
+            Requests[Queued].Flags = FILE_LOAD_POOL;
+            Requests[Queued].Destination = (VOID *)(UINTN)Read->dest;
+            Requests[Queued].Capacity = Read->size;
+            Index[Queued++] = Base + i;
+        }
+        if (Queued > 0) {
+            LoadBootFiles(Requests, Queued);
+        }
+        for (UINTN i = 0; i < Queued; i++) {
+            if (!EFI_ERROR(Requests[i].Status)) {
+                reads[Index[i]].status = 0;
+            }
+        }
+        for (UINTN i = 0; i < Batch; i++) {
+            if (reads[Base + i].status != 0) {
+                Failed++;
+            }
+        }
+    }
+    return Failed;
+}
+
+/**
+  Reads `length` bytes at `offset` of a file straight into `dest`, for the
+  loaders that place kernel segments at their final addresses. Returns 0
+  on success, -1 if the file is missing, shorter or unreadable.
+**/
+int
+read_file_range(
+    const char  *path,
+    uint32_t    offset,
+    uint8_t     *dest,
+    uint32_t    length
+) {
+    CHAR16 WidePath[256];
+    EFI_FILE_PROTOCOL *RootFs = NULL;
+    EFI_FILE_PROTOCOL *FileHandle = NULL;
+    UINTN DataSize = 0;
+    UINTN Length = 0;
+    EFI_STATUS Status;
+
+    if (path == NULL || dest == NULL ||
+        EFI_ERROR(AsciiStrToUnicodeStrS(path, WidePath, ARRAY_SIZE(WidePath))) ||
+        EFI_ERROR(GetRootFileSystem(&RootFs)) ||
+        EFI_ERROR(OpenBootFile(RootFs, WidePath, &FileHandle, &DataSize, NULL))) {
+        return -1;
+    }
+    Status = EFI_END_OF_FILE;
+    if ((UINT64)offset + length <= DataSize) {
+        Status = FileHandle->SetPosition(FileHandle, offset);
+    }
+    if (!EFI_ERROR(Status)) {
+        Status = StreamFileData(FileHandle, dest, 0, length, NULL, NULL, &Length);
+    }
+    FileHandle->Close(FileHandle);
+    return (!EFI_ERROR(Status) && Length == length) ? 0 : -1;
+}
+
+/**
+  Creates or replaces a file on the boot volume, creating its directory
+  (one level) if it does not exist yet. Returns 0 on success, -1 on error.
+**/
+int
+save_file(
+    const char  *path,
+    const void  *data,
+    uint32_t    size
+) {
+    CHAR16 WidePath[256];
+    EFI_FILE_PROTOCOL *RootFs = NULL;
+    EFI_FILE_PROTOCOL *Directory = NULL;
+    UINTN Separator = 0;
+
+    if (path == NULL || EFI_ERROR(AsciiStrToUnicodeStrS(path, WidePath, ARRAY_SIZE(WidePath))) ||
+        EFI_ERROR(GetRootFileSystem(&RootFs))) {
+        return -1;
+    }
+    for (UINTN i = 0; WidePath[i] != 0; i++) {
+        if (WidePath[i] == L'\\' || WidePath[i] == L'/') {
+            Separator = i;
+        }
+    }
+    if (Separator > 0) {
+        CHAR16 Saved = WidePath[Separator];
+        WidePath[Separator] = 0;
+        if (!EFI_ERROR(RootFs->Open(RootFs, &Directory, WidePath,
+                                    EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE,
+                                    EFI_FILE_DIRECTORY))) {
+            Directory->Close(Directory);
+        }
+        WidePath[Separator] = Saved;
+    }
+    return EFI_ERROR(WriteBootFile(WidePath, data, size)) ? -1 : 0;
+}
@@ -0,0 +1,510 @@
+/*
+ * uefi.h
+ *
+ * This file is part of BloodHorn and is licensed under the BSD License.
+ * See the root of the repository for license details.
+ */
+
+#ifndef _UEFI_H_
+#define _UEFI_H_
+
+#include <Uefi.h>
+#include <stdint.h>
+#include "compat.h"
+#include <Protocol/SimpleFileSystem.h>
+#include "../boot/Arch32/fwinfo.h"
+
+// Load flags for LoadBootFile
+#define FILE_LOAD_POOL          0x00000000  // AllocatePool buffer, release with FreeLoadedFile or FreePool
+#define FILE_LOAD_PAGES         0x00000001  // Page-aligned AllocatePages buffer that can be handed to a kernel as-is
+#define FILE_LOAD_TEXT          0x00000002  // Append a NUL terminator after the file data
+#define FILE_LOAD_DECOMPRESS    0x00000004  // Return gzip, lz4 and zstd images decompressed (chunk hooks see the file as stored)
+#define FILE_LOAD_LOANED        0x00000008  // Set by LoadBootFiles on files read into a request's Destination; FreeLoadedFile only forgets them
+
+// Read granularity used by LoadBootFile when streaming a file in
+#define FILE_LOAD_CHUNK_SIZE    (2 * 1024 * 1024)
+
+// Called once per chunk as it lands in the destination buffer; an error
+// return stops the load and becomes its result
+typedef EFI_STATUS (*FILE_LOAD_CHUNK_CALLBACK)(
+    IN VOID         *Context,
+    IN CONST VOID   *Data,
+    IN UINTN        Length
+);
+
+// Maximum number of files LoadBootFiles keeps in flight at once
+#define FILE_LOAD_MAX_CONCURRENT 8
+
+// A file loaded (or loaned) by LoadBootFile
+typedef struct {
+    VOID    *Buffer;    // File contents
+    UINTN   Size;       // Number of valid data bytes in Buffer
+    UINTN   Pages;      // Pages backing Buffer when loaded with FILE_LOAD_PAGES, 0 otherwise
+    UINT32  Flags;      // FILE_LOAD_* flags used for the load
+} LOADED_FILE;
+
+// Called once a file is fully loaded; an error return fails the request
+typedef EFI_STATUS (*FILE_LOAD_COMPLETE_CALLBACK)(
+    IN VOID         *Context,
+    IN LOADED_FILE  *File
+);
+
+// One entry of a LoadBootFiles batch
+typedef struct {
+    CONST CHAR16                    *FileName;  // in:  file to load
+    UINT32                          Flags;      // in:  FILE_LOAD_* flags
+    FILE_LOAD_CHUNK_CALLBACK        Callback;   // in:  optional per-chunk hook (e.g. hashing)
+    FILE_LOAD_COMPLETE_CALLBACK     Complete;   // in:  optional hook run as soon as this file is in (and decompressed)
+    VOID                            *Context;   // in:  passed to both hooks
+    VOID                            *Destination; // in: optional caller buffer read into instead of allocating (never decompressed)
+    UINTN                           Capacity;   // in:  size of Destination, which the file must fill exactly
+    LOADED_FILE                     File;       // out: loaded data
+    EFI_STATUS                      Status;     // out: per-file result
+} FILE_LOAD_REQUEST;
+
+// Get the root directory of the boot volume. The handle is opened once
+// and cached; callers must not Close it.
+EFI_STATUS
+GetRootFileSystem(
+    OUT EFI_FILE_PROTOCOL **RootFs
+);
+
+// Close the cached root directory handle (e.g. before chainloading)
+VOID
+ReleaseRootFileSystem(VOID);
+
+// Allocate File->Buffer for DataSize bytes as LoadBootFile does for Flags
+// (pages, or pool with room for the FILE_LOAD_TEXT terminator), so that
+// FreeLoadedFile releases buffers filled by other loaders too
+EFI_STATUS
+AllocateFileBuffer(
+    IN  UINT32          Flags,
+    IN  UINTN           DataSize,
+    OUT LOADED_FILE     *File
+);
+
+// Load a file from the boot volume in a single streamed pass. An http://
+// or https:// name is downloaded with LoadHttpFile instead, and a name
+// under NVMETCP_MOUNT_PATH is read from the NVMe/TCP disk.
+EFI_STATUS
+LoadBootFile(
+    IN  CONST CHAR16                *FileName,
+    IN  UINT32                      Flags,
+    IN  FILE_LOAD_CHUNK_CALLBACK    Callback OPTIONAL,
+    IN  VOID                        *Context OPTIONAL,
+    OUT LOADED_FILE                 *File
+);
+
+// Load only [Offset, Offset + Length) of a file (not decompressed)
+EFI_STATUS
+LoadBootFileRange(
+    IN  CONST CHAR16                *FileName,
+    IN  UINT64                      Offset,
+    IN  UINTN                       Length,
+    IN  UINT32                      Flags,
+    IN  FILE_LOAD_CHUNK_CALLBACK    Callback OPTIONAL,
+    IN  VOID                        *Context OPTIONAL,
+    OUT LOADED_FILE                 *File
+);
+
+// Size and modification time of a file, without reading it
+EFI_STATUS
+GetBootFileInfo(
+    IN  CONST CHAR16    *FileName,
+    OUT UINT64          *FileSize,
+    OUT EFI_TIME        *ModificationTime
+);
+
+// Load several files with overlapped EFI_FILE_PROTOCOL.ReadEx I/O when the
+// volume supports revision 2, synchronously otherwise
+EFI_STATUS
+LoadBootFiles(
+    IN OUT FILE_LOAD_REQUEST   *Requests,
+    IN     UINTN               Count
+);
+
+// A file handed chunk by chunk to a callback in the background (ReadEx
+// completions chain the reads), e.g. to hash an image the firmware loads
+typedef struct FILE_STREAM FILE_STREAM;
+
+// Start streaming a file from the volume on DeviceHandle
+EFI_STATUS
+StartFileStream(
+    IN  EFI_HANDLE                  DeviceHandle,
+    IN  CONST CHAR16                *FileName,
+    IN  FILE_LOAD_CHUNK_CALLBACK    Callback,
+    IN  VOID                        *Context OPTIONAL,
+    OUT FILE_STREAM                 **Stream
+);
+
+// Wait for the rest of the file (Drain) or stop after the read in flight,
+// then free the stream; EFI_SUCCESS only if every byte was delivered
+EFI_STATUS
+FinishFileStream(
+    IN FILE_STREAM     *Stream,
+    IN BOOLEAN         Drain
+);
+
+// How long ConfigureNicChild waits for DHCP to give the NIC an address
+#define NIC_MAPPING_TIMEOUT_MS  10000
+
+// One protocol's Configure(This, ConfigData), for ConfigureNicChild
+typedef EFI_STATUS (*NIC_CHILD_CONFIGURE)(
+    IN VOID *Child,
+    IN VOID *Config
+);
+
+// Configure a network child (HTTP, TCP4, IP4...) of Nic. While the NIC has
+// no address (EFI_NO_MAPPING) it is put on DHCP and Configure is retried
+// every 100 ms, up to NIC_MAPPING_TIMEOUT_MS
+EFI_STATUS
+ConfigureNicChild(
+    IN EFI_HANDLE           Nic,
+    IN NIC_CHILD_CONFIGURE  Configure,
+    IN VOID                 *Child,
+    IN VOID                 *Config
+);
+
+// TRUE for names LoadBootFile downloads rather than reads from the volume
+BOOLEAN
+IsHttpUrl(
+    IN CONST CHAR16 *Name
+);
+
+// Download a file over HTTP(S) as parallel byte ranges on keep-alive
+// connections, resuming ranges whose connection drops; Callback sees the
+// data in order as the completed prefix grows
+EFI_STATUS
+LoadHttpFile(
+    IN  CONST CHAR16                *Url,
+    IN  UINT32                      Flags,
+    IN  FILE_LOAD_CHUNK_CALLBACK    Callback OPTIONAL,
+    IN  VOID                        *Context OPTIONAL,
+    OUT LOADED_FILE                 *File
+);
+
+// Volumes of the NVMe/TCP disk are mounted at "/net", "/net1", ...
+#define NVMETCP_MOUNT_PATH      "/net"
+
+// Connect to an NVMe/TCP target given as "a.b.c.d[:port]/subsystem-nqn"
+// and present its first active namespace as a block device. Reads are
+// split over several TCP connections with many commands in flight on each
+struct block_device;
+EFI_STATUS
+AttachNvmeTcpDisk(
+    IN  CONST CHAR8             *Target,
+    OUT struct block_device     **Device
+);
+
+// TRUE for names LoadBootFile reads from a volume of the NVMe/TCP disk
+BOOLEAN
+IsRemoteDiskPath(
+    IN CONST CHAR16 *Name
+);
+
+// RttUs entry of a host IcmpEchoSweep heard nothing from
+#define ICMP_NO_REPLY   MAX_UINT32
+
+// Send one ICMP echo request to each of Targets (IPv4, network order)
+// through the firmware IP4 stack, many in flight at once, and wait until
+// every host answered or TimeoutMs passed since the last request went
+// out. Requests carry sequence numbers Sequence, Sequence + 1, ...
+EFI_STATUS
+IcmpEchoSweep(
+    IN  CONST UINT32    *Targets,
+    IN  UINTN           Count,
+    IN  UINT16          Sequence,
+    IN  UINT32          TimeoutMs,
+    OUT UINT32          *RttUs
+);
+
+// Release memory returned by LoadBootFile
+VOID
+FreeLoadedFile(
+    IN OUT LOADED_FILE *File
+);
+
+// Read a whole file into a pool buffer (thin wrapper over LoadBootFile)
+EFI_STATUS
+ReadFile(
+    IN  CHAR16  *FileName,
+    OUT VOID    **Buffer,
+    OUT UINTN   *FileSize
+);
+
+// Open a new, empty file on the boot volume for writing, replacing any
+// previous copy; for output too large to build in one buffer
+EFI_STATUS
+CreateBootFile(
+    IN  CONST CHAR16        *FileName,
+    OUT EFI_FILE_PROTOCOL   **Handle
+);
+
+// Create or replace a file on the boot volume
+EFI_STATUS
+WriteBootFile(
+    IN CONST CHAR16   *FileName,
+    IN CONST VOID     *Buffer,
+    IN UINTN          Size
+);
+
+// Put the whole disk holding the boot volume behind the filesystem block
+// cache (read_sector, disk_read, fs_read_sectors)
+EFI_STATUS
+AttachBootBlockDevice(VOID);
+
+// Block device for the whole disk under a partition or disk handle. Disks
+// are opened once and shared; the boot disk returns the attached device.
+struct block_device;
+EFI_STATUS
+GetDiskBlockDevice(
+    IN  EFI_HANDLE              Handle,
+    OUT struct block_device     **Device
+);
+
+// Disk in slot Index of the open-disk table (0 = boot disk), for tools
+// that enumerate them: EFI_NOT_FOUND for an empty slot, and
+// EFI_INVALID_PARAMETER past the end of the table
+EFI_STATUS
+GetOpenBlockDevice(
+    IN  UINTN                   Index,
+    OUT struct block_device     **Device
+);
+
+// Find every partition on every disk, identify its filesystem (batched
+// superblock reads, with results cached in an NV variable across boots)
+// and mount it: the boot volume at "/", the others at "/volN"
+EFI_STATUS
+ProbeFileSystems(VOID);
+
+// Probe the partitions of one disk attached after ProbeFileSystems (or
+// the whole disk if it has none) and mount those with a filesystem at
+// Prefix, then Prefix1, Prefix2, ...; nothing is cached across boots
+EFI_STATUS
+MountDiskVolumes(
+    IN struct block_device  *Device,
+    IN CONST CHAR8          *Prefix
+);
+
+// Register (TRUE) or withdraw (FALSE, before ExitBootServices) the
+// EFI_RNG_PROTOCOL as a seed source for the crypto RNG
+VOID
+InstallEntropySource(
+    IN BOOLEAN Enable
+);
+
+// Start (TRUE) or stop (FALSE) the timer that advances deferred PCR
+// extends in the background while files load
+VOID
+InstallTpmPoller(
+    IN BOOLEAN Enable
+);
+
+// Image base and [Start, End) of the loader's code sections
+EFI_STATUS
+GetLoaderCodeRange(
+    OUT UINTN *ImageBase OPTIONAL,
+    OUT UINTN *Start,
+    OUT UINTN *End
+);
+
+// Sampling profiler (profile.c): a periodic timer notification counts
+// where the loader was interrupted into a histogram over its code
+EFI_STATUS
+InstallBootProfiler(
+    IN BOOLEAN Enable
+);
+
+BOOLEAN
+BootProfilerRunning(VOID);
+
+VOID
+BootProfilerReset(VOID);
+
+// Print the Top hottest spots as image offsets
+VOID
+BootProfilerPrint(
+    IN UINTN Top
+);
+
+// Save the whole histogram as "offset count" lines
+EFI_STATUS
+BootProfilerSave(
+    IN CONST CHAR16 *FileName
+);
+
+// Allocation profiler (allocprof.c): pool and page allocations counted
+// per loader call site through hooks in the boot services table, which
+// must come out (FALSE) before the image exits or ExitBootServices
+EFI_STATUS
+InstallAllocProfiler(
+    IN BOOLEAN Enable
+);
+
+BOOLEAN
+AllocProfilerRunning(VOID);
+
+// Highest pool and page bytes held at once while the profiler ran; 0 if
+// it never did
+UINT64
+AllocProfilerPeak(VOID);
+
+// Pool and page bytes held right now, as far as the profiler has seen
+UINT64
+AllocProfilerLive(VOID);
+
+// Print the Top sites by what they held at the footprint peak
+VOID
+AllocProfilerPrint(
+    IN UINTN Top
+);
+
+// Save every site as "offset calls bytes at-peak peak live" lines
+EFI_STATUS
+AllocProfilerSave(
+    IN CONST CHAR16 *FileName
+);
+
+// Load progress (progress.c): LoadBootFile, LoadBootFiles, LoadHttpFile
+// and PXE downloads count bytes as they land, and the hook, if one is
+// set, is shown loads that run past a quarter of a second, ~10 times a
+// second. It runs inside the loader's read loop and must be quick.
+#define LOAD_PROGRESS_NAME_MAX  64
+
+typedef struct {
+    CONST CHAR16    *Name;              // File or URL being loaded (possibly truncated)
+    UINT64          Done;               // Bytes in so far
+    UINT64          Total;              // Expected size, 0 while unknown
+    UINT64          ElapsedUs;          // Since the load began
+    UINT64          BytesPerSecond;     // Average since the load began
+    UINT64          EtaSeconds;         // Time left at that rate, 0 when the size is unknown
+    BOOLEAN         Finished;           // Last call for this load
+} LOAD_PROGRESS;
+
+typedef VOID (*LOAD_PROGRESS_HOOK)(
+    IN CONST LOAD_PROGRESS *Progress
+);
+
+VOID
+SetLoadProgressHook(
+    IN LOAD_PROGRESS_HOOK Hook OPTIONAL
+);
+
+VOID
+LoadProgressBegin(
+    IN CONST CHAR16 *Name,
+    IN UINT64       Total
+);
+
+VOID
+LoadProgressTotal(
+    IN UINT64 Total
+);
+
+VOID
+LoadProgressAdd(
+    IN UINT64 Bytes
+);
+
+VOID
+LoadProgressEnd(VOID);
+
+// C wrappers for the network loaders
+void load_progress_begin(const char* name, uint64_t total);
+void load_progress_total(uint64_t total);
+void load_progress_add(uint64_t bytes);
+void load_progress_end(void);
+
+// AP start-up for libb's task pool (mpfill.c): Worker runs on every AP
+// without the caller waiting; MpTaskApsIdle is TRUE once all returned
+UINT32
+MpTaskApCount(VOID);
+
+UINT32
+MpTaskStartAps(
+    IN VOID (*Worker)(VOID *Context),
+    IN VOID *Context
+);
+
+BOOLEAN
+MpTaskApsIdle(VOID);
+
+// C-string wrappers used by the protocol loaders (0 on success)
+int load_file(const char* path, uint8_t** data, uint32_t* size);
+int load_file_pair(const char* first_path, uint8_t** first_data, uint32_t* first_size,
+                   const char* second_path, uint8_t** second_data, uint32_t* second_size);
+
+// As above, but gzip, lz4 and zstd images come back decompressed
+int load_image_file(const char* path, uint8_t** data, uint32_t* size);
+int load_image_file_pair(const char* first_path, uint8_t** first_data, uint32_t* first_size,
+                         const char* second_path, uint8_t** second_data, uint32_t* second_size);
+
+// Plain file access for the network image cache (0 on success): the size
+// of a file, a read into a caller's buffer with a per-chunk hook, and a
+// write that creates the file's directory if needed
+int get_file_size(const char* path, uint32_t* size);
+int read_file_into(const char* path, uint8_t* buffer, uint32_t size,
+                   void (*chunk)(void* context, const uint8_t* data, uint32_t len), void* context);
+int save_file(const char* path, const void* data, uint32_t size);
+
+// In-place loading (0 on success): a file range read straight to its
+// destination
+int read_file_range(const char* path, uint32_t offset, uint8_t* dest, uint32_t length);
+
+// Placement engine (memplace.c): free conventional memory from one memory
+// map snapshot, indexed for O(log n) fits. Placements are claimed with
+// AllocatePages(AllocateAddress) as EfiLoaderData.
+#define MEM_PLACE_TOP_DOWN      0x00000001  // Highest fit below Max (initrds, boot data)
+#define MEM_PLACE_RELOCATABLE   0x00000002  // May go anywhere it fits; random when randomization is on
+
+EFI_STATUS
+MemPlaceSnapshot(VOID);
+
+VOID
+MemPlaceSetRandomize(
+    IN BOOLEAN Enable
+);
+
+EFI_STATUS
+MemPlaceAllocate(
+    IN  UINT64                  Size,
+    IN  UINT64                  Align,
+    IN  UINT64                  Min,
+    IN  UINT64                  Max,
+    IN  UINT32                  Flags,
+    OUT EFI_PHYSICAL_ADDRESS    *Address
+);
+
+EFI_STATUS
+MemPlaceReserve(
+    IN EFI_PHYSICAL_ADDRESS Address,
+    IN UINT64               Size
+);
+
+// Final memory map and ExitBootServices (fwinfo.c): a stale map key is
+// retried with the snapshot buffer fwinfo_memory_map_to sized, and the
+// map that got us out is converted into Table with Put
+EFI_STATUS
+ExitBootServicesWithMemoryMap(
+    IN  VOID                *Table OPTIONAL,
+    IN  UINT32              Max,
+    IN  fwinfo_mmap_put_t   Put OPTIONAL,
+    OUT UINT32              *Count OPTIONAL
+);
+
+// Linux through its own EFI stub (linuxefi.c): the bzImage is loaded as a
+// PE image and the initrd offered on the LINUX_EFI_INITRD_MEDIA_GUID
+// LoadFile2 path. Returns only if the kernel did not take over.
+EFI_STATUS
+BootLinuxEfiStub(
+    IN CONST CHAR16 *KernelPath,
+    IN CONST CHAR16 *InitrdPath OPTIONAL,
+    IN CONST CHAR16 *CommandLine OPTIONAL
+);
+
+// C wrappers for the protocol loaders (0 on success); flags as above
+int place_memory(uint64_t size, uint64_t align, uint64_t min, uint64_t max, uint32_t flags, uint64_t* addr);
+int reserve_memory(uint64_t addr, uint64_t size);
+uint64_t memory_top(void);
+
+#endif // _UEFI_H_